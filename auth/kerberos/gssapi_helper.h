@@ -52,4 +52,8 @@ NTSTATUS gssapi_check_packet(gss_ctx_id_t gssapi_context,
 			     const uint8_t *whole_pdu, size_t pdu_length,
 			     const DATA_BLOB *sig);
 
+struct loadparm_context;
+NTSTATUS gssapi_replay_cache_check(struct loadparm_context *lp_ctx,
+				   const DATA_BLOB *token);
+
 #endif /* AUTH_KERBEROS_GSSAPI_HELPER_H */
@@ -0,0 +1,211 @@
+/*
+   Unix SMB/CIFS implementation.
+   Replay cache for GSSAPI acceptors, shared by all server processes
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * The krb5 libraries either have no replay cache in the acceptor, or
+ * one in a file, usually private to the process and synced on every
+ * AP-REQ. This one lives in a mutex tdb in the lock directory, so a
+ * replay is detected across all smbd and samba processes at the cost
+ * of a hash and a store into shared memory.
+ *
+ * The key is the SHA-256 of the initial context token, which carries
+ * the AP-REQ. An authenticator is only accepted within the allowed
+ * clock skew of its timestamp, so an entry can be dropped once twice
+ * that time has passed since it was seen. The data is the expiry time.
+ *
+ * The skew is "gensec_gssapi:clock skew" and has to be kept at least
+ * as large as the clockskew the krb5 library is configured with.
+ */
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "system/gssapi.h"
+#include "lib/tdb_wrap/tdb_wrap.h"
+#include "lib/util/util_tdb.h"
+#include "param/param.h"
+#include "auth/kerberos/gssapi_helper.h"
+
+#include "lib/crypto/gnutls_helpers.h"
+#include <gnutls/crypto.h>
+
+#undef DBGC_CLASS
+#define DBGC_CLASS DBGC_AUTH
+
+/* the default clock skew of both Heimdal and MIT */
+#define GSSAPI_REPLAY_CACHE_DEFAULT_SKEW 300
+
+/* purge the expired entries after this many stores in a process */
+#define GSSAPI_REPLAY_CACHE_PURGE_INTERVAL 1024
+
+#define GSSAPI_REPLAY_CACHE_HITS_KEY "HITS"
+
+static struct tdb_wrap *gssapi_replay_cache_db(struct loadparm_context *lp_ctx)
+{
+	static struct tdb_wrap *db;
+	char *db_path = NULL;
+	int tdb_flags = TDB_INCOMPATIBLE_HASH | TDB_CLEAR_IF_FIRST |
+		TDB_MUTEX_LOCKING;
+
+	if (db != NULL) {
+		return db;
+	}
+
+	db_path = lpcfg_lock_path(NULL, lp_ctx, "gssapi_replay_cache.tdb");
+	if (db_path == NULL) {
+		return NULL;
+	}
+
+	db = tdb_wrap_open(NULL, db_path, 0,
+			   lpcfg_tdb_flags(lp_ctx, tdb_flags),
+			   O_CREAT | O_RDWR, 0600);
+	if (db == NULL) {
+		DBG_ERR("Failed to open %s: %s\n", db_path, strerror(errno));
+	}
+
+	TALLOC_FREE(db_path);
+	return db;
+}
+
+static int gssapi_replay_cache_purge_fn(struct tdb_context *tdb,
+					TDB_DATA key,
+					TDB_DATA data,
+					void *private_data)
+{
+	time_t now = *(time_t *)private_data;
+
+	if (key.dsize != 32 || data.dsize != 8) {
+		return 0;
+	}
+	if ((time_t)BVAL(data.dptr, 0) <= now) {
+		tdb_delete(tdb, key);
+	}
+	return 0;
+}
+
+static uint64_t gssapi_replay_cache_count_hit(struct tdb_context *tdb)
+{
+	TDB_DATA key = string_term_tdb_data(GSSAPI_REPLAY_CACHE_HITS_KEY);
+	uint8_t buf[8];
+	TDB_DATA data;
+	uint64_t hits = 0;
+	int ret;
+
+	ret = tdb_chainlock(tdb, key);
+	if (ret != 0) {
+		return 0;
+	}
+	data = tdb_fetch(tdb, key);
+	if (data.dsize == sizeof(buf)) {
+		hits = BVAL(data.dptr, 0);
+	}
+	SAFE_FREE(data.dptr);
+
+	hits += 1;
+	SBVAL(buf, 0, hits);
+	data = (TDB_DATA) { .dptr = buf, .dsize = sizeof(buf) };
+	tdb_store(tdb, key, data, TDB_REPLACE);
+	tdb_chainunlock(tdb, key);
+
+	return hits;
+}
+
+/*
+ * Check that the initial token of a GSSAPI acceptor was not seen
+ * before, and remember it. This is meant to be called once the token
+ * was accepted, so garbage is not stored.
+ *
+ * Returns NT_STATUS_LOGON_FAILURE for a replay. If the cache is not
+ * available the token is accepted, the krb5 library checks still
+ * apply.
+ */
+NTSTATUS gssapi_replay_cache_check(struct loadparm_context *lp_ctx,
+				   const DATA_BLOB *token)
+{
+	static unsigned num_stores;
+	struct tdb_wrap *db = NULL;
+	uint8_t digest[32];
+	uint8_t buf[8];
+	TDB_DATA key = { .dptr = digest, .dsize = sizeof(digest) };
+	TDB_DATA data = { .dptr = buf, .dsize = sizeof(buf) };
+	TDB_DATA old;
+	time_t now = time(NULL);
+	time_t ttl;
+	bool replay = false;
+	int rc;
+
+	ttl = 2 * lpcfg_parm_int(lp_ctx, NULL,
+				 "gensec_gssapi", "clock skew",
+				 GSSAPI_REPLAY_CACHE_DEFAULT_SKEW);
+	if (ttl <= 0) {
+		ttl = 2 * GSSAPI_REPLAY_CACHE_DEFAULT_SKEW;
+	}
+
+	db = gssapi_replay_cache_db(lp_ctx);
+	if (db == NULL) {
+		return NT_STATUS_OK;
+	}
+
+	rc = gnutls_hash_fast(GNUTLS_DIG_SHA256,
+			      token->data,
+			      token->length,
+			      digest);
+	if (rc < 0) {
+		return gnutls_error_to_ntstatus(rc,
+						NT_STATUS_HASH_NOT_SUPPORTED);
+	}
+
+	rc = tdb_chainlock(db->tdb, key);
+	if (rc != 0) {
+		DBG_WARNING("tdb_chainlock failed: %s\n",
+			    tdb_errorstr(db->tdb));
+		return NT_STATUS_OK;
+	}
+
+	old = tdb_fetch(db->tdb, key);
+	if (old.dsize == sizeof(buf) && (time_t)BVAL(old.dptr, 0) > now) {
+		replay = true;
+	}
+	SAFE_FREE(old.dptr);
+
+	if (!replay) {
+		SBVAL(buf, 0, now + ttl);
+		rc = tdb_store(db->tdb, key, data, TDB_REPLACE);
+		if (rc != 0) {
+			DBG_WARNING("tdb_store failed: %s\n",
+				    tdb_errorstr(db->tdb));
+		}
+	}
+
+	tdb_chainunlock(db->tdb, key);
+
+	if (replay) {
+		uint64_t hits = gssapi_replay_cache_count_hit(db->tdb);
+
+		DBG_WARNING("Rejecting a replayed GSSAPI token, "
+			    "%"PRIu64" replays seen\n",
+			    hits);
+		return NT_STATUS_LOGON_FAILURE;
+	}
+
+	num_stores += 1;
+	if (num_stores % GSSAPI_REPLAY_CACHE_PURGE_INTERVAL == 0) {
+		tdb_traverse(db->tdb, gssapi_replay_cache_purge_fn, &now);
+	}
+
+	return NT_STATUS_OK;
+}
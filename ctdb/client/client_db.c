@@ -20,6 +20,7 @@
 #include "replace.h"
 #include "system/network.h"
 #include "system/filesys.h"
+#include "system/time.h"
 
 #include <talloc.h>
 #include <tevent.h>
@@ -1283,6 +1284,13 @@ static int ctdb_fetch_lock_check(struct tevent_req *req)
 				       CTDB_REC_RO_HAVE_DELEGATIONS))) {
 			goto migrate;
 		}
+
+		/* Read only copy with an expired lease */
+		if (header.dmaster != state->pnn &&
+		    header.reserved1 != 0 &&
+		    time(NULL) >= (time_t)header.reserved1) {
+			goto migrate;
+		}
 	}
 
 	/* We are the dmaster or readonly delegation */
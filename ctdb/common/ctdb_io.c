@@ -38,6 +38,9 @@
 #include "common/logging.h"
 #include "common/common.h"
 
+/* maximum number of queued packets written with a single writev() */
+#define CTDB_QUEUE_IOV_MAX 64
+
 /* structures for packet queueing - see common/ctdb_io.c */
 struct ctdb_buffer {
 	uint8_t *data;
@@ -280,7 +283,24 @@ static bool queue_io_write(struct ctdb_queue *queue)
 		if (queue->ctdb->flags & CTDB_FLAG_TORTURE) {
 			n = write(queue->fd, pkt->data, 1);
 		} else {
-			n = write(queue->fd, pkt->data, pkt->length);
+			struct iovec iov[CTDB_QUEUE_IOV_MAX];
+			int niov = 0;
+
+			/*
+			 * Write as many queued packets as possible
+			 * with a single system call.
+			 */
+			while (pkt != NULL && niov < CTDB_QUEUE_IOV_MAX) {
+				iov[niov] = (struct iovec) {
+					.iov_base = pkt->data,
+					.iov_len = pkt->length,
+				};
+				niov += 1;
+				pkt = pkt->next;
+			}
+			pkt = queue->out_queue;
+
+			n = writev(queue->fd, iov, niov);
 		}
 
 		if (n == -1 && errno != EAGAIN && errno != EWOULDBLOCK) {
@@ -297,16 +317,21 @@ static bool queue_io_write(struct ctdb_queue *queue)
 			return false;
 		}
 		if (n <= 0) return true;
-		
-		if (n != pkt->length) {
-			pkt->length -= n;
-			pkt->data += n;
-			return true;
-		}
 
-		DLIST_REMOVE(queue->out_queue, pkt);
-		queue->out_queue_length--;
-		talloc_free(pkt);
+		while (n > 0) {
+			pkt = queue->out_queue;
+
+			if ((size_t)n < pkt->length) {
+				pkt->length -= n;
+				pkt->data += n;
+				return true;
+			}
+
+			n -= pkt->length;
+			DLIST_REMOVE(queue->out_queue, pkt);
+			queue->out_queue_length--;
+			talloc_free(pkt);
+		}
 	}
 
 	TEVENT_FD_NOT_WRITEABLE(queue->fde);
@@ -66,8 +66,12 @@ static bool validate_transport(const char *key,
 			       const char *new_transport,
 			       enum conf_update_mode mode)
 {
-	/* Don't allow "ib" for now.  It is broken! */
-	if (strcmp(new_transport, CLUSTER_TRANSPORT_DEFAULT) != 0) {
+	/* "ib" is only available when built with --enable-infiniband */
+	if (strcmp(new_transport, CLUSTER_TRANSPORT_DEFAULT) != 0
+#ifdef USE_INFINIBAND
+	    && strcmp(new_transport, "ib") != 0
+#endif
+	    ) {
 		D_ERR("Invalid value for [cluster] -> transport = %s\n",
 		      new_transport);
 		return false;
@@ -147,6 +151,26 @@ static bool validate_leader_timeout(const char *key,
 	return true;
 }
 
+static bool validate_node_connections(const char *key,
+				      int old_value,
+				      int new_value,
+				      enum conf_update_mode mode)
+{
+	if (new_value < 1 || new_value > 16) {
+		D_ERR("Invalid value for [cluster] -> node connections = %d\n",
+		      new_value);
+		return false;
+	}
+
+	if (mode == CONF_MODE_RELOAD && old_value != new_value) {
+		D_WARNING("Ignoring update of [%s] -> %s\n",
+			  CLUSTER_CONF_SECTION,
+			  key);
+	}
+
+	return true;
+}
+
 void cluster_conf_init(struct conf_context *conf)
 {
 	conf_define_section(conf, CLUSTER_CONF_SECTION, NULL);
@@ -186,6 +210,11 @@ void cluster_conf_init(struct conf_context *conf)
 			    CLUSTER_CONF_LEADER_CAPABILITY,
 			    true,
 			    NULL);
+	conf_define_integer(conf,
+			    CLUSTER_CONF_SECTION,
+			    CLUSTER_CONF_NODE_CONNECTIONS,
+			    1,
+			    validate_node_connections);
 }
 
 char *cluster_conf_nodes_list(TALLOC_CTX *mem_ctx, struct conf_context *conf)
@@ -33,6 +33,7 @@
 #define CLUSTER_CONF_NODES_LIST      "nodes list"
 #define CLUSTER_CONF_LEADER_TIMEOUT  "leader timeout"
 #define CLUSTER_CONF_LEADER_CAPABILITY "leader capability"
+#define CLUSTER_CONF_NODE_CONNECTIONS "node connections"
 
 void cluster_conf_init(struct conf_context *conf);
 
@@ -69,6 +69,10 @@ static void setup_config_pointers(struct conf_context *conf)
 				    CLUSTER_CONF_SECTION,
 				    CLUSTER_CONF_LEADER_CAPABILITY,
 				    &ctdb_config.leader_capability);
+	conf_assign_integer_pointer(conf,
+				    CLUSTER_CONF_SECTION,
+				    CLUSTER_CONF_NODE_CONNECTIONS,
+				    &ctdb_config.node_connections);
 
 	/*
 	 * Database
@@ -94,6 +98,22 @@ static void setup_config_pointers(struct conf_context *conf)
 				    DATABASE_CONF_SECTION,
 				    DATABASE_CONF_TDB_MUTEXES,
 				    &ctdb_config.tdb_mutexes);
+	conf_assign_integer_pointer(conf,
+				    DATABASE_CONF_SECTION,
+				    DATABASE_CONF_LOCK_THREADS,
+				    &ctdb_config.lock_threads);
+	conf_assign_integer_pointer(conf,
+				    DATABASE_CONF_SECTION,
+				    DATABASE_CONF_RO_LEASE_TIME,
+				    &ctdb_config.ro_lease_time);
+	conf_assign_integer_pointer(conf,
+				    DATABASE_CONF_SECTION,
+				    DATABASE_CONF_RECOVERY_PARALLELISM,
+				    &ctdb_config.recovery_parallelism);
+	conf_assign_boolean_pointer(conf,
+				    DATABASE_CONF_SECTION,
+				    DATABASE_CONF_VACUUM_DIRTY_CHAINS,
+				    &ctdb_config.vacuum_dirty_chains);
 
 	/*
 	 * Event
@@ -31,6 +31,7 @@ struct ctdb_config {
 	const char *nodes_list;
 	int leader_timeout;
 	bool leader_capability;
+	int node_connections;
 
 	/* Database */
 	const char *dbdir_volatile;
@@ -38,6 +39,10 @@ struct ctdb_config {
 	const char *dbdir_state;
 	const char *lock_debug_script;
 	bool tdb_mutexes;
+	int lock_threads;
+	int ro_lease_time;
+	int recovery_parallelism;
+	bool vacuum_dirty_chains;
 
 	/* Event */
 	const char *event_debug_script;
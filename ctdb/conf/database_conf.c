@@ -70,6 +70,30 @@ static bool check_static_boolean_change(const char *key,
 	return true;
 }
 
+static bool database_conf_validate_static_count(const char *key,
+						int old_value,
+						int new_value,
+						enum conf_update_mode mode)
+{
+	if (new_value < 0) {
+		D_ERR("Invalid value for [%s] -> %s = %d\n",
+		      DATABASE_CONF_SECTION,
+		      key,
+		      new_value);
+		return false;
+	}
+
+	if (mode == CONF_MODE_RELOAD || mode == CONF_MODE_API) {
+		if (old_value != new_value) {
+			D_WARNING("Ignoring update of [%s] -> %s\n",
+				  DATABASE_CONF_SECTION,
+				  key);
+		}
+	}
+
+	return true;
+}
+
 static bool database_conf_validate_lock_debug_script(const char *key,
 						     const char *old_script,
 						     const char *new_script,
@@ -162,4 +186,24 @@ void database_conf_init(struct conf_context *conf)
 			    DATABASE_CONF_TDB_MUTEXES,
 			    true,
 			    check_static_boolean_change);
+	conf_define_integer(conf,
+			    DATABASE_CONF_SECTION,
+			    DATABASE_CONF_LOCK_THREADS,
+			    0,
+			    database_conf_validate_static_count);
+	conf_define_integer(conf,
+			    DATABASE_CONF_SECTION,
+			    DATABASE_CONF_RO_LEASE_TIME,
+			    0,
+			    database_conf_validate_static_count);
+	conf_define_integer(conf,
+			    DATABASE_CONF_SECTION,
+			    DATABASE_CONF_RECOVERY_PARALLELISM,
+			    0,
+			    database_conf_validate_static_count);
+	conf_define_boolean(conf,
+			    DATABASE_CONF_SECTION,
+			    DATABASE_CONF_VACUUM_DIRTY_CHAINS,
+			    false,
+			    check_static_boolean_change);
 }
@@ -29,6 +29,10 @@
 #define DATABASE_CONF_STATE_DB_DIR              "state database directory"
 #define DATABASE_CONF_LOCK_DEBUG_SCRIPT         "lock debug script"
 #define DATABASE_CONF_TDB_MUTEXES               "tdb mutexes"
+#define DATABASE_CONF_LOCK_THREADS              "lock threads"
+#define DATABASE_CONF_RO_LEASE_TIME             "read only lease time"
+#define DATABASE_CONF_RECOVERY_PARALLELISM      "recovery parallelism"
+#define DATABASE_CONF_VACUUM_DIRTY_CHAINS       "vacuum dirty chains"
 
 void database_conf_init(struct conf_context *conf);
 
@@ -83,6 +83,34 @@ void ctdb_ibw_node_connect_event(struct tevent_context *ev,
 	ctdb_ibw_node_connect(node);
 }
 
+/*
+ * Throw away the current connection to a node and reconnect in a
+ * second.  Packets queued while not connected are kept.
+ */
+int ctdb_ibw_node_reconnect(struct ctdb_node *node)
+{
+	struct ctdb_ibw_node *cn = talloc_get_type(node->transport_data,
+						   struct ctdb_ibw_node);
+	struct ibw_ctx *ictx = talloc_get_type(node->ctdb->transport_data,
+					       struct ibw_ctx);
+
+	if (cn == NULL || ictx == NULL) {
+		return -1;
+	}
+
+	talloc_free(cn->conn); /* internal queue content is destroyed */
+	cn->conn = ibw_conn_new(ictx, node);
+	if (cn->conn == NULL) {
+		return -1;
+	}
+
+	tevent_add_timer(node->ctdb->ev, cn->conn,
+			 timeval_current_ofs(1, 0),
+			 ctdb_ibw_node_connect_event, node);
+
+	return 0;
+}
+
 int ctdb_ibw_connstate_handler(struct ibw_ctx *ctx, struct ibw_conn *conn)
 {
 	if (ctx!=NULL) {
@@ -130,25 +158,18 @@ int ctdb_ibw_connstate_handler(struct ibw_ctx *ctx, struct ibw_conn *conn)
 		} break;
 		case IBWC_DISCONNECTED: { /* after ibw_disconnect */
 			struct ctdb_node *node = talloc_get_type(conn->conn_userdata, struct ctdb_node);
-			if (node!=NULL)
+			if (node!=NULL) {
+				/* restart frees conn and reconnects */
 				node->ctdb->upcalls->node_dead(node);
-			talloc_free(conn);
-			/* normal + intended disconnect => not reconnecting in this layer */
+			} else {
+				talloc_free(conn);
+			}
 		} break;
 		case IBWC_ERROR: {
 			struct ctdb_node *node = talloc_get_type(conn->conn_userdata, struct ctdb_node);
 			if (node!=NULL) {
-				struct ctdb_ibw_node *cn = talloc_get_type(
-					node->transport_data,
-					struct ctdb_ibw_node);
-				struct ibw_ctx *ictx = cn->conn->ctx;
-
 				DEBUG(DEBUG_DEBUG, ("IBWC_ERROR, reconnecting...\n"));
-				talloc_free(cn->conn); /* internal queue content is destroyed */
-				cn->conn = (void *)ibw_conn_new(ictx, node);
-				tevent_add_timer(node->ctdb->ev, node,
-						 timeval_current_ofs(1, 0),
-						 ctdb_ibw_node_connect_event, node);
+				ctdb_ibw_node_reconnect(node);
 			}
 		} break;
 		default:
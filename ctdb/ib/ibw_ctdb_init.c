@@ -65,9 +65,16 @@ static int ctdb_ibw_add_node(struct ctdb_node *node)
 {
 	struct ibw_ctx *ictx = talloc_get_type(node->ctdb->transport_data,
 					       struct ibw_ctx);
-	struct ctdb_ibw_node *cn = talloc_zero(node, struct ctdb_ibw_node);
+	struct ctdb_ibw_node *cn;
+
+	if (node->transport_data != NULL) {
+		/* already set up, e.g. on reload of the nodes list */
+		return 0;
+	}
+
+	cn = talloc_zero(node, struct ctdb_ibw_node);
+	CTDB_NO_MEMORY(node->ctdb, cn);
 
-	assert(cn!=NULL);
 	cn->conn = ibw_conn_new(ictx, node);
 	node->transport_data = (void *)cn;
 
@@ -76,17 +83,17 @@ static int ctdb_ibw_add_node(struct ctdb_node *node)
 
 /*
  * initialise infiniband
+ *
+ * ctdb_ibw_init() has already set up the ibw context and the methods
  */
 static int ctdb_ibw_initialise(struct ctdb_context *ctdb)
 {
-	int i, ret;
-
-	ret = ctdb_ibw_init(ctdb);
-	if (ret != 0) {
-		return ret;
-	}
+	unsigned int i;
 
 	for (i=0; i<ctdb->num_nodes; i++) {
+		if (ctdb->nodes[i]->flags & NODE_FLAGS_DELETED) {
+			continue;
+		}
 		if (ctdb_ibw_add_node(ctdb->nodes[i]) != 0) {
 			DEBUG(DEBUG_CRIT, ("methods->add_node failed at %d\n", i));
 			return -1;
@@ -104,16 +111,27 @@ static int ctdb_ibw_initialise(struct ctdb_context *ctdb)
 /*
  * Start infiniband
  */
-static int ctdb_ibw_start(struct ctdb_context *ctdb)
+static int ctdb_ibw_connect_node(struct ctdb_node *node)
 {
-	int i;
+	struct ctdb_context *ctdb = node->ctdb;
+
+	if (ctdb_same_address(ctdb->address, &node->address)) {
+		return 0;
+	}
 
 	/* everything async here */
+	return ctdb_ibw_node_connect(node);
+}
+
+static int ctdb_ibw_start(struct ctdb_context *ctdb)
+{
+	unsigned int i;
+
 	for (i=0;i<ctdb->num_nodes;i++) {
-		struct ctdb_node *node = ctdb->nodes[i];
-		if (!ctdb_same_address(ctdb->address, &node->address)) {
-			ctdb_ibw_node_connect(node);
+		if (ctdb->nodes[i]->flags & NODE_FLAGS_DELETED) {
+			continue;
 		}
+		ctdb_ibw_connect_node(ctdb->nodes[i]);
 	}
 
 	return 0;
@@ -190,8 +208,29 @@ static int ctdb_ibw_queue_pkt(struct ctdb_node *node, uint8_t *data, uint32_t le
 
 static void ctdb_ibw_restart(struct ctdb_node *node)
 {
-	/* TODO: implement this method for IB */
-	DEBUG(DEBUG_ALERT,("WARNING: method restart is not yet implemented for IB\n"));
+	DEBUG(DEBUG_NOTICE,
+	      ("Tearing down connection to dead node :%d\n", node->pnn));
+
+	if (ctdb_ibw_node_reconnect(node) != 0) {
+		DEBUG(DEBUG_ERR,
+		      ("Failed to reconnect to node %d\n", node->pnn));
+	}
+}
+
+static void ctdb_ibw_shutdown(struct ctdb_context *ctdb)
+{
+	struct ibw_ctx *ictx = talloc_get_type(ctdb->transport_data,
+					       struct ibw_ctx);
+	uint32_t i;
+
+	for (i=0; i<ctdb->num_nodes; i++) {
+		TALLOC_FREE(ctdb->nodes[i]->transport_data);
+	}
+
+	if (ictx != NULL) {
+		ibw_stop(ictx);
+	}
+	TALLOC_FREE(ctdb->transport_data);
 }
 
 /*
@@ -203,27 +242,15 @@ static void *ctdb_ibw_allocate_pkt(TALLOC_CTX *mem_ctx, size_t size)
 	return talloc_size(mem_ctx, size);
 }
 
-#ifdef __NOTDEF__
-
-static int ctdb_ibw_stop(struct ctdb_context *cctx)
-{
-	struct ibw_ctx *ictx = talloc_get_type(cctx->private_data, struct ibw_ctx);
-
-	assert(ictx!=NULL);
-	return ibw_stop(ictx);
-}
-
-#endif /* __NOTDEF__ */
-
 static const struct ctdb_methods ctdb_ibw_methods = {
-	.initialise= ctdb_ibw_initialise,
-	.start     = ctdb_ibw_start,
-	.queue_pkt = ctdb_ibw_queue_pkt,
-	.add_node = ctdb_ibw_add_node,
-	.allocate_pkt = ctdb_ibw_allocate_pkt,
-	.restart      = ctdb_ibw_restart,
-
-//	.stop = ctdb_ibw_stop
+	.initialise	= ctdb_ibw_initialise,
+	.start		= ctdb_ibw_start,
+	.queue_pkt	= ctdb_ibw_queue_pkt,
+	.add_node	= ctdb_ibw_add_node,
+	.connect_node	= ctdb_ibw_connect_node,
+	.allocate_pkt	= ctdb_ibw_allocate_pkt,
+	.shutdown	= ctdb_ibw_shutdown,
+	.restart	= ctdb_ibw_restart,
 };
 
 /*
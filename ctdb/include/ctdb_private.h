@@ -298,6 +298,12 @@ struct ctdb_context {
 	uint32_t num_clients;
 	bool do_checkpublicip;
 	bool do_setsched;
+	unsigned int node_connections;
+	unsigned int lock_threads;
+	unsigned int lock_num_threads;
+	unsigned int ro_lease_time;
+	unsigned int recovery_parallelism;
+	bool vacuum_dirty_chains;
 	const char *event_script_dir;
 	const char *notification_script;
 	pid_t ctdbd_pid;
@@ -362,6 +368,7 @@ struct ctdb_db_context {
 	struct revokechild_handle *revokechild_active;
 	struct ctdb_persistent_state *persistent_state;
 	struct trbt_tree *delete_queue;
+	uint8_t *vacuum_dirty_chains;
 	struct trbt_tree *fetch_queue;
 	struct trbt_tree *sticky_records; 
 	int (*ctdb_ltdb_store_fn)(struct ctdb_db_context *ctdb_db,
@@ -1081,6 +1081,18 @@ void ctdb_request_call(struct ctdb_context *ctdb, struct ctdb_req_header *hdr)
 		}
 		free(tdata.dptr);
 
+		/*
+		 * With leases, remember locally when the last
+		 * delegation expires, so that a revoke does not have
+		 * to wait for nodes that do not respond.
+		 */
+		if (ctdb->ro_lease_time != 0) {
+			header.reserved1 = time(NULL) + ctdb->ro_lease_time;
+			if (ctdb_ltdb_store(ctdb_db, call->key, &header, data) != 0) {
+				ctdb_fatal(ctdb, "Failed to store record with read only lease");
+			}
+		}
+
 		ret = ctdb_ltdb_unlock(ctdb_db, call->key);
 		if (ret != 0) {
 			DEBUG(DEBUG_ERR,(__location__ " ctdb_ltdb_unlock() failed with error %d\n", ret));
@@ -1098,6 +1110,8 @@ void ctdb_request_call(struct ctdb_context *ctdb, struct ctdb_req_header *hdr)
 		header.rsn      -= 2;
 		header.flags   |= CTDB_REC_RO_HAVE_READONLY;
 		header.flags   &= ~CTDB_REC_RO_HAVE_DELEGATIONS;
+		/* the lease is sent as a duration, 0 means no lease */
+		header.reserved1 = ctdb->ro_lease_time;
 		memcpy(&r->data[0], &header, sizeof(struct ctdb_ltdb_header));
 
 		if (data.dsize) {
@@ -1249,7 +1263,9 @@ void ctdb_reply_call(struct ctdb_context *ctdb, struct ctdb_req_header *hdr)
 			goto finished_ro;
 		}			
 
-		if (header->rsn <= oldheader.rsn) {
+		/* a renewed lease for the same copy is stored again */
+		if (header->rsn < oldheader.rsn ||
+		    (header->rsn == oldheader.rsn && header->reserved1 == 0)) {
 			ctdb_ltdb_unlock(ctdb_db, key);
 			goto finished_ro;
 		}
@@ -1260,6 +1276,14 @@ void ctdb_reply_call(struct ctdb_context *ctdb, struct ctdb_req_header *hdr)
 			goto finished_ro;
 		}
 
+		/*
+		 * The read only lease arrives as a duration, store it
+		 * as the local time the copy expires.
+		 */
+		if (header->reserved1 != 0) {
+			header->reserved1 += time(NULL);
+		}
+
 		data.dsize = c->datalen - sizeof(struct ctdb_ltdb_header);
 		data.dptr  = &c->data[sizeof(struct ctdb_ltdb_header)];
 		ret = ctdb_ltdb_store(ctdb_db, key, header, data);
@@ -1841,9 +1865,22 @@ static int ctdb_revoke_all_delegations(struct ctdb_context *ctdb, struct ctdb_db
 	 * If revoke on all nodes succeed, revoke is complete.  Otherwise,
 	 * remove CTDB_REC_RO_REVOKING_READONLY flag and retry.
 	 */
+	if (state->status != 0 && new_header.reserved1 != 0 &&
+	    time(NULL) >= (time_t)new_header.reserved1 +
+			   ctdb->tunable.control_timeout) {
+		/*
+		 * All read only leases have expired, so nodes that
+		 * did not respond no longer use their copies.
+		 */
+		DEBUG(DEBUG_NOTICE,
+		      ("Revoke all delegations failed, "
+		       "but read only leases expired.\n"));
+		state->status = 0;
+	}
 	if (state->status == 0) {
 		new_header.rsn++;
 		new_header.flags |= CTDB_REC_RO_REVOKE_COMPLETE;
+		new_header.reserved1 = 0;
 	} else {
 		DEBUG(DEBUG_NOTICE, ("Revoke all delegations failed, retrying.\n"));
 		new_header.flags &= ~CTDB_REC_RO_REVOKING_READONLY;
@@ -1878,6 +1915,7 @@ int ctdb_start_revoke_ro_record(struct ctdb_context *ctdb,
 
 	header->flags |= CTDB_REC_FLAG_MIGRATED_WITH_DATA;
 	header->rsn   -= 1;
+	header->reserved1 = 0;
 
 	rev_hdl = talloc_zero(ctdb_db, struct revokechild_handle);
 	if (rev_hdl == NULL) {
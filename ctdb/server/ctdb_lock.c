@@ -21,6 +21,7 @@
 #include "system/filesys.h"
 #include "system/network.h"
 
+#include <pthread.h>
 #include <talloc.h>
 #include <tevent.h>
 
@@ -44,6 +45,11 @@
  * 4. If the child process cannot get locks within certain time,
  *    execute an external script to debug.
  *
+ * Record locks on databases using robust mutexes can instead be taken
+ * by a lock thread ([database] lock threads in ctdb.conf). The thread
+ * owns the chain mutex and signals the parent via fd just like the
+ * child process, it drops the mutex once its lock context is freed.
+ *
  * ctdb_lock_record()      - get a lock on a record
  * ctdb_lock_db()          - get a lock on a DB
  *
@@ -65,6 +71,7 @@ static const char * const lock_type_str[] = {
 };
 
 struct lock_request;
+struct lock_thread;
 
 /* lock_context is the common part for a lock request */
 struct lock_context {
@@ -77,6 +84,7 @@ struct lock_context {
 	bool auto_mark;
 	struct lock_request *request;
 	pid_t child;
+	struct lock_thread *thread;
 	int fd[2];
 	struct tevent_fd *tfd;
 	struct tevent_timer *ttimer;
@@ -92,6 +100,27 @@ struct lock_request {
 	void *private_data;
 };
 
+/*
+ * A thread waiting for, then holding a chain mutex.
+ *
+ * It is not a child of the lock context, as it can't be stopped while
+ * it waits for the mutex. The thread only uses tdb, key and the fds,
+ * it closes its end of status_fd once it has dropped the mutex.
+ */
+struct lock_thread {
+	struct ctdb_context *ctdb;
+	struct lock_context *lock_ctx;
+	struct tdb_wrap *ltdb;
+	struct tdb_context *tdb;
+	TDB_DATA key;
+	int status_fd[2];
+	int release_fd[2];
+	struct tevent_fd *tfd;
+	bool started;
+	bool reported;
+	bool finished;
+};
+
 
 int ctdb_db_iterator(struct ctdb_context *ctdb, ctdb_db_handler_t handler,
 		     void *private_data)
@@ -186,13 +215,20 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb);
 /*
  * Destructor to kill the child locking process
  */
+static void ctdb_lock_thread_release(struct lock_thread *lock_thread);
+
 static int ctdb_lock_context_destructor(struct lock_context *lock_ctx)
 {
 	if (lock_ctx->request) {
 		lock_ctx->request->lctx = NULL;
 	}
-	if (lock_ctx->child > 0) {
-		ctdb_kill(lock_ctx->ctdb, lock_ctx->child, SIGTERM);
+	if (lock_ctx->child > 0 || lock_ctx->thread != NULL) {
+		if (lock_ctx->thread != NULL) {
+			ctdb_lock_thread_release(lock_ctx->thread);
+			lock_ctx->thread = NULL;
+		} else {
+			ctdb_kill(lock_ctx->ctdb, lock_ctx->child, SIGTERM);
+		}
 		if (lock_ctx->type == LOCK_RECORD) {
 			DLIST_REMOVE(lock_ctx->ctdb_db->lock_current, lock_ctx);
 		} else {
@@ -323,35 +359,20 @@ static int lock_bucket_id(double t)
 }
 
 /*
- * Callback routine when the required locks are obtained.
- * Called from parent context
+ * Update statistics and run the callbacks once the child process or
+ * lock thread has reported
  */
-static void ctdb_lock_handler(struct tevent_context *ev,
-			    struct tevent_fd *tfd,
-			    uint16_t flags,
-			    void *private_data)
+static void ctdb_lock_done(struct lock_context *lock_ctx, bool locked)
 {
-	struct lock_context *lock_ctx;
-	char c;
-	bool locked;
 	double t;
 	int id;
 
-	lock_ctx = talloc_get_type_abort(private_data, struct lock_context);
-
 	/* cancel the timeout event */
 	TALLOC_FREE(lock_ctx->ttimer);
 
 	t = timeval_elapsed(&lock_ctx->start_time);
 	id = lock_bucket_id(t);
 
-	/* Read the status from the child process */
-	if (sys_read(lock_ctx->fd[0], &c, 1) != 1) {
-		locked = false;
-	} else {
-		locked = (c == 0 ? true : false);
-	}
-
 	/* Update statistics */
 	CTDB_INCREMENT_STAT(lock_ctx->ctdb, locks.num_calls);
 	CTDB_INCREMENT_DB_STAT(lock_ctx->ctdb_db, locks.num_calls);
@@ -372,6 +393,246 @@ static void ctdb_lock_handler(struct tevent_context *ev,
 	process_callbacks(lock_ctx, locked);
 }
 
+/*
+ * Callback routine when the required locks are obtained.
+ * Called from parent context
+ */
+static void ctdb_lock_handler(struct tevent_context *ev,
+			    struct tevent_fd *tfd,
+			    uint16_t flags,
+			    void *private_data)
+{
+	struct lock_context *lock_ctx;
+	char c;
+	bool locked;
+
+	lock_ctx = talloc_get_type_abort(private_data, struct lock_context);
+
+	/* Read the status from the child process */
+	if (sys_read(lock_ctx->fd[0], &c, 1) != 1) {
+		locked = false;
+	} else {
+		locked = (c == 0 ? true : false);
+	}
+
+	ctdb_lock_done(lock_ctx, locked);
+}
+
+/*
+ * Lock threads
+ */
+
+static void *ctdb_lock_thread_fn(void *private_data)
+{
+	struct lock_thread *lock_thread = private_data;
+	ssize_t nread;
+	char c;
+	int ret;
+
+	ret = tdb_chainlock_unowned(lock_thread->tdb, lock_thread->key);
+	c = (ret == 0) ? 0 : 1;
+	sys_write_v(lock_thread->status_fd[1], &c, 1);
+
+	if (ret == 0) {
+		/* Hold the mutex until the parent closes release_fd */
+		do {
+			nread = sys_read(lock_thread->release_fd[0], &c, 1);
+		} while (nread > 0);
+
+		tdb_chainunlock_unowned(lock_thread->tdb, lock_thread->key);
+	}
+
+	/* From here on lock_thread may be gone */
+	close(lock_thread->status_fd[1]);
+
+	return NULL;
+}
+
+static int ctdb_lock_thread_destructor(struct lock_thread *lock_thread)
+{
+	if (lock_thread->lock_ctx != NULL) {
+		lock_thread->lock_ctx->thread = NULL;
+		lock_thread->lock_ctx = NULL;
+	}
+	if (lock_thread->tfd == NULL && lock_thread->status_fd[0] != -1) {
+		close(lock_thread->status_fd[0]);
+	}
+	TALLOC_FREE(lock_thread->tfd);
+	if (!lock_thread->started && lock_thread->status_fd[1] != -1) {
+		close(lock_thread->status_fd[1]);
+	}
+	if (lock_thread->release_fd[0] != -1) {
+		close(lock_thread->release_fd[0]);
+	}
+	if (lock_thread->release_fd[1] != -1) {
+		close(lock_thread->release_fd[1]);
+	}
+	lock_thread->ctdb->lock_num_threads--;
+
+	return 0;
+}
+
+/*
+ * Called when the lock context goes away: Let the thread drop the
+ * mutex, lock_thread is freed once it has done so.
+ */
+static void ctdb_lock_thread_release(struct lock_thread *lock_thread)
+{
+	lock_thread->lock_ctx = NULL;
+
+	if (lock_thread->finished) {
+		talloc_free(lock_thread);
+		return;
+	}
+
+	if (lock_thread->release_fd[1] != -1) {
+		close(lock_thread->release_fd[1]);
+		lock_thread->release_fd[1] = -1;
+	}
+}
+
+static void ctdb_lock_thread_handler(struct tevent_context *ev,
+				     struct tevent_fd *tfd,
+				     uint16_t flags,
+				     void *private_data)
+{
+	struct lock_thread *lock_thread = talloc_get_type_abort(
+		private_data, struct lock_thread);
+	struct lock_context *lock_ctx = lock_thread->lock_ctx;
+	bool reported = lock_thread->reported;
+	char c;
+
+	if (sys_read(lock_thread->status_fd[0], &c, 1) != 1) {
+		/* The thread is done */
+		lock_thread->finished = true;
+		TALLOC_FREE(lock_thread->tfd);
+		lock_thread->status_fd[0] = -1;
+
+		if (lock_ctx == NULL) {
+			talloc_free(lock_thread);
+			return;
+		}
+		if (!reported) {
+			lock_thread->reported = true;
+			ctdb_lock_done(lock_ctx, false);
+		}
+		return;
+	}
+
+	lock_thread->reported = true;
+
+	if (lock_ctx == NULL) {
+		/* Nobody wants the lock anymore */
+		return;
+	}
+
+	ctdb_lock_done(lock_ctx, c == 0);
+}
+
+/*
+ * Start a lock thread for a record lock, returns false if a child
+ * process has to be used instead
+ */
+static bool ctdb_lock_thread_start(struct ctdb_context *ctdb,
+				   struct lock_context *lock_ctx)
+{
+	struct lock_thread *lock_thread = NULL;
+	pthread_attr_t attr;
+	pthread_t thread;
+	int tdb_flags;
+	int ret;
+
+	if (lock_ctx->type != LOCK_RECORD) {
+		return false;
+	}
+	if (ctdb->lock_num_threads >= ctdb->lock_threads) {
+		return false;
+	}
+	tdb_flags = tdb_get_flags(lock_ctx->ctdb_db->ltdb->tdb);
+	if ((tdb_flags & TDB_MUTEX_LOCKING) == 0) {
+		return false;
+	}
+
+	lock_thread = talloc_zero(ctdb, struct lock_thread);
+	if (lock_thread == NULL) {
+		return false;
+	}
+	lock_thread->ctdb = ctdb;
+	lock_thread->status_fd[0] = lock_thread->status_fd[1] = -1;
+	lock_thread->release_fd[0] = lock_thread->release_fd[1] = -1;
+
+	ctdb->lock_num_threads++;
+	talloc_set_destructor(lock_thread, ctdb_lock_thread_destructor);
+
+	/*
+	 * Keep the database open for the thread, even if it is
+	 * detached meanwhile
+	 */
+	lock_thread->ltdb = talloc_reference(lock_thread,
+					     lock_ctx->ctdb_db->ltdb);
+	if (lock_thread->ltdb == NULL) {
+		goto fail;
+	}
+	lock_thread->tdb = lock_thread->ltdb->tdb;
+
+	lock_thread->key.dsize = lock_ctx->key.dsize;
+	lock_thread->key.dptr = talloc_memdup(lock_thread,
+					      lock_ctx->key.dptr,
+					      lock_ctx->key.dsize);
+	if (lock_thread->key.dptr == NULL && lock_ctx->key.dsize > 0) {
+		goto fail;
+	}
+
+	ret = pipe(lock_thread->status_fd);
+	if (ret != 0) {
+		lock_thread->status_fd[0] = lock_thread->status_fd[1] = -1;
+		goto fail;
+	}
+	ret = pipe(lock_thread->release_fd);
+	if (ret != 0) {
+		lock_thread->release_fd[0] = lock_thread->release_fd[1] = -1;
+		goto fail;
+	}
+	set_close_on_exec(lock_thread->status_fd[0]);
+	set_close_on_exec(lock_thread->status_fd[1]);
+	set_close_on_exec(lock_thread->release_fd[0]);
+	set_close_on_exec(lock_thread->release_fd[1]);
+
+	lock_thread->tfd = tevent_add_fd(ctdb->ev,
+					 lock_thread,
+					 lock_thread->status_fd[0],
+					 TEVENT_FD_READ,
+					 ctdb_lock_thread_handler,
+					 lock_thread);
+	if (lock_thread->tfd == NULL) {
+		goto fail;
+	}
+	tevent_fd_set_auto_close(lock_thread->tfd);
+
+	ret = pthread_attr_init(&attr);
+	if (ret != 0) {
+		goto fail;
+	}
+	pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+	ret = pthread_create(&thread, &attr, ctdb_lock_thread_fn, lock_thread);
+	pthread_attr_destroy(&attr);
+	if (ret != 0) {
+		DBG_WARNING("Failed to create lock thread: %s\n",
+			    strerror(ret));
+		goto fail;
+	}
+	lock_thread->started = true;
+
+	lock_thread->lock_ctx = lock_ctx;
+	lock_ctx->thread = lock_thread;
+
+	return true;
+
+fail:
+	talloc_free(lock_thread);
+	return false;
+}
+
 struct lock_log_entry {
 	struct db_hash_context *lock_log;
 	TDB_DATA key;
@@ -503,7 +764,10 @@ static char **debug_locks_args(TALLOC_CTX *mem_ctx,
 	char **args = str_list_make_empty(mem_ctx);
 
 	str_list_add_printf(&args, "debug_locks");
-	str_list_add_printf(&args, "%d", lock_ctx->child);
+	str_list_add_printf(&args,
+			    "%d",
+			    (lock_ctx->thread != NULL) ? getpid()
+						       : lock_ctx->child);
 	str_list_add_printf(&args,
 			    "%s",
 			    (lock_ctx->type == LOCK_RECORD) ? "RECORD" : "DB");
@@ -723,6 +987,20 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 		return;
 	}
 
+	if (ctdb_lock_thread_start(ctdb, lock_ctx)) {
+		lock_ctx->ttimer = tevent_add_timer(ctdb->ev,
+						    lock_ctx,
+						    timeval_current_ofs(10, 0),
+						    ctdb_lock_timeout_handler,
+						    (void *)lock_ctx);
+		if (lock_ctx->ttimer == NULL) {
+			ctdb_lock_thread_release(lock_ctx->thread);
+			lock_ctx->thread = NULL;
+			return;
+		}
+		goto scheduled;
+	}
+
 	lock_ctx->child = -1;
 	ret = pipe(lock_ctx->fd);
 	if (ret != 0) {
@@ -806,6 +1084,7 @@ static void ctdb_lock_schedule(struct ctdb_context *ctdb)
 	}
 	tevent_fd_set_auto_close(lock_ctx->tfd);
 
+scheduled:
 	/* Move the context from pending to current */
 	if (lock_ctx->type == LOCK_RECORD) {
 		DLIST_REMOVE(lock_ctx->ctdb_db->lock_pending, lock_ctx);
@@ -1282,6 +1282,7 @@ static int db_recovery_parallel(struct ctdb_recoverd *rec, TALLOC_CTX *mem_ctx)
 {
 	static char prog[PATH_MAX+1] = "";
 	const char *arg;
+	char parallelism[16];
 
 	if (!ctdb_set_helper("recovery_helper", prog, sizeof(prog),
 			     "CTDB_RECOVERY_HELPER", CTDB_HELPER_BINDIR,
@@ -1297,6 +1298,12 @@ static int db_recovery_parallel(struct ctdb_recoverd *rec, TALLOC_CTX *mem_ctx)
 
 	setenv("CTDB_DBDIR_STATE", rec->ctdb->db_directory_state, 1);
 
+	snprintf(parallelism,
+		 sizeof(parallelism),
+		 "%u",
+		 rec->ctdb->recovery_parallelism);
+	setenv("CTDB_RECOVERY_PARALLELISM", parallelism, 1);
+
 	return helper_run(rec, mem_ctx, prog, arg, "recovery");
 }
 
@@ -2012,9 +2012,21 @@ static bool recover_db_recv(struct tevent_req *req)
  * Try to recover each database 5 times before failing recovery.
  */
 
+/*
+ * Databases are recovered concurrently.  The number of databases
+ * recovered at the same time can be limited with
+ * CTDB_RECOVERY_PARALLELISM, 0 means no limit.
+ */
 struct db_recovery_state {
 	struct tevent_context *ev;
+	struct ctdb_client_context *client;
 	struct db_list *dblist;
+	struct ctdb_tunable_list *tun_list;
+	struct node_list *nlist;
+	uint32_t generation;
+	struct db *next_db;
+	unsigned int max_active;
+	unsigned int num_active;
 	unsigned int num_replies;
 	unsigned int num_failed;
 };
@@ -2028,8 +2040,10 @@ struct db_recovery_one_state {
 	uint32_t generation;
 	struct db *db;
 	int num_fails;
+	struct timeval start_time;
 };
 
+static bool db_recovery_one_start(struct tevent_req *req);
 static void db_recovery_one_done(struct tevent_req *subreq);
 
 static struct tevent_req *db_recovery_send(TALLOC_CTX *mem_ctx,
@@ -2040,9 +2054,9 @@ static struct tevent_req *db_recovery_send(TALLOC_CTX *mem_ctx,
 					   struct node_list *nlist,
 					   uint32_t generation)
 {
-	struct tevent_req *req, *subreq;
+	struct tevent_req *req;
 	struct db_recovery_state *state;
-	struct db *db;
+	const char *ptr;
 
 	req = tevent_req_create(mem_ctx, &state, struct db_recovery_state);
 	if (req == NULL) {
@@ -2050,49 +2064,91 @@ static struct tevent_req *db_recovery_send(TALLOC_CTX *mem_ctx,
 	}
 
 	state->ev = ev;
+	state->client = client;
 	state->dblist = dblist;
+	state->tun_list = tun_list;
+	state->nlist = nlist;
+	state->generation = generation;
+	state->next_db = dblist->db;
+	state->max_active = 0;
+	state->num_active = 0;
 	state->num_replies = 0;
 	state->num_failed = 0;
 
+	ptr = getenv("CTDB_RECOVERY_PARALLELISM");
+	if (ptr != NULL) {
+		int ret = 0;
+
+		state->max_active = smb_strtoul(ptr,
+						NULL,
+						0,
+						&ret,
+						SMB_STR_STANDARD);
+		if (ret != 0) {
+			D_WARNING("Invalid CTDB_RECOVERY_PARALLELISM=%s, "
+				  "ignoring\n", ptr);
+			state->max_active = 0;
+		}
+	}
+
 	if (dblist->num_dbs == 0) {
 		tevent_req_done(req);
 		return tevent_req_post(req, ev);
 	}
 
-	for (db = dblist->db; db != NULL; db = db->next) {
-		struct db_recovery_one_state *substate;
-
-		substate = talloc_zero(state, struct db_recovery_one_state);
-		if (tevent_req_nomem(substate, req)) {
-			return tevent_req_post(req, ev);
+	while (state->next_db != NULL) {
+		if (state->max_active != 0 &&
+		    state->num_active >= state->max_active) {
+			break;
 		}
-
-		substate->req = req;
-		substate->client = client;
-		substate->dblist = dblist;
-		substate->tun_list = tun_list;
-		substate->nlist = nlist;
-		substate->generation = generation;
-		substate->db = db;
-
-		subreq = recover_db_send(state,
-					 ev,
-					 client,
-					 tun_list,
-					 nlist,
-					 generation,
-					 substate->db);
-		if (tevent_req_nomem(subreq, req)) {
+		if (! db_recovery_one_start(req)) {
 			return tevent_req_post(req, ev);
 		}
-		tevent_req_set_callback(subreq, db_recovery_one_done,
-					substate);
-		D_NOTICE("recover database 0x%08x\n", substate->db->db_id);
 	}
 
 	return req;
 }
 
+static bool db_recovery_one_start(struct tevent_req *req)
+{
+	struct db_recovery_state *state = tevent_req_data(
+		req, struct db_recovery_state);
+	struct db_recovery_one_state *substate;
+	struct tevent_req *subreq;
+
+	substate = talloc_zero(state, struct db_recovery_one_state);
+	if (tevent_req_nomem(substate, req)) {
+		return false;
+	}
+
+	substate->req = req;
+	substate->client = state->client;
+	substate->dblist = state->dblist;
+	substate->tun_list = state->tun_list;
+	substate->nlist = state->nlist;
+	substate->generation = state->generation;
+	substate->db = state->next_db;
+	substate->start_time = timeval_current();
+
+	state->next_db = state->next_db->next;
+
+	subreq = recover_db_send(state,
+				 state->ev,
+				 substate->client,
+				 substate->tun_list,
+				 substate->nlist,
+				 substate->generation,
+				 substate->db);
+	if (tevent_req_nomem(subreq, req)) {
+		return false;
+	}
+	tevent_req_set_callback(subreq, db_recovery_one_done, substate);
+	D_NOTICE("recover database 0x%08x\n", substate->db->db_id);
+
+	state->num_active += 1;
+	return true;
+}
+
 static void db_recovery_one_done(struct tevent_req *subreq)
 {
 	struct db_recovery_one_state *substate = tevent_req_callback_data(
@@ -2106,6 +2162,9 @@ static void db_recovery_one_done(struct tevent_req *subreq)
 	TALLOC_FREE(subreq);
 
 	if (status) {
+		D_INFO("recovered database 0x%08x in %.3f seconds\n",
+		       substate->db->db_id,
+		       timeval_elapsed(&substate->start_time));
 		talloc_free(substate);
 		goto done;
 	}
@@ -2133,9 +2192,15 @@ failed:
 
 done:
 	state->num_replies += 1;
+	state->num_active -= 1;
 
 	if (state->num_replies == state->dblist->num_dbs) {
 		tevent_req_done(req);
+		return;
+	}
+
+	if (state->next_db != NULL) {
+		db_recovery_one_start(req);
 	}
 }
 
@@ -1029,6 +1029,7 @@ static void takeover_avail_ips_done(struct tevent_req *subreq)
 	bool status;
 	int ret;
 	struct ctdb_public_ip_list *available_ips;
+	struct ipalloc_timing timing;
 
 	status = get_public_ips_recv(subreq, &ret, state, &available_ips);
 	TALLOC_FREE(subreq);
@@ -1054,6 +1055,14 @@ static void takeover_avail_ips_done(struct tevent_req *subreq)
 		return;
 	}
 
+	ipalloc_get_timing(state->ipalloc_state, &timing);
+	D_NOTICE("IP allocation took %.6lf seconds "
+		 "(merge %.6lf, bitmaps %.6lf, algorithm %.6lf)\n",
+		 timing.merge_ips + timing.populate_bitmap + timing.algorithm,
+		 timing.merge_ips,
+		 timing.populate_bitmap,
+		 timing.algorithm);
+
 	/* Each of the following stages (START_IPREALLOCATE, RELEASE_IP, TAKEOVER_IP,
 	 * IPREALLOCATED) notionally has a timeout of TakeoverTimeout
 	 * seconds.  However, RELEASE_IP can take longer due to TCP
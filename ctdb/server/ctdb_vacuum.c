@@ -57,6 +57,7 @@ struct ctdb_vacuum_child_context {
 	enum vacuum_child_status status;
 	struct timeval start_time;
 	bool scheduled;
+	bool full_vacuum_run;
 };
 
 struct ctdb_vacuum_handle {
@@ -793,6 +794,67 @@ static void ctdb_process_delete_queue(struct ctdb_db_context *ctdb_db,
 	return;
 }
 
+/*
+ * With "vacuum dirty chains", each bit of ctdb_db->vacuum_dirty_chains
+ * marks a hash chain in which a record was scheduled for deletion
+ * since the last full vacuuming run.  Only these chains can contain
+ * empty records that the fast path vacuuming has missed, for example
+ * because of a hash collision in the delete queue.
+ */
+static void vacuum_mark_chain_dirty(struct ctdb_db_context *ctdb_db,
+				    TDB_DATA key)
+{
+	unsigned int chain;
+
+	if (ctdb_db->vacuum_dirty_chains == NULL) {
+		return;
+	}
+
+	chain = tdb_hash_chain(ctdb_db->ltdb->tdb, key);
+	ctdb_db->vacuum_dirty_chains[chain / 8] |= 1 << (chain % 8);
+}
+
+static void vacuum_mark_all_chains(struct ctdb_db_context *ctdb_db,
+				   bool dirty)
+{
+	if (ctdb_db->vacuum_dirty_chains == NULL) {
+		return;
+	}
+
+	memset(ctdb_db->vacuum_dirty_chains,
+	       dirty ? 0xff : 0,
+	       talloc_get_size(ctdb_db->vacuum_dirty_chains));
+}
+
+static int vacuum_traverse_dirty_chains(struct ctdb_db_context *ctdb_db,
+					struct vacuum_data *vdata)
+{
+	struct tdb_context *tdb = ctdb_db->ltdb->tdb;
+	int hash_size = tdb_hash_size(tdb);
+	unsigned int num_chains = 0;
+	int chain;
+	int ret;
+
+	for (chain = 0; chain < hash_size; chain++) {
+		if (!(ctdb_db->vacuum_dirty_chains[chain / 8] &
+		      (1 << (chain % 8)))) {
+			continue;
+		}
+
+		ret = tdb_traverse_chain(tdb, chain, vacuum_traverse, vdata);
+		if (ret == -1 || vdata->traverse_error) {
+			return -1;
+		}
+		num_chains += 1;
+	}
+
+	DEBUG(DEBUG_INFO,
+	      ("Traversed %u of %d hash chains of db[%s]\n",
+	       num_chains, hash_size, ctdb_db->db_name));
+
+	return 0;
+}
+
 /**
  * read-only traverse of the database, looking for records that
  * might be able to be vacuumed.
@@ -805,7 +867,12 @@ static void ctdb_vacuum_traverse_db(struct ctdb_db_context *ctdb_db,
 {
 	int ret;
 
-	ret = tdb_traverse_read(ctdb_db->ltdb->tdb, vacuum_traverse, vdata);
+	if (ctdb_db->vacuum_dirty_chains != NULL) {
+		ret = vacuum_traverse_dirty_chains(ctdb_db, vdata);
+	} else {
+		ret = tdb_traverse_read(ctdb_db->ltdb->tdb, vacuum_traverse,
+					vdata);
+	}
 	if (ret == -1 || vdata->traverse_error) {
 		DEBUG(DEBUG_ERR, (__location__ " Traverse error in vacuuming "
 				  "'%s'\n", ctdb_db->db_name));
@@ -1329,6 +1396,11 @@ static int vacuum_child_destructor(struct ctdb_vacuum_child_context *child_ctx)
 		vacuum_handle->fast_path_count++;
 	}
 
+	if (child_ctx->full_vacuum_run && child_ctx->status != VACUUM_OK) {
+		/* The next full run has to look at everything again */
+		vacuum_mark_all_chains(ctdb_db, true);
+	}
+
 	ctdb->vacuumer = NULL;
 
 	if (child_ctx->scheduled) {
@@ -1469,11 +1541,20 @@ static int vacuum_db_child(TALLOC_CTX *mem_ctx,
 
 	child_ctx->status = VACUUM_RUNNING;
 	child_ctx->scheduled = scheduled;
+	child_ctx->full_vacuum_run = full_vacuum_run;
 	child_ctx->start_time = timeval_current();
 
 	ctdb->vacuumer = child_ctx;
 	talloc_set_destructor(child_ctx, vacuum_child_destructor);
 
+	/*
+	 * The child traverses the dirty chains, new deletions are
+	 * tracked for the next full run.
+	 */
+	if (full_vacuum_run) {
+		vacuum_mark_all_chains(ctdb_db, false);
+	}
+
 	/*
 	 * Clear the fastpath vacuuming list in the parent.
 	 */
@@ -1704,6 +1785,19 @@ int ctdb_vacuum_init(struct ctdb_db_context *ctdb_db)
 
 	ctdb_db->vacuum_handle = vacuum_handle;
 
+	if (ctdb_db->ctdb->vacuum_dirty_chains) {
+		int hash_size = tdb_hash_size(ctdb_db->ltdb->tdb);
+
+		ctdb_db->vacuum_dirty_chains = talloc_array(ctdb_db,
+							    uint8_t,
+							    (hash_size+7)/8);
+		if (ctdb_db->vacuum_dirty_chains == NULL) {
+			DBG_ERR("Memory allocation error\n");
+			return -1;
+		}
+		vacuum_mark_all_chains(ctdb_db, true);
+	}
+
 	tevent_add_timer(ctdb_db->ctdb->ev,
 			 vacuum_handle,
 			 timeval_current_ofs(vacuum_handle->vacuum_interval, 0),
@@ -1778,6 +1872,8 @@ static int insert_record_into_delete_queue(struct ctdb_db_context *ctdb_db,
 
 	hash = (uint32_t)ctdb_hash(&key);
 
+	vacuum_mark_chain_dirty(ctdb_db, key);
+
 	DEBUG(DEBUG_DEBUG, (__location__ " schedule for deletion: db[%s] "
 			    "db_id[0x%08x] "
 			    "key_hash[0x%08x] "
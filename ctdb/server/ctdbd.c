@@ -277,6 +277,8 @@ int main(int argc, const char *argv[])
 	 * Cluster setup/options
 	 */
 
+	ctdb->node_connections = ctdb_config.node_connections;
+
 	ret = ctdb_set_transport(ctdb, ctdb_config.transport);
 	if (ret == -1) {
 		D_ERR("Failed to setup transport\n");
@@ -347,6 +349,11 @@ int main(int argc, const char *argv[])
 		}
 	}
 
+	ctdb->lock_threads = ctdb_config.lock_threads;
+	ctdb->ro_lease_time = ctdb_config.ro_lease_time;
+	ctdb->recovery_parallelism = ctdb_config.recovery_parallelism;
+	ctdb->vacuum_dirty_chains = ctdb_config.vacuum_dirty_chains;
+
 	/*
 	 * Legacy setup/options
 	 */
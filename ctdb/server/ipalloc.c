@@ -25,6 +25,7 @@
 #include <talloc.h>
 
 #include "lib/util/debug.h"
+#include "lib/util/time.h"
 
 #include "common/logging.h"
 #include "common/rb_tree.h"
@@ -253,17 +254,27 @@ bool ipalloc_can_host_ips(struct ipalloc_state *ipalloc_state)
 /* The calculation part of the IP allocation algorithm. */
 struct public_ip_list *ipalloc(struct ipalloc_state *ipalloc_state)
 {
+	struct timeval start;
 	bool ret = false;
 
+	ipalloc_state->timing = (struct ipalloc_timing) { 0 };
+
+	start = timeval_current();
 	ipalloc_state->all_ips = create_merged_ip_list(ipalloc_state);
+	ipalloc_state->timing.merge_ips = timeval_elapsed(&start);
 	if (ipalloc_state->all_ips == NULL) {
 		return NULL;
 	}
 
-	if (!populate_bitmap(ipalloc_state)) {
+	start = timeval_current();
+	ret = populate_bitmap(ipalloc_state);
+	ipalloc_state->timing.populate_bitmap = timeval_elapsed(&start);
+	if (!ret) {
 		return NULL;
 	}
 
+	start = timeval_current();
+
 	switch (ipalloc_state->algorithm) {
 	case IPALLOC_LCP2:
 		ret = ipalloc_lcp2(ipalloc_state);
@@ -275,6 +286,7 @@ struct public_ip_list *ipalloc(struct ipalloc_state *ipalloc_state)
 		ret = ipalloc_nondeterministic(ipalloc_state);
                break;
 	}
+	ipalloc_state->timing.algorithm = timeval_elapsed(&start);
 
 	/* at this point ->pnn is the node which will own each IP
 	   or CTDB_UNKNOWN_PNN if there is no node that can cover this ip
@@ -282,3 +294,9 @@ struct public_ip_list *ipalloc(struct ipalloc_state *ipalloc_state)
 
 	return (ret ? ipalloc_state->all_ips : NULL);
 }
+
+void ipalloc_get_timing(struct ipalloc_state *ipalloc_state,
+			struct ipalloc_timing *timing)
+{
+	*timing = ipalloc_state->timing;
+}
@@ -49,6 +49,13 @@ enum ipalloc_algorithm {
 
 struct ipalloc_state;
 
+/* Time taken by each phase of ipalloc(), in seconds */
+struct ipalloc_timing {
+	double merge_ips;
+	double populate_bitmap;
+	double algorithm;
+};
+
 struct ipalloc_state * ipalloc_state_init(TALLOC_CTX *mem_ctx,
 					  uint32_t num_nodes,
 					  enum ipalloc_algorithm algorithm,
@@ -64,4 +71,7 @@ bool ipalloc_can_host_ips(struct ipalloc_state *ipalloc_state);
 
 struct public_ip_list *ipalloc(struct ipalloc_state *ipalloc_state);
 
+void ipalloc_get_timing(struct ipalloc_state *ipalloc_state,
+			struct ipalloc_timing *timing);
+
 #endif /* __CTDB_IPALLOC_H__ */
@@ -38,6 +38,8 @@ struct ipalloc_state {
 	bool no_ip_failback;
 	bool no_ip_takeover;
 	uint32_t *force_rebalance_nodes;
+
+	struct ipalloc_timing timing;
 };
 
 bool can_node_takeover_ip(struct ipalloc_state *ipalloc_state,
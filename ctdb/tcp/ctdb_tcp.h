@@ -26,6 +26,22 @@ struct ctdb_tcp {
 	int listen_fd;
 };
 
+/*
+  additional connection to a node, see "node connections"
+*/
+struct ctdb_tcp_lane {
+	struct ctdb_node *node;
+	unsigned int idx;
+
+	int out_fd;
+	struct ctdb_queue *out_queue;
+
+	struct tevent_fd *connect_fde;
+	struct tevent_timer *connect_te;
+
+	struct ctdb_queue *in_queue;
+};
+
 /*
   state associated with one tcp node
 */
@@ -38,6 +54,9 @@ struct ctdb_tcp_node {
 
 	struct ctdb_context *ctdb;
 	struct ctdb_queue *in_queue;
+
+	unsigned int num_lanes;
+	struct ctdb_tcp_lane **lanes;
 };
 
 
@@ -47,6 +66,9 @@ int ctdb_tcp_listen(struct ctdb_context *ctdb);
 void ctdb_tcp_node_connect(struct tevent_context *ev, struct tevent_timer *te,
 			   struct timeval t, void *private_data);
 void ctdb_tcp_read_cb(uint8_t *data, size_t cnt, void *args);
+void ctdb_tcp_lane_read_cb(uint8_t *data, size_t cnt, void *args);
+void ctdb_tcp_start_lanes(struct ctdb_node *node);
+void ctdb_tcp_stop_lanes(struct ctdb_node *node);
 void ctdb_tcp_tnode_cb(uint8_t *data, size_t cnt, void *private_data);
 void ctdb_tcp_stop_outgoing(struct ctdb_node *node);
 void ctdb_tcp_stop_incoming(struct ctdb_node *node);
@@ -82,6 +82,30 @@ void ctdb_tcp_tnode_cb(uint8_t *data, size_t cnt, void *private_data)
 	TALLOC_FREE(data);
 }
 
+static void ctdb_tcp_set_sockopts(int fd)
+{
+	int one = 1;
+	int ret;
+
+	ret = setsockopt(fd,
+			 IPPROTO_TCP,
+			 TCP_NODELAY,
+			 (char *)&one,
+			 sizeof(one));
+	if (ret == -1) {
+		DBG_WARNING("Failed to set TCP_NODELAY on fd - %s\n",
+			  strerror(errno));
+	}
+	ret = setsockopt(fd,
+			 SOL_SOCKET,
+			 SO_KEEPALIVE,(char *)&one,
+			 sizeof(one));
+	if (ret == -1) {
+		DBG_WARNING("Failed to set KEEPALIVE on fd - %s\n",
+			    strerror(errno));
+	}
+}
+
 /*
   called when socket becomes writeable on connect
 */
@@ -96,7 +120,6 @@ static void ctdb_node_connect_write(struct tevent_context *ev,
 	struct ctdb_context *ctdb = node->ctdb;
 	int error = 0;
 	socklen_t len = sizeof(error);
-	int one = 1;
 	int ret;
 
 	TALLOC_FREE(tnode->connect_te);
@@ -112,23 +135,7 @@ static void ctdb_node_connect_write(struct tevent_context *ev,
 
 	TALLOC_FREE(tnode->connect_fde);
 
-	ret = setsockopt(tnode->out_fd,
-			 IPPROTO_TCP,
-			 TCP_NODELAY,
-			 (char *)&one,
-			 sizeof(one));
-	if (ret == -1) {
-		DBG_WARNING("Failed to set TCP_NODELAY on fd - %s\n",
-			  strerror(errno));
-	}
-	ret = setsockopt(tnode->out_fd,
-			 SOL_SOCKET,
-			 SO_KEEPALIVE,(char *)&one,
-			 sizeof(one));
-	if (ret == -1) {
-		DBG_WARNING("Failed to set KEEPALIVE on fd - %s\n",
-			    strerror(errno));
-	}
+	ctdb_tcp_set_sockopts(tnode->out_fd);
 
 	tnode->out_queue = ctdb_queue_setup(node->ctdb,
 					    tnode,
@@ -160,6 +167,12 @@ static void ctdb_node_connect_write(struct tevent_context *ev,
 	if (tnode->in_queue != NULL) {
 		node->ctdb->upcalls->node_connected(node);
 	}
+
+	/*
+	 * The additional connections are only established after the
+	 * main one, so the other node accepts the main one first
+	 */
+	ctdb_tcp_start_lanes(node);
 }
 
 
@@ -171,35 +184,34 @@ static void ctdb_tcp_node_connect_timeout(struct tevent_context *ev,
 /*
   called when we should try and establish a tcp connection to a node
 */
-static void ctdb_tcp_start_outgoing(struct ctdb_node *node)
+static int ctdb_tcp_connect_socket(struct ctdb_node *node)
 {
-	struct ctdb_tcp_node *tnode = talloc_get_type(node->transport_data,
-						      struct ctdb_tcp_node);
 	struct ctdb_context *ctdb = node->ctdb;
         ctdb_sock_addr sock_in;
 	int sockin_size;
 	int sockout_size;
         ctdb_sock_addr sock_out;
+	int fd;
 	int ret;
 
 	sock_out = node->address;
 
-	tnode->out_fd = socket(sock_out.sa.sa_family, SOCK_STREAM, IPPROTO_TCP);
-	if (tnode->out_fd == -1) {
+	fd = socket(sock_out.sa.sa_family, SOCK_STREAM, IPPROTO_TCP);
+	if (fd == -1) {
 		DBG_ERR("Failed to create socket\n");
-		goto failed;
+		return -1;
 	}
 
-	ret = set_blocking(tnode->out_fd, false);
+	ret = set_blocking(fd, false);
 	if (ret != 0) {
 		DBG_ERR("Failed to set socket non-blocking (%s)\n",
 			strerror(errno));
 		goto failed;
 	}
 
-	set_close_on_exec(tnode->out_fd);
+	set_close_on_exec(fd);
 
-	DBG_DEBUG("Created TCP SOCKET FD:%d\n", tnode->out_fd);
+	DBG_DEBUG("Created TCP SOCKET FD:%d\n", fd);
 
 	/* Bind our side of the socketpair to the same address we use to listen
 	 * on incoming CTDB traffic.
@@ -231,19 +243,35 @@ static void ctdb_tcp_start_outgoing(struct ctdb_node *node)
 		goto failed;
 	}
 
-	ret = bind(tnode->out_fd, (struct sockaddr *)&sock_in, sockin_size);
+	ret = bind(fd, (struct sockaddr *)&sock_in, sockin_size);
 	if (ret == -1) {
 		DBG_ERR("Failed to bind socket (%s)\n", strerror(errno));
 		goto failed;
 	}
 
-	ret = connect(tnode->out_fd,
-		      (struct sockaddr *)&sock_out,
-		      sockout_size);
+	ret = connect(fd, (struct sockaddr *)&sock_out, sockout_size);
 	if (ret != 0 && errno != EINPROGRESS) {
 		goto failed;
 	}
 
+	return fd;
+
+failed:
+	close(fd);
+	return -1;
+}
+
+static void ctdb_tcp_start_outgoing(struct ctdb_node *node)
+{
+	struct ctdb_tcp_node *tnode = talloc_get_type(node->transport_data,
+						      struct ctdb_tcp_node);
+	struct ctdb_context *ctdb = node->ctdb;
+
+	tnode->out_fd = ctdb_tcp_connect_socket(node);
+	if (tnode->out_fd == -1) {
+		goto failed;
+	}
+
 	/* non-blocking connect - wait for write event */
 	tnode->connect_fde = tevent_add_fd(node->ctdb->ev,
 					   tnode,
@@ -295,6 +323,183 @@ static void ctdb_tcp_node_connect_timeout(struct tevent_context *ev,
 	ctdb_tcp_start_outgoing(node);
 }
 
+/*
+  stop an additional outgoing connection (established or pending)
+ */
+static void ctdb_tcp_lane_stop_outgoing(struct ctdb_tcp_lane *lane)
+{
+	TALLOC_FREE(lane->out_queue);
+	TALLOC_FREE(lane->connect_te);
+	TALLOC_FREE(lane->connect_fde);
+	if (lane->out_fd != -1) {
+		close(lane->out_fd);
+		lane->out_fd = -1;
+	}
+}
+
+static void ctdb_tcp_lane_connect(struct tevent_context *ev,
+				  struct tevent_timer *te,
+				  struct timeval t,
+				  void *private_data);
+
+static void ctdb_tcp_lane_retry(struct ctdb_tcp_lane *lane)
+{
+	struct ctdb_context *ctdb = lane->node->ctdb;
+
+	ctdb_tcp_lane_stop_outgoing(lane);
+	lane->connect_te = tevent_add_timer(ctdb->ev,
+					    lane,
+					    timeval_current_ofs(1, 0),
+					    ctdb_tcp_lane_connect,
+					    lane);
+}
+
+/*
+  Losing an additional connection does not make the node dead, its
+  packets use the main connection until it is re-established
+ */
+static void ctdb_tcp_lane_out_cb(uint8_t *data, size_t cnt,
+				 void *private_data)
+{
+	struct ctdb_tcp_lane *lane = talloc_get_type_abort(
+		private_data, struct ctdb_tcp_lane);
+
+	DBG_NOTICE("Connection %u to node %s lost\n",
+		   lane->idx,
+		   lane->node->name);
+
+	TALLOC_FREE(data);
+	ctdb_tcp_lane_retry(lane);
+}
+
+static void ctdb_tcp_lane_connect_write(struct tevent_context *ev,
+					struct tevent_fd *fde,
+					uint16_t flags,
+					void *private_data)
+{
+	struct ctdb_tcp_lane *lane = talloc_get_type_abort(
+		private_data, struct ctdb_tcp_lane);
+	struct ctdb_node *node = lane->node;
+	int error = 0;
+	socklen_t len = sizeof(error);
+	int ret;
+
+	TALLOC_FREE(lane->connect_te);
+
+	ret = getsockopt(lane->out_fd, SOL_SOCKET, SO_ERROR, &error, &len);
+	if (ret != 0 || error != 0) {
+		ctdb_tcp_lane_retry(lane);
+		return;
+	}
+
+	TALLOC_FREE(lane->connect_fde);
+
+	ctdb_tcp_set_sockopts(lane->out_fd);
+
+	lane->out_queue = ctdb_queue_setup(node->ctdb,
+					   lane,
+					   lane->out_fd,
+					   CTDB_TCP_ALIGNMENT,
+					   ctdb_tcp_lane_out_cb,
+					   lane,
+					   "to-node-%s-%u",
+					   node->name,
+					   lane->idx);
+	if (lane->out_queue == NULL) {
+		DBG_ERR("Failed to set up outgoing queue\n");
+		ctdb_tcp_lane_retry(lane);
+		return;
+	}
+
+	/* the queue subsystem now owns this fd */
+	lane->out_fd = -1;
+}
+
+static void ctdb_tcp_lane_connect_timeout(struct tevent_context *ev,
+					  struct tevent_timer *te,
+					  struct timeval t,
+					  void *private_data)
+{
+	struct ctdb_tcp_lane *lane = talloc_get_type_abort(
+		private_data, struct ctdb_tcp_lane);
+
+	ctdb_tcp_lane_retry(lane);
+}
+
+static void ctdb_tcp_lane_start_outgoing(struct ctdb_tcp_lane *lane)
+{
+	struct ctdb_context *ctdb = lane->node->ctdb;
+
+	lane->out_fd = ctdb_tcp_connect_socket(lane->node);
+	if (lane->out_fd == -1) {
+		ctdb_tcp_lane_retry(lane);
+		return;
+	}
+
+	lane->connect_fde = tevent_add_fd(ctdb->ev,
+					  lane,
+					  lane->out_fd,
+					  TEVENT_FD_WRITE|TEVENT_FD_READ,
+					  ctdb_tcp_lane_connect_write,
+					  lane);
+
+	lane->connect_te = tevent_add_timer(ctdb->ev,
+					    lane,
+					    timeval_current_ofs(1, 0),
+					    ctdb_tcp_lane_connect_timeout,
+					    lane);
+}
+
+static void ctdb_tcp_lane_connect(struct tevent_context *ev,
+				  struct tevent_timer *te,
+				  struct timeval t,
+				  void *private_data)
+{
+	struct ctdb_tcp_lane *lane = talloc_get_type_abort(
+		private_data, struct ctdb_tcp_lane);
+
+	lane->connect_te = NULL;
+	ctdb_tcp_lane_start_outgoing(lane);
+}
+
+/*
+  establish the additional outgoing connections to a node
+ */
+void ctdb_tcp_start_lanes(struct ctdb_node *node)
+{
+	struct ctdb_tcp_node *tnode = talloc_get_type_abort(
+		node->transport_data, struct ctdb_tcp_node);
+	unsigned int i;
+
+	for (i = 0; i < tnode->num_lanes; i++) {
+		struct ctdb_tcp_lane *lane = tnode->lanes[i];
+
+		if (lane->out_queue != NULL || lane->out_fd != -1 ||
+		    lane->connect_te != NULL) {
+			continue;
+		}
+
+		ctdb_tcp_lane_start_outgoing(lane);
+	}
+}
+
+/*
+  stop all additional connections (incoming and outgoing) to a node
+ */
+void ctdb_tcp_stop_lanes(struct ctdb_node *node)
+{
+	struct ctdb_tcp_node *tnode = talloc_get_type_abort(
+		node->transport_data, struct ctdb_tcp_node);
+	unsigned int i;
+
+	for (i = 0; i < tnode->num_lanes; i++) {
+		struct ctdb_tcp_lane *lane = tnode->lanes[i];
+
+		ctdb_tcp_lane_stop_outgoing(lane);
+		TALLOC_FREE(lane->in_queue);
+	}
+}
+
 /*
   called when we get contacted by another node
   currently makes no attempt to check if the connection is really from a ctdb
@@ -311,6 +516,7 @@ static void ctdb_listen_event(struct tevent_context *ev, struct tevent_fd *fde,
 	int fd;
 	struct ctdb_node *node;
 	struct ctdb_tcp_node *tnode;
+	struct ctdb_tcp_lane *lane = NULL;
 	int one = 1;
 	int ret;
 
@@ -343,9 +549,21 @@ static void ctdb_listen_event(struct tevent_context *ev, struct tevent_fd *fde,
 	}
 
 	if (tnode->in_queue != NULL) {
-		DBG_ERR("Incoming queue active, rejecting connection from %s\n",
-			node->name);
-		goto failed;
+		unsigned int i;
+
+		for (i = 0; i < tnode->num_lanes; i++) {
+			if (tnode->lanes[i]->in_queue == NULL) {
+				lane = tnode->lanes[i];
+				break;
+			}
+		}
+
+		if (lane == NULL) {
+			DBG_ERR("Incoming queue active, "
+				"rejecting connection from %s\n",
+				node->name);
+			goto failed;
+		}
 	}
 
 	ret = set_blocking(fd, false);
@@ -369,6 +587,23 @@ static void ctdb_listen_event(struct tevent_context *ev, struct tevent_fd *fde,
 			    strerror(errno));
 	}
 
+	if (lane != NULL) {
+		lane->in_queue = ctdb_queue_setup(ctdb,
+						  lane,
+						  fd,
+						  CTDB_TCP_ALIGNMENT,
+						  ctdb_tcp_lane_read_cb,
+						  lane,
+						  "ctdbd-%s-%u",
+						  node->name,
+						  lane->idx);
+		if (lane->in_queue == NULL) {
+			DBG_ERR("Failed to set up incoming queue\n");
+			goto failed;
+		}
+		return;
+	}
+
 	tnode->in_queue = ctdb_queue_setup(ctdb,
 					   tnode,
 					   fd,
@@ -46,6 +46,16 @@ static int tnode_destructor(struct ctdb_tcp_node *tnode)
 	return 0;
 }
 
+static int lane_destructor(struct ctdb_tcp_lane *lane)
+{
+	if (lane->out_fd != -1) {
+		close(lane->out_fd);
+		lane->out_fd = -1;
+	}
+
+	return 0;
+}
+
 /*
   initialise tcp portion of a ctdb node
 */
@@ -61,6 +71,30 @@ static int ctdb_tcp_add_node(struct ctdb_node *node)
 	node->transport_data = tnode;
 	talloc_set_destructor(tnode, tnode_destructor);
 
+	if (node->ctdb->node_connections > 1) {
+		unsigned int i;
+
+		tnode->num_lanes = node->ctdb->node_connections - 1;
+		tnode->lanes = talloc_zero_array(tnode,
+						 struct ctdb_tcp_lane *,
+						 tnode->num_lanes);
+		CTDB_NO_MEMORY(node->ctdb, tnode->lanes);
+
+		for (i = 0; i < tnode->num_lanes; i++) {
+			struct ctdb_tcp_lane *lane;
+
+			lane = talloc_zero(tnode->lanes, struct ctdb_tcp_lane);
+			CTDB_NO_MEMORY(node->ctdb, lane);
+
+			lane->node = node;
+			lane->idx = i + 1;
+			lane->out_fd = -1;
+			talloc_set_destructor(lane, lane_destructor);
+
+			tnode->lanes[i] = lane;
+		}
+	}
+
 	return 0;
 }
 
@@ -121,6 +155,7 @@ static void ctdb_tcp_restart(struct ctdb_node *node)
 		node->transport_data, struct ctdb_tcp_node);
 
 	DEBUG(DEBUG_NOTICE,("Tearing down connection to dead node :%d\n", node->pnn));
+	ctdb_tcp_stop_lanes(node);
 	ctdb_tcp_stop_incoming(node);
 	ctdb_tcp_stop_outgoing(node);
 
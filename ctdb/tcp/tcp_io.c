@@ -32,41 +32,51 @@
 #include "ctdb_tcp.h"
 
 
-/*
-  called when a complete packet has come in
- */
-void ctdb_tcp_read_cb(uint8_t *data, size_t cnt, void *args)
+static bool ctdb_tcp_pkt_valid(uint8_t *data, size_t cnt)
 {
-	struct ctdb_node *node = talloc_get_type_abort(args, struct ctdb_node);
-	struct ctdb_tcp_node *tnode = talloc_get_type_abort(
-		node->transport_data, struct ctdb_tcp_node);
 	struct ctdb_req_header *hdr = (struct ctdb_req_header *)data;
 
-	if (data == NULL) {
-		/* incoming socket has died */
-		goto failed;
-	}
-
 	if (cnt < sizeof(*hdr)) {
 		DEBUG(DEBUG_ALERT,(__location__ " Bad packet length %u\n", (unsigned)cnt));
-		goto failed;
+		return false;
 	}
 
 	if (cnt & (CTDB_TCP_ALIGNMENT-1)) {
 		DEBUG(DEBUG_ALERT,(__location__ " Length 0x%x not multiple of alignment\n", 
 			 (unsigned)cnt));
-		goto failed;
+		return false;
 	}
 
 	if (hdr->ctdb_magic != CTDB_MAGIC) {
 		DEBUG(DEBUG_ALERT,(__location__ " Non CTDB packet 0x%x rejected\n", 
 			 hdr->ctdb_magic));
-		goto failed;
+		return false;
 	}
 
 	if (hdr->ctdb_version != CTDB_PROTOCOL) {
 		DEBUG(DEBUG_ALERT, (__location__ " Bad CTDB version 0x%x rejected\n", 
 			  hdr->ctdb_version));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+  called when a complete packet has come in
+ */
+void ctdb_tcp_read_cb(uint8_t *data, size_t cnt, void *args)
+{
+	struct ctdb_node *node = talloc_get_type_abort(args, struct ctdb_node);
+	struct ctdb_tcp_node *tnode = talloc_get_type_abort(
+		node->transport_data, struct ctdb_tcp_node);
+
+	if (data == NULL) {
+		/* incoming socket has died */
+		goto failed;
+	}
+
+	if (!ctdb_tcp_pkt_valid(data, cnt)) {
 		goto failed;
 	}
 
@@ -80,6 +90,115 @@ failed:
 	TALLOC_FREE(data);
 }
 
+/*
+  called when a complete packet has come in on an additional connection
+ */
+void ctdb_tcp_lane_read_cb(uint8_t *data, size_t cnt, void *args)
+{
+	struct ctdb_tcp_lane *lane = talloc_get_type_abort(
+		args, struct ctdb_tcp_lane);
+	struct ctdb_node *node = lane->node;
+
+	if (data == NULL) {
+		/*
+		 * The other node re-establishes the connection, this
+		 * does not make the node dead
+		 */
+		TALLOC_FREE(lane->in_queue);
+		return;
+	}
+
+	if (!ctdb_tcp_pkt_valid(data, cnt)) {
+		node->ctdb->upcalls->node_dead(node);
+		TALLOC_FREE(data);
+		return;
+	}
+
+	node->ctdb->upcalls->recv_pkt(node->ctdb, data, cnt);
+}
+
+/*
+ * Record migrations are spread across the additional connections by
+ * database and key.  Everything else uses the main connection, so
+ * that for example control replies never overtake the messages sent
+ * before them.
+ */
+static struct ctdb_queue *ctdb_tcp_select_queue(struct ctdb_tcp_node *tnode,
+						uint8_t *data,
+						uint32_t length)
+{
+	struct ctdb_req_header *hdr = (struct ctdb_req_header *)data;
+	struct ctdb_tcp_lane *lane;
+	TDB_DATA key;
+	uint32_t db_id;
+	uint64_t hash;
+
+	if (tnode->num_lanes == 0 || length < sizeof(*hdr)) {
+		return tnode->out_queue;
+	}
+
+	switch (hdr->operation) {
+	case CTDB_REQ_CALL: {
+		struct ctdb_req_call_old *c =
+			(struct ctdb_req_call_old *)data;
+
+		if (length < offsetof(struct ctdb_req_call_old, data) ||
+		    length - offsetof(struct ctdb_req_call_old, data) <
+		    c->keylen) {
+			return tnode->out_queue;
+		}
+		db_id = c->db_id;
+		key = (TDB_DATA) { .dptr = c->data, .dsize = c->keylen };
+		break;
+	}
+	case CTDB_REQ_DMASTER: {
+		struct ctdb_req_dmaster_old *c =
+			(struct ctdb_req_dmaster_old *)data;
+
+		if (length < offsetof(struct ctdb_req_dmaster_old, data) ||
+		    length - offsetof(struct ctdb_req_dmaster_old, data) <
+		    c->keylen) {
+			return tnode->out_queue;
+		}
+		db_id = c->db_id;
+		key = (TDB_DATA) { .dptr = c->data, .dsize = c->keylen };
+		break;
+	}
+	case CTDB_REPLY_DMASTER: {
+		struct ctdb_reply_dmaster_old *c =
+			(struct ctdb_reply_dmaster_old *)data;
+
+		if (length < offsetof(struct ctdb_reply_dmaster_old, data) ||
+		    length - offsetof(struct ctdb_reply_dmaster_old, data) <
+		    c->keylen) {
+			return tnode->out_queue;
+		}
+		db_id = c->db_id;
+		key = (TDB_DATA) { .dptr = c->data, .dsize = c->keylen };
+		break;
+	}
+	default:
+		return tnode->out_queue;
+	}
+
+	/*
+	 * The lmaster is chosen from the low bits of the same hash,
+	 * so mix it before picking a connection
+	 */
+	hash = (uint64_t)(ctdb_hash(&key) ^ db_id) * 0x9e3779b97f4a7c15ULL;
+	hash = (hash >> 32) % (tnode->num_lanes + 1);
+	if (hash == 0) {
+		return tnode->out_queue;
+	}
+
+	lane = tnode->lanes[hash - 1];
+	if (lane->out_queue == NULL) {
+		return tnode->out_queue;
+	}
+
+	return lane->out_queue;
+}
+
 /*
   queue a packet for sending
 */
@@ -92,5 +211,7 @@ int ctdb_tcp_queue_pkt(struct ctdb_node *node, uint8_t *data, uint32_t length)
 		return 0;
 	}
 
-	return ctdb_queue_send(tnode->out_queue, data, length);
+	return ctdb_queue_send(ctdb_tcp_select_queue(tnode, data, length),
+			       data,
+			       length);
 }
@@ -39,12 +39,17 @@ ok <<EOF
 	# nodes list = 
 	# leader timeout = 5
 	# leader capability = true
+	# node connections = 1
 [database]
 	# volatile database directory = ${database_volatile_dbdir}
 	# persistent database directory = ${database_persistent_dbdir}
 	# state database directory = ${database_state_dbdir}
 	# lock debug script = 
 	# tdb mutexes = true
+	# lock threads = 0
+	# read only lease time = 0
+	# recovery parallelism = 0
+	# vacuum dirty chains = false
 [event]
 	# debug script = 
 [failover]
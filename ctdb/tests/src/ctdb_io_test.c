@@ -22,6 +22,8 @@
 
 #include <assert.h>
 
+#include "lib/util/blocking.h"
+
 #include "common/ctdb_io.c"
 
 void ctdb_set_error(struct ctdb_context *ctdb, const char *fmt, ...)
@@ -320,6 +322,69 @@ static void test4(void)
 	TALLOC_FREE(ctdb);
 }
 
+#define TEST5_NUM_PKTS	8
+#define TEST5_PKT_LEN	32
+
+static void test5(void)
+{
+	struct ctdb_context *ctdb;
+	struct ctdb_queue *queue;
+	uint8_t pkt[TEST5_PKT_LEN];
+	uint8_t buf[4096];
+	int pipefd[2];
+	ssize_t nread = 0;
+	int i, ret;
+
+	ret = pipe(pipefd);
+	assert(ret == 0);
+	set_blocking(pipefd[0], false);
+	set_blocking(pipefd[1], false);
+
+	ctdb = talloc_zero(NULL, struct ctdb_context);
+	assert(ctdb != NULL);
+
+	ctdb->ev = tevent_context_init(ctdb);
+	assert(ctdb->ev != NULL);
+
+	queue = ctdb_queue_setup(ctdb, ctdb, pipefd[1], 0, test_cb,
+				 NULL, "test queue");
+	assert(queue != NULL);
+
+	/* fill the pipe, so that packets get queued */
+	memset(buf, 0, sizeof(buf));
+	do {
+		ret = write(pipefd[1], buf, sizeof(buf));
+	} while (ret > 0);
+	assert(errno == EAGAIN || errno == EWOULDBLOCK);
+
+	for (i = 0; i < TEST5_NUM_PKTS; i++) {
+		memset(pkt, i, sizeof(pkt));
+		*(uint32_t *)pkt = TEST5_PKT_LEN;
+		ret = ctdb_queue_send(queue, pkt, sizeof(pkt));
+		assert(ret == 0);
+	}
+	assert(ctdb_queue_length(queue) == TEST5_NUM_PKTS);
+
+	/* drain the pipe */
+	do {
+		nread = read(pipefd[0], buf, sizeof(buf));
+	} while (nread > 0);
+
+	/* all queued packets are written in one go */
+	tevent_loop_once(ctdb->ev);
+	assert(ctdb_queue_length(queue) == 0);
+
+	for (i = 0; i < TEST5_NUM_PKTS; i++) {
+		nread = read(pipefd[0], pkt, sizeof(pkt));
+		assert(nread == sizeof(pkt));
+		assert(*(uint32_t *)pkt == TEST5_PKT_LEN);
+		assert(pkt[TEST5_PKT_LEN - 1] == i);
+	}
+
+	TALLOC_FREE(ctdb);
+	close(pipefd[0]);
+}
+
 int main(int argc, const char **argv)
 {
 	int num;
@@ -348,6 +413,10 @@ int main(int argc, const char **argv)
 		test4();
 		break;
 
+	case 5:
+		test5();
+		break;
+
 	default:
 		fprintf(stderr, "Unknown test number %s\n", argv[1]);
 	}
@@ -5790,6 +5790,148 @@ static int control_dbstatistics(TALLOC_CTX *mem_ctx, struct ctdb_context *ctdb,
 	return 0;
 }
 
+struct hotkey_entry {
+	const char *db_name;
+	uint32_t count;
+	TDB_DATA key;
+};
+
+static int hotkey_entry_cmp(const void *a, const void *b)
+{
+	const struct hotkey_entry *ka = (const struct hotkey_entry *)a;
+	const struct hotkey_entry *kb = (const struct hotkey_entry *)b;
+
+	if (ka->count > kb->count) {
+		return -1;
+	}
+	if (ka->count < kb->count) {
+		return 1;
+	}
+	return strcmp(ka->db_name, kb->db_name);
+}
+
+static int control_hotkeys(TALLOC_CTX *mem_ctx, struct ctdb_context *ctdb,
+			   int argc, const char **argv)
+{
+	struct ctdb_dbid_map *dbmap;
+	struct hotkey_entry *keys = NULL;
+	unsigned int num_keys = 0;
+	uint32_t match_id = 0;
+	unsigned int i;
+	int ret;
+
+	if (argc > 1) {
+		usage("hotkeys");
+	}
+
+	if (argc == 1) {
+		if (! db_exists(mem_ctx, ctdb, argv[0], &match_id, NULL,
+				NULL)) {
+			return 1;
+		}
+	}
+
+	ret = ctdb_ctrl_get_dbmap(mem_ctx, ctdb->ev, ctdb->client,
+				  ctdb->cmd_pnn, TIMEOUT(), &dbmap);
+	if (ret != 0) {
+		return ret;
+	}
+
+	for (i=0; i<dbmap->num; i++) {
+		struct ctdb_db_statistics *dbstats;
+		const char *name;
+		uint32_t db_id = dbmap->dbs[i].db_id;
+		int j;
+
+		if (argc == 1 && db_id != match_id) {
+			continue;
+		}
+
+		/* Migrations happen only for volatile databases */
+		if (dbmap->dbs[i].flags &
+		    (CTDB_DB_FLAGS_PERSISTENT | CTDB_DB_FLAGS_REPLICATED)) {
+			continue;
+		}
+
+		ret = ctdb_ctrl_get_dbname(mem_ctx, ctdb->ev, ctdb->client,
+					   ctdb->cmd_pnn, TIMEOUT(), db_id,
+					   &name);
+		if (ret != 0) {
+			return ret;
+		}
+
+		ret = ctdb_ctrl_get_db_statistics(mem_ctx, ctdb->ev,
+						  ctdb->client,
+						  ctdb->cmd_pnn, TIMEOUT(),
+						  db_id, &dbstats);
+		if (ret != 0) {
+			fprintf(stderr, "Failed to get statistics for DB %s\n",
+				name);
+			return ret;
+		}
+
+		if (dbstats->num_hot_keys == 0) {
+			continue;
+		}
+
+		keys = talloc_realloc(mem_ctx, keys, struct hotkey_entry,
+				      num_keys + dbstats->num_hot_keys);
+		if (keys == NULL) {
+			return ENOMEM;
+		}
+
+		for (j=0; j<dbstats->num_hot_keys; j++) {
+			if (dbstats->hot_keys[j].count == 0) {
+				continue;
+			}
+			keys[num_keys] = (struct hotkey_entry) {
+				.db_name = name,
+				.count = dbstats->hot_keys[j].count,
+				.key = dbstats->hot_keys[j].key,
+			};
+			num_keys += 1;
+		}
+	}
+
+	if (num_keys > 0) {
+		qsort(keys, num_keys, sizeof(struct hotkey_entry),
+		      hotkey_entry_cmp);
+	}
+
+	if (options.machinereadable == 1) {
+		printf("%s%s%s%s%s%s%s\n",
+		       options.sep,
+		       "Count", options.sep,
+		       "Name", options.sep,
+		       "Key", options.sep);
+	} else {
+		printf("Number of hot keys:%u\n", num_keys);
+	}
+
+	for (i=0; i<num_keys; i++) {
+		size_t j;
+
+		if (options.machinereadable == 1) {
+			printf("%s%u%s%s%s",
+			       options.sep,
+			       keys[i].count, options.sep,
+			       keys[i].db_name, options.sep);
+		} else {
+			printf("Count:%u DB:%s Key:",
+			       keys[i].count, keys[i].db_name);
+		}
+		for (j=0; j<keys[i].key.dsize; j++) {
+			printf("%02x", keys[i].key.dptr[j] & 0xff);
+		}
+		if (options.machinereadable == 1) {
+			printf("%s", options.sep);
+		}
+		printf("\n");
+	}
+
+	return 0;
+}
+
 struct disable_takeover_runs_state {
 	uint32_t *pnn_list;
 	unsigned int node_count;
@@ -6154,6 +6296,8 @@ static const struct ctdb_cmd {
 		"show and return node status", "[all|<pnn-list>]" },
 	{ "dbstatistics", control_dbstatistics, false, true,
 		"show database statistics", "<dbname|dbid>" },
+	{ "hotkeys", control_hotkeys, false, true,
+		"show most migrated records", "[<dbname|dbid>]" },
 	{ "reloadips", control_reloadips, false, false,
 		"reload the public addresses file", "[all|<pnn-list>]" },
 };
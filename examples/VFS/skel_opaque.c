@@ -351,6 +351,42 @@ static int skel_fstatat(
 	return -1;
 }
 
+struct skel_fstatat_state {
+	uint8_t dummy;
+};
+
+static struct tevent_req *skel_fstatat_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct vfs_handle_struct *handle,
+	files_struct *dirfsp,
+	const struct smb_filename *smb_fname,
+	int flags)
+{
+	struct tevent_req *req = NULL;
+	struct skel_fstatat_state *state = NULL;
+
+	req = tevent_req_create(mem_ctx, &state, struct skel_fstatat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	tevent_req_error(req, ENOSYS);
+	return tevent_req_post(req, ev);
+}
+
+static int skel_fstatat_recv(struct tevent_req *req,
+			     struct vfs_aio_state *aio_state,
+			     SMB_STRUCT_STAT *sbuf)
+{
+	if (tevent_req_is_unix_error(req, &aio_state->error)) {
+		tevent_req_received(req);
+		return -1;
+	}
+	tevent_req_received(req);
+	return 0;
+}
+
 static uint64_t skel_get_alloc_size(struct vfs_handle_struct *handle,
 				    struct files_struct *fsp,
 				    const SMB_STRUCT_STAT *sbuf)
@@ -770,6 +806,44 @@ static NTSTATUS skel_get_dos_attributes_recv(struct tevent_req *req,
 	return NT_STATUS_OK;
 }
 
+static struct tevent_req *skel_get_dos_attributes_batch_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct vfs_handle_struct *handle,
+			files_struct *dir_fsp,
+			struct smb_filename **smb_fnames,
+			size_t num_fnames)
+{
+	struct tevent_req *req = NULL;
+	struct skel_get_dos_attributes_state *state = NULL;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct skel_get_dos_attributes_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	tevent_req_nterror(req, NT_STATUS_NOT_IMPLEMENTED);
+	return tevent_req_post(req, ev);
+}
+
+static NTSTATUS skel_get_dos_attributes_batch_recv(
+			struct tevent_req *req,
+			struct vfs_aio_state *aio_state,
+			uint32_t *dosmodes,
+			NTSTATUS *statuses)
+{
+	NTSTATUS status;
+
+	if (tevent_req_is_nterror(req, &status)) {
+		tevent_req_received(req);
+		return status;
+	}
+
+	tevent_req_received(req);
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS skel_fget_dos_attributes(struct vfs_handle_struct *handle,
 				struct files_struct *fsp,
 				uint32_t *dosmode)
@@ -1008,6 +1082,8 @@ static struct vfs_fn_pointers skel_opaque_fns = {
 	.fstat_fn = skel_fstat,
 	.lstat_fn = skel_lstat,
 	.fstatat_fn = skel_fstatat,
+	.fstatat_send_fn = skel_fstatat_send,
+	.fstatat_recv_fn = skel_fstatat_recv,
 	.get_alloc_size_fn = skel_get_alloc_size,
 	.unlinkat_fn = skel_unlinkat,
 	.fchmod_fn = skel_fchmod,
@@ -1053,6 +1129,8 @@ static struct vfs_fn_pointers skel_opaque_fns = {
 	/* DOS attributes. */
 	.get_dos_attributes_send_fn = skel_get_dos_attributes_send,
 	.get_dos_attributes_recv_fn = skel_get_dos_attributes_recv,
+	.get_dos_attributes_batch_send_fn = skel_get_dos_attributes_batch_send,
+	.get_dos_attributes_batch_recv_fn = skel_get_dos_attributes_batch_recv,
 	.fget_dos_attributes_fn = skel_fget_dos_attributes,
 	.fset_dos_attributes_fn = skel_fset_dos_attributes,
 
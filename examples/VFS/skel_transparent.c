@@ -474,6 +474,80 @@ static int skel_fstatat(
 	return SMB_VFS_NEXT_FSTATAT(handle, dirfsp, smb_fname, sbuf, flags);
 }
 
+struct skel_fstatat_state {
+	struct vfs_aio_state aio_state;
+	SMB_STRUCT_STAT sbuf;
+};
+
+static void skel_fstatat_done(struct tevent_req *subreq);
+
+static struct tevent_req *skel_fstatat_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct vfs_handle_struct *handle,
+	files_struct *dirfsp,
+	const struct smb_filename *smb_fname,
+	int flags)
+{
+	struct tevent_req *req = NULL;
+	struct skel_fstatat_state *state = NULL;
+	struct tevent_req *subreq = NULL;
+
+	req = tevent_req_create(mem_ctx, &state, struct skel_fstatat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	subreq = SMB_VFS_NEXT_FSTATAT_SEND(state,
+					   ev,
+					   handle,
+					   dirfsp,
+					   smb_fname,
+					   flags);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, skel_fstatat_done, req);
+
+	return req;
+}
+
+static void skel_fstatat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct skel_fstatat_state *state = tevent_req_data(
+		req, struct skel_fstatat_state);
+	int ret;
+
+	ret = SMB_VFS_NEXT_FSTATAT_RECV(subreq, &state->aio_state, &state->sbuf);
+	TALLOC_FREE(subreq);
+	if (ret == -1) {
+		tevent_req_error(req, state->aio_state.error);
+		return;
+	}
+
+	tevent_req_done(req);
+}
+
+static int skel_fstatat_recv(struct tevent_req *req,
+			     struct vfs_aio_state *aio_state,
+			     SMB_STRUCT_STAT *sbuf)
+{
+	struct skel_fstatat_state *state = tevent_req_data(
+		req, struct skel_fstatat_state);
+
+	if (tevent_req_is_unix_error(req, &aio_state->error)) {
+		tevent_req_received(req);
+		return -1;
+	}
+
+	*aio_state = state->aio_state;
+	*sbuf = state->sbuf;
+	tevent_req_received(req);
+	return 0;
+}
+
 static uint64_t skel_get_alloc_size(struct vfs_handle_struct *handle,
 				    struct files_struct *fsp,
 				    const SMB_STRUCT_STAT *sbuf)
@@ -1033,6 +1107,34 @@ static NTSTATUS skel_get_dos_attributes_recv(struct tevent_req *req,
 	return NT_STATUS_OK;
 }
 
+static struct tevent_req *skel_get_dos_attributes_batch_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct vfs_handle_struct *handle,
+			files_struct *dir_fsp,
+			struct smb_filename **smb_fnames,
+			size_t num_fnames)
+{
+	return SMB_VFS_NEXT_GET_DOS_ATTRIBUTES_BATCH_SEND(mem_ctx,
+							  ev,
+							  handle,
+							  dir_fsp,
+							  smb_fnames,
+							  num_fnames);
+}
+
+static NTSTATUS skel_get_dos_attributes_batch_recv(
+			struct tevent_req *req,
+			struct vfs_aio_state *aio_state,
+			uint32_t *dosmodes,
+			NTSTATUS *statuses)
+{
+	return SMB_VFS_NEXT_GET_DOS_ATTRIBUTES_BATCH_RECV(req,
+							  aio_state,
+							  dosmodes,
+							  statuses);
+}
+
 static NTSTATUS skel_fget_dos_attributes(struct vfs_handle_struct *handle,
 				struct files_struct *fsp,
 				uint32_t *dosmode)
@@ -1319,6 +1421,8 @@ static struct vfs_fn_pointers skel_transparent_fns = {
 	.fstat_fn = skel_fstat,
 	.lstat_fn = skel_lstat,
 	.fstatat_fn = skel_fstatat,
+	.fstatat_send_fn = skel_fstatat_send,
+	.fstatat_recv_fn = skel_fstatat_recv,
 	.get_alloc_size_fn = skel_get_alloc_size,
 	.unlinkat_fn = skel_unlinkat,
 	.fchmod_fn = skel_fchmod,
@@ -1364,6 +1468,8 @@ static struct vfs_fn_pointers skel_transparent_fns = {
 	/* DOS attributes. */
 	.get_dos_attributes_send_fn = skel_get_dos_attributes_send,
 	.get_dos_attributes_recv_fn = skel_get_dos_attributes_recv,
+	.get_dos_attributes_batch_send_fn = skel_get_dos_attributes_batch_send,
+	.get_dos_attributes_batch_recv_fn = skel_get_dos_attributes_batch_recv,
 	.fget_dos_attributes_fn = skel_fget_dos_attributes,
 	.fset_dos_attributes_fn = skel_fset_dos_attributes,
 
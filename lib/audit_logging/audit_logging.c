@@ -32,6 +32,7 @@
 #include "auth/common_auth.h"
 #include "audit_logging.h"
 #include "auth/authn_policy.h"
+#include "lib/util/dlinklist.h"
 
 /*
  * @brief Get a human readable timestamp.
@@ -123,6 +124,14 @@ void audit_log_json(struct json_object* message,
 		return;
 	}
 
+	/*
+	 * Callers also come here when they only want to send the
+	 * message to an event server, don't serialise it for nothing.
+	 */
+	if (!CHECK_DEBUGLVLC(debug_class, debug_level)) {
+		return;
+	}
+
 	frame = talloc_stackframe();
 	s = json_to_string(frame, message);
 	if (s == NULL) {
@@ -206,6 +215,110 @@ static NTSTATUS get_event_server(
 	return NT_STATUS_OBJECT_NAME_NOT_FOUND;
 }
 
+/*
+ * Looking up the event server on every message costs a names.tdb
+ * fetch plus a MSG_PING round over the message bus, which is far
+ * more than the send itself. Remember the server per messaging
+ * context and server name, and only look it up again when the
+ * names database changed or the send failed.
+ */
+struct audit_event_server {
+	struct audit_event_server *prev, *next;
+	struct imessaging_context *msg_ctx;
+	const char *server_name;
+	struct server_id server_id;
+	int names_seqnum;
+};
+
+static struct audit_event_server *audit_event_servers;
+
+static int audit_event_server_destructor(struct audit_event_server *s)
+{
+	DLIST_REMOVE(audit_event_servers, s);
+	return 0;
+}
+
+static struct audit_event_server *audit_event_server_find(
+	struct imessaging_context *msg_ctx,
+	const char *server_name)
+{
+	struct audit_event_server *s = NULL;
+
+	for (s = audit_event_servers; s != NULL; s = s->next) {
+		if ((s->msg_ctx == msg_ctx) &&
+		    (strcmp(s->server_name, server_name) == 0)) {
+			return s;
+		}
+	}
+	return NULL;
+}
+
+static void audit_event_server_forget(struct imessaging_context *msg_ctx,
+				      const char *server_name)
+{
+	struct audit_event_server *s = NULL;
+
+	s = audit_event_server_find(msg_ctx, server_name);
+	TALLOC_FREE(s);
+}
+
+/*
+ * @brief get the messaging event server, using the cached value if the
+ *        names database did not change since it was looked up.
+ *
+ * @param msg_ctx a valid imessaging_context.
+ * @param server_name name of messaging event server to connect to.
+ * @param server_id The event server details to populate
+ *
+ * @return NTSTATUS
+ */
+static NTSTATUS get_cached_event_server(
+	struct imessaging_context *msg_ctx,
+	const char *server_name,
+	struct server_id *event_server)
+{
+	struct audit_event_server *s = NULL;
+	int seqnum = irpc_names_seqnum(msg_ctx);
+	NTSTATUS status;
+
+	s = audit_event_server_find(msg_ctx, server_name);
+	if (s != NULL) {
+		if (s->names_seqnum == seqnum) {
+			*event_server = s->server_id;
+			return NT_STATUS_OK;
+		}
+		TALLOC_FREE(s);
+	}
+
+	status = get_event_server(msg_ctx, server_name, event_server);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
+	/*
+	 * Failing to cache is not fatal, we just look it up again
+	 * next time. The entry goes away with the messaging context.
+	 */
+	s = talloc(msg_ctx, struct audit_event_server);
+	if (s == NULL) {
+		return NT_STATUS_OK;
+	}
+	*s = (struct audit_event_server) {
+		.msg_ctx = msg_ctx,
+		.server_id = *event_server,
+		.names_seqnum = seqnum,
+	};
+	s->server_name = talloc_strdup(s, server_name);
+	if (s->server_name == NULL) {
+		TALLOC_FREE(s);
+		return NT_STATUS_OK;
+	}
+	DLIST_ADD(audit_event_servers, s);
+	talloc_set_destructor(s, audit_event_server_destructor);
+
+	return NT_STATUS_OK;
+}
+
 /*
  * @brief send an audit message to a messaging event server.
  *
@@ -254,17 +367,22 @@ void audit_message_send(
 		return;
 	}
 
-	/* Need to refetch the address each time as the destination server may
-	 * have disconnected and reconnected in the interim, in which case
-	 * messages may get lost
+	/*
+	 * The destination server may have disconnected and reconnected
+	 * in the interim, a new registration changes the names database
+	 * and makes us look it up again.
 	 */
-	status = get_event_server(msg_ctx, server_name, &event_server);
+	status = get_cached_event_server(msg_ctx, server_name, &event_server);
 	if (!NT_STATUS_IS_OK(status)) {
 		TALLOC_FREE(ctx);
 		return;
 	}
 
 	message_string = json_to_string(ctx, message);
+	if (message_string == NULL) {
+		TALLOC_FREE(ctx);
+		return;
+	}
 	message_blob = data_blob_string_const(message_string);
 	status = imessaging_send(
 		msg_ctx,
@@ -276,7 +394,10 @@ void audit_message_send(
 	 * If the server crashed, try to find it again
 	 */
 	if (NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_NOT_FOUND)) {
-		status = get_event_server(msg_ctx, server_name, &event_server);
+		audit_event_server_forget(msg_ctx, server_name);
+		status = get_cached_event_server(msg_ctx,
+						 server_name,
+						 &event_server);
 		if (!NT_STATUS_IS_OK(status)) {
 			TALLOC_FREE(ctx);
 			return;
@@ -32,6 +32,12 @@
 #include "lib/util/byteorder.h"
 #include "lib/util/bytearray.h"
 
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 /*
  * DEBUG_NO_LZ77_MATCHES toggles the encoding of matches as matches. If it is
  * false the potential match is written as a series of literals, which is a
@@ -70,13 +76,22 @@
 #define MAX_MATCH_LENGTH (64 * 1024 * 1024)
 
 
+/*
+ * LZX_HUFF_DECOMP_FAST_BITS is the width of the direct lookup table used to
+ * decode the Huffman codes. Codes that are not longer than this are resolved
+ * with one lookup, longer ones fall back to walking the tree in `table`.
+ */
+#define LZX_HUFF_DECOMP_FAST_BITS 11
+#define LZX_HUFF_DECOMP_FAST_SIZE (1 << LZX_HUFF_DECOMP_FAST_BITS)
+
 struct bitstream {
 	const uint8_t *bytes;
 	size_t byte_pos;
 	size_t byte_size;
-	uint32_t bits;
+	uint64_t bits;
 	int remaining_bits;
 	uint16_t *table;
+	uint16_t *fast_table;
 };
 
 
@@ -118,6 +133,78 @@ static inline int bitlen_nonzero_16(uint16_t x)
 }
 
 
+/*
+ * match_length() returns the number of leading bytes that are the same in
+ * `here` and `there`, up to `max_len`.
+ *
+ * This is where the compressor spends most of its time on compressible data,
+ * so we compare 32 or 16 bytes at a time where the target architecture
+ * guarantees us the vector instructions (AVX2 if the compiler was told to use
+ * it, otherwise SSE2 on x86-64 and NEON on aarch64), then 8 bytes at a time,
+ * then bytewise for the tail.
+ *
+ * `there` is always before `here`, and the regions may overlap.
+ */
+
+static inline size_t match_length(const uint8_t *here,
+				  const uint8_t *there,
+				  size_t max_len)
+{
+	size_t len = 0;
+
+#if defined(__AVX2__) && __has_builtin(__builtin_ctz)
+	while (len + 32 <= max_len) {
+		__m256i a = _mm256_loadu_si256((const __m256i *)(here + len));
+		__m256i b = _mm256_loadu_si256((const __m256i *)(there + len));
+		uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+		if (eq != UINT32_MAX) {
+			return len + __builtin_ctz(~eq);
+		}
+		len += 32;
+	}
+#endif
+#if defined(__SSE2__) && __has_builtin(__builtin_ctz)
+	while (len + 16 <= max_len) {
+		__m128i a = _mm_loadu_si128((const __m128i *)(here + len));
+		__m128i b = _mm_loadu_si128((const __m128i *)(there + len));
+		uint32_t eq = _mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+		if (eq != 0xffff) {
+			return len + __builtin_ctz(~eq);
+		}
+		len += 16;
+	}
+#elif defined(__ARM_NEON) && __has_builtin(__builtin_ctzll)
+	while (len + 16 <= max_len) {
+		uint8x16_t a = vld1q_u8(here + len);
+		uint8x16_t b = vld1q_u8(there + len);
+		uint8x16_t ne = vmvnq_u8(vceqq_u8(a, b));
+		/* narrow each byte to a nibble, giving a 64 bit mask */
+		uint64_t mask = vget_lane_u64(
+			vreinterpret_u64_u8(
+				vshrn_n_u16(vreinterpretq_u16_u8(ne), 4)), 0);
+		if (mask != 0) {
+			return len + (__builtin_ctzll(mask) >> 2);
+		}
+		len += 16;
+	}
+#endif
+#if __has_builtin(__builtin_ctzll)
+	while (len + 8 <= max_len) {
+		uint64_t a = PULL_LE_U64(here, len);
+		uint64_t b = PULL_LE_U64(there, len);
+		if (a != b) {
+			return len + (__builtin_ctzll(a ^ b) >> 3);
+		}
+		len += 8;
+	}
+#endif
+	while (len < max_len && here[len] == there[len]) {
+		len++;
+	}
+	return len;
+}
+
+
 struct lzxhuff_compressor_context {
 	const uint8_t *input_bytes;
 	size_t input_size;
@@ -720,11 +807,18 @@ static inline struct match lookup_match(uint16_t *hash_table,
 			continue;
 		}
 
-		for (len = 0;
-		     len < max_len && here[len] == there[len];
-		     len++) {
-			/* counting */
+		/*
+		 * Most candidates are hash collisions that fail in the first
+		 * three bytes, and we don't want those anyway.
+		 */
+		if (max_len < 3 ||
+		    here[0] != there[0] ||
+		    here[1] != there[1] ||
+		    here[2] != there[2]) {
+			continue;
 		}
+
+		len = match_length(here + 3, there + 3, max_len - 3) + 3;
 		if (len > 2) {
 			/*
 			 * As a tiebreaker, we prefer the closer match which
@@ -1592,6 +1686,14 @@ static bool fill_decomp_table(struct bitstream *input)
 		/* prefill the table head */
 		input->table[i] = 0xffff;
 	}
+	/*
+	 * The fast table is indexed by the next LZX_HUFF_DECOMP_FAST_BITS
+	 * bits of the stream, and holds (length << 9 | symbol) for every
+	 * code that fits in that many bits. Zero means the code is longer
+	 * and has to be found in the tree.
+	 */
+	memset(input->fast_table, 0,
+	       LZX_HUFF_DECOMP_FAST_SIZE * sizeof(input->fast_table[0]));
 	code = -1;
 	prev_len = 0;
 	for (i = 0; i < n_symbols; i++) {
@@ -1609,7 +1711,23 @@ static bool fill_decomp_table(struct bitstream *input)
 		if (code >= 65535) {
 			return false;
 		}
+		if (code > (1 << (len + 1)) - 2) {
+			/*
+			 * There are too many codes of this length. This
+			 * can't be fixed by later symbols, and would
+			 * fail the check at the end.
+			 */
+			return false;
+		}
 		input->table[code] = s;
+		if (len <= LZX_HUFF_DECOMP_FAST_BITS) {
+			size_t shift = LZX_HUFF_DECOMP_FAST_BITS - len;
+			size_t start = (code + 1 - (1 << len)) << shift;
+			size_t j;
+			for (j = 0; j < (1 << shift); j++) {
+				input->fast_table[start + j] = (len << 9) | s;
+			}
+		}
 		for(prefix = (code - 1) >> 1;
 		    prefix > 31;
 		    prefix = (prefix - 1) >> 1) {
@@ -1681,6 +1799,28 @@ static inline ssize_t pull_bits(struct bitstream *input)
 }
 
 
+/*
+ * consume_bits() drops n (<= 16) bits that have already been looked at.
+ *
+ * We always keep at least 16 unread bits in input->bits (the format has the
+ * decoder read a 32 bit word at the start), which means the next code can be
+ * looked up without checking the input. The words are read at the same
+ * points in the stream as if the bits were consumed one by one, which matters
+ * because match lengths are read from the byte stream between the words.
+ */
+static inline ssize_t consume_bits(struct bitstream *input, int n)
+{
+	while (input->remaining_bits - n < 16) {
+		ssize_t ret = pull_bits(input);
+		if (ret) {
+			return ret;
+		}
+	}
+	input->remaining_bits -= n;
+	return 0;
+}
+
+
 /*
  * Decompress a block. The actual decompressed size is returned (or -1 on
  * error). The putative block length is 64k (or shorter, if the message ends
@@ -1724,19 +1864,19 @@ static ssize_t lzx_huffman_decompress_block(struct bitstream *input,
 	input->remaining_bits = 32;
 
 	/*
-	 * This loop iterates over individual *bits*. These are read from
+	 * In this loop we decode one symbol at a time. The bits are read from
 	 * little-endian 16 bit words, most significant bit first.
 	 *
 	 * At points in the bitstream, the following are possible:
 	 *
 	 * # the source word is empty and needs to be refilled from the input
-	 *    stream.
-	 * # an incomplete codeword is being extended.
-	 * # a codeword is resolved, either as a literal or a match.
+	 *    stream (consume_bits() does this).
+	 * # a codeword is resolved, usually with a single lookup in the fast
+	 *   table, otherwise by walking the tree for the remaining bits.
 	 * # a literal is written.
-	 * # a match is collecting distance bits.
-	 * # the output stream is copied, as specified by a match.
 	 * # input bytes are read for match lengths.
+	 * # the distance bits of a match are read.
+	 * # the output stream is copied, as specified by a match.
 	 *
 	 * Note that we *don't* specifically check for the EOF marker (symbol
 	 * 256) in this loop, because the precondition for stopping for the
@@ -1748,64 +1888,89 @@ static ssize_t lzx_huffman_decompress_block(struct bitstream *input,
 
 	index = 0;
 	while (output_pos < block_size) {
-		uint16_t b;
-		if (input->remaining_bits == 16) {
-			ssize_t ret = pull_bits(input);
+		uint16_t entry;
+		size_t peek;
+		ssize_t ret;
+
+		peek = (input->bits >>
+			(input->remaining_bits - LZX_HUFF_DECOMP_FAST_BITS)) &
+			(LZX_HUFF_DECOMP_FAST_SIZE - 1);
+		entry = input->fast_table[peek];
+		if (likely(entry != 0)) {
+			/* a short code, the common case */
+			ret = consume_bits(input, entry >> 9);
 			if (ret) {
 				return ret;
 			}
-		}
-		input->remaining_bits--;
-
-		b = (input->bits >> input->remaining_bits) & 1;
-		if (length == 0) {
-			/* not in a match; pulling a codeword */
-			index <<= 1;
-			index += b + 1;
-			if (input->table[index] == 0xffff) {
-				/* incomplete codeword, the common case */
-				continue;
+			symbol = entry & 511;
+		} else {
+			/*
+			 * A long code. We carry on down the tree from the
+			 * node reached by the bits we have already looked at.
+			 */
+			index = LZX_HUFF_DECOMP_FAST_SIZE - 1 + peek;
+			ret = consume_bits(input, LZX_HUFF_DECOMP_FAST_BITS);
+			if (ret) {
+				return ret;
 			}
-			/* found the symbol, reset the code string */
+			do {
+				uint16_t b;
+				ret = consume_bits(input, 1);
+				if (ret) {
+					return ret;
+				}
+				b = (input->bits >> input->remaining_bits) & 1;
+				index <<= 1;
+				index += b + 1;
+				if (unlikely(index >= 65535)) {
+					return LZXPRESS_ERROR;
+				}
+			} while (input->table[index] == 0xffff);
 			symbol = input->table[index] & 511;
 			index = 0;
-			if (symbol < 256) {
-				/* a literal, the easy case */
-				output[output_pos] = symbol;
-				output_pos++;
-				continue;
-			}
+		}
 
-			/* the beginning of a match */
-			distance_bits_wanted = (symbol >> 4) & 15;
-			distance = 1 << distance_bits_wanted;
-			length = symbol & 15;
-			if (length == 15) {
-				CHECK_READ_8(tmp);
-				length += tmp;
-				if (length == 255 + 15) {
-					/*
-					 * note, we discard (don't add) the
-					 * length so far.
-					 */
-					CHECK_READ_16(length);
-					if (length == 0) {
-						CHECK_READ_32(length);
-					}
+		if (symbol < 256) {
+			/* a literal, the easy case */
+			output[output_pos] = symbol;
+			output_pos++;
+			continue;
+		}
+
+		/* the beginning of a match */
+		distance_bits_wanted = (symbol >> 4) & 15;
+		length = symbol & 15;
+		if (length == 15) {
+			CHECK_READ_8(tmp);
+			length += tmp;
+			if (length == 255 + 15) {
+				/*
+				 * note, we discard (don't add) the
+				 * length so far.
+				 */
+				CHECK_READ_16(length);
+				if (length == 0) {
+					CHECK_READ_32(length);
 				}
 			}
-			length += 3;
-		} else {
-			/* we are pulling extra distance bits */
-			distance_bits_wanted--;
-			distance |= b << distance_bits_wanted;
+		}
+		length += 3;
+
+		/* the extra distance bits */
+		distance = (input->bits >>
+			    (input->remaining_bits - distance_bits_wanted)) &
+			((1 << distance_bits_wanted) - 1);
+		distance |= 1 << distance_bits_wanted;
+		ret = consume_bits(input, distance_bits_wanted);
+		if (ret) {
+			return ret;
 		}
 
-		if (distance_bits_wanted == 0) {
+		{
 			/*
 			 * We have a complete match, and it is time to do the
-			 * copy (byte by byte, because the ranges can overlap,
-			 * and we might need to copy bytes we just copied in).
+			 * copy (byte by byte if the ranges overlap, because
+			 * we might need to copy bytes we just copied in).
 			 *
 			 * It is possible that this match will extend beyond
 			 * the end of the expected block. That's fine, so long
@@ -1820,20 +1985,17 @@ static ssize_t lzx_huffman_decompress_block(struct bitstream *input,
 			    unlikely(end < output_pos || there > here)) {
 				return LZXPRESS_ERROR;
 			}
-			for (i = 0; i < length; i++) {
-				here[i] = there[i];
+			if (distance >= length) {
+				memcpy(here, there, length);
+			} else {
+				for (i = 0; i < length; i++) {
+					here[i] = there[i];
+				}
 			}
 			output_pos += length;
-			distance = 0;
-			length = 0;
 		}
 	}
 
-	if (length != 0 || index != 0) {
-		/* it seems like we've hit an early end, mid-code */
-		return LZXPRESS_ERROR;
-	}
-
 	if (input->byte_pos + 256 < input->byte_size) {
 		/*
 		 * This block is over, but it clearly isn't the last block, so
@@ -1962,13 +2124,15 @@ ssize_t lzxpress_huffman_decompress(const uint8_t *input_bytes,
 				    size_t output_size)
 {
 	uint16_t table[65536];
+	uint16_t fast_table[LZX_HUFF_DECOMP_FAST_SIZE];
 	struct bitstream input = {
 		.bytes = input_bytes,
 		.byte_size = input_size,
 		.byte_pos = 0,
 		.bits = 0,
 		.remaining_bits = 0,
-		.table = table
+		.table = table,
+		.fast_table = fast_table
 	};
 
 	if (input_size > SSIZE_MAX ||
@@ -2032,6 +2196,13 @@ uint8_t *lzxpress_huffman_decompress_talloc(TALLOC_CTX *mem_ctx,
 		talloc_free(output);
 		return NULL;
 	}
+	input.fast_table = talloc_array(input.table, uint16_t,
+					LZX_HUFF_DECOMP_FAST_SIZE);
+	if (input.fast_table == NULL) {
+		talloc_free(input.table);
+		talloc_free(output);
+		return NULL;
+	}
 	result = lzxpress_huffman_decompress_internal(&input,
 						      output,
 						      output_size);
@@ -0,0 +1,309 @@
+/*
+ * Samba compression library - LGPLv3
+ *
+ * Microbenchmark for the LZ77 + Huffman and plain LZ77 compressors.
+ *
+ *  ** NOTE! The following LGPL license applies to this file.
+ *  ** It does NOT imply that all of Samba is released under the LGPL
+ *
+ *  This library is free software; you can redistribute it and/or
+ *  modify it under the terms of the GNU Lesser General Public
+ *  License as published by the Free Software Foundation; either
+ *  version 3 of the License, or (at your option) any later version.
+ *
+ *  This library is distributed in the hope that it will be useful,
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *  Lesser General Public License for more details.
+ *
+ *  You should have received a copy of the GNU Lesser General Public
+ *  License along with this library; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * Usage: bench_lzx_huffman [DIR [ITERATIONS]]
+ *
+ * Every file in DIR (default testdata/compression/decompressed) is
+ * compressed and decompressed ITERATIONS times (default 10) with both
+ * algorithms, and the throughput is reported in MB of uncompressed data
+ * per second.
+ */
+
+#include "replace.h"
+#include <talloc.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <time.h>
+#include "lzxpress.h"
+#include "lzxpress_huffman.h"
+#include "lib/util/data_blob.h"
+
+#define DEFAULT_DIR "testdata/compression/decompressed"
+#define DEFAULT_ITERATIONS 10
+
+struct bench_totals {
+	size_t bytes;
+	size_t compressed;
+	double comp_secs;
+	double decomp_secs;
+};
+
+struct bench_algo {
+	const char *name;
+	ssize_t (*compress)(struct lzxhuff_compressor_mem *cmp_mem,
+			    const uint8_t *input,
+			    size_t input_size,
+			    uint8_t *output,
+			    size_t available_size);
+	ssize_t (*decompress)(const uint8_t *input,
+			      size_t input_size,
+			      uint8_t *output,
+			      size_t output_size);
+	size_t (*max_size)(size_t input_size);
+	struct bench_totals totals;
+};
+
+static ssize_t plain_compress(struct lzxhuff_compressor_mem *cmp_mem,
+			      const uint8_t *input,
+			      size_t input_size,
+			      uint8_t *output,
+			      size_t available_size)
+{
+	return lzxpress_compress(input, input_size, output, available_size);
+}
+
+static ssize_t plain_decompress(const uint8_t *input,
+				size_t input_size,
+				uint8_t *output,
+				size_t output_size)
+{
+	return lzxpress_decompress(input, input_size, output, output_size);
+}
+
+static size_t plain_max_size(size_t input_size)
+{
+	/* one 32 bit indicator per 32 literals, plus slack */
+	return input_size + input_size / 8 + 16;
+}
+
+static double now_secs(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double mb_per_sec(size_t bytes, double secs)
+{
+	if (secs <= 0) {
+		return 0;
+	}
+	return bytes / (secs * 1024 * 1024);
+}
+
+static DATA_BLOB datablob_from_file(TALLOC_CTX *mem_ctx,
+				    const char *filename)
+{
+	DATA_BLOB b = {0};
+	FILE *fh = fopen(filename, "rb");
+	struct stat s;
+	size_t len;
+	int ret;
+
+	if (fh == NULL) {
+		return b;
+	}
+	ret = fstat(fileno(fh), &s);
+	if (ret != 0 || !S_ISREG(s.st_mode) || s.st_size == 0) {
+		fclose(fh);
+		return b;
+	}
+	b.data = talloc_array(mem_ctx, uint8_t, s.st_size);
+	if (b.data == NULL) {
+		fclose(fh);
+		return b;
+	}
+	len = fread(b.data, 1, s.st_size, fh);
+	if (ferror(fh) || len != s.st_size) {
+		TALLOC_FREE(b.data);
+	} else {
+		b.length = len;
+	}
+	fclose(fh);
+	return b;
+}
+
+static bool bench_one(TALLOC_CTX *mem_ctx,
+		      struct lzxhuff_compressor_mem *cmp_mem,
+		      struct bench_algo *algo,
+		      const char *name,
+		      DATA_BLOB data,
+		      unsigned iterations)
+{
+	size_t max_len = algo->max_size(data.length);
+	uint8_t *comp = talloc_array(mem_ctx, uint8_t, max_len);
+	uint8_t *decomp = talloc_array(mem_ctx, uint8_t, data.length);
+	ssize_t comp_len = 0;
+	ssize_t decomp_len = 0;
+	double start, comp_secs, decomp_secs;
+	unsigned i;
+
+	if (comp == NULL || decomp == NULL) {
+		return false;
+	}
+
+	start = now_secs();
+	for (i = 0; i < iterations; i++) {
+		comp_len = algo->compress(cmp_mem,
+					  data.data,
+					  data.length,
+					  comp,
+					  max_len);
+		if (comp_len < 0) {
+			fprintf(stderr, "%s: %s compression failed\n",
+				name, algo->name);
+			return false;
+		}
+	}
+	comp_secs = now_secs() - start;
+
+	start = now_secs();
+	for (i = 0; i < iterations; i++) {
+		decomp_len = algo->decompress(comp,
+					      comp_len,
+					      decomp,
+					      data.length);
+	}
+	decomp_secs = now_secs() - start;
+
+	if (decomp_len != data.length ||
+	    memcmp(decomp, data.data, data.length) != 0) {
+		fprintf(stderr, "%s: %s round trip failed\n",
+			name, algo->name);
+		return false;
+	}
+
+	printf("%-14s %-32s %10zu %10zd %9.2f %9.2f\n",
+	       algo->name,
+	       name,
+	       data.length,
+	       comp_len,
+	       mb_per_sec(data.length * iterations, comp_secs),
+	       mb_per_sec(data.length * iterations, decomp_secs));
+
+	algo->totals.bytes += data.length * iterations;
+	algo->totals.compressed += comp_len * iterations;
+	algo->totals.comp_secs += comp_secs;
+	algo->totals.decomp_secs += decomp_secs;
+	return true;
+}
+
+int main(int argc, const char **argv)
+{
+	const char *dirname = DEFAULT_DIR;
+	unsigned iterations = DEFAULT_ITERATIONS;
+	struct bench_algo algos[] = {
+		{
+			.name = "lz77+huffman",
+			.compress = lzxpress_huffman_compress,
+			.decompress = lzxpress_huffman_decompress,
+			.max_size = lzxpress_huffman_max_compressed_size,
+		},
+		{
+			.name = "lz77",
+			.compress = plain_compress,
+			.decompress = plain_decompress,
+			.max_size = plain_max_size,
+		},
+	};
+	struct lzxhuff_compressor_mem *cmp_mem = NULL;
+	TALLOC_CTX *mem_ctx = NULL;
+	struct dirent *de = NULL;
+	DIR *dir = NULL;
+	size_t a;
+	bool ok = true;
+
+	if (argc > 1) {
+		dirname = argv[1];
+	}
+	if (argc > 2) {
+		iterations = atoi(argv[2]);
+		if (iterations == 0) {
+			fprintf(stderr, "invalid iteration count '%s'\n",
+				argv[2]);
+			return 1;
+		}
+	}
+
+	mem_ctx = talloc_new(NULL);
+	if (mem_ctx == NULL) {
+		return 1;
+	}
+	cmp_mem = talloc(mem_ctx, struct lzxhuff_compressor_mem);
+	if (cmp_mem == NULL) {
+		talloc_free(mem_ctx);
+		return 1;
+	}
+
+	dir = opendir(dirname);
+	if (dir == NULL) {
+		fprintf(stderr, "could not open '%s'\n", dirname);
+		talloc_free(mem_ctx);
+		return 1;
+	}
+
+	printf("%-14s %-32s %10s %10s %9s %9s\n",
+	       "algorithm", "file", "size", "compressed",
+	       "comp MB/s", "dec MB/s");
+
+	while (ok && (de = readdir(dir)) != NULL) {
+		TALLOC_CTX *tmp_ctx = NULL;
+		char *filename = NULL;
+		DATA_BLOB data;
+
+		if (de->d_name[0] == '.') {
+			continue;
+		}
+		tmp_ctx = talloc_new(mem_ctx);
+		if (tmp_ctx == NULL) {
+			ok = false;
+			break;
+		}
+		filename = talloc_asprintf(tmp_ctx, "%s/%s",
+					   dirname, de->d_name);
+		if (filename == NULL) {
+			ok = false;
+			break;
+		}
+		data = datablob_from_file(tmp_ctx, filename);
+		if (data.data == NULL) {
+			/* not a regular file, or empty */
+			talloc_free(tmp_ctx);
+			continue;
+		}
+		for (a = 0; ok && a < ARRAY_SIZE(algos); a++) {
+			ok = bench_one(tmp_ctx,
+				       cmp_mem,
+				       &algos[a],
+				       de->d_name,
+				       data,
+				       iterations);
+		}
+		talloc_free(tmp_ctx);
+	}
+	closedir(dir);
+
+	for (a = 0; a < ARRAY_SIZE(algos); a++) {
+		struct bench_totals *t = &algos[a].totals;
+		printf("%-14s %-32s %10zu %10zu %9.2f %9.2f\n",
+		       algos[a].name,
+		       "TOTAL",
+		       t->bytes,
+		       t->compressed,
+		       mb_per_sec(t->bytes, t->comp_secs),
+		       mb_per_sec(t->bytes, t->decomp_secs));
+	}
+
+	talloc_free(mem_ctx);
+	return ok ? 0 : 1;
+}
@@ -564,6 +564,61 @@ NTSTATUS dbwrap_parse_record_recv(struct tevent_req *req)
 	return tevent_req_simple_recv_ntstatus(req);
 }
 
+struct dbwrap_parse_records_batch_state {
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data);
+	void *private_data;
+	size_t idx;
+};
+
+static void dbwrap_parse_records_batch_parser(
+	TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct dbwrap_parse_records_batch_state *state = private_data;
+	state->parser(state->idx, key, data, state->private_data);
+}
+
+static void dbwrap_batch_null_parser(
+	size_t idx, TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	return;
+}
+
+NTSTATUS dbwrap_parse_records_batch(
+	struct db_context *db,
+	const TDB_DATA *keys,
+	size_t num_keys,
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data),
+	void *private_data,
+	NTSTATUS *statuses)
+{
+	struct dbwrap_parse_records_batch_state state = {
+		.parser = parser,
+		.private_data = private_data,
+	};
+
+	if (parser == NULL) {
+		parser = dbwrap_batch_null_parser;
+		state.parser = parser;
+	}
+
+	if (db->parse_records_batch != NULL) {
+		return db->parse_records_batch(
+			db, keys, num_keys, parser, private_data, statuses);
+	}
+
+	for (state.idx = 0; state.idx < num_keys; state.idx++) {
+		statuses[state.idx] = db->parse_record(
+			db,
+			keys[state.idx],
+			dbwrap_parse_records_batch_parser,
+			&state);
+	}
+
+	return NT_STATUS_OK;
+}
+
 NTSTATUS dbwrap_do_locked(struct db_context *db, TDB_DATA key,
 			  void (*fn)(struct db_record *rec,
 				     TDB_DATA value,
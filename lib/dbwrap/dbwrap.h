@@ -150,6 +150,39 @@ struct tevent_req *dbwrap_parse_record_send(
 	void *private_data,
 	enum dbwrap_req_state *req_state);
 NTSTATUS dbwrap_parse_record_recv(struct tevent_req *req);
+
+/**
+ * Look up many records in one call
+ *
+ * @param[in]  db           Database to query
+ *
+ * @param[in]  keys         Array of record keys
+ *
+ * @param[in]  num_keys     Number of keys
+ *
+ * @param[in]  parser       Called for every record found, idx is the
+ *                          position of the record's key in keys
+ *
+ * @param[in]  private_data Private data for the callback function
+ *
+ * @param[out] statuses     Array of num_keys NTSTATUS values, receives
+ *                          the dbwrap_parse_record() result for every key.
+ *
+ * @note The backend resolves the keys in the order that is cheapest for
+ * it, so the parser is not called in key order. The same restrictions as
+ * for dbwrap_parse_record() parsers apply: don't call back into the db.
+ *
+ * @return NT_STATUS_OK if every key has been looked up, regardless of
+ * whether it was found.
+ **/
+NTSTATUS dbwrap_parse_records_batch(
+	struct db_context *db,
+	const TDB_DATA *keys,
+	size_t num_keys,
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data),
+	void *private_data,
+	NTSTATUS *statuses);
 int dbwrap_wipe(struct db_context *db);
 int dbwrap_check(struct db_context *db);
 int dbwrap_get_seqnum(struct db_context *db);
@@ -0,0 +1,1512 @@
+/*
+   Unix SMB/CIFS implementation.
+   Database interface wrapper around an adaptive radix tree
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * This is a drop-in replacement for dbwrap_rbt. Keys are stored in an
+ * adaptive radix tree (Leis et al, "The Adaptive Radix Tree: ARTful
+ * Indexing for Main-Memory Databases") with inner nodes of fan-out 4,
+ * 16, 48 and 256 and path compression. Leaves hold key and value in
+ * one piece of memory, like the db_rbt_node does.
+ *
+ * Inner nodes and leaves are carved out of large talloc chunks instead
+ * of being individual talloc objects. Freed memory goes to a freelist
+ * per 16-byte size class and is reused for the next allocation of the
+ * same size. Memory is only given back when the database is wiped or
+ * freed.
+ *
+ * A key that ends in the middle of the tree (a prefix of other keys)
+ * is attached to the inner node where it ends. This makes in-order
+ * traversal produce the same order as dbwrap_rbt: bytewise, shorter
+ * keys first.
+ */
+
+#include "includes.h"
+#include "dbwrap/dbwrap.h"
+#include "dbwrap/dbwrap_private.h"
+#include "dbwrap/dbwrap_art.h"
+
+#define DBWRAP_ART_ALIGN(_size_) (((_size_)+15)&~15)
+
+#define DBWRAP_ART_CHUNK (64*1024)
+#define DBWRAP_ART_ARENA_MAX 4096
+#define DBWRAP_ART_ARENA_CLASSES (DBWRAP_ART_ARENA_MAX/16)
+
+/*
+ * Number of compressed path bytes stored in the node itself. Longer
+ * paths are checked against a leaf below the node.
+ */
+#define DBWRAP_ART_PREFIX_MAX 12
+
+enum db_art_node_type {
+	DB_ART_NODE4 = 0,
+	DB_ART_NODE16,
+	DB_ART_NODE48,
+	DB_ART_NODE256,
+};
+
+struct db_art_ctx {
+	void *root;
+	uint8_t *chunk;
+	size_t chunk_used;
+	void *freelist[DBWRAP_ART_ARENA_CLASSES];
+	size_t traverse_read;
+	bool traverse_rw;
+};
+
+struct db_art_rec {
+	struct db_art_leaf *leaf;
+};
+
+/*
+ * Children and the per-node "key ends here" slot point either at
+ * another db_art_node or, with the lowest bit set, at a leaf.
+ */
+
+struct db_art_leaf {
+	size_t keysize, valuesize, valuecap;
+};
+
+struct db_art_node {
+	uint8_t type;
+	uint16_t num_children;
+	size_t prefix_len;
+	uint8_t prefix[DBWRAP_ART_PREFIX_MAX];
+	void *leaf;
+};
+
+struct db_art_node4 {
+	struct db_art_node n;
+	uint8_t keys[4];
+	void *children[4];
+};
+
+struct db_art_node16 {
+	struct db_art_node n;
+	uint8_t keys[16];
+	void *children[16];
+};
+
+struct db_art_node48 {
+	struct db_art_node n;
+	uint8_t index[256];	/* 0 is empty, otherwise slot+1 */
+	void *children[48];
+};
+
+struct db_art_node256 {
+	struct db_art_node n;
+	void *children[256];
+};
+
+static bool db_art_is_leaf(const void *p)
+{
+	return ((uintptr_t)p & 1) != 0;
+}
+
+static struct db_art_leaf *db_art_to_leaf(const void *p)
+{
+	return (struct db_art_leaf *)((uintptr_t)p & ~(uintptr_t)1);
+}
+
+static void *db_art_from_leaf(struct db_art_leaf *leaf)
+{
+	return (void *)((uintptr_t)leaf | 1);
+}
+
+/*
+ * Arena allocator. Everything handed out is 16-byte aligned, which
+ * leaves the lowest pointer bit free for the leaf tag.
+ */
+
+static void *db_art_alloc(struct db_art_ctx *ctx, size_t size)
+{
+	size_t cls;
+	void *p;
+
+	size = DBWRAP_ART_ALIGN(size);
+
+	if (size > DBWRAP_ART_ARENA_MAX) {
+		return talloc_size(ctx, size);
+	}
+
+	cls = size/16 - 1;
+
+	p = ctx->freelist[cls];
+	if (p != NULL) {
+		ctx->freelist[cls] = *(void **)p;
+		return p;
+	}
+
+	if ((ctx->chunk == NULL) ||
+	    (DBWRAP_ART_CHUNK - ctx->chunk_used < size)) {
+		uint8_t *chunk = talloc_size(ctx, DBWRAP_ART_CHUNK);
+		if (chunk == NULL) {
+			return NULL;
+		}
+		ctx->chunk = chunk;
+		ctx->chunk_used = 0;
+	}
+
+	p = ctx->chunk + ctx->chunk_used;
+	ctx->chunk_used += size;
+	return p;
+}
+
+static void db_art_free(struct db_art_ctx *ctx, void *p, size_t size)
+{
+	size_t cls;
+
+	size = DBWRAP_ART_ALIGN(size);
+
+	if (size > DBWRAP_ART_ARENA_MAX) {
+		talloc_free(p);
+		return;
+	}
+
+	cls = size/16 - 1;
+	*(void **)p = ctx->freelist[cls];
+	ctx->freelist[cls] = p;
+}
+
+/*
+ * Compare two keys, same order as dbwrap_rbt
+ */
+
+static int db_art_compare(TDB_DATA a, TDB_DATA b)
+{
+	int res;
+
+	res = memcmp(a.dptr, b.dptr, MIN(a.dsize, b.dsize));
+
+	if ((res < 0) || ((res == 0) && (a.dsize < b.dsize))) {
+		return -1;
+	}
+	if ((res > 0) || ((res == 0) && (a.dsize > b.dsize))) {
+		return 1;
+	}
+	return 0;
+}
+
+/*
+ * dissect a db_art_leaf into its implicit key and value parts
+ */
+
+static void db_art_parse_leaf(struct db_art_leaf *leaf,
+			      TDB_DATA *key, TDB_DATA *value)
+{
+	size_t key_offset, value_offset;
+
+	key_offset = DBWRAP_ART_ALIGN(sizeof(struct db_art_leaf));
+	key->dptr = ((uint8_t *)leaf) + key_offset;
+	key->dsize = leaf->keysize;
+
+	value_offset = DBWRAP_ART_ALIGN(leaf->keysize);
+	value->dptr = key->dptr + value_offset;
+	value->dsize = leaf->valuesize;
+}
+
+static TDB_DATA db_art_leaf_key(struct db_art_leaf *leaf)
+{
+	TDB_DATA key, value;
+	db_art_parse_leaf(leaf, &key, &value);
+	return key;
+}
+
+static ssize_t db_art_leaflen(size_t keylen, size_t valuelen)
+{
+	size_t len, tmp;
+
+	len = DBWRAP_ART_ALIGN(sizeof(struct db_art_leaf));
+
+	tmp = DBWRAP_ART_ALIGN(keylen);
+	if (tmp < keylen) {
+		goto overflow;
+	}
+
+	len += tmp;
+	if (len < tmp) {
+		goto overflow;
+	}
+
+	len += valuelen;
+	if (len < valuelen) {
+		goto overflow;
+	}
+
+	tmp = DBWRAP_ART_ALIGN(len);
+	if (tmp < len) {
+		goto overflow;
+	}
+
+	return tmp;
+overflow:
+	return -1;
+}
+
+static void db_art_free_leaf(struct db_art_ctx *ctx, struct db_art_leaf *leaf)
+{
+	db_art_free(ctx, leaf, db_art_leaflen(leaf->keysize, leaf->valuecap));
+}
+
+static size_t db_art_node_size(uint8_t type)
+{
+	switch (type) {
+	case DB_ART_NODE4:
+		return sizeof(struct db_art_node4);
+	case DB_ART_NODE16:
+		return sizeof(struct db_art_node16);
+	case DB_ART_NODE48:
+		return sizeof(struct db_art_node48);
+	case DB_ART_NODE256:
+		return sizeof(struct db_art_node256);
+	}
+	smb_panic("invalid art node type");
+	return 0;
+}
+
+static struct db_art_node *db_art_node_new(struct db_art_ctx *ctx,
+					   uint8_t type)
+{
+	size_t size = db_art_node_size(type);
+	struct db_art_node *n;
+
+	n = db_art_alloc(ctx, size);
+	if (n == NULL) {
+		return NULL;
+	}
+	memset(n, 0, size);
+	n->type = type;
+	return n;
+}
+
+static void db_art_node_free(struct db_art_ctx *ctx, struct db_art_node *n)
+{
+	db_art_free(ctx, n, db_art_node_size(n->type));
+}
+
+/*
+ * Carry the common header over when a node changes its size
+ */
+static void db_art_copy_header(struct db_art_node *dst,
+			       const struct db_art_node *src)
+{
+	dst->num_children = src->num_children;
+	dst->prefix_len = src->prefix_len;
+	memcpy(dst->prefix, src->prefix, sizeof(dst->prefix));
+	dst->leaf = src->leaf;
+}
+
+static void db_art_set_prefix(struct db_art_node *n,
+			      const uint8_t *prefix, size_t len)
+{
+	n->prefix_len = len;
+	memcpy(n->prefix, prefix, MIN(len, DBWRAP_ART_PREFIX_MAX));
+}
+
+static void **db_art_find_child(struct db_art_node *n, uint8_t c)
+{
+	uint16_t i;
+
+	switch (n->type) {
+	case DB_ART_NODE4: {
+		struct db_art_node4 *n4 = (struct db_art_node4 *)n;
+		for (i=0; i<n->num_children; i++) {
+			if (n4->keys[i] == c) {
+				return &n4->children[i];
+			}
+		}
+		break;
+	}
+	case DB_ART_NODE16: {
+		struct db_art_node16 *n16 = (struct db_art_node16 *)n;
+		for (i=0; i<n->num_children; i++) {
+			if (n16->keys[i] == c) {
+				return &n16->children[i];
+			}
+		}
+		break;
+	}
+	case DB_ART_NODE48: {
+		struct db_art_node48 *n48 = (struct db_art_node48 *)n;
+		if (n48->index[c] != 0) {
+			return &n48->children[n48->index[c]-1];
+		}
+		break;
+	}
+	case DB_ART_NODE256: {
+		struct db_art_node256 *n256 = (struct db_art_node256 *)n;
+		if (n256->children[c] != NULL) {
+			return &n256->children[c];
+		}
+		break;
+	}
+	}
+	return NULL;
+}
+
+/*
+ * Return the first child with a key byte > c, or with c == -1 the
+ * first child at all
+ */
+static void *db_art_child_after(struct db_art_node *n, int c)
+{
+	uint16_t i;
+	int cc;
+
+	switch (n->type) {
+	case DB_ART_NODE4: {
+		struct db_art_node4 *n4 = (struct db_art_node4 *)n;
+		for (i=0; i<n->num_children; i++) {
+			if (n4->keys[i] > c) {
+				return n4->children[i];
+			}
+		}
+		break;
+	}
+	case DB_ART_NODE16: {
+		struct db_art_node16 *n16 = (struct db_art_node16 *)n;
+		for (i=0; i<n->num_children; i++) {
+			if (n16->keys[i] > c) {
+				return n16->children[i];
+			}
+		}
+		break;
+	}
+	case DB_ART_NODE48: {
+		struct db_art_node48 *n48 = (struct db_art_node48 *)n;
+		for (cc=c+1; cc<256; cc++) {
+			if (n48->index[cc] != 0) {
+				return n48->children[n48->index[cc]-1];
+			}
+		}
+		break;
+	}
+	case DB_ART_NODE256: {
+		struct db_art_node256 *n256 = (struct db_art_node256 *)n;
+		for (cc=c+1; cc<256; cc++) {
+			if (n256->children[cc] != NULL) {
+				return n256->children[cc];
+			}
+		}
+		break;
+	}
+	}
+	return NULL;
+}
+
+/*
+ * The smallest key below p. Every inner node has a leaf or at least
+ * one child, so this always finds something.
+ */
+static struct db_art_leaf *db_art_minimum(const void *p)
+{
+	while (!db_art_is_leaf(p)) {
+		struct db_art_node *n = discard_const_p(struct db_art_node, p);
+		if (n->leaf != NULL) {
+			return db_art_to_leaf(n->leaf);
+		}
+		p = db_art_child_after(n, -1);
+	}
+	return db_art_to_leaf(p);
+}
+
+/*
+ * The compressed path of n starting at key offset depth. Only the
+ * first DBWRAP_ART_PREFIX_MAX bytes live in the node, the rest is
+ * taken from any leaf below it.
+ */
+static const uint8_t *db_art_full_prefix(struct db_art_node *n, size_t depth)
+{
+	if (n->prefix_len <= DBWRAP_ART_PREFIX_MAX) {
+		return n->prefix;
+	}
+	return db_art_leaf_key(db_art_minimum(n)).dptr + depth;
+}
+
+/*
+ * Number of bytes of n's compressed path that match key at depth
+ */
+static size_t db_art_prefix_match(struct db_art_node *n,
+				  TDB_DATA key, size_t depth)
+{
+	size_t max = MIN(n->prefix_len, key.dsize - depth);
+	const uint8_t *prefix = n->prefix;
+	size_t i;
+
+	for (i=0; i<max; i++) {
+		if (i == DBWRAP_ART_PREFIX_MAX) {
+			prefix = db_art_full_prefix(n, depth);
+		}
+		if (prefix[i] != key.dptr[depth+i]) {
+			break;
+		}
+	}
+	return i;
+}
+
+static void db_art_insert_sorted(uint8_t *keys, void **children,
+				 uint16_t num, uint8_t c, void *child)
+{
+	uint16_t i = 0;
+
+	while ((i < num) && (keys[i] < c)) {
+		i++;
+	}
+	memmove(keys+i+1, keys+i, num-i);
+	memmove(children+i+1, children+i, (num-i) * sizeof(void *));
+	keys[i] = c;
+	children[i] = child;
+}
+
+/*
+ * Add a child to *ref, growing the node if it's full. Nothing changes
+ * if we're out of memory.
+ */
+static bool db_art_add_child(struct db_art_ctx *ctx, void **ref,
+			     uint8_t c, void *child)
+{
+	struct db_art_node *n = *ref;
+	struct db_art_node *grown;
+	uint16_t i;
+
+	switch (n->type) {
+	case DB_ART_NODE4: {
+		struct db_art_node4 *n4 = (struct db_art_node4 *)n;
+		struct db_art_node16 *n16;
+
+		if (n->num_children < ARRAY_SIZE(n4->keys)) {
+			db_art_insert_sorted(n4->keys, n4->children,
+					     n->num_children, c, child);
+			n->num_children++;
+			return true;
+		}
+
+		grown = db_art_node_new(ctx, DB_ART_NODE16);
+		if (grown == NULL) {
+			return false;
+		}
+		db_art_copy_header(grown, n);
+		n16 = (struct db_art_node16 *)grown;
+		memcpy(n16->keys, n4->keys, sizeof(n4->keys));
+		memcpy(n16->children, n4->children, sizeof(n4->children));
+		break;
+	}
+	case DB_ART_NODE16: {
+		struct db_art_node16 *n16 = (struct db_art_node16 *)n;
+		struct db_art_node48 *n48;
+
+		if (n->num_children < ARRAY_SIZE(n16->keys)) {
+			db_art_insert_sorted(n16->keys, n16->children,
+					     n->num_children, c, child);
+			n->num_children++;
+			return true;
+		}
+
+		grown = db_art_node_new(ctx, DB_ART_NODE48);
+		if (grown == NULL) {
+			return false;
+		}
+		db_art_copy_header(grown, n);
+		n48 = (struct db_art_node48 *)grown;
+		for (i=0; i<n->num_children; i++) {
+			n48->children[i] = n16->children[i];
+			n48->index[n16->keys[i]] = i+1;
+		}
+		break;
+	}
+	case DB_ART_NODE48: {
+		struct db_art_node48 *n48 = (struct db_art_node48 *)n;
+		struct db_art_node256 *n256;
+		int cc;
+
+		if (n->num_children < ARRAY_SIZE(n48->children)) {
+			for (i=0; n48->children[i] != NULL; i++) {
+				;
+			}
+			n48->children[i] = child;
+			n48->index[c] = i+1;
+			n->num_children++;
+			return true;
+		}
+
+		grown = db_art_node_new(ctx, DB_ART_NODE256);
+		if (grown == NULL) {
+			return false;
+		}
+		db_art_copy_header(grown, n);
+		n256 = (struct db_art_node256 *)grown;
+		for (cc=0; cc<256; cc++) {
+			if (n48->index[cc] != 0) {
+				n256->children[cc] =
+					n48->children[n48->index[cc]-1];
+			}
+		}
+		break;
+	}
+	case DB_ART_NODE256: {
+		struct db_art_node256 *n256 = (struct db_art_node256 *)n;
+		n256->children[c] = child;
+		n->num_children++;
+		return true;
+	}
+	default:
+		smb_panic("invalid art node type");
+		return false;
+	}
+
+	db_art_node_free(ctx, n);
+	*ref = grown;
+
+	return db_art_add_child(ctx, ref, c, child);
+}
+
+/*
+ * A node4 with a single child and no leaf of its own is merged into
+ * the child, a node4 without children is replaced by its leaf.
+ */
+static void db_art_collapse(struct db_art_ctx *ctx, void **ref)
+{
+	struct db_art_node *n = *ref;
+	struct db_art_node4 *n4 = (struct db_art_node4 *)n;
+	struct db_art_node *child;
+	uint8_t buf[DBWRAP_ART_PREFIX_MAX];
+	size_t len;
+
+	if (n->type != DB_ART_NODE4) {
+		return;
+	}
+
+	if (n->num_children == 0) {
+		*ref = n->leaf;
+		db_art_node_free(ctx, n);
+		return;
+	}
+
+	if ((n->num_children != 1) || (n->leaf != NULL)) {
+		return;
+	}
+
+	if (db_art_is_leaf(n4->children[0])) {
+		*ref = n4->children[0];
+		db_art_node_free(ctx, n);
+		return;
+	}
+
+	child = n4->children[0];
+
+	len = MIN(n->prefix_len, DBWRAP_ART_PREFIX_MAX);
+	memcpy(buf, n->prefix, len);
+	if (len < DBWRAP_ART_PREFIX_MAX) {
+		buf[len++] = n4->keys[0];
+	}
+	if (len < DBWRAP_ART_PREFIX_MAX) {
+		size_t tocopy = MIN(child->prefix_len,
+				    DBWRAP_ART_PREFIX_MAX - len);
+		memcpy(buf + len, child->prefix, tocopy);
+		len += tocopy;
+	}
+	memcpy(child->prefix, buf, len);
+	child->prefix_len += n->prefix_len + 1;
+
+	*ref = child;
+	db_art_node_free(ctx, n);
+}
+
+static void db_art_remove_child(struct db_art_ctx *ctx, void **ref,
+				uint8_t c)
+{
+	struct db_art_node *n = *ref;
+	struct db_art_node *shrunk = NULL;
+	uint16_t i, j;
+	int cc;
+
+	switch (n->type) {
+	case DB_ART_NODE4: {
+		struct db_art_node4 *n4 = (struct db_art_node4 *)n;
+
+		for (i=0; n4->keys[i] != c; i++) {
+			;
+		}
+		n->num_children--;
+		memmove(n4->keys+i, n4->keys+i+1, n->num_children-i);
+		memmove(n4->children+i, n4->children+i+1,
+			(n->num_children-i) * sizeof(void *));
+
+		db_art_collapse(ctx, ref);
+		return;
+	}
+	case DB_ART_NODE16: {
+		struct db_art_node16 *n16 = (struct db_art_node16 *)n;
+		struct db_art_node4 *n4;
+
+		for (i=0; n16->keys[i] != c; i++) {
+			;
+		}
+		n->num_children--;
+		memmove(n16->keys+i, n16->keys+i+1, n->num_children-i);
+		memmove(n16->children+i, n16->children+i+1,
+			(n->num_children-i) * sizeof(void *));
+
+		if (n->num_children > 3) {
+			return;
+		}
+		shrunk = db_art_node_new(ctx, DB_ART_NODE4);
+		if (shrunk == NULL) {
+			/* Just leave the bigger node around */
+			return;
+		}
+		db_art_copy_header(shrunk, n);
+		n4 = (struct db_art_node4 *)shrunk;
+		memcpy(n4->keys, n16->keys, n->num_children);
+		memcpy(n4->children, n16->children,
+		       n->num_children * sizeof(void *));
+		break;
+	}
+	case DB_ART_NODE48: {
+		struct db_art_node48 *n48 = (struct db_art_node48 *)n;
+		struct db_art_node16 *n16;
+
+		n48->children[n48->index[c]-1] = NULL;
+		n48->index[c] = 0;
+		n->num_children--;
+
+		if (n->num_children > 12) {
+			return;
+		}
+		shrunk = db_art_node_new(ctx, DB_ART_NODE16);
+		if (shrunk == NULL) {
+			return;
+		}
+		db_art_copy_header(shrunk, n);
+		n16 = (struct db_art_node16 *)shrunk;
+		for (cc=0, j=0; cc<256; cc++) {
+			if (n48->index[cc] != 0) {
+				n16->keys[j] = cc;
+				n16->children[j] =
+					n48->children[n48->index[cc]-1];
+				j++;
+			}
+		}
+		break;
+	}
+	case DB_ART_NODE256: {
+		struct db_art_node256 *n256 = (struct db_art_node256 *)n;
+		struct db_art_node48 *n48;
+
+		n256->children[c] = NULL;
+		n->num_children--;
+
+		if (n->num_children > 37) {
+			return;
+		}
+		shrunk = db_art_node_new(ctx, DB_ART_NODE48);
+		if (shrunk == NULL) {
+			return;
+		}
+		db_art_copy_header(shrunk, n);
+		n48 = (struct db_art_node48 *)shrunk;
+		for (cc=0, j=0; cc<256; cc++) {
+			if (n256->children[cc] != NULL) {
+				n48->children[j] = n256->children[cc];
+				n48->index[cc] = j+1;
+				j++;
+			}
+		}
+		break;
+	}
+	default:
+		smb_panic("invalid art node type");
+		return;
+	}
+
+	db_art_node_free(ctx, n);
+	*ref = shrunk;
+}
+
+/*
+ * Find the slot pointing at the leaf for key
+ */
+static void **db_art_find_ref(struct db_art_ctx *ctx, TDB_DATA key)
+{
+	void **ref = &ctx->root;
+	size_t depth = 0;
+
+	while (*ref != NULL) {
+		struct db_art_node *n;
+
+		if (db_art_is_leaf(*ref)) {
+			TDB_DATA leafkey = db_art_leaf_key(db_art_to_leaf(*ref));
+			if (db_art_compare(key, leafkey) == 0) {
+				return ref;
+			}
+			return NULL;
+		}
+
+		n = *ref;
+
+		if (n->prefix_len != 0) {
+			/*
+			 * Only check the bytes we have in the node, the
+			 * final key compare catches the rest
+			 */
+			if (key.dsize - depth < n->prefix_len) {
+				return NULL;
+			}
+			if (memcmp(n->prefix, key.dptr + depth,
+				   MIN(n->prefix_len,
+				       DBWRAP_ART_PREFIX_MAX)) != 0) {
+				return NULL;
+			}
+			depth += n->prefix_len;
+		}
+
+		if (depth == key.dsize) {
+			TDB_DATA leafkey;
+			if (n->leaf == NULL) {
+				return NULL;
+			}
+			leafkey = db_art_leaf_key(db_art_to_leaf(n->leaf));
+			if (db_art_compare(key, leafkey) == 0) {
+				return &n->leaf;
+			}
+			return NULL;
+		}
+
+		ref = db_art_find_child(n, key.dptr[depth]);
+		if (ref == NULL) {
+			return NULL;
+		}
+		depth += 1;
+	}
+	return NULL;
+}
+
+/*
+ * Two different keys meet at a leaf: Put a node4 in there that holds
+ * both of them
+ */
+static bool db_art_split_leaf(struct db_art_ctx *ctx, void **ref,
+			      size_t depth, void *newp, TDB_DATA key)
+{
+	TDB_DATA oldkey = db_art_leaf_key(db_art_to_leaf(*ref));
+	struct db_art_node *n;
+	struct db_art_node4 *n4;
+	size_t max, i;
+
+	max = MIN(oldkey.dsize, key.dsize) - depth;
+
+	for (i=0; i<max; i++) {
+		if (oldkey.dptr[depth+i] != key.dptr[depth+i]) {
+			break;
+		}
+	}
+
+	n = db_art_node_new(ctx, DB_ART_NODE4);
+	if (n == NULL) {
+		return false;
+	}
+	n4 = (struct db_art_node4 *)n;
+
+	db_art_set_prefix(n, key.dptr + depth, i);
+	depth += i;
+
+	if (oldkey.dsize == depth) {
+		n->leaf = *ref;
+	} else {
+		db_art_insert_sorted(n4->keys, n4->children, n->num_children,
+				     oldkey.dptr[depth], *ref);
+		n->num_children++;
+	}
+
+	if (key.dsize == depth) {
+		n->leaf = newp;
+	} else {
+		db_art_insert_sorted(n4->keys, n4->children, n->num_children,
+				     key.dptr[depth], newp);
+		n->num_children++;
+	}
+
+	*ref = n;
+	return true;
+}
+
+/*
+ * key diverges from the compressed path of *ref after "matched"
+ * bytes: Put a node4 above it with the common part of the path
+ */
+static bool db_art_split_prefix(struct db_art_ctx *ctx, void **ref,
+				size_t depth, size_t matched,
+				void *newp, TDB_DATA key)
+{
+	struct db_art_node *n = *ref;
+	struct db_art_node *split;
+	struct db_art_node4 *s4;
+	const uint8_t *prefix;
+	size_t remaining;
+	uint8_t c;
+
+	split = db_art_node_new(ctx, DB_ART_NODE4);
+	if (split == NULL) {
+		return false;
+	}
+	s4 = (struct db_art_node4 *)split;
+
+	db_art_set_prefix(split, n->prefix, matched);
+
+	prefix = db_art_full_prefix(n, depth);
+	c = prefix[matched];
+	remaining = n->prefix_len - matched - 1;
+	memmove(n->prefix, prefix + matched + 1,
+		MIN(remaining, DBWRAP_ART_PREFIX_MAX));
+	n->prefix_len = remaining;
+
+	db_art_insert_sorted(s4->keys, s4->children, split->num_children,
+			     c, n);
+	split->num_children++;
+
+	if (key.dsize == depth + matched) {
+		split->leaf = newp;
+	} else {
+		db_art_insert_sorted(s4->keys, s4->children,
+				     split->num_children,
+				     key.dptr[depth + matched], newp);
+		split->num_children++;
+	}
+
+	*ref = split;
+	return true;
+}
+
+/*
+ * Link a new leaf into the tree. The key must not be there yet.
+ */
+static bool db_art_insert(struct db_art_ctx *ctx, struct db_art_leaf *leaf)
+{
+	TDB_DATA key = db_art_leaf_key(leaf);
+	void *newp = db_art_from_leaf(leaf);
+	void **ref = &ctx->root;
+	size_t depth = 0;
+
+	for (;;) {
+		struct db_art_node *n;
+		void **child;
+
+		if (*ref == NULL) {
+			*ref = newp;
+			return true;
+		}
+
+		if (db_art_is_leaf(*ref)) {
+			return db_art_split_leaf(ctx, ref, depth, newp, key);
+		}
+
+		n = *ref;
+
+		if (n->prefix_len != 0) {
+			size_t matched = db_art_prefix_match(n, key, depth);
+			if (matched < n->prefix_len) {
+				return db_art_split_prefix(
+					ctx, ref, depth, matched, newp, key);
+			}
+			depth += n->prefix_len;
+		}
+
+		if (depth == key.dsize) {
+			SMB_ASSERT(n->leaf == NULL);
+			n->leaf = newp;
+			return true;
+		}
+
+		child = db_art_find_child(n, key.dptr[depth]);
+		if (child == NULL) {
+			return db_art_add_child(ctx, ref, key.dptr[depth],
+						newp);
+		}
+		ref = child;
+		depth += 1;
+	}
+}
+
+/*
+ * Unlink the leaf for key from the tree. The key must be there.
+ */
+static void db_art_remove(struct db_art_ctx *ctx, TDB_DATA key)
+{
+	void **ref = &ctx->root;
+	size_t depth = 0;
+
+	for (;;) {
+		struct db_art_node *n;
+		void **child;
+		uint8_t c;
+
+		if (db_art_is_leaf(*ref)) {
+			*ref = NULL;
+			return;
+		}
+
+		n = *ref;
+		depth += n->prefix_len;
+
+		if (depth == key.dsize) {
+			n->leaf = NULL;
+			db_art_collapse(ctx, ref);
+			return;
+		}
+
+		c = key.dptr[depth];
+		child = db_art_find_child(n, c);
+		SMB_ASSERT(child != NULL);
+
+		if (db_art_is_leaf(*child)) {
+			db_art_remove_child(ctx, ref, c);
+			return;
+		}
+		ref = child;
+		depth += 1;
+	}
+}
+
+/*
+ * The smallest leaf below p with a key > key. All keys below p share
+ * the first depth bytes with key.
+ */
+static struct db_art_leaf *db_art_next(void *p, TDB_DATA key, size_t depth)
+{
+	struct db_art_node *n;
+	struct db_art_leaf *leaf;
+	void **child;
+	void *next;
+	uint8_t c;
+
+	if (p == NULL) {
+		return NULL;
+	}
+
+	if (db_art_is_leaf(p)) {
+		leaf = db_art_to_leaf(p);
+		if (db_art_compare(db_art_leaf_key(leaf), key) > 0) {
+			return leaf;
+		}
+		return NULL;
+	}
+
+	n = p;
+
+	if (n->prefix_len != 0) {
+		const uint8_t *prefix = db_art_full_prefix(n, depth);
+		size_t i;
+
+		for (i=0; i<n->prefix_len; i++) {
+			if (depth + i == key.dsize) {
+				/* Everything below n extends key */
+				return db_art_minimum(n);
+			}
+			if (prefix[i] > key.dptr[depth + i]) {
+				return db_art_minimum(n);
+			}
+			if (prefix[i] < key.dptr[depth + i]) {
+				return NULL;
+			}
+		}
+		depth += n->prefix_len;
+	}
+
+	if (depth == key.dsize) {
+		/* n->leaf is key itself, all children are bigger */
+		next = db_art_child_after(n, -1);
+		return (next != NULL) ? db_art_minimum(next) : NULL;
+	}
+
+	c = key.dptr[depth];
+
+	child = db_art_find_child(n, c);
+	if (child != NULL) {
+		leaf = db_art_next(*child, key, depth + 1);
+		if (leaf != NULL) {
+			return leaf;
+		}
+	}
+
+	next = db_art_child_after(n, c);
+	return (next != NULL) ? db_art_minimum(next) : NULL;
+}
+
+static NTSTATUS db_art_storev(struct db_record *rec,
+			      const TDB_DATA *dbufs, int num_dbufs, int flag)
+{
+	struct db_art_ctx *db_ctx = talloc_get_type_abort(
+		rec->db->private_data, struct db_art_ctx);
+	struct db_art_rec *rec_priv = (struct db_art_rec *)rec->private_data;
+	struct db_art_leaf *leaf;
+	ssize_t reclen;
+	TDB_DATA data, this_key, this_val;
+	void *to_free = NULL;
+
+	if (db_ctx->traverse_read > 0) {
+		return NT_STATUS_MEDIA_WRITE_PROTECTED;
+	}
+
+	if ((flag == TDB_INSERT) && (rec_priv->leaf != NULL)) {
+		return NT_STATUS_OBJECT_NAME_COLLISION;
+	}
+
+	if ((flag == TDB_MODIFY) && (rec_priv->leaf == NULL)) {
+		return NT_STATUS_OBJECT_NAME_NOT_FOUND;
+	}
+
+	if (num_dbufs == 1) {
+		data = dbufs[0];
+	} else {
+		NTSTATUS status;
+
+		data = (TDB_DATA) {0};
+		status = dbwrap_merge_dbufs(&data, rec, dbufs, num_dbufs);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+		to_free = data.dptr;
+	}
+
+	if ((rec_priv->leaf != NULL) && (rec_priv->leaf->valuecap >= data.dsize)) {
+		/*
+		 * The new value fits into the old space
+		 */
+		db_art_parse_leaf(rec_priv->leaf, &this_key, &this_val);
+		if (data.dsize > 0) {
+			memcpy(this_val.dptr, data.dptr, data.dsize);
+		}
+		rec_priv->leaf->valuesize = data.dsize;
+		TALLOC_FREE(to_free);
+		return NT_STATUS_OK;
+	}
+
+	reclen = db_art_leaflen(rec->key.dsize, data.dsize);
+	if (reclen == -1) {
+		TALLOC_FREE(to_free);
+		return NT_STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	leaf = db_art_alloc(db_ctx, reclen);
+	if (leaf == NULL) {
+		TALLOC_FREE(to_free);
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	leaf->keysize = rec->key.dsize;
+	leaf->valuesize = data.dsize;
+	leaf->valuecap = data.dsize;
+
+	db_art_parse_leaf(leaf, &this_key, &this_val);
+
+	/*
+	 * rec->key might point into the old leaf, copy before freeing it
+	 */
+	memcpy(this_key.dptr, rec->key.dptr, leaf->keysize);
+	if (leaf->valuesize > 0) {
+		memcpy(this_val.dptr, data.dptr, leaf->valuesize);
+	}
+	TALLOC_FREE(to_free);
+
+	if (rec_priv->leaf != NULL) {
+		void **ref = db_art_find_ref(db_ctx, this_key);
+
+		SMB_ASSERT(ref != NULL);
+		SMB_ASSERT(db_art_to_leaf(*ref) == rec_priv->leaf);
+
+		*ref = db_art_from_leaf(leaf);
+		db_art_free_leaf(db_ctx, rec_priv->leaf);
+	} else if (!db_art_insert(db_ctx, leaf)) {
+		db_art_free_leaf(db_ctx, leaf);
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	rec_priv->leaf = leaf;
+	rec->key = this_key;
+
+	return NT_STATUS_OK;
+}
+
+static NTSTATUS db_art_delete(struct db_record *rec)
+{
+	struct db_art_ctx *db_ctx = talloc_get_type_abort(
+		rec->db->private_data, struct db_art_ctx);
+	struct db_art_rec *rec_priv = (struct db_art_rec *)rec->private_data;
+
+	if (db_ctx->traverse_read > 0) {
+		return NT_STATUS_MEDIA_WRITE_PROTECTED;
+	}
+
+	if (rec_priv->leaf == NULL) {
+		return NT_STATUS_OK;
+	}
+
+	db_art_remove(db_ctx, rec->key);
+	db_art_free_leaf(db_ctx, rec_priv->leaf);
+	rec_priv->leaf = NULL;
+
+	return NT_STATUS_OK;
+}
+
+static struct db_art_leaf *db_art_search(struct db_context *db, TDB_DATA key)
+{
+	struct db_art_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_art_ctx);
+	void **ref = db_art_find_ref(ctx, key);
+
+	if (ref == NULL) {
+		return NULL;
+	}
+	return db_art_to_leaf(*ref);
+}
+
+static struct db_record *db_art_fetch_locked(struct db_context *db_ctx,
+					     TALLOC_CTX *mem_ctx,
+					     TDB_DATA key)
+{
+	struct db_art_rec *rec_priv;
+	struct db_record *result;
+	struct db_art_leaf *leaf;
+	size_t size;
+
+	leaf = db_art_search(db_ctx, key);
+
+	/*
+	 * One talloc for the record, the private part and the key, as
+	 * in dbwrap_rbt
+	 */
+
+	size = DBWRAP_ART_ALIGN(sizeof(struct db_record))
+		+ sizeof(struct db_art_rec);
+
+	if (leaf == NULL) {
+		/*
+		 * We need to keep the key around for later store
+		 */
+		size += key.dsize;
+	}
+
+	result = (struct db_record *)talloc_size(mem_ctx, size);
+	if (result == NULL) {
+		return NULL;
+	}
+
+	rec_priv = (struct db_art_rec *)
+		((char *)result + DBWRAP_ART_ALIGN(sizeof(struct db_record)));
+
+	result->storev = db_art_storev;
+	result->delete_rec = db_art_delete;
+	result->private_data = rec_priv;
+	result->value_valid = true;
+
+	rec_priv->leaf = leaf;
+
+	if (leaf != NULL) {
+		db_art_parse_leaf(leaf, &result->key, &result->value);
+	} else {
+		result->value = (TDB_DATA) { .dptr = NULL };
+		result->key.dptr = (uint8_t *)
+			((char *)rec_priv + sizeof(*rec_priv));
+		result->key.dsize = key.dsize;
+		memcpy(result->key.dptr, key.dptr, key.dsize);
+	}
+
+	return result;
+}
+
+static int db_art_exists(struct db_context *db, TDB_DATA key)
+{
+	return db_art_search(db, key) != NULL;
+}
+
+static int db_art_wipe(struct db_context *db)
+{
+	struct db_art_ctx *old_ctx = talloc_get_type_abort(
+		db->private_data, struct db_art_ctx);
+	struct db_art_ctx *new_ctx = talloc_zero(db, struct db_art_ctx);
+	if (new_ctx == NULL) {
+		return -1;
+	}
+	db->private_data = new_ctx;
+	talloc_free(old_ctx);
+	return 0;
+}
+
+static NTSTATUS db_art_parse_record(struct db_context *db, TDB_DATA key,
+				    void (*parser)(TDB_DATA key, TDB_DATA data,
+						   void *private_data),
+				    void *private_data)
+{
+	struct db_art_leaf *leaf = db_art_search(db, key);
+	TDB_DATA leafkey, value;
+
+	if (leaf == NULL) {
+		return NT_STATUS_NOT_FOUND;
+	}
+	db_art_parse_leaf(leaf, &leafkey, &value);
+	parser(leafkey, value, private_data);
+	return NT_STATUS_OK;
+}
+
+static int db_art_traverse_leaf(struct db_context *db,
+				struct db_art_leaf *leaf,
+				int (*f)(struct db_record *db,
+					 void *private_data),
+				void *private_data, uint32_t *count)
+{
+	struct db_record rec;
+	struct db_art_rec rec_priv = { .leaf = leaf };
+	int ret;
+
+	ZERO_STRUCT(rec);
+	rec.db = db;
+	rec.private_data = &rec_priv;
+	rec.storev = db_art_storev;
+	rec.delete_rec = db_art_delete;
+	db_art_parse_leaf(leaf, &rec.key, &rec.value);
+	rec.value_valid = true;
+
+	ret = f(&rec, private_data);
+	(*count) ++;
+	return ret;
+}
+
+/*
+ * Recursive in-order walk, only valid if nobody modifies the tree
+ */
+static int db_art_traverse_node(struct db_context *db, void *p,
+				int (*f)(struct db_record *db,
+					 void *private_data),
+				void *private_data, uint32_t *count)
+{
+	struct db_art_node *n;
+	int ret;
+	int c;
+
+	if (db_art_is_leaf(p)) {
+		return db_art_traverse_leaf(db, db_art_to_leaf(p),
+					    f, private_data, count);
+	}
+
+	n = p;
+
+	if (n->leaf != NULL) {
+		ret = db_art_traverse_leaf(db, db_art_to_leaf(n->leaf),
+					   f, private_data, count);
+		if (ret != 0) {
+			return ret;
+		}
+	}
+
+	switch (n->type) {
+	case DB_ART_NODE4: {
+		struct db_art_node4 *n4 = (struct db_art_node4 *)n;
+		for (c=0; c<n->num_children; c++) {
+			ret = db_art_traverse_node(db, n4->children[c],
+						   f, private_data, count);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+		break;
+	}
+	case DB_ART_NODE16: {
+		struct db_art_node16 *n16 = (struct db_art_node16 *)n;
+		for (c=0; c<n->num_children; c++) {
+			ret = db_art_traverse_node(db, n16->children[c],
+						   f, private_data, count);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+		break;
+	}
+	case DB_ART_NODE48: {
+		struct db_art_node48 *n48 = (struct db_art_node48 *)n;
+		for (c=0; c<256; c++) {
+			if (n48->index[c] == 0) {
+				continue;
+			}
+			ret = db_art_traverse_node(
+				db, n48->children[n48->index[c]-1],
+				f, private_data, count);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+		break;
+	}
+	case DB_ART_NODE256: {
+		struct db_art_node256 *n256 = (struct db_art_node256 *)n;
+		for (c=0; c<256; c++) {
+			if (n256->children[c] == NULL) {
+				continue;
+			}
+			ret = db_art_traverse_node(db, n256->children[c],
+						   f, private_data, count);
+			if (ret != 0) {
+				return ret;
+			}
+		}
+		break;
+	}
+	}
+
+	return 0;
+}
+
+static int db_art_traverse_read(struct db_context *db,
+				int (*f)(struct db_record *db,
+					 void *private_data),
+				void *private_data)
+{
+	struct db_art_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_art_ctx);
+	uint32_t count = 0;
+	int ret = 0;
+
+	ctx->traverse_read++;
+	if (ctx->root != NULL) {
+		ret = db_art_traverse_node(db, ctx->root,
+					   f, private_data, &count);
+	}
+	ctx->traverse_read--;
+	if (ret != 0) {
+		return -1;
+	}
+	if (count > INT_MAX) {
+		return -1;
+	}
+	return count;
+}
+
+static int db_art_traverse(struct db_context *db,
+			   int (*f)(struct db_record *db,
+				    void *private_data),
+			   void *private_data)
+{
+	struct db_art_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_art_ctx);
+	struct db_art_leaf *leaf = NULL;
+	uint8_t *keybuf = NULL;
+	uint32_t count = 0;
+	int ret = 0;
+
+	if (ctx->traverse_rw) {
+		return -1;
+	};
+
+	if (ctx->traverse_read > 0) {
+		return db_art_traverse_read(db, f, private_data);
+	}
+
+	/*
+	 * f may delete or store records. Remember the current key and
+	 * look up its successor from the root after each call.
+	 */
+
+	ctx->traverse_rw = true;
+
+	if (ctx->root != NULL) {
+		leaf = db_art_minimum(ctx->root);
+	}
+
+	while (leaf != NULL) {
+		TDB_DATA key = db_art_leaf_key(leaf);
+
+		keybuf = talloc_realloc(db, keybuf, uint8_t,
+					MAX(key.dsize, 1));
+		if (keybuf == NULL) {
+			ret = -1;
+			break;
+		}
+		memcpy(keybuf, key.dptr, key.dsize);
+		key.dptr = keybuf;
+
+		ret = db_art_traverse_leaf(db, leaf, f, private_data, &count);
+		if (ret != 0) {
+			break;
+		}
+
+		leaf = db_art_next(ctx->root, key, 0);
+	}
+
+	ctx->traverse_rw = false;
+	TALLOC_FREE(keybuf);
+
+	if (ret != 0) {
+		return -1;
+	}
+	if (count > INT_MAX) {
+		return -1;
+	}
+	return count;
+}
+
+static int db_art_get_seqnum(struct db_context *db)
+{
+	return 0;
+}
+
+static int db_art_trans_dummy(struct db_context *db)
+{
+	/*
+	 * Transactions are pretty pointless in-memory, just return success.
+	 */
+	return 0;
+}
+
+static size_t db_art_id(struct db_context *db, uint8_t *id, size_t idlen)
+{
+	if (idlen >= sizeof(struct db_context *)) {
+		memcpy(id, &db, sizeof(struct db_context *));
+	}
+	return sizeof(struct db_context *);
+}
+
+struct db_context *db_open_art(TALLOC_CTX *mem_ctx)
+{
+	struct db_context *result;
+
+	result = talloc_zero(mem_ctx, struct db_context);
+
+	if (result == NULL) {
+		return NULL;
+	}
+
+	result->private_data = talloc_zero(result, struct db_art_ctx);
+
+	if (result->private_data == NULL) {
+		TALLOC_FREE(result);
+		return NULL;
+	}
+
+	result->fetch_locked = db_art_fetch_locked;
+	result->traverse = db_art_traverse;
+	result->traverse_read = db_art_traverse_read;
+	result->get_seqnum = db_art_get_seqnum;
+	result->transaction_start = db_art_trans_dummy;
+	result->transaction_commit = db_art_trans_dummy;
+	result->transaction_cancel = db_art_trans_dummy;
+	result->exists = db_art_exists;
+	result->wipe = db_art_wipe;
+	result->parse_record = db_art_parse_record;
+	result->id = db_art_id;
+	result->name = "dbwrap art";
+
+	return result;
+}
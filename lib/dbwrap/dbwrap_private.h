@@ -66,6 +66,14 @@ struct db_context {
 		void *private_data,
 		enum dbwrap_req_state *req_state);
 	NTSTATUS (*parse_record_recv)(struct tevent_req *req);
+	NTSTATUS (*parse_records_batch)(
+		struct db_context *db,
+		const TDB_DATA *keys,
+		size_t num_keys,
+		void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+			       void *private_data),
+		void *private_data,
+		NTSTATUS *statuses);
 	NTSTATUS (*do_locked)(struct db_context *db, TDB_DATA key,
 			      void (*fn)(struct db_record *rec,
 					 TDB_DATA value,
@@ -21,6 +21,7 @@
 #include "dbwrap/dbwrap.h"
 #include "dbwrap/dbwrap_private.h"
 #include "dbwrap/dbwrap_rbt.h"
+#include "dbwrap/dbwrap_art.h"
 #include "../lib/util/rbtree.h"
 #include "../lib/util/dlinklist.h"
 
@@ -587,3 +588,15 @@ struct db_context *db_open_rbt(TALLOC_CTX *mem_ctx)
 
 	return result;
 }
+
+struct db_context *db_open_rbt_backend(TALLOC_CTX *mem_ctx,
+				       enum dbwrap_rbt_backend backend)
+{
+	switch (backend) {
+	case DBWRAP_RBT_BACKEND_RBTREE:
+		return db_open_rbt(mem_ctx);
+	case DBWRAP_RBT_BACKEND_ART:
+		return db_open_art(mem_ctx);
+	}
+	return NULL;
+}
@@ -26,4 +26,18 @@ struct db_context;
 
 struct db_context *db_open_rbt(TALLOC_CTX *mem_ctx);
 
+/*
+ * In-memory databases come in two flavours with identical semantics
+ * and traverse order: The red-black tree behind db_open_rbt() and an
+ * adaptive radix tree with arena-allocated nodes, which is kinder to
+ * the CPU caches for large databases.
+ */
+enum dbwrap_rbt_backend {
+	DBWRAP_RBT_BACKEND_RBTREE = 0,
+	DBWRAP_RBT_BACKEND_ART,
+};
+
+struct db_context *db_open_rbt_backend(TALLOC_CTX *mem_ctx,
+				       enum dbwrap_rbt_backend backend);
+
 #endif /* __DBWRAP_RBT_H__ */
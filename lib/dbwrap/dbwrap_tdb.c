@@ -28,6 +28,7 @@
 #include "system/filesys.h"
 #include "lib/param/param.h"
 #include "libcli/util/error.h"
+#include "lib/util/tsort.h"
 
 struct db_tdb_ctx {
 	struct tdb_wrap *wtdb;
@@ -278,6 +279,106 @@ static NTSTATUS db_tdb_parse(struct db_context *db, TDB_DATA key,
 	return NT_STATUS_OK;
 }
 
+struct db_tdb_batch_key {
+	unsigned int chain;
+	size_t idx;
+};
+
+static int db_tdb_batch_key_cmp(const struct db_tdb_batch_key *k1,
+				const struct db_tdb_batch_key *k2)
+{
+	if (k1->chain != k2->chain) {
+		return NUMERIC_CMP(k1->chain, k2->chain);
+	}
+	return NUMERIC_CMP(k1->idx, k2->idx);
+}
+
+struct db_tdb_batch_parse_state {
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data);
+	void *private_data;
+	size_t idx;
+};
+
+static int db_tdb_batch_parser(TDB_DATA key, TDB_DATA data,
+			       void *private_data)
+{
+	struct db_tdb_batch_parse_state *state =
+		(struct db_tdb_batch_parse_state *)private_data;
+	state->parser(state->idx, key, data, state->private_data);
+	return 0;
+}
+
+/*
+ * Look up the keys sorted by hash chain. All keys of a chain are
+ * parsed under one chain read lock, the tdb_parse_record() calls just
+ * nest into that lock.
+ */
+static NTSTATUS db_tdb_parse_records_batch(
+	struct db_context *db,
+	const TDB_DATA *keys,
+	size_t num_keys,
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data),
+	void *private_data,
+	NTSTATUS *statuses)
+{
+	struct db_tdb_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_tdb_ctx);
+	struct tdb_context *tdb = ctx->wtdb->tdb;
+	struct db_tdb_batch_parse_state state = {
+		.parser = parser,
+		.private_data = private_data,
+	};
+	struct db_tdb_batch_key *sorted = NULL;
+	size_t i;
+
+	sorted = talloc_array(db, struct db_tdb_batch_key, num_keys);
+	if (sorted == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	for (i=0; i<num_keys; i++) {
+		sorted[i] = (struct db_tdb_batch_key) {
+			.chain = tdb_hash_chain(tdb, keys[i]),
+			.idx = i,
+		};
+	}
+	TYPESAFE_QSORT(sorted, num_keys, db_tdb_batch_key_cmp);
+
+	i = 0;
+	while (i < num_keys) {
+		unsigned int chain = sorted[i].chain;
+		bool locked;
+		int ret;
+
+		ret = tdb_chainlock_read(tdb, keys[sorted[i].idx]);
+		locked = (ret == 0);
+
+		for (; (i < num_keys) && (sorted[i].chain == chain); i++) {
+			state.idx = sorted[i].idx;
+
+			ret = tdb_parse_record(tdb,
+					       keys[state.idx],
+					       db_tdb_batch_parser,
+					       &state);
+			if (ret != 0) {
+				statuses[state.idx] = map_nt_error_from_tdb(
+					tdb_error(tdb));
+				continue;
+			}
+			statuses[state.idx] = NT_STATUS_OK;
+		}
+
+		if (locked) {
+			tdb_chainunlock_read(tdb, keys[sorted[i-1].idx]);
+		}
+	}
+
+	TALLOC_FREE(sorted);
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS db_tdb_storev(struct db_record *rec,
 			      const TDB_DATA *dbufs, int num_dbufs, int flag)
 {
@@ -499,6 +600,7 @@ struct db_context *db_open_tdb(TALLOC_CTX *mem_ctx,
 	result->traverse = db_tdb_traverse;
 	result->traverse_read = db_tdb_traverse_read;
 	result->parse_record = db_tdb_parse;
+	result->parse_records_batch = db_tdb_parse_records_batch;
 	result->get_seqnum = db_tdb_get_seqnum;
 	result->persistent = ((tdb_flags & TDB_CLEAR_IF_FIRST) == 0);
 	result->transaction_start = db_tdb_transaction_start;
@@ -220,12 +220,22 @@ int samba_ldb_connect(struct ldb_context *ldb, struct loadparm_context *lp_ctx,
 {
 	int ret;
 	char *real_url = NULL;
+	const char *options[] = { NULL, NULL };
 
 	/* allow admins to force non-sync ldb for all databases */
 	if (lpcfg_parm_bool(lp_ctx, NULL, "ldb", "nosync", false)) {
 		flags |= LDB_FLG_NOSYNC;
 	}
 
+	/*
+	 * Keep the LMDB read transaction handles between searches,
+	 * for the many small lookups of the KDC and LDAP server
+	 */
+	if (lpcfg_parm_bool(lp_ctx, NULL, "ldb", "reuse read transactions",
+			    false)) {
+		options[0] = "lmdb_reuse_read_txn";
+	}
+
 	if (DEBUGLVL(10)) {
 		flags |= LDB_FLG_ENABLE_TRACING;
 	}
@@ -235,7 +245,7 @@ int samba_ldb_connect(struct ldb_context *ldb, struct loadparm_context *lp_ctx,
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	ret = ldb_connect(ldb, real_url, flags, NULL);
+	ret = ldb_connect(ldb, real_url, flags, options);
 
 	if (ret != LDB_SUCCESS) {
 		return ret;
@@ -91,6 +91,9 @@ int ldb_schema_attribute_add_with_syntax(struct ldb_context *ldb,
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
+	/* The case folding of DN components may change */
+	ldb_dn_cache_flush(ldb);
+
 	n = ldb->schema.num_attributes + 1;
 
 	a = talloc_realloc(ldb, ldb->schema.attributes,
@@ -237,6 +240,8 @@ void ldb_schema_attribute_remove(struct ldb_context *ldb, const char *name)
 		return;
 	}
 
+	ldb_dn_cache_flush(ldb);
+
 	if (a->flags & LDB_ATTR_FLAG_ALLOCATED) {
 		talloc_free(discard_const_p(char, a->name));
 	}
@@ -259,6 +264,8 @@ void ldb_schema_attribute_remove_flagged(struct ldb_context *ldb, unsigned int f
 {
 	ptrdiff_t i;
 
+	ldb_dn_cache_flush(ldb);
+
 	for (i = 0; i < ldb->schema.num_attributes;) {
 		const struct ldb_schema_attribute *a
 			= &ldb->schema.attributes[i];
@@ -382,6 +389,7 @@ void ldb_schema_attribute_set_override_handler(struct ldb_context *ldb,
 {
 	ldb->schema.attribute_handler_override_private = private_data;
 	ldb->schema.attribute_handler_override = override;
+	ldb_dn_cache_flush(ldb);
 }
 
 /*
@@ -77,12 +77,203 @@ struct ldb_dn {
 
 	unsigned int ext_comp_num;
 	struct ldb_dn_ext_component *ext_components;
+
+	/*
+	 * Non-zero if the components are those of the ldb_dn_cache
+	 * entry with this id, see ldb_dn_compare()
+	 */
+	uint64_t cache_id;
 };
 
 /* it is helpful to be able to break on this in gdb */
 static void ldb_dn_mark_invalid(struct ldb_dn *dn)
 {
 	dn->invalid = true;
+	dn->cache_id = 0;
+}
+
+/*
+ * Cache of exploded and case folded DNs.
+ *
+ * Samba explodes and case folds the same DN strings over and over,
+ * e.g. for every linked attribute value. Once a DN is case folded its
+ * components are remembered in a small direct mapped table on the
+ * ldb context, so the next ldb_dn_explode() of the same string only
+ * copies them.
+ *
+ * A DN is only added once it was seen twice, so a stream of distinct
+ * DNs does not pay for copying them into the table.
+ *
+ * Each entry has an id that is never reused. DNs built from the same
+ * entry carry its id, so ldb_dn_compare() can tell they are equal
+ * without looking at the components.
+ */
+#define LDB_DN_CACHE_SIZE 1024
+
+struct ldb_dn_cache_entry {
+	uint64_t id;
+	char *linearized;
+	unsigned int comp_num;
+	struct ldb_dn_component *components;
+};
+
+struct ldb_dn_cache {
+	uint64_t next_id;
+	struct ldb_dn_cache_entry *slots[LDB_DN_CACHE_SIZE];
+	/* hash of the last DN not added to each slot */
+	uint32_t seen[LDB_DN_CACHE_SIZE];
+};
+
+static struct ldb_dn_component ldb_dn_copy_component(
+						TALLOC_CTX *mem_ctx,
+						struct ldb_dn_component *src);
+
+static uint32_t ldb_dn_cache_hash(const char *linearized)
+{
+	/* FNV-1a */
+	uint32_t h = 2166136261U;
+	const uint8_t *p;
+
+	for (p = (const uint8_t *)linearized; *p != '\0'; p++) {
+		h ^= *p;
+		h *= 16777619U;
+	}
+	return h;
+}
+
+static bool ldb_dn_cache_usable(struct ldb_dn *dn)
+{
+	if (dn->ldb == NULL || dn->ldb->dn_cache_suspended != 0) {
+		return false;
+	}
+	/* The extended components are not cached */
+	if (dn->ext_linearized != NULL || dn->linearized == NULL) {
+		return false;
+	}
+	return !dn->special;
+}
+
+/*
+ * The table itself stays, so the ids already handed out are not
+ * reused
+ */
+void ldb_dn_cache_flush(struct ldb_context *ldb)
+{
+	struct ldb_dn_cache *cache = ldb->dn_cache;
+	unsigned int i;
+
+	if (cache == NULL) {
+		return;
+	}
+	for (i = 0; i < LDB_DN_CACHE_SIZE; i++) {
+		TALLOC_FREE(cache->slots[i]);
+		cache->seen[i] = 0;
+	}
+}
+
+/*
+ * Fill in the components of dn from the cache, returns false if the
+ * linearized DN is not cached
+ */
+static bool ldb_dn_cache_lookup(struct ldb_dn *dn)
+{
+	struct ldb_dn_cache *cache = NULL;
+	struct ldb_dn_cache_entry *e = NULL;
+	unsigned int i;
+
+	if (!ldb_dn_cache_usable(dn)) {
+		return false;
+	}
+	cache = dn->ldb->dn_cache;
+	if (cache == NULL) {
+		return false;
+	}
+
+	e = cache->slots[ldb_dn_cache_hash(dn->linearized) % LDB_DN_CACHE_SIZE];
+	if (e == NULL || strcmp(e->linearized, dn->linearized) != 0) {
+		return false;
+	}
+
+	dn->components = talloc_zero_array(dn,
+					   struct ldb_dn_component,
+					   e->comp_num);
+	if (dn->components == NULL) {
+		return false;
+	}
+	for (i = 0; i < e->comp_num; i++) {
+		dn->components[i] = ldb_dn_copy_component(dn->components,
+							  &e->components[i]);
+		if (dn->components[i].cf_name == NULL) {
+			LDB_FREE(dn->components);
+			return false;
+		}
+	}
+	dn->comp_num = e->comp_num;
+	dn->valid_case = true;
+	dn->cache_id = e->id;
+
+	return true;
+}
+
+/*
+ * Remember the components of a freshly case folded dn
+ */
+static void ldb_dn_cache_add(struct ldb_dn *dn)
+{
+	struct ldb_dn_cache *cache = NULL;
+	struct ldb_dn_cache_entry *e = NULL;
+	uint32_t hash;
+	unsigned int slot;
+	unsigned int i;
+
+	if (!ldb_dn_cache_usable(dn) || dn->comp_num == 0) {
+		return;
+	}
+
+	cache = dn->ldb->dn_cache;
+	if (cache == NULL) {
+		cache = talloc_zero(dn->ldb, struct ldb_dn_cache);
+		if (cache == NULL) {
+			return;
+		}
+		dn->ldb->dn_cache = cache;
+	}
+
+	hash = ldb_dn_cache_hash(dn->linearized);
+	slot = hash % LDB_DN_CACHE_SIZE;
+
+	if (cache->seen[slot] != hash) {
+		cache->seen[slot] = hash;
+		return;
+	}
+
+	e = talloc_zero(cache, struct ldb_dn_cache_entry);
+	if (e == NULL) {
+		return;
+	}
+	e->linearized = talloc_strdup(e, dn->linearized);
+	e->components = talloc_zero_array(e,
+					  struct ldb_dn_component,
+					  dn->comp_num);
+	if (e->linearized == NULL || e->components == NULL) {
+		talloc_free(e);
+		return;
+	}
+	for (i = 0; i < dn->comp_num; i++) {
+		e->components[i] = ldb_dn_copy_component(e->components,
+							 &dn->components[i]);
+		if (e->components[i].cf_name == NULL) {
+			talloc_free(e);
+			return;
+		}
+	}
+	e->comp_num = dn->comp_num;
+	e->id = ++cache->next_id;
+
+	TALLOC_FREE(cache->slots[slot]);
+	cache->slots[slot] = e;
+
+	dn->cache_id = e->id;
 }
 
 /* strdn may be NULL */
@@ -327,6 +518,10 @@ static bool ldb_dn_explode(struct ldb_dn *dn)
 		return true;
 	}
 
+	if (ldb_dn_cache_lookup(dn)) {
+		return true;
+	}
+
 	LDB_FREE(dn->ext_components);
 	dn->ext_comp_num = 0;
 	dn->comp_num = 0;
@@ -960,6 +1155,8 @@ static bool ldb_dn_casefold_internal(struct ldb_dn *dn)
 
 	dn->valid_case = true;
 
+	ldb_dn_cache_add(dn);
+
 	return true;
   failed_1:
 	/*
@@ -1058,6 +1255,13 @@ int ldb_dn_compare_base(struct ldb_dn *base, struct ldb_dn *dn)
 	if ( ! base || base->invalid) return 1;
 	if ( ! dn || dn->invalid) return -1;
 
+	if (base->cache_id != 0 &&
+	    base->cache_id == dn->cache_id &&
+	    base->ldb == dn->ldb) {
+		/* Same DN */
+		return 0;
+	}
+
 	if (( ! base->valid_case) || ( ! dn->valid_case)) {
 		if (base->linearized && dn->linearized && dn->special == base->special) {
 			/* try with a normal compare first, if we are lucky
@@ -1172,6 +1376,13 @@ int ldb_dn_compare(struct ldb_dn *dn0, struct ldb_dn *dn1)
 		return -1;
 	}
 
+	if (dn0->cache_id != 0 &&
+	    dn0->cache_id == dn1->cache_id &&
+	    dn0->ldb == dn1->ldb) {
+		/* Both built from the same cached DN */
+		return 0;
+	}
+
 	if (( ! dn0->valid_case) || ( ! dn1->valid_case)) {
 		bool ok0, ok1;
 		if (dn0->linearized && dn1->linearized) {
@@ -1424,6 +1635,8 @@ struct ldb_dn *ldb_dn_copy_with_ldb_context(TALLOC_CTX *mem_ctx,
 
 	/* Set the ldb context. */
 	new_dn->ldb = ldb;
+	/* The cache ids are per ldb context */
+	new_dn->cache_id = 0;
 	return new_dn;
 }
 
@@ -1441,6 +1654,8 @@ bool ldb_dn_add_base(struct ldb_dn *dn, struct ldb_dn *base)
 		return false;
 	}
 
+	dn->cache_id = 0;
+
 	if (dn == base) {
 		return false; /* or we will visit infinity */
 	}
@@ -1567,6 +1782,8 @@ bool ldb_dn_add_child(struct ldb_dn *dn, struct ldb_dn *child)
 		return false;
 	}
 
+	dn->cache_id = 0;
+
 	if (dn->components) {
 		unsigned int n;
 		unsigned int i, j;
@@ -1729,6 +1946,8 @@ bool ldb_dn_remove_base_components(struct ldb_dn *dn, unsigned int num)
 		return false;
 	}
 
+	dn->cache_id = 0;
+
 	/* free components */
 	for (i = dn->comp_num - num; i < dn->comp_num; i++) {
 		LDB_FREE(dn->components[i].name);
@@ -1771,6 +1990,8 @@ bool ldb_dn_remove_child_components(struct ldb_dn *dn, unsigned int num)
 		return false;
 	}
 
+	dn->cache_id = 0;
+
 	for (i = 0, j = num; j < dn->comp_num; i++, j++) {
 		if (i < num) {
 			LDB_FREE(dn->components[i].name);
@@ -1818,6 +2039,8 @@ bool ldb_dn_replace_components(struct ldb_dn *dn, struct ldb_dn *new_dn)
 		return false;
 	}
 
+	dn->cache_id = 0;
+
 	/* free components */
 	for (i = 0; i < dn->comp_num; i++) {
 		LDB_FREE(dn->components[i].name);
@@ -2029,6 +2252,8 @@ int ldb_dn_set_component(struct ldb_dn *dn, int num,
 		return LDB_ERR_OTHER;
 	}
 
+	dn->cache_id = 0;
+
 	n = talloc_strdup(dn, name);
 	if ( ! n) {
 		return LDB_ERR_OTHER;
@@ -2223,6 +2448,7 @@ bool ldb_dn_is_null(struct ldb_dn *dn)
  */
 int ldb_dn_update_components(struct ldb_dn *dn, const struct ldb_dn *ref_dn)
 {
+	dn->cache_id = 0;
 	dn->components = talloc_realloc(dn, dn->components,
 					struct ldb_dn_component, ref_dn->comp_num);
 	if (!dn->components) {
@@ -2258,6 +2484,8 @@ bool ldb_dn_minimise(struct ldb_dn *dn)
 		return true;
 	}
 
+	dn->cache_id = 0;
+
 	/* free components */
 	for (i = 0; i < dn->comp_num; i++) {
 		LDB_FREE(dn->components[i].name);
@@ -77,6 +77,29 @@ int ldb_match_scope(struct ldb_context *ldb,
 }
 
 
+/*
+  match the values of a present element against a present node
+*/
+static int ldb_match_present_values(struct ldb_context *ldb,
+				    const struct ldb_schema_attribute *a,
+				    const struct ldb_message_element *el,
+				    bool *matched)
+{
+	if (a->syntax->operator_fn) {
+		unsigned int i;
+		for (i = 0; i < el->num_values; i++) {
+			int ret = a->syntax->operator_fn(ldb, LDB_OP_PRESENT, a, &el->values[i], NULL, matched);
+			if (ret != LDB_SUCCESS) return ret;
+			if (*matched) return LDB_SUCCESS;
+		}
+		*matched = false;
+		return LDB_SUCCESS;
+	}
+
+	*matched = true;
+	return LDB_SUCCESS;
+}
+
 /*
   match if node is present
 */
@@ -104,18 +127,46 @@ static int ldb_match_present(struct ldb_context *ldb,
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
 
-	if (a->syntax->operator_fn) {
-		unsigned int i;
-		for (i = 0; i < el->num_values; i++) {
-			int ret = a->syntax->operator_fn(ldb, LDB_OP_PRESENT, a, &el->values[i], NULL, matched);
+	return ldb_match_present_values(ldb, a, el, matched);
+}
+
+/*
+  match the values of an element against a greater/less node
+*/
+static int ldb_match_comparison_values(struct ldb_context *ldb,
+				       const struct ldb_schema_attribute *a,
+				       const struct ldb_message_element *el,
+				       enum ldb_parse_op comp_op,
+				       const struct ldb_val *value,
+				       bool *matched)
+{
+	unsigned int i;
+
+	for (i = 0; i < el->num_values; i++) {
+		if (a->syntax->operator_fn) {
+			int ret;
+			ret = a->syntax->operator_fn(ldb, comp_op, a, &el->values[i], value, matched);
 			if (ret != LDB_SUCCESS) return ret;
 			if (*matched) return LDB_SUCCESS;
+		} else {
+			int ret = a->syntax->comparison_fn(ldb, ldb, &el->values[i], value);
+
+			if (ret == 0) {
+				*matched = true;
+				return LDB_SUCCESS;
+			}
+			if (ret > 0 && comp_op == LDB_OP_GREATER) {
+				*matched = true;
+				return LDB_SUCCESS;
+			}
+			if (ret < 0 && comp_op == LDB_OP_LESS) {
+				*matched = true;
+				return LDB_SUCCESS;
+			}
 		}
-		*matched = false;
-		return LDB_SUCCESS;
 	}
 
-	*matched = true;
+	*matched = false;
 	return LDB_SUCCESS;
 }
 
@@ -125,7 +176,6 @@ static int ldb_match_comparison(struct ldb_context *ldb,
 				enum ldb_scope scope,
 				enum ldb_parse_op comp_op, bool *matched)
 {
-	unsigned int i;
 	struct ldb_message_element *el;
 	const struct ldb_schema_attribute *a;
 
@@ -145,24 +195,31 @@ static int ldb_match_comparison(struct ldb_context *ldb,
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
 
-	for (i = 0; i < el->num_values; i++) {
+	return ldb_match_comparison_values(ldb, a, el, comp_op,
+					   &tree->u.comparison.value, matched);
+}
+
+/*
+  match the values of an element against an equality node
+*/
+static int ldb_match_equality_values(struct ldb_context *ldb,
+				     const struct ldb_schema_attribute *a,
+				     const struct ldb_message_element *el,
+				     const struct ldb_val *value,
+				     bool *matched)
+{
+	unsigned int i;
+	int ret;
+
+	for (i=0;i<el->num_values;i++) {
 		if (a->syntax->operator_fn) {
-			int ret;
-			ret = a->syntax->operator_fn(ldb, comp_op, a, &el->values[i], &tree->u.comparison.value, matched);
+			ret = a->syntax->operator_fn(ldb, LDB_OP_EQUALITY, a,
+						     value, &el->values[i], matched);
 			if (ret != LDB_SUCCESS) return ret;
 			if (*matched) return LDB_SUCCESS;
 		} else {
-			int ret = a->syntax->comparison_fn(ldb, ldb, &el->values[i], &tree->u.comparison.value);
-
-			if (ret == 0) {
-				*matched = true;
-				return LDB_SUCCESS;
-			}
-			if (ret > 0 && comp_op == LDB_OP_GREATER) {
-				*matched = true;
-				return LDB_SUCCESS;
-			}
-			if (ret < 0 && comp_op == LDB_OP_LESS) {
+			if (a->syntax->comparison_fn(ldb, ldb, value,
+						     &el->values[i]) == 0) {
 				*matched = true;
 				return LDB_SUCCESS;
 			}
@@ -182,7 +239,6 @@ static int ldb_match_equality(struct ldb_context *ldb,
 			      enum ldb_scope scope,
 			      bool *matched)
 {
-	unsigned int i;
 	struct ldb_message_element *el;
 	const struct ldb_schema_attribute *a;
 	struct ldb_dn *valuedn;
@@ -215,53 +271,34 @@ static int ldb_match_equality(struct ldb_context *ldb,
 		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 	}
 
-	for (i=0;i<el->num_values;i++) {
-		if (a->syntax->operator_fn) {
-			ret = a->syntax->operator_fn(ldb, LDB_OP_EQUALITY, a,
-						     &tree->u.equality.value, &el->values[i], matched);
-			if (ret != LDB_SUCCESS) return ret;
-			if (*matched) return LDB_SUCCESS;
-		} else {
-			if (a->syntax->comparison_fn(ldb, ldb, &tree->u.equality.value,
-						     &el->values[i]) == 0) {
-				*matched = true;
-				return LDB_SUCCESS;
-			}
-		}
-	}
-
-	*matched = false;
-	return LDB_SUCCESS;
+	return ldb_match_equality_values(ldb, a, el,
+					 &tree->u.equality.value, matched);
 }
 
-static int ldb_wildcard_compare(struct ldb_context *ldb,
-				const struct ldb_parse_tree *tree,
-				const struct ldb_val value, bool *matched)
+/*
+  match one value against the chunks of a substring node.
+
+  If chunks_canonical is false every chunk is run through the
+  canonicalise function of the attribute before comparing, otherwise
+  the caller has done that already (see ldb_match_program_compile()).
+*/
+static int ldb_wildcard_match(struct ldb_context *ldb,
+			      const struct ldb_schema_attribute *a,
+			      struct ldb_val * const *chunks,
+			      bool start_with_wildcard,
+			      bool end_with_wildcard,
+			      bool chunks_canonical,
+			      const struct ldb_val value, bool *matched)
 {
-	const struct ldb_schema_attribute *a;
 	struct ldb_val val;
 	struct ldb_val cnk;
 	struct ldb_val *chunk;
 	uint8_t *save_p = NULL;
 	unsigned int c = 0;
-
-	if (tree->operation != LDB_OP_SUBSTRING) {
-		*matched = false;
-		return LDB_ERR_INAPPROPRIATE_MATCHING;
-	}
-
-	a = ldb_schema_attribute_by_name(ldb, tree->u.substring.attr);
-	if (!a) {
-		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
-	}
-
-	if (tree->u.substring.chunks == NULL) {
-		*matched = false;
-		return LDB_SUCCESS;
-	}
+	bool canonicalise = (a->syntax->canonicalise_fn != ldb_handler_copy);
 
 	/* No need to just copy this value for a binary match */
-	if (a->syntax->canonicalise_fn != ldb_handler_copy) {
+	if (canonicalise) {
 		if (a->syntax->canonicalise_fn(ldb, ldb, &value, &val) != 0) {
 			return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
 		}
@@ -276,14 +313,18 @@ static int ldb_wildcard_compare(struct ldb_context *ldb,
 		val = value;
 	}
 
+	if (chunks_canonical) {
+		canonicalise = false;
+	}
+
 	cnk.data = NULL;
 
-	if ( ! tree->u.substring.start_with_wildcard ) {
+	if ( ! start_with_wildcard ) {
 		uint8_t *cnk_to_free = NULL;
 
-		chunk = tree->u.substring.chunks[c];
+		chunk = chunks[c];
 		/* No need to just copy this value for a binary match */
-		if (a->syntax->canonicalise_fn != ldb_handler_copy) {
+		if (canonicalise) {
 			if (a->syntax->canonicalise_fn(ldb, ldb, chunk, &cnk) != 0) {
 				goto mismatch;
 			}
@@ -319,13 +360,13 @@ static int ldb_wildcard_compare(struct ldb_context *ldb,
 		cnk.data = NULL;
 	}
 
-	while (tree->u.substring.chunks[c]) {
+	while (chunks[c]) {
 		uint8_t *p;
 		uint8_t *cnk_to_free = NULL;
 
-		chunk = tree->u.substring.chunks[c];
+		chunk = chunks[c];
 		/* No need to just copy this value for a binary match */
-		if (a->syntax->canonicalise_fn != ldb_handler_copy) {
+		if (canonicalise) {
 			if (a->syntax->canonicalise_fn(ldb, ldb, chunk, &cnk) != 0) {
 				goto mismatch;
 			}
@@ -347,8 +388,8 @@ static int ldb_wildcard_compare(struct ldb_context *ldb,
 			goto mismatch;
 		}
 
-		if ( (tree->u.substring.chunks[c + 1]) == NULL &&
-		     (! tree->u.substring.end_with_wildcard) ) {
+		if ( (chunks[c + 1]) == NULL &&
+		     (! end_with_wildcard) ) {
 			/*
 			 * The last bit, after all the asterisks, must match
 			 * exactly the last bit of the string.
@@ -393,6 +434,35 @@ mismatch:
 	return LDB_SUCCESS;
 }
 
+static int ldb_wildcard_compare(struct ldb_context *ldb,
+				const struct ldb_parse_tree *tree,
+				const struct ldb_val value, bool *matched)
+{
+	const struct ldb_schema_attribute *a;
+
+	if (tree->operation != LDB_OP_SUBSTRING) {
+		*matched = false;
+		return LDB_ERR_INAPPROPRIATE_MATCHING;
+	}
+
+	a = ldb_schema_attribute_by_name(ldb, tree->u.substring.attr);
+	if (!a) {
+		return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+	}
+
+	if (tree->u.substring.chunks == NULL) {
+		*matched = false;
+		return LDB_SUCCESS;
+	}
+
+	return ldb_wildcard_match(ldb, a,
+				  tree->u.substring.chunks,
+				  tree->u.substring.start_with_wildcard,
+				  tree->u.substring.end_with_wildcard,
+				  false,
+				  value, matched);
+}
+
 /*
   match a simple leaf node
 */
@@ -720,6 +790,442 @@ int ldb_match_msg_error(struct ldb_context *ldb,
 	return ldb_match_message(ldb, msg, tree, scope, matched);
 }
 
+/*
+  A parse tree compiled for repeated matching, see
+  ldb_match_program_compile().
+
+  The nodes are stored in prefix order, every node records the index
+  just past its subtree so AND/OR can walk their children without
+  pointers. Leaves carry everything ldb_match_message() would look up
+  again for each message: the attribute handler, the parsed DN of a
+  DN equality, the canonicalised substring chunks and the extended
+  match rule.
+*/
+struct ldb_match_node {
+	const struct ldb_parse_tree *tree;
+	enum ldb_parse_op operation;
+	unsigned int end;
+	const char *attr;
+	bool attr_is_dn;
+	const struct ldb_schema_attribute *a;
+
+	/* DN equality, NULL if the value could not be casefolded */
+	struct ldb_dn *value_dn;
+
+	/* substring */
+	struct ldb_val **chunks;
+	bool chunks_canonical;
+
+	/* extended */
+	const struct ldb_extended_match_rule *rule;
+	int error;
+};
+
+struct ldb_match_program {
+	unsigned int num_nodes;
+	struct ldb_match_node *nodes;
+};
+
+static unsigned int ldb_match_count_nodes(const struct ldb_parse_tree *tree)
+{
+	unsigned int i, n = 1;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			n += ldb_match_count_nodes(tree->u.list.elements[i]);
+		}
+		break;
+	case LDB_OP_NOT:
+		n += ldb_match_count_nodes(tree->u.isnot.child);
+		break;
+	default:
+		break;
+	}
+	return n;
+}
+
+static int ldb_match_compile_substring(struct ldb_context *ldb,
+				       struct ldb_match_program *prog,
+				       struct ldb_match_node *node)
+{
+	const struct ldb_parse_tree *tree = node->tree;
+	unsigned int i, n;
+
+	if (tree->u.substring.chunks == NULL ||
+	    node->a->syntax->canonicalise_fn == ldb_handler_copy) {
+		node->chunks = tree->u.substring.chunks;
+		return LDB_SUCCESS;
+	}
+
+	for (n = 0; tree->u.substring.chunks[n] != NULL; n++) {
+		/* count */
+	}
+
+	node->chunks = talloc_zero_array(prog, struct ldb_val *, n + 1);
+	if (node->chunks == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	for (i = 0; i < n; i++) {
+		struct ldb_val *cnk = talloc_zero(node->chunks, struct ldb_val);
+		int ret;
+
+		if (cnk == NULL) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		ret = node->a->syntax->canonicalise_fn(ldb, node->chunks,
+						       tree->u.substring.chunks[i],
+						       cnk);
+		if (ret != 0) {
+			/*
+			 * Leave it to ldb_wildcard_match() to fail on
+			 * this chunk, if it ever gets that far
+			 */
+			TALLOC_FREE(node->chunks);
+			node->chunks = tree->u.substring.chunks;
+			return LDB_SUCCESS;
+		}
+		node->chunks[i] = cnk;
+	}
+	node->chunks_canonical = true;
+
+	return LDB_SUCCESS;
+}
+
+static int ldb_match_compile_extended(struct ldb_context *ldb,
+				      struct ldb_match_node *node)
+{
+	const struct ldb_parse_tree *tree = node->tree;
+
+	if (tree->u.extended.dnAttributes) {
+		/* See ldb_match_extended() */
+		ldb_debug(ldb, LDB_DEBUG_WARNING, "ldb: dnAttributes extended match not supported yet");
+	}
+	if (tree->u.extended.rule_id == NULL) {
+		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: no-rule extended matches not supported yet");
+		node->error = LDB_ERR_INAPPROPRIATE_MATCHING;
+		return LDB_SUCCESS;
+	}
+	if (tree->u.extended.attr == NULL) {
+		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: no-attribute extended matches not supported yet");
+		node->error = LDB_ERR_INAPPROPRIATE_MATCHING;
+		return LDB_SUCCESS;
+	}
+
+	node->rule = ldb_find_extended_match_rule(ldb, tree->u.extended.rule_id);
+	if (node->rule == NULL) {
+		ldb_debug(ldb, LDB_DEBUG_ERROR, "ldb: unknown extended rule_id %s",
+			  tree->u.extended.rule_id);
+	}
+	return LDB_SUCCESS;
+}
+
+static int ldb_match_compile_node(struct ldb_context *ldb,
+				  struct ldb_match_program *prog,
+				  const struct ldb_parse_tree *tree,
+				  unsigned int *next)
+{
+	struct ldb_match_node *node = &prog->nodes[*next];
+	unsigned int i;
+	int ret = LDB_SUCCESS;
+
+	*next += 1;
+
+	node->tree = tree;
+	node->operation = tree->operation;
+	node->attr = ldb_parse_tree_get_attr(tree);
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			ret = ldb_match_compile_node(ldb, prog,
+						     tree->u.list.elements[i],
+						     next);
+			if (ret != LDB_SUCCESS) {
+				return ret;
+			}
+		}
+		break;
+
+	case LDB_OP_NOT:
+		ret = ldb_match_compile_node(ldb, prog, tree->u.isnot.child,
+					     next);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+		break;
+
+	case LDB_OP_EQUALITY:
+		node->attr_is_dn = (ldb_attr_dn(node->attr) == 0);
+		if (node->attr_is_dn) {
+			struct ldb_dn *dn = NULL;
+
+			dn = ldb_dn_from_ldb_val(prog, ldb,
+						 &tree->u.equality.value);
+			if (dn == NULL) {
+				node->error = LDB_ERR_INVALID_DN_SYNTAX;
+				break;
+			}
+			/*
+			 * Casefold now, so matching never changes the
+			 * program. If that fails every message has to go
+			 * through ldb_match_equality() instead.
+			 */
+			if (ldb_dn_get_casefold(dn) == NULL) {
+				TALLOC_FREE(dn);
+				break;
+			}
+			node->value_dn = dn;
+			break;
+		}
+		node->a = ldb_schema_attribute_by_name(ldb, node->attr);
+		break;
+
+	case LDB_OP_SUBSTRING:
+		node->a = ldb_schema_attribute_by_name(ldb, node->attr);
+		if (node->a == NULL) {
+			break;
+		}
+		ret = ldb_match_compile_substring(ldb, prog, node);
+		break;
+
+	case LDB_OP_GREATER:
+	case LDB_OP_LESS:
+		node->a = ldb_schema_attribute_by_name(ldb, node->attr);
+		break;
+
+	case LDB_OP_APPROX:
+		/* FIXME: APPROX comparison not handled yet */
+		node->error = LDB_ERR_INAPPROPRIATE_MATCHING;
+		break;
+
+	case LDB_OP_PRESENT:
+		node->attr_is_dn = (ldb_attr_dn(node->attr) == 0);
+		if (!node->attr_is_dn) {
+			node->a = ldb_schema_attribute_by_name(ldb, node->attr);
+		}
+		break;
+
+	case LDB_OP_EXTENDED:
+		ret = ldb_match_compile_extended(ldb, node);
+		break;
+	}
+
+	node->end = *next;
+	return ret;
+}
+
+/*
+  compile a parse tree for matching against many messages with
+  ldb_match_program_run()
+
+  The program points into the tree, so the tree must remain valid for
+  the lifetime of the program. The attribute handlers are resolved
+  here, so it must not outlive a schema change either. The program is
+  not changed by ldb_match_program_run(), so it may be shared between
+  threads.
+*/
+int ldb_match_program_compile(struct ldb_context *ldb,
+			      TALLOC_CTX *mem_ctx,
+			      const struct ldb_parse_tree *tree,
+			      struct ldb_match_program **_prog)
+{
+	struct ldb_match_program *prog = NULL;
+	unsigned int next = 0;
+	int ret;
+
+	prog = talloc_zero(mem_ctx, struct ldb_match_program);
+	if (prog == NULL) {
+		return ldb_oom(ldb);
+	}
+
+	prog->num_nodes = ldb_match_count_nodes(tree);
+	prog->nodes = talloc_zero_array(prog,
+					struct ldb_match_node,
+					prog->num_nodes);
+	if (prog->nodes == NULL) {
+		TALLOC_FREE(prog);
+		return ldb_oom(ldb);
+	}
+
+	ret = ldb_match_compile_node(ldb, prog, tree, &next);
+	if (ret != LDB_SUCCESS) {
+		TALLOC_FREE(prog);
+		return ret;
+	}
+
+	*_prog = prog;
+	return LDB_SUCCESS;
+}
+
+static int ldb_match_run_node(struct ldb_context *ldb,
+			      const struct ldb_match_program *prog,
+			      unsigned int idx,
+			      const struct ldb_message *msg,
+			      enum ldb_scope scope,
+			      bool *matched)
+{
+	const struct ldb_match_node *node = &prog->nodes[idx];
+	struct ldb_message_element *el = NULL;
+	unsigned int i;
+	int ret;
+
+	*matched = false;
+
+	switch (node->operation) {
+	case LDB_OP_AND:
+		for (i = idx + 1; i < node->end; i = prog->nodes[i].end) {
+			ret = ldb_match_run_node(ldb, prog, i, msg, scope,
+						 matched);
+			if (ret != LDB_SUCCESS) return ret;
+			if (!*matched) return LDB_SUCCESS;
+		}
+		*matched = true;
+		return LDB_SUCCESS;
+
+	case LDB_OP_OR:
+		for (i = idx + 1; i < node->end; i = prog->nodes[i].end) {
+			ret = ldb_match_run_node(ldb, prog, i, msg, scope,
+						 matched);
+			if (ret != LDB_SUCCESS) return ret;
+			if (*matched) return LDB_SUCCESS;
+		}
+		*matched = false;
+		return LDB_SUCCESS;
+
+	case LDB_OP_NOT:
+		ret = ldb_match_run_node(ldb, prog, idx + 1, msg, scope,
+					 matched);
+		if (ret != LDB_SUCCESS) return ret;
+		*matched = ! *matched;
+		return LDB_SUCCESS;
+
+	case LDB_OP_EXTENDED:
+		if (node->error != LDB_SUCCESS) {
+			return node->error;
+		}
+		if (node->rule == NULL) {
+			return LDB_SUCCESS;
+		}
+		return node->rule->callback(ldb, node->rule->oid, msg,
+					    node->tree->u.extended.attr,
+					    &node->tree->u.extended.value,
+					    matched);
+
+	default:
+		break;
+	}
+
+	/*
+	 * Suppress matches on confidential attributes, as
+	 * ldb_must_suppress_match() does
+	 */
+	el = ldb_msg_find_element(msg, node->attr);
+	if (el != NULL && ldb_msg_element_is_inaccessible(el)) {
+		return LDB_SUCCESS;
+	}
+
+	if (node->error != LDB_SUCCESS) {
+		return node->error;
+	}
+
+	switch (node->operation) {
+	case LDB_OP_EQUALITY:
+		if (node->attr_is_dn) {
+			if (node->value_dn == NULL) {
+				return ldb_match_equality(ldb, msg, node->tree,
+							  scope, matched);
+			}
+			*matched = (ldb_dn_compare(msg->dn,
+						   node->value_dn) == 0);
+			return LDB_SUCCESS;
+		}
+		if (el == NULL) {
+			return LDB_SUCCESS;
+		}
+		if (node->a == NULL) {
+			return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+		}
+		return ldb_match_equality_values(ldb, node->a, el,
+						 &node->tree->u.equality.value,
+						 matched);
+
+	case LDB_OP_SUBSTRING:
+		if (el == NULL) {
+			return LDB_SUCCESS;
+		}
+		if (node->a == NULL) {
+			return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+		}
+		if (node->chunks == NULL) {
+			return LDB_SUCCESS;
+		}
+		for (i = 0; i < el->num_values; i++) {
+			ret = ldb_wildcard_match(ldb, node->a, node->chunks,
+						 node->tree->u.substring.start_with_wildcard,
+						 node->tree->u.substring.end_with_wildcard,
+						 node->chunks_canonical,
+						 el->values[i], matched);
+			if (ret != LDB_SUCCESS) return ret;
+			if (*matched) return LDB_SUCCESS;
+		}
+		*matched = false;
+		return LDB_SUCCESS;
+
+	case LDB_OP_GREATER:
+	case LDB_OP_LESS:
+		if (el == NULL) {
+			return LDB_SUCCESS;
+		}
+		if (node->a == NULL) {
+			return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+		}
+		return ldb_match_comparison_values(ldb, node->a, el,
+						   node->operation,
+						   &node->tree->u.comparison.value,
+						   matched);
+
+	case LDB_OP_PRESENT:
+		if (node->attr_is_dn) {
+			*matched = true;
+			return LDB_SUCCESS;
+		}
+		if (el == NULL) {
+			return LDB_SUCCESS;
+		}
+		if (node->a == NULL) {
+			return LDB_ERR_INVALID_ATTRIBUTE_SYNTAX;
+		}
+		return ldb_match_present_values(ldb, node->a, el, matched);
+
+	default:
+		break;
+	}
+
+	return LDB_ERR_INAPPROPRIATE_MATCHING;
+}
+
+/*
+  the same as ldb_match_message(), using a compiled program
+*/
+int ldb_match_program_run(struct ldb_context *ldb,
+			  const struct ldb_match_program *prog,
+			  const struct ldb_message *msg,
+			  enum ldb_scope scope, bool *matched)
+{
+	*matched = false;
+
+	if (scope != LDB_SCOPE_BASE && ldb_dn_is_special(msg->dn)) {
+		/* don't match special records except on base searches */
+		return LDB_SUCCESS;
+	}
+
+	return ldb_match_run_node(ldb, prog, 0, msg, scope, matched);
+}
+
 int ldb_match_msg_objectclass(const struct ldb_message *msg,
 			      const char *objectclass)
 {
@@ -824,3 +1330,10 @@ int ldb_register_redact_callback(struct ldb_context *ldb,
 	ldb->redact.module = module;
 	return LDB_SUCCESS;
 }
+
+int ldb_register_redact_attrs(struct ldb_context *ldb,
+			      const char * const *attrs)
+{
+	ldb->redact.attrs = attrs;
+	return LDB_SUCCESS;
+}
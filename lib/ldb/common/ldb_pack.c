@@ -762,12 +762,56 @@ failed:
 	return -1;
 }
 
+/*
+ * Step over the values of an element that is not unpacked
+ */
+static int ldb_unpack_skip_values_v2(uint8_t **pp,
+				     uint8_t **pq,
+				     const uint8_t *end_p,
+				     uint8_t val_len_width,
+				     unsigned int num_values)
+{
+	uint8_t *p = *pp;
+	uint8_t *q = *pq;
+	unsigned int j;
+
+	for (j = 0; j < num_values; j++) {
+		size_t len;
+
+		if (val_len_width == U8_LEN) {
+			len = PULL_LE_U8(p, 0);
+		} else if (val_len_width == U16_LEN) {
+			len = PULL_LE_U16(p, 0);
+		} else {
+			len = PULL_LE_U32(p, 0);
+		}
+		p += val_len_width;
+
+		if (len + NULL_PAD_BYTE_LEN < len) {
+			errno = EIO;
+			return -1;
+		}
+		if (len + NULL_PAD_BYTE_LEN > end_p - q) {
+			errno = EIO;
+			return -1;
+		}
+		q += len + NULL_PAD_BYTE_LEN;
+	}
+
+	*pp = p;
+	*pq = q;
+	return 0;
+}
+
 /*
  * Unpack a ldb message from a linear buffer in ldb_val
+ *
+ * If attrs is not NULL only the elements named in it are unpacked.
  */
 static int ldb_unpack_data_flags_v2(struct ldb_context *ldb,
 				    const struct ldb_val *data,
 				    struct ldb_message *message,
+				    const char * const *attrs,
 				    unsigned int flags)
 {
 	uint8_t *p, *q, *end_p, *value_section_p;
@@ -926,6 +970,34 @@ static int ldb_unpack_data_flags_v2(struct ldb_context *ldb,
 			goto failed;
 		}
 
+		if (attrs != NULL && !ldb_attr_in_list(attrs, attr)) {
+			unsigned int num_values = PULL_LE_U32(p, 0);
+
+			p += U32_LEN;
+			val_len_width = *p;
+			p += U8_LEN;
+
+			if (val_len_width != U8_LEN &&
+			    val_len_width != U16_LEN &&
+			    val_len_width != U32_LEN) {
+				errno = ERANGE;
+				goto failed;
+			}
+			if (val_len_width * num_values >
+			    value_section_p - p) {
+				errno = EIO;
+				goto failed;
+			}
+			if (ldb_unpack_skip_values_v2(&p,
+						      &q,
+						      end_p,
+						      val_len_width,
+						      num_values) != 0) {
+				goto failed;
+			}
+			continue;
+		}
+
 		element = &message->elements[nelem];
 		element->name = attr;
 		element->flags = 0;
@@ -1072,7 +1144,7 @@ int ldb_unpack_data_flags(struct ldb_context *ldb,
 
 	format = PULL_LE_U32(data->data, 0);
 	if (format == LDB_PACKING_FORMAT_V2) {
-		return ldb_unpack_data_flags_v2(ldb, data, message, flags);
+		return ldb_unpack_data_flags_v2(ldb, data, message, NULL, flags);
 	}
 
 	/*
@@ -1084,6 +1156,33 @@ int ldb_unpack_data_flags(struct ldb_context *ldb,
 	return ldb_unpack_data_flags_v1(ldb, data, message, flags, format);
 }
 
+/*
+ * Unpack the elements named in attrs from a linear buffer in ldb_val,
+ * skipping over the others without allocating anything for them.
+ *
+ * Records in the old packing formats are unpacked in full.
+ */
+int ldb_unpack_data_attrs_flags(struct ldb_context *ldb,
+				const struct ldb_val *data,
+				struct ldb_message *message,
+				const char * const *attrs,
+				unsigned int flags)
+{
+	unsigned format;
+
+	if (data->length < U32_LEN) {
+		errno = EIO;
+		return -1;
+	}
+
+	format = PULL_LE_U32(data->data, 0);
+	if (format == LDB_PACKING_FORMAT_V2) {
+		return ldb_unpack_data_flags_v2(ldb, data, message, attrs, flags);
+	}
+
+	return ldb_unpack_data_flags_v1(ldb, data, message, flags, format);
+}
+
 
 /*
  * Unpack a ldb message from a linear buffer in ldb_val
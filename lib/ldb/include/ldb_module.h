@@ -530,6 +530,14 @@ typedef int (*ldb_redact_fn)(struct ldb_module *, struct ldb_request *, struct l
 int ldb_register_redact_callback(struct ldb_context *ldb,
 			       ldb_redact_fn redact_fn,
 			       struct ldb_module *module);
+/*
+ * Attributes the redaction callback reads besides the ones in the
+ * search filter. Without them a backend has to unpack every
+ * attribute of a record before calling it. attrs must stay valid
+ * for the lifetime of the ldb context.
+ */
+int ldb_register_redact_attrs(struct ldb_context *ldb,
+			      const char * const *attrs);
 
 /*
  * these pack/unpack functions are exposed in the library for use by
@@ -587,6 +595,16 @@ int ldb_unpack_data_flags(struct ldb_context *ldb,
 			  struct ldb_message *message,
 			  unsigned int flags);
 
+/*
+ * Like ldb_unpack_data_flags(), but only the elements named in attrs
+ * are guaranteed to be unpacked, the others may be skipped.
+ */
+int ldb_unpack_data_attrs_flags(struct ldb_context *ldb,
+				const struct ldb_val *data,
+				struct ldb_message *message,
+				const char * const *attrs,
+				unsigned int flags);
+
 int ldb_unpack_get_format(const struct ldb_val *data,
 			  uint32_t *pack_format_version);
 
@@ -143,8 +143,17 @@ struct ldb_context {
 	struct {
 		struct ldb_module *module;
 		ldb_redact_fn callback;
+		const char * const *attrs;
 	} redact;
 
+	/*
+	 * Exploded DNs, see ldb_dn.c. While dn_cache_suspended is
+	 * non-zero it is neither used nor changed, so DNs can be
+	 * handled on several threads.
+	 */
+	struct ldb_dn_cache *dn_cache;
+	unsigned int dn_cache_suspended;
+
 	/* custom utf8 functions */
 	struct ldb_utf8_fns utf8_fns;
 
@@ -274,6 +283,9 @@ char *ldb_ldif_write_redacted_trace_string(struct ldb_context *ldb, TALLOC_CTX *
  */
 struct ldb_context *ldb_dn_get_ldb_context(struct ldb_dn *dn);
 
+/* forget all cached DNs, e.g. after a schema change */
+void ldb_dn_cache_flush(struct ldb_context *ldb);
+
 #define LDB_MSG_FIND_COMMON_REMOVE_DUPLICATES 1
 
 /**
@@ -344,6 +356,18 @@ int ldb_match_message(struct ldb_context *ldb,
 		      const struct ldb_parse_tree *tree,
 		      enum ldb_scope scope, bool *matched);
 
+struct ldb_match_program;
+
+int ldb_match_program_compile(struct ldb_context *ldb,
+			      TALLOC_CTX *mem_ctx,
+			      const struct ldb_parse_tree *tree,
+			      struct ldb_match_program **_prog);
+
+int ldb_match_program_run(struct ldb_context *ldb,
+			  const struct ldb_match_program *prog,
+			  const struct ldb_message *msg,
+			  enum ldb_scope scope, bool *matched);
+
 /*
   check if the scope matches in a search result
 */
@@ -2246,6 +2246,30 @@ int ldb_kv_init_store(struct ldb_kv_private *ldb_kv,
 		}
 	}
 
+	/*
+	 * Print statistics on index lookups for every indexed search,
+	 * used by ldbsearch --show-index-work. Like
+	 * pack_format_override this is passed on as opaque for the
+	 * partitions of a sam.ldb
+	 */
+	{
+		const char *show = ldb_options_find(ldb, options,
+						    "show_index_work");
+		if (show != NULL) {
+			int ret;
+			ldb_kv->show_index_work = true;
+			ret = ldb_set_opaque(ldb, "show_index_work",
+					     (void *)(intptr_t)1);
+			if (ret != LDB_SUCCESS) {
+				talloc_free(ldb_kv->module);
+				return ldb_module_operr(ldb_kv->module);
+			}
+		} else {
+			ldb_kv->show_index_work =
+				ldb_get_opaque(ldb, "show_index_work") != NULL;
+		}
+	}
+
 	/*
 	 * Set the size of the transaction index cache.
 	 * If the ldb option "transaction_index_cache_size" is set use that
@@ -2276,6 +2300,43 @@ int ldb_kv_init_store(struct ldb_kv_private *ldb_kv,
 			}
 		}
 	}
+	/*
+	 * Number of threads used to run searches that can't use an
+	 * index. Only backends that can read the same snapshot from
+	 * several threads (LMDB) support this. As for show_index_work
+	 * the value is kept as an opaque so the sam.ldb partitions
+	 * pick it up.
+	 */
+	{
+		const char *threads = ldb_options_find(ldb, options,
+						       "full_scan_threads");
+		if (threads != NULL) {
+			unsigned long num_threads;
+			int ret;
+
+			errno = 0;
+			num_threads = strtoul(threads, NULL, 0);
+			if (errno == ERANGE || num_threads > 256) {
+				ldb_debug(ldb,
+					  LDB_DEBUG_WARNING,
+					  "Invalid full_scan_threads value "
+					  "[%s], not using threads\n",
+					  threads);
+				num_threads = 0;
+			}
+			ldb_kv->full_scan_threads = num_threads;
+			ret = ldb_set_opaque(ldb, "full_scan_threads",
+					     (void *)(uintptr_t)num_threads);
+			if (ret != LDB_SUCCESS) {
+				talloc_free(ldb_kv->module);
+				return ldb_module_operr(ldb_kv->module);
+			}
+		} else {
+			ldb_kv->full_scan_threads = (uintptr_t)ldb_get_opaque(
+				ldb, "full_scan_threads");
+		}
+	}
+
 	/*
 	 * Set batch mode operation.
 	 * This disables the nested sub transactions, and increases the
@@ -11,6 +11,19 @@ typedef int (*ldb_kv_traverse_fn)(struct ldb_kv_private *ldb_kv,
 				  struct ldb_val key,
 				  struct ldb_val data,
 				  void *ctx);
+/*
+ * Called on a worker thread of iterate_range_parallel. Anything
+ * allocated must be on mem_ctx; a non-NULL *result is handed to the
+ * matching ldb_kv_parallel_result_fn on the calling thread.
+ */
+typedef int (*ldb_kv_parallel_fn)(TALLOC_CTX *mem_ctx,
+				  struct ldb_val key,
+				  struct ldb_val data,
+				  void *ctx,
+				  void **result);
+typedef int (*ldb_kv_parallel_result_fn)(struct ldb_kv_private *ldb_kv,
+					 void *result,
+					 void *ctx);
 
 struct kv_db_ops {
 	uint32_t options;
@@ -54,6 +67,19 @@ struct kv_db_ops {
 	int (*begin_nested_write)(struct ldb_kv_private *);
 	int (*finish_nested_write)(struct ldb_kv_private *);
 	int (*abort_nested_write)(struct ldb_kv_private *);
+	/*
+	 * Optional: traverse num_ranges key ranges, range i being
+	 * [bounds[i], bounds[i+1]), each on its own thread. The results
+	 * are passed to fn in key order. Returns
+	 * LDB_ERR_UNWILLING_TO_PERFORM if the traverse can't be run in
+	 * parallel, before any result is passed to fn.
+	 */
+	int (*iterate_range_parallel)(struct ldb_kv_private *ldb_kv,
+				      const struct ldb_val *bounds,
+				      unsigned int num_ranges,
+				      ldb_kv_parallel_fn worker_fn,
+				      ldb_kv_parallel_result_fn fn,
+				      void *ctx);
 };
 
 /* this private structure is used by the key value backends in the
@@ -136,6 +162,27 @@ struct ldb_kv_private {
 	 */
 	bool disable_full_db_scan;
 
+	/*
+	 * Number of threads for un-indexed searches, see the
+	 * "full_scan_threads" option
+	 */
+	unsigned int full_scan_threads;
+
+	/*
+	 * Report the work done by the index for each search, see the
+	 * "show_index_work" option
+	 */
+	bool show_index_work;
+	struct ldb_kv_index_stats {
+		unsigned records_loaded;
+		unsigned long long values_loaded;
+		unsigned intersections;
+		unsigned long long intersect_in;
+		unsigned long long intersect_out;
+		unsigned unions;
+		unsigned and_skipped;
+	} index_stats;
+
 	/*
 	 * The PID that opened this database so we don't work in a
 	 * fork()ed child.
@@ -170,6 +217,21 @@ struct ldb_kv_context {
 	struct ldb_dn *base;
 	enum ldb_scope scope;
 	const char * const *attrs;
+	/*
+	 * The attributes a full scan unpacks to match a record, NULL
+	 * to unpack all of them
+	 */
+	const char **match_attrs;
+	/*
+	 * The attributes the candidates of an indexed search are
+	 * unpacked with, NULL to unpack all of them
+	 */
+	const char **index_attrs;
+	/*
+	 * The filter compiled for the candidates of this search, NULL
+	 * to use ldb_match_message() on the tree
+	 */
+	struct ldb_match_program *match_program;
 	struct tevent_timer *timeout_event;
 
 	/* error handling */
@@ -301,8 +363,17 @@ int ldb_kv_search_key(struct ldb_module *module,
 		      const struct ldb_val ldb_key,
 		      struct ldb_message *msg,
 		      unsigned int unpack_flags);
+int ldb_kv_search_key_attrs(struct ldb_module *module,
+			    struct ldb_kv_private *ldb_kv,
+			    const struct ldb_val ldb_key,
+			    struct ldb_message *msg,
+			    const char * const *attrs,
+			    unsigned int unpack_flags);
 int ldb_kv_filter_attrs_in_place(struct ldb_message *msg,
 				 const char *const *attrs);
+int ldb_kv_match_message(struct ldb_kv_context *ac,
+			 const struct ldb_message *msg,
+			 bool *matched);
 int ldb_kv_search(struct ldb_kv_context *ctx);
 
 /*
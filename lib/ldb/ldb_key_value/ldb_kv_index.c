@@ -599,6 +599,9 @@ normal_index:
 		}
 	}
 
+	ldb_kv->index_stats.records_loaded += 1;
+	ldb_kv->index_stats.values_loaded += list->count;
+
 	/* We don't need msg->elements any more */
 	talloc_free(msg->elements);
 	return LDB_SUCCESS;
@@ -915,45 +918,155 @@ static int ldb_kv_dn_list_store(struct ldb_module *module,
 	return LDB_SUCCESS;
 }
 
+struct ldb_kv_index_store_entry {
+	TDB_DATA key;
+	struct dn_list *list;
+};
+
+struct ldb_kv_index_store_state {
+	struct ldb_module *module;
+	struct ldb_kv_index_store_entry *entries;
+	size_t num_entries;
+	size_t max_entries;
+};
+
 /*
-  traverse function for storing the in-memory index entries on disk
+  traverse function collecting the in-memory index entries, so they
+  can be written in key order
  */
-static int ldb_kv_index_traverse_store(_UNUSED_ struct tdb_context *tdb,
-				       TDB_DATA key,
-				       TDB_DATA data,
-				       void *state)
+static int ldb_kv_index_traverse_collect(_UNUSED_ struct tdb_context *tdb,
+					 TDB_DATA key,
+					 TDB_DATA data,
+					 void *private_data)
 {
-	struct ldb_module *module = state;
+	struct ldb_kv_index_store_state *state = private_data;
 	struct ldb_kv_private *ldb_kv = talloc_get_type(
-	    ldb_module_get_private(module), struct ldb_kv_private);
-	struct ldb_dn *dn;
-	struct ldb_context *ldb = ldb_module_get_ctx(module);
-	struct ldb_val v;
+	    ldb_module_get_private(state->module), struct ldb_kv_private);
+	struct ldb_kv_index_store_entry *entry = NULL;
 	struct dn_list *list;
 
-	list = ldb_kv_index_idxptr(module, data);
+	if (state->num_entries == state->max_entries) {
+		/* The cache changed under the traverse */
+		ldb_kv->idxptr->error = LDB_ERR_OPERATIONS_ERROR;
+		return -1;
+	}
+
+	list = ldb_kv_index_idxptr(state->module, data);
 	if (list == NULL) {
 		ldb_kv->idxptr->error = LDB_ERR_OPERATIONS_ERROR;
 		return -1;
 	}
 
-	v.data = key.dptr;
-	v.length = strnlen((char *)key.dptr, key.dsize);
+	entry = &state->entries[state->num_entries];
+	entry->key.dptr = talloc_memdup(state->entries, key.dptr, key.dsize);
+	if (entry->key.dptr == NULL) {
+		ldb_kv->idxptr->error = LDB_ERR_OPERATIONS_ERROR;
+		return -1;
+	}
+	entry->key.dsize = key.dsize;
+	entry->list = list;
+	state->num_entries++;
+	return 0;
+}
+
+static int ldb_kv_index_store_entry_cmp(
+	const struct ldb_kv_index_store_entry *e1,
+	const struct ldb_kv_index_store_entry *e2)
+{
+	size_t len = MIN(e1->key.dsize, e2->key.dsize);
+	int ret;
+
+	ret = memcmp(e1->key.dptr, e2->key.dptr, len);
+	if (ret != 0) {
+		return ret;
+	}
+	return NUMERIC_CMP(e1->key.dsize, e2->key.dsize);
+}
+
+/*
+  store one in-memory index entry on disk
+ */
+static int ldb_kv_index_store_entry(struct ldb_module *module,
+				    struct ldb_kv_private *ldb_kv,
+				    const struct ldb_kv_index_store_entry *entry)
+{
+	struct ldb_dn *dn;
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct ldb_val v;
+	int ret;
+
+	v.data = entry->key.dptr;
+	v.length = strnlen((char *)entry->key.dptr, entry->key.dsize);
 
 	dn = ldb_dn_from_ldb_val(module, ldb, &v);
 	if (dn == NULL) {
 		ldb_asprintf_errstring(ldb, "Failed to parse index key %*.*s as an LDB DN", (int)v.length, (int)v.length, (const char *)v.data);
-		ldb_kv->idxptr->error = LDB_ERR_OPERATIONS_ERROR;
-		return -1;
+		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
-	ldb_kv->idxptr->error =
-	    ldb_kv_dn_list_store_full(module, ldb_kv, dn, list);
+	ret = ldb_kv_dn_list_store_full(module, ldb_kv, dn, entry->list);
 	talloc_free(dn);
-	if (ldb_kv->idxptr->error != 0) {
-		return -1;
+	return ret;
+}
+
+/*
+  write the in-memory index entries to disk.
+
+  The index records are written sorted by key, rather than in hash
+  order, so a backend keeping its records in key order (LMDB) appends
+  to, or updates neighbouring, pages instead of touching the tree at
+  random.  The record key is "DN=" followed by the index DN so the
+  order of the cache keys is the order of the records.
+ */
+static int ldb_kv_index_store_sorted(struct ldb_module *module,
+				     struct ldb_kv_private *ldb_kv)
+{
+	struct ldb_kv_index_store_state state = {
+		.module = module,
+	};
+	size_t i;
+	int count;
+	int ret = LDB_SUCCESS;
+
+	count = tdb_traverse_read(ldb_kv->idxptr->itdb, NULL, NULL);
+	if (count < 0) {
+		return ltdb_err_map(tdb_error(ldb_kv->idxptr->itdb));
 	}
-	return 0;
+	if (count == 0) {
+		return LDB_SUCCESS;
+	}
+
+	state.entries = talloc_array(ldb_kv->idxptr,
+				     struct ldb_kv_index_store_entry,
+				     count);
+	if (state.entries == NULL) {
+		return ldb_module_oom(module);
+	}
+	state.max_entries = count;
+
+	tdb_traverse_read(ldb_kv->idxptr->itdb,
+			  ldb_kv_index_traverse_collect,
+			  &state);
+	if (ldb_kv->idxptr->error != LDB_SUCCESS) {
+		TALLOC_FREE(state.entries);
+		return ldb_kv->idxptr->error;
+	}
+
+	TYPESAFE_QSORT(state.entries,
+		       state.num_entries,
+		       ldb_kv_index_store_entry_cmp);
+
+	for (i = 0; i < state.num_entries; i++) {
+		ret = ldb_kv_index_store_entry(module,
+					       ldb_kv,
+					       &state.entries[i]);
+		if (ret != LDB_SUCCESS) {
+			break;
+		}
+	}
+
+	TALLOC_FREE(state.entries);
+	return ret;
 }
 
 /* cleanup the idxptr mode when transaction commits */
@@ -967,13 +1080,12 @@ int ldb_kv_index_transaction_commit(struct ldb_module *module)
 
 	ldb_reset_err_string(ldb);
 
+	ret = LDB_SUCCESS;
 	if (ldb_kv->idxptr->itdb) {
-		tdb_traverse(
-		    ldb_kv->idxptr->itdb, ldb_kv_index_traverse_store, module);
+		ret = ldb_kv_index_store_sorted(module, ldb_kv);
 		tdb_close(ldb_kv->idxptr->itdb);
 	}
 
-	ret = ldb_kv->idxptr->error;
 	if (ret != LDB_SUCCESS) {
 		if (!ldb_errstring(ldb)) {
 			ldb_set_errstring(ldb, ldb_strerror(ret));
@@ -1412,6 +1524,45 @@ static int ldb_kv_index_dn_leaf(struct ldb_module *module,
 }
 
 
+/*
+  Find the first entry in list->dn[start..] that is >= v, searching
+  exponentially growing steps ahead of start first. When intersecting
+  sorted GUID lists this costs O(log(distance)) instead of
+  O(log(count)) per value and walks the long list front to back.
+ */
+static unsigned int ldb_kv_dn_list_gallop(const struct dn_list *list,
+					  unsigned int start,
+					  const struct ldb_val *v)
+{
+	unsigned int lo = start;
+	unsigned int hi = start;
+	unsigned int step = 1;
+
+	while ((hi < list->count) &&
+	       (ldb_val_equal_exact_ordered(list->dn[hi], v) < 0)) {
+		lo = hi + 1;
+		if (list->count - hi <= step) {
+			hi = list->count;
+			break;
+		}
+		hi += step;
+		step *= 2;
+	}
+
+	/* list->dn[hi] >= v (or hi == count), everything below lo is < v */
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+
+		if (ldb_val_equal_exact_ordered(list->dn[mid], v) < 0) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+
+	return lo;
+}
+
 /*
   list intersection
   list = list & list2
@@ -1481,15 +1632,40 @@ static bool list_intersect(struct ldb_kv_private *ldb_kv,
 	}
 	list3->count = 0;
 
-	for (i=0;i<short_list->count;i++) {
-		/* For the GUID index case, this is a binary search */
-		if (ldb_kv_dn_list_find_val(
-			ldb_kv, long_list, &short_list->dn[i]) != -1) {
-			list3->dn[list3->count] = short_list->dn[i];
-			list3->count++;
+	if (ldb_kv->cache->GUID_index_attribute != NULL) {
+		/*
+		 * Both lists are sorted, merge them
+		 */
+		unsigned int j = 0;
+
+		for (i=0; i<short_list->count; i++) {
+			j = ldb_kv_dn_list_gallop(long_list, j,
+						  &short_list->dn[i]);
+			if (j == long_list->count) {
+				break;
+			}
+			if (ldb_val_equal_exact_ordered(
+				    long_list->dn[j],
+				    &short_list->dn[i]) == 0) {
+				list3->dn[list3->count] = short_list->dn[i];
+				list3->count++;
+				j++;
+			}
+		}
+	} else {
+		for (i=0;i<short_list->count;i++) {
+			if (ldb_kv_dn_list_find_val(
+				ldb_kv, long_list, &short_list->dn[i]) != -1) {
+				list3->dn[list3->count] = short_list->dn[i];
+				list3->count++;
+			}
 		}
 	}
 
+	ldb_kv->index_stats.intersections += 1;
+	ldb_kv->index_stats.intersect_in += short_list->count;
+	ldb_kv->index_stats.intersect_out += list3->count;
+
 	list->strict |= list2->strict;
 	list->dn = talloc_steal(list, list3->dn);
 	list->count = list3->count;
@@ -1577,6 +1753,8 @@ static bool list_union(struct ldb_context *ldb,
 	list->dn = dn3;
 	list->count = k;
 
+	ldb_kv->index_stats.unions += 1;
+
 	return true;
 }
 
@@ -1684,6 +1862,147 @@ static bool ldb_kv_index_unique(struct ldb_context *ldb,
 	return false;
 }
 
+/*
+ * Once an AND intersection is down to this many candidates, clauses
+ * whose index is more than LDB_KV_AND_COST_RATIO times larger are not
+ * worth loading. ldb_kv_index_filter() checks the candidates against
+ * the full filter anyway.
+ */
+#define LDB_KV_AND_FILTER_CANDIDATES 100
+#define LDB_KV_AND_COST_RATIO 64
+
+#define LDB_KV_ESTIMATE_UNKNOWN UINT_MAX
+
+static int ldb_kv_index_size_parser(_UNUSED_ struct ldb_val key,
+				    struct ldb_val data,
+				    void *private_data)
+{
+	size_t *size = private_data;
+	*size = data.length;
+	return LDB_SUCCESS;
+}
+
+/*
+  Estimate the number of GUIDs an indexed equality clause returns
+  without loading its index record. In GUID index mode the @IDX value
+  makes up nearly all of the packed record, so the record size gives
+  an upper bound for the list length.
+ */
+static unsigned int ldb_kv_index_dn_estimate(
+	struct ldb_module *module,
+	struct ldb_kv_private *ldb_kv,
+	const struct ldb_parse_tree *tree)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	enum key_truncation truncation = KEY_NOT_TRUNCATED;
+	unsigned int estimate = LDB_KV_ESTIMATE_UNKNOWN;
+	TALLOC_CTX *tmp_ctx = NULL;
+	struct ldb_dn *dn = NULL;
+	struct ldb_val key;
+	size_t size = 0;
+	int ret;
+
+	if (tree->operation != LDB_OP_EQUALITY) {
+		return LDB_KV_ESTIMATE_UNKNOWN;
+	}
+	if (ldb_kv->cache->GUID_index_attribute == NULL) {
+		return LDB_KV_ESTIMATE_UNKNOWN;
+	}
+	if (!ldb_kv_is_indexed(module, ldb_kv, tree->u.equality.attr)) {
+		return LDB_KV_ESTIMATE_UNKNOWN;
+	}
+
+	tmp_ctx = talloc_new(ldb_kv);
+	if (tmp_ctx == NULL) {
+		return LDB_KV_ESTIMATE_UNKNOWN;
+	}
+
+	dn = ldb_kv_index_key(ldb,
+			      tmp_ctx,
+			      ldb_kv,
+			      tree->u.equality.attr,
+			      &tree->u.equality.value,
+			      NULL,
+			      &truncation);
+	if (dn == NULL) {
+		goto done;
+	}
+
+	if (ldb_kv->idxptr != NULL) {
+		struct ldb_dn_list_state state = {
+			.module = module,
+		};
+		TDB_DATA tkey = {
+			.dptr = discard_const_p(unsigned char,
+						ldb_dn_get_linearized(dn)),
+		};
+
+		if (tkey.dptr == NULL) {
+			goto done;
+		}
+		tkey.dsize = strlen((char *)tkey.dptr);
+
+		/*
+		 * Changes of this transaction are only in the
+		 * caches, see ldb_kv_dn_list_load()
+		 */
+		ret = -1;
+		if (ldb_kv->nested_idx_ptr != NULL) {
+			ret = tdb_parse_record(ldb_kv->nested_idx_ptr->itdb,
+					       tkey,
+					       ldb_kv_index_idxptr_wrapper,
+					       &state);
+		}
+		if (ret == -1) {
+			ret = tdb_parse_record(ldb_kv->idxptr->itdb,
+					       tkey,
+					       ldb_kv_index_idxptr_wrapper,
+					       &state);
+		}
+		if (ret == 0) {
+			if (state.list != NULL) {
+				estimate = state.list->count;
+			}
+			goto done;
+		}
+	}
+
+	key = ldb_kv_key_dn(tmp_ctx, dn);
+	if (key.data == NULL) {
+		goto done;
+	}
+
+	ret = ldb_kv->kv_ops->fetch_and_parse(ldb_kv,
+					       key,
+					       ldb_kv_index_size_parser,
+					       &size);
+	if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+		estimate = 0;
+	} else if (ret == LDB_SUCCESS) {
+		estimate = MIN(size / LDB_KV_GUID_SIZE,
+			       LDB_KV_ESTIMATE_UNKNOWN - 1);
+	}
+
+done:
+	TALLOC_FREE(tmp_ctx);
+	return estimate;
+}
+
+struct ldb_kv_and_clause {
+	unsigned int idx;
+	unsigned int estimate;
+};
+
+static int ldb_kv_and_clause_cmp(const struct ldb_kv_and_clause *c1,
+				 const struct ldb_kv_and_clause *c2)
+{
+	if (c1->estimate != c2->estimate) {
+		return (c1->estimate < c2->estimate) ? -1 : 1;
+	}
+	/* Keep the filter order for clauses of equal cost */
+	return NUMERIC_CMP(c1->idx, c2->idx);
+}
+
 /*
   process an AND expression (intersection)
  */
@@ -1693,6 +2012,7 @@ static int ldb_kv_index_dn_and(struct ldb_module *module,
 			       struct dn_list *list)
 {
 	struct ldb_context *ldb;
+	struct ldb_kv_and_clause *clauses = NULL;
 	unsigned int i;
 	bool found;
 
@@ -1728,14 +2048,50 @@ static int ldb_kv_index_dn_and(struct ldb_module *module,
 		}
 	}
 
-	/* now do a full intersection */
+	/*
+	 * now do a full intersection, starting with the clauses
+	 * expected to return the fewest entries
+	 */
 	found = false;
 
+	clauses = talloc_array(list,
+			       struct ldb_kv_and_clause,
+			       tree->u.list.num_elements);
+	if (clauses == NULL) {
+		return ldb_module_oom(module);
+	}
 	for (i=0; i<tree->u.list.num_elements; i++) {
-		const struct ldb_parse_tree *subtree = tree->u.list.elements[i];
+		clauses[i] = (struct ldb_kv_and_clause) {
+			.idx = i,
+			.estimate = ldb_kv_index_dn_estimate(
+				module, ldb_kv, tree->u.list.elements[i]),
+		};
+	}
+	TYPESAFE_QSORT(clauses,
+		       tree->u.list.num_elements,
+		       ldb_kv_and_clause_cmp);
+
+	for (i=0; i<tree->u.list.num_elements; i++) {
+		const struct ldb_parse_tree *subtree =
+			tree->u.list.elements[clauses[i].idx];
 		struct dn_list *list2;
 		int ret;
 
+		if (found &&
+		    (list->count <= LDB_KV_AND_FILTER_CANDIDATES) &&
+		    ((clauses[i].estimate == LDB_KV_ESTIMATE_UNKNOWN) ||
+		     (clauses[i].estimate / LDB_KV_AND_COST_RATIO >=
+		      list->count))) {
+			/*
+			 * Filtering the few candidates is cheaper
+			 * than loading the remaining indexes
+			 */
+			ldb_kv->index_stats.and_skipped +=
+				tree->u.list.num_elements - i;
+			TALLOC_FREE(clauses);
+			return LDB_SUCCESS;
+		}
+
 		list2 = talloc_zero(list, struct dn_list);
 		if (list2 == NULL) {
 			return ldb_module_oom(module);
@@ -1748,6 +2104,7 @@ static int ldb_kv_index_dn_and(struct ldb_module *module,
 			list->dn = NULL;
 			list->count = 0;
 			talloc_free(list2);
+			TALLOC_FREE(clauses);
 			return LDB_ERR_NO_SUCH_OBJECT;
 		}
 
@@ -1764,20 +2121,25 @@ static int ldb_kv_index_dn_and(struct ldb_module *module,
 			found = true;
 		} else if (!list_intersect(ldb_kv, list, list2)) {
 			talloc_free(list2);
+			TALLOC_FREE(clauses);
 			return LDB_ERR_OPERATIONS_ERROR;
 		}
 
 		if (list->count == 0) {
 			list->dn = NULL;
+			TALLOC_FREE(clauses);
 			return LDB_ERR_NO_SUCH_OBJECT;
 		}
 
 		if (list->count < 2) {
 			/* it isn't worth loading the next part of the tree */
+			TALLOC_FREE(clauses);
 			return LDB_SUCCESS;
 		}
 	}
 
+	TALLOC_FREE(clauses);
+
 	if (!found) {
 		/* none of the attributes were indexed */
 		return LDB_ERR_OPERATIONS_ERROR;
@@ -2420,17 +2782,18 @@ static int ldb_kv_index_filter(struct ldb_kv_private *ldb_kv,
 		}
 
 		ret =
-		    ldb_kv_search_key(ac->module,
-				      ldb_kv,
-				      keys[i],
-				      msg,
-				      LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC |
-				      /*
-				       * The entry point ldb_kv_search_indexed is
-				       * only called from the read-locked
-				       * ldb_kv_search.
-				       */
-				      LDB_UNPACK_DATA_FLAG_READ_LOCKED);
+		    ldb_kv_search_key_attrs(ac->module,
+					    ldb_kv,
+					    keys[i],
+					    msg,
+					    ac->index_attrs,
+					    LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC |
+					    /*
+					     * The entry point ldb_kv_search_indexed
+					     * is only called from the read-locked
+					     * ldb_kv_search.
+					     */
+					    LDB_UNPACK_DATA_FLAG_READ_LOCKED);
 		if (ret == LDB_ERR_NO_SUCH_OBJECT) {
 			/*
 			 * the record has disappeared? yes, this can
@@ -2478,8 +2841,7 @@ static int ldb_kv_index_filter(struct ldb_kv_private *ldb_kv,
 			}
 		}
 
-		ret = ldb_match_message(ldb, msg, ac->tree,
-					ac->scope, &matched);
+		ret = ldb_kv_match_message(ac, msg, &matched);
 		if (ret != LDB_SUCCESS) {
 			talloc_free(keys);
 			talloc_free(msg);
@@ -2577,6 +2939,8 @@ int ldb_kv_search_indexed(struct ldb_kv_context *ac, uint32_t *match_count)
 		return ldb_module_oom(ac->module);
 	}
 
+	ldb_kv->index_stats = (struct ldb_kv_index_stats) {};
+
 	/*
 	 * For the purposes of selecting the switch arm below, if we
 	 * don't have a one-level index then treat it like a subtree
@@ -2715,6 +3079,22 @@ int ldb_kv_search_indexed(struct ldb_kv_context *ac, uint32_t *match_count)
 	 * processing as the truncation here refers only to the
 	 * SCOPE_ONELEVEL index.
 	 */
+	if (ldb_kv->show_index_work) {
+		struct ldb_kv_index_stats *st = &ldb_kv->index_stats;
+		char *filter = ldb_filter_from_tree(dn_list, ac->tree);
+
+		ldb_debug(ldb, LDB_DEBUG_WARNING,
+			  "index work for %s: %u records with %llu values "
+			  "loaded, %u intersections (%llu -> %llu values), "
+			  "%u unions, %u AND clauses skipped, %u candidates",
+			  filter != NULL ? filter : "<filter>",
+			  st->records_loaded, st->values_loaded,
+			  st->intersections, st->intersect_in,
+			  st->intersect_out, st->unions, st->and_skipped,
+			  dn_list->count);
+		TALLOC_FREE(filter);
+	}
+
 	ret = ldb_kv_index_filter(
 	    ldb_kv, dn_list, ac, match_count, scope_one_truncation);
 	talloc_free(dn_list);
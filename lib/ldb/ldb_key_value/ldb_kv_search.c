@@ -101,6 +101,7 @@ struct ldb_kv_parse_data_unpack_ctx {
 	struct ldb_message *msg;
 	struct ldb_module *module;
 	struct ldb_kv_private *ldb_kv;
+	const char * const *attrs;
 	unsigned int unpack_flags;
 };
 
@@ -151,8 +152,8 @@ static int ldb_kv_parse_data_unpack(struct ldb_val key,
 		}
 	}
 
-	ret = ldb_unpack_data_flags(ldb, &data_parse,
-				    ctx->msg, ctx->unpack_flags);
+	ret = ldb_unpack_data_attrs_flags(ldb, &data_parse, ctx->msg,
+					  ctx->attrs, ctx->unpack_flags);
 	if (ret == -1) {
 		if (data_parse.data != data.data) {
 			talloc_free(data_parse.data);
@@ -178,11 +179,27 @@ int ldb_kv_search_key(struct ldb_module *module,
 		      const struct ldb_val ldb_key,
 		      struct ldb_message *msg,
 		      unsigned int unpack_flags)
+{
+	return ldb_kv_search_key_attrs(module, ldb_kv, ldb_key, msg,
+				       NULL, unpack_flags);
+}
+
+/*
+  as ldb_kv_search_key(), but only unpack the elements in attrs if it
+  is not NULL
+ */
+int ldb_kv_search_key_attrs(struct ldb_module *module,
+			    struct ldb_kv_private *ldb_kv,
+			    const struct ldb_val ldb_key,
+			    struct ldb_message *msg,
+			    const char * const *attrs,
+			    unsigned int unpack_flags)
 {
 	int ret;
 	struct ldb_kv_parse_data_unpack_ctx ctx = {
 		.msg = msg,
 		.module = module,
+		.attrs = attrs,
 		.unpack_flags = unpack_flags,
 		.ldb_kv = ldb_kv
 	};
@@ -302,6 +319,212 @@ int ldb_kv_filter_attrs_in_place(struct ldb_message *msg,
 	return ldb_filter_attrs_in_place(msg, attrs);
 }
 
+/*
+  unpack a record found by a non-indexed search, only the elements in
+  attrs if it is not NULL
+ */
+static int search_unpack(struct ldb_kv_context *ac,
+			 TALLOC_CTX *mem_ctx,
+			 struct ldb_val key,
+			 struct ldb_val val,
+			 const char * const *attrs,
+			 struct ldb_message **pmsg)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(ac->module);
+	struct ldb_message *msg;
+	int ret;
+
+	msg = ldb_msg_new(mem_ctx);
+	if (!msg) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	/* unpack the record */
+	ret = ldb_unpack_data_attrs_flags(ldb, &val, msg, attrs,
+					  LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC);
+	if (ret == -1) {
+		talloc_free(msg);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	if (!msg->dn) {
+		msg->dn = ldb_dn_new(msg, ldb,
+				     (char *)key.data + 3);
+		if (msg->dn == NULL) {
+			talloc_free(msg);
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+	}
+
+	*pmsg = msg;
+	return LDB_SUCCESS;
+}
+
+/*
+  unpack the elements of a record needed to match it against the
+  filter, *pmsg is NULL if the record is not within the scope of the
+  search
+ */
+static int search_unpack_in_scope(struct ldb_kv_context *ac,
+				  TALLOC_CTX *mem_ctx,
+				  struct ldb_val key,
+				  struct ldb_val val,
+				  struct ldb_message **pmsg)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(ac->module);
+	struct ldb_message *msg = NULL;
+	int ret;
+
+	*pmsg = NULL;
+
+	ret = search_unpack(ac, mem_ctx, key, val, ac->match_attrs, &msg);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	/*
+	 * The redaction callback may be expensive to call if it fetches a
+	 * security descriptor. Check the DN early and bail out if it doesn't
+	 * match the base.
+	 */
+	if (!ldb_match_scope(ldb, ac->base, msg->dn, ac->scope)) {
+		talloc_free(msg);
+		return LDB_SUCCESS;
+	}
+
+	*pmsg = msg;
+	return LDB_SUCCESS;
+}
+
+/*
+  see if an unpacked record matches the search filter
+ */
+/*
+  match a candidate against the filter of the search, using the
+  compiled program if there is one
+ */
+int ldb_kv_match_message(struct ldb_kv_context *ac,
+			 const struct ldb_message *msg,
+			 bool *matched)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(ac->module);
+
+	if (ac->match_program != NULL) {
+		return ldb_match_program_run(ldb, ac->match_program,
+					     msg, ac->scope, matched);
+	}
+	return ldb_match_message(ldb, msg, ac->tree, ac->scope, matched);
+}
+
+static int search_match(struct ldb_kv_context *ac,
+			struct ldb_message *msg,
+			bool *matched)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(ac->module);
+	int ret;
+
+	if (ldb->redact.callback != NULL) {
+		ret = ldb->redact.callback(ldb->redact.module, ac->req, msg);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+
+	/* see if it matches the given expression */
+	ret = ldb_kv_match_message(ac, msg, matched);
+	if (ret != LDB_SUCCESS) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	return LDB_SUCCESS;
+}
+
+/*
+  turn a matching record into the reply, reducing it to the requested
+  attributes. If only the filter attributes were unpacked, *pmsg is
+  replaced by the full record.
+ */
+static int search_prepare_reply(struct ldb_kv_context *ac,
+				 struct ldb_val key,
+				 struct ldb_val val,
+				 struct ldb_message **pmsg)
+{
+	struct ldb_message *msg = *pmsg;
+	int ret;
+
+	if (ac->match_attrs != NULL) {
+		struct ldb_message *full = NULL;
+
+		ret = search_unpack(ac,
+				    talloc_parent(msg),
+				    key,
+				    val,
+				    NULL,
+				    &full);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+		TALLOC_FREE(*pmsg);
+		*pmsg = msg = full;
+	}
+
+	ret = ldb_msg_add_distinguished_name(msg);
+	if (ret == -1) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	/* filter the attributes that the user wants */
+	ret = ldb_kv_filter_attrs_in_place(msg, ac->attrs);
+	if (ret != LDB_SUCCESS) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ldb_msg_shrink_to_fit(msg);
+
+	/* Ensure the message elements are all talloc'd. */
+	ret = ldb_msg_elements_take_ownership(msg);
+	if (ret != LDB_SUCCESS) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	return LDB_SUCCESS;
+}
+
+/*
+  Check the time every 64 records, to reduce calls to
+  gettimeofday().  This is a compromise, not all calls to
+  ldb_match_message() will take the same time, most will fail
+  quickly but by luck it might be possible to have 64 records
+  that are slow, doing a recursive search via
+  LDAP_MATCHING_RULE_IN_CHAIN.
+ */
+static bool search_timed_out(struct ldb_kv_context *ac)
+{
+	struct timeval now;
+	int timeval_cmp;
+
+	if (ac->timeout_counter++ % 64 != 0) {
+		return false;
+	}
+
+	now = tevent_timeval_current();
+	timeval_cmp = tevent_timeval_compare(&ac->timeout_timeval,
+					     &now);
+
+	/*
+	 * The search has taken too long.  This is the most
+	 * likely place for our time to expire, as we are in
+	 * an un-indexed search and we return the data from
+	 * within this loop.  The tevent based timeout is not
+	 * likely to be hit, sadly.
+	 *
+	 * ldb_match_msg_error() can be quite expensive if a
+	 * LDAP_MATCHING_RULE_IN_CHAIN extended match was
+	 * specified.
+	 */
+	return timeval_cmp <= 0;
+}
+
 /*
   search function for a non-indexed search
  */
@@ -310,15 +533,12 @@ static int search_func(_UNUSED_ struct ldb_kv_private *ldb_kv,
 		       struct ldb_val val,
 		       void *state)
 {
-	struct ldb_context *ldb;
 	struct ldb_kv_context *ac;
 	struct ldb_message *msg;
-	struct timeval now;
-	int ret, timeval_cmp;
+	int ret;
 	bool matched;
 
 	ac = talloc_get_type(state, struct ldb_kv_context);
-	ldb = ldb_module_get_ctx(ac->module);
 
 	/*
 	 * We want to skip @ records early in a search full scan
@@ -341,117 +561,189 @@ static int search_func(_UNUSED_ struct ldb_kv_private *ldb_kv,
 		return 0;
 	}
 
-	/*
-	 * Check the time every 64 records, to reduce calls to
-	 * gettimeofday().  This is a compromise, not all calls to
-	 * ldb_match_message() will take the same time, most will fail
-	 * quickly but by luck it might be possible to have 64 records
-	 * that are slow, doing a recursive search via
-	 * LDAP_MATCHING_RULE_IN_CHAIN.
-	 */
-	if (ac->timeout_counter++ % 64 == 0) {
-		now = tevent_timeval_current();
-		timeval_cmp = tevent_timeval_compare(&ac->timeout_timeval,
-						     &now);
+	if (search_timed_out(ac)) {
+		ac->error = LDB_ERR_TIME_LIMIT_EXCEEDED;
+		return -1;
+	}
 
-		/*
-		 * The search has taken too long.  This is the most
-		 * likely place for our time to expire, as we are in
-		 * an un-indexed search and we return the data from
-		 * within this loop.  The tevent based timeout is not
-		 * likely to be hit, sadly.
-		 *
-		 * ldb_match_msg_error() can be quite expensive if a
-		 * LDAP_MATCHING_RULE_IN_CHAIN extended match was
-		 * specified.
-		 */
-		if (timeval_cmp <= 0) {
-			ac->error = LDB_ERR_TIME_LIMIT_EXCEEDED;
-			return -1;
-		}
+	ret = search_unpack_in_scope(ac, ac, key, val, &msg);
+	if (ret != LDB_SUCCESS) {
+		ac->error = ret;
+		return -1;
+	}
+	if (msg == NULL) {
+		return 0;
 	}
 
-	msg = ldb_msg_new(ac);
-	if (!msg) {
-		ac->error = LDB_ERR_OPERATIONS_ERROR;
+	ret = search_match(ac, msg, &matched);
+	if (ret != LDB_SUCCESS) {
+		talloc_free(msg);
+		ac->error = ret;
 		return -1;
 	}
+	if (!matched) {
+		talloc_free(msg);
+		return 0;
+	}
 
-	/* unpack the record */
-	ret = ldb_unpack_data_flags(ldb, &val, msg,
-				    LDB_UNPACK_DATA_FLAG_NO_VALUES_ALLOC);
-	if (ret == -1) {
+	ret = search_prepare_reply(ac, key, val, &msg);
+	if (ret != LDB_SUCCESS) {
 		talloc_free(msg);
+		ac->error = ret;
+		return -1;
+	}
+
+	ret = ldb_module_send_entry(ac->req, msg, NULL);
+	if (ret != LDB_SUCCESS) {
+		ac->request_terminated = true;
+		/* the callback failed, abort the operation */
 		ac->error = LDB_ERR_OPERATIONS_ERROR;
 		return -1;
 	}
 
-	if (!msg->dn) {
-		msg->dn = ldb_dn_new(msg, ldb,
-				     (char *)key.data + 3);
-		if (msg->dn == NULL) {
-			talloc_free(msg);
-			ac->error = LDB_ERR_OPERATIONS_ERROR;
-			return -1;
+	return 0;
+}
+
+/*
+ * State of a full scan run on several threads by
+ * iterate_range_parallel.
+ *
+ * The workers unpack the records and check the scope. Matching the
+ * filter only happens on the worker threads if nothing in it calls
+ * back into the modules: a redaction callback (acl_read) or an
+ * extended match rule such as LDAP_MATCHING_RULE_IN_CHAIN may
+ * search the database themselves.
+ */
+struct ldb_kv_parallel_search {
+	struct ldb_kv_context *ac;
+	bool match_in_worker;
+};
+
+/*
+ * The key and value point into the read snapshot of the caller, they
+ * stay valid until the search is done.
+ */
+struct ldb_kv_parallel_result {
+	struct ldb_message *msg;
+	struct ldb_val key;
+	struct ldb_val val;
+};
+
+static bool search_tree_has_extended(const struct ldb_parse_tree *tree)
+{
+	unsigned int i;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			if (search_tree_has_extended(
+				    tree->u.list.elements[i])) {
+				return true;
+			}
 		}
+		return false;
+	case LDB_OP_NOT:
+		return search_tree_has_extended(tree->u.isnot.child);
+	case LDB_OP_EXTENDED:
+		return true;
+	default:
+		return false;
+	}
+}
+
+static int search_parallel_worker(TALLOC_CTX *mem_ctx,
+				  struct ldb_val key,
+				  struct ldb_val val,
+				  void *state,
+				  void **result)
+{
+	struct ldb_kv_parallel_search *ps = state;
+	struct ldb_kv_context *ac = ps->ac;
+	struct ldb_kv_parallel_result *res = NULL;
+	struct timeval now;
+	int ret;
+	bool matched;
+
+	if (ldb_kv_key_is_normal_record(key) == false) {
+		return LDB_SUCCESS;
 	}
 
 	/*
-	 * The redaction callback may be expensive to call if it fetches a
-	 * security descriptor. Check the DN early and bail out if it doesn't
-	 * match the base.
+	 * There is no per thread record counter, but the time
+	 * is cheap compared to unpacking the record.
 	 */
-	if (!ldb_match_scope(ldb, ac->base, msg->dn, ac->scope)) {
-		talloc_free(msg);
-		return 0;
+	now = tevent_timeval_current();
+	if (tevent_timeval_compare(&ac->timeout_timeval, &now) <= 0) {
+		return LDB_ERR_TIME_LIMIT_EXCEEDED;
 	}
 
-	if (ldb->redact.callback != NULL) {
-		ret = ldb->redact.callback(ldb->redact.module, ac->req, msg);
+	res = talloc(mem_ctx, struct ldb_kv_parallel_result);
+	if (res == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	*res = (struct ldb_kv_parallel_result) {
+		.key = key,
+		.val = val,
+	};
+
+	ret = search_unpack_in_scope(ac, res, key, val, &res->msg);
+	if (ret != LDB_SUCCESS || res->msg == NULL) {
+		talloc_free(res);
+		return ret;
+	}
+
+	if (ps->match_in_worker) {
+		ret = search_match(ac, res->msg, &matched);
+		if (ret != LDB_SUCCESS || !matched) {
+			talloc_free(res);
+			return ret;
+		}
+		ret = search_prepare_reply(ac, key, val, &res->msg);
 		if (ret != LDB_SUCCESS) {
-			talloc_free(msg);
+			talloc_free(res);
 			return ret;
 		}
 	}
 
-	/* see if it matches the given expression */
-	ret = ldb_match_message(ldb, msg,
-				ac->tree, ac->scope, &matched);
-	if (ret != LDB_SUCCESS) {
-		talloc_free(msg);
-		ac->error = LDB_ERR_OPERATIONS_ERROR;
-		return -1;
-	}
-	if (!matched) {
-		talloc_free(msg);
-		return 0;
-	}
+	*result = res;
+	return LDB_SUCCESS;
+}
 
-	ret = ldb_msg_add_distinguished_name(msg);
-	if (ret == -1) {
-		talloc_free(msg);
-		return LDB_ERR_OPERATIONS_ERROR;
-	}
+static int search_parallel_result(_UNUSED_ struct ldb_kv_private *ldb_kv,
+				  void *result,
+				  void *state)
+{
+	struct ldb_kv_parallel_search *ps = state;
+	struct ldb_kv_context *ac = ps->ac;
+	struct ldb_kv_parallel_result *res = result;
+	int ret;
+	bool matched;
 
-	/* filter the attributes that the user wants */
-	ret = ldb_kv_filter_attrs_in_place(msg, ac->attrs);
-	if (ret != LDB_SUCCESS) {
-		talloc_free(msg);
-		ac->error = LDB_ERR_OPERATIONS_ERROR;
+	if (search_timed_out(ac)) {
+		ac->error = LDB_ERR_TIME_LIMIT_EXCEEDED;
 		return -1;
 	}
 
-	ldb_msg_shrink_to_fit(msg);
-
-	/* Ensure the message elements are all talloc'd. */
-	ret = ldb_msg_elements_take_ownership(msg);
-	if (ret != LDB_SUCCESS) {
-		talloc_free(msg);
-		ac->error = LDB_ERR_OPERATIONS_ERROR;
-		return -1;
+	if (!ps->match_in_worker) {
+		ret = search_match(ac, res->msg, &matched);
+		if (ret != LDB_SUCCESS) {
+			ac->error = ret;
+			return -1;
+		}
+		if (!matched) {
+			return 0;
+		}
+		ret = search_prepare_reply(ac, res->key, res->val, &res->msg);
+		if (ret != LDB_SUCCESS) {
+			ac->error = ret;
+			return -1;
+		}
 	}
 
-	ret = ldb_module_send_entry(ac->req, msg, NULL);
+	ret = ldb_module_send_entry(ac->req,
+				    talloc_steal(ac, res->msg),
+				    NULL);
 	if (ret != LDB_SUCCESS) {
 		ac->request_terminated = true;
 		/* the callback failed, abort the operation */
@@ -475,6 +767,226 @@ struct ldb_val start_of_db_key = {.data=discard_const_p(uint8_t, "GUID<"),
 struct ldb_val end_of_db_key = {.data=discard_const_p(uint8_t, "GUID>"),
 				.length=6};
 
+/*
+  collect the attributes ldb_match_message() looks at, returns false if
+  the filter needs the whole record
+ */
+static bool search_collect_match_attrs(TALLOC_CTX *mem_ctx,
+				       const struct ldb_parse_tree *tree,
+				       const char ***pattrs)
+{
+	const char *attr = NULL;
+	unsigned int i;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			if (!search_collect_match_attrs(
+				    mem_ctx, tree->u.list.elements[i], pattrs)) {
+				return false;
+			}
+		}
+		return true;
+	case LDB_OP_NOT:
+		return search_collect_match_attrs(mem_ctx,
+						  tree->u.isnot.child,
+						  pattrs);
+	case LDB_OP_EQUALITY:
+		attr = tree->u.equality.attr;
+		break;
+	case LDB_OP_GREATER:
+	case LDB_OP_LESS:
+	case LDB_OP_APPROX:
+		attr = tree->u.comparison.attr;
+		break;
+	case LDB_OP_SUBSTRING:
+		attr = tree->u.substring.attr;
+		break;
+	case LDB_OP_PRESENT:
+		attr = tree->u.present.attr;
+		break;
+	case LDB_OP_EXTENDED:
+		attr = tree->u.extended.attr;
+		break;
+	}
+
+	if (attr == NULL) {
+		return false;
+	}
+	if (ldb_attr_in_list(*pattrs, attr)) {
+		return true;
+	}
+
+	*pattrs = ldb_attr_list_copy_add(mem_ctx, *pattrs, attr);
+	return *pattrs != NULL;
+}
+
+/*
+  A full scan rejects most records. To do that only the attributes of
+  the filter, and those the redaction callback reads, are unpacked.
+  The whole record is unpacked once it matched.
+ */
+static void ldb_kv_search_set_match_attrs(struct ldb_kv_context *ctx)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(ctx->module);
+	const char **attrs = NULL;
+	unsigned int i;
+
+	ctx->match_attrs = NULL;
+
+	if (ldb->redact.callback != NULL && ldb->redact.attrs == NULL) {
+		return;
+	}
+
+	attrs = talloc_zero_array(ctx, const char *, 1);
+	if (attrs == NULL) {
+		return;
+	}
+
+	if (!search_collect_match_attrs(ctx, ctx->tree, &attrs)) {
+		TALLOC_FREE(attrs);
+		return;
+	}
+
+	if (ldb->redact.callback != NULL) {
+		for (i = 0; ldb->redact.attrs[i] != NULL; i++) {
+			if (ldb_attr_in_list(attrs, ldb->redact.attrs[i])) {
+				continue;
+			}
+			attrs = ldb_attr_list_copy_add(ctx,
+						       attrs,
+						       ldb->redact.attrs[i]);
+			if (attrs == NULL) {
+				return;
+			}
+		}
+	}
+
+	ctx->match_attrs = attrs;
+}
+
+/*
+  The candidates of an indexed search are only unpacked once, so they
+  need the attributes of the filter and those the caller asked for.
+  Searches for a few attributes (eg objectGUID of all the members of
+  an objectClass) then skip the bulk of the records.
+ */
+static void ldb_kv_search_set_index_attrs(struct ldb_kv_context *ctx)
+{
+	const char **attrs = NULL;
+	unsigned int i;
+
+	ctx->index_attrs = NULL;
+
+	if (ctx->match_attrs == NULL || ctx->attrs == NULL) {
+		return;
+	}
+
+	attrs = ldb_attr_list_copy(ctx, ctx->match_attrs);
+	if (attrs == NULL) {
+		return;
+	}
+
+	for (i = 0; ctx->attrs[i] != NULL; i++) {
+		const char *attr = ctx->attrs[i];
+
+		if (strcmp(attr, "*") == 0) {
+			TALLOC_FREE(attrs);
+			return;
+		}
+		if (ldb_attr_in_list(attrs, attr)) {
+			continue;
+		}
+		attrs = ldb_attr_list_copy_add(ctx, attrs, attr);
+		if (attrs == NULL) {
+			return;
+		}
+	}
+
+	ctx->index_attrs = attrs;
+}
+
+/*
+  run the full search on ldb_kv->full_scan_threads threads, each
+  scanning the records whose GUID starts with a range of byte values.
+  Returns LDB_ERR_UNWILLING_TO_PERFORM if the serial search should be
+  used instead.
+*/
+static int ldb_kv_search_full_parallel(struct ldb_kv_private *ldb_kv,
+				       struct ldb_kv_context *ctx)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(ctx->module);
+	const size_t prefix_len = sizeof(LDB_KV_GUID_KEY_PREFIX) - 1;
+	struct ldb_kv_parallel_search ps = {
+		.ac = ctx,
+	};
+	unsigned int num_ranges = MIN(ldb_kv->full_scan_threads, 256);
+	struct ldb_val *bounds = NULL;
+	uint8_t *keys = NULL;
+	unsigned int i;
+	int ret;
+
+	/*
+	 * The workers compare against the base DN, make sure it is
+	 * exploded and case folded before they share it.
+	 */
+	if (ctx->base != NULL) {
+		if (ldb_dn_get_casefold(ctx->base) == NULL) {
+			return LDB_ERR_UNWILLING_TO_PERFORM;
+		}
+		(void)ldb_dn_get_comp_num(ctx->base);
+	}
+
+	ps.match_in_worker = (ldb->redact.callback == NULL) &&
+		!search_tree_has_extended(ctx->tree);
+
+	bounds = talloc_array(ctx, struct ldb_val, num_ranges + 1);
+	keys = talloc_array(bounds, uint8_t, num_ranges * (prefix_len + 1));
+	if (bounds == NULL || keys == NULL) {
+		TALLOC_FREE(bounds);
+		return LDB_ERR_UNWILLING_TO_PERFORM;
+	}
+
+	/*
+	 * The GUIDs are random, so splitting on their first byte
+	 * gives each thread about the same number of records. A key
+	 * of just the prefix and one byte sorts before any record key
+	 * starting with them.
+	 */
+	bounds[0] = start_of_db_key;
+	for (i = 1; i < num_ranges; i++) {
+		uint8_t *key = keys + i * (prefix_len + 1);
+
+		memcpy(key, LDB_KV_GUID_KEY_PREFIX, prefix_len);
+		key[prefix_len] = (i * 256) / num_ranges;
+		bounds[i] = (struct ldb_val) {
+			.data = key,
+			.length = prefix_len + 1,
+		};
+	}
+	bounds[num_ranges] = end_of_db_key;
+
+	/*
+	 * The workers explode and case fold DNs, keep them away from
+	 * the DN cache of the ldb context
+	 */
+	ldb->dn_cache_suspended++;
+	ret = ldb_kv->kv_ops->iterate_range_parallel(ldb_kv,
+						     bounds,
+						     num_ranges,
+						     search_parallel_worker,
+						     search_parallel_result,
+						     &ps);
+	ldb->dn_cache_suspended--;
+	TALLOC_FREE(bounds);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	return ctx->error;
+}
+
 /*
   search the database with a LDAP-like expression.
   this is the "full search" non-indexed variant
@@ -486,11 +998,21 @@ static int ldb_kv_search_full(struct ldb_kv_context *ctx)
 	    talloc_get_type(data, struct ldb_kv_private);
 	int ret;
 
+	ctx->error = LDB_SUCCESS;
+
+	if (ldb_kv->full_scan_threads > 1 &&
+	    ldb_kv->kv_ops->iterate_range_parallel != NULL &&
+	    ldb_kv->cache->GUID_index_attribute != NULL) {
+		ret = ldb_kv_search_full_parallel(ldb_kv, ctx);
+		if (ret != LDB_ERR_UNWILLING_TO_PERFORM) {
+			return ret;
+		}
+	}
+
 	/*
 	 * If the backend has an iterate_range op, use it to start the search
 	 * at the first GUID indexed record, skipping the indexes section.
 	 */
-	ctx->error = LDB_SUCCESS;
 	ret = ldb_kv->kv_ops->iterate_range(ldb_kv,
 					    start_of_db_key,
 					    end_of_db_key,
@@ -736,6 +1258,22 @@ int ldb_kv_search(struct ldb_kv_context *ctx)
 	if (ret == LDB_SUCCESS) {
 		uint32_t match_count = 0;
 
+		/*
+		 * The filter is evaluated against every candidate the
+		 * index or the full scan finds, so resolve the
+		 * attribute handlers and canonicalise the assertion
+		 * values once. If that fails the tree is matched
+		 * directly.
+		 */
+		ret = ldb_match_program_compile(ldb, ctx, ctx->tree,
+						&ctx->match_program);
+		if (ret != LDB_SUCCESS) {
+			ctx->match_program = NULL;
+		}
+
+		ldb_kv_search_set_match_attrs(ctx);
+		ldb_kv_search_set_index_attrs(ctx);
+
 		ret = ldb_kv_search_indexed(ctx, &match_count);
 		if (ret == LDB_ERR_NO_SUCH_OBJECT) {
 			/* Not in the index, therefore OK! */
@@ -25,6 +25,7 @@
 #include "ldb_mdb.h"
 #include "../ldb_key_value/ldb_kv.h"
 #include "include/dlinklist.h"
+#include <pthread.h>
 
 #define MDB_URL_PREFIX		"mdb://"
 #define MDB_URL_PREFIX_SIZE	(sizeof(MDB_URL_PREFIX)-1)
@@ -567,6 +568,373 @@ done:
 	return ldb_mdb_err_map(lmdb->error);
 }
 
+/*
+ * Results of a parallel traverse are handed to the calling thread in
+ * batches, and each worker stops when LMDB_PARALLEL_QUEUE batches
+ * are waiting, so memory use does not grow with the database. Below
+ * LMDB_PARALLEL_MIN_ENTRIES records starting the threads costs more
+ * than it saves.
+ */
+#define LMDB_PARALLEL_BATCH 64
+#define LMDB_PARALLEL_QUEUE 8
+#define LMDB_PARALLEL_MIN_ENTRIES 10000
+
+struct lmdb_parallel_batch {
+	struct lmdb_parallel_batch *prev, *next;
+	unsigned int num_results;
+	void *results[LMDB_PARALLEL_BATCH];
+};
+
+struct lmdb_parallel_state;
+
+struct lmdb_parallel_range {
+	struct lmdb_parallel_state *state;
+	pthread_t thread;
+	bool started;
+	MDB_val start;
+	MDB_val end;
+	/*
+	 * Parent of the batches. The worker allocates a batch and
+	 * the caller steals it only while holding state->mutex,
+	 * everything else below a batch belongs to one thread at a
+	 * time.
+	 */
+	TALLOC_CTX *mem_ctx;
+	struct lmdb_parallel_batch *batches;
+	unsigned int num_batches;
+	bool done;
+	int error;
+};
+
+struct lmdb_parallel_state {
+	MDB_env *env;
+	MDB_dbi dbi;
+	size_t txnid;
+	ldb_kv_parallel_fn worker_fn;
+	void *private_data;
+
+	pthread_mutex_t mutex;
+	pthread_cond_t cond;
+	unsigned int num_ready;
+	bool snapshot_mismatch;
+	bool stop;
+};
+
+static void lmdb_parallel_queue(struct lmdb_parallel_range *range,
+				struct lmdb_parallel_batch *batch)
+{
+	struct lmdb_parallel_state *state = range->state;
+
+	pthread_mutex_lock(&state->mutex);
+	DLIST_ADD_END(range->batches, batch);
+	range->num_batches++;
+	pthread_cond_broadcast(&state->cond);
+	pthread_mutex_unlock(&state->mutex);
+}
+
+static void *lmdb_parallel_worker(void *private_data)
+{
+	struct lmdb_parallel_range *range = private_data;
+	struct lmdb_parallel_state *state = range->state;
+	struct lmdb_parallel_batch *batch = NULL;
+	MDB_txn *txn = NULL;
+	MDB_cursor *cursor = NULL;
+	MDB_val mdb_key = range->start;
+	MDB_val mdb_data;
+	MDB_cursor_op op = MDB_SET_RANGE;
+	int mdb_ret;
+	int error = LDB_SUCCESS;
+	bool mismatch;
+
+	/*
+	 * Each thread needs its own read transaction. They are only
+	 * useful if they see the same snapshot as the caller, which
+	 * holds its read transaction open until we are done.
+	 */
+	mdb_ret = mdb_txn_begin(state->env, NULL, MDB_RDONLY, &txn);
+	mismatch = (mdb_ret != MDB_SUCCESS) ||
+		(mdb_txn_id(txn) != state->txnid);
+
+	pthread_mutex_lock(&state->mutex);
+	state->num_ready++;
+	if (mismatch) {
+		state->snapshot_mismatch = true;
+	}
+	pthread_cond_broadcast(&state->cond);
+	pthread_mutex_unlock(&state->mutex);
+
+	if (mismatch) {
+		goto done;
+	}
+
+	mdb_ret = mdb_cursor_open(txn, state->dbi, &cursor);
+
+	while (mdb_ret == MDB_SUCCESS) {
+		struct ldb_val key;
+		struct ldb_val data;
+		void *result = NULL;
+
+		mdb_ret = mdb_cursor_get(cursor, &mdb_key, &mdb_data, op);
+		op = MDB_NEXT;
+		if (mdb_ret != MDB_SUCCESS) {
+			break;
+		}
+		if (mdb_cmp(txn, state->dbi, &mdb_key, &range->end) >= 0) {
+			break;
+		}
+
+		if (batch == NULL) {
+			pthread_mutex_lock(&state->mutex);
+			while (!state->stop &&
+			       range->num_batches >= LMDB_PARALLEL_QUEUE) {
+				pthread_cond_wait(&state->cond,
+						  &state->mutex);
+			}
+			if (!state->stop) {
+				batch = talloc_zero(range->mem_ctx,
+						    struct lmdb_parallel_batch);
+			}
+			pthread_mutex_unlock(&state->mutex);
+			if (batch == NULL) {
+				error = state->stop ? LDB_SUCCESS :
+					LDB_ERR_OPERATIONS_ERROR;
+				break;
+			}
+		}
+
+		key = (struct ldb_val) {
+			.length = mdb_key.mv_size,
+			.data = mdb_key.mv_data,
+		};
+		data = (struct ldb_val) {
+			.length = mdb_data.mv_size,
+			.data = mdb_data.mv_data,
+		};
+
+		error = state->worker_fn(batch,
+					 key,
+					 data,
+					 state->private_data,
+					 &result);
+		if (error != LDB_SUCCESS) {
+			break;
+		}
+		if (result == NULL) {
+			continue;
+		}
+
+		batch->results[batch->num_results++] = result;
+		if (batch->num_results == LMDB_PARALLEL_BATCH) {
+			lmdb_parallel_queue(range, batch);
+			batch = NULL;
+		}
+	}
+	if (mdb_ret == MDB_NOTFOUND) {
+		mdb_ret = MDB_SUCCESS;
+	}
+	if (error == LDB_SUCCESS && mdb_ret != MDB_SUCCESS) {
+		error = ldb_mdb_err_map(mdb_ret);
+	}
+
+done:
+	if (cursor != NULL) {
+		mdb_cursor_close(cursor);
+	}
+	if (txn != NULL) {
+		mdb_txn_abort(txn);
+	}
+
+	pthread_mutex_lock(&state->mutex);
+	if (batch != NULL) {
+		DLIST_ADD_END(range->batches, batch);
+		range->num_batches++;
+	}
+	range->error = error;
+	range->done = true;
+	pthread_cond_broadcast(&state->cond);
+	pthread_mutex_unlock(&state->mutex);
+
+	return NULL;
+}
+
+/*
+ * Pass the results of one range to fn in order, returns false if fn
+ * asked to stop.
+ */
+static bool lmdb_parallel_collect(struct ldb_kv_private *ldb_kv,
+				  struct lmdb_parallel_range *range,
+				  ldb_kv_parallel_result_fn fn,
+				  void *ctx,
+				  TALLOC_CTX *mem_ctx,
+				  int *error)
+{
+	struct lmdb_parallel_state *state = range->state;
+
+	for (;;) {
+		struct lmdb_parallel_batch *batch = NULL;
+		unsigned int i;
+
+		pthread_mutex_lock(&state->mutex);
+		while (range->batches == NULL && !range->done) {
+			pthread_cond_wait(&state->cond, &state->mutex);
+		}
+		batch = range->batches;
+		if (batch != NULL) {
+			DLIST_REMOVE(range->batches, batch);
+			range->num_batches--;
+			talloc_steal(mem_ctx, batch);
+			pthread_cond_broadcast(&state->cond);
+		}
+		*error = range->error;
+		pthread_mutex_unlock(&state->mutex);
+
+		if (batch == NULL) {
+			/* The range is done and everything is passed on */
+			return *error == LDB_SUCCESS;
+		}
+
+		for (i = 0; i < batch->num_results; i++) {
+			int ret = fn(ldb_kv, batch->results[i], ctx);
+			if (ret != 0) {
+				TALLOC_FREE(batch);
+				*error = LDB_SUCCESS;
+				return false;
+			}
+		}
+		TALLOC_FREE(batch);
+	}
+}
+
+static int lmdb_iterate_range_parallel(struct ldb_kv_private *ldb_kv,
+				       const struct ldb_val *bounds,
+				       unsigned int num_ranges,
+				       ldb_kv_parallel_fn worker_fn,
+				       ldb_kv_parallel_result_fn fn,
+				       void *ctx)
+{
+	struct lmdb_private *lmdb = ldb_kv->lmdb_private;
+	struct lmdb_parallel_state state = {
+		.env = lmdb->env,
+		.worker_fn = worker_fn,
+		.private_data = ctx,
+	};
+	struct lmdb_parallel_range *ranges = NULL;
+	MDB_stat st;
+	unsigned int i;
+	int error = LDB_SUCCESS;
+	int ret;
+
+	/*
+	 * Changes of a write transaction are not visible to other
+	 * transactions, only a read transaction can be shared.
+	 */
+	if (num_ranges < 2 || lmdb_private_trans_head(lmdb) != NULL ||
+	    lmdb->read_txn == NULL) {
+		return LDB_ERR_UNWILLING_TO_PERFORM;
+	}
+
+	ret = mdb_dbi_open(lmdb->read_txn, NULL, 0, &state.dbi);
+	if (ret != MDB_SUCCESS) {
+		return LDB_ERR_UNWILLING_TO_PERFORM;
+	}
+	ret = mdb_stat(lmdb->read_txn, state.dbi, &st);
+	if (ret != MDB_SUCCESS || st.ms_entries < LMDB_PARALLEL_MIN_ENTRIES) {
+		return LDB_ERR_UNWILLING_TO_PERFORM;
+	}
+	state.txnid = mdb_txn_id(lmdb->read_txn);
+
+	ranges = talloc_zero_array(ldb_kv,
+				   struct lmdb_parallel_range,
+				   num_ranges);
+	if (ranges == NULL) {
+		return LDB_ERR_UNWILLING_TO_PERFORM;
+	}
+	for (i = 0; i < num_ranges; i++) {
+		ranges[i] = (struct lmdb_parallel_range) {
+			.state = &state,
+			.start = {
+				.mv_size = bounds[i].length,
+				.mv_data = bounds[i].data,
+			},
+			.end = {
+				.mv_size = bounds[i+1].length,
+				.mv_data = bounds[i+1].data,
+			},
+			.mem_ctx = talloc_new(ranges),
+		};
+		if (ranges[i].mem_ctx == NULL) {
+			TALLOC_FREE(ranges);
+			return LDB_ERR_UNWILLING_TO_PERFORM;
+		}
+	}
+
+	if (pthread_mutex_init(&state.mutex, NULL) != 0) {
+		TALLOC_FREE(ranges);
+		return LDB_ERR_UNWILLING_TO_PERFORM;
+	}
+	if (pthread_cond_init(&state.cond, NULL) != 0) {
+		pthread_mutex_destroy(&state.mutex);
+		TALLOC_FREE(ranges);
+		return LDB_ERR_UNWILLING_TO_PERFORM;
+	}
+
+	for (i = 0; i < num_ranges; i++) {
+		ret = pthread_create(&ranges[i].thread,
+				     NULL,
+				     lmdb_parallel_worker,
+				     &ranges[i]);
+		if (ret != 0) {
+			error = LDB_ERR_UNWILLING_TO_PERFORM;
+			goto stop;
+		}
+		ranges[i].started = true;
+	}
+
+	/*
+	 * Nothing must be passed on before we know this gives the
+	 * same result as a serial traverse would.
+	 */
+	pthread_mutex_lock(&state.mutex);
+	while (state.num_ready < num_ranges) {
+		pthread_cond_wait(&state.cond, &state.mutex);
+	}
+	pthread_mutex_unlock(&state.mutex);
+	if (state.snapshot_mismatch) {
+		error = LDB_ERR_UNWILLING_TO_PERFORM;
+		goto stop;
+	}
+
+	for (i = 0; i < num_ranges; i++) {
+		bool ok = lmdb_parallel_collect(ldb_kv,
+						&ranges[i],
+						fn,
+						ctx,
+						ranges,
+						&error);
+		if (!ok) {
+			break;
+		}
+	}
+
+stop:
+	pthread_mutex_lock(&state.mutex);
+	state.stop = true;
+	pthread_cond_broadcast(&state.cond);
+	pthread_mutex_unlock(&state.mutex);
+
+	for (i = 0; i < num_ranges; i++) {
+		if (ranges[i].started) {
+			pthread_join(ranges[i].thread, NULL);
+		}
+	}
+
+	pthread_cond_destroy(&state.cond);
+	pthread_mutex_destroy(&state.mutex);
+	TALLOC_FREE(ranges);
+
+	return error;
+}
+
 static int lmdb_lock_read(struct ldb_module *module)
 {
 	void *data = ldb_module_get_private(module);
@@ -589,10 +957,25 @@ static int lmdb_lock_read(struct ldb_module *module)
 	lmdb->error = MDB_SUCCESS;
 	if (lmdb_transaction_active(ldb_kv) == false &&
 	    ldb_kv->read_lock_count == 0) {
-		lmdb->error = mdb_txn_begin(lmdb->env,
-					    NULL,
-					    MDB_RDONLY,
-					    &lmdb->read_txn);
+		if (lmdb->idle_read_txn != NULL) {
+			/*
+			 * mdb_txn_renew() takes a new snapshot, so
+			 * changes made since the reset are visible
+			 */
+			lmdb->error = mdb_txn_renew(lmdb->idle_read_txn);
+			if (lmdb->error == MDB_SUCCESS) {
+				lmdb->read_txn = lmdb->idle_read_txn;
+			} else {
+				mdb_txn_abort(lmdb->idle_read_txn);
+			}
+			lmdb->idle_read_txn = NULL;
+		}
+		if (lmdb->read_txn == NULL) {
+			lmdb->error = mdb_txn_begin(lmdb->env,
+						    NULL,
+						    MDB_RDONLY,
+						    &lmdb->read_txn);
+		}
 	}
 	if (lmdb->error != MDB_SUCCESS) {
 		return ldb_mdb_error(lmdb->ldb, lmdb->error);
@@ -611,7 +994,12 @@ static int lmdb_unlock_read(struct ldb_module *module)
 	if (lmdb_transaction_active(ldb_kv) == false &&
 	    ldb_kv->read_lock_count == 1) {
 		struct lmdb_private *lmdb = ldb_kv->lmdb_private;
-		mdb_txn_commit(lmdb->read_txn);
+		if (lmdb->reuse_read_txn) {
+			mdb_txn_reset(lmdb->read_txn);
+			lmdb->idle_read_txn = lmdb->read_txn;
+		} else {
+			mdb_txn_commit(lmdb->read_txn);
+		}
 		lmdb->read_txn = NULL;
 		ldb_kv->read_lock_count--;
 		return LDB_SUCCESS;
@@ -803,6 +1191,7 @@ static struct kv_db_ops lmdb_key_value_ops = {
 	.update_in_iterate  = lmdb_update_in_iterate,
 	.fetch_and_parse    = lmdb_parse_record,
 	.iterate_range      = lmdb_iterate_range,
+	.iterate_range_parallel = lmdb_iterate_range_parallel,
 	.lock_read          = lmdb_lock_read,
 	.unlock_read        = lmdb_unlock_read,
 	.begin_write        = lmdb_transaction_start,
@@ -866,6 +1255,10 @@ static int lmdb_pvt_destructor(struct lmdb_private *lmdb)
 	if (lmdb->read_txn != NULL) {
 		mdb_txn_abort(lmdb->read_txn);
 	}
+	if (lmdb->idle_read_txn != NULL) {
+		mdb_txn_abort(lmdb->idle_read_txn);
+		lmdb->idle_read_txn = NULL;
+	}
 
 	if (lmdb->env == NULL) {
 		return 0;
@@ -1127,6 +1520,15 @@ int lmdb_connect(struct ldb_context *ldb,
 		}
 	}
 
+	/*
+	 * Keep the read transaction handle between read locks, for
+	 * callers doing many small searches
+	 */
+	if (ldb_options_find(ldb, ldb->options,
+			     "lmdb_reuse_read_txn") != NULL) {
+		lmdb->reuse_read_txn = true;
+	}
+
 	ret = lmdb_pvt_open(lmdb, ldb, path, env_map_size, flags);
 	if (ret != LDB_SUCCESS) {
 		TALLOC_FREE(ldb_kv);
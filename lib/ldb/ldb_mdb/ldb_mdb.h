@@ -41,6 +41,15 @@ struct lmdb_private {
 	int error;
 	MDB_txn *read_txn;
 
+	/*
+	 * With the "lmdb_reuse_read_txn" option the read transaction
+	 * is only reset when the last read lock is dropped, and
+	 * renewed by the next one.  This keeps the reader table slot
+	 * and the MDB_txn allocation, but not the snapshot.
+	 */
+	bool reuse_read_txn;
+	MDB_txn *idle_read_txn;
+
 	pid_t pid;
 
 };
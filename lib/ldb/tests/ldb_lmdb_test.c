@@ -549,6 +549,87 @@ static void test_multiple_opens_across_fork(void **state)
 	assert_int_equal(WEXITSTATUS(wstatus), 0);
 }
 
+static struct lmdb_private *get_lmdb_private(struct ldb_context *ldb)
+{
+	void *data = NULL;
+	struct ldb_kv_private *ldb_kv = NULL;
+
+	data = ldb_module_get_private(ldb->modules);
+	assert_non_null(data);
+
+	ldb_kv = talloc_get_type(data, struct ldb_kv_private);
+	assert_non_null(ldb_kv);
+	assert_non_null(ldb_kv->lmdb_private);
+
+	return ldb_kv->lmdb_private;
+}
+
+static int count_by_dn(struct ldb_context *ldb, const char *dn_str)
+{
+	struct ldb_result *res = NULL;
+	struct ldb_dn *dn = NULL;
+	int ret;
+	int count;
+
+	dn = ldb_dn_new(ldb, ldb, dn_str);
+	assert_non_null(dn);
+
+	ret = ldb_search(ldb, ldb, &res, dn, LDB_SCOPE_BASE, NULL, NULL);
+	if (ret == LDB_ERR_NO_SUCH_OBJECT) {
+		TALLOC_FREE(dn);
+		return 0;
+	}
+	assert_int_equal(ret, LDB_SUCCESS);
+	count = res->count;
+
+	TALLOC_FREE(res);
+	TALLOC_FREE(dn);
+	return count;
+}
+
+static void test_reuse_read_txn(void **state)
+{
+	struct ldb_context *ldb1 = NULL;
+	struct lmdb_private *lmdb = NULL;
+	MDB_txn *txn = NULL;
+	struct ldb_message *msg = NULL;
+	const char *options[] = { "lmdb_reuse_read_txn", NULL };
+	int ret;
+	struct ldbtest_ctx *test_ctx = NULL;
+
+	test_ctx = talloc_get_type_abort(*state, struct ldbtest_ctx);
+
+	ldb1 = ldb_init(test_ctx, test_ctx->ev);
+	ret = ldb_connect(ldb1, test_ctx->dbpath, 0, options);
+	assert_int_equal(ret, 0);
+
+	lmdb = get_lmdb_private(ldb1);
+	assert_true(lmdb->reuse_read_txn);
+
+	assert_int_equal(count_by_dn(ldb1, "dc=reuse"), 0);
+
+	/* The read transaction is kept, but reset */
+	txn = lmdb->idle_read_txn;
+	assert_non_null(txn);
+	assert_null(lmdb->read_txn);
+
+	/* A change through another ldb is seen after the renew */
+	msg = ldb_msg_new(test_ctx);
+	assert_non_null(msg);
+	msg->dn = ldb_dn_new(msg, test_ctx->ldb, "dc=reuse");
+	assert_non_null(msg->dn);
+	ret = ldb_msg_add_string(msg, "objectUUID", "0123456789abcdef");
+	assert_int_equal(ret, LDB_SUCCESS);
+	ret = ldb_add(test_ctx->ldb, msg);
+	assert_int_equal(ret, LDB_SUCCESS);
+
+	assert_int_equal(count_by_dn(ldb1, "dc=reuse"), 1);
+	assert_ptr_equal(lmdb->idle_read_txn, txn);
+
+	TALLOC_FREE(msg);
+	TALLOC_FREE(ldb1);
+}
+
 int main(int argc, const char **argv)
 {
 	const struct CMUnitTest tests[] = {
@@ -584,6 +665,10 @@ int main(int argc, const char **argv)
 			test_multiple_opens_across_fork,
 			ldbtest_setup,
 			ldbtest_teardown),
+		cmocka_unit_test_setup_teardown(
+			test_reuse_read_txn,
+			ldbtest_setup,
+			ldbtest_teardown),
 	};
 
 	cmocka_set_message_output(CM_OUTPUT_SUBUNIT);
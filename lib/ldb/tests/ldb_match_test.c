@@ -286,6 +286,86 @@ static void test_wildcard_match_end_condition(void **state)
 	assert_true(matched);
 }
 
+/*
+ * A compiled filter has to give the same answer, and the same error,
+ * as matching the parse tree directly.
+ */
+static void test_match_program(void **state)
+{
+	struct ldbtest_ctx *ctx = *state;
+	struct ldb_message *msg = NULL;
+	size_t failed = 0;
+	size_t i;
+	int ret;
+	const char *filters[] = {
+		"(objectclass=USER)",
+		"(objectclass=*ser)",
+		"(objectclass= u*E*r )",
+		"(objectclass=*x*)",
+		"(&(objectclass=top)(!(birthLocation=*wich)))",
+		"(&(objectclass=top)(!(birthLocation=*WICH)))",
+		"(|(dn=cn=FOO,dc=samba,dc=org)(a=x))",
+		"(dn=cn=bar,dc=samba,dc=org)",
+		"(distinguishedName=cn=foo,dc=samba,dc=org)",
+		"(dn=*)",
+		"(missing=*)",
+		"(!(missing=*))",
+		"(birthLocation>=N)",
+		"(birthLocation<=N)",
+		"(birthLocation~=Norwich)",
+		"(a=*)",
+		"(a:1.2.840.113556.1.4.803:=1)",
+		"(a:1.2.840.113556.1.4.804:=6)",
+		"(a:1.2.3.4:=1)",
+		"(|(a:1.2.840.113556.1.4.803:=8)(objectclass=top))",
+	};
+
+	msg = ldb_msg_new(ctx);
+	assert_non_null(msg);
+	msg->dn = ldb_dn_new(msg, ctx->ldb, "cn=foo,dc=samba,dc=org");
+	assert_non_null(msg->dn);
+	ret = ldb_msg_add_string(msg, "objectclass", "top");
+	assert_int_equal(LDB_SUCCESS, ret);
+	ret = ldb_msg_add_string(msg, "objectclass", "user");
+	assert_int_equal(LDB_SUCCESS, ret);
+	ret = ldb_msg_add_string(msg, "birthLocation", "Norwich");
+	assert_int_equal(LDB_SUCCESS, ret);
+	ret = ldb_msg_add_string(msg, "a", "6");
+	assert_int_equal(LDB_SUCCESS, ret);
+
+	for (i = 0; i < ARRAY_SIZE(filters); i++) {
+		struct ldb_parse_tree *tree = NULL;
+		struct ldb_match_program *prog = NULL;
+		bool matched = false;
+		bool prog_matched = false;
+		int prog_ret;
+
+		tree = ldb_parse_tree(ctx, filters[i]);
+		assert_non_null(tree);
+		ret = ldb_match_program_compile(ctx->ldb, ctx, tree, &prog);
+		assert_int_equal(LDB_SUCCESS, ret);
+
+		ret = ldb_match_message(ctx->ldb, msg, tree,
+					LDB_SCOPE_SUBTREE, &matched);
+		prog_ret = ldb_match_program_run(ctx->ldb, prog, msg,
+						 LDB_SCOPE_SUBTREE,
+						 &prog_matched);
+		if (ret != prog_ret ||
+		    (ret == LDB_SUCCESS && matched != prog_matched)) {
+			print_error("%zu filter «%s»: tree %d/%d, "
+				    "program %d/%d\n",
+				    i, filters[i], ret, matched,
+				    prog_ret, prog_matched);
+			failed++;
+		}
+		TALLOC_FREE(prog);
+	}
+	if (failed != 0) {
+		fail_msg("different results for %zu/%zu filters\n",
+			 failed, ARRAY_SIZE(filters));
+	}
+}
+
 /*
  * Note: to run under valgrind use:
  *       valgrind \
@@ -307,6 +387,10 @@ int main(int argc, const char **argv)
 			test_wildcard_match_end_condition,
 			setup,
 			teardown),
+		cmocka_unit_test_setup_teardown(
+			test_match_program,
+			setup,
+			teardown),
 	};
 
 	cmocka_set_message_output(CM_OUTPUT_SUBUNIT);
@@ -36,3 +36,8 @@ $VALGRIND ldbadd $LDBDIR/tests/init.ldif || exit 1
 . $LDBDIR/tests/test-tdb-features.sh
 
 . $LDBDIR/tests/test-controls.sh
+
+echo "Starting ldbbench"
+rm -f $LDB_URL.bench
+$VALGRIND ldbbench --nosync --num-records 100 --num-searches 10 -H tdb://$LDB_URL.bench || exit 1
+rm -f $LDB_URL.bench
@@ -187,6 +187,15 @@ static struct poptOption builtin_popt_options[] = {
 		.descrip    = "display binary LDIF",
 		.argDescrip = NULL
 	},
+	{
+		.longName   = "show-index-work",
+		.shortName  = 0,
+		.argInfo    = POPT_ARG_NONE,
+		.arg        = &options.show_index_work,
+		.val        = 0,
+		.descrip    = "report index lookups of each search on stderr",
+		.argDescrip = NULL
+	},
 	{
 		.longName   = "paged",
 		.shortName  = 0,
@@ -456,6 +465,18 @@ static struct ldb_cmdline *ldb_cmdline_process_internal(struct ldb_context *ldb,
 		}
 	}
 
+	if (options.show_index_work) {
+		options.options = talloc_realloc(ret, options.options,
+						 const char *, num_options+2);
+		if (options.options == NULL) {
+			fprintf(stderr, "Out of memory!\n");
+			goto failed;
+		}
+		options.options[num_options] = "show_index_work";
+		options.options[num_options+1] = NULL;
+		num_options++;
+	}
+
 	/* setup the remaining options for the main program to use */
 	options.argv = poptGetArgs(pc);
 	if (options.argv) {
@@ -44,6 +44,7 @@ struct ldb_cmdline {
 	const char **controls;
 	int show_binary;
 	int tracing;
+	int show_index_work;
 };
 
 struct ldb_cmdline *ldb_cmdline_process_search(struct ldb_context *ldb,
@@ -0,0 +1,1090 @@
+/*
+   ldb database library
+
+     ** NOTE! The following LGPL license applies to the ldb
+     ** library. This does NOT imply that all of Samba is released
+     ** under the LGPL
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ *  Name: ldb
+ *
+ *  Component: ldbbench
+ *
+ *  Description: benchmark the ldb index, pack and DN code
+ *
+ *  A synthetic directory of users and nested groups is created below
+ *  the base DN, then a set of representative operations is run
+ *  against it and the latency percentiles of each are reported.
+ *  Every URL on the command line is benchmarked in turn, so the
+ *  backends can be compared in one run:
+ *
+ *      ldbbench --nosync -H tdb://bench.ldb mdb://bench.mdb
+ */
+
+#include "replace.h"
+#include "system/filesys.h"
+#include "system/time.h"
+#include "ldb.h"
+#include "ldb_module.h"
+#include "tools/cmdline.h"
+
+#define BENCH_DEFAULT_RECORDS 1000
+#define BENCH_DEFAULT_SEARCHES 1000
+/* records are added in transactions of this size */
+#define BENCH_ADD_BATCH 100
+/* users in each group */
+#define BENCH_GROUP_SIZE 50
+/* groups are nested in chains of this length */
+#define BENCH_GROUP_NESTING 5
+#define BENCH_PAGE_SIZE 100
+#define BENCH_MAX_OPS 20
+
+struct bench_op {
+	const char *name;
+	/* the latency of each operation in nsec */
+	uint64_t *samples;
+	size_t num_samples;
+	size_t max_samples;
+	/* talloc blocks held by the results */
+	uint64_t blocks;
+};
+
+struct bench_ctx {
+	struct ldb_context *ldb;
+	struct ldb_dn *basedn;
+	const char *base;
+	unsigned int num_users;
+	unsigned int num_groups;
+	unsigned int num_iterations;
+	unsigned int usn;
+	struct bench_op ops[BENCH_MAX_OPS];
+	unsigned int num_ops;
+};
+
+static struct ldb_cmdline *options;
+
+static uint64_t bench_now(void)
+{
+	struct timespec ts;
+
+	if (clock_gettime(CUSTOM_CLOCK_MONOTONIC, &ts) != 0) {
+		clock_gettime(CLOCK_REALTIME, &ts);
+	}
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static struct bench_op *bench_op_new(struct bench_ctx *b,
+				     const char *name,
+				     size_t max_samples)
+{
+	struct bench_op *op = NULL;
+
+	if (b->num_ops == BENCH_MAX_OPS) {
+		printf("Too many benchmark operations\n");
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+
+	op = &b->ops[b->num_ops++];
+	*op = (struct bench_op) {
+		.name = name,
+		.max_samples = max_samples,
+	};
+
+	op->samples = talloc_array(b, uint64_t, MAX(max_samples, 1));
+	if (op->samples == NULL) {
+		printf("Out of memory\n");
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	return op;
+}
+
+static void bench_op_sample(struct bench_op *op,
+			    uint64_t start,
+			    const void *result)
+{
+	uint64_t end = bench_now();
+
+	if (op->num_samples == op->max_samples) {
+		return;
+	}
+	op->samples[op->num_samples++] = end - start;
+	if (result != NULL) {
+		op->blocks += talloc_total_blocks(result);
+	}
+}
+
+static int uint64_cmp(const void *p1, const void *p2)
+{
+	const uint64_t *u1 = p1;
+	const uint64_t *u2 = p2;
+
+	if (*u1 < *u2) {
+		return -1;
+	}
+	return *u1 > *u2;
+}
+
+static double bench_op_percentile(const struct bench_op *op,
+				  unsigned int percent)
+{
+	size_t i = (op->num_samples - 1) * percent / 100;
+
+	return op->samples[i] / 1000.0;
+}
+
+static void bench_report(struct bench_ctx *b, const char *url)
+{
+	unsigned int i;
+
+	printf("\n%s: %u users, %u groups\n",
+	       url, b->num_users, b->num_groups);
+	printf("%-18s %8s %10s %10s %10s %10s %10s %10s\n",
+	       "operation", "count", "ops/s", "p50 us", "p90 us",
+	       "p99 us", "max us", "blocks/op");
+
+	for (i = 0; i < b->num_ops; i++) {
+		struct bench_op *op = &b->ops[i];
+		uint64_t total = 0;
+		size_t j;
+
+		if (op->num_samples == 0) {
+			continue;
+		}
+		for (j = 0; j < op->num_samples; j++) {
+			total += op->samples[j];
+		}
+		qsort(op->samples, op->num_samples, sizeof(uint64_t),
+		      uint64_cmp);
+
+		printf("%-18s %8zu %10.0f %10.1f %10.1f %10.1f %10.1f %10.1f\n",
+		       op->name,
+		       op->num_samples,
+		       op->num_samples * 1.0e9 / MAX(total, 1),
+		       bench_op_percentile(op, 50),
+		       bench_op_percentile(op, 90),
+		       bench_op_percentile(op, 99),
+		       op->samples[op->num_samples - 1] / 1000.0,
+		       (double)op->blocks / op->num_samples);
+	}
+}
+
+static void bench_add(struct bench_ctx *b, struct ldb_message *msg)
+{
+	int ret;
+
+	/*
+	 * The records are in GUID index mode, make up a unique value
+	 * of the right length for each of them.
+	 */
+	ret = ldb_msg_add_fmt(msg, "objectUUID", "%016x", ++b->usn);
+	if (ret != LDB_SUCCESS) {
+		printf("Out of memory\n");
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	ret = ldb_msg_add_fmt(msg, "uSNChanged", "%u", b->usn);
+	if (ret != LDB_SUCCESS) {
+		printf("Out of memory\n");
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+
+	ret = ldb_add(b->ldb, msg);
+	if (ret != LDB_SUCCESS) {
+		printf("Add of %s failed - %s\n",
+		       ldb_dn_get_linearized(msg->dn),
+		       ldb_errstring(b->ldb));
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+}
+
+static void bench_add_ldif(struct bench_ctx *b, const char *ldif_str)
+{
+	struct ldb_ldif *ldif = NULL;
+
+	while ((ldif = ldb_ldif_read_string(b->ldb, &ldif_str)) != NULL) {
+		if (ldb_add(b->ldb, ldif->msg) != LDB_SUCCESS) {
+			printf("Add of %s failed - %s\n",
+			       ldb_dn_get_linearized(ldif->msg->dn),
+			       ldb_errstring(b->ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		ldb_ldif_read_free(b->ldb, ldif);
+	}
+}
+
+static struct ldb_message *bench_user_msg(struct bench_ctx *b,
+					  TALLOC_CTX *mem_ctx,
+					  unsigned int n)
+{
+	struct ldb_message *msg = ldb_msg_new(mem_ctx);
+	int ret;
+
+	if (msg == NULL) {
+		printf("Out of memory\n");
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	msg->dn = ldb_dn_new_fmt(msg, b->ldb, "cn=user%u,ou=users,%s",
+				 n, b->base);
+
+	ret = ldb_msg_add_string(msg, "objectClass", "top");
+	ret |= ldb_msg_add_string(msg, "objectClass", "user");
+	ret |= ldb_msg_add_fmt(msg, "cn", "user%u", n);
+	ret |= ldb_msg_add_fmt(msg, "uid", "USER%u", n);
+	ret |= ldb_msg_add_fmt(msg, "sn", "Surname%u", n);
+	ret |= ldb_msg_add_fmt(msg, "mail", "user%u@example.com", n);
+	ret |= ldb_msg_add_fmt(msg, "description",
+			       "User %u of the benchmark directory", n);
+	if (msg->dn == NULL || ret != LDB_SUCCESS) {
+		printf("Out of memory\n");
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	return msg;
+}
+
+/*
+  Each group has BENCH_GROUP_SIZE users, and all but the first group
+  of a chain also have the previous group as a member.
+ */
+static struct ldb_message *bench_group_msg(struct bench_ctx *b,
+					   TALLOC_CTX *mem_ctx,
+					   unsigned int n)
+{
+	struct ldb_message *msg = ldb_msg_new(mem_ctx);
+	unsigned int num_members = MIN(BENCH_GROUP_SIZE, b->num_users);
+	unsigned int i;
+	int ret;
+
+	if (msg == NULL) {
+		printf("Out of memory\n");
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	msg->dn = ldb_dn_new_fmt(msg, b->ldb, "cn=group%u,ou=groups,%s",
+				 n, b->base);
+
+	ret = ldb_msg_add_string(msg, "objectClass", "top");
+	ret |= ldb_msg_add_string(msg, "objectClass", "group");
+	ret |= ldb_msg_add_fmt(msg, "cn", "group%u", n);
+	for (i = 0; i < num_members; i++) {
+		unsigned int u = (n * BENCH_GROUP_SIZE + i) % b->num_users;
+
+		ret |= ldb_msg_add_fmt(msg, "member",
+				       "cn=user%u,ou=users,%s", u, b->base);
+	}
+	if (n % BENCH_GROUP_NESTING != 0) {
+		ret |= ldb_msg_add_fmt(msg, "member",
+				       "cn=group%u,ou=groups,%s",
+				       n - 1, b->base);
+	}
+	if (msg->dn == NULL || ret != LDB_SUCCESS) {
+		printf("Out of memory\n");
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	return msg;
+}
+
+static void bench_populate(struct bench_ctx *b)
+{
+	struct bench_op *add = NULL;
+	struct bench_op *commit = NULL;
+	unsigned int num_records = b->num_users + b->num_groups;
+	unsigned int i;
+	char *ldif = NULL;
+
+	ldif = talloc_asprintf(b,
+			       "dn: @INDEXLIST\n"
+			       "@IDXATTR: uid\n"
+			       "@IDXATTR: cn\n"
+			       "@IDXATTR: objectClass\n"
+			       "@IDXATTR: member\n"
+			       "@IDXATTR: uSNChanged\n"
+			       "@IDXONE: 1\n"
+			       "@IDXGUID: objectUUID\n"
+			       "@IDX_DN_GUID: GUID\n"
+			       "\n"
+			       "dn: @ATTRIBUTES\n"
+			       "uid: CASE_INSENSITIVE\n"
+			       "cn: CASE_INSENSITIVE\n"
+			       "uSNChanged: ORDERED_INTEGER\n"
+			       "\n");
+	if (ldif == NULL) {
+		printf("Out of memory\n");
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	bench_add_ldif(b, ldif);
+	TALLOC_FREE(ldif);
+
+	for (i = 0; i < 3; i++) {
+		static const char *containers[] = { NULL, "users", "groups" };
+		struct ldb_message *msg = ldb_msg_new(b);
+		int ret;
+
+		if (msg == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		if (containers[i] == NULL) {
+			msg->dn = ldb_dn_copy(msg, b->basedn);
+		} else {
+			msg->dn = ldb_dn_new_fmt(msg, b->ldb, "ou=%s,%s",
+						 containers[i], b->base);
+		}
+		ret = ldb_msg_add_string(msg, "objectClass",
+					 "organizationalUnit");
+		if (msg->dn == NULL || ret != LDB_SUCCESS) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		bench_add(b, msg);
+		talloc_free(msg);
+	}
+
+	add = bench_op_new(b, "add", num_records);
+	commit = bench_op_new(b, "add-commit",
+			      num_records / BENCH_ADD_BATCH + 1);
+
+	for (i = 0; i < num_records; i++) {
+		TALLOC_CTX *tmp_ctx = talloc_new(b);
+		struct ldb_message *msg = NULL;
+		uint64_t start;
+
+		if (tmp_ctx == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		if (i % BENCH_ADD_BATCH == 0 &&
+		    ldb_transaction_start(b->ldb) != LDB_SUCCESS) {
+			printf("Failed to start transaction - %s\n",
+			       ldb_errstring(b->ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		/* the groups refer to the users, so add them first */
+		if (i < b->num_users) {
+			msg = bench_user_msg(b, tmp_ctx, i);
+		} else {
+			msg = bench_group_msg(b, tmp_ctx, i - b->num_users);
+		}
+
+		start = bench_now();
+		bench_add(b, msg);
+		bench_op_sample(add, start, NULL);
+
+		if (i % BENCH_ADD_BATCH == BENCH_ADD_BATCH - 1 ||
+		    i == num_records - 1) {
+			start = bench_now();
+			if (ldb_transaction_commit(b->ldb) != LDB_SUCCESS) {
+				printf("Failed to commit transaction - %s\n",
+				       ldb_errstring(b->ldb));
+				exit(LDB_ERR_OPERATIONS_ERROR);
+			}
+			bench_op_sample(commit, start, NULL);
+		}
+
+		talloc_free(tmp_ctx);
+	}
+}
+
+/*
+  the filters of the searches, n is a random user number
+ */
+static char *filter_uid(struct bench_ctx *b, TALLOC_CTX *mem_ctx,
+			unsigned int n)
+{
+	return talloc_asprintf(mem_ctx, "(uid=user%u)", n);
+}
+
+static char *filter_and(struct bench_ctx *b, TALLOC_CTX *mem_ctx,
+			unsigned int n)
+{
+	return talloc_asprintf(mem_ctx,
+			       "(&(objectClass=user)(uid=user%u))", n);
+}
+
+static char *filter_or(struct bench_ctx *b, TALLOC_CTX *mem_ctx,
+		       unsigned int n)
+{
+	return talloc_asprintf(mem_ctx,
+			       "(|(uid=user%u)(uid=user%u)(cn=group%u))",
+			       n, (n + 1) % b->num_users,
+			       (n / BENCH_GROUP_SIZE) % b->num_groups);
+}
+
+static char *filter_member(struct bench_ctx *b, TALLOC_CTX *mem_ctx,
+			   unsigned int n)
+{
+	return talloc_asprintf(mem_ctx, "(member=cn=user%u,ou=users,%s)",
+			       n, b->base);
+}
+
+/* about the last 100 changes */
+static char *filter_range(struct bench_ctx *b, TALLOC_CTX *mem_ctx,
+			  unsigned int n)
+{
+	return talloc_asprintf(mem_ctx, "(uSNChanged>=%u)",
+			       b->usn > 100 ? b->usn - 100 : 0);
+}
+
+static char *filter_any(struct bench_ctx *b, TALLOC_CTX *mem_ctx,
+			unsigned int n)
+{
+	return talloc_strdup(mem_ctx, "(objectClass=*)");
+}
+
+static char *filter_description(struct bench_ctx *b, TALLOC_CTX *mem_ctx,
+				unsigned int n)
+{
+	return talloc_asprintf(mem_ctx, "(description=User %u of *)", n);
+}
+
+/*
+  run num searches, each with the filter for a random user
+ */
+static void bench_search(struct bench_ctx *b,
+			 const char *name,
+			 struct ldb_dn *basedn,
+			 enum ldb_scope scope,
+			 const char * const *attrs,
+			 char *(*filter)(struct bench_ctx *b,
+					 TALLOC_CTX *mem_ctx,
+					 unsigned int n),
+			 unsigned int num,
+			 unsigned int expected)
+{
+	struct bench_op *op = bench_op_new(b, name, num);
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		TALLOC_CTX *tmp_ctx = talloc_new(b);
+		struct ldb_result *res = NULL;
+		const char *expr = NULL;
+		uint64_t start;
+		int ret;
+
+		if (tmp_ctx == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		expr = filter(b, tmp_ctx, random() % b->num_users);
+		if (expr == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		start = bench_now();
+		ret = ldb_search(b->ldb, tmp_ctx, &res, basedn, scope,
+				 attrs, "%s", expr);
+		bench_op_sample(op, start, res);
+
+		if (ret != LDB_SUCCESS) {
+			printf("Search %s failed - %s\n",
+			       expr, ldb_errstring(b->ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		if (expected != 0 && res->count < expected) {
+			printf("Search %s found %u records, expected %u\n",
+			       expr, res->count, expected);
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		talloc_free(tmp_ctx);
+	}
+}
+
+static void bench_search_base(struct bench_ctx *b, unsigned int num)
+{
+	struct bench_op *op = bench_op_new(b, "search-base", num);
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		TALLOC_CTX *tmp_ctx = talloc_new(b);
+		struct ldb_result *res = NULL;
+		struct ldb_dn *dn = NULL;
+		uint64_t start;
+		int ret;
+
+		if (tmp_ctx == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		dn = ldb_dn_new_fmt(tmp_ctx, b->ldb, "cn=user%u,ou=users,%s",
+				    (unsigned int)(random() % b->num_users),
+				    b->base);
+		if (dn == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		start = bench_now();
+		ret = ldb_search(b->ldb, tmp_ctx, &res, dn, LDB_SCOPE_BASE,
+				 NULL, NULL);
+		bench_op_sample(op, start, res);
+
+		if (ret != LDB_SUCCESS || res->count != 1) {
+			printf("Base search of %s failed - %s\n",
+			       ldb_dn_get_linearized(dn),
+			       ldb_errstring(b->ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		talloc_free(tmp_ctx);
+	}
+}
+
+/*
+  expand the members of a group and the groups nested in it, the way a
+  token is built from the member attributes
+ */
+static void bench_nested(struct bench_ctx *b, unsigned int num)
+{
+	struct bench_op *op = bench_op_new(b, "nested-expand", num);
+	const char * const attrs[] = { "member", NULL };
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		TALLOC_CTX *tmp_ctx = talloc_new(b);
+		struct ldb_dn *dn = NULL;
+		unsigned int num_members = 0;
+		uint64_t start;
+
+		if (tmp_ctx == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		dn = ldb_dn_new_fmt(tmp_ctx, b->ldb,
+				    "cn=group%u,ou=groups,%s",
+				    (unsigned int)(random() % b->num_groups),
+				    b->base);
+
+		start = bench_now();
+		while (dn != NULL) {
+			struct ldb_result *res = NULL;
+			struct ldb_message_element *el = NULL;
+			struct ldb_dn *next = NULL;
+			unsigned int j;
+			int ret;
+
+			ret = ldb_search(b->ldb, tmp_ctx, &res, dn,
+					 LDB_SCOPE_BASE, attrs, NULL);
+			if (ret != LDB_SUCCESS || res->count != 1) {
+				printf("Base search of %s failed - %s\n",
+				       ldb_dn_get_linearized(dn),
+				       ldb_errstring(b->ldb));
+				exit(LDB_ERR_OPERATIONS_ERROR);
+			}
+
+			el = ldb_msg_find_element(res->msgs[0], "member");
+			for (j = 0; el != NULL && j < el->num_values; j++) {
+				struct ldb_dn *member = NULL;
+
+				member = ldb_dn_from_ldb_val(tmp_ctx, b->ldb,
+							     &el->values[j]);
+				if (!ldb_dn_validate(member)) {
+					printf("Invalid member DN\n");
+					exit(LDB_ERR_OPERATIONS_ERROR);
+				}
+				if (strncasecmp((const char *)el->values[j].data,
+						"cn=group", 8) == 0) {
+					next = member;
+				}
+				num_members++;
+			}
+			dn = next;
+		}
+		bench_op_sample(op, start, NULL);
+
+		if (num_members == 0) {
+			printf("Found no members\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		talloc_free(tmp_ctx);
+	}
+}
+
+/*
+  walk all the users with the paged results control, one sample per
+  page. Without a module handling the control all the results come
+  back as one page.
+ */
+static void bench_paged(struct bench_ctx *b, unsigned int num)
+{
+	unsigned int max_pages = b->num_users / BENCH_PAGE_SIZE + 1;
+	struct bench_op *op = bench_op_new(b, "paged-search",
+					   num * max_pages);
+	const char * const attrs[] = { "cn", "mail", NULL };
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		TALLOC_CTX *tmp_ctx = talloc_new(b);
+		struct ldb_paged_control *paged = NULL;
+		unsigned int count = 0;
+
+		if (tmp_ctx == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		paged = talloc_zero(tmp_ctx, struct ldb_paged_control);
+		if (paged == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		paged->size = BENCH_PAGE_SIZE;
+
+		do {
+			struct ldb_result *res = NULL;
+			struct ldb_request *req = NULL;
+			struct ldb_control *ctrl = NULL;
+			uint64_t start;
+			int ret;
+
+			res = talloc_zero(tmp_ctx, struct ldb_result);
+			if (res == NULL) {
+				printf("Out of memory\n");
+				exit(LDB_ERR_OPERATIONS_ERROR);
+			}
+			ret = ldb_build_search_req(&req, b->ldb, tmp_ctx,
+						   b->basedn,
+						   LDB_SCOPE_SUBTREE,
+						   "(objectClass=user)",
+						   attrs, NULL, res,
+						   ldb_search_default_callback,
+						   NULL);
+			if (ret == LDB_SUCCESS) {
+				ret = ldb_request_add_control(
+					req, LDB_CONTROL_PAGED_RESULTS_OID,
+					false, paged);
+			}
+			if (ret != LDB_SUCCESS) {
+				printf("Out of memory\n");
+				exit(LDB_ERR_OPERATIONS_ERROR);
+			}
+
+			start = bench_now();
+			ret = ldb_request(b->ldb, req);
+			if (ret == LDB_SUCCESS) {
+				ret = ldb_wait(req->handle, LDB_WAIT_ALL);
+			}
+			bench_op_sample(op, start, res);
+
+			if (ret != LDB_SUCCESS) {
+				printf("Paged search failed - %s\n",
+				       ldb_errstring(b->ldb));
+				exit(LDB_ERR_OPERATIONS_ERROR);
+			}
+			count += res->count;
+
+			ctrl = ldb_controls_get_control(
+				res->controls, LDB_CONTROL_PAGED_RESULTS_OID);
+			if (ctrl == NULL || ctrl->data == NULL) {
+				break;
+			}
+			paged = talloc_get_type(ctrl->data,
+						struct ldb_paged_control);
+			if (paged == NULL) {
+				break;
+			}
+			paged->size = BENCH_PAGE_SIZE;
+		} while (paged->cookie_len > 0);
+
+		if (count != b->num_users) {
+			printf("Paged search found %u users, expected %u\n",
+			       count, b->num_users);
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		talloc_free(tmp_ctx);
+	}
+}
+
+static void bench_modify(struct bench_ctx *b, unsigned int num)
+{
+	struct bench_op *op = bench_op_new(b, "modify", num);
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		struct ldb_message *msg = ldb_msg_new(b);
+		unsigned int n = random() % b->num_users;
+		uint64_t start;
+		int ret;
+
+		if (msg == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		msg->dn = ldb_dn_new_fmt(msg, b->ldb, "cn=user%u,ou=users,%s",
+					 n, b->base);
+		ret = ldb_msg_append_fmt(msg, LDB_FLAG_MOD_REPLACE,
+					 "description",
+					 "User %u, modified %u times", n, i);
+		ret |= ldb_msg_append_fmt(msg, LDB_FLAG_MOD_REPLACE,
+					  "uSNChanged", "%u", ++b->usn);
+		if (msg->dn == NULL || ret != LDB_SUCCESS) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		start = bench_now();
+		ret = ldb_modify(b->ldb, msg);
+		bench_op_sample(op, start, NULL);
+
+		if (ret != LDB_SUCCESS) {
+			printf("Modify of %s failed - %s\n",
+			       ldb_dn_get_linearized(msg->dn),
+			       ldb_errstring(b->ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		talloc_free(msg);
+	}
+}
+
+/*
+  pack and unpack a group, the largest records of the directory
+ */
+static void bench_pack(struct bench_ctx *b, unsigned int num)
+{
+	struct bench_op *pack = bench_op_new(b, "pack-group", num);
+	struct bench_op *unpack = bench_op_new(b, "unpack-group", num);
+	struct ldb_message *group = NULL;
+	unsigned int i;
+
+	group = bench_group_msg(b, b, 1);
+
+	for (i = 0; i < num; i++) {
+		TALLOC_CTX *tmp_ctx = talloc_new(b);
+		struct ldb_message *msg = NULL;
+		struct ldb_val data;
+		uint64_t start;
+		int ret;
+
+		if (tmp_ctx == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		start = bench_now();
+		ret = ldb_pack_data(b->ldb, group, &data,
+				    LDB_PACKING_FORMAT_V2);
+		bench_op_sample(pack, start, NULL);
+		if (ret != 0) {
+			printf("Pack of %s failed\n",
+			       ldb_dn_get_linearized(group->dn));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		talloc_steal(tmp_ctx, data.data);
+
+		msg = ldb_msg_new(tmp_ctx);
+		if (msg == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		start = bench_now();
+		ret = ldb_unpack_data(b->ldb, &data, msg);
+		bench_op_sample(unpack, start, msg);
+		if (ret != 0 || msg->num_elements != group->num_elements) {
+			printf("Unpack of %s failed\n",
+			       ldb_dn_get_linearized(group->dn));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		talloc_free(tmp_ctx);
+	}
+
+	talloc_free(group);
+}
+
+/*
+  parse, case fold and compare the DNs of the member values, as every
+  search of a DN valued attribute does
+ */
+static void bench_dn(struct bench_ctx *b, unsigned int num)
+{
+	struct bench_op *op = bench_op_new(b, "dn-parse-compare", num);
+	unsigned int i;
+
+	for (i = 0; i < num; i++) {
+		TALLOC_CTX *tmp_ctx = talloc_new(b);
+		const char *str = NULL;
+		struct ldb_dn *dn = NULL;
+		uint64_t start;
+		int cmp;
+
+		if (tmp_ctx == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		str = talloc_asprintf(tmp_ctx, "CN=User%u,OU=Users,%s",
+				      (unsigned int)(random() % b->num_users),
+				      b->base);
+		if (str == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		start = bench_now();
+		dn = ldb_dn_new(tmp_ctx, b->ldb, str);
+		if (dn == NULL || ldb_dn_get_casefold(dn) == NULL) {
+			printf("Invalid DN %s\n", str);
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		cmp = ldb_dn_compare_base(b->basedn, dn);
+		bench_op_sample(op, start, dn);
+
+		if (cmp != 0) {
+			printf("%s is not below %s\n", str, b->base);
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		talloc_free(tmp_ctx);
+	}
+}
+
+static void bench_delete(struct bench_ctx *b)
+{
+	unsigned int num_records = b->num_users + b->num_groups;
+	struct bench_op *op = bench_op_new(b, "delete", num_records);
+	unsigned int i;
+
+	/* delete the groups first, they are the more expensive ones */
+	for (i = 0; i < num_records; i++) {
+		struct ldb_dn *dn = NULL;
+		uint64_t start;
+		int ret;
+
+		if (i < b->num_groups) {
+			dn = ldb_dn_new_fmt(b, b->ldb,
+					    "cn=group%u,ou=groups,%s",
+					    i, b->base);
+		} else {
+			dn = ldb_dn_new_fmt(b, b->ldb,
+					    "cn=user%u,ou=users,%s",
+					    i - b->num_groups, b->base);
+		}
+		if (dn == NULL) {
+			printf("Out of memory\n");
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		start = bench_now();
+		ret = ldb_delete(b->ldb, dn);
+		bench_op_sample(op, start, NULL);
+
+		if (ret != LDB_SUCCESS) {
+			printf("Delete of %s failed - %s\n",
+			       ldb_dn_get_linearized(dn),
+			       ldb_errstring(b->ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		talloc_free(dn);
+	}
+
+	for (i = 0; i < 5; i++) {
+		static const char *dns[] = {
+			"ou=users", "ou=groups", NULL,
+			"@INDEXLIST", "@ATTRIBUTES"
+		};
+		struct ldb_dn *dn = NULL;
+
+		if (i < 2) {
+			dn = ldb_dn_new_fmt(b, b->ldb, "%s,%s",
+					    dns[i], b->base);
+		} else if (dns[i] == NULL) {
+			dn = ldb_dn_copy(b, b->basedn);
+		} else {
+			dn = ldb_dn_new(b, b->ldb, dns[i]);
+		}
+		if (ldb_delete(b->ldb, dn) != LDB_SUCCESS) {
+			printf("Delete of %s failed - %s\n",
+			       ldb_dn_get_linearized(dn),
+			       ldb_errstring(b->ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+		talloc_free(dn);
+	}
+}
+
+/*
+  refuse to run against a database that has data below the base DN or
+  its own indexes, they would be overwritten and deleted
+ */
+static void bench_check_empty(struct bench_ctx *b)
+{
+	const char *dns[] = { b->base, "@INDEXLIST", "@ATTRIBUTES" };
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_SIZE(dns); i++) {
+		struct ldb_result *res = NULL;
+		struct ldb_dn *dn = ldb_dn_new(b, b->ldb, dns[i]);
+		int ret;
+
+		ret = ldb_search(b->ldb, b, &res, dn, LDB_SCOPE_BASE,
+				 NULL, NULL);
+		if (ret == LDB_SUCCESS && res->count > 0) {
+			printf("%s exists, ldbbench needs an empty database\n",
+			       dns[i]);
+			exit(LDB_ERR_ENTRY_ALREADY_EXISTS);
+		}
+		talloc_free(res);
+		talloc_free(dn);
+	}
+}
+
+static void start_bench(struct ldb_context *ldb, const char *url)
+{
+	struct bench_ctx *b = talloc_zero(ldb, struct bench_ctx);
+	unsigned int n;
+	size_t blocks;
+	const char * const user_attrs[] = { "cn", "mail", NULL };
+	const char * const guid_attrs[] = { "objectUUID", NULL };
+	const char * const cn_attrs[] = { "cn", NULL };
+	const char * const usn_attrs[] = { "uSNChanged", NULL };
+
+	if (b == NULL) {
+		printf("Out of memory\n");
+		exit(LDB_ERR_OPERATIONS_ERROR);
+	}
+	b->ldb = ldb;
+	b->base = options->basedn;
+	b->basedn = ldb_dn_new(b, ldb, b->base);
+	if (!ldb_dn_validate(b->basedn)) {
+		printf("Invalid base DN format\n");
+		exit(LDB_ERR_INVALID_DN_SYNTAX);
+	}
+	b->num_users = MAX(options->num_records, 1);
+	b->num_groups = MAX(b->num_users / 10, 1);
+	b->num_iterations = MAX(options->num_searches, 1);
+	n = b->num_iterations;
+
+	bench_check_empty(b);
+
+	printf("Populating %s with %u users and %u groups\n",
+	       url, b->num_users, b->num_groups);
+	bench_populate(b);
+
+	blocks = talloc_total_blocks(ldb) - talloc_total_blocks(b);
+
+	printf("Running %u iterations of each operation\n", n);
+
+	bench_search(b, "search-uid", b->basedn, LDB_SCOPE_SUBTREE,
+		     NULL, filter_uid, n, 1);
+	bench_search(b, "search-uid-attrs", b->basedn, LDB_SCOPE_SUBTREE,
+		     guid_attrs, filter_uid, n, 1);
+	bench_search(b, "search-and", b->basedn, LDB_SCOPE_SUBTREE,
+		     user_attrs, filter_and, n, 1);
+	bench_search(b, "search-or", b->basedn, LDB_SCOPE_SUBTREE,
+		     user_attrs, filter_or, n, 2);
+	bench_search(b, "search-member", b->basedn, LDB_SCOPE_SUBTREE,
+		     cn_attrs, filter_member, n, 0);
+	bench_search(b, "search-range", b->basedn, LDB_SCOPE_SUBTREE,
+		     usn_attrs, filter_range, n, 1);
+	bench_search(b, "search-onelevel", b->basedn, LDB_SCOPE_ONELEVEL,
+		     cn_attrs, filter_any, n, 2);
+	bench_search(b, "search-unindexed", b->basedn, LDB_SCOPE_SUBTREE,
+		     cn_attrs, filter_description, MIN(n, 10), 1);
+	bench_search_base(b, n);
+	bench_nested(b, n);
+	bench_paged(b, MIN(n, 10));
+	bench_modify(b, n);
+	bench_pack(b, n);
+	bench_dn(b, n);
+
+	/*
+	 * Anything the searches left behind on the ldb context is a
+	 * cache or a leak, report it with the per operation results.
+	 */
+	printf("talloc blocks retained by the searches: %zd\n",
+	       (ssize_t)(talloc_total_blocks(ldb) - talloc_total_blocks(b) -
+			 blocks));
+
+	bench_delete(b);
+
+	bench_report(b, url);
+
+	talloc_free(b);
+}
+
+static void usage(struct ldb_context *ldb)
+{
+	printf("Usage: ldbbench <options> [url ...]\n");
+	printf("Options:\n");
+	printf("  -H ldb_url       choose the database (or $LDB_URL)\n");
+	printf("  --num-records  nrecords      number of users to create\n");
+	printf("  --num-searches nsearches     iterations of each operation\n");
+	printf("\n");
+	printf("benchmarks ldb against an empty database, and then any\n");
+	printf("further URLs given on the command line\n\n");
+	exit(LDB_ERR_OPERATIONS_ERROR);
+}
+
+int main(int argc, const char **argv)
+{
+	TALLOC_CTX *mem_ctx = talloc_new(NULL);
+	struct ldb_context *ldb;
+	unsigned int flags = 0;
+	int i;
+
+	ldb = ldb_init(mem_ctx, NULL);
+	if (ldb == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	options = ldb_cmdline_process(ldb, argc, argv, usage);
+
+	talloc_steal(mem_ctx, options);
+
+	if (options->basedn == NULL) {
+		options->basedn = "dc=bench,dc=example,dc=com";
+	}
+	if (options->num_records <= 0) {
+		options->num_records = BENCH_DEFAULT_RECORDS;
+	}
+	if (options->num_searches <= 0) {
+		options->num_searches = BENCH_DEFAULT_SEARCHES;
+	}
+	if (options->nosync) {
+		flags |= LDB_FLG_NOSYNC;
+	}
+
+	srandom(1);
+
+	start_bench(ldb, options->url);
+
+	for (i = 0; i < options->argc; i++) {
+		const char *url = options->argv[i];
+
+		talloc_free(ldb);
+		ldb = ldb_init(mem_ctx, NULL);
+		if (ldb == NULL) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+		if (ldb_connect(ldb, url, flags, options->options) !=
+		    LDB_SUCCESS) {
+			printf("failed to connect to %s - %s\n",
+			       url, ldb_errstring(ldb));
+			exit(LDB_ERR_OPERATIONS_ERROR);
+		}
+
+		srandom(1);
+
+		start_bench(ldb, url);
+	}
+
+	talloc_free(mem_ctx);
+
+	return LDB_SUCCESS;
+}
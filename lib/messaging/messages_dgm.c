@@ -107,10 +107,29 @@ struct messaging_dgm_context {
 
 	bool *have_dgm_context;
 
+	/*
+	 * Active read handler invocations, told by the destructor
+	 * that ctx is gone.
+	 */
+	struct messaging_dgm_read_guard *read_guards;
+
+	/*
+	 * Reads the next queued datagram without polling,
+	 * read_batch counts the datagrams read since the last
+	 * wakeup of the socket.
+	 */
+	struct tevent_immediate *read_im;
+	unsigned read_batch;
+
 	struct pthreadpool_tevent *pool;
 	struct messaging_dgm_out *outsocks;
 };
 
+struct messaging_dgm_read_guard {
+	struct messaging_dgm_read_guard *prev, *next;
+	bool ctx_destroyed;
+};
+
 /* Set socket close on exec. */
 static int prepare_socket_cloexec(int sock)
 {
@@ -1113,6 +1132,11 @@ static int messaging_dgm_context_destructor(struct messaging_dgm_context *c)
 		c->fde_evs->ctx = NULL;
 		DLIST_REMOVE(c->fde_evs, c->fde_evs);
 	}
+	while (c->read_guards != NULL) {
+		struct messaging_dgm_read_guard *g = c->read_guards;
+		g->ctx_destroyed = true;
+		DLIST_REMOVE(c->read_guards, g);
+	}
 
 	close(c->sock);
 
@@ -1241,8 +1265,49 @@ static void messaging_dgm_recv(struct messaging_dgm_context *ctx,
 /*
  * Raw read callback handler - passes to messaging_dgm_recv()
  * for fragment reassembly processing.
+ *
+ * Under load (oplock breaks, notifyd) many datagrams are queued on
+ * the socket. Read up to MESSAGING_DGM_READ_BATCH of them per
+ * wakeup with non-blocking reads, saving a poll syscall for each.
+ *
+ * The follow-up reads run from an immediate event, not in a loop
+ * right here: messaging_read_send() delivers its result via
+ * tevent_req_defer_callback(), and the callback has to get the
+ * chance to wait for the next message before we dispatch it.
+ * Immediates run in the order they were scheduled.
  */
 
+#define MESSAGING_DGM_READ_BATCH 16
+
+static bool messaging_dgm_read_one(struct messaging_dgm_context *ctx,
+				   struct tevent_context *ev,
+				   struct tevent_fd *fde,
+				   int recv_flags);
+static void messaging_dgm_read_next(struct tevent_context *ev,
+				    struct tevent_immediate *im,
+				    void *private_data);
+
+static void messaging_dgm_read_more(struct messaging_dgm_context *ctx,
+				    struct tevent_context *ev)
+{
+	if (ctx->read_batch >= MESSAGING_DGM_READ_BATCH) {
+		return;
+	}
+
+	if (ctx->read_im == NULL) {
+		ctx->read_im = tevent_create_immediate(ctx);
+		if (ctx->read_im == NULL) {
+			/* The fd handler will pick up the rest */
+			return;
+		}
+	}
+
+	tevent_schedule_immediate(ctx->read_im,
+				  ev,
+				  messaging_dgm_read_next,
+				  ctx);
+}
+
 static void messaging_dgm_read_handler(struct tevent_context *ev,
 				       struct tevent_fd *fde,
 				       uint16_t flags,
@@ -1250,6 +1315,72 @@ static void messaging_dgm_read_handler(struct tevent_context *ev,
 {
 	struct messaging_dgm_context *ctx = talloc_get_type_abort(
 		private_data, struct messaging_dgm_context);
+	struct messaging_dgm_read_guard guard = { .ctx_destroyed = false };
+	bool ok;
+
+	messaging_dgm_validate(ctx);
+
+	if ((flags & TEVENT_FD_READ) == 0) {
+		return;
+	}
+
+	/*
+	 * The recv callback might destroy ctx, for example via
+	 * messaging_reinit() in a forked child.
+	 */
+	DLIST_ADD(ctx->read_guards, &guard);
+
+	ok = messaging_dgm_read_one(ctx, ev, fde, 0);
+
+	if (guard.ctx_destroyed) {
+		return;
+	}
+	DLIST_REMOVE(ctx->read_guards, &guard);
+
+	if (ok) {
+		ctx->read_batch = 1;
+		messaging_dgm_read_more(ctx, ev);
+	}
+}
+
+static void messaging_dgm_read_next(struct tevent_context *ev,
+				    struct tevent_immediate *im,
+				    void *private_data)
+{
+	struct messaging_dgm_context *ctx = talloc_get_type_abort(
+		private_data, struct messaging_dgm_context);
+	struct messaging_dgm_read_guard guard = { .ctx_destroyed = false };
+	bool ok;
+
+	DLIST_ADD(ctx->read_guards, &guard);
+
+	/*
+	 * Socket errors are left to the fd handler, it will be
+	 * called again for them.
+	 */
+	ok = messaging_dgm_read_one(ctx, ev, NULL, MSG_DONTWAIT);
+
+	if (guard.ctx_destroyed) {
+		return;
+	}
+	DLIST_REMOVE(ctx->read_guards, &guard);
+
+	if (ok) {
+		ctx->read_batch += 1;
+		messaging_dgm_read_more(ctx, ev);
+	}
+}
+
+/*
+ * Returns true if a datagram was read, false if the socket is
+ * drained or broken.
+ */
+
+static bool messaging_dgm_read_one(struct messaging_dgm_context *ctx,
+				   struct tevent_context *ev,
+				   struct tevent_fd *fde,
+				   int recv_flags)
+{
 	ssize_t received;
 	struct msghdr msg;
 	struct iovec iov;
@@ -1258,12 +1389,6 @@ static void messaging_dgm_read_handler(struct tevent_context *ev,
 	uint8_t buf[MESSAGING_DGM_FRAGMENT_LENGTH];
 	size_t num_fds;
 
-	messaging_dgm_validate(ctx);
-
-	if ((flags & TEVENT_FD_READ) == 0) {
-		return;
-	}
-
 	iov = (struct iovec) { .iov_base = buf, .iov_len = sizeof(buf) };
 	msg = (struct msghdr) { .msg_iov = &iov, .msg_iovlen = 1 };
 
@@ -1273,23 +1398,25 @@ static void messaging_dgm_read_handler(struct tevent_context *ev,
 	msg.msg_flags |= MSG_CMSG_CLOEXEC;
 #endif
 
-	received = recvmsg(ctx->sock, &msg, 0);
+	received = recvmsg(ctx->sock, &msg, recv_flags);
 	if (received == -1) {
 		if ((errno == EAGAIN) ||
 		    (errno == EWOULDBLOCK) ||
 		    (errno == EINTR) ||
 		    (errno == ENOMEM)) {
 			/* Not really an error - just try again. */
-			return;
+			return false;
 		}
 		/* Problem with the socket. Set it unreadable. */
-		tevent_fd_set_flags(fde, 0);
-		return;
+		if (fde != NULL) {
+			tevent_fd_set_flags(fde, 0);
+		}
+		return false;
 	}
 
 	if ((size_t)received > sizeof(buf)) {
 		/* More than we expected, not for us */
-		return;
+		return true;
 	}
 
 	num_fds = msghdr_extract_fds(&msg, NULL, 0);
@@ -1315,6 +1442,8 @@ static void messaging_dgm_read_handler(struct tevent_context *ev,
 
 		messaging_dgm_recv(ctx, ev, buf, received, fds, num_fds);
 	}
+
+	return true;
 }
 
 static int messaging_dgm_in_msg_destructor(struct messaging_dgm_in_msg *m)
@@ -1368,6 +1368,9 @@ bool smb_transport_parse(const char *_value, struct smb_transport *_t)
 	} else if (strcmp("nbt", value) == 0) {
 		t.type = SMB_TRANSPORT_TYPE_NBT;
 		t.port = 139;
+	} else if (strcmp("quic", value) == 0) {
+		t.type = SMB_TRANSPORT_TYPE_QUIC;
+		t.port = 443;
 	} else if (vparam != NULL) {
 		/*
 		 * a port number should not have
@@ -2776,6 +2779,7 @@ struct loadparm_context *loadparm_init(TALLOC_CTX *mem_ctx)
 	lp_ctx->sDefault->force_directory_mode = 0000;
 	lp_ctx->sDefault->aio_read_size = 1;
 	lp_ctx->sDefault->aio_write_size = 1;
+	lp_ctx->sDefault->smb2_qos_weight = 100;
 	lp_ctx->sDefault->smbd_search_ask_sharemode = true;
 	lp_ctx->sDefault->smbd_getinfo_ask_sharemode = true;
 	lp_ctx->sDefault->volume_serial_number = -1;
@@ -3060,6 +3064,9 @@ struct loadparm_context *loadparm_init(TALLOC_CTX *mem_ctx)
 	lpcfg_do_global_parameter(lp_ctx, "keepalive", "300");
 
 	lpcfg_do_global_parameter(lp_ctx, "smbd profiling level", "off");
+	lpcfg_do_global_parameter(lp_ctx, "smbd profiling share clients", "1024");
+	lpcfg_do_global_parameter(lp_ctx, "change notify coalesce msec", "0");
+	lpcfg_do_global_parameter(lp_ctx, "change notify coalesce max events", "256");
 
 	lpcfg_do_global_parameter(lp_ctx, "winbind cache time", "300");
 
@@ -3123,6 +3130,8 @@ struct loadparm_context *loadparm_init(TALLOC_CTX *mem_ctx)
 
 	lpcfg_do_global_parameter(lp_ctx, "durable handles", "yes");
 
+	lpcfg_do_global_parameter(lp_ctx, "smb3 compression threshold", "4096");
+
 	lpcfg_do_global_parameter(lp_ctx, "max stat cache size", "512");
 
 	lpcfg_do_global_parameter(lp_ctx, "ldap passwd sync", "no");
@@ -3217,6 +3226,8 @@ struct loadparm_context *loadparm_init(TALLOC_CTX *mem_ctx)
 		lp_ctx, "ldap max authenticated request size", "16777216");
 	lpcfg_do_global_parameter(
 		lp_ctx, "ldap max search request size", "256000");
+	lpcfg_do_global_parameter(
+		lp_ctx, "ldap max pipelined requests", "8");
 
 	/* Async DNS query timeout in seconds. */
 	lpcfg_do_global_parameter(lp_ctx, "async dns timeout", "10");
@@ -305,6 +305,7 @@ enum client_netlogon_ping_protocol {
 	char *szService;						\
 	struct parmlist_entry *param_opt;				\
 	struct bitmap *copymap;						\
+	char *registry_params;						\
 	char dummy[3];		/* for alignment */
 
 #include "lib/param/param_local.h"
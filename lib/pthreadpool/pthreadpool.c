@@ -35,6 +35,19 @@ struct pthreadpool_job {
 	int id;
 	void (*fn)(void *private_data);
 	void *private_data;
+	struct timespec queued;
+	enum pthreadpool_prio prio;
+};
+
+/*
+ * FIFO ring of jobs for one priority class
+ */
+struct pthreadpool_queue {
+	size_t jobs_array_len;
+	struct pthreadpool_job *jobs;
+
+	size_t head;
+	size_t num_jobs;
 };
 
 struct pthreadpool {
@@ -54,14 +67,19 @@ struct pthreadpool {
 	pthread_cond_t condvar;
 
 	/*
-	 * Array of jobs
+	 * One queue per priority class, num_jobs is the sum over all
+	 * queues
 	 */
-	size_t jobs_array_len;
-	struct pthreadpool_job *jobs;
-
-	size_t head;
+	struct pthreadpool_queue queues[PTHREADPOOL_NUM_PRIOS];
 	size_t num_jobs;
 
+	/*
+	 * Jobs currently running per class and the number of threads
+	 * reserved for a class, see pthreadpool_set_reserved_threads()
+	 */
+	unsigned num_running[PTHREADPOOL_NUM_PRIOS];
+	unsigned num_reserved[PTHREADPOOL_NUM_PRIOS];
+
 	/*
 	 * Indicate job completion
 	 */
@@ -113,6 +131,21 @@ struct pthreadpool {
 	 * where the forking thread will unlock it again.
 	 */
 	pthread_mutex_t fork_mutex;
+
+	/*
+	 * CPUs new threads are bound to, see pthreadpool_set_cpus()
+	 */
+	unsigned *cpus;
+	size_t num_cpus;
+	size_t next_cpu;
+
+	/*
+	 * See pthreadpool_get_stats()
+	 */
+	size_t max_queued_jobs;
+	uint64_t num_started_jobs;
+	uint64_t total_wait_usec;
+	uint64_t max_wait_usec;
 };
 
 static pthread_mutex_t pthreadpools_mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -121,6 +154,16 @@ static pthread_once_t pthreadpool_atfork_initialized = PTHREAD_ONCE_INIT;
 
 static void pthreadpool_prep_atfork(void);
 
+static void pthreadpool_free_queues(struct pthreadpool *pool)
+{
+	size_t i;
+
+	for (i = 0; i < PTHREADPOOL_NUM_PRIOS; i++) {
+		free(pool->queues[i].jobs);
+		pool->queues[i].jobs = NULL;
+	}
+}
+
 /*
  * Initialize a thread pool
  */
@@ -133,6 +176,7 @@ int pthreadpool_init(unsigned max_threads, struct pthreadpool **presult,
 		     void *signal_fn_private_data)
 {
 	struct pthreadpool *pool;
+	size_t i;
 	int ret;
 
 	pool = (struct pthreadpool *)malloc(sizeof(struct pthreadpool));
@@ -142,20 +186,31 @@ int pthreadpool_init(unsigned max_threads, struct pthreadpool **presult,
 	pool->signal_fn = signal_fn;
 	pool->signal_fn_private_data = signal_fn_private_data;
 
-	pool->jobs_array_len = 4;
-	pool->jobs = calloc(
-		pool->jobs_array_len, sizeof(struct pthreadpool_job));
+	for (i = 0; i < PTHREADPOOL_NUM_PRIOS; i++) {
+		struct pthreadpool_queue *q = &pool->queues[i];
 
-	if (pool->jobs == NULL) {
-		free(pool);
-		return ENOMEM;
+		q->jobs_array_len = 4;
+		q->jobs = calloc(
+			q->jobs_array_len, sizeof(struct pthreadpool_job));
+		q->head = q->num_jobs = 0;
+
+		pool->num_running[i] = 0;
+		pool->num_reserved[i] = 0;
 	}
 
-	pool->head = pool->num_jobs = 0;
+	for (i = 0; i < PTHREADPOOL_NUM_PRIOS; i++) {
+		if (pool->queues[i].jobs == NULL) {
+			pthreadpool_free_queues(pool);
+			free(pool);
+			return ENOMEM;
+		}
+	}
+
+	pool->num_jobs = 0;
 
 	ret = pthread_mutex_init(&pool->mutex, NULL);
 	if (ret != 0) {
-		free(pool->jobs);
+		pthreadpool_free_queues(pool);
 		free(pool);
 		return ret;
 	}
@@ -163,7 +218,7 @@ int pthreadpool_init(unsigned max_threads, struct pthreadpool **presult,
 	ret = pthread_cond_init(&pool->condvar, NULL);
 	if (ret != 0) {
 		pthread_mutex_destroy(&pool->mutex);
-		free(pool->jobs);
+		pthreadpool_free_queues(pool);
 		free(pool);
 		return ret;
 	}
@@ -172,7 +227,7 @@ int pthreadpool_init(unsigned max_threads, struct pthreadpool **presult,
 	if (ret != 0) {
 		pthread_cond_destroy(&pool->condvar);
 		pthread_mutex_destroy(&pool->mutex);
-		free(pool->jobs);
+		pthreadpool_free_queues(pool);
 		free(pool);
 		return ret;
 	}
@@ -183,13 +238,20 @@ int pthreadpool_init(unsigned max_threads, struct pthreadpool **presult,
 	pool->max_threads = max_threads;
 	pool->num_idle = 0;
 	pool->prefork_cond = NULL;
+	pool->cpus = NULL;
+	pool->num_cpus = 0;
+	pool->next_cpu = 0;
+	pool->max_queued_jobs = 0;
+	pool->num_started_jobs = 0;
+	pool->total_wait_usec = 0;
+	pool->max_wait_usec = 0;
 
 	ret = pthread_mutex_lock(&pthreadpools_mutex);
 	if (ret != 0) {
 		pthread_mutex_destroy(&pool->fork_mutex);
 		pthread_cond_destroy(&pool->condvar);
 		pthread_mutex_destroy(&pool->mutex);
-		free(pool->jobs);
+		pthreadpool_free_queues(pool);
 		free(pool);
 		return ret;
 	}
@@ -242,6 +304,106 @@ size_t pthreadpool_queued_jobs(struct pthreadpool *pool)
 	return ret;
 }
 
+int pthreadpool_get_stats(struct pthreadpool *pool,
+			  struct pthreadpool_stats *stats)
+{
+	int res;
+
+	res = pthread_mutex_lock(&pool->mutex);
+	if (res != 0) {
+		return res;
+	}
+
+	*stats = (struct pthreadpool_stats) {
+		.queued_jobs = pool->stopped ? 0 : pool->num_jobs,
+		.max_queued_jobs = pool->max_queued_jobs,
+		.num_jobs = pool->num_started_jobs,
+		.total_wait_usec = pool->total_wait_usec,
+		.max_wait_usec = pool->max_wait_usec,
+		.num_threads = pool->num_threads,
+		.num_idle = pool->num_idle,
+	};
+
+	res = pthread_mutex_unlock(&pool->mutex);
+	assert(res == 0);
+
+	return 0;
+}
+
+int pthreadpool_set_cpus(struct pthreadpool *pool,
+			 const unsigned *cpus,
+			 size_t num_cpus)
+{
+#ifdef HAVE_PTHREAD_ATTR_SETAFFINITY_NP
+	unsigned *tmp = NULL;
+	size_t i;
+	int res;
+
+	for (i = 0; i < num_cpus; i++) {
+		if (cpus[i] >= CPU_SETSIZE) {
+			return EINVAL;
+		}
+	}
+
+	if (num_cpus != 0) {
+		tmp = malloc(sizeof(unsigned) * num_cpus);
+		if (tmp == NULL) {
+			return ENOMEM;
+		}
+		memcpy(tmp, cpus, sizeof(unsigned) * num_cpus);
+	}
+
+	res = pthread_mutex_lock(&pool->mutex);
+	if (res != 0) {
+		free(tmp);
+		return res;
+	}
+
+	free(pool->cpus);
+	pool->cpus = tmp;
+	pool->num_cpus = num_cpus;
+	pool->next_cpu = 0;
+
+	res = pthread_mutex_unlock(&pool->mutex);
+	assert(res == 0);
+
+	return 0;
+#else
+	return ENOSYS;
+#endif
+}
+
+int pthreadpool_set_reserved_threads(struct pthreadpool *pool,
+				     enum pthreadpool_prio prio,
+				     unsigned num_threads)
+{
+	int res;
+
+	if ((unsigned)prio >= PTHREADPOOL_NUM_PRIOS) {
+		return EINVAL;
+	}
+
+	res = pthread_mutex_lock(&pool->mutex);
+	if (res != 0) {
+		return res;
+	}
+
+	pool->num_reserved[prio] = num_threads;
+
+	/*
+	 * A smaller reservation might make queued jobs runnable
+	 */
+	if (pool->num_idle > 0) {
+		res = pthread_cond_broadcast(&pool->condvar);
+		assert(res == 0);
+	}
+
+	res = pthread_mutex_unlock(&pool->mutex);
+	assert(res == 0);
+
+	return 0;
+}
+
 static void pthreadpool_prepare_pool(struct pthreadpool *pool)
 {
 	int ret;
@@ -338,9 +500,15 @@ static void pthreadpool_child(void)
 	     pool != NULL;
 	     pool = DLIST_PREV(pool)) {
 
+		size_t i;
+
 		pool->num_threads = 0;
 		pool->num_idle = 0;
-		pool->head = 0;
+		for (i = 0; i < PTHREADPOOL_NUM_PRIOS; i++) {
+			pool->queues[i].head = 0;
+			pool->queues[i].num_jobs = 0;
+			pool->num_running[i] = 0;
+		}
 		pool->num_jobs = 0;
 		pool->stopped = true;
 
@@ -395,7 +563,8 @@ static int pthreadpool_free(struct pthreadpool *pool)
 		return ret2;
 	}
 
-	free(pool->jobs);
+	free(pool->cpus);
+	pthreadpool_free_queues(pool);
 	free(pool);
 
 	return 0;
@@ -503,39 +672,117 @@ static void pthreadpool_server_exit(struct pthreadpool *pool)
 	}
 }
 
+/*
+ * A class may use all threads except those reserved for the classes
+ * with a higher priority. This keeps a flood of bulk jobs from
+ * occupying the threads that interactive requests need.
+ */
+static bool pthreadpool_prio_runnable(struct pthreadpool *p,
+				      enum pthreadpool_prio prio)
+{
+	unsigned reserved = 0;
+	unsigned limit = 1;
+	size_t i;
+
+	if (p->queues[prio].num_jobs == 0) {
+		return false;
+	}
+
+	for (i = 0; i < prio; i++) {
+		reserved += p->num_reserved[i];
+	}
+	if (p->max_threads > reserved) {
+		limit = p->max_threads - reserved;
+	}
+
+	return (p->num_running[prio] < limit);
+}
+
+static bool pthreadpool_job_runnable(struct pthreadpool *p)
+{
+	size_t i;
+
+	if (p->num_jobs == 0) {
+		return false;
+	}
+
+	for (i = 0; i < PTHREADPOOL_NUM_PRIOS; i++) {
+		if (pthreadpool_prio_runnable(p, i)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
 static bool pthreadpool_get_job(struct pthreadpool *p,
 				struct pthreadpool_job *job)
 {
+	struct pthreadpool_queue *q = NULL;
+	size_t i;
+
 	if (p->stopped) {
 		return false;
 	}
 
-	if (p->num_jobs == 0) {
+	for (i = 0; i < PTHREADPOOL_NUM_PRIOS; i++) {
+		if (pthreadpool_prio_runnable(p, i)) {
+			q = &p->queues[i];
+			break;
+		}
+	}
+	if (q == NULL) {
 		return false;
 	}
-	*job = p->jobs[p->head];
-	p->head = (p->head+1) % p->jobs_array_len;
+
+	*job = q->jobs[q->head];
+	q->head = (q->head+1) % q->jobs_array_len;
+	q->num_jobs -= 1;
 	p->num_jobs -= 1;
+	p->num_running[job->prio] += 1;
+
+	{
+		struct timespec now;
+		uint64_t wait_usec = 0;
+
+		clock_gettime(CLOCK_MONOTONIC, &now);
+		if ((now.tv_sec > job->queued.tv_sec) ||
+		    ((now.tv_sec == job->queued.tv_sec) &&
+		     (now.tv_nsec > job->queued.tv_nsec))) {
+			wait_usec = (now.tv_sec - job->queued.tv_sec) * 1000000;
+			wait_usec += now.tv_nsec / 1000;
+			wait_usec -= job->queued.tv_nsec / 1000;
+		}
+
+		p->num_started_jobs += 1;
+		p->total_wait_usec += wait_usec;
+		if (wait_usec > p->max_wait_usec) {
+			p->max_wait_usec = wait_usec;
+		}
+	}
+
 	return true;
 }
 
 static bool pthreadpool_put_job(struct pthreadpool *p,
 				int id,
+				enum pthreadpool_prio prio,
 				void (*fn)(void *private_data),
 				void *private_data)
 {
+	struct pthreadpool_queue *q = &p->queues[prio];
 	struct pthreadpool_job *job;
 
-	if (p->num_jobs == p->jobs_array_len) {
+	if (q->num_jobs == q->jobs_array_len) {
 		struct pthreadpool_job *tmp;
-		size_t new_len = p->jobs_array_len * 2;
+		size_t new_len = q->jobs_array_len * 2;
 
 		tmp = realloc(
-			p->jobs, sizeof(struct pthreadpool_job) * new_len);
+			q->jobs, sizeof(struct pthreadpool_job) * new_len);
 		if (tmp == NULL) {
 			return false;
 		}
-		p->jobs = tmp;
+		q->jobs = tmp;
 
 		/*
 		 * We just doubled the jobs array. The array implements a FIFO
@@ -546,24 +793,32 @@ static bool pthreadpool_put_job(struct pthreadpool *p,
 		 * copy everything before the current head job into the new
 		 * area.
 		 */
-		memcpy(&p->jobs[p->jobs_array_len], p->jobs,
-		       sizeof(struct pthreadpool_job) * p->head);
+		memcpy(&q->jobs[q->jobs_array_len], q->jobs,
+		       sizeof(struct pthreadpool_job) * q->head);
 
-		p->jobs_array_len = new_len;
+		q->jobs_array_len = new_len;
 	}
 
-	job = &p->jobs[(p->head + p->num_jobs) % p->jobs_array_len];
+	job = &q->jobs[(q->head + q->num_jobs) % q->jobs_array_len];
 	job->id = id;
 	job->fn = fn;
 	job->private_data = private_data;
+	job->prio = prio;
+	clock_gettime(CLOCK_MONOTONIC, &job->queued);
 
+	q->num_jobs += 1;
 	p->num_jobs += 1;
+	if (p->num_jobs > p->max_queued_jobs) {
+		p->max_queued_jobs = p->num_jobs;
+	}
 
 	return true;
 }
 
-static void pthreadpool_undo_put_job(struct pthreadpool *p)
+static void pthreadpool_undo_put_job(struct pthreadpool *p,
+				     enum pthreadpool_prio prio)
 {
+	p->queues[prio].num_jobs -= 1;
 	p->num_jobs -= 1;
 }
 
@@ -589,7 +844,7 @@ static void *pthreadpool_server(void *arg)
 		clock_gettime(CLOCK_REALTIME, &ts);
 		ts.tv_sec += 1;
 
-		while ((pool->num_jobs == 0) && !pool->stopped) {
+		while (!pthreadpool_job_runnable(pool) && !pool->stopped) {
 
 			pool->num_idle += 1;
 			res = pthread_cond_timedwait(
@@ -628,10 +883,12 @@ static void *pthreadpool_server(void *arg)
 
 			if (res == ETIMEDOUT) {
 
-				if (pool->num_jobs == 0) {
+				if (!pthreadpool_job_runnable(pool)) {
 					/*
 					 * we timed out and still no work for
-					 * us. Exit.
+					 * us. Exit. Jobs held back by their
+					 * class limit are picked up by the
+					 * threads running that class.
 					 */
 					pthreadpool_server_exit(pool);
 					return NULL;
@@ -661,6 +918,8 @@ static void *pthreadpool_server(void *arg)
 			res = pthread_mutex_lock(&pool->mutex);
 			assert(res == 0);
 
+			pool->num_running[job.prio] -= 1;
+
 			if (ret != 0) {
 				pthreadpool_server_exit(pool);
 				return NULL;
@@ -702,6 +961,23 @@ static int pthreadpool_create_thread(struct pthreadpool *pool)
 		return res;
 	}
 
+#ifdef HAVE_PTHREAD_ATTR_SETAFFINITY_NP
+	if (pool->num_cpus != 0) {
+		cpu_set_t cpuset;
+
+		CPU_ZERO(&cpuset);
+		CPU_SET(pool->cpus[pool->next_cpu], &cpuset);
+		pool->next_cpu = (pool->next_cpu + 1) % pool->num_cpus;
+
+		res = pthread_attr_setaffinity_np(
+			&thread_attr, sizeof(cpuset), &cpuset);
+		if (res != 0) {
+			pthread_attr_destroy(&thread_attr);
+			return res;
+		}
+	}
+#endif
+
 	res = pthread_sigmask(SIG_BLOCK, &mask, &omask);
 	if (res != 0) {
 		pthread_attr_destroy(&thread_attr);
@@ -724,12 +1000,26 @@ static int pthreadpool_create_thread(struct pthreadpool *pool)
 
 int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 			void (*fn)(void *private_data), void *private_data)
+{
+	return pthreadpool_add_job_prio(pool, job_id,
+					PTHREADPOOL_PRIO_INTERACTIVE,
+					fn, private_data);
+}
+
+int pthreadpool_add_job_prio(struct pthreadpool *pool, int job_id,
+			     enum pthreadpool_prio prio,
+			     void (*fn)(void *private_data),
+			     void *private_data)
 {
 	int res;
 	int unlock_res;
 
 	assert(!pool->destroyed);
 
+	if ((unsigned)prio >= PTHREADPOOL_NUM_PRIOS) {
+		return EINVAL;
+	}
+
 	res = pthread_mutex_lock(&pool->mutex);
 	if (res != 0) {
 		return res;
@@ -761,7 +1051,7 @@ int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 	/*
 	 * Add job to the end of the queue
 	 */
-	if (!pthreadpool_put_job(pool, job_id, fn, private_data)) {
+	if (!pthreadpool_put_job(pool, job_id, prio, fn, private_data)) {
 		unlock_res = pthread_mutex_unlock(&pool->mutex);
 		assert(unlock_res == 0);
 		return ENOMEM;
@@ -773,16 +1063,20 @@ int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 		 */
 		res = pthread_cond_signal(&pool->condvar);
 		if (res != 0) {
-			pthreadpool_undo_put_job(pool);
+			pthreadpool_undo_put_job(pool, prio);
 		}
 		unlock_res = pthread_mutex_unlock(&pool->mutex);
 		assert(unlock_res == 0);
 		return res;
 	}
 
-	if (pool->num_threads >= pool->max_threads) {
+	if ((pool->num_threads >= pool->max_threads) ||
+	    !pthreadpool_prio_runnable(pool, prio)) {
 		/*
-		 * No more new threads, we just queue the request
+		 * No more new threads or the class is at its limit
+		 * (so a running job of this class has to finish
+		 * before this one can start), we just queue the
+		 * request
 		 */
 		unlock_res = pthread_mutex_unlock(&pool->mutex);
 		assert(unlock_res == 0);
@@ -806,7 +1100,7 @@ int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 		return 0;
 	}
 
-	pthreadpool_undo_put_job(pool);
+	pthreadpool_undo_put_job(pool, prio);
 
 	unlock_res = pthread_mutex_unlock(&pool->mutex);
 	assert(unlock_res == 0);
@@ -818,7 +1112,7 @@ size_t pthreadpool_cancel_job(struct pthreadpool *pool, int job_id,
 			      void (*fn)(void *private_data), void *private_data)
 {
 	int res;
-	size_t i, j;
+	size_t p, i, j;
 	size_t num = 0;
 
 	assert(!pool->destroyed);
@@ -828,30 +1122,39 @@ size_t pthreadpool_cancel_job(struct pthreadpool *pool, int job_id,
 		return res;
 	}
 
-	for (i = 0, j = 0; i < pool->num_jobs; i++) {
-		size_t idx = (pool->head + i) % pool->jobs_array_len;
-		size_t new_idx = (pool->head + j) % pool->jobs_array_len;
-		struct pthreadpool_job *job = &pool->jobs[idx];
+	for (p = 0; p < PTHREADPOOL_NUM_PRIOS; p++) {
+		struct pthreadpool_queue *q = &pool->queues[p];
+		size_t qnum = 0;
+
+		for (i = 0, j = 0; i < q->num_jobs; i++) {
+			size_t idx = (q->head + i) % q->jobs_array_len;
+			size_t new_idx = (q->head + j) % q->jobs_array_len;
+			struct pthreadpool_job *job = &q->jobs[idx];
+
+			if ((job->private_data == private_data) &&
+			    (job->id == job_id) &&
+			    (job->fn == fn))
+			{
+				/*
+				 * Just skip the entry.
+				 */
+				qnum++;
+				continue;
+			}
 
-		if ((job->private_data == private_data) &&
-		    (job->id == job_id) &&
-		    (job->fn == fn))
-		{
 			/*
-			 * Just skip the entry.
+			 * If we already removed one or more jobs (so j will
+			 * be smaller then i), we need to fill possible gaps
+			 * in the logical list.
 			 */
-			num++;
-			continue;
+			if (j < i) {
+				q->jobs[new_idx] = *job;
+			}
+			j++;
 		}
 
-		/*
-		 * If we already removed one or more jobs (so j will be smaller
-		 * then i), we need to fill possible gaps in the logical list.
-		 */
-		if (j < i) {
-			pool->jobs[new_idx] = *job;
-		}
-		j++;
+		q->num_jobs -= qnum;
+		num += qnum;
 	}
 
 	pool->num_jobs -= num;
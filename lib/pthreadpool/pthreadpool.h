@@ -71,6 +71,81 @@ size_t pthreadpool_max_threads(struct pthreadpool *pool);
  */
 size_t pthreadpool_queued_jobs(struct pthreadpool *pool);
 
+struct pthreadpool_stats {
+	/* Jobs waiting for a thread right now */
+	size_t queued_jobs;
+	/* Maximum of queued_jobs since pthreadpool_init() */
+	size_t max_queued_jobs;
+	/* Jobs picked up by a thread */
+	uint64_t num_jobs;
+	/* Time the jobs in num_jobs spent in the queue */
+	uint64_t total_wait_usec;
+	uint64_t max_wait_usec;
+	/* Current threads, and those of them waiting for work */
+	unsigned num_threads;
+	unsigned num_idle;
+};
+
+/**
+ * @brief Get queue statistics of pthreadpool
+ *
+ * @param[in]	pool		The pool
+ * @param[out]	stats		The statistics
+ * @return			success: 0, failure: errno
+ */
+int pthreadpool_get_stats(struct pthreadpool *pool,
+			  struct pthreadpool_stats *stats);
+
+/**
+ * @brief Bind the threads of a pthreadpool to CPUs
+ *
+ * Threads created after this call are bound to one of the given
+ * CPUs each, in a round robin way. Passing the CPUs of a NUMA node
+ * keeps the threads on that node. num_cpus=0 removes the binding for
+ * new threads.
+ *
+ * @param[in]	pool		The pool
+ * @param[in]	cpus		Array of CPU numbers
+ * @param[in]	num_cpus	Number of elements in cpus
+ * @return			success: 0, failure: errno,
+ *				ENOSYS if not supported
+ */
+int pthreadpool_set_cpus(struct pthreadpool *pool,
+			 const unsigned *cpus,
+			 size_t num_cpus);
+
+/**
+ * @brief Priority classes of jobs
+ *
+ * Queued jobs of a class are started before those of all classes
+ * further down in this list. Within a class jobs are started in FIFO
+ * order.
+ */
+enum pthreadpool_prio {
+	PTHREADPOOL_PRIO_INTERACTIVE = 0,
+	PTHREADPOOL_PRIO_METADATA,
+	PTHREADPOOL_PRIO_BULK,
+	PTHREADPOOL_PRIO_BACKGROUND,
+	PTHREADPOOL_NUM_PRIOS,
+};
+
+/**
+ * @brief Reserve threads for a priority class
+ *
+ * Jobs of lower priority classes will never occupy the num_threads
+ * threads reserved for prio, so that a flood of bulk jobs can't
+ * delay interactive ones until the whole queue is drained. A class
+ * can always run at least one job, regardless of the reservations.
+ *
+ * @param[in]	pool		The pool
+ * @param[in]	prio		The class to reserve threads for
+ * @param[in]	num_threads	Number of threads, 0 removes the reservation
+ * @return			success: 0, failure: errno
+ */
+int pthreadpool_set_reserved_threads(struct pthreadpool *pool,
+				     enum pthreadpool_prio prio,
+				     unsigned num_threads);
+
 /**
  * @brief Stop a pthreadpool
  *
@@ -127,6 +202,26 @@ int pthreadpool_destroy(struct pthreadpool *pool);
 int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 			void (*fn)(void *private_data), void *private_data);
 
+/**
+ * @brief Add a job of a given priority class to a pthreadpool
+ *
+ * pthreadpool_add_job() queues jobs as PTHREADPOOL_PRIO_INTERACTIVE.
+ *
+ * @param[in]	pool		The pool to run the job on
+ * @param[in]	job_id		A custom identifier
+ * @param[in]	prio		The priority class of the job
+ * @param[in]	fn		The function to run asynchronously
+ * @param[in]	private_data	Pointer passed to fn
+ * @return			success: 0, failure: errno
+ *
+ * @see pthreadpool_add_job()
+ * @see pthreadpool_set_reserved_threads()
+ */
+int pthreadpool_add_job_prio(struct pthreadpool *pool, int job_id,
+			     enum pthreadpool_prio prio,
+			     void (*fn)(void *private_data),
+			     void *private_data);
+
 /**
  * @brief Try to cancel a job in a pthreadpool
  *
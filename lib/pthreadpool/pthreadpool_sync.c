@@ -65,6 +65,35 @@ size_t pthreadpool_queued_jobs(struct pthreadpool *pool)
 	return 0;
 }
 
+int pthreadpool_get_stats(struct pthreadpool *pool,
+			  struct pthreadpool_stats *stats)
+{
+	*stats = (struct pthreadpool_stats) { .queued_jobs = 0, };
+	return 0;
+}
+
+int pthreadpool_set_cpus(struct pthreadpool *pool,
+			 const unsigned *cpus,
+			 size_t num_cpus)
+{
+	return ENOSYS;
+}
+
+int pthreadpool_set_reserved_threads(struct pthreadpool *pool,
+				     enum pthreadpool_prio prio,
+				     unsigned num_threads)
+{
+	return 0;
+}
+
+int pthreadpool_add_job_prio(struct pthreadpool *pool, int job_id,
+			     enum pthreadpool_prio prio,
+			     void (*fn)(void *private_data),
+			     void *private_data)
+{
+	return pthreadpool_add_job(pool, job_id, fn, private_data);
+}
+
 int pthreadpool_add_job(struct pthreadpool *pool, int job_id,
 			void (*fn)(void *private_data), void *private_data)
 {
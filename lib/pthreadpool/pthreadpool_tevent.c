@@ -121,6 +121,39 @@ size_t pthreadpool_tevent_queued_jobs(struct pthreadpool_tevent *pool)
 	return pthreadpool_queued_jobs(pool->pool);
 }
 
+int pthreadpool_tevent_get_stats(struct pthreadpool_tevent *pool,
+				 struct pthreadpool_stats *stats)
+{
+	if (pool->pool == NULL) {
+		*stats = (struct pthreadpool_stats) { .queued_jobs = 0, };
+		return 0;
+	}
+
+	return pthreadpool_get_stats(pool->pool, stats);
+}
+
+int pthreadpool_tevent_set_cpus(struct pthreadpool_tevent *pool,
+				const unsigned *cpus,
+				size_t num_cpus)
+{
+	if (pool->pool == NULL) {
+		return EINVAL;
+	}
+
+	return pthreadpool_set_cpus(pool->pool, cpus, num_cpus);
+}
+
+int pthreadpool_tevent_set_reserved_threads(struct pthreadpool_tevent *pool,
+					    enum pthreadpool_prio prio,
+					    unsigned num_threads)
+{
+	if (pool->pool == NULL) {
+		return EINVAL;
+	}
+
+	return pthreadpool_set_reserved_threads(pool->pool, prio, num_threads);
+}
+
 static int pthreadpool_tevent_destructor(struct pthreadpool_tevent *pool)
 {
 	struct pthreadpool_tevent_job_state *state, *next;
@@ -291,6 +324,17 @@ struct tevent_req *pthreadpool_tevent_job_send(
 	TALLOC_CTX *mem_ctx, struct tevent_context *ev,
 	struct pthreadpool_tevent *pool,
 	void (*fn)(void *private_data), void *private_data)
+{
+	return pthreadpool_tevent_job_send_prio(mem_ctx, ev, pool,
+						PTHREADPOOL_PRIO_INTERACTIVE,
+						fn, private_data);
+}
+
+struct tevent_req *pthreadpool_tevent_job_send_prio(
+	TALLOC_CTX *mem_ctx, struct tevent_context *ev,
+	struct pthreadpool_tevent *pool,
+	enum pthreadpool_prio prio,
+	void (*fn)(void *private_data), void *private_data)
 {
 	struct tevent_req *req;
 	struct pthreadpool_tevent_job_state *state;
@@ -326,9 +370,9 @@ struct tevent_req *pthreadpool_tevent_job_send(
 		return tevent_req_post(req, ev);
 	}
 
-	ret = pthreadpool_add_job(pool->pool, 0,
-				  pthreadpool_tevent_job_fn,
-				  state);
+	ret = pthreadpool_add_job_prio(pool->pool, 0, prio,
+				       pthreadpool_tevent_job_fn,
+				       state);
 	if (tevent_req_error(req, ret)) {
 		return tevent_req_post(req, ev);
 	}
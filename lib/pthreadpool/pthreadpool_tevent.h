@@ -21,6 +21,7 @@
 #define __PTHREADPOOL_TEVENT_H__
 
 #include <tevent.h>
+#include "pthreadpool.h"
 
 struct pthreadpool_tevent;
 
@@ -30,11 +31,28 @@ int pthreadpool_tevent_init(TALLOC_CTX *mem_ctx, unsigned max_threads,
 size_t pthreadpool_tevent_max_threads(struct pthreadpool_tevent *pool);
 size_t pthreadpool_tevent_queued_jobs(struct pthreadpool_tevent *pool);
 
+struct pthreadpool_stats;
+int pthreadpool_tevent_get_stats(struct pthreadpool_tevent *pool,
+				 struct pthreadpool_stats *stats);
+int pthreadpool_tevent_set_cpus(struct pthreadpool_tevent *pool,
+				const unsigned *cpus,
+				size_t num_cpus);
+
+int pthreadpool_tevent_set_reserved_threads(struct pthreadpool_tevent *pool,
+					    enum pthreadpool_prio prio,
+					    unsigned num_threads);
+
 struct tevent_req *pthreadpool_tevent_job_send(
 	TALLOC_CTX *mem_ctx, struct tevent_context *ev,
 	struct pthreadpool_tevent *pool,
 	void (*fn)(void *private_data), void *private_data);
 
+struct tevent_req *pthreadpool_tevent_job_send_prio(
+	TALLOC_CTX *mem_ctx, struct tevent_context *ev,
+	struct pthreadpool_tevent *pool,
+	enum pthreadpool_prio prio,
+	void (*fn)(void *private_data), void *private_data);
+
 int pthreadpool_tevent_job_recv(struct tevent_req *req);
 
 #endif
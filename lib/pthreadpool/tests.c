@@ -9,8 +9,10 @@
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <signal.h>
+#include <inttypes.h>
 #include "pthreadpool_pipe.h"
 #include "pthreadpool_tevent.h"
+#include "pthreadpool.h"
 
 static int test_init(void)
 {
@@ -465,6 +467,229 @@ static int test_tevent_1(void)
 	return 0;
 }
 
+#define NUM_STATS_JOBS 20
+
+static int test_stats(void)
+{
+	struct tevent_context *ev;
+	struct pthreadpool_tevent *pool;
+	struct pthreadpool_stats stats;
+	struct tevent_req *reqs[NUM_STATS_JOBS];
+	unsigned cpu = 0;
+	int timeout = 10;
+	size_t i;
+	int ret;
+
+	ev = tevent_context_init(NULL);
+	if (ev == NULL) {
+		ret = errno;
+		fprintf(stderr, "tevent_context_init failed: %s\n",
+			strerror(ret));
+		return ret;
+	}
+	ret = pthreadpool_tevent_init(ev, 2, &pool);
+	if (ret != 0) {
+		fprintf(stderr, "pthreadpool_tevent_init failed: %s\n",
+			strerror(ret));
+		TALLOC_FREE(ev);
+		return ret;
+	}
+
+	ret = pthreadpool_tevent_set_cpus(pool, &cpu, 1);
+	if (ret != 0 && ret != ENOSYS) {
+		fprintf(stderr, "pthreadpool_tevent_set_cpus failed: %s\n",
+			strerror(ret));
+		TALLOC_FREE(ev);
+		return ret;
+	}
+
+	for (i = 0; i < NUM_STATS_JOBS; i++) {
+		reqs[i] = pthreadpool_tevent_job_send(
+			ev, ev, pool, test_tevent_wait, &timeout);
+		if (reqs[i] == NULL) {
+			fprintf(stderr, "pthreadpool_tevent_job_send failed\n");
+			TALLOC_FREE(ev);
+			return ENOMEM;
+		}
+	}
+
+	for (i = 0; i < NUM_STATS_JOBS; i++) {
+		if (!tevent_req_poll(reqs[i], ev)) {
+			ret = errno;
+			fprintf(stderr, "tevent_req_poll failed: %s\n",
+				strerror(ret));
+			TALLOC_FREE(ev);
+			return ret;
+		}
+		ret = pthreadpool_tevent_job_recv(reqs[i]);
+		TALLOC_FREE(reqs[i]);
+		if (ret != 0) {
+			fprintf(stderr, "job failed: %s\n", strerror(ret));
+			TALLOC_FREE(ev);
+			return ret;
+		}
+	}
+
+	ret = pthreadpool_tevent_get_stats(pool, &stats);
+	if (ret != 0) {
+		fprintf(stderr, "pthreadpool_tevent_get_stats failed: %s\n",
+			strerror(ret));
+		TALLOC_FREE(ev);
+		return ret;
+	}
+
+	/*
+	 * Only two threads for 20 jobs, so most of them
+	 * had to wait in the queue.
+	 */
+	if ((stats.num_jobs != NUM_STATS_JOBS) ||
+	    (stats.queued_jobs != 0) ||
+	    (stats.max_queued_jobs < NUM_STATS_JOBS - 2) ||
+	    (stats.max_wait_usec < 10000) ||
+	    (stats.total_wait_usec < stats.max_wait_usec) ||
+	    (stats.num_threads > 2)) {
+		fprintf(stderr, "unexpected stats: num_jobs=%"PRIu64" "
+			"queued_jobs=%zu max_queued_jobs=%zu "
+			"max_wait_usec=%"PRIu64" total_wait_usec=%"PRIu64" "
+			"num_threads=%u\n",
+			stats.num_jobs, stats.queued_jobs,
+			stats.max_queued_jobs, stats.max_wait_usec,
+			stats.total_wait_usec, stats.num_threads);
+		TALLOC_FREE(ev);
+		return EINVAL;
+	}
+
+	TALLOC_FREE(pool);
+	TALLOC_FREE(ev);
+	return 0;
+}
+
+#define NUM_PRIO_JOBS 6
+
+static pthread_mutex_t test_prio_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned test_prio_bulk_running;
+static unsigned test_prio_bulk_max;
+static unsigned test_prio_num_done;
+
+static void test_prio_bulk(void *private_data)
+{
+	int *timeout = private_data;
+
+	pthread_mutex_lock(&test_prio_mutex);
+	test_prio_bulk_running += 1;
+	if (test_prio_bulk_running > test_prio_bulk_max) {
+		test_prio_bulk_max = test_prio_bulk_running;
+	}
+	pthread_mutex_unlock(&test_prio_mutex);
+
+	poll(NULL, 0, *timeout);
+
+	pthread_mutex_lock(&test_prio_mutex);
+	test_prio_bulk_running -= 1;
+	pthread_mutex_unlock(&test_prio_mutex);
+}
+
+static void test_prio_done(struct tevent_req *req)
+{
+	unsigned *done_idx = tevent_req_callback_data_void(req);
+	*done_idx = test_prio_num_done++;
+}
+
+static int test_prio(void)
+{
+	struct tevent_context *ev;
+	struct pthreadpool_tevent *pool;
+	struct tevent_req *reqs[NUM_PRIO_JOBS + 1];
+	unsigned done_idx[NUM_PRIO_JOBS + 1];
+	int timeout = 50;
+	size_t i;
+	int ret;
+
+	ev = tevent_context_init(NULL);
+	if (ev == NULL) {
+		ret = errno;
+		fprintf(stderr, "tevent_context_init failed: %s\n",
+			strerror(ret));
+		return ret;
+	}
+	ret = pthreadpool_tevent_init(ev, 2, &pool);
+	if (ret != 0) {
+		fprintf(stderr, "pthreadpool_tevent_init failed: %s\n",
+			strerror(ret));
+		TALLOC_FREE(ev);
+		return ret;
+	}
+
+	ret = pthreadpool_tevent_set_reserved_threads(
+		pool, PTHREADPOOL_PRIO_INTERACTIVE, 1);
+	if (ret != 0) {
+		fprintf(stderr, "pthreadpool_tevent_set_reserved_threads "
+			"failed: %s\n", strerror(ret));
+		TALLOC_FREE(ev);
+		return ret;
+	}
+
+	/*
+	 * Fill the queue with bulk jobs, the interactive job queued
+	 * last must not wait for them.
+	 */
+	for (i = 0; i < NUM_PRIO_JOBS + 1; i++) {
+		if (i < NUM_PRIO_JOBS) {
+			reqs[i] = pthreadpool_tevent_job_send_prio(
+				ev, ev, pool, PTHREADPOOL_PRIO_BULK,
+				test_prio_bulk, &timeout);
+		} else {
+			reqs[i] = pthreadpool_tevent_job_send_prio(
+				ev, ev, pool, PTHREADPOOL_PRIO_INTERACTIVE,
+				test_tevent_wait, &timeout);
+		}
+		if (reqs[i] == NULL) {
+			fprintf(stderr, "pthreadpool_tevent_job_send_prio "
+				"failed\n");
+			TALLOC_FREE(ev);
+			return ENOMEM;
+		}
+		tevent_req_set_callback(reqs[i], test_prio_done,
+					&done_idx[i]);
+	}
+
+	while (test_prio_num_done < NUM_PRIO_JOBS + 1) {
+		ret = tevent_loop_once(ev);
+		if (ret != 0) {
+			ret = errno;
+			fprintf(stderr, "tevent_loop_once failed: %s\n",
+				strerror(ret));
+			TALLOC_FREE(ev);
+			return ret;
+		}
+	}
+
+	for (i = 0; i < NUM_PRIO_JOBS + 1; i++) {
+		ret = pthreadpool_tevent_job_recv(reqs[i]);
+		if (ret != 0) {
+			fprintf(stderr, "job failed: %s\n", strerror(ret));
+			TALLOC_FREE(ev);
+			return ret;
+		}
+	}
+
+	/*
+	 * Only one thread was left for the bulk jobs, the interactive
+	 * one ran in the reserved thread in parallel to the first bulk
+	 * job.
+	 */
+	if ((test_prio_bulk_max != 1) || (done_idx[NUM_PRIO_JOBS] > 1)) {
+		fprintf(stderr, "unexpected scheduling: bulk_max=%u "
+			"interactive_done=%u\n", test_prio_bulk_max,
+			done_idx[NUM_PRIO_JOBS]);
+		TALLOC_FREE(ev);
+		return EINVAL;
+	}
+
+	TALLOC_FREE(ev);
+	return 0;
+}
+
 int main(void)
 {
 	int ret;
@@ -482,6 +707,20 @@ int main(void)
 		return 1;
 	}
 
+	ret = test_stats();
+	if (ret != 0) {
+		fprintf(stderr, "test_stats failed: %s\n",
+			strerror(ret));
+		return 1;
+	}
+
+	ret = test_prio();
+	if (ret != 0) {
+		fprintf(stderr, "test_prio failed: %s\n",
+			strerror(ret));
+		return 1;
+	}
+
 	ret = test_fork();
 	if (ret != 0) {
 		fprintf(stderr, "test_fork failed\n");
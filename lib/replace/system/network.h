@@ -278,6 +278,10 @@ int rep_socketpair(int d, int type, int protocol, int sv[2]);
 #define INADDR_NONE 0xffffffff
 #endif
 
+#ifndef IPPROTO_QUIC
+#define IPPROTO_QUIC 261
+#endif
+
 #ifndef EAFNOSUPPORT
 #define EAFNOSUPPORT EINVAL
 #endif
@@ -60,12 +60,14 @@
 #define TALLOC_FLAG_LOOP 0x02
 #define TALLOC_FLAG_POOL 0x04		/* This is a talloc pool */
 #define TALLOC_FLAG_POOLMEM 0x08	/* This is allocated in a pool */
+#define TALLOC_FLAG_SLABMEM 0x10	/* This is allocated from a slab */
+#define TALLOC_FLAG_COMPACT 0x20	/* This is a compact leaf chunk */
 
 /*
  * Bits above this are random, used to make it harder to fake talloc
  * headers during an attack.  Try not to change this without good reason.
  */
-#define TALLOC_FLAG_MASK 0x0F
+#define TALLOC_FLAG_MASK 0x3F
 
 #define TALLOC_MAGIC_REFERENCE ((const char *)1)
 
@@ -259,6 +261,16 @@ static struct talloc_chunk *_vasprintf_tc(const void *t,
 typedef int (*talloc_destructor_t)(void *);
 
 struct talloc_pool_hdr;
+struct talloc_slab_cache;
+struct talloc_compact_chunk;
+
+/*
+ * Compact chunks need the 64 bit layout of struct talloc_chunk, with
+ * 32 bit pointers the compact header would not be smaller.
+ */
+#if SIZEOF_VOID_P == 8
+#define TALLOC_COMPACT_CHUNKS 1
+#endif
 
 struct talloc_chunk {
 	/*
@@ -267,6 +279,11 @@ struct talloc_chunk {
 	 */
 	unsigned flags;
 
+	/*
+	 * MAX_TALLOC_SIZE fits, this fills the alignment padding
+	 */
+	uint32_t size;
+
 	/*
 	 * If you have a logical tree like:
 	 *
@@ -292,7 +309,6 @@ struct talloc_chunk {
 	struct talloc_reference_handle *refs;
 	talloc_destructor_t destructor;
 	const char *name;
-	size_t size;
 
 	/*
 	 * limit semantics:
@@ -303,13 +319,53 @@ struct talloc_chunk {
 	 */
 	struct talloc_memlimit *limit;
 
+	union {
+		/*
+		 * For members of a pool (i.e. TALLOC_FLAG_POOLMEM is
+		 * set), "pool" is a pointer to the struct talloc_chunk
+		 * of the pool that it was allocated from. This way
+		 * children can quickly find the pool to chew from.
+		 */
+		struct talloc_pool_hdr *pool;
+
+		/*
+		 * For chunks allocated from a slab (i.e.
+		 * TALLOC_FLAG_SLABMEM is set), "slab" is the cache the
+		 * memory goes back to when the chunk is freed.
+		 */
+		struct talloc_slab_cache *slab;
+	} mem;
+
 	/*
-	 * For members of a pool (i.e. TALLOC_FLAG_POOLMEM is set), "pool"
-	 * is a pointer to the struct talloc_chunk of the pool that it was
-	 * allocated from. This way children can quickly find the pool to chew
-	 * from.
+	 * The compact children, linked like the normal children:
+	 * only the first one has a parent pointer.
 	 */
-	struct talloc_pool_hdr *pool;
+	struct talloc_compact_chunk *compact;
+
+#ifdef TALLOC_COMPACT_CHUNKS
+	uint32_t pad;
+
+	/*
+	 * Always 0. This is where the flags of a struct
+	 * talloc_compact_chunk are, directly in front of the user
+	 * data, so TALLOC_FLAG_COMPACT is never set here.
+	 */
+	unsigned tail;
+#endif
+};
+
+/*
+ * The header of a compact chunk, see talloc_compact_size(). A
+ * compact chunk has no children, destructor, references or name,
+ * it's not counted against memory limits and never allocated from
+ * a pool or slab. This saves 64 bytes per chunk for things like
+ * strings and blobs.
+ */
+struct talloc_compact_chunk {
+	struct talloc_compact_chunk *next, *prev;
+	struct talloc_chunk *parent;
+	uint32_t size;
+	unsigned flags;
 };
 
 union talloc_chunk_cast_u {
@@ -322,6 +378,22 @@ union talloc_chunk_cast_u {
 #define TC_HDR_SIZE TC_ALIGN16(sizeof(struct talloc_chunk))
 #define TC_PTR_FROM_CHUNK(tc) ((void *)(TC_HDR_SIZE + (char*)tc))
 
+#define TCC_HDR_SIZE TC_ALIGN16(sizeof(struct talloc_compact_chunk))
+#define TCC_PTR_FROM_CHUNK(tcc) ((void *)(TCC_HDR_SIZE + (char*)tcc))
+
+#ifdef TALLOC_COMPACT_CHUNKS
+/*
+ * Both headers must end with the tail or the flags, without any
+ * padding
+ */
+typedef char talloc_chunk_tail_last[
+	(offsetof(struct talloc_chunk, tail) + sizeof(unsigned)
+	 == TC_HDR_SIZE) ? 1 : -1];
+typedef char talloc_compact_chunk_flags_last[
+	(offsetof(struct talloc_compact_chunk, flags) + sizeof(unsigned)
+	 == TCC_HDR_SIZE) ? 1 : -1];
+#endif
+
 _PUBLIC_ int talloc_version_major(void)
 {
 	return TALLOC_VERSION_MAJOR;
@@ -519,11 +591,64 @@ static void talloc_abort_unknown_value(void)
 	talloc_abort("Bad talloc magic value - unknown value");
 }
 
+static void talloc_abort_compact(void)
+{
+	talloc_abort("talloc: operation not possible on a compact chunk");
+}
+
+/*
+ * Check the flags in front of ptr, they are at the same place for
+ * both header types.
+ */
+static inline bool tc_ptr_is_compact(const void *ptr)
+{
+#ifdef TALLOC_COMPACT_CHUNKS
+	const char *pp = (const char *)ptr;
+	const struct talloc_compact_chunk *tcc =
+		(const struct talloc_compact_chunk *)(pp - TCC_HDR_SIZE);
+	return unlikely(tcc->flags & TALLOC_FLAG_COMPACT);
+#else
+	return false;
+#endif
+}
+
+/* panic if we get a bad magic value */
+static inline struct talloc_compact_chunk *talloc_compact_from_ptr(
+	const void *ptr)
+{
+	const char *pp = (const char *)ptr;
+	struct talloc_compact_chunk *tcc = discard_const_p(
+		struct talloc_compact_chunk, pp - TCC_HDR_SIZE);
+	if (unlikely((tcc->flags & (TALLOC_FLAG_FREE | ~TALLOC_FLAG_MASK)) != talloc_magic)) {
+		if ((tcc->flags & (TALLOC_FLAG_FREE | ~TALLOC_FLAG_MASK))
+		    == (TALLOC_MAGIC_NON_RANDOM | TALLOC_FLAG_FREE)) {
+			talloc_log("talloc: access after free error of a compact chunk\n");
+			talloc_abort_access_after_free();
+			return NULL;
+		}
+
+		talloc_abort_unknown_value();
+		return NULL;
+	}
+	return tcc;
+}
+
 /* panic if we get a bad magic value */
 static inline struct talloc_chunk *talloc_chunk_from_ptr(const void *ptr)
 {
 	const char *pp = (const char *)ptr;
 	struct talloc_chunk *tc = discard_const_p(struct talloc_chunk, pp - TC_HDR_SIZE);
+	if (tc_ptr_is_compact(ptr)) {
+		/*
+		 * Don't look at tc, it is outside of the
+		 * allocation. Panic in talloc_compact_from_ptr() if
+		 * ptr has a bad magic value as well.
+		 */
+		if (talloc_compact_from_ptr(ptr) != NULL) {
+			talloc_abort_compact();
+		}
+		return NULL;
+	}
 	if (unlikely((tc->flags & (TALLOC_FLAG_FREE | ~TALLOC_FLAG_MASK)) != talloc_magic)) {
 		if ((tc->flags & (TALLOC_FLAG_FREE | ~TALLOC_FLAG_MASK))
 		    == (TALLOC_MAGIC_NON_RANDOM | TALLOC_FLAG_FREE)) {
@@ -577,6 +702,13 @@ static inline struct talloc_chunk *talloc_parent_chunk(const void *ptr)
 		return NULL;
 	}
 
+	if (tc_ptr_is_compact(ptr)) {
+		struct talloc_compact_chunk *tcc = talloc_compact_from_ptr(ptr);
+		while (tcc->prev) tcc=tcc->prev;
+
+		return tcc->parent;
+	}
+
 	tc = talloc_chunk_from_ptr(ptr);
 	while (tc->prev) tc=tc->prev;
 
@@ -696,7 +828,7 @@ static inline struct talloc_chunk *tc_alloc_pool(struct talloc_chunk *parent,
 		pool_hdr = talloc_pool_from_chunk(parent);
 	}
 	else if (parent->flags & TALLOC_FLAG_POOLMEM) {
-		pool_hdr = parent->pool;
+		pool_hdr = parent->mem.pool;
 	}
 
 	if (pool_hdr == NULL) {
@@ -726,7 +858,7 @@ static inline struct talloc_chunk *tc_alloc_pool(struct talloc_chunk *parent,
 	pool_hdr->end = (void *)((char *)pool_hdr->end + chunk_size);
 
 	result->flags = talloc_magic | TALLOC_FLAG_POOLMEM;
-	result->pool = pool_hdr;
+	result->mem.pool = pool_hdr;
 
 	pool_hdr->object_count++;
 
@@ -734,11 +866,165 @@ static inline struct talloc_chunk *tc_alloc_pool(struct talloc_chunk *parent,
 }
 
 /*
-   Allocate a bit of memory as a child of an existing pointer
+  A talloc slab keeps the memory of freed chunks of one fixed size on
+  a free list instead of handing it back to free(3). The chunks are
+  normal talloc chunks with TALLOC_FLAG_SLABMEM set: They can be
+  stolen, have destructors and children like any other chunk.
+
+  "struct talloc_slab" is the talloc object the caller sees, the
+  cache itself is malloc'ed separately. Chunks can outlive the slab
+  object, the cache is freed together with the last of them.
+
+  The free list belongs to the thread that created the slab. A chunk
+  freed by another thread, for example after its parent was handed
+  over, is given back to free(3) directly. Only the reference count
+  of the cache is shared between threads, it counts the chunks handed
+  out plus one for the slab object.
+*/
+
+#ifdef HAVE_PTHREAD
+static __thread char tc_slab_thread;
+#define TC_SLAB_THREAD ((const void *)&tc_slab_thread)
+#else
+#define TC_SLAB_THREAD NULL
+#endif
+
+#if defined(HAVE___ATOMIC_ADD_FETCH)
+#define TC_SLAB_REF(p) __atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define TC_SLAB_UNREF(p) __atomic_sub_fetch((p), 1, __ATOMIC_SEQ_CST)
+#elif defined(HAVE___SYNC_ADD_AND_FETCH)
+#define TC_SLAB_REF(p) __sync_add_and_fetch((p), 1)
+#define TC_SLAB_UNREF(p) __sync_sub_and_fetch((p), 1)
+#else
+#define TC_SLAB_REF(p) (*(p) += 1)
+#define TC_SLAB_UNREF(p) (*(p) -= 1)
+#ifdef HAVE_PTHREAD
+/* Not safe, talloc_slab_create() fails */
+#define TC_SLAB_NO_ATOMICS 1
+#endif
+#endif
+
+struct talloc_slab_cache {
+	size_t chunk_len;	/* bytes per element, including prefixes */
+	size_t max_cached;
+	size_t num_cached;
+	void *cached;		/* free list, linked at the element end */
+	size_t refs;		/* elements handed out, +1 for the slab */
+	const void *owner;	/* thread using the free list */
+	bool orphaned;		/* struct talloc_slab is gone */
+
+	unsigned long long num_allocs;
+	unsigned long long num_reused;
+};
+
+struct talloc_slab {
+	struct talloc_slab_cache *cache;
+};
+
+/*
+ * The free list link lives at the end of an element. This keeps
+ * the stamped talloc header of a freed chunk intact, so that double
+ * frees are still reported as such while the element is cached.
+ */
+static inline void **tc_slab_link(struct talloc_slab_cache *cache, void *mem)
+{
+	return (void **)((char *)mem + cache->chunk_len - sizeof(void *));
+}
+
+static inline void *tc_slab_get(struct talloc_slab_cache *cache)
+{
+	void *mem = cache->cached;
+
+	if (mem != NULL) {
+		cache->cached = *tc_slab_link(cache, mem);
+		cache->num_cached -= 1;
+		cache->num_reused += 1;
+#if defined(DEVELOPER) && defined(VALGRIND_MAKE_MEM_UNDEFINED)
+		VALGRIND_MAKE_MEM_UNDEFINED(mem, cache->chunk_len);
+#endif
+	} else {
+		mem = malloc(cache->chunk_len);
+		if (unlikely(mem == NULL)) {
+			return NULL;
+		}
+	}
+
+	TC_SLAB_REF(&cache->refs);
+	cache->num_allocs += 1;
+
+	return mem;
+}
+
+static inline void tc_slab_unref(struct talloc_slab_cache *cache)
+{
+	if (TC_SLAB_UNREF(&cache->refs) == 0) {
+		free(cache);
+	}
+}
+
+static inline void tc_slab_put(struct talloc_slab_cache *cache, void *mem)
+{
+	void **link;
+
+	if (unlikely(cache->owner != TC_SLAB_THREAD)) {
+		/*
+		 * Not our free list, don't look at anything but
+		 * the reference count.
+		 */
+		free(mem);
+		tc_slab_unref(cache);
+		return;
+	}
+
+	if (unlikely(cache->orphaned) ||
+	    (cache->num_cached >= cache->max_cached)) {
+		free(mem);
+		tc_slab_unref(cache);
+		return;
+	}
+
+	link = tc_slab_link(cache, mem);
+#if defined(DEVELOPER) && defined(VALGRIND_MAKE_MEM_UNDEFINED)
+	VALGRIND_MAKE_MEM_UNDEFINED(link, sizeof(void *));
+#endif
+	*link = cache->cached;
+	cache->cached = mem;
+	cache->num_cached += 1;
+
+	/* The slab holds a reference, this does not drop to 0 */
+	TC_SLAB_UNREF(&cache->refs);
+}
+
+/*
+  Give back the memory of a chunk that has been freed, ptr is the
+  start of the allocation including any prefix
+*/
+static inline void tc_free_memory(struct talloc_chunk *tc, void *ptr)
+{
+	struct talloc_slab_cache *cache = NULL;
+
+	if (unlikely(tc->flags & TALLOC_FLAG_SLABMEM)) {
+		cache = tc->mem.slab;
+	}
+
+	TC_INVALIDATE_FULL_CHUNK(tc);
+
+	if (cache != NULL) {
+		tc_slab_put(cache, ptr);
+		return;
+	}
+
+	free(ptr);
+}
+
+/*
+   Allocate a bit of memory as a child of an existing pointer, taking
+   it from slab if given and the chunk fits
 */
 static inline void *__talloc_with_prefix(const void *context,
 					size_t size,
 					size_t prefix_len,
+					struct talloc_slab_cache *slab,
 					struct talloc_chunk **tc_ret)
 {
 	struct talloc_chunk *tc = NULL;
@@ -764,7 +1050,14 @@ static inline void *__talloc_with_prefix(const void *context,
 		if (parent->limit != NULL) {
 			limit = parent->limit;
 		}
+	}
 
+	if ((slab != NULL) &&
+	    ((total_len > slab->chunk_len) || (slab->owner != TC_SLAB_THREAD))) {
+		slab = NULL;
+	}
+
+	if ((parent != NULL) && (slab == NULL)) {
 		tc = tc_alloc_pool(parent, TC_HDR_SIZE+size, prefix_len);
 	}
 
@@ -780,14 +1073,21 @@ static inline void *__talloc_with_prefix(const void *context,
 			return NULL;
 		}
 
-		ptr = malloc(total_len);
+		if (slab != NULL) {
+			ptr = tc_slab_get(slab);
+		} else {
+			ptr = malloc(total_len);
+		}
 		if (unlikely(ptr == NULL)) {
 			return NULL;
 		}
 		tcc = (union talloc_chunk_cast_u) { .ptr = ptr + prefix_len };
 		tc = tcc.chunk;
 		tc->flags = talloc_magic;
-		tc->pool  = NULL;
+		if (slab != NULL) {
+			tc->flags |= TALLOC_FLAG_SLABMEM;
+		}
+		tc->mem.slab = slab;
 
 		talloc_memlimit_grow(limit, total_len);
 	}
@@ -796,6 +1096,10 @@ static inline void *__talloc_with_prefix(const void *context,
 	tc->size = size;
 	tc->destructor = NULL;
 	tc->child = NULL;
+	tc->compact = NULL;
+#ifdef TALLOC_COMPACT_CHUNKS
+	tc->tail = 0;
+#endif
 	tc->name = NULL;
 	tc->refs = NULL;
 
@@ -822,20 +1126,21 @@ static inline void *__talloc(const void *context,
 			size_t size,
 			struct talloc_chunk **tc)
 {
-	return __talloc_with_prefix(context, size, 0, tc);
+	return __talloc_with_prefix(context, size, 0, NULL, tc);
 }
 
 /*
  * Create a talloc pool
  */
 
-static inline void *_talloc_pool(const void *context, size_t size)
+static inline void *_talloc_pool(const void *context, size_t size,
+				 struct talloc_slab_cache *slab)
 {
 	struct talloc_chunk *tc = NULL;
 	struct talloc_pool_hdr *pool_hdr;
 	void *result;
 
-	result = __talloc_with_prefix(context, size, TP_HDR_SIZE, &tc);
+	result = __talloc_with_prefix(context, size, TP_HDR_SIZE, slab, &tc);
 
 	if (unlikely(result == NULL)) {
 		return NULL;
@@ -857,7 +1162,7 @@ static inline void *_talloc_pool(const void *context, size_t size)
 
 _PUBLIC_ void *talloc_pool(const void *context, size_t size)
 {
-	return _talloc_pool(context, size);
+	return _talloc_pool(context, size, NULL);
 }
 
 /*
@@ -866,25 +1171,21 @@ _PUBLIC_ void *talloc_pool(const void *context, size_t size)
  * a custom allocator for talloc to reduce fragmentation.
  */
 
-_PUBLIC_ void *_talloc_pooled_object(const void *ctx,
-				     size_t type_size,
-				     const char *type_name,
-				     unsigned num_subobjects,
-				     size_t total_subobjects_size)
+static inline bool tc_pooled_object_size(size_t type_size,
+					 unsigned num_subobjects,
+					 size_t total_subobjects_size,
+					 size_t *psize)
 {
 	size_t poolsize, subobjects_slack, tmp;
-	struct talloc_chunk *tc;
-	struct talloc_pool_hdr *pool_hdr;
-	void *ret;
 
 	poolsize = type_size + total_subobjects_size;
 
 	if ((poolsize < type_size) || (poolsize < total_subobjects_size)) {
-		goto overflow;
+		return false;
 	}
 
 	if (num_subobjects == UINT_MAX) {
-		goto overflow;
+		return false;
 	}
 	num_subobjects += 1;       /* the object body itself */
 
@@ -894,16 +1195,40 @@ _PUBLIC_ void *_talloc_pooled_object(const void *ctx,
 	 */
 	subobjects_slack = (TC_HDR_SIZE + TP_HDR_SIZE + 15) * num_subobjects;
 	if (subobjects_slack < num_subobjects) {
-		goto overflow;
+		return false;
 	}
 
 	tmp = poolsize + subobjects_slack;
 	if ((tmp < poolsize) || (tmp < subobjects_slack)) {
-		goto overflow;
+		return false;
+	}
+
+	*psize = tmp;
+	return true;
+}
+
+static inline void *_tc_pooled_object(const void *ctx,
+				      struct talloc_slab_cache *slab,
+				      size_t type_size,
+				      const char *type_name,
+				      unsigned num_subobjects,
+				      size_t total_subobjects_size)
+{
+	size_t poolsize;
+	struct talloc_chunk *tc;
+	struct talloc_pool_hdr *pool_hdr;
+	void *ret;
+	bool ok;
+
+	ok = tc_pooled_object_size(type_size,
+				   num_subobjects,
+				   total_subobjects_size,
+				   &poolsize);
+	if (!ok) {
+		return NULL;
 	}
-	poolsize = tmp;
 
-	ret = _talloc_pool(ctx, poolsize);
+	ret = _talloc_pool(ctx, poolsize, slab);
 	if (ret == NULL) {
 		return NULL;
 	}
@@ -921,9 +1246,390 @@ _PUBLIC_ void *_talloc_pooled_object(const void *ctx,
 
 	_tc_set_name_const(tc, type_name);
 	return ret;
+}
+
+_PUBLIC_ void *_talloc_pooled_object(const void *ctx,
+				     size_t type_size,
+				     const char *type_name,
+				     unsigned num_subobjects,
+				     size_t total_subobjects_size)
+{
+	return _tc_pooled_object(ctx, NULL, type_size, type_name,
+				 num_subobjects, total_subobjects_size);
+}
+
+/*
+ * Free the cached elements of a slab. Chunks still in use are
+ * freed with free(3) from now on, the last one takes the cache
+ * with it. This has to run in the thread that created the slab.
+ */
+static int talloc_slab_destructor(struct talloc_slab *slab)
+{
+	struct talloc_slab_cache *cache = slab->cache;
+
+	if (cache->owner != TC_SLAB_THREAD) {
+		talloc_abort("talloc_slab freed by a foreign thread");
+		return -1;
+	}
+
+	while (cache->cached != NULL) {
+		void *mem = cache->cached;
+		cache->cached = *tc_slab_link(cache, mem);
+		free(mem);
+	}
+	cache->num_cached = 0;
+	cache->orphaned = true;
+	slab->cache = NULL;
 
-overflow:
+	tc_slab_unref(cache);
+
+	return 0;
+}
+
+_PUBLIC_ struct talloc_slab *talloc_slab_create(const void *ctx,
+						size_t size,
+						unsigned num_subobjects,
+						size_t max_cached)
+{
+	struct talloc_chunk *tc = NULL;
+	struct talloc_slab_cache *cache;
+	struct talloc_slab *slab;
+	size_t poolsize;
+	bool ok;
+
+#ifdef TC_SLAB_NO_ATOMICS
+	/*
+	 * Chunks might be freed by other threads, we can't
+	 * count them safely.
+	 */
+	errno = ENOSYS;
 	return NULL;
+#endif
+
+	ok = tc_pooled_object_size(size, num_subobjects, 0, &poolsize);
+	if (!ok || (poolsize >= MAX_TALLOC_SIZE)) {
+		return NULL;
+	}
+
+	cache = malloc(sizeof(struct talloc_slab_cache));
+	if (cache == NULL) {
+		return NULL;
+	}
+	*cache = (struct talloc_slab_cache) {
+		/*
+		 * Room for a pool header, so that pooled objects
+		 * fit as well
+		 */
+		.chunk_len = TC_ALIGN16(TP_HDR_SIZE + TC_HDR_SIZE + poolsize),
+		.max_cached = max_cached,
+		.refs = 1,
+		.owner = TC_SLAB_THREAD,
+	};
+
+	slab = __talloc(ctx, sizeof(struct talloc_slab), &tc);
+	if (slab == NULL) {
+		free(cache);
+		return NULL;
+	}
+	_tc_set_name_const(tc, "struct talloc_slab");
+
+	slab->cache = cache;
+	tc->destructor = (talloc_destructor_t)talloc_slab_destructor;
+
+	return slab;
+}
+
+static inline struct talloc_slab_cache *talloc_slab_cache(
+	struct talloc_slab *slab)
+{
+	if (slab == NULL) {
+		return NULL;
+	}
+	return slab->cache;
+}
+
+_PUBLIC_ void *_talloc_slab_alloc(struct talloc_slab *slab,
+				  const void *ctx,
+				  size_t size,
+				  const char *name)
+{
+	struct talloc_chunk *tc = NULL;
+	void *ptr;
+
+	ptr = __talloc_with_prefix(ctx, size, 0, talloc_slab_cache(slab), &tc);
+	if (unlikely(ptr == NULL)) {
+		return NULL;
+	}
+
+	_tc_set_name_const(tc, name);
+
+	return ptr;
+}
+
+_PUBLIC_ void *_talloc_slab_zero(struct talloc_slab *slab,
+				 const void *ctx,
+				 size_t size,
+				 const char *name)
+{
+	void *p = _talloc_slab_alloc(slab, ctx, size, name);
+
+	if (p) {
+		memset(p, '\0', size);
+	}
+
+	return p;
+}
+
+_PUBLIC_ void *_talloc_slab_pooled_object(struct talloc_slab *slab,
+					  const void *ctx,
+					  size_t type_size,
+					  const char *type_name,
+					  unsigned num_subobjects,
+					  size_t total_subobjects_size)
+{
+	return _tc_pooled_object(ctx, talloc_slab_cache(slab),
+				 type_size, type_name,
+				 num_subobjects, total_subobjects_size);
+}
+
+/*
+  Allocate a compact chunk as a child of an existing pointer
+*/
+static inline void *__talloc_compact(const void *context, size_t size)
+{
+	struct talloc_compact_chunk *tcc = NULL;
+	struct talloc_chunk *parent = NULL;
+
+#ifndef TALLOC_COMPACT_CHUNKS
+	{
+		struct talloc_chunk *tc = NULL;
+		return __talloc(context, size, &tc);
+	}
+#endif
+
+	if (unlikely(context == NULL)) {
+		context = null_context;
+	}
+
+	if (unlikely(size >= MAX_TALLOC_SIZE)) {
+		return NULL;
+	}
+
+	if (likely(context != NULL)) {
+		parent = talloc_chunk_from_ptr(context);
+
+		if (unlikely(parent->limit != NULL)) {
+			/*
+			 * Compact chunks are not accounted, use a
+			 * normal chunk to keep the limit.
+			 */
+			struct talloc_chunk *tc = NULL;
+			return __talloc(context, size, &tc);
+		}
+	}
+
+	tcc = malloc(TCC_HDR_SIZE + size);
+	if (unlikely(tcc == NULL)) {
+		return NULL;
+	}
+
+	tcc->flags = talloc_magic | TALLOC_FLAG_COMPACT;
+	tcc->size = size;
+
+	if (likely(parent != NULL)) {
+		if (parent->compact) {
+			parent->compact->parent = NULL;
+			tcc->next = parent->compact;
+			tcc->next->prev = tcc;
+		} else {
+			tcc->next = NULL;
+		}
+		tcc->parent = parent;
+		tcc->prev = NULL;
+		parent->compact = tcc;
+	} else {
+		tcc->next = tcc->prev = NULL;
+		tcc->parent = NULL;
+	}
+
+	return TCC_PTR_FROM_CHUNK(tcc);
+}
+
+static inline void _tcc_unlink(struct talloc_compact_chunk *tcc)
+{
+	/*
+	 * The header is not protected by the magic in front of it,
+	 * check the links before writing through them.
+	 */
+	if (unlikely((tcc->next != NULL && tcc->next->prev != tcc) ||
+		     (tcc->prev != NULL && tcc->prev->next != tcc))) {
+		talloc_abort("talloc: corrupted compact chunk list");
+		return;
+	}
+
+	if (tcc->parent) {
+		_TLIST_REMOVE(tcc->parent->compact, tcc);
+		if (tcc->parent->compact) {
+			tcc->parent->compact->parent = tcc->parent;
+		}
+	} else {
+		if (tcc->prev) tcc->prev->next = tcc->next;
+		if (tcc->next) tcc->next->prev = tcc->prev;
+		tcc->prev = tcc->next = NULL;
+	}
+	tcc->parent = NULL;
+}
+
+static inline void _tcc_free(struct talloc_compact_chunk *tcc)
+{
+	_tcc_unlink(tcc);
+
+	if (unlikely(talloc_fill.enabled)) {
+		memset(TCC_PTR_FROM_CHUNK(tcc), talloc_fill.fill_value,
+		       tcc->size);
+	}
+
+	tcc->flags = TALLOC_MAGIC_NON_RANDOM | TALLOC_FLAG_FREE
+		| TALLOC_FLAG_COMPACT;
+	free(tcc);
+}
+
+static void *_tcc_steal(const void *new_ctx, struct talloc_compact_chunk *tcc)
+{
+	struct talloc_chunk *new_tc = NULL;
+	void *ptr = TCC_PTR_FROM_CHUNK(tcc);
+
+	if (unlikely(new_ctx == NULL)) {
+		new_ctx = null_context;
+	}
+	if (new_ctx != NULL) {
+		new_tc = talloc_chunk_from_ptr(new_ctx);
+	}
+
+	if (unlikely(tcc->parent != NULL && tcc->parent == new_tc)) {
+		return ptr;
+	}
+
+	_tcc_unlink(tcc);
+
+	if (new_tc != NULL) {
+		tcc->parent = new_tc;
+		if (new_tc->compact) new_tc->compact->parent = NULL;
+		_TLIST_ADD(new_tc->compact, tcc);
+	}
+
+	return ptr;
+}
+
+static inline void _tcc_set_not_free(struct talloc_compact_chunk *tcc)
+{
+	tcc->flags = talloc_magic | TALLOC_FLAG_COMPACT;
+}
+
+static void *_tcc_realloc(void *ptr, size_t size)
+{
+	struct talloc_compact_chunk *tcc = talloc_compact_from_ptr(ptr);
+	void *new_ptr = NULL;
+
+	if (unlikely(talloc_fill.enabled && size < tcc->size)) {
+		memset((char *)TCC_PTR_FROM_CHUNK(tcc) + size,
+		       talloc_fill.fill_value,
+		       tcc->size - size);
+	}
+
+	/* see the comments in _talloc_realloc() */
+	tcc->flags = TALLOC_MAGIC_NON_RANDOM | TALLOC_FLAG_FREE
+		| TALLOC_FLAG_COMPACT;
+
+	new_ptr = realloc(tcc, TCC_HDR_SIZE + size);
+	if (unlikely(!new_ptr)) {
+		/* this was not free'ed by realloc() after all */
+		_tcc_set_not_free((struct talloc_compact_chunk *)
+				  ((char *)ptr - TCC_HDR_SIZE));
+		return NULL;
+	}
+
+	tcc = (struct talloc_compact_chunk *)new_ptr;
+	_tcc_set_not_free(tcc);
+	tcc->size = size;
+
+	if (tcc->parent) {
+		tcc->parent->compact = tcc;
+	}
+	if (tcc->prev) {
+		tcc->prev->next = tcc;
+	}
+	if (tcc->next) {
+		tcc->next->prev = tcc;
+	}
+
+	return TCC_PTR_FROM_CHUNK(tcc);
+}
+
+_PUBLIC_ void *_talloc_compact(const void *ctx, size_t size)
+{
+	return __talloc_compact(ctx, size);
+}
+
+_PUBLIC_ void *_talloc_compact_array(const void *ctx,
+				     size_t el_size,
+				     unsigned count)
+{
+	if (count >= MAX_TALLOC_SIZE/el_size) {
+		return NULL;
+	}
+	return __talloc_compact(ctx, el_size * count);
+}
+
+_PUBLIC_ void *talloc_compact_memdup(const void *t,
+				     const void *p,
+				     size_t size)
+{
+	void *newp = __talloc_compact(t, size);
+
+	if (likely(newp)) {
+		memcpy(newp, p, size);
+	}
+
+	return newp;
+}
+
+static inline char *__talloc_compact_strlendup(const void *t,
+					       const char *p,
+					       size_t len)
+{
+	char *ret;
+
+	ret = (char *)__talloc_compact(t, len + 1);
+	if (unlikely(!ret)) return NULL;
+
+	memcpy(ret, p, len);
+	ret[len] = 0;
+
+	return ret;
+}
+
+_PUBLIC_ char *talloc_compact_strdup(const void *t, const char *p)
+{
+	if (unlikely(!p)) return NULL;
+	return __talloc_compact_strlendup(t, p, strlen(p));
+}
+
+_PUBLIC_ char *talloc_compact_strndup(const void *t, const char *p, size_t n)
+{
+	if (unlikely(!p)) return NULL;
+	return __talloc_compact_strlendup(t, p, strnlen(p, n));
+}
+
+_PUBLIC_ int talloc_is_compact(const void *ptr)
+{
+	if (ptr == NULL) {
+		return 0;
+	}
+	if (!tc_ptr_is_compact(ptr)) {
+		return 0;
+	}
+	return talloc_compact_from_ptr(ptr) != NULL;
 }
 
 /*
@@ -1029,7 +1735,7 @@ static inline void _tc_free_poolmem(struct talloc_chunk *tc,
 	struct talloc_chunk *pool_tc;
 	void *next_tc;
 
-	pool = tc->pool;
+	pool = tc->mem.pool;
 	pool_tc = talloc_chunk_from_pool(pool);
 	next_tc = tc_next_chunk(tc);
 
@@ -1076,8 +1782,7 @@ static inline void _tc_free_poolmem(struct talloc_chunk *tc,
 			 * the pool talloc_chunk.
 			 */
 			tc_memlimit_update_on_free(pool_tc);
-			TC_INVALIDATE_FULL_CHUNK(pool_tc);
-			free(pool);
+			tc_free_memory(pool_tc, pool);
 		}
 		return;
 	}
@@ -1218,8 +1923,7 @@ static inline int _tc_free_internal(struct talloc_chunk *tc,
 
 	tc_memlimit_update_on_free(tc);
 
-	TC_INVALIDATE_FULL_CHUNK(tc);
-	free(ptr_to_free);
+	tc_free_memory(tc, ptr_to_free);
 	return 0;
 }
 
@@ -1244,6 +1948,11 @@ static inline int _talloc_free_internal(void *ptr, const char *location)
 		talloc_fill.initialised = true;
 	}
 
+	if (tc_ptr_is_compact(ptr)) {
+		_tcc_free(talloc_compact_from_ptr(ptr));
+		return 0;
+	}
+
 	tc = talloc_chunk_from_ptr(ptr);
 	return _tc_free_internal(tc, location);
 }
@@ -1266,6 +1975,10 @@ static void *_talloc_steal_internal(const void *new_ctx, const void *ptr)
 		return NULL;
 	}
 
+	if (tc_ptr_is_compact(ptr)) {
+		return _tcc_steal(new_ctx, talloc_compact_from_ptr(ptr));
+	}
+
 	if (unlikely(new_ctx == NULL)) {
 		new_ctx = null_context;
 	}
@@ -1347,6 +2060,10 @@ _PUBLIC_ void *_talloc_steal_loc(const void *new_ctx, const void *ptr, const cha
 		return NULL;
 	}
 
+	if (tc_ptr_is_compact(ptr)) {
+		return _talloc_steal_internal(new_ctx, ptr);
+	}
+
 	tc = talloc_chunk_from_ptr(ptr);
 
 	if (unlikely(tc->refs != NULL) && talloc_parent(ptr) != new_ctx) {
@@ -1392,6 +2109,11 @@ _PUBLIC_ void *talloc_reparent(const void *old_parent, const void *new_parent, c
 		return _talloc_steal_internal(new_parent, ptr);
 	}
 
+	if (tc_ptr_is_compact(ptr)) {
+		/* compact chunks don't have references */
+		return NULL;
+	}
+
 	tc = talloc_chunk_from_ptr(ptr);
 	for (h=tc->refs;h;h=h->next) {
 		if (talloc_parent(h) == old_parent) {
@@ -1454,6 +2176,14 @@ _PUBLIC_ int talloc_unlink(const void *context, void *ptr)
 		context = null_context;
 	}
 
+	if (tc_ptr_is_compact(ptr)) {
+		tc_p = talloc_parent_chunk(ptr);
+		if ((tc_p == NULL ? NULL : TC_PTR_FROM_CHUNK(tc_p)) != context) {
+			return -1;
+		}
+		return _talloc_free_internal(ptr, __location__);
+	}
+
 	if (talloc_unreference(context, ptr) == 0) {
 		return 0;
 	}
@@ -1517,9 +2247,16 @@ static inline const char *tc_set_name_v(struct talloc_chunk *tc,
 */
 _PUBLIC_ const char *talloc_set_name(const void *ptr, const char *fmt, ...)
 {
-	struct talloc_chunk *tc = talloc_chunk_from_ptr(ptr);
+	struct talloc_chunk *tc = NULL;
 	const char *name;
 	va_list ap;
+
+	if (tc_ptr_is_compact(ptr)) {
+		/* the name would be a child */
+		return NULL;
+	}
+
+	tc = talloc_chunk_from_ptr(ptr);
 	va_start(ap, fmt);
 	name = tc_set_name_v(tc, fmt, ap);
 	va_end(ap);
@@ -1559,7 +2296,14 @@ _PUBLIC_ void *talloc_named(const void *context, size_t size, const char *fmt, .
 */
 static inline const char *__talloc_get_name(const void *ptr)
 {
-	struct talloc_chunk *tc = talloc_chunk_from_ptr(ptr);
+	struct talloc_chunk *tc = NULL;
+
+	if (tc_ptr_is_compact(ptr)) {
+		talloc_compact_from_ptr(ptr);
+		return ".compact";
+	}
+
+	tc = talloc_chunk_from_ptr(ptr);
 	if (unlikely(tc->name == TALLOC_MAGIC_REFERENCE)) {
 		return ".reference";
 	}
@@ -1681,6 +2425,10 @@ static inline void _tc_free_children_internal(struct talloc_chunk *tc,
 			_talloc_steal_internal(new_parent, child);
 		}
 	}
+
+	while (tc->compact) {
+		_tcc_free(tc->compact);
+	}
 }
 
 /*
@@ -1697,6 +2445,11 @@ _PUBLIC_ void talloc_free_children(void *ptr)
 		return;
 	}
 
+	if (tc_ptr_is_compact(ptr)) {
+		/* no children */
+		return;
+	}
+
 	tc = talloc_chunk_from_ptr(ptr);
 
 	/* we do not want to free the context name if it is a child .. */
@@ -1738,6 +2491,10 @@ _PUBLIC_ void *_talloc(const void *context, size_t size)
 */
 _PUBLIC_ void talloc_set_name_const(const void *ptr, const char *name)
 {
+	if (tc_ptr_is_compact(ptr)) {
+		/* compact chunks have no name, see __talloc_get_name() */
+		return;
+	}
 	_tc_set_name_const(talloc_chunk_from_ptr(ptr), name);
 }
 
@@ -1767,6 +2524,10 @@ _PUBLIC_ int _talloc_free(void *ptr, const char *location)
 		return -1;
 	}
 
+	if (tc_ptr_is_compact(ptr)) {
+		return _talloc_free_internal(ptr, location);
+	}
+
 	tc = talloc_chunk_from_ptr(ptr);
 
 	if (unlikely(tc->refs != NULL)) {
@@ -1804,6 +2565,7 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 	void *new_ptr;
 	bool malloced = false;
 	struct talloc_pool_hdr *pool_hdr = NULL;
+	struct talloc_slab_cache *slab = NULL;
 	size_t old_size = 0;
 	size_t new_size = 0;
 
@@ -1822,6 +2584,10 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 		return _talloc_named_const(context, size, name);
 	}
 
+	if (tc_ptr_is_compact(ptr)) {
+		return _tcc_realloc(ptr, size);
+	}
+
 	tc = talloc_chunk_from_ptr(ptr);
 
 	/* don't allow realloc on referenced pointers */
@@ -1836,7 +2602,12 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 
 	/* handle realloc inside a talloc_pool */
 	if (unlikely(tc->flags & TALLOC_FLAG_POOLMEM)) {
-		pool_hdr = tc->pool;
+		pool_hdr = tc->mem.pool;
+	}
+
+	/* handle realloc of a slab element */
+	if (unlikely(tc->flags & TALLOC_FLAG_SLABMEM)) {
+		slab = tc->mem.slab;
 	}
 
 	/* don't shrink if we have less than 1k to gain */
@@ -2016,6 +2787,36 @@ _PUBLIC_ void *_talloc_realloc(const void *context, void *ptr, size_t size, cons
 			_tc_free_poolmem(tc, __location__ "_talloc_realloc");
 		}
 	}
+	else if (slab) {
+		old_size = tc->size;
+		new_size = size;
+
+		if (tc->limit && (size > old_size)) {
+			if (!talloc_memlimit_check(tc->limit,
+					(size - old_size))) {
+				_talloc_chunk_set_not_free(tc);
+				errno = ENOMEM;
+				return NULL;
+			}
+		}
+
+		if (TC_HDR_SIZE + size <= slab->chunk_len) {
+			/*
+			 * Still fits into the slab element
+			 */
+			if (size > tc->size) {
+				TC_UNDEFINE_GROW_CHUNK(tc, size);
+			}
+			new_ptr = tc;
+		} else {
+			new_ptr = malloc(TC_HDR_SIZE+size);
+			if (new_ptr) {
+				memcpy(new_ptr, tc, tc->size + TC_HDR_SIZE);
+				tc_slab_put(slab, tc);
+				malloced = true;
+			}
+		}
+	}
 	else {
 		/* We're doing realloc here, so record the difference. */
 		old_size = tc->size;
@@ -2056,7 +2857,8 @@ got_new_ptr:
 	tc = (struct talloc_chunk *)new_ptr;
 	_talloc_chunk_set_not_free(tc);
 	if (malloced) {
-		tc->flags &= ~TALLOC_FLAG_POOLMEM;
+		tc->flags &= ~(TALLOC_FLAG_POOLMEM|TALLOC_FLAG_SLABMEM);
+		tc->mem.slab = NULL;
 	}
 	if (tc->parent) {
 		tc->parent->child = tc;
@@ -2064,6 +2866,9 @@ got_new_ptr:
 	if (tc->child) {
 		tc->child->parent = tc;
 	}
+	if (tc->compact) {
+		tc->compact->parent = tc;
+	}
 
 	if (tc->prev) {
 		tc->prev->next = tc;
@@ -2109,6 +2914,7 @@ static inline size_t _talloc_total_mem_internal(const void *ptr,
 {
 	size_t total = 0;
 	struct talloc_chunk *c, *tc;
+	struct talloc_compact_chunk *cc;
 
 	if (ptr == NULL) {
 		ptr = null_context;
@@ -2117,6 +2923,20 @@ static inline size_t _talloc_total_mem_internal(const void *ptr,
 		return 0;
 	}
 
+	if (tc_ptr_is_compact(ptr)) {
+		cc = talloc_compact_from_ptr(ptr);
+		switch (type) {
+		case TOTAL_MEM_SIZE:
+			return cc->size;
+		case TOTAL_MEM_BLOCKS:
+			return 1;
+		case TOTAL_MEM_LIMIT:
+			/* compact chunks are not counted in limits */
+			return 0;
+		}
+		return 0;
+	}
+
 	tc = talloc_chunk_from_ptr(ptr);
 
 	if (old_limit || new_limit) {
@@ -2185,6 +3005,11 @@ static inline size_t _talloc_total_mem_internal(const void *ptr,
 		total += _talloc_total_mem_internal(TC_PTR_FROM_CHUNK(c), type,
 						    old_limit, new_limit);
 	}
+	if (type != TOTAL_MEM_LIMIT) {
+		for (cc = tc->compact; cc; cc = cc->next) {
+			total += (type == TOTAL_MEM_SIZE) ? cc->size : 1;
+		}
+	}
 
 	tc->flags &= ~TALLOC_FLAG_LOOP;
 
@@ -2212,10 +3037,16 @@ _PUBLIC_ size_t talloc_total_blocks(const void *ptr)
 */
 _PUBLIC_ size_t talloc_reference_count(const void *ptr)
 {
-	struct talloc_chunk *tc = talloc_chunk_from_ptr(ptr);
+	struct talloc_chunk *tc = NULL;
 	struct talloc_reference_handle *h;
 	size_t ret = 0;
 
+	if (tc_ptr_is_compact(ptr)) {
+		return 0;
+	}
+
+	tc = talloc_chunk_from_ptr(ptr);
+
 	for (h=tc->refs;h;h=h->next) {
 		ret++;
 	}
@@ -2233,12 +3064,18 @@ _PUBLIC_ void talloc_report_depth_cb(const void *ptr, int depth, int max_depth,
 			    void *private_data)
 {
 	struct talloc_chunk *c, *tc;
+	struct talloc_compact_chunk *cc;
 
 	if (ptr == NULL) {
 		ptr = null_context;
 	}
 	if (ptr == NULL) return;
 
+	if (tc_ptr_is_compact(ptr)) {
+		callback(ptr, depth, max_depth, 0, private_data);
+		return;
+	}
+
 	tc = talloc_chunk_from_ptr(ptr);
 
 	if (tc->flags & TALLOC_FLAG_LOOP) {
@@ -2260,6 +3097,9 @@ _PUBLIC_ void talloc_report_depth_cb(const void *ptr, int depth, int max_depth,
 			talloc_report_depth_cb(TC_PTR_FROM_CHUNK(c), depth + 1, max_depth, callback, private_data);
 		}
 	}
+	for (cc=tc->compact;cc;cc=cc->next) {
+		callback(TCC_PTR_FROM_CHUNK(cc), depth + 1, max_depth, 0, private_data);
+	}
 	tc->flags &= ~TALLOC_FLAG_LOOP;
 }
 
@@ -2274,6 +3114,10 @@ static void talloc_report_depth_FILE_helper(const void *ptr, int depth, int max_
 		return;
 	}
 
+	if (tc_ptr_is_compact(ptr)) {
+		goto totals;
+	}
+
 	tc = talloc_chunk_from_ptr(ptr);
 	if (tc->limit && tc->limit->parent == tc) {
 		fprintf(f, "%*s%-30s is a memlimit context"
@@ -2284,6 +3128,24 @@ static void talloc_report_depth_FILE_helper(const void *ptr, int depth, int max_
 			(unsigned long)tc->limit->cur_size);
 	}
 
+	if (tc->destructor == (talloc_destructor_t)talloc_slab_destructor) {
+		struct talloc_slab *slab = discard_const_p(
+			struct talloc_slab, ptr);
+		struct talloc_slab_cache *cache = slab->cache;
+
+		fprintf(f, "%*s%-30s is a slab"
+			" (chunk_len = %lu bytes, used = %lu, cached = %lu,"
+			" allocs = %llu, reused = %llu)\n",
+			depth*4, "",
+			name,
+			(unsigned long)cache->chunk_len,
+			(unsigned long)(cache->refs - 1),
+			(unsigned long)cache->num_cached,
+			cache->num_allocs,
+			cache->num_reused);
+	}
+
+totals:
 	if (depth == 0) {
 		fprintf(f,"%stalloc report on '%s' (total %6lu bytes in %3lu blocks)\n",
 			(max_depth < 0 ? "full " :""), name,
@@ -2491,7 +3353,7 @@ static inline char *__talloc_strlendup_append(char *s, size_t slen,
 	memcpy(&ret[slen], a, alen);
 	ret[slen+alen] = 0;
 
-	_tc_set_name_const(talloc_chunk_from_ptr(ret), ret);
+	talloc_set_name_const(ret, ret);
 	return ret;
 }
 
@@ -2680,7 +3542,7 @@ static inline char *__talloc_vaslenprintf_append(char *s, size_t slen,
 
 	vsnprintf(s + slen, alen + 1, fmt, ap);
 
-	_tc_set_name_const(talloc_chunk_from_ptr(s), s);
+	talloc_set_name_const(s, s);
 	return s;
 }
 
@@ -2849,6 +3711,10 @@ _PUBLIC_ size_t talloc_get_size(const void *context)
 		return 0;
 	}
 
+	if (tc_ptr_is_compact(context)) {
+		return talloc_compact_from_ptr(context)->size;
+	}
+
 	tc = talloc_chunk_from_ptr(context);
 
 	return tc->size;
@@ -2865,7 +3731,11 @@ _PUBLIC_ void *talloc_find_parent_byname(const void *context, const char *name)
 		return NULL;
 	}
 
-	tc = talloc_chunk_from_ptr(context);
+	if (tc_ptr_is_compact(context)) {
+		tc = talloc_parent_chunk(context);
+	} else {
+		tc = talloc_chunk_from_ptr(context);
+	}
 	while (tc) {
 		if (tc->name && strcmp(tc->name, name) == 0) {
 			return TC_PTR_FROM_CHUNK(tc);
@@ -2890,8 +3760,13 @@ _PUBLIC_ void talloc_show_parents(const void *context, FILE *file)
 		return;
 	}
 
-	tc = talloc_chunk_from_ptr(context);
 	fprintf(file, "talloc parents of '%s'\n", __talloc_get_name(context));
+	if (tc_ptr_is_compact(context)) {
+		fprintf(file, "\t'%s'\n", __talloc_get_name(context));
+		tc = talloc_parent_chunk(context);
+	} else {
+		tc = talloc_chunk_from_ptr(context);
+	}
 	while (tc) {
 		fprintf(file, "\t'%s'\n", __talloc_get_name(TC_PTR_FROM_CHUNK(tc)));
 		while (tc && tc->prev) tc = tc->prev;
@@ -2913,7 +3788,15 @@ static int _talloc_is_parent(const void *context, const void *ptr, int depth)
 		return 0;
 	}
 
-	tc = talloc_chunk_from_ptr(context);
+	if (tc_ptr_is_compact(context)) {
+		if (context == ptr) {
+			return 1;
+		}
+		tc = talloc_parent_chunk(context);
+		depth--;
+	} else {
+		tc = talloc_chunk_from_ptr(context);
+	}
 	while (tc) {
 		if (depth <= 0) {
 			return 0;
@@ -56,7 +56,7 @@ extern "C" {
  */
 
 #define TALLOC_VERSION_MAJOR 2
-#define TALLOC_VERSION_MINOR 4
+#define TALLOC_VERSION_MINOR 5
 
 _PUBLIC_ int talloc_version_major(void);
 _PUBLIC_ int talloc_version_minor(void);
@@ -925,6 +925,211 @@ _PUBLIC_ void *_talloc_pooled_object(const void *ctx,
 			    size_t total_subobjects_size);
 #endif
 
+struct talloc_slab;
+
+/**
+ * @brief Create a cache for talloc objects of a fixed size.
+ *
+ * A talloc pool helps for children that die together with their
+ * parent. Objects like per-request structures are allocated and
+ * freed at a high rate with unrelated lifetimes, a talloc slab keeps
+ * the memory of freed objects on a free list for the next allocation
+ * instead of calling free(3) and malloc(3) again.
+ *
+ * Objects allocated from a slab are normal talloc chunks: They hang
+ * off the talloc context given at allocation time, they can be
+ * stolen, have children and destructors. Only their memory comes
+ * from and goes back to the slab. Objects can outlive the slab,
+ * their memory is free(3)'ed when they are freed after the slab.
+ *
+ * A slab belongs to the thread that created it. Allocations from
+ * other threads don't use it, objects freed by other threads give
+ * their memory back with free(3). The slab itself must be freed by
+ * the thread that created it.
+ *
+ * talloc_report_full() shows the use count and reuse statistics of
+ * a slab.
+ *
+ * @param[in]  ctx            The talloc context to hang the slab off.
+ *
+ * @param[in]  size           The size of the objects. For
+ *                            talloc_slab_pooled_object() this is the
+ *                            type size plus the total size of the
+ *                            subobjects.
+ *
+ * @param[in]  num_subobjects The number of subobjects of pooled objects,
+ *                            0 for plain objects.
+ *
+ * @param[in]  max_cached     The maximum number of freed objects to keep.
+ *
+ * @return                    The slab, NULL on error.
+ *
+ * @see talloc_slab_alloc()
+ * @see talloc_slab_pooled_object()
+ */
+_PUBLIC_ struct talloc_slab *talloc_slab_create(const void *ctx,
+						size_t size,
+						unsigned num_subobjects,
+						size_t max_cached);
+
+#ifdef DOXYGEN
+/**
+ * @brief Allocate a talloc object from a slab.
+ *
+ * This is like talloc(), but the memory is taken from the slab. If
+ * the object does not fit into the slab's objects or slab is NULL,
+ * this falls back to a normal allocation.
+ *
+ * @param[in]  slab     The slab to allocate from.
+ *
+ * @param[in]  ctx      The talloc context to hang the result off.
+ *
+ * @param[in]  type     The type to allocate.
+ *
+ * @return              The allocated object, NULL on error.
+ */
+_PUBLIC_ void *talloc_slab_alloc(struct talloc_slab *slab,
+				 const void *ctx,
+				 #type);
+
+/**
+ * @brief Allocate a zero-initialized talloc object from a slab.
+ *
+ * @see talloc_slab_alloc()
+ */
+_PUBLIC_ void *talloc_slab_zero(struct talloc_slab *slab,
+				const void *ctx,
+				#type);
+
+/**
+ * @brief Allocate a talloc object with an additional pool from a slab.
+ *
+ * This is like talloc_pooled_object(), but the memory of the pool is
+ * taken from the slab.
+ *
+ * @see talloc_pooled_object()
+ * @see talloc_slab_alloc()
+ */
+_PUBLIC_ void *talloc_slab_pooled_object(struct talloc_slab *slab,
+					 const void *ctx,
+					 #type,
+					 unsigned num_subobjects,
+					 size_t total_subobjects_size);
+#else
+#define talloc_slab_alloc(_slab, _ctx, _type) \
+	(_type *)_talloc_slab_alloc((_slab), (_ctx), sizeof(_type), #_type)
+#define talloc_slab_zero(_slab, _ctx, _type) \
+	(_type *)_talloc_slab_zero((_slab), (_ctx), sizeof(_type), #_type)
+#define talloc_slab_pooled_object(_slab, _ctx, _type, \
+				  _num_subobjects, \
+				  _total_subobjects_size) \
+	(_type *)_talloc_slab_pooled_object((_slab), (_ctx), \
+					    sizeof(_type), #_type, \
+					    (_num_subobjects), \
+					    (_total_subobjects_size))
+_PUBLIC_ void *_talloc_slab_alloc(struct talloc_slab *slab,
+				  const void *ctx,
+				  size_t size,
+				  const char *name);
+_PUBLIC_ void *_talloc_slab_zero(struct talloc_slab *slab,
+				 const void *ctx,
+				 size_t size,
+				 const char *name);
+_PUBLIC_ void *_talloc_slab_pooled_object(struct talloc_slab *slab,
+					  const void *ctx,
+					  size_t type_size,
+					  const char *type_name,
+					  unsigned num_subobjects,
+					  size_t total_subobjects_size);
+#endif
+
+#ifdef DOXYGEN
+/**
+ * @brief Allocate a compact leaf chunk.
+ *
+ * This is like talloc_size(), but the chunk has a much smaller header
+ * (32 instead of 96 bytes on 64 bit systems). This is meant for the
+ * many small leaves of a tree, things like strings and blobs.
+ *
+ * The price is that a compact chunk is only memory: It can't have
+ * children, a destructor or references, and it has the fixed name
+ * ".compact". talloc_set_name_const() is ignored, the operations that
+ * need a full chunk like using it as a talloc context abort. It can be
+ * freed, stolen, reallocated and reported like any other chunk.
+ *
+ * If ctx has a memory limit or on systems with 32 bit pointers, a
+ * normal chunk is returned. Compact chunks that are moved under a
+ * memory limited context later are not counted against the limit.
+ *
+ * @param[in]  ctx      The talloc context to hang the result off.
+ *
+ * @param[in]  size     Number of char's that you want to allocate.
+ *
+ * @return              The allocated memory chunk, NULL on error.
+ *
+ * @see talloc_size()
+ * @see talloc_is_compact()
+ */
+_PUBLIC_ void *talloc_compact_size(const void *ctx, size_t size);
+
+/**
+ * @brief Allocate a compact array.
+ *
+ * @see talloc_array()
+ * @see talloc_compact_size()
+ */
+_PUBLIC_ void *talloc_compact_array(const void *ctx, #type, unsigned count);
+#else
+#define talloc_compact_size(ctx, size) _talloc_compact(ctx, size)
+#define talloc_compact_array(ctx, type, count) \
+	(type *)_talloc_compact_array(ctx, sizeof(type), count)
+_PUBLIC_ void *_talloc_compact(const void *ctx, size_t size);
+_PUBLIC_ void *_talloc_compact_array(const void *ctx,
+				     size_t el_size,
+				     unsigned count);
+#endif
+
+/**
+ * @brief Duplicate a memory area into a compact chunk.
+ *
+ * @see talloc_memdup()
+ * @see talloc_compact_size()
+ */
+_PUBLIC_ void *talloc_compact_memdup(const void *t,
+				     const void *p,
+				     size_t size);
+
+/**
+ * @brief Duplicate a string into a compact chunk.
+ *
+ * @see talloc_strdup()
+ * @see talloc_compact_size()
+ */
+_PUBLIC_ char *talloc_compact_strdup(const void *t, const char *p);
+
+/**
+ * @brief Duplicate the first n characters of a string into a compact
+ * chunk.
+ *
+ * @see talloc_strndup()
+ * @see talloc_compact_size()
+ */
+_PUBLIC_ char *talloc_compact_strndup(const void *t,
+				      const char *p,
+				      size_t n);
+
+/**
+ * @brief Check if a pointer is a compact chunk.
+ *
+ * @param[in]  ptr      The talloc chunk to check.
+ *
+ * @return              1 if ptr was allocated with one of the
+ *                      talloc_compact functions, 0 otherwise.
+ *
+ * @see talloc_compact_size()
+ */
+_PUBLIC_ int talloc_is_compact(const void *ptr);
+
 /**
  * @brief Free a talloc chunk and NULL out the pointer.
  *
@@ -870,6 +870,7 @@ static bool test_speed(void) disable_optimization;
 static bool test_speed(void)
 {
 	void *ctx = talloc_new(NULL);
+	struct talloc_slab *slab;
 	unsigned count;
 	const int loop = 1000;
 	int i;
@@ -917,6 +918,50 @@ static bool test_speed(void)
 
 	fprintf(stderr, "talloc_pool:\t%.0f ops/sec\n", count/private_timeval_elapsed(&tv));
 
+	ctx = talloc_new(NULL);
+	slab = talloc_slab_create(ctx, ALLOC_SIZE, 0, 16);
+
+	tv = private_timeval_current();
+	count = 0;
+	do {
+		void *p1, *p2, *p3;
+		for (i=0;i<loop;i++) {
+			p1 = _talloc_slab_alloc(slab, ctx, loop % ALLOC_SIZE,
+						"p1");
+			p2 = talloc_strdup(p1, ALLOC_DUP_STRING);
+			p3 = talloc_size(p1, ALLOC_SIZE);
+			(void)p2;
+			(void)p3;
+			talloc_free(p1);
+		}
+		count += 3 * loop;
+	} while (private_timeval_elapsed(&tv) < 5.0);
+
+	talloc_free(ctx);
+
+	fprintf(stderr, "talloc_slab:\t%.0f ops/sec\n", count/private_timeval_elapsed(&tv));
+
+	ctx = talloc_new(NULL);
+
+	tv = private_timeval_current();
+	count = 0;
+	do {
+		void *p1, *p2, *p3;
+		for (i=0;i<loop;i++) {
+			p1 = talloc_size(ctx, loop % ALLOC_SIZE);
+			p2 = talloc_compact_strdup(p1, ALLOC_DUP_STRING);
+			p3 = talloc_compact_size(p1, ALLOC_SIZE);
+			(void)p2;
+			(void)p3;
+			talloc_free(p1);
+		}
+		count += 3 * loop;
+	} while (private_timeval_elapsed(&tv) < 5.0);
+
+	talloc_free(ctx);
+
+	fprintf(stderr, "talloc_compact:\t%.0f ops/sec\n", count/private_timeval_elapsed(&tv));
+
 	tv = private_timeval_current();
 	count = 0;
 	do {
@@ -1551,6 +1596,208 @@ static bool test_pooled_object(void)
 	return true;
 }
 
+static int test_slab_destructor_calls;
+
+static int test_slab_destructor(struct pooled *p)
+{
+	test_slab_destructor_calls += 1;
+	return 0;
+}
+
+static bool test_slab(void)
+{
+	void *root;
+	struct talloc_slab *slab, *pslab;
+	struct pooled *p1, *p2, *p3;
+	uintptr_t addr;
+	char *s;
+
+	printf("test: slab\n# TALLOC SLAB\n");
+
+	root = talloc_new(NULL);
+
+	slab = talloc_slab_create(root, sizeof(struct pooled), 0, 2);
+	torture_assert("slab", slab != NULL, "talloc_slab_create failed\n");
+
+	p1 = talloc_slab_zero(slab, root, struct pooled);
+	torture_assert("slab", p1 != NULL, "talloc_slab_zero failed\n");
+	torture_assert("slab", p1->s1 == NULL && p1->s2 == NULL,
+		       "talloc_slab_zero did not zero\n");
+	torture_assert("slab", talloc_get_type(p1, struct pooled) == p1,
+		       "wrong name of slab object\n");
+	torture_assert("slab", talloc_parent(p1) == root,
+		       "wrong parent of slab object\n");
+
+	p1->s1 = talloc_strdup(p1, "hello");
+	talloc_set_destructor(p1, test_slab_destructor);
+	addr = (uintptr_t)p1;
+
+	test_slab_destructor_calls = 0;
+	talloc_free(p1);
+	torture_assert("slab", test_slab_destructor_calls == 1,
+		       "destructor not called\n");
+
+	p2 = talloc_slab_alloc(slab, root, struct pooled);
+	torture_assert("slab", (uintptr_t)p2 == addr,
+		       "freed slab object not reused\n");
+
+	/* Does not fit, falls back to malloc */
+	s = _talloc_slab_alloc(slab, root, 4096, "big");
+	torture_assert("slab", s != NULL, "big alloc failed\n");
+	TALLOC_FREE(s);
+
+	/* Grow within the slab element and beyond */
+	s = _talloc_slab_alloc(slab, root, 8, "string");
+	torture_assert("slab", s != NULL, "alloc failed\n");
+	memcpy(s, "1234567", 8);
+	s = talloc_realloc(root, s, char, 16);
+	torture_assert("slab", s != NULL && strcmp(s, "1234567") == 0,
+		       "realloc within slab element failed\n");
+	s = talloc_realloc(root, s, char, 4096);
+	torture_assert("slab", s != NULL && strcmp(s, "1234567") == 0,
+		       "realloc out of slab element failed\n");
+	TALLOC_FREE(s);
+
+	/* Stealing works as with any other chunk */
+	p3 = talloc_slab_alloc(slab, NULL, struct pooled);
+	torture_assert("slab", p3 != NULL, "alloc failed\n");
+	talloc_steal(root, p3);
+	torture_assert("slab", talloc_parent(p3) == root,
+		       "steal of slab object failed\n");
+
+	/* Objects can outlive the slab */
+	TALLOC_FREE(slab);
+	TALLOC_FREE(p2);
+	TALLOC_FREE(p3);
+
+	pslab = talloc_slab_create(root, sizeof(struct pooled) + 32, 3, 1);
+	torture_assert("slab", pslab != NULL, "talloc_slab_create failed\n");
+
+	p1 = talloc_slab_pooled_object(pslab, root, struct pooled, 3, 32);
+	torture_assert("slab", p1 != NULL, "pooled object failed\n");
+	p1->s1 = talloc_strdup(p1, "hello");
+	p1->s2 = talloc_strdup(p1, "world");
+	p1->s3 = talloc_strdup(p1, "");
+	torture_assert("slab", talloc_total_blocks(p1) == 4,
+		       "wrong number of blocks\n");
+	addr = (uintptr_t)p1;
+
+	/* A moved subobject keeps the pool alive */
+	s = talloc_move(root, &p1->s1);
+	TALLOC_FREE(p1);
+	TALLOC_FREE(s);
+
+	p1 = talloc_slab_pooled_object(pslab, root, struct pooled, 3, 32);
+	torture_assert("slab", (uintptr_t)p1 == addr,
+		       "freed pooled object not reused\n");
+
+	talloc_free(root);
+
+	printf("success: slab\n");
+	return true;
+}
+
+static bool test_compact(void)
+{
+	void *root, *ctx;
+	char *s1, *s2, *s3;
+	int *a;
+	size_t blocks;
+
+	printf("test: compact\n# TALLOC COMPACT\n");
+
+	if (sizeof(void *) != 8) {
+		/* Only supported with 64 bit pointers */
+		printf("success: compact\n");
+		return true;
+	}
+
+	root = talloc_new(NULL);
+	ctx = talloc_new(root);
+
+	s1 = talloc_compact_strdup(root, "one");
+	s2 = talloc_compact_strndup(root, "two three", 3);
+	s3 = talloc_compact_memdup(root, "three", 6);
+	torture_assert("compact", s1 != NULL && s2 != NULL && s3 != NULL,
+		       "compact alloc failed\n");
+	torture_assert("compact", talloc_is_compact(s1) &&
+		       !talloc_is_compact(root),
+		       "talloc_is_compact failed\n");
+	torture_assert_str_equal("compact", s2, "two",
+				 "wrong string\n");
+	torture_assert("compact", talloc_get_size(s2) == 4,
+		       "wrong size of compact chunk\n");
+	CHECK_PARENT("compact", s1, root);
+	CHECK_PARENT("compact", s2, root);
+	CHECK_PARENT("compact", s3, root);
+	torture_assert("compact", talloc_is_parent(s2, root),
+		       "talloc_is_parent failed\n");
+	torture_assert_str_equal("compact", talloc_get_name(s1), ".compact",
+				 "wrong string\n");
+	torture_assert("compact", talloc_get_type(s1, char) == NULL,
+		       "compact chunk has a type\n");
+	talloc_set_name_const(s1, "ignored");
+	torture_assert_str_equal("compact", talloc_get_name(s1), ".compact",
+				 "wrong string\n");
+
+	CHECK_BLOCKS("compact", root, 5);
+	CHECK_SIZE("compact", root, 4 + 4 + 6);
+
+	/* remove from the middle and the head of the list */
+	TALLOC_FREE(s2);
+	CHECK_BLOCKS("compact", root, 4);
+	torture_assert("compact", talloc_unlink(ctx, s3) == -1,
+		       "unlink with the wrong parent\n");
+	torture_assert("compact", talloc_unlink(root, s3) == 0,
+		       "unlink failed\n");
+	CHECK_BLOCKS("compact", root, 3);
+	CHECK_PARENT("compact", s1, root);
+
+	talloc_steal(ctx, s1);
+	CHECK_PARENT("compact", s1, ctx);
+	CHECK_BLOCKS("compact", root, 3);
+	CHECK_BLOCKS("compact", ctx, 2);
+
+	s1 = talloc_strdup_append(s1, " and more");
+	torture_assert("compact", s1 != NULL && talloc_is_compact(s1),
+		       "realloc of compact chunk failed\n");
+	torture_assert_str_equal("compact", s1, "one and more",
+				 "wrong string\n");
+	CHECK_PARENT("compact", s1, ctx);
+
+	talloc_steal(NULL, s1);
+	torture_assert("compact", talloc_parent(s1) != ctx,
+		       "steal to NULL failed\n");
+	CHECK_BLOCKS("compact", ctx, 1);
+	TALLOC_FREE(s1);
+
+	/* the parent can move */
+	a = talloc_array(root, int, 1);
+	s1 = talloc_compact_strdup(a, "child of a");
+	s2 = talloc_compact_array(a, char, 16);
+	a = talloc_realloc(root, a, int, 100000);
+	torture_assert("compact", a != NULL, "realloc failed\n");
+	CHECK_PARENT("compact", s1, a);
+	CHECK_PARENT("compact", s2, a);
+
+	/* children are freed with the parent */
+	blocks = talloc_total_blocks(root);
+	TALLOC_FREE(a);
+	torture_assert("compact", talloc_total_blocks(root) == blocks - 3,
+		       "compact children not freed\n");
+
+	/* memory limits don't account compact chunks */
+	talloc_set_memlimit(ctx, 1024);
+	s1 = talloc_compact_strdup(ctx, "limited");
+	torture_assert("compact", s1 != NULL && !talloc_is_compact(s1),
+		       "compact chunk under a memory limit\n");
+
+	talloc_free(root);
+
+	printf("success: compact\n");
+	return true;
+}
+
 static bool test_free_ref_null_context(void)
 {
 	void *p1, *p2, *p3;
@@ -2105,6 +2352,84 @@ static bool test_pthread_talloc_passing(void)
 	printf("success: pthread_talloc_passing\n");
 	return true;
 }
+
+struct slab_thread_state {
+	struct talloc_slab *slab;
+	void *from_main;
+	void *from_thread;
+	void *from_thread_slab;
+};
+
+static void *slab_thread_fn(void *arg)
+{
+	struct slab_thread_state *state = arg;
+	struct talloc_slab *slab = NULL;
+
+	/* Not our slab, this is a normal allocation */
+	state->from_thread = talloc_slab_alloc(state->slab, NULL, int);
+
+	/* Free an object of the main thread's slab */
+	TALLOC_FREE(state->from_main);
+
+	/* An object outliving its slab and its thread */
+	slab = talloc_slab_create(NULL, sizeof(int), 0, 4);
+	if (slab == NULL) {
+		return NULL;
+	}
+	state->from_thread_slab = talloc_slab_alloc(slab, NULL, int);
+	TALLOC_FREE(slab);
+
+	return NULL;
+}
+
+static bool test_pthread_slab(void)
+{
+	struct slab_thread_state state = { .slab = NULL };
+	pthread_t thread_id;
+	void *p1;
+	uintptr_t addr;
+	int ret;
+
+	talloc_disable_null_tracking();
+
+	printf("test: pthread_slab\n# PTHREAD TALLOC SLAB\n");
+
+	state.slab = talloc_slab_create(NULL, sizeof(int), 0, 4);
+	torture_assert("pthread_slab", state.slab != NULL,
+		       "talloc_slab_create failed\n");
+
+	p1 = talloc_slab_alloc(state.slab, NULL, int);
+	torture_assert("pthread_slab", p1 != NULL, "alloc failed\n");
+	addr = (uintptr_t)p1;
+	TALLOC_FREE(p1);
+
+	state.from_main = talloc_slab_alloc(state.slab, NULL, int);
+	torture_assert("pthread_slab", (uintptr_t)state.from_main == addr,
+		       "freed slab object not reused\n");
+
+	ret = pthread_create(&thread_id, NULL, slab_thread_fn, &state);
+	torture_assert("pthread_slab", ret == 0, "pthread_create failed\n");
+	ret = pthread_join(thread_id, NULL);
+	torture_assert("pthread_slab", ret == 0, "pthread_join failed\n");
+
+	torture_assert("pthread_slab", state.from_main == NULL,
+		       "object not freed by thread\n");
+	torture_assert("pthread_slab", state.from_thread != NULL,
+		       "alloc in thread failed\n");
+	torture_assert("pthread_slab", state.from_thread_slab != NULL,
+		       "alloc from thread slab failed\n");
+
+	p1 = talloc_slab_alloc(state.slab, NULL, int);
+	torture_assert("pthread_slab", p1 != NULL, "alloc failed\n");
+
+	TALLOC_FREE(state.from_thread);
+	TALLOC_FREE(state.from_thread_slab);
+	TALLOC_FREE(p1);
+	TALLOC_FREE(state.slab);
+
+	printf("success: pthread_slab\n");
+	return true;
+}
 #endif
 
 static void test_magic_protection_abort(const char *reason)
@@ -2310,6 +2635,10 @@ bool torture_local_talloc(struct torture_context *tctx)
 	test_reset();
 	ret &= test_pool_steal();
 	test_reset();
+	ret &= test_slab();
+	test_reset();
+	ret &= test_compact();
+	test_reset();
 	ret &= test_free_ref_null_context();
 	test_reset();
 	ret &= test_rusty();
@@ -2320,6 +2649,8 @@ bool torture_local_talloc(struct torture_context *tctx)
 #ifdef HAVE_PTHREAD
 	test_reset();
 	ret &= test_pthread_talloc_passing();
+	test_reset();
+	ret &= test_pthread_slab();
 #endif
 
 
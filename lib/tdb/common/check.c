@@ -397,6 +397,12 @@ _PUBLIC_ int tdb_check(struct tdb_context *tdb,
 		if (off)
 			record_offset(hashes[h], off);
 	}
+	for (h = 1; h < tdb_freelist_num_classes(tdb); h++) {
+		if (tdb_ofs_read(tdb, tdb_freelist_head(tdb, h), &off) == -1)
+			goto free;
+		if (off)
+			record_offset(hashes[0], off);
+	}
 
 	/* For each record, read it in and check it's ok. */
 	for (off = TDB_DATA_START(tdb->hash_size);
@@ -433,6 +439,7 @@ _PUBLIC_ int tdb_check(struct tdb_context *tdb,
 			rec.rec_len = dead - sizeof(rec);
 			break;
 		case TDB_RECOVERY_MAGIC:
+		case TDB_RECOVERY_CSUM_MAGIC:
 			if (recovery_start != off) {
 				TDB_LOG((tdb, TDB_DEBUG_ERROR,
 					 "Unexpected recovery record at offset %u\n",
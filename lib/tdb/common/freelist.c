@@ -27,6 +27,53 @@
 
 #include "tdb_private.h"
 
+/*
+ * With TDB_FEATURE_FLAG_FREELIST_CLASSES free records are kept on
+ * TDB_FREELIST_CLASSES lists segregated by power-of-two size classes:
+ * class 0 holds records below 32 bytes, class k holds records of
+ * [16<<k, 32<<k) bytes and the last class holds everything bigger.
+ *
+ * A record on list k is never smaller than the lower bound of class k.
+ * Records only grow by merging while on a list and are moved to their
+ * proper class when they are shortened by an allocation, so the head of
+ * any non-empty list above the class of a request is big enough for it.
+ * The lists are singly linked, so a record that grew by merging stays
+ * on its list until it is found by the last resort walk of the smaller
+ * classes done before expanding the file.
+ */
+uint32_t tdb_freelist_num_classes(struct tdb_context *tdb)
+{
+	if (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES) {
+		return TDB_FREELIST_CLASSES;
+	}
+	return 1;
+}
+
+uint32_t tdb_freelist_class(struct tdb_context *tdb, tdb_len_t rec_len)
+{
+	uint32_t cls = 0;
+
+	if (!(tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES)) {
+		return 0;
+	}
+
+	rec_len >>= 5;
+	while (rec_len != 0 && cls < TDB_FREELIST_CLASSES-1) {
+		rec_len >>= 1;
+		cls++;
+	}
+	return cls;
+}
+
+tdb_off_t tdb_freelist_head(struct tdb_context *tdb, uint32_t cls)
+{
+	if (cls == 0) {
+		return FREELIST_TOP;
+	}
+	return offsetof(struct tdb_header, freelist_classes) +
+		(cls-1) * sizeof(tdb_off_t);
+}
+
 /* read a freelist record and check for simple errors */
 int tdb_rec_free_read(struct tdb_context *tdb, tdb_off_t off, struct tdb_record *rec)
 {
@@ -276,6 +323,7 @@ static int check_merge_ptr_with_left_record(struct tdb_context *tdb,
  */
 int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec)
 {
+	tdb_off_t head;
 	int ret;
 
 	/* Allocation and tailer lock */
@@ -300,10 +348,11 @@ int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec)
 	/* Nothing to merge, prepend to free list */
 
 	rec->magic = TDB_FREE_MAGIC;
+	head = tdb_freelist_head(tdb, tdb_freelist_class(tdb, rec->rec_len));
 
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &rec->next) == -1 ||
+	if (tdb_ofs_read(tdb, head, &rec->next) == -1 ||
 	    tdb_rec_write(tdb, offset, rec) == -1 ||
-	    tdb_ofs_write(tdb, FREELIST_TOP, &offset) == -1) {
+	    tdb_ofs_write(tdb, head, &offset) == -1) {
 		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_free record write failed at offset=%u\n", offset));
 		goto fail;
 	}
@@ -319,6 +368,33 @@ done:
 }
 
 
+/*
+ * A free record on the list of class "cls" has been shortened, move it
+ * to the list matching its new size. rec->next is updated, the caller
+ * has to write the record.
+ */
+static int tdb_freelist_reclassify(struct tdb_context *tdb,
+				   tdb_off_t rec_ptr, struct tdb_record *rec,
+				   uint32_t cls, tdb_off_t last_ptr)
+{
+	uint32_t new_cls = tdb_freelist_class(tdb, rec->rec_len);
+	tdb_off_t head;
+
+	if (new_cls == cls) {
+		return 0;
+	}
+	head = tdb_freelist_head(tdb, new_cls);
+
+	if (tdb_ofs_write(tdb, last_ptr, &rec->next) == -1 ||
+	    tdb_ofs_read(tdb, head, &rec->next) == -1 ||
+	    tdb_ofs_write(tdb, head, &rec_ptr) == -1) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_freelist_reclassify: "
+			 "moving %u to class %u failed\n",
+			 rec_ptr, new_cls));
+		return -1;
+	}
+	return 0;
+}
 
 /*
    the core of tdb_allocate - called when we have decided which
@@ -330,7 +406,8 @@ done:
  */
 static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 				  tdb_len_t length, tdb_off_t rec_ptr,
-				  struct tdb_record *rec, tdb_off_t last_ptr)
+				  struct tdb_record *rec, tdb_off_t last_ptr,
+				  uint32_t cls)
 {
 #define MIN_REC_SIZE (sizeof(struct tdb_record) + sizeof(tdb_off_t) + 8)
 
@@ -352,6 +429,9 @@ static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 
 	/* we're going to just shorten the existing record */
 	rec->rec_len -= (length + sizeof(*rec));
+	if (tdb_freelist_reclassify(tdb, rec_ptr, rec, cls, last_ptr) == -1) {
+		return 0;
+	}
 	if (tdb_rec_write(tdb, rec_ptr, rec) == -1) {
 		return 0;
 	}
@@ -377,47 +457,43 @@ static tdb_off_t tdb_allocate_ofs(struct tdb_context *tdb,
 	return rec_ptr;
 }
 
-/* allocate some space from the free list. The offset returned points
-   to a unconnected tdb_record within the database with room for at
-   least length bytes of total data
+struct tdb_freelist_fit {
+	tdb_off_t rec_ptr, last_ptr;
+	tdb_len_t rec_len;
+	uint32_t cls;
+};
 
-   0 is returned if the space could not be allocated
+/*
+   walk the freelist of class "cls" looking for a record of at least
+   length bytes, merging free neighbours on the way. With first_fit
+   the first record that is big enough is taken, otherwise the best
+   fit. max_walk limits the number of records looked at, 0 means no
+   limit.
+
+   Returns -1 on error, 1 if the walk was cut short by max_walk
+   without a fit and 0 otherwise.
  */
-static tdb_off_t tdb_allocate_from_freelist(
-	struct tdb_context *tdb, tdb_len_t length, struct tdb_record *rec)
+static int tdb_freelist_search(struct tdb_context *tdb, uint32_t cls,
+			       tdb_len_t length, struct tdb_record *rec,
+			       bool first_fit, uint32_t max_walk,
+			       struct tdb_freelist_fit *bestfit,
+			       bool *merge_created_candidate)
 {
-	tdb_off_t rec_ptr, last_ptr, newrec_ptr;
+	tdb_off_t rec_ptr, last_ptr;
 	struct tdb_chainwalk_ctx chainwalk;
 	bool modified;
-	struct {
-		tdb_off_t rec_ptr, last_ptr;
-		tdb_len_t rec_len;
-	} bestfit;
 	float multiplier = 1.0;
-	bool merge_created_candidate;
-
-	/* over-allocate to reduce fragmentation */
-	length *= 1.25;
-
-	/* Extra bytes required for tailer */
-	length += sizeof(tdb_off_t);
-	length = TDB_ALIGN(length, TDB_ALIGNMENT);
+	uint32_t walked = 0;
 
- again:
-	merge_created_candidate = false;
-	last_ptr = FREELIST_TOP;
+	last_ptr = tdb_freelist_head(tdb, cls);
 
 	/* read in the freelist top */
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &rec_ptr) == -1)
-		return 0;
+	if (tdb_ofs_read(tdb, last_ptr, &rec_ptr) == -1)
+		return -1;
 
 	modified = false;
 	tdb_chainwalk_init(&chainwalk, rec_ptr);
 
-	bestfit.rec_ptr = 0;
-	bestfit.last_ptr = 0;
-	bestfit.rec_len = 0;
-
 	/*
 	   this is a best fit allocation strategy. Originally we used
 	   a first fit strategy, but it suffered from massive fragmentation
@@ -428,21 +504,25 @@ static tdb_off_t tdb_allocate_from_freelist(
 		tdb_off_t left_ptr;
 		struct tdb_record left_rec;
 
+		if (max_walk != 0 && walked++ == max_walk) {
+			return 1;
+		}
+
 		if (tdb_rec_free_read(tdb, rec_ptr, rec) == -1) {
-			return 0;
+			return -1;
 		}
 
 		ret = check_merge_with_left_record(tdb, rec_ptr, rec,
 						   &left_ptr, &left_rec);
 		if (ret == -1) {
-			return 0;
+			return -1;
 		}
 		if (ret == 1) {
 			/* merged */
 			rec_ptr = rec->next;
 			ret = tdb_ofs_write(tdb, last_ptr, &rec->next);
 			if (ret == -1) {
-				return 0;
+				return -1;
 			}
 
 			/*
@@ -466,12 +546,12 @@ static tdb_off_t tdb_allocate_from_freelist(
 			 * This way we can avoid expanding the database.
 			 */
 
-			if (bestfit.rec_ptr == left_ptr) {
-				bestfit.rec_len = left_rec.rec_len;
+			if (bestfit->rec_ptr == left_ptr) {
+				bestfit->rec_len = left_rec.rec_len;
 			}
 
 			if (left_rec.rec_len > length) {
-				merge_created_candidate = true;
+				*merge_created_candidate = true;
 			}
 
 			modified = true;
@@ -480,11 +560,15 @@ static tdb_off_t tdb_allocate_from_freelist(
 		}
 
 		if (rec->rec_len >= length) {
-			if (bestfit.rec_ptr == 0 ||
-			    rec->rec_len < bestfit.rec_len) {
-				bestfit.rec_len = rec->rec_len;
-				bestfit.rec_ptr = rec_ptr;
-				bestfit.last_ptr = last_ptr;
+			if (bestfit->rec_ptr == 0 ||
+			    rec->rec_len < bestfit->rec_len) {
+				bestfit->rec_len = rec->rec_len;
+				bestfit->rec_ptr = rec_ptr;
+				bestfit->last_ptr = last_ptr;
+				bestfit->cls = cls;
+			}
+			if (first_fit) {
+				break;
 			}
 		}
 
@@ -496,7 +580,7 @@ static tdb_off_t tdb_allocate_from_freelist(
 			bool ok;
 			ok = tdb_chainwalk_check(tdb, &chainwalk, rec_ptr);
 			if (!ok) {
-				return 0;
+				return -1;
 			}
 		}
 
@@ -504,8 +588,8 @@ static tdb_off_t tdb_allocate_from_freelist(
 		   stop searching if its also not too big. The
 		   definition of 'too big' changes as we scan
 		   through */
-		if (bestfit.rec_len > 0 &&
-		    bestfit.rec_len < length * multiplier) {
+		if (bestfit->rec_len > 0 &&
+		    bestfit->rec_len < length * multiplier) {
 			break;
 		}
 
@@ -516,13 +600,110 @@ static tdb_off_t tdb_allocate_from_freelist(
 		multiplier *= 1.05;
 	}
 
+	return 0;
+}
+
+/*
+ * With size classes only this many records of the request's own class
+ * are looked at before falling back to the larger classes
+ */
+#define TDB_FREELIST_CLASS_WALK 16
+
+/* allocate some space from the free list. The offset returned points
+   to a unconnected tdb_record within the database with room for at
+   least length bytes of total data
+
+   0 is returned if the space could not be allocated
+ */
+static tdb_off_t tdb_allocate_from_freelist(
+	struct tdb_context *tdb, tdb_len_t length, bool tight,
+	struct tdb_record *rec)
+{
+	tdb_off_t newrec_ptr;
+	struct tdb_freelist_fit bestfit;
+	bool merge_created_candidate;
+	uint32_t num_classes = tdb_freelist_num_classes(tdb);
+	uint32_t cls, i;
+	int ret;
+
+	if (!tight) {
+		/* over-allocate to reduce fragmentation */
+		length *= 1.25;
+	}
+
+	/* Extra bytes required for tailer */
+	length += sizeof(tdb_off_t);
+	length = TDB_ALIGN(length, TDB_ALIGNMENT);
+
+	cls = tdb_freelist_class(tdb, length);
+
+ again:
+	merge_created_candidate = false;
+
+	bestfit.rec_ptr = 0;
+	bestfit.last_ptr = 0;
+	bestfit.rec_len = 0;
+	bestfit.cls = 0;
+
+	/*
+	 * First a bounded best fit walk of our own class. Without size
+	 * classes this is the only (unbounded) walk of the one freelist.
+	 */
+	ret = tdb_freelist_search(tdb, cls, length, rec, false,
+				  (num_classes > 1) ? TDB_FREELIST_CLASS_WALK : 0,
+				  &bestfit, &merge_created_candidate);
+	if (ret == -1) {
+		return 0;
+	}
+
+	/*
+	 * Every record in a larger class fits, take the first one of
+	 * the smallest non-empty class.
+	 */
+	for (i = cls+1; (bestfit.rec_ptr == 0) && (i < num_classes); i++) {
+		int ret2;
+
+		ret2 = tdb_freelist_search(tdb, i, length, rec, true, 0,
+					   &bestfit, &merge_created_candidate);
+		if (ret2 == -1) {
+			return 0;
+		}
+	}
+
+	/*
+	 * Only if nothing else is available walk the rest of our own
+	 * class before expanding the file.
+	 */
+	if ((bestfit.rec_ptr == 0) && (ret == 1)) {
+		ret = tdb_freelist_search(tdb, cls, length, rec, false, 0,
+					  &bestfit, &merge_created_candidate);
+		if (ret == -1) {
+			return 0;
+		}
+	}
+
+	/*
+	 * Records grown by merging stay on the list they were on, look
+	 * for those in the smaller classes as a last resort.
+	 */
+	for (i = 0; (bestfit.rec_ptr == 0) && (i < cls); i++) {
+		int ret2;
+
+		ret2 = tdb_freelist_search(tdb, i, length, rec, true, 0,
+					   &bestfit, &merge_created_candidate);
+		if (ret2 == -1) {
+			return 0;
+		}
+	}
+
 	if (bestfit.rec_ptr != 0) {
 		if (tdb_rec_free_read(tdb, bestfit.rec_ptr, rec) == -1) {
 			return 0;
 		}
 
 		newrec_ptr = tdb_allocate_ofs(tdb, length, bestfit.rec_ptr,
-					      rec, bestfit.last_ptr);
+					      rec, bestfit.last_ptr,
+					      bestfit.cls);
 		return newrec_ptr;
 	}
 
@@ -530,6 +711,10 @@ static tdb_off_t tdb_allocate_from_freelist(
 		goto again;
 	}
 
+	if (tight) {
+		return 0;
+	}
+
 	/* we didn't find enough space. See if we can expand the
 	   database and if we can then try again */
 	if (tdb_expand(tdb, length + sizeof(*rec)) == 0)
@@ -619,7 +804,8 @@ tdb_off_t tdb_allocate(struct tdb_context *tdb, int hash, tdb_len_t length,
 			 */
 			tdb_purge_dead(tdb, hash);
 
-			ret = tdb_allocate_from_freelist(tdb, length, rec);
+			ret = tdb_allocate_from_freelist(tdb, length, false,
+							 rec);
 			tdb_unlock(tdb, -1, F_WRLCK);
 			return ret;
 		}
@@ -636,18 +822,59 @@ blocking_freelist_allocate:
 	 * tdb_delete happens concurrently with a traverse.
 	 */
 	tdb_purge_dead(tdb, hash);
-	ret = tdb_allocate_from_freelist(tdb, length, rec);
+	ret = tdb_allocate_from_freelist(tdb, length, false, rec);
 	tdb_unlock(tdb, -1, F_WRLCK);
 	return ret;
 }
 
+/*
+ * Allocate the new home of a record moved by tdb_repack_step(): no
+ * over-allocation, and never expand the file. The freelist must be
+ * locked.
+ */
+tdb_off_t tdb_allocate_tight(struct tdb_context *tdb, tdb_len_t length,
+			     struct tdb_record *rec)
+{
+	return tdb_allocate_from_freelist(tdb, length, true, rec);
+}
+
+/*
+ * Is the record at rec_ptr directly next to a free record? Moving it
+ * away lets the free space around it merge. The freelist must be
+ * locked.
+ */
+bool tdb_rec_borders_free(struct tdb_context *tdb, tdb_off_t rec_ptr,
+			  const struct tdb_record *rec)
+{
+	struct tdb_record neighbour;
+	tdb_off_t left_ptr, right_ptr;
+	int ret;
+
+	ret = read_record_on_left(tdb, rec_ptr, &left_ptr, &neighbour);
+	if ((ret == 0) && (neighbour.magic == TDB_FREE_MAGIC)) {
+		return true;
+	}
+
+	right_ptr = rec_ptr + sizeof(*rec) + rec->rec_len;
+	if (tdb_oob(tdb, right_ptr, sizeof(neighbour), 1) != 0) {
+		return false;
+	}
+	ret = tdb->methods->tdb_read(tdb, right_ptr, &neighbour,
+				     sizeof(neighbour), DOCONV());
+	if (ret == -1) {
+		return false;
+	}
+	return (neighbour.magic == TDB_FREE_MAGIC);
+}
+
 /**
  * Merge adjacent records in the freelist.
  */
-static int tdb_freelist_merge_adjacent(struct tdb_context *tdb,
-				       int *count_records, int *count_merged)
+int tdb_freelist_merge_adjacent(struct tdb_context *tdb,
+				int *count_records, int *count_merged)
 {
 	tdb_off_t cur, next;
+	uint32_t cls;
 	int count = 0;
 	int merged = 0;
 	int ret;
@@ -657,32 +884,41 @@ static int tdb_freelist_merge_adjacent(struct tdb_context *tdb,
 		return -1;
 	}
 
-	cur = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, cur, &next) == 0 && next != 0) {
-		tdb_off_t next2;
-
-		count++;
+	for (cls = 0; cls < tdb_freelist_num_classes(tdb); cls++) {
+		cur = tdb_freelist_head(tdb, cls);
+		while (tdb_ofs_read(tdb, cur, &next) == 0 && next != 0) {
+			tdb_off_t next2;
 
-		ret = check_merge_ptr_with_left_record(tdb, next, &next2);
-		if (ret == -1) {
-			goto done;
-		}
-		if (ret == 1) {
-			/*
-			 * merged:
-			 * now let cur->next point to next2 instead of next
-			 */
+			count++;
 
-			ret = tdb_ofs_write(tdb, cur, &next2);
-			if (ret != 0) {
+			ret = check_merge_ptr_with_left_record(tdb, next,
+							       &next2);
+			if (ret == -1) {
 				goto done;
 			}
+			if (ret == 1) {
+				/*
+				 * merged:
+				 * now let cur->next point to next2
+				 * instead of next
+				 */
+
+				ret = tdb_ofs_write(tdb, cur, &next2);
+				if (ret != 0) {
+					goto done;
+				}
+
+				merged++;
+
+				/*
+				 * Stay on cur, next2 might be mergeable
+				 * as well, and it might be 0.
+				 */
+				continue;
+			}
 
-			next = next2;
-			merged++;
+			cur = next;
 		}
-
-		cur = next;
 	}
 
 	if (count_records != NULL) {
@@ -706,15 +942,18 @@ done:
 static int tdb_freelist_size_no_merge(struct tdb_context *tdb)
 {
 	tdb_off_t ptr;
+	uint32_t cls;
 	int count=0;
 
 	if (tdb_lock(tdb, -1, F_RDLCK) == -1) {
 		return -1;
 	}
 
-	ptr = FREELIST_TOP;
-	while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
-		count++;
+	for (cls = 0; cls < tdb_freelist_num_classes(tdb); cls++) {
+		ptr = tdb_freelist_head(tdb, cls);
+		while (tdb_ofs_read(tdb, ptr, &ptr) == 0 && ptr != 0) {
+			count++;
+		}
 	}
 
 	tdb_unlock(tdb, -1, F_RDLCK);
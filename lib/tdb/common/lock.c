@@ -362,6 +362,20 @@ int tdb_nest_lock(struct tdb_context *tdb, uint32_t offset, int ltype,
 				if (ret != 0) {
 					return ret;
 				}
+			} else if (tdb_have_mutex_rwlocks(tdb) &&
+				   !(flags & TDB_LOCK_MARK_ONLY)) {
+				int ret;
+				/*
+				 * Shared chain mutexes: wait for
+				 * the other readers to go away.
+				 */
+
+				ret = tdb_mutex_upgrade(
+					tdb, offset, flags & TDB_LOCK_WAIT);
+				if (ret != 0) {
+					tdb->ecode = TDB_ERR_LOCK;
+					return ret;
+				}
 			}
 			new_lck->ltype = F_WRLCK;
 		}
@@ -885,6 +899,35 @@ _PUBLIC_ int tdb_chainlock_unmark(struct tdb_context *tdb, TDB_DATA key)
 			       F_WRLCK, true);
 }
 
+/*
+ * Lock the chain mutex of a key for the calling thread, without
+ * recording the lock in the tdb_context. Only available for
+ * TDB_MUTEX_LOCKING databases; the tdb_context is only read, so
+ * another thread can take the lock while the owner of the
+ * tdb_context uses it. The owner can then tdb_chainlock_mark() the
+ * chain and operate on it until the locking thread calls
+ * tdb_chainunlock_unowned().
+ */
+_PUBLIC_ int tdb_chainlock_unowned(struct tdb_context *tdb, TDB_DATA key)
+{
+	if (!tdb_have_mutexes(tdb)) {
+		errno = ENOSYS;
+		return -1;
+	}
+	return tdb_mutex_chainlock_unowned(
+		tdb, lock_offset(BUCKET(tdb->hash_fn(&key))));
+}
+
+_PUBLIC_ int tdb_chainunlock_unowned(struct tdb_context *tdb, TDB_DATA key)
+{
+	if (!tdb_have_mutexes(tdb)) {
+		errno = ENOSYS;
+		return -1;
+	}
+	return tdb_mutex_chainunlock_unowned(
+		tdb, lock_offset(BUCKET(tdb->hash_fn(&key))));
+}
+
 _PUBLIC_ int tdb_chainunlock(struct tdb_context *tdb, TDB_DATA key)
 {
 	tdb_trace_1rec(tdb, "tdb_chainunlock", key);
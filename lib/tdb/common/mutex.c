@@ -75,11 +75,80 @@ struct tdb_mutexes {
 	pthread_mutex_t hashchains[1];
 };
 
+/*
+ * With TDB_FEATURE_FLAG_MUTEX_RWLOCK the chain mutexes are followed by
+ * a table of reader slots and a reader count per chain.
+ *
+ * A process wanting a chain read lock locks the chain mutex, checks
+ * the allrecord lock as usual, claims a free reader slot by locking
+ * its robust slot mutex, records the chain in the slot and drops the
+ * chain mutex again. Any number of readers can share a chain this
+ * way. A writer locks the chain mutex and then waits until no other
+ * live reader slot references the chain. If a reader dies, its slot
+ * mutex returns EOWNERDEAD to the next writer looking at it, which
+ * then cleans up the slot, so a dead reader can't wedge a chain.
+ *
+ * The per chain reader count is only a hint that allows writers to
+ * skip the slot scan: It is incremented before a slot is published
+ * and decremented after it is cleared, so it is never lower than the
+ * number of readers on that chain.
+ *
+ * If all reader slots are busy, a reader just keeps the chain mutex
+ * and behaves like a writer.
+ */
+
+#define TDB_MUTEX_READER_SLOTS 256
+
+struct tdb_mutex_reader {
+	pid_t pid;
+	uint32_t chain;		/* 0 while not published */
+	uint32_t upgrading;	/* waiting for the chain mutex */
+};
+
+struct tdb_mutex_rwlocks {
+	pthread_mutex_t slot_mutexes[TDB_MUTEX_READER_SLOTS];
+	struct tdb_mutex_reader readers[TDB_MUTEX_READER_SLOTS];
+
+	/*
+	 * Index 0 (the freelist) is unused, followed by
+	 * one reader count per hashchain.
+	 */
+	uint32_t num_readers[1];
+};
+
 bool tdb_have_mutexes(struct tdb_context *tdb)
 {
 	return ((tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX) != 0);
 }
 
+bool tdb_have_mutex_rwlocks(struct tdb_context *tdb)
+{
+	uint32_t flags = TDB_FEATURE_FLAG_MUTEX|TDB_FEATURE_FLAG_MUTEX_RWLOCK;
+
+	return ((tdb->feature_flags & flags) == flags);
+}
+
+bool tdb_mutex_rwlock_supported(void)
+{
+#if defined(HAVE___ATOMIC_ADD_FETCH) && defined(HAVE___ATOMIC_ADD_LOAD)
+	return true;
+#else
+	return false;
+#endif
+}
+
+static size_t tdb_mutex_rwlocks_ofs(struct tdb_context *tdb)
+{
+	return offsetof(struct tdb_mutexes, hashchains) +
+		(tdb->hash_size + 1) * sizeof(pthread_mutex_t);
+}
+
+static struct tdb_mutex_rwlocks *tdb_mutex_rwlocks(struct tdb_context *tdb)
+{
+	return (struct tdb_mutex_rwlocks *)
+		((char *)tdb->mutexes + tdb_mutex_rwlocks_ofs(tdb));
+}
+
 size_t tdb_mutex_size(struct tdb_context *tdb)
 {
 	size_t mutex_size;
@@ -91,6 +160,12 @@ size_t tdb_mutex_size(struct tdb_context *tdb)
 	mutex_size = sizeof(struct tdb_mutexes);
 	mutex_size += tdb->hash_size * sizeof(pthread_mutex_t);
 
+	if (tdb_have_mutex_rwlocks(tdb)) {
+		mutex_size = tdb_mutex_rwlocks_ofs(tdb);
+		mutex_size += sizeof(struct tdb_mutex_rwlocks);
+		mutex_size += tdb->hash_size * sizeof(uint32_t);
+	}
+
 	return TDB_ALIGN(mutex_size, tdb->page_size);
 }
 
@@ -216,8 +291,292 @@ static int allrecord_mutex_lock(struct tdb_mutexes *m, bool waitflag)
 	return pthread_mutex_consistent(&m->allrecord_mutex);
 }
 
-bool tdb_mutex_lock(struct tdb_context *tdb, int rw, off_t off, off_t len,
-		    bool waitflag, int *pret)
+#if defined(HAVE___ATOMIC_ADD_FETCH) && defined(HAVE___ATOMIC_ADD_LOAD)
+#define tdb_atomic_load(p) __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define tdb_atomic_store(p, v) __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define tdb_atomic_inc(p) __atomic_add_fetch((p), 1, __ATOMIC_SEQ_CST)
+#define tdb_atomic_dec(p) __atomic_sub_fetch((p), 1, __ATOMIC_SEQ_CST)
+#else
+/*
+ * Never used: tdb_mutex_rwlock_supported() makes tdb_open_ex() refuse
+ * rwlock tdbs.
+ */
+#define tdb_atomic_load(p) (*(p))
+#define tdb_atomic_store(p, v) (*(p) = (v))
+#define tdb_atomic_inc(p) (++(*(p)))
+#define tdb_atomic_dec(p) (--(*(p)))
+#endif
+
+static unsigned tdb_mutex_reader_start(pid_t pid, unsigned idx)
+{
+	return ((uint32_t)pid * 2654435761U + idx) % TDB_MUTEX_READER_SLOTS;
+}
+
+/*
+ * Find the slot through which we hold a read lock on chain "idx"
+ */
+static int tdb_mutex_reader_find(struct tdb_context *tdb, unsigned idx)
+{
+	struct tdb_mutex_rwlocks *rw = tdb_mutex_rwlocks(tdb);
+	pid_t pid = getpid();
+	unsigned start = tdb_mutex_reader_start(pid, idx);
+	unsigned i;
+
+	for (i=0; i<TDB_MUTEX_READER_SLOTS; i++) {
+		unsigned s = (start + i) % TDB_MUTEX_READER_SLOTS;
+		struct tdb_mutex_reader *r = &rw->readers[s];
+
+		if ((tdb_atomic_load(&r->chain) == idx) &&
+		    (tdb_atomic_load(&r->pid) == pid)) {
+			return s;
+		}
+	}
+
+	return -1;
+}
+
+static void tdb_mutex_reader_clear(struct tdb_mutex_rwlocks *rw, int s)
+{
+	struct tdb_mutex_reader *r = &rw->readers[s];
+	uint32_t chain = tdb_atomic_load(&r->chain);
+
+	tdb_atomic_store(&r->chain, 0);
+	tdb_atomic_store(&r->upgrading, 0);
+	tdb_atomic_store(&r->pid, 0);
+
+	if (chain != 0) {
+		tdb_atomic_dec(&rw->num_readers[chain]);
+	}
+}
+
+static int tdb_mutex_reader_release(struct tdb_context *tdb, int s)
+{
+	struct tdb_mutex_rwlocks *rw = tdb_mutex_rwlocks(tdb);
+	struct tdb_mutex_reader *r = &rw->readers[s];
+	uint32_t chain = tdb_atomic_load(&r->chain);
+	int ret;
+
+	tdb_atomic_store(&r->chain, 0);
+	tdb_atomic_store(&r->upgrading, 0);
+	tdb_atomic_store(&r->pid, 0);
+
+	ret = pthread_mutex_unlock(&rw->slot_mutexes[s]);
+
+	/*
+	 * Decrement after the slot is gone, the count must never be
+	 * lower than the number of published slots.
+	 */
+	tdb_atomic_dec(&rw->num_readers[chain]);
+
+	return ret;
+}
+
+/*
+ * Called with the chain mutex held: Turn it into a shared lock by
+ * claiming a reader slot. If all slots are taken we keep the chain
+ * mutex and our read lock is exclusive.
+ */
+static int tdb_mutex_reader_enter(struct tdb_context *tdb, unsigned idx)
+{
+	struct tdb_mutexes *m = tdb->mutexes;
+	struct tdb_mutex_rwlocks *rw = tdb_mutex_rwlocks(tdb);
+	pid_t pid = getpid();
+	unsigned start = tdb_mutex_reader_start(pid, idx);
+	unsigned i;
+	int ret;
+
+	tdb_atomic_inc(&rw->num_readers[idx]);
+
+	for (i=0; i<TDB_MUTEX_READER_SLOTS; i++) {
+		unsigned s = (start + i) % TDB_MUTEX_READER_SLOTS;
+		struct tdb_mutex_reader *r = &rw->readers[s];
+
+		ret = pthread_mutex_trylock(&rw->slot_mutexes[s]);
+		if (ret == EOWNERDEAD) {
+			/*
+			 * A dead reader nobody cleaned up yet
+			 */
+			tdb_mutex_reader_clear(rw, s);
+			ret = pthread_mutex_consistent(&rw->slot_mutexes[s]);
+		}
+		if (ret != 0) {
+			continue;
+		}
+
+		tdb_atomic_store(&r->pid, pid);
+		tdb_atomic_store(&r->upgrading, 0);
+		tdb_atomic_store(&r->chain, idx);
+
+		ret = pthread_mutex_unlock(&m->hashchains[idx]);
+		if (ret != 0) {
+			TDB_LOG((tdb, TDB_DEBUG_FATAL, "pthread_mutex_unlock"
+				 "(chain_mutex) failed: %s\n", strerror(ret)));
+			tdb_mutex_reader_release(tdb, s);
+			return ret;
+		}
+		return 0;
+	}
+
+	tdb_atomic_dec(&rw->num_readers[idx]);
+	return 0;
+}
+
+/*
+ * Count the live readers on chain "idx" other than ourselves. Dead
+ * readers are cleaned up on the way. Called with the chain mutex
+ * held, so no new reader can show up for this chain.
+ */
+static unsigned tdb_mutex_chain_readers(struct tdb_context *tdb,
+					unsigned idx,
+					bool *upgrader)
+{
+	struct tdb_mutex_rwlocks *rw = tdb_mutex_rwlocks(tdb);
+	pid_t pid = getpid();
+	unsigned num = 0;
+	unsigned s;
+
+	*upgrader = false;
+
+	if (tdb_atomic_load(&rw->num_readers[idx]) == 0) {
+		return 0;
+	}
+
+	for (s=0; s<TDB_MUTEX_READER_SLOTS; s++) {
+		struct tdb_mutex_reader *r = &rw->readers[s];
+		int ret;
+
+		if (tdb_atomic_load(&r->chain) != idx) {
+			continue;
+		}
+		if (tdb_atomic_load(&r->pid) == pid) {
+			continue;
+		}
+
+		ret = pthread_mutex_trylock(&rw->slot_mutexes[s]);
+		if (ret == EBUSY) {
+			num += 1;
+			if (tdb_atomic_load(&r->upgrading)) {
+				*upgrader = true;
+			}
+			continue;
+		}
+		if (ret == EOWNERDEAD) {
+			tdb_mutex_reader_clear(rw, s);
+			pthread_mutex_consistent(&rw->slot_mutexes[s]);
+		}
+		if ((ret == 0) || (ret == EOWNERDEAD)) {
+			/*
+			 * Released behind our back or cleaned up
+			 */
+			pthread_mutex_unlock(&rw->slot_mutexes[s]);
+		}
+	}
+
+	return num;
+}
+
+/*
+ * Called with the chain mutex held, wait for the readers to go
+ * away. EDEADLK means a reader is waiting for our chain mutex to
+ * upgrade its lock.
+ */
+static int tdb_mutex_wait_readers(struct tdb_context *tdb, unsigned idx,
+				  bool waitflag)
+{
+	unsigned count;
+
+	for (count = 0; ; count++) {
+		bool upgrader;
+		unsigned num;
+
+		num = tdb_mutex_chain_readers(tdb, idx, &upgrader);
+		if (num == 0) {
+			return 0;
+		}
+		if (upgrader) {
+			return EDEADLK;
+		}
+		if (!waitflag) {
+			return EAGAIN;
+		}
+		if (count < 100) {
+			sched_yield();
+		} else {
+			usleep(1000);
+		}
+	}
+}
+
+int tdb_mutex_upgrade(struct tdb_context *tdb, off_t off, bool waitflag)
+{
+	struct tdb_mutexes *m = tdb->mutexes;
+	pthread_mutex_t *chain;
+	struct tdb_mutex_rwlocks *rw;
+	unsigned idx;
+	int s;
+	int ret;
+
+	if (!tdb_mutex_index(tdb, off, 1, &idx)) {
+		return 0;
+	}
+	if ((idx == 0) || !tdb_have_mutex_rwlocks(tdb)) {
+		return 0;
+	}
+	chain = &m->hashchains[idx];
+	rw = tdb_mutex_rwlocks(tdb);
+
+	s = tdb_mutex_reader_find(tdb, idx);
+	if (s == -1) {
+		/*
+		 * We did not get a reader slot and hold the chain
+		 * mutex already.
+		 */
+		ret = tdb_mutex_wait_readers(tdb, idx, waitflag);
+		if (ret != 0) {
+			errno = ret;
+			return -1;
+		}
+		return 0;
+	}
+
+	/*
+	 * Keep our slot while waiting for the chain mutex, so the
+	 * upgrade does not open a window for writers. The upgrading
+	 * flag makes a writer holding the chain mutex and waiting for
+	 * us back off.
+	 */
+	tdb_atomic_store(&rw->readers[s].upgrading, 1);
+
+	ret = chain_mutex_lock(chain, waitflag);
+	if (ret == EBUSY) {
+		ret = EAGAIN;
+	}
+	if (ret == 0) {
+		ret = tdb_mutex_wait_readers(tdb, idx, waitflag);
+		if (ret == 0) {
+			ret = tdb_mutex_reader_release(tdb, s);
+			if (ret != 0) {
+				TDB_LOG((tdb, TDB_DEBUG_FATAL,
+					 "pthread_mutex_unlock"
+					 "(slot_mutex) failed: %s\n",
+					 strerror(ret)));
+			}
+			return 0;
+		}
+		pthread_mutex_unlock(chain);
+	}
+
+	/*
+	 * We still own the read lock
+	 */
+	tdb_atomic_store(&rw->readers[s].upgrading, 0);
+	errno = ret;
+	return -1;
+}
+
+static bool tdb_mutex_lock_internal(struct tdb_context *tdb, int rw,
+				    off_t off, off_t len, bool waitflag,
+				    bool have_chainlocks, int *pret)
 {
 	struct tdb_mutexes *m = tdb->mutexes;
 	pthread_mutex_t *chain;
@@ -250,7 +609,7 @@ again:
 		return true;
 	}
 
-	if (tdb_have_mutex_chainlocks(tdb)) {
+	if (have_chainlocks) {
 		/*
 		 * We can only check the allrecord lock once. If we do it with
 		 * one chain mutex locked, we will deadlock with the allrecord
@@ -268,8 +627,7 @@ again:
 		 * chain lock.
 		 */
 
-		*pret = 0;
-		return true;
+		goto locked;
 	}
 
 	/*
@@ -293,8 +651,7 @@ again:
 	}
 
 	if (allrecord_ok) {
-		*pret = 0;
-		return true;
+		goto locked;
 	}
 
 	ret = pthread_mutex_unlock(chain);
@@ -326,11 +683,91 @@ again:
 	}
 	goto again;
 
+locked:
+	if (!tdb_have_mutex_rwlocks(tdb)) {
+		*pret = 0;
+		return true;
+	}
+
+	if (rw == F_RDLCK) {
+		ret = tdb_mutex_reader_enter(tdb, idx);
+		if (ret != 0) {
+			errno = ret;
+			goto fail;
+		}
+		*pret = 0;
+		return true;
+	}
+
+	ret = tdb_mutex_wait_readers(tdb, idx, waitflag);
+	if (ret == 0) {
+		*pret = 0;
+		return true;
+	}
+
+	pthread_mutex_unlock(chain);
+
+	if (waitflag && (ret == EDEADLK)) {
+		/*
+		 * A reader waits for the chain mutex to upgrade its
+		 * lock, let it go first.
+		 */
+		sched_yield();
+		goto again;
+	}
+	if (ret == EDEADLK) {
+		ret = EAGAIN;
+	}
+	errno = ret;
+
 fail:
 	*pret = -1;
 	return true;
 }
 
+bool tdb_mutex_lock(struct tdb_context *tdb, int rw, off_t off, off_t len,
+		    bool waitflag, int *pret)
+{
+	return tdb_mutex_lock_internal(tdb, rw, off, len, waitflag,
+				       tdb_have_mutex_chainlocks(tdb), pret);
+}
+
+/*
+ * Lock a chain mutex for the calling thread, without recording the
+ * lock in the tdb_context. This only reads the mutex area, so it can
+ * be called from a thread other than the one using the tdb_context.
+ */
+int tdb_mutex_chainlock_unowned(struct tdb_context *tdb, off_t off)
+{
+	int ret;
+	bool ok;
+
+	ok = tdb_mutex_lock_internal(tdb, F_WRLCK, off, 1, true, false, &ret);
+	if (!ok) {
+		errno = EINVAL;
+		return -1;
+	}
+	return ret;
+}
+
+int tdb_mutex_chainunlock_unowned(struct tdb_context *tdb, off_t off)
+{
+	unsigned idx;
+	int ret;
+
+	if (!tdb_mutex_index(tdb, off, 1, &idx) || (idx == 0)) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ret = pthread_mutex_unlock(&tdb->mutexes->hashchains[idx]);
+	if (ret != 0) {
+		errno = ret;
+		return -1;
+	}
+	return 0;
+}
+
 bool tdb_mutex_unlock(struct tdb_context *tdb, int rw, off_t off, off_t len,
 		      int *pret)
 {
@@ -344,6 +781,25 @@ bool tdb_mutex_unlock(struct tdb_context *tdb, int rw, off_t off, off_t len,
 	}
 	chain = &m->hashchains[idx];
 
+	if ((rw == F_RDLCK) && (idx != 0) && tdb_have_mutex_rwlocks(tdb)) {
+		int s = tdb_mutex_reader_find(tdb, idx);
+
+		if (s != -1) {
+			ret = tdb_mutex_reader_release(tdb, s);
+			if (ret == 0) {
+				*pret = 0;
+				return true;
+			}
+			errno = ret;
+			*pret = -1;
+			return true;
+		}
+
+		/*
+		 * No reader slot, we hold the chain mutex
+		 */
+	}
+
 	ret = pthread_mutex_unlock(chain);
 	if (ret == 0) {
 		*pret = 0;
@@ -414,6 +870,26 @@ int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
 			goto fail_unroll_allrecord_lock;
 		}
 
+		if ((ltype == F_WRLCK) && tdb_have_mutex_rwlocks(tdb)) {
+			ret = tdb_mutex_wait_readers(tdb, i+1, waitflag);
+		}
+
+		if (ret == EDEADLK) {
+			/*
+			 * A reader wants to upgrade, retry this chain
+			 * once it is done.
+			 */
+			pthread_mutex_unlock(chain);
+			sched_yield();
+			i -= 1;
+			continue;
+		}
+		if (ret != 0) {
+			pthread_mutex_unlock(chain);
+			errno = ret;
+			goto fail_unroll_allrecord_lock;
+		}
+
 		ret = pthread_mutex_unlock(chain);
 		if (ret != 0) {
 			TDB_LOG((tdb, TDB_DEBUG_FATAL, "pthread_mutex_unlock"
@@ -480,6 +956,16 @@ int tdb_mutex_allrecord_upgrade(struct tdb_context *tdb)
 			goto fail_unroll_allrecord_lock;
 		}
 
+		if (tdb_have_mutex_rwlocks(tdb)) {
+			ret = tdb_mutex_wait_readers(tdb, i+1, true);
+			if (ret == EDEADLK) {
+				pthread_mutex_unlock(chain);
+				sched_yield();
+				i -= 1;
+				continue;
+			}
+		}
+
 		ret = pthread_mutex_unlock(chain);
 		if (ret != 0) {
 			TDB_LOG((tdb, TDB_DEBUG_FATAL, "pthread_mutex_unlock"
@@ -594,6 +1080,21 @@ int tdb_mutex_init(struct tdb_context *tdb)
 		}
 	}
 
+	if (tdb_have_mutex_rwlocks(tdb)) {
+		struct tdb_mutex_rwlocks *rw = tdb_mutex_rwlocks(tdb);
+
+		memset(rw->readers, 0, sizeof(rw->readers));
+		memset(rw->num_readers, 0,
+		       (tdb->hash_size+1) * sizeof(uint32_t));
+
+		for (i=0; i<TDB_MUTEX_READER_SLOTS; i++) {
+			ret = pthread_mutex_init(&rw->slot_mutexes[i], &ma);
+			if (ret != 0) {
+				goto fail;
+			}
+		}
+	}
+
 	m->allrecord_lock = F_UNLCK;
 
 	ret = pthread_mutex_init(&m->allrecord_mutex, &ma);
@@ -1029,6 +1530,21 @@ bool tdb_have_mutexes(struct tdb_context *tdb)
 	return false;
 }
 
+bool tdb_have_mutex_rwlocks(struct tdb_context *tdb)
+{
+	return false;
+}
+
+bool tdb_mutex_rwlock_supported(void)
+{
+	return false;
+}
+
+int tdb_mutex_upgrade(struct tdb_context *tdb, off_t off, bool waitflag)
+{
+	return 0;
+}
+
 int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
 			     enum tdb_lock_flags flags)
 {
@@ -1041,6 +1557,18 @@ int tdb_mutex_allrecord_unlock(struct tdb_context *tdb)
 	return -1;
 }
 
+int tdb_mutex_chainlock_unowned(struct tdb_context *tdb, off_t off)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
+int tdb_mutex_chainunlock_unowned(struct tdb_context *tdb, off_t off)
+{
+	errno = ENOSYS;
+	return -1;
+}
+
 int tdb_mutex_allrecord_upgrade(struct tdb_context *tdb)
 {
 	tdb->ecode = TDB_ERR_LOCK;
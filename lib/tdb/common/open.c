@@ -84,6 +84,22 @@ static int tdb_new_database(struct tdb_context *tdb, struct tdb_header *header,
 	if (tdb->flags & TDB_MUTEX_LOCKING) {
 		newdb->feature_flags |= TDB_FEATURE_FLAG_MUTEX;
 	}
+	if (tdb->flags & TDB_MUTEX_RWLOCK) {
+		newdb->feature_flags |= TDB_FEATURE_FLAG_MUTEX_RWLOCK;
+	}
+	if (tdb->flags & TDB_SEGREGATED_FREELIST) {
+		newdb->feature_flags |= TDB_FEATURE_FLAG_FREELIST_CLASSES;
+	}
+	if (tdb->flags & TDB_RECOVERY_CHECKSUM) {
+		newdb->feature_flags |= TDB_FEATURE_FLAG_RECOVERY_CSUM;
+	}
+	/*
+	 * The feature flag makes older tdb versions refuse the file,
+	 * they would not find the hash function for it.
+	 */
+	if (tdb->hash_fn == tdb_fast_hash) {
+		newdb->feature_flags |= TDB_FEATURE_FLAG_FAST_HASH;
+	}
 
 	/*
 	 * If we have any features we add the FEATURE_FLAG_MAGIC, overwriting the
@@ -246,6 +262,14 @@ static bool tdb_mutex_open_ok(struct tdb_context *tdb,
 		return false;
 	}
 
+	if ((tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX_RWLOCK) &&
+	    !tdb_mutex_rwlock_supported()) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_mutex_open_ok[%s]: "
+			 "Shared chain mutexes are not supported\n",
+			 tdb->name));
+		return false;
+	}
+
 	if (tdb_mutex_size(tdb) != header->mutex_size) {
 		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_mutex_open_ok[%s]: "
 			 "Mutex size changed from %"PRIu32" to %zu\n.",
@@ -338,7 +362,9 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		hash_alg = "the user defined";
 	} else {
 		/* This controls what we use when creating a tdb. */
-		if (tdb->flags & TDB_INCOMPATIBLE_HASH) {
+		if (tdb->flags & TDB_FAST_HASH) {
+			tdb->hash_fn = tdb_fast_hash;
+		} else if (tdb->flags & TDB_INCOMPATIBLE_HASH) {
 			tdb->hash_fn = tdb_jenkins_hash;
 		} else {
 			tdb->hash_fn = tdb_old_hash;
@@ -367,7 +393,8 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		tdb->read_only = 1;
 		/* read only databases don't do locking or clear if first */
 		tdb->flags |= TDB_NOLOCK;
-		tdb->flags &= ~(TDB_CLEAR_IF_FIRST|TDB_MUTEX_LOCKING);
+		tdb->flags &= ~(TDB_CLEAR_IF_FIRST|TDB_MUTEX_LOCKING|
+				TDB_MUTEX_RWLOCK);
 	}
 
 	if ((tdb->flags & TDB_ALLOW_NESTING) &&
@@ -429,6 +456,24 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		}
 	}
 
+	if (tdb->flags & TDB_MUTEX_RWLOCK) {
+		if (!(tdb->flags & TDB_MUTEX_LOCKING)) {
+			TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: "
+				"invalid flags for %s - TDB_MUTEX_RWLOCK "
+				"requires TDB_MUTEX_LOCKING\n", name));
+			errno = EINVAL;
+			goto fail;
+		}
+
+		if (!tdb_mutex_rwlock_supported()) {
+			TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_open_ex: "
+				"invalid flags for %s - TDB_MUTEX_RWLOCK "
+				"not supported\n", name));
+			errno = ENOSYS;
+			goto fail;
+		}
+	}
+
 	if (getenv("TDB_NO_FSYNC")) {
 		tdb->flags |= TDB_NOSYNC;
 	}
@@ -625,10 +670,25 @@ _PUBLIC_ struct tdb_context *tdb_open_ex(const char *name, int hash_size, int td
 		}
 	}
 
+	if (hash_fn == NULL) {
+		/*
+		 * TDB_FAST_HASH only matters when creating the file,
+		 * existing files say themselves which hash they use.
+		 */
+		if (tdb->feature_flags & TDB_FEATURE_FLAG_FAST_HASH) {
+			tdb->hash_fn = tdb_fast_hash;
+			hash_alg = "the fast";
+		} else if (tdb->hash_fn == tdb_fast_hash) {
+			tdb->hash_fn = tdb_jenkins_hash;
+		}
+	}
+
 	if ((header.magic1_hash == 0) && (header.magic2_hash == 0)) {
 		/* older TDB without magic hash references */
 		tdb->hash_fn = tdb_old_hash;
-	} else if (!check_header_hash(tdb, &header, !hash_fn,
+	} else if (!check_header_hash(tdb, &header,
+				      (hash_fn == NULL) &&
+				      (tdb->hash_fn != tdb_fast_hash),
 				      &magic1, &magic2)) {
 		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_open_ex: "
 			 "%s was not created with %s hash function we are using\n"
@@ -248,13 +248,19 @@ _PUBLIC_ int tdb_rescue(struct tdb_context *tdb,
 		}
 	}
 
-	/* Walk hash chains to positive vet. */
-	for (h = 0; h < 1+tdb->hash_size; h++) {
+	/* Walk hash chains to positive vet, then the other freelists. */
+	for (h = 0; h < tdb->hash_size + tdb_freelist_num_classes(tdb); h++) {
 		bool slow_chase = false;
-		tdb_off_t slow_off = FREELIST_TOP + h*sizeof(tdb_off_t);
+		bool is_free = (h == 0) || (h > tdb->hash_size);
+		tdb_off_t slow_off;
 
-		if (tdb_ofs_read(tdb, FREELIST_TOP + h*sizeof(tdb_off_t),
-				 &off) == -1)
+		if (h > tdb->hash_size) {
+			slow_off = tdb_freelist_head(tdb, h - tdb->hash_size);
+		} else {
+			slow_off = FREELIST_TOP + h*sizeof(tdb_off_t);
+		}
+
+		if (tdb_ofs_read(tdb, slow_off, &off) == -1)
 			continue;
 
 		while (off && off != slow_off) {
@@ -264,7 +270,7 @@ _PUBLIC_ int tdb_rescue(struct tdb_context *tdb,
 			}
 
 			/* 0 is the free list, rest are hash chains. */
-			if (h == 0) {
+			if (is_free) {
 				/* Don't mark garbage as free. */
 				if (rec.magic != TDB_FREE_MAGIC) {
 					break;
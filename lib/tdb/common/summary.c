@@ -31,8 +31,11 @@
 	"Smallest/average/largest dead records: %zu/%zu/%zu\n" \
 	"Number of free records: %zu\n" \
 	"Smallest/average/largest free records: %zu/%zu/%zu\n" \
+	"%s" \
 	"Number of hash chains: %zu\n" \
 	"Smallest/average/largest hash chains: %zu/%zu/%zu\n" \
+	"Hash chain length distribution 0/1/2-3/4-7/8-15/16-31/32+: " \
+	"%zu/%zu/%zu/%zu/%zu/%zu/%zu\n" \
 	"Number of uncoalesced records: %zu\n" \
 	"Smallest/average/largest uncoalesced runs: %zu/%zu/%zu\n" \
 	"Percentage keys/data/padding/free/dead/rechdrs&tailers/hashes: %.0f/%.0f/%.0f/%.0f/%.0f/%.0f/%.0f\n"
@@ -69,6 +72,20 @@ static size_t tally_mean(const struct tally *tally)
 	return tally->total / tally->num;
 }
 
+#define CHAIN_HIST_BUCKETS 7
+
+/* 0, 1, 2-3, 4-7, ... 32 and more */
+static void chain_hist_add(size_t *hist, size_t len)
+{
+	size_t i = 0;
+
+	while ((len > 0) && (i < CHAIN_HIST_BUCKETS - 1)) {
+		len >>= 1;
+		i++;
+	}
+	hist[i]++;
+}
+
 static size_t get_hash_length(struct tdb_context *tdb, unsigned int i)
 {
 	tdb_off_t rec_ptr;
@@ -96,11 +113,80 @@ static size_t get_hash_length(struct tdb_context *tdb, unsigned int i)
 	return count;
 }
 
+/*
+ * Walk one size class freelist, returns false if it's broken
+ */
+static bool get_freelist_class(struct tdb_context *tdb, uint32_t cls,
+			       size_t *num, size_t *bytes)
+{
+	tdb_off_t rec_ptr;
+	struct tdb_chainwalk_ctx chainwalk;
+
+	*num = *bytes = 0;
+
+	if (tdb_ofs_read(tdb, tdb_freelist_head(tdb, cls), &rec_ptr) == -1)
+		return false;
+
+	tdb_chainwalk_init(&chainwalk, rec_ptr);
+
+	while (rec_ptr) {
+		struct tdb_record r;
+		bool ok;
+		if (tdb->methods->tdb_read(tdb, rec_ptr, &r, sizeof(r),
+					   DOCONV()) == -1)
+			return false;
+		*num += 1;
+		*bytes += r.rec_len;
+		rec_ptr = r.next;
+		ok = tdb_chainwalk_check(tdb, &chainwalk, rec_ptr);
+		if (!ok) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * "Free records/bytes per size class: 12/336 0/0 ..." if the tdb has
+ * segregated freelists, an empty string otherwise
+ */
+static bool freelist_classes_summary(struct tdb_context *tdb,
+				     char *buf, size_t buflen)
+{
+	size_t used;
+	uint32_t cls;
+
+	buf[0] = '\0';
+
+	if (tdb_freelist_num_classes(tdb) == 1) {
+		return true;
+	}
+
+	used = snprintf(buf, buflen, "Free records/bytes per size class:");
+
+	for (cls = 0; cls < tdb_freelist_num_classes(tdb); cls++) {
+		size_t num, bytes;
+		if (!get_freelist_class(tdb, cls, &num, &bytes)) {
+			return false;
+		}
+		if (used < buflen) {
+			used += snprintf(buf + used, buflen - used,
+					 " %zu/%zu", num, bytes);
+		}
+	}
+	if (used < buflen) {
+		snprintf(buf + used, buflen - used, "\n");
+	}
+	return true;
+}
+
 _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 {
 	off_t file_size;
 	tdb_off_t off, rec_off;
 	struct tally freet, keys, data, dead, extra, hashval, uncoal;
+	size_t chain_hist[CHAIN_HIST_BUCKETS] = { 0 };
+	char freelist_classes[64 + TDB_FREELIST_CLASSES * 44];
 	struct tdb_record rec;
 	char *ret = NULL;
 	bool locked;
@@ -174,8 +260,16 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 	if (unc > 1)
 		tally_add(&uncoal, unc - 1);
 
-	for (off = 0; off < tdb->hash_size; off++)
-		tally_add(&hashval, get_hash_length(tdb, off));
+	for (off = 0; off < tdb->hash_size; off++) {
+		size_t chain_len = get_hash_length(tdb, off);
+		tally_add(&hashval, chain_len);
+		chain_hist_add(chain_hist, chain_len);
+	}
+
+	if (!freelist_classes_summary(tdb, freelist_classes,
+				      sizeof(freelist_classes))) {
+		goto unlock;
+	}
 
 	file_size = tdb->hdr_ofs + tdb->map_size;
 
@@ -183,7 +277,8 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 		 (unsigned long long)file_size, keys.total+data.total,
 		 (size_t)tdb->hdr_ofs, (size_t)tdb->map_size,
 		 keys.num,
-		 (tdb->hash_fn == tdb_jenkins_hash)?"yes":"no",
+		 (tdb->hash_fn == tdb_jenkins_hash)?"yes":
+		 (tdb->hash_fn == tdb_fast_hash)?"yes (fast)":"no",
 		 (unsigned)tdb->feature_flags, TDB_SUPPORTED_FEATURE_FLAGS,
 		 (tdb->feature_flags & TDB_FEATURE_FLAG_MUTEX)?"yes":"no",
 		 keys.min, tally_mean(&keys), keys.max,
@@ -193,8 +288,11 @@ _PUBLIC_ char *tdb_summary(struct tdb_context *tdb)
 		 dead.min, tally_mean(&dead), dead.max,
 		 freet.num,
 		 freet.min, tally_mean(&freet), freet.max,
+		 freelist_classes,
 		 hashval.num,
 		 hashval.min, tally_mean(&hashval), hashval.max,
+		 chain_hist[0], chain_hist[1], chain_hist[2], chain_hist[3],
+		 chain_hist[4], chain_hist[5], chain_hist[6],
 		 uncoal.total,
 		 uncoal.min, tally_mean(&uncoal), uncoal.max,
 		 keys.total * 100.0 / file_size,
@@ -871,6 +871,11 @@ _PUBLIC_ int tdb_hash_size(struct tdb_context *tdb)
 	return tdb->hash_size;
 }
 
+_PUBLIC_ unsigned int tdb_hash_chain(struct tdb_context *tdb, TDB_DATA key)
+{
+	return BUCKET(tdb->hash_fn(&key));
+}
+
 _PUBLIC_ size_t tdb_map_size(struct tdb_context *tdb)
 {
 	return tdb->map_size;
@@ -1011,10 +1016,12 @@ _PUBLIC_ int tdb_wipe_all(struct tdb_context *tdb)
 		}
 	}
 
-	/* wipe the freelist */
-	if (tdb_ofs_write(tdb, FREELIST_TOP, &offset) == -1) {
-		TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to write freelist\n"));
-		goto failed;
+	/* wipe the freelists */
+	for (i=0;i<tdb_freelist_num_classes(tdb);i++) {
+		if (tdb_ofs_write(tdb, tdb_freelist_head(tdb, i), &offset) == -1) {
+			TDB_LOG((tdb, TDB_DEBUG_FATAL,"tdb_wipe_all: failed to write freelist %d\n", i));
+			goto failed;
+		}
 	}
 
 	/* add all the rest of the file to the freelist, possibly leaving a gap
@@ -1150,6 +1157,228 @@ _PUBLIC_ int tdb_repack(struct tdb_context *tdb)
 	return 0;
 }
 
+/*
+  move the record at rec_ptr into free space before it. The freelist
+  is locked by the caller.
+
+  Returns 1 if the record was moved, 0 if it was left alone and -1
+  on error
+ */
+static int tdb_repack_move(struct tdb_context *tdb, tdb_off_t rec_ptr,
+			   struct tdb_record *rec)
+{
+	uint32_t hash = rec->full_hash;
+	struct tdb_chainwalk_ctx chainwalk;
+	struct tdb_record newrec;
+	tdb_off_t last_ptr, ptr, new_ptr;
+	unsigned char *buf = NULL;
+	tdb_len_t len;
+	int ret = 0;
+
+	/*
+	 * We hold the freelist lock, which is normally taken after a
+	 * chain lock. Don't wait for the chain, just leave the record
+	 * for the next pass.
+	 */
+	if (tdb_lock_nonblock(tdb, BUCKET(hash), F_WRLCK) != 0) {
+		return 0;
+	}
+
+	/* the record could have been modified in place or deleted */
+	if (tdb->methods->tdb_read(tdb, rec_ptr, rec, sizeof(*rec),
+				   DOCONV()) == -1) {
+		ret = -1;
+		goto unlock;
+	}
+	if ((rec->magic != TDB_MAGIC) ||
+	    (BUCKET(rec->full_hash) != BUCKET(hash))) {
+		goto unlock;
+	}
+
+	/*
+	 * Find the pointer to us. A record that is not on its chain
+	 * is a tdb_store() in progress.
+	 */
+	last_ptr = TDB_HASH_TOP(hash);
+	if (tdb_ofs_read(tdb, last_ptr, &ptr) == -1) {
+		ret = -1;
+		goto unlock;
+	}
+	tdb_chainwalk_init(&chainwalk, ptr);
+
+	while (ptr != rec_ptr) {
+		struct tdb_record r;
+
+		if (ptr == 0) {
+			goto unlock;
+		}
+		if (tdb_rec_read(tdb, ptr, &r) == -1) {
+			ret = -1;
+			goto unlock;
+		}
+		last_ptr = ptr;
+		ptr = r.next;
+
+		if (!tdb_chainwalk_check(tdb, &chainwalk, ptr)) {
+			tdb->ecode = TDB_ERR_CORRUPT;
+			ret = -1;
+			goto unlock;
+		}
+	}
+
+	if (tdb_write_lock_record(tdb, rec_ptr) == -1) {
+		/* Someone traversing here: leave it */
+		goto unlock;
+	}
+	if (tdb_write_unlock_record(tdb, rec_ptr) == -1) {
+		ret = -1;
+		goto unlock;
+	}
+
+	len = rec->key_len + rec->data_len;
+	if (len < rec->key_len) {
+		tdb->ecode = TDB_ERR_CORRUPT;
+		ret = -1;
+		goto unlock;
+	}
+
+	new_ptr = tdb_allocate_tight(tdb, len, &newrec);
+	if (new_ptr == 0) {
+		/* no space without expanding the file */
+		goto unlock;
+	}
+	if (new_ptr > rec_ptr) {
+		ret = tdb_free(tdb, new_ptr, &newrec);
+		goto unlock;
+	}
+
+	buf = tdb_alloc_read(tdb, rec_ptr + sizeof(*rec), len);
+	if (buf == NULL) {
+		tdb_free(tdb, new_ptr, &newrec);
+		ret = -1;
+		goto unlock;
+	}
+
+	newrec.next = rec->next;
+	newrec.key_len = rec->key_len;
+	newrec.data_len = rec->data_len;
+	newrec.full_hash = rec->full_hash;
+	newrec.magic = TDB_MAGIC;
+
+	if ((tdb_rec_write(tdb, new_ptr, &newrec) == -1) ||
+	    (tdb->methods->tdb_write(tdb, new_ptr + sizeof(newrec),
+				     buf, len) == -1)) {
+		tdb_free(tdb, new_ptr, &newrec);
+		ret = -1;
+		goto unlock;
+	}
+
+	/* From now on the chain sees the copy */
+	if (tdb_ofs_write(tdb, last_ptr, &new_ptr) == -1) {
+		tdb_free(tdb, new_ptr, &newrec);
+		ret = -1;
+		goto unlock;
+	}
+
+	ret = tdb_free(tdb, rec_ptr, rec);
+	if (ret == 0) {
+		ret = 1;
+	}
+
+unlock:
+	SAFE_FREE(buf);
+	tdb_unlock(tdb, BUCKET(hash), F_WRLCK);
+	return ret;
+}
+
+/*
+  incremental, online alternative to tdb_repack, see tdb.h
+ */
+_PUBLIC_ int tdb_repack_step(struct tdb_context *tdb, size_t *offset,
+			     unsigned int max_records)
+{
+	tdb_off_t rec_ptr;
+	struct tdb_record rec;
+	unsigned int i;
+	int moved = 0;
+
+	tdb_trace(tdb, "tdb_repack_step");
+
+	if (tdb->read_only || tdb->traverse_read) {
+		tdb->ecode = TDB_ERR_RDONLY;
+		return -1;
+	}
+	if (tdb->transaction != NULL) {
+		TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_repack_step: "
+			 "not allowed inside a transaction\n"));
+		tdb->ecode = TDB_ERR_EINVAL;
+		return -1;
+	}
+
+	if ((*offset < TDB_DATA_START(tdb->hash_size)) ||
+	    (*offset > UINT32_MAX)) {
+		*offset = TDB_DATA_START(tdb->hash_size);
+	}
+	rec_ptr = *offset;
+
+	if (tdb_lock_nonblock(tdb, -1, F_WRLCK) != 0) {
+		/* busy, nothing done */
+		return 0;
+	}
+
+	for (i = 0; i < max_records; i++) {
+		tdb_off_t next;
+		int ret;
+
+		if (tdb_oob(tdb, rec_ptr, sizeof(rec), 1) != 0) {
+			break;
+		}
+		if (tdb->methods->tdb_read(tdb, rec_ptr, &rec, sizeof(rec),
+					   DOCONV()) == -1) {
+			goto fail;
+		}
+		if (!tdb_add_off_t(rec_ptr, sizeof(rec), &next) ||
+		    !tdb_add_off_t(next, rec.rec_len, &next) ||
+		    (next <= rec_ptr)) {
+			tdb->ecode = TDB_ERR_CORRUPT;
+			goto fail;
+		}
+
+		if ((rec.magic == TDB_MAGIC) &&
+		    tdb_rec_borders_free(tdb, rec_ptr, &rec)) {
+			ret = tdb_repack_move(tdb, rec_ptr, &rec);
+			if (ret == -1) {
+				goto fail;
+			}
+			moved += ret;
+		}
+
+		rec_ptr = next;
+	}
+
+	if (tdb_oob(tdb, rec_ptr, sizeof(rec), 1) == 0) {
+		tdb_unlock(tdb, -1, F_WRLCK);
+		*offset = rec_ptr;
+		return moved;
+	}
+
+	tdb_unlock(tdb, -1, F_WRLCK);
+
+	/*
+	 * End of the file: the records we moved away from free space
+	 * on their right left two free records next to each other.
+	 */
+	if (tdb_freelist_merge_adjacent(tdb, NULL, NULL) == -1) {
+		return -1;
+	}
+	*offset = 0;
+	return moved;
+
+fail:
+	tdb_unlock(tdb, -1, F_WRLCK);
+	return -1;
+}
+
 /* Even on files, we can get partial writes due to signals. */
 bool tdb_write_all(int fd, const void *buf, size_t count)
 {
@@ -52,6 +52,8 @@ typedef uint32_t tdb_off_t;
 #define TDB_DEAD_MAGIC (0xFEE1DEAD)
 #define TDB_RECOVERY_MAGIC (0xf53bc0e7U)
 #define TDB_RECOVERY_INVALID_MAGIC (0x0)
+/* recovery data protected by a checksum in full_hash */
+#define TDB_RECOVERY_CSUM_MAGIC (0xf53bc1e7U)
 #define TDB_HASH_RWLOCK_MAGIC (0xbad1a51U)
 #define TDB_FEATURE_FLAG_MAGIC (0xbad1a52U)
 #define TDB_ALIGNMENT 4
@@ -66,13 +68,22 @@ typedef uint32_t tdb_off_t;
 #define TDB_DATA_START(hash_size) (TDB_HASH_TOP(hash_size-1) + sizeof(tdb_off_t))
 #define TDB_RECOVERY_HEAD offsetof(struct tdb_header, recovery_start)
 #define TDB_SEQNUM_OFS    offsetof(struct tdb_header, sequence_number)
+#define TDB_FREELIST_CLASSES 16
 #define TDB_PAD_BYTE 0x42
 #define TDB_PAD_U32  0x42424242
 
 #define TDB_FEATURE_FLAG_MUTEX 0x00000001
+#define TDB_FEATURE_FLAG_MUTEX_RWLOCK 0x00000002
+#define TDB_FEATURE_FLAG_FREELIST_CLASSES 0x00000004
+#define TDB_FEATURE_FLAG_RECOVERY_CSUM 0x00000008
+#define TDB_FEATURE_FLAG_FAST_HASH 0x00000010
 
 #define TDB_SUPPORTED_FEATURE_FLAGS ( \
 	TDB_FEATURE_FLAG_MUTEX | \
+	TDB_FEATURE_FLAG_MUTEX_RWLOCK | \
+	TDB_FEATURE_FLAG_FREELIST_CLASSES | \
+	TDB_FEATURE_FLAG_RECOVERY_CSUM | \
+	TDB_FEATURE_FLAG_FAST_HASH | \
 	0)
 
 /* NB assumes there is a local variable called "tdb" that is the
@@ -182,7 +193,12 @@ struct tdb_header {
 	uint32_t magic2_hash; /* hash of TDB_MAGIC. */
 	uint32_t feature_flags;
 	tdb_len_t mutex_size; /* set if TDB_FEATURE_FLAG_MUTEX is set */
-	tdb_off_t reserved[25];
+	/*
+	 * With TDB_FEATURE_FLAG_FREELIST_CLASSES FREELIST_TOP is size
+	 * class 0, these are the heads of classes 1 and up
+	 */
+	tdb_off_t freelist_classes[TDB_FREELIST_CLASSES-1];
+	tdb_off_t reserved[25-(TDB_FREELIST_CLASSES-1)];
 };
 
 struct tdb_lock_type {
@@ -302,8 +318,17 @@ int tdb_ofs_read(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 int tdb_ofs_write(struct tdb_context *tdb, tdb_off_t offset, tdb_off_t *d);
 void *tdb_convert(void *buf, uint32_t size);
 int tdb_free(struct tdb_context *tdb, tdb_off_t offset, struct tdb_record *rec);
+uint32_t tdb_freelist_num_classes(struct tdb_context *tdb);
+uint32_t tdb_freelist_class(struct tdb_context *tdb, tdb_len_t rec_len);
+tdb_off_t tdb_freelist_head(struct tdb_context *tdb, uint32_t cls);
 tdb_off_t tdb_allocate(struct tdb_context *tdb, int hash, tdb_len_t length,
 		       struct tdb_record *rec);
+tdb_off_t tdb_allocate_tight(struct tdb_context *tdb, tdb_len_t length,
+			     struct tdb_record *rec);
+bool tdb_rec_borders_free(struct tdb_context *tdb, tdb_off_t rec_ptr,
+			  const struct tdb_record *rec);
+int tdb_freelist_merge_adjacent(struct tdb_context *tdb,
+				int *count_records, int *count_merged);
 
 int _tdb_oob(struct tdb_context *tdb, tdb_off_t off, tdb_len_t len, int probe);
 
@@ -354,6 +379,9 @@ bool tdb_add_off_t(tdb_off_t a, tdb_off_t b, tdb_off_t *pret);
 
 size_t tdb_mutex_size(struct tdb_context *tdb);
 bool tdb_have_mutexes(struct tdb_context *tdb);
+bool tdb_have_mutex_rwlocks(struct tdb_context *tdb);
+bool tdb_mutex_rwlock_supported(void);
+int tdb_mutex_upgrade(struct tdb_context *tdb, off_t off, bool waitflag);
 int tdb_mutex_init(struct tdb_context *tdb);
 int tdb_mutex_mmap(struct tdb_context *tdb);
 int tdb_mutex_munmap(struct tdb_context *tdb);
@@ -364,6 +392,8 @@ bool tdb_mutex_unlock(struct tdb_context *tdb, int rw, off_t off, off_t len,
 int tdb_mutex_allrecord_lock(struct tdb_context *tdb, int ltype,
 			     enum tdb_lock_flags flags);
 int tdb_mutex_allrecord_unlock(struct tdb_context *tdb);
+int tdb_mutex_chainlock_unowned(struct tdb_context *tdb, off_t off);
+int tdb_mutex_chainunlock_unowned(struct tdb_context *tdb, off_t off);
 int tdb_mutex_allrecord_upgrade(struct tdb_context *tdb);
 void tdb_mutex_allrecord_downgrade(struct tdb_context *tdb);
 
@@ -75,6 +75,12 @@
     needed per commit to prevent race conditions. It might be possible
     to reduce this to 3 or even 2 with some more work.
 
+  - if TDB_RECOVERY_CHECKSUM was given when creating the tdb, the
+    recovery record carries a checksum of the recovery data. The data
+    and the magic are then written and synced together, a torn record
+    is detected by the checksum on recovery. This saves one of the 4
+    syncs.
+
   - check for a valid recovery record on open of the tdb, while the
     open lock is held. Automatically recover from the transaction
     recovery area if needed, then continue with the open as
@@ -714,6 +720,7 @@ int tdb_recovery_area(struct tdb_context *tdb,
 
 	/* ignore invalid recovery regions: can happen in crash */
 	if (rec->magic != TDB_RECOVERY_MAGIC &&
+	    rec->magic != TDB_RECOVERY_CSUM_MAGIC &&
 	    rec->magic != TDB_RECOVERY_INVALID_MAGIC) {
 		*recovery_offset = 0;
 		rec->rec_len = 0;
@@ -837,6 +844,33 @@ static int tdb_recovery_allocate(struct tdb_context *tdb,
 }
 
 
+/*
+  checksum of a TDB_RECOVERY_CSUM_MAGIC record, independent of the
+  byte order of the host
+*/
+static uint32_t tdb_recovery_csum(tdb_len_t key_len, tdb_len_t data_len,
+				  const unsigned char *data)
+{
+	unsigned char buf[12];
+	TDB_DATA d = {
+		.dptr = discard_const_p(unsigned char, data),
+		.dsize = data_len,
+	};
+	uint32_t data_hash = tdb_jenkins_hash(&d);
+	uint32_t vals[3] = { key_len, data_len, data_hash };
+	size_t i;
+
+	for (i=0; i<3; i++) {
+		buf[i*4+0] = vals[i] & 0xff;
+		buf[i*4+1] = (vals[i] >> 8) & 0xff;
+		buf[i*4+2] = (vals[i] >> 16) & 0xff;
+		buf[i*4+3] = (vals[i] >> 24) & 0xff;
+	}
+
+	d = (TDB_DATA) { .dptr = buf, .dsize = sizeof(buf) };
+	return tdb_jenkins_hash(&d);
+}
+
 /*
   setup the recovery data that will be used on a crash during commit
 */
@@ -851,6 +885,7 @@ static int transaction_setup_recovery(struct tdb_context *tdb,
 	tdb_off_t old_map_size = tdb->transaction->old_map_size;
 	uint32_t magic, tailer;
 	uint32_t i;
+	bool csum = (tdb->feature_flags & TDB_FEATURE_FLAG_RECOVERY_CSUM);
 
 	/*
 	  check that the recovery area has enough space
@@ -872,7 +907,6 @@ static int transaction_setup_recovery(struct tdb_context *tdb,
 	rec->data_len = recovery_size;
 	rec->rec_len  = recovery_max_size;
 	rec->key_len  = old_map_size;
-	CONVERT(*rec);
 
 	data = (unsigned char *)rec;
 
@@ -925,6 +959,20 @@ static int transaction_setup_recovery(struct tdb_context *tdb,
 		tdb_convert(p, 4);
 	}
 
+	*magic_offset = recovery_offset + offsetof(struct tdb_record, magic);
+
+	if (csum) {
+		/*
+		 * The record is only used if the checksum matches,
+		 * so it can be marked valid right away.
+		 */
+		rec->full_hash = tdb_recovery_csum(rec->key_len,
+						   rec->data_len,
+						   data + sizeof(*rec));
+		rec->magic = TDB_RECOVERY_CSUM_MAGIC;
+	}
+	CONVERT(*rec);
+
 	/* write the recovery data to the recovery area */
 	if (methods->tdb_write(tdb, recovery_offset, data, sizeof(*rec) + recovery_size) == -1) {
 		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_transaction_setup_recovery: failed to write recovery data\n"));
@@ -949,11 +997,14 @@ static int transaction_setup_recovery(struct tdb_context *tdb,
 
 	free(data);
 
+	if (csum) {
+		/* the magic went out with the data */
+		return 0;
+	}
+
 	magic = TDB_RECOVERY_MAGIC;
 	CONVERT(magic);
 
-	*magic_offset = recovery_offset + offsetof(struct tdb_record, magic);
-
 	if (methods->tdb_write(tdb, *magic_offset, &magic, sizeof(magic)) == -1) {
 		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_transaction_setup_recovery: failed to write recovery magic\n"));
 		tdb->ecode = TDB_ERR_IO;
@@ -1091,17 +1142,20 @@ static bool repack_worthwhile(struct tdb_context *tdb)
 	tdb_off_t ptr;
 	struct tdb_record rec;
 	tdb_len_t total = 0, largest = 0;
+	uint32_t cls;
 
-	if (tdb_ofs_read(tdb, FREELIST_TOP, &ptr) == -1) {
-		return false;
-	}
+	for (cls = 0; cls < tdb_freelist_num_classes(tdb); cls++) {
+		if (tdb_ofs_read(tdb, tdb_freelist_head(tdb, cls), &ptr) == -1) {
+			return false;
+		}
 
-	while (ptr != 0 && tdb_rec_free_read(tdb, ptr, &rec) == 0) {
-		total += rec.rec_len;
-		if (rec.rec_len > largest) {
-			largest = rec.rec_len;
+		while (ptr != 0 && tdb_rec_free_read(tdb, ptr, &rec) == 0) {
+			total += rec.rec_len;
+			if (rec.rec_len > largest) {
+				largest = rec.rec_len;
+			}
+			ptr = rec.next;
 		}
-		ptr = rec.next;
 	}
 
 	return total > largest * 2;
@@ -1242,6 +1296,30 @@ _PUBLIC_ int tdb_transaction_commit(struct tdb_context *tdb)
 }
 
 
+/*
+  forget about an incomplete TDB_RECOVERY_CSUM_MAGIC recovery record
+*/
+static int tdb_recovery_drop(struct tdb_context *tdb, tdb_off_t recovery_head)
+{
+	uint32_t zero = 0;
+
+	TDB_LOG((tdb, TDB_DEBUG_ERROR, "tdb_transaction_recover: "
+		 "ignoring incomplete recovery record\n"));
+	if (tdb_ofs_write(tdb, recovery_head +
+			  offsetof(struct tdb_record, magic),
+			  &zero) == -1) {
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_transaction_recover: failed to remove recovery magic\n"));
+		tdb->ecode = TDB_ERR_IO;
+		return -1;
+	}
+	if (transaction_sync(tdb, recovery_head,
+			     sizeof(struct tdb_record)) == -1) {
+		tdb->ecode = TDB_ERR_IO;
+		return -1;
+	}
+	return 0;
+}
+
 /*
   recover from an aborted transaction. Must be called with exclusive
   database write access already established (including the open
@@ -1274,7 +1352,8 @@ int tdb_transaction_recover(struct tdb_context *tdb)
 		return -1;
 	}
 
-	if (rec.magic != TDB_RECOVERY_MAGIC) {
+	if (rec.magic != TDB_RECOVERY_MAGIC &&
+	    rec.magic != TDB_RECOVERY_CSUM_MAGIC) {
 		/* there is no valid recovery data */
 		return 0;
 	}
@@ -1287,6 +1366,28 @@ int tdb_transaction_recover(struct tdb_context *tdb)
 
 	recovery_eof = rec.key_len;
 
+	/*
+	 * Check the lengths before trusting them for the allocation
+	 * and the read below.
+	 */
+	if ((rec.data_len > rec.rec_len) ||
+	    (tdb_oob(tdb, recovery_head + sizeof(rec), rec.data_len, 1) != 0)) {
+		if (rec.magic == TDB_RECOVERY_CSUM_MAGIC) {
+			/*
+			 * We crashed while writing the recovery
+			 * record, the commit didn't get to touch the
+			 * data yet.
+			 */
+			return tdb_recovery_drop(tdb, recovery_head);
+		}
+		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_transaction_recover: "
+			 "invalid recovery record length %u "
+			 "(record length %u)\n",
+			 (unsigned)rec.data_len, (unsigned)rec.rec_len));
+		tdb->ecode = TDB_ERR_CORRUPT;
+		return -1;
+	}
+
 	data = (unsigned char *)malloc(rec.data_len);
 	if (data == NULL) {
 		TDB_LOG((tdb, TDB_DEBUG_FATAL, "tdb_transaction_recover: failed to allocate recovery data\n"));
@@ -1303,6 +1404,15 @@ int tdb_transaction_recover(struct tdb_context *tdb)
 		return -1;
 	}
 
+	if ((rec.magic == TDB_RECOVERY_CSUM_MAGIC) &&
+	    (rec.full_hash != tdb_recovery_csum(rec.key_len,
+						rec.data_len,
+						data))) {
+		/* Torn write of the recovery data, see above. */
+		free(data);
+		return tdb_recovery_drop(tdb, recovery_head);
+	}
+
 	/* recover the file data */
 	p = data;
 	while (p+8 < data + rec.data_len) {
@@ -1382,5 +1492,6 @@ bool tdb_needs_recovery(struct tdb_context *tdb)
 		return true;
 	}
 
-	return (rec.magic == TDB_RECOVERY_MAGIC);
+	return (rec.magic == TDB_RECOVERY_MAGIC ||
+		rec.magic == TDB_RECOVERY_CSUM_MAGIC);
 }
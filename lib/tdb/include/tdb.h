@@ -97,6 +97,14 @@ extern "C" {
 #define TDB_MUTEX_LOCKING 4096 /** optimized locking using robust mutexes if supported,
                                    only with tdb >= 1.3.0 and TDB_CLEAR_IF_FIRST
                                    after checking tdb_runtime_check_for_robust_mutexes() */
+#define TDB_MUTEX_RWLOCK 8192 /** shared read locks on hash chains, only together
+                                  with TDB_MUTEX_LOCKING, can't be opened by older tdb */
+#define TDB_SEGREGATED_FREELIST 16384 /** power-of-two size class freelists,
+                                         can't be opened by older tdb */
+#define TDB_RECOVERY_CHECKSUM 32768 /** fewer syncs per transaction commit,
+                                       can't be opened by older tdb */
+#define TDB_FAST_HASH 65536 /** faster hashing with tdb_fast_hash(),
+                               can't be opened by older tdb */
 
 /** The tdb error codes */
 enum TDB_ERROR {TDB_SUCCESS=0, TDB_ERR_CORRUPT, TDB_ERR_IO, TDB_ERR_LOCK, 
@@ -165,6 +173,25 @@ struct tdb_logging_context {
  *                                             can't be opened by tdb < 1.3.0.
  *                                             Only valid in combination with TDB_CLEAR_IF_FIRST
  *                                             after checking tdb_runtime_check_for_robust_mutexes()\n
+ *                         TDB_MUTEX_RWLOCK - Allow several readers on a hash chain at the same
+ *                                            time, for example in tdb_parse_record().
+ *                                            Only valid in combination with TDB_MUTEX_LOCKING,
+ *                                            can't be opened by tdb versions without support.\n
+ *                         TDB_SEGREGATED_FREELIST - Keep free records on one freelist per
+ *                                                   power-of-two size class, making most
+ *                                                   allocations O(1) in fragmented databases.
+ *                                                   Only honoured when creating the file,
+ *                                                   can't be opened by tdb versions without support.\n
+ *                         TDB_RECOVERY_CHECKSUM - Checksum the transaction recovery data,
+ *                                                 which saves one of the four fsync calls
+ *                                                 of a transaction commit.
+ *                                                 Only honoured when creating the file,
+ *                                                 can't be opened by tdb versions without support.\n
+ *                         TDB_FAST_HASH - Use tdb_fast_hash() instead of the Jenkins hash,
+ *                                         faster for all but the shortest keys.
+ *                                         Only honoured when creating the file and
+ *                                         without a user defined hash function,
+ *                                         can't be opened by tdb versions without support.\n
  *
  * @param[in]  open_flags Flags for the open(2) function.
  *
@@ -206,6 +233,25 @@ _PUBLIC_ struct tdb_context *tdb_open(const char *name, int hash_size, int tdb_f
  *                                             can't be opened by tdb < 1.3.0.
  *                                             Only valid in combination with TDB_CLEAR_IF_FIRST
  *                                             after checking tdb_runtime_check_for_robust_mutexes()\n
+ *                         TDB_MUTEX_RWLOCK - Allow several readers on a hash chain at the same
+ *                                            time, for example in tdb_parse_record().
+ *                                            Only valid in combination with TDB_MUTEX_LOCKING,
+ *                                            can't be opened by tdb versions without support.\n
+ *                         TDB_SEGREGATED_FREELIST - Keep free records on one freelist per
+ *                                                   power-of-two size class, making most
+ *                                                   allocations O(1) in fragmented databases.
+ *                                                   Only honoured when creating the file,
+ *                                                   can't be opened by tdb versions without support.\n
+ *                         TDB_RECOVERY_CHECKSUM - Checksum the transaction recovery data,
+ *                                                 which saves one of the four fsync calls
+ *                                                 of a transaction commit.
+ *                                                 Only honoured when creating the file,
+ *                                                 can't be opened by tdb versions without support.\n
+ *                         TDB_FAST_HASH - Use tdb_fast_hash() instead of the Jenkins hash,
+ *                                         faster for all but the shortest keys.
+ *                                         Only honoured when creating the file and
+ *                                         without a user defined hash function,
+ *                                         can't be opened by tdb versions without support.\n
  *
  * @param[in]  open_flags Flags for the open(2) function.
  *
@@ -869,6 +915,20 @@ _PUBLIC_ int tdb_get_seqnum(struct tdb_context *tdb);
  */
 _PUBLIC_ int tdb_hash_size(struct tdb_context *tdb);
 
+/**
+ * @brief Get the hash chain a key is stored in.
+ *
+ * Keys in the same chain share a chain lock, callers looking up many
+ * keys can use this to group them.
+ *
+ * @param[in]  tdb      The database the key belongs to.
+ *
+ * @param[in]  key      The key to hash.
+ *
+ * @return              The chain number, between 0 and tdb_hash_size()-1.
+ */
+_PUBLIC_ unsigned int tdb_hash_chain(struct tdb_context *tdb, TDB_DATA key);
+
 /**
  * @brief Get the map size.
  *
@@ -936,6 +996,18 @@ _PUBLIC_ void tdb_increment_seqnum_nonblock(struct tdb_context *tdb);
  */
 _PUBLIC_ unsigned int tdb_jenkins_hash(TDB_DATA *key);
 
+/**
+ * @brief Create a hash of the key with the hash used by TDB_FAST_HASH.
+ *
+ * This is XXH64 folded to 32 bits, it is considerably faster than
+ * tdb_jenkins_hash() for longer keys.
+ *
+ * @param[in]  key      The key to hash
+ *
+ * @return              The hash.
+ */
+_PUBLIC_ unsigned int tdb_fast_hash(TDB_DATA *key);
+
 /**
  * @brief Check the consistency of the database.
  *
@@ -1015,6 +1087,8 @@ _PUBLIC_ int tdb_chainlock_read_nonblock(struct tdb_context *tdb, TDB_DATA key);
 _PUBLIC_ int tdb_chainunlock_read(struct tdb_context *tdb, TDB_DATA key);
 _PUBLIC_ int tdb_chainlock_mark(struct tdb_context *tdb, TDB_DATA key);
 _PUBLIC_ int tdb_chainlock_unmark(struct tdb_context *tdb, TDB_DATA key);
+_PUBLIC_ int tdb_chainlock_unowned(struct tdb_context *tdb, TDB_DATA key);
+_PUBLIC_ int tdb_chainunlock_unowned(struct tdb_context *tdb, TDB_DATA key);
 
 _PUBLIC_ void tdb_setalarm_sigptr(struct tdb_context *tdb, volatile sig_atomic_t *sigptr);
 
@@ -1022,6 +1096,31 @@ _PUBLIC_ void tdb_setalarm_sigptr(struct tdb_context *tdb, volatile sig_atomic_t
 _PUBLIC_ int tdb_wipe_all(struct tdb_context *tdb);
 _PUBLIC_ int tdb_repack(struct tdb_context *tdb);
 
+/**
+ * @brief Defragment the free space of a database step by step.
+ *
+ * Unlike tdb_repack() this does not copy the database in a
+ * transaction. Each call looks at up to max_records records, starting
+ * at *offset, and moves records that are next to free space into
+ * free space nearer to the start of the file. Only the freelist and
+ * the chain of the record being moved are locked, neither lock is
+ * waited for: busy records are skipped.
+ *
+ * @param[in]  tdb      The database to defragment.
+ *
+ * @param[in,out] offset Where to continue, start with 0. This is a file
+ *                      offset that can be compared to tdb_map_size()
+ *                      for progress reports. It is set back to 0 when
+ *                      the end of the file has been reached.
+ *
+ * @param[in]  max_records The number of records to look at.
+ *
+ * @return              The number of records moved, -1 on error. Must
+ *                      not be called inside a transaction.
+ */
+_PUBLIC_ int tdb_repack_step(struct tdb_context *tdb, size_t *offset,
+			     unsigned int max_records);
+
 /* Debug functions. Not used in production. */
 _PUBLIC_ void tdb_dump_all(struct tdb_context *tdb);
 _PUBLIC_ int tdb_printfreelist(struct tdb_context *tdb);
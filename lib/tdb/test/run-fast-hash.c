@@ -0,0 +1,144 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+
+static void log_fn(struct tdb_context *tdb, enum tdb_debug_level level,
+		   const char *fmt, ...)
+{
+	unsigned int *count = tdb_get_logging_private(tdb);
+	if (strstr(fmt, "hash"))
+		(*count)++;
+}
+
+static uint32_t hdr_feature_flags(const char *fname, unsigned int flags)
+{
+	struct tdb_header hdr;
+	ssize_t nread;
+
+	int fd = open(fname, O_RDONLY);
+	if (fd == -1)
+		return 0;
+
+	nread = read(fd, &hdr, sizeof(hdr));
+	close(fd);
+	if (nread != sizeof(hdr)) {
+		return 0;
+	}
+	if (flags & TDB_CONVERT) {
+		tdb_convert(&hdr.feature_flags, sizeof(hdr.feature_flags));
+	}
+	return hdr.feature_flags;
+}
+
+static bool fetch_ok(struct tdb_context *tdb, TDB_DATA d)
+{
+	TDB_DATA r = tdb_fetch(tdb, d);
+	bool ok = (r.dsize == d.dsize) &&
+		  (memcmp(r.dptr, d.dptr, d.dsize) == 0);
+
+	free(r.dptr);
+	return ok;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	unsigned int log_count, flags;
+	TDB_DATA d;
+	struct tdb_logging_context log_ctx = { log_fn, &log_count };
+
+	plan_tests(2 + 24 * 2);
+
+	/* XXH64 of "" and "abc", folded to 32 bits. */
+	d.dptr = discard_const_p(uint8_t, "");
+	d.dsize = 0;
+	ok1(tdb_fast_hash(&d) == 0xbe9e32ae);
+	d.dptr = discard_const_p(uint8_t, "abc");
+	d.dsize = 3;
+	ok1(tdb_fast_hash(&d) == 0xe9cb256c);
+
+	d.dptr = discard_const_p(uint8_t, "Hello");
+	d.dsize = 5;
+
+	for (flags = 0; flags <= TDB_CONVERT; flags += TDB_CONVERT) {
+		log_count = 0;
+		tdb = tdb_open_ex("run-fast-hash.tdb", 0,
+				  flags|TDB_FAST_HASH,
+				  O_CREAT|O_RDWR|O_TRUNC, 0600, &log_ctx,
+				  NULL);
+		ok1(tdb);
+		ok1(log_count == 0);
+		ok1(tdb->hash_fn == tdb_fast_hash);
+		ok1(tdb_store(tdb, d, d, TDB_INSERT) == 0);
+		tdb_close(tdb);
+
+		/* The header tells older versions to stay away. */
+		ok1(hdr_feature_flags("run-fast-hash.tdb", flags) &
+		    TDB_FEATURE_FLAG_FAST_HASH);
+
+		/* The hash is detected without any flag. */
+		log_count = 0;
+		tdb = tdb_open_ex("run-fast-hash.tdb", 0, 0,
+				  O_RDWR, 0600, &log_ctx, NULL);
+		ok1(tdb);
+		ok1(log_count == 0);
+		ok1(tdb->hash_fn == tdb_fast_hash);
+		ok1(fetch_ok(tdb, d));
+		ok1(tdb_check(tdb, NULL, NULL) == 0);
+		tdb_close(tdb);
+
+		/* And with the Jenkins hash requested. */
+		tdb = tdb_open_ex("run-fast-hash.tdb", 0,
+				  TDB_INCOMPATIBLE_HASH,
+				  O_RDWR, 0600, &log_ctx, NULL);
+		ok1(tdb);
+		ok1(tdb->hash_fn == tdb_fast_hash);
+		ok1(fetch_ok(tdb, d));
+		tdb_close(tdb);
+
+		/* An explicitly given hash function is respected. */
+		log_count = 0;
+		tdb = tdb_open_ex("run-fast-hash.tdb", 0, 0,
+				  O_RDWR, 0600, &log_ctx, tdb_jenkins_hash);
+		ok1(!tdb);
+		ok1(log_count == 1);
+
+		tdb = tdb_open_ex("run-fast-hash.tdb", 0, 0,
+				  O_RDWR, 0600, &log_ctx, tdb_fast_hash);
+		ok1(tdb);
+		ok1(fetch_ok(tdb, d));
+		tdb_close(tdb);
+
+		/* TDB_FAST_HASH does not change an existing file. */
+		tdb = tdb_open_ex("run-fast-hash.tdb", 0,
+				  flags|TDB_INCOMPATIBLE_HASH,
+				  O_CREAT|O_RDWR|O_TRUNC, 0600, &log_ctx,
+				  NULL);
+		ok1(tdb);
+		ok1(tdb_store(tdb, d, d, TDB_INSERT) == 0);
+		tdb_close(tdb);
+
+		log_count = 0;
+		tdb = tdb_open_ex("run-fast-hash.tdb", 0, TDB_FAST_HASH,
+				  O_RDWR, 0600, &log_ctx, NULL);
+		ok1(tdb);
+		ok1(log_count == 0);
+		ok1(tdb->hash_fn == tdb_jenkins_hash);
+		ok1(!(tdb->feature_flags & TDB_FEATURE_FLAG_FAST_HASH));
+		ok1(fetch_ok(tdb, d));
+		tdb_close(tdb);
+	}
+
+	return exit_status();
+}
@@ -0,0 +1,124 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/summary.c"
+#include "../common/freelistcheck.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+/* Every record on the list of class k must be at least 16<<k bytes */
+static bool classes_ordered(struct tdb_context *tdb)
+{
+	uint32_t cls;
+
+	for (cls = 0; cls < tdb_freelist_num_classes(tdb); cls++) {
+		tdb_off_t rec_ptr;
+		struct tdb_record rec;
+
+		if (tdb_ofs_read(tdb, tdb_freelist_head(tdb, cls),
+				 &rec_ptr) == -1) {
+			return false;
+		}
+		while (rec_ptr != 0) {
+			if (tdb_rec_free_read(tdb, rec_ptr, &rec) == -1) {
+				return false;
+			}
+			if (cls != 0 && rec.rec_len < (16U << cls)) {
+				diag("record %u of length %u on class %u",
+				     rec_ptr, rec.rec_len, cls);
+				return false;
+			}
+			rec_ptr = rec.next;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[])
+{
+	unsigned int i, j;
+	struct tdb_context *tdb;
+	int flags[] = { TDB_INTERNAL, TDB_DEFAULT, TDB_NOMMAP,
+			TDB_INTERNAL|TDB_CONVERT, TDB_CONVERT,
+			TDB_NOMMAP|TDB_CONVERT };
+	TDB_DATA key = { (unsigned char *)&j, sizeof(j) };
+	TDB_DATA data;
+	uint8_t buf[4096];
+	char *summary;
+	int num_entries;
+	tdb_off_t map_size;
+
+	memset(buf, 'x', sizeof(buf));
+	data.dptr = buf;
+
+	plan_tests(sizeof(flags) / sizeof(flags[0]) * 9 + 2);
+
+	for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
+		tdb = tdb_open_ex("run-freelist-classes.tdb", 131,
+				  flags[i]|TDB_SEGREGATED_FREELIST,
+				  O_RDWR|O_CREAT|O_TRUNC, 0600,
+				  &taplogctx, NULL);
+		ok1(tdb);
+		if (!tdb)
+			continue;
+		ok1(tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES);
+
+		/* Lots of differently sized records, every other one deleted */
+		for (j = 0; j < 1000; j++) {
+			data.dsize = (j * 37) % sizeof(buf);
+			if (tdb_store(tdb, key, data, TDB_REPLACE) != 0)
+				fail("Storing in tdb");
+		}
+		for (j = 0; j < 1000; j += 2) {
+			if (tdb_delete(tdb, key) != 0)
+				fail("Deleting from tdb");
+		}
+		ok1(classes_ordered(tdb));
+
+		/* Refill the holes, this must not grow the file */
+		map_size = tdb->map_size;
+		for (j = 0; j < 1000; j += 2) {
+			data.dsize = (j * 37) % (sizeof(buf) / 2);
+			if (tdb_store(tdb, key, data, TDB_REPLACE) != 0)
+				fail("Storing in tdb");
+		}
+		ok1(tdb->map_size == map_size);
+		ok1(classes_ordered(tdb));
+		/* internal databases don't have the magic food */
+		ok1((flags[i] & TDB_INTERNAL) ||
+		    tdb_check(tdb, NULL, NULL) == 0);
+		ok1(tdb_validate_freelist(tdb, &num_entries) == 0);
+
+		summary = tdb_summary(tdb);
+		ok1(summary && strstr(summary,
+				      "Free records/bytes per size class: "));
+		free(summary);
+
+		ok1(tdb_close(tdb) == 0);
+	}
+
+	/* The size classes survive a reopen, and don't show up without */
+	tdb = tdb_open_ex("run-freelist-classes.tdb", 0, TDB_DEFAULT,
+			  O_RDWR, 0600, &taplogctx, NULL);
+	ok1(tdb && (tdb->feature_flags & TDB_FEATURE_FLAG_FREELIST_CLASSES));
+	tdb_close(tdb);
+
+	tdb = tdb_open_ex("run-freelist-classes.tdb", 131, TDB_DEFAULT,
+			  O_RDWR|O_CREAT|O_TRUNC, 0600, &taplogctx, NULL);
+	summary = tdb_summary(tdb);
+	ok1(summary && !strstr(summary, "per size class"));
+	free(summary);
+	tdb_close(tdb);
+
+	return exit_status();
+}
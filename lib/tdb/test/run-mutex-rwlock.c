@@ -0,0 +1,218 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <stdarg.h>
+
+static TDB_DATA key, data;
+
+static void log_fn(struct tdb_context *tdb, enum tdb_debug_level level,
+		   const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+static int parse_fn(TDB_DATA k, TDB_DATA d, void *private_data)
+{
+	bool *found = (bool *)private_data;
+
+	*found = ((d.dsize == data.dsize) &&
+		  (memcmp(d.dptr, data.dptr, d.dsize) == 0));
+	return 0;
+}
+
+/*
+ * Take a chain read lock in a forked child, tell the parent and wait. If "die" is set,
+ * exit without unlocking.
+ */
+static int do_child(struct tdb_context *tdb, int to, int from, bool die)
+{
+	int ret;
+	char c = 0;
+
+	ret = tdb_reopen(tdb);
+	ok(ret == 0, "tdb_reopen should succeed");
+
+	ret = tdb_chainlock_read(tdb, key);
+	ok(ret == 0, "tdb_chainlock_read should succeed");
+
+	write(to, &c, sizeof(c));
+
+	read(from, &c, sizeof(c));
+
+	if (die) {
+		_exit(0);
+	}
+
+	ret = tdb_chainunlock_read(tdb, key);
+	ok(ret == 0, "tdb_chainunlock_read should succeed");
+
+	write(to, &c, sizeof(c));
+
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	unsigned int log_count;
+	struct tdb_logging_context log_ctx = { log_fn, &log_count };
+	int ret, status;
+	pid_t child, wait_ret;
+	int fromchild[2];
+	int tochild[2];
+	char c;
+	int tdb_flags;
+	bool runtime_support;
+	bool found;
+
+	runtime_support = tdb_runtime_check_for_robust_mutexes() &&
+		tdb_mutex_rwlock_supported();
+
+	if (!runtime_support) {
+		skip(1, "No robust mutex support");
+		return exit_status();
+	}
+
+	key.dsize = strlen("hi");
+	key.dptr = discard_const_p(uint8_t, "hi");
+	data.dsize = strlen("world");
+	data.dptr = discard_const_p(uint8_t, "world");
+
+	tdb = tdb_open_ex("mutex-rwlock.tdb", 0,
+			  TDB_INCOMPATIBLE_HASH|
+			  TDB_MUTEX_RWLOCK|
+			  TDB_CLEAR_IF_FIRST,
+			  O_RDWR|O_CREAT, 0755, &log_ctx, NULL);
+	ok(tdb == NULL, "TDB_MUTEX_RWLOCK requires TDB_MUTEX_LOCKING");
+	ok(errno == EINVAL, "errno should be EINVAL");
+
+	tdb_flags = TDB_INCOMPATIBLE_HASH|
+		TDB_MUTEX_LOCKING|
+		TDB_MUTEX_RWLOCK|
+		TDB_CLEAR_IF_FIRST;
+
+	tdb = tdb_open_ex("mutex-rwlock.tdb", 0, tdb_flags,
+			  O_RDWR|O_CREAT, 0755, &log_ctx, NULL);
+	ok(tdb, "tdb_open_ex should succeed");
+	ok(tdb_have_mutex_rwlocks(tdb), "tdb should have rwlocks");
+
+	ret = tdb_store(tdb, key, data, TDB_INSERT);
+	ok(ret == 0, "tdb_store should succeed");
+
+	pipe(fromchild);
+	pipe(tochild);
+
+	child = fork();
+	if (child == 0) {
+		close(fromchild[0]);
+		close(tochild[1]);
+		return do_child(tdb, fromchild[1], tochild[0], false);
+	}
+	close(fromchild[1]);
+	close(tochild[0]);
+
+	read(fromchild[0], &c, sizeof(c));
+
+	/*
+	 * The child holds a read lock, other readers get in
+	 */
+	ret = tdb_chainlock_read_nonblock(tdb, key);
+	ok(ret == 0, "tdb_chainlock_read_nonblock should succeed");
+	ret = tdb_chainunlock_read(tdb, key);
+	ok(ret == 0, "tdb_chainunlock_read should succeed");
+
+	found = false;
+	alarm(10);
+	ret = tdb_parse_record(tdb, key, parse_fn, &found);
+	alarm(0);
+	ok(ret == 0, "tdb_parse_record should succeed");
+	ok(found, "tdb_parse_record should find the record");
+
+	/*
+	 * ... but writers don't
+	 */
+	ret = tdb_chainlock_nonblock(tdb, key);
+	ok(ret == -1, "tdb_chainlock_nonblock should not succeed");
+
+	write(tochild[1], &c, sizeof(c));
+
+	read(fromchild[0], &c, sizeof(c));
+
+	ret = tdb_chainlock_nonblock(tdb, key);
+	ok(ret == 0, "tdb_chainlock_nonblock should succeed");
+	ret = tdb_chainunlock(tdb, key);
+	ok(ret == 0, "tdb_chainunlock should succeed");
+
+	wait_ret = wait(&status);
+	ok(wait_ret == child, "child should have exited correctly");
+
+	/*
+	 * Upgrade a read lock to a write lock
+	 */
+	ret = tdb_chainlock_read(tdb, key);
+	ok(ret == 0, "tdb_chainlock_read should succeed");
+	ret = tdb_chainlock(tdb, key);
+	ok(ret == 0, "tdb_chainlock should succeed");
+	ret = tdb_store(tdb, key, data, TDB_REPLACE);
+	ok(ret == 0, "tdb_store should succeed");
+	ret = tdb_chainunlock(tdb, key);
+	ok(ret == 0, "tdb_chainunlock should succeed");
+	ret = tdb_chainunlock_read(tdb, key);
+	ok(ret == 0, "tdb_chainunlock_read should succeed");
+
+	/*
+	 * A reader dying with the lock held must not block writers
+	 */
+	close(fromchild[0]);
+	close(tochild[1]);
+	pipe(fromchild);
+	pipe(tochild);
+
+	child = fork();
+	if (child == 0) {
+		close(fromchild[0]);
+		close(tochild[1]);
+		return do_child(tdb, fromchild[1], tochild[0], true);
+	}
+	close(fromchild[1]);
+	close(tochild[0]);
+
+	read(fromchild[0], &c, sizeof(c));
+
+	ret = tdb_chainlock_nonblock(tdb, key);
+	ok(ret == -1, "tdb_chainlock_nonblock should not succeed");
+
+	write(tochild[1], &c, sizeof(c));
+
+	wait_ret = wait(&status);
+	ok(wait_ret == child, "child should have exited correctly");
+
+	alarm(10);
+	ret = tdb_chainlock(tdb, key);
+	alarm(0);
+	ok(ret == 0, "tdb_chainlock should succeed");
+	ret = tdb_chainunlock(tdb, key);
+	ok(ret == 0, "tdb_chainunlock should succeed");
+
+	ret = tdb_close(tdb);
+	ok(ret == 0, "tdb_close should succeed");
+
+	diag("done");
+	return exit_status();
+}
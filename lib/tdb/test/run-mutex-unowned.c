@@ -0,0 +1,137 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include <pthread.h>
+#include <stdarg.h>
+
+static TDB_DATA key, data;
+
+static void log_fn(struct tdb_context *tdb, enum tdb_debug_level level,
+		   const char *fmt, ...)
+{
+	va_list ap;
+	va_start(ap, fmt);
+	vfprintf(stderr, fmt, ap);
+	va_end(ap);
+}
+
+struct locker {
+	struct tdb_context *tdb;
+	int to;
+	int from;
+	int lock_ret;
+	int unlock_ret;
+};
+
+static void *locker_fn(void *private_data)
+{
+	struct locker *l = private_data;
+	char c = 0;
+
+	l->lock_ret = tdb_chainlock_unowned(l->tdb, key);
+
+	write(l->to, &c, sizeof(c));
+	read(l->from, &c, sizeof(c));
+
+	l->unlock_ret = tdb_chainunlock_unowned(l->tdb, key);
+
+	return NULL;
+}
+
+/* A chain locked by another thread can be marked and used. */
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	unsigned int log_count;
+	struct tdb_logging_context log_ctx = { log_fn, &log_count };
+	struct locker l;
+	pthread_t thread;
+	int fromthread[2];
+	int tothread[2];
+	int ret;
+	char c = 0;
+	int tdb_flags;
+	bool runtime_support;
+
+	runtime_support = tdb_runtime_check_for_robust_mutexes();
+
+	if (!runtime_support) {
+		skip(1, "No robust mutex support");
+		return exit_status();
+	}
+
+	key.dsize = strlen("hi");
+	key.dptr = discard_const_p(uint8_t, "hi");
+	data.dsize = strlen("world");
+	data.dptr = discard_const_p(uint8_t, "world");
+
+	tdb = tdb_open_ex("mutex-unowned.tdb", 0, TDB_CLEAR_IF_FIRST,
+			  O_RDWR|O_CREAT, 0755, &log_ctx, NULL);
+	ok(tdb, "tdb_open_ex should succeed");
+	ret = tdb_chainlock_unowned(tdb, key);
+	ok(ret == -1 && errno == ENOSYS,
+	   "tdb_chainlock_unowned should fail without mutexes");
+	tdb_close(tdb);
+
+	pipe(fromthread);
+	pipe(tothread);
+
+	tdb_flags = TDB_INCOMPATIBLE_HASH|
+		TDB_MUTEX_LOCKING|
+		TDB_CLEAR_IF_FIRST;
+
+	tdb = tdb_open_ex("mutex-unowned.tdb", 0, tdb_flags,
+			  O_RDWR|O_CREAT, 0755, &log_ctx, NULL);
+	ok(tdb, "tdb_open_ex should succeed");
+
+	l = (struct locker) {
+		.tdb = tdb, .to = fromthread[1], .from = tothread[0],
+		.lock_ret = -1, .unlock_ret = -1,
+	};
+
+	ret = pthread_create(&thread, NULL, locker_fn, &l);
+	ok(ret == 0, "pthread_create should succeed");
+
+	read(fromthread[0], &c, sizeof(c));
+	ok(l.lock_ret == 0, "tdb_chainlock_unowned should succeed");
+
+	ret = tdb_chainlock_nonblock(tdb, key);
+	ok(ret == -1, "tdb_chainlock_nonblock should fail");
+
+	ret = tdb_chainlock_mark(tdb, key);
+	ok(ret == 0, "tdb_chainlock_mark should succeed");
+
+	ret = tdb_store(tdb, key, data, 0);
+	ok(ret == 0, "tdb_store should succeed");
+
+	ret = tdb_chainlock_unmark(tdb, key);
+	ok(ret == 0, "tdb_chainlock_unmark should succeed");
+
+	write(tothread[1], &c, sizeof(c));
+	pthread_join(thread, NULL);
+	ok(l.unlock_ret == 0, "tdb_chainunlock_unowned should succeed");
+
+	ret = tdb_chainlock_nonblock(tdb, key);
+	ok(ret == 0, "tdb_chainlock_nonblock should succeed");
+
+	ret = tdb_chainunlock(tdb, key);
+	ok(ret == 0, "tdb_chainunlock should succeed");
+
+	ok(tdb_exists(tdb, key), "record should exist");
+
+	tdb_close(tdb);
+
+	diag("done");
+	return exit_status();
+}
@@ -0,0 +1,178 @@
+#include "../common/tdb_private.h"
+
+/* Count the syncs, but don't actually do them. */
+static unsigned int sync_counts = 0;
+static inline int fake_fsync(int fd)
+{
+	sync_counts++;
+	return 0;
+}
+#define fsync fake_fsync
+
+#ifdef MS_SYNC
+static inline int fake_msync(void *addr, size_t length, int flags)
+{
+	sync_counts++;
+	return 0;
+}
+#define msync fake_msync
+#endif
+
+#ifdef HAVE_FDATASYNC
+static inline int fake_fdatasync(int fd)
+{
+	sync_counts++;
+	return 0;
+}
+#define fdatasync fake_fdatasync
+#endif
+
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+static TDB_DATA key = {
+	.dptr = discard_const_p(uint8_t, "hi"),
+	.dsize = 2,
+};
+
+static unsigned int store_syncs(struct tdb_context *tdb, const char *val)
+{
+	TDB_DATA data = {
+		.dptr = discard_const_p(uint8_t, val),
+		.dsize = strlen(val),
+	};
+	unsigned int before = sync_counts;
+
+	tdb_transaction_start(tdb);
+	tdb_store(tdb, key, data, TDB_REPLACE);
+	tdb_transaction_commit(tdb);
+
+	return sync_counts - before;
+}
+
+static bool fetch_is(struct tdb_context *tdb, const char *val)
+{
+	TDB_DATA data = tdb_fetch(tdb, key);
+	bool ret;
+
+	ret = (data.dsize == strlen(val) &&
+	       memcmp(data.dptr, val, data.dsize) == 0);
+	free(data.dptr);
+	return ret;
+}
+
+/*
+ * A commit leaves the recovery record with the old contents in
+ * place and only clears the magic. Put a magic back to make it
+ * look like we crashed in the middle of the commit.
+ */
+static bool set_recovery_magic(struct tdb_context *tdb, uint32_t magic,
+			       uint32_t full_hash_xor)
+{
+	struct tdb_record rec;
+	tdb_off_t off;
+
+	if (tdb_ofs_read(tdb, TDB_RECOVERY_HEAD, &off) == -1 || off == 0) {
+		return false;
+	}
+	if (tdb_read(tdb, off, &rec, sizeof(rec), DOCONV()) == -1) {
+		return false;
+	}
+	rec.magic = magic;
+	rec.full_hash ^= full_hash_xor;
+	return tdb_rec_write(tdb, off, &rec) == 0;
+}
+
+/* Pretend the header of the recovery record was torn as well. */
+static bool set_recovery_data_len(struct tdb_context *tdb, uint32_t data_len)
+{
+	struct tdb_record rec;
+	tdb_off_t off;
+
+	if (tdb_ofs_read(tdb, TDB_RECOVERY_HEAD, &off) == -1 || off == 0) {
+		return false;
+	}
+	if (tdb_read(tdb, off, &rec, sizeof(rec), DOCONV()) == -1) {
+		return false;
+	}
+	rec.data_len = data_len;
+	return tdb_rec_write(tdb, off, &rec) == 0;
+}
+
+int main(int argc, char *argv[])
+{
+	struct tdb_context *tdb;
+	unsigned int plain_syncs, csum_syncs;
+
+	/* Do *not* suppress sync for this test; we do it ourselves. */
+	unsetenv("TDB_NO_FSYNC");
+
+	plan_tests(16);
+
+	tdb = tdb_open_ex("run-recovery-checksum.tdb", 1024,
+			  TDB_CLEAR_IF_FIRST,
+			  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx, NULL);
+	ok1(tdb);
+	store_syncs(tdb, "first");
+	plain_syncs = store_syncs(tdb, "second");
+	tdb_close(tdb);
+
+	tdb = tdb_open_ex("run-recovery-checksum.tdb", 1024,
+			  TDB_RECOVERY_CHECKSUM,
+			  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx, NULL);
+	ok1(tdb);
+	ok1(tdb->feature_flags & TDB_FEATURE_FLAG_RECOVERY_CSUM);
+	store_syncs(tdb, "first");
+	csum_syncs = store_syncs(tdb, "second");
+	diag("syncs per commit: %u, with checksum: %u",
+	     plain_syncs, csum_syncs);
+	/* one of the four sync points of a commit is gone */
+	ok1(csum_syncs * 4 == plain_syncs * 3);
+	ok1(tdb_check(tdb, NULL, NULL) == 0);
+
+	/* A valid recovery record rolls back the last commit. */
+	ok1(set_recovery_magic(tdb, TDB_RECOVERY_CSUM_MAGIC, 0));
+	ok1(tdb_needs_recovery(tdb));
+	tdb_close(tdb);
+
+	tdb = tdb_open_ex("run-recovery-checksum.tdb", 1024, TDB_DEFAULT,
+			  O_RDWR, 0600, &taplogctx, NULL);
+	ok1(fetch_is(tdb, "first"));
+
+	/* A torn recovery record is ignored. */
+	store_syncs(tdb, "third");
+	ok1(set_recovery_magic(tdb, TDB_RECOVERY_CSUM_MAGIC, 0x1));
+	tdb_close(tdb);
+
+	tdb = tdb_open_ex("run-recovery-checksum.tdb", 1024, TDB_DEFAULT,
+			  O_RDWR, 0600, &taplogctx, NULL);
+	ok1(fetch_is(tdb, "third"));
+	ok1(!tdb_needs_recovery(tdb));
+	ok1(tdb_check(tdb, NULL, NULL) == 0);
+
+	/* So is one claiming more data than the file holds. */
+	store_syncs(tdb, "fourth");
+	ok1(set_recovery_magic(tdb, TDB_RECOVERY_CSUM_MAGIC, 0));
+	ok1(set_recovery_data_len(tdb, 0xfffffff0));
+	tdb_close(tdb);
+
+	tdb = tdb_open_ex("run-recovery-checksum.tdb", 1024, TDB_DEFAULT,
+			  O_RDWR, 0600, &taplogctx, NULL);
+	ok1(fetch_is(tdb, "fourth"));
+	ok1(!tdb_needs_recovery(tdb));
+	tdb_close(tdb);
+
+	return exit_status();
+}
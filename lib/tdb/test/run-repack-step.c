@@ -0,0 +1,147 @@
+#include "../common/tdb_private.h"
+#include "../common/io.c"
+#include "../common/tdb.c"
+#include "../common/lock.c"
+#include "../common/freelist.c"
+#include "../common/traverse.c"
+#include "../common/transaction.c"
+#include "../common/error.c"
+#include "../common/open.c"
+#include "../common/check.c"
+#include "../common/hash.c"
+#include "../common/mutex.c"
+#include "tap-interface.h"
+#include <stdlib.h>
+#include "logging.h"
+
+#define NUM_RECORDS 1000
+
+static void free_space(struct tdb_context *tdb,
+		       tdb_len_t *total, tdb_len_t *largest)
+{
+	uint32_t cls;
+
+	*total = *largest = 0;
+
+	for (cls = 0; cls < tdb_freelist_num_classes(tdb); cls++) {
+		tdb_off_t ptr;
+		struct tdb_record rec;
+
+		if (tdb_ofs_read(tdb, tdb_freelist_head(tdb, cls), &ptr) == -1) {
+			return;
+		}
+		while (ptr != 0 && tdb_rec_free_read(tdb, ptr, &rec) == 0) {
+			*total += rec.rec_len;
+			if (rec.rec_len > *largest) {
+				*largest = rec.rec_len;
+			}
+			ptr = rec.next;
+		}
+	}
+}
+
+static bool records_ok(struct tdb_context *tdb)
+{
+	unsigned int i;
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		TDB_DATA key = { .dptr = (uint8_t *)&i, .dsize = sizeof(i) };
+		TDB_DATA data = tdb_fetch(tdb, key);
+		bool ok;
+
+		if ((i % 2) == 0) {
+			ok = (data.dptr == NULL);
+		} else {
+			ok = (data.dsize == (i % 97) * 8 &&
+			      (data.dsize == 0 || data.dptr[0] == (i & 0xff)));
+		}
+		free(data.dptr);
+		if (!ok) {
+			diag("record %u is wrong", i);
+			return false;
+		}
+	}
+	return true;
+}
+
+static int test_repack_step(int tdb_flags)
+{
+	struct tdb_context *tdb;
+	unsigned char buf[97 * 8];
+	tdb_len_t total, largest, total2, largest2;
+	size_t offset = 0, map_size;
+	unsigned int i, pass;
+	int moved = 0, steps = 0, free_recs;
+
+	tdb = tdb_open_ex("run-repack-step.tdb", 1024,
+			  TDB_CLEAR_IF_FIRST|tdb_flags,
+			  O_CREAT|O_TRUNC|O_RDWR, 0600, &taplogctx, NULL);
+	ok1(tdb);
+
+	for (i = 0; i < NUM_RECORDS; i++) {
+		TDB_DATA key = { .dptr = (uint8_t *)&i, .dsize = sizeof(i) };
+		TDB_DATA data = { .dptr = buf, .dsize = (i % 97) * 8 };
+
+		memset(buf, i & 0xff, sizeof(buf));
+		tdb_store(tdb, key, data, TDB_INSERT);
+	}
+	/* Punch holes all over the file */
+	for (i = 0; i < NUM_RECORDS; i += 2) {
+		TDB_DATA key = { .dptr = (uint8_t *)&i, .dsize = sizeof(i) };
+		tdb_delete(tdb, key);
+	}
+	free_space(tdb, &total, &largest);
+	free_recs = tdb_freelist_size(tdb);
+	map_size = tdb->map_size;
+
+	/* Every pass lets a few more holes merge */
+	for (pass = 0; pass < 50; pass++) {
+		int pass_moved = 0;
+
+		do {
+			int ret = tdb_repack_step(tdb, &offset, 10);
+			if (ret == -1) {
+				break;
+			}
+			pass_moved += ret;
+			steps++;
+		} while (offset != 0);
+
+		if (pass_moved == 0) {
+			break;
+		}
+		moved += pass_moved;
+	}
+
+	ok1(offset == 0);
+	ok1(steps > pass);
+	ok1(moved > 0);
+
+	free_space(tdb, &total2, &largest2);
+	diag("moved %d records in %u passes, largest free %u -> %u of %u",
+	     moved, pass, largest, largest2, total2);
+	ok1(largest2 > largest);
+	ok1(tdb_freelist_size(tdb) < free_recs);
+	ok1(tdb->map_size == map_size);
+	ok1(tdb_check(tdb, NULL, NULL) == 0);
+	ok1(records_ok(tdb));
+
+	/* Not inside a transaction */
+	ok1(tdb_transaction_start(tdb) == 0);
+	ok1(tdb_repack_step(tdb, &offset, 10) == -1);
+	ok1(tdb_error(tdb) == TDB_ERR_EINVAL);
+	tdb_transaction_cancel(tdb);
+
+	tdb_close(tdb);
+	return 0;
+}
+
+int main(int argc, char *argv[])
+{
+	plan_tests(2 * 12);
+
+	test_repack_step(0);
+	test_repack_step(TDB_SEGREGATED_FREELIST);
+
+	return exit_status();
+}
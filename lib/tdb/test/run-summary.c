@@ -25,7 +25,7 @@ int main(int argc, char *argv[])
 	TDB_DATA data = { (unsigned char *)&j, sizeof(j) };
 	char *summary;
 
-	plan_tests(sizeof(flags) / sizeof(flags[0]) * 14);
+	plan_tests(sizeof(flags) / sizeof(flags[0]) * 15);
 	for (i = 0; i < sizeof(flags) / sizeof(flags[0]); i++) {
 		tdb = tdb_open("run-summary.tdb", 131, flags[i],
 			       O_RDWR|O_CREAT|O_TRUNC, 0600);
@@ -53,6 +53,7 @@ int main(int argc, char *argv[])
 		ok1(strstr(summary, "Smallest/average/largest free records: "));
 		ok1(strstr(summary, "Number of hash chains: 131\n"));
 		ok1(strstr(summary, "Smallest/average/largest hash chains: "));
+		ok1(strstr(summary, "Hash chain length distribution 0/1/2-3/4-7/8-15/16-31/32+: "));
 		ok1(strstr(summary, "Number of uncoalesced records: 0\n"));
 		ok1(strstr(summary, "Smallest/average/largest uncoalesced runs: 0/0/0\n"));
 		ok1(strstr(summary, "Percentage keys/data/padding/free/dead/rechdrs&tailers/hashes: "));
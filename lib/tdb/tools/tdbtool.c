@@ -65,6 +65,7 @@ enum commands {
 	CMD_SYSTEM,
 	CMD_CHECK,
 	CMD_REPACK,
+	CMD_DEFRAG,
 	CMD_QUIT,
 	CMD_HELP
 };
@@ -105,6 +106,7 @@ COMMAND_TABLE cmd_table[] = {
 	{"q",		CMD_QUIT},
 	{"!",		CMD_SYSTEM},
 	{"repack",	CMD_REPACK},
+	{"defrag",	CMD_DEFRAG},
 	{NULL,		CMD_HELP}
 };
 
@@ -240,6 +242,8 @@ static void help(void)
 "  freelist_size        : print the number of records in the freelist\n"
 "  check                : check the integrity of an opened database\n"
 "  repack               : repack the database\n"
+"  defrag [batch] [ms]  : defragment the database online, moving up to\n"
+"                         batch records with a pause of ms in between\n"
 "  speed                : perform speed tests on the database\n"
 "  ! command            : execute system command\n"
 "  1 | first            : print the first record\n"
@@ -657,6 +661,38 @@ static int count(TDB_DATA key, TDB_DATA data, void *private_data)
 	return 0;
 }
 
+static void defrag_tdb(const char *batch_str, const char *delay_str)
+{
+	unsigned int batch = batch_str ? atoi(batch_str) : 0;
+	unsigned int delay = delay_str ? atoi(delay_str) : 0;
+	size_t offset = 0;
+	int moved = 0;
+	int ret;
+
+	if (batch == 0) {
+		batch = 100;
+	}
+
+	do {
+		ret = tdb_repack_step(tdb, &offset, batch);
+		if (ret == -1) {
+			printf("Error = %s\n", tdb_errorstr(tdb));
+			return;
+		}
+		moved += ret;
+		if (offset != 0) {
+			printf("\r%3u%%", (unsigned int)
+			       (offset * 100 / tdb_map_size(tdb)));
+			fflush(stdout);
+			if (delay != 0) {
+				usleep(delay * 1000);
+			}
+		}
+	} while (offset != 0);
+
+	printf("\rMoved %d records\n", moved);
+}
+
 static void check_db(TDB_CONTEXT *the_tdb)
 {
 	int tdbcount = 0;
@@ -794,6 +830,10 @@ static int do_command(void)
 		case CMD_SPEED:
 			speed_tdb(arg1);
 			return 0;
+		case CMD_DEFRAG:
+			bIterate = 0;
+			defrag_tdb(arg1, arg2);
+			return 0;
 		case CMD_MMAP:
 			toggle_mmap();
 			return 0;
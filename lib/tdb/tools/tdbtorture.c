@@ -22,6 +22,7 @@
 #define LOCKSTORE_PROB 5
 #define TRAVERSE_PROB 20
 #define TRAVERSE_READ_PROB 20
+#define PARSE_PROB 2
 #define CULL_PROB 100
 #define KEYLEN 3
 #define DATALEN 100
@@ -34,6 +35,10 @@ static int hash_size = 2;
 static unsigned loopnum;
 static int count_pipe;
 static bool mutex = false;
+static bool rwlock = false;
+static bool size_classes = false;
+static bool recovery_csum = false;
+static bool fast_hash = false;
 static struct tdb_logging_context log_ctx;
 
 #ifdef PRINTF_ATTRIBUTE
@@ -106,6 +111,31 @@ static bool do_transaction(void)
 	return false;
 }
 
+static int parse_fn(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	size_t i;
+
+	if (data.dsize == 0) {
+		/* LOCKSTORE_PROB stores empty records */
+		return 0;
+	}
+	if (data.dptr[data.dsize-1] != '\0') {
+		fatal("parse_fn: invalid record");
+		return -1;
+	}
+	/* appended records contain several strings */
+	for (i=0; i<data.dsize-1; i++) {
+		if (data.dptr[i] == '\0') {
+			continue;
+		}
+		if (data.dptr[i] < 'a' || data.dptr[i] > 'z') {
+			fatal("parse_fn: invalid record data");
+			return -1;
+		}
+	}
+	return 0;
+}
+
 static void addrec_db(void)
 {
 	int klen, dlen;
@@ -211,6 +241,17 @@ static void addrec_db(void)
 	}
 #endif
 
+#if PARSE_PROB
+	if (rwlock && random() % PARSE_PROB == 0) {
+		/*
+		 * Concurrent readers on the chain, make them overlap
+		 * with writers and with children getting killed.
+		 */
+		tdb_parse_record(db, key, parse_fn, NULL);
+		goto next;
+	}
+#endif
+
 	data = tdb_fetch(db, key);
 	if (data.dptr) free(data.dptr);
 
@@ -228,7 +269,7 @@ static int traverse_fn(struct tdb_context *tdb, TDB_DATA key, TDB_DATA dbuf,
 
 static void usage(void)
 {
-	printf("Usage: tdbtorture [-t] [-k] [-m] [-n NUM_PROCS] [-l NUM_LOOPS] [-s SEED] [-H HASH_SIZE]\n");
+	printf("Usage: tdbtorture [-t] [-k] [-m] [-r] [-f] [-c] [-x] [-n NUM_PROCS] [-l NUM_LOOPS] [-s SEED] [-H HASH_SIZE]\n");
 	exit(0);
 }
 
@@ -251,6 +292,18 @@ static int run_child(const char *filename, int i, int seed, unsigned num_loops,
 	if (mutex) {
 		tdb_flags |= TDB_MUTEX_LOCKING;
 	}
+	if (rwlock) {
+		tdb_flags |= TDB_MUTEX_RWLOCK;
+	}
+	if (size_classes) {
+		tdb_flags |= TDB_SEGREGATED_FREELIST;
+	}
+	if (recovery_csum) {
+		tdb_flags |= TDB_RECOVERY_CHECKSUM;
+	}
+	if (fast_hash) {
+		tdb_flags |= TDB_FAST_HASH;
+	}
 
 	db = tdb_open_ex(filename, hash_size, tdb_flags,
 			 O_RDWR | O_CREAT, 0600, &log_ctx, NULL);
@@ -324,7 +377,7 @@ int main(int argc, char * const *argv)
 
 	log_ctx.log_fn = tdb_log;
 
-	while ((c = getopt(argc, argv, "n:l:s:H:thkm")) != -1) {
+	while ((c = getopt(argc, argv, "n:l:s:H:thkmrfcx")) != -1) {
 		switch (c) {
 		case 'n':
 			num_procs = strtol(optarg, NULL, 0);
@@ -351,6 +404,23 @@ int main(int argc, char * const *argv)
 				exit(1);
 			}
 			break;
+		case 'r':
+			mutex = tdb_runtime_check_for_robust_mutexes();
+			if (!mutex) {
+				printf("tdb_runtime_check_for_robust_mutexes() returned false\n");
+				exit(1);
+			}
+			rwlock = true;
+			break;
+		case 'f':
+			size_classes = true;
+			break;
+		case 'c':
+			recovery_csum = true;
+			break;
+		case 'x':
+			fast_hash = true;
+			break;
 		default:
 			usage();
 		}
@@ -364,9 +434,10 @@ int main(int argc, char * const *argv)
 		seed = (getpid() + time(NULL)) & 0x7FFFFFFF;
 	}
 
-	printf("Testing with %d processes, %d loops, %d hash_size, seed=%d%s\n",
+	printf("Testing with %d processes, %d loops, %d hash_size, seed=%d%s%s\n",
 	       num_procs, num_loops, hash_size, seed,
-	       (always_transaction ? " (all within transactions)" : ""));
+	       (always_transaction ? " (all within transactions)" : ""),
+	       (rwlock ? " (shared chain mutexes)" : ""));
 
 	if (num_procs == 1 && !kill_random) {
 		/* Don't fork for this case, makes debugging easier. */
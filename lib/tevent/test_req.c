@@ -30,6 +30,9 @@
 #include "lib/util/tevent_unix.h"
 #include "lib/util/tevent_req_profile.h"
 #include "lib/util/time_basic.h"
+#ifdef HAVE_PTHREAD
+#include "system/threads.h"
+#endif
 
 struct tevent_req_create_state {
 	uint8_t val;
@@ -262,6 +265,72 @@ static bool test_tevent_req_profile2(struct torture_context *tctx,
 	return true;
 }
 
+#ifdef HAVE_PTHREAD
+
+#define THREAD_NUM_REQS 64
+
+struct thread_reqs_state {
+	TALLOC_CTX *mem_ctx;
+	struct tevent_req *reqs[THREAD_NUM_REQS];
+};
+
+static void *thread_reqs_fn(void *arg)
+{
+	struct thread_reqs_state *state = arg;
+	struct tevent_req_create_state *rstate = NULL;
+	size_t i;
+
+	for (i = 0; i < THREAD_NUM_REQS; i++) {
+		state->reqs[i] = tevent_req_create(
+			state->mem_ctx,
+			&rstate,
+			struct tevent_req_create_state);
+		if (state->reqs[i] == NULL) {
+			return NULL;
+		}
+	}
+
+	/* Fill the thread's free list, it goes away with the thread */
+	for (i = 0; i < THREAD_NUM_REQS / 2; i++) {
+		TALLOC_FREE(state->reqs[i]);
+	}
+
+	return NULL;
+}
+
+static bool test_tevent_req_thread(struct torture_context *tctx,
+				   const void *test_data)
+{
+	struct thread_reqs_state state = { .mem_ctx = NULL };
+	pthread_t thread_id;
+	size_t i;
+	int ret;
+
+	state.mem_ctx = talloc_new(tctx);
+	torture_assert_not_null(tctx, state.mem_ctx, "talloc_new failed\n");
+
+	ret = pthread_create(&thread_id, NULL, thread_reqs_fn, &state);
+	torture_assert_int_equal(tctx, ret, 0, "pthread_create failed\n");
+	ret = pthread_join(thread_id, NULL);
+	torture_assert_int_equal(tctx, ret, 0, "pthread_join failed\n");
+
+	for (i = THREAD_NUM_REQS / 2; i < THREAD_NUM_REQS; i++) {
+		torture_assert_not_null(tctx,
+					state.reqs[i],
+					"tevent_req_create failed\n");
+	}
+
+	/* The slabs of the thread are gone, free its requests here */
+	for (i = THREAD_NUM_REQS / 2; i < THREAD_NUM_REQS; i++) {
+		TALLOC_FREE(state.reqs[i]);
+	}
+	TALLOC_FREE(state.mem_ctx);
+
+	return true;
+}
+
+#endif
+
 struct torture_suite *torture_local_tevent_req(TALLOC_CTX *mem_ctx)
 {
 	struct torture_suite *suite;
@@ -283,6 +352,13 @@ struct torture_suite *torture_local_tevent_req(TALLOC_CTX *mem_ctx)
 		"profile2",
 		test_tevent_req_profile2,
 		NULL);
+#ifdef HAVE_PTHREAD
+	torture_suite_add_simple_tcase_const(
+		suite,
+		"thread",
+		test_tevent_req_thread,
+		NULL);
+#endif
 
 	return suite;
 }
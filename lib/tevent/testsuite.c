@@ -2522,6 +2522,357 @@ static void *test_cached_pid_thread(void *private_data)
 }
 #endif
 
+#define TEST_TIMER_SPEED_NUM 100000
+
+struct test_timer_speed_state {
+	struct timeval *next_events;
+	struct timeval last;
+	uint64_t last_tag;
+	size_t fired;
+	bool out_of_order;
+};
+
+static void test_timer_speed_handler(struct tevent_context *ev,
+				     struct tevent_timer *te,
+				     struct timeval current_time,
+				     void *private_data)
+{
+	struct test_timer_speed_state *state =
+		(struct test_timer_speed_state *)private_data;
+	uint64_t tag = tevent_timer_get_tag(te);
+	struct timeval next_event = state->next_events[tag];
+	int cmp;
+
+	cmp = tevent_timeval_compare(&next_event, &state->last);
+	if (cmp < 0 || (cmp == 0 && tag < state->last_tag)) {
+		state->out_of_order = true;
+	}
+	state->last = next_event;
+	state->last_tag = tag;
+	state->fired += 1;
+}
+
+static bool test_timer_speed(struct torture_context *test,
+			     const void *test_data)
+{
+	struct tevent_context *ev_ctx = test_tevent_context_init(test);
+	struct test_timer_speed_state state = {};
+	struct tevent_timer **timers = NULL;
+	struct timeval base;
+	struct timeval t;
+	size_t num_freed = 0;
+	size_t i;
+
+	torture_assert(test, ev_ctx != NULL, "tevent_context_init failed");
+
+	timers = talloc_array(test, struct tevent_timer *,
+			      TEST_TIMER_SPEED_NUM);
+	torture_assert(test, timers != NULL, "talloc_array failed");
+	state.next_events = talloc_array(timers, struct timeval,
+					 TEST_TIMER_SPEED_NUM);
+	torture_assert(test, state.next_events != NULL, "talloc_array failed");
+
+	/*
+	 * All timers are in the past, so they fire
+	 * without waiting, but not in insertion order.
+	 * Use only 1000 different times, so that we also
+	 * check the order of timers with the same time.
+	 */
+	t = timeval_current();
+	base = tevent_timeval_set(t.tv_sec - 10, t.tv_usec);
+	for (i = 0; i < TEST_TIMER_SPEED_NUM; i++) {
+		struct timeval next_event =
+			tevent_timeval_add(&base, 0, (random() % 1000) * 1000);
+
+		state.next_events[i] = next_event;
+		timers[i] = tevent_add_timer(ev_ctx, timers, next_event,
+					     test_timer_speed_handler,
+					     &state);
+		torture_assert(test, timers[i] != NULL,
+			       "tevent_add_timer failed");
+		tevent_timer_set_tag(timers[i], i);
+	}
+	torture_comment(test, "Added %.2f timers/sec\n",
+			TEST_TIMER_SPEED_NUM/timeval_elapsed(&t));
+
+	t = timeval_current();
+	for (i = 0; i < TEST_TIMER_SPEED_NUM; i += 3) {
+		TALLOC_FREE(timers[i]);
+		num_freed += 1;
+	}
+	torture_comment(test, "Removed %.2f timers/sec\n",
+			num_freed/timeval_elapsed(&t));
+
+	t = timeval_current();
+	while (state.fired < TEST_TIMER_SPEED_NUM - num_freed) {
+		int ret = tevent_loop_once(ev_ctx);
+		torture_assert(test, ret == 0, "tevent_loop_once failed");
+	}
+	torture_comment(test, "Fired %.2f timers/sec\n",
+			state.fired/timeval_elapsed(&t));
+
+	torture_assert(test, !state.out_of_order, "timers out of order");
+
+	TALLOC_FREE(timers);
+	TALLOC_FREE(ev_ctx);
+
+	return true;
+}
+
+struct test_timer_rearm_state {
+	TALLOC_CTX *mem_ctx;
+	unsigned fired;
+	bool add_failed;
+};
+
+static void test_timer_rearm_future(struct tevent_context *ev,
+				    struct tevent_timer *te,
+				    struct timeval current_time,
+				    void *private_data)
+{
+}
+
+static void test_timer_rearm_handler(struct tevent_context *ev,
+				     struct tevent_timer *te,
+				     struct timeval current_time,
+				     void *private_data)
+{
+	struct test_timer_rearm_state *state =
+		(struct test_timer_rearm_state *)private_data;
+	struct tevent_timer *other = NULL;
+
+	state->fired += 1;
+	if (state->fired > 1) {
+		return;
+	}
+
+	/*
+	 * Take the slot we just left in the heap, then re-arm
+	 * ourselves, which needs one more.
+	 */
+	other = tevent_add_timer(ev, state->mem_ctx,
+				 tevent_timeval_current_ofs(3600, 0),
+				 test_timer_rearm_future,
+				 state);
+	if (other == NULL) {
+		state->add_failed = true;
+	}
+
+	tevent_update_timer(te, tevent_timeval_zero());
+}
+
+static bool test_timer_rearm(struct torture_context *test,
+			     const void *test_data)
+{
+	unsigned num;
+
+	/*
+	 * Try all heap fill levels around the first two
+	 * growth steps, so the heap is full for one of them.
+	 */
+	for (num = 1; num <= 40; num++) {
+		struct tevent_context *ev_ctx = NULL;
+		struct test_timer_rearm_state state = {};
+		struct tevent_timer *te = NULL;
+		unsigned i;
+
+		ev_ctx = test_tevent_context_init(test);
+		torture_assert(test, ev_ctx != NULL,
+			       "tevent_context_init failed");
+		state.mem_ctx = ev_ctx;
+
+		for (i = 1; i < num; i++) {
+			te = tevent_add_timer(ev_ctx, ev_ctx,
+					      tevent_timeval_current_ofs(3600, 0),
+					      test_timer_rearm_future,
+					      &state);
+			torture_assert(test, te != NULL,
+				       "tevent_add_timer failed");
+		}
+
+		te = tevent_add_timer(ev_ctx, ev_ctx,
+				      tevent_timeval_zero(),
+				      test_timer_rearm_handler,
+				      &state);
+		torture_assert(test, te != NULL, "tevent_add_timer failed");
+
+		for (i = 0; (i < 10) && (state.fired < 2); i++) {
+			int ret = tevent_loop_once(ev_ctx);
+			torture_assert(test, ret == 0,
+				       "tevent_loop_once failed");
+		}
+
+		torture_assert(test, !state.add_failed,
+			       "tevent_add_timer in handler failed");
+		torture_assert_int_equal(test, state.fired, 2,
+					 "re-armed timer did not fire again");
+
+		TALLOC_FREE(ev_ctx);
+	}
+
+	return true;
+}
+
+static void test_timer_blocks_handler(struct tevent_context *ev,
+				      struct tevent_timer *te,
+				      struct timeval current_time,
+				      void *private_data)
+{
+	unsigned *fired = (unsigned *)private_data;
+
+	*fired += 1;
+}
+
+static bool test_timer_blocks(struct torture_context *test,
+			      const void *test_data)
+{
+	struct tevent_context *ev_ctx = test_tevent_context_init(test);
+	TALLOC_CTX *mem_ctx = NULL;
+	size_t blocks;
+	unsigned fired = 0;
+	unsigned i;
+
+	torture_assert(test, ev_ctx != NULL, "tevent_context_init failed");
+
+	mem_ctx = talloc_new(test);
+	torture_assert(test, mem_ctx != NULL, "talloc_new failed");
+
+	/*
+	 * Arming timers must not leave talloc children on ev,
+	 * this is what smbtorture checks after each tcase.
+	 * 100 timers grow the heap beyond its initial size.
+	 */
+	blocks = talloc_total_blocks(ev_ctx);
+
+	for (i = 0; i < 100; i++) {
+		struct tevent_timer *te = NULL;
+
+		te = tevent_add_timer(ev_ctx, mem_ctx,
+				      tevent_timeval_zero(),
+				      test_timer_blocks_handler,
+				      &fired);
+		torture_assert(test, te != NULL, "tevent_add_timer failed");
+	}
+
+	while (fired < 100) {
+		int ret = tevent_loop_once(ev_ctx);
+		torture_assert(test, ret == 0, "tevent_loop_once failed");
+	}
+
+	TALLOC_FREE(mem_ctx);
+
+	torture_assert_int_equal(test, talloc_total_blocks(ev_ctx), blocks,
+				 "timers left blocks on the event context");
+
+	TALLOC_FREE(ev_ctx);
+
+	return true;
+}
+
+#define TEST_REQ_SPEED_NUM 100000
+#define TEST_REQ_SPEED_BATCH 100
+
+struct test_req_speed_state {
+	size_t idx;
+};
+
+static struct tevent_req *test_req_speed_send(TALLOC_CTX *mem_ctx,
+					      struct tevent_context *ev,
+					      size_t idx)
+{
+	struct tevent_req *req = NULL;
+	struct test_req_speed_state *state = NULL;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct test_req_speed_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->idx = idx;
+
+	tevent_req_done(req);
+	return tevent_req_post(req, ev);
+}
+
+static void test_req_speed_done(struct tevent_req *req)
+{
+	size_t *done = (size_t *)tevent_req_callback_data_void(req);
+
+	*done += 1;
+	TALLOC_FREE(req);
+}
+
+static bool test_req_speed(struct torture_context *test,
+			   const void *test_data)
+{
+	struct tevent_context *ev_ctx = test_tevent_context_init(test);
+	TALLOC_CTX *frame = NULL;
+	struct timeval t;
+	size_t blocks;
+	size_t done = 0;
+	size_t i;
+
+	torture_assert(test, ev_ctx != NULL, "tevent_context_init failed");
+
+	frame = talloc_new(test);
+	torture_assert(test, frame != NULL, "talloc_new failed");
+	blocks = talloc_total_blocks(frame);
+
+	/*
+	 * The memory of freed requests is recycled,
+	 * so this only measures the cost of tevent_req_create()
+	 * and the destructor chain.
+	 */
+	t = timeval_current();
+	for (i = 0; i < TEST_REQ_SPEED_NUM; i++) {
+		struct tevent_req *req = NULL;
+		struct test_req_speed_state *state = NULL;
+
+		req = tevent_req_create(frame, &state,
+					struct test_req_speed_state);
+		torture_assert(test, req != NULL, "tevent_req_create failed");
+		state->idx = i;
+		TALLOC_FREE(req);
+	}
+	torture_comment(test, "Created and freed %.2f requests/sec\n",
+			TEST_REQ_SPEED_NUM/timeval_elapsed(&t));
+
+	/*
+	 * A more realistic pattern, a batch of requests
+	 * in flight, completed via tevent_req_post().
+	 */
+	t = timeval_current();
+	for (i = 0; i < TEST_REQ_SPEED_NUM; i++) {
+		struct tevent_req *req = NULL;
+
+		req = test_req_speed_send(frame, ev_ctx, i);
+		torture_assert(test, req != NULL,
+			       "test_req_speed_send failed");
+		tevent_req_set_callback(req, test_req_speed_done, &done);
+
+		if ((i % TEST_REQ_SPEED_BATCH) != TEST_REQ_SPEED_BATCH - 1) {
+			continue;
+		}
+		while (done <= i) {
+			int ret = tevent_loop_once(ev_ctx);
+			torture_assert(test, ret == 0,
+				       "tevent_loop_once failed");
+		}
+	}
+	torture_comment(test, "Completed %.2f requests/sec\n",
+			TEST_REQ_SPEED_NUM/timeval_elapsed(&t));
+
+	torture_assert_int_equal(test, done, TEST_REQ_SPEED_NUM,
+				 "not all requests completed");
+	torture_assert_int_equal(test, talloc_total_blocks(frame), blocks,
+				 "requests leaked");
+
+	TALLOC_FREE(frame);
+	TALLOC_FREE(ev_ctx);
+
+	return true;
+}
+
 static bool test_cached_pid(struct torture_context *test,
 			    const void *test_data)
 {
@@ -2647,5 +2998,21 @@ struct torture_suite *torture_local_event(TALLOC_CTX *mem_ctx)
 					     test_cached_pid,
 					     NULL);
 
+	torture_suite_add_simple_tcase_const(suite, "timer_speed",
+					     test_timer_speed,
+					     NULL);
+
+	torture_suite_add_simple_tcase_const(suite, "timer_rearm",
+					     test_timer_rearm,
+					     NULL);
+
+	torture_suite_add_simple_tcase_const(suite, "timer_blocks",
+					     test_timer_blocks,
+					     NULL);
+
+	torture_suite_add_simple_tcase_const(suite, "req_speed",
+					     test_req_speed,
+					     NULL);
+
 	return suite;
 }
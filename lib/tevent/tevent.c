@@ -131,6 +131,9 @@ static void tevent_backend_init(void)
 #if defined(HAVE_EPOLL)
 	tevent_epoll_init();
 #endif
+#if defined(HAVE_TEVENT_IO_URING)
+	tevent_io_uring_init();
+#endif
 
 	tevent_standard_init();
 }
@@ -413,13 +416,12 @@ int tevent_common_context_destructor(struct tevent_context *ev)
 		tevent_common_fd_disarm(fd);
 	}
 
-	ev->last_zero_timer = NULL;
 	for (te = ev->timer_events; te; te = tn) {
 		tn = te->next;
 		tevent_trace_timer_callback(te->event_ctx, te, TEVENT_EVENT_TRACE_DETACH);
+		tevent_common_timer_unlink(ev, te);
 		te->wrapper = NULL;
 		te->event_ctx = NULL;
-		DLIST_REMOVE(ev->timer_events, te);
 	}
 
 	for (ie = ev->immediate_events; ie; ie = in) {
@@ -469,6 +471,11 @@ static int tevent_common_context_constructor(struct tevent_context *ev)
 		return ret;
 	}
 
+	ret = tevent_common_timer_heap_init(ev);
+	if (ret != 0) {
+		return ret;
+	}
+
 #ifdef HAVE_PTHREAD
 
 	ret = pthread_mutex_init(&ev->scheduled_mutex, NULL);
@@ -306,6 +306,9 @@ struct tevent_timer *_tevent_add_timer(struct tevent_context *ev,
 /**
  * @brief Set the time a tevent_timer fires
  *
+ * This can also be called from the timer's own handler, the timer is
+ * then not freed after the handler returns but fires again.
+ *
  * @param[in]  te       The timer event to reset
  *
  * @param[in]  next_event  Timeval specifying the absolute time to fire this
@@ -243,6 +243,10 @@ struct tevent_timer {
 	void *additional_data;
 	/* custom tag that can be set by caller */
 	uint64_t tag;
+	/* position in tevent_context->timers.heap */
+	size_t heap_idx;
+	/* insertion order, keeps timers with equal next_event FIFO */
+	uint64_t seq;
 };
 
 struct tevent_immediate {
@@ -342,9 +346,17 @@ struct tevent_context {
 	/* list of timed events - used by common code */
 	struct tevent_timer *timer_events;
 
-	/* List of scheduled immediates */
+	/*
+	 * List of scheduled immediates. With atomic builtins
+	 * this is a lock free stack (linked via next) pushed by
+	 * the helper threads, scheduled_mutex is only used
+	 * around fork then.
+	 */
 	pthread_mutex_t scheduled_mutex;
 	struct tevent_immediate *scheduled_immediates;
+	/* batches and immediates taken from scheduled_immediates */
+	uint64_t num_scheduled_batches;
+	uint64_t num_scheduled_immediates;
 
 	/* this is private for the events_ops implementation */
 	void *additional_data;
@@ -412,11 +424,14 @@ struct tevent_context {
 	} wrapper;
 
 	/*
-	 * an optimization pointer into timer_events
-	 * used by used by common code via
-	 * tevent_common_add_timer_v2()
+	 * A binary min heap of timer_events ordered by
+	 * next_event and seq, used by common code.
 	 */
-	struct tevent_timer *last_zero_timer;
+	struct {
+		struct tevent_timer **heap;
+		size_t num;
+		uint64_t seq;
+	} timers;
 	struct timeval wait_timeout;
 
 #ifdef HAVE_PTHREAD
@@ -467,6 +482,9 @@ struct tevent_timer *tevent_common_add_timer_v2(struct tevent_context *ev,
 					        const char *handler_name,
 					        const char *location);
 struct timeval tevent_common_loop_timer_delay(struct tevent_context *);
+void tevent_common_timer_unlink(struct tevent_context *ev,
+				struct tevent_timer *te);
+int tevent_common_timer_heap_init(struct tevent_context *ev);
 
 /* timeout values for poll(2) / epoll_wait(2) */
 static inline bool tevent_common_no_timeout(const struct timeval *tv)
@@ -560,6 +578,9 @@ void tevent_epoll_set_panic_fallback(struct tevent_context *ev,
 			bool (*panic_fallback)(struct tevent_context *ev,
 					       bool replay));
 #endif
+#ifdef HAVE_TEVENT_IO_URING
+bool tevent_io_uring_init(void);
+#endif
 
 static inline void tevent_thread_call_depth_notify(
 			enum tevent_thread_call_depth_cmd cmd,
@@ -0,0 +1,937 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   main select loop and event handling - io_uring implementation
+
+   Copyright (C) Samba Team 2026
+
+     ** NOTE! The following LGPL license applies to the tevent
+     ** library. This does NOT imply that all of Samba is released
+     ** under the LGPL
+
+   This library is free software; you can redistribute it and/or
+   modify it under the terms of the GNU Lesser General Public
+   License as published by the Free Software Foundation; either
+   version 3 of the License, or (at your option) any later version.
+
+   This library is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+   Lesser General Public License for more details.
+
+   You should have received a copy of the GNU Lesser General Public
+   License along with this library; if not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "system/filesys.h"
+#include "system/select.h"
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "tevent.h"
+#include "tevent_internal.h"
+#include "tevent_util.h"
+
+/*
+ * This backend uses IORING_OP_POLL_ADD requests instead of
+ * epoll_ctl() and epoll_wait(). All modifications of the
+ * interest set are queued up in the submission ring and
+ * handed to the kernel together with the wait for completions,
+ * so a loop iteration that changes fd flags costs a single
+ * io_uring_enter() syscall.
+ *
+ * tevent fd events are level triggered, so we use one shot poll
+ * requests and re-arm them after the handler returned.
+ * Multishot poll requests are edge triggered and would
+ * require every handler to drain its fd completely.
+ */
+
+#define IO_URING_EVENT_ENTRIES 1024
+
+struct io_uring_event_fde;
+
+struct io_uring_event_context {
+	/* a pointer back to the generic event_context */
+	struct tevent_context *ev;
+
+	int ring_fd;
+	pid_t pid;
+
+	void *sq_ring;
+	size_t sq_ring_size;
+	void *cq_ring;
+	size_t cq_ring_size;
+	struct io_uring_sqe *sqes;
+	size_t sqes_size;
+
+	unsigned *sq_head;
+	unsigned *sq_tail;
+	unsigned *sq_mask;
+	unsigned *sq_entries;
+	unsigned *sq_array;
+	unsigned sq_local_tail;
+
+	unsigned *cq_head;
+	unsigned *cq_tail;
+	unsigned *cq_mask;
+	struct io_uring_cqe *cqes;
+
+	/*
+	 * fdes that need a POLL_ADD or POLL_REMOVE
+	 * before the next wait.
+	 */
+	struct io_uring_event_fde *dirty;
+
+	/*
+	 * fdes with a completed poll request,
+	 * which are not yet passed to their handler.
+	 */
+	struct io_uring_event_fde *ready;
+
+	/*
+	 * fdes that were freed while their poll request
+	 * was pending.
+	 */
+	struct io_uring_event_fde *orphans;
+};
+
+enum io_uring_event_fde_list {
+	IO_URING_EVENT_FDE_NONE = 0,
+	IO_URING_EVENT_FDE_DIRTY,
+	IO_URING_EVENT_FDE_READY,
+	IO_URING_EVENT_FDE_ORPHAN,
+};
+
+/*
+ * The per fde state. This is a child of the io_uring_event_context
+ * and not of the fde, as it has to stay around until the kernel
+ * has completed (or cancelled) its poll request.
+ */
+struct io_uring_event_fde {
+	struct io_uring_event_fde *prev, *next;
+	enum io_uring_event_fde_list list;
+
+	/* NULL once the fde was freed */
+	struct tevent_fd *fde;
+
+	/* poll mask of the pending poll request, 0 if none */
+	uint32_t armed;
+	/* a POLL_REMOVE for the pending poll request was queued */
+	bool removing;
+	/* the result of the last completed poll request */
+	uint32_t revents;
+};
+
+static int io_uring_event_setup(struct io_uring_event_context *uring_ev);
+static void io_uring_event_teardown(struct io_uring_event_context *uring_ev);
+
+static int io_uring_event_context_destructor(
+	struct io_uring_event_context *uring_ev)
+{
+	io_uring_event_teardown(uring_ev);
+	return 0;
+}
+
+static void io_uring_event_teardown(struct io_uring_event_context *uring_ev)
+{
+	if (uring_ev->sqes != NULL) {
+		munmap(uring_ev->sqes, uring_ev->sqes_size);
+		uring_ev->sqes = NULL;
+	}
+	if (uring_ev->cq_ring != NULL &&
+	    uring_ev->cq_ring != uring_ev->sq_ring) {
+		munmap(uring_ev->cq_ring, uring_ev->cq_ring_size);
+	}
+	uring_ev->cq_ring = NULL;
+	if (uring_ev->sq_ring != NULL) {
+		munmap(uring_ev->sq_ring, uring_ev->sq_ring_size);
+		uring_ev->sq_ring = NULL;
+	}
+	if (uring_ev->ring_fd != -1) {
+		close(uring_ev->ring_fd);
+		uring_ev->ring_fd = -1;
+	}
+}
+
+static int io_uring_event_setup(struct io_uring_event_context *uring_ev)
+{
+	struct io_uring_params p = {
+		.flags = IORING_SETUP_CLAMP,
+	};
+	uint32_t required = IORING_FEAT_NODROP | IORING_FEAT_EXT_ARG;
+	uint8_t *sq, *cq;
+	int fd;
+
+	fd = syscall(__NR_io_uring_setup, IO_URING_EVENT_ENTRIES, &p);
+	if (fd == -1) {
+		return -1;
+	}
+	uring_ev->ring_fd = fd;
+
+	if ((p.features & required) != required) {
+		tevent_debug(uring_ev->ev, TEVENT_DEBUG_WARNING,
+			     "io_uring lacks features 0x%x\n",
+			     (unsigned)(required & ~p.features));
+		goto fail;
+	}
+
+	/*
+	 * Don't let a forked child run the ring of its parent.
+	 */
+	if (fcntl(fd, F_SETFD, FD_CLOEXEC) == -1) {
+		goto fail;
+	}
+
+	uring_ev->sq_ring_size = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	uring_ev->cq_ring_size = p.cq_off.cqes +
+		p.cq_entries * sizeof(struct io_uring_cqe);
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		uring_ev->sq_ring_size = MAX(uring_ev->sq_ring_size,
+					     uring_ev->cq_ring_size);
+		uring_ev->cq_ring_size = uring_ev->sq_ring_size;
+	}
+
+	sq = mmap(NULL, uring_ev->sq_ring_size, PROT_READ|PROT_WRITE,
+		  MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+	if (sq == MAP_FAILED) {
+		goto fail;
+	}
+	uring_ev->sq_ring = sq;
+
+	if (p.features & IORING_FEAT_SINGLE_MMAP) {
+		cq = sq;
+	} else {
+		cq = mmap(NULL, uring_ev->cq_ring_size, PROT_READ|PROT_WRITE,
+			  MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+		if (cq == MAP_FAILED) {
+			goto fail;
+		}
+	}
+	uring_ev->cq_ring = cq;
+
+	uring_ev->sqes_size = p.sq_entries * sizeof(struct io_uring_sqe);
+	uring_ev->sqes = mmap(NULL, uring_ev->sqes_size, PROT_READ|PROT_WRITE,
+			      MAP_SHARED|MAP_POPULATE, fd, IORING_OFF_SQES);
+	if (uring_ev->sqes == MAP_FAILED) {
+		uring_ev->sqes = NULL;
+		goto fail;
+	}
+
+	uring_ev->sq_head = (unsigned *)(sq + p.sq_off.head);
+	uring_ev->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+	uring_ev->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+	uring_ev->sq_entries = (unsigned *)(sq + p.sq_off.ring_entries);
+	uring_ev->sq_array = (unsigned *)(sq + p.sq_off.array);
+	uring_ev->sq_local_tail = *uring_ev->sq_tail;
+
+	uring_ev->cq_head = (unsigned *)(cq + p.cq_off.head);
+	uring_ev->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+	uring_ev->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+	uring_ev->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+
+	uring_ev->pid = tevent_cached_getpid();
+
+	return 0;
+
+fail:
+	io_uring_event_teardown(uring_ev);
+	errno = ENOSYS;
+	return -1;
+}
+
+/*
+  create a io_uring_event_context structure.
+*/
+static int io_uring_event_context_init(struct tevent_context *ev)
+{
+	struct io_uring_event_context *uring_ev;
+	int ret;
+
+	/*
+	 * we might be called during tevent_re_initialise()
+	 * which means we need to free our old additional_data.
+	 */
+	TALLOC_FREE(ev->additional_data);
+
+	uring_ev = talloc_zero(ev, struct io_uring_event_context);
+	if (uring_ev == NULL) {
+		return -1;
+	}
+	uring_ev->ev = ev;
+	uring_ev->ring_fd = -1;
+	talloc_set_destructor(uring_ev, io_uring_event_context_destructor);
+
+	ret = io_uring_event_setup(uring_ev);
+	if (ret != 0) {
+		talloc_free(uring_ev);
+		return -1;
+	}
+
+	ev->additional_data = uring_ev;
+	return 0;
+}
+
+/*
+  map from TEVENT_FD_* to POLLIN/POLLOUT, see poll_map_flags()
+*/
+static uint32_t io_uring_map_flags(uint16_t flags)
+{
+	uint32_t pollflags = 0;
+
+	if (flags & TEVENT_FD_READ) {
+		pollflags |= POLLIN;
+#ifdef POLLRDHUP
+		pollflags |= POLLRDHUP;
+#endif
+	}
+	if (flags & TEVENT_FD_WRITE) {
+		pollflags |= POLLOUT;
+	}
+	if (flags & TEVENT_FD_ERROR) {
+#ifdef POLLRDHUP
+		pollflags |= POLLRDHUP;
+#endif
+	}
+
+	return pollflags;
+}
+
+static void io_uring_event_fde_list_remove(
+	struct io_uring_event_context *uring_ev,
+	struct io_uring_event_fde *ufde)
+{
+	switch (ufde->list) {
+	case IO_URING_EVENT_FDE_NONE:
+		break;
+	case IO_URING_EVENT_FDE_DIRTY:
+		DLIST_REMOVE(uring_ev->dirty, ufde);
+		break;
+	case IO_URING_EVENT_FDE_READY:
+		DLIST_REMOVE(uring_ev->ready, ufde);
+		break;
+	case IO_URING_EVENT_FDE_ORPHAN:
+		DLIST_REMOVE(uring_ev->orphans, ufde);
+		break;
+	}
+	ufde->list = IO_URING_EVENT_FDE_NONE;
+}
+
+static void io_uring_event_fde_free(struct io_uring_event_context *uring_ev,
+				    struct io_uring_event_fde *ufde)
+{
+	io_uring_event_fde_list_remove(uring_ev, ufde);
+	talloc_free(ufde);
+}
+
+/*
+  Decide if the fde needs a new poll request or the cancellation
+  of the pending one, to be sent before the next wait.
+*/
+static void io_uring_event_fde_update(struct io_uring_event_context *uring_ev,
+				      struct io_uring_event_fde *ufde)
+{
+	uint32_t wanted = 0;
+
+	if (ufde->list != IO_URING_EVENT_FDE_NONE) {
+		/*
+		 * Already dirty, or we'll be called again
+		 * after the handler was invoked.
+		 */
+		return;
+	}
+
+	if (ufde->fde != NULL) {
+		wanted = io_uring_map_flags(ufde->fde->flags);
+	}
+
+	if (ufde->armed != 0) {
+		if (ufde->armed == wanted || ufde->removing) {
+			return;
+		}
+	} else if (wanted == 0) {
+		return;
+	}
+
+	ufde->list = IO_URING_EVENT_FDE_DIRTY;
+	DLIST_ADD_END(uring_ev->dirty, ufde);
+}
+
+static int io_uring_event_enter(struct io_uring_event_context *uring_ev,
+				unsigned min_complete,
+				const struct timespec *ts)
+{
+	struct io_uring_getevents_arg arg = {
+		.ts = (uint64_t)(uintptr_t)ts,
+	};
+	unsigned to_submit;
+	unsigned flags = 0;
+	int ret;
+
+	to_submit = uring_ev->sq_local_tail -
+		__atomic_load_n(uring_ev->sq_head, __ATOMIC_ACQUIRE);
+	__atomic_store_n(uring_ev->sq_tail, uring_ev->sq_local_tail,
+			 __ATOMIC_RELEASE);
+
+	if (min_complete > 0) {
+		flags |= IORING_ENTER_GETEVENTS | IORING_ENTER_EXT_ARG;
+	}
+
+	ret = syscall(__NR_io_uring_enter, uring_ev->ring_fd, to_submit,
+		      min_complete, flags,
+		      (flags & IORING_ENTER_EXT_ARG) ? &arg : NULL,
+		      (flags & IORING_ENTER_EXT_ARG) ? sizeof(arg) : 0);
+	return ret;
+}
+
+static struct io_uring_sqe *io_uring_event_get_sqe(
+	struct io_uring_event_context *uring_ev)
+{
+	struct io_uring_sqe *sqe = NULL;
+	unsigned head;
+	unsigned idx;
+
+	head = __atomic_load_n(uring_ev->sq_head, __ATOMIC_ACQUIRE);
+	if (uring_ev->sq_local_tail - head >= *uring_ev->sq_entries) {
+		/*
+		 * The submission ring is full, hand what we have
+		 * to the kernel.
+		 */
+		io_uring_event_enter(uring_ev, 0, NULL);
+		head = __atomic_load_n(uring_ev->sq_head, __ATOMIC_ACQUIRE);
+		if (uring_ev->sq_local_tail - head >= *uring_ev->sq_entries) {
+			return NULL;
+		}
+	}
+
+	idx = uring_ev->sq_local_tail & *uring_ev->sq_mask;
+	sqe = &uring_ev->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	uring_ev->sq_array[idx] = idx;
+	uring_ev->sq_local_tail += 1;
+
+	return sqe;
+}
+
+static bool io_uring_event_queue_remove(struct io_uring_event_context *uring_ev,
+					struct io_uring_event_fde *ufde)
+{
+	struct io_uring_sqe *sqe = NULL;
+
+	sqe = io_uring_event_get_sqe(uring_ev);
+	if (sqe == NULL) {
+		return false;
+	}
+
+	sqe->opcode = IORING_OP_POLL_REMOVE;
+	sqe->fd = -1;
+	sqe->addr = (uint64_t)(uintptr_t)ufde;
+	/* the completion of the POLL_REMOVE itself is ignored */
+	sqe->user_data = 0;
+
+	ufde->removing = true;
+	return true;
+}
+
+static bool io_uring_event_queue_add(struct io_uring_event_context *uring_ev,
+				     struct io_uring_event_fde *ufde,
+				     uint32_t mask)
+{
+	struct io_uring_sqe *sqe = NULL;
+
+	sqe = io_uring_event_get_sqe(uring_ev);
+	if (sqe == NULL) {
+		return false;
+	}
+
+	sqe->opcode = IORING_OP_POLL_ADD;
+	sqe->fd = ufde->fde->fd;
+#if __BYTE_ORDER == __BIG_ENDIAN
+	sqe->poll32_events = (mask << 16) | (mask >> 16);
+#else
+	sqe->poll32_events = mask;
+#endif
+	sqe->user_data = (uint64_t)(uintptr_t)ufde;
+
+	ufde->armed = mask;
+	ufde->removing = false;
+	return true;
+}
+
+/*
+  Turn the dirty list into submission queue entries
+*/
+static void io_uring_event_prepare(struct io_uring_event_context *uring_ev)
+{
+	struct io_uring_event_fde *ufde = NULL;
+
+	while ((ufde = uring_ev->dirty) != NULL) {
+		uint32_t wanted = 0;
+		bool ok = true;
+
+		if (ufde->fde != NULL) {
+			wanted = io_uring_map_flags(ufde->fde->flags);
+		}
+
+		if (ufde->armed != 0) {
+			if (ufde->armed != wanted && !ufde->removing) {
+				ok = io_uring_event_queue_remove(uring_ev,
+								 ufde);
+			}
+		} else if (wanted != 0) {
+			ok = io_uring_event_queue_add(uring_ev, ufde, wanted);
+		}
+		if (!ok) {
+			/* try again in the next loop iteration */
+			return;
+		}
+
+		io_uring_event_fde_list_remove(uring_ev, ufde);
+	}
+}
+
+static void io_uring_event_complete(struct io_uring_event_context *uring_ev,
+				    struct io_uring_event_fde *ufde,
+				    int32_t res)
+{
+	struct tevent_fd *fde = ufde->fde;
+
+	ufde->armed = 0;
+	ufde->removing = false;
+
+	if (fde == NULL) {
+		/*
+		 * The fde was freed while the poll request
+		 * was pending.
+		 */
+		io_uring_event_fde_free(uring_ev, ufde);
+		return;
+	}
+
+	if (res == -ECANCELED) {
+		/*
+		 * We removed the poll request because
+		 * the flags changed.
+		 */
+		io_uring_event_fde_update(uring_ev, ufde);
+		return;
+	}
+
+	if (res < 0 || (res & POLLNVAL)) {
+		/*
+		 * the socket is dead! this should never
+		 * happen as the socket should have first been
+		 * made readable and that should have removed
+		 * the event, so this must be a bug.
+		 *
+		 * We ignore it here to match the epoll
+		 * behavior.
+		 */
+		tevent_debug(uring_ev->ev, TEVENT_DEBUG_ERROR,
+			     "POLLNVAL on fde[%p] fd[%d] - disabling\n",
+			     fde, fde->fd);
+		fde->additional_data = NULL;
+		ufde->fde = NULL;
+		io_uring_event_fde_free(uring_ev, ufde);
+		tevent_common_fd_disarm(fde);
+		return;
+	}
+
+	ufde->revents = res;
+	io_uring_event_fde_list_remove(uring_ev, ufde);
+	ufde->list = IO_URING_EVENT_FDE_READY;
+	DLIST_ADD_END(uring_ev->ready, ufde);
+}
+
+static void io_uring_event_reap(struct io_uring_event_context *uring_ev)
+{
+	unsigned head = *uring_ev->cq_head;
+	unsigned tail;
+
+	tail = __atomic_load_n(uring_ev->cq_tail, __ATOMIC_ACQUIRE);
+
+	while (head != tail) {
+		struct io_uring_cqe *cqe = NULL;
+		uint64_t user_data;
+		int32_t res;
+
+		cqe = &uring_ev->cqes[head & *uring_ev->cq_mask];
+		user_data = cqe->user_data;
+		res = cqe->res;
+		head += 1;
+
+		if (user_data != 0) {
+			struct io_uring_event_fde *ufde =
+				(struct io_uring_event_fde *)(uintptr_t)user_data;
+			io_uring_event_complete(uring_ev, ufde, res);
+		}
+	}
+
+	__atomic_store_n(uring_ev->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/*
+  reopen the ring when our pid changes, see epoll_check_reopen()
+*/
+static int io_uring_event_check_reopen(struct io_uring_event_context *uring_ev)
+{
+	struct tevent_fd *fde = NULL;
+	int ret;
+
+	if (uring_ev->pid == tevent_cached_getpid()) {
+		return 0;
+	}
+
+	/*
+	 * The pending poll requests belong to the
+	 * ring of our parent.
+	 */
+	io_uring_event_teardown(uring_ev);
+	ret = io_uring_event_setup(uring_ev);
+	if (ret != 0) {
+		tevent_debug(uring_ev->ev, TEVENT_DEBUG_FATAL,
+			     "io_uring_setup() failed after fork\n");
+		return -1;
+	}
+
+	while (uring_ev->orphans != NULL) {
+		io_uring_event_fde_free(uring_ev, uring_ev->orphans);
+	}
+
+	for (fde = uring_ev->ev->fd_events; fde != NULL; fde = fde->next) {
+		struct io_uring_event_fde *ufde = talloc_get_type_abort(
+			fde->additional_data, struct io_uring_event_fde);
+
+		ufde->armed = 0;
+		ufde->removing = false;
+		io_uring_event_fde_list_remove(uring_ev, ufde);
+		io_uring_event_fde_update(uring_ev, ufde);
+	}
+
+	return 0;
+}
+
+/*
+  destroy an fd_event
+*/
+static int io_uring_event_fd_destructor(struct tevent_fd *fde)
+{
+	struct tevent_context *ev = fde->event_ctx;
+	struct io_uring_event_context *uring_ev = NULL;
+	struct io_uring_event_fde *ufde = NULL;
+
+	if (ev == NULL) {
+		goto done;
+	}
+
+	uring_ev = talloc_get_type_abort(
+		ev->additional_data, struct io_uring_event_context);
+
+	ufde = talloc_get_type(fde->additional_data,
+			       struct io_uring_event_fde);
+	if (ufde == NULL) {
+		goto done;
+	}
+	fde->additional_data = NULL;
+	ufde->fde = NULL;
+
+	if (uring_ev->pid != tevent_cached_getpid() || ufde->armed == 0) {
+		io_uring_event_fde_free(uring_ev, ufde);
+		goto done;
+	}
+
+	io_uring_event_fde_list_remove(uring_ev, ufde);
+	ufde->list = IO_URING_EVENT_FDE_ORPHAN;
+	DLIST_ADD(uring_ev->orphans, ufde);
+
+	/*
+	 * The pending poll request holds a reference
+	 * on the file, cancel it before the fd might be
+	 * closed by tevent_common_fd_destructor(),
+	 * otherwise the peer would not notice the close.
+	 * The poll request completes with -ECANCELED
+	 * and frees the orphaned ufde.
+	 */
+	if (!ufde->removing) {
+		io_uring_event_queue_remove(uring_ev, ufde);
+	}
+	io_uring_event_enter(uring_ev, 0, NULL);
+
+done:
+	return tevent_common_fd_destructor(fde);
+}
+
+/*
+  add a fd based event
+  return NULL on failure (memory allocation error)
+*/
+static struct tevent_fd *io_uring_event_add_fd(struct tevent_context *ev,
+					       TALLOC_CTX *mem_ctx,
+					       int fd, uint16_t flags,
+					       tevent_fd_handler_t handler,
+					       void *private_data,
+					       const char *handler_name,
+					       const char *location)
+{
+	struct io_uring_event_context *uring_ev = talloc_get_type_abort(
+		ev->additional_data, struct io_uring_event_context);
+	struct io_uring_event_fde *ufde = NULL;
+	struct tevent_fd *fde = NULL;
+
+	if (fd < 0) {
+		return NULL;
+	}
+
+	ufde = talloc_zero(uring_ev, struct io_uring_event_fde);
+	if (ufde == NULL) {
+		return NULL;
+	}
+
+	fde = tevent_common_add_fd(ev,
+				   mem_ctx,
+				   fd,
+				   flags,
+				   handler,
+				   private_data,
+				   handler_name,
+				   location);
+	if (fde == NULL) {
+		talloc_free(ufde);
+		return NULL;
+	}
+
+	tevent_common_fd_mpx_reinit(fde);
+	ufde->fde = fde;
+	fde->additional_data = ufde;
+	talloc_set_destructor(fde, io_uring_event_fd_destructor);
+
+	io_uring_event_fde_update(uring_ev, ufde);
+
+	return fde;
+}
+
+/*
+  set the fd event flags
+*/
+static void io_uring_event_set_fd_flags(struct tevent_fd *fde, uint16_t flags)
+{
+	struct tevent_context *ev = fde->event_ctx;
+	struct io_uring_event_context *uring_ev = NULL;
+	struct io_uring_event_fde *ufde = NULL;
+
+	if (ev == NULL) {
+		return;
+	}
+
+	if (fde->flags == flags) {
+		return;
+	}
+
+	uring_ev = talloc_get_type_abort(
+		ev->additional_data, struct io_uring_event_context);
+
+	fde->flags = flags;
+
+	ufde = talloc_get_type(fde->additional_data,
+			       struct io_uring_event_fde);
+	if (ufde == NULL) {
+		return;
+	}
+
+	io_uring_event_fde_update(uring_ev, ufde);
+}
+
+/*
+  call the handler of the first ready fde
+*/
+static int io_uring_event_dispatch(struct io_uring_event_context *uring_ev)
+{
+	struct io_uring_event_fde *ufde = NULL;
+
+	while ((ufde = uring_ev->ready) != NULL) {
+		struct tevent_fd *fde = ufde->fde;
+		uint32_t revents = ufde->revents;
+		uint16_t flags = 0;
+		bool removed = false;
+		int ret;
+
+		io_uring_event_fde_list_remove(uring_ev, ufde);
+
+#ifdef POLLRDHUP
+#define __POLL_RETURN_ERROR_FLAGS (POLLHUP|POLLERR|POLLRDHUP)
+#else
+#define __POLL_RETURN_ERROR_FLAGS (POLLHUP|POLLERR)
+#endif
+
+		if (revents & __POLL_RETURN_ERROR_FLAGS) {
+			/*
+			 * If we only wait for TEVENT_FD_WRITE, we
+			 * should not tell the event handler about it,
+			 * and remove the writable flag, as we only
+			 * report errors when waiting for read events
+			 * or explicit for errors.
+			 */
+			if (!(fde->flags & (TEVENT_FD_READ|TEVENT_FD_ERROR)))
+			{
+				TEVENT_FD_NOT_WRITEABLE(fde);
+				io_uring_event_fde_update(uring_ev, ufde);
+				continue;
+			}
+			if (fde->flags & TEVENT_FD_ERROR) {
+				flags |= TEVENT_FD_ERROR;
+			}
+			if (fde->flags & TEVENT_FD_READ) {
+				flags |= TEVENT_FD_READ;
+			}
+		}
+		if (revents & POLLIN) {
+			flags |= TEVENT_FD_READ;
+		}
+		if (revents & POLLOUT) {
+			flags |= TEVENT_FD_WRITE;
+		}
+		/*
+		 * The flags might have changed since
+		 * the poll request was submitted.
+		 */
+		flags &= fde->flags;
+		if (flags == 0) {
+			io_uring_event_fde_update(uring_ev, ufde);
+			continue;
+		}
+
+		ret = tevent_common_invoke_fd_handler(fde, flags, &removed);
+		if (!removed) {
+			io_uring_event_fde_update(uring_ev, ufde);
+		}
+		return ret;
+	}
+
+	return 0;
+}
+
+/*
+  event loop handling using io_uring
+*/
+static int io_uring_event_loop(struct io_uring_event_context *uring_ev,
+			       struct timeval *tvalp)
+{
+	struct tevent_context *ev = uring_ev->ev;
+	int timeout = tevent_common_timeout_msec(tvalp);
+	struct timespec ts = {
+		.tv_sec = timeout / 1000,
+		.tv_nsec = (timeout % 1000) * 1000000,
+	};
+	int ret;
+	int wait_errno;
+
+	if (ev->signal_events && tevent_common_check_signal(ev)) {
+		return 0;
+	}
+
+	ret = io_uring_event_check_reopen(uring_ev);
+	if (ret != 0) {
+		return -1;
+	}
+
+	if (uring_ev->ready != NULL) {
+		/*
+		 * Handlers from the last batch of completions
+		 * are still pending, don't wait.
+		 */
+		return io_uring_event_dispatch(uring_ev);
+	}
+
+	io_uring_event_prepare(uring_ev);
+
+	tevent_trace_point_callback(ev, TEVENT_TRACE_BEFORE_WAIT);
+	ret = io_uring_event_enter(uring_ev, 1, (timeout < 0) ? NULL : &ts);
+	wait_errno = errno;
+	tevent_trace_point_callback(ev, TEVENT_TRACE_AFTER_WAIT);
+
+	if (ret == -1 && wait_errno == EINTR && ev->signal_events) {
+		tevent_common_check_signal(ev);
+		return 0;
+	}
+
+	if (ret == -1 &&
+	    wait_errno != EINTR &&
+	    wait_errno != ETIME &&
+	    wait_errno != EBUSY &&
+	    wait_errno != EAGAIN)
+	{
+		tevent_debug(ev, TEVENT_DEBUG_FATAL,
+			     "io_uring_enter() failed: %s\n",
+			     strerror(wait_errno));
+		errno = wait_errno;
+		return -1;
+	}
+
+	io_uring_event_reap(uring_ev);
+
+	if (uring_ev->ready == NULL) {
+		/*
+		 * tevent_context_set_wait_timeout(0) was used.
+		 */
+		if (tevent_common_no_timeout(tvalp)) {
+			errno = EAGAIN;
+			return -1;
+		}
+
+		/* we don't care about a possible delay here */
+		tevent_common_loop_timer_delay(ev);
+		return 0;
+	}
+
+	return io_uring_event_dispatch(uring_ev);
+}
+
+/*
+  do a single event loop using the events defined in ev
+*/
+static int io_uring_event_loop_once(struct tevent_context *ev,
+				    const char *location)
+{
+	struct io_uring_event_context *uring_ev = talloc_get_type_abort(
+		ev->additional_data, struct io_uring_event_context);
+	struct timeval tval;
+
+	if (ev->signal_events &&
+	    tevent_common_check_signal(ev)) {
+		return 0;
+	}
+
+	if (ev->threaded_contexts != NULL) {
+		tevent_common_threaded_activate_immediate(ev);
+	}
+
+	if (ev->immediate_events &&
+	    tevent_common_loop_immediate(ev)) {
+		return 0;
+	}
+
+	tval = tevent_common_loop_timer_delay(ev);
+	if (tevent_timeval_is_zero(&tval)) {
+		return 0;
+	}
+
+	return io_uring_event_loop(uring_ev, &tval);
+}
+
+static const struct tevent_ops io_uring_event_ops = {
+	.context_init		= io_uring_event_context_init,
+	.add_fd			= io_uring_event_add_fd,
+	.set_fd_close_fn	= tevent_common_fd_set_close_fn,
+	.get_fd_flags		= tevent_common_fd_get_flags,
+	.set_fd_flags		= io_uring_event_set_fd_flags,
+	.add_timer		= tevent_common_add_timer_v2,
+	.schedule_immediate	= tevent_common_schedule_immediate,
+	.add_signal		= tevent_common_add_signal,
+	.loop_once		= io_uring_event_loop_once,
+	.loop_wait		= tevent_common_loop_wait,
+};
+
+_PRIVATE_ bool tevent_io_uring_init(void)
+{
+	return tevent_register_backend("io_uring", &io_uring_event_ops);
+}
@@ -23,6 +23,9 @@
 */
 
 #include "replace.h"
+#ifdef HAVE_PTHREAD
+#include "system/threads.h"
+#endif
 #include "tevent.h"
 #include "tevent_internal.h"
 #include "tevent_util.h"
@@ -62,6 +65,121 @@ char *tevent_req_print(TALLOC_CTX *mem_ctx, struct tevent_req *req)
 
 static int tevent_req_destructor(struct tevent_req *req);
 
+/*
+ * Requests are created and freed at a high rate, most of them with
+ * a state of a few hundred bytes. Keep their memory in talloc slabs
+ * per size class of the state. A talloc slab belongs to one thread,
+ * so every thread has its own set. It is freed when the thread
+ * exits, requests still alive then go back to free(3) later.
+ *
+ * This needs thread local storage and a thread exit hook, without
+ * them requests are allocated normally.
+ */
+#define TEVENT_REQ_SLAB_CLASS_SIZE 64
+#define TEVENT_REQ_SLAB_NUM_CLASSES 16
+#define TEVENT_REQ_SLAB_CACHED 16
+
+#if defined(HAVE___THREAD) && defined(HAVE_PTHREAD)
+
+struct tevent_req_slabs {
+	struct talloc_slab *slabs[TEVENT_REQ_SLAB_NUM_CLASSES];
+};
+
+static pthread_once_t tevent_req_slabs_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tevent_req_slabs_key;
+static bool tevent_req_slabs_key_ok;
+static __thread struct tevent_req_slabs *tevent_req_slabs_g;
+
+static void tevent_req_slabs_free(void *ptr)
+{
+	struct tevent_req_slabs *slabs = talloc_get_type_abort(
+		ptr, struct tevent_req_slabs);
+
+	tevent_req_slabs_g = NULL;
+	TALLOC_FREE(slabs);
+}
+
+static void tevent_req_slabs_init_key(void)
+{
+	int ret;
+
+	ret = pthread_key_create(&tevent_req_slabs_key,
+				 tevent_req_slabs_free);
+	tevent_req_slabs_key_ok = (ret == 0);
+}
+
+static struct tevent_req_slabs *tevent_req_slabs_get(void)
+{
+	struct tevent_req_slabs *slabs = tevent_req_slabs_g;
+	int ret;
+
+	if (slabs != NULL) {
+		return slabs;
+	}
+
+	ret = pthread_once(&tevent_req_slabs_once, tevent_req_slabs_init_key);
+	if ((ret != 0) || !tevent_req_slabs_key_ok) {
+		return NULL;
+	}
+
+	slabs = talloc_zero(NULL, struct tevent_req_slabs);
+	if (slabs == NULL) {
+		return NULL;
+	}
+
+	ret = pthread_setspecific(tevent_req_slabs_key, slabs);
+	if (ret != 0) {
+		TALLOC_FREE(slabs);
+		return NULL;
+	}
+
+	tevent_req_slabs_g = slabs;
+	return slabs;
+}
+
+static struct talloc_slab *tevent_req_slab(size_t data_size)
+{
+	struct tevent_req_slabs *slabs = NULL;
+	size_t idx = 0;
+
+	if (data_size > 0) {
+		idx = (data_size - 1) / TEVENT_REQ_SLAB_CLASS_SIZE;
+	}
+	if (idx >= TEVENT_REQ_SLAB_NUM_CLASSES) {
+		return NULL;
+	}
+
+	slabs = tevent_req_slabs_get();
+	if (slabs == NULL) {
+		return NULL;
+	}
+
+	if (slabs->slabs[idx] == NULL) {
+		/*
+		 * On failure we just keep falling back to normal
+		 * allocations
+		 */
+		slabs->slabs[idx] = talloc_slab_create(
+			slabs,
+			sizeof(struct tevent_req) +
+			sizeof(struct tevent_immediate) +
+			(idx + 1) * TEVENT_REQ_SLAB_CLASS_SIZE,
+			2,
+			TEVENT_REQ_SLAB_CACHED);
+	}
+
+	return slabs->slabs[idx];
+}
+
+#else
+
+static struct talloc_slab *tevent_req_slab(size_t data_size)
+{
+	return NULL;
+}
+
+#endif
+
 struct tevent_req *_tevent_req_create(TALLOC_CTX *mem_ctx,
 				    void *pdata,
 				    size_t data_size,
@@ -95,7 +213,8 @@ struct tevent_req *__tevent_req_create(TALLOC_CTX *mem_ctx,
 		return NULL;
 	}
 
-	req = talloc_pooled_object(
+	req = talloc_slab_pooled_object(
+		tevent_req_slab(data_size),
 		mem_ctx, struct tevent_req, 2,
 		sizeof(struct tevent_immediate) + data_size);
 	if (req == NULL) {
@@ -115,7 +234,7 @@ struct tevent_req *__tevent_req_create(TALLOC_CTX *mem_ctx,
 
 	/*
 	 * No need to check for req->internal.trigger!=NULL or
-	 * data!=NULL, this can't fail: talloc_pooled_object has
+	 * data!=NULL, this can't fail: talloc_slab_pooled_object has
 	 * already allocated sufficient memory.
 	 */
 
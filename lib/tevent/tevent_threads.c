@@ -455,6 +455,101 @@ struct tevent_threaded_context *tevent_threaded_context_create(
 #endif
 }
 
+#ifdef HAVE_PTHREAD
+
+/*
+ * Push an immediate onto ev->scheduled_immediates,
+ * returns true if the list was empty before.
+ */
+static bool tevent_threaded_push_immediate(struct tevent_context *ev,
+					   struct tevent_immediate *im)
+{
+#if defined(HAVE___ATOMIC_ADD_FETCH)
+	struct tevent_immediate *head = NULL;
+
+	head = __atomic_load_n(&ev->scheduled_immediates, __ATOMIC_RELAXED);
+	do {
+		im->next = head;
+	} while (!__atomic_compare_exchange_n(&ev->scheduled_immediates,
+					      &head,
+					      im,
+					      true,
+					      __ATOMIC_RELEASE,
+					      __ATOMIC_RELAXED));
+
+	return (head == NULL);
+#else
+	struct tevent_immediate *head = NULL;
+	int ret;
+
+	ret = pthread_mutex_lock(&ev->scheduled_mutex);
+	if (ret != 0) {
+		abort();
+	}
+
+	head = ev->scheduled_immediates;
+	im->next = head;
+	ev->scheduled_immediates = im;
+
+	ret = pthread_mutex_unlock(&ev->scheduled_mutex);
+	if (ret != 0) {
+		abort();
+	}
+
+	return (head == NULL);
+#endif
+}
+
+/*
+ * Take all of ev->scheduled_immediates in the order they were pushed.
+ */
+static struct tevent_immediate *tevent_threaded_take_immediates(
+	struct tevent_context *ev)
+{
+	struct tevent_immediate *list = NULL;
+	struct tevent_immediate *fifo = NULL;
+
+#if defined(HAVE___ATOMIC_ADD_FETCH)
+	if (__atomic_load_n(&ev->scheduled_immediates,
+			    __ATOMIC_RELAXED) == NULL) {
+		return NULL;
+	}
+	list = __atomic_exchange_n(&ev->scheduled_immediates,
+				   NULL,
+				   __ATOMIC_ACQUIRE);
+#else
+	int ret;
+
+	ret = pthread_mutex_lock(&ev->scheduled_mutex);
+	if (ret != 0) {
+		abort();
+	}
+
+	list = ev->scheduled_immediates;
+	ev->scheduled_immediates = NULL;
+
+	ret = pthread_mutex_unlock(&ev->scheduled_mutex);
+	if (ret != 0) {
+		abort();
+	}
+#endif
+
+	/*
+	 * The list is a stack, reverse it.
+	 */
+	while (list != NULL) {
+		struct tevent_immediate *im = list;
+
+		list = im->next;
+		im->next = fifo;
+		fifo = im;
+	}
+
+	return fifo;
+}
+
+#endif
+
 static int tevent_threaded_schedule_immediate_destructor(struct tevent_immediate *im)
 {
 	if (im->event_ctx != NULL) {
@@ -474,6 +569,7 @@ void _tevent_threaded_schedule_immediate(struct tevent_threaded_context *tctx,
 	const char *create_location = im->create_location;
 	struct tevent_context *main_ev = NULL;
 	struct tevent_wrapper_glue *glue = NULL;
+	bool need_wakeup;
 	int ret, wakeup_fd;
 
 	ret = pthread_mutex_lock(&tctx->event_ctx_mutex);
@@ -524,22 +620,21 @@ void _tevent_threaded_schedule_immediate(struct tevent_threaded_context *tctx,
 	 */
 	talloc_set_destructor(im, tevent_threaded_schedule_immediate_destructor);
 
-	ret = pthread_mutex_lock(&main_ev->scheduled_mutex);
-	if (ret != 0) {
-		abort();
-	}
-
-	DLIST_ADD_END(main_ev->scheduled_immediates, im);
 	wakeup_fd = main_ev->wakeup_fd;
+	need_wakeup = tevent_threaded_push_immediate(main_ev, im);
 
-	ret = pthread_mutex_unlock(&main_ev->scheduled_mutex);
+	ret = pthread_mutex_unlock(&tctx->event_ctx_mutex);
 	if (ret != 0) {
 		abort();
 	}
 
-	ret = pthread_mutex_unlock(&tctx->event_ctx_mutex);
-	if (ret != 0) {
-		abort();
+	if (!need_wakeup) {
+		/*
+		 * The list was not empty, so whoever added the
+		 * first entry already woke up the main thread,
+		 * which did not yet collect the list.
+		 */
+		return;
 	}
 
 	/*
@@ -564,17 +659,22 @@ void _tevent_threaded_schedule_immediate(struct tevent_threaded_context *tctx,
 void tevent_common_threaded_activate_immediate(struct tevent_context *ev)
 {
 #ifdef HAVE_PTHREAD
-	int ret;
-	ret = pthread_mutex_lock(&ev->scheduled_mutex);
-	if (ret != 0) {
-		abort();
+	struct tevent_immediate *list = NULL;
+	struct tevent_immediate *next = NULL;
+	size_t num = 0;
+
+	list = tevent_threaded_take_immediates(ev);
+	if (list == NULL) {
+		return;
 	}
 
-	while (ev->scheduled_immediates != NULL) {
-		struct tevent_immediate *im = ev->scheduled_immediates;
+	for (; list != NULL; list = next) {
+		struct tevent_immediate *im = list;
 		struct tevent_immediate copy = *im;
 
-		DLIST_REMOVE(ev->scheduled_immediates, im);
+		next = im->next;
+		im->prev = im->next = NULL;
+		num += 1;
 
 		TEVENT_DEBUG(ev, TEVENT_DEBUG_TRACE,
 			     "Schedule immediate event \"%s\": %p from thread into main\n",
@@ -588,10 +688,15 @@ void tevent_common_threaded_activate_immediate(struct tevent_context *ev)
 					   copy.schedule_location);
 	}
 
-	ret = pthread_mutex_unlock(&ev->scheduled_mutex);
-	if (ret != 0) {
-		abort();
-	}
+	ev->num_scheduled_batches += 1;
+	ev->num_scheduled_immediates += num;
+
+	TEVENT_DEBUG(ev, TEVENT_DEBUG_TRACE,
+		     "Scheduled %zu immediates from threads, "
+		     "%"PRIu64" immediates in %"PRIu64" wakeups\n",
+		     num,
+		     ev->num_scheduled_immediates,
+		     ev->num_scheduled_batches);
 #else
 	/*
 	 * tevent_threaded_context_create() returned NULL with ENOSYS...
@@ -129,6 +129,128 @@ struct timeval tevent_timeval_current_ofs(uint32_t secs, uint32_t usecs)
 	return tevent_timeval_add(&tv, secs, usecs);
 }
 
+/* the heap never shrinks below this number of slots */
+#define TEVENT_TIMER_HEAP_MIN 16
+
+static bool tevent_timer_before(const struct tevent_timer *te1,
+				const struct tevent_timer *te2)
+{
+	int ret;
+
+	ret = tevent_timeval_compare(&te1->next_event, &te2->next_event);
+	if (ret != 0) {
+		return ret < 0;
+	}
+	return te1->seq < te2->seq;
+}
+
+static void tevent_timer_heap_set(struct tevent_context *ev,
+				  size_t idx,
+				  struct tevent_timer *te)
+{
+	ev->timers.heap[idx] = te;
+	te->heap_idx = idx;
+}
+
+static void tevent_timer_heap_up(struct tevent_context *ev, size_t idx)
+{
+	struct tevent_timer *te = ev->timers.heap[idx];
+
+	while (idx > 0) {
+		size_t parent = (idx - 1) / 2;
+
+		if (!tevent_timer_before(te, ev->timers.heap[parent])) {
+			break;
+		}
+		tevent_timer_heap_set(ev, idx, ev->timers.heap[parent]);
+		idx = parent;
+	}
+	tevent_timer_heap_set(ev, idx, te);
+}
+
+static void tevent_timer_heap_down(struct tevent_context *ev, size_t idx)
+{
+	struct tevent_timer *te = ev->timers.heap[idx];
+	size_t num = ev->timers.num;
+
+	while (true) {
+		size_t child = idx * 2 + 1;
+
+		if (child >= num) {
+			break;
+		}
+		if ((child + 1 < num) &&
+		    tevent_timer_before(ev->timers.heap[child + 1],
+					ev->timers.heap[child])) {
+			child += 1;
+		}
+		if (!tevent_timer_before(ev->timers.heap[child], te)) {
+			break;
+		}
+		tevent_timer_heap_set(ev, idx, ev->timers.heap[child]);
+		idx = child;
+	}
+	tevent_timer_heap_set(ev, idx, te);
+}
+
+/*
+  remove a timer from the heap and the timer_events list
+*/
+_PRIVATE_ void tevent_common_timer_unlink(struct tevent_context *ev,
+				struct tevent_timer *te)
+{
+	size_t idx = te->heap_idx;
+	size_t last;
+	size_t len;
+
+	if (idx == SIZE_MAX) {
+		/*
+		 * Already removed by tevent_common_invoke_timer_handler()
+		 */
+		return;
+	}
+
+	if (idx >= ev->timers.num || ev->timers.heap[idx] != te) {
+		tevent_abort(ev, "tevent_timer not in heap");
+		return;
+	}
+
+	DLIST_REMOVE(ev->timer_events, te);
+
+	last = ev->timers.num - 1;
+	ev->timers.num = last;
+	te->heap_idx = SIZE_MAX;
+
+	if (idx != last) {
+		tevent_timer_heap_set(ev, idx, ev->timers.heap[last]);
+		if (idx > 0 &&
+		    tevent_timer_before(ev->timers.heap[idx],
+					ev->timers.heap[(idx - 1) / 2])) {
+			tevent_timer_heap_up(ev, idx);
+		} else {
+			tevent_timer_heap_down(ev, idx);
+		}
+	}
+	ev->timers.heap[last] = NULL;
+
+	len = talloc_array_length(ev->timers.heap);
+	if (len > TEVENT_TIMER_HEAP_MIN && ev->timers.num <= len / 4) {
+		struct tevent_timer **heap = NULL;
+
+		/*
+		 * Shrink, but leave room for tevent_update_timer()
+		 * to insert the timer again, a failure is not fatal.
+		 */
+		heap = talloc_realloc(ev,
+				      ev->timers.heap,
+				      struct tevent_timer *,
+				      len / 2);
+		if (heap != NULL) {
+			ev->timers.heap = heap;
+		}
+	}
+}
+
 /*
   destroy a timed event
 */
@@ -148,12 +270,8 @@ static int tevent_common_timed_destructor(struct tevent_timer *te)
 		     "Destroying timer event %p \"%s\"\n",
 		     te, te->handler_name);
 
-	if (te->event_ctx->last_zero_timer == te) {
-		te->event_ctx->last_zero_timer = DLIST_PREV(te);
-	}
-
 	tevent_trace_timer_callback(te->event_ctx, te, TEVENT_EVENT_TRACE_DETACH);
-	DLIST_REMOVE(te->event_ctx->timer_events, te);
+	tevent_common_timer_unlink(te->event_ctx, te);
 
 	te->event_ctx = NULL;
 done:
@@ -165,61 +283,78 @@ done:
 	return 0;
 }
 
+/*
+  The heap is allocated together with the context, so that arming
+  the first timer does not add a talloc child to ev. Callers like
+  smbtorture compare talloc_total_blocks(ev) around each test.
+*/
+_PRIVATE_ int tevent_common_timer_heap_init(struct tevent_context *ev)
+{
+	if (ev->timers.heap != NULL) {
+		return 0;
+	}
+
+	ev->timers.heap = talloc_zero_array(ev,
+					    struct tevent_timer *,
+					    TEVENT_TIMER_HEAP_MIN);
+	if (ev->timers.heap == NULL) {
+		return ENOMEM;
+	}
+
+	return 0;
+}
+
+static bool tevent_common_timer_heap_reserve(struct tevent_context *ev)
+{
+	struct tevent_timer **heap = NULL;
+	size_t len = talloc_array_length(ev->timers.heap);
+
+	if (ev->timers.num < len) {
+		return true;
+	}
+
+	len = MAX(len * 2, TEVENT_TIMER_HEAP_MIN);
+	if (len <= ev->timers.num) {
+		return false;
+	}
+
+	heap = talloc_realloc(ev, ev->timers.heap, struct tevent_timer *, len);
+	if (heap == NULL) {
+		return false;
+	}
+	ev->timers.heap = heap;
+
+	return true;
+}
+
+/*
+  The caller needs to make sure that there is space in the heap,
+  see tevent_common_timer_heap_reserve().
+*/
 static void tevent_common_insert_timer(struct tevent_context *ev,
-				       struct tevent_timer *te,
-				       bool optimize_zero)
+				       struct tevent_timer *te)
 {
-	struct tevent_timer *prev_te = NULL;
+	size_t idx = ev->timers.num;
 
 	if (te->destroyed) {
 		tevent_abort(ev, "tevent_timer use after free");
 		return;
 	}
 
-	/* keep the list ordered */
-	if (optimize_zero && tevent_timeval_is_zero(&te->next_event)) {
-		/*
-		 * Some callers use zero tevent_timer
-		 * instead of tevent_immediate events.
-		 *
-		 * As these can happen very often,
-		 * we remember the last zero timer
-		 * in the list.
-		 */
-		prev_te = ev->last_zero_timer;
-		ev->last_zero_timer = te;
-	} else {
-		struct tevent_timer *cur_te;
-
-		/*
-		 * we traverse the list from the tail
-		 * because it's much more likely that
-		 * timers are added at the end of the list
-		 */
-		for (cur_te = DLIST_TAIL(ev->timer_events);
-		     cur_te != NULL;
-		     cur_te = DLIST_PREV(cur_te))
-		{
-			int ret;
-
-			/*
-			 * if the new event comes before the current
-			 * we continue searching
-			 */
-			ret = tevent_timeval_compare(&te->next_event,
-						     &cur_te->next_event);
-			if (ret < 0) {
-				continue;
-			}
-
-			break;
-		}
+	/*
+	 * The heap keeps the timers ordered by next_event,
+	 * seq keeps the order of timers with the same
+	 * next_event, including zero timers used
+	 * instead of tevent_immediate events.
+	 */
+	te->seq = ev->timers.seq++;
 
-		prev_te = cur_te;
-	}
+	ev->timers.num += 1;
+	tevent_timer_heap_set(ev, idx, te);
+	tevent_timer_heap_up(ev, idx);
 
 	tevent_trace_timer_callback(te->event_ctx, te, TEVENT_EVENT_TRACE_ATTACH);
-	DLIST_ADD_AFTER(ev->timer_events, te, prev_te);
+	DLIST_ADD_END(ev->timer_events, te);
 }
 
 /*
@@ -233,10 +368,15 @@ static struct tevent_timer *tevent_common_add_timer_internal(
 					tevent_timer_handler_t handler,
 					void *private_data,
 					const char *handler_name,
-					const char *location,
-					bool optimize_zero)
+					const char *location)
 {
 	struct tevent_timer *te;
+	bool ok;
+
+	ok = tevent_common_timer_heap_reserve(ev);
+	if (!ok) {
+		return NULL;
+	}
 
 	te = talloc(mem_ctx?mem_ctx:ev, struct tevent_timer);
 	if (te == NULL) return NULL;
@@ -248,13 +388,10 @@ static struct tevent_timer *tevent_common_add_timer_internal(
 		.private_data	= private_data,
 		.handler_name	= handler_name,
 		.location	= location,
+		.heap_idx	= SIZE_MAX,
 	};
 
-	if (ev->timer_events == NULL) {
-		ev->last_zero_timer = NULL;
-	}
-
-	tevent_common_insert_timer(ev, te, optimize_zero);
+	tevent_common_insert_timer(ev, te);
 
 	talloc_set_destructor(te, tevent_common_timed_destructor);
 
@@ -274,16 +411,13 @@ struct tevent_timer *tevent_common_add_timer(struct tevent_context *ev,
 					     const char *location)
 {
 	/*
-	 * do not use optimization, there are broken Samba
-	 * versions which use tevent_common_add_timer()
-	 * without using tevent_common_loop_timer_delay(),
-	 * it just uses DLIST_REMOVE(ev->timer_events, te)
-	 * and would leave ev->last_zero_timer behind.
+	 * There used to be a zero timer optimization only
+	 * in tevent_common_add_timer_v2(), with the heap both
+	 * are the same.
 	 */
 	return tevent_common_add_timer_internal(ev, mem_ctx, next_event,
 						handler, private_data,
-						handler_name, location,
-						false);
+						handler_name, location);
 }
 
 struct tevent_timer *tevent_common_add_timer_v2(struct tevent_context *ev,
@@ -294,32 +428,33 @@ struct tevent_timer *tevent_common_add_timer_v2(struct tevent_context *ev,
 					        const char *handler_name,
 					        const char *location)
 {
-	/*
-	 * Here we turn on last_zero_timer optimization
-	 */
 	return tevent_common_add_timer_internal(ev, mem_ctx, next_event,
 						handler, private_data,
-						handler_name, location,
-						true);
+						handler_name, location);
 }
 
 void tevent_update_timer(struct tevent_timer *te, struct timeval next_event)
 {
 	struct tevent_context *ev = te->event_ctx;
 
-	if (ev->last_zero_timer == te) {
-		te->event_ctx->last_zero_timer = DLIST_PREV(te);
-	}
+	bool ok;
+
 	tevent_trace_timer_callback(te->event_ctx, te, TEVENT_EVENT_TRACE_DETACH);
-	DLIST_REMOVE(ev->timer_events, te);
+	tevent_common_timer_unlink(ev, te);
 
 	te->next_event = next_event;
 
 	/*
-	 * Not doing the zero_timer optimization. This is for new code
-	 * that should know about immediates.
+	 * A timer re-armed from its own handler is not in the
+	 * heap anymore, so unlinking it did not make room.
 	 */
-	tevent_common_insert_timer(ev, te, false);
+	ok = tevent_common_timer_heap_reserve(ev);
+	if (!ok) {
+		tevent_abort(ev, "tevent_update_timer: no memory for timer heap");
+		return;
+	}
+
+	tevent_common_insert_timer(ev, te);
 }
 
 int tevent_common_invoke_timer_handler(struct tevent_timer *te,
@@ -341,10 +476,7 @@ int tevent_common_invoke_timer_handler(struct tevent_timer *te,
 	 * handler because in a semi-async inner event loop called from the
 	 * handler we don't want to come across this event again -- vl
 	 */
-	if (te->event_ctx->last_zero_timer == te) {
-		te->event_ctx->last_zero_timer = DLIST_PREV(te);
-	}
-	DLIST_REMOVE(te->event_ctx->timer_events, te);
+	tevent_common_timer_unlink(te->event_ctx, te);
 
 	TEVENT_DEBUG(te->event_ctx, TEVENT_DEBUG_TRACE,
 		     "Running timer event %p \"%s\"\n",
@@ -392,6 +524,14 @@ int tevent_common_invoke_timer_handler(struct tevent_timer *te,
 		     "Ending timer event %p \"%s\"\n",
 		     te, te->handler_name);
 
+	if (!te->destroyed && te->heap_idx != SIZE_MAX) {
+		/*
+		 * The handler re-armed the timer with
+		 * tevent_update_timer(), keep it.
+		 */
+		return 0;
+	}
+
 	/* The callback was already called when freed from the handler. */
 	if (!te->destroyed) {
 		tevent_trace_timer_callback(te->event_ctx, te, TEVENT_EVENT_TRACE_DETACH);
@@ -417,12 +557,13 @@ int tevent_common_invoke_timer_handler(struct tevent_timer *te,
 struct timeval tevent_common_loop_timer_delay(struct tevent_context *ev)
 {
 	struct timeval current_time = tevent_timeval_zero();
-	struct tevent_timer *te = ev->timer_events;
+	struct tevent_timer *te = NULL;
 	int ret;
 
-	if (!te) {
+	if (ev->timers.num == 0) {
 		return ev->wait_timeout;
 	}
+	te = ev->timers.heap[0];
 
 	/*
 	 * work out the right timeout for the next timed event
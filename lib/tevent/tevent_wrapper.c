@@ -286,13 +286,9 @@ static int tevent_wrapper_context_destructor(struct tevent_context *wrap_ev)
 			continue;
 		}
 
+		tevent_common_timer_unlink(main_ev, te);
 		te->wrapper = NULL;
 		te->event_ctx = NULL;
-
-		if (main_ev->last_zero_timer == te) {
-			main_ev->last_zero_timer = DLIST_PREV(te);
-		}
-		DLIST_REMOVE(main_ev->timer_events, te);
 	}
 
 	for (ie = main_ev->immediate_events; ie; ie = in) {
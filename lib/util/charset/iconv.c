@@ -22,6 +22,7 @@
 #include "system/iconv.h"
 #include "system/filesys.h"
 #include "lib/util/byteorder.h"
+#include "lib/util/bytearray.h"
 #include "lib/util/dlinklist.h"
 #include "lib/util/charset/charset.h"
 #include "lib/util/charset/charset_proto.h"
@@ -35,6 +36,12 @@
 #undef strcasecmp
 #endif
 
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
 /**
  * @file
  *
@@ -803,6 +810,110 @@ static size_t iconv_copy(void *cd, const char **inbuf, size_t *inbytesleft,
 	return 0;
 }
 
+/*
+ * utf8_to_utf16_ascii() converts the leading run of ASCII bytes in
+ * src (at most n bytes) to UTF-16LE in dst, which has room for n
+ * characters, and returns the number of characters converted.
+ *
+ * Nearly all file names are mostly ASCII, so this is where the UTF-8
+ * conversions spend their time. We look at 16 bytes at a time where
+ * the target architecture guarantees us the vector instructions (SSE2
+ * on x86-64 and NEON on aarch64), then 8 bytes at a time. The caller
+ * handles the tail and anything that is not ASCII.
+ */
+static size_t utf8_to_utf16_ascii(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128i zero = _mm_setzero_si128();
+
+	while (i + 16 <= n) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + i));
+		if (_mm_movemask_epi8(v) != 0) {
+			break;
+		}
+		_mm_storeu_si128((__m128i *)(dst + 2 * i),
+				 _mm_unpacklo_epi8(v, zero));
+		_mm_storeu_si128((__m128i *)(dst + 2 * i + 16),
+				 _mm_unpackhi_epi8(v, zero));
+		i += 16;
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__) && !defined(__ARM_BIG_ENDIAN)
+	while (i + 16 <= n) {
+		uint8x16x2_t w;
+		uint8x16_t v = vld1q_u8(src + i);
+		if (vmaxvq_u8(v) >= 0x80) {
+			break;
+		}
+		w.val[0] = v;
+		w.val[1] = vdupq_n_u8(0);
+		vst2q_u8(dst + 2 * i, w);
+		i += 16;
+	}
+#endif
+	while (i + 8 <= n) {
+		uint64_t v = PULL_LE_U64(src, i);
+		size_t j;
+		if (v & UINT64_C(0x8080808080808080)) {
+			break;
+		}
+		for (j = 0; j < 8; j++) {
+			dst[2 * (i + j)] = src[i + j];
+			dst[2 * (i + j) + 1] = 0;
+		}
+		i += 8;
+	}
+	return i;
+}
+
+/*
+ * utf16_to_utf8_ascii() is the reverse of utf8_to_utf16_ascii(): it
+ * converts the leading run of UTF-16LE characters below 0x80 in src (at
+ * most n characters) to dst, and returns the number converted.
+ */
+static size_t utf16_to_utf8_ascii(const uint8_t *src, uint8_t *dst, size_t n)
+{
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	const __m128i mask = _mm_set1_epi16((short)0xff80);
+	const __m128i zero = _mm_setzero_si128();
+
+	while (i + 8 <= n) {
+		__m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+		__m128i hi = _mm_and_si128(v, mask);
+		if (_mm_movemask_epi8(_mm_cmpeq_epi16(hi, zero)) != 0xffff) {
+			break;
+		}
+		_mm_storel_epi64((__m128i *)(dst + i), _mm_packus_epi16(v, v));
+		i += 8;
+	}
+#elif defined(__ARM_NEON) && defined(__aarch64__) && !defined(__ARM_BIG_ENDIAN)
+	while (i + 8 <= n) {
+		uint8x16_t b = vld1q_u8(src + 2 * i);
+		uint16x8_t v = vreinterpretq_u16_u8(b);
+		if (vmaxvq_u16(v) >= 0x80) {
+			break;
+		}
+		vst1_u8(dst + i, vmovn_u16(v));
+		i += 8;
+	}
+#endif
+	while (i + 4 <= n) {
+		uint64_t v = PULL_LE_U64(src, 2 * i);
+		size_t j;
+		if (v & UINT64_C(0xff80ff80ff80ff80)) {
+			break;
+		}
+		for (j = 0; j < 4; j++) {
+			dst[i + j] = src[2 * (i + j)];
+		}
+		i += 4;
+	}
+	return i;
+}
+
 /*
   this takes a UTF8 sequence and produces a UTF16 sequence
  */
@@ -815,6 +926,15 @@ static size_t utf8_pull(void *cd, const char **inbuf, size_t *inbytesleft,
 
 	while (in_left >= 1 && out_left >= 2) {
 		if ((c[0] & 0x80) == 0) {
+			size_t n = utf8_to_utf16_ascii(c, uc,
+						       MIN(in_left, out_left / 2));
+			if (n > 0) {
+				c += n;
+				in_left -= n;
+				out_left -= 2 * n;
+				uc += 2 * n;
+				continue;
+			}
 			uc[0] = c[0];
 			uc[1] = 0;
 			c  += 1;
@@ -991,6 +1111,15 @@ static size_t utf8_push(void *cd, const char **inbuf, size_t *inbytesleft,
 		unsigned int codepoint;
 
 		if (uc[1] == 0 && !(uc[0] & 0x80)) {
+			size_t n = utf16_to_utf8_ascii(uc, c,
+						       MIN(in_left / 2, out_left));
+			if (n > 0) {
+				in_left -= 2 * n;
+				out_left -= n;
+				uc += 2 * n;
+				c += n;
+				continue;
+			}
 			/* simplest case */
 			c[0] = uc[0];
 			in_left  -= 2;
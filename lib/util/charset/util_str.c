@@ -53,6 +53,24 @@ _PUBLIC_ int strcasecmp_m_handle(struct smb_iconv_handle *iconv_handle,
 	if (s2 == NULL) return 1;
 
 	while (*s1 && *s2) {
+		if ((((unsigned char)*s1 | (unsigned char)*s2) & 0x80) == 0) {
+			/*
+			 * Both are ASCII, which next_codepoint_handle()
+			 * would return as is: avoid the call.
+			 */
+			c1 = (unsigned char)*s1++;
+			c2 = (unsigned char)*s2++;
+			if (c1 == c2) {
+				continue;
+			}
+			l1 = tolower_m(c1);
+			l2 = tolower_m(c2);
+			if (l1 == l2) {
+				continue;
+			}
+			return NUMERIC_CMP(l1, l2);
+		}
+
 		c1 = next_codepoint_handle(iconv_handle, s1, &size1);
 		c2 = next_codepoint_handle(iconv_handle, s2, &size2);
 
@@ -115,6 +133,21 @@ _PUBLIC_ int strncasecmp_m_handle(struct smb_iconv_handle *iconv_handle,
 	while (*s1 && *s2 && n) {
 		n--;
 
+		if ((((unsigned char)*s1 | (unsigned char)*s2) & 0x80) == 0) {
+			/* see strcasecmp_m_handle() */
+			c1 = (unsigned char)*s1++;
+			c2 = (unsigned char)*s2++;
+			if (c1 == c2) {
+				continue;
+			}
+			l1 = tolower_m(c1);
+			l2 = tolower_m(c2);
+			if (l1 == l2) {
+				continue;
+			}
+			return NUMERIC_CMP(l1, l2);
+		}
+
 		c1 = next_codepoint_handle(iconv_handle, s1, &size1);
 		c2 = next_codepoint_handle(iconv_handle, s2, &size2);
 
@@ -32,7 +32,11 @@
 #include "util_strlist.h" /* LIST_SEP */
 #include "blocking.h"
 #include "debug.h"
+#include "system/wait.h"
 #include <assert.h>
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
 
 /* define what facility to use for syslog */
 #ifndef SYSLOG_FACILITY
@@ -248,6 +252,377 @@ static int debug_level_to_priority(int level)
  * all active backends.
  */
 
+#ifdef HAVE_PTHREAD
+/*
+ * "file:async[=NBYTES]" lets a writer thread do the write() calls of
+ * the file backend. debug_file_log() only copies the message into
+ * one of two buffers under a mutex, the writer thread writes the
+ * other one. If both are full, messages are dropped and counted
+ * instead of blocking the caller.
+ */
+
+#define DEBUG_FILE_ASYNC_OPT "async"
+#define DEBUG_FILE_ASYNC_SIZE (4 * 1024 * 1024)
+#define DEBUG_FILE_ASYNC_MAX_SEGMENTS 64
+
+struct debug_async_buf {
+	char *data;
+	size_t used;
+	/*
+	 * Consecutive messages for the same fd
+	 */
+	struct {
+		int fd;
+		size_t ofs;
+		size_t len;
+	} segments[DEBUG_FILE_ASYNC_MAX_SEGMENTS];
+	size_t num_segments;
+};
+
+static struct {
+	pthread_mutex_t mutex;
+	pthread_cond_t wakeup;
+	pthread_cond_t drained;
+
+	bool enabled;
+	bool running;
+	bool writing;
+	bool stop;
+	bool registered;
+	pthread_t thread;
+
+	size_t option_size;
+	size_t buf_size;
+	struct debug_async_buf bufs[2];
+	struct debug_async_buf *fill;
+
+	uint64_t dropped;
+	int dropped_fd;
+} debug_async = {
+	.mutex = PTHREAD_MUTEX_INITIALIZER,
+	.wakeup = PTHREAD_COND_INITIALIZER,
+	.drained = PTHREAD_COND_INITIALIZER,
+	.dropped_fd = -1,
+};
+
+static void debug_async_write(int fd, const char *buf, size_t len)
+{
+	while (len > 0) {
+		ssize_t ret = write(fd, buf, len);
+		if (ret == -1 && errno == EINTR) {
+			continue;
+		}
+		if (ret <= 0) {
+			return;
+		}
+		buf += ret;
+		len -= ret;
+	}
+}
+
+static void *debug_async_writer(void *private_data)
+{
+	pthread_mutex_lock(&debug_async.mutex);
+
+	while (true) {
+		struct debug_async_buf *buf = NULL;
+		uint64_t dropped;
+		int dropped_fd;
+		size_t i;
+
+		while (!debug_async.stop &&
+		       (debug_async.fill->used == 0) &&
+		       (debug_async.dropped == 0)) {
+			pthread_cond_wait(&debug_async.wakeup,
+					  &debug_async.mutex);
+		}
+		if (debug_async.stop &&
+		    (debug_async.fill->used == 0) &&
+		    (debug_async.dropped == 0)) {
+			break;
+		}
+
+		buf = debug_async.fill;
+		if (buf == &debug_async.bufs[0]) {
+			debug_async.fill = &debug_async.bufs[1];
+		} else {
+			debug_async.fill = &debug_async.bufs[0];
+		}
+		dropped = debug_async.dropped;
+		dropped_fd = debug_async.dropped_fd;
+		debug_async.dropped = 0;
+		debug_async.writing = true;
+
+		pthread_mutex_unlock(&debug_async.mutex);
+
+		for (i = 0; i < buf->num_segments; i++) {
+			debug_async_write(buf->segments[i].fd,
+					  buf->data + buf->segments[i].ofs,
+					  buf->segments[i].len);
+		}
+		buf->used = 0;
+		buf->num_segments = 0;
+
+		if (dropped != 0 && dropped_fd != -1) {
+			char msg[64];
+			int len;
+
+			len = snprintf(msg,
+				       sizeof(msg),
+				       "[debug] %" PRIu64 " messages dropped\n",
+				       dropped);
+			if (len > 0 && (size_t)len < sizeof(msg)) {
+				debug_async_write(dropped_fd, msg, len);
+			}
+		}
+
+		pthread_mutex_lock(&debug_async.mutex);
+		debug_async.writing = false;
+		pthread_cond_broadcast(&debug_async.drained);
+	}
+
+	debug_async.running = false;
+	pthread_cond_broadcast(&debug_async.drained);
+	pthread_mutex_unlock(&debug_async.mutex);
+
+	return NULL;
+}
+
+/*
+ * Wait until everything queued so far is written
+ */
+static void debug_async_flush(void)
+{
+	pthread_mutex_lock(&debug_async.mutex);
+	while (debug_async.running &&
+	       ((debug_async.fill->used != 0) ||
+		debug_async.writing ||
+		(debug_async.dropped != 0))) {
+		pthread_cond_signal(&debug_async.wakeup);
+		pthread_cond_wait(&debug_async.drained, &debug_async.mutex);
+	}
+	pthread_mutex_unlock(&debug_async.mutex);
+}
+
+static void debug_async_stop(void)
+{
+	bool running;
+
+	pthread_mutex_lock(&debug_async.mutex);
+	running = debug_async.running;
+	debug_async.stop = true;
+	pthread_cond_signal(&debug_async.wakeup);
+	pthread_mutex_unlock(&debug_async.mutex);
+
+	if (running) {
+		pthread_join(debug_async.thread, NULL);
+	}
+
+	pthread_mutex_lock(&debug_async.mutex);
+	debug_async.stop = false;
+	pthread_mutex_unlock(&debug_async.mutex);
+}
+
+static void debug_async_atexit(void)
+{
+	debug_async_stop();
+}
+
+static void debug_async_prepare(void)
+{
+	pthread_mutex_lock(&debug_async.mutex);
+}
+
+static void debug_async_parent(void)
+{
+	pthread_mutex_unlock(&debug_async.mutex);
+}
+
+static void debug_async_child(void)
+{
+	/*
+	 * The writer thread does not exist in the child, the parent
+	 * writes what is queued. We start a new thread on demand.
+	 */
+	debug_async.running = false;
+	debug_async.writing = false;
+	debug_async.stop = false;
+	debug_async.bufs[0].used = 0;
+	debug_async.bufs[0].num_segments = 0;
+	debug_async.bufs[1].used = 0;
+	debug_async.bufs[1].num_segments = 0;
+	debug_async.dropped = 0;
+	pthread_mutex_unlock(&debug_async.mutex);
+}
+
+/* Called with debug_async.mutex held */
+static bool debug_async_start(void)
+{
+	sigset_t mask, omask;
+	int ret;
+
+	if (!debug_async.registered) {
+		ret = pthread_atfork(debug_async_prepare,
+				     debug_async_parent,
+				     debug_async_child);
+		if (ret != 0) {
+			return false;
+		}
+		atexit(debug_async_atexit);
+		debug_async.registered = true;
+	}
+
+	/*
+	 * Leave all signals to the main thread
+	 */
+	sigfillset(&mask);
+	pthread_sigmask(SIG_SETMASK, &mask, &omask);
+	ret = pthread_create(&debug_async.thread,
+			     NULL,
+			     debug_async_writer,
+			     NULL);
+	pthread_sigmask(SIG_SETMASK, &omask, NULL);
+	if (ret != 0) {
+		return false;
+	}
+
+	debug_async.running = true;
+	return true;
+}
+
+/*
+ * Returns false if the caller needs to write the message itself
+ */
+static bool debug_async_log(int fd, const struct iovec *iov, size_t iovcnt)
+{
+	struct debug_async_buf *buf = NULL;
+	size_t i, len = 0;
+	bool new_segment;
+	bool ok;
+
+	for (i = 0; i < iovcnt; i++) {
+		len += iov[i].iov_len;
+	}
+
+	if (len > debug_async.buf_size) {
+		/*
+		 * Keep the order of messages
+		 */
+		debug_async_flush();
+		return false;
+	}
+
+	pthread_mutex_lock(&debug_async.mutex);
+
+	if (!debug_async.running) {
+		ok = debug_async_start();
+		if (!ok) {
+			pthread_mutex_unlock(&debug_async.mutex);
+			return false;
+		}
+	}
+
+	buf = debug_async.fill;
+
+	new_segment = (buf->num_segments == 0) ||
+		(buf->segments[buf->num_segments-1].fd != fd);
+
+	if ((buf->used + len > debug_async.buf_size) ||
+	    (new_segment &&
+	     (buf->num_segments == DEBUG_FILE_ASYNC_MAX_SEGMENTS))) {
+		debug_async.dropped += 1;
+		debug_async.dropped_fd = fd;
+		pthread_cond_signal(&debug_async.wakeup);
+		pthread_mutex_unlock(&debug_async.mutex);
+		return true;
+	}
+
+	if (new_segment) {
+		buf->segments[buf->num_segments].fd = fd;
+		buf->segments[buf->num_segments].ofs = buf->used;
+		buf->segments[buf->num_segments].len = 0;
+		buf->num_segments += 1;
+	}
+
+	for (i = 0; i < iovcnt; i++) {
+		memcpy(buf->data + buf->used, iov[i].iov_base, iov[i].iov_len);
+		buf->used += iov[i].iov_len;
+	}
+	buf->segments[buf->num_segments-1].len += len;
+
+	if (!debug_async.writing) {
+		pthread_cond_signal(&debug_async.wakeup);
+	}
+
+	pthread_mutex_unlock(&debug_async.mutex);
+	return true;
+}
+
+static void debug_file_reload(bool enabled, bool previously_enabled,
+			      const char *prog_name, char *option)
+{
+	size_t optlen = strlen(DEBUG_FILE_ASYNC_OPT);
+	size_t buf_size = DEBUG_FILE_ASYNC_SIZE;
+	size_t option_size;
+	bool async = false;
+	int cmp;
+
+	if (enabled && option != NULL) {
+		cmp = strncmp(option, DEBUG_FILE_ASYNC_OPT, optlen);
+		if (cmp == 0 && option[optlen] == '\0') {
+			async = true;
+		} else if (cmp == 0 && option[optlen] == '=') {
+			async = true;
+			buf_size = (size_t)strtoull(
+				option + optlen + 1, NULL, 10);
+		}
+	}
+
+	if (!async && !debug_async.enabled) {
+		return;
+	}
+	if (async && debug_async.enabled &&
+	    buf_size == debug_async.option_size) {
+		return;
+	}
+
+	debug_async_stop();
+
+	debug_async.enabled = false;
+	SAFE_FREE(debug_async.bufs[0].data);
+	SAFE_FREE(debug_async.bufs[1].data);
+	debug_async.bufs[0] = (struct debug_async_buf) { .data = NULL };
+	debug_async.bufs[1] = (struct debug_async_buf) { .data = NULL };
+	debug_async.fill = &debug_async.bufs[0];
+	debug_async.buf_size = 0;
+	debug_async.option_size = 0;
+
+	if (!async || buf_size == 0) {
+		return;
+	}
+
+	/*
+	 * The option is the total memory used, split between the two
+	 * buffers.
+	 */
+	option_size = buf_size;
+	buf_size = MAX(buf_size / 2, FORMAT_BUFR_SIZE);
+
+	debug_async.bufs[0].data = malloc(buf_size);
+	debug_async.bufs[1].data = malloc(buf_size);
+	if (debug_async.bufs[0].data == NULL ||
+	    debug_async.bufs[1].data == NULL) {
+		SAFE_FREE(debug_async.bufs[0].data);
+		SAFE_FREE(debug_async.bufs[1].data);
+		return;
+	}
+
+	debug_async.option_size = option_size;
+	debug_async.buf_size = buf_size;
+	debug_async.enabled = true;
+}
+#endif /* HAVE_PTHREAD */
+
 static void debug_file_log(int msg_level, const char *msg, size_t msg_len)
 {
 	struct iovec iov[] = {
@@ -271,6 +646,12 @@ static void debug_file_log(int msg_level, const char *msg, size_t msg_len)
 		fd = dbgc_config[DBGC_ALL].fd;
 	}
 
+#ifdef HAVE_PTHREAD
+	if (debug_async.enabled && debug_async_log(fd, iov, ARRAY_SIZE(iov))) {
+		return;
+	}
+#endif
+
 	do {
 		ret = writev(fd, iov, ARRAY_SIZE(iov));
 	} while (ret == -1 && errno == EINTR);
@@ -539,6 +920,9 @@ static struct debug_backend {
 	{
 		.name = "file",
 		.log = debug_file_log,
+#ifdef HAVE_PTHREAD
+		.reload = debug_file_reload,
+#endif
 	},
 #ifdef WITH_SYSLOG
 	{
@@ -1303,6 +1687,14 @@ bool reopen_logs_internal(void)
 		return true;
 	}
 
+#ifdef HAVE_PTHREAD
+	/*
+	 * Queued messages need to go to the old fds before we close
+	 * them
+	 */
+	debug_async_flush();
+#endif
+
 	/* Now clear the SIGHUP induced flag */
 	state.schedule_reopen_logs = false;
 
@@ -1697,6 +2089,9 @@ static void format_debug_text( const char *msg )
 void dbgflush( void )
 {
 	bufr_print();
+#ifdef HAVE_PTHREAD
+	debug_async_flush();
+#endif
 }
 
 bool dbgsetclass(int level, int cls)
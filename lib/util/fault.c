@@ -193,6 +193,11 @@ _PUBLIC_ void smb_panic_log(const char *why)
 		 (unsigned long long)getpid(), why));
 
 	log_stack_trace();
+
+	/*
+	 * Don't lose what might still be queued by "logging = file:async"
+	 */
+	dbgflush();
 }
 
 /**
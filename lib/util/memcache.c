@@ -21,10 +21,29 @@
 #include <talloc.h>
 #include "../lib/util/debug.h"
 #include "../lib/util/samba_util.h"
-#include "../lib/util/dlinklist.h"
-#include "../lib/util/rbtree.h"
 #include "memcache.h"
 
+/*
+ * The cache is split into MEMCACHE_NUM_SHARDS open-addressing hash
+ * tables with linear probing, so growing one table only rehashes a
+ * fraction of the elements. Each slot carries the hash and the cache
+ * number, so most mismatches are sorted out without touching the
+ * element itself.
+ *
+ * Eviction is CLOCK: A hit just sets the referenced bit in the slot.
+ * When we're over budget, a clock hand sweeps the slots of one shard
+ * after the other, clearing referenced bits and evicting the first
+ * element that has not been referenced since the last sweep.
+ *
+ * The shards only split the hash table, the budget is not divided.
+ * cache->size is the sum over all shards and eviction goes on in the
+ * next shard until the whole cache is within max_size again.
+ */
+
+#define MEMCACHE_SHARD_BITS 3
+#define MEMCACHE_NUM_SHARDS (1U << MEMCACHE_SHARD_BITS)
+#define MEMCACHE_MIN_SLOTS 16
+
 static struct memcache *global_cache;
 
 struct memcache_talloc_value {
@@ -33,18 +52,32 @@ struct memcache_talloc_value {
 };
 
 struct memcache_element {
-	struct rb_node rb_node;
-	struct memcache_element *prev, *next;
 	size_t keylength, valuelength;
 	uint8_t n;		/* This is really an enum, but save memory */
 	char data[1];		/* placeholder for offsetof */
 };
 
+struct memcache_slot {
+	uint32_t hash;
+	uint8_t n;
+	bool referenced;
+	struct memcache_element *e; /* NULL for an empty slot */
+};
+
+struct memcache_shard {
+	struct memcache_slot *slots;
+	uint32_t num_slots;	/* power of 2 */
+	uint32_t num_used;
+	uint32_t clock_hand;
+};
+
 struct memcache {
-	struct memcache_element *mru;
-	struct rb_root tree;
+	struct memcache_shard shards[MEMCACHE_NUM_SHARDS];
+	unsigned evict_shard;
 	size_t size;
 	size_t max_size;
+	size_t num_elements;
+	struct memcache_stats stats[MEMCACHE_NUM_CACHES];
 };
 
 static void memcache_element_parse(struct memcache_element *e,
@@ -61,6 +94,8 @@ static bool memcache_is_talloc(enum memcache_number n)
 	case SHARE_MODE_LOCK_CACHE:
 	case GETWD_CACHE:
 	case VIRUSFILTER_SCAN_RESULTS_CACHE_TALLOC:
+	case ACL_BLOB_CACHE_TALLOC:
+	case REGDB_INDEX_CACHE_TALLOC:
 		result = true;
 		break;
 	default:
@@ -71,16 +106,6 @@ static bool memcache_is_talloc(enum memcache_number n)
 	return result;
 }
 
-static int memcache_destructor(struct memcache *cache) {
-	struct memcache_element *e, *next;
-
-	for (e = cache->mru; e != NULL; e = next) {
-		next = e->next;
-		TALLOC_FREE(e);
-	}
-	return 0;
-}
-
 struct memcache *memcache_init(TALLOC_CTX *mem_ctx, size_t max_size)
 {
 	struct memcache *result;
@@ -90,7 +115,6 @@ struct memcache *memcache_init(TALLOC_CTX *mem_ctx, size_t max_size)
 		return NULL;
 	}
 	result->max_size = max_size;
-	talloc_set_destructor(result, memcache_destructor);
 	return result;
 }
 
@@ -100,12 +124,6 @@ void memcache_set_global(struct memcache *cache)
 	global_cache = cache;
 }
 
-static struct memcache_element *memcache_node2elem(struct rb_node *node)
-{
-	return (struct memcache_element *)
-		((char *)node - offsetof(struct memcache_element, rb_node));
-}
-
 static void memcache_element_parse(struct memcache_element *e,
 				   DATA_BLOB *key, DATA_BLOB *value)
 {
@@ -120,46 +138,244 @@ static size_t memcache_element_size(size_t key_length, size_t value_length)
 	return sizeof(struct memcache_element) - 1 + key_length + value_length;
 }
 
-static int memcache_compare(struct memcache_element *e, enum memcache_number n,
-			    DATA_BLOB key)
+/*
+ * FNV-1a over the cache number and the key
+ */
+static uint32_t memcache_hash(enum memcache_number n, DATA_BLOB key)
 {
-	DATA_BLOB this_key, this_value;
+	uint32_t hash = 2166136261U;
+	size_t i;
 
-	if ((int)e->n < (int)n) return 1;
-	if ((int)e->n > (int)n) return -1;
+	hash = (hash ^ (uint8_t)n) * 16777619U;
 
-	if (e->keylength < key.length) return 1;
-	if (e->keylength > key.length) return -1;
+	for (i=0; i<key.length; i++) {
+		hash = (hash ^ key.data[i]) * 16777619U;
+	}
+	return hash;
+}
 
-	memcache_element_parse(e, &this_key, &this_value);
-	return memcmp(this_key.data, key.data, key.length);
+static struct memcache_shard *memcache_shard(struct memcache *cache,
+					     uint32_t hash)
+{
+	/*
+	 * The low bits index the slots, use the high bits for the shard
+	 */
+	return &cache->shards[hash >> (32 - MEMCACHE_SHARD_BITS)];
 }
 
-static struct memcache_element *memcache_find(
+static bool memcache_slot_match(const struct memcache_slot *slot,
+				uint32_t hash, enum memcache_number n,
+				DATA_BLOB key)
+{
+	DATA_BLOB this_key, this_value;
+
+	if ((slot->hash != hash) || (slot->n != n)) {
+		return false;
+	}
+	if (slot->e->keylength != key.length) {
+		return false;
+	}
+	memcache_element_parse(slot->e, &this_key, &this_value);
+	return (memcmp(this_key.data, key.data, key.length) == 0);
+}
+
+static struct memcache_slot *memcache_find(
 	struct memcache *cache, enum memcache_number n, DATA_BLOB key)
 {
-	struct rb_node *node;
+	uint32_t hash = memcache_hash(n, key);
+	struct memcache_shard *shard = memcache_shard(cache, hash);
+	uint32_t mask, i;
+
+	if (shard->num_used == 0) {
+		return NULL;
+	}
 
-	node = cache->tree.rb_node;
+	mask = shard->num_slots - 1;
 
-	while (node != NULL) {
-		struct memcache_element *elem = memcache_node2elem(node);
-		int cmp;
+	for (i = hash & mask; shard->slots[i].e != NULL; i = (i+1) & mask) {
+		struct memcache_slot *slot = &shard->slots[i];
 
-		cmp = memcache_compare(elem, n, key);
-		if (cmp == 0) {
-			return elem;
+		if (memcache_slot_match(slot, hash, n, key)) {
+			return slot;
 		}
-		node = (cmp < 0) ? node->rb_left : node->rb_right;
 	}
 
 	return NULL;
 }
 
+static void memcache_shard_link(struct memcache_shard *shard,
+				struct memcache_slot slot)
+{
+	uint32_t mask = shard->num_slots - 1;
+	uint32_t i;
+
+	for (i = slot.hash & mask;
+	     shard->slots[i].e != NULL;
+	     i = (i+1) & mask) {
+		;
+	}
+	shard->slots[i] = slot;
+	shard->num_used += 1;
+}
+
+/*
+ * Make room for one more element, keeping the load factor below 3/4
+ */
+static bool memcache_shard_reserve(struct memcache *cache,
+				   struct memcache_shard *shard)
+{
+	struct memcache_slot *old_slots = shard->slots;
+	uint32_t old_num = shard->num_slots;
+	uint32_t new_num;
+	uint32_t i;
+
+	if ((shard->num_used + 1) * 4 <= old_num * 3) {
+		return true;
+	}
+
+	new_num = MAX(old_num * 2, MEMCACHE_MIN_SLOTS);
+	if (new_num < old_num) {
+		return false;
+	}
+
+	shard->slots = talloc_zero_array(cache, struct memcache_slot, new_num);
+	if (shard->slots == NULL) {
+		shard->slots = old_slots;
+		return false;
+	}
+	shard->num_slots = new_num;
+	shard->num_used = 0;
+	shard->clock_hand = 0;
+
+	for (i=0; i<old_num; i++) {
+		if (old_slots[i].e != NULL) {
+			memcache_shard_link(shard, old_slots[i]);
+		}
+	}
+
+	TALLOC_FREE(old_slots);
+	return true;
+}
+
+/*
+ * Remove slot i, moving later members of the probe sequence back so
+ * we don't need tombstones
+ */
+static void memcache_shard_unlink(struct memcache_shard *shard, uint32_t i)
+{
+	uint32_t mask = shard->num_slots - 1;
+	uint32_t j = i;
+
+	while (true) {
+		uint32_t home;
+
+		j = (j+1) & mask;
+		if (shard->slots[j].e == NULL) {
+			break;
+		}
+		home = shard->slots[j].hash & mask;
+
+		/*
+		 * Slot j can move to i if its home is not cyclically
+		 * within (i, j]
+		 */
+		if ((i <= j) ? ((home <= i) || (home > j))
+			     : ((home <= i) && (home > j))) {
+			shard->slots[i] = shard->slots[j];
+			i = j;
+		}
+	}
+
+	shard->slots[i] = (struct memcache_slot) { .e = NULL };
+	shard->num_used -= 1;
+}
+
+static size_t memcache_value_size(struct memcache_element *e)
+{
+	DATA_BLOB cache_key, cache_value;
+	struct memcache_talloc_value mtv;
+
+	if (!memcache_is_talloc(e->n)) {
+		return 0;
+	}
+
+	memcache_element_parse(e, &cache_key, &cache_value);
+	SMB_ASSERT(cache_value.length == sizeof(mtv));
+	memcpy(&mtv, cache_value.data, sizeof(mtv));
+	return mtv.len;
+}
+
+/*
+ * What an element costs against max_size: The element itself, its
+ * slot in the hash table and the talloc'ed value
+ */
+static size_t memcache_charged_size(struct memcache_element *e)
+{
+	return memcache_element_size(e->keylength, e->valuelength) +
+		sizeof(struct memcache_slot) + memcache_value_size(e);
+}
+
+static void memcache_charge(struct memcache *cache, struct memcache_element *e)
+{
+	size_t size = memcache_charged_size(e);
+
+	cache->size += size;
+	cache->stats[e->n].size += size;
+}
+
+static void memcache_discharge(struct memcache *cache,
+			       struct memcache_element *e)
+{
+	size_t size = memcache_charged_size(e);
+
+	cache->size -= size;
+	cache->stats[e->n].size -= size;
+}
+
+static void memcache_free_value(struct memcache_element *e)
+{
+	DATA_BLOB cache_key, cache_value;
+	struct memcache_talloc_value mtv;
+
+	if (!memcache_is_talloc(e->n)) {
+		return;
+	}
+
+	memcache_element_parse(e, &cache_key, &cache_value);
+	SMB_ASSERT(cache_value.length == sizeof(mtv));
+	memcpy(&mtv, cache_value.data, sizeof(mtv));
+	TALLOC_FREE(mtv.ptr);
+}
+
+static void memcache_delete_slot(struct memcache *cache,
+				 struct memcache_shard *shard,
+				 uint32_t i)
+{
+	struct memcache_element *e = shard->slots[i].e;
+
+	memcache_shard_unlink(shard, i);
+
+	memcache_discharge(cache, e);
+	memcache_free_value(e);
+
+	cache->num_elements -= 1;
+	cache->stats[e->n].num_elements -= 1;
+
+	TALLOC_FREE(e);
+}
+
+static void memcache_delete_element(struct memcache *cache,
+				    struct memcache_slot *slot)
+{
+	struct memcache_shard *shard = memcache_shard(cache, slot->hash);
+
+	memcache_delete_slot(cache, shard, slot - shard->slots);
+}
+
 bool memcache_lookup(struct memcache *cache, enum memcache_number n,
 		     DATA_BLOB key, DATA_BLOB *value)
 {
-	struct memcache_element *e;
+	struct memcache_slot *slot;
 
 	if (cache == NULL) {
 		cache = global_cache;
@@ -168,16 +384,16 @@ bool memcache_lookup(struct memcache *cache, enum memcache_number n,
 		return false;
 	}
 
-	e = memcache_find(cache, n, key);
-	if (e == NULL) {
+	slot = memcache_find(cache, n, key);
+	if (slot == NULL) {
+		cache->stats[n].misses += 1;
 		return false;
 	}
 
-	if (cache->size != 0) {
-		DLIST_PROMOTE(cache->mru, e);
-	}
+	cache->stats[n].hits += 1;
+	slot->referenced = true;
 
-	memcache_element_parse(e, &key, value);
+	memcache_element_parse(slot->e, &key, value);
 	return true;
 }
 
@@ -200,55 +416,78 @@ void *memcache_lookup_talloc(struct memcache *cache, enum memcache_number n,
 	return mtv.ptr;
 }
 
-static void memcache_delete_element(struct memcache *cache,
-				    struct memcache_element *e)
+/*
+ * Run the clock hand over one shard for at most one round. If all
+ * elements were referenced, we've cleared their bits and the next
+ * round over this shard will find something.
+ */
+static bool memcache_shard_evict(struct memcache *cache,
+				 struct memcache_shard *shard,
+				 struct memcache_element *keep)
 {
-	rb_erase(&e->rb_node, &cache->tree);
+	uint32_t mask = shard->num_slots - 1;
+	uint32_t steps;
 
-	DLIST_REMOVE(cache->mru, e);
+	if (shard->num_used == 0) {
+		return false;
+	}
 
-	if (memcache_is_talloc(e->n)) {
-		DATA_BLOB cache_key, cache_value;
-		struct memcache_talloc_value mtv;
+	for (steps = 0; steps < shard->num_slots; steps++) {
+		uint32_t i = shard->clock_hand;
+		struct memcache_slot *slot = &shard->slots[i];
+		enum memcache_number n;
 
-		memcache_element_parse(e, &cache_key, &cache_value);
-		SMB_ASSERT(cache_value.length == sizeof(mtv));
-		memcpy(&mtv, cache_value.data, sizeof(mtv));
-		cache->size -= mtv.len;
-		TALLOC_FREE(mtv.ptr);
-	}
+		shard->clock_hand = (i+1) & mask;
+
+		if ((slot->e == NULL) || (slot->e == keep)) {
+			continue;
+		}
+		if (slot->referenced) {
+			slot->referenced = false;
+			continue;
+		}
 
-	cache->size -= memcache_element_size(e->keylength, e->valuelength);
+		n = slot->n;
+		memcache_delete_slot(cache, shard, i);
+		cache->stats[n].evictions += 1;
+		return true;
+	}
 
-	TALLOC_FREE(e);
+	return false;
 }
 
 static void memcache_trim(struct memcache *cache, struct memcache_element *e)
 {
-	struct memcache_element *tail = NULL;
+	unsigned tries = 0;
 
 	if (cache->max_size == 0) {
 		return;
 	}
 
-	for (tail = DLIST_TAIL(cache->mru);
-	     (cache->size > cache->max_size) && (tail != NULL);
-	     tail = DLIST_TAIL(cache->mru))
-	{
-		if (tail == e) {
-			tail = DLIST_PREV(tail);
-			if (tail == NULL) {
-				break;
-			}
+	/*
+	 * Visit the shards round-robin, this approximates one global
+	 * clock hand. Two rounds over all shards without a victim mean
+	 * only "e" is left.
+	 */
+	while ((cache->size > cache->max_size) &&
+	       (tries < MEMCACHE_NUM_SHARDS * 2)) {
+		struct memcache_shard *shard =
+			&cache->shards[cache->evict_shard];
+
+		if (memcache_shard_evict(cache, shard, e)) {
+			tries = 0;
+		} else {
+			tries += 1;
 		}
-		memcache_delete_element(cache, tail);
+		cache->evict_shard = (cache->evict_shard + 1) %
+			MEMCACHE_NUM_SHARDS;
 	}
 }
 
 void memcache_delete(struct memcache *cache, enum memcache_number n,
 		     DATA_BLOB key)
 {
-	struct memcache_element *e;
+	struct memcache_slot *slot;
 
 	if (cache == NULL) {
 		cache = global_cache;
@@ -257,22 +496,23 @@ void memcache_delete(struct memcache *cache, enum memcache_number n,
 		return;
 	}
 
-	e = memcache_find(cache, n, key);
-	if (e == NULL) {
+	slot = memcache_find(cache, n, key);
+	if (slot == NULL) {
 		return;
 	}
 
-	memcache_delete_element(cache, e);
+	memcache_delete_element(cache, slot);
 }
 
 bool memcache_add(struct memcache *cache, enum memcache_number n,
 		  DATA_BLOB key, DATA_BLOB value)
 {
 	struct memcache_element *e;
-	struct rb_node **p;
-	struct rb_node *parent;
+	struct memcache_slot *slot;
+	struct memcache_shard *shard;
 	DATA_BLOB cache_key, cache_value;
 	size_t element_size;
+	uint32_t hash;
 
 	if (cache == NULL) {
 		cache = global_cache;
@@ -285,37 +525,37 @@ bool memcache_add(struct memcache *cache, enum memcache_number n,
 		return false;
 	}
 
-	e = memcache_find(cache, n, key);
+	slot = memcache_find(cache, n, key);
 
-	if (e != NULL) {
+	if (slot != NULL) {
+		e = slot->e;
 		memcache_element_parse(e, &cache_key, &cache_value);
 
 		if (value.length <= cache_value.length) {
-			if (memcache_is_talloc(e->n)) {
-				struct memcache_talloc_value mtv;
+			memcache_discharge(cache, e);
+			memcache_free_value(e);
 
-				SMB_ASSERT(cache_value.length == sizeof(mtv));
-				memcpy(&mtv, cache_value.data, sizeof(mtv));
-				cache->size -= mtv.len;
-				TALLOC_FREE(mtv.ptr);
-			}
 			/*
 			 * We can reuse the existing record
 			 */
 			memcpy(cache_value.data, value.data, value.length);
 			e->valuelength = value.length;
 
-			if (memcache_is_talloc(e->n)) {
-				struct memcache_talloc_value mtv;
-
-				SMB_ASSERT(cache_value.length == sizeof(mtv));
-				memcpy(&mtv, cache_value.data, sizeof(mtv));
-				cache->size += mtv.len;
-			}
+			memcache_charge(cache, e);
+			slot->referenced = true;
+			memcache_trim(cache, e);
 			return true;
 		}
 
-		memcache_delete_element(cache, e);
+		memcache_delete_element(cache, slot);
+	}
+
+	hash = memcache_hash(n, key);
+	shard = memcache_shard(cache, hash);
+
+	if (!memcache_shard_reserve(cache, shard)) {
+		DEBUG(0, ("talloc failed\n"));
+		return false;
 	}
 
 	element_size = memcache_element_size(key.length, value.length);
@@ -335,33 +575,13 @@ bool memcache_add(struct memcache *cache, enum memcache_number n,
 	memcpy(cache_key.data, key.data, key.length);
 	memcpy(cache_value.data, value.data, value.length);
 
-	parent = NULL;
-	p = &cache->tree.rb_node;
-
-	while (*p) {
-		struct memcache_element *elem = memcache_node2elem(*p);
-		int cmp;
-
-		parent = (*p);
-
-		cmp = memcache_compare(elem, n, key);
-
-		p = (cmp < 0) ? &(*p)->rb_left : &(*p)->rb_right;
-	}
-
-	rb_link_node(&e->rb_node, parent, p);
-	rb_insert_color(&e->rb_node, &cache->tree);
-
-	DLIST_ADD(cache->mru, e);
+	memcache_shard_link(shard, (struct memcache_slot) {
+			.hash = hash, .n = n, .e = e });
 
-	cache->size += element_size;
-	if (memcache_is_talloc(e->n)) {
-		struct memcache_talloc_value mtv;
+	cache->num_elements += 1;
+	cache->stats[n].num_elements += 1;
+	memcache_charge(cache, e);
 
-		SMB_ASSERT(cache_value.length == sizeof(mtv));
-		memcpy(&mtv, cache_value.data, sizeof(mtv));
-		cache->size += mtv.len;
-	}
 	memcache_trim(cache, e);
 
 	return true;
@@ -388,7 +608,7 @@ bool memcache_add_talloc(struct memcache *cache, enum memcache_number n,
 
 void memcache_flush(struct memcache *cache, enum memcache_number n)
 {
-	struct rb_node *node;
+	unsigned s;
 
 	if (cache == NULL) {
 		cache = global_cache;
@@ -397,68 +617,63 @@ void memcache_flush(struct memcache *cache, enum memcache_number n)
 		return;
 	}
 
-	/*
-	 * Find the smallest element of number n
-	 */
-
-	node = cache->tree.rb_node;
-	if (node == NULL) {
-		return;
-	}
-
-	/*
-	 * First, find *any* element of number n
-	 */
+	for (s = 0; s < MEMCACHE_NUM_SHARDS; s++) {
+		struct memcache_shard *shard = &cache->shards[s];
+		uint32_t i = 0;
 
-	while (true) {
-		struct memcache_element *elem = memcache_node2elem(node);
-		struct rb_node *next;
+		while ((i < shard->num_slots) &&
+		       (cache->stats[n].num_elements != 0)) {
+			struct memcache_slot *slot = &shard->slots[i];
 
-		if ((int)elem->n == (int)n) {
-			break;
-		}
+			if ((slot->e == NULL) || (slot->n != n)) {
+				i += 1;
+				continue;
+			}
 
-		if ((int)elem->n < (int)n) {
-			next = node->rb_right;
-		}
-		else {
-			next = node->rb_left;
-		}
-		if (next == NULL) {
-			break;
+			/*
+			 * Don't advance i, unlinking might have moved
+			 * another element into this slot
+			 */
+			memcache_delete_slot(cache, shard, i);
 		}
-		node = next;
 	}
+}
 
-	/*
-	 * Then, find the leftmost element with number n
-	 */
+bool memcache_get_stats(struct memcache *cache, enum memcache_number n,
+			struct memcache_stats *stats)
+{
+	if (cache == NULL) {
+		cache = global_cache;
+	}
+	if ((cache == NULL) || (n >= MEMCACHE_NUM_CACHES)) {
+		return false;
+	}
+	*stats = cache->stats[n];
+	return true;
+}
 
-	while (true) {
-		struct rb_node *prev = rb_prev(node);
-		struct memcache_element *elem;
+bool memcache_get_usage(struct memcache *cache, struct memcache_usage *usage)
+{
+	unsigned s;
 
-		if (prev == NULL) {
-			break;
-		}
-		elem = memcache_node2elem(prev);
-		if ((int)elem->n != (int)n) {
-			break;
-		}
-		node = prev;
+	if (cache == NULL) {
+		cache = global_cache;
+	}
+	if (cache == NULL) {
+		return false;
 	}
 
-	while (node != NULL) {
-		struct memcache_element *e = memcache_node2elem(node);
-		struct rb_node *next = rb_next(node);
-
-		if (e->n != n) {
-			break;
-		}
+	*usage = (struct memcache_usage) {
+		.size = cache->size,
+		.max_size = cache->max_size,
+		.num_elements = cache->num_elements,
+	};
 
-		memcache_delete_element(cache, e);
-		node = next;
+	for (s = 0; s < MEMCACHE_NUM_SHARDS; s++) {
+		usage->table_size += cache->shards[s].num_slots *
+			sizeof(struct memcache_slot);
 	}
+	return true;
 }
 
 void gfree_memcache(void)
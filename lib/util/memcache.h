@@ -47,11 +47,32 @@ enum memcache_number {
 	SHARE_MODE_LOCK_CACHE,	/* talloc */
 	VIRUSFILTER_SCAN_RESULTS_CACHE_TALLOC, /* talloc */
 	DFREE_CACHE,
+	SHARE_MODE_SNAPSHOT_CACHE,
+	IDMAP_SID2XID_CACHE,
+	IDMAP_XID2SID_CACHE,
+	GENCACHE_RECORD_CACHE,
+	ACL_BLOB_CACHE_TALLOC,	/* talloc */
+	SYS_ACL_HASH_CACHE,
+	DNS_RECORDS_CACHE,
+	DNS_FORWARDER_CACHE,
+	MDSSVC_ES_RESULTS_CACHE,
+	REGDB_INDEX_CACHE_TALLOC, /* talloc */
+	SPOOLSS_PRINTER_INFO_CACHE,
+	SPOOLSS_DRIVER_INFO_CACHE,
+	SAMLOGON_NTLM_CACHE,
+	AUTORID_RANGE_CACHE,
+	MEMCACHE_NUM_CACHES	/* must be last */
 };
 
 /*
  * Create a memcache structure. max_size is in bytes, if you set it 0 it will
  * not forget anything.
+ *
+ * An element is charged with its key, its value, a hash table slot and for
+ * talloc caches the talloc_total_size() of the value at the time it was
+ * added. The unused slots of the hash tables are not charged. max_size
+ * limits the sum over all elements of the cache, it is exceeded only by a
+ * single element that is larger than max_size on its own.
  */
 
 struct memcache *memcache_init(TALLOC_CTX *mem_ctx, size_t max_size);
@@ -114,6 +135,37 @@ void *memcache_lookup_talloc(struct memcache *cache, enum memcache_number n,
 
 void memcache_flush(struct memcache *cache, enum memcache_number n);
 
+/*
+ * Counters per cache subset. num_elements and size describe what's
+ * currently in the cache, size includes talloc'ed values.
+ */
+
+struct memcache_stats {
+	uint64_t hits;
+	uint64_t misses;
+	uint64_t evictions;
+	size_t num_elements;
+	size_t size;
+};
+
+bool memcache_get_stats(struct memcache *cache, enum memcache_number n,
+			struct memcache_stats *stats);
+
+/*
+ * Overall memory use. size is what's charged against max_size, this
+ * includes one hash table slot per element. table_size is the size of
+ * all hash tables including the unused slots.
+ */
+
+struct memcache_usage {
+	size_t size;
+	size_t max_size;
+	size_t table_size;
+	size_t num_elements;
+};
+
+bool memcache_get_usage(struct memcache *cache, struct memcache_usage *usage);
+
 void gfree_memcache(void);
 
 #endif
@@ -57,7 +57,11 @@ struct server_id_db *server_id_db_init(TALLOC_CTX *mem_ctx,
 
 	snprintf(path, pathlen, "%s/names.tdb", base_path);
 
-	db->tdb = tdb_wrap_open(db, path, hash_size, tdb_flags,
+	/*
+	 * TDB_SEQNUM for server_id_db_seqnum(), all writers need to
+	 * bump it.
+	 */
+	db->tdb = tdb_wrap_open(db, path, hash_size, tdb_flags|TDB_SEQNUM,
 				O_RDWR|O_CREAT, 0660);
 	if (db->tdb == NULL) {
 		TALLOC_FREE(db);
@@ -80,6 +84,15 @@ struct server_id server_id_db_pid(struct server_id_db *db)
 	return db->pid;
 }
 
+/*
+ * Changes whenever a name is added or removed by any process, so
+ * callers can cache lookup results while it stays the same.
+ */
+int server_id_db_seqnum(struct server_id_db *db)
+{
+	return tdb_get_seqnum(db->tdb->tdb);
+}
+
 static int server_id_db_destructor(struct server_id_db *db)
 {
 	char *name = NULL;
@@ -139,6 +139,161 @@ static void torture_memcache_add_oversize(void **state)
 	TALLOC_FREE(cache);
 }
 
+static void torture_memcache_stats(void **state)
+{
+	TALLOC_CTX *mem_ctx = *state;
+	struct memcache *cache = NULL;
+	struct memcache_stats stats;
+	struct memcache_usage usage;
+	DATA_BLOB key1, key2, value;
+	bool ok;
+
+	cache = memcache_init(mem_ctx, 0);
+	assert_non_null(cache);
+
+	key1 = data_blob_const("key1", 4);
+	key2 = data_blob_const("key2", 4);
+
+	ok = memcache_add(cache, STAT_CACHE, key1, data_blob_const("v1", 2));
+	assert_true(ok);
+	ok = memcache_add(cache, DFREE_CACHE, key2, data_blob_const("v2", 2));
+	assert_true(ok);
+
+	ok = memcache_lookup(cache, STAT_CACHE, key1, &value);
+	assert_true(ok);
+	ok = memcache_lookup(cache, STAT_CACHE, key2, &value);
+	assert_false(ok);
+
+	ok = memcache_get_stats(cache, STAT_CACHE, &stats);
+	assert_true(ok);
+	assert_int_equal(stats.hits, 1);
+	assert_int_equal(stats.misses, 1);
+	assert_int_equal(stats.evictions, 0);
+	assert_int_equal(stats.num_elements, 1);
+
+	ok = memcache_get_usage(cache, &usage);
+	assert_true(ok);
+	assert_int_equal(usage.num_elements, 2);
+	assert_int_equal(usage.max_size, 0);
+	assert_true(usage.size > stats.size);
+	assert_true(usage.table_size > 0);
+
+	memcache_flush(cache, STAT_CACHE);
+
+	ok = memcache_get_stats(cache, STAT_CACHE, &stats);
+	assert_true(ok);
+	assert_int_equal(stats.num_elements, 0);
+	assert_int_equal(stats.size, 0);
+
+	ok = memcache_get_usage(cache, &usage);
+	assert_true(ok);
+	assert_int_equal(usage.num_elements, 1);
+
+	TALLOC_FREE(cache);
+}
+
+static void torture_memcache_clock(void **state)
+{
+	TALLOC_CTX *mem_ctx = *state;
+	struct memcache *cache = NULL;
+	struct memcache_stats stats;
+	struct memcache_usage usage;
+	DATA_BLOB hot, value;
+	int i;
+	bool ok;
+
+	cache = memcache_init(mem_ctx, 2000);
+	assert_non_null(cache);
+
+	hot = data_blob_const("hot", 3);
+	ok = memcache_add(cache, STAT_CACHE, hot, data_blob_const("x", 1));
+	assert_true(ok);
+
+	/*
+	 * A stream of cold entries must not push out the one we keep
+	 * looking at
+	 */
+	for (i=0; i<10000; i++) {
+		char key[32];
+
+		ok = memcache_lookup(cache, STAT_CACHE, hot, &value);
+		assert_true(ok);
+
+		snprintf(key, sizeof(key), "cold%d", i);
+		ok = memcache_add(cache, STAT_CACHE,
+				  data_blob_const(key, strlen(key)),
+				  data_blob_const(key, strlen(key)));
+		assert_true(ok);
+
+		ok = memcache_get_usage(cache, &usage);
+		assert_true(ok);
+		assert_true(usage.size <= usage.max_size);
+	}
+
+	ok = memcache_get_stats(cache, STAT_CACHE, &stats);
+	assert_true(ok);
+	assert_int_equal(stats.hits, 10000);
+	assert_true(stats.evictions > 0);
+	assert_int_equal(stats.evictions + stats.num_elements, 10001);
+
+	TALLOC_FREE(cache);
+}
+
+/*
+ * max_size is a limit for the whole cache, not per shard: With all
+ * elements referenced, adding one more has to clear the referenced
+ * bits in every shard and still evict something.
+ */
+static void torture_memcache_shards(void **state)
+{
+	TALLOC_CTX *mem_ctx = *state;
+	struct memcache *cache = NULL;
+	struct memcache_stats stats;
+	struct memcache_usage usage;
+	DATA_BLOB value;
+	size_t max_elements = 0;
+	int i, j;
+	bool ok;
+
+	cache = memcache_init(mem_ctx, 4000);
+	assert_non_null(cache);
+
+	for (i=0; i<200; i++) {
+		char key[32];
+
+		snprintf(key, sizeof(key), "key%d", i);
+		ok = memcache_add(cache, STAT_CACHE,
+				  data_blob_const(key, strlen(key)),
+				  data_blob_const(key, strlen(key)));
+		assert_true(ok);
+
+		ok = memcache_get_usage(cache, &usage);
+		assert_true(ok);
+		assert_true(usage.size <= usage.max_size);
+		if (usage.num_elements > max_elements) {
+			max_elements = usage.num_elements;
+		}
+
+		for (j=0; j<=i; j++) {
+			snprintf(key, sizeof(key), "key%d", j);
+			memcache_lookup(cache, STAT_CACHE,
+					data_blob_const(key, strlen(key)),
+					&value);
+		}
+	}
+
+	/* More than one element per shard fits */
+	assert_true(max_elements > 8);
+
+	ok = memcache_get_stats(cache, STAT_CACHE, &stats);
+	assert_true(ok);
+	assert_int_equal(stats.num_elements, usage.num_elements);
+	assert_int_equal(stats.size, usage.size);
+	assert_int_equal(stats.evictions + stats.num_elements, 200);
+
+	TALLOC_FREE(cache);
+}
+
 int main(int argc, char *argv[])
 {
 	int rc;
@@ -146,6 +301,9 @@ int main(int argc, char *argv[])
 		cmocka_unit_test(torture_memcache_init),
 		cmocka_unit_test(torture_memcache_add_lookup_delete),
 		cmocka_unit_test(torture_memcache_add_oversize),
+		cmocka_unit_test(torture_memcache_stats),
+		cmocka_unit_test(torture_memcache_clock),
+		cmocka_unit_test(torture_memcache_shards),
 	};
 
 	if (argc == 2) {
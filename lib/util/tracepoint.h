@@ -0,0 +1,45 @@
+/*
+ * Unix SMB/CIFS implementation.
+ *
+ * Static (USDT) tracepoints
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef __LIB_UTIL_TRACEPOINT_H__
+#define __LIB_UTIL_TRACEPOINT_H__
+
+/*
+ * SAMBA_TRACEPOINT(name, args...) places a USDT probe
+ * "samba:name" at the calling site. The probe is a single nop
+ * instruction plus a note in the .note.stapsdt section, the
+ * arguments are only put into registers or onto the stack, so
+ * this is cheap enough for hot paths. Keep the arguments to
+ * plain integers and pointers, at most 12 of them, and don't
+ * pass anything that needs to be computed.
+ *
+ * bpftrace, perf, systemtap and "lttng enable-event --userspace-probe"
+ * can attach to these, see examples/bpftrace/ for some scripts.
+ *
+ * Without sys/sdt.h the probes compile to nothing.
+ */
+
+#ifdef HAVE_SYS_SDT_H
+#include <sys/sdt.h>
+#define SAMBA_TRACEPOINT(name, ...) STAP_PROBEV(samba, name, ##__VA_ARGS__)
+#else
+#define SAMBA_TRACEPOINT(name, ...) do { } while (0)
+#endif
+
+#endif /* __LIB_UTIL_TRACEPOINT_H__ */
@@ -30,3 +30,12 @@ WERROR drsuapi_encrypt_attribute(TALLOC_CTX *mem_ctx,
 				 const DATA_BLOB *gensec_skey,
 				 uint32_t rid,
 				 struct drsuapi_DsReplicaAttribute *attr);
+
+bool drsuapi_attribute_is_encrypted(uint32_t attid, bool *rid_crypt);
+
+WERROR drsuapi_encrypt_attribute_value(TALLOC_CTX *mem_ctx,
+				       const DATA_BLOB *gensec_skey,
+				       bool rid_crypt,
+				       uint32_t rid,
+				       const DATA_BLOB *in,
+				       DATA_BLOB *out);
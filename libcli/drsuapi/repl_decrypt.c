@@ -213,12 +213,16 @@ WERROR drsuapi_decrypt_attribute(TALLOC_CTX *mem_ctx,
 	return WERR_OK;
 }
 
-static WERROR drsuapi_encrypt_attribute_value(TALLOC_CTX *mem_ctx,
-					      const DATA_BLOB *gensec_skey,
-					      bool rid_crypt,
-					      uint32_t rid,
-					      const DATA_BLOB *in,
-					      DATA_BLOB *out)
+/*
+ * Only allocates on mem_ctx, so this can run in a helper thread when
+ * mem_ctx, gensec_skey and in are not shared with the main thread.
+ */
+WERROR drsuapi_encrypt_attribute_value(TALLOC_CTX *mem_ctx,
+				       const DATA_BLOB *gensec_skey,
+				       bool rid_crypt,
+				       uint32_t rid,
+				       const DATA_BLOB *in,
+				       DATA_BLOB *out)
 {
 	DATA_BLOB rid_crypt_out = data_blob(NULL, 0);
 	DATA_BLOB confounder;
@@ -332,6 +336,35 @@ out:
   encrypt a DRSUAPI attribute ready for sending over the wire
   Only some attribute types are encrypted
  */
+/*
+ * Return true if the values of the attribute are sent encrypted,
+ * *rid_crypt tells if they are also encrypted with the RID
+ */
+bool drsuapi_attribute_is_encrypted(uint32_t attid, bool *rid_crypt)
+{
+	switch (attid) {
+	case DRSUAPI_ATTID_dBCSPwd:
+	case DRSUAPI_ATTID_unicodePwd:
+	case DRSUAPI_ATTID_ntPwdHistory:
+	case DRSUAPI_ATTID_lmPwdHistory:
+		*rid_crypt = true;
+		return true;
+	case DRSUAPI_ATTID_supplementalCredentials:
+	case DRSUAPI_ATTID_priorValue:
+	case DRSUAPI_ATTID_currentValue:
+	case DRSUAPI_ATTID_trustAuthOutgoing:
+	case DRSUAPI_ATTID_trustAuthIncoming:
+	case DRSUAPI_ATTID_initialAuthOutgoing:
+	case DRSUAPI_ATTID_initialAuthIncoming:
+		*rid_crypt = false;
+		return true;
+	default:
+		break;
+	}
+
+	return false;
+}
+
 WERROR drsuapi_encrypt_attribute(TALLOC_CTX *mem_ctx, 
 				 const DATA_BLOB *gensec_skey,
 				 uint32_t rid,
@@ -346,22 +379,7 @@ WERROR drsuapi_encrypt_attribute(TALLOC_CTX *mem_ctx,
 		return WERR_OK;
 	}
 
-	switch (attr->attid) {
-	case DRSUAPI_ATTID_dBCSPwd:
-	case DRSUAPI_ATTID_unicodePwd:
-	case DRSUAPI_ATTID_ntPwdHistory:
-	case DRSUAPI_ATTID_lmPwdHistory:
-		rid_crypt = true;
-		break;
-	case DRSUAPI_ATTID_supplementalCredentials:
-	case DRSUAPI_ATTID_priorValue:
-	case DRSUAPI_ATTID_currentValue:
-	case DRSUAPI_ATTID_trustAuthOutgoing:
-	case DRSUAPI_ATTID_trustAuthIncoming:
-	case DRSUAPI_ATTID_initialAuthOutgoing:
-	case DRSUAPI_ATTID_initialAuthIncoming:
-		break;
-	default:
+	if (!drsuapi_attribute_is_encrypted(attr->attid, &rid_crypt)) {
 		return WERR_OK;
 	}
 
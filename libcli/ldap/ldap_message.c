@@ -708,6 +708,177 @@ _PUBLIC_ bool ldap_encode(struct ldap_message *msg,
 	return false;
 }
 
+/*
+ * A SearchResultEntry encoded straight from the ldb_message, see
+ * ldap_search_entry_size(). The lengths are encoded the way
+ * asn1_pop_tag() does, so the result matches ldap_encode().
+ */
+
+static size_t ldap_ber_length_size(size_t len)
+{
+	if (len > 0xFFFFFF) {
+		return 5;
+	}
+	if (len > 0xFFFF) {
+		return 4;
+	}
+	if (len > 255) {
+		return 3;
+	}
+	if (len > 127) {
+		return 2;
+	}
+	return 1;
+}
+
+/* tag, length and contents */
+static size_t ldap_ber_size(size_t len)
+{
+	return 1 + ldap_ber_length_size(len) + len;
+}
+
+static size_t ldap_ber_int_size(int32_t v)
+{
+	size_t n = 1;
+
+	/* minimal two's complement, like asn1_write_implicit_Integer() */
+	while ((n < 4) &&
+	       ((v >> (8*n - 1)) != 0) &&
+	       ((v >> (8*n - 1)) != -1)) {
+		n++;
+	}
+	return n;
+}
+
+static uint8_t *ldap_ber_put_header(uint8_t *p, uint8_t tag, size_t len)
+{
+	size_t n = ldap_ber_length_size(len);
+
+	*p++ = tag;
+	if (n == 1) {
+		*p++ = len;
+		return p;
+	}
+	*p++ = 0x80 | (n - 1);
+	while (--n > 0) {
+		*p++ = (len >> (8 * (n - 1))) & 0xFF;
+	}
+	return p;
+}
+
+static uint8_t *ldap_ber_put_octets(uint8_t *p, const void *data, size_t len)
+{
+	p = ldap_ber_put_header(p, ASN1_OCTET_STRING, len);
+	if (len != 0) {
+		memcpy(p, data, len);
+	}
+	return p + len;
+}
+
+static size_t ldap_search_entry_values_size(const struct ldb_message_element *el)
+{
+	size_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < el->num_values; i++) {
+		len += ldap_ber_size(el->values[i].length);
+	}
+	return len;
+}
+
+static size_t ldap_search_entry_attr_size(const struct ldb_message_element *el)
+{
+	return ldap_ber_size(strlen(el->name)) +
+		ldap_ber_size(ldap_search_entry_values_size(el));
+}
+
+static size_t ldap_search_entry_attrs_size(const struct ldb_message *msg)
+{
+	size_t len = 0;
+	unsigned int i;
+
+	for (i = 0; i < msg->num_elements; i++) {
+		len += ldap_ber_size(ldap_search_entry_attr_size(
+					     &msg->elements[i]));
+	}
+	return len;
+}
+
+static size_t ldap_search_entry_op_size(const char *dn,
+					const struct ldb_message *msg)
+{
+	return ldap_ber_size(strlen(dn)) +
+		ldap_ber_size(ldap_search_entry_attrs_size(msg));
+}
+
+/*
+ * The size of the encoded SearchResultEntry, 0 if it is too large
+ * for a BER length
+ */
+_PUBLIC_ size_t ldap_search_entry_size(int messageid,
+				       const char *dn,
+				       const struct ldb_message *msg)
+{
+	size_t len;
+
+	/*
+	 * Each value is bounded by the memory it lives in, so the
+	 * sum can't wrap, it is just checked against what BER can
+	 * describe.
+	 */
+	len = ldap_ber_size(ldap_ber_int_size(messageid)) +
+		ldap_ber_size(ldap_search_entry_op_size(dn, msg));
+	if (len > UINT32_MAX) {
+		return 0;
+	}
+	return ldap_ber_size(len);
+}
+
+/*
+ * Encode a SearchResultEntry into buf, which needs to have room for
+ * ldap_search_entry_size() bytes. This avoids building a struct
+ * ldap_message and the reallocs and memmoves of struct asn1_data.
+ */
+_PUBLIC_ void ldap_search_entry_encode(int messageid,
+				       const char *dn,
+				       const struct ldb_message *msg,
+				       uint8_t *buf)
+{
+	size_t int_len = ldap_ber_int_size(messageid);
+	size_t op_len = ldap_search_entry_op_size(dn, msg);
+	uint8_t *p = buf;
+	unsigned int i, j;
+
+	p = ldap_ber_put_header(p, ASN1_SEQUENCE(0),
+				ldap_ber_size(int_len) + ldap_ber_size(op_len));
+
+	p = ldap_ber_put_header(p, ASN1_INTEGER, int_len);
+	for (i = int_len; i > 0; i--) {
+		*p++ = ((uint32_t)messageid >> (8 * (i - 1))) & 0xFF;
+	}
+
+	p = ldap_ber_put_header(p, ASN1_APPLICATION(LDAP_TAG_SearchResultEntry),
+				op_len);
+	p = ldap_ber_put_octets(p, dn, strlen(dn));
+	p = ldap_ber_put_header(p, ASN1_SEQUENCE(0),
+				ldap_search_entry_attrs_size(msg));
+
+	for (i = 0; i < msg->num_elements; i++) {
+		const struct ldb_message_element *el = &msg->elements[i];
+
+		p = ldap_ber_put_header(p, ASN1_SEQUENCE(0),
+					ldap_search_entry_attr_size(el));
+		p = ldap_ber_put_octets(p, el->name, strlen(el->name));
+		p = ldap_ber_put_header(p, ASN1_SEQUENCE(1),
+					ldap_search_entry_values_size(el));
+		for (j = 0; j < el->num_values; j++) {
+			p = ldap_ber_put_octets(p,
+						el->values[j].data,
+						el->values[j].length);
+		}
+	}
+}
+
 static const char *blob2string_talloc(TALLOC_CTX *mem_ctx,
 				      DATA_BLOB blob)
 {
@@ -228,6 +228,13 @@ NTSTATUS ldap_decode(struct asn1_data *data,
 bool ldap_encode(struct ldap_message *msg,
 		 const struct ldap_control_handler *control_handlers,
 		 DATA_BLOB *result, TALLOC_CTX *mem_ctx);
+size_t ldap_search_entry_size(int messageid,
+			      const char *dn,
+			      const struct ldb_message *msg);
+void ldap_search_entry_encode(int messageid,
+			      const char *dn,
+			      const struct ldb_message *msg,
+			      uint8_t *buf);
 NTSTATUS ldap_full_packet(struct tstream_context *stream,
 			  void *private_data,
 			  DATA_BLOB blob,
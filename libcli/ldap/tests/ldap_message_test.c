@@ -315,6 +315,114 @@ static void test_decode_exop_response(void **state)
 	assert_true(ret == 0);
 }
 
+/*
+ * Check that ldap_search_entry_encode() produces the same bytes as
+ * ldap_encode() on the equivalent ldap_message
+ */
+static void assert_search_entry_encoding(struct test_ctx *test_ctx,
+					 int messageid,
+					 const char *dn,
+					 struct ldb_message *msg)
+{
+	struct ldap_message *ldap_msg = NULL;
+	struct ldap_SearchResEntry *ent = NULL;
+	DATA_BLOB expected = data_blob_null;
+	uint8_t *buf = NULL;
+	size_t size;
+	bool ok;
+
+	ldap_msg = talloc_zero(test_ctx, struct ldap_message);
+	assert_non_null(ldap_msg);
+	ldap_msg->messageid = messageid;
+	ldap_msg->type = LDAP_TAG_SearchResultEntry;
+	ent = &ldap_msg->r.SearchResultEntry;
+	ent->dn = dn;
+	ent->num_attributes = msg->num_elements;
+	ent->attributes = msg->elements;
+
+	ok = ldap_encode(ldap_msg,
+			 samba_ldap_control_handlers(),
+			 &expected,
+			 test_ctx);
+	assert_true(ok);
+
+	size = ldap_search_entry_size(messageid, dn, msg);
+	assert_int_equal(size, expected.length);
+
+	buf = talloc_size(test_ctx, size);
+	assert_non_null(buf);
+	ldap_search_entry_encode(messageid, dn, msg, buf);
+	assert_memory_equal(buf, expected.data, size);
+
+	TALLOC_FREE(buf);
+	TALLOC_FREE(expected.data);
+	TALLOC_FREE(ldap_msg);
+}
+
+/*
+ * Test the direct encoding of search entries, across the boundaries
+ * of the BER length and integer encodings
+ */
+static void test_encode_search_entry(void **state)
+{
+	struct test_ctx *test_ctx = talloc_get_type_abort(
+		*state,
+		struct test_ctx);
+	const int messageids[] = {
+		0, 1, 127, 128, 255, 256, 32767, 32768,
+		0x7fffff, 0x800000, 0x7fffffff, -1, -128, -129,
+	};
+	const size_t lengths[] = {
+		0, 1, 127, 128, 255, 256, 65535, 65536, 70000,
+	};
+	struct ldb_message *msg = NULL;
+	struct ldb_val values[2];
+	size_t i, j;
+
+	msg = ldb_msg_new(test_ctx);
+	assert_non_null(msg);
+
+	/* an entry without attributes */
+	for (i = 0; i < ARRAY_SIZE(messageids); i++) {
+		assert_search_entry_encoding(test_ctx, messageids[i], "", msg);
+		assert_search_entry_encoding(test_ctx,
+					     messageids[i],
+					     "CN=foo,DC=samba,DC=example,DC=com",
+					     msg);
+	}
+
+	msg->num_elements = 2;
+	msg->elements = talloc_zero_array(msg,
+					  struct ldb_message_element,
+					  msg->num_elements);
+	assert_non_null(msg->elements);
+	msg->elements[0].name = "description";
+	msg->elements[0].num_values = ARRAY_SIZE(values);
+	msg->elements[0].values = values;
+	/* an attribute without values, as sent for attributesonly */
+	msg->elements[1].name = "objectGUID";
+
+	for (i = 0; i < ARRAY_SIZE(lengths); i++) {
+		for (j = 0; j < ARRAY_SIZE(values); j++) {
+			values[j].length = lengths[i] + j;
+			values[j].data = talloc_size(msg, values[j].length + 1);
+			assert_non_null(values[j].data);
+			memset(values[j].data, 'a' + j, values[j].length);
+		}
+
+		assert_search_entry_encoding(test_ctx,
+					     messageids[i],
+					     "CN=foo,DC=samba,DC=example,DC=com",
+					     msg);
+
+		for (j = 0; j < ARRAY_SIZE(values); j++) {
+			TALLOC_FREE(values[j].data);
+		}
+	}
+
+	TALLOC_FREE(msg);
+}
+
 int main(_UNUSED_ int argc, _UNUSED_ const char **argv)
 {
 	const struct CMUnitTest tests[] = {
@@ -338,6 +446,10 @@ int main(_UNUSED_ int argc, _UNUSED_ const char **argv)
 			test_decode_exop_response,
 			setup,
 			teardown),
+		cmocka_unit_test_setup_teardown(
+			test_encode_search_entry,
+			setup,
+			teardown),
 	};
 
 	cmocka_set_message_output(CM_OUTPUT_SUBUNIT);
@@ -0,0 +1,453 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   SMB3 compression transform handling
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "../libcli/smb/smb_common.h"
+#include "libcli/smb/smb2_negotiate_context.h"
+#include "libcli/smb/smb2_compression.h"
+#include "lib/compression/lzxpress.h"
+#include "lib/compression/lzxpress_huffman.h"
+
+bool smb2_compression_algo_negotiated(
+	const struct smb3_compression_capabilities *c,
+	uint16_t algo)
+{
+	size_t i;
+
+	for (i = 0; i < c->num_algos; i++) {
+		if (c->algos[i] == algo) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+size_t smb2_compression_max_size(uint16_t algo, size_t in_len)
+{
+	if (algo == SMB2_COMPRESSION_LZ77_HUFFMAN) {
+		return lzxpress_huffman_max_compressed_size(in_len);
+	}
+
+	/*
+	 * Plain LZ77 needs one 32-bit indicator per 32 literals
+	 * in the worst case.
+	 */
+	return in_len + (in_len / 8) + 16;
+}
+
+bool smb2_compression_is_pattern(const uint8_t *buf, size_t len)
+{
+	if (len == 0) {
+		return false;
+	}
+
+	/*
+	 * buf[0..len-1] equals buf[1..len] only if
+	 * every byte has the same value.
+	 */
+	return (memcmp(buf, buf + 1, len - 1) == 0);
+}
+
+static ssize_t smb2_compression_decompress_algo(uint16_t algo,
+						const uint8_t *in,
+						size_t in_len,
+						uint8_t *out,
+						size_t out_len)
+{
+	switch (algo) {
+	case SMB2_COMPRESSION_LZ77:
+		return lzxpress_decompress(in, in_len, out, out_len);
+	case SMB2_COMPRESSION_LZ77_HUFFMAN:
+		return lzxpress_huffman_decompress(in, in_len, out, out_len);
+	default:
+		break;
+	}
+
+	return -1;
+}
+
+static NTSTATUS smb2_decompress_chained(
+	const struct smb3_compression_capabilities *c,
+	const uint8_t *buf,
+	size_t buflen,
+	uint8_t *out,
+	size_t out_size)
+{
+	size_t ofs = SMB2_COMP_TF_ALGORITHM;
+	size_t out_ofs = 0;
+
+	while (ofs < buflen) {
+		uint16_t algo;
+		uint32_t len;
+		const uint8_t *payload = NULL;
+
+		if (buflen - ofs < SMB2_COMP_PAYLOAD_HDR_SIZE) {
+			return NT_STATUS_INVALID_PARAMETER;
+		}
+
+		algo = SVAL(buf, ofs + SMB2_COMP_PAYLOAD_ALGORITHM);
+		len = IVAL(buf, ofs + SMB2_COMP_PAYLOAD_LENGTH);
+		ofs += SMB2_COMP_PAYLOAD_HDR_SIZE;
+
+		if (len > buflen - ofs) {
+			return NT_STATUS_INVALID_PARAMETER;
+		}
+		payload = buf + ofs;
+		ofs += len;
+
+		if (algo != SMB2_COMPRESSION_NONE &&
+		    !smb2_compression_algo_negotiated(c, algo))
+		{
+			DBG_INFO("compression algorithm 0x%04x "
+				 "not negotiated\n", algo);
+			return NT_STATUS_INVALID_PARAMETER;
+		}
+
+		switch (algo) {
+		case SMB2_COMPRESSION_NONE:
+			if (len > out_size - out_ofs) {
+				return NT_STATUS_INVALID_PARAMETER;
+			}
+			memcpy(out + out_ofs, payload, len);
+			out_ofs += len;
+			break;
+
+		case SMB2_COMPRESSION_PATTERN_V1: {
+			uint8_t pattern;
+			uint32_t repetitions;
+
+			if (len != SMB2_COMP_PATTERN_V1_SIZE) {
+				return NT_STATUS_INVALID_PARAMETER;
+			}
+			pattern = CVAL(payload, 0);
+			repetitions = IVAL(payload, 4);
+			if (repetitions > out_size - out_ofs) {
+				return NT_STATUS_INVALID_PARAMETER;
+			}
+			memset(out + out_ofs, pattern, repetitions);
+			out_ofs += repetitions;
+			break;
+		}
+
+		default: {
+			uint32_t original_size;
+			ssize_t ret;
+
+			if (len < 4) {
+				return NT_STATUS_INVALID_PARAMETER;
+			}
+			original_size = IVAL(payload, 0);
+			if (original_size > out_size - out_ofs) {
+				return NT_STATUS_INVALID_PARAMETER;
+			}
+			ret = smb2_compression_decompress_algo(algo,
+							       payload + 4,
+							       len - 4,
+							       out + out_ofs,
+							       original_size);
+			if (ret != original_size) {
+				return NT_STATUS_BAD_COMPRESSION_BUFFER;
+			}
+			out_ofs += original_size;
+			break;
+		}
+		}
+	}
+
+	if (out_ofs != out_size) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	return NT_STATUS_OK;
+}
+
+NTSTATUS smb2_compression_decompress(TALLOC_CTX *mem_ctx,
+				     const struct smb3_compression_capabilities *c,
+				     const uint8_t *buf,
+				     size_t buflen,
+				     size_t max_size,
+				     uint8_t **_out,
+				     size_t *_out_len)
+{
+	uint32_t original_size;
+	uint16_t flags;
+	size_t out_size;
+	uint8_t *out = NULL;
+	NTSTATUS status;
+
+	if (c->num_algos == 0) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	if (buflen < SMB2_COMP_TF_HDR_SIZE) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	if (IVAL(buf, SMB2_COMP_TF_PROTOCOL_ID) != SMB2_COMP_TF_MAGIC) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	original_size = IVAL(buf, SMB2_COMP_TF_ORIGINAL_SIZE);
+	flags = SVAL(buf, SMB2_COMP_TF_FLAGS);
+
+	if (flags & SMB2_COMPRESSION_FLAG_CHAINED) {
+		if (!c->chained) {
+			return NT_STATUS_INVALID_PARAMETER;
+		}
+		out_size = original_size;
+	} else {
+		uint32_t offset = IVAL(buf, SMB2_COMP_TF_OFFSET);
+
+		if (offset > buflen - SMB2_COMP_TF_HDR_SIZE) {
+			return NT_STATUS_INVALID_PARAMETER;
+		}
+		out_size = (size_t)offset + original_size;
+	}
+
+	if (out_size > max_size || out_size < SMB2_HDR_BODY + 2) {
+		DBG_INFO("invalid decompressed size %zu (max %zu)\n",
+			 out_size, max_size);
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	out = talloc_array(mem_ctx, uint8_t, out_size);
+	if (out == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	if (flags & SMB2_COMPRESSION_FLAG_CHAINED) {
+		status = smb2_decompress_chained(c, buf, buflen, out, out_size);
+	} else {
+		uint16_t algo = SVAL(buf, SMB2_COMP_TF_ALGORITHM);
+		uint32_t offset = IVAL(buf, SMB2_COMP_TF_OFFSET);
+		const uint8_t *in = buf + SMB2_COMP_TF_HDR_SIZE;
+		size_t in_len = buflen - SMB2_COMP_TF_HDR_SIZE;
+		ssize_t ret;
+
+		if (algo == SMB2_COMPRESSION_PATTERN_V1 ||
+		    !smb2_compression_algo_negotiated(c, algo))
+		{
+			DBG_INFO("compression algorithm 0x%04x "
+				 "not negotiated\n", algo);
+			TALLOC_FREE(out);
+			return NT_STATUS_INVALID_PARAMETER;
+		}
+
+		memcpy(out, in, offset);
+		ret = smb2_compression_decompress_algo(algo,
+						       in + offset,
+						       in_len - offset,
+						       out + offset,
+						       original_size);
+		if (ret != original_size) {
+			status = NT_STATUS_BAD_COMPRESSION_BUFFER;
+		} else {
+			status = NT_STATUS_OK;
+		}
+	}
+
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_INFO("failed to decompress %zu bytes: %s\n",
+			 buflen, nt_errstr(status));
+		TALLOC_FREE(out);
+		return status;
+	}
+
+	*_out = out;
+	*_out_len = out_size;
+	return NT_STATUS_OK;
+}
+
+static ssize_t smb2_compression_compress_algo(TALLOC_CTX *mem_ctx,
+					      uint16_t algo,
+					      const uint8_t *in,
+					      size_t in_len,
+					      uint8_t *out,
+					      size_t out_len)
+{
+	struct lzxhuff_compressor_mem *mem = NULL;
+	ssize_t ret;
+
+	switch (algo) {
+	case SMB2_COMPRESSION_LZ77:
+		return lzxpress_compress(in, in_len, out, out_len);
+	case SMB2_COMPRESSION_LZ77_HUFFMAN:
+		mem = talloc(mem_ctx, struct lzxhuff_compressor_mem);
+		if (mem == NULL) {
+			return -1;
+		}
+		ret = lzxpress_huffman_compress(mem, in, in_len, out, out_len);
+		TALLOC_FREE(mem);
+		return ret;
+	default:
+		break;
+	}
+
+	return -1;
+}
+
+NTSTATUS smb2_compression_compress(TALLOC_CTX *mem_ctx,
+				   const struct smb3_compression_capabilities *c,
+				   const uint8_t *buf,
+				   size_t buflen,
+				   size_t offset,
+				   uint8_t **_out,
+				   size_t *_out_len)
+{
+	const uint8_t *data = buf + offset;
+	size_t data_len;
+	uint16_t algo = SMB2_COMPRESSION_NONE;
+	uint8_t *out = NULL;
+	size_t hdr_len;
+	size_t ofs;
+	size_t i;
+
+	*_out = NULL;
+	*_out_len = 0;
+
+	if (c->num_algos == 0 || offset > buflen) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+	data_len = buflen - offset;
+
+	if (buflen > UINT32_MAX) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	if (c->chained &&
+	    smb2_compression_algo_negotiated(c, SMB2_COMPRESSION_PATTERN_V1) &&
+	    smb2_compression_is_pattern(data, data_len))
+	{
+		algo = SMB2_COMPRESSION_PATTERN_V1;
+	}
+
+	for (i = 0; algo == SMB2_COMPRESSION_NONE && i < c->num_algos; i++) {
+		if (c->algos[i] != SMB2_COMPRESSION_PATTERN_V1) {
+			algo = c->algos[i];
+		}
+	}
+
+	if (algo == SMB2_COMPRESSION_NONE) {
+		return NT_STATUS_OK;
+	}
+
+	if (c->chained) {
+		/*
+		 * The transform header carries the first chained
+		 * payload header, which has to have
+		 * SMB2_COMPRESSION_FLAG_CHAINED set. The offset
+		 * bytes go into a SMB2_COMPRESSION_NONE payload
+		 * in front of the compressed one.
+		 */
+		hdr_len = SMB2_COMP_TF_ALGORITHM;
+		if (offset > 0) {
+			hdr_len += SMB2_COMP_PAYLOAD_HDR_SIZE;
+		}
+		ofs = hdr_len + offset + SMB2_COMP_PAYLOAD_HDR_SIZE;
+		if (algo != SMB2_COMPRESSION_PATTERN_V1) {
+			ofs += 4; /* OriginalPayloadSize */
+		}
+	} else {
+		hdr_len = SMB2_COMP_TF_HDR_SIZE;
+		ofs = hdr_len + offset;
+	}
+
+	if (algo == SMB2_COMPRESSION_PATTERN_V1) {
+		out = talloc_zero_array(mem_ctx, uint8_t,
+					ofs + SMB2_COMP_PATTERN_V1_SIZE);
+		if (out == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+		SCVAL(out, ofs + 0, data[0]);
+		SIVAL(out, ofs + 4, data_len);
+		ofs += SMB2_COMP_PATTERN_V1_SIZE;
+	} else {
+		size_t max_len = smb2_compression_max_size(algo, data_len);
+		ssize_t ret;
+
+		out = talloc_array(mem_ctx, uint8_t, ofs + max_len);
+		if (out == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+		ret = smb2_compression_compress_algo(out,
+						     algo,
+						     data,
+						     data_len,
+						     out + ofs,
+						     max_len);
+		if (ret < 0) {
+			DBG_DEBUG("%s compression failed for %zu bytes\n",
+				  smb3_compression_algorithm_name(algo),
+				  data_len);
+			TALLOC_FREE(out);
+			return NT_STATUS_OK;
+		}
+		ofs += ret;
+	}
+
+	if (ofs >= buflen) {
+		/*
+		 * Not worth it, the caller sends it raw.
+		 */
+		TALLOC_FREE(out);
+		return NT_STATUS_OK;
+	}
+
+	SIVAL(out, SMB2_COMP_TF_PROTOCOL_ID, SMB2_COMP_TF_MAGIC);
+
+	if (c->chained) {
+		size_t pofs = SMB2_COMP_TF_ALGORITHM;
+
+		SIVAL(out, SMB2_COMP_TF_ORIGINAL_SIZE, buflen);
+
+		if (offset > 0) {
+			SSVAL(out, pofs + SMB2_COMP_PAYLOAD_ALGORITHM,
+			      SMB2_COMPRESSION_NONE);
+			SSVAL(out, pofs + SMB2_COMP_PAYLOAD_FLAGS,
+			      SMB2_COMPRESSION_FLAG_CHAINED);
+			SIVAL(out, pofs + SMB2_COMP_PAYLOAD_LENGTH, offset);
+			pofs += SMB2_COMP_PAYLOAD_HDR_SIZE;
+			memcpy(out + pofs, buf, offset);
+			pofs += offset;
+		}
+
+		SSVAL(out, pofs + SMB2_COMP_PAYLOAD_ALGORITHM, algo);
+		SSVAL(out, pofs + SMB2_COMP_PAYLOAD_FLAGS,
+		      (pofs == SMB2_COMP_TF_ALGORITHM) ?
+		      SMB2_COMPRESSION_FLAG_CHAINED :
+		      SMB2_COMPRESSION_FLAG_NONE);
+		SIVAL(out, pofs + SMB2_COMP_PAYLOAD_LENGTH,
+		      ofs - (pofs + SMB2_COMP_PAYLOAD_HDR_SIZE));
+		if (algo != SMB2_COMPRESSION_PATTERN_V1) {
+			SIVAL(out, pofs + SMB2_COMP_PAYLOAD_ORIGINAL_SIZE,
+			      data_len);
+		}
+	} else {
+		SIVAL(out, SMB2_COMP_TF_ORIGINAL_SIZE, data_len);
+		SSVAL(out, SMB2_COMP_TF_ALGORITHM, algo);
+		SSVAL(out, SMB2_COMP_TF_FLAGS, SMB2_COMPRESSION_FLAG_NONE);
+		SIVAL(out, SMB2_COMP_TF_OFFSET, offset);
+		memcpy(out + hdr_len, buf, offset);
+	}
+
+	*_out = out;
+	*_out_len = ofs;
+	return NT_STATUS_OK;
+}
@@ -0,0 +1,80 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   SMB3 compression transform handling
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LIBCLI_SMB_SMB2_COMPRESSION_H_
+#define _LIBCLI_SMB_SMB2_COMPRESSION_H_
+
+#include "replace.h"
+#include <talloc.h>
+#include "libcli/util/ntstatus.h"
+
+struct smb3_compression_capabilities;
+
+bool smb2_compression_algo_negotiated(
+	const struct smb3_compression_capabilities *c,
+	uint16_t algo);
+
+/*
+ * The worst case size of the output of
+ * the given algorithm for in_len bytes.
+ */
+size_t smb2_compression_max_size(uint16_t algo, size_t in_len);
+
+/*
+ * true if all len bytes of buf have the same value
+ * and they can be sent as SMB2_COMPRESSION_PATTERN_V1.
+ */
+bool smb2_compression_is_pattern(const uint8_t *buf, size_t len);
+
+/*
+ * Decompress a complete SMB2_COMPRESSION_TRANSFORM message
+ * using only the negotiated algorithms in c.
+ *
+ * The decompressed message can't be larger than max_size
+ * bytes. NT_STATUS_INVALID_PARAMETER is returned for
+ * malformed headers, NT_STATUS_BAD_COMPRESSION_BUFFER when
+ * the payload doesn't match OriginalSize.
+ */
+NTSTATUS smb2_compression_decompress(TALLOC_CTX *mem_ctx,
+				     const struct smb3_compression_capabilities *c,
+				     const uint8_t *buf,
+				     size_t buflen,
+				     size_t max_size,
+				     uint8_t **_out,
+				     size_t *_out_len);
+
+/*
+ * Build a SMB2_COMPRESSION_TRANSFORM message for buf.
+ *
+ * The first offset bytes are sent as they are, the rest
+ * is compressed using the first negotiated algorithm, or
+ * SMB2_COMPRESSION_PATTERN_V1 if possible.
+ *
+ * If the result isn't smaller than buflen, NT_STATUS_OK
+ * is returned with *_out = NULL.
+ */
+NTSTATUS smb2_compression_compress(TALLOC_CTX *mem_ctx,
+				   const struct smb3_compression_capabilities *c,
+				   const uint8_t *buf,
+				   size_t buflen,
+				   size_t offset,
+				   uint8_t **_out,
+				   size_t *_out_len);
+
+#endif /* _LIBCLI_SMB_SMB2_COMPRESSION_H_ */
@@ -0,0 +1,692 @@
+/*
+   Unix SMB/CIFS implementation.
+   smb2 lib
+
+   Related CREATE + <op> + CLOSE compound requests
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "system/network.h"
+#include "lib/util/tevent_ntstatus.h"
+#include "smb_common.h"
+#include "smbXcli_base.h"
+#include "smb2_create_blob.h"
+#include "libcli/security/security.h"
+
+/*
+ * Many operations on a path need a handle just for a single
+ * request: stat, reading a small file, getting or setting a
+ * security descriptor. Sending CREATE, the operation and CLOSE
+ * as one related compound ([MS-SMB2] 3.2.4.1.4) saves two round
+ * trips on every such call.
+ *
+ * The server applies the file id of the CREATE to the related
+ * requests, so they use the 0xFFFFFFFFFFFFFFFF placeholder.
+ *
+ * If the CREATE fails, the server fails the related requests
+ * with the same status. The caller gets the status of the first
+ * request that failed, callers that need to handle things like
+ * NT_STATUS_STOPPED_ON_SYMLINK have to retry with the separate
+ * requests.
+ */
+
+#define SMB2CLI_COMPOUND_FID UINT64_MAX
+
+#define SMB2CLI_COMPOUND_MAX_FIXED 48
+
+struct smb2cli_compound_state {
+	uint8_t create_fixed[56];
+	uint8_t op_fixed[SMB2CLI_COMPOUND_MAX_FIXED];
+	uint8_t close_fixed[24];
+	uint8_t dyn_pad[1];
+	uint16_t opcode;
+	uint32_t max_output_length;
+
+	struct tevent_req *subreqs[3];
+	unsigned num_pending;
+
+	NTSTATUS create_status;
+	NTSTATUS op_status;
+	NTSTATUS close_status;
+
+	struct smb_create_returns cr;
+	struct iovec *recv_iov;
+	DATA_BLOB out_output_buffer;
+};
+
+static void smb2cli_compound_create_done(struct tevent_req *subreq);
+static void smb2cli_compound_op_done(struct tevent_req *subreq);
+static void smb2cli_compound_close_done(struct tevent_req *subreq);
+
+static uint16_t smb2cli_compound_charge(struct smbXcli_conn *conn,
+					size_t dyn_len,
+					size_t max_dyn_len)
+{
+	size_t len = MAX(1, MAX(dyn_len, max_dyn_len));
+
+	if (!(smb2cli_conn_server_capabilities(conn) & SMB2_CAP_LARGE_MTU)) {
+		return 1;
+	}
+	return (len - 1) / 65536 + 1;
+}
+
+static struct tevent_req *smb2cli_compound_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct smbXcli_conn *conn,
+	uint32_t timeout_msec,
+	struct smbXcli_session *session,
+	struct smbXcli_tcon *tcon,
+	const char *filename,
+	uint32_t desired_access,
+	uint32_t file_attributes,
+	uint32_t share_access,
+	uint32_t create_options,
+	struct smb2_create_blobs *blobs,
+	uint16_t opcode,
+	const uint8_t *op_fixed,
+	uint16_t op_fixed_len,
+	const DATA_BLOB *op_dyn,
+	uint32_t max_output_length)
+{
+	struct tevent_req *req = NULL;
+	struct smb2cli_compound_state *state = NULL;
+	uint8_t *name_utf16 = NULL;
+	size_t name_utf16_len = 0;
+	uint8_t *fixed = NULL;
+	DATA_BLOB blob = data_blob_null;
+	size_t blobs_offset;
+	uint8_t *dyn = NULL;
+	size_t dyn_len;
+	const uint8_t *op_dyn_buf = NULL;
+	size_t op_dyn_len;
+	uint32_t create_flags = 0;
+	uint16_t needed;
+	NTSTATUS status;
+	bool ok;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct smb2cli_compound_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->opcode = opcode;
+	state->max_output_length = max_output_length;
+	state->create_status = NT_STATUS_INTERNAL_ERROR;
+	state->op_status = NT_STATUS_INTERNAL_ERROR;
+	state->close_status = NT_STATUS_INTERNAL_ERROR;
+
+	if (op_fixed_len > sizeof(state->op_fixed)) {
+		tevent_req_nterror(req, NT_STATUS_INTERNAL_ERROR);
+		return tevent_req_post(req, ev);
+	}
+	memcpy(state->op_fixed, op_fixed, op_fixed_len);
+
+	if (smbXcli_conn_protocol(conn) < PROTOCOL_SMB2_02) {
+		tevent_req_nterror(req, NT_STATUS_REVISION_MISMATCH);
+		return tevent_req_post(req, ev);
+	}
+
+	if (strlen(filename) > 0) {
+		ok = convert_string_talloc(state,
+					   CH_UNIX,
+					   CH_UTF16,
+					   filename,
+					   strlen(filename),
+					   &name_utf16,
+					   &name_utf16_len);
+		if (!ok) {
+			tevent_req_oom(req);
+			return tevent_req_post(req, ev);
+		}
+	}
+
+	fixed = state->create_fixed;
+
+	SSVAL(fixed, 0, 57);
+	SCVAL(fixed, 3, SMB2_OPLOCK_LEVEL_NONE);
+	SIVAL(fixed, 4, SMB2_IMPERSONATION_IMPERSONATION);
+	SIVAL(fixed, 24, desired_access);
+	SIVAL(fixed, 28, file_attributes);
+	SIVAL(fixed, 32, share_access);
+	SIVAL(fixed, 36, FILE_OPEN);
+	SIVAL(fixed, 40, create_options);
+
+	SSVAL(fixed, 44, SMB2_HDR_BODY + 56);
+	SSVAL(fixed, 46, name_utf16_len);
+
+	if (blobs != NULL) {
+		status = smb2_create_blob_push(state, &blob, *blobs);
+		if (tevent_req_nterror(req, status)) {
+			return tevent_req_post(req, ev);
+		}
+	}
+
+	blobs_offset = name_utf16_len;
+	blobs_offset = ((blobs_offset + 3) & ~3);
+
+	if (blob.length > 0) {
+		blobs_offset = ((blobs_offset + 7) & ~7);
+		SIVAL(fixed, 48, blobs_offset + SMB2_HDR_BODY + 56);
+		SIVAL(fixed, 52, blob.length);
+	}
+
+	dyn_len = MAX(1, blobs_offset + blob.length);
+	dyn = talloc_zero_array(state, uint8_t, dyn_len);
+	if (tevent_req_nomem(dyn, req)) {
+		return tevent_req_post(req, ev);
+	}
+	if (name_utf16 != NULL) {
+		memcpy(dyn, name_utf16, name_utf16_len);
+		TALLOC_FREE(name_utf16);
+	}
+	if (blob.data != NULL) {
+		memcpy(dyn + blobs_offset, blob.data, blob.length);
+		data_blob_free(&blob);
+	}
+
+	if (op_dyn != NULL && op_dyn->length > 0) {
+		op_dyn_buf = (const uint8_t *)talloc_memdup(
+			state, op_dyn->data, op_dyn->length);
+		if (tevent_req_nomem(op_dyn_buf, req)) {
+			return tevent_req_post(req, ev);
+		}
+		op_dyn_len = op_dyn->length;
+	} else {
+		op_dyn_buf = state->dyn_pad;
+		op_dyn_len = sizeof(state->dyn_pad);
+	}
+
+	/*
+	 * smb2cli_req_compound_submit() fails with
+	 * NT_STATUS_INTERNAL_ERROR if we run out of credits in the
+	 * middle of the chain, give the caller a status it can
+	 * recognize and fall back to separate requests.
+	 */
+	needed = smb2cli_compound_charge(conn, dyn_len, 0);
+	needed += smb2cli_compound_charge(conn, op_dyn_len, max_output_length);
+	needed += 1;
+	if (smb2cli_conn_get_cur_credits(conn) < needed) {
+		tevent_req_nterror(req, NT_STATUS_INSUFFICIENT_RESOURCES);
+		return tevent_req_post(req, ev);
+	}
+
+	if (smbXcli_conn_dfs_supported(conn) &&
+	    smbXcli_tcon_is_dfs_share(tcon))
+	{
+		create_flags |= SMB2_HDR_FLAG_DFS;
+	}
+
+	state->subreqs[0] = smb2cli_req_create(state, ev, conn,
+					       SMB2_OP_CREATE,
+					       create_flags, 0,
+					       timeout_msec,
+					       tcon,
+					       session,
+					       state->create_fixed,
+					       sizeof(state->create_fixed),
+					       dyn, dyn_len,
+					       0); /* max_dyn_len */
+	if (tevent_req_nomem(state->subreqs[0], req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(state->subreqs[0],
+				smb2cli_compound_create_done,
+				req);
+
+	state->subreqs[1] = smb2cli_req_create(state, ev, conn,
+					       opcode,
+					       SMB2_HDR_FLAG_CHAINED, 0,
+					       timeout_msec,
+					       tcon,
+					       session,
+					       state->op_fixed,
+					       op_fixed_len,
+					       op_dyn_buf, op_dyn_len,
+					       max_output_length);
+	if (tevent_req_nomem(state->subreqs[1], req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(state->subreqs[1],
+				smb2cli_compound_op_done,
+				req);
+
+	fixed = state->close_fixed;
+	SSVAL(fixed, 0, 24);
+	SSVAL(fixed, 2, 0); /* flags */
+	SBVAL(fixed, 8, SMB2CLI_COMPOUND_FID);
+	SBVAL(fixed, 16, SMB2CLI_COMPOUND_FID);
+
+	state->subreqs[2] = smb2cli_req_create(state, ev, conn,
+					       SMB2_OP_CLOSE,
+					       SMB2_HDR_FLAG_CHAINED, 0,
+					       timeout_msec,
+					       tcon,
+					       session,
+					       state->close_fixed,
+					       sizeof(state->close_fixed),
+					       NULL, 0, /* dyn* */
+					       0); /* max_dyn_len */
+	if (tevent_req_nomem(state->subreqs[2], req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(state->subreqs[2],
+				smb2cli_compound_close_done,
+				req);
+
+	status = smb2cli_req_compound_submit(state->subreqs,
+					     ARRAY_SIZE(state->subreqs));
+	if (tevent_req_nterror(req, status)) {
+		return tevent_req_post(req, ev);
+	}
+	state->num_pending = ARRAY_SIZE(state->subreqs);
+
+	return req;
+}
+
+static void smb2cli_compound_finish(struct tevent_req *req)
+{
+	struct smb2cli_compound_state *state = tevent_req_data(
+		req, struct smb2cli_compound_state);
+
+	SMB_ASSERT(state->num_pending > 0);
+	state->num_pending -= 1;
+	if (state->num_pending > 0) {
+		return;
+	}
+
+	if (tevent_req_nterror(req, state->create_status)) {
+		return;
+	}
+	if (!NT_STATUS_EQUAL(state->op_status, STATUS_BUFFER_OVERFLOW) &&
+	    tevent_req_nterror(req, state->op_status)) {
+		return;
+	}
+	if (tevent_req_nterror(req, state->close_status)) {
+		return;
+	}
+	tevent_req_done(req);
+}
+
+static void smb2cli_compound_create_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smb2cli_compound_state *state = tevent_req_data(
+		req, struct smb2cli_compound_state);
+	struct iovec *iov = NULL;
+	uint8_t *body = NULL;
+	static const struct smb2cli_req_expected_response expected[] = {
+	{
+		.status = NT_STATUS_OK,
+		.body_size = 0x59
+	}
+	};
+
+	state->create_status = smb2cli_req_recv(subreq, state, &iov,
+						expected,
+						ARRAY_SIZE(expected));
+	state->subreqs[0] = NULL;
+	TALLOC_FREE(subreq);
+	if (NT_STATUS_IS_OK(state->create_status)) {
+		body = (uint8_t *)iov[1].iov_base;
+
+		state->cr.oplock_level  = CVAL(body, 2);
+		state->cr.flags         = CVAL(body, 3);
+		state->cr.create_action = IVAL(body, 4);
+		state->cr.creation_time = BVAL(body, 8);
+		state->cr.last_access_time = BVAL(body, 16);
+		state->cr.last_write_time = BVAL(body, 24);
+		state->cr.change_time   = BVAL(body, 32);
+		state->cr.allocation_size = BVAL(body, 40);
+		state->cr.end_of_file   = BVAL(body, 48);
+		state->cr.file_attributes = IVAL(body, 56);
+	}
+	TALLOC_FREE(iov);
+
+	smb2cli_compound_finish(req);
+}
+
+static NTSTATUS smb2cli_compound_parse_output(
+	struct smb2cli_compound_state *state,
+	struct iovec *iov)
+{
+	uint8_t *fixed = (uint8_t *)iov[1].iov_base;
+	DATA_BLOB dyn_buffer = data_blob_const((uint8_t *)iov[2].iov_base,
+					       iov[2].iov_len);
+	uint32_t next_offset = 0;
+	uint32_t dyn_ofs;
+	uint32_t offset;
+	uint32_t length;
+
+	switch (state->opcode) {
+	case SMB2_OP_READ:
+		dyn_ofs = SMB2_HDR_BODY + 0x10;
+		offset = CVAL(fixed, 2);
+		length = IVAL(fixed, 4);
+		break;
+	case SMB2_OP_GETINFO:
+		dyn_ofs = SMB2_HDR_BODY + 0x08;
+		offset = SVAL(fixed, 2);
+		length = IVAL(fixed, 4);
+		break;
+	default:
+		return NT_STATUS_OK;
+	}
+
+	return smb2cli_parse_dyn_buffer(dyn_ofs,
+					dyn_buffer,
+					dyn_ofs, /* min_offset */
+					offset,
+					length,
+					state->max_output_length,
+					&next_offset,
+					&state->out_output_buffer);
+}
+
+static void smb2cli_compound_op_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smb2cli_compound_state *state = tevent_req_data(
+		req, struct smb2cli_compound_state);
+	struct iovec *iov = NULL;
+	static const struct smb2cli_req_expected_response expected_read[] = {
+	{
+		.status = STATUS_BUFFER_OVERFLOW,
+		.body_size = 0x11
+	},
+	{
+		.status = NT_STATUS_OK,
+		.body_size = 0x11
+	}
+	};
+	static const struct smb2cli_req_expected_response expected_getinfo[] = {
+	{
+		.status = NT_STATUS_OK,
+		.body_size = 0x09
+	},
+	{
+		.status = STATUS_BUFFER_OVERFLOW,
+		.body_size = 0x09
+	}
+	};
+	static const struct smb2cli_req_expected_response expected_setinfo[] = {
+	{
+		.status = NT_STATUS_OK,
+		.body_size = 0x02
+	}
+	};
+	const struct smb2cli_req_expected_response *expected = NULL;
+	size_t num_expected = 0;
+	NTSTATUS status;
+
+	switch (state->opcode) {
+	case SMB2_OP_READ:
+		expected = expected_read;
+		num_expected = ARRAY_SIZE(expected_read);
+		break;
+	case SMB2_OP_GETINFO:
+		expected = expected_getinfo;
+		num_expected = ARRAY_SIZE(expected_getinfo);
+		break;
+	case SMB2_OP_SETINFO:
+		expected = expected_setinfo;
+		num_expected = ARRAY_SIZE(expected_setinfo);
+		break;
+	}
+
+	status = smb2cli_req_recv(subreq, state, &iov,
+				  expected, num_expected);
+	state->subreqs[1] = NULL;
+	TALLOC_FREE(subreq);
+
+	if (NT_STATUS_IS_OK(status) ||
+	    NT_STATUS_EQUAL(status, STATUS_BUFFER_OVERFLOW))
+	{
+		NTSTATUS error = smb2cli_compound_parse_output(state, iov);
+		if (!NT_STATUS_IS_OK(error)) {
+			status = error;
+		}
+		state->recv_iov = iov;
+	}
+	state->op_status = status;
+
+	smb2cli_compound_finish(req);
+}
+
+static void smb2cli_compound_close_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smb2cli_compound_state *state = tevent_req_data(
+		req, struct smb2cli_compound_state);
+	static const struct smb2cli_req_expected_response expected[] = {
+	{
+		.status = NT_STATUS_OK,
+		.body_size = 0x3C
+	}
+	};
+
+	state->close_status = smb2cli_req_recv(subreq, NULL, NULL,
+					       expected,
+					       ARRAY_SIZE(expected));
+	state->subreqs[2] = NULL;
+	TALLOC_FREE(subreq);
+
+	smb2cli_compound_finish(req);
+}
+
+static NTSTATUS smb2cli_compound_recv(struct tevent_req *req,
+				      TALLOC_CTX *mem_ctx,
+				      struct smb_create_returns *cr,
+				      DATA_BLOB *out_output_buffer)
+{
+	struct smb2cli_compound_state *state = tevent_req_data(
+		req, struct smb2cli_compound_state);
+	NTSTATUS status;
+
+	if (out_output_buffer != NULL) {
+		*out_output_buffer = data_blob_null;
+	}
+
+	if (tevent_req_is_nterror(req, &status)) {
+		tevent_req_received(req);
+		return status;
+	}
+
+	if (cr != NULL) {
+		*cr = state->cr;
+	}
+	if (out_output_buffer != NULL) {
+		talloc_steal(mem_ctx, state->recv_iov);
+		*out_output_buffer = state->out_output_buffer;
+	}
+
+	status = state->op_status;
+	tevent_req_received(req);
+	return status;
+}
+
+struct tevent_req *smb2cli_create_read_close_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct smbXcli_conn *conn,
+	uint32_t timeout_msec,
+	struct smbXcli_session *session,
+	struct smbXcli_tcon *tcon,
+	const char *filename,
+	uint32_t share_access,
+	uint32_t create_options,
+	struct smb2_create_blobs *blobs,
+	uint32_t length)
+{
+	uint8_t fixed[48] = { 0, };
+
+	SSVAL(fixed, 0, 49);
+	SIVAL(fixed, 4, length);
+	SBVAL(fixed, 8, 0); /* offset */
+	SBVAL(fixed, 16, SMB2CLI_COMPOUND_FID);
+	SBVAL(fixed, 24, SMB2CLI_COMPOUND_FID);
+
+	return smb2cli_compound_send(mem_ctx, ev, conn, timeout_msec,
+				     session, tcon,
+				     filename,
+				     SEC_FILE_READ_DATA|
+				     SEC_FILE_READ_ATTRIBUTE,
+				     0, /* file_attributes */
+				     share_access,
+				     create_options|FILE_NON_DIRECTORY_FILE,
+				     blobs,
+				     SMB2_OP_READ,
+				     fixed, sizeof(fixed),
+				     NULL,
+				     length);
+}
+
+/*
+ * *data is NULL-terminated, so it can be used as a string.
+ * STATUS_BUFFER_OVERFLOW is not possible for reads, a file
+ * larger than the requested length is detected by the caller
+ * via cr->end_of_file.
+ */
+NTSTATUS smb2cli_create_read_close_recv(struct tevent_req *req,
+					TALLOC_CTX *mem_ctx,
+					struct smb_create_returns *cr,
+					uint8_t **data,
+					uint32_t *data_length)
+{
+	DATA_BLOB out = data_blob_null;
+	NTSTATUS status;
+
+	status = smb2cli_compound_recv(req, talloc_tos(), cr, &out);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+	*data = talloc_array(mem_ctx, uint8_t, out.length + 1);
+	if (*data == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	if (out.length > 0) {
+		memcpy(*data, out.data, out.length);
+	}
+	(*data)[out.length] = '\0';
+	*data_length = out.length;
+	data_blob_free(&out);
+	return NT_STATUS_OK;
+}
+
+struct tevent_req *smb2cli_create_query_info_close_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct smbXcli_conn *conn,
+	uint32_t timeout_msec,
+	struct smbXcli_session *session,
+	struct smbXcli_tcon *tcon,
+	const char *filename,
+	uint32_t desired_access,
+	uint32_t share_access,
+	uint32_t create_options,
+	struct smb2_create_blobs *blobs,
+	uint8_t in_info_type,
+	uint8_t in_file_info_class,
+	uint32_t in_max_output_length,
+	uint32_t in_additional_info,
+	uint32_t in_flags)
+{
+	uint8_t fixed[0x28] = { 0, };
+
+	SSVAL(fixed, 0x00, 0x29);
+	SCVAL(fixed, 0x02, in_info_type);
+	SCVAL(fixed, 0x03, in_file_info_class);
+	SIVAL(fixed, 0x04, in_max_output_length);
+	SSVAL(fixed, 0x08, 0); /* input_buffer_offset */
+	SIVAL(fixed, 0x0C, 0); /* input_buffer_length */
+	SIVAL(fixed, 0x10, in_additional_info);
+	SIVAL(fixed, 0x14, in_flags);
+	SBVAL(fixed, 0x18, SMB2CLI_COMPOUND_FID);
+	SBVAL(fixed, 0x20, SMB2CLI_COMPOUND_FID);
+
+	return smb2cli_compound_send(mem_ctx, ev, conn, timeout_msec,
+				     session, tcon,
+				     filename,
+				     desired_access,
+				     0, /* file_attributes */
+				     share_access,
+				     create_options,
+				     blobs,
+				     SMB2_OP_GETINFO,
+				     fixed, sizeof(fixed),
+				     NULL,
+				     in_max_output_length);
+}
+
+NTSTATUS smb2cli_create_query_info_close_recv(
+	struct tevent_req *req,
+	TALLOC_CTX *mem_ctx,
+	struct smb_create_returns *cr,
+	DATA_BLOB *out_output_buffer)
+{
+	return smb2cli_compound_recv(req, mem_ctx, cr, out_output_buffer);
+}
+
+struct tevent_req *smb2cli_create_set_info_close_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct smbXcli_conn *conn,
+	uint32_t timeout_msec,
+	struct smbXcli_session *session,
+	struct smbXcli_tcon *tcon,
+	const char *filename,
+	uint32_t desired_access,
+	uint32_t share_access,
+	uint32_t create_options,
+	struct smb2_create_blobs *blobs,
+	uint8_t in_info_type,
+	uint8_t in_file_info_class,
+	const DATA_BLOB *in_input_buffer,
+	uint32_t in_additional_info)
+{
+	uint8_t fixed[0x20] = { 0, };
+
+	SSVAL(fixed, 0x00, 0x21);
+	SCVAL(fixed, 0x02, in_info_type);
+	SCVAL(fixed, 0x03, in_file_info_class);
+	SIVAL(fixed, 0x04, in_input_buffer->length);
+	SSVAL(fixed, 0x08, SMB2_HDR_BODY + 0x20);
+	SSVAL(fixed, 0x0A, 0); /* reserved */
+	SIVAL(fixed, 0x0C, in_additional_info);
+	SBVAL(fixed, 0x10, SMB2CLI_COMPOUND_FID);
+	SBVAL(fixed, 0x18, SMB2CLI_COMPOUND_FID);
+
+	return smb2cli_compound_send(mem_ctx, ev, conn, timeout_msec,
+				     session, tcon,
+				     filename,
+				     desired_access,
+				     0, /* file_attributes */
+				     share_access,
+				     create_options,
+				     blobs,
+				     SMB2_OP_SETINFO,
+				     fixed, sizeof(fixed),
+				     in_input_buffer,
+				     0); /* max_output_length */
+}
+
+NTSTATUS smb2cli_create_set_info_close_recv(struct tevent_req *req)
+{
+	return smb2cli_compound_recv(req, NULL, NULL, NULL);
+}
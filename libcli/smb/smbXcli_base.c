@@ -35,6 +35,7 @@
 #include "smbXcli_base.h"
 #include "librpc/ndr/libndr.h"
 #include "libcli/smb/smb2_negotiate_context.h"
+#include "libcli/smb/smb2_compression.h"
 #include "libcli/smb/smb2_signing.h"
 
 #include "lib/crypto/gnutls_helpers.h"
@@ -162,6 +163,7 @@ struct smbXcli_conn {
 			DATA_BLOB gss_blob;
 			uint16_t sign_algo;
 			uint16_t cipher;
+			struct smb3_compression_capabilities compression;
 			bool smb311_posix;
 		} server;
 
@@ -169,11 +171,32 @@ struct smbXcli_conn {
 		uint16_t cur_credits;
 		uint16_t max_credits;
 
+		/*
+		 * Smoothed round trip time of the requests,
+		 * used to spread requests over the channels
+		 * of a session.
+		 */
+		uint64_t srtt_usec;
+
 		uint32_t cc_chunk_len;
 		uint32_t cc_max_chunks;
 
 		uint8_t io_priority;
 
+		struct {
+			uint64_t compressed_requests;
+			uint64_t decompressed_responses;
+
+			/*
+			 * Only for torture tests, see
+			 * smb2cli_conn_torture_compression_hook()
+			 */
+			void (*torture_hook)(uint8_t *buf,
+					     size_t buflen,
+					     void *private_data);
+			void *torture_private;
+		} compression;
+
 		bool force_channel_sequence;
 
 		uint8_t preauth_sha512[64];
@@ -199,6 +222,12 @@ struct smb2cli_session {
 	bool replay_active;
 	bool require_signed_response;
 
+	/*
+	 * All channels of this session,
+	 * see smb2cli_session_select_channel()
+	 */
+	struct smbXcli_session **channels;
+
 	/*
 	 * The following are just for torture tests
 	 */
@@ -329,6 +358,9 @@ struct smbXcli_req_state {
 
 		uint16_t credit_charge;
 
+		/* when the request was sent, for the round trip time */
+		struct timeval sent_time;
+
 		bool should_sign;
 		bool should_encrypt;
 		uint64_t encryption_session_id;
@@ -3318,6 +3350,32 @@ uint16_t smb2cli_conn_server_encryption_algo(struct smbXcli_conn *conn)
 	return conn->smb2.server.cipher;
 }
 
+const struct smb3_compression_capabilities *smb2cli_conn_server_compression(
+	struct smbXcli_conn *conn)
+{
+	return &conn->smb2.server.compression;
+}
+
+uint64_t smb2cli_conn_compressed_requests(struct smbXcli_conn *conn)
+{
+	return conn->smb2.compression.compressed_requests;
+}
+
+uint64_t smb2cli_conn_decompressed_responses(struct smbXcli_conn *conn)
+{
+	return conn->smb2.compression.decompressed_responses;
+}
+
+void smb2cli_conn_torture_compression_hook(struct smbXcli_conn *conn,
+			void (*fn)(uint8_t *buf,
+				   size_t buflen,
+				   void *private_data),
+			void *private_data)
+{
+	conn->smb2.compression.torture_hook = fn;
+	conn->smb2.compression.torture_private = private_data;
+}
+
 uint32_t smb2cli_conn_max_trans_size(struct smbXcli_conn *conn)
 {
 	return conn->smb2.server.max_trans_size;
@@ -3344,6 +3402,30 @@ uint16_t smb2cli_conn_get_cur_credits(struct smbXcli_conn *conn)
 	return conn->smb2.cur_credits;
 }
 
+static void smb2cli_conn_update_srtt(struct smbXcli_conn *conn,
+				     const struct timeval *sent_time)
+{
+	struct timeval now = timeval_current();
+	int64_t diff = usec_time_diff(&now, sent_time);
+	uint64_t rtt = MAX(diff, 0);
+
+	if (conn->smb2.srtt_usec == 0) {
+		conn->smb2.srtt_usec = MAX(rtt, 1);
+		return;
+	}
+
+	/*
+	 * The same smoothing as TCP does, see RFC 6298
+	 */
+	conn->smb2.srtt_usec = (7 * conn->smb2.srtt_usec + rtt) / 8;
+	conn->smb2.srtt_usec = MAX(conn->smb2.srtt_usec, 1);
+}
+
+uint64_t smb2cli_conn_srtt_usec(struct smbXcli_conn *conn)
+{
+	return conn->smb2.srtt_usec;
+}
+
 uint8_t smb2cli_conn_get_io_priority(struct smbXcli_conn *conn)
 {
 	if (conn->protocol < PROTOCOL_SMB3_11) {
@@ -3638,6 +3720,89 @@ static NTSTATUS smb2cli_conn_dispatch_incoming(struct smbXcli_conn *conn,
 					       TALLOC_CTX *tmp_mem,
 					       uint8_t *inbuf);
 
+static NTSTATUS smb2cli_req_compress(struct smbXcli_req_state *state,
+				     struct iovec *iov,
+				     int *pnum_iov,
+				     int *pnbt_len)
+{
+	struct smbXcli_conn *conn = state->conn;
+	uint16_t opcode = SVAL(state->smb2.hdr, SMB2_HDR_OPCODE);
+	size_t buflen = *pnbt_len;
+	uint8_t *buf = NULL;
+	uint8_t *p = NULL;
+	uint8_t *out = NULL;
+	size_t out_len = 0;
+	NTSTATUS status;
+	int vi;
+
+	if (conn->smb2.server.compression.num_algos == 0) {
+		return NT_STATUS_OK;
+	}
+
+	/*
+	 * We only compress WRITE requests on shares
+	 * which ask for it.
+	 */
+	if (opcode != SMB2_OP_WRITE) {
+		return NT_STATUS_OK;
+	}
+	if (state->tcon == NULL ||
+	    !(state->tcon->smb2.flags & SMB2_SHAREFLAG_COMPRESS_DATA))
+	{
+		return NT_STATUS_OK;
+	}
+	if (state->smb2.dyn_len == 0) {
+		return NT_STATUS_OK;
+	}
+
+	buf = talloc_array(iov, uint8_t, buflen);
+	if (buf == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	p = buf;
+	for (vi = 1; vi < *pnum_iov; vi++) {
+		memcpy(p, iov[vi].iov_base, iov[vi].iov_len);
+		p += iov[vi].iov_len;
+	}
+
+	/*
+	 * The SMB2 header and the WRITE request body
+	 * are sent uncompressed.
+	 */
+	status = smb2_compression_compress(iov,
+					   &conn->smb2.server.compression,
+					   buf,
+					   buflen,
+					   SMB2_HDR_BODY + state->smb2.fixed_len,
+					   &out,
+					   &out_len);
+	TALLOC_FREE(buf);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+	if (out == NULL) {
+		/*
+		 * Not worth it, send it raw.
+		 */
+		return NT_STATUS_OK;
+	}
+
+	if (conn->smb2.compression.torture_hook != NULL) {
+		conn->smb2.compression.torture_hook(
+			out, out_len, conn->smb2.compression.torture_private);
+	}
+
+	iov[1].iov_base = out;
+	iov[1].iov_len = out_len;
+	*pnum_iov = 2;
+	*pnbt_len = out_len;
+
+	conn->smb2.compression.compressed_requests += 1;
+
+	return NT_STATUS_OK;
+}
+
 NTSTATUS smb2cli_req_compound_submit(struct tevent_req **reqs,
 				     int num_reqs)
 {
@@ -3812,6 +3977,7 @@ NTSTATUS smb2cli_req_compound_submit(struct tevent_req **reqs,
 		mid = state->conn->smb2.mid;
 		state->conn->smb2.mid += charge;
 		state->conn->smb2.cur_credits -= charge;
+		state->smb2.sent_time = timeval_current();
 
 		if (state->conn->smb2.server.capabilities & SMB2_CAP_LARGE_MTU) {
 			SSVAL(state->smb2.hdr, SMB2_HDR_CREDIT_CHARGE, charge);
@@ -3908,6 +4074,21 @@ skip_credits:
 	}
 
 	state = tevent_req_data(reqs[0], struct smbXcli_req_state);
+
+	if (num_reqs == 1 && encryption_key == NULL) {
+		/*
+		 * The message is compressed after signing,
+		 * the server verifies the signature over
+		 * the decompressed message.
+		 */
+		NTSTATUS status;
+
+		status = smb2cli_req_compress(state, iov, &num_iov, &nbt_len);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+	}
+
 	_smb_setlen_tcp(state->length_hdr, nbt_len);
 	iov[0].iov_base = state->length_hdr;
 	iov[0].iov_len  = sizeof(state->length_hdr);
@@ -4217,6 +4398,60 @@ inval:
 	return NT_STATUS_INVALID_NETWORK_RESPONSE;
 }
 
+static NTSTATUS smb2cli_inbuf_decompress(struct smbXcli_conn *conn,
+					 TALLOC_CTX *mem_ctx,
+					 const uint8_t *buf,
+					 size_t buflen,
+					 uint8_t **_out,
+					 size_t *_out_len)
+{
+	uint8_t *out = NULL;
+	size_t out_len = 0;
+	size_t max_size;
+	NTSTATUS status;
+
+	/*
+	 * A READ response can have the maximum read size
+	 * and the SMB2 header and READ response body on top.
+	 */
+	max_size = MAX(conn->smb2.server.max_trans_size,
+		       conn->smb2.server.max_read_size);
+	max_size += SMB2_HDR_BODY + 0x10000;
+
+	status = smb2_compression_decompress(mem_ctx,
+					     &conn->smb2.server.compression,
+					     buf,
+					     buflen,
+					     max_size,
+					     &out,
+					     &out_len);
+	if (NT_STATUS_EQUAL(status, NT_STATUS_NO_MEMORY)) {
+		return status;
+	}
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_INFO("Invalid SMB2_COMPRESSION_TRANSFORM: %s\n",
+			 nt_errstr(status));
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+
+	if (IVAL(out, 0) != SMB2_MAGIC) {
+		/*
+		 * We don't support encrypted messages
+		 * inside of the compression transform.
+		 */
+		DBG_INFO("Got non-SMB2 PDU in SMB2_COMPRESSION_TRANSFORM: "
+			 "%x\n", IVAL(out, 0));
+		TALLOC_FREE(out);
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+
+	conn->smb2.compression.decompressed_responses += 1;
+
+	*_out = out;
+	*_out_len = out_len;
+	return NT_STATUS_OK;
+}
+
 static struct tevent_req *smb2cli_conn_find_pending(struct smbXcli_conn *conn,
 						    uint64_t mid)
 {
@@ -4247,11 +4482,30 @@ static NTSTATUS smb2cli_conn_dispatch_incoming(struct smbXcli_conn *conn,
 	NTSTATUS status;
 	bool defer = true;
 	struct smbXcli_session *last_session = NULL;
-	size_t inbuf_len = smb_len_tcp(inbuf);
+	uint8_t *pdu = inbuf + NBT_HDR_SIZE;
+	size_t pdu_len = smb_len_tcp(inbuf);
+
+	if (pdu_len >= 4 && IVAL(pdu, 0) == SMB2_COMP_TF_MAGIC) {
+		status = smb2cli_inbuf_decompress(conn,
+						  tmp_mem,
+						  pdu,
+						  pdu_len,
+						  &pdu,
+						  &pdu_len);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+
+		/*
+		 * The responses point into the decompressed
+		 * buffer, so that's what they need to reference.
+		 */
+		inbuf = pdu;
+	}
 
 	status = smb2cli_inbuf_parse_compound(conn,
-					      inbuf + NBT_HDR_SIZE,
-					      inbuf_len,
+					      pdu,
+					      pdu_len,
 					      tmp_mem,
 					      &iov, &num_iov);
 	if (!NT_STATUS_IS_OK(status)) {
@@ -4292,6 +4546,15 @@ static NTSTATUS smb2cli_conn_dispatch_incoming(struct smbXcli_conn *conn,
 		}
 		req_flags = SVAL(state->smb2.hdr, SMB2_HDR_FLAGS);
 
+		if (!timeval_is_zero(&state->smb2.sent_time)) {
+			/*
+			 * The first response, an interim response
+			 * counts as well.
+			 */
+			smb2cli_conn_update_srtt(conn, &state->smb2.sent_time);
+			state->smb2.sent_time = timeval_zero();
+		}
+
 		if (!(flags & SMB2_HDR_FLAG_REDIRECT)) {
 			return NT_STATUS_INVALID_NETWORK_RESPONSE;
 		}
@@ -5385,6 +5648,8 @@ static struct tevent_req *smbXcli_negprot_smb2_subreq(struct smbXcli_negprot_sta
 			&state->conn->smb2.client.smb3_capabilities.signing;
 		const struct smb3_encryption_capabilities *client_ciphers =
 			&state->conn->smb2.client.smb3_capabilities.encryption;
+		const struct smb3_compression_capabilities *client_compression =
+			&state->conn->smb2.client.smb3_capabilities.compression;
 		NTSTATUS status;
 		struct smb2_negotiate_contexts c = { .num_contexts = 0, };
 		uint8_t *netname_utf16 = NULL;
@@ -5445,6 +5710,31 @@ static struct tevent_req *smbXcli_negprot_smb2_subreq(struct smbXcli_negprot_sta
 			}
 		}
 
+		if (client_compression->num_algos > 0) {
+			size_t ofs = 0;
+			SSVAL(p, ofs, client_compression->num_algos);
+			ofs += 2;
+			SSVAL(p, ofs, 0); /* Padding */
+			ofs += 2;
+			SIVAL(p, ofs, client_compression->chained ?
+				      SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED :
+				      SMB2_COMPRESSION_CAPABILITIES_FLAG_NONE);
+			ofs += 4;
+
+			for (i = 0; i < client_compression->num_algos; i++) {
+				size_t next_ofs = ofs + 2;
+				SMB_ASSERT(next_ofs < ARRAY_SIZE(p));
+				SSVAL(p, ofs, client_compression->algos[i]);
+				ofs = next_ofs;
+			}
+
+			status = smb2_negotiate_context_add(
+				state, &c, SMB2_COMPRESSION_CAPABILITIES, p, ofs);
+			if (!NT_STATUS_IS_OK(status)) {
+				return NULL;
+			}
+		}
+
 		ok = convert_string_talloc(state, CH_UNIX, CH_UTF16,
 					   state->conn->remote_name,
 					   strlen(state->conn->remote_name),
@@ -5546,6 +5836,7 @@ static void smbXcli_negprot_smb2_done(struct tevent_req *subreq)
 	gnutls_hash_hd_t hash_hnd = NULL;
 	struct smb2_negotiate_context *sign_algo = NULL;
 	struct smb2_negotiate_context *cipher = NULL;
+	struct smb2_negotiate_context *compression = NULL;
 	struct smb2_negotiate_context *posix = NULL;
 	struct iovec sent_iov[3] = {{0}, {0}, {0}};
 	static const struct smb2cli_req_expected_response expected[] = {
@@ -5914,6 +6205,101 @@ static void smbXcli_negprot_smb2_done(struct tevent_req *subreq)
 		conn->smb2.server.cipher = cipher_selected;
 	}
 
+	compression = smb2_negotiate_context_find(
+		state->out_ctx, SMB2_COMPRESSION_CAPABILITIES);
+	if (compression != NULL) {
+		const struct smb3_compression_capabilities *client_compression =
+			&state->conn->smb2.client.smb3_capabilities.compression;
+		struct smb3_compression_capabilities *server_compression =
+			&conn->smb2.server.compression;
+		uint16_t algo_count;
+		uint32_t compression_flags;
+
+		*server_compression = (struct smb3_compression_capabilities) {
+			.num_algos = 0,
+		};
+
+		if (client_compression->num_algos == 0) {
+			/*
+			 * We didn't ask for SMB2_COMPRESSION_CAPABILITIES
+			 */
+			tevent_req_nterror(req,
+					NT_STATUS_INVALID_NETWORK_RESPONSE);
+			return;
+		}
+
+		if (compression->data.length < 8) {
+			tevent_req_nterror(req,
+					NT_STATUS_INVALID_NETWORK_RESPONSE);
+			return;
+		}
+
+		algo_count = SVAL(compression->data.data, 0);
+		compression_flags = IVAL(compression->data.data, 4);
+		if (algo_count == 0 ||
+		    algo_count > SMB3_COMPRESSION_CAPABILITIES_MAX_ALGOS)
+		{
+			tevent_req_nterror(req,
+					NT_STATUS_INVALID_NETWORK_RESPONSE);
+			return;
+		}
+
+		if (compression->data.length < (8 + 2 * algo_count)) {
+			tevent_req_nterror(req,
+					NT_STATUS_INVALID_NETWORK_RESPONSE);
+			return;
+		}
+
+		if ((compression_flags &
+		     SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED) &&
+		    !client_compression->chained)
+		{
+			/*
+			 * We didn't offer chained compression.
+			 */
+			tevent_req_nterror(req,
+					NT_STATUS_INVALID_NETWORK_RESPONSE);
+			return;
+		}
+
+		for (i = 0; i < algo_count; i++) {
+			uint16_t algo = SVAL(compression->data.data, 8 + i * 2);
+
+			if (algo == SMB2_COMPRESSION_NONE && algo_count == 1) {
+				/*
+				 * compression not supported
+				 */
+				break;
+			}
+
+			if (!smb2_compression_algo_negotiated(
+					client_compression, algo))
+			{
+				/*
+				 * The server send an algorithm
+				 * we didn't offer.
+				 */
+				*server_compression =
+					(struct smb3_compression_capabilities) {
+						.num_algos = 0,
+					};
+				tevent_req_nterror(req,
+					NT_STATUS_INVALID_NETWORK_RESPONSE);
+				return;
+			}
+
+			server_compression->algos[server_compression->num_algos] =
+				algo;
+			server_compression->num_algos += 1;
+		}
+
+		if (server_compression->num_algos > 0) {
+			server_compression->chained =
+				(compression_flags &
+				 SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED);
+		}
+	}
+
 	posix = smb2_negotiate_context_find(
 		state->out_ctx, SMB2_POSIX_EXTENSIONS_AVAILABLE);
 	if (posix != NULL) {
@@ -6394,8 +6780,57 @@ NTSTATUS smb2cli_validate_negotiate_info_recv(struct tevent_req *req)
 	return tevent_req_simple_recv_ntstatus(req);
 }
 
+static bool smb2cli_session_add_channel(struct smbXcli_session *session)
+{
+	struct smb2cli_session *smb2 = session->smb2;
+	size_t num_channels = talloc_array_length(smb2->channels);
+	struct smbXcli_session **channels = NULL;
+
+	channels = talloc_realloc(smb2,
+				  smb2->channels,
+				  struct smbXcli_session *,
+				  num_channels + 1);
+	if (channels == NULL) {
+		return false;
+	}
+	channels[num_channels] = session;
+	smb2->channels = channels;
+	return true;
+}
+
+static void smb2cli_session_remove_channel(struct smbXcli_session *session)
+{
+	struct smb2cli_session *smb2 = session->smb2;
+	size_t num_channels = talloc_array_length(smb2->channels);
+	size_t i;
+
+	for (i = 0; i < num_channels; i++) {
+		if (smb2->channels[i] == session) {
+			break;
+		}
+	}
+	if (i == num_channels) {
+		return;
+	}
+
+	if (num_channels == 1) {
+		TALLOC_FREE(smb2->channels);
+		return;
+	}
+
+	ARRAY_DEL_ELEMENT(smb2->channels, i, num_channels);
+	smb2->channels = talloc_realloc(smb2,
+					smb2->channels,
+					struct smbXcli_session *,
+					num_channels - 1);
+}
+
 static int smbXcli_session_destructor(struct smbXcli_session *session)
 {
+	if (session->smb2 != NULL) {
+		smb2cli_session_remove_channel(session);
+	}
+
 	if (session->conn == NULL) {
 		return 0;
 	}
@@ -6448,6 +6883,11 @@ struct smbXcli_session *smbXcli_session_create(TALLOC_CTX *mem_ctx,
 	       conn->smb2.preauth_sha512,
 	       sizeof(session->smb2_channel.preauth_sha512));
 
+	if (!smb2cli_session_add_channel(session)) {
+		talloc_free(session);
+		return NULL;
+	}
+
 	return session;
 }
 
@@ -6475,6 +6915,7 @@ struct smbXcli_session *smbXcli_session_shallow_copy(TALLOC_CTX *mem_ctx,
 	 */
 	session->conn = src->conn;
 	*session->smb2 = *src->smb2;
+	session->smb2->channels = NULL;
 	session->smb2_channel = src->smb2_channel;
 	session->disconnect_expired = src->disconnect_expired;
 
@@ -6498,6 +6939,11 @@ struct smbXcli_session *smbXcli_session_shallow_copy(TALLOC_CTX *mem_ctx,
 	DLIST_ADD_END(src->conn->sessions, session);
 	talloc_set_destructor(session, smbXcli_session_destructor);
 
+	if (!smb2cli_session_add_channel(session)) {
+		talloc_free(session);
+		return NULL;
+	}
+
 	return session;
 }
 
@@ -7163,10 +7609,96 @@ NTSTATUS smb2cli_session_create_channel(TALLOC_CTX *mem_ctx,
 	       conn->smb2.preauth_sha512,
 	       sizeof(session2->smb2_channel.preauth_sha512));
 
+	if (!smb2cli_session_add_channel(session2)) {
+		talloc_free(session2);
+		return NT_STATUS_NO_MEMORY;
+	}
+
 	*_session2 = session2;
 	return NT_STATUS_OK;
 }
 
+struct smbXcli_conn *smbXcli_session_conn(struct smbXcli_session *session)
+{
+	return session->conn;
+}
+
+/*
+ * Pick the channel of the session a request with dyn_len bytes
+ * of payload should be sent on. The caller needs to send
+ * the request on the returned session and its connection.
+ *
+ * Only connected channels that completed the session binding
+ * are used. Channels with enough credits for the request are
+ * preferred, between them the one with the lowest expected
+ * wait wins: the smoothed round trip time multiplied by the
+ * number of requests already in flight. Without any other
+ * usable channel the given session is returned.
+ */
+struct smbXcli_session *smb2cli_session_select_channel(
+	struct smbXcli_session *session,
+	uint32_t dyn_len)
+{
+	struct smb2cli_session *smb2 = session->smb2;
+	size_t num_channels = talloc_array_length(smb2->channels);
+	struct smbXcli_session *best = session;
+	uint64_t best_cost = UINT64_MAX;
+	bool best_has_credits = false;
+	size_t i;
+
+	if (num_channels <= 1) {
+		return session;
+	}
+
+	for (i = 0; i < num_channels; i++) {
+		struct smbXcli_session *c = smb2->channels[i];
+		struct smbXcli_conn *conn = c->conn;
+		uint16_t charge = 1;
+		uint64_t cost;
+		bool has_credits;
+
+		if (conn == NULL) {
+			continue;
+		}
+		if (!smbXcli_conn_is_connected(conn)) {
+			continue;
+		}
+		if (c != session) {
+			if (conn->protocol < PROTOCOL_SMB3_00) {
+				continue;
+			}
+			if (!smb2_signing_key_valid(c->smb2_channel.signing_key)) {
+				/*
+				 * The session binding is not finished
+				 */
+				continue;
+			}
+		}
+
+		if (conn->smb2.server.capabilities & SMB2_CAP_LARGE_MTU) {
+			charge = (MAX(dyn_len, 1) - 1) / 65536 + 1;
+		}
+		has_credits = (conn->smb2.cur_credits >= charge);
+
+		cost = MAX(conn->smb2.srtt_usec, 1);
+		cost *= talloc_array_length(conn->pending) + 1;
+
+		if (has_credits != best_has_credits) {
+			if (!has_credits) {
+				continue;
+			}
+		} else if (cost >= best_cost) {
+			continue;
+		}
+
+		best = c;
+		best_cost = cost;
+		best_has_credits = has_credits;
+	}
+
+	return best;
+}
+
 NTSTATUS smb2cli_session_set_channel_key(struct smbXcli_session *session,
 					 const DATA_BLOB _channel_key,
 					 const struct iovec *recv_iov)
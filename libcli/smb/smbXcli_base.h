@@ -41,6 +41,7 @@ struct smb2_create_blobs;
 struct smb_create_returns;
 struct smb_transport;
 struct smb311_capabilities;
+struct smb3_compression_capabilities;
 struct samba_sockaddr;
 struct tstream_context;
 
@@ -415,12 +416,22 @@ uint32_t smb2cli_conn_server_capabilities(struct smbXcli_conn *conn);
 uint16_t smb2cli_conn_server_security_mode(struct smbXcli_conn *conn);
 uint16_t smb2cli_conn_server_signing_algo(struct smbXcli_conn *conn);
 uint16_t smb2cli_conn_server_encryption_algo(struct smbXcli_conn *conn);
+const struct smb3_compression_capabilities *smb2cli_conn_server_compression(
+	struct smbXcli_conn *conn);
+uint64_t smb2cli_conn_compressed_requests(struct smbXcli_conn *conn);
+uint64_t smb2cli_conn_decompressed_responses(struct smbXcli_conn *conn);
+void smb2cli_conn_torture_compression_hook(struct smbXcli_conn *conn,
+			void (*fn)(uint8_t *buf,
+				   size_t buflen,
+				   void *private_data),
+			void *private_data);
 uint32_t smb2cli_conn_max_trans_size(struct smbXcli_conn *conn);
 uint32_t smb2cli_conn_max_read_size(struct smbXcli_conn *conn);
 uint32_t smb2cli_conn_max_write_size(struct smbXcli_conn *conn);
 void smb2cli_conn_set_max_credits(struct smbXcli_conn *conn,
 				  uint16_t max_credits);
 uint16_t smb2cli_conn_get_cur_credits(struct smbXcli_conn *conn);
+uint64_t smb2cli_conn_srtt_usec(struct smbXcli_conn *conn);
 uint8_t smb2cli_conn_get_io_priority(struct smbXcli_conn *conn);
 void smb2cli_conn_set_io_priority(struct smbXcli_conn *conn,
 				  uint8_t io_priority);
@@ -582,6 +593,10 @@ NTSTATUS smb2cli_session_create_channel(TALLOC_CTX *mem_ctx,
 NTSTATUS smb2cli_session_set_channel_key(struct smbXcli_session *session,
 					 const DATA_BLOB channel_key,
 					 const struct iovec *recv_iov);
+struct smbXcli_conn *smbXcli_session_conn(struct smbXcli_session *session);
+struct smbXcli_session *smb2cli_session_select_channel(
+	struct smbXcli_session *session,
+	uint32_t dyn_len);
 NTSTATUS smb2cli_session_encryption_on(struct smbXcli_session *session);
 uint16_t smb2cli_session_get_encryption_cipher(struct smbXcli_session *session);
 
@@ -884,6 +899,67 @@ NTSTATUS smb2cli_query_info(struct smbXcli_conn *conn,
 			    TALLOC_CTX *mem_ctx,
 			    DATA_BLOB *out_output_buffer);
 
+/*
+ * Related CREATE + READ/GETINFO/SETINFO + CLOSE compounds
+ * for one-shot operations on a path.
+ */
+struct tevent_req *smb2cli_create_read_close_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct smbXcli_conn *conn,
+	uint32_t timeout_msec,
+	struct smbXcli_session *session,
+	struct smbXcli_tcon *tcon,
+	const char *filename,
+	uint32_t share_access,
+	uint32_t create_options,
+	struct smb2_create_blobs *blobs,
+	uint32_t length);
+NTSTATUS smb2cli_create_read_close_recv(struct tevent_req *req,
+					TALLOC_CTX *mem_ctx,
+					struct smb_create_returns *cr,
+					uint8_t **data,
+					uint32_t *data_length);
+struct tevent_req *smb2cli_create_query_info_close_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct smbXcli_conn *conn,
+	uint32_t timeout_msec,
+	struct smbXcli_session *session,
+	struct smbXcli_tcon *tcon,
+	const char *filename,
+	uint32_t desired_access,
+	uint32_t share_access,
+	uint32_t create_options,
+	struct smb2_create_blobs *blobs,
+	uint8_t in_info_type,
+	uint8_t in_file_info_class,
+	uint32_t in_max_output_length,
+	uint32_t in_additional_info,
+	uint32_t in_flags);
+NTSTATUS smb2cli_create_query_info_close_recv(
+	struct tevent_req *req,
+	TALLOC_CTX *mem_ctx,
+	struct smb_create_returns *cr,
+	DATA_BLOB *out_output_buffer);
+struct tevent_req *smb2cli_create_set_info_close_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct smbXcli_conn *conn,
+	uint32_t timeout_msec,
+	struct smbXcli_session *session,
+	struct smbXcli_tcon *tcon,
+	const char *filename,
+	uint32_t desired_access,
+	uint32_t share_access,
+	uint32_t create_options,
+	struct smb2_create_blobs *blobs,
+	uint8_t in_info_type,
+	uint8_t in_file_info_class,
+	const DATA_BLOB *in_input_buffer,
+	uint32_t in_additional_info);
+NTSTATUS smb2cli_create_set_info_close_recv(struct tevent_req *req);
+
 struct tevent_req *smb2cli_query_directory_send(TALLOC_CTX *mem_ctx,
 						struct tevent_context *ev,
 						struct smbXcli_conn *conn,
@@ -0,0 +1,397 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   SMB Direct [MS-SMBD] protocol handling
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+#include "lib/util/byteorder.h"
+#include "libcli/util/ntstatus.h"
+#include "libcli/smb/smb_direct.h"
+
+void smb_direct_settings_default(struct smb_direct_settings *settings)
+{
+	/*
+	 * These match the defaults of Windows,
+	 * see [MS-SMBD] 3.1.1.1 and the product behavior notes.
+	 */
+	*settings = (struct smb_direct_settings) {
+		.receive_credit_max = 255,
+		.send_credit_target = 255,
+		.max_send_size = 1364,
+		.max_receive_size = 8192,
+		.max_fragmented_size = 1048576,
+		.max_read_write_size = 1048576,
+	};
+}
+
+NTSTATUS smb_direct_negotiate_request_pull(
+	const uint8_t *buf, size_t len,
+	struct smb_direct_negotiate_request *req)
+{
+	if (len < SMB_DIRECT_NEGOTIATE_REQUEST_SIZE) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	*req = (struct smb_direct_negotiate_request) {
+		.min_version = PULL_LE_U16(buf, 0),
+		.max_version = PULL_LE_U16(buf, 2),
+		/* 2 bytes reserved */
+		.credits_requested = PULL_LE_U16(buf, 6),
+		.preferred_send_size = PULL_LE_U32(buf, 8),
+		.max_receive_size = PULL_LE_U32(buf, 12),
+		.max_fragmented_size = PULL_LE_U32(buf, 16),
+	};
+
+	return NT_STATUS_OK;
+}
+
+void smb_direct_negotiate_request_push(
+	const struct smb_direct_negotiate_request *req,
+	uint8_t buf[SMB_DIRECT_NEGOTIATE_REQUEST_SIZE])
+{
+	PUSH_LE_U16(buf, 0, req->min_version);
+	PUSH_LE_U16(buf, 2, req->max_version);
+	PUSH_LE_U16(buf, 4, 0);
+	PUSH_LE_U16(buf, 6, req->credits_requested);
+	PUSH_LE_U32(buf, 8, req->preferred_send_size);
+	PUSH_LE_U32(buf, 12, req->max_receive_size);
+	PUSH_LE_U32(buf, 16, req->max_fragmented_size);
+}
+
+NTSTATUS smb_direct_negotiate_response_pull(
+	const uint8_t *buf, size_t len,
+	struct smb_direct_negotiate_response *rsp)
+{
+	if (len < SMB_DIRECT_NEGOTIATE_RESPONSE_SIZE) {
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+
+	*rsp = (struct smb_direct_negotiate_response) {
+		.min_version = PULL_LE_U16(buf, 0),
+		.max_version = PULL_LE_U16(buf, 2),
+		.negotiated_version = PULL_LE_U16(buf, 4),
+		/* 2 bytes reserved */
+		.credits_requested = PULL_LE_U16(buf, 8),
+		.credits_granted = PULL_LE_U16(buf, 10),
+		.status = NT_STATUS(PULL_LE_U32(buf, 12)),
+		.max_read_write_size = PULL_LE_U32(buf, 16),
+		.preferred_send_size = PULL_LE_U32(buf, 20),
+		.max_receive_size = PULL_LE_U32(buf, 24),
+		.max_fragmented_size = PULL_LE_U32(buf, 28),
+	};
+
+	return NT_STATUS_OK;
+}
+
+void smb_direct_negotiate_response_push(
+	const struct smb_direct_negotiate_response *rsp,
+	uint8_t buf[SMB_DIRECT_NEGOTIATE_RESPONSE_SIZE])
+{
+	PUSH_LE_U16(buf, 0, rsp->min_version);
+	PUSH_LE_U16(buf, 2, rsp->max_version);
+	PUSH_LE_U16(buf, 4, rsp->negotiated_version);
+	PUSH_LE_U16(buf, 6, 0);
+	PUSH_LE_U16(buf, 8, rsp->credits_requested);
+	PUSH_LE_U16(buf, 10, rsp->credits_granted);
+	PUSH_LE_U32(buf, 12, NT_STATUS_V(rsp->status));
+	PUSH_LE_U32(buf, 16, rsp->max_read_write_size);
+	PUSH_LE_U32(buf, 20, rsp->preferred_send_size);
+	PUSH_LE_U32(buf, 24, rsp->max_receive_size);
+	PUSH_LE_U32(buf, 28, rsp->max_fragmented_size);
+}
+
+void smb_direct_negotiate_server(
+	const struct smb_direct_settings *settings,
+	const struct smb_direct_negotiate_request *req,
+	struct smb_direct_negotiate_response *rsp,
+	struct smb_direct_connection_params *params)
+{
+	*rsp = (struct smb_direct_negotiate_response) {
+		.min_version = SMB_DIRECT_VERSION_1,
+		.max_version = SMB_DIRECT_VERSION_1,
+		.status = NT_STATUS_NOT_SUPPORTED,
+	};
+	*params = (struct smb_direct_connection_params) {
+		.max_send_size = 0,
+	};
+
+	if (req->min_version > SMB_DIRECT_VERSION_1 ||
+	    req->max_version < SMB_DIRECT_VERSION_1)
+	{
+		return;
+	}
+	rsp->negotiated_version = SMB_DIRECT_VERSION_1;
+
+	if (req->credits_requested == 0 ||
+	    req->max_receive_size < SMB_DIRECT_MIN_RECEIVE_SIZE ||
+	    req->max_fragmented_size < SMB_DIRECT_MIN_FRAGMENTED_SIZE)
+	{
+		rsp->status = NT_STATUS_INVALID_PARAMETER;
+		return;
+	}
+
+	params->max_send_size = MIN(req->max_receive_size,
+				    settings->max_send_size);
+	params->max_receive_size = MIN(req->preferred_send_size,
+				       settings->max_receive_size);
+	params->max_receive_size = MAX(params->max_receive_size,
+				       SMB_DIRECT_MIN_RECEIVE_SIZE);
+	params->max_fragmented_send_size = req->max_fragmented_size;
+	params->max_fragmented_receive_size = settings->max_fragmented_size;
+	params->max_read_write_size = settings->max_read_write_size;
+	params->receive_credit_max = settings->receive_credit_max;
+	params->send_credit_target = settings->send_credit_target;
+
+	rsp->credits_requested = settings->send_credit_target;
+	rsp->credits_granted = MIN(req->credits_requested,
+				   settings->receive_credit_max);
+	rsp->status = NT_STATUS_OK;
+	rsp->max_read_write_size = params->max_read_write_size;
+	rsp->preferred_send_size = params->max_send_size;
+	rsp->max_receive_size = params->max_receive_size;
+	rsp->max_fragmented_size = params->max_fragmented_receive_size;
+}
+
+NTSTATUS smb_direct_negotiate_client(
+	const struct smb_direct_settings *settings,
+	const struct smb_direct_negotiate_request *req,
+	const struct smb_direct_negotiate_response *rsp,
+	struct smb_direct_connection_params *params)
+{
+	*params = (struct smb_direct_connection_params) {
+		.max_send_size = 0,
+	};
+
+	if (!NT_STATUS_IS_OK(rsp->status)) {
+		return rsp->status;
+	}
+
+	if (rsp->negotiated_version < req->min_version ||
+	    rsp->negotiated_version > req->max_version)
+	{
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+
+	if (rsp->credits_granted == 0 ||
+	    rsp->credits_requested == 0 ||
+	    rsp->max_receive_size < SMB_DIRECT_MIN_RECEIVE_SIZE ||
+	    rsp->max_fragmented_size < SMB_DIRECT_MIN_FRAGMENTED_SIZE ||
+	    rsp->preferred_send_size > req->max_receive_size)
+	{
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+
+	params->max_send_size = MIN(rsp->max_receive_size,
+				    settings->max_send_size);
+	params->max_receive_size = req->max_receive_size;
+	params->max_fragmented_send_size = rsp->max_fragmented_size;
+	params->max_fragmented_receive_size = req->max_fragmented_size;
+	params->max_read_write_size = MIN(rsp->max_read_write_size,
+					  settings->max_read_write_size);
+	params->receive_credit_max = settings->receive_credit_max;
+	params->send_credit_target = settings->send_credit_target;
+
+	return NT_STATUS_OK;
+}
+
+NTSTATUS smb_direct_data_transfer_pull(
+	const struct smb_direct_connection_params *params,
+	const uint8_t *buf, size_t len,
+	struct smb_direct_data_transfer *dt,
+	const uint8_t **data)
+{
+	uint64_t end;
+
+	*data = NULL;
+
+	if (len < SMB_DIRECT_DATA_TRANSFER_HEADER_SIZE) {
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+	if (len > params->max_receive_size) {
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+
+	*dt = (struct smb_direct_data_transfer) {
+		.credits_requested = PULL_LE_U16(buf, 0),
+		.credits_granted = PULL_LE_U16(buf, 2),
+		.flags = PULL_LE_U16(buf, 4),
+		/* 2 bytes reserved */
+		.remaining_data_length = PULL_LE_U32(buf, 8),
+		.data_offset = PULL_LE_U32(buf, 12),
+		.data_length = PULL_LE_U32(buf, 16),
+	};
+
+	if (dt->data_length == 0) {
+		/*
+		 * A message only used to grant
+		 * credits or as keepalive.
+		 */
+		if (dt->remaining_data_length != 0) {
+			return NT_STATUS_INVALID_NETWORK_RESPONSE;
+		}
+		return NT_STATUS_OK;
+	}
+
+	if (dt->data_offset < SMB_DIRECT_DATA_TRANSFER_DATA_OFFSET ||
+	    (dt->data_offset % 8) != 0)
+	{
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+
+	end = (uint64_t)dt->data_offset + dt->data_length;
+	if (end > len) {
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+
+	end = (uint64_t)dt->remaining_data_length + dt->data_length;
+	if (end > params->max_fragmented_receive_size) {
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+
+	*data = buf + dt->data_offset;
+	return NT_STATUS_OK;
+}
+
+void smb_direct_data_transfer_push(
+	const struct smb_direct_data_transfer *dt,
+	uint8_t buf[SMB_DIRECT_DATA_TRANSFER_DATA_OFFSET])
+{
+	PUSH_LE_U16(buf, 0, dt->credits_requested);
+	PUSH_LE_U16(buf, 2, dt->credits_granted);
+	PUSH_LE_U16(buf, 4, dt->flags);
+	PUSH_LE_U16(buf, 6, 0);
+	PUSH_LE_U32(buf, 8, dt->remaining_data_length);
+	PUSH_LE_U32(buf, 12, dt->data_offset);
+	PUSH_LE_U32(buf, 16, dt->data_length);
+	/* padding */
+	PUSH_LE_U32(buf, 20, 0);
+}
+
+NTSTATUS smb_direct_buffer_descriptors_pull(
+	const uint8_t *buf, size_t len,
+	size_t max_descriptors,
+	struct smb_direct_buffer_descriptor_v1 *descs,
+	size_t *num_descs)
+{
+	size_t n = len / SMB_DIRECT_BUFFER_DESCRIPTOR_V1_SIZE;
+	size_t i;
+
+	*num_descs = 0;
+
+	if (len == 0 || (len % SMB_DIRECT_BUFFER_DESCRIPTOR_V1_SIZE) != 0) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+	if (n > max_descriptors) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	for (i = 0; i < n; i++) {
+		const uint8_t *p = buf + i * SMB_DIRECT_BUFFER_DESCRIPTOR_V1_SIZE;
+
+		descs[i] = (struct smb_direct_buffer_descriptor_v1) {
+			.offset = PULL_LE_U64(p, 0),
+			.token = PULL_LE_U32(p, 8),
+			.length = PULL_LE_U32(p, 12),
+		};
+	}
+
+	*num_descs = n;
+	return NT_STATUS_OK;
+}
+
+bool smb_direct_credits_can_send(const struct smb_direct_credits *c,
+				 uint16_t credits_granted)
+{
+	if (c->send_credits == 0) {
+		return false;
+	}
+
+	/*
+	 * The last credit is reserved for a message that
+	 * grants credits to the peer, otherwise both sides
+	 * could end up without any credits.
+	 */
+	if (c->send_credits == 1 && credits_granted == 0) {
+		return false;
+	}
+
+	return true;
+}
+
+uint16_t smb_direct_credits_grant(struct smb_direct_credits *c,
+				  uint16_t receive_credit_max)
+{
+	uint16_t n = c->receive_posted;
+
+	if (c->receive_granted >= receive_credit_max) {
+		return 0;
+	}
+
+	n = MIN(n, receive_credit_max - c->receive_granted);
+	if (c->receive_granted >= c->receive_target && n > 0) {
+		/*
+		 * The peer doesn't need more than it asked for,
+		 * but we always grant one credit if it has none.
+		 */
+		n = (c->receive_granted == 0) ? 1 : 0;
+	} else {
+		n = MIN(n, c->receive_target - c->receive_granted);
+	}
+
+	c->receive_posted -= n;
+	c->receive_granted += n;
+
+	return n;
+}
+
+NTSTATUS smb_direct_credits_sent(struct smb_direct_credits *c)
+{
+	if (c->send_credits == 0) {
+		return NT_STATUS_INTERNAL_ERROR;
+	}
+	c->send_credits -= 1;
+	return NT_STATUS_OK;
+}
+
+NTSTATUS smb_direct_credits_received(struct smb_direct_credits *c,
+				     const struct smb_direct_data_transfer *dt,
+				     uint16_t receive_credit_max)
+{
+	uint32_t send_credits;
+
+	if (c->receive_granted == 0) {
+		/*
+		 * The peer sent a message
+		 * without having a credit.
+		 */
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+	c->receive_granted -= 1;
+
+	send_credits = (uint32_t)c->send_credits + dt->credits_granted;
+	if (send_credits > UINT16_MAX) {
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+	c->send_credits = send_credits;
+
+	if (dt->credits_requested == 0) {
+		return NT_STATUS_INVALID_NETWORK_RESPONSE;
+	}
+	c->receive_target = MIN(dt->credits_requested, receive_credit_max);
+
+	return NT_STATUS_OK;
+}
@@ -0,0 +1,188 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   SMB Direct [MS-SMBD] protocol handling
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _LIBCLI_SMB_SMB_DIRECT_H_
+#define _LIBCLI_SMB_SMB_DIRECT_H_
+
+/*
+ * This only contains the transport independent parts of
+ * SMB Direct: the wire format of the messages, the negotiation
+ * of the connection limits and the credit accounting.
+ * The RDMA I/O needs to be provided on top of it.
+ */
+
+#define SMB_DIRECT_VERSION_1 0x0100
+
+#define SMB_DIRECT_NEGOTIATE_REQUEST_SIZE 20
+#define SMB_DIRECT_NEGOTIATE_RESPONSE_SIZE 32
+#define SMB_DIRECT_DATA_TRANSFER_HEADER_SIZE 20
+/* the payload of a data transfer message starts 8 byte aligned */
+#define SMB_DIRECT_DATA_TRANSFER_DATA_OFFSET 24
+#define SMB_DIRECT_BUFFER_DESCRIPTOR_V1_SIZE 16
+
+/* Values for the data transfer message Flags field */
+#define SMB_DIRECT_RESPONSE_REQUESTED 0x0001
+
+/* The minimum limits a peer needs to support, see [MS-SMBD] 3.1.5.2 */
+#define SMB_DIRECT_MIN_RECEIVE_SIZE 128
+#define SMB_DIRECT_MIN_FRAGMENTED_SIZE 131072
+
+struct smb_direct_negotiate_request {
+	uint16_t min_version;
+	uint16_t max_version;
+	uint16_t credits_requested;
+	uint32_t preferred_send_size;
+	uint32_t max_receive_size;
+	uint32_t max_fragmented_size;
+};
+
+struct smb_direct_negotiate_response {
+	uint16_t min_version;
+	uint16_t max_version;
+	uint16_t negotiated_version;
+	uint16_t credits_requested;
+	uint16_t credits_granted;
+	NTSTATUS status;
+	uint32_t max_read_write_size;
+	uint32_t preferred_send_size;
+	uint32_t max_receive_size;
+	uint32_t max_fragmented_size;
+};
+
+struct smb_direct_data_transfer {
+	uint16_t credits_requested;
+	uint16_t credits_granted;
+	uint16_t flags;
+	uint32_t remaining_data_length;
+	uint32_t data_offset;
+	uint32_t data_length;
+};
+
+struct smb_direct_buffer_descriptor_v1 {
+	uint64_t offset;
+	uint32_t token;
+	uint32_t length;
+};
+
+/*
+ * The local limits, used as input for the negotiation.
+ */
+struct smb_direct_settings {
+	uint16_t receive_credit_max;
+	uint16_t send_credit_target;
+	uint32_t max_send_size;
+	uint32_t max_receive_size;
+	uint32_t max_fragmented_size;
+	uint32_t max_read_write_size;
+};
+
+/*
+ * The state of a connection after the negotiation.
+ */
+struct smb_direct_connection_params {
+	uint32_t max_send_size;
+	uint32_t max_receive_size;
+	uint32_t max_fragmented_send_size;
+	uint32_t max_fragmented_receive_size;
+	uint32_t max_read_write_size;
+	uint16_t receive_credit_max;
+	uint16_t send_credit_target;
+};
+
+void smb_direct_settings_default(struct smb_direct_settings *settings);
+
+NTSTATUS smb_direct_negotiate_request_pull(
+	const uint8_t *buf, size_t len,
+	struct smb_direct_negotiate_request *req);
+void smb_direct_negotiate_request_push(
+	const struct smb_direct_negotiate_request *req,
+	uint8_t buf[SMB_DIRECT_NEGOTIATE_REQUEST_SIZE]);
+
+NTSTATUS smb_direct_negotiate_response_pull(
+	const uint8_t *buf, size_t len,
+	struct smb_direct_negotiate_response *rsp);
+void smb_direct_negotiate_response_push(
+	const struct smb_direct_negotiate_response *rsp,
+	uint8_t buf[SMB_DIRECT_NEGOTIATE_RESPONSE_SIZE]);
+
+/*
+ * Server side of the negotiation, fills in the response
+ * for the given request. If rsp->status is not NT_STATUS_OK
+ * the response still needs to be sent before the
+ * connection is disconnected.
+ */
+void smb_direct_negotiate_server(
+	const struct smb_direct_settings *settings,
+	const struct smb_direct_negotiate_request *req,
+	struct smb_direct_negotiate_response *rsp,
+	struct smb_direct_connection_params *params);
+
+/*
+ * Client side of the negotiation, checks the response
+ * against the request that was sent.
+ */
+NTSTATUS smb_direct_negotiate_client(
+	const struct smb_direct_settings *settings,
+	const struct smb_direct_negotiate_request *req,
+	const struct smb_direct_negotiate_response *rsp,
+	struct smb_direct_connection_params *params);
+
+/*
+ * Parse and validate a data transfer message, *data points
+ * into buf on return.
+ */
+NTSTATUS smb_direct_data_transfer_pull(
+	const struct smb_direct_connection_params *params,
+	const uint8_t *buf, size_t len,
+	struct smb_direct_data_transfer *dt,
+	const uint8_t **data);
+void smb_direct_data_transfer_push(
+	const struct smb_direct_data_transfer *dt,
+	uint8_t buf[SMB_DIRECT_DATA_TRANSFER_DATA_OFFSET]);
+
+NTSTATUS smb_direct_buffer_descriptors_pull(
+	const uint8_t *buf, size_t len,
+	size_t max_descriptors,
+	struct smb_direct_buffer_descriptor_v1 *descs,
+	size_t *num_descs);
+
+/*
+ * Credit accounting, see [MS-SMBD] 3.1.1.1.
+ */
+struct smb_direct_credits {
+	/* credits granted by the peer, needed to send a message */
+	uint16_t send_credits;
+	/* receives posted, but not granted to the peer yet */
+	uint16_t receive_posted;
+	/* credits granted to the peer, not used yet */
+	uint16_t receive_granted;
+	/* the number of credits the peer asked for */
+	uint16_t receive_target;
+};
+
+bool smb_direct_credits_can_send(const struct smb_direct_credits *c,
+				 uint16_t credits_granted);
+uint16_t smb_direct_credits_grant(struct smb_direct_credits *c,
+				  uint16_t receive_credit_max);
+NTSTATUS smb_direct_credits_sent(struct smb_direct_credits *c);
+NTSTATUS smb_direct_credits_received(struct smb_direct_credits *c,
+				     const struct smb_direct_data_transfer *dt,
+				     uint16_t receive_credit_max);
+
+#endif /* _LIBCLI_SMB_SMB_DIRECT_H_ */
@@ -0,0 +1,296 @@
+/*
+ * Unix SMB/CIFS implementation.
+ *
+ * Tests for the SMB Direct protocol handling
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <cmocka.h>
+
+#include "lib/replace/replace.h"
+
+#include "libcli/smb/smb_direct.c"
+
+static struct smb_direct_negotiate_request test_request(void)
+{
+	return (struct smb_direct_negotiate_request) {
+		.min_version = SMB_DIRECT_VERSION_1,
+		.max_version = SMB_DIRECT_VERSION_1,
+		.credits_requested = 16,
+		.preferred_send_size = 1024,
+		.max_receive_size = 2048,
+		.max_fragmented_size = 1048576,
+	};
+}
+
+static void test_smb_direct_negotiate_roundtrip(void **state)
+{
+	struct smb_direct_settings settings;
+	struct smb_direct_negotiate_request req = test_request();
+	struct smb_direct_negotiate_request req2;
+	struct smb_direct_negotiate_response rsp;
+	struct smb_direct_negotiate_response rsp2;
+	struct smb_direct_connection_params sparams;
+	struct smb_direct_connection_params cparams;
+	uint8_t reqbuf[SMB_DIRECT_NEGOTIATE_REQUEST_SIZE];
+	uint8_t rspbuf[SMB_DIRECT_NEGOTIATE_RESPONSE_SIZE];
+	NTSTATUS status;
+
+	smb_direct_settings_default(&settings);
+
+	smb_direct_negotiate_request_push(&req, reqbuf);
+	status = smb_direct_negotiate_request_pull(reqbuf,
+						   sizeof(reqbuf),
+						   &req2);
+	assert_true(NT_STATUS_IS_OK(status));
+	assert_memory_equal(&req, &req2, sizeof(req));
+
+	smb_direct_negotiate_server(&settings, &req2, &rsp, &sparams);
+	assert_true(NT_STATUS_IS_OK(rsp.status));
+	assert_int_equal(rsp.negotiated_version, SMB_DIRECT_VERSION_1);
+	assert_int_equal(rsp.credits_granted, 16);
+	assert_int_equal(rsp.credits_requested, 255);
+	/* we never send more than the client can receive */
+	assert_int_equal(sparams.max_send_size, 1364);
+	assert_int_equal(sparams.max_receive_size, 1024);
+
+	smb_direct_negotiate_response_push(&rsp, rspbuf);
+	status = smb_direct_negotiate_response_pull(rspbuf,
+						    sizeof(rspbuf),
+						    &rsp2);
+	assert_true(NT_STATUS_IS_OK(status));
+	assert_memory_equal(&rsp, &rsp2, sizeof(rsp));
+
+	status = smb_direct_negotiate_client(&settings, &req, &rsp2, &cparams);
+	assert_true(NT_STATUS_IS_OK(status));
+	assert_int_equal(cparams.max_send_size, sparams.max_receive_size);
+	assert_int_equal(cparams.max_receive_size, req.max_receive_size);
+	assert_int_equal(cparams.max_read_write_size, 1048576);
+}
+
+static void test_smb_direct_negotiate_invalid(void **state)
+{
+	struct smb_direct_settings settings;
+	struct smb_direct_negotiate_request req;
+	struct smb_direct_negotiate_response rsp;
+	struct smb_direct_connection_params params;
+	uint8_t buf[SMB_DIRECT_NEGOTIATE_REQUEST_SIZE] = { 0, };
+	NTSTATUS status;
+
+	smb_direct_settings_default(&settings);
+
+	status = smb_direct_negotiate_request_pull(buf, sizeof(buf) - 1, &req);
+	assert_true(NT_STATUS_EQUAL(status, NT_STATUS_INVALID_PARAMETER));
+
+	req = test_request();
+	req.min_version = 0x0200;
+	req.max_version = 0x0200;
+	smb_direct_negotiate_server(&settings, &req, &rsp, &params);
+	assert_true(NT_STATUS_EQUAL(rsp.status, NT_STATUS_NOT_SUPPORTED));
+	assert_int_equal(rsp.negotiated_version, 0);
+
+	req = test_request();
+	req.credits_requested = 0;
+	smb_direct_negotiate_server(&settings, &req, &rsp, &params);
+	assert_true(NT_STATUS_EQUAL(rsp.status, NT_STATUS_INVALID_PARAMETER));
+
+	req = test_request();
+	req.max_receive_size = SMB_DIRECT_MIN_RECEIVE_SIZE - 1;
+	smb_direct_negotiate_server(&settings, &req, &rsp, &params);
+	assert_true(NT_STATUS_EQUAL(rsp.status, NT_STATUS_INVALID_PARAMETER));
+
+	req = test_request();
+	smb_direct_negotiate_server(&settings, &req, &rsp, &params);
+	assert_true(NT_STATUS_IS_OK(rsp.status));
+	rsp.preferred_send_size = req.max_receive_size + 1;
+	status = smb_direct_negotiate_client(&settings, &req, &rsp, &params);
+	assert_true(NT_STATUS_EQUAL(status,
+				    NT_STATUS_INVALID_NETWORK_RESPONSE));
+}
+
+static void test_smb_direct_data_transfer(void **state)
+{
+	struct smb_direct_connection_params params = {
+		.max_receive_size = 1364,
+		.max_fragmented_receive_size = 131072,
+	};
+	struct smb_direct_data_transfer dt = {
+		.credits_requested = 10,
+		.credits_granted = 5,
+		.flags = SMB_DIRECT_RESPONSE_REQUESTED,
+		.remaining_data_length = 100,
+		.data_offset = SMB_DIRECT_DATA_TRANSFER_DATA_OFFSET,
+		.data_length = 4,
+	};
+	struct smb_direct_data_transfer dt2;
+	uint8_t buf[SMB_DIRECT_DATA_TRANSFER_DATA_OFFSET + 4];
+	const uint8_t *data = NULL;
+	NTSTATUS status;
+
+	smb_direct_data_transfer_push(&dt, buf);
+	memcpy(buf + SMB_DIRECT_DATA_TRANSFER_DATA_OFFSET, "abcd", 4);
+
+	status = smb_direct_data_transfer_pull(&params, buf, sizeof(buf),
+					       &dt2, &data);
+	assert_true(NT_STATUS_IS_OK(status));
+	assert_memory_equal(&dt, &dt2, sizeof(dt));
+	assert_ptr_equal(data, buf + SMB_DIRECT_DATA_TRANSFER_DATA_OFFSET);
+
+	/* data beyond the message */
+	status = smb_direct_data_transfer_pull(&params, buf, sizeof(buf) - 1,
+					       &dt2, &data);
+	assert_true(NT_STATUS_EQUAL(status,
+				    NT_STATUS_INVALID_NETWORK_RESPONSE));
+	assert_null(data);
+
+	/* unaligned data offset */
+	PUSH_LE_U32(buf, 12, 20);
+	status = smb_direct_data_transfer_pull(&params, buf, sizeof(buf),
+					       &dt2, &data);
+	assert_true(NT_STATUS_EQUAL(status,
+				    NT_STATUS_INVALID_NETWORK_RESPONSE));
+
+	/* too large after reassembly */
+	dt.remaining_data_length = params.max_fragmented_receive_size;
+	smb_direct_data_transfer_push(&dt, buf);
+	status = smb_direct_data_transfer_pull(&params, buf, sizeof(buf),
+					       &dt2, &data);
+	assert_true(NT_STATUS_EQUAL(status,
+				    NT_STATUS_INVALID_NETWORK_RESPONSE));
+
+	/* credit only message */
+	dt = (struct smb_direct_data_transfer) {
+		.credits_requested = 1,
+		.credits_granted = 1,
+	};
+	smb_direct_data_transfer_push(&dt, buf);
+	status = smb_direct_data_transfer_pull(&params, buf,
+					       SMB_DIRECT_DATA_TRANSFER_HEADER_SIZE,
+					       &dt2, &data);
+	assert_true(NT_STATUS_IS_OK(status));
+	assert_null(data);
+}
+
+static void test_smb_direct_buffer_descriptors(void **state)
+{
+	struct smb_direct_buffer_descriptor_v1 descs[2];
+	uint8_t buf[2 * SMB_DIRECT_BUFFER_DESCRIPTOR_V1_SIZE];
+	size_t num_descs = 0;
+	NTSTATUS status;
+
+	PUSH_LE_U64(buf, 0, 0x1122334455667788ULL);
+	PUSH_LE_U32(buf, 8, 0xaabbccdd);
+	PUSH_LE_U32(buf, 12, 65536);
+	PUSH_LE_U64(buf, 16, 4096);
+	PUSH_LE_U32(buf, 24, 1);
+	PUSH_LE_U32(buf, 28, 8192);
+
+	status = smb_direct_buffer_descriptors_pull(buf, sizeof(buf),
+						    ARRAY_SIZE(descs),
+						    descs, &num_descs);
+	assert_true(NT_STATUS_IS_OK(status));
+	assert_int_equal(num_descs, 2);
+	assert_int_equal(descs[0].offset, 0x1122334455667788ULL);
+	assert_int_equal(descs[0].token, 0xaabbccdd);
+	assert_int_equal(descs[0].length, 65536);
+	assert_int_equal(descs[1].offset, 4096);
+	assert_int_equal(descs[1].token, 1);
+	assert_int_equal(descs[1].length, 8192);
+
+	status = smb_direct_buffer_descriptors_pull(buf, sizeof(buf) - 1,
+						    ARRAY_SIZE(descs),
+						    descs, &num_descs);
+	assert_true(NT_STATUS_EQUAL(status, NT_STATUS_INVALID_PARAMETER));
+
+	status = smb_direct_buffer_descriptors_pull(buf, sizeof(buf),
+						    1, descs, &num_descs);
+	assert_true(NT_STATUS_EQUAL(status, NT_STATUS_INVALID_PARAMETER));
+	assert_int_equal(num_descs, 0);
+}
+
+static void test_smb_direct_credits(void **state)
+{
+	struct smb_direct_credits c = {
+		.send_credits = 2,
+		.receive_posted = 10,
+		.receive_target = 4,
+	};
+	struct smb_direct_data_transfer dt = {
+		.credits_requested = 8,
+		.credits_granted = 0,
+	};
+	NTSTATUS status;
+	uint16_t n;
+
+	/* never grant more than the peer asked for */
+	n = smb_direct_credits_grant(&c, 255);
+	assert_int_equal(n, 4);
+	assert_int_equal(c.receive_posted, 6);
+	assert_int_equal(c.receive_granted, 4);
+	n = smb_direct_credits_grant(&c, 255);
+	assert_int_equal(n, 0);
+
+	assert_true(smb_direct_credits_can_send(&c, 0));
+	status = smb_direct_credits_sent(&c);
+	assert_true(NT_STATUS_IS_OK(status));
+
+	/* the last credit is only used to grant credits */
+	assert_false(smb_direct_credits_can_send(&c, 0));
+	assert_true(smb_direct_credits_can_send(&c, 1));
+	status = smb_direct_credits_sent(&c);
+	assert_true(NT_STATUS_IS_OK(status));
+	assert_false(smb_direct_credits_can_send(&c, 1));
+	status = smb_direct_credits_sent(&c);
+	assert_true(NT_STATUS_EQUAL(status, NT_STATUS_INTERNAL_ERROR));
+
+	dt.credits_granted = 3;
+	status = smb_direct_credits_received(&c, &dt, 255);
+	assert_true(NT_STATUS_IS_OK(status));
+	assert_int_equal(c.send_credits, 3);
+	assert_int_equal(c.receive_granted, 3);
+	assert_int_equal(c.receive_target, 8);
+
+	n = smb_direct_credits_grant(&c, 255);
+	assert_int_equal(n, 5);
+	assert_int_equal(c.receive_granted, 8);
+
+	/* a message without a credit is a protocol error */
+	c.receive_granted = 0;
+	status = smb_direct_credits_received(&c, &dt, 255);
+	assert_true(NT_STATUS_EQUAL(status,
+				    NT_STATUS_INVALID_NETWORK_RESPONSE));
+}
+
+int main(int argc, char *argv[])
+{
+	const struct CMUnitTest tests[] = {
+		cmocka_unit_test(test_smb_direct_negotiate_roundtrip),
+		cmocka_unit_test(test_smb_direct_negotiate_invalid),
+		cmocka_unit_test(test_smb_direct_data_transfer),
+		cmocka_unit_test(test_smb_direct_buffer_descriptors),
+		cmocka_unit_test(test_smb_direct_credits),
+	};
+
+	if (argc == 2) {
+		cmocka_set_test_filter(argv[1]);
+	}
+	cmocka_set_message_output(CM_OUTPUT_SUBUNIT);
+
+	return cmocka_run_group_tests(tests, NULL, NULL);
+}
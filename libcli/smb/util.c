@@ -520,6 +520,32 @@ const char *smb3_encryption_algorithm_name(uint16_t algo)
 	return NULL;
 }
 
+static const struct enum_list enum_smb3_compression_algorithms[] = {
+	{SMB2_COMPRESSION_LZ77_HUFFMAN, "LZ77+Huffman"},
+	{SMB2_COMPRESSION_LZ77, "LZ77"},
+	{SMB2_COMPRESSION_PATTERN_V1, "Pattern_V1"},
+	{-1, NULL}
+};
+
+const char *smb3_compression_algorithm_name(uint16_t algo)
+{
+	size_t i;
+
+	if (algo == SMB2_COMPRESSION_NONE) {
+		return "NONE";
+	}
+
+	for (i = 0; i < ARRAY_SIZE(enum_smb3_compression_algorithms); i++) {
+		if (enum_smb3_compression_algorithms[i].value != algo) {
+			continue;
+		}
+
+		return enum_smb3_compression_algorithms[i].name;
+	}
+
+	return NULL;
+}
+
 static int32_t parse_enum_val(const struct enum_list *e,
 			      const char *param_name,
 			      const char *param_value)
@@ -643,6 +669,64 @@ struct smb311_capabilities smb311_capabilities_parse(const char *role,
 	return c;
 }
 
+struct smb3_compression_capabilities smb3_compression_capabilities_parse(
+				const char *role,
+				const char * const *compression_algos)
+{
+	struct smb3_compression_capabilities c = {
+		.num_algos = 0,
+	};
+	char comp_param[64] = { 0, };
+	size_t ai;
+
+	snprintf(comp_param, sizeof(comp_param),
+		 "%s smb3 compression algorithms", role);
+
+	for (ai = 0;
+	     compression_algos != NULL && compression_algos[ai] != NULL;
+	     ai++)
+	{
+		const char *algoname = compression_algos[ai];
+		int32_t v32;
+		uint16_t algo;
+		size_t di;
+		bool ignore = false;
+
+		if (c.num_algos >= SMB3_COMPRESSION_CAPABILITIES_MAX_ALGOS) {
+			DBG_ERR("WARNING: Ignoring trailing value '%s' for parameter '%s'\n",
+				  algoname, comp_param);
+			continue;
+		}
+
+		v32 = parse_enum_val(enum_smb3_compression_algorithms,
+				     comp_param, algoname);
+		if (v32 == INT32_MIN) {
+			continue;
+		}
+		algo = v32;
+
+		for (di = 0; di < c.num_algos; di++) {
+			if (algo != c.algos[di]) {
+				continue;
+			}
+
+			ignore = true;
+			break;
+		}
+
+		if (ignore) {
+			DBG_ERR("WARNING: Ignoring duplicate value '%s' for parameter '%s'\n",
+				  algoname, comp_param);
+			continue;
+		}
+
+		c.algos[c.num_algos] = algo;
+		c.num_algos += 1;
+	}
+
+	return c;
+}
+
 NTSTATUS smb311_capabilities_check(const struct smb311_capabilities *c,
 				   const char *debug_prefix,
 				   int debug_lvl,
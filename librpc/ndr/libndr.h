@@ -125,10 +125,12 @@ typedef enum {
 	LIBNDR_FLAG_NO_NDR_SIZE = 1U << 31,
 
 	/*
-	 * present to keep the size of this enumeration 64 bits until we need a
-	 * 33rd flag.
+	 * Pull DATA_BLOBs as views into the buffer being parsed instead
+	 * of talloc copies. The caller has to keep the input buffer
+	 * alive (and unmodified) for as long as the result is used and
+	 * must not talloc_free() or talloc_steal() the blob data.
 	 */
-	LIBNDR_FLAG_0x100000000 = UINT64_C(1) << 32,
+	LIBNDR_FLAG_DATA_VIEW = UINT64_C(1) << 32,
 } libndr_flags;
 LIBNDR_STATIC_ASSERT(libndr_flags_are_64_bit, sizeof (libndr_flags) == 8);
 #define PRI_LIBNDR_FLAGS PRIx64
@@ -866,6 +868,9 @@ enum ndr_err_code ndr_pull_generic_ptr(struct ndr_pull *ndr, uint32_t *v);
 enum ndr_err_code ndr_pull_ref_ptr(struct ndr_pull *ndr, uint32_t *v);
 enum ndr_err_code ndr_pull_bytes(struct ndr_pull *ndr, uint8_t *data, uint32_t n);
 enum ndr_err_code ndr_pull_array_uint8(struct ndr_pull *ndr, ndr_flags_type ndr_flags, uint8_t *data, uint32_t n);
+enum ndr_err_code ndr_pull_array_uint16(struct ndr_pull *ndr, ndr_flags_type ndr_flags, uint16_t *data, uint32_t n);
+enum ndr_err_code ndr_pull_array_uint32(struct ndr_pull *ndr, ndr_flags_type ndr_flags, uint32_t *data, uint32_t n);
+enum ndr_err_code ndr_pull_array_hyper(struct ndr_pull *ndr, ndr_flags_type ndr_flags, uint64_t *data, uint32_t n);
 enum ndr_err_code ndr_push_align(struct ndr_push *ndr, size_t size);
 enum ndr_err_code ndr_pull_align(struct ndr_pull *ndr, size_t size);
 enum ndr_err_code ndr_push_union_align(struct ndr_push *ndr, size_t size);
@@ -875,6 +880,9 @@ enum ndr_err_code ndr_pull_trailer_align(struct ndr_pull *ndr, size_t size);
 enum ndr_err_code ndr_push_bytes(struct ndr_push *ndr, const uint8_t *data, uint32_t n);
 enum ndr_err_code ndr_push_zero(struct ndr_push *ndr, uint32_t n);
 enum ndr_err_code ndr_push_array_uint8(struct ndr_push *ndr, ndr_flags_type ndr_flags, const uint8_t *data, uint32_t n);
+enum ndr_err_code ndr_push_array_uint16(struct ndr_push *ndr, ndr_flags_type ndr_flags, const uint16_t *data, uint32_t n);
+enum ndr_err_code ndr_push_array_uint32(struct ndr_push *ndr, ndr_flags_type ndr_flags, const uint32_t *data, uint32_t n);
+enum ndr_err_code ndr_push_array_hyper(struct ndr_push *ndr, ndr_flags_type ndr_flags, const uint64_t *data, uint32_t n);
 enum ndr_err_code ndr_push_unique_ptr(struct ndr_push *ndr, const void *p);
 enum ndr_err_code ndr_push_full_ptr(struct ndr_push *ndr, const void *p);
 enum ndr_err_code ndr_push_ref_ptr(struct ndr_push *ndr);
@@ -285,10 +285,22 @@ _PUBLIC_ enum ndr_err_code ndr_push_expand(struct ndr_push *ndr, uint32_t extra_
 		return NDR_ERR_SUCCESS;
 	}
 
-	ndr->alloc_size += NDR_BASE_MARSHALL_SIZE;
 	if (size == UINT32_MAX) {
 		return ndr_push_error(ndr, NDR_ERR_BUFSIZE, "Overflow in push_expand");
 	}
+
+	/*
+	 * Grow geometrically, large responses would otherwise be
+	 * reallocated (and copied) once per NDR_BASE_MARSHALL_SIZE
+	 * bytes pushed.
+	 */
+	if (ndr->alloc_size < NDR_BASE_MARSHALL_SIZE) {
+		ndr->alloc_size = NDR_BASE_MARSHALL_SIZE;
+	} else if (ndr->alloc_size <= UINT32_MAX / 2) {
+		ndr->alloc_size *= 2;
+	} else {
+		ndr->alloc_size = UINT32_MAX;
+	}
 	if (size+1 > ndr->alloc_size) {
 		ndr->alloc_size = size+1;
 	}
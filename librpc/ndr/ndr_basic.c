@@ -522,6 +522,116 @@ _PUBLIC_ enum ndr_err_code ndr_pull_array_uint8(struct ndr_pull *ndr, ndr_flags_
 	return ndr_pull_bytes(ndr, data, n);
 }
 
+/*
+  common checks for pulling an array of n fixed size scalars: align
+  once and check the bounds once for the whole array instead of once
+  per element. The wire layout is the same as pulling the elements
+  one by one. *_size is set to 0 if there is nothing to copy.
+*/
+static enum ndr_err_code ndr_pull_array_scalar_start(struct ndr_pull *ndr,
+						     ndr_flags_type ndr_flags,
+						     uint32_t n,
+						     uint32_t width,
+						     uint32_t *_size)
+{
+	*_size = 0;
+
+	NDR_PULL_CHECK_FLAGS(ndr, ndr_flags);
+	if (!(ndr_flags & NDR_SCALARS) || n == 0) {
+		return NDR_ERR_SUCCESS;
+	}
+	if (n > UINT32_MAX / width) {
+		return ndr_pull_error(ndr, NDR_ERR_BUFSIZE,
+				      "Pull array of %"PRIu32" * %"PRIu32" bytes",
+				      n, width);
+	}
+	NDR_PULL_ALIGN(ndr, width);
+	NDR_PULL_NEED_BYTES(ndr, n * width);
+	*_size = n * width;
+	return NDR_ERR_SUCCESS;
+}
+
+/*
+  pull an array of uint16
+*/
+_PUBLIC_ enum ndr_err_code ndr_pull_array_uint16(struct ndr_pull *ndr, ndr_flags_type ndr_flags, uint16_t *data, uint32_t n)
+{
+	const uint8_t *p = NULL;
+	uint32_t size, i;
+
+	NDR_CHECK(ndr_pull_array_scalar_start(ndr, ndr_flags, n, 2, &size));
+	if (size == 0) {
+		return NDR_ERR_SUCCESS;
+	}
+	p = ndr->data + ndr->offset;
+#ifdef HAVE_LITTLE_ENDIAN
+	if (!NDR_BE(ndr)) {
+		memcpy(data, p, size);
+		ndr->offset += size;
+		return NDR_ERR_SUCCESS;
+	}
+#endif
+	for (i = 0; i < n; i++) {
+		data[i] = NDR_BE(ndr) ? PULL_BE_U16(p, i * 2) : PULL_LE_U16(p, i * 2);
+	}
+	ndr->offset += size;
+	return NDR_ERR_SUCCESS;
+}
+
+/*
+  pull an array of uint32
+*/
+_PUBLIC_ enum ndr_err_code ndr_pull_array_uint32(struct ndr_pull *ndr, ndr_flags_type ndr_flags, uint32_t *data, uint32_t n)
+{
+	const uint8_t *p = NULL;
+	uint32_t size, i;
+
+	NDR_CHECK(ndr_pull_array_scalar_start(ndr, ndr_flags, n, 4, &size));
+	if (size == 0) {
+		return NDR_ERR_SUCCESS;
+	}
+	p = ndr->data + ndr->offset;
+#ifdef HAVE_LITTLE_ENDIAN
+	if (!NDR_BE(ndr)) {
+		memcpy(data, p, size);
+		ndr->offset += size;
+		return NDR_ERR_SUCCESS;
+	}
+#endif
+	for (i = 0; i < n; i++) {
+		data[i] = NDR_BE(ndr) ? PULL_BE_U32(p, i * 4) : PULL_LE_U32(p, i * 4);
+	}
+	ndr->offset += size;
+	return NDR_ERR_SUCCESS;
+}
+
+/*
+  pull an array of hyper
+*/
+_PUBLIC_ enum ndr_err_code ndr_pull_array_hyper(struct ndr_pull *ndr, ndr_flags_type ndr_flags, uint64_t *data, uint32_t n)
+{
+	const uint8_t *p = NULL;
+	uint32_t size, i;
+
+	NDR_CHECK(ndr_pull_array_scalar_start(ndr, ndr_flags, n, 8, &size));
+	if (size == 0) {
+		return NDR_ERR_SUCCESS;
+	}
+	p = ndr->data + ndr->offset;
+#ifdef HAVE_LITTLE_ENDIAN
+	if (!NDR_BE(ndr)) {
+		memcpy(data, p, size);
+		ndr->offset += size;
+		return NDR_ERR_SUCCESS;
+	}
+#endif
+	for (i = 0; i < n; i++) {
+		data[i] = NDR_BE(ndr) ? PULL_BE_U64(p, i * 8) : PULL_LE_U64(p, i * 8);
+	}
+	ndr->offset += size;
+	return NDR_ERR_SUCCESS;
+}
+
 /*
   push a int8_t
 */
@@ -824,6 +934,130 @@ _PUBLIC_ enum ndr_err_code ndr_push_array_uint8(struct ndr_push *ndr, ndr_flags_
 	return ndr_push_bytes(ndr, data, n);
 }
 
+/*
+  common part of pushing an array of n fixed size scalars, see
+  ndr_pull_array_scalar_start()
+*/
+static enum ndr_err_code ndr_push_array_scalar_start(struct ndr_push *ndr,
+						     ndr_flags_type ndr_flags,
+						     const void *data,
+						     uint32_t n,
+						     uint32_t width,
+						     uint32_t *_size)
+{
+	*_size = 0;
+
+	NDR_PUSH_CHECK_FLAGS(ndr, ndr_flags);
+	if (!(ndr_flags & NDR_SCALARS) || n == 0) {
+		return NDR_ERR_SUCCESS;
+	}
+	if (unlikely(data == NULL)) {
+		return NDR_ERR_INVALID_POINTER;
+	}
+	if (n > UINT32_MAX / width) {
+		return ndr_push_error(ndr, NDR_ERR_BUFSIZE,
+				      "Push array of %"PRIu32" * %"PRIu32" bytes",
+				      n, width);
+	}
+	NDR_PUSH_ALIGN(ndr, width);
+	NDR_PUSH_NEED_BYTES(ndr, n * width);
+	*_size = n * width;
+	return NDR_ERR_SUCCESS;
+}
+
+/*
+  push an array of uint16
+*/
+_PUBLIC_ enum ndr_err_code ndr_push_array_uint16(struct ndr_push *ndr, ndr_flags_type ndr_flags, const uint16_t *data, uint32_t n)
+{
+	uint8_t *p = NULL;
+	uint32_t size, i;
+
+	NDR_CHECK(ndr_push_array_scalar_start(ndr, ndr_flags, data, n, 2, &size));
+	if (size == 0) {
+		return NDR_ERR_SUCCESS;
+	}
+	p = ndr->data + ndr->offset;
+#ifdef HAVE_LITTLE_ENDIAN
+	if (!NDR_BE(ndr)) {
+		memcpy(p, data, size);
+		ndr->offset += size;
+		return NDR_ERR_SUCCESS;
+	}
+#endif
+	for (i = 0; i < n; i++) {
+		if (NDR_BE(ndr)) {
+			PUSH_BE_U16(p, i * 2, data[i]);
+		} else {
+			PUSH_LE_U16(p, i * 2, data[i]);
+		}
+	}
+	ndr->offset += size;
+	return NDR_ERR_SUCCESS;
+}
+
+/*
+  push an array of uint32
+*/
+_PUBLIC_ enum ndr_err_code ndr_push_array_uint32(struct ndr_push *ndr, ndr_flags_type ndr_flags, const uint32_t *data, uint32_t n)
+{
+	uint8_t *p = NULL;
+	uint32_t size, i;
+
+	NDR_CHECK(ndr_push_array_scalar_start(ndr, ndr_flags, data, n, 4, &size));
+	if (size == 0) {
+		return NDR_ERR_SUCCESS;
+	}
+	p = ndr->data + ndr->offset;
+#ifdef HAVE_LITTLE_ENDIAN
+	if (!NDR_BE(ndr)) {
+		memcpy(p, data, size);
+		ndr->offset += size;
+		return NDR_ERR_SUCCESS;
+	}
+#endif
+	for (i = 0; i < n; i++) {
+		if (NDR_BE(ndr)) {
+			PUSH_BE_U32(p, i * 4, data[i]);
+		} else {
+			PUSH_LE_U32(p, i * 4, data[i]);
+		}
+	}
+	ndr->offset += size;
+	return NDR_ERR_SUCCESS;
+}
+
+/*
+  push an array of hyper
+*/
+_PUBLIC_ enum ndr_err_code ndr_push_array_hyper(struct ndr_push *ndr, ndr_flags_type ndr_flags, const uint64_t *data, uint32_t n)
+{
+	uint8_t *p = NULL;
+	uint32_t size, i;
+
+	NDR_CHECK(ndr_push_array_scalar_start(ndr, ndr_flags, data, n, 8, &size));
+	if (size == 0) {
+		return NDR_ERR_SUCCESS;
+	}
+	p = ndr->data + ndr->offset;
+#ifdef HAVE_LITTLE_ENDIAN
+	if (!NDR_BE(ndr)) {
+		memcpy(p, data, size);
+		ndr->offset += size;
+		return NDR_ERR_SUCCESS;
+	}
+#endif
+	for (i = 0; i < n; i++) {
+		if (NDR_BE(ndr)) {
+			PUSH_BE_U64(p, i * 8, data[i]);
+		} else {
+			PUSH_LE_U64(p, i * 8, data[i]);
+		}
+	}
+	ndr->offset += size;
+	return NDR_ERR_SUCCESS;
+}
+
 /*
   push a unique non-zero value if a pointer is non-NULL, otherwise 0
 */
@@ -1465,7 +1699,11 @@ _PUBLIC_ enum ndr_err_code ndr_pull_DATA_BLOB(struct ndr_pull *ndr, ndr_flags_ty
 		return NDR_ERR_SUCCESS;
 	}
 	NDR_PULL_NEED_BYTES(ndr, length);
-	*blob = data_blob_talloc(ndr->current_mem_ctx, ndr->data+ndr->offset, length);
+	if (ndr->flags & LIBNDR_FLAG_DATA_VIEW) {
+		*blob = data_blob_const(ndr->data+ndr->offset, length);
+	} else {
+		*blob = data_blob_talloc(ndr->current_mem_ctx, ndr->data+ndr->offset, length);
+	}
 	ndr->offset += length;
 	return NDR_ERR_SUCCESS;
 }
@@ -37,6 +37,7 @@
 #include "lib/util/idtree_random.h"
 #include "nsswitch/winbind_client.h"
 #include "libcli/smb/tstream_smbXcli_np.h"
+#include "lib/pthreadpool/pthreadpool_tevent.h"
 
 /**
  * @file
@@ -1997,6 +1998,154 @@ done:
 	return status;
 }
 
+/*
+ * Run the dispatch function of a DCESRV_INTERFACE_FLAGS_THREAD_SAFE
+ * interface on a helper thread. Calls of one association group are
+ * still dispatched one after the other through
+ * assoc_group->dispatch_queue, so the order of calls on an
+ * association is preserved while other association groups run in
+ * parallel.
+ */
+struct dcesrv_thread_dispatch_state {
+	struct dcesrv_call_state *call;
+	struct tevent_req *queue_req;
+	NTSTATUS status;
+};
+
+static void dcesrv_thread_dispatch_queued(struct tevent_req *subreq);
+static void dcesrv_thread_dispatch_job(void *private_data);
+static void dcesrv_thread_dispatch_done(struct tevent_req *subreq);
+
+static NTSTATUS dcesrv_thread_dispatch(struct dcesrv_call_state *call)
+{
+	struct dcesrv_assoc_group *assoc_group = call->conn->assoc_group;
+	struct dcesrv_thread_dispatch_state *state = NULL;
+
+	if (assoc_group->dispatch_queue == NULL) {
+		assoc_group->dispatch_queue = tevent_queue_create(
+			assoc_group, "dcesrv_dispatch_queue");
+		NT_STATUS_HAVE_NO_MEMORY(assoc_group->dispatch_queue);
+	}
+
+	state = talloc_zero(call, struct dcesrv_thread_dispatch_state);
+	NT_STATUS_HAVE_NO_MEMORY(state);
+	state->call = call;
+
+	state->queue_req = tevent_queue_wait_send(
+		state, call->event_ctx, assoc_group->dispatch_queue);
+	if (state->queue_req == NULL) {
+		TALLOC_FREE(state);
+		return NT_STATUS_NO_MEMORY;
+	}
+	tevent_req_set_callback(
+		state->queue_req, dcesrv_thread_dispatch_queued, state);
+
+	call->state_flags |= DCESRV_CALL_STATE_FLAG_ASYNC;
+	return NT_STATUS_OK;
+}
+
+static void dcesrv_thread_dispatch_queued(struct tevent_req *subreq)
+{
+	struct dcesrv_thread_dispatch_state *state = tevent_req_callback_data(
+		subreq, struct dcesrv_thread_dispatch_state);
+	struct dcesrv_call_state *call = state->call;
+	struct dcesrv_context *dce_ctx = call->conn->dce_ctx;
+	NTSTATUS status;
+	bool ok;
+
+	/*
+	 * Keep state->queue_req around, it blocks the queue until we
+	 * replied.
+	 */
+	ok = tevent_queue_wait_recv(subreq);
+	if (!ok) {
+		call->fault_code = DCERPC_FAULT_CANT_PERFORM;
+		goto fault;
+	}
+
+	if (call->got_disconnect) {
+		/*
+		 * Don't bother to run it, the reply would be
+		 * dropped anyway.
+		 */
+		TALLOC_FREE(state->queue_req);
+		talloc_free(call);
+		return;
+	}
+
+	subreq = pthreadpool_tevent_job_send(
+		state,
+		call->event_ctx,
+		dce_ctx->dispatch_pool,
+		dcesrv_thread_dispatch_job,
+		state);
+	if (subreq == NULL) {
+		call->fault_code = DCERPC_FAULT_CANT_PERFORM;
+		goto fault;
+	}
+	tevent_req_set_callback(subreq, dcesrv_thread_dispatch_done, state);
+	return;
+
+fault:
+	TALLOC_FREE(state->queue_req);
+	status = dcesrv_fault(call, call->fault_code);
+	if (!NT_STATUS_IS_OK(status)) {
+		dcesrv_terminate_connection(call->conn, nt_errstr(status));
+	}
+}
+
+/*
+ * Runs on the helper thread. The call is on the pending list, so
+ * neither it nor its connection go away before we're done.
+ */
+static void dcesrv_thread_dispatch_job(void *private_data)
+{
+	struct dcesrv_thread_dispatch_state *state = talloc_get_type_abort(
+		private_data, struct dcesrv_thread_dispatch_state);
+	struct dcesrv_call_state *call = state->call;
+
+	state->status = call->context->iface->dispatch(call, call, call->r);
+}
+
+static void dcesrv_thread_dispatch_done(struct tevent_req *subreq)
+{
+	struct dcesrv_thread_dispatch_state *state = tevent_req_callback_data(
+		subreq, struct dcesrv_thread_dispatch_state);
+	struct dcesrv_call_state *call = state->call;
+	NTSTATUS status;
+	int ret;
+
+	ret = pthreadpool_tevent_job_recv(subreq);
+	TALLOC_FREE(subreq);
+
+	/*
+	 * The next call of this association group can go
+	 */
+	TALLOC_FREE(state->queue_req);
+
+	if (ret != 0) {
+		DBG_WARNING("pthreadpool_tevent_job failed: %s\n",
+			    strerror(ret));
+		call->fault_code = DCERPC_FAULT_CANT_PERFORM;
+		state->status = map_nt_error_from_unix_common(ret);
+	}
+
+	if (!NT_STATUS_IS_OK(state->status)) {
+		DEBUG(5,("dcerpc fault in call %s:%02x - %s\n",
+			 call->context->iface->name,
+			 call->pkt.u.request.opnum,
+			 dcerpc_errstr(call, call->fault_code)));
+		status = dcesrv_fault(call, call->fault_code);
+		if (!NT_STATUS_IS_OK(status)) {
+			dcesrv_terminate_connection(call->conn,
+						    nt_errstr(status));
+		}
+		return;
+	}
+
+	dcesrv_async_reply(call);
+}
+
 /*
   handle a dcerpc request packet
 */
@@ -2147,6 +2296,22 @@ static NTSTATUS dcesrv_request(struct dcesrv_call_state *call)
 			 pull->data_size - pull->offset));
 	}
 
+	if ((call->context->iface->flags & DCESRV_INTERFACE_FLAGS_THREAD_SAFE) &&
+	    (call->conn->dce_ctx->dispatch_pool != NULL) &&
+	    (call->state_flags & DCESRV_CALL_STATE_FLAG_MAY_ASYNC) &&
+	    !(call->state_flags & DCESRV_CALL_STATE_FLAG_WINBIND_OFF) &&
+	    (call->conn->assoc_group != NULL))
+	{
+		status = dcesrv_thread_dispatch(call);
+		if (!NT_STATUS_IS_OK(status)) {
+			return dcesrv_fault(call, DCERPC_FAULT_CANT_PERFORM);
+		}
+
+		/* add the call to the pending list */
+		dcesrv_call_set_list(call, DCESRV_LIST_PENDING_CALL_LIST);
+		return NT_STATUS_OK;
+	}
+
 	if (call->state_flags & DCESRV_CALL_STATE_FLAG_WINBIND_OFF) {
 		bool winbind_active = !winbind_env_set();
 		if (winbind_active) {
@@ -2544,15 +2709,31 @@ static NTSTATUS dcesrv_process_ncacn_packet(struct dcesrv_connection *dce_conn,
 			     nr->stub_and_verifier.length;
 		alloc_size = MAX(alloc_size, alloc_hint);
 
-		er->stub_and_verifier.data =
-			talloc_realloc(existing,
-				       er->stub_and_verifier.data,
-				       uint8_t, alloc_size);
-		if (er->stub_and_verifier.data == NULL) {
-			TALLOC_FREE(call);
-			return dcesrv_fault_with_flags(existing,
-						       DCERPC_FAULT_OUT_OF_RESOURCES,
-						       DCERPC_PFC_FLAG_DID_NOT_EXECUTE);
+		if (alloc_size > talloc_get_size(er->stub_and_verifier.data)) {
+			/*
+			 * Grow at least by a factor of 2, otherwise a
+			 * client not sending a useful alloc_hint makes
+			 * us copy everything we got so far for each
+			 * fragment. The checks above make sure
+			 * max_total_request_size is enough for this
+			 * fragment.
+			 */
+			alloc_size = MAX(alloc_size,
+					 talloc_get_size(
+						 er->stub_and_verifier.data) * 2);
+			alloc_size = MIN(alloc_size,
+					 dce_conn->max_total_request_size);
+
+			er->stub_and_verifier.data =
+				talloc_realloc(existing,
+					       er->stub_and_verifier.data,
+					       uint8_t, alloc_size);
+			if (er->stub_and_verifier.data == NULL) {
+				TALLOC_FREE(call);
+				return dcesrv_fault_with_flags(existing,
+							       DCERPC_FAULT_OUT_OF_RESOURCES,
+							       DCERPC_PFC_FLAG_DID_NOT_EXECUTE);
+			}
 		}
 		memcpy(er->stub_and_verifier.data +
 		       er->stub_and_verifier.length,
@@ -2742,6 +2923,32 @@ _PUBLIC_ void dcesrv_context_set_callbacks(
 	dce_ctx->callbacks = cb;
 }
 
+/*
+ * Dispatch calls to interfaces with DCESRV_INTERFACE_FLAGS_THREAD_SAFE
+ * on up to max_threads helper threads. 0 turns this off again.
+ */
+_PUBLIC_ NTSTATUS dcesrv_context_set_dispatch_threads(
+	struct dcesrv_context *dce_ctx,
+	unsigned max_threads)
+{
+	int ret;
+
+	TALLOC_FREE(dce_ctx->dispatch_pool);
+
+	if (max_threads == 0) {
+		return NT_STATUS_OK;
+	}
+
+	ret = pthreadpool_tevent_init(dce_ctx,
+				      max_threads,
+				      &dce_ctx->dispatch_pool);
+	if (ret != 0) {
+		return map_nt_error_from_unix_common(ret);
+	}
+
+	return NT_STATUS_OK;
+}
+
 _PUBLIC_ NTSTATUS dcesrv_init_ep_servers(struct dcesrv_context *dce_ctx,
 					 const char **endpoint_servers)
 {
@@ -3025,10 +3232,16 @@ _PUBLIC_ void dcesrv_cleanup_broken_connections(struct dcesrv_context *dce_ctx)
 	}
 }
 
+/*
+ * Send up to this many iovecs with one writev, stays below IOV_MAX
+ */
+#define DCESRV_SOCK_REPLY_MAX_IOV 128
+
 struct dcesrv_sock_reply_state {
 	struct dcesrv_connection *dce_conn;
 	struct dcesrv_call_state *call;
-	struct iovec iov;
+	struct iovec *iov;
+	size_t count;
 };
 
 static void dcesrv_sock_reply_done(struct tevent_req *subreq);
@@ -3044,9 +3257,10 @@ _PUBLIC_ void dcesrv_sock_report_output_data(struct dcesrv_connection *dce_conn)
 	}
 
 	while (call->replies) {
-		struct data_blob_list_item *rep = call->replies;
+		struct data_blob_list_item *rep = NULL;
 		struct dcesrv_sock_reply_state *substate;
 		struct tevent_req *subreq;
+		size_t num_iov = 0;
 
 		substate = talloc_zero(call, struct dcesrv_sock_reply_state);
 		if (!substate) {
@@ -3057,20 +3271,50 @@ _PUBLIC_ void dcesrv_sock_report_output_data(struct dcesrv_connection *dce_conn)
 		substate->dce_conn = dce_conn;
 		substate->call = NULL;
 
-		DLIST_REMOVE(call->replies, rep);
+		/*
+		 * Each fragment needs up to two iovecs, the marshalled
+		 * header and the stub data referenced by rep->payload.
+		 * Send as many fragments as possible with one writev.
+		 */
+		for (rep = call->replies; rep != NULL; rep = rep->next) {
+			num_iov += 2;
+		}
+		num_iov = MIN(num_iov, DCESRV_SOCK_REPLY_MAX_IOV);
+
+		substate->iov = talloc_array(substate, struct iovec, num_iov);
+		if (substate->iov == NULL) {
+			dcesrv_terminate_connection(dce_conn, "no memory");
+			return;
+		}
+
+		while ((call->replies != NULL) &&
+		       (substate->count + 2 <= num_iov)) {
+			rep = call->replies;
+			DLIST_REMOVE(call->replies, rep);
+
+			substate->iov[substate->count++] = (struct iovec) {
+				.iov_base = (void *)rep->blob.data,
+				.iov_len = rep->blob.length,
+			};
+			if (rep->payload.length != 0) {
+				substate->iov[substate->count++] =
+					(struct iovec) {
+					.iov_base = (void *)rep->payload.data,
+					.iov_len = rep->payload.length,
+				};
+			}
+		}
 
 		if (call->replies == NULL && call->terminate_reason == NULL) {
 			substate->call = call;
 		}
 
-		substate->iov.iov_base = (void *) rep->blob.data;
-		substate->iov.iov_len = rep->blob.length;
-
 		subreq = tstream_writev_queue_send(substate,
 						   dce_conn->event_ctx,
 						   dce_conn->stream,
 						   dce_conn->send_queue,
-						   &substate->iov, 1);
+						   substate->iov,
+						   substate->count);
 		if (!subreq) {
 			dcesrv_terminate_connection(dce_conn, "no memory");
 			return;
@@ -79,6 +79,13 @@ struct dcesrv_interface {
 };
 
 #define DCESRV_INTERFACE_FLAGS_HANDLES_NOT_USED 0x00000001
+/*
+ * The dispatch function can run on a helper thread, see
+ * dcesrv_context_set_dispatch_threads(). It must not touch
+ * process wide state like the credentials (no impersonation) or
+ * global caches and only allocate memory below the call.
+ */
+#define DCESRV_INTERFACE_FLAGS_THREAD_SAFE 0x00000002
 
 enum dcesrv_call_list {
 	DCESRV_LIST_NONE,
@@ -90,6 +97,11 @@ enum dcesrv_call_list {
 struct data_blob_list_item {
 	struct data_blob_list_item *prev,*next;
 	DATA_BLOB blob;
+	/*
+	 * Optional data sent right after blob, not copied into it.
+	 * Only valid as long as the call is.
+	 */
+	DATA_BLOB payload;
 };
 
 /* the state of an ongoing dcerpc call */
@@ -393,6 +405,9 @@ struct dcesrv_assoc_group {
 
 	/* the negotiated bind time features */
 	uint16_t bind_time_features;
+
+	/* orders threaded dispatch of the calls in this association group */
+	struct tevent_queue *dispatch_queue;
 };
 
 struct dcesrv_context_callbacks {
@@ -475,6 +490,12 @@ struct dcesrv_context {
 	const struct ndr_syntax_id *preferred_transfer;
 
 	struct dcesrv_context_callbacks *callbacks;
+
+	/*
+	 * Threads for DCESRV_INTERFACE_FLAGS_THREAD_SAFE interfaces,
+	 * NULL unless dcesrv_context_set_dispatch_threads() was called.
+	 */
+	struct pthreadpool_tevent *dispatch_pool;
 };
 
 /* this structure is used by modules to determine the size of some critical types */
@@ -527,6 +548,9 @@ NTSTATUS dcesrv_init_context(TALLOC_CTX *mem_ctx,
 void dcesrv_context_set_callbacks(
 	struct dcesrv_context *dce_ctx,
 	struct dcesrv_context_callbacks *cb);
+NTSTATUS dcesrv_context_set_dispatch_threads(
+	struct dcesrv_context *dce_ctx,
+	unsigned max_threads);
 
 /*
  * Use dcesrv_async_reply() in async code
@@ -263,6 +263,16 @@ _PUBLIC_ NTSTATUS dcesrv_reply(struct dcesrv_call_state *call)
 		pkt.u.response.stub_and_verifier.data = stub.data;
 		pkt.u.response.stub_and_verifier.length = length;
 
+		if (sig_size == 0) {
+			/*
+			 * Without a signature we only need to
+			 * marshall the header, the stub is sent
+			 * from where ndr_push put it.
+			 */
+			rep->payload = pkt.u.response.stub_and_verifier;
+			pkt.u.response.stub_and_verifier = data_blob_null;
+		}
+
 		ok = dcesrv_auth_pkt_push(call, &rep->blob, sig_size,
 					  DCERPC_RESPONSE_LENGTH,
 					  &pkt.u.response.stub_and_verifier,
@@ -271,7 +281,8 @@ _PUBLIC_ NTSTATUS dcesrv_reply(struct dcesrv_call_state *call)
 			return dcesrv_fault(call, DCERPC_FAULT_OTHER);
 		}
 
-		dcerpc_set_frag_length(&rep->blob, rep->blob.length);
+		dcerpc_set_frag_length(&rep->blob,
+				       rep->blob.length + rep->payload.length);
 
 		DLIST_ADD_END(call->replies, rep);
 
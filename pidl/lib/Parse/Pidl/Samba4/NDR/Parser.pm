@@ -88,6 +88,29 @@ sub has_fast_array($$)
 	return ($t->{NAME} eq "uint8");
 }
 
+# Arrays of fixed size scalars that are marshalled with a single
+# ndr_{push,pull}_array_* call instead of a per-element loop. Unlike
+# has_fast_array() this doesn't apply to ndr_print, which keeps printing
+# the elements one by one.
+sub has_bulk_array($$)
+{
+	my ($e,$l) = @_;
+
+	return 1 if has_fast_array($e, $l);
+	return 0 if ($l->{TYPE} ne "ARRAY");
+	return 0 if has_property($e, "max_recursion");
+
+	my $nl = GetNextLevel($e,$l);
+	return 0 unless ($nl->{TYPE} eq "DATA");
+	return 0 unless (hasType($nl->{DATA_TYPE}));
+
+	my $t = getType($nl->{DATA_TYPE});
+
+	return ($t->{NAME} eq "uint16" or
+		$t->{NAME} eq "uint32" or
+		$t->{NAME} eq "hyper");
+}
+
 sub is_public_struct
 {
 	my ($d) = @_;
@@ -658,7 +681,7 @@ sub ParseElementPushLevel
 					$self->pidl("NDR_CHECK(ndr_push_charset($ndr, $ndr_flags, $var_name, $length, sizeof(" . mapTypeName($nl->{DATA_TYPE}) . "), CH_$e->{PROPERTIES}->{charset}));");
 				}
 				return;
-			} elsif (has_fast_array($e,$l)) {
+			} elsif (has_bulk_array($e,$l)) {
 				$self->pidl("NDR_CHECK(ndr_push_array_$nl->{DATA_TYPE}($ndr, $ndr_flags, $var_name, $length));");
 				return;
 			}
@@ -693,7 +716,7 @@ sub ParseElementPushLevel
 			$self->deindent;
 			$self->pidl("}");
 		}
-	} elsif ($l->{TYPE} eq "ARRAY" and not has_fast_array($e,$l) and
+	} elsif ($l->{TYPE} eq "ARRAY" and not has_bulk_array($e,$l) and
 		not is_charset_array($e, $l)) {
 		my $length = ParseExpr($l->{LENGTH_IS}, $env, $e->{ORIGINAL});
 		my $counter = "cntr_$e->{NAME}_$l->{LEVEL_INDEX}";
@@ -1111,7 +1134,7 @@ sub ParseMemCtxPullFlags($$$$)
 	return undef if (($l->{TYPE} eq "POINTER") and ($l->{POINTER_TYPE} eq "ignore"));
 
 	return undef unless ($l->{TYPE} ne "ARRAY" or ArrayDynamicallyAllocated($e,$l));
-	return undef if has_fast_array($e, $l);
+	return undef if has_bulk_array($e, $l);
 	return undef if is_charset_array($e, $l);
 
 	my $mem_flags = "0";
@@ -1206,7 +1229,7 @@ sub ParseElementPullLevel
 					$self->pidl("NDR_CHECK(ndr_pull_charset($ndr, $ndr_flags, ".get_pointer_to($var_name).", $length, sizeof(" . mapTypeName($nl->{DATA_TYPE}) . "), CH_$e->{PROPERTIES}->{charset}));");
 				}
 				return;
-			} elsif (has_fast_array($e, $l)) {
+			} elsif (has_bulk_array($e, $l)) {
 				if ($l->{IS_ZERO_TERMINATED}) {
 					$self->CheckStringTerminator($ndr,$e,$l,$length);
 				}
@@ -1257,7 +1280,7 @@ sub ParseElementPullLevel
 			$self->pidl("}");
 		}
 	} elsif ($l->{TYPE} eq "ARRAY" and
-			not has_fast_array($e,$l) and not is_charset_array($e, $l)) {
+			not has_bulk_array($e,$l) and not is_charset_array($e, $l)) {
 		my $length = $array_length;
 		my $counter = "cntr_$e->{NAME}_$l->{LEVEL_INDEX}";
 		my $array_name = $var_name;
@@ -1733,7 +1756,7 @@ sub DeclarePtrVariables($$)
 
 sub DeclareArrayVariables($$;$)
 {
-	my ($self,$e,$pull) = @_;
+	my ($self,$e,$mode) = @_;
 
 	if (has_property($e, "skip") or has_property($e, "skip_noinit")) {
 		return;
@@ -1741,13 +1764,15 @@ sub DeclareArrayVariables($$;$)
 
 	foreach my $l (@{$e->{LEVELS}}) {
 		next if ($l->{TYPE} ne "ARRAY");
-		if (defined($pull)) {
+		if (defined($mode) and $mode eq "pull") {
 			$self->pidl("uint32_t size_$e->{NAME}_$l->{LEVEL_INDEX} = 0;");
 			if ($l->{IS_VARYING}) {
 				$self->pidl("uint32_t length_$e->{NAME}_$l->{LEVEL_INDEX} = 0;");
 			}
 		}
 		next if has_fast_array($e,$l);
+		# push and pull don't loop over bulk arrays, print does
+		next if (defined($mode) and has_bulk_array($e,$l));
 		next if is_charset_array($e,$l);
 		$self->pidl("uint32_t cntr_$e->{NAME}_$l->{LEVEL_INDEX};");
 	}
@@ -1763,7 +1788,7 @@ sub DeclareArrayVariablesNoZero($$$)
 
 	foreach my $l (@{$e->{LEVELS}}) {
 		next if ($l->{TYPE} ne "ARRAY");
-		next if has_fast_array($e,$l);
+		next if has_bulk_array($e,$l);
 		next if is_charset_array($e,$l);
 		my $length = ParseExpr($l->{LENGTH_IS}, $env, $e->{ORIGINAL});
 		if ($length eq "0") {
@@ -1958,7 +1983,7 @@ sub ParseUnionPushPrimitives($$$$)
 				# and store it based on the toplevel struct/union
 				$self->pidl("NDR_CHECK(ndr_push_setup_relative_base_offset1($ndr, $varname, $ndr->offset));");
 			}
-			$self->DeclareArrayVariables($el);
+			$self->DeclareArrayVariables($el, "push");
 			my $el_env = {$el->{NAME} => "$varname->$el->{NAME}"};
 			$self->CheckRefPtrs($el, $ndr, $el_env);
 			$self->ParseElementPush($el, $ndr, $el_env, 1, 0);
@@ -2508,7 +2533,7 @@ sub ParseFunctionPush($$)
 	$self->indent;
 
 	foreach my $e (@{$fn->{ELEMENTS}}) {
-		$self->DeclareArrayVariables($e);
+		$self->DeclareArrayVariables($e, "push");
 	}
 
 	$self->pidl("NDR_PUSH_CHECK_FN_FLAGS(ndr, flags);");
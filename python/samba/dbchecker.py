@@ -17,6 +17,9 @@
 # along with this program.  If not, see <http://www.gnu.org/licenses/>.
 #
 
+import os
+import sys
+import traceback
 import ldb
 import samba
 import time
@@ -39,6 +42,12 @@ from samba.netcmd import CommandError
 from samba.netcmd.fsmo import get_fsmo_roleowner
 from samba.colour import c_RED, c_DARK_YELLOW, c_DARK_CYAN, c_DARK_GREEN
 
+# How many link targets check_dn() looks up with one search
+DN_TARGET_BATCH_SIZE = 100
+
+# How often (in seconds) progress is reported while checking objects
+PROGRESS_INTERVAL = 60
+
 def dump_attr_values(vals):
     """Stringify a value list, using utf-8 if possible (which some tests
     want), or the python bytes representation otherwise (with leading
@@ -261,9 +270,21 @@ class dbcheck(object):
         return dn
 
     def check_database(self, DN=None, scope=ldb.SCOPE_SUBTREE, controls=None,
-                       attrs=None):
-        """perform a database check, returning the number of errors found"""
-        res = self.samdb.search(base=DN, scope=scope, attrs=['dn'], controls=controls)
+                       attrs=None, jobs=1, connect=None):
+        """perform a database check, returning the number of errors found
+
+        With jobs > 1 the objects are split by ranges of their
+        objectGUID over that many worker processes. Every worker
+        uses its own database connection, returned as a
+        (samdb, samdb_schema) tuple by connect(). Errors are only
+        reported then, not fixed.
+        """
+        if jobs > 1:
+            res = self.samdb.search(base=DN, scope=scope,
+                                    attrs=['objectGUID'], controls=controls)
+        else:
+            res = self.samdb.search(base=DN, scope=scope, attrs=['dn'],
+                                    controls=controls)
         self.report('Checking %u objects' % len(res))
         error_count = 0
         self.unfixable_errors = 0
@@ -272,9 +293,11 @@ class dbcheck(object):
 
         self.attribute_or_class_ids = set()
 
-        for object in res:
-            self.dn_set.add(str(object.dn))
-            error_count += self.check_object(object.dn, requested_attrs=attrs)
+        if jobs > 1:
+            error_count += self.check_objects_parallel(res, attrs, jobs,
+                                                       connect)
+        else:
+            error_count += self.check_objects(res, attrs)
 
         if DN is None:
             error_count += self.check_rootdse()
@@ -299,6 +322,90 @@ class dbcheck(object):
 
         return error_count
 
+    def check_objects(self, res, attrs, prefix=""):
+        """check a list of objects, reporting the progress every
+        PROGRESS_INTERVAL seconds"""
+        error_count = 0
+        start = time.time()
+        last_report = start
+
+        for i, object in enumerate(res):
+            self.dn_set.add(str(object.dn))
+            error_count += self.check_object(object.dn, requested_attrs=attrs)
+
+            now = time.time()
+            if now - last_report >= PROGRESS_INTERVAL:
+                last_report = now
+                self.report("%sChecked %u/%u objects (%.0f objects/sec)" %
+                            (prefix, i + 1, len(res), (i + 1) / (now - start)))
+
+        return error_count
+
+    def check_objects_parallel(self, res, attrs, jobs, connect):
+        """check a list of objects in jobs worker processes"""
+        slices = [[] for n in range(jobs)]
+        for msg in res:
+            self.dn_set.add(str(msg.dn))
+            guid = msg.get('objectGUID', idx=0)
+            n = 0
+            if guid is not None:
+                n = guid[0] * jobs // 256
+            slices[n].append(msg)
+
+        workers = []
+        sys.stdout.flush()
+        for n in range(jobs):
+            (r, w) = os.pipe()
+            pid = os.fork()
+            if pid == 0:
+                status = 1
+                try:
+                    os.close(r)
+                    (samdb, samdb_schema) = connect()
+                    chk = dbcheck(samdb, samdb_schema=samdb_schema,
+                                  verbose=self.verbose, quiet=self.quiet,
+                                  quick_membership_checks=self.quick_membership_checks,
+                                  reset_well_known_acls=self.reset_well_known_acls,
+                                  check_expired_tombstones=self.check_expired_tombstones,
+                                  colour=self.colour)
+                    chk.dn_set = self.dn_set
+                    chk.unfixable_errors = 0
+                    chk.attribute_or_class_ids = set()
+                    errors = chk.check_objects(slices[n], attrs,
+                                               "worker %u: " % n)
+                    os.write(w, ("%u %u %u" % (errors,
+                                                chk.unfixable_errors,
+                                                chk.expired_tombstones)).encode())
+                    status = 0
+                except Exception:
+                    traceback.print_exc()
+                finally:
+                    sys.stdout.flush()
+                    sys.stderr.flush()
+                    os._exit(status)
+            os.close(w)
+            workers.append((pid, r))
+
+        error_count = 0
+        failed = 0
+        for (pid, r) in workers:
+            with os.fdopen(r) as f:
+                result = f.read()
+            (pid, status) = os.waitpid(pid, 0)
+            if status != 0 or not result:
+                failed += 1
+                continue
+            (errors, unfixable, expired) = [int(x) for x in result.split()]
+            error_count += errors
+            self.unfixable_errors += unfixable
+            self.expired_tombstones += expired
+
+        if failed != 0:
+            raise CommandError("%u of %u dbcheck workers failed" %
+                               (failed, jobs))
+
+        return error_count
+
     def check_deleted_objects_containers(self):
         """This function only fixes conflicts on the Deleted Objects
         containers, not the attributes"""
@@ -1297,6 +1404,51 @@ newSuperior: %s""" % (str(from_dn), str(to_rdn), str(to_base)))
 
         return (missing_forward_links, error_count)
 
+    def get_dn_target_attrs(self, obj, attrname, reverse_link_name):
+        """return the attributes check_dn() needs of the targets of a
+        DN attribute"""
+        attrs = ['isDeleted', 'replPropertyMetaData']
+
+        if (str(attrname).lower() == 'msds-hasinstantiatedncs') and (obj.dn == self.ntds_dsa):
+            fixing_msDS_HasInstantiatedNCs = True
+            attrs.append("instanceType")
+        else:
+            fixing_msDS_HasInstantiatedNCs = False
+
+        if reverse_link_name is not None:
+            attrs.append(reverse_link_name)
+
+        return (attrs, fixing_msDS_HasInstantiatedNCs)
+
+    def search_dn_targets(self, vals, syntax_oid, attrs):
+        """look up the targets of DN values by GUID, DN_TARGET_BATCH_SIZE
+        at a time, returning a dict from GUID string to message"""
+        guidstrs = set()
+        for val in vals:
+            dsdb_dn = dsdb_Dn(self.samdb, val.decode('utf8'), syntax_oid)
+            guid = dsdb_dn.dn.get_extended_component("GUID")
+            if guid is not None:
+                guidstrs.add(str(misc.GUID(guid)))
+
+        guidstrs = sorted(guidstrs)
+        targets = {}
+        for i in range(0, len(guidstrs), DN_TARGET_BATCH_SIZE):
+            expression = "(|%s)" % "".join(
+                "(objectGUID=%s)" % g
+                for g in guidstrs[i:i + DN_TARGET_BATCH_SIZE])
+            res = self.samdb.search(scope=ldb.SCOPE_SUBTREE,
+                                    expression=expression,
+                                    attrs=attrs,
+                                    controls=["extended_dn:1:1",
+                                              "show_recycled:1",
+                                              "reveal_internals:0",
+                                              "search_options:1:2"])
+            for msg in res:
+                guid = msg.dn.get_extended_component("GUID")
+                targets[str(misc.GUID(guid))] = msg
+
+        return targets
+
     def check_dn(self, obj, attrname, syntax_oid):
         """check a DN attribute for correctness"""
         error_count = 0
@@ -1356,6 +1508,15 @@ newSuperior: %s""" % (str(from_dn), str(to_rdn), str(to_base)))
             # We should continue with the fixed values
             obj[attrname] = ldb.MessageElement(vals, 0, attrname)
 
+        attrs, fixing_msDS_HasInstantiatedNCs = \
+            self.get_dn_target_attrs(obj, attrname, reverse_link_name)
+
+        # Without --fix nothing changes underneath us, so the targets
+        # can be looked up in batches instead of one search per value.
+        targets = None
+        if not self.fix and len(obj[attrname]) > 1:
+            targets = self.search_dn_targets(obj[attrname], syntax_oid, attrs)
+
         for val in obj[attrname]:
             dsdb_dn = dsdb_Dn(self.samdb, val.decode('utf8'), syntax_oid)
 
@@ -1368,23 +1529,19 @@ newSuperior: %s""" % (str(from_dn), str(to_rdn), str(to_base)))
                 continue
 
             guidstr = str(misc.GUID(guid))
-            attrs = ['isDeleted', 'replPropertyMetaData']
-
-            if (str(attrname).lower() == 'msds-hasinstantiatedncs') and (obj.dn == self.ntds_dsa):
-                fixing_msDS_HasInstantiatedNCs = True
-                attrs.append("instanceType")
-            else:
-                fixing_msDS_HasInstantiatedNCs = False
-
-            if reverse_link_name is not None:
-                attrs.append(reverse_link_name)
 
             # check its the right GUID
             try:
-                res = self.samdb.search(base="<GUID=%s>" % guidstr, scope=ldb.SCOPE_BASE,
-                                        attrs=attrs, controls=["extended_dn:1:1", "show_recycled:1",
-                                                               "reveal_internals:0"
-                                                               ])
+                if targets is None:
+                    res = self.samdb.search(base="<GUID=%s>" % guidstr, scope=ldb.SCOPE_BASE,
+                                            attrs=attrs, controls=["extended_dn:1:1", "show_recycled:1",
+                                                                   "reveal_internals:0"
+                                                                   ])
+                elif guidstr in targets:
+                    res = [targets[guidstr]]
+                else:
+                    raise ldb.LdbError(ldb.ERR_NO_SUCH_OBJECT,
+                                       "No object with GUID %s" % guidstr)
             except ldb.LdbError as e3:
                 (enum, estr) = e3.args
                 if enum != ldb.ERR_NO_SUCH_OBJECT:
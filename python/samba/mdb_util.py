@@ -21,8 +21,14 @@ import os
 from samba.netcmd import CommandError
 
 
-def mdb_copy(file1, file2):
-    """Copy mdb file using mdb_copy utility and rename it
+def mdb_copy_start(file1, compact=False):
+    """Start copying an mdb file using the mdb_copy utility in the
+    background, returning the process for mdb_copy_finish().
+
+    With compact=True free pages are omitted and the records are
+    renumbered (mdb_env_copy2() with MDB_CP_COMPACT), which is
+    faster for a database with much free space and gives a smaller
+    copy.
     """
     # Find the location of the mdb_copy tool
     dirs = os.getenv('PATH').split(os.pathsep)
@@ -37,7 +43,25 @@ def mdb_copy(file1, file2):
         raise CommandError("mdb_copy not found. "
                            "You may need to install the lmdb-utils package")
 
-    mdb_copy_cmd = [toolpath, "-n", file1, "%s.copy.mdb" % file1]
-    status = subprocess.check_call(mdb_copy_cmd, close_fds=True, shell=False)
+    mdb_copy_cmd = [toolpath, "-n"]
+    if compact:
+        mdb_copy_cmd.append("-c")
+    mdb_copy_cmd += [file1, "%s.copy.mdb" % file1]
+    return subprocess.Popen(mdb_copy_cmd, close_fds=True, shell=False)
+
+
+def mdb_copy_finish(proc, file1, file2):
+    """Wait for a copy started with mdb_copy_start() and rename it
+    """
+    status = proc.wait()
+    if status != 0:
+        raise subprocess.CalledProcessError(status, proc.args)
 
     os.rename("%s.copy.mdb" % file1, file2)
+
+
+def mdb_copy(file1, file2, compact=False):
+    """Copy mdb file using mdb_copy utility and rename it
+    """
+    proc = mdb_copy_start(file1, compact=compact)
+    mdb_copy_finish(proc, file1, file2)
@@ -83,6 +83,9 @@ class cmd_dbcheck(Command):
                default=False, action="store_true"),
         Option("-H", "--URL", help="LDB URL for database or target server (defaults to local SAM database)",
                type=str, metavar="URL", dest="H"),
+        Option("--jobs", dest="jobs", type=int, default=1, metavar="N",
+               help=("check the objects in N processes in parallel "
+                     "(not together with --fix)")),
         Option("--selftest-check-expired-tombstones",
                dest="selftest_check_expired_tombstones", default=False, action="store_true",
                help=optparse.SUPPRESS_HELP),  # This is only used by tests
@@ -95,11 +98,17 @@ class cmd_dbcheck(Command):
             quick_membership_checks=False,
             reset_well_known_acls=False,
             selftest_check_expired_tombstones=False,
-            yes_rules=None):
+            yes_rules=None, jobs=1):
 
         if yes_rules is None:
             yes_rules = []
 
+        if jobs < 1:
+            raise CommandError("--jobs must be at least 1")
+        if jobs > 1 and (fix or reindex or force_modules):
+            raise CommandError("--jobs can't be used with --fix, --reindex "
+                               "or --force-modules")
+
         lp = sambaopts.get_loadparm()
 
         over_ldap = H is not None and H.startswith('ldap')
@@ -125,6 +134,16 @@ class cmd_dbcheck(Command):
             samdb_schema = SamDB(session_info=system_session(), url=None,
                                  credentials=creds, lp=lp)
 
+        def connect():
+            """a new connection for a --jobs worker process"""
+            worker_samdb = SamDB(session_info=system_session(), url=H,
+                                 credentials=creds, lp=lp)
+            if H is None or not over_ldap:
+                return (worker_samdb, worker_samdb)
+            worker_schema = SamDB(session_info=system_session(), url=None,
+                                  credentials=creds, lp=lp)
+            return (worker_samdb, worker_schema)
+
         scope_map = {"SUB": ldb.SCOPE_SUBTREE, "BASE": ldb.SCOPE_BASE, "ONE": ldb.SCOPE_ONELEVEL}
         scope = scope.upper()
         if scope not in scope_map:
@@ -180,7 +199,8 @@ class cmd_dbcheck(Command):
 
             else:
                 error_count = chk.check_database(DN=DN, scope=search_scope,
-                                                 controls=controls, attrs=attrs)
+                                                 controls=controls, attrs=attrs,
+                                                 jobs=jobs, connect=connect)
         except:
             if started_transaction:
                 samdb.transaction_cancel()
@@ -1388,6 +1388,50 @@ class cmd_cleanup_record(Command):
                                         ignore_no_name=True)
 
 
+class cmd_cachestats(Command):
+    """Show the cache counters of the local internal DNS server.
+
+    The internal DNS server caches the records of its zones until the
+    partition holding the zone changes, and the answers of the DNS
+    forwarders until their TTL expires. The cache size is set with
+    "dns:cache size" (bytes, 0 disables the cache), the maximum TTL of
+    forwarded answers with "dns:forwarder cache max ttl".
+
+    This only works on the DC running the internal DNS server.
+    """
+
+    synopsis = '%prog [options]'
+
+    takes_optiongroups = {
+        "sambaopts": options.SambaOptions,
+        "versionopts": options.VersionOptions,
+    }
+
+    def run(self, sambaopts=None, versionopts=None):
+        from samba.dcerpc import irpc
+
+        lp = sambaopts.get_loadparm()
+
+        try:
+            conn = irpc.irpc("irpc:dnssrv", lp_ctx=lp)
+            records, forwarder, max_size = conn.dnssrv_cache_stats()
+        except (RuntimeError, ValueError) as e:
+            raise CommandError('Could not get the cache counters from '
+                               'the internal DNS server', e)
+
+        self.outf.write('  max size            : %d\n' % max_size)
+        for name, c in (('records', records), ('forwarder', forwarder)):
+            lookups = c.hits + c.misses
+            ratio = (100.0 * c.hits / lookups) if lookups else 0.0
+            self.outf.write('  %s\n' % name)
+            self.outf.write('    hits              : %d (%.1f%%)\n' %
+                            (c.hits, ratio))
+            self.outf.write('    misses            : %d\n' % c.misses)
+            self.outf.write('    evictions         : %d\n' % c.evictions)
+            self.outf.write('    entries           : %d\n' % c.num_elements)
+            self.outf.write('    size              : %d\n' % c.size)
+
+
 class cmd_dns(SuperCommand):
     """Domain Name Service (DNS) management."""
 
@@ -1404,3 +1448,4 @@ class cmd_dns(SuperCommand):
     subcommands['update'] = cmd_update_record()
     subcommands['delete'] = cmd_delete_record()
     subcommands['cleanup'] = cmd_cleanup_record()
+    subcommands['cachestats'] = cmd_cachestats()
@@ -48,7 +48,7 @@ from samba.provision.sambadns import (fill_dns_data_partitions,
                                       get_dnsadmins_sid,
                                       get_domainguid)
 from samba.tdb_util import tdb_copy
-from samba.mdb_util import mdb_copy
+from samba.mdb_util import mdb_copy_start, mdb_copy_finish
 import errno
 from subprocess import CalledProcessError
 from samba import sites
@@ -1012,7 +1012,22 @@ class cmd_domain_backup_offline(samba.netcmd.Command):
 
 
     def offline_mdb_copy(self, path):
-        mdb_copy(path, path + self.backup_ext)
+        # The copies of all partitions run in parallel, they are
+        # waited for in backup_smb_dbs() under the same read lock.
+        proc = mdb_copy_start(path, compact=True)
+        self.mdb_copies.append((proc, path))
+
+    def wait_mdb_copies(self):
+        copies = self.mdb_copies
+        self.mdb_copies = []
+        error = None
+        for (proc, path) in copies:
+            try:
+                mdb_copy_finish(proc, path, path + self.backup_ext)
+            except CalledProcessError as e:
+                error = error or e
+        if error is not None:
+            raise error
 
     # Secrets databases are a special case: a transaction must be started
     # on the secrets.ldb file before backing up that file and secrets.tdb
@@ -1046,6 +1061,7 @@ class cmd_domain_backup_offline(samba.netcmd.Command):
         res_iterator = None
 
         copy_function = None
+        self.mdb_copies = []
         if mdb_backend:
             logger.info('MDB backend detected.  Using mdb backup function.')
             copy_function = self.offline_mdb_copy
@@ -1079,6 +1095,8 @@ class cmd_domain_backup_offline(samba.netcmd.Command):
                 logger.info('   copying locked/related file ' + sam_file)
                 shutil.copyfile(sam_file, sam_file + self.backup_ext)
 
+        self.wait_mdb_copies()
+
         sid = get_sid_for_restore(samdb, logger)
 
         if mdb_backend:
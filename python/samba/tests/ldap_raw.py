@@ -40,7 +40,9 @@ SASL_AUTH = b'\xa3'
 # Search
 SEARCH = b'\x63'
 SEARCH_RES = b'\x64'
+SEARCH_DONE = b'\x65'
 EQUALS = b'\xa3'
+PRESENT = b'\x87'
 
 
 #
@@ -276,6 +278,93 @@ class RawLdapTest(TestCase):
         self.assertEqual(SUCCESS.hex(), element.hex())
         self.assertGreater(len(rest), 0)
 
+    def recv_messages(self, count):
+        """
+            Receive count LDAP messages, returns a list of
+            (message id, operation) tuples
+        """
+        data = b''
+        messages = []
+        while len(messages) < count:
+            chunk = self.recv()
+            self.assertIsNotNone(chunk)
+            data += chunk
+            while True:
+                msg = decode_element(data)
+                if msg is None:
+                    break
+                (ber_type, length, element, rest) = msg
+                if len(element) < length:
+                    break
+                self.assertEqual(SEQUENCE.hex(), ber_type.hex())
+                (ber_type, length, msg_no, op) = decode_element(element)
+                self.assertEqual(INTEGER.hex(), ber_type.hex())
+                messages.append((int.from_bytes(msg_no, byteorder='big'),
+                                 op[0:1]))
+                data = rest
+        self.assertEqual(b'', data)
+        return messages
+
+    def rootdse_search(self, msg_id):
+        """ A search for the objectClass of the RootDSE """
+        header = encode_string(None)        # Base DN, ""
+        header += encode_enumerated(0)      # Enumeration scope
+        header += encode_enumerated(0)      # Enumeration dereference
+        header += encode_integer(0)         # Integer size limit
+        header += encode_integer(0)         # Integer time limit
+        header += encode_boolean(False)     # Boolean attributes only
+        present = encode_element(PRESENT, b'objectClass')
+        attrs = encode_sequence(encode_string(b'dnsHostName'))
+        search = encode_element(SEARCH, header + present + attrs)
+
+        return encode_sequence(encode_integer(msg_id) + search)
+
+    def test_pipelined_searches(self):
+        """
+        Searches sent without waiting for the replies each get their
+        entry and their done message, in the order they were sent.
+        """
+        self.bind()
+
+        ids = list(range(10, 30))
+        self.send(b''.join(self.rootdse_search(i) for i in ids))
+
+        messages = self.recv_messages(2 * len(ids))
+        expected = []
+        for i in ids:
+            expected.append((i, SEARCH_RES))
+            expected.append((i, SEARCH_DONE))
+        self.assertEqual(expected, messages)
+
+    def test_pipelined_bind_waits(self):
+        """
+        A bind sent behind searches is only processed after they
+        have been replied to.
+        """
+        self.bind()
+
+        user = self.user.encode('UTF8')
+        ou = self.dns_name.replace('.', ',dc=').encode('UTF8')
+        dn = b'cn=' + user + b',cn=users,dc=' + ou
+        password = self.password.encode('UTF8')
+        bind = encode_integer(3)
+        bind += encode_string(dn)
+        bind += encode_element(SIMPLE_AUTH, password)
+        bind = encode_sequence(encode_integer(12) +
+                               encode_element(BIND, bind))
+
+        self.send(self.rootdse_search(10) +
+                  self.rootdse_search(11) +
+                  bind +
+                  self.rootdse_search(13))
+
+        messages = self.recv_messages(7)
+        self.assertEqual([(10, SEARCH_RES), (10, SEARCH_DONE),
+                          (11, SEARCH_RES), (11, SEARCH_DONE),
+                          (12, BIND_RES),
+                          (13, SEARCH_RES), (13, SEARCH_DONE)],
+                         messages)
+
     def test_decode_element(self):
         """ Tests for the decode_element method """
 
@@ -0,0 +1,177 @@
+# Unix SMB/CIFS implementation.
+#
+# Tests for the NTLMv2 logon cache of winbindd ("winbind:ntlm cache time")
+#
+# This program is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; either version 3 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+#
+
+"""Check that winbindd does not accept a cached NTLMv2 logon once the
+account was disabled, locked out or its password changed on the DC.
+
+These tests need "winbind:ntlm cache time" to be set on the member.
+"""
+
+import hmac
+import os
+import struct
+import time
+from subprocess import Popen, PIPE
+
+import ldb
+import samba.tests
+from samba.credentials import Credentials
+from samba.crypto import md4_hash_blob
+from samba.tests.ntlm_auth_base import NTLMAuthTestCase
+
+
+class NTLMAuthCacheTests(NTLMAuthTestCase):
+
+    def setUp(self):
+        super().setUp()
+        self.domain = os.environ["DOMAIN"]
+
+        creds = Credentials()
+        creds.guess(self.lp)
+        creds.set_username(os.environ["DC_USERNAME"])
+        creds.set_password(os.environ["DC_PASSWORD"])
+        self.samdb = samba.tests.connect_samdb(
+            "ldap://%s" % os.environ["DC_SERVER"],
+            lp=self.lp,
+            credentials=creds)
+
+        self.username = "ntlmcacheuser"
+        self.password = "Ntlm.Cache.Pass01"
+        self.samdb.newuser(self.username, self.password)
+        self.addCleanup(self.samdb.deleteuser, self.username)
+        self.filter = "(sAMAccountName=%s)" % self.username
+
+    def ntlmv2_response(self, password, challenge):
+        nt_hash = md4_hash_blob(password.encode('utf-16-le'))
+        identity = (self.username.upper() + self.domain).encode('utf-16-le')
+        ntowfv2 = hmac.new(nt_hash, identity, 'md5').digest()
+
+        nttime = int((time.time() + 11644473600) * 10000000)
+        # An NTLMv2_CLIENT_CHALLENGE with just MsvAvEOL
+        blob = (b'\x01\x01' + b'\x00' * 6 +
+                struct.pack('<Q', nttime) +
+                os.urandom(8) +
+                b'\x00' * 4 +
+                b'\x00' * 4 +
+                b'\x00' * 4)
+
+        proof = hmac.new(ntowfv2, challenge + blob, 'md5').digest()
+        return proof + blob
+
+    def authenticate(self, challenge, nt_response):
+        ntlm_cmds = [
+            "LANMAN-Challenge: %s" % challenge.hex(),
+            "NT-Response: %s" % nt_response.hex(),
+            "NT-Domain: %s" % self.domain,
+            "Username: %s" % self.username,
+            ".\n"]
+
+        proc = Popen([self.ntlm_auth_path,
+                      "--helper-protocol", "ntlm-server-1"],
+                     stdout=PIPE, stdin=PIPE, stderr=PIPE)
+        buf = "\n".join(ntlm_cmds)
+        (out, err) = proc.communicate(input=buf.encode('utf-8'))
+        self.assertEqual(proc.returncode, 0)
+
+        lines = out.split(b"\n")
+        self.assertIn(lines[0],
+                      [b"Authenticated: Yes", b"Authenticated: No"])
+        return lines[0] == b"Authenticated: Yes"
+
+    def cache_logon(self):
+        challenge = os.urandom(8)
+        nt_response = self.ntlmv2_response(self.password, challenge)
+
+        self.assertTrue(self.authenticate(challenge, nt_response))
+        # The repeat is answered from the cache
+        self.assertTrue(self.authenticate(challenge, nt_response))
+
+        return (challenge, nt_response)
+
+    def test_disabled_account(self):
+        """A disabled account must not log on from the cache"""
+        (challenge, nt_response) = self.cache_logon()
+
+        self.samdb.disable_account(self.filter)
+
+        fresh_challenge = os.urandom(8)
+        fresh_response = self.ntlmv2_response(self.password,
+                                              fresh_challenge)
+        self.assertFalse(self.authenticate(fresh_challenge, fresh_response))
+
+        self.assertFalse(self.authenticate(challenge, nt_response))
+
+    def test_changed_password(self):
+        """The old password must not log on from the cache"""
+        (challenge, nt_response) = self.cache_logon()
+
+        self.samdb.setpassword(self.filter, "Ntlm.Cache.Pass02")
+
+        fresh_challenge = os.urandom(8)
+        fresh_response = self.ntlmv2_response(self.password,
+                                              fresh_challenge)
+        self.assertFalse(self.authenticate(fresh_challenge, fresh_response))
+
+        self.assertFalse(self.authenticate(challenge, nt_response))
+
+    def set_lockout_threshold(self, threshold):
+        base_dn = self.samdb.domain_dn()
+
+        def modify_threshold(value):
+            msg = ldb.Message(ldb.Dn(self.samdb, base_dn))
+            if value is None:
+                msg["lockoutThreshold"] = ldb.MessageElement(
+                    [], ldb.FLAG_MOD_DELETE, "lockoutThreshold")
+            else:
+                msg["lockoutThreshold"] = ldb.MessageElement(
+                    str(value), ldb.FLAG_MOD_REPLACE, "lockoutThreshold")
+            self.samdb.modify(msg)
+
+        res = self.samdb.search(base_dn,
+                                scope=ldb.SCOPE_BASE,
+                                attrs=["lockoutThreshold"])
+        self.assertEqual(1, len(res))
+        old_threshold = res[0].get("lockoutThreshold", idx=0)
+        self.addCleanup(modify_threshold, old_threshold)
+
+        modify_threshold(threshold)
+
+    def test_locked_out_account(self):
+        """A locked out account must not log on from the cache"""
+        self.set_lockout_threshold(3)
+
+        (challenge, nt_response) = self.cache_logon()
+
+        for i in range(3):
+            bad_challenge = os.urandom(8)
+            bad_response = self.ntlmv2_response("Wrong.Password01",
+                                                bad_challenge)
+            self.assertFalse(self.authenticate(bad_challenge,
+                                               bad_response))
+
+        res = self.samdb.search(expression=self.filter,
+                                attrs=["lockoutTime"])
+        self.assertEqual(1, len(res))
+        self.assertNotEqual(int(res[0]["lockoutTime"][0]), 0)
+
+        fresh_challenge = os.urandom(8)
+        fresh_response = self.ntlmv2_response(self.password,
+                                              fresh_challenge)
+        self.assertFalse(self.authenticate(fresh_challenge, fresh_response))
+
+        self.assertFalse(self.authenticate(challenge, nt_response))
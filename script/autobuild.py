@@ -384,6 +384,7 @@ tasks = {
             "fileserver",
             "fileserver_smb1",
             "fileserver_smb1_done",
+            "fileserver_io_uring",
             "maptoguest",
             "simpleserver",
             "backupfromdc",
@@ -454,6 +455,7 @@ tasks = {
             "fileserver",
             "fileserver_smb1",
             "fileserver_smb1_done",
+            "fileserver_io_uring",
             "maptoguest",
             "simpleserver",
             "backupfromdc",
@@ -508,6 +510,7 @@ tasks = {
             "fileserver",
             "fileserver_smb1",
             "fileserver_smb1_done",
+            "fileserver_io_uring",
             "maptoguest",
             "ktest", # ktest is also tested in samba-ktest-mit samba
                      # and samba-mitkrb5 but is tested here against
@@ -606,7 +606,7 @@ sub get_interface($)
 		localnt4dc2       => 3,
 		localnt4member3   => 4,
 		localshare4       => 5,
-		# 6 is spare
+		fileiouring       => 6,
 		localktest6       => 7,
 		maptoguest        => 8,
 		localnt4dc9       => 9,
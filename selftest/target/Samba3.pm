@@ -239,6 +239,7 @@ sub check_env($$)
 	fileserver          => [],
 	fileserver_smb1     => [],
 	fileserver_smb1_done => ["fileserver_smb1"],
+	fileserver_io_uring => [],
 	maptoguest          => [],
 	ktest               => [],
 
@@ -273,6 +274,7 @@ sub setup_nt4_dc
 	ntlm auth = yes
 	raw NTLMv2 auth = yes
 	rpc start on demand helpers = false
+	server smb3 compression algorithms = LZ77+Huffman, LZ77, Pattern_V1
 
 	CVE_2020_1472:warn_about_unused_debug_level = 3
 	server require schannel:schannel0\$ = no
@@ -1366,6 +1368,7 @@ sub setup_ad_member_idmap_rid
         map to guest = bad user
 	winbind expand groups = 10
 	server signing = required
+	winbind:ntlm cache time = 300
 ";
 
 	my $ret = $self->provision(
@@ -2276,6 +2279,23 @@ sub setup_fileserver_smb1_done
 	return $self->return_alias_env($path, $dep_env);
 }
 
+sub setup_fileserver_io_uring
+{
+	my ($self, $path) = @_;
+	my $prefix_abs = abs_path($path);
+	my $conf = "
+[global]
+	smb2 io_uring transport = yes
+	use sendfile = yes
+
+[io_uring_transport]
+	path = $prefix_abs/share
+	read only = no
+	vfs objects = acl_xattr fake_acls xattr_tdb streams_depot io_uring
+";
+	return $self->setup_fileserver($path, $conf, "FILEIOURING");
+}
+
 sub setup_ktest
 {
 	my ($self, $prefix) = @_;
@@ -2400,6 +2420,7 @@ domain logons = yes
 map to guest = bad user
 ntlm auth = yes
 server min protocol = LANMAN1
+smbd:token cache timeout = 600
 
 [force_user_error_inject]
 	path = $share_dir
@@ -3701,6 +3722,14 @@ sub provision($$)
 	copy = tmp
 	acl flag inherited canonicalization = no
 
+[compression]
+	copy = tmp
+	smb3 compression = yes
+
+[access_check_cache]
+	copy = tmp
+	access check cache = yes
+
 [full_audit_success_bad_name]
 	copy = tmp
 	full_audit:success = badname
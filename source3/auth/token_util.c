@@ -35,6 +35,9 @@
 #include "../lib/util/util_pw.h"
 #include "passdb.h"
 #include "lib/privileges.h"
+#include "lib/gencache.h"
+#include "util_tdb.h"
+#include "librpc/gen_ndr/ndr_security.h"
 
 /****************************************************************************
  Check for a SID in an struct security_token
@@ -552,6 +555,7 @@ static NTSTATUS add_local_groups(struct security_token *result,
 				 bool is_guest)
 {
 	gid_t *gids = NULL;
+	struct dom_sid *grp_sids = NULL;
 	uint32_t getgroups_num_group_sids = 0;
 	struct passwd *pass = NULL;
 	TALLOC_CTX *tmp_ctx = talloc_stackframe();
@@ -622,13 +626,22 @@ static NTSTATUS add_local_groups(struct security_token *result,
 		return NT_STATUS_UNSUCCESSFUL;
 	}
 
+	grp_sids = talloc_array(tmp_ctx, struct dom_sid,
+				getgroups_num_group_sids);
+	if (grp_sids == NULL) {
+		TALLOC_FREE(tmp_ctx);
+		return NT_STATUS_NO_MEMORY;
+	}
+	if (!gids_to_sids(gids, getgroups_num_group_sids, grp_sids)) {
+		TALLOC_FREE(tmp_ctx);
+		return NT_STATUS_NO_MEMORY;
+	}
+
 	for (i=0; i<getgroups_num_group_sids; i++) {
 		NTSTATUS status;
-		struct dom_sid grp_sid;
-		gid_to_sid(&grp_sid, gids[i]);
 
 		status = add_sid_to_array_unique(result,
-					 &grp_sid,
+					 &grp_sids[i],
 					 &result->sids,
 					 &result->num_sids);
 		if (!NT_STATUS_IS_OK(status)) {
@@ -641,8 +654,172 @@ static NTSTATUS add_local_groups(struct security_token *result,
 	return NT_STATUS_OK;
 }
 
+/*
+ * finalize_local_nt_token() looks at passdb for aliases and at the
+ * privileges database for every session setup. As all smbd processes
+ * see the same result for the same input SIDs, the outcome can be
+ * cached in gencache for a short while with
+ * "smbd:token cache timeout" (seconds, default 0 = off). The key
+ * includes the number of input SIDs and a hash over them, the cached
+ * token starts with the input SIDs, which is checked on lookup. The
+ * key also includes pdb_token_cache_generation(), so changes of
+ * aliases, group mappings and privileges through passdb make all
+ * cached tokens unreachable at once. The generation is taken before
+ * the token is built, so a token based on data changed meanwhile is
+ * stored under an outdated key. "net cache flush" drops the entries.
+ */
+
+static char *token_cache_key(TALLOC_CTX *mem_ctx,
+			     const struct security_token *token,
+			     uint32_t session_info_flags)
+{
+	struct dom_sid *sids = NULL;
+	struct dom_sid_buf buf;
+	char *generation = NULL;
+	char *key = NULL;
+	TDB_DATA data;
+	uint32_t i, hash;
+
+	generation = pdb_token_cache_generation(mem_ctx);
+	if (generation == NULL) {
+		return NULL;
+	}
+
+	sids = talloc_array(mem_ctx, struct dom_sid, token->num_sids);
+	if (sids == NULL) {
+		TALLOC_FREE(generation);
+		return NULL;
+	}
+	for (i=0; i<token->num_sids; i++) {
+		/* sid_copy() zeroes the unused sub_auths */
+		sid_copy(&sids[i], &token->sids[i]);
+	}
+	data = make_tdb_data((uint8_t *)sids,
+			     token->num_sids * sizeof(struct dom_sid));
+	hash = tdb_jenkins_hash(&data);
+	TALLOC_FREE(sids);
+
+	key = talloc_asprintf(mem_ctx,
+			      "SMBD_TOKEN/%s/%"PRIu32"/%"PRIx32"/%08"PRIx32"/%s",
+			      dom_sid_str_buf(&token->sids[0], &buf),
+			      token->num_sids,
+			      session_info_flags,
+			      hash,
+			      generation);
+	TALLOC_FREE(generation);
+	return key;
+}
+
+static bool token_cache_fetch(const char *key, struct security_token *result)
+{
+	struct security_token *cached = NULL;
+	DATA_BLOB blob = { .length = 0, };
+	enum ndr_err_code ndr_err;
+	uint32_t i;
+	bool ok;
+
+	ok = gencache_get_data_blob(key, talloc_tos(), &blob, NULL, NULL);
+	if (!ok) {
+		return false;
+	}
+
+	cached = talloc_zero(talloc_tos(), struct security_token);
+	if (cached == NULL) {
+		data_blob_free(&blob);
+		return false;
+	}
+	ndr_err = ndr_pull_struct_blob(
+		&blob, cached, cached,
+		(ndr_pull_flags_fn_t)ndr_pull_security_token);
+	data_blob_free(&blob);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		TALLOC_FREE(cached);
+		return false;
+	}
+
+	if (cached->num_sids < result->num_sids) {
+		TALLOC_FREE(cached);
+		return false;
+	}
+	for (i=0; i<result->num_sids; i++) {
+		if (!dom_sid_equal(&cached->sids[i], &result->sids[i])) {
+			DBG_DEBUG("hash collision for %s\n", key);
+			TALLOC_FREE(cached);
+			return false;
+		}
+	}
+
+	TALLOC_FREE(result->sids);
+	result->sids = talloc_move(result, &cached->sids);
+	result->num_sids = cached->num_sids;
+	result->privilege_mask = cached->privilege_mask;
+	result->rights_mask = cached->rights_mask;
+	TALLOC_FREE(cached);
+	return true;
+}
+
+static void token_cache_store(const char *key,
+			      const struct security_token *result,
+			      int timeout)
+{
+	struct security_token t = {
+		.num_sids = result->num_sids,
+		.sids = result->sids,
+		.privilege_mask = result->privilege_mask,
+		.rights_mask = result->rights_mask,
+	};
+	DATA_BLOB blob = { .length = 0, };
+	enum ndr_err_code ndr_err;
+
+	ndr_err = ndr_push_struct_blob(
+		&blob, talloc_tos(), &t,
+		(ndr_push_flags_fn_t)ndr_push_security_token);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		return;
+	}
+	gencache_set_data_blob(key, blob, time(NULL) + timeout);
+	data_blob_free(&blob);
+}
+
+static NTSTATUS finalize_local_nt_token_uncached(
+	struct security_token *result,
+	uint32_t session_info_flags);
+
 NTSTATUS finalize_local_nt_token(struct security_token *result,
 				 uint32_t session_info_flags)
+{
+	char *key = NULL;
+	int timeout;
+	NTSTATUS status;
+
+	timeout = lp_parm_int(-1, "smbd", "token cache timeout", 0);
+	if ((timeout <= 0) || (result->num_sids == 0)) {
+		return finalize_local_nt_token_uncached(result,
+							session_info_flags);
+	}
+
+	key = token_cache_key(talloc_tos(), result, session_info_flags);
+	if (key == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	if (token_cache_fetch(key, result)) {
+		DBG_DEBUG("Found %s in cache\n", key);
+		TALLOC_FREE(key);
+		return NT_STATUS_OK;
+	}
+
+	status = finalize_local_nt_token_uncached(result, session_info_flags);
+	if (NT_STATUS_IS_OK(status)) {
+		token_cache_store(key, result, timeout);
+	}
+	TALLOC_FREE(key);
+	return status;
+}
+
+static NTSTATUS finalize_local_nt_token_uncached(
+	struct security_token *result,
+	uint32_t session_info_flags)
 {
 	struct dom_sid _dom_sid = { 0, };
 	struct dom_sid *domain_sid = NULL;
@@ -1075,8 +1252,10 @@ static NTSTATUS create_token_from_sid(TALLOC_CTX *mem_ctx,
 			goto done;
 		}
 
-		for (i=0; i<num_group_sids; i++) {
-			gid_to_sid(&group_sids[i], gids[i]);
+		if (!gids_to_sids(gids, num_group_sids, group_sids)) {
+			DEBUG(1, ("gids_to_sids failed\n"));
+			result = NT_STATUS_NO_MEMORY;
+			goto done;
 		}
 
 		/* In getgroups_unix_user we always set the primary gid */
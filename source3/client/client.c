@@ -41,6 +41,7 @@
 #include "include/ntioctl.h"
 #include "../libcli/smb/smbXcli_base.h"
 #include "lib/util/time_basic.h"
+#include "../lib/util/tevent_ntstatus.h"
 #include "lib/util/string_wrappers.h"
 #include "lib/cmdline/cmdline.h"
 #include "libcli/smb/reparse.h"
@@ -61,6 +62,7 @@ static char *cmdstr = NULL;
 const char *cmd_ptr = NULL;
 
 static int io_bufsize = 0; /* we use the default size */
+static int max_transfers = 1; /* number of files mget/mput transfer in parallel */
 static int io_timeout = (CLIENT_TIMEOUT/1000); /* Per operation timeout (in seconds). */
 
 static int name_type = 0x20;
@@ -1202,6 +1204,495 @@ static int cmd_get(void)
 	return do_get(rname, lname, false);
 }
 
+/****************************************************************************
+ Parallel transfers for mget and mput.
+
+ The files are queued while walking the directories and then transferred
+ with up to max_transfers files in flight at the same time. Each transfer
+ uses the pipelined cli_pull/cli_push, so all of them share the credits
+ of the connection.
+****************************************************************************/
+
+struct client_transfer {
+	struct client_transfer *prev, *next;
+	bool put;
+	struct cli_state *cli;
+	char *rname;
+	char *targetname;
+	char *lname;
+};
+
+static TALLOC_CTX *transfer_mem_ctx;
+static struct client_transfer *transfer_queue;
+
+static bool client_transfers_enabled(void)
+{
+	if (max_transfers <= 1) {
+		return false;
+	}
+	if (archive_level >= 2) {
+		/*
+		 * Changing the archive bit needs a sync call
+		 */
+		return false;
+	}
+	if (smbXcli_conn_protocol(cli->conn) < PROTOCOL_NT1) {
+		return false;
+	}
+	return true;
+}
+
+static int client_transfer_queue(bool put, const char *rname,
+				 const char *lname)
+{
+	struct cli_credentials *creds = samba_cmdline_get_creds();
+	struct client_transfer *t = NULL;
+	struct cli_state *targetcli = NULL;
+	char *targetname = NULL;
+	NTSTATUS status;
+
+	if (transfer_mem_ctx == NULL) {
+		transfer_mem_ctx = talloc_new(NULL);
+		if (transfer_mem_ctx == NULL) {
+			return 1;
+		}
+	}
+
+	t = talloc_zero(transfer_mem_ctx, struct client_transfer);
+	if (t == NULL) {
+		return 1;
+	}
+	t->put = put;
+
+	t->rname = talloc_strdup(t, rname);
+	t->lname = talloc_strdup(t, lname);
+	if ((t->rname == NULL) || (t->lname == NULL)) {
+		TALLOC_FREE(t);
+		return 1;
+	}
+
+	if (!put && lowercase) {
+		if (!strlower_m(t->lname)) {
+			d_printf("strlower_m %s failed\n", t->lname);
+			TALLOC_FREE(t);
+			return 1;
+		}
+	}
+
+	status = cli_resolve_path(t, "", creds, cli, rname,
+				  &targetcli, &targetname);
+	if (!NT_STATUS_IS_OK(status)) {
+		d_printf("Failed to open %s: %s\n", rname, nt_errstr(status));
+		TALLOC_FREE(t);
+		return 1;
+	}
+	t->cli = targetcli;
+	t->targetname = targetname;
+
+	DLIST_ADD_END(transfer_queue, t);
+	return 0;
+}
+
+struct client_transfer_state {
+	struct tevent_context *ev;
+	struct client_transfer *t;
+	int fd;
+	struct push_state push;
+	uint16_t fnum;
+	off_t size;
+	off_t nread;
+	NTSTATUS status;
+	struct timespec tp_start;
+	struct timespec tp_opened;
+};
+
+static int client_transfer_state_destructor(struct client_transfer_state *state)
+{
+	if (state->fd != -1) {
+		close(state->fd);
+		state->fd = -1;
+	}
+	if (state->push.f != NULL) {
+		fclose(state->push.f);
+		state->push.f = NULL;
+	}
+	return 0;
+}
+
+static void client_transfer_opened(struct tevent_req *subreq);
+static void client_transfer_transferred(struct tevent_req *subreq);
+static void client_transfer_closed(struct tevent_req *subreq);
+
+static struct tevent_req *client_transfer_send(TALLOC_CTX *mem_ctx,
+					       struct tevent_context *ev,
+					       struct client_transfer *t)
+{
+	struct tevent_req *req = NULL, *subreq = NULL;
+	struct client_transfer_state *state = NULL;
+	uint32_t access_mask;
+	uint32_t create_disposition;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct client_transfer_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->ev = ev;
+	state->t = t;
+	state->fd = -1;
+	talloc_set_destructor(state, client_transfer_state_destructor);
+
+	clock_gettime_mono(&state->tp_start);
+
+	if (t->put) {
+		state->push.f = fopen(t->lname, "r");
+		if (state->push.f == NULL) {
+			tevent_req_nterror(req, map_nt_error_from_unix(errno));
+			return tevent_req_post(req, ev);
+		}
+		access_mask = FILE_GENERIC_READ|FILE_GENERIC_WRITE;
+		create_disposition = FILE_OVERWRITE_IF;
+	} else {
+		state->fd = open(t->lname, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+		if (state->fd == -1) {
+			tevent_req_nterror(req, map_nt_error_from_unix(errno));
+			return tevent_req_post(req, ev);
+		}
+		access_mask = FILE_GENERIC_READ;
+		create_disposition = FILE_OPEN;
+	}
+
+	subreq = cli_ntcreate_send(state,
+				   ev,
+				   t->cli,
+				   t->targetname,
+				   0,
+				   access_mask,
+				   0,
+				   FILE_SHARE_READ|FILE_SHARE_WRITE,
+				   create_disposition,
+				   0,
+				   SMB2_IMPERSONATION_IMPERSONATION,
+				   0);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, client_transfer_opened, req);
+	return req;
+}
+
+static void client_transfer_opened(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct client_transfer_state *state = tevent_req_data(
+		req, struct client_transfer_state);
+	struct smb_create_returns cr = {0};
+	NTSTATUS status;
+
+	status = cli_ntcreate_recv(subreq, &state->fnum, &cr);
+	TALLOC_FREE(subreq);
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+
+	clock_gettime_mono(&state->tp_opened);
+
+	if (state->t->put) {
+		setvbuf(state->push.f, NULL, _IOFBF, io_bufsize);
+		subreq = cli_push_send(state,
+				       state->ev,
+				       state->t->cli,
+				       state->fnum,
+				       0,
+				       0,
+				       io_bufsize,
+				       push_source,
+				       &state->push);
+	} else {
+		state->size = cr.end_of_file;
+		subreq = cli_pull_send(state,
+				       state->ev,
+				       state->t->cli,
+				       state->fnum,
+				       0,
+				       state->size,
+				       io_bufsize,
+				       writefile_sink,
+				       &state->fd);
+	}
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, client_transfer_transferred, req);
+}
+
+static void client_transfer_transferred(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct client_transfer_state *state = tevent_req_data(
+		req, struct client_transfer_state);
+
+	if (state->t->put) {
+		state->status = cli_push_recv(subreq);
+		state->nread = state->push.nread;
+	} else {
+		state->status = cli_pull_recv(subreq, &state->nread);
+	}
+	TALLOC_FREE(subreq);
+
+	/*
+	 * Close the file even if the transfer failed,
+	 * state->status is reported afterwards.
+	 */
+	subreq = cli_close_send(state,
+				state->ev,
+				state->t->cli,
+				state->fnum,
+				0);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, client_transfer_closed, req);
+}
+
+static void client_transfer_closed(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct client_transfer_state *state = tevent_req_data(
+		req, struct client_transfer_state);
+	NTSTATUS status;
+
+	status = cli_close_recv(subreq);
+	TALLOC_FREE(subreq);
+	if (tevent_req_nterror(req, state->status)) {
+		return;
+	}
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+	tevent_req_done(req);
+}
+
+static NTSTATUS client_transfer_recv(struct tevent_req *req,
+				     struct client_transfer **pt,
+				     off_t *nread,
+				     unsigned int *open_ms,
+				     unsigned int *total_ms)
+{
+	struct client_transfer_state *state = tevent_req_data(
+		req, struct client_transfer_state);
+	struct timespec tp_end;
+	NTSTATUS status;
+
+	*pt = state->t;
+
+	if (tevent_req_is_nterror(req, &status)) {
+		tevent_req_received(req);
+		return status;
+	}
+
+	clock_gettime_mono(&tp_end);
+
+	*nread = state->nread;
+	*open_ms = nsec_time_diff(&state->tp_opened, &state->tp_start) /
+		   1000000;
+	*total_ms = nsec_time_diff(&tp_end, &state->tp_start) / 1000000;
+
+	tevent_req_received(req);
+	return NT_STATUS_OK;
+}
+
+struct client_transfers_state {
+	struct tevent_context *ev;
+	int max_transfers;
+	int num_active;
+	unsigned int num_done;
+	unsigned int num_failed;
+	uint64_t total_size;
+};
+
+static void client_transfers_next(struct tevent_req *req);
+static void client_transfers_done(struct tevent_req *subreq);
+
+static struct tevent_req *client_transfers_send(TALLOC_CTX *mem_ctx,
+						struct tevent_context *ev,
+						int max_active)
+{
+	struct tevent_req *req = NULL;
+	struct client_transfers_state *state = NULL;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct client_transfers_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->ev = ev;
+	state->max_transfers = max_active;
+
+	client_transfers_next(req);
+	if (!tevent_req_is_in_progress(req)) {
+		return tevent_req_post(req, ev);
+	}
+	return req;
+}
+
+static void client_transfers_next(struct tevent_req *req)
+{
+	struct client_transfers_state *state = tevent_req_data(
+		req, struct client_transfers_state);
+
+	while ((transfer_queue != NULL) &&
+	       (state->num_active < state->max_transfers)) {
+		struct client_transfer *t = transfer_queue;
+		struct tevent_req *subreq = NULL;
+
+		DLIST_REMOVE(transfer_queue, t);
+
+		subreq = client_transfer_send(state, state->ev, t);
+		if (tevent_req_nomem(subreq, req)) {
+			return;
+		}
+		tevent_req_set_callback(subreq, client_transfers_done, req);
+		talloc_steal(subreq, t);
+		state->num_active++;
+	}
+
+	if (state->num_active == 0) {
+		tevent_req_done(req);
+	}
+}
+
+static void client_transfers_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct client_transfers_state *state = tevent_req_data(
+		req, struct client_transfers_state);
+	struct client_transfer *t = NULL;
+	off_t nread = 0;
+	unsigned int open_ms = 0;
+	unsigned int total_ms = 0;
+	NTSTATUS status;
+
+	status = client_transfer_recv(subreq, &t, &nread, &open_ms, &total_ms);
+	state->num_active--;
+
+	if (!NT_STATUS_IS_OK(status)) {
+		d_printf("%s %s %s: %s\n",
+			 t->put ? "Error putting" : "Error getting",
+			 t->put ? t->lname : t->rname,
+			 t->put ? "to server" : "from server",
+			 nt_errstr(status));
+		state->num_failed++;
+	} else {
+		if (t->put) {
+			put_total_time_ms += total_ms;
+			put_total_size += nread;
+		} else {
+			get_total_time_ms += total_ms;
+			get_total_size += nread;
+		}
+		state->num_done++;
+		state->total_size += nread;
+
+		DEBUG(1,("%s file %s as %s: %.0f bytes in %u ms "
+			 "(%3.1f KiloBytes/sec) (open latency %u ms)\n",
+			 t->put ? "put" : "got",
+			 t->put ? t->lname : t->rname,
+			 t->put ? t->rname : t->lname,
+			 (double)nread,
+			 total_ms,
+			 nread / (1.024*total_ms + 1.0e-4),
+			 open_ms));
+	}
+	TALLOC_FREE(subreq);
+
+	client_transfers_next(req);
+}
+
+static NTSTATUS client_transfers_recv(struct tevent_req *req,
+				      unsigned int *num_done,
+				      unsigned int *num_failed,
+				      uint64_t *total_size)
+{
+	struct client_transfers_state *state = tevent_req_data(
+		req, struct client_transfers_state);
+	NTSTATUS status;
+
+	*num_done = state->num_done;
+	*num_failed = state->num_failed;
+	*total_size = state->total_size;
+
+	if (tevent_req_is_nterror(req, &status)) {
+		tevent_req_received(req);
+		return status;
+	}
+	tevent_req_received(req);
+	return NT_STATUS_OK;
+}
+
+/****************************************************************************
+ Run all queued transfers and print a summary.
+****************************************************************************/
+
+static int client_run_transfers(void)
+{
+	TALLOC_CTX *frame = NULL;
+	struct tevent_context *ev = NULL;
+	struct tevent_req *req = NULL;
+	struct timespec tp_start, tp_end;
+	unsigned int num_done = 0;
+	unsigned int num_failed = 0;
+	uint64_t total_size = 0;
+	unsigned int this_time;
+	NTSTATUS status = NT_STATUS_OK;
+
+	if (transfer_queue == NULL) {
+		TALLOC_FREE(transfer_mem_ctx);
+		return 0;
+	}
+
+	frame = talloc_stackframe();
+
+	ev = samba_tevent_context_init(frame);
+	if (ev == NULL) {
+		status = NT_STATUS_NO_MEMORY;
+		goto fail;
+	}
+
+	clock_gettime_mono(&tp_start);
+
+	req = client_transfers_send(frame, ev, max_transfers);
+	if (req == NULL) {
+		status = NT_STATUS_NO_MEMORY;
+		goto fail;
+	}
+	if (!tevent_req_poll_ntstatus(req, ev, &status)) {
+		goto fail;
+	}
+	status = client_transfers_recv(req, &num_done, &num_failed,
+				       &total_size);
+
+	clock_gettime_mono(&tp_end);
+	this_time = nsec_time_diff(&tp_end, &tp_start) / 1000000;
+
+	DEBUG(1,("%u files transferred, %u failed, %.0f bytes in %u ms "
+		 "(%3.1f KiloBytes/sec)\n",
+		 num_done, num_failed, (double)total_size, this_time,
+		 total_size / (1.024*this_time + 1.0e-4)));
+fail:
+	if (!NT_STATUS_IS_OK(status)) {
+		d_printf("parallel transfer failed: %s\n", nt_errstr(status));
+	}
+	TALLOC_FREE(frame);
+	transfer_queue = NULL;
+	TALLOC_FREE(transfer_mem_ctx);
+	return (NT_STATUS_IS_OK(status) && num_failed == 0) ? 0 : 1;
+}
+
 /****************************************************************************
  Do an mget operation on one file.
 ****************************************************************************/
@@ -1276,6 +1767,8 @@ static NTSTATUS do_mget(struct cli_state *cli_state, struct file_info *finfo,
 		if ((ret == -1) && (errno != EEXIST)) {
 			return map_nt_error_from_unix(errno);
 		}
+	} else if (client_transfers_enabled()) {
+		client_transfer_queue(false, path, local_path);
 	} else {
 		do_get(path, local_path, false);
 	}
@@ -1387,6 +1880,7 @@ static int cmd_mget(void)
 			return 1;
 		}
 		status = do_list(mget_mask, attribute, do_mget, recurse, true);
+		client_run_transfers();
 		if (!NT_STATUS_IS_OK(status)) {
 			return 1;
 		}
@@ -1409,6 +1903,7 @@ static int cmd_mget(void)
 			return 1;
 		}
 		status = do_list(mget_mask, attribute, do_mget, recurse, true);
+		client_run_transfers();
 		if (!NT_STATUS_IS_OK(status)) {
 			return 1;
 		}
@@ -2267,8 +2762,13 @@ static int cmd_mput(void)
 					break;
 				}
 			}
-			do_put(rname, lname, false);
+			if (client_transfers_enabled()) {
+				client_transfer_queue(true, rname, lname);
+			} else {
+				do_put(rname, lname, false);
+			}
 		}
+		client_run_transfers();
 		free_file_list(file_list);
 		SAFE_FREE(quest);
 		SAFE_FREE(lname);
@@ -5583,6 +6083,40 @@ static int cmd_timeout(void)
 }
 
 
+int client_get_max_transfers(void)
+{
+	return max_transfers;
+}
+
+/****************************************************************************
+ parallel command
+***************************************************************************/
+
+static int cmd_parallel(void)
+{
+	TALLOC_CTX *ctx = talloc_tos();
+	char *buf;
+	int num;
+
+	if (!next_token_talloc(ctx, &cmd_ptr,&buf,NULL)) {
+		d_printf("parallel <n> (number of files mget, mput and tar "
+			"transfer at the same time - currently %d).\n",
+			max_transfers);
+		return 1;
+	}
+
+	num = strtol(buf,NULL,0);
+	if (num < 1 || num > 64) {
+		d_printf("parallel out of range (min = 1 (default), "
+			"max = 64)\n");
+		return 1;
+	}
+
+	max_transfers = num;
+	d_printf("parallel transfers is now %d\n", max_transfers);
+	return 0;
+}
+
 /****************************************************************************
 history
 ****************************************************************************/
@@ -5664,6 +6198,7 @@ static struct {
   {"newer",cmd_newer,"<file> only mget files newer than the specified local file",{COMPL_LOCAL,COMPL_NONE}},
   {"notify",cmd_notify,"<file>Get notified of dir changes",{COMPL_REMOTE,COMPL_NONE}},
   {"open",cmd_open,"<mask> open a file",{COMPL_REMOTE,COMPL_NONE}},
+  {"parallel",cmd_parallel,"<number> files mget, mput and tar transfer at the same time (default 1)",{COMPL_NONE,COMPL_NONE}},
   {"posix", cmd_posix, "turn on all POSIX capabilities", {COMPL_REMOTE,COMPL_NONE}},
   {"posix_encrypt",cmd_posix_encrypt,"<domain> <user> <password> start up transport encryption",{COMPL_REMOTE,COMPL_NONE}},
   {"posix_open",cmd_posix_open,"<name> 0<mode> open_flags mode open a file using POSIX interface",{COMPL_REMOTE,COMPL_NONE}},
@@ -44,6 +44,7 @@ NTSTATUS do_list(const char *mask,
 			bool dirs);
 int set_remote_attr(const char *filename, uint32_t new_attr, int mode);
 int cmd_iosize(void);
+int client_get_max_transfers(void);
 
 /* The following definitions come from client/dnsbrowse.c  */
 
@@ -58,6 +58,12 @@
  * not skipped it's downloaded and written to the archive in
  * tar_get_file().
  *
+ * If the "parallel" command set more than one transfer, the callback
+ * only queues the files with tar_queue_file(). Once the listing is
+ * finished tar_process_queue() reads several small files ahead into
+ * memory while the archive is written in listing order. Larger files
+ * are streamed into the archive when they are next.
+ *
  * ## Archive extraction
  *
  * tar_extract() opens the archive and iterates on each file in
@@ -73,6 +79,8 @@
 #include "source3/include/client.h"
 #include "source3/libsmb/proto.h"
 #include "lib/util/util_file.h"
+#include "lib/util/tevent_ntstatus.h"
+#include "libcli/security/security.h"
 
 #ifdef HAVE_LIBARCHIVE
 
@@ -106,6 +114,11 @@
  */
 #define TAR_CLI_READ_SIZE 0xff00
 
+/**
+ * Files up to this size are read ahead into memory in parallel mode
+ */
+#define TAR_READAHEAD_MAX_SIZE (1024 * 1024)
+
 #define TAR_DO_LIST_ATTR (FILE_ATTRIBUTE_DIRECTORY \
 			  | FILE_ATTRIBUTE_SYSTEM  \
 			  | FILE_ATTRIBUTE_HIDDEN)
@@ -159,6 +172,35 @@ struct tar {
 	/* counters */
 	uint64_t numdir;
 	uint64_t numfile;
+
+	/* files queued in parallel mode, see tar_queue_file() */
+	struct tar_file *queue;
+	int queue_active;
+};
+
+/**
+ * A file queued for the archive in parallel mode
+ */
+struct tar_file {
+	struct tar_file *prev, *next;
+	struct tar *t;
+
+	char *dos_path;
+	struct archive_entry *entry;
+	bool isdir;
+	uint64_t size;
+
+	/* the running tar_fetch request */
+	struct tevent_req *req;
+	bool stream;
+	bool done;
+	bool opened;
+	bool fatal;
+	NTSTATUS status;
+
+	/* the content if the file was read ahead */
+	uint8_t *buf;
+	size_t buflen;
 };
 
 /**
@@ -204,6 +246,14 @@ static NTSTATUS tar_path_in_list(struct tar *t, const char *path,
 static int tar_get_file(struct tar *t,
 			const char *full_dos_path,
 			struct file_info *finfo);
+static int tar_create_entry(TALLOC_CTX *mem_ctx,
+			    const char *full_dos_path,
+			    struct file_info *finfo,
+			    struct archive_entry **_entry);
+static int tar_queue_file(struct tar *t,
+			  const char *full_dos_path,
+			  struct file_info *finfo);
+static int tar_process_queue(struct tar *t);
 
 static NTSTATUS get_file_callback(struct cli_state *cli,
 				  struct file_info *finfo,
@@ -721,6 +771,11 @@ static int tar_create(struct tar* t)
 		}
 	}
 
+	if (tar_process_queue(t)) {
+		err = 1;
+		goto out_close;
+	}
+
 	clock_gettime_mono(&tp_end);
 	d_printf("tar: dumped %"PRIu64" files and %"PRIu64" directories\n",
 	         t->numfile, t->numdir);
@@ -886,7 +941,11 @@ static NTSTATUS get_file_callback(struct cli_state *cli,
 		goto out;
 	}
 
-	rc = tar_get_file(&tar_ctx, remote_name, finfo);
+	if (client_get_max_transfers() > 1 && !tar_ctx.mode.dry) {
+		rc = tar_queue_file(&tar_ctx, remote_name, finfo);
+	} else {
+		rc = tar_get_file(&tar_ctx, remote_name, finfo);
+	}
 	if (rc != 0) {
 		status = NT_STATUS_UNSUCCESSFUL;
 		goto out;
@@ -908,8 +967,7 @@ static int tar_get_file(struct tar *t,
 {
 	extern struct cli_state *cli;
 	NTSTATUS status;
-	struct archive_entry *entry;
-	char *full_unix_path;
+	struct archive_entry *entry = NULL;
 	char buf[TAR_CLI_READ_SIZE];
 	size_t len;
 	uint64_t off = 0;
@@ -935,35 +993,10 @@ static int tar_get_file(struct tar *t,
 		set_remote_attr(full_dos_path, FILE_ATTRIBUTE_ARCHIVE, ATTR_UNSET);
 	}
 
-	full_unix_path = talloc_asprintf(ctx, ".%s", full_dos_path);
-	if (full_unix_path == NULL) {
-		err = 1;
+	err = tar_create_entry(ctx, full_dos_path, finfo, &entry);
+	if (err != 0 || entry == NULL) {
 		goto out;
 	}
-	string_replace(full_unix_path, '\\', '/');
-	entry = archive_entry_new();
-	archive_entry_copy_pathname(entry, full_unix_path);
-	archive_entry_set_filetype(entry, isdir ? AE_IFDIR : AE_IFREG);
-	archive_entry_set_atime(entry,
-			finfo->atime_ts.tv_sec,
-			finfo->atime_ts.tv_nsec);
-	archive_entry_set_mtime(entry,
-			finfo->mtime_ts.tv_sec,
-			finfo->mtime_ts.tv_nsec);
-	archive_entry_set_ctime(entry,
-			finfo->ctime_ts.tv_sec,
-			finfo->ctime_ts.tv_nsec);
-	archive_entry_set_perm(entry, isdir ? 0755 : 0644);
-	/*
-	 * check if we can safely cast unsigned file size to libarchive
-	 * signed size. Very unlikely problem (>9 exabyte file)
-	 */
-	if (finfo->size > INT64_MAX) {
-		d_printf("Remote file %s too big\n", full_dos_path);
-		goto out_entry;
-	}
-
-	archive_entry_set_size(entry, (int64_t)finfo->size);
 
 	if (isdir) {
 		/* It's a directory just write a header */
@@ -1030,6 +1063,512 @@ out:
 	return err;
 }
 
+/**
+ * tar_create_entry - create the archive entry for a remote file
+ * @full_dos_path: path to the file
+ * @finfo: attributes of the file
+ *
+ * *_entry is NULL if the file needs to be skipped.
+ */
+static int tar_create_entry(TALLOC_CTX *mem_ctx,
+			    const char *full_dos_path,
+			    struct file_info *finfo,
+			    struct archive_entry **_entry)
+{
+	struct archive_entry *entry;
+	char *full_unix_path;
+	const bool isdir = finfo->attr & FILE_ATTRIBUTE_DIRECTORY;
+
+	*_entry = NULL;
+
+	full_unix_path = talloc_asprintf(mem_ctx, ".%s", full_dos_path);
+	if (full_unix_path == NULL) {
+		return 1;
+	}
+	string_replace(full_unix_path, '\\', '/');
+
+	/*
+	 * check if we can safely cast unsigned file size to libarchive
+	 * signed size. Very unlikely problem (>9 exabyte file)
+	 */
+	if (finfo->size > INT64_MAX) {
+		d_printf("Remote file %s too big\n", full_dos_path);
+		TALLOC_FREE(full_unix_path);
+		return 0;
+	}
+
+	entry = archive_entry_new();
+	if (entry == NULL) {
+		TALLOC_FREE(full_unix_path);
+		return 1;
+	}
+	archive_entry_copy_pathname(entry, full_unix_path);
+	archive_entry_set_filetype(entry, isdir ? AE_IFDIR : AE_IFREG);
+	archive_entry_set_atime(entry,
+			finfo->atime_ts.tv_sec,
+			finfo->atime_ts.tv_nsec);
+	archive_entry_set_mtime(entry,
+			finfo->mtime_ts.tv_sec,
+			finfo->mtime_ts.tv_nsec);
+	archive_entry_set_ctime(entry,
+			finfo->ctime_ts.tv_sec,
+			finfo->ctime_ts.tv_nsec);
+	archive_entry_set_perm(entry, isdir ? 0755 : 0644);
+	archive_entry_set_size(entry, (int64_t)finfo->size);
+
+	TALLOC_FREE(full_unix_path);
+	*_entry = entry;
+	return 0;
+}
+
+static int tar_file_destructor(struct tar_file *f)
+{
+	if (f->entry != NULL) {
+		archive_entry_free(f->entry);
+		f->entry = NULL;
+	}
+	return 0;
+}
+
+/**
+ * tar_queue_file - queue a remote file for the archive
+ * @full_dos_path: path to the file to fetch
+ * @finfo: attributes of the file to fetch
+ *
+ * This is the parallel mode variant of tar_get_file(), the file is
+ * fetched later by tar_process_queue().
+ */
+static int tar_queue_file(struct tar *t,
+			  const char *full_dos_path,
+			  struct file_info *finfo)
+{
+	struct tar_file *f = NULL;
+	int err;
+
+	DBG(5, ("+++ %s\n", full_dos_path));
+
+	t->total_size += finfo->size;
+
+	if (t->mode.reset) {
+		/* ignore return value: server might not store DOS attributes */
+		set_remote_attr(full_dos_path, FILE_ATTRIBUTE_ARCHIVE, ATTR_UNSET);
+	}
+
+	f = talloc_zero(t->talloc_ctx, struct tar_file);
+	if (f == NULL) {
+		return 1;
+	}
+	talloc_set_destructor(f, tar_file_destructor);
+	f->t = t;
+	f->isdir = finfo->attr & FILE_ATTRIBUTE_DIRECTORY;
+	f->size = finfo->size;
+
+	f->dos_path = talloc_strdup(f, full_dos_path);
+	if (f->dos_path == NULL) {
+		TALLOC_FREE(f);
+		return 1;
+	}
+
+	err = tar_create_entry(f, full_dos_path, finfo, &f->entry);
+	if (err != 0 || f->entry == NULL) {
+		TALLOC_FREE(f);
+		return err;
+	}
+
+	DLIST_ADD_END(t->queue, f);
+	return 0;
+}
+
+/*
+ * tar_fetch - open and read a queued file
+ *
+ * If f->stream is set the archive header is written once the file is
+ * open and the content goes straight into the archive. Otherwise the
+ * content is read into f->buf.
+ */
+struct tar_fetch_state {
+	struct tevent_context *ev;
+	struct tar_file *f;
+	uint16_t fnum;
+	NTSTATUS pull_status;
+};
+
+static NTSTATUS tar_fetch_buffer_sink(char *buf, size_t n, void *priv)
+{
+	struct tar_file *f = talloc_get_type_abort(priv, struct tar_file);
+
+	if (n > f->size - f->buflen) {
+		/* the file grew since the listing */
+		n = f->size - f->buflen;
+	}
+	memcpy(f->buf + f->buflen, buf, n);
+	f->buflen += n;
+	return NT_STATUS_OK;
+}
+
+static NTSTATUS tar_fetch_stream_sink(char *buf, size_t n, void *priv)
+{
+	struct tar_file *f = talloc_get_type_abort(priv, struct tar_file);
+	ssize_t r;
+
+	r = archive_write_data(f->t->archive, buf, n);
+	if (r < 0) {
+		d_printf("Fatal: %s\n", archive_error_string(f->t->archive));
+		f->fatal = true;
+		return NT_STATUS_UNSUCCESSFUL;
+	}
+	return NT_STATUS_OK;
+}
+
+static void tar_fetch_opened(struct tevent_req *subreq);
+static void tar_fetch_pulled(struct tevent_req *subreq);
+static void tar_fetch_closed(struct tevent_req *subreq);
+
+static struct tevent_req *tar_fetch_send(TALLOC_CTX *mem_ctx,
+					 struct tevent_context *ev,
+					 struct tar_file *f)
+{
+	extern struct cli_state *cli;
+	struct tevent_req *req = NULL, *subreq = NULL;
+	struct tar_fetch_state *state = NULL;
+
+	req = tevent_req_create(mem_ctx, &state, struct tar_fetch_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->ev = ev;
+	state->f = f;
+
+	subreq = cli_ntcreate_send(state,
+				   ev,
+				   cli,
+				   f->dos_path,
+				   0,
+				   FILE_GENERIC_READ,
+				   0,
+				   FILE_SHARE_READ|FILE_SHARE_WRITE,
+				   FILE_OPEN,
+				   0,
+				   SMB2_IMPERSONATION_IMPERSONATION,
+				   0);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, tar_fetch_opened, req);
+	return req;
+}
+
+static void tar_fetch_opened(struct tevent_req *subreq)
+{
+	extern struct cli_state *cli;
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct tar_fetch_state *state = tevent_req_data(
+		req, struct tar_fetch_state);
+	struct tar_file *f = state->f;
+	NTSTATUS (*sink)(char *buf, size_t n, void *priv);
+	NTSTATUS status;
+
+	status = cli_ntcreate_recv(subreq, &state->fnum, NULL);
+	TALLOC_FREE(subreq);
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+	f->opened = true;
+
+	if (f->stream) {
+		int r;
+
+		/* don't make tar file entry until after the file is open */
+		r = archive_write_header(f->t->archive, f->entry);
+		if (r != ARCHIVE_OK) {
+			d_printf("Fatal: %s\n",
+				 archive_error_string(f->t->archive));
+			f->fatal = true;
+			state->pull_status = NT_STATUS_UNSUCCESSFUL;
+			goto close;
+		}
+		if (f->t->mode.verbose) {
+			d_printf("a %s\n", f->dos_path);
+		}
+		sink = tar_fetch_stream_sink;
+	} else {
+		if (f->size > 0) {
+			f->buf = talloc_array(f, uint8_t, f->size);
+			if (tevent_req_nomem(f->buf, req)) {
+				return;
+			}
+		}
+		sink = tar_fetch_buffer_sink;
+	}
+
+	subreq = cli_pull_send(state,
+			       state->ev,
+			       cli,
+			       state->fnum,
+			       0,
+			       f->size,
+			       0,
+			       sink,
+			       f);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, tar_fetch_pulled, req);
+	return;
+
+close:
+	subreq = cli_close_send(state, state->ev, cli, state->fnum, 0);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, tar_fetch_closed, req);
+}
+
+static void tar_fetch_pulled(struct tevent_req *subreq)
+{
+	extern struct cli_state *cli;
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct tar_fetch_state *state = tevent_req_data(
+		req, struct tar_fetch_state);
+
+	state->pull_status = cli_pull_recv(subreq, NULL);
+	TALLOC_FREE(subreq);
+
+	subreq = cli_close_send(state, state->ev, cli, state->fnum, 0);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, tar_fetch_closed, req);
+}
+
+static void tar_fetch_closed(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct tar_fetch_state *state = tevent_req_data(
+		req, struct tar_fetch_state);
+
+	/* like tar_get_file() we ignore errors from the close */
+	cli_close_recv(subreq);
+	TALLOC_FREE(subreq);
+
+	if (tevent_req_nterror(req, state->pull_status)) {
+		return;
+	}
+	tevent_req_done(req);
+}
+
+static NTSTATUS tar_fetch_recv(struct tevent_req *req)
+{
+	return tevent_req_simple_recv_ntstatus(req);
+}
+
+static void tar_file_fetched(struct tevent_req *req)
+{
+	struct tar_file *f = tevent_req_callback_data(req, struct tar_file);
+
+	f->status = tar_fetch_recv(req);
+	f->done = true;
+	TALLOC_FREE(f->req);
+	f->t->queue_active--;
+}
+
+static bool tar_file_start(struct tar_file *f,
+			   struct tevent_context *ev,
+			   bool stream)
+{
+	f->stream = stream;
+	f->req = tar_fetch_send(f, ev, f);
+	if (f->req == NULL) {
+		return false;
+	}
+	tevent_req_set_callback(f->req, tar_file_fetched, f);
+	f->t->queue_active++;
+	return true;
+}
+
+/**
+ * tar_readahead - start reading the next small files
+ *
+ * Only the next max_active files are considered, so that the
+ * memory used for read ahead data stays bounded.
+ */
+static bool tar_readahead(struct tar *t,
+			  struct tevent_context *ev,
+			  int max_active)
+{
+	struct tar_file *f = NULL;
+	int i = 0;
+
+	for (f = t->queue; f != NULL; f = f->next) {
+		if (i++ >= max_active) {
+			break;
+		}
+		if (t->queue_active >= max_active) {
+			break;
+		}
+		if (f->isdir || f->req != NULL || f->done) {
+			continue;
+		}
+		if (f->size > TAR_READAHEAD_MAX_SIZE) {
+			continue;
+		}
+		if (!tar_file_start(f, ev, false)) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/**
+ * tar_write_file - write the next queued file to the archive
+ */
+static int tar_write_file(struct tar *t, struct tar_file *f)
+{
+	int r;
+
+	if (f->isdir) {
+		/* It's a directory just write a header */
+		r = archive_write_header(t->archive, f->entry);
+		if (r != ARCHIVE_OK) {
+			d_printf("Fatal: %s\n", archive_error_string(t->archive));
+			return 1;
+		}
+		if (t->mode.verbose) {
+			d_printf("a %s\\\n", f->dos_path);
+		}
+		DBG(5, ("get_file skip dir %s\n", f->dos_path));
+		return 0;
+	}
+
+	if (f->fatal) {
+		return 1;
+	}
+
+	if (!f->opened) {
+		d_printf("%s opening remote file %s\n",
+			 nt_errstr(f->status), f->dos_path);
+		return 0;
+	}
+
+	if (!NT_STATUS_IS_OK(f->status)) {
+		d_printf("Error reading file %s : %s\n",
+			 f->dos_path, nt_errstr(f->status));
+		return 1;
+	}
+
+	if (!f->stream) {
+		r = archive_write_header(t->archive, f->entry);
+		if (r != ARCHIVE_OK) {
+			d_printf("Fatal: %s\n", archive_error_string(t->archive));
+			return 1;
+		}
+
+		if (t->mode.verbose) {
+			d_printf("a %s\n", f->dos_path);
+		}
+
+		if (f->buflen > 0) {
+			r = archive_write_data(t->archive, f->buf, f->buflen);
+			if (r < 0) {
+				d_printf("Fatal: %s\n",
+					 archive_error_string(t->archive));
+				return 1;
+			}
+		}
+	}
+
+	t->numfile++;
+	return 0;
+}
+
+/**
+ * tar_process_queue - fetch the queued files into the archive
+ *
+ * The files are written in the order they were queued. While the
+ * next file is fetched, up to "parallel" small files behind it are
+ * read ahead into memory.
+ */
+static int tar_process_queue(struct tar *t)
+{
+	int max_active = client_get_max_transfers();
+	struct tevent_context *ev = NULL;
+	struct tar_file *f = NULL;
+	int err = 0;
+	TALLOC_CTX *ctx = NULL;
+
+	if (t->queue == NULL) {
+		return 0;
+	}
+
+	ctx = talloc_new(NULL);
+	if (ctx == NULL) {
+		return 1;
+	}
+
+	ev = samba_tevent_context_init(ctx);
+	if (ev == NULL) {
+		err = 1;
+		goto out;
+	}
+
+	while ((f = t->queue) != NULL) {
+		if (!tar_readahead(t, ev, max_active)) {
+			err = 1;
+			break;
+		}
+
+		if (!f->isdir && f->req == NULL && !f->done) {
+			bool stream = (f->size > TAR_READAHEAD_MAX_SIZE);
+
+			if (!tar_file_start(f, ev, stream)) {
+				err = 1;
+				break;
+			}
+		}
+
+		while (!f->isdir && !f->done) {
+			if (tevent_loop_once(ev) != 0) {
+				d_printf("tevent_loop_once failed: %s\n",
+					 strerror(errno));
+				err = 1;
+				goto out;
+			}
+		}
+
+		err = tar_write_file(t, f);
+
+		DLIST_REMOVE(t->queue, f);
+		TALLOC_FREE(f);
+
+		if (err != 0) {
+			break;
+		}
+	}
+
+	/*
+	 * Let the read ahead requests still in flight finish,
+	 * so that the connection stays usable.
+	 */
+	while (t->queue_active > 0) {
+		if (tevent_loop_once(ev) != 0) {
+			err = 1;
+			break;
+		}
+	}
+
+out:
+	while ((f = t->queue) != NULL) {
+		DLIST_REMOVE(t->queue, f);
+		TALLOC_FREE(f);
+	}
+	t->queue_active = 0;
+	TALLOC_FREE(ctx);
+	return err;
+}
+
 /**
  * tar_extract - open archive and send files.
  */
@@ -1707,6 +2246,8 @@ static void tar_free_mem_context(struct tar *t)
 		t->path_list_size = 0;
 		t->path_list = NULL;
 		t->tar_path = NULL;
+		t->queue = NULL;
+		t->queue_active = 0;
 	}
 }
 
@@ -134,4 +134,7 @@ NTSTATUS g_lock_watch_data_recv(
 	struct server_id *blocker);
 void g_lock_wake_watchers(struct g_lock_ctx *ctx, TDB_DATA key);
 
+void register_msg_g_lock_stats(
+	TALLOC_CTX *mem_ctx, struct messaging_context *msg_ctx);
+
 #endif
@@ -85,6 +85,15 @@ NTSTATUS idmap_autorid_setrange(struct db_context *db,
 NTSTATUS idmap_autorid_acquire_range(struct db_context *db,
 				     struct autorid_range_config *range);
 
+/**
+ * Acquire (or look up) the ranges for several domain#index
+ * pairs within a single transaction. The entries of ranges
+ * must be distinct; on success all of them are filled in.
+ */
+NTSTATUS idmap_autorid_acquire_ranges(struct db_context *db,
+				      struct autorid_range_config *ranges,
+				      size_t num_ranges);
+
 /**
  * Delete a domain#index <-> range mapping from the database.
  * The mapping is specified by the sid and index.
@@ -114,6 +114,9 @@ struct _SMBCFILE {
 	struct smbc_dirplus_list *dirplus_list, *dirplus_end, *dirplus_next;
 	int dir_type, dir_error;
 
+	/* number of smbc_aio_pread/pwrite requests not reported yet */
+	unsigned int aio_pending;
+
 	struct _SMBCFILE *next, *prev;
 };
 
@@ -150,6 +153,14 @@ struct SMBC_internal_data {
 	 */
 	SMBCFILE *                              files;
 
+	/*
+	 * Async read/write requests, see libsmb_aio.c
+	 */
+	struct tevent_context *                 aio_ev;
+	struct smbc_aio_req *                   aio_inflight;
+	struct smbc_aio_req *                   aio_waiting;
+	struct smbc_aio_req *                   aio_completed;
+
         /*
          * Support "Create Time" in get/set with the *xattr() functions, if
          * true.  This replaces the dos attribute strings C_TIME, A_TIME and
@@ -265,6 +276,10 @@ struct SMBC_internal_data {
 	struct loadparm_context *lp_ctx;
 };
 
+/* Functions in libsmb_aio.c */
+void
+SMBC_aio_free(SMBCCTX *context);
+
 /* Functions in libsmb_cache.c */
 int
 SMBC_add_cached_server(SMBCCTX * context,
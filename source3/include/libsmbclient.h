@@ -2937,6 +2937,129 @@ smbc_set_credentials_with_fallback(SMBCCTX *ctx,
 			    	   const char *password);
 
 
+/**
+ * @ingroup aio
+ *
+ * Callback for smbc_aio_pread() and smbc_aio_pwrite().
+ *
+ * @param c             The context the request was submitted on.
+ *
+ * @param file          The file the request was submitted for.
+ *
+ * @param result        The number of bytes read or written, which may be
+ *                      less than requested, or -1 on error.
+ *
+ * @param error         The errno value if result is -1, 0 otherwise.
+ *
+ * @param private_data  The private_data pointer passed at submission.
+ */
+typedef void (*smbc_aio_done_fn)(SMBCCTX *c,
+				 SMBCFILE *file,
+				 ssize_t result,
+				 int error,
+				 void *private_data);
+
+/**
+ * @ingroup aio
+ *
+ * Submit an asynchronous read at a given offset. The file offset
+ * used by smbc_read() is not changed. Many requests can be in
+ * flight for one file at the same time.
+ *
+ * The request is processed and its callback called from within
+ * smbc_aio_poll() or smbc_aio_wait(). buf must stay valid until
+ * then.
+ *
+ * While async requests are pending on a connection, synchronous
+ * calls using the same server fail with EINVAL.
+ *
+ * @param c             The context the file was opened on.
+ *
+ * @param file          An open file, returned by smbc_getFunctionOpen().
+ *
+ * @param buf           The buffer to read into.
+ *
+ * @param count         The number of bytes to read.
+ *
+ * @param offset        The file offset to read from.
+ *
+ * @param done_fn       Called once the request has completed.
+ *
+ * @param private_data  Passed to done_fn.
+ *
+ * @return              0 if the request was submitted, -1 on error
+ *                      with errno set:
+ *                      - EINVAL One of the parameters is not valid
+ *                      - EBADF  file is not an open file of c
+ *                      - ENOMEM Out of memory
+ */
+int
+smbc_aio_pread(SMBCCTX *c,
+	       SMBCFILE *file,
+	       void *buf,
+	       size_t count,
+	       off_t offset,
+	       smbc_aio_done_fn done_fn,
+	       void *private_data);
+
+/**
+ * @ingroup aio
+ *
+ * Submit an asynchronous write at a given offset, see
+ * smbc_aio_pread() for the details.
+ */
+int
+smbc_aio_pwrite(SMBCCTX *c,
+		SMBCFILE *file,
+		const void *buf,
+		size_t count,
+		off_t offset,
+		smbc_aio_done_fn done_fn,
+		void *private_data);
+
+/**
+ * @ingroup aio
+ *
+ * Process the network traffic of the async requests and call the
+ * callbacks of the requests that have completed.
+ *
+ * @param c             The context.
+ *
+ * @param timeout_msec  How long to wait for a request to complete if
+ *                      none has. 0 does not block, -1 waits forever.
+ *
+ * @return              The number of callbacks called, 0 on timeout or
+ *                      if no requests are pending, -1 on error with
+ *                      errno set.
+ */
+int
+smbc_aio_poll(SMBCCTX *c, int timeout_msec);
+
+/**
+ * @ingroup aio
+ *
+ * Wait until all async requests of a file have completed, calling
+ * the callbacks of all requests completing in the meantime.
+ *
+ * @param c             The context.
+ *
+ * @param file          The file to wait for, NULL waits for all files.
+ *
+ * @return              0 on success, -1 on error with errno set.
+ */
+int
+smbc_aio_wait(SMBCCTX *c, SMBCFILE *file);
+
+/**
+ * @ingroup aio
+ *
+ * Return the number of async requests of a file, or of all files if
+ * file is NULL, whose callback has not been called yet.
+ */
+unsigned int
+smbc_aio_pending(SMBCCTX *c, SMBCFILE *file);
+
+
 /**
  * @ingroup threads
  *
@@ -984,6 +984,8 @@ NTSTATUS pdb_create_builtin(uint32_t rid);
 NTSTATUS create_builtin_users(const struct dom_sid *sid);
 NTSTATUS create_builtin_administrators(const struct dom_sid *sid);
 NTSTATUS create_builtin_guests(const struct dom_sid *dom_sid);
+char *pdb_token_cache_generation(TALLOC_CTX *mem_ctx);
+void pdb_token_cache_generation_bump(void);
 
 #include "passdb/machine_sid.h"
 #include "passdb/lookup_sid.h"
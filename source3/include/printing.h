@@ -112,6 +112,13 @@ extern struct printif	generic_printif;
 
 #ifdef HAVE_CUPS
 extern struct printif	cups_printif;
+
+int cups_notify_subscribe(int lease_duration);
+bool cups_notify_renew(int subscription_id, int lease_duration);
+bool cups_notify_fetch(TALLOC_CTX *mem_ctx,
+		       int subscription_id,
+		       int *sequence,
+		       char **_printers);
 #endif /* HAVE_CUPS */
 
 #ifdef HAVE_IPRINT
@@ -125,6 +132,13 @@ extern struct printif	iprint_printif;
 #define MAX_CACHE_VALID_TIME 3600
 #define CUPS_DEFAULT_CONNECTION_TIMEOUT 30
 
+/* Defaults for the "cups:event ..." options */
+#define PRINT_NOTIFY_POLL_INTERVAL 2
+#define PRINT_NOTIFY_CACHE_TIME 600
+#define PRINT_NOTIFY_LEASE_DURATION 600
+/* how often the background queue process marks events as delivered */
+#define PRINT_NOTIFY_MARK_TIME 10
+
 #ifndef PRINT_SPOOL_PREFIX
 #define PRINT_SPOOL_PREFIX "smbprn."
 #endif
@@ -259,4 +273,7 @@ void print_queue_receive(struct messaging_context *msg,
 			 uint32_t msg_type,
 			 struct server_id server_id,
 			 DATA_BLOB *data);
+void print_queue_event(struct messaging_context *msg_ctx,
+		       const char *printername);
+void print_queue_events_reset(void);
 #endif /* PRINTING_H_ */
@@ -207,6 +207,9 @@ char *sys_realpath(const char *path);
 #if 0
 int sys_get_number_of_cores(void);
 #endif
+int sys_socket_incoming_cpu(int fd);
+int sys_cpu_numa_node(int cpu);
+bool sys_set_cpu_affinity(int cpu, int node);
 
 struct sys_proc_fd_path_buf {
 	char buf[35]; /* "/proc/self/fd/" + strlen(2^64) + 0-terminator */
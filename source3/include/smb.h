@@ -356,6 +356,9 @@ struct interface {
 /* Private flag for streams support */
 #define NTCREATEX_FLAG_STREAM_BASEOPEN		0x0010
 
+/* Private flag for SMB2 stat opens closed within the same compound */
+#define NTCREATEX_FLAG_COMPOUND_STAT_OPEN	0x0020
+
 /* Flag for NT transact rename call. */
 #define RENAME_REPLACE_IF_EXISTS 1
 
@@ -80,6 +80,7 @@ struct tevent_context;
 	SMBPROFILE_STATS_BASIC(syscall_fstat) \
 	SMBPROFILE_STATS_BASIC(syscall_lstat) \
 	SMBPROFILE_STATS_BASIC(syscall_fstatat) \
+	SMBPROFILE_STATS_BYTES(syscall_asys_fstatat) \
 	SMBPROFILE_STATS_BASIC(syscall_get_alloc_size) \
 	SMBPROFILE_STATS_BASIC(syscall_unlinkat) \
 	SMBPROFILE_STATS_BASIC(syscall_chmod) \
@@ -108,6 +109,7 @@ struct tevent_context;
 	SMBPROFILE_STATS_BASIC(syscall_brl_unlock) \
 	SMBPROFILE_STATS_BASIC(syscall_brl_cancel) \
 	SMBPROFILE_STATS_BYTES(syscall_asys_getxattrat) \
+	SMBPROFILE_STATS_BYTES(syscall_asys_copy_file_range) \
 	SMBPROFILE_STATS_SECTION_END \
 	\
 	SMBPROFILE_STATS_SECTION_START(acl, "ACL Calls") \
@@ -123,6 +125,98 @@ struct tevent_context;
 	SMBPROFILE_STATS_COUNT(statcache_hits) \
 	SMBPROFILE_STATS_SECTION_END \
 	\
+	SMBPROFILE_STATS_SECTION_START(mangle, "Name Mangling") \
+	SMBPROFILE_STATS_COUNT(mangle_cache_lookups) \
+	SMBPROFILE_STATS_COUNT(mangle_cache_hits) \
+	SMBPROFILE_STATS_COUNT(mangle_cache_misses) \
+	SMBPROFILE_STATS_COUNT(mangle_dir_scans) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(path_walk, "Path Walk") \
+	SMBPROFILE_STATS_COUNT(path_walk_cache_lookups) \
+	SMBPROFILE_STATS_COUNT(path_walk_cache_hits) \
+	SMBPROFILE_STATS_COUNT(path_walk_cache_expired) \
+	SMBPROFILE_STATS_COUNT(path_walk_openat2_lookups) \
+	SMBPROFILE_STATS_COUNT(path_walk_openat2_hits) \
+	SMBPROFILE_STATS_COUNT(path_walk_openat2_fallbacks) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(access_check, "Access Check") \
+	SMBPROFILE_STATS_COUNT(access_check_cache_lookups) \
+	SMBPROFILE_STATS_COUNT(access_check_cache_hits) \
+	SMBPROFILE_STATS_COUNT(access_check_cache_expired) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(readahead, "Adaptive Readahead") \
+	SMBPROFILE_STATS_COUNT(readahead_hits) \
+	SMBPROFILE_STATS_COUNT(readahead_misses) \
+	SMBPROFILE_STATS_COUNT(readahead_calls) \
+	SMBPROFILE_STATS_COUNT(readahead_bytes) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(compression, "SMB3 Compression") \
+	SMBPROFILE_STATS_BYTES(smb2_compress) \
+	SMBPROFILE_STATS_BYTES(smb2_decompress) \
+	SMBPROFILE_STATS_COUNT(smb2_compress_out_bytes) \
+	SMBPROFILE_STATS_COUNT(smb2_compress_raw_bytes) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(encryption, "SMB3 Encryption") \
+	SMBPROFILE_STATS_BYTES(smb2_encrypt) \
+	SMBPROFILE_STATS_BYTES(smb2_decrypt) \
+	SMBPROFILE_STATS_COUNT(smb2_encrypt_offload) \
+	SMBPROFILE_STATS_COUNT(smb2_decrypt_offload) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(signing, "SMB2 Signing") \
+	SMBPROFILE_STATS_BYTES(smb2_sign) \
+	SMBPROFILE_STATS_BYTES(smb2_verify) \
+	SMBPROFILE_STATS_COUNT(smb2_sign_offload) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(durable, "Durable Handles") \
+	SMBPROFILE_STATS_BASIC(durable_reconnect) \
+	SMBPROFILE_STATS_BASIC(durable_reconnect_locked) \
+	SMBPROFILE_STATS_COUNT(durable_reconnect_failed) \
+	SMBPROFILE_STATS_COUNT(durable_reconnect_peek_failed) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(smb2_send, "SMB2 Send Queue") \
+	SMBPROFILE_STATS_COUNT(smb2_send_calls) \
+	SMBPROFILE_STATS_COUNT(smb2_send_responses) \
+	SMBPROFILE_STATS_COUNT(smb2_send_deferred) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(smb2_qos, "SMB2 QoS") \
+	SMBPROFILE_STATS_COUNT(smb2_qos_queue_depth) \
+	SMBPROFILE_STATS_BASIC(smb2_qos_wait) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(io_uring, "io_uring") \
+	SMBPROFILE_STATS_COUNT(io_uring_submit) \
+	SMBPROFILE_STATS_COUNT(io_uring_submit_sqes) \
+	SMBPROFILE_STATS_COUNT(io_uring_coalesced_reads) \
+	SMBPROFILE_STATS_COUNT(io_uring_linked_fsyncs) \
+	SMBPROFILE_STATS_COUNT(io_uring_skipped_fsyncs) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(notifyd, "Change Notify Daemon") \
+	SMBPROFILE_STATS_COUNT(notifyd_events_in) \
+	SMBPROFILE_STATS_COUNT(notifyd_events_merged) \
+	SMBPROFILE_STATS_COUNT(notifyd_events_collapsed) \
+	SMBPROFILE_STATS_COUNT(notifyd_messages_out) \
+	SMBPROFILE_STATS_COUNT(notifyd_reclog_in) \
+	SMBPROFILE_STATS_COUNT(notifyd_reclog_out) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
+	SMBPROFILE_STATS_SECTION_START(gpfs, "GPFS Calls") \
+	SMBPROFILE_STATS_BASIC(gpfs_set_share) \
+	SMBPROFILE_STATS_BASIC(gpfs_set_lease) \
+	SMBPROFILE_STATS_BASIC(gpfs_fgetacl) \
+	SMBPROFILE_STATS_BASIC(gpfs_get_winattrs) \
+	SMBPROFILE_STATS_BASIC(gpfs_set_winattrs) \
+	SMBPROFILE_STATS_SECTION_END \
+	\
 	SMBPROFILE_STATS_SECTION_START(SMB, "SMB Calls") \
 	SMBPROFILE_STATS_BASIC(SMBmkdir) \
 	SMBPROFILE_STATS_BASIC(SMBrmdir) \
@@ -283,6 +377,7 @@ struct tevent_context;
 	SMBPROFILE_STATS_BASIC(syscall_fstat) \
 	SMBPROFILE_STATS_BASIC(syscall_lstat) \
 	SMBPROFILE_STATS_BASIC(syscall_fstatat) \
+	SMBPROFILE_STATS_BYTES(syscall_asys_fstatat) \
 	SMBPROFILE_STATS_BASIC(syscall_get_alloc_size) \
 	SMBPROFILE_STATS_BASIC(syscall_unlinkat) \
 	SMBPROFILE_STATS_BASIC(syscall_chmod) \
@@ -311,6 +406,7 @@ struct tevent_context;
 	SMBPROFILE_STATS_BASIC(syscall_brl_unlock) \
 	SMBPROFILE_STATS_BASIC(syscall_brl_cancel) \
 	SMBPROFILE_STATS_BYTES(syscall_asys_getxattrat) \
+	SMBPROFILE_STATS_BYTES(syscall_asys_copy_file_range) \
 	SMBPROFILE_STATS_SECTION_END \
 	\
 	SMBPROFILE_STATS_SECTION_START(acl, "ACL Calls") \
@@ -349,6 +445,19 @@ struct tevent_context;
 
 /* time values in the following structure are in microseconds */
 
+/*
+ * Latency histogram: bucket 0 counts the events that took less than
+ * 16 microseconds, bucket i the ones below 2^(i+4) microseconds not
+ * counted in bucket i-1. The last bucket has everything that took
+ * 2^(SMBPROFILE_HIST_BUCKETS+2) microseconds (about 16 seconds) or
+ * longer.
+ */
+#define SMBPROFILE_HIST_BUCKETS 22
+
+struct smbprofile_stats_hist {
+	uint64_t buckets[SMBPROFILE_HIST_BUCKETS];
+};
+
 struct smbprofile_stats_count {
 	uint64_t count;		/* number of events */
 };
@@ -365,6 +474,7 @@ struct smbprofile_stats_time_async {
 struct smbprofile_stats_basic {
 	uint64_t count;		/* number of events */
 	uint64_t time;		/* microseconds */
+	struct smbprofile_stats_hist hist;
 };
 
 struct smbprofile_stats_basic_async {
@@ -377,6 +487,7 @@ struct smbprofile_stats_bytes {
 	uint64_t time;		/* microseconds */
 	uint64_t idle;		/* idle time compared to 'time' microseconds */
 	uint64_t bytes;		/* bytes */
+	struct smbprofile_stats_hist hist;
 };
 
 struct smbprofile_stats_bytes_async {
@@ -390,7 +501,7 @@ struct smbprofile_stats_iobytes {
 	uint64_t count;		/* number of events */
 	uint64_t failed_count;	/* number of unsuccessful events */
 	uint64_t time;		/* microseconds */
-	uint64_t buckets[10];	/* 1,2,4,...256,Inf msecs */
+	struct smbprofile_stats_hist hist;
 	uint64_t idle;		/* idle time compared to 'time' microseconds */
 	uint64_t inbytes;	/* bytes read */
 	uint64_t outbytes;	/* bytes written */
@@ -406,6 +517,8 @@ struct smbprofile_stats_iobytes_async {
 struct profile_stats {
 	uint64_t magic;
 	bool summary_record;
+	/* seconds since the epoch, maintained for per-share summaries */
+	uint64_t last_update;
 	struct {
 #define SMBPROFILE_STATS_START
 #define SMBPROFILE_STATS_SECTION_START(name, display)
@@ -479,7 +592,9 @@ struct profile_stats {
 	_SMBPROFILE_BASIC_ASYNC_START(_name##_stats, _area, _async)
 #define SMBPROFILE_BASIC_ASYNC_END(_async) do { \
 	if ((_async).start != 0) { \
-		(_async).stats->time += profile_timestamp() - (_async).start; \
+		uint64_t _elapsed = profile_timestamp() - (_async).start; \
+		(_async).stats->time += _elapsed; \
+		smbprofile_update_hist(&(_async).stats->hist, _elapsed); \
 		(_async) = (struct smbprofile_stats_basic_async) {}; \
 		smbprofile_dump_schedule(); \
 	} \
@@ -507,9 +622,12 @@ struct profile_stats {
 } while(0)
 #define _SMBPROFILE_TIMER_ASYNC_END(_async) do { \
 	if ((_async).start != 0) { \
+		uint64_t _elapsed; \
 		_SMBPROFILE_TIMER_ASYNC_SET_BUSY(_async); \
-		(_async).stats->time += profile_timestamp() - (_async).start; \
+		_elapsed = profile_timestamp() - (_async).start; \
+		(_async).stats->time += _elapsed; \
 		(_async).stats->idle += (_async).idle_time; \
+		smbprofile_update_hist(&(_async).stats->hist, _elapsed); \
 	} \
 } while(0)
 
@@ -556,7 +674,6 @@ struct profile_stats {
 		(_async).stats->outbytes += (_outbytes); \
 		_SMBPROFILE_TIMER_ASYNC_END(_async); \
 		smbprofile_update_failed_count((_async.stats), (_opcode), (_status)); \
-		smbprofile_update_hist((_async).stats, profile_timestamp() - (_async).start); \
 		(_async) = (struct smbprofile_stats_iobytes_async) {}; \
 		smbprofile_dump_schedule(); \
 	} \
@@ -670,46 +787,17 @@ static inline void smbprofile_update_failed_count(
 	}
 }
 
-static inline void smbprofile_update_hist(struct smbprofile_stats_iobytes *s,
+static inline void smbprofile_update_hist(struct smbprofile_stats_hist *h,
 					  uint64_t microsecs)
 {
-	s->buckets[9]++;
-	if (microsecs >= 256000) {
-		return;
-	}
-	s->buckets[8]++;
-	if (microsecs >= 128000) {
-		return;
-	}
-	s->buckets[7]++;
-	if (microsecs >= 64000) {
-		return;
-	}
-	s->buckets[6]++;
-	if (microsecs >= 32000) {
-		return;
-	}
-	s->buckets[5]++;
-	if (microsecs >= 16000) {
-		return;
-	}
-	s->buckets[4]++;
-	if (microsecs >= 8000) {
-		return;
-	}
-	s->buckets[3]++;
-	if (microsecs >= 4000) {
-		return;
-	}
-	s->buckets[2]++;
-	if (microsecs >= 2000) {
-		return;
-	}
-	s->buckets[1]++;
-	if (microsecs >= 1000) {
-		return;
+	size_t i = 0;
+
+	microsecs >>= 4;
+	while ((microsecs != 0) && (i < SMBPROFILE_HIST_BUCKETS - 1)) {
+		microsecs >>= 1;
+		i++;
 	}
-	s->buckets[0]++;
+	h->buckets[i]++;
 }
 
 static inline bool smbprofile_dump_pending(void)
@@ -726,6 +814,9 @@ void smbprofile_dump(struct smbd_server_connection *sconn);
 void smbprofile_cleanup(pid_t pid, pid_t dst);
 void smbprofile_stats_accumulate(struct profile_stats *acc,
 				 const struct profile_stats *add);
+uint64_t smbprofile_hist_bucket_limit(size_t i);
+uint64_t smbprofile_hist_percentile(const struct smbprofile_stats_hist *h,
+				    unsigned permille);
 int smbprofile_magic(const struct profile_stats *stats, uint64_t *_magic);
 size_t smbprofile_collect_tdb(struct tdb_context *tdb,
 			      uint64_t magic,
@@ -390,6 +390,18 @@
  * Version 50 - Add struct files_struct.fsp_flags.posix_append
  * Change to Version 51 - will ship with 4.23
  * Version 51 - Add ntcreatex_deny_[dos|fcb] and ntcreatex_stream_baseopen
+ * Version 51 - Add SMB_VFS_FSTATAT_SEND/RECV
+ * Version 51 - Add SMB_VFS_GET_DOS_ATTRIBUTES_BATCH_SEND/RECV
+ * Version 51 - Add path_walk_cache to connection_struct
+ * Version 51 - Add VFS_OPEN_HOW_RESOLVE_BENEATH for SMB_VFS_OPENAT()
+ * Version 51 - Add access_check_cache to connection_struct
+ * Version 51 - Add fsp_flags.no_share_mode_entry
+ * Version 51 - Add files_struct.deferred_share_entry
+ * Version 51 - Add files_struct.write_behind
+ * Version 51 - Add files_struct.file_id_[next|hash|indexed], set
+ *              files_struct.file_id with fsp_set_file_id()
+ * Version 51 - Add fsp_flags.lease_stat_valid and
+ *              files_struct.lease_stat_epoch
  */
 
 #define SMB_VFS_INTERFACE_VERSION 51
@@ -434,7 +446,10 @@ typedef struct files_struct {
 	struct connection_struct *conn;
 	struct fd_handle *fh;
 	unsigned int num_smb_operations;
-	struct file_id file_id;
+	struct file_id file_id; /* change with fsp_set_file_id() */
+	struct files_struct *file_id_next;
+	uint64_t file_id_hash;
+	bool file_id_indexed;
 	uint64_t initial_allocation_size; /* Faked up initial allocation on disk. */
 	uint16_t file_pid;
 	uint64_t vuid; /* SMB2 compat */
@@ -467,6 +482,8 @@ typedef struct files_struct {
 		bool ntcreatex_deny_dos : 1;
 		bool ntcreatex_deny_fcb : 1;
 		bool ntcreatex_stream_baseopen : 1;
+		bool no_share_mode_entry : 1;
+		bool lease_stat_valid : 1;
 	} fsp_flags;
 
 	/* Only used for SMB1 close with explicit time */
@@ -482,6 +499,11 @@ typedef struct files_struct {
 	uint32_t lease_type;
 
 	struct fsp_lease *lease;
+	/*
+	 * The lease epoch fsp_name->st was last taken under, see
+	 * fsp_flags.lease_stat_valid
+	 */
+	uint16_t lease_stat_epoch;
 	int sent_oplock_break;
 	struct tevent_timer *oplock_timeout;
 	int current_lock_count; /* Count the number of outstanding locks and pending locks. */
@@ -493,6 +515,15 @@ typedef struct files_struct {
 	struct vfs_fsp_data *vfs_extension;
 	struct fake_file_handle *fake_file_handle;
 
+	/*
+	 * Stat open whose share mode entry is not yet in locking.tdb,
+	 * see "stat open share entry delay".
+	 */
+	struct deferred_share_entry *deferred_share_entry;
+
+	/* Buffered small writes, see "smb2 write behind size" */
+	struct write_behind *write_behind;
+
 	struct notify_change_buf *notify;
 
 	struct files_struct *base_fsp; /* placeholder for delete on close */
@@ -779,6 +810,12 @@ typedef struct connection_struct {
 
 	struct rpc_pipe_client *spoolss_pipe;
 
+	/* Recently walked directories, see openat_pathref_fsp_nosymlink() */
+	struct path_walk_cache *path_walk_cache;
+
+	/* Recently granted access checks, see smbd_check_access_rights_fsp() */
+	struct access_check_cache *access_check_cache;
+
 } connection_struct;
 
 struct smbd_smb2_request;
@@ -908,6 +945,7 @@ struct vfs_aio_state {
 
 #define VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS 1
 #define VFS_OPEN_HOW_WITH_BACKUP_INTENT 2
+#define VFS_OPEN_HOW_RESOLVE_BENEATH 4
 
 struct vfs_open_how {
 	int flags;
@@ -1050,6 +1088,16 @@ struct vfs_fn_pointers {
 		const struct smb_filename *smb_fname,
 		SMB_STRUCT_STAT *sbuf,
 		int flags);
+	struct tevent_req *(*fstatat_send_fn)(
+		TALLOC_CTX *mem_ctx,
+		struct tevent_context *ev,
+		struct vfs_handle_struct *handle,
+		files_struct *dirfsp,
+		const struct smb_filename *smb_fname,
+		int flags);
+	int (*fstatat_recv_fn)(struct tevent_req *req,
+			       struct vfs_aio_state *aio_state,
+			       SMB_STRUCT_STAT *sbuf);
 	uint64_t (*get_alloc_size_fn)(struct vfs_handle_struct *handle, struct files_struct *fsp, const SMB_STRUCT_STAT *sbuf);
 	int (*unlinkat_fn)(struct vfs_handle_struct *handle,
 			struct files_struct *srcdir_fsp,
@@ -1234,6 +1282,24 @@ struct vfs_fn_pointers {
 				struct vfs_aio_state *aio_state,
 				uint32_t *dosmode);
 
+	/*
+	 * DOS attributes of num_fnames entries of dir_fsp. dosmodes and
+	 * statuses passed to recv have num_fnames elements.
+	 */
+	struct tevent_req *(*get_dos_attributes_batch_send_fn)(
+				TALLOC_CTX *mem_ctx,
+				struct tevent_context *ev,
+				struct vfs_handle_struct *handle,
+				files_struct *dir_fsp,
+				struct smb_filename **smb_fnames,
+				size_t num_fnames);
+
+	NTSTATUS (*get_dos_attributes_batch_recv_fn)(
+				struct tevent_req *req,
+				struct vfs_aio_state *aio_state,
+				uint32_t *dosmodes,
+				NTSTATUS *statuses);
+
 	/* NT ACL operations. */
 
 	NTSTATUS (*fget_nt_acl_fn)(struct vfs_handle_struct *handle,
@@ -1563,6 +1629,16 @@ int smb_vfs_call_fstatat(
 	const struct smb_filename *smb_fname,
 	SMB_STRUCT_STAT *sbuf,
 	int flags);
+struct tevent_req *smb_vfs_call_fstatat_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct vfs_handle_struct *handle,
+	files_struct *dirfsp,
+	const struct smb_filename *smb_fname,
+	int flags);
+int smb_vfs_call_fstatat_recv(struct tevent_req *req,
+			      struct vfs_aio_state *aio_state,
+			      SMB_STRUCT_STAT *sbuf);
 uint64_t smb_vfs_call_get_alloc_size(struct vfs_handle_struct *handle,
 				     struct files_struct *fsp,
 				     const SMB_STRUCT_STAT *sbuf);
@@ -1700,6 +1776,18 @@ NTSTATUS smb_vfs_call_get_dos_attributes_recv(
 			struct tevent_req *req,
 			struct vfs_aio_state *aio_state,
 			uint32_t *dosmode);
+struct tevent_req *smb_vfs_call_get_dos_attributes_batch_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct vfs_handle_struct *handle,
+			files_struct *dir_fsp,
+			struct smb_filename **smb_fnames,
+			size_t num_fnames);
+NTSTATUS smb_vfs_call_get_dos_attributes_batch_recv(
+			struct tevent_req *req,
+			struct vfs_aio_state *aio_state,
+			uint32_t *dosmodes,
+			NTSTATUS *statuses);
 struct tevent_req *smb_vfs_call_offload_read_send(
 	TALLOC_CTX *mem_ctx,
 	struct tevent_context *ev,
@@ -1996,6 +2084,16 @@ int vfs_not_implemented_fstatat(
 	const struct smb_filename *smb_fname,
 	SMB_STRUCT_STAT *sbuf,
 	int flags);
+struct tevent_req *vfs_not_implemented_fstatat_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct vfs_handle_struct *handle,
+	files_struct *dirfsp,
+	const struct smb_filename *smb_fname,
+	int flags);
+int vfs_not_implemented_fstatat_recv(struct tevent_req *req,
+				     struct vfs_aio_state *aio_state,
+				     SMB_STRUCT_STAT *sbuf);
 uint64_t vfs_not_implemented_get_alloc_size(struct vfs_handle_struct *handle,
 					    struct files_struct *fsp,
 					    const SMB_STRUCT_STAT *sbuf);
@@ -2169,6 +2267,18 @@ NTSTATUS vfs_not_implemented_get_dos_attributes_recv(
 			struct tevent_req *req,
 			struct vfs_aio_state *aio_state,
 			uint32_t *dosmode);
+struct tevent_req *vfs_not_implemented_get_dos_attributes_batch_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct vfs_handle_struct *handle,
+			files_struct *dir_fsp,
+			struct smb_filename **smb_fnames,
+			size_t num_fnames);
+NTSTATUS vfs_not_implemented_get_dos_attributes_batch_recv(
+			struct tevent_req *req,
+			struct vfs_aio_state *aio_state,
+			uint32_t *dosmodes,
+			NTSTATUS *statuses);
 NTSTATUS vfs_not_implemented_fget_dos_attributes(struct vfs_handle_struct *handle,
 						 struct files_struct *fsp,
 						 uint32_t *dosmode);
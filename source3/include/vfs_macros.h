@@ -227,6 +227,21 @@
 	smb_vfs_call_fstatat((handle)->next, (dirfsp), (smb_fname), \
 			     (sbuf), (flags))
 
+#define SMB_VFS_FSTATAT_SEND(mem_ctx, ev, dirfsp, smb_fname, flags) \
+	smb_vfs_call_fstatat_send((mem_ctx), (ev), \
+				  (dirfsp)->conn->vfs_handles, \
+				  (dirfsp), (smb_fname), (flags))
+#define SMB_VFS_FSTATAT_RECV(req, aio_state, sbuf) \
+	smb_vfs_call_fstatat_recv((req), (aio_state), (sbuf))
+
+#define SMB_VFS_NEXT_FSTATAT_SEND(mem_ctx, ev, handle, dirfsp, smb_fname, \
+				  flags) \
+	smb_vfs_call_fstatat_send((mem_ctx), (ev), \
+				  (handle)->next, \
+				  (dirfsp), (smb_fname), (flags))
+#define SMB_VFS_NEXT_FSTATAT_RECV(req, aio_state, sbuf) \
+	smb_vfs_call_fstatat_recv((req), (aio_state), (sbuf))
+
 #define SMB_VFS_GET_ALLOC_SIZE(conn, fsp, sbuf) \
 	smb_vfs_call_get_alloc_size((conn)->vfs_handles, (fsp), (sbuf))
 #define SMB_VFS_NEXT_GET_ALLOC_SIZE(conn, fsp, sbuf) \
@@ -431,6 +446,29 @@
 #define SMB_VFS_NEXT_GET_DOS_ATTRIBUTES_RECV(req, aio_state, dosmode) \
 	smb_vfs_call_get_dos_attributes_recv((req), (aio_state), (dosmode))
 
+#define SMB_VFS_GET_DOS_ATTRIBUTES_BATCH_SEND(mem_ctx, evg, dir_fsp, \
+					      smb_fnames, num_fnames) \
+	smb_vfs_call_get_dos_attributes_batch_send((mem_ctx), (evg), \
+						   (dir_fsp)->conn->vfs_handles, \
+						   (dir_fsp), (smb_fnames), \
+						   (num_fnames))
+#define SMB_VFS_GET_DOS_ATTRIBUTES_BATCH_RECV(req, aio_state, dosmodes, \
+					      statuses) \
+	smb_vfs_call_get_dos_attributes_batch_recv((req), (aio_state), \
+						   (dosmodes), (statuses))
+
+#define SMB_VFS_NEXT_GET_DOS_ATTRIBUTES_BATCH_SEND(mem_ctx, evg, handle, \
+						   dir_fsp, smb_fnames, \
+						   num_fnames) \
+	smb_vfs_call_get_dos_attributes_batch_send((mem_ctx), (evg), \
+						   (handle)->next, \
+						   (dir_fsp), (smb_fnames), \
+						   (num_fnames))
+#define SMB_VFS_NEXT_GET_DOS_ATTRIBUTES_BATCH_RECV(req, aio_state, dosmodes, \
+						   statuses) \
+	smb_vfs_call_get_dos_attributes_batch_recv((req), (aio_state), \
+						   (dosmodes), (statuses))
+
 #define SMB_VFS_FSET_DOS_ATTRIBUTES(conn, fsp, attributes) \
 	smb_vfs_call_fset_dos_attributes((conn)->vfs_handles, (fsp), (attributes))
 #define SMB_VFS_NEXT_FSET_DOS_ATTRIBUTES(handle, fsp, attributes) \
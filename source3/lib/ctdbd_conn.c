@@ -1084,6 +1084,137 @@ int ctdbd_parse(struct ctdbd_connection *conn, uint32_t db_id,
 	return ret;
 }
 
+/*
+ * Fetch several records and parse them. All calls are sent before the
+ * first reply is read, so ctdbd works on them concurrently and the
+ * batch costs one round trip instead of one per key. The replies can
+ * come back in any order, rets[i] receives the result for keys[i].
+ */
+int ctdbd_parse_multi(struct ctdbd_connection *conn, uint32_t db_id,
+		      const TDB_DATA *keys, const bool *local_copy,
+		      size_t num_keys,
+		      void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+				     void *private_data),
+		      void *private_data,
+		      int *rets)
+{
+	uint32_t *reqids = NULL;
+	bool *answered = NULL;
+	size_t i, pending;
+	int ret;
+
+	if (ctdbd_conn_has_async_reqs(conn)) {
+		DBG_ERR("Async ctdb req on sync connection\n");
+		return EINVAL;
+	}
+
+	reqids = talloc_array(talloc_tos(), uint32_t, num_keys);
+	answered = talloc_zero_array(talloc_tos(), bool, num_keys);
+	if ((reqids == NULL) || (answered == NULL)) {
+		TALLOC_FREE(reqids);
+		TALLOC_FREE(answered);
+		return ENOMEM;
+	}
+
+	for (i=0; i<num_keys; i++) {
+		struct ctdb_req_call_old req;
+		struct iovec iov[2];
+		ssize_t nwritten;
+
+		ZERO_STRUCT(req);
+
+		req.hdr.length = offsetof(struct ctdb_req_call_old, data) +
+			keys[i].dsize;
+		req.hdr.ctdb_magic   = CTDB_MAGIC;
+		req.hdr.ctdb_version = CTDB_PROTOCOL;
+		req.hdr.operation    = CTDB_REQ_CALL;
+		req.hdr.reqid        = ctdbd_next_reqid(conn);
+		req.flags            = local_copy[i] ? CTDB_WANT_READONLY : 0;
+		req.callid           = CTDB_FETCH_FUNC;
+		req.db_id            = db_id;
+		req.keylen           = keys[i].dsize;
+
+		reqids[i] = req.hdr.reqid;
+		rets[i] = EIO;
+
+		iov[0].iov_base = &req;
+		iov[0].iov_len = offsetof(struct ctdb_req_call_old, data);
+		iov[1].iov_base = keys[i].dptr;
+		iov[1].iov_len = keys[i].dsize;
+
+		nwritten = write_data_iov(conn->fd, iov, ARRAY_SIZE(iov));
+		if (nwritten == -1) {
+			DEBUG(3, ("write_data_iov failed: %s\n",
+				  strerror(errno)));
+			cluster_fatal("cluster dispatch daemon msg write "
+				      "error\n");
+		}
+	}
+
+	pending = num_keys;
+
+	while (pending > 0) {
+		struct ctdb_req_header *hdr = NULL;
+		struct ctdb_reply_call_old *reply = NULL;
+
+		ret = ctdb_read_req(conn, 0, talloc_tos(), &hdr);
+		if (ret != 0) {
+			DEBUG(10, ("ctdb_read_req failed: %s\n",
+				   strerror(ret)));
+			goto done;
+		}
+
+		/*
+		 * The reqids are consecutive apart from wrapping
+		 * around 0, so look near the expected position first
+		 */
+		i = hdr->reqid - reqids[0];
+		if ((i >= num_keys) || (reqids[i] != hdr->reqid)) {
+			for (i=0; i<num_keys; i++) {
+				if (reqids[i] == hdr->reqid) {
+					break;
+				}
+			}
+		}
+		if ((i == num_keys) || answered[i]) {
+			DEBUG(0, ("Discarding mismatched ctdb reqid %u\n",
+				  hdr->reqid));
+			TALLOC_FREE(hdr);
+			continue;
+		}
+		answered[i] = true;
+		pending -= 1;
+
+		if (hdr->operation != CTDB_REPLY_CALL) {
+			DEBUG(0, ("received invalid reply\n"));
+			TALLOC_FREE(hdr);
+			continue;
+		}
+		reply = (struct ctdb_reply_call_old *)hdr;
+
+		if (reply->datalen == 0) {
+			/*
+			 * Treat an empty record as non-existing
+			 */
+			rets[i] = ENOENT;
+			TALLOC_FREE(hdr);
+			continue;
+		}
+
+		parser(i, keys[i],
+		       make_tdb_data(&reply->data[0], reply->datalen),
+		       private_data);
+		rets[i] = 0;
+		TALLOC_FREE(hdr);
+	}
+
+	ret = 0;
+done:
+	TALLOC_FREE(reqids);
+	TALLOC_FREE(answered);
+	return ret;
+}
+
 /*
   Traverse a ctdb database. "conn" must be an otherwise unused
   ctdb_connection where no other messages but the traverse ones are
@@ -1054,7 +1054,14 @@ static bool db_ctdb_can_use_local_hdr(const struct ctdb_ltdb_header *hdr,
 				      uint32_t my_vnn, bool read_only)
 {
 	if (hdr->dmaster != my_vnn) {
-		/* If we're not dmaster, it must be r/o copy. */
+		/*
+		 * If we're not dmaster, it must be r/o copy, with a
+		 * lease that has not expired yet.
+		 */
+		if (hdr->reserved1 != 0 &&
+		    time(NULL) >= (time_t)hdr->reserved1) {
+			return false;
+		}
 		return read_only && (hdr->flags & CTDB_REC_RO_HAVE_READONLY);
 	}
 
@@ -1408,6 +1415,127 @@ static NTSTATUS db_ctdb_parse_record(struct db_context *db, TDB_DATA key,
 	return NT_STATUS_OK;
 }
 
+struct db_ctdb_parse_records_batch_state {
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data);
+	void *private_data;
+	size_t idx;
+	const size_t *remote_idx;
+};
+
+static void db_ctdb_parse_records_batch_local(
+	TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct db_ctdb_parse_records_batch_state *state = private_data;
+	state->parser(state->idx, key, data, state->private_data);
+}
+
+static void db_ctdb_parse_records_batch_remote(
+	size_t idx, TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct db_ctdb_parse_records_batch_state *state = private_data;
+	state->parser(state->remote_idx[idx], key, data, state->private_data);
+}
+
+/*
+ * Serve what we can from the local copy, fetch the rest through ctdbd
+ * with one batch of calls.
+ */
+static NTSTATUS db_ctdb_parse_records_batch(
+	struct db_context *db,
+	const TDB_DATA *keys,
+	size_t num_keys,
+	void (*parser)(size_t idx, TDB_DATA key, TDB_DATA data,
+		       void *private_data),
+	void *private_data,
+	NTSTATUS *statuses)
+{
+	struct db_ctdb_ctx *ctx = talloc_get_type_abort(
+		db->private_data, struct db_ctdb_ctx);
+	struct db_ctdb_parse_records_batch_state batch = {
+		.parser = parser,
+		.private_data = private_data,
+	};
+	struct db_ctdb_parse_record_state state = {
+		.parser = db_ctdb_parse_records_batch_local,
+		.private_data = &batch,
+		.my_vnn = get_my_vnn(),
+	};
+	TALLOC_CTX *frame = talloc_stackframe();
+	TDB_DATA *remote_keys = NULL;
+	bool *local_copy = NULL;
+	size_t *remote_idx = NULL;
+	int *rets = NULL;
+	size_t i, num_remote = 0;
+	int ret;
+
+	remote_keys = talloc_array(frame, TDB_DATA, num_keys);
+	local_copy = talloc_array(frame, bool, num_keys);
+	remote_idx = talloc_array(frame, size_t, num_keys);
+	rets = talloc_array(frame, int, num_keys);
+	if ((remote_keys == NULL) || (local_copy == NULL) ||
+	    (remote_idx == NULL) || (rets == NULL)) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	for (i=0; i<num_keys; i++) {
+		NTSTATUS status;
+
+		batch.idx = i;
+		state.empty_record = false;
+
+		status = db_ctdb_try_parse_local_record(ctx, keys[i], &state);
+		if (!NT_STATUS_EQUAL(status,
+				     NT_STATUS_MORE_PROCESSING_REQUIRED)) {
+			statuses[i] = status;
+			continue;
+		}
+
+		remote_keys[num_remote] = keys[i];
+		local_copy[num_remote] = state.ask_for_readonly_copy;
+		remote_idx[num_remote] = i;
+		num_remote += 1;
+	}
+
+	if (num_remote == 0) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_OK;
+	}
+
+	batch.remote_idx = remote_idx;
+
+	ret = ctdbd_parse_multi(messaging_ctdb_connection(),
+				ctx->db_id,
+				remote_keys,
+				local_copy,
+				num_remote,
+				db_ctdb_parse_records_batch_remote,
+				&batch,
+				rets);
+	if (ret != 0) {
+		TALLOC_FREE(frame);
+		return map_nt_error_from_unix(ret);
+	}
+
+	for (i=0; i<num_remote; i++) {
+		NTSTATUS status = NT_STATUS_OK;
+
+		if (rets[i] == ENOENT) {
+			/*
+			 * See db_ctdb_parse_record()
+			 */
+			status = NT_STATUS_NOT_FOUND;
+		} else if (rets[i] != 0) {
+			status = map_nt_error_from_unix(rets[i]);
+		}
+		statuses[remote_idx[i]] = status;
+	}
+
+	TALLOC_FREE(frame);
+	return NT_STATUS_OK;
+}
+
 static void db_ctdb_parse_record_done(struct tevent_req *subreq);
 
 static struct tevent_req *db_ctdb_parse_record_send(
@@ -1974,6 +2102,7 @@ struct db_context *db_open_ctdb(TALLOC_CTX *mem_ctx,
 	result->parse_record = db_ctdb_parse_record;
 	result->parse_record_send = db_ctdb_parse_record_send;
 	result->parse_record_recv = db_ctdb_parse_record_recv;
+	result->parse_records_batch = db_ctdb_parse_records_batch;
 	result->traverse = db_ctdb_traverse;
 	result->traverse_read = db_ctdb_traverse_read;
 	result->get_seqnum = db_ctdb_get_seqnum;
@@ -19,6 +19,7 @@
 
 #include "replace.h"
 #include "system/filesys.h"
+#include "system/locale.h"
 #include "lib/util/server_id.h"
 #include "lib/util/debug.h"
 #include "lib/util/talloc_stack.h"
@@ -32,6 +33,7 @@
 #include "../lib/util/tevent_ntstatus.h"
 #include "messages.h"
 #include "serverid.h"
+#include "lib/util/util_file.h"
 
 struct g_lock_ctx {
 	struct db_context *db;
@@ -50,6 +52,203 @@ struct g_lock {
 	uint8_t *data;
 };
 
+/*
+ * Per-process contention statistics, dumped by "smbcontrol <pid>
+ * g-lock-stats". Only locks that had to wait are accounted per key
+ * prefix, the uncontended fast path just bumps a counter.
+ */
+
+#define G_LOCK_STATS_NUM_PREFIXES 32
+#define G_LOCK_STATS_PREFIX_LEN 16
+
+/* Wait time buckets: <10us, <100us, ..., <10s, >=10s */
+#define G_LOCK_STATS_NUM_BUCKETS 8
+
+struct g_lock_prefix_stats {
+	char prefix[64];
+	uint64_t contended;
+	uint64_t wakeups;
+	uint64_t wait_usec;
+	uint64_t max_wait_usec;
+};
+
+static struct {
+	uint64_t uncontended;
+	uint64_t contended;
+	uint64_t wakeups;
+	uint64_t wait_hist[G_LOCK_STATS_NUM_BUCKETS];
+	size_t num_prefixes;
+	struct g_lock_prefix_stats prefixes[G_LOCK_STATS_NUM_PREFIXES];
+	struct g_lock_prefix_stats other;
+} g_lock_stats = {
+	.other.prefix = "(other)",
+};
+
+/*
+ * Keys are either strings or binary (e.g. a file_id in locking.tdb).
+ * Group them by database name plus the leading printable part of the
+ * key, so binary keys of one database all end up in one bucket.
+ */
+static struct g_lock_prefix_stats *g_lock_stats_prefix(
+	struct g_lock_ctx *ctx, TDB_DATA key)
+{
+	char prefix[sizeof(g_lock_stats.prefixes[0].prefix)];
+	const char *name = dbwrap_name(ctx->db);
+	size_t i, len;
+
+	for (len = 0; len < MIN(key.dsize, G_LOCK_STATS_PREFIX_LEN); len++) {
+		uint8_t c = key.dptr[len];
+		if (!isalnum(c) && (c != '_') && (c != '-') && (c != '.')) {
+			break;
+		}
+	}
+
+	snprintf(prefix,
+		 sizeof(prefix),
+		 "%s%s%.*s",
+		 (name != NULL) ? name : "",
+		 (len != 0) ? ":" : "",
+		 (int)len,
+		 (len != 0) ? (const char *)key.dptr : "");
+
+	for (i = 0; i < g_lock_stats.num_prefixes; i++) {
+		struct g_lock_prefix_stats *p = &g_lock_stats.prefixes[i];
+		if (strcmp(p->prefix, prefix) == 0) {
+			return p;
+		}
+	}
+
+	if (g_lock_stats.num_prefixes == G_LOCK_STATS_NUM_PREFIXES) {
+		return &g_lock_stats.other;
+	}
+
+	i = g_lock_stats.num_prefixes++;
+	strlcpy(g_lock_stats.prefixes[i].prefix,
+		prefix,
+		sizeof(g_lock_stats.prefixes[i].prefix));
+	return &g_lock_stats.prefixes[i];
+}
+
+static void g_lock_stats_wait_done(struct g_lock_prefix_stats *p,
+				   struct timeval start)
+{
+	struct timeval now = timeval_current();
+	uint64_t usec = usec_time_diff(&now, &start);
+	uint64_t limit = 10;
+	size_t b;
+
+	for (b = 0; b < G_LOCK_STATS_NUM_BUCKETS - 1; b++) {
+		if (usec < limit) {
+			break;
+		}
+		limit *= 10;
+	}
+	g_lock_stats.wait_hist[b] += 1;
+
+	p->wait_usec += usec;
+	p->max_wait_usec = MAX(p->max_wait_usec, usec);
+}
+
+static void g_lock_stats_print(FILE *f)
+{
+	static const char *bucket_names[G_LOCK_STATS_NUM_BUCKETS] = {
+		"<10us", "<100us", "<1ms", "<10ms",
+		"<100ms", "<1s", "<10s", ">=10s",
+	};
+	size_t i;
+
+	fprintf(f, "g_lock statistics for pid %d\n", (int)getpid());
+	fprintf(f, "uncontended: %"PRIu64"\n", g_lock_stats.uncontended);
+	fprintf(f, "contended:   %"PRIu64"\n", g_lock_stats.contended);
+	fprintf(f, "wakeups:     %"PRIu64"\n", g_lock_stats.wakeups);
+
+	fprintf(f, "\nwait time histogram:\n");
+	for (i = 0; i < G_LOCK_STATS_NUM_BUCKETS; i++) {
+		fprintf(f,
+			"  %-8s %"PRIu64"\n",
+			bucket_names[i],
+			g_lock_stats.wait_hist[i]);
+	}
+
+	fprintf(f,
+		"\n%-40s %12s %12s %14s %14s\n",
+		"key prefix",
+		"contended",
+		"wakeups",
+		"avg wait us",
+		"max wait us");
+
+	for (i = 0; i <= g_lock_stats.num_prefixes; i++) {
+		const struct g_lock_prefix_stats *p =
+			(i < g_lock_stats.num_prefixes) ?
+			&g_lock_stats.prefixes[i] : &g_lock_stats.other;
+
+		if (p->contended == 0) {
+			continue;
+		}
+		fprintf(f,
+			"%-40s %12"PRIu64" %12"PRIu64" %14"PRIu64" "
+			"%14"PRIu64"\n",
+			p->prefix,
+			p->contended,
+			p->wakeups,
+			p->wait_usec / p->contended,
+			p->max_wait_usec);
+	}
+}
+
+static bool g_lock_stats_filter(struct messaging_rec *rec, void *private_data)
+{
+	FILE *f = NULL;
+
+	if (rec->msg_type != MSG_REQ_G_LOCK_STATS) {
+		return false;
+	}
+
+	DBG_DEBUG("Got MSG_REQ_G_LOCK_STATS\n");
+
+	if (rec->num_fds != 1) {
+		DBG_DEBUG("Got %"PRIu8" fds, expected one\n", rec->num_fds);
+		return false;
+	}
+
+	f = fdopen_keepfd(rec->fds[0], "w");
+	if (f == NULL) {
+		DBG_DEBUG("fdopen failed: %s\n", strerror(errno));
+		return false;
+	}
+
+	g_lock_stats_print(f);
+
+	fclose(f);
+	/*
+	 * Returning false keeps our messaging_filtered_read_send()
+	 * alive for the next request, see pool_usage_filter().
+	 */
+	return false;
+}
+
+/**
+ * Register handler for MSG_REQ_G_LOCK_STATS
+ **/
+void register_msg_g_lock_stats(
+	TALLOC_CTX *mem_ctx, struct messaging_context *msg_ctx)
+{
+	struct tevent_req *req = NULL;
+
+	req = messaging_filtered_read_send(
+		mem_ctx,
+		messaging_tevent_context(msg_ctx),
+		msg_ctx,
+		g_lock_stats_filter,
+		NULL);
+	if (req == NULL) {
+		DBG_WARNING("messaging_filtered_read_send failed\n");
+		return;
+	}
+	DBG_INFO("Registered MSG_REQ_G_LOCK_STATS\n");
+}
+
 static bool g_lock_parse(uint8_t *buf, size_t buflen, struct g_lock *lck)
 {
 	struct server_id exclusive;
@@ -665,6 +864,8 @@ struct g_lock_lock_state {
 	bool retry;
 	g_lock_lock_cb_fn_t cb_fn;
 	void *cb_private;
+	struct timeval wait_start;
+	struct g_lock_prefix_stats *stats;
 };
 
 struct g_lock_lock_fn_state {
@@ -931,6 +1132,21 @@ got_lock:
 	 */
 	dbwrap_watched_watch_remove_instance(rec, state->watch_instance);
 
+	if ((cb_state.new_shared != NULL) &&
+	    (retry || (req_state->type == G_LOCK_DOWNGRADE))) {
+		/*
+		 * dbwrap_watch only alerts the first waiter. We just
+		 * got a shared lock after waiting or gave up our
+		 * exclusive one, so the next waiter might be able
+		 * to share it with us: Pass the wakeup on instead of
+		 * letting it sleep until its timeout. This wakes
+		 * all queued readers one after the other, a writer
+		 * in the queue stops the chain by not alerting anyone
+		 * while it waits for us.
+		 */
+		dbwrap_watched_watch_reset_alerting(rec);
+	}
+
 	status = g_lock_lock_cb_run_and_store(&cb_state);
 	if (!NT_STATUS_IS_OK(status) &&
 	    !NT_STATUS_EQUAL(status, NT_STATUS_WAS_UNLOCKED))
@@ -1038,6 +1254,7 @@ struct tevent_req *g_lock_lock_send(TALLOC_CTX *mem_ctx,
 	}
 
 	if (NT_STATUS_IS_OK(fn_state.status)) {
+		g_lock_stats.uncontended += 1;
 		tevent_req_done(req);
 		return tevent_req_post(req, ev);
 	}
@@ -1050,6 +1267,11 @@ struct tevent_req *g_lock_lock_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
+	state->wait_start = timeval_current();
+	state->stats = g_lock_stats_prefix(ctx, key);
+	state->stats->contended += 1;
+	g_lock_stats.contended += 1;
+
 	ok = tevent_req_set_endtime(
 		fn_state.watch_req,
 		state->ev,
@@ -1086,6 +1308,8 @@ static void g_lock_lock_retry(struct tevent_req *subreq)
 	}
 
 	state->retry = true;
+	state->stats->wakeups += 1;
+	g_lock_stats.wakeups += 1;
 
 	fn_state = (struct g_lock_lock_fn_state) {
 		.req_state = state,
@@ -1101,6 +1325,11 @@ static void g_lock_lock_retry(struct tevent_req *subreq)
 		return;
 	}
 
+	if (NT_STATUS_IS_OK(fn_state.status) ||
+	    NT_STATUS_EQUAL(fn_state.status, NT_STATUS_WAS_UNLOCKED)) {
+		g_lock_stats_wait_done(state->stats, state->wait_start);
+	}
+
 	if (NT_STATUS_IS_OK(fn_state.status)) {
 		tevent_req_done(req);
 		return;
@@ -1278,6 +1507,10 @@ NTSTATUS g_lock_lock(struct g_lock_ctx *ctx, TDB_DATA key,
 			  nt_errstr(status),
 			  nt_errstr(state.status));
 
+		if (NT_STATUS_IS_OK(state.status) ||
+		    NT_STATUS_EQUAL(state.status, NT_STATUS_WAS_UNLOCKED)) {
+			g_lock_stats.uncontended += 1;
+		}
 		if (NT_STATUS_IS_OK(state.status)) {
 			if (ctx->lock_order != DBWRAP_LOCK_ORDER_NONE) {
 				const char *name = dbwrap_name(ctx->db);
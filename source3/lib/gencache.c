@@ -30,6 +30,7 @@
 #include "zlib.h"
 #include "lib/util/strv.h"
 #include "lib/util/util_paths.h"
+#include "lib/util/memcache.h"
 
 #undef  DBGC_CLASS
 #define DBGC_CLASS DBGC_TDB
@@ -38,6 +39,14 @@
 
 static struct tdb_wrap *cache;
 
+/*
+ * Per-process copy of recently read records. It is only valid for
+ * the tdb sequence number it was filled at, any modification of
+ * gencache.tdb by any process empties it.
+ */
+static struct memcache *cache_mem;
+static int cache_mem_seqnum = -1;
+
 /**
  * @file gencache.c
  * @brief Generic, persistent and shared between processes cache mechanism
@@ -59,6 +68,11 @@ bool gencache_timeout_expired(const struct gencache_timeout *t)
 	return t->timeout <= time(NULL);
 }
 
+time_t gencache_timeout_value(const struct gencache_timeout *t)
+{
+	return t->timeout;
+}
+
 /**
  * Cache initialisation function. Opens cache tdb file or creates
  * it if does not exist.
@@ -71,8 +85,10 @@ static bool gencache_init(void)
 {
 	char* cache_fname = NULL;
 	int open_flags = O_RDWR|O_CREAT;
-	int tdb_flags = TDB_INCOMPATIBLE_HASH|TDB_NOSYNC|TDB_MUTEX_LOCKING;
+	int tdb_flags = TDB_INCOMPATIBLE_HASH|TDB_NOSYNC|TDB_MUTEX_LOCKING|
+		TDB_SEQNUM;
 	int hash_size;
+	unsigned long memcache_size;
 
 	/* skip file open if it's already opened */
 	if (cache) {
@@ -154,9 +170,31 @@ static bool gencache_init(void)
 	}
 	TALLOC_FREE(cache_fname);
 
+	memcache_size = lp_parm_ulong(-1, "gencache", "memcache_size",
+				      256 * 1024);
+	if (memcache_size != 0) {
+		cache_mem = memcache_init(cache, memcache_size);
+	}
+
 	return true;
 }
 
+/**
+ * Return the sequence number of the cache file. It changes whenever
+ * any process modifies the cache, so it can be used to validate
+ * values derived from the cache and kept in memory.
+ *
+ * @retval -1 if the cache can't be opened
+ **/
+
+int gencache_seqnum(void)
+{
+	if (!gencache_init()) {
+		return -1;
+	}
+	return tdb_get_seqnum(cache->tdb);
+}
+
 /*
  * Walk the hash chain for "key", deleting all expired entries for
  * that hash chain
@@ -390,6 +428,7 @@ struct gencache_parse_state {
 		       void *private_data);
 	void *private_data;
 	bool format_error;
+	bool add_to_mem;
 };
 
 static int gencache_parse_fn(TDB_DATA key, TDB_DATA data, void *private_data)
@@ -404,11 +443,61 @@ static int gencache_parse_fn(TDB_DATA key, TDB_DATA data, void *private_data)
 		state->format_error = true;
 		return 0;
 	}
+
+	if (state->add_to_mem) {
+		memcache_add(cache_mem,
+			     GENCACHE_RECORD_CACHE,
+			     data_blob_const(key.dptr, key.dsize),
+			     data_blob_const(data.dptr, data.dsize));
+	}
+
 	state->parser(&t, payload, state->private_data);
 
 	return 0;
 }
 
+/*
+ * Look for "key" in the in-memory copy, flushing it first if
+ * gencache.tdb has changed since it was filled.
+ */
+static bool gencache_parse_mem(TDB_DATA key,
+			       struct gencache_parse_state *state)
+{
+	DATA_BLOB value;
+	int seqnum;
+	bool ok;
+
+	if (cache_mem == NULL) {
+		return false;
+	}
+
+	seqnum = tdb_get_seqnum(cache->tdb);
+	if (seqnum != cache_mem_seqnum) {
+		memcache_flush(cache_mem, GENCACHE_RECORD_CACHE);
+		cache_mem_seqnum = seqnum;
+	}
+
+	ok = memcache_lookup(cache_mem,
+			     GENCACHE_RECORD_CACHE,
+			     data_blob_const(key.dptr, key.dsize),
+			     &value);
+	if (!ok) {
+		/*
+		 * Fill it from tdb. The sequence number was read
+		 * before the record, so a concurrent change flushes
+		 * what we add.
+		 */
+		state->add_to_mem = true;
+		return false;
+	}
+
+	gencache_parse_fn(key,
+			  (TDB_DATA) { .dptr = value.data,
+				       .dsize = value.length },
+			  state);
+	return !state->format_error;
+}
+
 bool gencache_parse(const char *keystr,
 		    void (*parser)(const struct gencache_timeout *timeout,
 				   DATA_BLOB blob,
@@ -428,6 +517,10 @@ bool gencache_parse(const char *keystr,
 		return false;
 	}
 
+	if (gencache_parse_mem(key, &state)) {
+		return true;
+	}
+
 	ret = tdb_parse_record(cache->tdb, key,
 			       gencache_parse_fn, &state);
 	if ((ret == -1) && (tdb_error(cache->tdb) == TDB_ERR_CORRUPT)) {
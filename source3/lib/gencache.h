@@ -39,6 +39,8 @@ bool gencache_get(const char *keystr, TALLOC_CTX *mem_ctx, char **value,
  */
 struct gencache_timeout;
 bool gencache_timeout_expired(const struct gencache_timeout *t);
+time_t gencache_timeout_value(const struct gencache_timeout *t);
+int gencache_seqnum(void);
 
 bool gencache_parse(const char *keystr,
 		    void (*parser)(const struct gencache_timeout *timeout,
@@ -23,115 +23,213 @@
 #include "../librpc/gen_ndr/idmap.h"
 #include "lib/gencache.h"
 #include "lib/util/string_wrappers.h"
+#include "lib/util/memcache.h"
 
-/**
- * Find a sid2xid mapping
- * @param[in] sid		the sid to map
- * @param[out] id		where to put the result
- * @param[out] expired		is the cache entry expired?
- * @retval Was anything in the cache at all?
- *
- * If id->id == -1 this was a negative mapping.
+/*
+ * smbd keeps recently used mappings in its memcache, keyed by the
+ * binary SID or xid. This avoids formatting the gencache key and
+ * parsing the value again for every token we build. An entry is only
+ * used as long as gencache has not been modified by anyone since the
+ * entry was added.
  */
 
-bool idmap_cache_find_sid2unixid(const struct dom_sid *sid, struct unixid *id,
-				 bool *expired)
+struct idmap_cache_sid2xid_entry {
+	int seqnum;
+	time_t timeout;
+	struct unixid id;
+};
+
+struct idmap_cache_xid2sid_entry {
+	int seqnum;
+	time_t timeout;
+	struct dom_sid sid;
+};
+
+struct idmap_cache_xid_key {
+	uint32_t type;
+	uint32_t id;
+};
+
+static DATA_BLOB idmap_cache_sid_key(const struct dom_sid *sid)
 {
-	struct dom_sid_buf sidstr;
-	char *key;
-	char *value = NULL;
-	char *endptr;
+	if ((sid->num_auths < 0) ||
+	    ((size_t)sid->num_auths > ARRAY_SIZE(sid->sub_auths))) {
+		return data_blob_null;
+	}
+	return data_blob_const(
+		sid,
+		offsetof(struct dom_sid, sub_auths) +
+		sid->num_auths * sizeof(sid->sub_auths[0]));
+}
+
+struct idmap_cache_sid2xid_state {
+	const char *key;
+	struct unixid id;
 	time_t timeout;
 	bool ret;
-	struct unixid tmp_id;
+};
 
-	key = talloc_asprintf(talloc_tos(), "IDMAP/SID2XID/%s",
-			      dom_sid_str_buf(sid, &sidstr));
-	if (key == NULL) {
-		return false;
+static void idmap_cache_sid2xid_parser(const struct gencache_timeout *timeout,
+				       DATA_BLOB blob,
+				       void *private_data)
+{
+	struct idmap_cache_sid2xid_state *state = private_data;
+	const char *key = state->key;
+	char *value;
+	char *endptr;
+
+	state->timeout = gencache_timeout_value(timeout);
+	if (state->timeout == 0) {
+		/* delete marker */
+		return;
 	}
-	ret = gencache_get(key, talloc_tos(), &value, &timeout);
-	if (!ret) {
-		goto done;
+
+	if ((blob.length == 0) || (blob.data[blob.length-1] != 0)) {
+		/*
+		 * Not a string, can't be a valid mapping
+		 */
+		return;
 	}
+	value = (char *)blob.data;
 
 	DEBUG(10, ("Parsing value for key [%s]: value=[%s]\n", key, value));
 
 	if (value[0] == '\0') {
 		DEBUG(0, ("Failed to parse value for key [%s]: "
 			  "value is empty\n", key));
-		ret = false;
-		goto done;
+		return;
 	}
 
-	tmp_id.id = strtol(value, &endptr, 10);
+	state->id.id = strtol(value, &endptr, 10);
 
-	if ((value == endptr) && (tmp_id.id == 0)) {
+	if ((value == endptr) && (state->id.id == 0)) {
 		DEBUG(0, ("Failed to parse value for key [%s]: value[%s] does "
 			  "not start with a number\n", key, value));
-		ret = false;
-		goto done;
+		return;
 	}
 
 	DEBUG(10, ("Parsing value for key [%s]: id=[%llu], endptr=[%s]\n",
-		   key, (unsigned long long)tmp_id.id, endptr));
+		   key, (unsigned long long)state->id.id, endptr));
 
-	ret = (*endptr == ':');
-	if (ret) {
-		switch (endptr[1]) {
-		case 'U':
-			tmp_id.type = ID_TYPE_UID;
-			break;
+	if (*endptr != ':') {
+		DEBUG(0, ("FAILED to parse value for key [%s] (value=[%s]): "
+			  "colon missing after id=[%llu]\n",
+			  key, value, (unsigned long long)state->id.id));
+		return;
+	}
 
-		case 'G':
-			tmp_id.type = ID_TYPE_GID;
-			break;
+	switch (endptr[1]) {
+	case 'U':
+		state->id.type = ID_TYPE_UID;
+		break;
 
-		case 'B':
-			tmp_id.type = ID_TYPE_BOTH;
-			break;
+	case 'G':
+		state->id.type = ID_TYPE_GID;
+		break;
 
-		case 'N':
-			tmp_id.type = ID_TYPE_NOT_SPECIFIED;
-			break;
+	case 'B':
+		state->id.type = ID_TYPE_BOTH;
+		break;
 
-		case '\0':
-			DEBUG(0, ("FAILED to parse value for key [%s] "
-				  "(id=[%llu], endptr=[%s]): "
-				  "no type character after colon\n",
-				  key, (unsigned long long)tmp_id.id, endptr));
-			ret = false;
-			goto done;
-		default:
-			DEBUG(0, ("FAILED to parse value for key [%s] "
-				  "(id=[%llu], endptr=[%s]): "
-				  "illegal type character '%c'\n",
-				  key, (unsigned long long)tmp_id.id, endptr,
-				  endptr[1]));
-			ret = false;
-			goto done;
-		}
-		if (endptr[2] != '\0') {
-			DEBUG(0, ("FAILED to parse value for key [%s] "
-				  "(id=[%llu], endptr=[%s]): "
-				  "more than 1 type character after colon\n",
-				  key, (unsigned long long)tmp_id.id, endptr));
-			ret = false;
-			goto done;
+	case 'N':
+		state->id.type = ID_TYPE_NOT_SPECIFIED;
+		break;
+
+	case '\0':
+		DEBUG(0, ("FAILED to parse value for key [%s] "
+			  "(id=[%llu], endptr=[%s]): "
+			  "no type character after colon\n",
+			  key, (unsigned long long)state->id.id, endptr));
+		return;
+	default:
+		DEBUG(0, ("FAILED to parse value for key [%s] "
+			  "(id=[%llu], endptr=[%s]): "
+			  "illegal type character '%c'\n",
+			  key, (unsigned long long)state->id.id, endptr,
+			  endptr[1]));
+		return;
+	}
+	if (endptr[2] != '\0') {
+		DEBUG(0, ("FAILED to parse value for key [%s] "
+			  "(id=[%llu], endptr=[%s]): "
+			  "more than 1 type character after colon\n",
+			  key, (unsigned long long)state->id.id, endptr));
+		return;
+	}
+
+	state->ret = true;
+}
+
+/**
+ * Find a sid2xid mapping
+ * @param[in] sid		the sid to map
+ * @param[out] id		where to put the result
+ * @param[out] expired		is the cache entry expired?
+ * @retval Was anything in the cache at all?
+ *
+ * If id->id == -1 this was a negative mapping.
+ */
+
+bool idmap_cache_find_sid2unixid(const struct dom_sid *sid, struct unixid *id,
+				 bool *expired)
+{
+	struct idmap_cache_sid2xid_state state = { .ret = false };
+	struct idmap_cache_sid2xid_entry entry;
+	struct dom_sid_buf sidstr;
+	DATA_BLOB mkey = idmap_cache_sid_key(sid);
+	DATA_BLOB mval;
+	fstring key;
+	int seqnum;
+	bool ok;
+
+	seqnum = gencache_seqnum();
+
+	ok = (mkey.length != 0) &&
+		memcache_lookup(NULL, IDMAP_SID2XID_CACHE, mkey, &mval);
+	if (ok && (mval.length == sizeof(entry))) {
+		memcpy(&entry, mval.data, sizeof(entry));
+		if ((entry.seqnum == seqnum) &&
+		    (entry.timeout > time(NULL))) {
+			*id = entry.id;
+			*expired = false;
+			return true;
 		}
+		memcache_delete(NULL, IDMAP_SID2XID_CACHE, mkey);
+	}
 
-		*id = tmp_id;
-		*expired = (timeout <= time(NULL));
-	} else {
-		DEBUG(0, ("FAILED to parse value for key [%s] (value=[%s]): "
-			  "colon missing after id=[%llu]\n",
-			  key, value, (unsigned long long)tmp_id.id));
+	fstr_sprintf(key, "IDMAP/SID2XID/%s", dom_sid_str_buf(sid, &sidstr));
+	state.key = key;
+
+	ok = gencache_parse(key, idmap_cache_sid2xid_parser, &state);
+	if (!ok || !state.ret) {
+		return false;
 	}
 
-done:
-	TALLOC_FREE(key);
-	TALLOC_FREE(value);
-	return ret;
+	if (state.timeout <= time(NULL)) {
+		/*
+		 * Expired, remove the entry as gencache_get() would
+		 * have done
+		 */
+		gencache_set(key, "", 0);
+		return false;
+	}
+
+	*id = state.id;
+	*expired = false;
+
+	if ((mkey.length != 0) && (seqnum != -1)) {
+		entry = (struct idmap_cache_sid2xid_entry) {
+			.seqnum = seqnum,
+			.timeout = state.timeout,
+			.id = state.id,
+		};
+		memcache_add(NULL,
+			     IDMAP_SID2XID_CACHE,
+			     mkey,
+			     data_blob_const(&entry, sizeof(entry)));
+	}
+
+	return true;
 }
 
 /**
@@ -193,6 +291,7 @@ bool idmap_cache_find_sid2gid(const struct dom_sid *sid, gid_t *pgid,
 struct idmap_cache_xid2sid_state {
 	struct dom_sid *sid;
 	bool *expired;
+	time_t timeout;
 	bool ret;
 };
 
@@ -225,6 +324,7 @@ static void idmap_cache_xid2sid_parser(const struct gencache_timeout *timeout,
 	}
 	if (state->ret) {
 		*state->expired = gencache_timeout_expired(timeout);
+		state->timeout = gencache_timeout_value(timeout);
 	}
 }
 
@@ -243,8 +343,16 @@ bool idmap_cache_find_xid2sid(
 	struct idmap_cache_xid2sid_state state = {
 		.sid = sid, .expired = expired
 	};
+	struct idmap_cache_xid2sid_entry entry;
+	struct idmap_cache_xid_key xkey = {
+		.type = id->type, .id = id->id,
+	};
+	DATA_BLOB mkey = data_blob_const(&xkey, sizeof(xkey));
+	DATA_BLOB mval;
 	fstring key;
+	int seqnum;
 	char c;
+	bool ok;
 
 	switch (id->type) {
 	case ID_TYPE_UID:
@@ -257,9 +365,35 @@ bool idmap_cache_find_xid2sid(
 		return false;
 	}
 
+	seqnum = gencache_seqnum();
+
+	ok = memcache_lookup(NULL, IDMAP_XID2SID_CACHE, mkey, &mval);
+	if (ok && (mval.length == sizeof(entry))) {
+		memcpy(&entry, mval.data, sizeof(entry));
+		if (entry.seqnum == seqnum) {
+			*sid = entry.sid;
+			*expired = (entry.timeout <= time(NULL));
+			return true;
+		}
+		memcache_delete(NULL, IDMAP_XID2SID_CACHE, mkey);
+	}
+
 	fstr_sprintf(key, "IDMAP/%cID2SID/%d", c, (int)id->id);
 
 	gencache_parse(key, idmap_cache_xid2sid_parser, &state);
+
+	if (state.ret && (seqnum != -1)) {
+		entry = (struct idmap_cache_xid2sid_entry) {
+			.seqnum = seqnum,
+			.timeout = state.timeout,
+			.sid = *sid,
+		};
+		memcache_add(NULL,
+			     IDMAP_XID2SID_CACHE,
+			     mkey,
+			     data_blob_const(&entry, sizeof(entry)));
+	}
+
 	return state.ret;
 }
 
@@ -63,6 +63,7 @@
 #include "ctdbd_conn.h"
 #include "ctdb_srvids.h"
 #include "source3/lib/tallocmsg.h"
+#include "g_lock.h"
 
 #ifdef CLUSTER_SUPPORT
 #include "ctdb_protocol.h"
@@ -597,6 +598,7 @@ static NTSTATUS messaging_init_internal(TALLOC_CTX *mem_ctx,
 	/* Register some debugging related messages */
 
 	register_msg_pool_usage(ctx->per_process_talloc_ctx, ctx);
+	register_msg_g_lock_stats(ctx->per_process_talloc_ctx, ctx);
 	register_dmalloc_msgs(ctx);
 	debug_register_msgs(ctx);
 
@@ -694,6 +696,7 @@ NTSTATUS messaging_reinit(struct messaging_context *msg_ctx)
 
 	server_id_db_reinit(msg_ctx->names_db, msg_ctx->id);
 	register_msg_pool_usage(msg_ctx->per_process_talloc_ctx, msg_ctx);
+	register_msg_g_lock_stats(msg_ctx->per_process_talloc_ctx, msg_ctx);
 
 	return NT_STATUS_OK;
 }
@@ -130,6 +130,7 @@ static bool set_privileges( const struct dom_sid *sid, uint64_t mask )
 	struct dom_sid_buf tmp;
 	fstring keystr;
 	TDB_DATA data = { .dptr = privbuf, .dsize = sizeof(privbuf), };
+	NTSTATUS status;
 
 	if ( !lp_enable_privileges() )
 		return False;
@@ -149,8 +150,13 @@ static bool set_privileges( const struct dom_sid *sid, uint64_t mask )
 	/* This writes the 64 bit bitmask out in little endian format */
 	SBVAL(privbuf,0,mask);
 
-	return NT_STATUS_IS_OK(dbwrap_store_bystring(db, keystr, data,
-						     TDB_REPLACE));
+	status = dbwrap_store_bystring(db, keystr, data, TDB_REPLACE);
+	if (!NT_STATUS_IS_OK(status)) {
+		return false;
+	}
+
+	pdb_token_cache_generation_bump();
+	return true;
 }
 
 /*********************************************************************
@@ -471,6 +477,7 @@ NTSTATUS privilege_delete_account(const struct dom_sid *sid)
 	struct db_context *db = get_account_pol_db();
 	struct dom_sid_buf tmp;
 	fstring keystr;
+	NTSTATUS status;
 
 	if (!lp_enable_privileges()) {
 		return NT_STATUS_OK;
@@ -488,7 +495,11 @@ NTSTATUS privilege_delete_account(const struct dom_sid *sid)
 
 	fstr_sprintf(keystr, "%s%s", PRIVPREFIX, dom_sid_str_buf(sid, &tmp));
 
-	return dbwrap_delete_bystring(db, keystr);
+	status = dbwrap_delete_bystring(db, keystr);
+	if (NT_STATUS_IS_OK(status)) {
+		pdb_token_cache_generation_bump();
+	}
+	return status;
 }
 
 /*******************************************************************
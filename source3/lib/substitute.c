@@ -310,6 +310,11 @@ char *talloc_sub_basic(TALLOC_CTX *mem_ctx,
 		return NULL;
 	}
 
+	if (strchr(str, '%') == NULL) {
+		/* Nothing to substitute */
+		return talloc_strdup(mem_ctx, str);
+	}
+
 	a_string = talloc_strdup(mem_ctx, str);
 	if (a_string == NULL) {
 		DEBUG(0, ("talloc_sub_basic: Out of memory!\n"));
@@ -663,6 +668,11 @@ char *talloc_sub_full(TALLOC_CTX *ctx,
 {
 	char *a_string, *ret_string;
 
+	if (str != NULL && strchr(str, '%') == NULL) {
+		/* Nothing to substitute */
+		return talloc_strdup(ctx, str);
+	}
+
 	a_string = talloc_sub_advanced(ctx, servicename, user, connectpath,
 				       gid, str);
 	if (a_string == NULL) {
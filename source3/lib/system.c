@@ -36,6 +36,10 @@
 #include <sys/prctl.h>
 #endif
 
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
+
 /*
    The idea is that this file will eventually have wrappers around all
    important system calls in samba. The aims are:
@@ -1067,6 +1071,139 @@ int sys_get_number_of_cores(void)
 }
 #endif
 
+/*******************************************************************
+ Return the CPU that processed the last packet received on a socket,
+ see SO_INCOMING_CPU in socket(7). -1 if not known.
+********************************************************************/
+
+int sys_socket_incoming_cpu(int fd)
+{
+#ifdef SO_INCOMING_CPU
+	int cpu = -1;
+	socklen_t len = sizeof(cpu);
+	int ret;
+
+	ret = getsockopt(fd, SOL_SOCKET, SO_INCOMING_CPU, &cpu, &len);
+	if (ret != 0) {
+		return -1;
+	}
+	return cpu;
+#else
+	return -1;
+#endif
+}
+
+/*******************************************************************
+ Return the NUMA node a CPU belongs to, -1 if not known.
+********************************************************************/
+
+int sys_cpu_numa_node(int cpu)
+{
+	char path[64];
+	DIR *dir = NULL;
+	struct dirent *de = NULL;
+	int node = -1;
+
+	if (cpu < 0) {
+		return -1;
+	}
+
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d", cpu);
+	dir = opendir(path);
+	if (dir == NULL) {
+		return -1;
+	}
+	while ((de = readdir(dir)) != NULL) {
+		unsigned int n;
+		char c;
+
+		if (sscanf(de->d_name, "node%u%c", &n, &c) == 1) {
+			node = n;
+			break;
+		}
+	}
+	closedir(dir);
+
+	return node;
+}
+
+/*******************************************************************
+ Bind the calling process to a CPU or, if node is not -1, to all
+ CPUs of a NUMA node.
+********************************************************************/
+
+bool sys_set_cpu_affinity(int cpu, int node)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+	cpu_set_t cpuset;
+	int ret;
+
+	CPU_ZERO(&cpuset);
+
+	if (node >= 0) {
+		char path[64];
+		char buf[1024];
+		char *p = NULL;
+		FILE *f = NULL;
+
+		snprintf(path, sizeof(path),
+			 "/sys/devices/system/node/node%d/cpulist", node);
+		f = fopen(path, "r");
+		if (f == NULL) {
+			return false;
+		}
+		p = fgets(buf, sizeof(buf), f);
+		fclose(f);
+		if (p == NULL) {
+			errno = EINVAL;
+			return false;
+		}
+
+		/* The format is "0-15,64-79" */
+		while (*p != '\0' && *p != '\n') {
+			unsigned long first, last;
+			char *end = NULL;
+
+			first = strtoul(p, &end, 10);
+			if (end == p) {
+				errno = EINVAL;
+				return false;
+			}
+			last = first;
+			p = end;
+			if (*p == '-') {
+				p += 1;
+				last = strtoul(p, &end, 10);
+				if (end == p) {
+					errno = EINVAL;
+					return false;
+				}
+				p = end;
+			}
+			for (; first <= last && first < CPU_SETSIZE; first++) {
+				CPU_SET(first, &cpuset);
+			}
+			if (*p == ',') {
+				p += 1;
+			}
+		}
+	} else if (cpu >= 0 && cpu < CPU_SETSIZE) {
+		CPU_SET(cpu, &cpuset);
+	}
+
+	if (CPU_COUNT(&cpuset) == 0) {
+		errno = EINVAL;
+		return false;
+	}
+
+	ret = sched_setaffinity(0, sizeof(cpuset), &cpuset);
+	return (ret == 0);
+#else
+	errno = ENOSYS;
+	return false;
+#endif
+}
+
 bool sys_have_proc_fds(void)
 {
 	static bool checked = false;
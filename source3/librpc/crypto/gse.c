@@ -714,6 +714,7 @@ static NTSTATUS gse_get_server_auth_token(TALLOC_CTX *mem_ctx,
 	NTSTATUS status;
 	OM_uint32 time_rec = 0;
 	struct timeval tv;
+	bool initial_token = (gse_ctx->gssapi_context == GSS_C_NO_CONTEXT);
 
 	in_data.value = token_in->data;
 	in_data.length = token_in->length;
@@ -762,6 +763,24 @@ static NTSTATUS gse_get_server_auth_token(TALLOC_CTX *mem_ctx,
 	}
 #endif /* GSS_C_CHANNEL_BOUND_FLAG */
 
+	if (initial_token &&
+	    (gss_maj == GSS_S_COMPLETE || gss_maj == GSS_S_CONTINUE_NEEDED) &&
+	    gensec_setting_bool(gensec_security->settings,
+				"gensec_gssapi",
+				"replay cache",
+				false))
+	{
+		status = gssapi_replay_cache_check(
+			gensec_security->settings->lp_ctx, token_in);
+		if (!NT_STATUS_IS_OK(status)) {
+			gss_release_buffer(&gss_min, &out_data);
+			gss_delete_sec_context(&gss_min,
+					       &gse_ctx->gssapi_context,
+					       GSS_C_NO_BUFFER);
+			goto done;
+		}
+	}
+
 	switch (gss_maj) {
 	case GSS_S_COMPLETE:
 		/* we are done with it */
@@ -225,50 +225,28 @@ struct cli_smb2_create_fnum_state {
 static void cli_smb2_create_fnum_done(struct tevent_req *subreq);
 static bool cli_smb2_create_fnum_cancel(struct tevent_req *req);
 
-struct tevent_req *cli_smb2_create_fnum_send(
-	TALLOC_CTX *mem_ctx,
-	struct tevent_context *ev,
-	struct cli_state *cli,
-	const char *fname_in,
-	struct cli_smb2_create_flags create_flags,
-	uint32_t impersonation_level,
-	uint32_t desired_access,
-	uint32_t file_attributes,
-	uint32_t share_access,
-	uint32_t create_disposition,
-	uint32_t create_options,
-	const struct smb2_create_blobs *in_cblobs)
+/*
+ * Turn a client path into what an SMB2 CREATE needs: the DFS
+ * share prefix, no leading or trailing '\', @GMT tokens as TWrp
+ * create context. Also adds the POSIX create context if
+ * negotiated.
+ */
+static NTSTATUS cli_smb2_create_prepare(TALLOC_CTX *mem_ctx,
+					struct cli_state *cli,
+					const char *fname_in,
+					const struct smb2_create_blobs *in_cblobs,
+					char **pfname,
+					struct smb2_create_blobs *cblobs)
 {
-	struct tevent_req *req, *subreq;
-	struct cli_smb2_create_fnum_state *state;
 	char *fname = NULL;
 	size_t fname_len = 0;
 	bool have_twrp;
 	NTTIME ntt;
 	NTSTATUS status;
 
-	req = tevent_req_create(mem_ctx, &state,
-				struct cli_smb2_create_fnum_state);
-	if (req == NULL) {
-		return NULL;
-	}
-	state->ev = ev;
-	state->cli = cli;
-	state->create_flags = create_flags;
-	state->impersonation_level = impersonation_level;
-	state->desired_access = desired_access;
-	state->file_attributes = file_attributes;
-	state->share_access = share_access;
-	state->create_disposition = create_disposition;
-
-	if (cli->backup_intent) {
-		create_options |= FILE_OPEN_FOR_BACKUP_INTENT;
-	}
-	state->create_options = create_options;
-
-	fname = talloc_strdup(state, fname_in);
-	if (tevent_req_nomem(fname, req)) {
-		return tevent_req_post(req, ev);
+	fname = talloc_strdup(mem_ctx, fname_in);
+	if (fname == NULL) {
+		return NT_STATUS_NO_MEMORY;
 	}
 
 	if (cli->smb2.client_smb311_posix) {
@@ -277,15 +255,15 @@ struct tevent_req *cli_smb2_create_fnum_send(
 		};
 
 		status =
-			smb2_create_blob_add(state,
-					     &state->in_cblobs,
+			smb2_create_blob_add(mem_ctx,
+					     cblobs,
 					     SMB2_CREATE_TAG_POSIX,
 					     (DATA_BLOB){
 						     .data = modebuf,
 						     .length = sizeof(modebuf),
 					     });
-		if (tevent_req_nterror(req, status)) {
-			return tevent_req_post(req, ev);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
 		}
 	}
 
@@ -293,15 +271,15 @@ struct tevent_req *cli_smb2_create_fnum_send(
 	have_twrp = clistr_smb2_extract_snapshot_token(fname, &ntt);
 	if (have_twrp) {
 		status = smb2_create_blob_add(
-			state,
-			&state->in_cblobs,
+			mem_ctx,
+			cblobs,
 			SMB2_CREATE_TAG_TWRP,
 			(DATA_BLOB) {
 				.data = (uint8_t *)&ntt,
 				.length = sizeof(ntt),
 			});
-		if (tevent_req_nterror(req, status)) {
-			return tevent_req_post(req, ev);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
 		}
 	}
 
@@ -310,17 +288,16 @@ struct tevent_req *cli_smb2_create_fnum_send(
 		for (i=0; i<in_cblobs->num_blobs; i++) {
 			struct smb2_create_blob *b = &in_cblobs->blobs[i];
 			status = smb2_create_blob_add(
-				state, &state->in_cblobs, b->tag, b->data);
+				mem_ctx, cblobs, b->tag, b->data);
 			if (!NT_STATUS_IS_OK(status)) {
-				tevent_req_nterror(req, status);
-				return tevent_req_post(req, ev);
+				return status;
 			}
 		}
 	}
 
-	fname = smb2_dfs_share_path(state, cli, fname);
-	if (tevent_req_nomem(fname, req)) {
-		return tevent_req_post(req, ev);
+	fname = smb2_dfs_share_path(mem_ctx, cli, fname);
+	if (fname == NULL) {
+		return NT_STATUS_NO_MEMORY;
 	}
 	fname_len = strlen(fname);
 
@@ -336,8 +313,57 @@ struct tevent_req *cli_smb2_create_fnum_send(
 		fname_len -= 1;
 	}
 
-	state->fname = talloc_strndup(state, fname, fname_len);
-	if (tevent_req_nomem(state->fname, req)) {
+	*pfname = talloc_strndup(mem_ctx, fname, fname_len);
+	if (*pfname == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	return NT_STATUS_OK;
+}
+
+struct tevent_req *cli_smb2_create_fnum_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct cli_state *cli,
+	const char *fname_in,
+	struct cli_smb2_create_flags create_flags,
+	uint32_t impersonation_level,
+	uint32_t desired_access,
+	uint32_t file_attributes,
+	uint32_t share_access,
+	uint32_t create_disposition,
+	uint32_t create_options,
+	const struct smb2_create_blobs *in_cblobs)
+{
+	struct tevent_req *req, *subreq;
+	struct cli_smb2_create_fnum_state *state;
+	NTSTATUS status;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct cli_smb2_create_fnum_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->ev = ev;
+	state->cli = cli;
+	state->create_flags = create_flags;
+	state->impersonation_level = impersonation_level;
+	state->desired_access = desired_access;
+	state->file_attributes = file_attributes;
+	state->share_access = share_access;
+	state->create_disposition = create_disposition;
+
+	if (cli->backup_intent) {
+		create_options |= FILE_OPEN_FOR_BACKUP_INTENT;
+	}
+	state->create_options = create_options;
+
+	status = cli_smb2_create_prepare(state,
+					 cli,
+					 fname_in,
+					 in_cblobs,
+					 &state->fname,
+					 &state->in_cblobs);
+	if (tevent_req_nterror(req, status)) {
 		return tevent_req_post(req, ev);
 	}
 
@@ -2234,64 +2260,171 @@ static NTSTATUS get_fnum_from_path(struct cli_state *cli,
 	return status;
 }
 
-struct cli_smb2_qpathinfo_state {
+/*
+ * Statuses for which a CREATE + <op> + CLOSE compound is retried
+ * with separate requests: get_fnum_from_path() knows how to deal
+ * with symlinks and directories, and the compound needs enough
+ * credits for all three requests.
+ */
+static bool cli_smb2_compound_retry(NTSTATUS status)
+{
+	return (NT_STATUS_EQUAL(status, NT_STATUS_STOPPED_ON_SYMLINK) ||
+		NT_STATUS_EQUAL(status, NT_STATUS_IO_REPARSE_TAG_NOT_HANDLED) ||
+		NT_STATUS_EQUAL(status, NT_STATUS_FILE_IS_A_DIRECTORY) ||
+		NT_STATUS_EQUAL(status, NT_STATUS_INSUFFICIENT_RESOURCES));
+}
+
+/***************************************************************
+ Query info on a pathname. Sends CREATE, GETINFO and CLOSE as
+ one compound if possible.
+***************************************************************/
+
+struct cli_smb2_query_info_path_state {
 	struct tevent_context *ev;
 	struct cli_state *cli;
 	const char *fname;
+	uint32_t desired_access;
+	uint8_t info_type;
+	uint8_t info_class;
+	uint32_t max_output_length;
+	uint32_t additional_info;
 	uint16_t fnum;
-	uint16_t level;
-	uint32_t min_rdata;
-	uint32_t max_rdata;
 
 	NTSTATUS status;
 	DATA_BLOB out;
 };
 
-static void cli_smb2_qpathinfo_opened(struct tevent_req *subreq);
-static void cli_smb2_qpathinfo_done(struct tevent_req *subreq);
-static void cli_smb2_qpathinfo_closed(struct tevent_req *subreq);
+static void cli_smb2_query_info_path_compound_done(
+	struct tevent_req *subreq);
+static void cli_smb2_query_info_path_opened(struct tevent_req *subreq);
+static void cli_smb2_query_info_path_done(struct tevent_req *subreq);
+static void cli_smb2_query_info_path_closed(struct tevent_req *subreq);
 
-struct tevent_req *cli_smb2_qpathinfo_send(TALLOC_CTX *mem_ctx,
-					   struct tevent_context *ev,
-					   struct cli_state *cli,
-					   const char *fname,
-					   uint16_t level,
-					   uint32_t min_rdata,
-					   uint32_t max_rdata)
+struct tevent_req *cli_smb2_query_info_path_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct cli_state *cli,
+	const char *fname,
+	uint32_t desired_access,
+	uint8_t in_info_type,
+	uint8_t in_info_class,
+	uint32_t in_max_output_length,
+	uint32_t in_additional_info)
 {
 	struct tevent_req *req = NULL, *subreq = NULL;
-	struct cli_smb2_qpathinfo_state *state = NULL;
+	struct cli_smb2_query_info_path_state *state = NULL;
+	struct smb2_create_blobs cblobs = {
+		.num_blobs = 0,
+	};
+	char *name = NULL;
+	uint32_t create_options = 0;
+	NTSTATUS status;
 
 	req = tevent_req_create(mem_ctx,
 				&state,
-				struct cli_smb2_qpathinfo_state);
+				struct cli_smb2_query_info_path_state);
 	if (req == NULL) {
 		return NULL;
 	}
 	state->ev = ev;
 	state->cli = cli;
-	state->level = level;
-	state->min_rdata = min_rdata;
-	state->max_rdata = max_rdata;
+	state->fname = fname;
+	state->desired_access = desired_access;
+	state->info_type = in_info_type;
+	state->info_class = in_info_class;
+	state->max_output_length = in_max_output_length;
+	state->additional_info = in_additional_info;
 
-	subreq = get_fnum_from_path_send(state,
-					 ev,
+	status = cli_smb2_create_prepare(state,
 					 cli,
 					 fname,
-					 FILE_READ_ATTRIBUTES);
+					 NULL,
+					 &name,
+					 &cblobs);
+	if (tevent_req_nterror(req, status)) {
+		return tevent_req_post(req, ev);
+	}
+
+	if (cli->backup_intent) {
+		create_options |= FILE_OPEN_FOR_BACKUP_INTENT;
+	}
+
+	subreq = smb2cli_create_query_info_close_send(
+		state,
+		ev,
+		cli->conn,
+		cli->timeout,
+		cli->smb2.session,
+		cli->smb2.tcon,
+		name,
+		desired_access,
+		FILE_SHARE_READ|
+		FILE_SHARE_WRITE|
+		FILE_SHARE_DELETE, /* share_access */
+		create_options,
+		&cblobs,
+		in_info_type,
+		in_info_class,
+		in_max_output_length,
+		in_additional_info,
+		0);	/* in_flags */
 	if (tevent_req_nomem(subreq, req)) {
 		return tevent_req_post(req, ev);
 	}
-	tevent_req_set_callback(subreq, cli_smb2_qpathinfo_opened, req);
+	tevent_req_set_callback(subreq,
+				cli_smb2_query_info_path_compound_done,
+				req);
 	return req;
 }
 
-static void cli_smb2_qpathinfo_opened(struct tevent_req *subreq)
+static void cli_smb2_query_info_path_compound_done(
+	struct tevent_req *subreq)
 {
 	struct tevent_req *req =
 		tevent_req_callback_data(subreq, struct tevent_req);
-	struct cli_smb2_qpathinfo_state *state =
-		tevent_req_data(req, struct cli_smb2_qpathinfo_state);
+	struct cli_smb2_query_info_path_state *state =
+		tevent_req_data(req, struct cli_smb2_query_info_path_state);
+	DATA_BLOB out = data_blob_null;
+	NTSTATUS status;
+
+	status = smb2cli_create_query_info_close_recv(subreq,
+						      state,
+						      NULL,
+						      &out);
+	TALLOC_FREE(subreq);
+
+	if (cli_smb2_compound_retry(status)) {
+		subreq = get_fnum_from_path_send(state,
+						 state->ev,
+						 state->cli,
+						 state->fname,
+						 state->desired_access);
+		if (tevent_req_nomem(subreq, req)) {
+			return;
+		}
+		tevent_req_set_callback(subreq,
+					cli_smb2_query_info_path_opened,
+					req);
+		return;
+	}
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+
+	/* out points into the response buffer */
+	state->out = data_blob_talloc(state, out.data, out.length);
+	if ((out.length > 0) && tevent_req_nomem(state->out.data, req)) {
+		return;
+	}
+	tevent_req_done(req);
+}
+
+static void cli_smb2_query_info_path_opened(struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+		tevent_req_callback_data(subreq, struct tevent_req);
+	struct cli_smb2_query_info_path_state *state =
+		tevent_req_data(req, struct cli_smb2_query_info_path_state);
 	NTSTATUS status;
 
 	status = get_fnum_from_path_recv(subreq, &state->fnum);
@@ -2304,34 +2437,29 @@ static void cli_smb2_qpathinfo_opened(struct tevent_req *subreq)
 					       state->ev,
 					       state->cli,
 					       state->fnum,
-					       SMB2_0_INFO_FILE,
-					       state->level,
-					       state->max_rdata,
+					       state->info_type,
+					       state->info_class,
+					       state->max_output_length,
 					       NULL, /* in_input_buffer */
-					       0,    /* in_additional_info */
+					       state->additional_info,
 					       0);   /* in_flags */
 	if (tevent_req_nomem(subreq, req)) {
 		return;
 	}
-	tevent_req_set_callback(subreq, cli_smb2_qpathinfo_done, req);
+	tevent_req_set_callback(subreq, cli_smb2_query_info_path_done, req);
 }
 
-static void cli_smb2_qpathinfo_done(struct tevent_req *subreq)
+static void cli_smb2_query_info_path_done(struct tevent_req *subreq)
 {
 	struct tevent_req *req =
 		tevent_req_callback_data(subreq, struct tevent_req);
-	struct cli_smb2_qpathinfo_state *state =
-		tevent_req_data(req, struct cli_smb2_qpathinfo_state);
+	struct cli_smb2_query_info_path_state *state =
+		tevent_req_data(req, struct cli_smb2_query_info_path_state);
 
 	state->status =
 		cli_smb2_query_info_fnum_recv(subreq, state, &state->out);
 	TALLOC_FREE(subreq);
 
-	if (NT_STATUS_IS_OK(state->status) &&
-	    (state->out.length < state->min_rdata)) {
-		state->status = NT_STATUS_INVALID_NETWORK_RESPONSE;
-	}
-
 	subreq = cli_smb2_close_fnum_send(state,
 					  state->ev,
 					  state->cli,
@@ -2340,15 +2468,15 @@ static void cli_smb2_qpathinfo_done(struct tevent_req *subreq)
 	if (tevent_req_nomem(subreq, req)) {
 		return;
 	}
-	tevent_req_set_callback(subreq, cli_smb2_qpathinfo_closed, req);
+	tevent_req_set_callback(subreq, cli_smb2_query_info_path_closed, req);
 }
 
-static void cli_smb2_qpathinfo_closed(struct tevent_req *subreq)
+static void cli_smb2_query_info_path_closed(struct tevent_req *subreq)
 {
 	struct tevent_req *req =
 		tevent_req_callback_data(subreq, struct tevent_req);
-	struct cli_smb2_qpathinfo_state *state =
-		tevent_req_data(req, struct cli_smb2_qpathinfo_state);
+	struct cli_smb2_query_info_path_state *state =
+		tevent_req_data(req, struct cli_smb2_query_info_path_state);
 	NTSTATUS status;
 
 	status = cli_smb2_close_fnum_recv(subreq);
@@ -2362,6 +2490,87 @@ static void cli_smb2_qpathinfo_closed(struct tevent_req *subreq)
 	tevent_req_done(req);
 }
 
+NTSTATUS cli_smb2_query_info_path_recv(struct tevent_req *req,
+				       TALLOC_CTX *mem_ctx,
+				       DATA_BLOB *outbuf)
+{
+	struct cli_smb2_query_info_path_state *state =
+		tevent_req_data(req, struct cli_smb2_query_info_path_state);
+	NTSTATUS status;
+
+	if (tevent_req_is_nterror(req, &status)) {
+		tevent_req_received(req);
+		return status;
+	}
+
+	outbuf->data = talloc_move(mem_ctx, &state->out.data);
+	outbuf->length = state->out.length;
+	tevent_req_received(req);
+	return NT_STATUS_OK;
+}
+
+struct cli_smb2_qpathinfo_state {
+	uint32_t min_rdata;
+	DATA_BLOB out;
+};
+
+static void cli_smb2_qpathinfo_done(struct tevent_req *subreq);
+
+struct tevent_req *cli_smb2_qpathinfo_send(TALLOC_CTX *mem_ctx,
+					   struct tevent_context *ev,
+					   struct cli_state *cli,
+					   const char *fname,
+					   uint16_t level,
+					   uint32_t min_rdata,
+					   uint32_t max_rdata)
+{
+	struct tevent_req *req = NULL, *subreq = NULL;
+	struct cli_smb2_qpathinfo_state *state = NULL;
+
+	req = tevent_req_create(mem_ctx,
+				&state,
+				struct cli_smb2_qpathinfo_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->min_rdata = min_rdata;
+
+	subreq = cli_smb2_query_info_path_send(state,
+					       ev,
+					       cli,
+					       fname,
+					       FILE_READ_ATTRIBUTES,
+					       SMB2_0_INFO_FILE,
+					       level,
+					       max_rdata,
+					       0); /* in_additional_info */
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, cli_smb2_qpathinfo_done, req);
+	return req;
+}
+
+static void cli_smb2_qpathinfo_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+		tevent_req_callback_data(subreq, struct tevent_req);
+	struct cli_smb2_qpathinfo_state *state =
+		tevent_req_data(req, struct cli_smb2_qpathinfo_state);
+	NTSTATUS status;
+
+	status = cli_smb2_query_info_path_recv(subreq, state, &state->out);
+	TALLOC_FREE(subreq);
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+	if (state->out.length < state->min_rdata) {
+		tevent_req_nterror(req, NT_STATUS_INVALID_NETWORK_RESPONSE);
+		return;
+	}
+	tevent_req_done(req);
+}
+
 NTSTATUS cli_smb2_qpathinfo_recv(struct tevent_req *req,
 				 TALLOC_CTX *mem_ctx,
 				 uint8_t **rdata,
@@ -2381,6 +2590,211 @@ NTSTATUS cli_smb2_qpathinfo_recv(struct tevent_req *req,
 	return NT_STATUS_OK;
 }
 
+/***************************************************************
+ Set info on a pathname. Sends CREATE, SETINFO and CLOSE as one
+ compound if possible.
+***************************************************************/
+
+struct cli_smb2_set_info_path_state {
+	struct tevent_context *ev;
+	struct cli_state *cli;
+	const char *fname;
+	uint32_t desired_access;
+	uint8_t info_type;
+	uint8_t info_class;
+	DATA_BLOB in_buf;
+	uint32_t additional_info;
+	uint16_t fnum;
+
+	NTSTATUS status;
+};
+
+static void cli_smb2_set_info_path_compound_done(
+	struct tevent_req *subreq);
+static void cli_smb2_set_info_path_opened(struct tevent_req *subreq);
+static void cli_smb2_set_info_path_done(struct tevent_req *subreq);
+static void cli_smb2_set_info_path_closed(struct tevent_req *subreq);
+
+struct tevent_req *cli_smb2_set_info_path_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct cli_state *cli,
+	const char *fname,
+	uint32_t desired_access,
+	uint8_t in_info_type,
+	uint8_t in_info_class,
+	const DATA_BLOB *in_input_buffer,
+	uint32_t in_additional_info)
+{
+	struct tevent_req *req = NULL, *subreq = NULL;
+	struct cli_smb2_set_info_path_state *state = NULL;
+	struct smb2_create_blobs cblobs = {
+		.num_blobs = 0,
+	};
+	char *name = NULL;
+	uint32_t create_options = 0;
+	NTSTATUS status;
+
+	req = tevent_req_create(mem_ctx,
+				&state,
+				struct cli_smb2_set_info_path_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->ev = ev;
+	state->cli = cli;
+	state->fname = fname;
+	state->desired_access = desired_access;
+	state->info_type = in_info_type;
+	state->info_class = in_info_class;
+	state->in_buf = *in_input_buffer;
+	state->additional_info = in_additional_info;
+
+	status = cli_smb2_create_prepare(state,
+					 cli,
+					 fname,
+					 NULL,
+					 &name,
+					 &cblobs);
+	if (tevent_req_nterror(req, status)) {
+		return tevent_req_post(req, ev);
+	}
+
+	if (cli->backup_intent) {
+		create_options |= FILE_OPEN_FOR_BACKUP_INTENT;
+	}
+
+	subreq = smb2cli_create_set_info_close_send(
+		state,
+		ev,
+		cli->conn,
+		cli->timeout,
+		cli->smb2.session,
+		cli->smb2.tcon,
+		name,
+		desired_access,
+		FILE_SHARE_READ|
+		FILE_SHARE_WRITE|
+		FILE_SHARE_DELETE, /* share_access */
+		create_options,
+		&cblobs,
+		in_info_type,
+		in_info_class,
+		in_input_buffer,
+		in_additional_info);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq,
+				cli_smb2_set_info_path_compound_done,
+				req);
+	return req;
+}
+
+static void cli_smb2_set_info_path_compound_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+		tevent_req_callback_data(subreq, struct tevent_req);
+	struct cli_smb2_set_info_path_state *state =
+		tevent_req_data(req, struct cli_smb2_set_info_path_state);
+	NTSTATUS status;
+
+	status = smb2cli_create_set_info_close_recv(subreq);
+	TALLOC_FREE(subreq);
+
+	if (cli_smb2_compound_retry(status)) {
+		subreq = get_fnum_from_path_send(state,
+						 state->ev,
+						 state->cli,
+						 state->fname,
+						 state->desired_access);
+		if (tevent_req_nomem(subreq, req)) {
+			return;
+		}
+		tevent_req_set_callback(subreq,
+					cli_smb2_set_info_path_opened,
+					req);
+		return;
+	}
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+	tevent_req_done(req);
+}
+
+static void cli_smb2_set_info_path_opened(struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+		tevent_req_callback_data(subreq, struct tevent_req);
+	struct cli_smb2_set_info_path_state *state =
+		tevent_req_data(req, struct cli_smb2_set_info_path_state);
+	NTSTATUS status;
+
+	status = get_fnum_from_path_recv(subreq, &state->fnum);
+	TALLOC_FREE(subreq);
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+
+	subreq = cli_smb2_set_info_fnum_send(state,
+					     state->ev,
+					     state->cli,
+					     state->fnum,
+					     state->info_type,
+					     state->info_class,
+					     &state->in_buf,
+					     state->additional_info);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, cli_smb2_set_info_path_done, req);
+}
+
+static void cli_smb2_set_info_path_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+		tevent_req_callback_data(subreq, struct tevent_req);
+	struct cli_smb2_set_info_path_state *state =
+		tevent_req_data(req, struct cli_smb2_set_info_path_state);
+
+	state->status = cli_smb2_set_info_fnum_recv(subreq);
+	TALLOC_FREE(subreq);
+
+	subreq = cli_smb2_close_fnum_send(state,
+					  state->ev,
+					  state->cli,
+					  state->fnum,
+					  0);
+	if (tevent_req_nomem(subreq, req)) {
+		return;
+	}
+	tevent_req_set_callback(subreq, cli_smb2_set_info_path_closed, req);
+}
+
+static void cli_smb2_set_info_path_closed(struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+		tevent_req_callback_data(subreq, struct tevent_req);
+	struct cli_smb2_set_info_path_state *state =
+		tevent_req_data(req, struct cli_smb2_set_info_path_state);
+	NTSTATUS status;
+
+	status = cli_smb2_close_fnum_recv(subreq);
+	TALLOC_FREE(subreq);
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+	if (tevent_req_nterror(req, state->status)) {
+		return;
+	}
+	tevent_req_done(req);
+}
+
+NTSTATUS cli_smb2_set_info_path_recv(struct tevent_req *req)
+{
+	return tevent_req_simple_recv_ntstatus(req);
+}
+
 /***************************************************************
  Wrapper that allows SMB2 to set SMB_FILE_BASIC_INFORMATION on
  a pathname.
@@ -3874,6 +4288,7 @@ struct tevent_req *cli_smb2_read_send(TALLOC_CTX *mem_ctx,
 	NTSTATUS status;
 	struct tevent_req *req, *subreq;
 	struct cli_smb2_read_state *state;
+	struct smbXcli_session *session = NULL;
 
 	req = tevent_req_create(mem_ctx, &state, struct cli_smb2_read_state);
 	if (req == NULL) {
@@ -3893,11 +4308,18 @@ struct tevent_req *cli_smb2_read_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
+	/*
+	 * Reads on an open handle are independent of each other,
+	 * spread them over the channels of the session.
+	 */
+	session = smb2cli_session_select_channel(state->cli->smb2.session,
+						 state->size);
+
 	subreq = smb2cli_read_send(state,
 				state->ev,
-				state->cli->conn,
+				smbXcli_session_conn(session),
 				state->cli->timeout,
-				state->cli->smb2.session,
+				session,
 				state->cli->smb2.tcon,
 				state->size,
 				state->start_offset,
@@ -3981,6 +4403,7 @@ struct tevent_req *cli_smb2_write_send(TALLOC_CTX *mem_ctx,
 	NTSTATUS status;
 	struct tevent_req *req, *subreq = NULL;
 	struct cli_smb2_write_state *state = NULL;
+	struct smbXcli_session *session = NULL;
 
 	req = tevent_req_create(mem_ctx, &state, struct cli_smb2_write_state);
 	if (req == NULL) {
@@ -4002,11 +4425,14 @@ struct tevent_req *cli_smb2_write_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
+	session = smb2cli_session_select_channel(state->cli->smb2.session,
+						 state->size);
+
 	subreq = smb2cli_write_send(state,
 				state->ev,
-				state->cli->conn,
+				smbXcli_session_conn(session),
 				state->cli->timeout,
-				state->cli->smb2.session,
+				session,
 				state->cli->smb2.tcon,
 				state->size,
 				state->offset,
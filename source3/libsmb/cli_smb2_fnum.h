@@ -128,6 +128,30 @@ NTSTATUS cli_smb2_qpathinfo_recv(struct tevent_req *req,
 				 TALLOC_CTX *mem_ctx,
 				 uint8_t **rdata,
 				 uint32_t *num_rdata);
+struct tevent_req *cli_smb2_query_info_path_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct cli_state *cli,
+	const char *fname,
+	uint32_t desired_access,
+	uint8_t in_info_type,
+	uint8_t in_info_class,
+	uint32_t in_max_output_length,
+	uint32_t in_additional_info);
+NTSTATUS cli_smb2_query_info_path_recv(struct tevent_req *req,
+				       TALLOC_CTX *mem_ctx,
+				       DATA_BLOB *outbuf);
+struct tevent_req *cli_smb2_set_info_path_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct cli_state *cli,
+	const char *fname,
+	uint32_t desired_access,
+	uint8_t in_info_type,
+	uint8_t in_info_class,
+	const DATA_BLOB *in_input_buffer,
+	uint32_t in_additional_info);
+NTSTATUS cli_smb2_set_info_path_recv(struct tevent_req *req);
 struct tevent_req *cli_smb2_query_info_fnum_send(
 	TALLOC_CTX *mem_ctx,
 	struct tevent_context *ev,
@@ -323,6 +323,33 @@ static void cli_pull_setup_chunks(struct tevent_req *req);
 static void cli_pull_chunk_ship(struct cli_pull_chunk *chunk);
 static void cli_pull_chunk_done(struct tevent_req *subreq);
 
+/*
+ * The default window for cli_pull and cli_push.
+ *
+ * We use at least 16 MByte. With SMB2 we size the window by the
+ * credits the server granted us, so that a server handing out a
+ * lot of credits gets enough outstanding multi-credit requests to
+ * keep its disks busy. We only use half of the credits, the other
+ * half stays available for other requests on the connection.
+ */
+static size_t cli_rw_default_window_size(struct cli_state *cli)
+{
+	size_t window_size = 16 * 1024 * 1024;
+	size_t credit_window;
+
+	if (smbXcli_conn_protocol(cli->conn) < PROTOCOL_SMB2_02) {
+		return window_size;
+	}
+
+	credit_window = smb2cli_conn_get_cur_credits(cli->conn) / 2;
+	credit_window *= 65536;
+
+	window_size = MAX(window_size, credit_window);
+	window_size = MIN(window_size, 128 * 1024 * 1024);
+
+	return window_size;
+}
+
 /*
  * Parallel read support.
  *
@@ -374,10 +401,7 @@ struct tevent_req *cli_pull_send(TALLOC_CTX *mem_ctx,
 	}
 
 	if (window_size == 0) {
-		/*
-		 * We use 16 MByte as default window size.
-		 */
-		window_size = 16 * 1024 * 1024;
+		window_size = cli_rw_default_window_size(cli);
 	}
 
 	tmp64 = window_size/state->chunk_size;
@@ -1449,10 +1473,7 @@ struct tevent_req *cli_push_send(TALLOC_CTX *mem_ctx, struct tevent_context *ev,
 	}
 
 	if (window_size == 0) {
-		/*
-		 * We use 16 MByte as default window size.
-		 */
-		window_size = 16 * 1024 * 1024;
+		window_size = cli_rw_default_window_size(cli);
 	}
 
 	tmp64 = window_size/state->chunk_size;
@@ -372,3 +372,137 @@ NTSTATUS cli_set_secdesc(struct cli_state *cli, uint16_t fnum,
 
 	return cli_set_security_descriptor(cli, fnum, sec_info, sd);
 }
+
+/****************************************************************************
+  query the security descriptor of a path, without keeping the file
+  open. Over SMB2 this is a single CREATE/GETINFO/CLOSE compound.
+ ****************************************************************************/
+NTSTATUS cli_query_security_descriptor_path(struct cli_state *cli,
+					    const char *fname,
+					    uint32_t desired_access,
+					    uint32_t sec_info,
+					    TALLOC_CTX *mem_ctx,
+					    struct security_descriptor **sd)
+{
+	TALLOC_CTX *frame = NULL;
+	struct tevent_context *ev = NULL;
+	struct tevent_req *req = NULL;
+	DATA_BLOB outbuf = data_blob_null;
+	uint16_t fnum = (uint16_t)-1;
+	NTSTATUS status;
+
+	if (smbXcli_conn_protocol(cli->conn) < PROTOCOL_SMB2_02) {
+		status = cli_ntcreate(cli, fname, 0, desired_access,
+				      0, FILE_SHARE_READ|FILE_SHARE_WRITE,
+				      FILE_OPEN, 0x0, 0x0, &fnum, NULL);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+		status = cli_query_security_descriptor(
+			cli, fnum, sec_info, mem_ctx, sd);
+		cli_close(cli, fnum);
+		return status;
+	}
+
+	frame = talloc_stackframe();
+
+	if (smbXcli_conn_has_async_calls(cli->conn)) {
+		status = NT_STATUS_INVALID_PARAMETER;
+		goto fail;
+	}
+	status = NT_STATUS_NO_MEMORY;
+	ev = samba_tevent_context_init(frame);
+	if (ev == NULL) {
+		goto fail;
+	}
+	req = cli_smb2_query_info_path_send(
+		frame,		      /* mem_ctx */
+		ev,		      /* ev */
+		cli,		      /* cli */
+		fname,		      /* fname */
+		desired_access,	      /* desired_access */
+		SMB2_0_INFO_SECURITY, /* in_info_type */
+		0,		      /* in_info_class */
+		0xFFFF,		      /* in_max_output_length */
+		sec_info);	      /* in_additional_info */
+	if (req == NULL) {
+		goto fail;
+	}
+	if (!tevent_req_poll_ntstatus(req, ev, &status)) {
+		goto fail;
+	}
+	status = cli_smb2_query_info_path_recv(req, frame, &outbuf);
+	if (!NT_STATUS_IS_OK(status)) {
+		goto fail;
+	}
+	status = unmarshall_sec_desc(mem_ctx, outbuf.data, outbuf.length, sd);
+ fail:
+	TALLOC_FREE(frame);
+	return status;
+}
+
+/****************************************************************************
+  set the security descriptor of a path, without keeping the file
+  open. Over SMB2 this is a single CREATE/SETINFO/CLOSE compound.
+ ****************************************************************************/
+NTSTATUS cli_set_security_descriptor_path(struct cli_state *cli,
+					  const char *fname,
+					  uint32_t desired_access,
+					  uint32_t sec_info,
+					  const struct security_descriptor *sd)
+{
+	TALLOC_CTX *frame = NULL;
+	struct tevent_context *ev = NULL;
+	struct tevent_req *req = NULL;
+	DATA_BLOB buf = data_blob_null;
+	uint16_t fnum = (uint16_t)-1;
+	NTSTATUS status;
+
+	if (smbXcli_conn_protocol(cli->conn) < PROTOCOL_SMB2_02) {
+		status = cli_ntcreate(cli, fname, 0, desired_access,
+				      0, FILE_SHARE_READ|FILE_SHARE_WRITE,
+				      FILE_OPEN, 0x0, 0x0, &fnum, NULL);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+		status = cli_set_security_descriptor(cli, fnum, sec_info, sd);
+		cli_close(cli, fnum);
+		return status;
+	}
+
+	frame = talloc_stackframe();
+
+	if (smbXcli_conn_has_async_calls(cli->conn)) {
+		status = NT_STATUS_INVALID_PARAMETER;
+		goto fail;
+	}
+	status = marshall_sec_desc(frame, sd, &buf.data, &buf.length);
+	if (!NT_STATUS_IS_OK(status)) {
+		goto fail;
+	}
+	status = NT_STATUS_NO_MEMORY;
+	ev = samba_tevent_context_init(frame);
+	if (ev == NULL) {
+		goto fail;
+	}
+	req = cli_smb2_set_info_path_send(
+		frame,		      /* mem_ctx */
+		ev,		      /* ev */
+		cli,		      /* cli */
+		fname,		      /* fname */
+		desired_access,	      /* desired_access */
+		SMB2_0_INFO_SECURITY, /* in_info_type */
+		0,		      /* in_info_class */
+		&buf,		      /* in_input_buffer */
+		sec_info);	      /* in_additional_info */
+	if (req == NULL) {
+		goto fail;
+	}
+	if (!tevent_req_poll_ntstatus(req, ev, &status)) {
+		goto fail;
+	}
+	status = cli_smb2_set_info_path_recv(req);
+ fail:
+	TALLOC_FREE(frame);
+	return status;
+}
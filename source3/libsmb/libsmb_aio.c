@@ -0,0 +1,398 @@
+/*
+   Unix SMB/Netbios implementation.
+   SMB client library implementation
+   Async read/write
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "source3/include/client.h"
+#include "source3/libsmb/proto.h"
+#include "libsmbclient.h"
+#include "libsmb_internal.h"
+#include "../libcli/smb/smbXcli_base.h"
+#include "lib/util/tevent_ntstatus.h"
+
+/*
+ * The requests are sent with cli_read_send()/cli_write_send() on an
+ * event context private to the SMBCCTX. Nothing happens on the wire
+ * unless the application calls smbc_aio_poll() or smbc_aio_wait(),
+ * which is also where the completion callbacks are called.
+ *
+ * If the server does not grant enough credits for all requests,
+ * the ones that don't fit are kept back and sent once others
+ * have completed.
+ */
+
+struct smbc_aio_req {
+	struct smbc_aio_req *prev, *next;
+	SMBCCTX *context;
+	SMBCFILE *file;
+	bool write;
+	void *buf;
+	size_t count;
+	off_t offset;
+	smbc_aio_done_fn done_fn;
+	void *private_data;
+
+	struct tevent_req *subreq;
+	ssize_t result;
+	int err;
+};
+
+static void smbc_aio_done(struct tevent_req *subreq);
+
+static struct tevent_context *smbc_aio_ev(SMBCCTX *context)
+{
+	struct SMBC_internal_data *internal = context->internal;
+
+	if (internal->aio_ev == NULL) {
+		internal->aio_ev = samba_tevent_context_init(NULL);
+	}
+	return internal->aio_ev;
+}
+
+static bool smbc_aio_send(struct smbc_aio_req *r)
+{
+	struct tevent_context *ev = r->context->internal->aio_ev;
+
+	if (r->write) {
+		r->subreq = cli_write_send(r,
+					   ev,
+					   r->file->targetcli,
+					   r->file->cli_fd,
+					   0, /* mode */
+					   r->buf,
+					   r->offset,
+					   r->count);
+	} else {
+		r->subreq = cli_read_send(r,
+					  ev,
+					  r->file->targetcli,
+					  r->file->cli_fd,
+					  r->buf,
+					  r->offset,
+					  r->count);
+	}
+	if (r->subreq == NULL) {
+		return false;
+	}
+	tevent_req_set_callback(r->subreq, smbc_aio_done, r);
+	return true;
+}
+
+static void smbc_aio_resend_waiting(SMBCCTX *context)
+{
+	struct SMBC_internal_data *internal = context->internal;
+	struct smbc_aio_req *r = NULL, *next = NULL;
+
+	for (r = internal->aio_waiting; r != NULL; r = next) {
+		next = r->next;
+
+		DLIST_REMOVE(internal->aio_waiting, r);
+		DLIST_ADD_END(internal->aio_inflight, r);
+
+		if (!smbc_aio_send(r)) {
+			DLIST_REMOVE(internal->aio_inflight, r);
+			r->result = -1;
+			r->err = ENOMEM;
+			DLIST_ADD_END(internal->aio_completed, r);
+		}
+	}
+}
+
+static void smbc_aio_done(struct tevent_req *subreq)
+{
+	struct smbc_aio_req *r = tevent_req_callback_data(
+		subreq, struct smbc_aio_req);
+	struct SMBC_internal_data *internal = r->context->internal;
+	size_t nbytes = 0;
+	NTSTATUS status;
+
+	if (r->write) {
+		status = cli_write_recv(subreq, &nbytes);
+	} else {
+		status = cli_read_recv(subreq, &nbytes);
+	}
+	TALLOC_FREE(subreq);
+	r->subreq = NULL;
+
+	DLIST_REMOVE(internal->aio_inflight, r);
+
+	if (NT_STATUS_EQUAL(status, NT_STATUS_INSUFFICIENT_RESOURCES) &&
+	    (internal->aio_inflight != NULL))
+	{
+		/* Out of credits, wait for other requests */
+		DLIST_ADD_END(internal->aio_waiting, r);
+		return;
+	}
+
+	if (NT_STATUS_IS_OK(status)) {
+		r->result = nbytes;
+		r->err = 0;
+	} else {
+		r->result = -1;
+		r->err = cli_status_to_errno(status);
+	}
+	DLIST_ADD_END(internal->aio_completed, r);
+
+	smbc_aio_resend_waiting(r->context);
+}
+
+static int smbc_aio_submit(SMBCCTX *context,
+			   SMBCFILE *file,
+			   bool write,
+			   void *buf,
+			   size_t count,
+			   off_t offset,
+			   smbc_aio_done_fn done_fn,
+			   void *private_data)
+{
+	struct SMBC_internal_data *internal = NULL;
+	struct tevent_context *ev = NULL;
+	struct smbc_aio_req *r = NULL;
+
+	if (!context || !context->internal->initialized) {
+		errno = EINVAL;
+		return -1;
+	}
+	internal = context->internal;
+
+	if (!SMBC_dlist_contains(internal->files, file) || !file->file) {
+		errno = EBADF;
+		return -1;
+	}
+	if (buf == NULL || done_fn == NULL || offset < 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	ev = smbc_aio_ev(context);
+	if (ev == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	r = talloc_zero(ev, struct smbc_aio_req);
+	if (r == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	*r = (struct smbc_aio_req) {
+		.context = context,
+		.file = file,
+		.write = write,
+		.buf = buf,
+		.count = count,
+		.offset = offset,
+		.done_fn = done_fn,
+		.private_data = private_data,
+	};
+
+	if (!smbc_aio_send(r)) {
+		TALLOC_FREE(r);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	DLIST_ADD_END(internal->aio_inflight, r);
+	file->aio_pending += 1;
+	return 0;
+}
+
+int
+smbc_aio_pread(SMBCCTX *context,
+	       SMBCFILE *file,
+	       void *buf,
+	       size_t count,
+	       off_t offset,
+	       smbc_aio_done_fn done_fn,
+	       void *private_data)
+{
+	return smbc_aio_submit(context, file, false, buf, count, offset,
+			       done_fn, private_data);
+}
+
+int
+smbc_aio_pwrite(SMBCCTX *context,
+		SMBCFILE *file,
+		const void *buf,
+		size_t count,
+		off_t offset,
+		smbc_aio_done_fn done_fn,
+		void *private_data)
+{
+	return smbc_aio_submit(context, file, true, discard_const(buf), count,
+			       offset, done_fn, private_data);
+}
+
+/*
+ * Call the callbacks of all completed requests, returns the number
+ * of callbacks called.
+ */
+static int smbc_aio_run_completed(SMBCCTX *context)
+{
+	struct SMBC_internal_data *internal = context->internal;
+	int num = 0;
+
+	while (internal->aio_completed != NULL) {
+		struct smbc_aio_req *r = internal->aio_completed;
+		struct smbc_aio_req req = *r;
+
+		DLIST_REMOVE(internal->aio_completed, r);
+		TALLOC_FREE(r);
+
+		req.file->aio_pending -= 1;
+		req.done_fn(context, req.file, req.result, req.err,
+			    req.private_data);
+		num += 1;
+	}
+	return num;
+}
+
+static void smbc_aio_timeout(struct tevent_context *ev,
+			     struct tevent_timer *te,
+			     struct timeval current_time,
+			     void *private_data)
+{
+	bool *timed_out = (bool *)private_data;
+	*timed_out = true;
+}
+
+int
+smbc_aio_poll(SMBCCTX *context, int timeout_msec)
+{
+	struct SMBC_internal_data *internal = NULL;
+	struct tevent_timer *te = NULL;
+	bool timed_out = false;
+	int ret;
+
+	if (!context || !context->internal->initialized) {
+		errno = EINVAL;
+		return -1;
+	}
+	internal = context->internal;
+
+	if (internal->aio_completed == NULL &&
+	    internal->aio_inflight != NULL)
+	{
+		if (timeout_msec >= 0) {
+			/*
+			 * With a timeout of 0 we still need to look at
+			 * the sockets once, an already expired timer
+			 * would prevent that.
+			 */
+			struct timeval endtime = (timeout_msec == 0) ?
+				timeval_current_ofs_usec(1) :
+				timeval_current_ofs_msec(timeout_msec);
+
+			te = tevent_add_timer(internal->aio_ev,
+					      internal->aio_ev,
+					      endtime,
+					      smbc_aio_timeout,
+					      &timed_out);
+			if (te == NULL) {
+				errno = ENOMEM;
+				return -1;
+			}
+		}
+
+		while (internal->aio_completed == NULL &&
+		       internal->aio_inflight != NULL &&
+		       !timed_out)
+		{
+			ret = tevent_loop_once(internal->aio_ev);
+			if (ret != 0) {
+				TALLOC_FREE(te);
+				errno = EIO;
+				return -1;
+			}
+		}
+		TALLOC_FREE(te);
+	}
+
+	return smbc_aio_run_completed(context);
+}
+
+int
+smbc_aio_wait(SMBCCTX *context, SMBCFILE *file)
+{
+	if (!context || !context->internal->initialized) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (smbc_aio_pending(context, file) > 0) {
+		int ret = smbc_aio_poll(context, -1);
+		if (ret == -1) {
+			return -1;
+		}
+		if (ret == 0 && context->internal->aio_inflight == NULL) {
+			/* Nothing left that could complete */
+			break;
+		}
+	}
+	return 0;
+}
+
+unsigned int
+smbc_aio_pending(SMBCCTX *context, SMBCFILE *file)
+{
+	struct SMBC_internal_data *internal = NULL;
+	struct smbc_aio_req *r = NULL;
+	unsigned int num = 0;
+
+	if (!context || !context->internal->initialized) {
+		return 0;
+	}
+	internal = context->internal;
+
+	if (file != NULL) {
+		if (!SMBC_dlist_contains(internal->files, file)) {
+			return 0;
+		}
+		return file->aio_pending;
+	}
+
+	for (r = internal->aio_inflight; r != NULL; r = r->next) {
+		num += 1;
+	}
+	for (r = internal->aio_waiting; r != NULL; r = r->next) {
+		num += 1;
+	}
+	for (r = internal->aio_completed; r != NULL; r = r->next) {
+		num += 1;
+	}
+	return num;
+}
+
+/*
+ * Drop all requests without calling their callbacks, used when the
+ * context is shut down.
+ */
+void
+SMBC_aio_free(SMBCCTX *context)
+{
+	struct SMBC_internal_data *internal = context->internal;
+	SMBCFILE *f = NULL;
+
+	for (f = internal->files; f != NULL; f = f->next) {
+		f->aio_pending = 0;
+	}
+	internal->aio_inflight = NULL;
+	internal->aio_waiting = NULL;
+	internal->aio_completed = NULL;
+	TALLOC_FREE(internal->aio_ev);
+}
@@ -268,6 +268,9 @@ smbc_free_context(SMBCCTX *context,
                 SMBCFILE * f;
                 DEBUG(1,("Performing aggressive shutdown.\n"));
 
+		/* Don't bother waiting for async requests */
+		SMBC_aio_free(context);
+
                 f = context->internal->files;
                 while (f) {
 			SMBCFILE *next = f->next;
@@ -320,6 +323,7 @@ smbc_free_context(SMBCCTX *context,
 			TALLOC_FREE(frame);
                         return 1;
                 }
+		SMBC_aio_free(context);
         }
 
         /* Things we have to clean up */
@@ -460,6 +460,12 @@ SMBC_close_ctx(SMBCCTX *context,
 		return smbc_getFunctionClosedir(context)(context, file);
 	}
 
+	/* Async requests need the handle, wait for them */
+	if (file->aio_pending > 0 && smbc_aio_wait(context, file) != 0) {
+		TALLOC_FREE(frame);
+		return -1;
+	}
+
 	status = cli_close(file->targetcli, file->cli_fd);
 	if (!NT_STATUS_IS_OK(status)) {
 		SMBCSRV *srv;
@@ -997,6 +997,17 @@ NTSTATUS cli_set_security_descriptor(struct cli_state *cli,
 				     uint16_t fnum,
 				     uint32_t sec_info,
 				     const struct security_descriptor *sd);
+NTSTATUS cli_query_security_descriptor_path(struct cli_state *cli,
+					    const char *fname,
+					    uint32_t desired_access,
+					    uint32_t sec_info,
+					    TALLOC_CTX *mem_ctx,
+					    struct security_descriptor **sd);
+NTSTATUS cli_set_security_descriptor_path(struct cli_state *cli,
+					  const char *fname,
+					  uint32_t desired_access,
+					  uint32_t sec_info,
+					  const struct security_descriptor *sd);
 NTSTATUS cli_set_secdesc(struct cli_state *cli, uint16_t fnum,
 			 const struct security_descriptor *sd);
 
@@ -28,6 +28,7 @@
 #include "../libcli/smb/read_smb.h"
 #include "libsmb/nmblib.h"
 #include "libsmb/smbsock_connect.h"
+#include "lib/tls/tls.h"
 
 struct cli_session_request_state {
 	struct tevent_context *ev;
@@ -387,6 +388,7 @@ struct smbsock_connect_state {
 	uint8_t submit_idx;
 	uint8_t num_pending;
 	struct smbsock_connect_substate substates[SMB_TRANSPORTS_MAX_TRANSPORTS];
+	struct tstream_tls_params *quic_tls_params;
 	struct smbXcli_transport *transport;
 	struct smbXcli_transport *(*create_bsd_transport)(
 						TALLOC_CTX *mem_ctx,
@@ -469,6 +471,29 @@ struct tevent_req *smbsock_connect_send(TALLOC_CTX *mem_ctx,
 			break;
 		case SMB_TRANSPORT_TYPE_TCP:
 			break;
+		case SMB_TRANSPORT_TYPE_QUIC:
+			if (!tstream_tls_quic_supported()) {
+				num_unsupported += 1;
+				continue;
+			}
+			if (state->quic_tls_params == NULL) {
+				const char *peer_name = state->called_name;
+				NTSTATUS status;
+
+				if (peer_name[0] == '*') {
+					peer_name = NULL;
+				}
+
+				status = tstream_tls_params_client_lpcfg(
+						state,
+						lp_ctx,
+						peer_name,
+						&state->quic_tls_params);
+				if (tevent_req_nterror(req, status)) {
+					return tevent_req_post(req, ev);
+				}
+			}
+			break;
 		}
 
 		s->req = req;
@@ -595,6 +620,21 @@ static bool smbsock_connect_submit_next(struct tevent_req *req)
 					smbsock_connect_tcp_connected,
 					s);
 		break;
+
+	case SMB_TRANSPORT_TYPE_QUIC:
+		s->subreq = open_socket_out_send(state,
+						 state->ev,
+						 IPPROTO_QUIC,
+						 state->addr,
+						 s->transport.port,
+						 5000);
+		if (tevent_req_nomem(s->subreq, req)) {
+			return false;
+		}
+		tevent_req_set_callback(s->subreq,
+					smbsock_connect_tcp_connected,
+					s);
+		break;
 	}
 
 	if (s->subreq == NULL) {
@@ -719,12 +759,34 @@ static void smbsock_connect_tcp_connected(struct tevent_req *subreq)
 
 	status = open_socket_out_recv(subreq, &s->sockfd);
 	TALLOC_FREE(subreq);
+	if (NT_STATUS_IS_OK(status) &&
+	    s->transport.type == SMB_TRANSPORT_TYPE_QUIC)
+	{
+		/*
+		 * The QUIC handshake is synchronous,
+		 * the fallback transports have to wait
+		 * for it.
+		 */
+		set_blocking(s->sockfd, true);
+		status = tstream_tls_quic_handshake(state->quic_tls_params,
+						    false,
+						    s->sockfd);
+		set_blocking(s->sockfd, false);
+		if (!NT_STATUS_IS_OK(status)) {
+			DBG_NOTICE("QUIC handshake failed: %s\n",
+				   nt_errstr(status));
+			close(s->sockfd);
+			s->sockfd = -1;
+		}
+	}
 	if (NT_STATUS_IS_OK(status)) {
 		/*
 		 * smbsock_connect_cleanup()
 		 * will free all other subreqs
 		 */
-		set_socket_options(s->sockfd, lp_socket_options());
+		if (s->transport.type == SMB_TRANSPORT_TYPE_TCP) {
+			set_socket_options(s->sockfd, lp_socket_options());
+		}
 		state->transport = state->create_bsd_transport(state,
 							       &s->sockfd,
 							       &s->transport);
@@ -43,6 +43,30 @@
 
 static struct db_context *brlock_db;
 
+/*
+ * Below this number of locks brl_locktest() just walks the
+ * array, building the index would cost more than it saves.
+ */
+#define BRL_INDEX_MIN_LOCKS 16
+
+/*
+ * An interval tree over lock_data, only kept in memory. The entries
+ * are sorted by start, the tree is implicit: the root of the range
+ * [lo, hi[ of "entries" is at (lo + hi) / 2. For every node
+ * "max_last" holds the largest last byte found in its subtree.
+ */
+struct brl_index_entry {
+	uint64_t start;
+	uint64_t last;
+	uint64_t max_last;
+	unsigned int idx;
+};
+
+struct brl_index {
+	unsigned int num;
+	struct brl_index_entry *entries;
+};
+
 struct byte_range_lock {
 	struct files_struct *fsp;
 	TALLOC_CTX *req_mem_ctx;
@@ -51,6 +75,11 @@ struct byte_range_lock {
 	bool modified;
 	struct lock_struct *lock_data;
 	struct db_record *record;
+	/*
+	 * Built on demand by brl_index_get(),
+	 * dropped on every change of lock_data.
+	 */
+	struct brl_index *index;
 };
 
 /****************************************************************************
@@ -336,6 +365,186 @@ static bool brl_conflict_other(const struct lock_struct *lock,
 	return false;
 }
 
+/****************************************************************************
+ The interval tree index of the locks.
+****************************************************************************/
+
+static void brl_index_invalidate(struct byte_range_lock *br_lck)
+{
+	TALLOC_FREE(br_lck->index);
+}
+
+/*
+ * The last byte of a range in the sense of byte_range_overlap(). A
+ * zero length range ends before it starts, it only conflicts with
+ * ranges spanning its offset. Returns false for the {0, 0} range,
+ * which never conflicts.
+ */
+static bool brl_range_last(uint64_t ofs, uint64_t len, uint64_t *last)
+{
+	if (ofs == 0 && len == 0) {
+		return false;
+	}
+	if (byte_range_valid(ofs, len)) {
+		*last = ofs + len - 1;
+	} else {
+		*last = UINT64_MAX;
+	}
+	return true;
+}
+
+static int brl_index_cmp(const struct brl_index_entry *e1,
+			 const struct brl_index_entry *e2)
+{
+	return NUMERIC_CMP(e1->start, e2->start);
+}
+
+static uint64_t brl_index_build_node(struct brl_index *index,
+				     unsigned int lo,
+				     unsigned int hi)
+{
+	unsigned int mid = lo + (hi - lo) / 2;
+	struct brl_index_entry *e = &index->entries[mid];
+	uint64_t max_last = e->last;
+	uint64_t sub;
+
+	if (lo < mid) {
+		sub = brl_index_build_node(index, lo, mid);
+		max_last = MAX(max_last, sub);
+	}
+	if (mid + 1 < hi) {
+		sub = brl_index_build_node(index, mid + 1, hi);
+		max_last = MAX(max_last, sub);
+	}
+
+	e->max_last = max_last;
+	return max_last;
+}
+
+static struct brl_index *brl_index_get(struct byte_range_lock *br_lck)
+{
+	struct brl_index *index = br_lck->index;
+	const struct lock_struct *locks = br_lck->lock_data;
+	unsigned int i;
+
+	if (index != NULL) {
+		return index;
+	}
+
+	index = talloc_zero(br_lck, struct brl_index);
+	if (index == NULL) {
+		return NULL;
+	}
+	index->entries = talloc_array(
+		index, struct brl_index_entry, br_lck->num_locks);
+	if (index->entries == NULL) {
+		TALLOC_FREE(index);
+		return NULL;
+	}
+
+	for (i = 0; i < br_lck->num_locks; i++) {
+		struct brl_index_entry *e = &index->entries[index->num];
+		bool ok;
+
+		ok = brl_range_last(locks[i].start, locks[i].size, &e->last);
+		if (!ok) {
+			/*
+			 * {0, 0} locks never conflict,
+			 * leave them out of the index.
+			 */
+			continue;
+		}
+		e->start = locks[i].start;
+		e->idx = i;
+		index->num += 1;
+	}
+
+	if (index->num > 0) {
+		TYPESAFE_QSORT(index->entries, index->num, brl_index_cmp);
+		brl_index_build_node(index, 0, index->num);
+	}
+
+	br_lck->index = index;
+	return index;
+}
+
+/*
+ * Call fn() for all locks overlapping the range [first, last].
+ * Stops early if fn() returns true and returns true in that case.
+ */
+static bool brl_index_walk(struct byte_range_lock *br_lck,
+			   const struct brl_index *index,
+			   unsigned int lo,
+			   unsigned int hi,
+			   uint64_t first,
+			   uint64_t last,
+			   bool (*fn)(struct byte_range_lock *br_lck,
+				      unsigned int i,
+				      void *private_data),
+			   void *private_data)
+{
+	while (lo < hi) {
+		unsigned int mid = lo + (hi - lo) / 2;
+		const struct brl_index_entry *e = &index->entries[mid];
+		bool stop;
+
+		if (e->max_last < first) {
+			/*
+			 * Everything in this subtree
+			 * ends before our range starts.
+			 */
+			return false;
+		}
+
+		stop = brl_index_walk(br_lck, index, lo, mid,
+				      first, last, fn, private_data);
+		if (stop) {
+			return true;
+		}
+
+		if (e->start > last) {
+			/*
+			 * This and everything to the
+			 * right starts behind our range.
+			 */
+			return false;
+		}
+
+		if (e->last >= first) {
+			stop = fn(br_lck, e->idx, private_data);
+			if (stop) {
+				return true;
+			}
+		}
+
+		/* Iterate into the right subtree */
+		lo = mid + 1;
+	}
+
+	return false;
+}
+
+static bool brl_index_overlapping(struct byte_range_lock *br_lck,
+				  const struct brl_index *index,
+				  const struct lock_struct *probe,
+				  bool (*fn)(struct byte_range_lock *br_lck,
+					     unsigned int i,
+					     void *private_data),
+				  void *private_data)
+{
+	uint64_t last;
+	bool ok;
+
+	ok = brl_range_last(probe->start, probe->size, &last);
+	if (!ok) {
+		/* The {0, 0} range doesn't conflict */
+		return false;
+	}
+
+	return brl_index_walk(br_lck, index, 0, index->num,
+			      probe->start, last, fn, private_data);
+}
+
 /****************************************************************************
  Open up the brlock.tdb database.
 ****************************************************************************/
@@ -455,6 +664,7 @@ NTSTATUS brl_lock_windows_default(struct byte_range_lock *br_lck,
 	br_lck->num_locks += 1;
 	br_lck->lock_data = locks;
 	br_lck->modified = True;
+	brl_index_invalidate(br_lck);
 
 	return NT_STATUS_OK;
  fail:
@@ -911,6 +1121,7 @@ static NTSTATUS brl_lock_posix(struct byte_range_lock *br_lck,
 	br_lck->lock_data = tp;
 	locks = tp;
 	br_lck->modified = True;
+	brl_index_invalidate(br_lck);
 
 	/* A successful downgrade from write to read lock can trigger a lock
 	   re-evalutation where waiting readers can now proceed. */
@@ -1006,6 +1217,7 @@ bool brl_unlock_windows_default(struct byte_range_lock *br_lck,
 	ARRAY_DEL_ELEMENT(locks, i, br_lck->num_locks);
 	br_lck->num_locks -= 1;
 	br_lck->modified = True;
+	brl_index_invalidate(br_lck);
 
 	/* Unlock the underlying POSIX regions. */
 	if(lp_posix_locking(br_lck->fsp->conn->params)) {
@@ -1154,6 +1366,7 @@ static bool brl_unlock_posix(struct byte_range_lock *br_lck,
 	locks = tp;
 	br_lck->lock_data = tp;
 	br_lck->modified = True;
+	brl_index_invalidate(br_lck);
 
 	return True;
 }
@@ -1193,33 +1406,75 @@ bool brl_unlock(struct byte_range_lock *br_lck,
  Returns True if the region required is currently unlocked, False if locked.
 ****************************************************************************/
 
+struct brl_locktest_state {
+	const struct lock_struct *rw_probe;
+	bool upgradable;
+};
+
+/*
+ * Returns true if lock i conflicts with the probe
+ */
+static bool brl_locktest_one(struct byte_range_lock *br_lck,
+			     unsigned int i,
+			     void *private_data)
+{
+	struct brl_locktest_state *state = private_data;
+	struct lock_struct *lock = &br_lck->lock_data[i];
+
+	/*
+	 * Our own locks don't conflict.
+	 */
+	if (!brl_conflict_other(lock, state->rw_probe)) {
+		return false;
+	}
+
+	if (!state->upgradable) {
+		/* readonly */
+		return true;
+	}
+
+	if (!serverid_exists(&lock->context.pid)) {
+		lock->context.pid.pid = 0;
+		br_lck->modified = true;
+		return false;
+	}
+
+	return true;
+}
+
 bool brl_locktest(struct byte_range_lock *br_lck,
 		  const struct lock_struct *rw_probe,
 		  bool upgradable)
 {
+	struct brl_locktest_state state = {
+		.rw_probe = rw_probe,
+		.upgradable = upgradable,
+	};
+	struct brl_index *index = NULL;
 	bool ret = True;
 	unsigned int i;
-	struct lock_struct *locks = br_lck->lock_data;
 	files_struct *fsp = br_lck->fsp;
 
-	/* Make sure existing locks don't conflict */
-	for (i=0; i < br_lck->num_locks; i++) {
+	if (br_lck->num_locks >= BRL_INDEX_MIN_LOCKS) {
 		/*
-		 * Our own locks don't conflict.
+		 * Read-only records are cached in fsp->brlock_rec
+		 * until the database changes, so the index can serve
+		 * many checks.
 		 */
-		if (brl_conflict_other(&locks[i], rw_probe)) {
-			if (!upgradable) {
-				/* readonly */
-				return false;
-			}
+		index = brl_index_get(br_lck);
+	}
 
-			if (!serverid_exists(&locks[i].context.pid)) {
-				locks[i].context.pid.pid = 0;
-				br_lck->modified = true;
-				continue;
+	/* Make sure existing locks don't conflict */
+	if (index != NULL) {
+		if (brl_index_overlapping(br_lck, index, rw_probe,
+					  brl_locktest_one, &state)) {
+			return false;
+		}
+	} else {
+		for (i=0; i < br_lck->num_locks; i++) {
+			if (brl_locktest_one(br_lck, i, &state)) {
+				return false;
 			}
-
-			return False;
 		}
 	}
 
@@ -1603,6 +1858,7 @@ static void byte_range_lock_flush(struct byte_range_lock *br_lck)
 			i += 1;
 		}
 	}
+	brl_index_invalidate(br_lck);
 
 	if (br_lck->num_locks == 0) {
 		/* No locks - delete this entry. */
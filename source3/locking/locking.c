@@ -620,21 +620,23 @@ void get_file_infos(struct file_id id,
 		    uint32_t name_hash,
 		    bool *delete_on_close)
 {
-	struct share_mode_lock *lck;
+	bool delete_on_close_set = false;
+	NTSTATUS status;
 
 	if (delete_on_close) {
 		*delete_on_close = false;
 	}
 
-	if (!(lck = fetch_share_mode_unlocked(talloc_tos(), id))) {
+	status = share_mode_snapshot_delete_on_close(id,
+						     name_hash,
+						     &delete_on_close_set);
+	if (!NT_STATUS_IS_OK(status)) {
 		return;
 	}
 
 	if (delete_on_close) {
-		*delete_on_close = is_delete_on_close_set(lck, name_hash);
+		*delete_on_close = delete_on_close_set;
 	}
-
-	TALLOC_FREE(lck);
 }
 
 bool is_valid_share_mode_entry(const struct share_mode_entry *e)
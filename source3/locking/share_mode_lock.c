@@ -63,6 +63,7 @@ struct share_mode_lock {
 #include "g_lock.h"
 #include "smbd/fd_handle.h"
 #include "lib/global_contexts.h"
+#include "lib/util/tracepoint.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_LOCKING
@@ -928,6 +929,11 @@ static NTSTATUS get_share_mode_lock_internal(
 		.id = id,
 	};
 
+	SAMBA_TRACEPOINT(share_mode_lock_start,
+			 id.devid,
+			 id.inode,
+			 share_mode_lock_key_refcount);
+
 	if (share_mode_lock_key_refcount == 0) {
 		if (!share_mode_lock_skip_g_lock) {
 			TDB_DATA key = locking_key(&id);
@@ -979,6 +985,11 @@ static NTSTATUS get_share_mode_lock_internal(
 done:
 	lck->cached_data = static_share_mode_data;
 
+	SAMBA_TRACEPOINT(share_mode_lock_done,
+			 id.devid,
+			 id.inode,
+			 share_mode_lock_key_refcount);
+
 	if (CHECK_DEBUGLVL(DBGLVL_DEBUG)) {
 		struct file_id_buf returned;
 
@@ -1012,6 +1023,11 @@ static NTSTATUS put_share_mode_lock_internal(struct share_mode_lock *lck)
 	SMB_ASSERT(share_mode_lock_key_refcount > 0);
 	share_mode_lock_key_refcount -= 1;
 
+	SAMBA_TRACEPOINT(share_mode_unlock,
+			 lck->id.devid,
+			 lck->id.inode,
+			 share_mode_lock_key_refcount);
+
 	if (share_mode_lock_key_refcount > 0) {
 		return NT_STATUS_OK;
 	}
@@ -1527,6 +1543,206 @@ struct share_mode_lock *fetch_share_mode_unlocked(TALLOC_CTX *mem_ctx,
 	return state.lck;
 }
 
+/*
+ * Read-only snapshot of the delete-on-close state of a record.
+ *
+ * The unique_content_epoch at the start of the share_mode_data blob
+ * changes with every store of the share_mode_data, so it acts as a
+ * sequence number: A reader peeks at the blob header without taking
+ * the g_lock and only decodes the full blob if the epoch differs from
+ * the one of its cached snapshot. The snapshot is a flat blob in the
+ * SHARE_MODE_SNAPSHOT_CACHE, laid out as
+ *
+ * uint64 epoch, uint32 num_delete_tokens, uint32 name_hash[]
+ */
+
+#define SHARE_MODE_SNAPSHOT_HDR_LEN 12
+
+struct share_mode_snapshot_state {
+	struct file_id id;
+	uint32_t name_hash;
+	bool found;
+	bool delete_on_close;
+	NTSTATUS status;
+};
+
+static bool share_mode_snapshot_check(struct share_mode_snapshot_state *state,
+				      uint64_t epoch)
+{
+	const DATA_BLOB key = memcache_key(&state->id);
+	DATA_BLOB snap = { .length = 0 };
+	uint32_t i, num;
+	bool ok;
+
+	ok = memcache_lookup(NULL, SHARE_MODE_SNAPSHOT_CACHE, key, &snap);
+	if (!ok) {
+		return false;
+	}
+	if (snap.length < SHARE_MODE_SNAPSHOT_HDR_LEN) {
+		return false;
+	}
+	if (PULL_LE_U64(snap.data, 0) != epoch) {
+		return false;
+	}
+	num = PULL_LE_U32(snap.data, 8);
+	if (snap.length != SHARE_MODE_SNAPSHOT_HDR_LEN + num * 4) {
+		return false;
+	}
+
+	for (i = 0; i < num; i++) {
+		uint32_t name_hash = PULL_LE_U32(
+			snap.data, SHARE_MODE_SNAPSHOT_HDR_LEN + i * 4);
+		if (name_hash == state->name_hash) {
+			state->delete_on_close = true;
+			break;
+		}
+	}
+	return true;
+}
+
+static void share_mode_snapshot_store(struct share_mode_snapshot_state *state,
+				      const uint8_t *buf,
+				      size_t buflen)
+{
+	const DATA_BLOB key = memcache_key(&state->id);
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct share_mode_data *d = NULL;
+	enum ndr_err_code ndr_err;
+	DATA_BLOB blob = {
+		.data = discard_const_p(uint8_t, buf),
+		.length = buflen,
+	};
+	uint8_t *snap = NULL;
+	size_t snaplen;
+	uint32_t i;
+
+	d = talloc(frame, struct share_mode_data);
+	if (d == NULL) {
+		state->status = NT_STATUS_NO_MEMORY;
+		goto done;
+	}
+
+	ndr_err = ndr_pull_struct_blob_all(
+		&blob, d, d, (ndr_pull_flags_fn_t)ndr_pull_share_mode_data);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		DBG_WARNING("ndr_pull_share_mode_data failed: %s\n",
+			    ndr_errstr(ndr_err));
+		state->status = ndr_map_error2ntstatus(ndr_err);
+		goto done;
+	}
+
+	snaplen = SHARE_MODE_SNAPSHOT_HDR_LEN + d->num_delete_tokens * 4;
+	snap = talloc_array(frame, uint8_t, snaplen);
+	if (snap == NULL) {
+		state->status = NT_STATUS_NO_MEMORY;
+		goto done;
+	}
+	PUSH_LE_U64(snap, 0, d->unique_content_epoch);
+	PUSH_LE_U32(snap, 8, d->num_delete_tokens);
+
+	for (i = 0; i < d->num_delete_tokens; i++) {
+		uint32_t name_hash = d->delete_tokens[i].name_hash;
+
+		PUSH_LE_U32(snap, SHARE_MODE_SNAPSHOT_HDR_LEN + i * 4,
+			    name_hash);
+		if (name_hash == state->name_hash) {
+			state->delete_on_close = true;
+		}
+	}
+
+	memcache_add(NULL,
+		     SHARE_MODE_SNAPSHOT_CACHE,
+		     key,
+		     data_blob_const(snap, snaplen));
+done:
+	TALLOC_FREE(frame);
+}
+
+static void share_mode_snapshot_fn(
+	struct server_id exclusive,
+	size_t num_shared,
+	const struct server_id *shared,
+	const uint8_t *data,
+	size_t datalen,
+	void *private_data)
+{
+	struct share_mode_snapshot_state *state = private_data;
+	struct locking_tdb_data ltdb = { 0 };
+	enum ndr_err_code ndr_err;
+	uint64_t epoch;
+	uint16_t flags;
+	bool ok;
+
+	if (datalen != 0) {
+		ok = locking_tdb_data_parse(&ltdb, data, datalen);
+		if (!ok) {
+			DBG_DEBUG("locking_tdb_data_get failed\n");
+			state->status = NT_STATUS_INTERNAL_DB_CORRUPTION;
+			return;
+		}
+	}
+
+	if (ltdb.share_mode_data_len == 0) {
+		/* Likely a ctdb tombstone record, ignore it */
+		return;
+	}
+	state->found = true;
+
+	ndr_err = get_share_mode_blob_header(ltdb.share_mode_data_buf,
+					     ltdb.share_mode_data_len,
+					     &epoch,
+					     &flags);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		state->status = ndr_map_error2ntstatus(ndr_err);
+		return;
+	}
+
+	ok = share_mode_snapshot_check(state, epoch);
+	if (ok) {
+		return;
+	}
+
+	share_mode_snapshot_store(state,
+				  ltdb.share_mode_data_buf,
+				  ltdb.share_mode_data_len);
+}
+
+/*******************************************************************
+ Check for a delete-on-close token without locking the database and
+ without decoding the share mode data if it did not change since the
+ last call for this file.
+********************************************************************/
+
+NTSTATUS share_mode_snapshot_delete_on_close(struct file_id id,
+					     uint32_t name_hash,
+					     bool *delete_on_close)
+{
+	struct share_mode_snapshot_state state = {
+		.id = id,
+		.name_hash = name_hash,
+		.status = NT_STATUS_OK,
+	};
+	TDB_DATA key = locking_key(&id);
+	NTSTATUS status;
+
+	*delete_on_close = false;
+
+	status = g_lock_dump(lock_ctx, key, share_mode_snapshot_fn, &state);
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_DEBUG("g_lock_dump failed: %s\n", nt_errstr(status));
+		return status;
+	}
+	if (!NT_STATUS_IS_OK(state.status)) {
+		return state.status;
+	}
+	if (!state.found) {
+		return NT_STATUS_NOT_FOUND;
+	}
+
+	*delete_on_close = state.delete_on_close;
+	return NT_STATUS_OK;
+}
+
 struct fetch_share_mode_state {
 	struct file_id id;
 	struct share_mode_lock *lck;
@@ -1697,6 +1913,9 @@ NTSTATUS fetch_share_mode_recv(struct tevent_req *req,
 
 struct share_mode_forall_state {
 	TDB_DATA key;
+	bool (*filter_fn)(const struct share_mode_entry *e,
+			  void *private_data);
+	void *filter_private;
 	int (*ro_fn)(struct file_id fid,
 		     const struct share_mode_data *data,
 		     void *private_data);
@@ -1706,6 +1925,36 @@ struct share_mode_forall_state {
 	void *private_data;
 };
 
+/*
+ * Look at the raw share mode entries before decoding the much
+ * larger share_mode_data: records without any entry passing the
+ * filter are skipped cheaply.
+ */
+static bool share_mode_forall_filter(struct share_mode_forall_state *state,
+				     const struct locking_tdb_data *ltdb)
+{
+	size_t i;
+
+	if (state->filter_fn == NULL) {
+		return true;
+	}
+
+	for (i=0; i<ltdb->num_share_entries; i++) {
+		struct share_mode_entry e;
+		bool ok;
+
+		ok = share_mode_entry_get(
+			ltdb->share_entries + i * SHARE_MODE_ENTRY_SIZE, &e);
+		if (!ok) {
+			continue;
+		}
+		if (state->filter_fn(&e, state->filter_private)) {
+			return true;
+		}
+	}
+	return false;
+}
+
 static void share_mode_forall_dump_fn(
 	struct server_id exclusive,
 	size_t num_shared,
@@ -1732,6 +1981,10 @@ static void share_mode_forall_dump_fn(
 		return;
 	}
 
+	if (!share_mode_forall_filter(state, &ltdb)) {
+		return;
+	}
+
 	d = parse_share_mode_data(
 		talloc_tos(),
 		fid,
@@ -1816,6 +2069,8 @@ int share_mode_forall(int (*fn)(struct file_id fid,
 struct share_entry_forall_state {
 	struct file_id fid;
 	struct share_mode_data *data;
+	bool (*filter_fn)(const struct share_mode_entry *e,
+			  void *private_data);
 	int (*ro_fn)(struct file_id fid,
 		     const struct share_mode_data *data,
 		     const struct share_mode_entry *entry,
@@ -1836,6 +2091,11 @@ static bool share_entry_traverse_walker(
 	struct share_entry_forall_state *state = private_data;
 	int ret;
 
+	if ((state->filter_fn != NULL) &&
+	    !state->filter_fn(e, state->private_data)) {
+		return 0;
+	}
+
 	if (state->ro_fn != NULL) {
 		ret = state->ro_fn(state->fid,
 				   state->data,
@@ -1937,6 +2197,45 @@ int share_entry_forall_read(int (*fn)(struct file_id fid,
 	return share_mode_forall_read(share_entry_ro_traverse_fn, &state);
 }
 
+/*
+ * Like share_entry_forall_read(), but only calls ro_fn for entries
+ * filter_fn returns true for. The filter sees the entries before the
+ * share_mode_data is decoded, so it should be cheap.
+ */
+int share_entry_forall_read_filtered(
+	bool (*filter_fn)(const struct share_mode_entry *e,
+			  void *private_data),
+	int (*ro_fn)(struct file_id fid,
+		     const struct share_mode_data *data,
+		     const struct share_mode_entry *entry,
+		     void *private_data),
+	void *private_data)
+{
+	struct share_entry_forall_state state = {
+		.filter_fn = filter_fn,
+		.ro_fn = ro_fn,
+		.private_data = private_data,
+	};
+	struct share_mode_forall_state fstate = {
+		.filter_fn = filter_fn,
+		.filter_private = private_data,
+		.ro_fn = share_entry_ro_traverse_fn,
+		.private_data = &state,
+	};
+	int ret;
+
+	if (lock_ctx == NULL) {
+		return 0;
+	}
+
+	ret = g_lock_locks_read(
+		lock_ctx, share_mode_forall_fn, &fstate);
+	if (ret < 0) {
+		DBG_ERR("g_lock_locks failed\n");
+	}
+	return ret;
+}
+
 int share_entry_forall(int (*fn)(struct file_id fid,
 				 struct share_mode_data *data,
 				 struct share_mode_entry *entry,
@@ -73,6 +73,10 @@ struct share_mode_lock *fetch_share_mode_unlocked(
 	TALLOC_CTX *mem_ctx,
 	struct file_id id);
 
+NTSTATUS share_mode_snapshot_delete_on_close(struct file_id id,
+					     uint32_t name_hash,
+					     bool *delete_on_close);
+
 struct tevent_req *fetch_share_mode_send(
 	TALLOC_CTX *mem_ctx,
 	struct tevent_context *ev,
@@ -88,6 +92,14 @@ int share_entry_forall_read(int (*ro_fn)(struct file_id fid,
 					 const struct share_mode_entry *entry,
 					 void *private_data),
 			    void *private_data);
+int share_entry_forall_read_filtered(
+	bool (*filter_fn)(const struct share_mode_entry *e,
+			  void *private_data),
+	int (*ro_fn)(struct file_id fid,
+		     const struct share_mode_data *data,
+		     const struct share_mode_entry *entry,
+		     void *private_data),
+	void *private_data);
 int share_entry_forall(int (*fn)(struct file_id fid,
 				 struct share_mode_data *data,
 				 struct share_mode_entry *entry,
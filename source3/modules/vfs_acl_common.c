@@ -29,6 +29,7 @@
 #include "../librpc/gen_ndr/ndr_security.h"
 #include "../lib/util/bitmap.h"
 #include "passdb/lookup_sid.h"
+#include "lib/util/memcache.h"
 
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
@@ -43,6 +44,24 @@ static NTSTATUS create_acl_blob(const struct security_descriptor *psd,
 				SECINFO_DACL | \
 				SECINFO_SACL)
 
+/*
+ * Per-process cache of parsed NT ACL blobs and of the hashes of system
+ * ACL blobs, both keyed by the raw blob. With inherited ACLs most files
+ * carry byte-identical blobs, the cache saves the NDR decoding and the
+ * SHA-256 over the system ACL for all but the first of them. The
+ * entries are a pure function of their key, so there's nothing to
+ * invalidate.
+ */
+static struct memcache *acl_blob_cache;
+
+struct acl_blob_cache_entry {
+	uint16_t version;
+	uint16_t hash_type;
+	uint8_t hash[XATTR_SD_HASH_SIZE];
+	uint8_t sys_acl_hash[XATTR_SD_HASH_SIZE];
+	struct security_descriptor *psd;
+};
+
 bool init_acl_common_config(vfs_handle_struct *handle,
 			    const char *module_name)
 {
@@ -68,6 +87,18 @@ bool init_acl_common_config(vfs_handle_struct *handle,
 						 default_acl_style_list,
 						 DEFAULT_ACL_POSIX);
 
+	if (acl_blob_cache == NULL) {
+		unsigned long cache_size;
+
+		cache_size = lp_parm_ulong(-1,
+					   module_name,
+					   "sd cache size",
+					   1024 * 1024);
+		if (cache_size != 0) {
+			acl_blob_cache = memcache_init(NULL, cache_size);
+		}
+	}
+
 	SMB_VFS_HANDLE_SET_DATA(handle, config, NULL,
 				struct acl_common_config,
 				return false);
@@ -98,6 +129,43 @@ static NTSTATUS hash_blob_sha256(DATA_BLOB blob,
 	return NT_STATUS_OK;
 }
 
+/*******************************************************************
+ Hash a system ACL blob, looking in acl_blob_cache first.
+*******************************************************************/
+
+static NTSTATUS hash_sys_acl_blob_sha256(DATA_BLOB blob,
+					 uint8_t *hash)
+{
+	DATA_BLOB cached;
+	NTSTATUS status;
+	bool ok;
+
+	if (acl_blob_cache == NULL) {
+		/* NULL would mean the global memcache */
+		return hash_blob_sha256(blob, hash);
+	}
+
+	ok = memcache_lookup(acl_blob_cache,
+			     SYS_ACL_HASH_CACHE,
+			     blob,
+			     &cached);
+	if (ok && cached.length == XATTR_SD_HASH_SIZE) {
+		memcpy(hash, cached.data, XATTR_SD_HASH_SIZE);
+		return NT_STATUS_OK;
+	}
+
+	status = hash_blob_sha256(blob, hash);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
+	memcache_add(acl_blob_cache,
+		     SYS_ACL_HASH_CACHE,
+		     blob,
+		     data_blob_const(hash, XATTR_SD_HASH_SIZE));
+	return NT_STATUS_OK;
+}
+
 /*******************************************************************
  Hash a security descriptor.
 *******************************************************************/
@@ -131,7 +199,31 @@ static NTSTATUS parse_acl_blob(const DATA_BLOB *pblob,
 	struct xattr_NTACL xacl;
 	enum ndr_err_code ndr_err;
 	size_t sd_size;
-	TALLOC_CTX *frame = talloc_stackframe();
+	struct acl_blob_cache_entry *entry = NULL;
+	TALLOC_CTX *frame = NULL;
+
+	if (acl_blob_cache != NULL) {
+		entry = memcache_lookup_talloc(acl_blob_cache,
+					       ACL_BLOB_CACHE_TALLOC,
+					       *pblob);
+	}
+	if (entry != NULL) {
+		*ppdesc = security_descriptor_copy(mem_ctx, entry->psd);
+		if (*ppdesc == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+		*p_hash_type = entry->hash_type;
+		*p_version = entry->version;
+		memcpy(hash, entry->hash, XATTR_SD_HASH_SIZE);
+		if (entry->version == 4) {
+			memcpy(sys_acl_hash,
+			       entry->sys_acl_hash,
+			       XATTR_SD_HASH_SIZE);
+		}
+		return NT_STATUS_OK;
+	}
+
+	frame = talloc_stackframe();
 
 	ndr_err = ndr_pull_struct_blob(pblob, frame, &xacl,
 			(ndr_pull_flags_fn_t)ndr_pull_xattr_NTACL);
@@ -202,7 +294,35 @@ static NTSTATUS parse_acl_blob(const DATA_BLOB *pblob,
 
 	TALLOC_FREE(frame);
 
-	return (*ppdesc != NULL) ? NT_STATUS_OK : NT_STATUS_NO_MEMORY;
+	if (*ppdesc == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	if (acl_blob_cache == NULL) {
+		return NT_STATUS_OK;
+	}
+
+	entry = talloc_zero(NULL, struct acl_blob_cache_entry);
+	if (entry == NULL) {
+		return NT_STATUS_OK;
+	}
+	entry->version = *p_version;
+	entry->hash_type = *p_hash_type;
+	memcpy(entry->hash, hash, XATTR_SD_HASH_SIZE);
+	if (*p_version == 4) {
+		memcpy(entry->sys_acl_hash, sys_acl_hash, XATTR_SD_HASH_SIZE);
+	}
+	entry->psd = security_descriptor_copy(entry, *ppdesc);
+	if (entry->psd == NULL) {
+		TALLOC_FREE(entry);
+		return NT_STATUS_OK;
+	}
+	memcache_add_talloc(acl_blob_cache,
+			    ACL_BLOB_CACHE_TALLOC,
+			    *pblob,
+			    &entry);
+
+	return NT_STATUS_OK;
 }
 
 /*******************************************************************
@@ -492,7 +612,8 @@ static NTSTATUS validate_nt_acl_blob(TALLOC_CTX *mem_ctx,
 		/* If we fail to get the ACL blob (for some reason) then this
 		 * is not fatal, we just work based on the NT ACL only */
 		if (ret == 0) {
-			status = hash_blob_sha256(sys_acl_blob, sys_acl_hash_tmp);
+			status = hash_sys_acl_blob_sha256(sys_acl_blob,
+							  sys_acl_hash_tmp);
 			if (!NT_STATUS_IS_OK(status)) {
 				goto fail;
 			}
@@ -989,6 +1110,11 @@ NTSTATUS fset_nt_acl_common(
 	status = store_acl_blob_fsp_fn(handle, fsp, &blob);
 
 done:
+	/*
+	 * The ctime of the file does not change if the blob is stored
+	 * in a tdb, so tell the access check caches explicitly.
+	 */
+	access_check_cache_sd_changed(fsp);
 	VFS_REMOVE_FSP_EXTENSION(handle, fsp);
 	TALLOC_FREE(frame);
 	return status;
@@ -39,6 +39,7 @@
 #include "smbprofile.h"
 #include "modules/posixacl_xattr.h"
 #include "lib/util/tevent_unix.h"
+#include "lib/pthreadpool/pthreadpool_tevent.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_VFS
@@ -563,11 +564,6 @@ connect_ok:
 		 "snum=%d cookie='%s'\n",
 		 SNUM(handle->conn),
 		 cookie);
-
-	/*
-	 * Unless we have an async implementation of getxattrat turn this off.
-	 */
-	lp_do_parameter(SNUM(handle->conn), "smbd async dosmode", "false");
 connect_fail:
 	talloc_free(cookie);
 	return ret;
@@ -3911,6 +3907,276 @@ out:
 	return lstatus_code(ret);
 }
 
+struct vfs_ceph_getxattrat_state {
+	struct tevent_context *ev;
+	struct vfs_handle_struct *handle;
+	struct vfs_ceph_config *config;
+	files_struct *dir_fsp;
+	const struct smb_filename *smb_fname;
+
+	/*
+	 * The following variables are talloced off "state" which is protected
+	 * by a destructor and thus are guaranteed to be safe to be used in the
+	 * job function in the worker thread. The inode belongs to the pathref
+	 * fsp of smb_fname, which the caller keeps open until we are done.
+	 */
+	struct Inode *inode;
+	struct UserPerm *uperm;
+	const char *xattr_name;
+	uint8_t *xattr_value;
+
+	ssize_t xattr_size;
+	struct vfs_aio_state vfs_aio_state;
+	SMBPROFILE_BYTES_ASYNC_STATE(profile_bytes);
+	SMBPROFILE_BYTES_ASYNC_STATE(profile_bytes_x);
+};
+
+static int vfs_ceph_getxattrat_state_destructor(
+		struct vfs_ceph_getxattrat_state *state)
+{
+	return -1;
+}
+
+static void vfs_ceph_getxattrat_do_sync(struct tevent_req *req);
+static void vfs_ceph_getxattrat_do_async(void *private_data);
+static void vfs_ceph_getxattrat_done(struct tevent_req *subreq);
+
+/*
+ * libcephfs takes the caller's credentials as an explicit UserPerm
+ * argument, so unlike vfs_default we can run getxattr in a worker thread
+ * without per-thread cwd or credential support.
+ */
+static struct tevent_req *vfs_ceph_getxattrat_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct vfs_handle_struct *handle,
+			files_struct *dir_fsp,
+			const struct smb_filename *smb_fname,
+			const char *xattr_name,
+			size_t alloc_hint)
+{
+	struct tevent_req *req = NULL;
+	struct tevent_req *subreq = NULL;
+	struct vfs_ceph_getxattrat_state *state = NULL;
+	struct vfs_ceph_fh *cfh = NULL;
+	size_t max_threads = 0;
+	int ret;
+
+	SMB_ASSERT(!is_named_stream(smb_fname));
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct vfs_ceph_getxattrat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	*state = (struct vfs_ceph_getxattrat_state) {
+		.ev = ev,
+		.handle = handle,
+		.dir_fsp = dir_fsp,
+		.smb_fname = smb_fname,
+	};
+
+	SMB_VFS_HANDLE_GET_DATA(handle, state->config, struct vfs_ceph_config,
+				(void)0);
+	if (state->config == NULL) {
+		tevent_req_error(req, EINVAL);
+		return tevent_req_post(req, ev);
+	}
+
+	SMBPROFILE_BYTES_ASYNC_START_X(SNUM(handle->conn),
+				       syscall_asys_getxattrat,
+				       state->profile_bytes,
+				       state->profile_bytes_x,
+				       0);
+
+	if (alloc_hint > 0) {
+		state->xattr_value = talloc_zero_array(state,
+						       uint8_t,
+						       alloc_hint);
+		if (tevent_req_nomem(state->xattr_value, req)) {
+			return tevent_req_post(req, ev);
+		}
+	}
+
+	state->xattr_name = talloc_strdup(state, xattr_name);
+	if (tevent_req_nomem(state->xattr_name, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	max_threads = pthreadpool_tevent_max_threads(dir_fsp->conn->sconn->pool);
+	ret = -1;
+	if (smb_fname->fsp != NULL) {
+		ret = vfs_ceph_fetch_fh(handle, smb_fname->fsp, &cfh);
+	}
+	if ((max_threads == 0) || (ret != 0) || (cfh->iref.inode == NULL)) {
+		vfs_ceph_getxattrat_do_sync(req);
+		return tevent_req_post(req, ev);
+	}
+
+	state->inode = cfh->iref.inode;
+	state->uperm = vfs_ceph_userperm_new(state->config, handle->conn);
+	if (state->uperm == NULL) {
+		tevent_req_oom(req);
+		return tevent_req_post(req, ev);
+	}
+
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE_X(state->profile_bytes,
+					  state->profile_bytes_x);
+
+	subreq = pthreadpool_tevent_job_send_prio(
+			state,
+			ev,
+			dir_fsp->conn->sconn->pool,
+			PTHREADPOOL_PRIO_METADATA,
+			vfs_ceph_getxattrat_do_async,
+			state);
+	if (tevent_req_nomem(subreq, req)) {
+		vfs_ceph_userperm_del(state->config, state->uperm);
+		state->uperm = NULL;
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, vfs_ceph_getxattrat_done, req);
+
+	talloc_set_destructor(state, vfs_ceph_getxattrat_state_destructor);
+
+	return req;
+}
+
+static void vfs_ceph_getxattrat_do_sync(struct tevent_req *req)
+{
+	struct vfs_ceph_getxattrat_state *state = tevent_req_data(
+		req, struct vfs_ceph_getxattrat_state);
+
+	state->xattr_size = vfs_ceph_fgetxattr(
+					state->handle,
+					state->smb_fname->fsp,
+					state->xattr_name,
+					state->xattr_value,
+					talloc_array_length(state->xattr_value));
+	if (state->xattr_size == -1) {
+		tevent_req_error(req, errno);
+		return;
+	}
+
+	tevent_req_done(req);
+}
+
+static void vfs_ceph_getxattrat_do_async(void *private_data)
+{
+	struct vfs_ceph_getxattrat_state *state = talloc_get_type_abort(
+		private_data, struct vfs_ceph_getxattrat_state);
+	struct timespec start_time;
+	struct timespec end_time;
+	int ret;
+
+	PROFILE_TIMESTAMP(&start_time);
+	SMBPROFILE_BYTES_ASYNC_SET_BUSY_X(state->profile_bytes,
+					  state->profile_bytes_x);
+
+	ret = state->config->ceph_ll_getxattr_fn(
+					state->config->mount,
+					state->inode,
+					state->xattr_name,
+					state->xattr_value,
+					talloc_array_length(state->xattr_value),
+					state->uperm);
+	state->xattr_size = lstatus_code(ret);
+	if (state->xattr_size == -1) {
+		state->vfs_aio_state.error = -ret;
+	}
+
+	PROFILE_TIMESTAMP(&end_time);
+	state->vfs_aio_state.duration = nsec_time_diff(&end_time, &start_time);
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE_X(state->profile_bytes,
+					  state->profile_bytes_x);
+}
+
+static void vfs_ceph_getxattrat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct vfs_ceph_getxattrat_state *state = tevent_req_data(
+		req, struct vfs_ceph_getxattrat_state);
+	int ret;
+	bool ok;
+
+	/*
+	 * Make sure we run as the user again
+	 */
+	ok = change_to_user_and_service_by_fsp(state->dir_fsp);
+	SMB_ASSERT(ok);
+
+	ret = pthreadpool_tevent_job_recv(subreq);
+	TALLOC_FREE(subreq);
+	SMBPROFILE_BYTES_ASYNC_END(state->profile_bytes);
+	SMBPROFILE_BYTES_ASYNC_END(state->profile_bytes_x);
+	talloc_set_destructor(state, NULL);
+	vfs_ceph_userperm_del(state->config, state->uperm);
+	state->uperm = NULL;
+	if (ret != 0) {
+		if (ret != EAGAIN) {
+			tevent_req_error(req, ret);
+			return;
+		}
+		/*
+		 * If we get EAGAIN from pthreadpool_tevent_job_recv() this
+		 * means the lower level pthreadpool failed to create a new
+		 * thread. Fallback to sync processing in that case to allow
+		 * some progress for the client.
+		 */
+		vfs_ceph_getxattrat_do_sync(req);
+		return;
+	}
+
+	if (state->xattr_size == -1) {
+		tevent_req_error(req, state->vfs_aio_state.error);
+		return;
+	}
+
+	if (state->xattr_value == NULL) {
+		/*
+		 * The caller only wanted the size.
+		 */
+		tevent_req_done(req);
+		return;
+	}
+
+	/*
+	 * shrink the buffer to the returned size.
+	 * (can't fail). It means NULL if size is 0.
+	 */
+	state->xattr_value = talloc_realloc(state,
+					    state->xattr_value,
+					    uint8_t,
+					    state->xattr_size);
+
+	tevent_req_done(req);
+}
+
+static ssize_t vfs_ceph_getxattrat_recv(struct tevent_req *req,
+					struct vfs_aio_state *aio_state,
+					TALLOC_CTX *mem_ctx,
+					uint8_t **xattr_value)
+{
+	struct vfs_ceph_getxattrat_state *state = tevent_req_data(
+		req, struct vfs_ceph_getxattrat_state);
+	ssize_t xattr_size;
+
+	if (tevent_req_is_unix_error(req, &aio_state->error)) {
+		tevent_req_received(req);
+		return -1;
+	}
+
+	*aio_state = state->vfs_aio_state;
+	xattr_size = state->xattr_size;
+	if (xattr_value != NULL) {
+		*xattr_value = talloc_move(mem_ctx, &state->xattr_value);
+	}
+
+	tevent_req_received(req);
+	return xattr_size;
+}
+
 static ssize_t vfs_ceph_flistxattr(struct vfs_handle_struct *handle,
 				   struct files_struct *fsp,
 				   char *list,
@@ -4282,8 +4548,8 @@ static struct vfs_fn_pointers ceph_new_fns = {
 	.fset_dos_attributes_fn = vfs_ceph_fset_dos_attributes,
 
 	/* EA operations. */
-	.getxattrat_send_fn = vfs_not_implemented_getxattrat_send,
-	.getxattrat_recv_fn = vfs_not_implemented_getxattrat_recv,
+	.getxattrat_send_fn = vfs_ceph_getxattrat_send,
+	.getxattrat_recv_fn = vfs_ceph_getxattrat_recv,
 	.fgetxattr_fn = vfs_ceph_fgetxattr,
 	.flistxattr_fn = vfs_ceph_flistxattr,
 	.fremovexattr_fn = vfs_ceph_fremovexattr,
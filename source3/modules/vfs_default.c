@@ -77,6 +77,24 @@ static int vfswrap_connect(vfs_handle_struct *handle, const char *service, const
 	handle->conn->open_how_resolve &= ~VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS;
 #endif
 
+	/*
+	 * RESOLVE_BENEATH lets the kernel follow symlinks below the
+	 * share in the direct open, but then the name recorded for the
+	 * file is the one with the symlinks, not the canonical one the
+	 * component walk by smbd gives. So it is off unless asked for.
+	 */
+	bval = lp_parm_bool(SNUM(handle->conn),
+			    "vfs_default",
+			    "VFS_OPEN_HOW_RESOLVE_BENEATH",
+			    false);
+	if (bval) {
+		handle->conn->open_how_resolve |=
+			VFS_OPEN_HOW_RESOLVE_BENEATH;
+	}
+#ifdef DISABLE_VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS
+	handle->conn->open_how_resolve &= ~VFS_OPEN_HOW_RESOLVE_BENEATH;
+#endif
+
 	return 0;    /* Return >= 0 for success */
 }
 
@@ -150,15 +168,74 @@ static int vfswrap_statvfs(struct vfs_handle_struct *handle,
 	return sys_statvfs(smb_fname->base_name, statbuf);
 }
 
+/*
+ * Find out whether FICLONERANGE works on the filesystem below the
+ * share, so that FSCTL_DUPLICATE_EXTENTS_TO_FILE can be offered on
+ * XFS, OCFS2, Btrfs and friends without a filesystem specific module.
+ *
+ * Cloning an empty unnamed file into another one is a no-op on
+ * filesystems that support reflinks, everything else (including XFS
+ * formatted without reflink=1) fails with EOPNOTSUPP or EXDEV.
+ */
+static bool vfswrap_probe_reflink(struct connection_struct *conn)
+{
+#if defined(HAVE_LINUX_IOCTL) && defined(O_TMPFILE)
+	int src_fd = -1;
+	int dst_fd = -1;
+	int ret = -1;
+
+	src_fd = open(conn->connectpath, O_RDWR|O_TMPFILE|O_CLOEXEC, 0600);
+	if (src_fd == -1) {
+		DBG_DEBUG("O_TMPFILE in [%s] failed: %s\n",
+			  conn->connectpath, strerror(errno));
+		goto out;
+	}
+	dst_fd = open(conn->connectpath, O_RDWR|O_TMPFILE|O_CLOEXEC, 0600);
+	if (dst_fd == -1) {
+		DBG_DEBUG("O_TMPFILE in [%s] failed: %s\n",
+			  conn->connectpath, strerror(errno));
+		goto out;
+	}
+
+	ret = copy_reflink(src_fd, 0, dst_fd, 0, 0);
+	if (ret == -1) {
+		DBG_DEBUG("No reflink support in [%s]: %s\n",
+			  conn->connectpath, strerror(errno));
+	}
+out:
+	if (src_fd != -1) {
+		close(src_fd);
+	}
+	if (dst_fd != -1) {
+		close(dst_fd);
+	}
+	return ret == 0;
+#else
+	return false;
+#endif
+}
+
 static uint32_t vfswrap_fs_capabilities(struct vfs_handle_struct *handle,
 		enum timestamp_set_resolution *p_ts_res)
 {
 	uint32_t caps = vfs_get_fs_capabilities(handle->conn, p_ts_res);
+	bool bval;
 
 #if defined(HAVE_SYS_QUOTAS)
 	caps |= FILE_VOLUME_QUOTAS;
 #endif
 
+	bval = lp_parm_bool(SNUM(handle->conn),
+			    "vfs_default",
+			    "reflink",
+			    true);
+	if (bval &&
+	    !(caps & FILE_SUPPORTS_BLOCK_REFCOUNTING) &&
+	    vfswrap_probe_reflink(handle->conn))
+	{
+		caps |= FILE_SUPPORTS_BLOCK_REFCOUNTING;
+	}
+
 	return caps;
 }
 
@@ -619,6 +696,7 @@ static int vfswrap_openat(vfs_handle_struct *handle,
 	SMB_ASSERT((dirfd != -1) || (smb_fname->base_name[0] == '/'));
 
 	if (how->resolve & ~(VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS |
+			     VFS_OPEN_HOW_RESOLVE_BENEATH |
 			     VFS_OPEN_HOW_WITH_BACKUP_INTENT)) {
 		errno = ENOSYS;
 		result = -1;
@@ -652,13 +730,21 @@ static int vfswrap_openat(vfs_handle_struct *handle,
 	}
 #endif
 
-	if (how->resolve & VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS) {
+	if (how->resolve & (VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS |
+			    VFS_OPEN_HOW_RESOLVE_BENEATH)) {
 		struct open_how linux_how = {
 			.flags = flags,
 			.mode = mode,
-			.resolve = RESOLVE_NO_SYMLINKS,
 		};
 
+		if (how->resolve & VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS) {
+			linux_how.resolve |= RESOLVE_NO_SYMLINKS;
+		}
+		if (how->resolve & VFS_OPEN_HOW_RESOLVE_BENEATH) {
+			linux_how.resolve |= RESOLVE_BENEATH |
+					     RESOLVE_NO_MAGICLINKS;
+		}
+
 		result = openat2(dirfd,
 				 smb_fname->base_name,
 				 &linux_how,
@@ -673,7 +759,8 @@ static int vfswrap_openat(vfs_handle_struct *handle,
 				 * would just be a waste of time.
 				 */
 				fsp->conn->open_how_resolve &=
-					~VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS;
+					~(VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS |
+					  VFS_OPEN_HOW_RESOLVE_BENEATH);
 			}
 			goto out;
 		}
@@ -822,6 +909,19 @@ struct vfswrap_pread_state {
 	SMBPROFILE_BYTES_ASYNC_STATE(profile_bytes_x);
 };
 
+/*
+ * Small reads and writes usually have a client waiting for the
+ * reply, large ones are copies and streaming. Let the threadpool
+ * start the small ones first.
+ */
+static enum pthreadpool_prio vfswrap_io_prio(size_t n)
+{
+	if (n <= 65536) {
+		return PTHREADPOOL_PRIO_INTERACTIVE;
+	}
+	return PTHREADPOOL_PRIO_BULK;
+}
+
 static void vfs_pread_do(void *private_data);
 static void vfs_pread_done(struct tevent_req *subreq);
 static int vfs_pread_state_destructor(struct vfswrap_pread_state *state);
@@ -855,8 +955,8 @@ static struct tevent_req *vfswrap_pread_send(struct vfs_handle_struct *handle,
 	SMBPROFILE_BYTES_ASYNC_SET_IDLE_X(state->profile_bytes,
 					  state->profile_bytes_x);
 
-	subreq = pthreadpool_tevent_job_send(
-		state, ev, handle->conn->sconn->pool,
+	subreq = pthreadpool_tevent_job_send_prio(
+		state, ev, handle->conn->sconn->pool, vfswrap_io_prio(n),
 		vfs_pread_do, state);
 	if (tevent_req_nomem(subreq, req)) {
 		return tevent_req_post(req, ev);
@@ -999,8 +1099,8 @@ static struct tevent_req *vfswrap_pwrite_send(struct vfs_handle_struct *handle,
 	SMBPROFILE_BYTES_ASYNC_SET_IDLE_X(state->profile_bytes,
 					  state->profile_bytes_x);
 
-	subreq = pthreadpool_tevent_job_send(
-		state, ev, handle->conn->sconn->pool,
+	subreq = pthreadpool_tevent_job_send_prio(
+		state, ev, handle->conn->sconn->pool, vfswrap_io_prio(n),
 		vfs_pwrite_do, state);
 	if (tevent_req_nomem(subreq, req)) {
 		return tevent_req_post(req, ev);
@@ -1133,8 +1233,9 @@ static struct tevent_req *vfswrap_fsync_send(struct vfs_handle_struct *handle,
 	SMBPROFILE_BYTES_ASYNC_SET_IDLE_X(state->profile_bytes,
 					  state->profile_bytes_x);
 
-	subreq = pthreadpool_tevent_job_send(
-		state, ev, handle->conn->sconn->pool, vfs_fsync_do, state);
+	subreq = pthreadpool_tevent_job_send_prio(
+		state, ev, handle->conn->sconn->pool, PTHREADPOOL_PRIO_BULK,
+		vfs_fsync_do, state);
 	if (tevent_req_nomem(subreq, req)) {
 		return tevent_req_post(req, ev);
 	}
@@ -1372,6 +1473,276 @@ static int vfswrap_fstatat(
 	return result;
 }
 
+struct vfswrap_fstatat_state {
+	struct vfs_handle_struct *handle;
+	files_struct *dirfsp;
+	const struct smb_filename *smb_fname;
+	int flags;
+
+	/*
+	 * The following variables are talloced off "state" which is protected
+	 * by a destructor and thus are guaranteed to be safe to be used in the
+	 * job function in the worker thread.
+	 */
+	int dirfd;
+	char *name;
+	struct security_unix_token *token;
+	bool fake_dir_create_times;
+
+	int ret;
+	SMB_STRUCT_STAT sbuf;
+	struct vfs_aio_state vfs_aio_state;
+	SMBPROFILE_BYTES_ASYNC_STATE(profile_bytes);
+	SMBPROFILE_BYTES_ASYNC_STATE(profile_bytes_x);
+};
+
+static int vfswrap_fstatat_state_destructor(
+		struct vfswrap_fstatat_state *state)
+{
+	return -1;
+}
+
+static void vfswrap_fstatat_do_sync(struct tevent_req *req);
+static void vfswrap_fstatat_do_async(void *private_data);
+static void vfswrap_fstatat_done(struct tevent_req *subreq);
+
+static struct tevent_req *vfswrap_fstatat_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct vfs_handle_struct *handle,
+	files_struct *dirfsp,
+	const struct smb_filename *smb_fname,
+	int flags)
+{
+	struct tevent_req *req = NULL;
+	struct tevent_req *subreq = NULL;
+	struct vfswrap_fstatat_state *state = NULL;
+	size_t max_threads = 0;
+	bool have_per_thread_cwd = false;
+	bool have_per_thread_creds = false;
+	bool do_async = false;
+
+	SMB_ASSERT(!is_named_stream(smb_fname));
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct vfswrap_fstatat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	*state = (struct vfswrap_fstatat_state) {
+		.handle = handle,
+		.dirfsp = dirfsp,
+		.smb_fname = smb_fname,
+		.flags = flags,
+		.dirfd = fsp_get_pathref_fd(dirfsp),
+		.fake_dir_create_times = lp_fake_directory_create_times(
+			SNUM(handle->conn)),
+	};
+
+	max_threads = pthreadpool_tevent_max_threads(dirfsp->conn->sconn->pool);
+	if (max_threads >= 1) {
+		/*
+		 * We need a non sync threadpool!
+		 */
+		have_per_thread_cwd = per_thread_cwd_supported();
+	}
+#ifdef HAVE_LINUX_THREAD_CREDENTIALS
+	have_per_thread_creds = true;
+#endif
+	if (have_per_thread_cwd && have_per_thread_creds) {
+		do_async = true;
+	}
+
+	SMBPROFILE_BYTES_ASYNC_START_X(SNUM(handle->conn),
+				       syscall_asys_fstatat,
+				       state->profile_bytes,
+				       state->profile_bytes_x,
+				       0);
+
+	if (!do_async) {
+		vfswrap_fstatat_do_sync(req);
+		return tevent_req_post(req, ev);
+	}
+
+	/*
+	 * Now allocate all parameters from a memory context that won't go away
+	 * no matter what. These parameters will get used in threads and we
+	 * can't reliably cancel threads, so all buffers passed to the threads
+	 * must not be freed before all referencing threads terminate.
+	 */
+
+	if (state->dirfd == AT_FDCWD && smb_fname->base_name[0] != '/') {
+		/*
+		 * The worker threads have their own cwd,
+		 * which doesn't follow our chdir() calls.
+		 */
+		state->name = talloc_asprintf(state,
+					      "%s/%s",
+					      dirfsp->fsp_name->base_name,
+					      smb_fname->base_name);
+	} else {
+		state->name = talloc_strdup(state, smb_fname->base_name);
+	}
+	if (tevent_req_nomem(state->name, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	if (geteuid() == sec_initial_uid()) {
+		state->token = root_unix_token(state);
+	} else {
+		state->token = copy_unix_token(
+					state,
+					dirfsp->conn->session_info->unix_token);
+	}
+	if (tevent_req_nomem(state->token, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE_X(state->profile_bytes,
+					  state->profile_bytes_x);
+
+	subreq = pthreadpool_tevent_job_send_prio(
+			state,
+			ev,
+			dirfsp->conn->sconn->pool,
+			PTHREADPOOL_PRIO_METADATA,
+			vfswrap_fstatat_do_async,
+			state);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, vfswrap_fstatat_done, req);
+
+	talloc_set_destructor(state, vfswrap_fstatat_state_destructor);
+
+	return req;
+}
+
+static void vfswrap_fstatat_do_sync(struct tevent_req *req)
+{
+	struct vfswrap_fstatat_state *state = tevent_req_data(
+		req, struct vfswrap_fstatat_state);
+	struct timespec start_time;
+	struct timespec end_time;
+
+	PROFILE_TIMESTAMP(&start_time);
+	state->ret = vfswrap_fstatat(state->handle,
+				     state->dirfsp,
+				     state->smb_fname,
+				     &state->sbuf,
+				     state->flags);
+	PROFILE_TIMESTAMP(&end_time);
+	state->vfs_aio_state.duration = nsec_time_diff(&end_time, &start_time);
+	if (state->ret == -1) {
+		tevent_req_error(req, errno);
+		return;
+	}
+
+	tevent_req_done(req);
+}
+
+static void vfswrap_fstatat_do_async(void *private_data)
+{
+	struct vfswrap_fstatat_state *state = talloc_get_type_abort(
+		private_data, struct vfswrap_fstatat_state);
+	struct timespec start_time;
+	struct timespec end_time;
+	int ret;
+
+	PROFILE_TIMESTAMP(&start_time);
+	SMBPROFILE_BYTES_ASYNC_SET_BUSY_X(state->profile_bytes,
+					  state->profile_bytes_x);
+
+	per_thread_cwd_activate();
+
+	/* Become the correct credential on this thread. */
+	ret = set_thread_credentials(state->token->uid,
+				     state->token->gid,
+				     (size_t)state->token->ngroups,
+				     state->token->groups);
+	if (ret != 0) {
+		state->ret = -1;
+		state->vfs_aio_state.error = errno;
+		goto end_profile;
+	}
+
+	state->ret = sys_fstatat(state->dirfd,
+				 state->name,
+				 &state->sbuf,
+				 state->flags,
+				 state->fake_dir_create_times);
+	if (state->ret == -1) {
+		state->vfs_aio_state.error = errno;
+	}
+
+end_profile:
+	PROFILE_TIMESTAMP(&end_time);
+	state->vfs_aio_state.duration = nsec_time_diff(&end_time, &start_time);
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE_X(state->profile_bytes,
+					  state->profile_bytes_x);
+}
+
+static void vfswrap_fstatat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct vfswrap_fstatat_state *state = tevent_req_data(
+		req, struct vfswrap_fstatat_state);
+	int ret;
+	bool ok;
+
+	/*
+	 * Make sure we run as the user again
+	 */
+	ok = change_to_user_and_service_by_fsp(state->dirfsp);
+	SMB_ASSERT(ok);
+
+	ret = pthreadpool_tevent_job_recv(subreq);
+	TALLOC_FREE(subreq);
+	SMBPROFILE_BYTES_ASYNC_END(state->profile_bytes);
+	SMBPROFILE_BYTES_ASYNC_END(state->profile_bytes_x);
+	talloc_set_destructor(state, NULL);
+	if (ret != 0) {
+		if (ret != EAGAIN) {
+			tevent_req_error(req, ret);
+			return;
+		}
+		/*
+		 * If we get EAGAIN from pthreadpool_tevent_job_recv() this
+		 * means the lower level pthreadpool failed to create a new
+		 * thread. Fallback to sync processing in that case to allow
+		 * some progress for the client.
+		 */
+		vfswrap_fstatat_do_sync(req);
+		return;
+	}
+
+	if (state->ret == -1) {
+		tevent_req_error(req, state->vfs_aio_state.error);
+		return;
+	}
+
+	tevent_req_done(req);
+}
+
+static int vfswrap_fstatat_recv(struct tevent_req *req,
+				struct vfs_aio_state *aio_state,
+				SMB_STRUCT_STAT *sbuf)
+{
+	struct vfswrap_fstatat_state *state = tevent_req_data(
+		req, struct vfswrap_fstatat_state);
+
+	if (tevent_req_is_unix_error(req, &aio_state->error)) {
+		tevent_req_received(req);
+		return -1;
+	}
+
+	*aio_state = state->vfs_aio_state;
+	*sbuf = state->sbuf;
+	tevent_req_received(req);
+	return 0;
+}
+
 static NTSTATUS vfswrap_translate_name(struct vfs_handle_struct *handle,
 				       const char *name,
 				       enum vfs_translate_direction direction,
@@ -1984,6 +2355,139 @@ static NTSTATUS vfswrap_get_dos_attributes_recv(struct tevent_req *req,
 	return NT_STATUS_OK;
 }
 
+struct vfswrap_get_dos_attributes_batch_state {
+	struct vfs_aio_state aio_state;
+	files_struct *dir_fsp;
+	size_t num_pending;
+	uint32_t *dosmodes;
+	NTSTATUS *statuses;
+};
+
+struct vfswrap_get_dos_attributes_batch_entry {
+	struct tevent_req *req;
+	size_t idx;
+};
+
+static void vfswrap_get_dos_attributes_batch_done(struct tevent_req *subreq);
+
+/*
+ * Run the single entry requests of the whole stack in parallel, they
+ * end up as getxattrat requests in the threadpool
+ */
+static struct tevent_req *vfswrap_get_dos_attributes_batch_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct vfs_handle_struct *handle,
+			files_struct *dir_fsp,
+			struct smb_filename **smb_fnames,
+			size_t num_fnames)
+{
+	struct tevent_req *req = NULL;
+	struct vfswrap_get_dos_attributes_batch_state *state = NULL;
+	size_t i;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct vfswrap_get_dos_attributes_batch_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	*state = (struct vfswrap_get_dos_attributes_batch_state) {
+		.dir_fsp = dir_fsp,
+	};
+
+	state->dosmodes = talloc_zero_array(state, uint32_t, num_fnames);
+	if (tevent_req_nomem(state->dosmodes, req)) {
+		return tevent_req_post(req, ev);
+	}
+	state->statuses = talloc_zero_array(state, NTSTATUS, num_fnames);
+	if (tevent_req_nomem(state->statuses, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	for (i = 0; i < num_fnames; i++) {
+		struct vfswrap_get_dos_attributes_batch_entry *e = NULL;
+		struct tevent_req *subreq = NULL;
+
+		subreq = SMB_VFS_GET_DOS_ATTRIBUTES_SEND(state,
+							 ev,
+							 dir_fsp,
+							 smb_fnames[i]);
+		if (tevent_req_nomem(subreq, req)) {
+			return tevent_req_post(req, ev);
+		}
+
+		e = talloc(subreq, struct vfswrap_get_dos_attributes_batch_entry);
+		if (tevent_req_nomem(e, req)) {
+			return tevent_req_post(req, ev);
+		}
+		*e = (struct vfswrap_get_dos_attributes_batch_entry) {
+			.req = req,
+			.idx = i,
+		};
+
+		tevent_req_set_callback(subreq,
+					vfswrap_get_dos_attributes_batch_done,
+					e);
+		state->num_pending += 1;
+	}
+
+	if (state->num_pending == 0) {
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+	}
+
+	return req;
+}
+
+static void vfswrap_get_dos_attributes_batch_done(struct tevent_req *subreq)
+{
+	struct vfswrap_get_dos_attributes_batch_entry *e =
+		tevent_req_callback_data(subreq,
+		struct vfswrap_get_dos_attributes_batch_entry);
+	struct tevent_req *req = e->req;
+	struct vfswrap_get_dos_attributes_batch_state *state =
+		tevent_req_data(req,
+		struct vfswrap_get_dos_attributes_batch_state);
+	struct vfs_aio_state aio_state = {};
+	size_t idx = e->idx;
+
+	state->statuses[idx] = SMB_VFS_GET_DOS_ATTRIBUTES_RECV(
+		subreq, &aio_state, &state->dosmodes[idx]);
+	TALLOC_FREE(subreq);
+
+	state->aio_state.duration += aio_state.duration;
+
+	state->num_pending -= 1;
+	if (state->num_pending > 0) {
+		return;
+	}
+	tevent_req_done(req);
+}
+
+static NTSTATUS vfswrap_get_dos_attributes_batch_recv(
+			struct tevent_req *req,
+			struct vfs_aio_state *aio_state,
+			uint32_t *dosmodes,
+			NTSTATUS *statuses)
+{
+	struct vfswrap_get_dos_attributes_batch_state *state =
+		tevent_req_data(req,
+		struct vfswrap_get_dos_attributes_batch_state);
+	size_t num = talloc_array_length(state->dosmodes);
+	NTSTATUS status;
+
+	if (tevent_req_is_nterror(req, &status)) {
+		tevent_req_received(req);
+		return status;
+	}
+
+	*aio_state = state->aio_state;
+	memcpy(dosmodes, state->dosmodes, num * sizeof(uint32_t));
+	memcpy(statuses, state->statuses, num * sizeof(NTSTATUS));
+	tevent_req_received(req);
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS vfswrap_fget_dos_attributes(struct vfs_handle_struct *handle,
 					    struct files_struct *fsp,
 					    uint32_t *dosmode)
@@ -2096,6 +2600,16 @@ static NTSTATUS vfswrap_offload_read_recv(struct tevent_req *req,
 	return NT_STATUS_OK;
 }
 
+/*
+ * copy_file_range() runs in the threadpool, split into jobs of at most
+ * VFSWRAP_CFR_JOB_SIZE bytes with up to VFSWRAP_CFR_MAX_JOBS of them
+ * in flight.
+ */
+#define VFSWRAP_CFR_JOB_SIZE (1024 * 1024)
+#define VFSWRAP_CFR_MAX_JOBS 4
+
+static bool try_copy_file_range = true;
+
 struct vfswrap_offload_write_state {
 	uint8_t *buf;
 	bool read_lck_locked;
@@ -2111,6 +2625,25 @@ struct vfswrap_offload_write_state {
 	off_t remaining;
 	off_t copied;
 	size_t next_io_size;
+	struct pthreadpool_tevent *pool;
+	int snum;
+	unsigned cfr_jobs;
+	NTSTATUS cfr_status;
+	bool cancelled;
+};
+
+struct vfswrap_cfr_job {
+	struct tevent_req *req;
+	int src_fd;
+	off_t src_off;
+	int dst_fd;
+	off_t dst_off;
+	size_t len;
+	size_t copied;
+	int err;
+
+	SMBPROFILE_BYTES_ASYNC_STATE(profile_bytes);
+	SMBPROFILE_BYTES_ASYNC_STATE(profile_bytes_x);
 };
 
 static void vfswrap_offload_write_cleanup(struct tevent_req *req,
@@ -2129,7 +2662,22 @@ static void vfswrap_offload_write_cleanup(struct tevent_req *req,
 	state->dst_fsp = NULL;
 }
 
+static bool vfswrap_offload_write_cancel(struct tevent_req *req)
+{
+	struct vfswrap_offload_write_state *state = tevent_req_data(
+		req, struct vfswrap_offload_write_state);
+
+	/*
+	 * Copies that are in flight are finished, we just don't start
+	 * new ones. The request completes with NT_STATUS_CANCELLED
+	 * once the last one is done.
+	 */
+	state->cancelled = true;
+	return true;
+}
+
 static NTSTATUS vfswrap_offload_fast_copy(struct tevent_req *req, int fsctl);
+static NTSTATUS vfswrap_offload_write_start_loop(struct tevent_req *req);
 static NTSTATUS vfswrap_offload_write_loop(struct tevent_req *req);
 
 static struct tevent_req *vfswrap_offload_write_send(
@@ -2147,7 +2695,6 @@ static struct tevent_req *vfswrap_offload_write_send(
 	struct vfswrap_offload_write_state *state = NULL;
 	/* off_t is signed! */
 	off_t max_offset = INT64_MAX - to_copy;
-	off_t num = to_copy;
 	files_struct *src_fsp = NULL;
 	NTSTATUS status;
 	bool ok;
@@ -2166,6 +2713,8 @@ static struct tevent_req *vfswrap_offload_write_send(
 		.dst_off = dest_off,
 		.to_copy = to_copy,
 		.remaining = to_copy,
+		.pool = handle->conn->sconn->pool,
+		.snum = SNUM(handle->conn),
 	};
 
 	status = vfs_offload_token_ctx_init(handle->conn->sconn->client,
@@ -2175,6 +2724,7 @@ static struct tevent_req *vfswrap_offload_write_send(
 	}
 
 	tevent_req_set_cleanup_fn(req, vfswrap_offload_write_cleanup);
+	tevent_req_set_cancel_fn(req, vfswrap_offload_write_cancel);
 
 	switch (fsctl) {
 	case FSCTL_DUP_EXTENTS_TO_FILE:
@@ -2182,7 +2732,6 @@ static struct tevent_req *vfswrap_offload_write_send(
 
 	case FSCTL_SRV_COPYCHUNK:
 	case FSCTL_SRV_COPYCHUNK_WRITE:
-		num = MIN(to_copy, COPYCHUNK_MAX_TOTAL_LEN);
 		break;
 
 	case FSCTL_OFFLOAD_WRITE:
@@ -2277,17 +2826,16 @@ static struct tevent_req *vfswrap_offload_write_send(
 		tevent_req_done(req);
 		return tevent_req_post(req, ev);
 	}
+	if (NT_STATUS_EQUAL(status, NT_STATUS_PENDING)) {
+		/* copy_file_range() jobs are running */
+		return req;
+	}
 	if (!NT_STATUS_EQUAL(status, NT_STATUS_MORE_PROCESSING_REQUIRED)) {
 		tevent_req_nterror(req, status);
 		return tevent_req_post(req, ev);
 	}
 
-	state->buf = talloc_array(state, uint8_t, num);
-	if (tevent_req_nomem(state->buf, req)) {
-		return tevent_req_post(req, ev);
-	}
-
-	status = vfswrap_offload_write_loop(req);
+	status = vfswrap_offload_write_start_loop(req);
 	if (!NT_STATUS_IS_OK(status)) {
 		tevent_req_nterror(req, status);
 		return tevent_req_post(req, ev);
@@ -2296,16 +2844,236 @@ static struct tevent_req *vfswrap_offload_write_send(
 	return req;
 }
 
+/*
+ * Fall back to copying with pread/pwrite through our own buffer. This
+ * is called under the context of state->src_fsp.
+ */
+static NTSTATUS vfswrap_offload_write_start_loop(struct tevent_req *req)
+{
+	struct vfswrap_offload_write_state *state = tevent_req_data(
+		req, struct vfswrap_offload_write_state);
+	off_t num = MIN(state->remaining, COPYCHUNK_MAX_TOTAL_LEN);
+
+	state->buf = talloc_array(state, uint8_t, num);
+	if (state->buf == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	return vfswrap_offload_write_loop(req);
+}
+
+static void vfswrap_cfr_do(void *private_data)
+{
+	struct vfswrap_cfr_job *job = talloc_get_type_abort(
+		private_data, struct vfswrap_cfr_job);
+	off_t src_off = job->src_off;
+	off_t dst_off = job->dst_off;
+
+	SMBPROFILE_BYTES_ASYNC_SET_BUSY_X(job->profile_bytes,
+					  job->profile_bytes_x);
+
+	while (job->copied < job->len) {
+		ssize_t nwritten;
+
+		nwritten = copy_file_range(job->src_fd,
+					   &src_off,
+					   job->dst_fd,
+					   &dst_off,
+					   job->len - job->copied,
+					   0);
+		if (nwritten == -1) {
+			job->err = errno;
+			break;
+		}
+		if (nwritten == 0) {
+			break;
+		}
+		job->copied += nwritten;
+	}
+
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE_X(job->profile_bytes,
+					  job->profile_bytes_x);
+}
+
+static int vfswrap_cfr_job_destructor(struct vfswrap_cfr_job *job)
+{
+	return -1;
+}
+
+static void vfswrap_cfr_done(struct tevent_req *subreq);
+
+/*
+ * Start copy_file_range() jobs for the not yet scheduled part of the
+ * copy. state->src_off, state->dst_off and state->remaining describe
+ * that part, state->copied only counts what the jobs have finished.
+ */
+static NTSTATUS vfswrap_cfr_schedule(struct tevent_req *req,
+				     unsigned max_jobs)
+{
+	struct vfswrap_offload_write_state *state = tevent_req_data(
+		req, struct vfswrap_offload_write_state);
+
+	while (state->remaining > 0 && state->cfr_jobs < max_jobs) {
+		struct vfswrap_cfr_job *job = NULL;
+		struct tevent_req *subreq = NULL;
+
+		job = talloc(state, struct vfswrap_cfr_job);
+		if (job == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+		*job = (struct vfswrap_cfr_job) {
+			.req = req,
+			.src_fd = fsp_get_io_fd(state->src_fsp),
+			.src_off = state->src_off,
+			.dst_fd = fsp_get_io_fd(state->dst_fsp),
+			.dst_off = state->dst_off,
+			.len = MIN(state->remaining, VFSWRAP_CFR_JOB_SIZE),
+		};
+
+		SMBPROFILE_BYTES_ASYNC_START_X(state->snum,
+					       syscall_asys_copy_file_range,
+					       job->profile_bytes,
+					       job->profile_bytes_x,
+					       job->len);
+		SMBPROFILE_BYTES_ASYNC_SET_IDLE_X(job->profile_bytes,
+						  job->profile_bytes_x);
+
+		subreq = pthreadpool_tevent_job_send_prio(
+			job, state->dst_ev, state->pool,
+			PTHREADPOOL_PRIO_BULK, vfswrap_cfr_do, job);
+		if (subreq == NULL) {
+			SMBPROFILE_BYTES_ASYNC_END(job->profile_bytes);
+			SMBPROFILE_BYTES_ASYNC_END(job->profile_bytes_x);
+			TALLOC_FREE(job);
+			return NT_STATUS_NO_MEMORY;
+		}
+		tevent_req_set_callback(subreq, vfswrap_cfr_done, job);
+		talloc_set_destructor(job, vfswrap_cfr_job_destructor);
+
+		state->src_off += job->len;
+		state->dst_off += job->len;
+		state->remaining -= job->len;
+		state->cfr_jobs += 1;
+	}
+
+	return NT_STATUS_OK;
+}
+
+static void vfswrap_cfr_done(struct tevent_req *subreq)
+{
+	struct vfswrap_cfr_job *job = tevent_req_callback_data(
+		subreq, struct vfswrap_cfr_job);
+	struct tevent_req *req = job->req;
+	struct vfswrap_offload_write_state *state = tevent_req_data(
+		req, struct vfswrap_offload_write_state);
+	NTSTATUS status;
+	int ret;
+
+	ret = pthreadpool_tevent_job_recv(subreq);
+	TALLOC_FREE(subreq);
+	talloc_set_destructor(job, NULL);
+	if (ret == EAGAIN) {
+		/*
+		 * The pthreadpool failed to create a new thread,
+		 * fallback to sync processing.
+		 */
+		vfswrap_cfr_do(job);
+	} else if (ret != 0) {
+		job->err = ret;
+	}
+	SMBPROFILE_BYTES_ASYNC_END(job->profile_bytes);
+	SMBPROFILE_BYTES_ASYNC_END(job->profile_bytes_x);
+
+	state->cfr_jobs -= 1;
+	state->copied += job->copied;
+
+	if (job->err != 0) {
+		DBG_DEBUG("copy_file_range src [%s]:[%jd] dst [%s]:[%jd] "
+			  "n [%zu] failed: %s\n",
+			  fsp_str_dbg(state->src_fsp),
+			  (intmax_t)job->src_off,
+			  fsp_str_dbg(state->dst_fsp),
+			  (intmax_t)job->dst_off,
+			  job->len,
+			  strerror(job->err));
+	}
+
+	if (job->err != 0 && job->copied == 0 && state->copied == 0 &&
+	    state->cfr_jobs == 0 &&
+	    (job->err == EOPNOTSUPP || job->err == ENOSYS ||
+	     job->err == EXDEV))
+	{
+		bool ok;
+
+		/*
+		 * The first job is the only one we start before we
+		 * know copy_file_range() works for this pair of files,
+		 * so nothing has been copied yet: restart from the
+		 * beginning with pread/pwrite.
+		 */
+		if (job->err != EXDEV) {
+			try_copy_file_range = false;
+		}
+		state->src_off = job->src_off;
+		state->dst_off = job->dst_off;
+		state->remaining = state->to_copy;
+		TALLOC_FREE(job);
+
+		ok = change_to_user_and_service_by_fsp(state->src_fsp);
+		if (!ok) {
+			tevent_req_nterror(req, NT_STATUS_INTERNAL_ERROR);
+			return;
+		}
+		status = vfswrap_offload_write_start_loop(req);
+		if (!NT_STATUS_IS_OK(status)) {
+			tevent_req_nterror(req, status);
+		}
+		return;
+	}
+
+	if (NT_STATUS_IS_OK(state->cfr_status)) {
+		if (job->err != 0) {
+			state->cfr_status = map_nt_error_from_unix(job->err);
+			if (NT_STATUS_EQUAL(state->cfr_status,
+					    NT_STATUS_MORE_PROCESSING_REQUIRED))
+			{
+				state->cfr_status = NT_STATUS_INTERNAL_ERROR;
+			}
+		} else if (job->copied != job->len) {
+			DBG_ERR("Short copy, only %zu of %zu\n",
+				job->copied, job->len);
+			state->cfr_status = NT_STATUS_IO_DEVICE_ERROR;
+		}
+	}
+	TALLOC_FREE(job);
+
+	if (NT_STATUS_IS_OK(state->cfr_status) && !state->cancelled) {
+		state->cfr_status = vfswrap_cfr_schedule(
+			req, VFSWRAP_CFR_MAX_JOBS);
+	}
+	if (state->cfr_jobs > 0) {
+		return;
+	}
+
+	if (tevent_req_nterror(req, state->cfr_status)) {
+		return;
+	}
+	if (state->remaining > 0) {
+		SMB_ASSERT(state->cancelled);
+		tevent_req_nterror(req, NT_STATUS_CANCELLED);
+		return;
+	}
+	tevent_req_done(req);
+}
+
 static NTSTATUS vfswrap_offload_fast_copy(struct tevent_req *req, int fsctl)
 {
 	struct vfswrap_offload_write_state *state = tevent_req_data(
 		req, struct vfswrap_offload_write_state);
 	struct lock_struct lck;
-	ssize_t nwritten;
 	NTSTATUS status;
 	bool same_file;
 	bool ok;
-	static bool try_copy_file_range = true;
 
 	same_file = file_id_equal(&state->src_fsp->file_id,
 				  &state->dst_fsp->file_id);
@@ -2389,61 +3157,21 @@ static NTSTATUS vfswrap_offload_fast_copy(struct tevent_req *req, int fsctl)
 		return NT_STATUS_FILE_LOCK_CONFLICT;
 	}
 
-	while (state->remaining > 0) {
-		nwritten = copy_file_range(fsp_get_io_fd(state->src_fsp),
-					   &state->src_off,
-					   fsp_get_io_fd(state->dst_fsp),
-					   &state->dst_off,
-					   state->remaining,
-					   0);
-		if (nwritten == -1) {
-			DBG_DEBUG("copy_file_range src [%s]:[%jd] dst [%s]:[%jd] "
-				  "n [%jd] failed: %s\n",
-				  fsp_str_dbg(state->src_fsp),
-				  (intmax_t)state->src_off,
-				  fsp_str_dbg(state->dst_fsp),
-				  (intmax_t)state->dst_off,
-				  (intmax_t)state->remaining,
-				  strerror(errno));
-			switch (errno) {
-			case EOPNOTSUPP:
-			case ENOSYS:
-				try_copy_file_range = false;
-				status = NT_STATUS_MORE_PROCESSING_REQUIRED;
-				break;
-			case EXDEV:
-				status = NT_STATUS_MORE_PROCESSING_REQUIRED;
-				break;
-			default:
-				status = map_nt_error_from_unix(errno);
-				if (NT_STATUS_EQUAL(
-					    status,
-					    NT_STATUS_MORE_PROCESSING_REQUIRED))
-				{
-					/* Avoid triggering the fallback */
-					status = NT_STATUS_INTERNAL_ERROR;
-				}
-				break;
-			}
+	/*
+	 * Don't block the main loop with copy_file_range(), use the
+	 * threadpool. Until the first job has told us whether
+	 * copy_file_range() works for this pair of files we keep
+	 * only one job in flight, so that falling back to
+	 * pread/pwrite can start from the beginning.
+	 */
+	status = vfswrap_cfr_schedule(req, 1);
+	if (!NT_STATUS_IS_OK(status)) {
+		if (state->cfr_jobs == 0) {
 			return status;
 		}
-
-		if (state->remaining < nwritten) {
-			DBG_DEBUG("copy_file_range src [%s] dst [%s] "
-				  "n [%jd] remaining [%jd]\n",
-				  fsp_str_dbg(state->src_fsp),
-				  fsp_str_dbg(state->dst_fsp),
-				  (intmax_t)nwritten,
-				  (intmax_t)state->remaining);
-			return NT_STATUS_INTERNAL_ERROR;
-		}
-
-		if (nwritten == 0) {
-			break;
-		}
-		state->copied += nwritten;
-		state->remaining -= nwritten;
+		state->cfr_status = status;
 	}
+	return NT_STATUS_PENDING;
 
 done:
 	/*
@@ -2598,6 +3326,10 @@ static void vfswrap_offload_write_write_done(struct tevent_req *subreq)
 		tevent_req_done(req);
 		return;
 	}
+	if (state->cancelled) {
+		tevent_req_nterror(req, NT_STATUS_CANCELLED);
+		return;
+	}
 
 	ok = change_to_user_and_service_by_fsp(state->src_fsp);
 	if (!ok) {
@@ -3716,10 +4448,11 @@ static struct tevent_req *vfswrap_getxattrat_send(
 	SMBPROFILE_BYTES_ASYNC_SET_IDLE_X(state->profile_bytes,
 					  state->profile_bytes_x);
 
-	subreq = pthreadpool_tevent_job_send(
+	subreq = pthreadpool_tevent_job_send_prio(
 			state,
 			ev,
 			dir_fsp->conn->sconn->pool,
+			PTHREADPOOL_PRIO_METADATA,
 			vfswrap_getxattrat_do_async,
 			state);
 	if (tevent_req_nomem(subreq, req)) {
@@ -4066,6 +4799,8 @@ static struct vfs_fn_pointers vfs_default_fns = {
 	.fstat_fn = vfswrap_fstat,
 	.lstat_fn = vfswrap_lstat,
 	.fstatat_fn = vfswrap_fstatat,
+	.fstatat_send_fn = vfswrap_fstatat_send,
+	.fstatat_recv_fn = vfswrap_fstatat_recv,
 	.get_alloc_size_fn = vfswrap_get_alloc_size,
 	.unlinkat_fn = vfswrap_unlinkat,
 	.fchmod_fn = vfswrap_fchmod,
@@ -4101,6 +4836,10 @@ static struct vfs_fn_pointers vfs_default_fns = {
 	.fset_dos_attributes_fn = vfswrap_fset_dos_attributes,
 	.get_dos_attributes_send_fn = vfswrap_get_dos_attributes_send,
 	.get_dos_attributes_recv_fn = vfswrap_get_dos_attributes_recv,
+	.get_dos_attributes_batch_send_fn =
+		vfswrap_get_dos_attributes_batch_send,
+	.get_dos_attributes_batch_recv_fn =
+		vfswrap_get_dos_attributes_batch_recv,
 	.fget_dos_attributes_fn = vfswrap_fget_dos_attributes,
 	.offload_read_send_fn = vfswrap_offload_read_send,
 	.offload_read_recv_fn = vfswrap_offload_read_recv,
@@ -0,0 +1,703 @@
+/*
+ * VFS module caching directory listings across smbd processes
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * The names of a directory are stored in dircache.tdb, keyed by the
+ * file_id of the directory. A record is only used if the mtime and
+ * ctime of the directory still match the ones seen when the directory
+ * was read. Every create, delete or rename in a directory changes
+ * both, no matter whether it comes from smbd or from local access.
+ *
+ * Directories modified less than "dircache:min age" seconds ago are
+ * not cached. Timestamp granularity would otherwise allow a change
+ * that happens right after the read to go unnoticed.
+ *
+ * Record layout: a DIRCACHE_HDR_LEN byte header followed by the
+ * NUL terminated names in readdir order.
+ *
+ * Case insensitive lookups of names that are not found on disk would
+ * scan the whole directory each time. For those every connection
+ * keeps a few upper cased name indexes built from the cached
+ * listings, so probes for non-existent files are answered without
+ * touching the directory.
+ */
+
+#include "includes.h"
+#include "smbd/smbd.h"
+#include "system/filesys.h"
+#include "dbwrap/dbwrap.h"
+#include "dbwrap/dbwrap_open.h"
+#include "dbwrap/dbwrap_rbt.h"
+#include "util_tdb.h"
+#include "lib/util/time.h"
+
+#undef DBGC_CLASS
+#define DBGC_CLASS DBGC_VFS
+
+#define DIRCACHE_MODULE_NAME "dircache"
+
+#define DIRCACHE_VERSION 1
+
+#define DIRCACHE_HDR_VERSION_OFS 0
+#define DIRCACHE_HDR_NUM_OFS 4
+#define DIRCACHE_HDR_MTIME_SEC_OFS 8
+#define DIRCACHE_HDR_MTIME_NSEC_OFS 16
+#define DIRCACHE_HDR_CTIME_SEC_OFS 24
+#define DIRCACHE_HDR_CTIME_NSEC_OFS 32
+#define DIRCACHE_HDR_LEN 40
+
+#define DIRCACHE_KEY_LEN 24
+
+#define DIRCACHE_NUM_INDEXES 16
+
+static unsigned int ref_count;
+static struct db_context *dircache_db;
+
+struct dircache_dir {
+	struct dircache_dir *prev, *next;
+	DIR *dirp;
+	files_struct *fsp;
+
+	/* Header plus names, either from the cache or from readdir */
+	uint8_t *buf;
+	size_t buflen;
+	size_t pos;
+
+	/* Serve from buf instead of the directory */
+	bool cached;
+	/* Too large for the cache, continue with readdir after buf */
+	bool more;
+
+	struct dirent dirent;
+};
+
+/*
+ * Upper cased name -> name on disk, for one cached listing
+ */
+struct dircache_index {
+	struct dircache_index *prev, *next;
+	uint8_t key[DIRCACHE_KEY_LEN];
+	uint8_t hdr[DIRCACHE_HDR_LEN];
+	struct db_context *names;
+};
+
+struct dircache_config {
+	uint32_t max_entries;
+	int min_age;
+	struct dircache_dir *dirs;
+	struct dircache_index *indexes;
+	size_t num_indexes;
+};
+
+static bool dircache_db_init(void)
+{
+	char *dbname = NULL;
+
+	if (dircache_db != NULL) {
+		ref_count++;
+		return true;
+	}
+
+	dbname = cache_path(talloc_tos(), "dircache.tdb");
+	if (dbname == NULL) {
+		errno = ENOSYS;
+		return false;
+	}
+
+	become_root();
+	dircache_db = db_open(NULL, dbname, 0,
+			      TDB_DEFAULT|TDB_INCOMPATIBLE_HASH,
+			      O_RDWR|O_CREAT, 0600,
+			      DBWRAP_LOCK_ORDER_NONE, DBWRAP_FLAG_NONE);
+	unbecome_root();
+
+	if (dircache_db == NULL) {
+		DBG_ERR("Could not open %s: %s\n", dbname, strerror(errno));
+		TALLOC_FREE(dbname);
+		return false;
+	}
+
+	ref_count++;
+	TALLOC_FREE(dbname);
+	return true;
+}
+
+static TDB_DATA dircache_key(const struct file_id *id, uint8_t *buf)
+{
+	SBVAL(buf, 0, id->devid);
+	SBVAL(buf, 8, id->inode);
+	SBVAL(buf, 16, id->extid);
+	return make_tdb_data(buf, DIRCACHE_KEY_LEN);
+}
+
+static void dircache_push_hdr(uint8_t *buf,
+			      uint32_t num_names,
+			      const SMB_STRUCT_STAT *st)
+{
+	SIVAL(buf, DIRCACHE_HDR_VERSION_OFS, DIRCACHE_VERSION);
+	SIVAL(buf, DIRCACHE_HDR_NUM_OFS, num_names);
+	SBVAL(buf, DIRCACHE_HDR_MTIME_SEC_OFS, st->st_ex_mtime.tv_sec);
+	SBVAL(buf, DIRCACHE_HDR_MTIME_NSEC_OFS, st->st_ex_mtime.tv_nsec);
+	SBVAL(buf, DIRCACHE_HDR_CTIME_SEC_OFS, st->st_ex_ctime.tv_sec);
+	SBVAL(buf, DIRCACHE_HDR_CTIME_NSEC_OFS, st->st_ex_ctime.tv_nsec);
+}
+
+static bool dircache_hdr_matches(const uint8_t *buf,
+				 const SMB_STRUCT_STAT *st)
+{
+	if (IVAL(buf, DIRCACHE_HDR_VERSION_OFS) != DIRCACHE_VERSION) {
+		return false;
+	}
+	if ((BVAL(buf, DIRCACHE_HDR_MTIME_SEC_OFS) !=
+	     (uint64_t)st->st_ex_mtime.tv_sec) ||
+	    (BVAL(buf, DIRCACHE_HDR_MTIME_NSEC_OFS) !=
+	     (uint64_t)st->st_ex_mtime.tv_nsec) ||
+	    (BVAL(buf, DIRCACHE_HDR_CTIME_SEC_OFS) !=
+	     (uint64_t)st->st_ex_ctime.tv_sec) ||
+	    (BVAL(buf, DIRCACHE_HDR_CTIME_NSEC_OFS) !=
+	     (uint64_t)st->st_ex_ctime.tv_nsec)) {
+		return false;
+	}
+	return true;
+}
+
+struct dircache_parse_state {
+	struct dircache_dir *d;
+	const SMB_STRUCT_STAT *st;
+	bool found;
+};
+
+static void dircache_parse_fn(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct dircache_parse_state *state = private_data;
+	struct dircache_dir *d = state->d;
+
+	if (data.dsize < DIRCACHE_HDR_LEN) {
+		return;
+	}
+	if (!dircache_hdr_matches(data.dptr, state->st)) {
+		return;
+	}
+	if ((data.dsize > DIRCACHE_HDR_LEN) &&
+	    (data.dptr[data.dsize - 1] != '\0')) {
+		return;
+	}
+
+	d->buf = (uint8_t *)talloc_memdup(d, data.dptr, data.dsize);
+	if (d->buf == NULL) {
+		return;
+	}
+	d->buflen = data.dsize;
+	state->found = true;
+}
+
+/*
+ * Read the whole directory into d->buf. Returns true if the listing is
+ * complete and may go into the cache.
+ */
+static bool dircache_read_dir(vfs_handle_struct *handle,
+			      struct dircache_config *config,
+			      struct dircache_dir *d)
+{
+	size_t allocated = DIRCACHE_HDR_LEN + 4096;
+	uint32_t num_names = 0;
+	struct dirent *dp = NULL;
+
+	TALLOC_FREE(d->buf);
+	d->buf = talloc_array(d, uint8_t, allocated);
+	if (d->buf == NULL) {
+		return false;
+	}
+	d->buflen = DIRCACHE_HDR_LEN;
+
+	while (num_names < config->max_entries) {
+		size_t len;
+
+		dp = SMB_VFS_NEXT_READDIR(handle, d->fsp, d->dirp);
+		if (dp == NULL) {
+			break;
+		}
+		len = strlen(dp->d_name) + 1;
+
+		if (d->buflen + len > allocated) {
+			uint8_t *tmp = NULL;
+
+			/*
+			 * Grow by half, directories with many entries
+			 * should not double the memory
+			 */
+			allocated = MAX(d->buflen + len, allocated * 3 / 2);
+			tmp = talloc_realloc(d, d->buf, uint8_t, allocated);
+			if (tmp == NULL) {
+				TALLOC_FREE(d->buf);
+				return false;
+			}
+			d->buf = tmp;
+		}
+
+		memcpy(d->buf + d->buflen, dp->d_name, len);
+		d->buflen += len;
+		num_names += 1;
+	}
+
+	if (dp != NULL) {
+		/*
+		 * More than max_entries, go on with readdir once the
+		 * names read so far are returned
+		 */
+		d->more = true;
+		return false;
+	}
+
+	SIVAL(d->buf, DIRCACHE_HDR_NUM_OFS, num_names);
+	return true;
+}
+
+static void dircache_fill(vfs_handle_struct *handle,
+			  struct dircache_config *config,
+			  struct dircache_dir *d)
+{
+	struct dircache_parse_state state = { .d = d };
+	uint8_t keybuf[DIRCACHE_KEY_LEN];
+	SMB_STRUCT_STAT st;
+	struct timespec now;
+	TDB_DATA key;
+	NTSTATUS status;
+	bool complete;
+
+	d->cached = false;
+	d->more = false;
+	d->pos = DIRCACHE_HDR_LEN;
+	TALLOC_FREE(d->buf);
+
+	status = vfs_stat_fsp(d->fsp);
+	if (!NT_STATUS_IS_OK(status)) {
+		return;
+	}
+	st = d->fsp->fsp_name->st;
+	state.st = &st;
+
+	key = dircache_key(&d->fsp->file_id, keybuf);
+
+	status = dbwrap_parse_record(dircache_db, key,
+				     dircache_parse_fn, &state);
+	if (NT_STATUS_IS_OK(status) && state.found) {
+		DBG_DEBUG("cache hit for %s\n", fsp_str_dbg(d->fsp));
+		d->cached = true;
+		return;
+	}
+
+	complete = dircache_read_dir(handle, config, d);
+	if (d->buf == NULL) {
+		/* Start over with plain readdir */
+		SMB_VFS_NEXT_REWINDDIR(handle, d->dirp);
+		return;
+	}
+	d->cached = true;
+
+	if (!complete) {
+		return;
+	}
+
+	/*
+	 * Only store listings that can't have raced with a change
+	 */
+	now = timespec_current();
+	if (now.tv_sec - st.st_ex_mtime.tv_sec < config->min_age) {
+		return;
+	}
+	status = vfs_stat_fsp(d->fsp);
+	if (!NT_STATUS_IS_OK(status)) {
+		return;
+	}
+	if ((timespec_compare(&st.st_ex_mtime,
+			      &d->fsp->fsp_name->st.st_ex_mtime) != 0) ||
+	    (timespec_compare(&st.st_ex_ctime,
+			      &d->fsp->fsp_name->st.st_ex_ctime) != 0)) {
+		return;
+	}
+
+	dircache_push_hdr(d->buf, IVAL(d->buf, DIRCACHE_HDR_NUM_OFS), &st);
+
+	status = dbwrap_store(dircache_db,
+			      key,
+			      make_tdb_data(d->buf, d->buflen),
+			      0);
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_DEBUG("dbwrap_store failed: %s\n", nt_errstr(status));
+	}
+}
+
+static struct dircache_dir *dircache_find(vfs_handle_struct *handle,
+					  DIR *dirp)
+{
+	struct dircache_config *config = NULL;
+	struct dircache_dir *d = NULL;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config, struct dircache_config,
+				return NULL);
+
+	for (d = config->dirs; d != NULL; d = d->next) {
+		if (d->dirp == dirp) {
+			return d;
+		}
+	}
+	return NULL;
+}
+
+static int dircache_config_destructor(struct dircache_config *config)
+{
+	ref_count--;
+	if (ref_count == 0) {
+		TALLOC_FREE(dircache_db);
+	}
+	return 0;
+}
+
+static int dircache_connect(vfs_handle_struct *handle,
+			    const char *service,
+			    const char *user)
+{
+	struct dircache_config *config = NULL;
+	int ret;
+
+	ret = SMB_VFS_NEXT_CONNECT(handle, service, user);
+	if (ret < 0) {
+		return ret;
+	}
+
+	config = talloc_zero(handle->conn, struct dircache_config);
+	if (config == NULL) {
+		SMB_VFS_NEXT_DISCONNECT(handle);
+		errno = ENOMEM;
+		return -1;
+	}
+
+	if (!dircache_db_init()) {
+		TALLOC_FREE(config);
+		SMB_VFS_NEXT_DISCONNECT(handle);
+		return -1;
+	}
+	talloc_set_destructor(config, dircache_config_destructor);
+
+	config->max_entries = lp_parm_ulong(SNUM(handle->conn),
+					    DIRCACHE_MODULE_NAME,
+					    "max entries",
+					    100000);
+	config->min_age = lp_parm_int(SNUM(handle->conn),
+				      DIRCACHE_MODULE_NAME,
+				      "min age",
+				      2);
+
+	SMB_VFS_HANDLE_SET_DATA(handle, config, NULL,
+				struct dircache_config, return -1);
+
+	return 0;
+}
+
+static DIR *dircache_fdopendir(vfs_handle_struct *handle,
+			       files_struct *fsp,
+			       const char *mask,
+			       uint32_t attr)
+{
+	struct dircache_config *config = NULL;
+	struct dircache_dir *d = NULL;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config, struct dircache_config,
+				return NULL);
+
+	d = talloc_zero(config, struct dircache_dir);
+	if (d == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	d->fsp = fsp;
+
+	d->dirp = SMB_VFS_NEXT_FDOPENDIR(handle, fsp, mask, attr);
+	if (d->dirp == NULL) {
+		TALLOC_FREE(d);
+		return NULL;
+	}
+
+	dircache_fill(handle, config, d);
+
+	DLIST_ADD(config->dirs, d);
+	return d->dirp;
+}
+
+static struct dirent *dircache_readdir(vfs_handle_struct *handle,
+				       struct files_struct *dirfsp,
+				       DIR *dirp)
+{
+	struct dircache_dir *d = NULL;
+	const char *name = NULL;
+	size_t len;
+
+	d = dircache_find(handle, dirp);
+	if ((d == NULL) || !d->cached) {
+		return SMB_VFS_NEXT_READDIR(handle, dirfsp, dirp);
+	}
+
+	if (d->pos >= d->buflen) {
+		if (d->more) {
+			return SMB_VFS_NEXT_READDIR(handle, dirfsp, dirp);
+		}
+		return NULL;
+	}
+
+	name = (const char *)d->buf + d->pos;
+	len = strnlen(name, d->buflen - d->pos);
+	d->pos += len + 1;
+
+	d->dirent = (struct dirent) {};
+	strlcpy(d->dirent.d_name, name, sizeof(d->dirent.d_name));
+	return &d->dirent;
+}
+
+static void dircache_rewinddir(vfs_handle_struct *handle, DIR *dirp)
+{
+	struct dircache_config *config = NULL;
+	struct dircache_dir *d = NULL;
+
+	SMB_VFS_NEXT_REWINDDIR(handle, dirp);
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config, struct dircache_config,
+				return);
+
+	d = dircache_find(handle, dirp);
+	if (d == NULL) {
+		return;
+	}
+
+	/* A restarted scan has to see changes made in the meantime */
+	dircache_fill(handle, config, d);
+}
+
+static int dircache_closedir(vfs_handle_struct *handle, DIR *dirp)
+{
+	struct dircache_config *config = NULL;
+	struct dircache_dir *d = NULL;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config, struct dircache_config,
+				return -1);
+
+	d = dircache_find(handle, dirp);
+	if (d != NULL) {
+		DLIST_REMOVE(config->dirs, d);
+		TALLOC_FREE(d);
+	}
+
+	return SMB_VFS_NEXT_CLOSEDIR(handle, dirp);
+}
+
+struct dircache_index_state {
+	struct dircache_index *idx;
+	const SMB_STRUCT_STAT *st;
+	bool ok;
+};
+
+static void dircache_index_fn(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct dircache_index_state *state = private_data;
+	struct dircache_index *idx = state->idx;
+	size_t ofs = DIRCACHE_HDR_LEN;
+
+	if (data.dsize < DIRCACHE_HDR_LEN) {
+		return;
+	}
+	if (!dircache_hdr_matches(data.dptr, state->st)) {
+		return;
+	}
+	if ((data.dsize > DIRCACHE_HDR_LEN) &&
+	    (data.dptr[data.dsize - 1] != '\0')) {
+		return;
+	}
+
+	while (ofs < data.dsize) {
+		const char *name = (const char *)data.dptr + ofs;
+		size_t len = strlen(name) + 1;
+		char *upper = NULL;
+		NTSTATUS status;
+
+		ofs += len;
+
+		if (ISDOT(name) || ISDOTDOT(name)) {
+			continue;
+		}
+
+		upper = talloc_strdup_upper(idx, name);
+		if (upper == NULL) {
+			return;
+		}
+
+		/*
+		 * Several names can differ only in case, the
+		 * directory scan returns the first one in readdir
+		 * order, so do we.
+		 */
+		status = dbwrap_store(idx->names,
+				      string_term_tdb_data(upper),
+				      make_tdb_data((const uint8_t *)name,
+						    len),
+				      TDB_INSERT);
+		TALLOC_FREE(upper);
+		if (!NT_STATUS_IS_OK(status) &&
+		    !NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_COLLISION)) {
+			return;
+		}
+	}
+
+	memcpy(idx->hdr, data.dptr, DIRCACHE_HDR_LEN);
+	state->ok = true;
+}
+
+static struct dircache_index *dircache_get_index(
+	struct dircache_config *config,
+	struct files_struct *dirfsp)
+{
+	struct dircache_index_state state = {
+		.st = &dirfsp->fsp_name->st,
+	};
+	struct dircache_index *idx = NULL;
+	uint8_t keybuf[DIRCACHE_KEY_LEN];
+	TDB_DATA key;
+	NTSTATUS status;
+
+	key = dircache_key(&dirfsp->file_id, keybuf);
+
+	for (idx = config->indexes; idx != NULL; idx = idx->next) {
+		if (memcmp(idx->key, keybuf, sizeof(keybuf)) == 0) {
+			break;
+		}
+	}
+
+	if (idx != NULL) {
+		if (dircache_hdr_matches(idx->hdr, state.st)) {
+			DLIST_PROMOTE(config->indexes, idx);
+			return idx;
+		}
+		DLIST_REMOVE(config->indexes, idx);
+		config->num_indexes -= 1;
+		TALLOC_FREE(idx);
+	}
+
+	idx = talloc_zero(config, struct dircache_index);
+	if (idx == NULL) {
+		return NULL;
+	}
+	memcpy(idx->key, keybuf, sizeof(keybuf));
+	idx->names = db_open_rbt(idx);
+	if (idx->names == NULL) {
+		TALLOC_FREE(idx);
+		return NULL;
+	}
+	state.idx = idx;
+
+	status = dbwrap_parse_record(dircache_db, key,
+				     dircache_index_fn, &state);
+	if (!NT_STATUS_IS_OK(status) || !state.ok) {
+		TALLOC_FREE(idx);
+		return NULL;
+	}
+
+	if (config->num_indexes >= DIRCACHE_NUM_INDEXES) {
+		struct dircache_index *last = DLIST_TAIL(config->indexes);
+
+		DLIST_REMOVE(config->indexes, last);
+		config->num_indexes -= 1;
+		TALLOC_FREE(last);
+	}
+	DLIST_ADD(config->indexes, idx);
+	config->num_indexes += 1;
+
+	return idx;
+}
+
+static NTSTATUS dircache_get_real_filename_at(struct vfs_handle_struct *handle,
+					      struct files_struct *dirfsp,
+					      const char *name,
+					      TALLOC_CTX *mem_ctx,
+					      char **found_name)
+{
+	struct dircache_config *config = NULL;
+	struct dircache_index *idx = NULL;
+	char *upper = NULL;
+	TDB_DATA val;
+	NTSTATUS status;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config, struct dircache_config,
+				return NT_STATUS_INTERNAL_ERROR);
+
+	if (!(handle->conn->fs_capabilities & FILE_CASE_SENSITIVE_SEARCH)) {
+		goto next;
+	}
+
+	status = vfs_stat_fsp(dirfsp);
+	if (!NT_STATUS_IS_OK(status)) {
+		goto next;
+	}
+
+	idx = dircache_get_index(config, dirfsp);
+	if (idx == NULL) {
+		/*
+		 * No valid listing yet. The directory scan done by the
+		 * caller goes through dircache_fdopendir() and stores
+		 * one for the next lookup.
+		 */
+		goto next;
+	}
+
+	upper = talloc_strdup_upper(talloc_tos(), name);
+	if (upper == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	status = dbwrap_fetch(idx->names, mem_ctx,
+			      string_term_tdb_data(upper), &val);
+	TALLOC_FREE(upper);
+	if (NT_STATUS_EQUAL(status, NT_STATUS_NOT_FOUND)) {
+		DBG_DEBUG("%s not in %s\n", name, fsp_str_dbg(dirfsp));
+		return NT_STATUS_OBJECT_NAME_NOT_FOUND;
+	}
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
+	*found_name = (char *)val.dptr;
+	return NT_STATUS_OK;
+
+next:
+	return SMB_VFS_NEXT_GET_REAL_FILENAME_AT(handle, dirfsp, name,
+						 mem_ctx, found_name);
+}
+
+static struct vfs_fn_pointers vfs_dircache_fns = {
+	.connect_fn = dircache_connect,
+	.fdopendir_fn = dircache_fdopendir,
+	.readdir_fn = dircache_readdir,
+	.rewind_dir_fn = dircache_rewinddir,
+	.closedir_fn = dircache_closedir,
+	.get_real_filename_at_fn = dircache_get_real_filename_at,
+};
+
+static_decl_vfs;
+NTSTATUS vfs_dircache_init(TALLOC_CTX *ctx)
+{
+	return smb_register_vfs(SMB_VFS_INTERFACE_VERSION,
+				DIRCACHE_MODULE_NAME,
+				&vfs_dircache_fns);
+}
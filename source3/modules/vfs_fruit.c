@@ -1183,12 +1183,59 @@ static uint64_t readdir_attr_rfork_size(struct vfs_handle_struct *handle,
 	return rfork_size;
 }
 
+/*
+ * With metadata or resource fork in streams, one listing of the
+ * streams below us tells whether there's any Mac metadata at all.
+ * Most files in large folders have none, for those we return the
+ * defaults without opening AFP_AfpInfo or stat'ing AFP_Resource.
+ */
+static bool readdir_attr_list_streams(struct vfs_handle_struct *handle,
+				      struct files_struct *fsp,
+				      bool *_have_afpinfo,
+				      uint64_t *_rfork_size)
+{
+	struct stream_struct *streams = NULL;
+	unsigned int num_streams = 0;
+	bool have_afpinfo = false;
+	uint64_t rfork_size = 0;
+	unsigned int i;
+	NTSTATUS status;
+
+	status = SMB_VFS_NEXT_FSTREAMINFO(handle,
+					  fsp,
+					  talloc_tos(),
+					  &num_streams,
+					  &streams);
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_DEBUG("streaminfo [%s] failed: %s\n",
+			  fsp_str_dbg(fsp), nt_errstr(status));
+		return false;
+	}
+
+	for (i = 0; i < num_streams; i++) {
+		if (strequal_m(streams[i].name, AFPINFO_STREAM)) {
+			have_afpinfo = (streams[i].size >= AFP_INFO_SIZE);
+		} else if (strequal_m(streams[i].name, AFPRESOURCE_STREAM)) {
+			rfork_size = streams[i].size;
+		}
+	}
+	TALLOC_FREE(streams);
+
+	*_have_afpinfo = have_afpinfo;
+	*_rfork_size = rfork_size;
+	return true;
+}
+
 static NTSTATUS readdir_attr_macmeta(struct vfs_handle_struct *handle,
-				     const struct smb_filename *smb_fname,
+				     struct files_struct *fsp,
 				     struct readdir_attr_data *attr_data)
 {
 	NTSTATUS status = NT_STATUS_OK;
 	struct fruit_config_data *config = NULL;
+	const struct smb_filename *smb_fname = fsp->fsp_name;
+	bool have_list = false;
+	bool have_afpinfo = true;
+	uint64_t listed_rfork_size = 0;
 	bool ok;
 
 	SMB_VFS_HANDLE_GET_DATA(handle, config,
@@ -1199,6 +1246,17 @@ static NTSTATUS readdir_attr_macmeta(struct vfs_handle_struct *handle,
 	/* Ensure we return a default value in the creation_date field */
 	RSIVAL(&attr_data->attr_data.aapl.finder_info, 12, AD_DATE_START);
 
+	if ((config->readdir_attr_finder_info &&
+	     config->meta == FRUIT_META_STREAM) ||
+	    (config->readdir_attr_rsize &&
+	     config->rsrc == FRUIT_RSRC_STREAM))
+	{
+		have_list = readdir_attr_list_streams(handle,
+						      fsp,
+						      &have_afpinfo,
+						      &listed_rfork_size);
+	}
+
 	/*
 	 * Resource fork length
 	 */
@@ -1206,7 +1264,11 @@ static NTSTATUS readdir_attr_macmeta(struct vfs_handle_struct *handle,
 	if (config->readdir_attr_rsize) {
 		uint64_t rfork_size;
 
-		rfork_size = readdir_attr_rfork_size(handle, smb_fname);
+		if (have_list && config->rsrc == FRUIT_RSRC_STREAM) {
+			rfork_size = listed_rfork_size;
+		} else {
+			rfork_size = readdir_attr_rfork_size(handle, smb_fname);
+		}
 		attr_data->attr_data.aapl.rfork_size = rfork_size;
 	}
 
@@ -1214,6 +1276,15 @@ static NTSTATUS readdir_attr_macmeta(struct vfs_handle_struct *handle,
 	 * FinderInfo
 	 */
 
+	if (config->readdir_attr_finder_info &&
+	    have_list &&
+	    config->meta == FRUIT_META_STREAM &&
+	    !have_afpinfo)
+	{
+		/* Nothing to read, the defaults are already in place */
+		return status;
+	}
+
 	if (config->readdir_attr_finder_info) {
 		ok = readdir_attr_meta_finderi(handle, smb_fname, attr_data);
 		if (!ok) {
@@ -4486,7 +4557,7 @@ static NTSTATUS fruit_freaddir_attr(struct vfs_handle_struct *handle,
 	 * Mac metadata: compressed FinderInfo, resource fork length
 	 * and creation date
 	 */
-	status = readdir_attr_macmeta(handle, fsp->fsp_name, attr_data);
+	status = readdir_attr_macmeta(handle, fsp, attr_data);
 	if (!NT_STATUS_IS_OK(status)) {
 		/*
 		 * Error handling is tricky: if we return failure from
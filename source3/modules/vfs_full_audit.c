@@ -138,6 +138,8 @@ typedef enum _vfs_op_type {
 	SMB_VFS_OP_FSTAT,
 	SMB_VFS_OP_LSTAT,
 	SMB_VFS_OP_FSTATAT,
+	SMB_VFS_OP_FSTATAT_SEND,
+	SMB_VFS_OP_FSTATAT_RECV,
 	SMB_VFS_OP_GET_ALLOC_SIZE,
 	SMB_VFS_OP_UNLINKAT,
 	SMB_VFS_OP_FCHMOD,
@@ -185,6 +187,8 @@ typedef enum _vfs_op_type {
 	/* DOS attribute operations. */
 	SMB_VFS_OP_GET_DOS_ATTRIBUTES_SEND,
 	SMB_VFS_OP_GET_DOS_ATTRIBUTES_RECV,
+	SMB_VFS_OP_GET_DOS_ATTRIBUTES_BATCH_SEND,
+	SMB_VFS_OP_GET_DOS_ATTRIBUTES_BATCH_RECV,
 	SMB_VFS_OP_FGET_DOS_ATTRIBUTES,
 	SMB_VFS_OP_FSET_DOS_ATTRIBUTES,
 
@@ -273,6 +277,8 @@ static struct {
 	{ SMB_VFS_OP_FSTAT,	"fstat" },
 	{ SMB_VFS_OP_LSTAT,	"lstat" },
 	{ SMB_VFS_OP_FSTATAT,	"fstatat" },
+	{ SMB_VFS_OP_FSTATAT_SEND,	"fstatat_send" },
+	{ SMB_VFS_OP_FSTATAT_RECV,	"fstatat_recv" },
 	{ SMB_VFS_OP_GET_ALLOC_SIZE,	"get_alloc_size" },
 	{ SMB_VFS_OP_UNLINKAT,	"unlinkat" },
 	{ SMB_VFS_OP_FCHMOD,	"fchmod" },
@@ -318,6 +324,10 @@ static struct {
 	{ SMB_VFS_OP_SNAP_DELETE, "snap_delete" },
 	{ SMB_VFS_OP_GET_DOS_ATTRIBUTES_SEND, "get_dos_attributes_send" },
 	{ SMB_VFS_OP_GET_DOS_ATTRIBUTES_RECV, "get_dos_attributes_recv" },
+	{ SMB_VFS_OP_GET_DOS_ATTRIBUTES_BATCH_SEND,
+	  "get_dos_attributes_batch_send" },
+	{ SMB_VFS_OP_GET_DOS_ATTRIBUTES_BATCH_RECV,
+	  "get_dos_attributes_batch_recv" },
 	{ SMB_VFS_OP_FGET_DOS_ATTRIBUTES, "fget_dos_attributes" },
 	{ SMB_VFS_OP_FSET_DOS_ATTRIBUTES, "fset_dos_attributes" },
 	{ SMB_VFS_OP_FGET_NT_ACL,	"fget_nt_acl" },
@@ -1577,6 +1587,122 @@ static int smb_full_audit_fstatat(
 
 	return result;
 }
+
+struct smb_full_audit_fstatat_state {
+	struct vfs_aio_state aio_state;
+	vfs_handle_struct *handle;
+	files_struct *dirfsp;
+	const struct smb_filename *smb_fname;
+	SMB_STRUCT_STAT sbuf;
+	int ret;
+};
+
+static void smb_full_audit_fstatat_done(struct tevent_req *subreq);
+
+static struct tevent_req *smb_full_audit_fstatat_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct vfs_handle_struct *handle,
+	files_struct *dirfsp,
+	const struct smb_filename *smb_fname,
+	int flags)
+{
+	struct tevent_req *req = NULL;
+	struct smb_full_audit_fstatat_state *state = NULL;
+	struct tevent_req *subreq = NULL;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct smb_full_audit_fstatat_state);
+	if (req == NULL) {
+		do_log(SMB_VFS_OP_FSTATAT_SEND,
+		       false,
+		       handle,
+		       "%s/%s",
+		       fsp_str_do_log(dirfsp),
+		       smb_fname_str_do_log(handle->conn, smb_fname));
+		return NULL;
+	}
+	*state = (struct smb_full_audit_fstatat_state) {
+		.handle = handle,
+		.dirfsp = dirfsp,
+		.smb_fname = smb_fname,
+	};
+
+	subreq = SMB_VFS_NEXT_FSTATAT_SEND(state,
+					   ev,
+					   handle,
+					   dirfsp,
+					   smb_fname,
+					   flags);
+	if (tevent_req_nomem(subreq, req)) {
+		do_log(SMB_VFS_OP_FSTATAT_SEND,
+		       false,
+		       handle,
+		       "%s/%s",
+		       fsp_str_do_log(dirfsp),
+		       smb_fname_str_do_log(handle->conn, smb_fname));
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, smb_full_audit_fstatat_done, req);
+
+	do_log(SMB_VFS_OP_FSTATAT_SEND,
+	       true,
+	       handle,
+	       "%s/%s",
+	       fsp_str_do_log(dirfsp),
+	       smb_fname_str_do_log(handle->conn, smb_fname));
+
+	return req;
+}
+
+static void smb_full_audit_fstatat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smb_full_audit_fstatat_state *state = tevent_req_data(
+		req, struct smb_full_audit_fstatat_state);
+
+	state->ret = SMB_VFS_FSTATAT_RECV(subreq,
+					  &state->aio_state,
+					  &state->sbuf);
+	TALLOC_FREE(subreq);
+	tevent_req_done(req);
+}
+
+static int smb_full_audit_fstatat_recv(struct tevent_req *req,
+				       struct vfs_aio_state *aio_state,
+				       SMB_STRUCT_STAT *sbuf)
+{
+	struct smb_full_audit_fstatat_state *state = tevent_req_data(
+		req, struct smb_full_audit_fstatat_state);
+
+	if (tevent_req_is_unix_error(req, &aio_state->error)) {
+		do_log(SMB_VFS_OP_FSTATAT_RECV,
+		       false,
+		       state->handle,
+		       "%s/%s",
+		       fsp_str_do_log(state->dirfsp),
+		       smb_fname_str_do_log(state->handle->conn,
+					    state->smb_fname));
+		tevent_req_received(req);
+		return -1;
+	}
+
+	do_log(SMB_VFS_OP_FSTATAT_RECV,
+	       (state->ret >= 0),
+	       state->handle,
+	       "%s/%s",
+	       fsp_str_do_log(state->dirfsp),
+	       smb_fname_str_do_log(state->handle->conn, state->smb_fname));
+
+	*aio_state = state->aio_state;
+	if (sbuf != NULL) {
+		*sbuf = state->sbuf;
+	}
+	tevent_req_received(req);
+	return state->ret;
+}
+
 static uint64_t smb_full_audit_get_alloc_size(vfs_handle_struct *handle,
 		       files_struct *fsp, const SMB_STRUCT_STAT *sbuf)
 {
@@ -2471,6 +2597,150 @@ static NTSTATUS smb_full_audit_get_dos_attributes_recv(struct tevent_req *req,
 	return NT_STATUS_OK;
 }
 
+struct smb_full_audit_get_dos_attributes_batch_state {
+	struct vfs_aio_state aio_state;
+	vfs_handle_struct *handle;
+	files_struct *dir_fsp;
+	size_t num_fnames;
+	uint32_t *dosmodes;
+	NTSTATUS *statuses;
+};
+
+static void smb_full_audit_get_dos_attributes_batch_done(
+	struct tevent_req *subreq);
+
+static struct tevent_req *smb_full_audit_get_dos_attributes_batch_send(
+		TALLOC_CTX *mem_ctx,
+		struct tevent_context *ev,
+		struct vfs_handle_struct *handle,
+		files_struct *dir_fsp,
+		struct smb_filename **smb_fnames,
+		size_t num_fnames)
+{
+	struct tevent_req *req = NULL;
+	struct smb_full_audit_get_dos_attributes_batch_state *state = NULL;
+	struct tevent_req *subreq = NULL;
+
+	req = tevent_req_create(
+		mem_ctx, &state,
+		struct smb_full_audit_get_dos_attributes_batch_state);
+	if (req == NULL) {
+		do_log(SMB_VFS_OP_GET_DOS_ATTRIBUTES_BATCH_SEND,
+		       false,
+		       handle,
+		       "%s [%zu]",
+		       fsp_str_do_log(dir_fsp),
+		       num_fnames);
+		return NULL;
+	}
+	*state = (struct smb_full_audit_get_dos_attributes_batch_state) {
+		.handle = handle,
+		.dir_fsp = dir_fsp,
+		.num_fnames = num_fnames,
+	};
+
+	state->dosmodes = talloc_zero_array(state, uint32_t, num_fnames);
+	state->statuses = talloc_zero_array(state, NTSTATUS, num_fnames);
+	if ((state->dosmodes == NULL) || (state->statuses == NULL)) {
+		do_log(SMB_VFS_OP_GET_DOS_ATTRIBUTES_BATCH_SEND,
+		       false,
+		       handle,
+		       "%s [%zu]",
+		       fsp_str_do_log(dir_fsp),
+		       num_fnames);
+		tevent_req_oom(req);
+		return tevent_req_post(req, ev);
+	}
+
+	subreq = SMB_VFS_NEXT_GET_DOS_ATTRIBUTES_BATCH_SEND(state,
+							    ev,
+							    handle,
+							    dir_fsp,
+							    smb_fnames,
+							    num_fnames);
+	if (tevent_req_nomem(subreq, req)) {
+		do_log(SMB_VFS_OP_GET_DOS_ATTRIBUTES_BATCH_SEND,
+		       false,
+		       handle,
+		       "%s [%zu]",
+		       fsp_str_do_log(dir_fsp),
+		       num_fnames);
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq,
+				smb_full_audit_get_dos_attributes_batch_done,
+				req);
+
+	do_log(SMB_VFS_OP_GET_DOS_ATTRIBUTES_BATCH_SEND,
+	       true,
+	       handle,
+	       "%s [%zu]",
+	       fsp_str_do_log(dir_fsp),
+	       num_fnames);
+
+	return req;
+}
+
+static void smb_full_audit_get_dos_attributes_batch_done(
+	struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+		tevent_req_callback_data(subreq,
+		struct tevent_req);
+	struct smb_full_audit_get_dos_attributes_batch_state *state =
+		tevent_req_data(req,
+		struct smb_full_audit_get_dos_attributes_batch_state);
+	NTSTATUS status;
+
+	status = SMB_VFS_NEXT_GET_DOS_ATTRIBUTES_BATCH_RECV(subreq,
+							    &state->aio_state,
+							    state->dosmodes,
+							    state->statuses);
+	TALLOC_FREE(subreq);
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+
+	tevent_req_done(req);
+	return;
+}
+
+static NTSTATUS smb_full_audit_get_dos_attributes_batch_recv(
+		struct tevent_req *req,
+		struct vfs_aio_state *aio_state,
+		uint32_t *dosmodes,
+		NTSTATUS *statuses)
+{
+	struct smb_full_audit_get_dos_attributes_batch_state *state =
+		tevent_req_data(req,
+		struct smb_full_audit_get_dos_attributes_batch_state);
+	NTSTATUS status;
+
+	if (tevent_req_is_nterror(req, &status)) {
+		do_log(SMB_VFS_OP_GET_DOS_ATTRIBUTES_BATCH_RECV,
+		       false,
+		       state->handle,
+		       "%s [%zu]",
+		       fsp_str_do_log(state->dir_fsp),
+		       state->num_fnames);
+		tevent_req_received(req);
+		return status;
+	}
+
+	do_log(SMB_VFS_OP_GET_DOS_ATTRIBUTES_BATCH_RECV,
+	       true,
+	       state->handle,
+	       "%s [%zu]",
+	       fsp_str_do_log(state->dir_fsp),
+	       state->num_fnames);
+
+	*aio_state = state->aio_state;
+	memcpy(dosmodes, state->dosmodes, state->num_fnames * sizeof(uint32_t));
+	memcpy(statuses, state->statuses, state->num_fnames * sizeof(NTSTATUS));
+	tevent_req_received(req);
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS smb_full_audit_fget_dos_attributes(
 				struct vfs_handle_struct *handle,
 				struct files_struct *fsp,
@@ -2945,6 +3215,8 @@ static struct vfs_fn_pointers vfs_full_audit_fns = {
 	.fstat_fn = smb_full_audit_fstat,
 	.lstat_fn = smb_full_audit_lstat,
 	.fstatat_fn = smb_full_audit_fstatat,
+	.fstatat_send_fn = smb_full_audit_fstatat_send,
+	.fstatat_recv_fn = smb_full_audit_fstatat_recv,
 	.get_alloc_size_fn = smb_full_audit_get_alloc_size,
 	.unlinkat_fn = smb_full_audit_unlinkat,
 	.fchmod_fn = smb_full_audit_fchmod,
@@ -2988,6 +3260,10 @@ static struct vfs_fn_pointers vfs_full_audit_fns = {
 	.fsctl_fn = smb_full_audit_fsctl,
 	.get_dos_attributes_send_fn = smb_full_audit_get_dos_attributes_send,
 	.get_dos_attributes_recv_fn = smb_full_audit_get_dos_attributes_recv,
+	.get_dos_attributes_batch_send_fn =
+		smb_full_audit_get_dos_attributes_batch_send,
+	.get_dos_attributes_batch_recv_fn =
+		smb_full_audit_get_dos_attributes_batch_recv,
 	.fget_dos_attributes_fn = smb_full_audit_fget_dos_attributes,
 	.fset_dos_attributes_fn = smb_full_audit_fset_dos_attributes,
 	.fget_nt_acl_fn = smb_full_audit_fget_nt_acl,
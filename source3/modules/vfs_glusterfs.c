@@ -363,6 +363,7 @@ static int vfs_gluster_connect(struct vfs_handle_struct *handle,
 		loadparm_s3_global_substitution();
 	const char *volfile_servers;
 	const char *volume;
+	const char *read_ahead_page_count;
 	char *logfile;
 	int loglevel;
 	glfs_t *fs = NULL;
@@ -452,6 +453,20 @@ static int vfs_gluster_connect(struct vfs_handle_struct *handle,
 	write_behind_pass_through_set = true;
 #endif
 
+	read_ahead_page_count = lp_parm_const_string(SNUM(handle->conn),
+						     "glusterfs",
+						     "read_ahead_page_count",
+						     NULL);
+	if (read_ahead_page_count != NULL) {
+		ret = glfs_set_xlator_option(fs, "*-read-ahead", "page-count",
+					     read_ahead_page_count);
+		if (ret < 0) {
+			DBG_ERR("%s: Failed to set xlator option: "
+				"page-count\n", volume);
+			goto done;
+		}
+	}
+
 	ret = glfs_set_logging(fs, logfile, loglevel);
 	if (ret < 0) {
 		DEBUG(0, ("%s: Failed to set logfile %s loglevel %d\n",
@@ -489,11 +504,6 @@ static int vfs_gluster_connect(struct vfs_handle_struct *handle,
 	 */
 	lp_do_parameter(SNUM(handle->conn), "shadow:mountpoint", "/");
 
-	/*
-	 * Unless we have an async implementation of getxattrat turn this off.
-	 */
-	lp_do_parameter(SNUM(handle->conn), "smbd async dosmode", "false");
-
 done:
 	if (ret < 0) {
 		if (fs)
@@ -2290,6 +2300,226 @@ static ssize_t vfs_gluster_fgetxattr(struct vfs_handle_struct *handle,
 			     size);
 }
 
+struct vfs_gluster_getxattrat_state {
+	glfs_t *fs;
+	glfs_fd_t *fd;
+
+	/*
+	 * The following variables are talloced off "state" which is protected
+	 * by a destructor and thus are guaranteed to be safe to be used in the
+	 * job function in the worker thread.
+	 */
+	char *path;
+	const char *xattr_name;
+	uint8_t *xattr_value;
+
+	ssize_t xattr_size;
+	struct vfs_aio_state vfs_aio_state;
+	SMBPROFILE_BYTES_ASYNC_STATE(profile_bytes);
+};
+
+static void vfs_gluster_getxattrat_do(void *private_data);
+static void vfs_gluster_getxattrat_done(struct tevent_req *subreq);
+static int vfs_gluster_getxattrat_state_destructor(
+		struct vfs_gluster_getxattrat_state *state);
+
+static struct tevent_req *vfs_gluster_getxattrat_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct vfs_handle_struct *handle,
+			files_struct *dir_fsp,
+			const struct smb_filename *smb_fname,
+			const char *xattr_name,
+			size_t alloc_hint)
+{
+	struct vfs_gluster_getxattrat_state *state = NULL;
+	struct tevent_req *req = NULL;
+	struct tevent_req *subreq = NULL;
+	files_struct *fsp = smb_fname->fsp;
+
+	SMB_ASSERT(!is_named_stream(smb_fname));
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct vfs_gluster_getxattrat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->fs = handle->data;
+	state->xattr_size = -1;
+
+	SMBPROFILE_BYTES_ASYNC_START(syscall_asys_getxattrat, profile_p,
+				     state->profile_bytes, 0);
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->profile_bytes);
+
+	if (fsp == NULL) {
+		tevent_req_error(req, EINVAL);
+		return tevent_req_post(req, ev);
+	}
+
+	if (!fsp->fsp_flags.is_pathref) {
+		state->fd = vfs_gluster_fetch_glfd(handle, fsp);
+		if (state->fd == NULL) {
+			DBG_ERR("Failed to fetch gluster fd\n");
+			tevent_req_error(req, EBADF);
+			return tevent_req_post(req, ev);
+		}
+	} else {
+		/*
+		 * Pathref fsps are resolved by name. Use the absolute path,
+		 * the glfs cwd may be changed by the main thread while the
+		 * job runs.
+		 */
+		if (fsp->fsp_name->base_name[0] == '/') {
+			state->path = talloc_strdup(state,
+						    fsp->fsp_name->base_name);
+		} else {
+			state->path = talloc_asprintf(state, "%s/%s",
+						      handle->conn->connectpath,
+						      fsp->fsp_name->base_name);
+		}
+		if (tevent_req_nomem(state->path, req)) {
+			return tevent_req_post(req, ev);
+		}
+	}
+
+	state->xattr_name = talloc_strdup(state, xattr_name);
+	if (tevent_req_nomem(state->xattr_name, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	if (alloc_hint > 0) {
+		state->xattr_value = talloc_zero_array(state,
+						       uint8_t,
+						       alloc_hint);
+		if (tevent_req_nomem(state->xattr_value, req)) {
+			return tevent_req_post(req, ev);
+		}
+	}
+
+	subreq = pthreadpool_tevent_job_send_prio(
+		state, ev, handle->conn->sconn->pool,
+		PTHREADPOOL_PRIO_METADATA,
+		vfs_gluster_getxattrat_do, state);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, vfs_gluster_getxattrat_done, req);
+
+	talloc_set_destructor(state, vfs_gluster_getxattrat_state_destructor);
+
+	return req;
+}
+
+static void vfs_gluster_getxattrat_do(void *private_data)
+{
+	struct vfs_gluster_getxattrat_state *state = talloc_get_type_abort(
+		private_data, struct vfs_gluster_getxattrat_state);
+	struct timespec start_time;
+	struct timespec end_time;
+	size_t size = talloc_array_length(state->xattr_value);
+
+	SMBPROFILE_BYTES_ASYNC_SET_BUSY(state->profile_bytes);
+
+	PROFILE_TIMESTAMP(&start_time);
+
+	if (state->fd != NULL) {
+		state->xattr_size = glfs_fgetxattr(state->fd,
+						   state->xattr_name,
+						   state->xattr_value,
+						   size);
+	} else {
+		state->xattr_size = glfs_getxattr(state->fs,
+						  state->path,
+						  state->xattr_name,
+						  state->xattr_value,
+						  size);
+	}
+	if (state->xattr_size == -1) {
+		state->vfs_aio_state.error = errno;
+	}
+
+	PROFILE_TIMESTAMP(&end_time);
+
+	state->vfs_aio_state.duration = nsec_time_diff(&end_time, &start_time);
+
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->profile_bytes);
+}
+
+static int vfs_gluster_getxattrat_state_destructor(
+		struct vfs_gluster_getxattrat_state *state)
+{
+	return -1;
+}
+
+static void vfs_gluster_getxattrat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct vfs_gluster_getxattrat_state *state = tevent_req_data(
+		req, struct vfs_gluster_getxattrat_state);
+	int ret;
+
+	ret = pthreadpool_tevent_job_recv(subreq);
+	TALLOC_FREE(subreq);
+	SMBPROFILE_BYTES_ASYNC_END(state->profile_bytes);
+	talloc_set_destructor(state, NULL);
+	if (ret != 0) {
+		if (ret != EAGAIN) {
+			tevent_req_error(req, ret);
+			return;
+		}
+		/*
+		 * If we get EAGAIN from pthreadpool_tevent_job_recv() this
+		 * means the lower level pthreadpool failed to create a new
+		 * thread. Fallback to sync processing in that case to allow
+		 * some progress for the client.
+		 */
+		vfs_gluster_getxattrat_do(state);
+	}
+
+	if (state->xattr_size == -1) {
+		tevent_req_error(req, state->vfs_aio_state.error);
+		return;
+	}
+
+	if (state->xattr_value != NULL) {
+		/*
+		 * shrink the buffer to the returned size.
+		 * (can't fail). It means NULL if size is 0.
+		 */
+		state->xattr_value = talloc_realloc(state,
+						    state->xattr_value,
+						    uint8_t,
+						    state->xattr_size);
+	}
+
+	tevent_req_done(req);
+}
+
+static ssize_t vfs_gluster_getxattrat_recv(struct tevent_req *req,
+					   struct vfs_aio_state *aio_state,
+					   TALLOC_CTX *mem_ctx,
+					   uint8_t **xattr_value)
+{
+	struct vfs_gluster_getxattrat_state *state = tevent_req_data(
+		req, struct vfs_gluster_getxattrat_state);
+	ssize_t xattr_size;
+
+	if (tevent_req_is_unix_error(req, &aio_state->error)) {
+		tevent_req_received(req);
+		return -1;
+	}
+
+	*aio_state = state->vfs_aio_state;
+	xattr_size = state->xattr_size;
+	if (xattr_value != NULL) {
+		*xattr_value = talloc_move(mem_ctx, &state->xattr_value);
+	}
+
+	tevent_req_received(req);
+	return xattr_size;
+}
+
 static ssize_t vfs_gluster_flistxattr(struct vfs_handle_struct *handle,
 				      files_struct *fsp, char *list,
 				      size_t size)
@@ -2659,8 +2889,8 @@ static struct vfs_fn_pointers glusterfs_fns = {
 	.sys_acl_delete_def_fd_fn = posixacl_xattr_acl_delete_def_fd,
 
 	/* EA Operations */
-	.getxattrat_send_fn = vfs_not_implemented_getxattrat_send,
-	.getxattrat_recv_fn = vfs_not_implemented_getxattrat_recv,
+	.getxattrat_send_fn = vfs_gluster_getxattrat_send,
+	.getxattrat_recv_fn = vfs_gluster_getxattrat_recv,
 	.fgetxattr_fn = vfs_gluster_fgetxattr,
 	.flistxattr_fn = vfs_gluster_flistxattr,
 	.fremovexattr_fn = vfs_gluster_fremovexattr,
@@ -22,6 +22,7 @@
 
 #include "includes.h"
 #include "smbd/smbd.h"
+#include "smbd/globals.h"
 #include "include/smbprofile.h"
 #include "modules/non_posix_acls.h"
 #include "libcli/security/security.h"
@@ -29,7 +30,9 @@
 #include "system/filesys.h"
 #include "auth.h"
 #include "lib/util/tevent_unix.h"
+#include "lib/util/tevent_ntstatus.h"
 #include "lib/util/gpfswrap.h"
+#include "lib/pthreadpool/pthreadpool_tevent.h"
 
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
@@ -62,6 +65,79 @@ struct gpfs_fsp_extension {
 	bool offline;
 };
 
+/*
+ * Each of these GPFS calls may need a token round trip to another
+ * cluster node, account for them in the "GPFS Calls" smbprofile
+ * section. Not for use in threadpool jobs, the profile counters are
+ * not thread safe.
+ */
+static int gpfs_profiled_set_share(int fd, unsigned int allow,
+				   unsigned int deny)
+{
+	int ret, saved_errno;
+	START_PROFILE(gpfs_set_share);
+
+	ret = gpfswrap_set_share(fd, allow, deny);
+	saved_errno = errno;
+
+	END_PROFILE(gpfs_set_share);
+	errno = saved_errno;
+	return ret;
+}
+
+static int gpfs_profiled_set_lease(int fd, unsigned int type)
+{
+	int ret, saved_errno;
+	START_PROFILE(gpfs_set_lease);
+
+	ret = gpfswrap_set_lease(fd, type);
+	saved_errno = errno;
+
+	END_PROFILE(gpfs_set_lease);
+	errno = saved_errno;
+	return ret;
+}
+
+static int gpfs_profiled_fgetacl(int fd, int flags, void *acl)
+{
+	int ret, saved_errno;
+	START_PROFILE(gpfs_fgetacl);
+
+	ret = gpfswrap_fgetacl(fd, flags, acl);
+	saved_errno = errno;
+
+	END_PROFILE(gpfs_fgetacl);
+	errno = saved_errno;
+	return ret;
+}
+
+static int gpfs_profiled_get_winattrs(int fd, struct gpfs_winattr *attrs)
+{
+	int ret, saved_errno;
+	START_PROFILE(gpfs_get_winattrs);
+
+	ret = gpfswrap_get_winattrs(fd, attrs);
+	saved_errno = errno;
+
+	END_PROFILE(gpfs_get_winattrs);
+	errno = saved_errno;
+	return ret;
+}
+
+static int gpfs_profiled_set_winattrs(int fd, int flags,
+				      struct gpfs_winattr *attrs)
+{
+	int ret, saved_errno;
+	START_PROFILE(gpfs_set_winattrs);
+
+	ret = gpfswrap_set_winattrs(fd, flags, attrs);
+	saved_errno = errno;
+
+	END_PROFILE(gpfs_set_winattrs);
+	errno = saved_errno;
+	return ret;
+}
+
 static inline unsigned int gpfs_acl_flags(gpfs_acl_t *gacl)
 {
 	if (gacl->acl_level == GPFS_ACL_LEVEL_V4FLAGS) {
@@ -131,7 +207,7 @@ static int set_gpfs_sharemode(files_struct *fsp, uint32_t access_mask,
 	DBG_DEBUG("access_mask=0x%x, allow=0x%x, share_access=0x%x, "
 		  "deny=0x%x\n", access_mask, allow, share_access, deny);
 
-	result = gpfswrap_set_share(fsp_get_io_fd(fsp), allow, deny);
+	result = gpfs_profiled_set_share(fsp_get_io_fd(fsp), allow, deny);
 	if (result == 0) {
 		return 0;
 	}
@@ -198,14 +274,19 @@ static int vfs_gpfs_close(vfs_handle_struct *handle, files_struct *fsp)
 				return -1);
 
 	if (config->sharemodes &&
-	    (fsp->fsp_flags.kernel_share_modes_taken))
+	    (fsp->fsp_flags.kernel_share_modes_taken) &&
+	    lp_locking(fsp->conn->params) &&
+	    lp_posix_locking(fsp->conn->params) &&
+	    !fsp->fsp_flags.use_ofd_locks)
 	{
 		/*
-		 * Always clear GPFS sharemode in case the actual
-		 * close gets deferred due to outstanding POSIX locks
-		 * (see fd_close_posix)
+		 * Clear GPFS sharemode in case the actual close gets
+		 * deferred due to outstanding POSIX locks (see
+		 * fd_close_posix). Without POSIX locking or with OFD
+		 * locks the fd is closed right away, which drops the
+		 * sharemode without another call into GPFS.
 		 */
-		int ret = gpfswrap_set_share(fsp_get_io_fd(fsp), 0, 0);
+		int ret = gpfs_profiled_set_share(fsp_get_io_fd(fsp), 0, 0);
 		if (ret != 0) {
 			DBG_ERR("Clearing GPFS sharemode on close failed for "
 				" %s/%s: %s\n",
@@ -259,7 +340,8 @@ static int vfs_gpfs_setlease(vfs_handle_struct *handle,
 		 * correct delivery of lease-break signals.
 		 */
 		become_root();
-		ret = gpfswrap_set_lease(fsp_get_io_fd(fsp), gpfs_lease_type);
+		ret = gpfs_profiled_set_lease(fsp_get_io_fd(fsp),
+					      gpfs_lease_type);
 		if (ret < 0) {
 			saved_errno = errno;
 		}
@@ -429,7 +511,7 @@ static int gpfs_getacl_with_capability(struct files_struct *fsp,
 
 	set_effective_capability(DAC_OVERRIDE_CAPABILITY);
 
-	ret = gpfswrap_fgetacl(fsp_get_pathref_fd(fsp), flags, buf);
+	ret = gpfs_profiled_fgetacl(fsp_get_pathref_fd(fsp), flags, buf);
 	saved_errno = errno;
 
 	drop_effective_capability(DAC_OVERRIDE_CAPABILITY);
@@ -490,7 +572,7 @@ again:
 	if (use_capability) {
 		ret = gpfs_getacl_with_capability(fsp, flags, aclbuf);
 	} else {
-		ret = gpfswrap_fgetacl(fsp_get_pathref_fd(fsp), flags, aclbuf);
+		ret = gpfs_profiled_fgetacl(fsp_get_pathref_fd(fsp), flags, aclbuf);
 		if ((ret != 0) && (errno == EACCES)) {
 			DBG_DEBUG("Retry with DAC capability for %s\n", fname);
 			use_capability = true;
@@ -1450,7 +1532,7 @@ static NTSTATUS vfs_gpfs_fget_dos_attributes(struct vfs_handle_struct *handle,
 		return SMB_VFS_NEXT_FGET_DOS_ATTRIBUTES(handle, fsp, dosmode);
 	}
 
-	ret = gpfswrap_get_winattrs(fsp_get_pathref_fd(fsp), &attrs);
+	ret = gpfs_profiled_get_winattrs(fsp_get_pathref_fd(fsp), &attrs);
 	if (ret == -1 && errno == ENOSYS) {
 		return SMB_VFS_NEXT_FGET_DOS_ATTRIBUTES(handle, fsp, dosmode);
 	}
@@ -1467,7 +1549,7 @@ static NTSTATUS vfs_gpfs_fget_dos_attributes(struct vfs_handle_struct *handle,
 
 		set_effective_capability(DAC_OVERRIDE_CAPABILITY);
 
-		ret = gpfswrap_get_winattrs(fsp_get_pathref_fd(fsp), &attrs);
+		ret = gpfs_profiled_get_winattrs(fsp_get_pathref_fd(fsp), &attrs);
 		if (ret == -1) {
 			saved_errno = errno;
 		}
@@ -1494,6 +1576,260 @@ static NTSTATUS vfs_gpfs_fget_dos_attributes(struct vfs_handle_struct *handle,
 	return NT_STATUS_OK;
 }
 
+struct vfs_gpfs_get_dos_attributes_batch_state {
+	struct vfs_handle_struct *handle;
+	files_struct *dir_fsp;
+	struct smb_filename **smb_fnames;
+	size_t num_fnames;
+	struct security_unix_token *token;
+	int *fds;
+	struct gpfs_winattr *attrs;
+	int *errnos;
+	struct vfs_aio_state vfs_aio_state;
+	uint32_t *dosmodes;
+	NTSTATUS *statuses;
+};
+
+static int vfs_gpfs_get_dos_attributes_batch_state_destructor(
+		struct vfs_gpfs_get_dos_attributes_batch_state *state)
+{
+	return -1;
+}
+
+static void vfs_gpfs_get_dos_attributes_batch_do(void *private_data);
+static void vfs_gpfs_get_dos_attributes_batch_done(struct tevent_req *subreq);
+
+/*
+ * Fetch the winattrs of a whole batch of directory entries in one
+ * threadpool job, this is what allows "smbd async dosmode" on GPFS.
+ */
+static struct tevent_req *vfs_gpfs_get_dos_attributes_batch_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct vfs_handle_struct *handle,
+			files_struct *dir_fsp,
+			struct smb_filename **smb_fnames,
+			size_t num_fnames)
+{
+	struct gpfs_config_data *config = NULL;
+	struct tevent_req *req = NULL;
+	struct tevent_req *subreq = NULL;
+	struct vfs_gpfs_get_dos_attributes_batch_state *state = NULL;
+	bool have_per_thread_creds = false;
+	size_t i;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config,
+				struct gpfs_config_data,
+				return NULL);
+
+#ifdef HAVE_LINUX_THREAD_CREDENTIALS
+	have_per_thread_creds = true;
+#endif
+	if (!config->winattr ||
+	    !have_per_thread_creds ||
+	    pthreadpool_tevent_max_threads(dir_fsp->conn->sconn->pool) == 0)
+	{
+		return SMB_VFS_NEXT_GET_DOS_ATTRIBUTES_BATCH_SEND(mem_ctx,
+								  ev,
+								  handle,
+								  dir_fsp,
+								  smb_fnames,
+								  num_fnames);
+	}
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct vfs_gpfs_get_dos_attributes_batch_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	*state = (struct vfs_gpfs_get_dos_attributes_batch_state) {
+		.handle = handle,
+		.dir_fsp = dir_fsp,
+		.smb_fnames = smb_fnames,
+		.num_fnames = num_fnames,
+	};
+
+	/*
+	 * Everything the thread touches must belong to state, it can't
+	 * go away before the job is done.
+	 */
+	state->fds = talloc_array(state, int, num_fnames);
+	state->attrs = talloc_zero_array(state, struct gpfs_winattr, num_fnames);
+	state->errnos = talloc_zero_array(state, int, num_fnames);
+	state->dosmodes = talloc_zero_array(state, uint32_t, num_fnames);
+	state->statuses = talloc_zero_array(state, NTSTATUS, num_fnames);
+	if ((state->fds == NULL) || (state->attrs == NULL) ||
+	    (state->errnos == NULL) || (state->dosmodes == NULL) ||
+	    (state->statuses == NULL)) {
+		tevent_req_oom(req);
+		return tevent_req_post(req, ev);
+	}
+
+	for (i = 0; i < num_fnames; i++) {
+		state->fds[i] = fsp_get_pathref_fd(smb_fnames[i]->fsp);
+	}
+
+	if (geteuid() == sec_initial_uid()) {
+		state->token = root_unix_token(state);
+	} else {
+		state->token = copy_unix_token(
+					state,
+					dir_fsp->conn->session_info->unix_token);
+	}
+	if (tevent_req_nomem(state->token, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	subreq = pthreadpool_tevent_job_send(
+			state,
+			ev,
+			dir_fsp->conn->sconn->pool,
+			vfs_gpfs_get_dos_attributes_batch_do,
+			state);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq,
+				vfs_gpfs_get_dos_attributes_batch_done,
+				req);
+
+	talloc_set_destructor(state,
+			      vfs_gpfs_get_dos_attributes_batch_state_destructor);
+
+	return req;
+}
+
+static void vfs_gpfs_get_dos_attributes_batch_do(void *private_data)
+{
+	struct vfs_gpfs_get_dos_attributes_batch_state *state =
+		talloc_get_type_abort(private_data,
+		struct vfs_gpfs_get_dos_attributes_batch_state);
+	struct timespec start_time;
+	struct timespec end_time;
+	size_t i;
+	int ret;
+
+	PROFILE_TIMESTAMP(&start_time);
+
+	/* Become the correct credential on this thread. */
+	ret = set_thread_credentials(state->token->uid,
+				     state->token->gid,
+				     (size_t)state->token->ngroups,
+				     state->token->groups);
+	if (ret != 0) {
+		state->vfs_aio_state.error = errno;
+		goto done;
+	}
+
+	for (i = 0; i < state->num_fnames; i++) {
+		ret = gpfswrap_get_winattrs(state->fds[i], &state->attrs[i]);
+		if (ret == -1 && errno == EACCES) {
+			/* See vfs_gpfs_fget_dos_attributes() */
+			set_effective_capability(DAC_OVERRIDE_CAPABILITY);
+			ret = gpfswrap_get_winattrs(state->fds[i],
+						    &state->attrs[i]);
+			if (ret == -1) {
+				state->errnos[i] = errno;
+			}
+			drop_effective_capability(DAC_OVERRIDE_CAPABILITY);
+			continue;
+		}
+		if (ret == -1) {
+			state->errnos[i] = errno;
+		}
+	}
+
+done:
+	PROFILE_TIMESTAMP(&end_time);
+	state->vfs_aio_state.duration = nsec_time_diff(&end_time, &start_time);
+}
+
+static void vfs_gpfs_get_dos_attributes_batch_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct vfs_gpfs_get_dos_attributes_batch_state *state =
+		tevent_req_data(req,
+		struct vfs_gpfs_get_dos_attributes_batch_state);
+	size_t i;
+	int ret;
+
+	ret = pthreadpool_tevent_job_recv(subreq);
+	TALLOC_FREE(subreq);
+	talloc_set_destructor(state, NULL);
+	if (ret == EAGAIN) {
+		/*
+		 * No thread available, let dos_mode_at_batch_recv() fall
+		 * back to the sync vfs_gpfs_fget_dos_attributes()
+		 */
+		for (i = 0; i < state->num_fnames; i++) {
+			state->statuses[i] = NT_STATUS_NOT_SUPPORTED;
+		}
+		tevent_req_done(req);
+		return;
+	}
+	if (ret != 0) {
+		tevent_req_nterror(req, map_nt_error_from_unix(ret));
+		return;
+	}
+	if (state->vfs_aio_state.error != 0) {
+		tevent_req_nterror(
+			req, map_nt_error_from_unix(state->vfs_aio_state.error));
+		return;
+	}
+
+	for (i = 0; i < state->num_fnames; i++) {
+		struct smb_filename *smb_fname = state->smb_fnames[i];
+		struct timespec ts;
+
+		if (state->errnos[i] == ENOSYS) {
+			state->statuses[i] = NT_STATUS_NOT_SUPPORTED;
+			continue;
+		}
+		if (state->errnos[i] != 0) {
+			DBG_WARNING("Getting winattrs failed for %s: %s\n",
+				    smb_fname->base_name,
+				    strerror(state->errnos[i]));
+			state->statuses[i] =
+				map_nt_error_from_unix(state->errnos[i]);
+			continue;
+		}
+
+		ts.tv_sec = state->attrs[i].creationTime.tv_sec;
+		ts.tv_nsec = state->attrs[i].creationTime.tv_nsec;
+
+		state->dosmodes[i] = vfs_gpfs_winattrs_to_dosmode(
+			state->attrs[i].winAttrs);
+		update_stat_ex_create_time(&smb_fname->st, ts);
+		update_stat_ex_create_time(&smb_fname->fsp->fsp_name->st, ts);
+	}
+
+	tevent_req_done(req);
+}
+
+static NTSTATUS vfs_gpfs_get_dos_attributes_batch_recv(
+			struct tevent_req *req,
+			struct vfs_aio_state *aio_state,
+			uint32_t *dosmodes,
+			NTSTATUS *statuses)
+{
+	struct vfs_gpfs_get_dos_attributes_batch_state *state =
+		tevent_req_data(req,
+		struct vfs_gpfs_get_dos_attributes_batch_state);
+	NTSTATUS status;
+
+	if (tevent_req_is_nterror(req, &status)) {
+		tevent_req_received(req);
+		return status;
+	}
+
+	*aio_state = state->vfs_aio_state;
+	memcpy(dosmodes, state->dosmodes, state->num_fnames * sizeof(uint32_t));
+	memcpy(statuses, state->statuses, state->num_fnames * sizeof(NTSTATUS));
+	tevent_req_received(req);
+	return NT_STATUS_OK;
+}
+
 static int timespec_to_gpfs_timestruc(struct gpfs_config_data *config,
 				      struct timespec ts,
 				      struct gpfs_timestruc *gt)
@@ -1544,10 +1880,10 @@ static NTSTATUS vfs_gpfs_fset_dos_attributes(struct vfs_handle_struct *handle,
 
 	attrs.winAttrs = vfs_gpfs_dosmode_to_winattrs(dosmode);
 
-	ret = gpfswrap_set_winattrs(fsp_get_pathref_fd(fsp),
-				    GPFS_WINATTR_SET_CREATION_TIME|
-				    GPFS_WINATTR_SET_ATTRS,
-				    &attrs);
+	ret = gpfs_profiled_set_winattrs(fsp_get_pathref_fd(fsp),
+					 GPFS_WINATTR_SET_CREATION_TIME|
+					 GPFS_WINATTR_SET_ATTRS,
+					 &attrs);
 	if (ret == -1) {
 		DBG_WARNING("Setting winattrs failed for [%s]: %s\n",
 			    fsp_str_dbg(fsp), strerror(errno));
@@ -1746,7 +2082,7 @@ static bool vfs_gpfs_is_offline(struct vfs_handle_struct *handle,
 		return false;
 	}
 
-	ret = gpfswrap_get_winattrs(fsp_get_pathref_fd(fsp), &attrs);
+	ret = gpfs_profiled_get_winattrs(fsp_get_pathref_fd(fsp), &attrs);
 	if (ret == -1) {
 		return false;
 	}
@@ -1940,12 +2276,6 @@ static int vfs_gpfs_connect(struct vfs_handle_struct *handle,
 		}
 	}
 
-	/*
-	 * Unless we have an async implementation of get_dos_attributes turn
-	 * this off.
-	 */
-	lp_do_parameter(SNUM(handle->conn), "smbd async dosmode", "false");
-
 	return 0;
 }
 
@@ -2377,6 +2707,10 @@ static struct vfs_fn_pointers vfs_gpfs_fns = {
 	.get_real_filename_at_fn = vfs_gpfs_get_real_filename_at,
 	.get_dos_attributes_send_fn = vfs_not_implemented_get_dos_attributes_send,
 	.get_dos_attributes_recv_fn = vfs_not_implemented_get_dos_attributes_recv,
+	.get_dos_attributes_batch_send_fn =
+		vfs_gpfs_get_dos_attributes_batch_send,
+	.get_dos_attributes_batch_recv_fn =
+		vfs_gpfs_get_dos_attributes_batch_recv,
 	.fget_dos_attributes_fn = vfs_gpfs_fget_dos_attributes,
 	.fset_dos_attributes_fn = vfs_gpfs_fset_dos_attributes,
 	.fget_nt_acl_fn = gpfsacl_fget_nt_acl,
@@ -48,19 +48,60 @@ struct open_how;
 #include "smbprofile.h"
 #include <liburing.h>
 
+/*
+ * The maximum number of adjacent preads
+ * merged into a single vectored read.
+ */
+#define VFS_IO_URING_MAX_COALESCE 16
+
 struct vfs_io_uring_request;
 
 struct vfs_io_uring_config {
 	struct io_uring uring;
+	struct tevent_context *ev;
 	struct tevent_fd *fde;
+	struct tevent_immediate *im;
 	/* recursion guard. See comment above vfs_io_uring_queue_run() */
 	bool busy;
 	/* recursion guard. See comment above vfs_io_uring_queue_run() */
 	bool need_retry;
+	/*
+	 * Number of requests queued since the last
+	 * io_uring_submit(), compared against batch_depth.
+	 */
+	unsigned num_deferred;
+	unsigned batch_depth;
+	bool coalesce_reads;
+	bool link_fsync;
+	/* smbd_iobuf_pool_iov() is registered with the ring */
+	bool fixed_buffers;
+	/* Unused slots of the fixed file table */
+	unsigned *free_fixed;
+	unsigned num_free_fixed;
 	struct vfs_io_uring_request *queue;
 	struct vfs_io_uring_request *pending;
 };
 
+/*
+ * Per fsp state.
+ *
+ * For "io_uring:link fsync" write_seq is incremented for
+ * every write, synced_seq is set to write_seq if an fsync
+ * linked behind a write covers all writes that were issued
+ * before.
+ *
+ * For "io_uring:fixed files" fixed_slot is the index
+ * in the fixed file table fixed_fd is registered at.
+ */
+struct vfs_io_uring_fsp {
+	uint64_t write_seq;
+	uint64_t synced_seq;
+	unsigned inflight_writes;
+	bool fixed;
+	int fixed_fd;
+	unsigned fixed_slot;
+};
+
 struct vfs_io_uring_request {
 	struct vfs_io_uring_request *prev, *next;
 	struct vfs_io_uring_request **list_head;
@@ -71,10 +112,23 @@ struct vfs_io_uring_request {
 	struct timespec start_time;
 	struct timespec end_time;
 	SMBPROFILE_BYTES_ASYNC_STATE(profile_bytes);
+	/*
+	 * Readv requests with a single iovec may be
+	 * merged with the following queued requests.
+	 */
+	bool may_coalesce;
+	/*
+	 * Only set on the first request of a merged
+	 * read, the others are chained via coalesced_next.
+	 */
+	struct iovec *coalesced_iov;
+	struct vfs_io_uring_request *coalesced_next;
 	struct io_uring_sqe sqe;
 	struct io_uring_cqe cqe;
 };
 
+static void vfs_io_uring_request_submit(struct vfs_io_uring_request *cur);
+
 static void vfs_io_uring_finish_req(struct vfs_io_uring_request *cur,
 				    const struct io_uring_cqe *cqe,
 				    struct timespec end_time,
@@ -173,14 +227,34 @@ static void vfs_io_uring_fd_handler(struct tevent_context *ev,
 				    uint16_t flags,
 				    void *private_data);
 
+#ifdef HAVE_IO_URING_REGISTER_FILES_SPARSE
+static unsigned *vfs_io_uring_fixed_slots(struct vfs_io_uring_config *config,
+					  unsigned num_slots)
+{
+	unsigned *slots = talloc_array(config, unsigned, num_slots);
+	unsigned i;
+
+	if (slots == NULL) {
+		return NULL;
+	}
+	for (i = 0; i < num_slots; i++) {
+		slots[i] = num_slots - i - 1;
+	}
+	return slots;
+}
+#endif
+
 static int vfs_io_uring_connect(vfs_handle_struct *handle, const char *service,
 			    const char *user)
 {
 	int ret;
 	struct vfs_io_uring_config *config;
 	unsigned num_entries;
+	unsigned num_fixed_files;
+	unsigned num_buffers;
+	size_t buffer_size;
 	bool sqpoll;
-	unsigned flags = 0;
+	struct io_uring_params params = {};
 
 	config = talloc_zero(handle->conn, struct vfs_io_uring_config);
 	if (config == NULL) {
@@ -208,10 +282,50 @@ static int vfs_io_uring_connect(vfs_handle_struct *handle, const char *service,
 			     "sqpoll",
 			     false);
 	if (sqpoll) {
-		flags |= IORING_SETUP_SQPOLL;
+		params.flags |= IORING_SETUP_SQPOLL;
+		params.sq_thread_idle = lp_parm_ulong(SNUM(handle->conn),
+						      "io_uring",
+						      "sqpoll idle",
+						      0);
 	}
 
-	ret = io_uring_queue_init(num_entries, &config->uring, flags);
+	config->batch_depth = lp_parm_ulong(SNUM(handle->conn),
+					    "io_uring",
+					    "batch depth",
+					    1);
+	config->batch_depth = MAX(config->batch_depth, 1);
+	config->batch_depth = MIN(config->batch_depth, num_entries);
+
+	config->coalesce_reads = lp_parm_bool(SNUM(handle->conn),
+					      "io_uring",
+					      "coalesce reads",
+					      true);
+
+	/*
+	 * Linking only makes sense if every write is
+	 * followed by an fsync anyway.
+	 */
+	config->link_fsync = lp_parm_bool(SNUM(handle->conn),
+					  "io_uring",
+					  "link fsync",
+					  false);
+	config->link_fsync &= lp_strict_sync(SNUM(handle->conn));
+	config->link_fsync &= lp_sync_always(SNUM(handle->conn));
+
+	num_fixed_files = lp_parm_ulong(SNUM(handle->conn),
+					"io_uring",
+					"fixed files",
+					0);
+	num_buffers = lp_parm_ulong(SNUM(handle->conn),
+				    "io_uring",
+				    "registered buffers",
+				    0);
+	buffer_size = lp_parm_ulong(SNUM(handle->conn),
+				    "io_uring",
+				    "registered buffer size",
+				    1024 * 1024);
+
+	ret = io_uring_queue_init_params(num_entries, &config->uring, &params);
 	if (ret < 0) {
 		SMB_VFS_NEXT_DISCONNECT(handle);
 		errno = -ret;
@@ -220,6 +334,48 @@ static int vfs_io_uring_connect(vfs_handle_struct *handle, const char *service,
 
 	talloc_set_destructor(config, vfs_io_uring_config_destructor);
 
+	/*
+	 * Fixed files and buffers are only an optimization,
+	 * we just go on without them if the kernel refuses.
+	 */
+#ifdef HAVE_IO_URING_REGISTER_FILES_SPARSE
+	if (num_fixed_files > 0) {
+		ret = io_uring_register_files_sparse(&config->uring,
+						     num_fixed_files);
+		if (ret == 0) {
+			config->free_fixed = vfs_io_uring_fixed_slots(
+				config, num_fixed_files);
+		} else {
+			DBG_NOTICE("io_uring_register_files_sparse(%u) "
+				   "failed: %s\n",
+				   num_fixed_files,
+				   strerror(-ret));
+		}
+		if (config->free_fixed != NULL) {
+			config->num_free_fixed = num_fixed_files;
+		}
+	}
+#else
+	if (num_fixed_files > 0) {
+		DBG_NOTICE("io_uring:fixed files not supported by liburing\n");
+	}
+#endif
+
+	if (num_buffers > 0 && smbd_iobuf_pool_init(num_buffers, buffer_size)) {
+		const struct iovec *iov = NULL;
+		size_t num_iov;
+
+		iov = smbd_iobuf_pool_iov(&num_iov);
+		ret = io_uring_register_buffers(&config->uring, iov, num_iov);
+		if (ret == 0) {
+			config->fixed_buffers = true;
+		} else {
+			DBG_NOTICE("io_uring_register_buffers(%zu) failed: %s\n",
+				   num_iov,
+				   strerror(-ret));
+		}
+	}
+
 #ifdef HAVE_IO_URING_RING_DONTFORK
 	ret = io_uring_ring_dontfork(&config->uring);
 	if (ret < 0) {
@@ -229,7 +385,8 @@ static int vfs_io_uring_connect(vfs_handle_struct *handle, const char *service,
 	}
 #endif /* HAVE_IO_URING_RING_DONTFORK */
 
-	config->fde = tevent_add_fd(handle->conn->sconn->ev_ctx,
+	config->ev = handle->conn->sconn->ev_ctx;
+	config->fde = tevent_add_fd(config->ev,
 				    config,
 				    config->uring.ring_fd,
 				    TEVENT_FD_READ,
@@ -242,9 +399,134 @@ static int vfs_io_uring_connect(vfs_handle_struct *handle, const char *service,
 		return -1;
 	}
 
+	config->im = tevent_create_immediate(config);
+	if (config->im == NULL) {
+		SMB_VFS_NEXT_DISCONNECT(handle);
+		errno = ENOMEM;
+		return -1;
+	}
+
 	return 0;
 }
 
+static struct vfs_io_uring_request *vfs_io_uring_coalesce_reads(
+	struct vfs_io_uring_config *config,
+	struct vfs_io_uring_request *cur,
+	struct vfs_io_uring_request *next,
+	struct io_uring_sqe *sqe,
+	struct timespec start_time)
+{
+	const struct iovec *cur_iov =
+		(const struct iovec *)(uintptr_t)cur->sqe.addr;
+	struct vfs_io_uring_request *last = cur;
+	uint64_t end = cur->sqe.off + cur_iov->iov_len;
+	struct iovec *iov = NULL;
+	unsigned num_iov = 1;
+
+	while (next != NULL && num_iov < VFS_IO_URING_MAX_COALESCE) {
+		struct vfs_io_uring_request *n = next;
+		const struct iovec *n_iov =
+			(const struct iovec *)(uintptr_t)n->sqe.addr;
+		void *state = NULL;
+
+		if (!n->may_coalesce ||
+		    n->sqe.opcode != IORING_OP_READV ||
+		    n->sqe.fd != cur->sqe.fd ||
+		    n->sqe.flags != cur->sqe.flags ||
+		    n->sqe.len != 1 ||
+		    n->sqe.off != end)
+		{
+			break;
+		}
+
+		if (iov == NULL) {
+			iov = talloc_array(config,
+					   struct iovec,
+					   VFS_IO_URING_MAX_COALESCE);
+			if (iov == NULL) {
+				break;
+			}
+			iov[0] = *cur_iov;
+		}
+
+		next = n->next;
+
+		state = _tevent_req_data(n->req);
+		talloc_set_destructor(state,
+			vfs_io_uring_request_state_deny_destructor);
+		DLIST_REMOVE(config->queue, n);
+		DLIST_ADD_END(config->pending, n);
+		n->list_head = &config->pending;
+		SMBPROFILE_BYTES_ASYNC_SET_BUSY(n->profile_bytes);
+		n->start_time = start_time;
+
+		iov[num_iov++] = *n_iov;
+		end += n_iov->iov_len;
+		last->coalesced_next = n;
+		last = n;
+	}
+
+	if (iov == NULL) {
+		return next;
+	}
+
+	cur->coalesced_iov = iov;
+	sqe->addr = (uintptr_t)iov;
+	sqe->len = num_iov;
+
+	SMBPROFILE_COUNT_INCREMENT(io_uring_coalesced_reads,
+				   profile_p,
+				   num_iov - 1);
+	return next;
+}
+
+/*
+ * Split the result of a merged read between the requests.
+ */
+static void vfs_io_uring_finish_coalesced(struct vfs_io_uring_request *cur,
+					  const struct io_uring_cqe *cqe,
+					  struct timespec end_time,
+					  const char *location)
+{
+	struct vfs_io_uring_request *member = cur;
+	int64_t left = MAX(cqe->res, 0);
+
+	TALLOC_FREE(cur->coalesced_iov);
+
+	while (member != NULL) {
+		struct vfs_io_uring_request *next = member->coalesced_next;
+		const struct iovec *iov =
+			(const struct iovec *)(uintptr_t)member->sqe.addr;
+		struct io_uring_cqe member_cqe = *cqe;
+
+		member->coalesced_next = NULL;
+		member_cqe.user_data = (uintptr_t)(void *)member;
+
+		if (cqe->res >= 0 && left == 0 && member != cur) {
+			/*
+			 * A short read before this request, it's
+			 * most likely EOF, but let the kernel decide
+			 * by reading it on its own.
+			 */
+			DLIST_REMOVE(cur->config->pending, member);
+			member->list_head = NULL;
+			member->may_coalesce = false;
+			SMBPROFILE_BYTES_ASYNC_SET_IDLE(member->profile_bytes);
+			vfs_io_uring_request_submit(member);
+			member = next;
+			continue;
+		}
+
+		if (cqe->res >= 0) {
+			member_cqe.res = MIN(left, (int64_t)iov->iov_len);
+			left -= member_cqe.res;
+		}
+
+		vfs_io_uring_finish_req(member, &member_cqe, end_time, location);
+		member = next;
+	}
+}
+
 static void _vfs_io_uring_queue_run(struct vfs_io_uring_config *config)
 {
 	struct vfs_io_uring_request *cur = NULL, *next = NULL;
@@ -262,12 +544,24 @@ static void _vfs_io_uring_queue_run(struct vfs_io_uring_config *config)
 		return;
 	}
 
+	config->num_deferred = 0;
+
 	for (cur = config->queue; cur != NULL; cur = next) {
 		struct io_uring_sqe *sqe = NULL;
 		void *state = _tevent_req_data(cur->req);
 
 		next = cur->next;
 
+		if ((cur->sqe.flags & IOSQE_IO_LINK) &&
+		    io_uring_sq_space_left(&config->uring) < 2)
+		{
+			/*
+			 * A link needs to be submitted together
+			 * with the following request.
+			 */
+			break;
+		}
+
 		sqe = io_uring_get_sqe(&config->uring);
 		if (sqe == NULL) {
 			break;
@@ -282,6 +576,14 @@ static void _vfs_io_uring_queue_run(struct vfs_io_uring_config *config)
 		SMBPROFILE_BYTES_ASYNC_SET_BUSY(cur->profile_bytes);
 
 		cur->start_time = start_time;
+
+		if (config->coalesce_reads && cur->may_coalesce) {
+			next = vfs_io_uring_coalesce_reads(config,
+							   cur,
+							   next,
+							   sqe,
+							   start_time);
+		}
 	}
 
 	ret = io_uring_submit(&config->uring);
@@ -290,13 +592,25 @@ static void _vfs_io_uring_queue_run(struct vfs_io_uring_config *config)
 	} else if (ret < 0) {
 		vfs_io_uring_config_destroy(config, ret, __location__);
 		return;
+	} else if (ret > 0) {
+		DO_PROFILE_INC(io_uring_submit);
+		SMBPROFILE_COUNT_INCREMENT(io_uring_submit_sqes,
+					   profile_p,
+					   ret);
 	}
 
 	PROFILE_TIMESTAMP(&end_time);
 
 	io_uring_for_each_cqe(&config->uring, cqhead, cqe) {
 		cur = (struct vfs_io_uring_request *)io_uring_cqe_get_data(cqe);
-		vfs_io_uring_finish_req(cur, cqe, end_time, __location__);
+		if (cur->coalesced_next != NULL) {
+			vfs_io_uring_finish_coalesced(cur,
+						      cqe,
+						      end_time,
+						      __location__);
+		} else {
+			vfs_io_uring_finish_req(cur, cqe, end_time, __location__);
+		}
 		nr++;
 	}
 
@@ -390,13 +704,49 @@ static void vfs_io_uring_queue_run(struct vfs_io_uring_config *config)
 	config->busy = false;
 }
 
-static void vfs_io_uring_request_submit(struct vfs_io_uring_request *cur)
+static void vfs_io_uring_immediate_handler(struct tevent_context *ev,
+					   struct tevent_immediate *im,
+					   void *private_data)
+{
+	struct vfs_io_uring_config *config = talloc_get_type_abort(
+		private_data, struct vfs_io_uring_config);
+
+	vfs_io_uring_queue_run(config);
+}
+
+/*
+ * Only add the request to the queue, the caller
+ * will call vfs_io_uring_request_submit() for
+ * a following request.
+ */
+static void vfs_io_uring_request_queue(struct vfs_io_uring_request *cur)
 {
 	struct vfs_io_uring_config *config = cur->config;
 
 	io_uring_sqe_set_data(&cur->sqe, cur);
 	DLIST_ADD_END(config->queue, cur);
 	cur->list_head = &config->queue;
+	config->num_deferred += 1;
+}
+
+static void vfs_io_uring_request_submit(struct vfs_io_uring_request *cur)
+{
+	struct vfs_io_uring_config *config = cur->config;
+
+	vfs_io_uring_request_queue(cur);
+
+	if (config->num_deferred < config->batch_depth) {
+		/*
+		 * Wait for more requests, but submit at
+		 * the end of the current event loop iteration
+		 * at the latest.
+		 */
+		tevent_schedule_immediate(config->im,
+					  config->ev,
+					  vfs_io_uring_immediate_handler,
+					  config);
+		return;
+	}
 
 	vfs_io_uring_queue_run(config);
 }
@@ -432,8 +782,141 @@ static int vfs_io_uring_openat(struct vfs_handle_struct *handle,
 	return SMB_VFS_NEXT_OPENAT(handle, dirfsp, smb_fname, fsp, how);
 }
 
+static struct vfs_io_uring_fsp *vfs_io_uring_fetch_fsp(
+	struct vfs_handle_struct *handle,
+	struct files_struct *fsp)
+{
+	return (struct vfs_io_uring_fsp *)VFS_FETCH_FSP_EXTENSION(handle, fsp);
+}
+
+static struct vfs_io_uring_fsp *vfs_io_uring_fsp_ext(
+	struct vfs_handle_struct *handle,
+	struct files_struct *fsp)
+{
+	struct vfs_io_uring_fsp *uf = vfs_io_uring_fetch_fsp(handle, fsp);
+
+	if (uf == NULL) {
+		uf = VFS_ADD_FSP_EXTENSION(handle,
+					   fsp,
+					   struct vfs_io_uring_fsp,
+					   NULL);
+	}
+	return uf;
+}
+
+static void vfs_io_uring_fsp_written(struct vfs_handle_struct *handle,
+				     struct files_struct *fsp)
+{
+	struct vfs_io_uring_fsp *uf = vfs_io_uring_fetch_fsp(handle, fsp);
+
+	if (uf != NULL) {
+		uf->write_seq += 1;
+	}
+}
+
+/*
+ * Put the fd into the fixed file table on first use,
+ * so the kernel doesn't need to look it up for every
+ * request. Pathref fsps never get here.
+ */
+static struct vfs_io_uring_fsp *vfs_io_uring_fsp_fixed(
+	struct vfs_handle_struct *handle,
+	struct vfs_io_uring_config *config,
+	struct files_struct *fsp)
+{
+	struct vfs_io_uring_fsp *uf = NULL;
+	int fd = fsp_get_io_fd(fsp);
+	int ret;
+
+	if (config->free_fixed == NULL) {
+		return NULL;
+	}
+
+	uf = vfs_io_uring_fsp_ext(handle, fsp);
+	if (uf == NULL) {
+		return NULL;
+	}
+	if (uf->fixed && uf->fixed_fd == fd) {
+		return uf;
+	}
+
+	if (!uf->fixed) {
+		if (config->num_free_fixed == 0) {
+			return uf;
+		}
+		uf->fixed_slot = config->free_fixed[--config->num_free_fixed];
+		uf->fixed = true;
+	}
+
+	/* This replaces a stale fd in the slot */
+	ret = io_uring_register_files_update(&config->uring,
+					     uf->fixed_slot,
+					     &fd,
+					     1);
+	if (ret != 1) {
+		DBG_DEBUG("io_uring_register_files_update() failed: %s\n",
+			  strerror(-ret));
+		config->free_fixed[config->num_free_fixed++] = uf->fixed_slot;
+		uf->fixed = false;
+		return uf;
+	}
+
+	uf->fixed_fd = fd;
+	return uf;
+}
+
+static void vfs_io_uring_fsp_unfix(struct vfs_io_uring_config *config,
+				   struct vfs_io_uring_fsp *uf)
+{
+	int fd = -1;
+
+	/*
+	 * We just leave the fd registered if the
+	 * update fails, it's replaced by the next user.
+	 */
+	io_uring_register_files_update(&config->uring,
+				       uf->fixed_slot,
+				       &fd,
+				       1);
+	config->free_fixed[config->num_free_fixed++] = uf->fixed_slot;
+	uf->fixed = false;
+}
+
+static void vfs_io_uring_prep_fixed(struct vfs_io_uring_request *cur,
+				    const struct vfs_io_uring_fsp *uf)
+{
+	if (uf == NULL || !uf->fixed) {
+		return;
+	}
+	if (cur->sqe.fd != uf->fixed_fd) {
+		return;
+	}
+	cur->sqe.fd = uf->fixed_slot;
+	cur->sqe.flags |= IOSQE_FIXED_FILE;
+}
+
+static int vfs_io_uring_close(struct vfs_handle_struct *handle,
+			      struct files_struct *fsp)
+{
+	struct vfs_io_uring_config *config = NULL;
+	struct vfs_io_uring_fsp *uf = vfs_io_uring_fetch_fsp(handle, fsp);
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config,
+				struct vfs_io_uring_config,
+				smb_panic(__location__));
+
+	if (uf != NULL && uf->fixed &&
+	    uf->fixed_fd == fsp_get_pathref_fd(fsp))
+	{
+		vfs_io_uring_fsp_unfix(config, uf);
+	}
+
+	return SMB_VFS_NEXT_CLOSE(handle, fsp);
+}
+
 struct vfs_io_uring_pread_state {
 	struct files_struct *fsp;
+	struct vfs_io_uring_fsp *uf;
 	off_t offset;
 	struct iovec iov;
 	size_t nread;
@@ -480,6 +963,7 @@ static struct tevent_req *vfs_io_uring_pread_send(struct vfs_handle_struct *hand
 	}
 
 	state->fsp = fsp;
+	state->uf = vfs_io_uring_fsp_fixed(handle, config, fsp);
 	state->offset = offset;
 	state->iov.iov_base = (void *)data;
 	state->iov.iov_len = n;
@@ -495,10 +979,33 @@ static struct tevent_req *vfs_io_uring_pread_send(struct vfs_handle_struct *hand
 
 static void vfs_io_uring_pread_submit(struct vfs_io_uring_pread_state *state)
 {
-	io_uring_prep_readv(&state->ur.sqe,
-			    fsp_get_io_fd(state->fsp),
-			    &state->iov, 1,
-			    state->offset);
+	ssize_t buf_index = -1;
+
+	if (state->ur.config->fixed_buffers) {
+		buf_index = smbd_iobuf_index(state->iov.iov_base,
+					     state->iov.iov_len);
+	}
+
+	if (buf_index != -1) {
+		/*
+		 * The buffer is already mapped into
+		 * the kernel.
+		 */
+		io_uring_prep_read_fixed(&state->ur.sqe,
+					 fsp_get_io_fd(state->fsp),
+					 state->iov.iov_base,
+					 state->iov.iov_len,
+					 state->offset,
+					 buf_index);
+		state->ur.may_coalesce = false;
+	} else {
+		io_uring_prep_readv(&state->ur.sqe,
+				    fsp_get_io_fd(state->fsp),
+				    &state->iov, 1,
+				    state->offset);
+		state->ur.may_coalesce = true;
+	}
+	vfs_io_uring_prep_fixed(&state->ur, state->uf);
 	vfs_io_uring_request_submit(&state->ur);
 }
 
@@ -586,11 +1093,24 @@ struct vfs_io_uring_pwrite_state {
 	struct iovec iov;
 	size_t nwritten;
 	struct vfs_io_uring_request ur;
+	struct vfs_io_uring_fsp *uf;
+	/*
+	 * Only used for "io_uring:link fsync"
+	 */
+	bool link_fsync;
+	uint64_t write_seq;
+	bool sole_writer;
+	bool write_pending;
+	bool fsync_pending;
+	int error;
+	struct vfs_io_uring_request ur_fsync;
 };
 
 static void vfs_io_uring_pwrite_submit(struct vfs_io_uring_pwrite_state *state);
 static void vfs_io_uring_pwrite_completion(struct vfs_io_uring_request *cur,
 					   const char *location);
+static void vfs_io_uring_pwrite_fsync_completion(struct vfs_io_uring_request *cur,
+						 const char *location);
 
 static struct tevent_req *vfs_io_uring_pwrite_send(struct vfs_handle_struct *handle,
 					      TALLOC_CTX *mem_ctx,
@@ -632,6 +1152,33 @@ static struct tevent_req *vfs_io_uring_pwrite_send(struct vfs_handle_struct *han
 	state->offset = offset;
 	state->iov.iov_base = discard_const(data);
 	state->iov.iov_len = n;
+
+	state->uf = vfs_io_uring_fsp_fixed(handle, config, fsp);
+	if (config->link_fsync && state->uf == NULL) {
+		state->uf = vfs_io_uring_fsp_ext(handle, fsp);
+	}
+	if (config->link_fsync && state->uf != NULL) {
+		/*
+		 * As the fsync is linked behind our write,
+		 * it only covers all previous writes if
+		 * no other write is in flight.
+		 */
+		state->sole_writer = (state->uf->inflight_writes == 0);
+		state->uf->inflight_writes += 1;
+		state->uf->write_seq += 1;
+		state->write_seq = state->uf->write_seq;
+
+		state->ur_fsync.config = config;
+		state->ur_fsync.req = req;
+		state->ur_fsync.completion_fn =
+			vfs_io_uring_pwrite_fsync_completion;
+
+		state->ur.sqe.flags |= IOSQE_IO_LINK;
+		state->link_fsync = true;
+		state->fsync_pending = true;
+	}
+
+	state->write_pending = true;
 	vfs_io_uring_pwrite_submit(state);
 
 	if (!tevent_req_is_in_progress(req)) {
@@ -644,6 +1191,9 @@ static struct tevent_req *vfs_io_uring_pwrite_send(struct vfs_handle_struct *han
 
 static void vfs_io_uring_pwrite_submit(struct vfs_io_uring_pwrite_state *state)
 {
+	/* io_uring_prep_*() overwrites the flags */
+	uint8_t flags = state->ur.sqe.flags & IOSQE_IO_LINK;
+
 	if (!state->fsp->fsp_flags.posix_append) {
 		io_uring_prep_writev(&state->ur.sqe,
 				     fsp_get_io_fd(state->fsp),
@@ -662,7 +1212,97 @@ static void vfs_io_uring_pwrite_submit(struct vfs_io_uring_pwrite_state *state)
 		smb_panic("Unexpected POSIX append-IO");
 #endif
 	}
-	vfs_io_uring_request_submit(&state->ur);
+	state->ur.sqe.flags = flags;
+	vfs_io_uring_prep_fixed(&state->ur, state->uf);
+
+	if (!(flags & IOSQE_IO_LINK)) {
+		vfs_io_uring_request_submit(&state->ur);
+		return;
+	}
+
+	/*
+	 * The fsync has to follow the write directly
+	 * in the submission queue.
+	 */
+	io_uring_prep_fsync(&state->ur_fsync.sqe,
+			    fsp_get_io_fd(state->fsp),
+			    0); /* fsync_flags */
+	vfs_io_uring_prep_fixed(&state->ur_fsync, state->uf);
+	vfs_io_uring_request_queue(&state->ur);
+	vfs_io_uring_request_submit(&state->ur_fsync);
+	DO_PROFILE_INC(io_uring_linked_fsyncs);
+}
+
+/*
+ * With a linked fsync we're only done once
+ * we got the completions for both requests.
+ */
+static void vfs_io_uring_pwrite_maybe_done(
+	struct vfs_io_uring_pwrite_state *state,
+	const char *location)
+{
+	if (state->write_pending || state->fsync_pending) {
+		return;
+	}
+
+	if (state->link_fsync) {
+		state->uf->inflight_writes -= 1;
+		state->link_fsync = false;
+	}
+
+	if (state->error != 0) {
+		_tevent_req_error(state->ur.req, state->error, location);
+		return;
+	}
+
+	tevent_req_done(state->ur.req);
+}
+
+static void vfs_io_uring_pwrite_fail(struct vfs_io_uring_pwrite_state *state,
+				     int err,
+				     const char *location)
+{
+	if (!state->link_fsync) {
+		_tevent_req_error(state->ur.req, err, location);
+		return;
+	}
+
+	state->write_pending = false;
+	state->error = err;
+	vfs_io_uring_pwrite_maybe_done(state, location);
+}
+
+static void vfs_io_uring_pwrite_fsync_completion(struct vfs_io_uring_request *cur,
+						 const char *location)
+{
+	struct vfs_io_uring_pwrite_state *state = tevent_req_data(
+		cur->req, struct vfs_io_uring_pwrite_state);
+
+	state->fsync_pending = false;
+
+	if (state->write_pending) {
+		void *req_state = state;
+
+		/*
+		 * vfs_io_uring_finish_req() removed the destructor,
+		 * but the rest of a short write is still in flight.
+		 */
+		talloc_set_destructor(req_state,
+			vfs_io_uring_request_state_deny_destructor);
+	}
+
+	/*
+	 * An error, including -ECANCELED after a short
+	 * or failed write, is not reported here:
+	 * synced_seq is not updated and the caller's
+	 * SMB_VFS_FSYNC_SEND() will do the real fsync.
+	 */
+	if (cur->cqe.res == 0 && state->sole_writer) {
+		state->uf->synced_seq = MAX(state->uf->synced_seq,
+					    state->write_seq);
+	}
+
+	vfs_io_uring_pwrite_maybe_done(state, location);
 }
 
 static void vfs_io_uring_pwrite_completion(struct vfs_io_uring_request *cur,
@@ -680,9 +1320,12 @@ static void vfs_io_uring_pwrite_completion(struct vfs_io_uring_request *cur,
 	 * already.
 	 */
 
+	/* A resubmission of the rest is never linked */
+	cur->sqe.flags &= ~IOSQE_IO_LINK;
+
 	if (cur->cqe.res < 0) {
 		int err = -cur->cqe.res;
-		_tevent_req_error(cur->req, err, location);
+		vfs_io_uring_pwrite_fail(state, err, location);
 		return;
 	}
 
@@ -690,7 +1333,7 @@ static void vfs_io_uring_pwrite_completion(struct vfs_io_uring_request *cur,
 		/*
 		 * Ensure we can never spin.
 		 */
-		tevent_req_error(cur->req, ENOSPC);
+		vfs_io_uring_pwrite_fail(state, ENOSPC, location);
 		return;
 	}
 
@@ -700,7 +1343,7 @@ static void vfs_io_uring_pwrite_completion(struct vfs_io_uring_request *cur,
 		DBG_ERR("iov_advance() failed cur->cqe.res=%d > iov_len=%d\n",
 			(int)cur->cqe.res,
 			(int)state->iov.iov_len);
-		tevent_req_error(cur->req, EIO);
+		vfs_io_uring_pwrite_fail(state, EIO, location);
 		return;
 	}
 
@@ -708,7 +1351,8 @@ static void vfs_io_uring_pwrite_completion(struct vfs_io_uring_request *cur,
 	state->nwritten += state->ur.cqe.res;
 	if (num_iov == 0) {
 		/* We're done */
-		tevent_req_done(cur->req);
+		state->write_pending = false;
+		vfs_io_uring_pwrite_maybe_done(state, location);
 		return;
 	}
 
@@ -747,6 +1391,23 @@ struct vfs_io_uring_fsync_state {
 	struct vfs_io_uring_request ur;
 };
 
+static bool vfs_io_uring_fsync_needed(struct vfs_handle_struct *handle,
+				      struct files_struct *fsp)
+{
+	struct vfs_io_uring_fsp *uf = vfs_io_uring_fetch_fsp(handle, fsp);
+
+	if (uf == NULL) {
+		return true;
+	}
+	if (uf->inflight_writes != 0) {
+		return true;
+	}
+	if (uf->write_seq == 0) {
+		return true;
+	}
+	return uf->synced_seq != uf->write_seq;
+}
+
 static void vfs_io_uring_fsync_completion(struct vfs_io_uring_request *cur,
 					  const char *location);
 
@@ -776,10 +1437,29 @@ static struct tevent_req *vfs_io_uring_fsync_send(struct vfs_handle_struct *hand
 				     state->ur.profile_bytes, 0);
 	SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->ur.profile_bytes);
 
+	if (!vfs_io_uring_fsync_needed(handle, fsp)) {
+		/*
+		 * All writes were already synced
+		 * by linked fsync requests.
+		 */
+		DO_PROFILE_INC(io_uring_skipped_fsyncs);
+		PROFILE_TIMESTAMP(&state->ur.start_time);
+		state->ur.end_time = state->ur.start_time;
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+	}
+
 	io_uring_prep_fsync(&state->ur.sqe,
 			    fsp_get_io_fd(fsp),
 			    0); /* fsync_flags */
-	vfs_io_uring_request_submit(&state->ur);
+	vfs_io_uring_prep_fixed(&state->ur,
+				vfs_io_uring_fsp_fixed(handle, config, fsp));
+	/*
+	 * Don't defer the submission, we may be called
+	 * via sync_file() with a private event context.
+	 */
+	vfs_io_uring_request_queue(&state->ur);
+	vfs_io_uring_queue_run(config);
 
 	if (!tevent_req_is_in_progress(req)) {
 		return tevent_req_post(req, ev);
@@ -835,15 +1515,204 @@ static int vfs_io_uring_fsync_recv(struct tevent_req *req,
 	return 0;
 }
 
+struct vfs_io_uring_fstatat_state {
+	struct vfs_io_uring_request ur;
+	char *path;
+	bool fake_dir_create_times;
+	struct statx stx;
+	SMB_STRUCT_STAT sbuf;
+};
+
+static void vfs_io_uring_fstatat_completion(struct vfs_io_uring_request *cur,
+					    const char *location);
+
+static struct tevent_req *vfs_io_uring_fstatat_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct vfs_handle_struct *handle,
+	files_struct *dirfsp,
+	const struct smb_filename *smb_fname,
+	int flags)
+{
+	struct tevent_req *req = NULL;
+	struct vfs_io_uring_fstatat_state *state = NULL;
+	struct vfs_io_uring_config *config = NULL;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, config,
+				struct vfs_io_uring_config,
+				smb_panic(__location__));
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct vfs_io_uring_fstatat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	state->ur.config = config;
+	state->ur.req = req;
+	state->ur.completion_fn = vfs_io_uring_fstatat_completion;
+	state->fake_dir_create_times =
+		lp_fake_directory_create_times(SNUM(handle->conn));
+
+	SMBPROFILE_BYTES_ASYNC_START(syscall_asys_fstatat, profile_p,
+				     state->ur.profile_bytes, 0);
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->ur.profile_bytes);
+
+	if (is_named_stream(smb_fname)) {
+		tevent_req_error(req, EINVAL);
+		return tevent_req_post(req, ev);
+	}
+
+	/* The kernel reads the path asynchronously */
+	state->path = talloc_strdup(state, smb_fname->base_name);
+	if (tevent_req_nomem(state->path, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	io_uring_prep_statx(&state->ur.sqe,
+			    fsp_get_pathref_fd(dirfsp),
+			    state->path,
+			    flags,
+			    STATX_BASIC_STATS,
+			    &state->stx);
+	vfs_io_uring_request_submit(&state->ur);
+
+	if (!tevent_req_is_in_progress(req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	tevent_req_defer_callback(req, ev);
+	return req;
+}
+
+static void vfs_io_uring_fstatat_completion(struct vfs_io_uring_request *cur,
+					    const char *location)
+{
+	struct vfs_io_uring_fstatat_state *state = tevent_req_data(
+		cur->req, struct vfs_io_uring_fstatat_state);
+	const struct statx *stx = &state->stx;
+	struct stat st = {
+		.st_dev = makedev(stx->stx_dev_major, stx->stx_dev_minor),
+		.st_ino = stx->stx_ino,
+		.st_mode = stx->stx_mode,
+		.st_nlink = stx->stx_nlink,
+		.st_uid = stx->stx_uid,
+		.st_gid = stx->stx_gid,
+		.st_rdev = makedev(stx->stx_rdev_major, stx->stx_rdev_minor),
+		.st_size = stx->stx_size,
+		.st_blksize = stx->stx_blksize,
+		.st_blocks = stx->stx_blocks,
+	};
+
+	/*
+	 * We rely on being inside the _send() function
+	 * or tevent_req_defer_callback() being called
+	 * already.
+	 */
+
+	if (cur->cqe.res < 0) {
+		int err = -cur->cqe.res;
+		_tevent_req_error(cur->req, err, location);
+		return;
+	}
+
+	st.st_atim.tv_sec = stx->stx_atime.tv_sec;
+	st.st_atim.tv_nsec = stx->stx_atime.tv_nsec;
+	st.st_mtim.tv_sec = stx->stx_mtime.tv_sec;
+	st.st_mtim.tv_nsec = stx->stx_mtime.tv_nsec;
+	st.st_ctim.tv_sec = stx->stx_ctime.tv_sec;
+	st.st_ctim.tv_nsec = stx->stx_ctime.tv_nsec;
+
+	/* Same as sys_fstatat(): directories appear zero size */
+	if (S_ISDIR(st.st_mode)) {
+		st.st_size = 0;
+	}
+	init_stat_ex_from_stat(&state->sbuf, &st, state->fake_dir_create_times);
+
+	tevent_req_done(cur->req);
+}
+
+static int vfs_io_uring_fstatat_recv(struct tevent_req *req,
+				     struct vfs_aio_state *vfs_aio_state,
+				     SMB_STRUCT_STAT *sbuf)
+{
+	struct vfs_io_uring_fstatat_state *state = tevent_req_data(
+		req, struct vfs_io_uring_fstatat_state);
+
+	SMBPROFILE_BYTES_ASYNC_END(state->ur.profile_bytes);
+	vfs_aio_state->duration = nsec_time_diff(&state->ur.end_time,
+						 &state->ur.start_time);
+
+	if (tevent_req_is_unix_error(req, &vfs_aio_state->error)) {
+		tevent_req_received(req);
+		return -1;
+	}
+
+	vfs_aio_state->error = 0;
+	*sbuf = state->sbuf;
+
+	tevent_req_received(req);
+	return 0;
+}
+
+/*
+ * Synchronous modifications also need
+ * to be covered by the next fsync.
+ */
+
+static ssize_t vfs_io_uring_pwrite(struct vfs_handle_struct *handle,
+				   struct files_struct *fsp,
+				   const void *data,
+				   size_t n,
+				   off_t offset)
+{
+	vfs_io_uring_fsp_written(handle, fsp);
+	return SMB_VFS_NEXT_PWRITE(handle, fsp, data, n, offset);
+}
+
+static ssize_t vfs_io_uring_recvfile(struct vfs_handle_struct *handle,
+				     int fromfd,
+				     files_struct *tofsp,
+				     off_t offset,
+				     size_t n)
+{
+	vfs_io_uring_fsp_written(handle, tofsp);
+	return SMB_VFS_NEXT_RECVFILE(handle, fromfd, tofsp, offset, n);
+}
+
+static int vfs_io_uring_ftruncate(struct vfs_handle_struct *handle,
+				  struct files_struct *fsp,
+				  off_t len)
+{
+	vfs_io_uring_fsp_written(handle, fsp);
+	return SMB_VFS_NEXT_FTRUNCATE(handle, fsp, len);
+}
+
+static int vfs_io_uring_fallocate(struct vfs_handle_struct *handle,
+				  struct files_struct *fsp,
+				  uint32_t mode,
+				  off_t offset,
+				  off_t len)
+{
+	vfs_io_uring_fsp_written(handle, fsp);
+	return SMB_VFS_NEXT_FALLOCATE(handle, fsp, mode, offset, len);
+}
+
 static struct vfs_fn_pointers vfs_io_uring_fns = {
 	.connect_fn = vfs_io_uring_connect,
 	.openat_fn = vfs_io_uring_openat,
+	.close_fn = vfs_io_uring_close,
 	.pread_send_fn = vfs_io_uring_pread_send,
 	.pread_recv_fn = vfs_io_uring_pread_recv,
+	.pwrite_fn = vfs_io_uring_pwrite,
 	.pwrite_send_fn = vfs_io_uring_pwrite_send,
 	.pwrite_recv_fn = vfs_io_uring_pwrite_recv,
 	.fsync_send_fn = vfs_io_uring_fsync_send,
 	.fsync_recv_fn = vfs_io_uring_fsync_recv,
+	.fstatat_send_fn = vfs_io_uring_fstatat_send,
+	.fstatat_recv_fn = vfs_io_uring_fstatat_recv,
+	.recvfile_fn = vfs_io_uring_recvfile,
+	.ftruncate_fn = vfs_io_uring_ftruncate,
+	.fallocate_fn = vfs_io_uring_fallocate,
 };
 
 static_decl_vfs;
@@ -380,6 +380,45 @@ int vfs_not_implemented_fstatat(
 	return -1;
 }
 
+struct vfs_not_implemented_fstatat_state {
+	uint8_t dummy;
+};
+
+_PUBLIC_
+struct tevent_req *vfs_not_implemented_fstatat_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct vfs_handle_struct *handle,
+	files_struct *dirfsp,
+	const struct smb_filename *smb_fname,
+	int flags)
+{
+	struct tevent_req *req = NULL;
+	struct vfs_not_implemented_fstatat_state *state = NULL;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct vfs_not_implemented_fstatat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	tevent_req_error(req, ENOSYS);
+	return tevent_req_post(req, ev);
+}
+
+_PUBLIC_
+int vfs_not_implemented_fstatat_recv(struct tevent_req *req,
+				     struct vfs_aio_state *aio_state,
+				     SMB_STRUCT_STAT *sbuf)
+{
+	if (tevent_req_is_unix_error(req, &aio_state->error)) {
+		tevent_req_received(req);
+		return -1;
+	}
+	tevent_req_received(req);
+	return 0;
+}
+
 _PUBLIC_
 uint64_t vfs_not_implemented_get_alloc_size(struct vfs_handle_struct *handle,
 					    struct files_struct *fsp,
@@ -847,6 +886,54 @@ NTSTATUS vfs_not_implemented_get_dos_attributes_recv(
 	return NT_STATUS_OK;
 }
 
+struct vfs_not_implemented_get_dos_attributes_batch_state {
+	struct vfs_aio_state aio_state;
+};
+
+_PUBLIC_
+struct tevent_req *vfs_not_implemented_get_dos_attributes_batch_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct vfs_handle_struct *handle,
+			files_struct *dir_fsp,
+			struct smb_filename **smb_fnames,
+			size_t num_fnames)
+{
+	struct tevent_req *req = NULL;
+	struct vfs_not_implemented_get_dos_attributes_batch_state *state = NULL;
+
+	req = tevent_req_create(mem_ctx, &state,
+			struct vfs_not_implemented_get_dos_attributes_batch_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	tevent_req_nterror(req, NT_STATUS_NOT_IMPLEMENTED);
+	return tevent_req_post(req, ev);
+}
+
+_PUBLIC_
+NTSTATUS vfs_not_implemented_get_dos_attributes_batch_recv(
+			struct tevent_req *req,
+			struct vfs_aio_state *aio_state,
+			uint32_t *dosmodes,
+			NTSTATUS *statuses)
+{
+	struct vfs_not_implemented_get_dos_attributes_batch_state *state =
+		tevent_req_data(req,
+		struct vfs_not_implemented_get_dos_attributes_batch_state);
+	NTSTATUS status;
+
+	if (tevent_req_is_nterror(req, &status)) {
+		tevent_req_received(req);
+		return status;
+	}
+
+	*aio_state = state->aio_state;
+	tevent_req_received(req);
+	return NT_STATUS_OK;
+}
+
 _PUBLIC_
 NTSTATUS vfs_not_implemented_fget_dos_attributes(struct vfs_handle_struct *handle,
 						 struct files_struct *fsp,
@@ -1104,6 +1191,8 @@ static struct vfs_fn_pointers vfs_not_implemented_fns = {
 	.fstat_fn = vfs_not_implemented_fstat,
 	.lstat_fn = vfs_not_implemented_lstat,
 	.fstatat_fn = vfs_not_implemented_fstatat,
+	.fstatat_send_fn = vfs_not_implemented_fstatat_send,
+	.fstatat_recv_fn = vfs_not_implemented_fstatat_recv,
 	.get_alloc_size_fn = vfs_not_implemented_get_alloc_size,
 	.unlinkat_fn = vfs_not_implemented_unlinkat,
 	.fchmod_fn = vfs_not_implemented_fchmod,
@@ -1149,6 +1238,10 @@ static struct vfs_fn_pointers vfs_not_implemented_fns = {
 	/* DOS attributes. */
 	.get_dos_attributes_send_fn = vfs_not_implemented_get_dos_attributes_send,
 	.get_dos_attributes_recv_fn = vfs_not_implemented_get_dos_attributes_recv,
+	.get_dos_attributes_batch_send_fn =
+		vfs_not_implemented_get_dos_attributes_batch_send,
+	.get_dos_attributes_batch_recv_fn =
+		vfs_not_implemented_get_dos_attributes_batch_recv,
 	.fget_dos_attributes_fn = vfs_not_implemented_fget_dos_attributes,
 	.fset_dos_attributes_fn = vfs_not_implemented_fset_dos_attributes,
 
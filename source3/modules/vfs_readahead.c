@@ -18,6 +18,8 @@
 #include "includes.h"
 #include "system/filesys.h"
 #include "smbd/smbd.h"
+#include "smbprofile.h"
+#include "lib/util/tevent_unix.h"
 
 #if defined(HAVE_LINUX_READAHEAD) && ! defined(HAVE_READAHEAD_DECL)
 ssize_t readahead(int fd, off_t offset, size_t count);
@@ -27,6 +29,19 @@ struct readahead_data {
 	off_t off_bound;
 	off_t len;
 	bool didmsg;
+	bool adaptive;
+	off_t max_window;
+};
+
+/*
+ * Per open file state of the adaptive mode. "next" is the highest end
+ * offset read so far, "ra_end" the end of the range we already asked
+ * the kernel to prefetch.
+ */
+struct readahead_stream {
+	off_t next;
+	off_t ra_end;
+	off_t window;
 };
 
 /* 
@@ -35,6 +50,120 @@ struct readahead_data {
  * the buffer cache to be filled in advance.
  */
 
+static int readahead_issue(struct readahead_data *rhd,
+			   files_struct *fsp,
+			   off_t offset,
+			   off_t len)
+{
+	int err = -1;
+
+#if defined(HAVE_LINUX_READAHEAD)
+	err = readahead(fsp_get_io_fd(fsp), offset, (size_t)len);
+	DEBUG(10,("readahead_issue: readahead on fd %u, offset %llu, len %u returned %d\n",
+		(unsigned int)fsp_get_io_fd(fsp),
+		(unsigned long long)offset,
+		(unsigned int)len,
+		err ));
+#elif defined(HAVE_POSIX_FADVISE)
+	err = posix_fadvise(fsp_get_io_fd(fsp), offset, len, POSIX_FADV_WILLNEED);
+	DEBUG(10,("readahead_issue: posix_fadvise on fd %u, offset %llu, len %u returned %d\n",
+		(unsigned int)fsp_get_io_fd(fsp),
+		(unsigned long long)offset,
+		(unsigned int)len,
+		err ));
+#else
+	if (!rhd->didmsg) {
+		DEBUG(0,("readahead_issue: no readahead on this platform\n"));
+		rhd->didmsg = True;
+	}
+#endif
+	return err;
+}
+
+/*******************************************************************
+ Adaptive mode: detect sequential streams per fsp and keep the kernel
+ a growing window ahead of the reader.
+
+ Clients with multiple credits issue several reads in parallel which
+ may arrive out of order, so a read counts as sequential as long as it
+ falls within one window of the highest offset read so far. Every
+ sequential read doubles the window up to readahead:max window, any
+ other read resets it.
+*******************************************************************/
+
+static void readahead_adaptive(vfs_handle_struct *handle,
+			       struct readahead_data *rhd,
+			       files_struct *fsp,
+			       off_t offset,
+			       size_t count)
+{
+	struct readahead_stream *rs = NULL;
+	off_t end = offset + count;
+	off_t start;
+
+	rs = VFS_FETCH_FSP_EXTENSION(handle, fsp);
+	if (rs == NULL) {
+		rs = VFS_ADD_FSP_EXTENSION(handle,
+					   fsp,
+					   struct readahead_stream,
+					   NULL);
+		if (rs == NULL) {
+			return;
+		}
+		*rs = (struct readahead_stream) {
+			.window = rhd->len,
+		};
+	}
+
+	if ((offset <= rs->next + rs->window) &&
+	    (end + rs->window >= rs->next)) {
+		DO_PROFILE_INC(readahead_hits);
+		rs->window = MIN(rs->window * 2, rhd->max_window);
+	} else {
+		DO_PROFILE_INC(readahead_misses);
+		rs->window = rhd->len;
+		rs->next = end;
+		rs->ra_end = end;
+		return;
+	}
+
+	rs->next = MAX(rs->next, end);
+
+	/*
+	 * Only go to the kernel again once the reader got through half
+	 * of what we prefetched last time.
+	 */
+	if (rs->ra_end - rs->next >= rs->window / 2) {
+		return;
+	}
+
+	start = MAX(rs->ra_end, rs->next);
+	if (readahead_issue(rhd, fsp, start, rs->window) == 0) {
+		DO_PROFILE_INC(readahead_calls);
+		SMBPROFILE_COUNT_INCREMENT(readahead_bytes,
+					   profile_p,
+					   rs->window);
+	}
+	rs->ra_end = start + rs->window;
+}
+
+static void readahead_hint(vfs_handle_struct *handle,
+			   files_struct *fsp,
+			   off_t offset,
+			   size_t count)
+{
+	struct readahead_data *rhd = (struct readahead_data *)handle->data;
+
+	if (rhd->adaptive) {
+		readahead_adaptive(handle, rhd, fsp, offset, count);
+		return;
+	}
+
+	if ( offset % rhd->off_bound == 0) {
+		readahead_issue(rhd, fsp, offset, rhd->len);
+	}
+}
+
 /*******************************************************************
  sendfile wrapper that does readahead/posix_fadvise.
 *******************************************************************/
@@ -46,30 +175,8 @@ static ssize_t readahead_sendfile(struct vfs_handle_struct *handle,
 					off_t offset,
 					size_t count)
 {
-	struct readahead_data *rhd = (struct readahead_data *)handle->data;
+	readahead_hint(handle, fromfsp, offset, count);
 
-	if ( offset % rhd->off_bound == 0) {
-#if defined(HAVE_LINUX_READAHEAD)
-		int err = readahead(fsp_get_io_fd(fromfsp), offset, (size_t)rhd->len);
-		DEBUG(10,("readahead_sendfile: readahead on fd %u, offset %llu, len %u returned %d\n",
-			(unsigned int)fsp_get_io_fd(fromfsp),
-			(unsigned long long)offset,
-			(unsigned int)rhd->len,
-		        err ));
-#elif defined(HAVE_POSIX_FADVISE)
-		int err = posix_fadvise(fsp_get_io_fd(fromfsp), offset, (off_t)rhd->len, POSIX_FADV_WILLNEED);
-		DEBUG(10,("readahead_sendfile: posix_fadvise on fd %u, offset %llu, len %u returned %d\n",
-			(unsigned int)fsp_get_io_fd(fromfsp),
-			(unsigned long long)offset,
-			(unsigned int)rhd->len,
-			err ));
-#else
-		if (!rhd->didmsg) {
-			DEBUG(0,("readahead_sendfile: no readahead on this platform\n"));
-			rhd->didmsg = True;
-		}
-#endif
-	}
 	return SMB_VFS_NEXT_SENDFILE(handle,
 					tofd,
 					fromfsp,
@@ -88,31 +195,80 @@ static ssize_t readahead_pread(vfs_handle_struct *handle,
 				size_t count,
 				off_t offset)
 {
-	struct readahead_data *rhd = (struct readahead_data *)handle->data;
+	readahead_hint(handle, fsp, offset, count);
 
-	if ( offset % rhd->off_bound == 0) {
-#if defined(HAVE_LINUX_READAHEAD)
-		int err = readahead(fsp_get_io_fd(fsp), offset, (size_t)rhd->len);
-		DEBUG(10,("readahead_pread: readahead on fd %u, offset %llu, len %u returned %d\n",
-			(unsigned int)fsp_get_io_fd(fsp),
-			(unsigned long long)offset,
-			(unsigned int)rhd->len,
-			err ));
-#elif defined(HAVE_POSIX_FADVISE)
-		int err = posix_fadvise(fsp_get_io_fd(fsp), offset, (off_t)rhd->len, POSIX_FADV_WILLNEED);
-		DEBUG(10,("readahead_pread: posix_fadvise on fd %u, offset %llu, len %u returned %d\n",
-			(unsigned int)fsp_get_io_fd(fsp),
-			(unsigned long long)offset,
-			(unsigned int)rhd->len,
-			err ));
-#else
-		if (!rhd->didmsg) {
-			DEBUG(0,("readahead_pread: no readahead on this platform\n"));
-			rhd->didmsg = True;
-		}
-#endif
-        }
-        return SMB_VFS_NEXT_PREAD(handle, fsp, data, count, offset);
+	return SMB_VFS_NEXT_PREAD(handle, fsp, data, count, offset);
+}
+
+/*******************************************************************
+ pread_send wrapper that does readahead/posix_fadvise. SMB2 reads
+ take this path.
+*******************************************************************/
+
+struct readahead_pread_state {
+	ssize_t ret;
+	struct vfs_aio_state vfs_aio_state;
+};
+
+static void readahead_pread_done(struct tevent_req *subreq);
+
+static struct tevent_req *readahead_pread_send(struct vfs_handle_struct *handle,
+					       TALLOC_CTX *mem_ctx,
+					       struct tevent_context *ev,
+					       struct files_struct *fsp,
+					       void *data,
+					       size_t n,
+					       off_t offset)
+{
+	struct tevent_req *req = NULL;
+	struct tevent_req *subreq = NULL;
+	struct readahead_pread_state *state = NULL;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct readahead_pread_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	readahead_hint(handle, fsp, offset, n);
+
+	subreq = SMB_VFS_NEXT_PREAD_SEND(state, ev, handle, fsp, data,
+					 n, offset);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, readahead_pread_done, req);
+	return req;
+}
+
+static void readahead_pread_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct readahead_pread_state *state = tevent_req_data(
+		req, struct readahead_pread_state);
+
+	state->ret = SMB_VFS_PREAD_RECV(subreq, &state->vfs_aio_state);
+	TALLOC_FREE(subreq);
+	if (state->ret == -1) {
+		tevent_req_error(req, state->vfs_aio_state.error);
+		return;
+	}
+	tevent_req_done(req);
+}
+
+static ssize_t readahead_pread_recv(struct tevent_req *req,
+				    struct vfs_aio_state *vfs_aio_state)
+{
+	struct readahead_pread_state *state = tevent_req_data(
+		req, struct readahead_pread_state);
+
+	if (tevent_req_is_unix_error(req, &vfs_aio_state->error)) {
+		return -1;
+	}
+
+	*vfs_aio_state = state->vfs_aio_state;
+	return state->ret;
 }
 
 /*******************************************************************
@@ -161,6 +317,17 @@ static int readahead_connect(struct vfs_handle_struct *handle,
 	if (rhd->len == 0) {
 		rhd->len = rhd->off_bound;
 	}
+	rhd->adaptive = lp_parm_bool(SNUM(handle->conn),
+				     "readahead",
+				     "adaptive",
+				     false);
+	rhd->max_window = conv_str_size(lp_parm_const_string(SNUM(handle->conn),
+						"readahead",
+						"max window",
+						NULL));
+	if (rhd->max_window < rhd->len) {
+		rhd->max_window = MAX(rhd->len, 0x800000);
+	}
 
 	handle->data = (void *)rhd;
 	handle->free_data = free_readahead_data;
@@ -170,6 +337,8 @@ static int readahead_connect(struct vfs_handle_struct *handle,
 static struct vfs_fn_pointers vfs_readahead_fns = {
 	.sendfile_fn = readahead_sendfile,
 	.pread_fn = readahead_pread,
+	.pread_send_fn = readahead_pread_send,
+	.pread_recv_fn = readahead_pread_recv,
 	.connect_fn = readahead_connect
 };
 
@@ -38,6 +38,7 @@
 #include "lib/util_path.h"
 #include "libcli/security/security.h"
 #include "lib/util/tevent_unix.h"
+#include "lib/util/binsearch.h"
 
 struct shadow_copy2_config {
 	char *gmt_format;
@@ -65,8 +66,15 @@ struct shadow_copy2_snapentry {
 
 struct shadow_copy2_snaplist_info {
 	struct shadow_copy2_snapentry *snaplist; /* snapshot list */
+	/* snaplist entries sorted by time_fmt, for lookups */
+	struct shadow_copy2_snapentry **index;
+	size_t num_index;
 	regex_t *regex; /* Regex to filter snaps */
 	time_t fetch_time; /* snaplist update time */
+	/* snapdir, its mtime and ctime seen when the snaplist was fetched */
+	char *snapdir;
+	struct timespec snapdir_mtime;
+	struct timespec snapdir_ctime;
 };
 
 /*
@@ -87,6 +95,9 @@ static int shadow_copy2_get_shadow_copy_data(
 	vfs_handle_struct *handle, files_struct *fsp,
 	struct shadow_copy_data *shadow_copy2_data,
 	bool labels);
+static const char *shadow_copy2_find_snapdir(TALLOC_CTX *mem_ctx,
+					     struct vfs_handle_struct *handle,
+					     struct smb_filename *smb_fname);
 
 /**
  * This function will create a new snapshot list entry and
@@ -123,12 +134,67 @@ static void shadow_copy2_delete_snaplist(struct shadow_copy2_private *priv)
 {
 	struct shadow_copy2_snapentry *tmp = NULL;
 
+	TALLOC_FREE(priv->snaps->index);
+	priv->snaps->num_index = 0;
+	TALLOC_FREE(priv->snaps->snapdir);
+
 	while ((tmp = priv->snaps->snaplist) != NULL) {
 		DLIST_REMOVE(priv->snaps->snaplist, tmp);
 		talloc_free(tmp);
 	}
 }
 
+static int shadow_copy2_snapentry_cmp(struct shadow_copy2_snapentry * const *e1,
+				      struct shadow_copy2_snapentry * const *e2)
+{
+	return strcmp((*e1)->time_fmt, (*e2)->time_fmt);
+}
+
+/**
+ * Build the sorted lookup index over the snaplist, so
+ * shadow_copy2_saved_snapname() does not have to walk the whole list
+ * for every @GMT token translated.
+ *
+ * @param[in] priv shadow_copy2 specific data structure
+ * @return	true on success, false on allocation failure
+ */
+static bool shadow_copy2_build_snaplist_index(struct shadow_copy2_private *priv)
+{
+	struct shadow_copy2_snapentry *entry = NULL;
+	size_t num = 0;
+
+	TALLOC_FREE(priv->snaps->index);
+	priv->snaps->num_index = 0;
+
+	for (entry = priv->snaps->snaplist; entry; entry = entry->next) {
+		if (entry->snapname == NULL || entry->time_fmt == NULL) {
+			return false;
+		}
+		num += 1;
+	}
+
+	if (num == 0) {
+		return true;
+	}
+
+	priv->snaps->index = talloc_array(priv->snaps,
+					  struct shadow_copy2_snapentry *,
+					  num);
+	if (priv->snaps->index == NULL) {
+		return false;
+	}
+
+	num = 0;
+	for (entry = priv->snaps->snaplist; entry; entry = entry->next) {
+		priv->snaps->index[num++] = entry;
+	}
+
+	TYPESAFE_QSORT(priv->snaps->index, num, shadow_copy2_snapentry_cmp);
+	priv->snaps->num_index = num;
+
+	return true;
+}
+
 /**
  * Given a timestamp this function searches the global snapshot list
  * and returns the complete snapshot directory name saved in the entry.
@@ -153,27 +219,84 @@ static ssize_t shadow_copy2_saved_snapname(struct shadow_copy2_private *priv,
 		return -1;
 	}
 
-	snaptime_len = -1;
-
-	for (entry = priv->snaps->snaplist; entry; entry = entry->next) {
-		if (strcmp(entry->time_fmt, snap_str) == 0) {
-			snaptime_len = snprintf(snap_str, len, "%s",
-						entry->snapname);
-			return snaptime_len;
-		}
+	BINARY_ARRAY_SEARCH_P(priv->snaps->index,
+			      priv->snaps->num_index,
+			      time_fmt,
+			      snap_str,
+			      strcmp,
+			      entry);
+	if (entry != NULL) {
+		snaptime_len = snprintf(snap_str, len, "%s", entry->snapname);
+		return snaptime_len;
 	}
 
 	snap_str[0] = 0;
-	return snaptime_len;
+	return -1;
 }
 
 
+/**
+ * Check whether the snapshot directory is unchanged since the snaplist
+ * was fetched. Creating or removing a snapshot updates the mtime/ctime
+ * of the directory holding it, so a matching stat means a rescan would
+ * produce the same list. A directory modified within the last second
+ * is never trusted, as a further change could share its timestamp.
+ *
+ * @param[in]   handle		VFS handle struct
+ *
+ * @return 	true if the cached snaplist is still current
+ */
+static bool shadow_copy2_snapdir_unchanged(struct vfs_handle_struct *handle)
+{
+	struct smb_filename root_fname = {
+		.base_name = discard_const_p(char, "."),
+	};
+	struct smb_filename snapdir_fname = { .base_name = NULL, };
+	struct shadow_copy2_private *priv = NULL;
+	struct timespec now;
+	const char *snapdir = NULL;
+	int ret;
+
+	SMB_VFS_HANDLE_GET_DATA(handle, priv, struct shadow_copy2_private,
+				return false);
+
+	if (priv->snaps->snapdir == NULL) {
+		return false;
+	}
+
+	snapdir = shadow_copy2_find_snapdir(talloc_tos(), handle, &root_fname);
+	if (snapdir == NULL || strcmp(snapdir, priv->snaps->snapdir) != 0) {
+		return false;
+	}
+
+	snapdir_fname.base_name = discard_const_p(char, snapdir);
+	ret = SMB_VFS_NEXT_STAT(handle, &snapdir_fname);
+	if (ret != 0) {
+		return false;
+	}
+
+	if (timespec_compare(&snapdir_fname.st.st_ex_mtime,
+			     &priv->snaps->snapdir_mtime) != 0 ||
+	    timespec_compare(&snapdir_fname.st.st_ex_ctime,
+			     &priv->snaps->snapdir_ctime) != 0) {
+		return false;
+	}
+
+	now = timespec_current();
+	if (now.tv_sec - snapdir_fname.st.st_ex_ctime.tv_sec < 2) {
+		return false;
+	}
+
+	return true;
+}
+
 /**
  * This function will check if snaplist is updated or not. If snaplist
  * is empty then it will create a new list. Each time snaplist is updated
  * the time is recorded. If the snapshot time is greater than the snaplist
  * update time then chances are we are working on an older list. Then discard
- * the old list and fetch a new snaplist.
+ * the old list and fetch a new snaplist, unless the snapshot directory has
+ * not changed since the last fetch.
  *
  * @param[in]   handle		VFS handle struct
  * @param[in]   snap_time	time of snapshot
@@ -201,6 +324,11 @@ static bool shadow_copy2_update_snaplist(struct vfs_handle_struct *handle,
 	 * time.
 	 */
 	if (seconds > 0 || (priv->snaps->snaplist == NULL)) {
+		if (shadow_copy2_snapdir_unchanged(handle)) {
+			DBG_DEBUG("snapdir unchanged, keeping snaplist\n");
+			return false;
+		}
+
 		smb_fname.base_name = discard_const_p(char, ".");
 		fsp.fsp_name = &smb_fname;
 
@@ -2154,6 +2282,7 @@ static int shadow_copy2_get_shadow_copy_data(
 	struct shadow_copy2_private *priv = NULL;
 	struct shadow_copy2_snapentry *tmpentry = NULL;
 	bool get_snaplist = false;
+	bool snapdir_stat_ok = false;
 	struct vfs_open_how how = {
 		.flags = O_RDONLY, .mode = 0,
 	};
@@ -2260,6 +2389,20 @@ static int shadow_copy2_get_shadow_copy_data(
 
 		/* Set the current time as snaplist update time */
 		time(&(priv->snaps->fetch_time));
+
+		/*
+		 * Remember the state of the snapdir before reading it, so
+		 * that any change made while we read is seen as newer.
+		 */
+		ret = SMB_VFS_NEXT_FSTAT(handle, dirfsp, &dirfsp->fsp_name->st);
+		if (ret == 0) {
+			snapdir_stat_ok = true;
+			priv->snaps->snapdir_mtime =
+				dirfsp->fsp_name->st.st_ex_mtime;
+			priv->snaps->snapdir_ctime =
+				dirfsp->fsp_name->st.st_ex_ctime;
+		}
+		ret = -1;
 	}
 
 	while ((d = SMB_VFS_NEXT_READDIR(handle, dirfsp, p))) {
@@ -2321,6 +2464,19 @@ static int shadow_copy2_get_shadow_copy_data(
 		shadow_copy2_data->labels = tlabels;
 	}
 
+	if (get_snaplist) {
+		if (!shadow_copy2_build_snaplist_index(priv)) {
+			DBG_ERR("Failed to index snaplist\n");
+			shadow_copy2_delete_snaplist(priv);
+			errno = ENOMEM;
+			goto done;
+		}
+		if (snapdir_stat_ok) {
+			priv->snaps->snapdir = talloc_strdup(priv->snaps,
+							     snapdir);
+		}
+	}
+
 	shadow_copy2_sort_data(handle, shadow_copy2_data);
 	ret = 0;
 
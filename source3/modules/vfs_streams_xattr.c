@@ -45,6 +45,11 @@ struct stream_io {
 	vfs_handle_struct *handle;
 };
 
+/*
+ * Return the size of a stream without reading its value. Backends
+ * that can't report the size with a zero sized buffer fail with
+ * ERANGE, for those fall back to reading the value.
+ */
 static ssize_t get_xattr_size_fsp(struct files_struct *fsp,
 			          const char *xattr_name)
 {
@@ -52,8 +57,23 @@ static ssize_t get_xattr_size_fsp(struct files_struct *fsp,
 	struct ea_struct ea;
 	ssize_t result;
 
+	if (refuse_symlink_fsp(fsp)) {
+		errno = EACCES;
+		return -1;
+	}
+
+	result = SMB_VFS_FGETXATTR(fsp, xattr_name, NULL, 0);
+	if (result > 0) {
+		/* Streams are stored with a trailing 0 byte */
+		return result - 1;
+	}
+	if ((result == -1) && (errno == ENOATTR)) {
+		return -1;
+	}
+
 	ret = get_ea_value_fsp(talloc_tos(), fsp, xattr_name, &ea);
 	if (ret != 0) {
+		errno = ret;
 		return -1;
 	}
 
@@ -395,7 +415,6 @@ static int streams_xattr_openat(struct vfs_handle_struct *handle,
 {
 	struct streams_xattr_config *config = NULL;
 	struct stream_io *sio = NULL;
-	struct ea_struct ea;
 	char *xattr_name = NULL;
 	int fakefd = -1;
 	bool set_empty_xattr = false;
@@ -433,9 +452,9 @@ static int streams_xattr_openat(struct vfs_handle_struct *handle,
 		goto fail;
 	}
 
-	ret = get_ea_value_fsp(talloc_tos(), fsp->base_fsp, xattr_name, &ea);
-	if (ret != 0) {
-		DBG_DEBUG("get_ea_value_fsp returned %s\n", strerror(ret));
+	if (get_xattr_size_fsp(fsp->base_fsp, xattr_name) == -1) {
+		ret = errno;
+		DBG_DEBUG("get_xattr_size_fsp returned %s\n", strerror(ret));
 
 		if (ret != ENOATTR) {
 			/*
@@ -774,11 +793,16 @@ static int streams_xattr_renameat(vfs_handle_struct *handle,
 	return ret;
 }
 
+/*
+ * Call fn for every stream with its name and size. Only the sizes are
+ * fetched, not the stream contents.
+ */
 static NTSTATUS walk_xattr_streams(vfs_handle_struct *handle,
 				files_struct *fsp,
 				const struct smb_filename *smb_fname,
-				bool (*fn)(struct ea_struct *ea,
-					void *private_data),
+				bool (*fn)(const char *name,
+					   off_t size,
+					   void *private_data),
 				void *private_data)
 {
 	NTSTATUS status;
@@ -798,8 +822,8 @@ static NTSTATUS walk_xattr_streams(vfs_handle_struct *handle,
 	}
 
 	for (i=0; i<num_names; i++) {
-		struct ea_struct ea;
-		int ret;
+		char *name = NULL;
+		ssize_t size;
 
 		/*
 		 * We want to check with samba_private_attr_name()
@@ -824,30 +848,30 @@ static NTSTATUS walk_xattr_streams(vfs_handle_struct *handle,
 			continue;
 		}
 
-		ret = get_ea_value_fsp(names, smb_fname->fsp, names[i], &ea);
-		if (ret != 0) {
+		size = get_xattr_size_fsp(smb_fname->fsp, names[i]);
+		if (size == -1) {
 			DBG_DEBUG("Could not get ea %s for file %s: %s\n",
 				  names[i],
 				  smb_fname->base_name,
-				  strerror(ret));
+				  strerror(errno));
 			continue;
 		}
 
-		ea.name = talloc_asprintf(
-			ea.value.data, ":%s%s",
+		name = talloc_asprintf(
+			names, ":%s%s",
 			names[i] + config->prefix_len,
 			config->store_stream_type ? "" : ":$DATA");
-		if (ea.name == NULL) {
+		if (name == NULL) {
 			DEBUG(0, ("talloc failed\n"));
 			continue;
 		}
 
-		if (!fn(&ea, private_data)) {
-			TALLOC_FREE(ea.value.data);
+		if (!fn(name, size, private_data)) {
+			TALLOC_FREE(names);
 			return NT_STATUS_OK;
 		}
 
-		TALLOC_FREE(ea.value.data);
+		TALLOC_FREE(name);
 	}
 
 	TALLOC_FREE(names);
@@ -888,16 +912,17 @@ struct streaminfo_state {
 	NTSTATUS status;
 };
 
-static bool collect_one_stream(struct ea_struct *ea, void *private_data)
+static bool collect_one_stream(const char *name,
+			       off_t size,
+			       void *private_data)
 {
 	struct streaminfo_state *state =
 		(struct streaminfo_state *)private_data;
 
 	if (!add_one_stream(state->mem_ctx,
 			    &state->num_streams, &state->streams,
-			    ea->name, ea->value.length-1,
-			    smb_roundup(state->handle->conn,
-					ea->value.length-1))) {
+			    name, size,
+			    smb_roundup(state->handle->conn, size))) {
 		state->status = NT_STATUS_NO_MEMORY;
 		return false;
 	}
@@ -996,6 +1021,37 @@ static int streams_xattr_connect(vfs_handle_struct *handle,
 	return 0;
 }
 
+/*
+ * Set the stream to exactly data[0..n), adding the trailing 0 byte.
+ */
+static ssize_t streams_xattr_replace(files_struct *fsp,
+				     struct stream_io *sio,
+				     const void *data,
+				     size_t n)
+{
+	uint8_t *buf = NULL;
+	int ret;
+
+	buf = talloc_array(talloc_tos(), uint8_t, n + 1);
+	if (buf == NULL) {
+		errno = ENOMEM;
+		return -1;
+	}
+	memcpy(buf, data, n);
+	buf[n] = 0;
+
+	ret = SMB_VFS_FSETXATTR(fsp->base_fsp,
+				sio->xattr_name,
+				buf,
+				n + 1,
+				0);
+	TALLOC_FREE(buf);
+	if (ret == -1) {
+		return -1;
+	}
+	return n;
+}
+
 static ssize_t streams_xattr_pwrite(vfs_handle_struct *handle,
 				    files_struct *fsp, const void *data,
 				    size_t n, off_t offset)
@@ -1036,6 +1092,22 @@ static ssize_t streams_xattr_pwrite(vfs_handle_struct *handle,
 		return -1;
 	}
 
+	if (offset == 0) {
+		ssize_t size = get_xattr_size_fsp(fsp->base_fsp,
+						  sio->xattr_name);
+		if (size == -1) {
+			return -1;
+		}
+		if (n >= (size_t)size) {
+			/*
+			 * The write replaces the whole stream, as
+			 * AFP_AfpInfo updates do, no need to read the
+			 * old contents.
+			 */
+			return streams_xattr_replace(fsp, sio, data, n);
+		}
+	}
+
 	ret = get_ea_value_fsp(talloc_tos(),
 			       fsp->base_fsp,
 			       sio->xattr_name,
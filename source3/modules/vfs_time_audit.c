@@ -1095,6 +1095,91 @@ static int smb_time_audit_fstatat(
 	return result;
 }
 
+struct smb_time_audit_fstatat_state {
+	struct vfs_aio_state aio_state;
+	const struct smb_filename *smb_fname;
+	SMB_STRUCT_STAT sbuf;
+	int ret;
+};
+
+static void smb_time_audit_fstatat_done(struct tevent_req *subreq);
+
+static struct tevent_req *smb_time_audit_fstatat_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct vfs_handle_struct *handle,
+	files_struct *dirfsp,
+	const struct smb_filename *smb_fname,
+	int flags)
+{
+	struct tevent_req *req = NULL;
+	struct smb_time_audit_fstatat_state *state = NULL;
+	struct tevent_req *subreq = NULL;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct smb_time_audit_fstatat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	*state = (struct smb_time_audit_fstatat_state) {
+		.smb_fname = smb_fname,
+	};
+
+	subreq = SMB_VFS_NEXT_FSTATAT_SEND(state,
+					   ev,
+					   handle,
+					   dirfsp,
+					   smb_fname,
+					   flags);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, smb_time_audit_fstatat_done, req);
+	return req;
+}
+
+static void smb_time_audit_fstatat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smb_time_audit_fstatat_state *state = tevent_req_data(
+		req, struct smb_time_audit_fstatat_state);
+
+	state->ret = SMB_VFS_FSTATAT_RECV(subreq,
+					  &state->aio_state,
+					  &state->sbuf);
+	TALLOC_FREE(subreq);
+	tevent_req_done(req);
+}
+
+static int smb_time_audit_fstatat_recv(struct tevent_req *req,
+				       struct vfs_aio_state *aio_state,
+				       SMB_STRUCT_STAT *sbuf)
+{
+	struct smb_time_audit_fstatat_state *state = tevent_req_data(
+		req, struct smb_time_audit_fstatat_state);
+	double timediff;
+
+	timediff = state->aio_state.duration * 1.0e-9;
+
+	if (timediff > audit_timeout) {
+		smb_time_audit_log_smb_fname("async fstatat",
+					     timediff,
+					     state->smb_fname);
+	}
+
+	if (tevent_req_is_unix_error(req, &aio_state->error)) {
+		tevent_req_received(req);
+		return -1;
+	}
+	*aio_state = state->aio_state;
+	if (sbuf != NULL) {
+		*sbuf = state->sbuf;
+	}
+	tevent_req_received(req);
+	return state->ret;
+}
+
 static uint64_t smb_time_audit_get_alloc_size(vfs_handle_struct *handle,
 					      files_struct *fsp,
 					      const SMB_STRUCT_STAT *sbuf)
@@ -1976,6 +2061,121 @@ static NTSTATUS smb_time_audit_get_dos_attributes_recv(struct tevent_req *req,
 	return NT_STATUS_OK;
 }
 
+struct smb_time_audit_get_dos_attributes_batch_state {
+	struct vfs_aio_state aio_state;
+	files_struct *dir_fsp;
+	size_t num_fnames;
+	uint32_t *dosmodes;
+	NTSTATUS *statuses;
+};
+
+static void smb_time_audit_get_dos_attributes_batch_done(
+	struct tevent_req *subreq);
+
+static struct tevent_req *smb_time_audit_get_dos_attributes_batch_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct vfs_handle_struct *handle,
+			files_struct *dir_fsp,
+			struct smb_filename **smb_fnames,
+			size_t num_fnames)
+{
+	struct tevent_req *req = NULL;
+	struct smb_time_audit_get_dos_attributes_batch_state *state = NULL;
+	struct tevent_req *subreq = NULL;
+
+	req = tevent_req_create(
+		mem_ctx, &state,
+		struct smb_time_audit_get_dos_attributes_batch_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	*state = (struct smb_time_audit_get_dos_attributes_batch_state) {
+		.dir_fsp = dir_fsp,
+		.num_fnames = num_fnames,
+	};
+
+	state->dosmodes = talloc_zero_array(state, uint32_t, num_fnames);
+	if (tevent_req_nomem(state->dosmodes, req)) {
+		return tevent_req_post(req, ev);
+	}
+	state->statuses = talloc_zero_array(state, NTSTATUS, num_fnames);
+	if (tevent_req_nomem(state->statuses, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	subreq = SMB_VFS_NEXT_GET_DOS_ATTRIBUTES_BATCH_SEND(state,
+							    ev,
+							    handle,
+							    dir_fsp,
+							    smb_fnames,
+							    num_fnames);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq,
+				smb_time_audit_get_dos_attributes_batch_done,
+				req);
+
+	return req;
+}
+
+static void smb_time_audit_get_dos_attributes_batch_done(
+	struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+		tevent_req_callback_data(subreq,
+		struct tevent_req);
+	struct smb_time_audit_get_dos_attributes_batch_state *state =
+		tevent_req_data(req,
+		struct smb_time_audit_get_dos_attributes_batch_state);
+	NTSTATUS status;
+
+	status = SMB_VFS_NEXT_GET_DOS_ATTRIBUTES_BATCH_RECV(subreq,
+							    &state->aio_state,
+							    state->dosmodes,
+							    state->statuses);
+	TALLOC_FREE(subreq);
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+
+	tevent_req_done(req);
+	return;
+}
+
+static NTSTATUS smb_time_audit_get_dos_attributes_batch_recv(
+			struct tevent_req *req,
+			struct vfs_aio_state *aio_state,
+			uint32_t *dosmodes,
+			NTSTATUS *statuses)
+{
+	struct smb_time_audit_get_dos_attributes_batch_state *state =
+		tevent_req_data(req,
+		struct smb_time_audit_get_dos_attributes_batch_state);
+	NTSTATUS status;
+	double timediff;
+
+	timediff = state->aio_state.duration * 1.0e-9;
+
+	if (timediff > audit_timeout) {
+		smb_time_audit_log_fsp("async get_dos_attributes_batch",
+				       timediff,
+				       state->dir_fsp);
+	}
+
+	if (tevent_req_is_nterror(req, &status)) {
+		tevent_req_received(req);
+		return status;
+	}
+
+	*aio_state = state->aio_state;
+	memcpy(dosmodes, state->dosmodes, state->num_fnames * sizeof(uint32_t));
+	memcpy(statuses, state->statuses, state->num_fnames * sizeof(NTSTATUS));
+	tevent_req_received(req);
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS smb_time_fget_dos_attributes(struct vfs_handle_struct *handle,
 					struct files_struct *fsp,
 					uint32_t *dosmode)
@@ -2736,6 +2936,8 @@ static struct vfs_fn_pointers vfs_time_audit_fns = {
 	.fstat_fn = smb_time_audit_fstat,
 	.lstat_fn = smb_time_audit_lstat,
 	.fstatat_fn = smb_time_audit_fstatat,
+	.fstatat_send_fn = smb_time_audit_fstatat_send,
+	.fstatat_recv_fn = smb_time_audit_fstatat_recv,
 	.get_alloc_size_fn = smb_time_audit_get_alloc_size,
 	.unlinkat_fn = smb_time_audit_unlinkat,
 	.fchmod_fn = smb_time_audit_fchmod,
@@ -2779,6 +2981,10 @@ static struct vfs_fn_pointers vfs_time_audit_fns = {
 	.fsctl_fn = smb_time_audit_fsctl,
 	.get_dos_attributes_send_fn = smb_time_audit_get_dos_attributes_send,
 	.get_dos_attributes_recv_fn = smb_time_audit_get_dos_attributes_recv,
+	.get_dos_attributes_batch_send_fn =
+		smb_time_audit_get_dos_attributes_batch_send,
+	.get_dos_attributes_batch_recv_fn =
+		smb_time_audit_get_dos_attributes_batch_recv,
 	.fget_dos_attributes_fn = smb_time_fget_dos_attributes,
 	.fset_dos_attributes_fn = smb_time_fset_dos_attributes,
 	.fget_nt_acl_fn = smb_time_audit_fget_nt_acl,
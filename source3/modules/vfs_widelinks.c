@@ -364,7 +364,8 @@ static int widelinks_openat(vfs_handle_struct *handle,
 		how.flags = (how.flags & ~O_PATH);
 #endif
 		how.resolve = (how.resolve &
-			       ~(VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS));
+			       ~(VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS |
+				 VFS_OPEN_HOW_RESOLVE_BENEATH));
 	}
 
 	ret = SMB_VFS_NEXT_OPENAT(handle,
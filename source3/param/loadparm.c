@@ -81,6 +81,7 @@
 #include "source3/lib/substitute.h"
 #include "source3/librpc/gen_ndr/ads.h"
 #include "lib/util/time_basic.h"
+#include "lib/util/strv.h"
 #include "libds/common/flags.h"
 
 #ifdef HAVE_SYS_SYSCTL_H
@@ -248,11 +249,18 @@ static const struct loadparm_service _sDefault =
 	.acl_flag_inherited_canonicalization = true,
 	.aio_read_size = 1,
 	.aio_write_size = 1,
+	.smb2_qos_weight = 100,
 	.map_readonly = MAP_READONLY_NO,
 	.server_smb_encrypt = SMB_ENCRYPTION_DEFAULT,
 	.kernel_share_modes = false,
 	.durable_handles = true,
+	.smb3_compression = false,
 	.check_parent_directory_delete_on_close = false,
+	.path_walk_cache = false,
+	.access_check_cache = false,
+	.smb2_compound_stat_opens = false,
+	.stat_open_share_entry_delay = 0,
+	.smb2_write_behind_size = 0,
 	.param_opt = NULL,
 	.smbd_search_ask_sharemode = true,
 	.smbd_getinfo_ask_sharemode = true,
@@ -706,6 +714,9 @@ void loadparm_s3_init_globals(struct loadparm_context *lp_ctx,
 	Globals.nt_pipe_support = true;	/* Do NT pipes by default. */
 	Globals.nt_status_support = true; /* Use NT status by default. */
 	Globals.smbd_profiling_level = 0;
+	Globals.smbd_profiling_share_clients = 1024;
+	Globals.change_notify_coalesce_msec = 0;
+	Globals.change_notify_coalesce_max_events = 256;
 	Globals.stat_cache = true;	/* use stat cache by default */
 	Globals.max_stat_cache_size = 512; /* 512k by default */
 	Globals.restrict_anonymous = 0;
@@ -883,6 +894,7 @@ void loadparm_s3_init_globals(struct loadparm_context *lp_ctx,
 	Globals.smb2_max_credits = DEFAULT_SMB2_MAX_CREDITS;
 	Globals.smb2_leases = true;
 	Globals._smb3_directory_leases = Auto;
+	Globals.smb3_compression_threshold = 4096;
 	Globals.server_multi_channel_support = true;
 
 	lpcfg_string_set(Globals.ctx, &Globals.ncalrpc_dir,
@@ -972,6 +984,7 @@ void loadparm_s3_init_globals(struct loadparm_context *lp_ctx,
 	Globals.ldap_max_anonymous_request_size = 256000;
 	Globals.ldap_max_authenticated_request_size = 16777216;
 	Globals.ldap_max_search_request_size = 256000;
+	Globals.ldap_max_pipelined_requests = 8;
 
 	/* Async DNS query timeout (in seconds). */
 	Globals.async_dns_timeout = 10;
@@ -1070,6 +1083,18 @@ static char *loadparm_s3_global_substitution_fn(
 		return NULL;
 	}
 
+	/*
+	 * Most values contain neither substitutions nor quotes, don't
+	 * pay for the substitution machinery on every lp_*() call.
+	 */
+	if (strchr(s, '%') == NULL) {
+		size_t len = strlen(s);
+
+		if ((len == 0) || ((s[0] != '\"') && (s[len-1] != '\"'))) {
+			return talloc_strndup(mem_ctx, s, len);
+		}
+	}
+
 	ret = talloc_sub_basic(mem_ctx,
 			get_current_username(),
 			get_current_user_info_domain(),
@@ -1488,6 +1513,7 @@ static void free_service(struct loadparm_service *pservice)
 
 	lpcfg_string_free(&pservice->szService);
 	TALLOC_FREE(pservice->copymap);
+	TALLOC_FREE(pservice->registry_params);
 
 	free_param_opts(&pservice->param_opt);
 
@@ -2226,15 +2252,103 @@ static struct smbconf_ctx *lp_smbconf_ctx(void)
 	return conf_ctx;
 }
 
+/*
+ * Flatten the parameters of a registry service into a strv of
+ * name/value pairs, used to detect unchanged services on reload.
+ * Returns NULL for services that can't be skipped because they
+ * depend on other services or files.
+ */
+static char *smbconf_service_params(TALLOC_CTX *mem_ctx,
+				    struct smbconf_service *service)
+{
+	char *strv = NULL;
+	uint32_t count;
+	int ret;
+
+	if (strequal(service->name, GLOBAL_NAME)) {
+		return NULL;
+	}
+
+	for (count = 0; count < service->num_params; count++) {
+		const char *name = service->param_names[count];
+
+		if (strwicmp(name, "copy") == 0 ||
+		    strwicmp(name, "include") == 0)
+		{
+			TALLOC_FREE(strv);
+			return NULL;
+		}
+
+		ret = strv_add(mem_ctx, &strv, name);
+		if (ret != 0) {
+			TALLOC_FREE(strv);
+			return NULL;
+		}
+		ret = strv_add(mem_ctx, &strv, service->param_values[count]);
+		if (ret != 0) {
+			TALLOC_FREE(strv);
+			return NULL;
+		}
+	}
+
+	if (strv == NULL) {
+		/* Empty share definition, still remember it */
+		strv = talloc_zero_array(mem_ctx, char, 1);
+	}
+
+	return strv;
+}
+
+static bool smbconf_service_unchanged(struct smbconf_service *service,
+				      const char *params)
+{
+	const char *loaded = NULL;
+	int snum;
+
+	if (params == NULL) {
+		return false;
+	}
+
+	snum = getservicebyname(service->name, NULL);
+	if (!LP_SNUM_OK(snum)) {
+		return false;
+	}
+
+	loaded = ServicePtrs[snum]->registry_params;
+	if (loaded == NULL) {
+		return false;
+	}
+	if (talloc_array_length(loaded) != talloc_array_length(params)) {
+		return false;
+	}
+
+	return memcmp(loaded, params, talloc_array_length(params)) == 0;
+}
+
 static bool process_smbconf_service(struct smbconf_service *service)
 {
 	uint32_t count;
+	char *params = NULL;
 	bool ret;
 
 	if (service == NULL) {
 		return false;
 	}
 
+	/*
+	 * Reprocessing a share that is already loaded gives the same
+	 * result if its definition did not change, so skip it. This
+	 * keeps reloads cheap when just a few of many registry shares
+	 * were modified.
+	 */
+	params = smbconf_service_params(service, service);
+	if (smbconf_service_unchanged(service, params)) {
+		DBG_DEBUG("service [%s] unchanged, not reloading\n",
+			  service->name);
+		TALLOC_FREE(params);
+		return true;
+	}
+
 	ret = lp_do_section(service->name, NULL);
 	if (ret != true) {
 		return false;
@@ -2258,8 +2372,20 @@ static bool process_smbconf_service(struct smbconf_service *service)
 		}
 	}
 	if (iServiceIndex >= 0) {
-		return lpcfg_service_ok(ServicePtrs[iServiceIndex]);
+		struct loadparm_service *s = ServicePtrs[iServiceIndex];
+
+		if (!bInGlobalSection && !bGlobalOnly &&
+		    strequal(s->szService, service->name))
+		{
+			TALLOC_FREE(s->registry_params);
+			if (params != NULL) {
+				s->registry_params = talloc_move(s, &params);
+			}
+		}
+		TALLOC_FREE(params);
+		return lpcfg_service_ok(s);
 	}
+	TALLOC_FREE(params);
 	return true;
 }
 
@@ -1580,6 +1580,109 @@ fail:
 	return ret;
 }
 
+/*
+ * Bulk version of gid_to_sid(): Look at the idmap cache first and ask
+ * winbindd for all remaining gids in a single wbcUnixIdsToSids()
+ * round trip. Unmapped gids end up as S-1-22-2-gid, like in
+ * xid_to_sid().
+ */
+
+bool gids_to_sids(const gid_t *gids, uint32_t num_gids,
+		  struct dom_sid *sids)
+{
+	struct wbcUnixId *wbc_ids = NULL;
+	struct wbcDomainSid *wbc_sids = NULL;
+	struct bitmap *found = NULL;
+	uint32_t i, num_not_cached;
+	wbcErr err;
+
+	found = bitmap_talloc(talloc_tos(), num_gids);
+	if (found == NULL) {
+		return false;
+	}
+	wbc_ids = talloc_array(found, struct wbcUnixId, num_gids);
+	if (wbc_ids == NULL) {
+		TALLOC_FREE(found);
+		return false;
+	}
+
+	num_not_cached = 0;
+
+	for (i=0; i<num_gids; i++) {
+		struct unixid xid = { .type = ID_TYPE_GID, .id = gids[i] };
+		bool expired = true;
+
+		sids[i] = (struct dom_sid) {0};
+
+		if (idmap_cache_find_xid2sid(&xid, &sids[i], &expired) &&
+		    !expired)
+		{
+			bitmap_set(found, i);
+			continue;
+		}
+		sids[i] = (struct dom_sid) {0};
+		wbc_ids[num_not_cached] = (struct wbcUnixId) {
+			.type = WBC_ID_TYPE_GID, .id.gid = gids[i],
+		};
+		num_not_cached += 1;
+	}
+	if (num_not_cached == 0) {
+		goto done;
+	}
+
+	wbc_sids = talloc_zero_array(found, struct wbcDomainSid,
+				     num_not_cached);
+	if (wbc_sids == NULL) {
+		TALLOC_FREE(found);
+		return false;
+	}
+
+	err = wbcUnixIdsToSids(wbc_ids, num_not_cached, wbc_sids);
+	if (!WBC_ERROR_IS_OK(err)) {
+		DBG_DEBUG("wbcUnixIdsToSids returned %s\n",
+			  wbcErrorString(err));
+	}
+
+	num_not_cached = 0;
+
+	for (i=0; i<num_gids; i++) {
+		if (bitmap_query(found, i)) {
+			continue;
+		}
+
+		if (WBC_ERROR_IS_OK(err)) {
+			/*
+			 * As in xid_to_sid(), winbind may have returned
+			 * an explicit negative mapping (a null SID), that
+			 * is left to the S-1-22 fallback below.
+			 */
+			memcpy(&sids[i], &wbc_sids[num_not_cached],
+			       sizeof(struct dom_sid));
+		} else {
+			struct unixid xid = {
+				.type = ID_TYPE_GID, .id = gids[i],
+			};
+
+			become_root();
+			if (!pdb_id_to_sid(&xid, &sids[i])) {
+				sids[i] = (struct dom_sid) {0};
+			}
+			unbecome_root();
+		}
+		num_not_cached += 1;
+	}
+
+done:
+	for (i=0; i<num_gids; i++) {
+		if (is_null_sid(&sids[i])) {
+			gid_to_unix_groups_sid(gids[i], &sids[i]);
+		}
+	}
+
+	TALLOC_FREE(found);
+	return true;
+}
+
 /*****************************************************************
  *THE CANONICAL* convert SID to uid function.
 *****************************************************************/
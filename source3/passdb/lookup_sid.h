@@ -95,6 +95,8 @@ bool sid_to_uid(const struct dom_sid *psid, uid_t *puid);
 bool sid_to_gid(const struct dom_sid *psid, gid_t *pgid);
 bool sids_to_unixids(const struct dom_sid *sids, uint32_t num_sids,
 		      struct unixid *ids);
+bool gids_to_sids(const gid_t *gids, uint32_t num_gids,
+		  struct dom_sid *sids);
 NTSTATUS get_primary_group_sid(TALLOC_CTX *mem_ctx,
 				const char *username,
 				struct passwd **_pwd,
@@ -864,19 +864,37 @@ NTSTATUS pdb_delete_dom_group(TALLOC_CTX *mem_ctx, uint32_t rid)
 NTSTATUS pdb_add_group_mapping_entry(GROUP_MAP *map)
 {
 	struct pdb_methods *pdb = pdb_get_methods();
-	return pdb->add_group_mapping_entry(pdb, map);
+	NTSTATUS status;
+
+	status = pdb->add_group_mapping_entry(pdb, map);
+	if (NT_STATUS_IS_OK(status)) {
+		pdb_token_cache_generation_bump();
+	}
+	return status;
 }
 
 NTSTATUS pdb_update_group_mapping_entry(GROUP_MAP *map)
 {
 	struct pdb_methods *pdb = pdb_get_methods();
-	return pdb->update_group_mapping_entry(pdb, map);
+	NTSTATUS status;
+
+	status = pdb->update_group_mapping_entry(pdb, map);
+	if (NT_STATUS_IS_OK(status)) {
+		pdb_token_cache_generation_bump();
+	}
+	return status;
 }
 
 NTSTATUS pdb_delete_group_mapping_entry(struct dom_sid sid)
 {
 	struct pdb_methods *pdb = pdb_get_methods();
-	return pdb->delete_group_mapping_entry(pdb, sid);
+	NTSTATUS status;
+
+	status = pdb->delete_group_mapping_entry(pdb, sid);
+	if (NT_STATUS_IS_OK(status)) {
+		pdb_token_cache_generation_bump();
+	}
+	return status;
 }
 
 bool pdb_enum_group_mapping(const struct dom_sid *sid,
@@ -1132,7 +1150,13 @@ NTSTATUS pdb_create_alias(const char *name, uint32_t *rid)
 NTSTATUS pdb_delete_alias(const struct dom_sid *sid)
 {
 	struct pdb_methods *pdb = pdb_get_methods();
-	return pdb->delete_alias(pdb, sid);
+	NTSTATUS status;
+
+	status = pdb->delete_alias(pdb, sid);
+	if (NT_STATUS_IS_OK(status)) {
+		pdb_token_cache_generation_bump();
+	}
+	return status;
 }
 
 NTSTATUS pdb_get_aliasinfo(const struct dom_sid *sid, struct acct_info *info)
@@ -1150,13 +1174,25 @@ NTSTATUS pdb_set_aliasinfo(const struct dom_sid *sid, struct acct_info *info)
 NTSTATUS pdb_add_aliasmem(const struct dom_sid *alias, const struct dom_sid *member)
 {
 	struct pdb_methods *pdb = pdb_get_methods();
-	return pdb->add_aliasmem(pdb, alias, member);
+	NTSTATUS status;
+
+	status = pdb->add_aliasmem(pdb, alias, member);
+	if (NT_STATUS_IS_OK(status)) {
+		pdb_token_cache_generation_bump();
+	}
+	return status;
 }
 
 NTSTATUS pdb_del_aliasmem(const struct dom_sid *alias, const struct dom_sid *member)
 {
 	struct pdb_methods *pdb = pdb_get_methods();
-	return pdb->del_aliasmem(pdb, alias, member);
+	NTSTATUS status;
+
+	status = pdb->del_aliasmem(pdb, alias, member);
+	if (NT_STATUS_IS_OK(status)) {
+		pdb_token_cache_generation_bump();
+	}
+	return status;
 }
 
 NTSTATUS pdb_enum_aliasmem(const struct dom_sid *alias, TALLOC_CTX *mem_ctx,
@@ -27,6 +27,7 @@
 #include "passdb.h"
 #include "lib/winbind_util.h"
 #include "../librpc/gen_ndr/idmap.h"
+#include "lib/gencache.h"
 
 /**
  * Add sid as a member of builtin_sid.
@@ -243,3 +244,39 @@ NTSTATUS create_builtin_guests(const struct dom_sid *dom_sid)
 
 	return NT_STATUS_OK;
 }
+
+/*
+ * finalize_local_nt_token() can cache its results in gencache, see
+ * token_util.c. The cache keys contain a generation, which changes
+ * with every change of aliases, group mappings or privileges, so
+ * cached tokens built from outdated data are never found again.
+ */
+
+#define PDB_TOKEN_CACHE_GENERATION_KEY "SMBD_TOKEN_GENERATION"
+
+char *pdb_token_cache_generation(TALLOC_CTX *mem_ctx)
+{
+	char *value = NULL;
+	bool ok;
+
+	ok = gencache_get(PDB_TOKEN_CACHE_GENERATION_KEY, mem_ctx, &value, NULL);
+	if (!ok) {
+		return talloc_strdup(mem_ctx, "0");
+	}
+	return value;
+}
+
+void pdb_token_cache_generation_bump(void)
+{
+	struct timeval tv = timeval_current();
+	fstring value;
+
+	/*
+	 * Use the time rather than a counter, so that an expired or
+	 * flushed entry can't bring back an old generation.
+	 */
+	fstr_sprintf(value, "%"PRIu64,
+		     (uint64_t)tv.tv_sec * 1000000 + tv.tv_usec);
+	gencache_set(PDB_TOKEN_CACHE_GENERATION_KEY, value,
+		     tv.tv_sec + 10 * 365 * 24 * 60 * 60);
+}
@@ -28,6 +28,7 @@
 #include "librpc/gen_ndr/ndr_printcap.h"
 #include "lib/util/sys_rw.h"
 #include "lib/util/string_wrappers.h"
+#include "lib/util/strv.h"
 
 #ifdef HAVE_CUPS
 #include <cups/cups.h>
@@ -622,6 +623,279 @@ bool cups_cache_reload(struct tevent_context *ev,
 	return true;
 }
 
+/*
+ * Event notifications, used by the background queue process to
+ * refresh only the queues CUPS reports changes for. We use the
+ * "ippget" pull method, see RFC 3996.
+ */
+
+static ipp_t *cups_notify_request(ipp_op_t op, cups_lang_t *language)
+{
+	ipp_t *request = NULL;
+	char uri[HTTP_MAX_URI] = {0};
+	http_uri_status_t ustatus;
+
+	ustatus = httpAssembleURIf(HTTP_URI_CODING_ALL,
+				   uri,
+				   sizeof(uri),
+				   "ipp",
+				   NULL, /* username */
+				   "localhost",
+				   ippPort(),
+				   "/");
+	if (ustatus != HTTP_URI_STATUS_OK) {
+		return NULL;
+	}
+
+	request = ippNew();
+	if (request == NULL) {
+		return NULL;
+	}
+
+	ippSetOperation(request, op);
+	ippSetRequestId(request, 1);
+
+	ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_CHARSET,
+		     "attributes-charset", NULL, "utf-8");
+	ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_LANGUAGE,
+		     "attributes-natural-language", NULL, language->language);
+	ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_URI,
+		     "printer-uri", NULL, uri);
+	ippAddString(request, IPP_TAG_OPERATION, IPP_TAG_NAME,
+		     "requesting-user-name", NULL, cupsUser());
+
+	return request;
+}
+
+static ipp_t *cups_notify_do_request(TALLOC_CTX *frame,
+				     ipp_t *request,
+				     const char *what)
+{
+	http_t *http = NULL;
+	ipp_t *response = NULL;
+
+	cupsSetPasswordCB(cups_passwd_cb);
+
+	http = cups_connect(frame);
+	if (http == NULL) {
+		ippDelete(request);
+		return NULL;
+	}
+
+	response = cupsDoRequest(http, request, "/");
+	httpClose(http);
+
+	if (response == NULL) {
+		DBG_WARNING("Unable to %s - %s\n",
+			    what, ippErrorString(cupsLastError()));
+		return NULL;
+	}
+
+	if (ippGetStatusCode(response) >= IPP_OK_CONFLICT) {
+		DBG_WARNING("Unable to %s - %s\n",
+			    what, ippErrorString(ippGetStatusCode(response)));
+		ippDelete(response);
+		return NULL;
+	}
+
+	return response;
+}
+
+/*
+ * Create a server wide subscription for job and printer state
+ * changes, returns the subscription id or -1.
+ */
+
+int cups_notify_subscribe(int lease_duration)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	ipp_t *request = NULL, *response = NULL;
+	ipp_attribute_t *attr = NULL;
+	cups_lang_t *language = NULL;
+	int subscription_id = -1;
+	static const char *events[] = {
+		"job-created",
+		"job-completed",
+		"job-state-changed",
+		"job-config-changed",
+		"printer-state-changed",
+	};
+
+	language = cupsLangDefault();
+
+	request = cups_notify_request(IPP_CREATE_PRINTER_SUBSCRIPTION,
+				      language);
+	if (request == NULL) {
+		goto out;
+	}
+
+	ippAddString(request, IPP_TAG_SUBSCRIPTION, IPP_TAG_KEYWORD,
+		     "notify-pull-method", NULL, "ippget");
+	ippAddStrings(request, IPP_TAG_SUBSCRIPTION, IPP_TAG_KEYWORD,
+		      "notify-events", ARRAY_SIZE(events), NULL, events);
+	ippAddInteger(request, IPP_TAG_SUBSCRIPTION, IPP_TAG_INTEGER,
+		      "notify-lease-duration", lease_duration);
+
+	response = cups_notify_do_request(frame, request,
+					  "create subscription");
+	if (response == NULL) {
+		goto out;
+	}
+
+	attr = ippFindAttribute(response, "notify-subscription-id",
+				IPP_TAG_INTEGER);
+	if (attr == NULL) {
+		DBG_WARNING("No notify-subscription-id in response\n");
+		goto out;
+	}
+	subscription_id = ippGetInteger(attr, 0);
+
+	DBG_INFO("Created CUPS subscription %d\n", subscription_id);
+
+ out:
+	if (response)
+		ippDelete(response);
+
+	if (language)
+		cupsLangFree(language);
+
+	TALLOC_FREE(frame);
+	return subscription_id;
+}
+
+bool cups_notify_renew(int subscription_id, int lease_duration)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	ipp_t *request = NULL, *response = NULL;
+	cups_lang_t *language = NULL;
+	bool ok = false;
+
+	language = cupsLangDefault();
+
+	request = cups_notify_request(IPP_RENEW_SUBSCRIPTION, language);
+	if (request == NULL) {
+		goto out;
+	}
+
+	ippAddInteger(request, IPP_TAG_OPERATION, IPP_TAG_INTEGER,
+		      "notify-subscription-id", subscription_id);
+	ippAddInteger(request, IPP_TAG_SUBSCRIPTION, IPP_TAG_INTEGER,
+		      "notify-lease-duration", lease_duration);
+
+	response = cups_notify_do_request(frame, request,
+					  "renew subscription");
+	if (response == NULL) {
+		goto out;
+	}
+	ok = true;
+
+ out:
+	if (response)
+		ippDelete(response);
+
+	if (language)
+		cupsLangFree(language);
+
+	TALLOC_FREE(frame);
+	return ok;
+}
+
+/*
+ * Fetch the pending events of a subscription. *sequence is the
+ * last seen event sequence number and gets updated, *_printers
+ * returns the names of the printers with events as a strv.
+ * Returns false if the subscription is not usable anymore.
+ */
+
+bool cups_notify_fetch(TALLOC_CTX *mem_ctx,
+		       int subscription_id,
+		       int *sequence,
+		       char **_printers)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	ipp_t *request = NULL, *response = NULL;
+	ipp_attribute_t *attr = NULL;
+	cups_lang_t *language = NULL;
+	char *printers = NULL;
+	int last_sequence = *sequence;
+	bool ok = false;
+
+	language = cupsLangDefault();
+
+	request = cups_notify_request(IPP_GET_NOTIFICATIONS, language);
+	if (request == NULL) {
+		goto out;
+	}
+
+	ippAddInteger(request, IPP_TAG_OPERATION, IPP_TAG_INTEGER,
+		      "notify-subscription-ids", subscription_id);
+	ippAddInteger(request, IPP_TAG_OPERATION, IPP_TAG_INTEGER,
+		      "notify-sequence-numbers", last_sequence + 1);
+	ippAddBoolean(request, IPP_TAG_OPERATION,
+		      "notify-wait", 0);
+
+	response = cups_notify_do_request(frame, request,
+					  "get notifications");
+	if (response == NULL) {
+		goto out;
+	}
+
+	for (attr = ippFirstAttribute(response);
+	     attr != NULL;
+	     attr = ippNextAttribute(response)) {
+		const char *name = ippGetName(attr);
+		char *printer = NULL;
+		size_t size;
+
+		if ((ippGetGroupTag(attr) != IPP_TAG_EVENT_NOTIFICATION) ||
+		    (name == NULL)) {
+			continue;
+		}
+
+		if (strcmp(name, "notify-sequence-number") == 0) {
+			last_sequence = MAX(last_sequence,
+					    ippGetInteger(attr, 0));
+			continue;
+		}
+
+		if ((strcmp(name, "printer-name") != 0) ||
+		    (ippGetValueTag(attr) != IPP_TAG_NAME)) {
+			continue;
+		}
+
+		if (!pull_utf8_talloc(frame,
+				      &printer,
+				      ippGetString(attr, 0, NULL),
+				      &size)) {
+			goto out;
+		}
+
+		if (strv_find(printers, printer) == NULL) {
+			int ret = strv_add(mem_ctx, &printers, printer);
+			if (ret != 0) {
+				goto out;
+			}
+		}
+	}
+
+	*sequence = last_sequence;
+	*_printers = printers;
+	printers = NULL;
+	ok = true;
+
+ out:
+	TALLOC_FREE(printers);
+
+	if (response)
+		ippDelete(response);
+
+	if (language)
+		cupsLangFree(language);
+
+	TALLOC_FREE(frame);
+	return ok;
+}
+
 /*
  * 'cups_job_delete()' - Delete a job.
  */
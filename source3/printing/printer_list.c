@@ -27,6 +27,7 @@
 #define PL_KEY_PREFIX "PRINTERLIST/PRN/"
 #define PL_KEY_FORMAT PL_KEY_PREFIX"%s"
 #define PL_TIMESTAMP_KEY "PRINTERLIST/GLOBAL/LAST_REFRESH"
+#define PL_NOTIFY_KEY "PRINTERLIST/GLOBAL/LAST_NOTIFY"
 #define PL_DATA_FORMAT "ddPPP"
 #define PL_TSTAMP_FORMAT "dd"
 
@@ -224,7 +225,8 @@ done:
 	return status;
 }
 
-NTSTATUS printer_list_get_last_refresh(time_t *last_refresh)
+static NTSTATUS printer_list_get_timestamp(const char *keystr,
+					   time_t *timestamp)
 {
 	struct db_context *db;
 	TDB_DATA data;
@@ -239,9 +241,10 @@ NTSTATUS printer_list_get_last_refresh(time_t *last_refresh)
 
 	ZERO_STRUCT(data);
 
-	status = dbwrap_fetch_bystring(db, talloc_tos(), PL_TIMESTAMP_KEY, &data);
+	status = dbwrap_fetch_bystring(db, talloc_tos(), keystr, &data);
 	if (!NT_STATUS_IS_OK(status)) {
-		DEBUG(1, ("Failed to fetch record!\n"));
+		DEBUG(NT_STATUS_EQUAL(status, NT_STATUS_NOT_FOUND) ? 10 : 1,
+		      ("Failed to fetch record!\n"));
 		goto done;
 	}
 
@@ -254,14 +257,14 @@ NTSTATUS printer_list_get_last_refresh(time_t *last_refresh)
 		goto done;
 	}
 
-	*last_refresh = (time_t)(((uint64_t)time_h << 32) + time_l);
+	*timestamp = (time_t)(((uint64_t)time_h << 32) + time_l);
 	status = NT_STATUS_OK;
 
 done:
 	return status;
 }
 
-NTSTATUS printer_list_mark_reload(void)
+static NTSTATUS printer_list_set_timestamp(const char *keystr)
 {
 	struct db_context *db;
 	TDB_DATA data;
@@ -291,7 +294,7 @@ NTSTATUS printer_list_mark_reload(void)
 	len = tdb_pack(data.dptr, data.dsize,
 		       PL_TSTAMP_FORMAT, time_h, time_l);
 
-	status = dbwrap_store_bystring(db, PL_TIMESTAMP_KEY,
+	status = dbwrap_store_bystring(db, keystr,
 						data, TDB_REPLACE);
 
 done:
@@ -299,6 +302,26 @@ done:
 	return status;
 }
 
+NTSTATUS printer_list_get_last_refresh(time_t *last_refresh)
+{
+	return printer_list_get_timestamp(PL_TIMESTAMP_KEY, last_refresh);
+}
+
+NTSTATUS printer_list_mark_reload(void)
+{
+	return printer_list_set_timestamp(PL_TIMESTAMP_KEY);
+}
+
+NTSTATUS printer_list_get_last_notify(time_t *last_notify)
+{
+	return printer_list_get_timestamp(PL_NOTIFY_KEY, last_notify);
+}
+
+NTSTATUS printer_list_mark_notify(void)
+{
+	return printer_list_set_timestamp(PL_NOTIFY_KEY);
+}
+
 typedef int (printer_list_trv_fn_t)(struct db_record *, void *);
 
 static NTSTATUS printer_list_traverse(printer_list_trv_fn_t *fn,
@@ -90,6 +90,29 @@ NTSTATUS printer_list_get_last_refresh(time_t *last_refresh);
  */
 NTSTATUS printer_list_mark_reload(void);
 
+/**
+ * @brief Get the time the printer event notifications were last fetched.
+ *
+ * @param[out] last_notify The last notification time in the db.
+ *
+ * @return              NT_STATUS_OK on success, a correspoining NTSTATUS error
+ *                      code on a failure.
+ */
+NTSTATUS printer_list_get_last_notify(time_t *last_notify);
+
+/**
+ * @brief Mark the printer event notifications as delivered.
+ *
+ * The background queue process calls this after every successful fetch
+ * of the event notifications of the print system. As long as this is
+ * recent the print queues in the print databases are kept up to date by
+ * the events and don't need to be refreshed by polling.
+ *
+ * @return              NT_STATUS_OK on success, a correspoining NTSTATUS error
+ *                      code on a failure.
+ */
+NTSTATUS printer_list_mark_notify(void);
+
 /**
  * @brief Cleanup old entries in the database.
  *
@@ -1111,7 +1111,8 @@ static int printjob_comp(print_queue_struct *j1, print_queue_struct *j2)
 
 static void store_queue_struct(struct tdb_print_db *pdb, struct traverse_struct *pts)
 {
-	TDB_DATA data;
+	TDB_DATA data, old_data;
+	TDB_DATA key = string_tdb_data("INFO/linear_queue_array");
 	int max_reported_jobs = lp_max_reported_print_jobs(pts->snum);
 	print_queue_struct *queue = pts->queue;
 	size_t len;
@@ -1162,8 +1163,17 @@ static void store_queue_struct(struct tdb_print_db *pdb, struct traverse_struct
 				queue[i].fs_file);
 	}
 
-	tdb_store(pdb->tdb, string_tdb_data("INFO/linear_queue_array"), data,
-		  TDB_REPLACE);
+	/*
+	 * Most updates don't change the queue, avoid rewriting
+	 * the record in that case.
+	 */
+	old_data = tdb_fetch(pdb->tdb, key);
+	if ((old_data.dptr == NULL) ||
+	    (old_data.dsize != data.dsize) ||
+	    (memcmp(old_data.dptr, data.dptr, data.dsize) != 0)) {
+		tdb_store(pdb->tdb, key, data, TDB_REPLACE);
+	}
+	SAFE_FREE(old_data.dptr);
 	SAFE_FREE(data.dptr);
 	return;
 }
@@ -1197,6 +1207,46 @@ static void check_job_added(const char *sharename, TDB_DATA data, uint32_t jobid
 	}
 }
 
+/****************************************************************************
+ Check whether the print queue of a share is kept up to date by event
+ notifications of the print system, delivered by the background queue
+ process.
+****************************************************************************/
+
+static bool print_queue_events_active(const char *sharename)
+{
+	int snum;
+	int interval;
+	time_t last_notify;
+	NTSTATUS status;
+
+	if (!lp_parm_bool(GLOBAL_SECTION_SNUM,
+			  "cups", "event notifications", false)) {
+		return false;
+	}
+
+	snum = lp_servicenumber(sharename);
+	if ((snum == -1) || (lp_printing(snum) != PRINT_CUPS)) {
+		return false;
+	}
+
+	status = printer_list_get_last_notify(&last_notify);
+	if (!NT_STATUS_IS_OK(status)) {
+		return false;
+	}
+
+	/*
+	 * The background queue process marks successful fetches at
+	 * most every PRINT_NOTIFY_MARK_TIME seconds. If it didn't for
+	 * a while, events may be lost and we go back to polling.
+	 */
+	interval = lp_parm_int(GLOBAL_SECTION_SNUM,
+			       "cups", "event poll interval",
+			       PRINT_NOTIFY_POLL_INTERVAL);
+	return (time_mono(NULL) - last_notify) <=
+		(3 * MAX(interval, PRINT_NOTIFY_MARK_TIME));
+}
+
 /****************************************************************************
  Check if the print queue has been updated recently enough.
 ****************************************************************************/
@@ -1206,11 +1256,23 @@ static bool print_cache_expired(const char *sharename, bool check_pending)
 	fstring key;
 	time_t last_qscan_time, time_now = time(NULL);
 	struct tdb_print_db *pdb = get_print_db_byname(sharename);
+	int cache_time = lp_lpq_cache_time();
 	bool result = False;
 
 	if (!pdb)
 		return False;
 
+	if (print_queue_events_active(sharename)) {
+		/*
+		 * Changes are pushed to us, we only poll as a
+		 * safety net.
+		 */
+		cache_time = MAX(cache_time,
+				 lp_parm_int(GLOBAL_SECTION_SNUM,
+					     "cups", "event cache time",
+					     PRINT_NOTIFY_CACHE_TIME));
+	}
+
 	snprintf(key, sizeof(key), "CACHE/%s", sharename);
 	last_qscan_time = (time_t)tdb_fetch_int32(pdb->tdb, key);
 
@@ -1225,7 +1287,7 @@ static bool print_cache_expired(const char *sharename, bool check_pending)
 	 */
 
 	if (last_qscan_time == ((time_t)-1)
-		|| (time_now - last_qscan_time) >= lp_lpq_cache_time()
+		|| (time_now - last_qscan_time) >= cache_time
 		|| last_qscan_time > (time_now + MAX_CACHE_VALID_TIME))
 	{
 		uint32_t u;
@@ -1237,7 +1299,7 @@ static bool print_cache_expired(const char *sharename, bool check_pending)
 			 sharename,
 			 (uint64_t)last_qscan_time,
 			 (uint64_t)time_now,
-			 lp_lpq_cache_time());
+			 cache_time);
 
 		/* check if another smbd has already sent a message to update the
 		   queue.  Give the pending message one minute to clear and
@@ -1693,6 +1755,55 @@ static void print_queue_update(struct messaging_context *msg_ctx,
 	return;
 }
 
+/****************************************************************************
+ The print system reported a change for a printer, update the queues of
+ all the shares using it. Called in the background queue process.
+****************************************************************************/
+
+void print_queue_event(struct messaging_context *msg_ctx,
+		       const char *printername)
+{
+	const struct loadparm_substitution *lp_sub =
+		loadparm_s3_global_substitution();
+	int n_services = lp_numservices();
+	int snum;
+
+	for (snum = 0; snum < n_services; snum++) {
+		if (!lp_snum_ok(snum) || !lp_printable(snum) ||
+		    (lp_printing(snum) != PRINT_CUPS)) {
+			continue;
+		}
+		if (!strequal(printername,
+			      lp_printername(talloc_tos(), lp_sub, snum))) {
+			continue;
+		}
+
+		DBG_DEBUG("event for printer %s, updating queue [%s]\n",
+			  printername,
+			  lp_const_servicename(snum));
+		print_queue_update(msg_ctx, snum, true);
+	}
+}
+
+/****************************************************************************
+ Events may have been lost, make sure the next client request refreshes
+ the queues fed by event notifications.
+****************************************************************************/
+
+void print_queue_events_reset(void)
+{
+	int n_services = lp_numservices();
+	int snum;
+
+	for (snum = 0; snum < n_services; snum++) {
+		if (!lp_snum_ok(snum) || !lp_printable(snum) ||
+		    (lp_printing(snum) != PRINT_CUPS)) {
+			continue;
+		}
+		print_cache_flush(lp_const_servicename(snum));
+	}
+}
+
 /****************************************************************************
  Create/Update an entry in the print tdb that will allow us to send notify
  updates only to interested smbd's.
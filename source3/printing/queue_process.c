@@ -41,6 +41,7 @@
 #include "util_event.h"
 #include "lib/global_contexts.h"
 #include "lib/util/pidfile.h"
+#include "lib/util/strv.h"
 
 /**
  * @brief Purge stale printers and reload from pre-populated pcap cache.
@@ -160,6 +161,11 @@ struct bq_state {
 	struct idle_event *housekeep;
 	struct tevent_signal *sighup_handler;
 	struct tevent_signal *sigchld_handler;
+	struct tevent_timer *notify_te;
+	int notify_subscription;
+	int notify_sequence;
+	time_t notify_renew;
+	time_t notify_marked;
 };
 
 static bool print_queue_housekeeping(const struct timeval *now, void *pvt)
@@ -201,6 +207,130 @@ static bool printing_subsystem_queue_tasks(struct bq_state *state)
 	return true;
 }
 
+#ifdef HAVE_CUPS
+
+/*
+ * Fetch the job and printer events from CUPS and refresh only the
+ * queues that changed, see print_queue_events_active().
+ */
+
+static bool bq_notify_enabled(void)
+{
+	return lp_parm_bool(GLOBAL_SECTION_SNUM,
+			    "cups", "event notifications", false);
+}
+
+static void bq_notify_poll(struct tevent_context *ev,
+			   struct tevent_timer *te,
+			   struct timeval current_time,
+			   void *private_data);
+
+static void bq_notify_schedule(struct bq_state *state)
+{
+	int interval = lp_parm_int(GLOBAL_SECTION_SNUM,
+				   "cups", "event poll interval",
+				   PRINT_NOTIFY_POLL_INTERVAL);
+
+	TALLOC_FREE(state->notify_te);
+
+	if (!bq_notify_enabled()) {
+		state->notify_subscription = -1;
+		return;
+	}
+
+	state->notify_te = tevent_add_timer(
+		state->ev,
+		state,
+		timeval_current_ofs(MAX(interval, 1), 0),
+		bq_notify_poll,
+		state);
+	if (state->notify_te == NULL) {
+		DBG_WARNING("Could not add notify poll timer\n");
+	}
+}
+
+static void bq_notify_poll(struct tevent_context *ev,
+			   struct tevent_timer *te,
+			   struct timeval current_time,
+			   void *private_data)
+{
+	struct bq_state *state = talloc_get_type_abort(
+		private_data, struct bq_state);
+	int lease = lp_parm_int(GLOBAL_SECTION_SNUM,
+				"cups", "event lease duration",
+				PRINT_NOTIFY_LEASE_DURATION);
+	time_t now = time_mono(NULL);
+	char *printers = NULL;
+	char *printer = NULL;
+	bool ok;
+
+	TALLOC_FREE(state->notify_te);
+
+	if ((state->notify_subscription != -1) &&
+	    (now >= state->notify_renew)) {
+		ok = cups_notify_renew(state->notify_subscription, lease);
+		if (ok) {
+			state->notify_renew = now + lease / 2;
+		} else {
+			state->notify_subscription = -1;
+		}
+	}
+
+	if (state->notify_subscription == -1) {
+		state->notify_subscription = cups_notify_subscribe(lease);
+		if (state->notify_subscription == -1) {
+			goto done;
+		}
+		state->notify_sequence = 0;
+		state->notify_renew = now + lease / 2;
+		state->notify_marked = 0;
+
+		/*
+		 * We don't know what happened before we subscribed,
+		 * the next request for each queue needs to refresh
+		 * it.
+		 */
+		print_queue_events_reset();
+	}
+
+	ok = cups_notify_fetch(state,
+			       state->notify_subscription,
+			       &state->notify_sequence,
+			       &printers);
+	if (!ok) {
+		/* resubscribe on the next run */
+		state->notify_subscription = -1;
+		goto done;
+	}
+
+	while ((printer = strv_next(printers, printer)) != NULL) {
+		print_queue_event(state->msg, printer);
+	}
+	TALLOC_FREE(printers);
+
+	if ((now - state->notify_marked) >= PRINT_NOTIFY_MARK_TIME) {
+		NTSTATUS status = printer_list_mark_notify();
+		if (NT_STATUS_IS_OK(status)) {
+			state->notify_marked = now;
+		} else {
+			DBG_WARNING("printer_list_mark_notify failed: %s\n",
+				    nt_errstr(status));
+		}
+	}
+
+done:
+	bq_notify_schedule(state);
+}
+
+#else /* HAVE_CUPS */
+
+static void bq_notify_schedule(struct bq_state *state)
+{
+	return;
+}
+
+#endif /* HAVE_CUPS */
+
 static void bq_reopen_logs(char *logfile)
 {
 	if (logfile) {
@@ -225,6 +355,7 @@ static void bq_sig_hup_handler(struct tevent_context *ev,
 	pcap_cache_reload(state->ev, state->msg,
 			  reload_pcap_change_notify);
 	printing_subsystem_queue_tasks(state);
+	bq_notify_schedule(state);
 	bq_reopen_logs(NULL);
 }
 
@@ -267,6 +398,7 @@ static void bq_smb_conf_updated(struct messaging_context *msg_ctx,
 	change_to_root_user();
 	pcap_cache_reload(state->ev, msg_ctx, reload_pcap_change_notify);
 	printing_subsystem_queue_tasks(state);
+	bq_notify_schedule(state);
 }
 
 static int bq_state_destructor(struct bq_state *s)
@@ -294,6 +426,7 @@ struct bq_state *register_printing_bq_handlers(
 	}
 	state->ev = messaging_tevent_context(msg_ctx);
 	state->msg = msg_ctx;
+	state->notify_subscription = -1;
 
 	status = messaging_register(
 		msg_ctx, state, MSG_SMB_CONF_UPDATED, bq_smb_conf_updated);
@@ -330,6 +463,8 @@ struct bq_state *register_printing_bq_handlers(
 		goto fail_free_handlers;
 	}
 
+	bq_notify_schedule(state);
+
 	talloc_set_destructor(state, bq_state_destructor);
 
 	return state;
@@ -508,8 +508,184 @@ static void smbprofile_persvc_store(struct profile_stats_persvc *persvc)
 	tdb_store(smbprofile_state.internal.db->tdb, tdb_keyof(persvc), val, 0);
 }
 
+/*
+ * Add stats to the summary record under key, returns true if the
+ * record did not exist before
+ */
+static bool smbprofile_persvc_fold(const char *key,
+				   const struct profile_stats *add)
+{
+	struct tdb_context *tdb = smbprofile_state.internal.db->tdb;
+	TDB_DATA dbkey = string_tdb_data(key);
+	struct profile_stats acc = {};
+	bool created;
+	int ret;
+
+	ret = tdb_chainlock(tdb, dbkey);
+	if (ret != 0) {
+		return false;
+	}
+
+	ret = tdb_parse_record(tdb, dbkey, profile_stats_parser, &acc);
+	created = (ret == -1);
+
+	smbprofile_stats_accumulate(&acc, add);
+	acc.magic = profile_p->magic;
+	acc.summary_record = true;
+	acc.last_update = time(NULL);
+
+	tdb_store(tdb,
+		  dbkey,
+		  (TDB_DATA) {
+			.dptr = (uint8_t *)&acc,
+			.dsize = sizeof(acc)
+		  },
+		  0);
+
+	tdb_chainunlock(tdb, dbkey);
+	return created;
+}
+
+struct smbprofile_persvc_lru_state {
+	TALLOC_CTX *mem_ctx;
+	size_t num_summaries;
+	uint64_t oldest_update;
+	char *oldest_key;
+};
+
+static int smbprofile_persvc_lru_fn(struct tdb_context *tdb,
+				    TDB_DATA key,
+				    TDB_DATA value,
+				    void *private_data)
+{
+	struct smbprofile_persvc_lru_state *state = private_data;
+	const struct profile_stats *stats = NULL;
+
+	if ((key.dsize < 5) || (value.dsize != sizeof(*stats))) {
+		return 0;
+	}
+	stats = (const struct profile_stats *)value.dptr;
+	if (!stats->summary_record || (stats->magic != profile_p->magic)) {
+		return 0;
+	}
+	if (memcmp(key.dptr + key.dsize - 4, ":[*]", 4) == 0) {
+		/* Overflow records don't count */
+		return 0;
+	}
+
+	state->num_summaries += 1;
+
+	if ((state->oldest_key == NULL) ||
+	    (stats->last_update < state->oldest_update)) {
+		TALLOC_FREE(state->oldest_key);
+		state->oldest_key = talloc_strndup(state->mem_ctx,
+						   (const char *)key.dptr,
+						   key.dsize);
+		state->oldest_update = stats->last_update;
+	}
+	return 0;
+}
+
+/*
+ * Retire the least recently updated (share, client) summaries into the
+ * "share:[*]" record of their share, so the share totals stay correct
+ */
+static void smbprofile_persvc_lru_trim(size_t max_summaries)
+{
+	struct tdb_context *tdb = smbprofile_state.internal.db->tdb;
+
+	while (true) {
+		struct smbprofile_persvc_lru_state state = {
+			.mem_ctx = talloc_tos(),
+		};
+		struct profile_stats s = {};
+		TDB_DATA key;
+		char *overflow_key = NULL;
+		char *sep = NULL;
+		int ret;
+
+		tdb_traverse_read(tdb, smbprofile_persvc_lru_fn, &state);
+		if ((state.num_summaries <= max_summaries) ||
+		    (state.oldest_key == NULL)) {
+			TALLOC_FREE(state.oldest_key);
+			return;
+		}
+
+		key = string_tdb_data(state.oldest_key);
+
+		ret = tdb_chainlock(tdb, key);
+		if (ret != 0) {
+			TALLOC_FREE(state.oldest_key);
+			return;
+		}
+		ret = tdb_parse_record(tdb, key, profile_stats_parser, &s);
+		if (ret == 0) {
+			tdb_delete(tdb, key);
+		}
+		tdb_chainunlock(tdb, key);
+
+		sep = strchr(state.oldest_key, ':');
+		if ((ret == 0) && (sep != NULL)) {
+			overflow_key = talloc_asprintf(
+				talloc_tos(),
+				"%.*s:[*]",
+				(int)(sep - state.oldest_key),
+				state.oldest_key);
+		}
+		if (overflow_key != NULL) {
+			smbprofile_persvc_fold(overflow_key, &s);
+		}
+
+		TALLOC_FREE(overflow_key);
+		TALLOC_FREE(state.oldest_key);
+	}
+}
+
+/*
+ * The dbkey is "share:pid.snum[client]", the summary of a share and
+ * client over all processes is kept as "share:[client]"
+ */
+static void smbprofile_persvc_retire(struct profile_stats_persvc *persvc)
+{
+	int max_summaries = lp_smbd_profiling_share_clients();
+	const char *sep = NULL;
+	const char *remote = NULL;
+	char *summary_key = NULL;
+	bool created;
+
+	if (max_summaries <= 0) {
+		return;
+	}
+
+	sep = strchr(persvc->dbkey, ':');
+	if (sep == NULL) {
+		return;
+	}
+	remote = strchr(sep, '[');
+	if (remote == NULL) {
+		return;
+	}
+
+	summary_key = talloc_asprintf(talloc_tos(),
+				      "%.*s:%s",
+				      (int)(sep - persvc->dbkey),
+				      persvc->dbkey,
+				      remote);
+	if (summary_key == NULL) {
+		return;
+	}
+
+	created = smbprofile_persvc_fold(summary_key, &persvc->stats);
+	TALLOC_FREE(summary_key);
+
+	if (created) {
+		smbprofile_persvc_lru_trim(max_summaries);
+	}
+}
+
 static void smbprofile_persvc_clear(struct profile_stats_persvc *persvc)
 {
+	smbprofile_persvc_retire(persvc);
 	tdb_delete(smbprofile_state.internal.db->tdb, tdb_keyof(persvc));
 	smbprofile_persvc_delete(persvc);
 }
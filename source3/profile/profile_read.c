@@ -20,12 +20,66 @@
 
 #include "replace.h"
 #include <tdb.h>
+#include <talloc.h>
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
 #include "lib/crypto/gnutls_helpers.h"
 #include "lib/util/byteorder.h"
 #include "source3/include/smbprofile.h"
 
+static void smbprofile_hist_accumulate(struct smbprofile_stats_hist *acc,
+				       const struct smbprofile_stats_hist *add)
+{
+	size_t i;
+
+	for (i = 0; i < SMBPROFILE_HIST_BUCKETS; i++) {
+		acc->buckets[i] += add->buckets[i];
+	}
+}
+
+/*
+ * Upper limit in microseconds of histogram bucket i, UINT64_MAX for
+ * the last one
+ */
+uint64_t smbprofile_hist_bucket_limit(size_t i)
+{
+	if (i >= SMBPROFILE_HIST_BUCKETS - 1) {
+		return UINT64_MAX;
+	}
+	return UINT64_C(16) << i;
+}
+
+/*
+ * The upper limit of the bucket that holds the given percentile
+ * (in 1/1000), 0 for an empty histogram
+ */
+uint64_t smbprofile_hist_percentile(const struct smbprofile_stats_hist *h,
+				    unsigned permille)
+{
+	uint64_t total = 0;
+	uint64_t sum = 0;
+	uint64_t rank;
+	size_t i;
+
+	for (i = 0; i < SMBPROFILE_HIST_BUCKETS; i++) {
+		total += h->buckets[i];
+	}
+	if (total == 0) {
+		return 0;
+	}
+
+	rank = (total * MIN(permille, 1000) + 999) / 1000;
+	rank = MAX(rank, 1);
+
+	for (i = 0; i < SMBPROFILE_HIST_BUCKETS; i++) {
+		sum += h->buckets[i];
+		if (sum >= rank) {
+			break;
+		}
+	}
+	return smbprofile_hist_bucket_limit(i);
+}
+
 void smbprofile_stats_accumulate(struct profile_stats *acc,
 				 const struct profile_stats *add)
 {
@@ -47,6 +101,9 @@ void smbprofile_stats_accumulate(struct profile_stats *acc,
 			add->values.name##_stats.count; \
 		acc->values.name##_stats.time +=        \
 			add->values.name##_stats.time;  \
+		smbprofile_hist_accumulate(             \
+			&acc->values.name##_stats.hist, \
+			&add->values.name##_stats.hist); \
 	} while (0);
 #define SMBPROFILE_STATS_BYTES(name)                    \
 	do {                                            \
@@ -58,6 +115,9 @@ void smbprofile_stats_accumulate(struct profile_stats *acc,
 			add->values.name##_stats.idle;  \
 		acc->values.name##_stats.bytes +=       \
 			add->values.name##_stats.bytes; \
+		smbprofile_hist_accumulate(             \
+			&acc->values.name##_stats.hist, \
+			&add->values.name##_stats.hist); \
 	} while (0);
 #define SMBPROFILE_STATS_IOBYTES(name)                     \
 	do {                                               \
@@ -67,26 +127,9 @@ void smbprofile_stats_accumulate(struct profile_stats *acc,
 			add->values.name##_stats.failed_count; \
 		acc->values.name##_stats.time +=           \
 			add->values.name##_stats.time;     \
-		acc->values.name##_stats.buckets[0] +=     \
-			add->values.name##_stats.buckets[0]; \
-		acc->values.name##_stats.buckets[1] +=     \
-			add->values.name##_stats.buckets[1]; \
-		acc->values.name##_stats.buckets[2] +=     \
-			add->values.name##_stats.buckets[2]; \
-		acc->values.name##_stats.buckets[3] +=     \
-			add->values.name##_stats.buckets[3]; \
-		acc->values.name##_stats.buckets[4] +=     \
-			add->values.name##_stats.buckets[4]; \
-		acc->values.name##_stats.buckets[5] +=     \
-			add->values.name##_stats.buckets[5]; \
-		acc->values.name##_stats.buckets[6] +=     \
-			add->values.name##_stats.buckets[6]; \
-		acc->values.name##_stats.buckets[7] +=     \
-			add->values.name##_stats.buckets[7]; \
-		acc->values.name##_stats.buckets[8] +=     \
-			add->values.name##_stats.buckets[8]; \
-		acc->values.name##_stats.buckets[9] +=     \
-			add->values.name##_stats.buckets[9]; \
+		smbprofile_hist_accumulate(                \
+			&acc->values.name##_stats.hist,    \
+			&add->values.name##_stats.hist);   \
 		acc->values.name##_stats.idle +=           \
 			add->values.name##_stats.idle;     \
 		acc->values.name##_stats.inbytes +=        \
@@ -143,6 +186,7 @@ int smbprofile_magic(const struct profile_stats *stats, uint64_t *_magic)
 	do {                              \
 		__UPDATE(#name "+count"); \
 		__UPDATE(#name "+time");  \
+		__UPDATE(#name "+hist");  \
 	} while (0);
 #define SMBPROFILE_STATS_BYTES(name)      \
 	do {                              \
@@ -150,6 +194,7 @@ int smbprofile_magic(const struct profile_stats *stats, uint64_t *_magic)
 		__UPDATE(#name "+time");  \
 		__UPDATE(#name "+idle");  \
 		__UPDATE(#name "+bytes"); \
+		__UPDATE(#name "+hist");  \
 	} while (0);
 #define SMBPROFILE_STATS_IOBYTES(name)       \
 	do {                                 \
@@ -158,6 +203,7 @@ int smbprofile_magic(const struct profile_stats *stats, uint64_t *_magic)
 		__UPDATE(#name "+idle");     \
 		__UPDATE(#name "+inbytes");  \
 		__UPDATE(#name "+outbytes"); \
+		__UPDATE(#name "+hist");     \
 	} while (0);
 #define SMBPROFILE_STATS_SECTION_END
 #define SMBPROFILE_STATS_END
@@ -257,6 +303,7 @@ static int smbprofile_persvc_collect_fn(struct tdb_context *tdb,
 
 	const struct profile_stats *stats = NULL;
 	struct smbprofile_persvc_collector *col = NULL;
+	char *keystr = NULL;
 
 	if (key.dsize < 5) {
 		return 0;
@@ -269,7 +316,14 @@ static int smbprofile_persvc_collect_fn(struct tdb_context *tdb,
 	col = (struct smbprofile_persvc_collector *)private_data;
 	stats = (const struct profile_stats *)(value.dptr);
 
-	col->ret = col->cb((const char *)key.dptr, stats, col->userp);
+	/* Keys are stored without the terminating NUL */
+	keystr = talloc_strndup(NULL, (const char *)key.dptr, key.dsize);
+	if (keystr == NULL) {
+		return 0;
+	}
+
+	col->ret = col->cb(keystr, stats, col->userp);
+	TALLOC_FREE(keystr);
 	return (col->ret == 0) ? 0 : -1;
 }
 
@@ -33,6 +33,7 @@
 #include "util_tdb.h"
 #include "dbwrap/dbwrap.h"
 #include "dbwrap/dbwrap_open.h"
+#include "lib/util/memcache.h"
 #include "../libcli/security/secdesc.h"
 
 #undef DBGC_CLASS
@@ -66,6 +67,117 @@ struct regdb_trans_ctx {
 	void *private_data;
 };
 
+/*
+ * In-memory index of the subkey lists in registry.tdb. Entries are
+ * keyed by the normalized key path and are only valid for the tdb
+ * sequence number they were read with: any change to the registry,
+ * also by other processes, flushes the whole index. Within
+ * transactions the index is not used at all, the records might be
+ * changed without the seqnum being visible yet.
+ */
+
+#define REGDB_INDEX_SIZE (4 * 1024 * 1024)
+
+struct regdb_index_entry {
+	uint32_t num_subkeys;
+	char **subkeys;
+};
+
+static struct memcache *regdb_index;
+static bool regdb_index_disabled;
+static int regdb_index_seqnum;
+static int regdb_transactions;
+
+static struct memcache *regdb_index_get(struct db_context *db)
+{
+	int seqnum;
+
+	if (db != regdb || regdb_transactions > 0 || regdb_index_disabled) {
+		return NULL;
+	}
+
+	seqnum = dbwrap_get_seqnum(db);
+
+	if (regdb_index == NULL) {
+		unsigned long long size;
+
+		size = lp_parm_ulonglong(GLOBAL_SECTION_SNUM,
+					 "registry",
+					 "index size",
+					 REGDB_INDEX_SIZE);
+		if (size == 0) {
+			regdb_index_disabled = true;
+			return NULL;
+		}
+		regdb_index = memcache_init(regdb, size);
+		if (regdb_index == NULL) {
+			return NULL;
+		}
+		regdb_index_seqnum = seqnum;
+	}
+
+	if (seqnum != regdb_index_seqnum) {
+		memcache_flush(regdb_index, REGDB_INDEX_CACHE_TALLOC);
+		regdb_index_seqnum = seqnum;
+	}
+
+	return regdb_index;
+}
+
+static struct regdb_index_entry *regdb_index_lookup(struct db_context *db,
+						    const char *path)
+{
+	struct memcache *index = regdb_index_get(db);
+
+	if (index == NULL) {
+		return NULL;
+	}
+
+	return memcache_lookup_talloc(index,
+				      REGDB_INDEX_CACHE_TALLOC,
+				      data_blob_string_const(path));
+}
+
+static void regdb_index_store(struct db_context *db,
+			      const char *path,
+			      int seqnum,
+			      struct regsubkey_ctr *ctr)
+{
+	struct memcache *index = regdb_index_get(db);
+	struct regdb_index_entry *entry = NULL;
+	uint32_t i;
+
+	if (index == NULL || seqnum != regdb_index_seqnum) {
+		return;
+	}
+
+	entry = talloc_zero(NULL, struct regdb_index_entry);
+	if (entry == NULL) {
+		return;
+	}
+
+	entry->num_subkeys = regsubkey_ctr_numkeys(ctr);
+	entry->subkeys = talloc_array(entry, char *, entry->num_subkeys);
+	if (entry->subkeys == NULL) {
+		TALLOC_FREE(entry);
+		return;
+	}
+
+	for (i = 0; i < entry->num_subkeys; i++) {
+		entry->subkeys[i] = talloc_strdup(
+			entry->subkeys, regsubkey_ctr_specific_key(ctr, i));
+		if (entry->subkeys[i] == NULL) {
+			TALLOC_FREE(entry);
+			return;
+		}
+	}
+
+	memcache_add_talloc(index,
+			    REGDB_INDEX_CACHE_TALLOC,
+			    data_blob_string_const(path),
+			    &entry);
+}
+
 static NTSTATUS regdb_trans_do_action(struct db_context *db, void *private_data)
 {
 	NTSTATUS status;
@@ -104,7 +216,9 @@ static WERROR regdb_trans_do(struct db_context *db,
 	ctx.action = action;
 	ctx.private_data = private_data;
 
+	regdb_transactions++;
 	status = dbwrap_trans_do(db, regdb_trans_do_action, &ctx);
+	regdb_transactions--;
 
 	return ntstatus_to_werror(status);
 }
@@ -725,6 +839,7 @@ WERROR regdb_init(void)
 	WERROR werr;
 	NTSTATUS status;
 	char *db_path;
+	int ret;
 
 	if (regdb) {
 		DEBUG(10, ("regdb_init: incrementing refcount (%d->%d)\n",
@@ -817,6 +932,7 @@ WERROR regdb_init(void)
 	if (dbwrap_transaction_start(regdb) != 0) {
 		return WERR_REGISTRY_IO_FAILED;
 	}
+	regdb_transactions++;
 
 	if (vers_id == REGDB_VERSION_V1) {
 		DEBUG(10, ("regdb_init: upgrading registry from version %d "
@@ -825,6 +941,7 @@ WERROR regdb_init(void)
 		werr = regdb_upgrade_v1_to_v2(regdb);
 		if (!W_ERROR_IS_OK(werr)) {
 			dbwrap_transaction_cancel(regdb);
+			regdb_transactions--;
 			return werr;
 		}
 
@@ -838,6 +955,7 @@ WERROR regdb_init(void)
 		werr = regdb_upgrade_v2_to_v3(regdb);
 		if (!W_ERROR_IS_OK(werr)) {
 			dbwrap_transaction_cancel(regdb);
+			regdb_transactions--;
 			return werr;
 		}
 
@@ -846,7 +964,9 @@ WERROR regdb_init(void)
 
 	/* future upgrade code should go here */
 
-	if (dbwrap_transaction_commit(regdb) != 0) {
+	ret = dbwrap_transaction_commit(regdb);
+	regdb_transactions--;
+	if (ret != 0) {
 		return WERR_REGISTRY_IO_FAILED;
 	}
 
@@ -920,26 +1040,42 @@ int regdb_close( void )
 
 	SMB_ASSERT( regdb_refcount >= 0 );
 
+	/* the index is a talloc child of regdb */
+	regdb_index = NULL;
+	regdb_transactions = 0;
 	TALLOC_FREE(regdb);
 	return 0;
 }
 
 WERROR regdb_transaction_start(void)
 {
-	return (dbwrap_transaction_start(regdb) == 0) ?
-		WERR_OK : WERR_REGISTRY_IO_FAILED;
+	if (dbwrap_transaction_start(regdb) != 0) {
+		return WERR_REGISTRY_IO_FAILED;
+	}
+	regdb_transactions++;
+	return WERR_OK;
 }
 
 WERROR regdb_transaction_commit(void)
 {
-	return (dbwrap_transaction_commit(regdb) == 0) ?
-		WERR_OK : WERR_REGISTRY_IO_FAILED;
+	int ret;
+
+	ret = dbwrap_transaction_commit(regdb);
+	if (regdb_transactions > 0) {
+		regdb_transactions--;
+	}
+	return (ret == 0) ? WERR_OK : WERR_REGISTRY_IO_FAILED;
 }
 
 WERROR regdb_transaction_cancel(void)
 {
-	return (dbwrap_transaction_cancel(regdb) == 0) ?
-		WERR_OK : WERR_REGISTRY_IO_FAILED;
+	int ret;
+
+	ret = dbwrap_transaction_cancel(regdb);
+	if (regdb_transactions > 0) {
+		regdb_transactions--;
+	}
+	return (ret == 0) ? WERR_OK : WERR_REGISTRY_IO_FAILED;
 }
 
 /***********************************************************************
@@ -1658,6 +1794,11 @@ static bool regdb_key_exists(struct db_context *db, const char *key)
 		goto done;
 	}
 
+	if (regdb_index_lookup(db, path) != NULL) {
+		ret = true;
+		goto done;
+	}
+
 	value = regdb_fetch_key_internal(db, mem_ctx, path);
 	if (value.dptr == NULL) {
 		goto done;
@@ -1744,9 +1885,34 @@ static WERROR regdb_fetch_keys_internal(struct db_context *db, const char *key,
 	TALLOC_CTX *frame = talloc_stackframe();
 	TDB_DATA value;
 	int seqnum[2], count;
+	struct regdb_index_entry *entry = NULL;
+	char *path = NULL;
 
 	DEBUG(11,("regdb_fetch_keys: Enter key => [%s]\n", key ? key : "NULL"));
 
+	if (key != NULL) {
+		path = normalize_reg_path(frame, key);
+	}
+	if (path != NULL) {
+		entry = regdb_index_lookup(db, path);
+	}
+	if (entry != NULL) {
+		werr = regsubkey_ctr_reinit(ctr);
+		W_ERROR_NOT_OK_GOTO_DONE(werr);
+
+		werr = regsubkey_ctr_set_seqnum(ctr, regdb_index_seqnum);
+		W_ERROR_NOT_OK_GOTO_DONE(werr);
+
+		for (i = 0; i < entry->num_subkeys; i++) {
+			werr = regsubkey_ctr_addkey(ctr, entry->subkeys[i]);
+			W_ERROR_NOT_OK_GOTO_DONE(werr);
+		}
+
+		DEBUG(11,("regdb_fetch_keys: Exit [%u] items from index\n",
+			  (unsigned int)entry->num_subkeys));
+		goto done;
+	}
+
 	if (!regdb_key_exists(db, key)) {
 		DEBUG(10, ("key [%s] not found\n", key));
 		werr = WERR_NOT_FOUND;
@@ -1782,7 +1948,7 @@ static WERROR regdb_fetch_keys_internal(struct db_context *db, const char *key,
 	if (value.dsize == 0 || value.dptr == NULL) {
 		DEBUG(10, ("regdb_fetch_keys: no subkeys found for key [%s]\n",
 			   key));
-		goto done;
+		goto index;
 	}
 
 	buf = value.dptr;
@@ -1822,6 +1988,11 @@ static WERROR regdb_fetch_keys_internal(struct db_context *db, const char *key,
 
 	DEBUG(11,("regdb_fetch_keys: Exit [%d] items\n", num_items));
 
+index:
+	if (path != NULL) {
+		regdb_index_store(db, path, seqnum[0], ctr);
+	}
+
 done:
 	TALLOC_FREE(frame);
 	return werr;
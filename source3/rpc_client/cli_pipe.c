@@ -174,6 +174,14 @@ struct rpc_client_connection {
 
 	uint32_t next_auth_context_id;
 	uint16_t next_pres_context_id;
+
+	/*
+	 * Requests on one connection are processed one at a time,
+	 * replies are matched by call_id in rpc_api_pipe. This lets
+	 * callers use the async binding handle interface without
+	 * coordinating among themselves.
+	 */
+	struct tevent_queue *call_queue;
 };
 
 static NTSTATUS rpc_client_connection_create(TALLOC_CTX *mem_ctx,
@@ -193,6 +201,12 @@ static NTSTATUS rpc_client_connection_create(TALLOC_CTX *mem_ctx,
 	conn->features.max_recv_frag = max_frag;
 	conn->features.client_hdr_signing = client_hdr_signing;
 
+	conn->call_queue = tevent_queue_create(conn, "rpc_client_connection");
+	if (conn->call_queue == NULL) {
+		TALLOC_FREE(conn);
+		return NT_STATUS_NO_MEMORY;
+	}
+
 	*pconn = conn;
 	return NT_STATUS_OK;
 }
@@ -1469,6 +1483,8 @@ struct rpc_api_pipe_req_state {
 	DATA_BLOB reply_pdu;
 };
 
+static void rpc_api_pipe_req_trigger(struct tevent_req *req,
+				     void *private_data);
 static void rpc_api_pipe_req_write_done(struct tevent_req *subreq);
 static void rpc_api_pipe_req_done(struct tevent_req *subreq);
 static NTSTATUS prepare_verification_trailer(struct rpc_api_pipe_req_state *state);
@@ -1482,10 +1498,9 @@ static struct tevent_req *rpc_api_pipe_req_send(TALLOC_CTX *mem_ctx,
 					 const struct GUID *object_uuid,
 					 const DATA_BLOB *req_data)
 {
-	struct tevent_req *req, *subreq;
+	struct tevent_req *req;
 	struct rpc_api_pipe_req_state *state;
-	NTSTATUS status;
-	bool is_last_frag;
+	struct tevent_queue_entry *e = NULL;
 
 	req = tevent_req_create(mem_ctx, &state,
 				struct rpc_api_pipe_req_state);
@@ -1497,7 +1512,6 @@ static struct tevent_req *rpc_api_pipe_req_send(TALLOC_CTX *mem_ctx,
 	state->op_num = op_num;
 	state->object_uuid = object_uuid;
 	state->req_data = req_data;
-	state->call_id = ++cli->assoc->next_call_id;
 
 	if (cli->conn->features.max_xmit_frag < DCERPC_REQUEST_LENGTH
 					+ RPC_MAX_SIGN_SIZE) {
@@ -1506,36 +1520,62 @@ static struct tevent_req *rpc_api_pipe_req_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
+	/*
+	 * The entry is removed from the queue once req is finished,
+	 * that is when the response was received or the call failed.
+	 */
+	e = tevent_queue_add_optimize_empty(cli->conn->call_queue, ev, req,
+					    rpc_api_pipe_req_trigger, NULL);
+	if (tevent_req_nomem(e, req)) {
+		return tevent_req_post(req, ev);
+	}
+	if (!tevent_req_is_in_progress(req)) {
+		return tevent_req_post(req, ev);
+	}
+	return req;
+}
+
+static void rpc_api_pipe_req_trigger(struct tevent_req *req,
+				     void *private_data)
+{
+	struct rpc_api_pipe_req_state *state = tevent_req_data(
+		req, struct rpc_api_pipe_req_state);
+	struct tevent_req *subreq = NULL;
+	NTSTATUS status;
+	bool is_last_frag;
+
+	state->call_id = ++state->cli->assoc->next_call_id;
+
 	status = prepare_verification_trailer(state);
 	if (tevent_req_nterror(req, status)) {
-		return tevent_req_post(req, ev);
+		return;
 	}
 
 	status = prepare_next_frag(state, &is_last_frag);
 	if (tevent_req_nterror(req, status)) {
-		return tevent_req_post(req, ev);
+		return;
 	}
 
 	if (is_last_frag) {
-		subreq = rpc_api_pipe_send(state, ev, state->cli,
+		subreq = rpc_api_pipe_send(state, state->ev, state->cli,
 					   &state->rpc_out,
 					   DCERPC_PKT_RESPONSE,
 					   state->call_id);
 		if (tevent_req_nomem(subreq, req)) {
-			return tevent_req_post(req, ev);
+			return;
 		}
 		tevent_req_set_callback(subreq, rpc_api_pipe_req_done, req);
 	} else {
-		subreq = rpc_write_send(state, ev, cli->conn->transport,
+		subreq = rpc_write_send(state, state->ev,
+					state->cli->conn->transport,
 					state->rpc_out.data,
 					state->rpc_out.length);
 		if (tevent_req_nomem(subreq, req)) {
-			return tevent_req_post(req, ev);
+			return;
 		}
 		tevent_req_set_callback(subreq, rpc_api_pipe_req_write_done,
 					req);
 	}
-	return req;
 }
 
 static NTSTATUS prepare_verification_trailer(struct rpc_api_pipe_req_state *state)
@@ -477,7 +477,7 @@ static int ino_path_map_destr_cb(struct sl_inode_path_map *entry)
 static bool inode_map_add(struct sl_query *slq,
 			  uint64_t ino,
 			  const char *path,
-			  struct stat_ex *st)
+			  const struct stat_ex *st)
 {
 	NTSTATUS status;
 	struct sl_inode_path_map *entry;
@@ -545,38 +545,16 @@ static bool inode_map_add(struct sl_query *slq,
 	return true;
 }
 
-bool mds_add_result(struct sl_query *slq, const char *path)
+/*
+ * Stat path and check the pipe user has read access. Must be called
+ * as the authenticated pipe user.
+ */
+static bool mds_check_result(struct sl_query *slq,
+			     const char *path,
+			     struct stat_ex *sb)
 {
 	struct smb_filename *smb_fname = NULL;
-	const char *relative = NULL;
-	char *fake_path = NULL;
-	struct stat_ex sb;
-	uint64_t ino64;
-	int result;
 	NTSTATUS status;
-	bool sub;
-	bool ok;
-
-	/*
-	 * We're in a tevent callback which means in the case of
-	 * running as external RPC service we're running as root and
-	 * not as the user.
-	 */
-	if (!become_authenticated_pipe_user(slq->mds_ctx->pipe_session_info)) {
-		DBG_ERR("can't become authenticated user: %d\n",
-			slq->mds_ctx->uid);
-		smb_panic("can't become authenticated user");
-	}
-
-	if (geteuid() != slq->mds_ctx->uid) {
-		DBG_ERR("uid mismatch: %d/%d\n", geteuid(), slq->mds_ctx->uid);
-		smb_panic("uid mismatch");
-	}
-
-	/*
-	 * We've changed identity to the authenticated pipe user, so
-	 * any function exit below must ensure we switch back
-	 */
 
 	status = synthetic_pathref(talloc_tos(),
 				   slq->mds_ctx->conn->cwd_fsp,
@@ -590,28 +568,59 @@ bool mds_add_result(struct sl_query *slq, const char *path)
 		DBG_DEBUG("synthetic_pathref [%s]: %s\n",
 			  smb_fname_str_dbg(smb_fname),
 			  nt_errstr(status));
-		unbecome_authenticated_pipe_user();
-		return true;
+		return false;
 	}
 
 	fdos_mode(smb_fname->fsp);
 
-	sb = smb_fname->fsp->fsp_name->st;
+	*sb = smb_fname->fsp->fsp_name->st;
 
 	status = smbd_check_access_rights_fsp(slq->mds_ctx->conn->cwd_fsp,
 					      smb_fname->fsp,
 					      false,
 					      FILE_READ_DATA);
-	unbecome_authenticated_pipe_user();
+	TALLOC_FREE(smb_fname);
 	if (!NT_STATUS_IS_OK(status)) {
-		TALLOC_FREE(smb_fname);
-		return true;
+		return false;
 	}
 
-	/* Done with smb_fname now. */
-	TALLOC_FREE(smb_fname);
+	return true;
+}
+
+static void mds_become_pipe_user(struct sl_query *slq)
+{
+	/*
+	 * We're in a tevent callback which means in the case of
+	 * running as external RPC service we're running as root and
+	 * not as the user.
+	 */
+	if (!become_authenticated_pipe_user(slq->mds_ctx->pipe_session_info)) {
+		DBG_ERR("can't become authenticated user: %d\n",
+			slq->mds_ctx->uid);
+		smb_panic("can't become authenticated user");
+	}
+
+	if (geteuid() != slq->mds_ctx->uid) {
+		DBG_ERR("uid mismatch: %d/%d\n", geteuid(), slq->mds_ctx->uid);
+		smb_panic("uid mismatch");
+	}
+}
+
+/*
+ * Add an accessible result to the result set
+ */
+static bool mds_add_checked_result(struct sl_query *slq,
+				   const char *path,
+				   const struct stat_ex *sb)
+{
+	const char *relative = NULL;
+	char *fake_path = NULL;
+	uint64_t ino64;
+	int result;
+	bool sub;
+	bool ok;
 
-	ino64 = SMB_VFS_FS_FILE_ID(slq->mds_ctx->conn, &sb);
+	ino64 = SMB_VFS_FS_FILE_ID(slq->mds_ctx->conn, sb);
 
 	if (slq->cnids) {
 		bool found;
@@ -668,7 +677,7 @@ bool mds_add_result(struct sl_query *slq, const char *path)
 			  slq->reqinfo,
 			  slq->query_results->fm_array,
 			  fake_path,
-			  &sb);
+			  sb);
 	if (!ok) {
 		DBG_ERR("add_filemeta error\n");
 		TALLOC_FREE(fake_path);
@@ -676,7 +685,7 @@ bool mds_add_result(struct sl_query *slq, const char *path)
 		return false;
 	}
 
-	ok = inode_map_add(slq, ino64, fake_path, &sb);
+	ok = inode_map_add(slq, ino64, fake_path, sb);
 	TALLOC_FREE(fake_path);
 	if (!ok) {
 		DEBUG(1, ("inode_map_add error\n"));
@@ -688,6 +697,72 @@ bool mds_add_result(struct sl_query *slq, const char *path)
 	return true;
 }
 
+bool mds_add_result(struct sl_query *slq, const char *path)
+{
+	struct stat_ex sb;
+	bool ok;
+
+	mds_become_pipe_user(slq);
+	ok = mds_check_result(slq, path, &sb);
+	unbecome_authenticated_pipe_user();
+	if (!ok) {
+		return true;
+	}
+
+	return mds_add_checked_result(slq, path, &sb);
+}
+
+/*
+ * Add a batch of results, switching to the pipe user only once for
+ * the whole batch instead of once per path.
+ */
+bool mds_add_results(struct sl_query *slq,
+		     const char **paths,
+		     size_t num_paths)
+{
+	struct stat_ex *sbs = NULL;
+	bool *accessible = NULL;
+	size_t i;
+	bool ok = true;
+
+	if (num_paths == 0) {
+		return true;
+	}
+
+	sbs = talloc_array(talloc_tos(), struct stat_ex, num_paths);
+	if (sbs == NULL) {
+		slq->state = SLQ_STATE_ERROR;
+		return false;
+	}
+	accessible = talloc_zero_array(sbs, bool, num_paths);
+	if (accessible == NULL) {
+		TALLOC_FREE(sbs);
+		slq->state = SLQ_STATE_ERROR;
+		return false;
+	}
+
+	mds_become_pipe_user(slq);
+	for (i = 0; i < num_paths; i++) {
+		accessible[i] = mds_check_result(slq, paths[i], &sbs[i]);
+	}
+	unbecome_authenticated_pipe_user();
+
+	for (i = 0; i < num_paths; i++) {
+		if (!accessible[i]) {
+			continue;
+		}
+		ok = mds_add_checked_result(slq, paths[i], &sbs[i]);
+		if (!ok) {
+			DBG_ERR("error adding result for path: %s\n",
+				paths[i]);
+			break;
+		}
+	}
+
+	TALLOC_FREE(sbs);
+	return ok;
+}
+
 /***********************************************************
  * Spotlight RPC functions
  ***********************************************************/
@@ -164,5 +164,8 @@ extern bool mds_dispatch(struct mds_ctx *mds_ctx,
 			 struct mdssvc_blob *response_blob,
 			 size_t max_fragment_size);
 bool mds_add_result(struct sl_query *slq, const char *path);
+bool mds_add_results(struct sl_query *slq,
+		     const char **paths,
+		     size_t num_paths);
 
 #endif /* _MDSSVC_H */
@@ -30,6 +30,8 @@
 #include "mdssvc_es.h"
 #include "rpc_server/mdssvc/es_parser.tab.h"
 #include "lib/param/param.h"
+#include "lib/util/memcache.h"
+#include "lib/util/strv.h"
 
 #include <jansson.h>
 
@@ -51,12 +53,16 @@
 #define MDSSVC_ELASTIC_SOURCES \
 	"\"path.real\""
 
+#define MDSSVC_ES_RESULT_CACHE_SIZE (16 * 1024 * 1024)
+#define MDSSVC_ES_RESULT_CACHE_TTL 30
+
 static bool mdssvc_es_init(struct mdssvc_ctx *mdssvc_ctx)
 {
 	struct mdssvc_es_ctx *mdssvc_es_ctx = NULL;
 	json_error_t json_error;
 	char *default_path = NULL;
 	const char *path = NULL;
+	unsigned long long cache_size;
 
 	mdssvc_es_ctx = talloc_zero(mdssvc_ctx, struct mdssvc_es_ctx);
 	if (mdssvc_es_ctx == NULL) {
@@ -97,6 +103,20 @@ static bool mdssvc_es_init(struct mdssvc_ctx *mdssvc_ctx)
 	}
 	TALLOC_FREE(default_path);
 
+	cache_size = lp_parm_ulonglong(GLOBAL_SECTION_SNUM,
+				       "elasticsearch",
+				       "result cache size",
+				       MDSSVC_ES_RESULT_CACHE_SIZE);
+	if (cache_size != 0) {
+		mdssvc_es_ctx->results_cache = memcache_init(mdssvc_es_ctx,
+							     cache_size);
+		if (mdssvc_es_ctx->results_cache == NULL) {
+			json_decref(mdssvc_es_ctx->mappings);
+			TALLOC_FREE(mdssvc_es_ctx);
+			return false;
+		}
+	}
+
 	mdssvc_ctx->backend_private = mdssvc_es_ctx;
 	return true;
 }
@@ -384,6 +404,170 @@ static struct tevent_req *mds_es_search_send(TALLOC_CTX *mem_ctx,
 static int mds_es_search_recv(struct tevent_req *req);
 static void mds_es_search_done(struct tevent_req *subreq);
 
+/*
+ * The results cache stores the raw paths returned by Elasticsearch, so
+ * access checks are still done for every path whenever results are
+ * served from the cache.
+ */
+struct mds_es_cache_hdr {
+	time_t expires;
+};
+
+static DATA_BLOB mds_es_cache_key(TALLOC_CTX *mem_ctx,
+				  struct sl_query *slq)
+{
+	char *key = NULL;
+
+	key = talloc_asprintf(mem_ctx,
+			      "%d:%u:%s:%s",
+			      slq->mds_ctx->snum,
+			      (unsigned int)slq->mds_ctx->uid,
+			      slq->path_scope,
+			      slq->query_string);
+	if (key == NULL) {
+		return data_blob_null;
+	}
+	return data_blob_const(key, strlen(key));
+}
+
+static bool mds_es_cache_lookup(struct sl_es_search *s)
+{
+	struct memcache *cache = s->mds_es_ctx->mdssvc_es_ctx->results_cache;
+	struct mds_es_cache_hdr hdr;
+	DATA_BLOB key;
+	DATA_BLOB value;
+	size_t len;
+	bool ok;
+
+	if (cache == NULL || s->cache_ttl <= 0) {
+		return false;
+	}
+
+	key = mds_es_cache_key(talloc_tos(), s->slq);
+	if (key.data == NULL) {
+		return false;
+	}
+
+	ok = memcache_lookup(cache, MDSSVC_ES_RESULTS_CACHE, key, &value);
+	if (!ok) {
+		data_blob_free(&key);
+		return false;
+	}
+	if (value.length < sizeof(hdr)) {
+		memcache_delete(cache, MDSSVC_ES_RESULTS_CACHE, key);
+		data_blob_free(&key);
+		return false;
+	}
+	memcpy(&hdr, value.data, sizeof(hdr));
+
+	len = value.length - sizeof(hdr);
+	if (hdr.expires <= time(NULL) ||
+	    (len > 0 && value.data[value.length - 1] != '\0'))
+	{
+		memcache_delete(cache, MDSSVC_ES_RESULTS_CACHE, key);
+		data_blob_free(&key);
+		return false;
+	}
+	data_blob_free(&key);
+
+	if (len > 0) {
+		s->cached = talloc_memdup(s, value.data + sizeof(hdr), len);
+		if (s->cached == NULL) {
+			return false;
+		}
+	}
+
+	s->from_cache = true;
+	s->cached_next = strv_next(s->cached, NULL);
+	s->total = strv_count(s->cached);
+	if (s->max == 0 || s->max > s->total) {
+		s->max = s->total;
+	}
+
+	DBG_DEBUG("Serving %zu results from cache\n", s->total);
+	return true;
+}
+
+static void mds_es_cache_store(struct sl_es_search *s)
+{
+	struct memcache *cache = s->mds_es_ctx->mdssvc_es_ctx->results_cache;
+	struct mds_es_cache_hdr hdr;
+	DATA_BLOB key;
+	DATA_BLOB value;
+	size_t len;
+
+	if (cache == NULL || s->cache_ttl <= 0 || s->from_cache) {
+		return;
+	}
+
+	key = mds_es_cache_key(talloc_tos(), s->slq);
+	if (key.data == NULL) {
+		return;
+	}
+
+	len = talloc_array_length(s->hits);
+	value = data_blob_talloc(talloc_tos(), NULL, sizeof(hdr) + len);
+	if (value.data == NULL) {
+		data_blob_free(&key);
+		return;
+	}
+
+	hdr = (struct mds_es_cache_hdr) {
+		.expires = time(NULL) + s->cache_ttl,
+	};
+	memcpy(value.data, &hdr, sizeof(hdr));
+	if (len > 0) {
+		memcpy(value.data + sizeof(hdr), s->hits, len);
+	}
+
+	memcache_add(cache, MDSSVC_ES_RESULTS_CACHE, key, value);
+
+	data_blob_free(&value);
+	data_blob_free(&key);
+	TALLOC_FREE(s->hits);
+}
+
+/*
+ * Add the next page of results from the results cache
+ */
+static bool mds_es_search_cached(struct sl_es_search *s)
+{
+	struct sl_query *slq = s->slq;
+	const char **paths = NULL;
+	size_t n = 0;
+	bool ok;
+
+	if (s->total == 0) {
+		return true;
+	}
+
+	paths = talloc_array(talloc_tos(), const char *, s->size);
+	if (paths == NULL) {
+		slq->state = SLQ_STATE_ERROR;
+		return false;
+	}
+
+	while (s->cached_next != NULL && n < s->size && s->from + n < s->max) {
+		paths[n++] = s->cached_next;
+		s->cached_next = strv_next(s->cached, s->cached_next);
+	}
+
+	ok = mds_add_results(slq, paths, n);
+	TALLOC_FREE(paths);
+	if (!ok) {
+		slq->state = SLQ_STATE_ERROR;
+		return false;
+	}
+
+	s->from += n;
+	if (n == 0) {
+		/* Nothing left in the cache entry */
+		s->from = s->max;
+	}
+	slq->state = SLQ_STATE_RESULTS;
+	return true;
+}
+
 static bool mds_es_search(struct sl_query *slq)
 {
 	struct mds_es_ctx *mds_es_ctx = talloc_get_type_abort(
@@ -408,8 +592,18 @@ static bool mds_es_search(struct sl_query *slq)
 				   "max results",
 				   MAX_SL_RESULTS);
 
+	s->cache_ttl = lp_parm_int(s->slq->mds_ctx->snum,
+				   "elasticsearch",
+				   "result cache ttl",
+				   MDSSVC_ES_RESULT_CACHE_TTL);
+
 	DBG_DEBUG("Spotlight query: '%s'\n", slq->query_string);
 
+	ok = mds_es_cache_lookup(s);
+	if (ok) {
+		goto queue;
+	}
+
 	ok = map_spotlight_to_es_query(
 		s,
 		mds_es_ctx->mdssvc_es_ctx->mappings,
@@ -422,6 +616,7 @@ static bool mds_es_search(struct sl_query *slq)
 	}
 	DBG_DEBUG("Elasticsearch query: '%s'\n", s->es_query);
 
+queue:
 	slq->backend_private = s;
 	slq->state = SLQ_STATE_RUNNING;
 	DLIST_ADD_END(mds_es_ctx->searches, s);
@@ -435,10 +630,6 @@ static bool mds_es_next_search_trigger(struct mds_es_ctx *mds_es_ctx)
 	struct tevent_req *subreq = NULL;
 	struct sl_es_search *s = mds_es_ctx->searches;
 
-	if (mds_es_ctx->http_conn == NULL) {
-		DBG_DEBUG("Waiting for HTTP connection...\n");
-		return true;
-	}
 	if (s == NULL) {
 		DBG_DEBUG("No pending searches, idling...\n");
 		return true;
@@ -447,6 +638,10 @@ static bool mds_es_next_search_trigger(struct mds_es_ctx *mds_es_ctx)
 		DBG_DEBUG("Search pending [%p]\n", s);
 		return true;
 	}
+	if (mds_es_ctx->http_conn == NULL && !s->from_cache) {
+		DBG_DEBUG("Waiting for HTTP connection...\n");
+		return true;
+	}
 
 	subreq = mds_es_search_send(s, s->ev, s);
 	if (subreq == NULL) {
@@ -483,6 +678,10 @@ static void mds_es_search_done(struct tevent_req *subreq)
 	ret = mds_es_search_recv(subreq);
 	TALLOC_FREE(subreq);
 	if (ret != 0) {
+		if (s->from_cache) {
+			/* No HTTP involved, nothing to reconnect */
+			goto trigger;
+		}
 		mds_es_reconnect_on_error(s);
 		return;
 	}
@@ -499,6 +698,7 @@ static void mds_es_search_done(struct tevent_req *subreq)
 	SLQ_DEBUG(10, slq, "search done");
 
 	if (s->total == 0 || s->from >= s->max) {
+		mds_es_cache_store(s);
 		slq->state = SLQ_STATE_DONE;
 		goto trigger;
 	}
@@ -592,6 +792,18 @@ static struct tevent_req *mds_es_search_send(TALLOC_CTX *mem_ctx,
 		.s = s,
 	};
 
+	if (s->from_cache) {
+		bool ok;
+
+		ok = mds_es_search_cached(s);
+		if (!ok) {
+			tevent_req_error(req, EINVAL);
+			return tevent_req_post(req, ev);
+		}
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+	}
+
 	if (!tevent_req_set_endtime(req, ev, timeval_current_ofs(60, 0))) {
 		return tevent_req_post(req, s->ev);
 	}
@@ -712,6 +924,8 @@ static void mds_es_search_http_read_done(struct tevent_req *subreq)
 	json_t *root = NULL;
 	json_t *matches = NULL;
 	json_t *match = NULL;
+	const char **paths = NULL;
+	size_t num_paths = 0;
 	size_t i;
 	json_error_t error;
 	size_t hits;
@@ -801,6 +1015,11 @@ static void mds_es_search_http_read_done(struct tevent_req *subreq)
 	}
 	DBG_DEBUG("Hits: %zu\n", hits);
 
+	paths = talloc_array(state, const char *, hits);
+	if (paths == NULL) {
+		goto fail;
+	}
+
 	for (i = 0; i < hits && s->from + i < s->max; i++) {
 		const char *path = NULL;
 
@@ -820,12 +1039,32 @@ static void mds_es_search_http_read_done(struct tevent_req *subreq)
 			goto fail;
 		}
 
-		ok = mds_add_result(slq, path);
-		if (!ok) {
-			DBG_ERR("error adding result for path: %s\n", path);
-			goto fail;
+		paths[num_paths++] = path;
+	}
+
+	/*
+	 * Check the whole page as the user in one go, the paths point into
+	 * root so this must be done before freeing it.
+	 */
+	ok = mds_add_results(slq, paths, num_paths);
+	if (!ok) {
+		goto fail;
+	}
+
+	if (s->cache_ttl > 0 &&
+	    s->mds_es_ctx->mdssvc_es_ctx->results_cache != NULL)
+	{
+		for (i = 0; i < num_paths; i++) {
+			ret = strv_add(s, &s->hits, paths[i]);
+			if (ret != 0) {
+				/* Just don't cache this search */
+				TALLOC_FREE(s->hits);
+				s->cache_ttl = 0;
+				break;
+			}
 		}
 	}
+	TALLOC_FREE(paths);
 	json_decref(root);
 
 	s->from += hits;
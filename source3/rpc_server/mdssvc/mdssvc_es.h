@@ -30,6 +30,12 @@ struct mdssvc_es_ctx {
 	struct mdssvc_ctx *mdssvc_ctx;
 	struct cli_credentials *creds;
 	json_t *mappings;
+
+	/*
+	 * Short-lived cache of the paths returned by Elasticsearch for a
+	 * (share, user, scope, query) tuple, NULL if disabled
+	 */
+	struct memcache *results_cache;
 };
 
 /*
@@ -101,6 +107,26 @@ struct sl_es_search {
 	 * The translated Es query
 	 */
 	char *es_query;
+
+	/*
+	 * Lifetime of results cache entries for this share, 0 if the
+	 * results cache is disabled
+	 */
+	int cache_ttl;
+
+	/*
+	 * Paths returned by Elasticsearch so far, stored in the results
+	 * cache when the search completes
+	 */
+	char *hits;
+
+	/*
+	 * The search is served from the results cache instead of asking
+	 * Elasticsearch
+	 */
+	bool from_cache;
+	char *cached;
+	const char *cached_next;
 };
 
 extern struct mdssvc_backend mdsscv_backend_es;
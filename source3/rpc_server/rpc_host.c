@@ -148,6 +148,12 @@ struct rpc_host_pending_client {
 	struct rpc_host_client *client;
 };
 
+/*
+ * Below this busy time a worker can take another client, see
+ * rpc_host_worker_has_capacity()
+ */
+#define RPC_HOST_WORKER_SPARE_PERMILLE 250
+
 /*
  * Representation of one worker process. For each rpcd_* executable
  * there will be more of than one of these.
@@ -174,6 +180,13 @@ struct rpc_work_process {
 	uint32_t num_associations;
 	uint32_t num_connections;
 
+	/*
+	 * Load as reported by the worker with MSG_RPC_WORKER_STATUS,
+	 * used to send new clients to the least loaded worker
+	 */
+	uint32_t num_pending_calls;
+	uint32_t busy_permille;
+
 	/*
 	 * Send SHUTDOWN to an idle child after a while
 	 */
@@ -198,6 +211,12 @@ struct rpc_server {
 	size_t max_workers;
 	size_t idle_seconds;
 
+	/*
+	 * Number of workers not sent SHUTDOWN when idle, started
+	 * right away
+	 */
+	size_t min_workers;
+
 	/*
 	 * "workers" can be larger than "max_workers": Internal
 	 * connections require an idle worker to avoid deadlocks
@@ -222,6 +241,7 @@ struct rpc_server_get_endpoints_state {
 
 	unsigned long num_workers;
 	unsigned long idle_seconds;
+	unsigned long min_workers;
 };
 
 static void rpc_server_get_endpoints_done(struct tevent_req *subreq);
@@ -585,8 +605,8 @@ static void rpc_server_get_endpoints_done(struct tevent_req *subreq)
 		return;
 	}
 
-	if (num_lines < 2) {
-		DBG_DEBUG("Got %d lines, expected at least 2\n", num_lines);
+	if (num_lines < 3) {
+		DBG_DEBUG("Got %d lines, expected at least 3\n", num_lines);
 		tevent_req_error(req, EINVAL);
 		return;
 	}
@@ -618,12 +638,25 @@ static void rpc_server_get_endpoints_done(struct tevent_req *subreq)
 		return;
 	}
 
-	DBG_DEBUG("num_workers=%lu, idle_seconds=%lu for %s\n",
+	state->min_workers = smb_strtoul(
+		lines[2], NULL, 10, &ret, SMB_STR_FULL_STR_CONV);
+	if (ret != 0) {
+		DBG_DEBUG("Could not parse min_workers (%s): %s\n",
+			  lines[2],
+			  strerror(ret));
+		tevent_req_error(req, ret);
+		return;
+	}
+	state->min_workers = MIN(state->min_workers, state->num_workers);
+
+	DBG_DEBUG("num_workers=%lu, idle_seconds=%lu, min_workers=%lu "
+		  "for %s\n",
 		  state->num_workers,
 		  state->idle_seconds,
+		  state->min_workers,
 		  state->argl[0]);
 
-	for (i=2; i<num_lines; i++) {
+	for (i=3; i<num_lines; i++) {
 		char *line = lines[i];
 		struct rpc_host_endpoint *endpoint = NULL;
 		bool ok;
@@ -685,7 +718,8 @@ static int rpc_server_get_endpoints_recv(
 	struct rpc_host_endpoint ***endpoints,
 	struct rpc_host_iface_name **iface_names,
 	size_t *num_workers,
-	size_t *idle_seconds)
+	size_t *idle_seconds,
+	size_t *min_workers)
 {
 	struct rpc_server_get_endpoints_state *state = tevent_req_data(
 		req, struct rpc_server_get_endpoints_state);
@@ -700,6 +734,7 @@ static int rpc_server_get_endpoints_recv(
 	*iface_names = talloc_move(mem_ctx, &state->iface_names);
 	*num_workers = state->num_workers;
 	*idle_seconds = state->idle_seconds;
+	*min_workers = state->min_workers;
 	tevent_req_received(req);
 	return 0;
 }
@@ -1153,6 +1188,25 @@ fail:
 	return ret;
 }
 
+/*
+ * The load of a worker as last reported: Calls waiting for an answer
+ * dominate, busy time breaks ties.
+ */
+static uint64_t rpc_host_worker_load(const struct rpc_work_process *w)
+{
+	return (uint64_t)w->num_pending_calls * 1000 + w->busy_permille;
+}
+
+/*
+ * A busy worker with no calls queued and mostly waiting for events
+ * can take another client, we don't need to start a new process.
+ */
+static bool rpc_host_worker_has_capacity(const struct rpc_work_process *w)
+{
+	return (w->num_pending_calls == 0) &&
+	       (w->busy_permille < RPC_HOST_WORKER_SPARE_PERMILLE);
+}
+
 /*
  * Find an rpcd_* worker for an external client, respect server->max_workers
  */
@@ -1165,6 +1219,8 @@ static struct rpc_work_process *rpc_host_find_worker(struct rpc_server *server)
 	size_t i;
 
 	for (i=0; i<server->max_workers; i++) {
+		uint64_t load, best_load;
+
 		worker = &server->workers[i];
 
 		if (worker->pid == -1) {
@@ -1188,9 +1244,26 @@ static struct rpc_work_process *rpc_host_find_worker(struct rpc_server *server)
 			best_worker = worker;
 			continue;
 		}
+
+		load = rpc_host_worker_load(worker);
+		best_load = rpc_host_worker_load(best_worker);
+
+		if (load < best_load) {
+			/*
+			 * It's also busy, but does less work
+			 */
+			best_worker = worker;
+			continue;
+		}
+		if (load > best_load) {
+			/*
+			 * It's not better
+			 */
+			continue;
+		}
 		if (worker->num_associations < best_worker->num_associations) {
 			/*
-			 * It's also busy, but has less association groups
+			 * Same load, but less association groups
 			 * (logical clients)
 			 */
 			best_worker = worker;
@@ -1216,6 +1289,14 @@ static struct rpc_work_process *rpc_host_find_worker(struct rpc_server *server)
 		return perfect_worker;
 	}
 
+	if ((best_worker != NULL) && rpc_host_worker_has_capacity(best_worker)) {
+		/*
+		 * Don't pay for a new process as long as the least
+		 * loaded one is mostly idle.
+		 */
+		return best_worker;
+	}
+
 	if (empty_slot < SIZE_MAX) {
 		int ret = rpc_host_exec_worker(server, empty_slot);
 		if (ret != 0) {
@@ -1693,7 +1774,8 @@ static void rpc_server_setup_got_endpoints(struct tevent_req *subreq)
 		&server->endpoints,
 		&server->iface_names,
 		&server->max_workers,
-		&server->idle_seconds);
+		&server->idle_seconds,
+		&server->min_workers);
 	TALLOC_FREE(subreq);
 	if (ret != 0) {
 		tevent_req_nterror(req, map_nt_error_from_unix(ret));
@@ -1884,6 +1966,31 @@ static void rpc_host_exit_worker(
 	}
 }
 
+/*
+ * Only shut down idle workers beyond server->min_workers. Workers
+ * beyond max_workers are only for internal connections and always
+ * go away when idle.
+ */
+static bool rpc_host_may_retire_worker(
+	struct rpc_server *server, size_t idx)
+{
+	size_t i, num_running = 0;
+
+	if (idx >= server->max_workers) {
+		return true;
+	}
+
+	for (i=0; i<server->max_workers; i++) {
+		struct rpc_work_process *w = &server->workers[i];
+
+		if ((w->pid != -1) && w->available) {
+			num_running += 1;
+		}
+	}
+
+	return (num_running > server->min_workers);
+}
+
 /*
  * rcpd_* worker replied with its status.
  */
@@ -1949,10 +2056,13 @@ static void rpc_host_child_status_recv(
 	worker->available = true;
 	worker->num_associations = status_message.num_association_groups;
 	worker->num_connections = status_message.num_connections;
+	worker->num_pending_calls = status_message.num_pending_calls;
+	worker->busy_permille = status_message.busy_permille;
 
-	if (worker->num_associations != 0) {
-		TALLOC_FREE(worker->exit_timer);
-	} else {
+	TALLOC_FREE(worker->exit_timer);
+
+	if ((worker->num_associations == 0) &&
+	    rpc_host_may_retire_worker(server, status_message.worker_index)) {
 		worker->exit_timer = tevent_add_timer(
 			messaging_tevent_context(msg),
 			server->workers,
@@ -2341,11 +2451,13 @@ static bool rpc_host_dump_status_filter(
 			}
 
 			fprintf(f,
-				" worker[%zu]: pid=%d, num_associations=%"PRIu32", num_connections=%"PRIu32"\n",
+				" worker[%zu]: pid=%d, num_associations=%"PRIu32", num_connections=%"PRIu32", num_pending_calls=%"PRIu32", busy_permille=%"PRIu32"\n",
 				j,
 				(int)w->pid,
 				w->num_associations,
-				w->num_connections);
+				w->num_connections,
+				w->num_pending_calls,
+				w->busy_permille);
 		}
 	}
 
@@ -2550,6 +2662,14 @@ static void rpc_host_server_setup_done(struct tevent_req *subreq)
 		server = host->servers[i];
 		num_endpoints = talloc_array_length(server->endpoints);
 
+		for (j=0; (j<server->min_workers) && !host->np_helper; j++) {
+			int ret = rpc_host_exec_worker(server, j);
+			if (ret != 0) {
+				DBG_WARNING("Could not fork worker: %s\n",
+					    strerror(ret));
+			}
+		}
+
 		for (j=0; j<num_endpoints; j++) {
 			subreq = rpc_host_endpoint_accept_send(
 				state, state->ev, server->endpoints[j]);
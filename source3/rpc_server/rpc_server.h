@@ -43,6 +43,9 @@ struct dcerpc_ncacn_conn {
 
 	char *remote_client_name;
 	char *local_server_name;
+
+	/* Only used to report the number of pending calls */
+	struct dcesrv_connection *dcesrv_conn;
 };
 
 void set_incoming_fault(struct pipes_struct *p);
@@ -74,9 +74,20 @@ struct rpc_worker {
 
 	struct rpc_worker_status status;
 
+	/*
+	 * Load accounting, see rpc_worker_load_timer()
+	 */
+	struct timeval busy_start;
+	uint64_t busy_usec;
+	struct timeval load_start;
+	struct tevent_timer *load_timer;
+
 	bool done;
 };
 
+#define RPC_WORKER_LOAD_INTERVAL 1 /* seconds */
+#define RPC_WORKER_BUSY_REPORT_DELTA 100 /* permille */
+
 static void rpc_worker_print_interface(
 	FILE *f, const struct ndr_interface_table *t)
 {
@@ -94,15 +105,52 @@ static void rpc_worker_print_interface(
 	}
 }
 
+/*
+ * Number of calls received, but not completely answered yet. This
+ * and busy_permille are the load samba-dcerpcd distributes new
+ * clients by.
+ */
+static uint32_t rpc_worker_num_pending_calls(struct rpc_worker *worker)
+{
+	struct dcerpc_ncacn_conn *conn = NULL;
+	uint32_t num_calls = 0;
+
+	for (conn = worker->conns; conn != NULL; conn = conn->next) {
+		struct dcesrv_connection *dcesrv_conn = conn->dcesrv_conn;
+		struct dcesrv_call_state *call = NULL;
+
+		if (dcesrv_conn == NULL) {
+			continue;
+		}
+		for (call = dcesrv_conn->pending_call_list;
+		     call != NULL;
+		     call = call->next) {
+			num_calls += 1;
+		}
+		for (call = dcesrv_conn->call_list;
+		     call != NULL;
+		     call = call->next) {
+			num_calls += 1;
+		}
+	}
+
+	return num_calls;
+}
+
 static NTSTATUS rpc_worker_report_status(struct rpc_worker *worker)
 {
-	uint8_t buf[16];
+	uint8_t buf[24];
 	DATA_BLOB blob = { .data = buf, .length = sizeof(buf), };
 	enum ndr_err_code ndr_err;
 	NTSTATUS status;
 
 	worker->status.num_association_groups = worker->dce_ctx->assoc_groups_num;
 
+	if (worker->status.num_connections == 0) {
+		worker->status.num_pending_calls = 0;
+		worker->status.busy_permille = 0;
+	}
+
 	if (DEBUGLEVEL >= 10) {
 		NDR_PRINT_DEBUG(rpc_worker_status, &worker->status);
 	}
@@ -121,6 +169,118 @@ static NTSTATUS rpc_worker_report_status(struct rpc_worker *worker)
 	return status;
 }
 
+/*
+ * Everything between returning from and going back into waiting
+ * for events is accounted as busy time.
+ */
+static void rpc_worker_tevent_trace(
+	enum tevent_trace_point point, void *private_data)
+{
+	struct rpc_worker *worker = talloc_get_type_abort(
+		private_data, struct rpc_worker);
+	struct timeval now;
+
+	switch (point) {
+	case TEVENT_TRACE_AFTER_WAIT:
+		worker->busy_start = timeval_current();
+		break;
+	case TEVENT_TRACE_BEFORE_WAIT:
+		if (timeval_is_zero(&worker->busy_start)) {
+			break;
+		}
+		now = timeval_current();
+		worker->busy_usec += usec_time_diff(&now, &worker->busy_start);
+		worker->busy_start = timeval_zero();
+		break;
+	default:
+		break;
+	}
+}
+
+static void rpc_worker_load_schedule(struct rpc_worker *worker);
+
+/*
+ * Sample our load once per RPC_WORKER_LOAD_INTERVAL while we have
+ * clients. Only tell samba-dcerpcd if it changed noticeably, it
+ * only needs this to pick a worker for the next client.
+ */
+static void rpc_worker_load_timer(
+	struct tevent_context *ev,
+	struct tevent_timer *te,
+	struct timeval current_time,
+	void *private_data)
+{
+	struct rpc_worker *worker = talloc_get_type_abort(
+		private_data, struct rpc_worker);
+	uint32_t old_busy = worker->status.busy_permille;
+	uint32_t old_pending = worker->status.num_pending_calls;
+	uint32_t busy_permille = 0;
+	int64_t elapsed;
+	bool changed;
+
+	worker->load_timer = NULL;
+
+	if (!timeval_is_zero(&worker->busy_start)) {
+		/*
+		 * We are running the timer, count the time up to
+		 * now into this interval.
+		 */
+		worker->busy_usec += usec_time_diff(
+			&current_time, &worker->busy_start);
+		worker->busy_start = current_time;
+	}
+
+	elapsed = usec_time_diff(&current_time, &worker->load_start);
+	if (elapsed > 0) {
+		busy_permille = MIN(worker->busy_usec * 1000 / (uint64_t)elapsed,
+				    1000);
+	}
+	worker->busy_usec = 0;
+	worker->load_start = current_time;
+
+	worker->status.busy_permille = busy_permille;
+	worker->status.num_pending_calls =
+		rpc_worker_num_pending_calls(worker);
+
+	changed = (worker->status.num_pending_calls != old_pending);
+	changed |= (busy_permille > old_busy + RPC_WORKER_BUSY_REPORT_DELTA);
+	changed |= (busy_permille + RPC_WORKER_BUSY_REPORT_DELTA < old_busy);
+
+	if (changed) {
+		NTSTATUS status = rpc_worker_report_status(worker);
+		if (!NT_STATUS_IS_OK(status)) {
+			DBG_DEBUG("rpc_worker_report_status returned %s\n",
+				  nt_errstr(status));
+		}
+	}
+
+	rpc_worker_load_schedule(worker);
+}
+
+static void rpc_worker_load_schedule(struct rpc_worker *worker)
+{
+	struct tevent_context *ev = messaging_tevent_context(worker->msg_ctx);
+
+	if (worker->status.num_connections == 0) {
+		TALLOC_FREE(worker->load_timer);
+		return;
+	}
+	if (worker->load_timer != NULL) {
+		return;
+	}
+
+	worker->load_start = timeval_current();
+	worker->busy_usec = 0;
+
+	worker->load_timer = tevent_add_timer(
+		ev,
+		worker,
+		tevent_timeval_current_ofs(RPC_WORKER_LOAD_INTERVAL, 0),
+		rpc_worker_load_timer,
+		worker);
+	/* No NULL check, it's not fatal if we don't report our load */
+}
+
 static void rpc_worker_connection_terminated(
 	struct dcesrv_connection *conn, void *private_data)
 {
@@ -163,6 +323,8 @@ static void rpc_worker_connection_terminated(
 		DBG_DEBUG("rpc_worker_report_status returned %s\n",
 			  nt_errstr(status));
 	}
+
+	rpc_worker_load_schedule(worker);
 }
 
 static int dcesrv_connection_destructor(struct dcesrv_connection *conn)
@@ -440,6 +602,7 @@ static void rpc_worker_new_client(
 	talloc_set_destructor(dcesrv_conn, dcesrv_connection_destructor);
 
 	dcesrv_conn->transport.private_data = ncacn_conn;
+	ncacn_conn->dcesrv_conn = dcesrv_conn;
 	dcesrv_conn->transport.report_output_data =
 		dcesrv_sock_report_output_data;
 	dcesrv_conn->transport.terminate_connection =
@@ -485,6 +648,7 @@ static void rpc_worker_new_client(
 
 	DLIST_ADD(worker->conns, ncacn_conn);
 	worker->status.num_connections += 1;
+	rpc_worker_load_schedule(worker);
 
 	dcesrv_loop_next_packet(dcesrv_conn, pkt, buffer);
 
@@ -833,6 +997,8 @@ static struct tevent_req *rpc_worker_send(
 		.worker_index = worker_index,
 	};
 
+	tevent_set_trace_callback(ev, rpc_worker_tevent_trace, w);
+
 	/* Wait for new client messages. */
 	state->new_client_req = messaging_filtered_read_send(
 		w,
@@ -1018,6 +1184,7 @@ int rpc_worker_main(
 	int worker_index = -1;
 	bool log_stdout;
 	int list_interfaces = 0;
+	int dispatch_threads;
 	struct rpc_worker *worker = NULL;
 	const struct dcesrv_endpoint_server **ep_servers;
 	size_t i, num_servers;
@@ -1092,17 +1259,28 @@ int rpc_worker_main(
 		const struct ndr_interface_table **ifaces = NULL;
 		size_t num_ifaces;
 
+		int min_workers;
+
 		num_workers = lp_parm_int(
 			-1, daemon_config_name, "num_workers", num_workers);
 		idle_seconds = lp_parm_int(
 			-1, daemon_config_name, "idle_seconds", idle_seconds);
+		min_workers = lp_parm_int(
+			-1, daemon_config_name, "min_workers", 0);
+		min_workers = MAX(MIN(min_workers, num_workers), 0);
 
-		DBG_DEBUG("daemon=%s, num_workers=%d, idle_seconds=%d\n",
+		DBG_DEBUG("daemon=%s, num_workers=%d, idle_seconds=%d, "
+			  "min_workers=%d\n",
 			  daemon_config_name,
 			  num_workers,
-			  idle_seconds);
+			  idle_seconds,
+			  min_workers);
 
-		fprintf(stdout, "%d\n%d\n", num_workers, idle_seconds);
+		fprintf(stdout,
+			"%d\n%d\n%d\n",
+			num_workers,
+			idle_seconds,
+			min_workers);
 
 		num_ifaces = get_interfaces(&ifaces, private_data);
 
@@ -1232,6 +1410,22 @@ int rpc_worker_main(
 		}
 	}
 
+	/*
+	 * Only interfaces flagged with DCESRV_INTERFACE_FLAGS_THREAD_SAFE
+	 * make use of the threads.
+	 */
+	dispatch_threads = lp_parm_int(
+		-1, daemon_config_name, "dispatch_threads", 0);
+	if (dispatch_threads > 0) {
+		status = dcesrv_context_set_dispatch_threads(
+			dce_ctx, dispatch_threads);
+		if (!NT_STATUS_IS_OK(status)) {
+			DBG_WARNING("dcesrv_context_set_dispatch_threads "
+				    "failed: %s\n",
+				    nt_errstr(status));
+		}
+	}
+
 	req = rpc_worker_send(
 		ev_ctx, ev_ctx, worker, getppid(), worker_group, worker_index);
 	if (req == NULL) {
@@ -4455,6 +4455,7 @@ static WERROR enum_all_printers_info_level(TALLOC_CTX *mem_ctx,
 	WERROR result = WERR_OK;
 	struct dcerpc_binding_handle *b = NULL;
 	TALLOC_CTX *tmp_ctx = NULL;
+	bool use_cache = (session_info == get_session_info_system());
 
 	tmp_ctx = talloc_new(mem_ctx);
 	if (!tmp_ctx) {
@@ -4497,10 +4498,13 @@ static WERROR enum_all_printers_info_level(TALLOC_CTX *mem_ctx,
 			}
 		}
 
-		result = winreg_create_printer(tmp_ctx, b,
-					       printer);
-		if (!W_ERROR_IS_OK(result)) {
-			goto out;
+		/* a cached printer exists already */
+		if (!use_cache || !winreg_printer_is_cached(printer)) {
+			result = winreg_create_printer(tmp_ctx, b,
+						       printer);
+			if (!W_ERROR_IS_OK(result)) {
+				goto out;
+			}
 		}
 
 		info = talloc_realloc(tmp_ctx, info,
@@ -4511,8 +4515,13 @@ static WERROR enum_all_printers_info_level(TALLOC_CTX *mem_ctx,
 			goto out;
 		}
 
-		result = winreg_get_printer(tmp_ctx, b,
-					    printer, &info2);
+		if (use_cache) {
+			result = winreg_get_printer_cached(tmp_ctx, b,
+							   printer, &info2);
+		} else {
+			result = winreg_get_printer(tmp_ctx, b,
+						    printer, &info2);
+		}
 		if (!W_ERROR_IS_OK(result)) {
 			goto out;
 		}
@@ -5756,9 +5765,9 @@ static WERROR construct_printer_driver_info_level(TALLOC_CTX *mem_ctx,
 		goto done;
 	}
 
-	result = winreg_get_printer(tmp_ctx, b,
-				    lp_const_servicename(snum),
-				    &pinfo2);
+	result = winreg_get_printer_cached(tmp_ctx, b,
+					   lp_const_servicename(snum),
+					   &pinfo2);
 	if (!W_ERROR_IS_OK(result)) {
 		DBG_ERR("Failed to get printer info2 for [%s]: %s\n",
 			lp_const_servicename(snum), win_errstr(result));
@@ -5775,9 +5784,9 @@ static WERROR construct_printer_driver_info_level(TALLOC_CTX *mem_ctx,
 		 pinfo2->drivername,
 		 pinfo2->sharename);
 
-	result = winreg_get_driver(tmp_ctx, b,
-				   architecture,
-				   pinfo2->drivername, version, &driver);
+	result = winreg_get_driver_cached(tmp_ctx, b,
+					  architecture,
+					  pinfo2->drivername, version, &driver);
 
 	DBG_INFO("winreg_get_driver() status: %s\n",
 		 win_errstr(result));
@@ -5794,10 +5803,10 @@ static WERROR construct_printer_driver_info_level(TALLOC_CTX *mem_ctx,
 
 		/* Yes - try again with a WinNT driver. */
 		version = 2;
-		result = winreg_get_driver(tmp_ctx, b,
-					   architecture,
-					   pinfo2->drivername,
-					   version, &driver);
+		result = winreg_get_driver_cached(tmp_ctx, b,
+						  architecture,
+						  pinfo2->drivername,
+						  version, &driver);
 		DEBUG(8,("construct_printer_driver_level: status: %s\n",
 			win_errstr(result)));
 		if (!W_ERROR_IS_OK(result)) {
@@ -7962,9 +7971,10 @@ static WERROR enumprinterdrivers_level_by_architecture(TALLOC_CTX *mem_ctx,
 		for (i = 0; i < num_drivers; i++) {
 			DEBUG(5, ("\tdriver: [%s]\n", drivers[i]));
 
-			result = winreg_get_driver(tmp_ctx, b,
-						   architecture, drivers[i],
-						   version, &driver);
+			result = winreg_get_driver_cached(tmp_ctx, b,
+							  architecture,
+							  drivers[i],
+							  version, &driver);
 			if (!W_ERROR_IS_OK(result)) {
 				goto out;
 			}
@@ -26,6 +26,9 @@
 #include "../librpc/gen_ndr/ndr_winreg.h"
 #include "srv_spoolss_util.h"
 #include "rpc_client/cli_winreg_spoolss.h"
+#include "registry/reg_backend_db.h"
+#include "auth.h"
+#include "../lib/util/memcache.h"
 
 WERROR winreg_printer_binding_handle(TALLOC_CTX *mem_ctx,
 				     const struct auth_session_info *session_info,
@@ -62,6 +65,235 @@ WERROR winreg_printer_binding_handle(TALLOC_CTX *mem_ctx,
 	return WERR_OK;
 }
 
+/*
+ * Printer and driver info fetched with the system session is cached
+ * NDR encoded, so that EnumPrinters and GetPrinterDriver2 from many
+ * clients don't have to query the registry through winreg for every
+ * printer on every call. Any registry change bumps the seqnum of the
+ * registry tdb and flushes the whole cache, this covers updates
+ * done by SetPrinter, AddPrinterDriver and friends in any process.
+ */
+
+static struct memcache *spoolss_info_cache;
+static int spoolss_info_cache_seqnum = -1;
+
+static struct memcache *spoolss_info_cache_get(void)
+{
+	int seqnum;
+
+	if (spoolss_info_cache == NULL) {
+		unsigned long long size;
+		WERROR werr;
+
+		size = lp_parm_ulonglong(GLOBAL_SECTION_SNUM,
+					 "spoolss",
+					 "info cache size",
+					 4 * 1024 * 1024);
+		if (size == 0) {
+			return NULL;
+		}
+
+		werr = regdb_open();
+		if (!W_ERROR_IS_OK(werr)) {
+			DBG_DEBUG("regdb_open failed: %s\n", win_errstr(werr));
+			return NULL;
+		}
+
+		spoolss_info_cache = memcache_init(NULL, size);
+		if (spoolss_info_cache == NULL) {
+			regdb_close();
+			return NULL;
+		}
+	}
+
+	seqnum = regdb_get_seqnum();
+	if (seqnum != spoolss_info_cache_seqnum) {
+		memcache_flush(spoolss_info_cache, SPOOLSS_PRINTER_INFO_CACHE);
+		memcache_flush(spoolss_info_cache, SPOOLSS_DRIVER_INFO_CACHE);
+		spoolss_info_cache_seqnum = seqnum;
+	}
+
+	return spoolss_info_cache;
+}
+
+static bool spoolss_info_cache_fetch(enum memcache_number n,
+				     DATA_BLOB key,
+				     TALLOC_CTX *mem_ctx,
+				     void *r,
+				     ndr_pull_flags_fn_t pull_fn)
+{
+	struct memcache *cache = spoolss_info_cache_get();
+	enum ndr_err_code ndr_err;
+	DATA_BLOB blob;
+
+	if (cache == NULL) {
+		return false;
+	}
+
+	if (!memcache_lookup(cache, n, key, &blob)) {
+		return false;
+	}
+
+	ndr_err = ndr_pull_struct_blob(&blob, mem_ctx, r, pull_fn);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		DBG_WARNING("ndr_pull_struct_blob failed: %s\n",
+			    ndr_errstr(ndr_err));
+		memcache_delete(cache, n, key);
+		return false;
+	}
+
+	return true;
+}
+
+static void spoolss_info_cache_store(enum memcache_number n,
+				     DATA_BLOB key,
+				     const void *r,
+				     ndr_push_flags_fn_t push_fn)
+{
+	struct memcache *cache = spoolss_info_cache_get();
+	enum ndr_err_code ndr_err;
+	DATA_BLOB blob;
+
+	if (cache == NULL) {
+		return;
+	}
+
+	ndr_err = ndr_push_struct_blob(&blob, talloc_tos(), r, push_fn);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		DBG_WARNING("ndr_push_struct_blob failed: %s\n",
+			    ndr_errstr(ndr_err));
+		return;
+	}
+
+	memcache_add(cache, n, key, blob);
+	data_blob_free(&blob);
+}
+
+static bool spoolss_printer_cache_fetch(TALLOC_CTX *mem_ctx,
+					const char *printer,
+					struct spoolss_PrinterInfo2 **pinfo2)
+{
+	struct spoolss_PrinterInfo2 *info2 = NULL;
+	bool ok;
+
+	info2 = talloc_zero(mem_ctx, struct spoolss_PrinterInfo2);
+	if (info2 == NULL) {
+		return false;
+	}
+
+	ok = spoolss_info_cache_fetch(
+		SPOOLSS_PRINTER_INFO_CACHE,
+		data_blob_string_const(printer),
+		info2,
+		info2,
+		(ndr_pull_flags_fn_t)ndr_pull_spoolss_PrinterInfo2);
+	if (!ok) {
+		TALLOC_FREE(info2);
+		return false;
+	}
+
+	*pinfo2 = info2;
+	return true;
+}
+
+bool winreg_printer_is_cached(const char *printer)
+{
+	struct memcache *cache = spoolss_info_cache_get();
+	DATA_BLOB blob;
+
+	if (cache == NULL) {
+		return false;
+	}
+
+	return memcache_lookup(cache,
+			       SPOOLSS_PRINTER_INFO_CACHE,
+			       data_blob_string_const(printer),
+			       &blob);
+}
+
+WERROR winreg_get_printer_cached(TALLOC_CTX *mem_ctx,
+				 struct dcerpc_binding_handle *b,
+				 const char *printer,
+				 struct spoolss_PrinterInfo2 **pinfo2)
+{
+	WERROR result;
+	bool ok;
+
+	ok = spoolss_printer_cache_fetch(mem_ctx, printer, pinfo2);
+	if (ok) {
+		return WERR_OK;
+	}
+
+	result = winreg_get_printer(mem_ctx, b, printer, pinfo2);
+	if (!W_ERROR_IS_OK(result)) {
+		return result;
+	}
+
+	spoolss_info_cache_store(
+		SPOOLSS_PRINTER_INFO_CACHE,
+		data_blob_string_const(printer),
+		*pinfo2,
+		(ndr_push_flags_fn_t)ndr_push_spoolss_PrinterInfo2);
+
+	return WERR_OK;
+}
+
+WERROR winreg_get_driver_cached(TALLOC_CTX *mem_ctx,
+				struct dcerpc_binding_handle *b,
+				const char *architecture,
+				const char *driver_name,
+				uint32_t driver_version,
+				struct spoolss_DriverInfo8 **_info8)
+{
+	struct spoolss_DriverInfo8 *info8 = NULL;
+	char *keystr = NULL;
+	DATA_BLOB key;
+	WERROR result;
+	bool ok;
+
+	keystr = talloc_asprintf(talloc_tos(), "%s/%s/%"PRIu32,
+				 architecture, driver_name, driver_version);
+	if (keystr == NULL) {
+		return WERR_NOT_ENOUGH_MEMORY;
+	}
+	key = data_blob_string_const(keystr);
+
+	info8 = talloc_zero(mem_ctx, struct spoolss_DriverInfo8);
+	if (info8 == NULL) {
+		TALLOC_FREE(keystr);
+		return WERR_NOT_ENOUGH_MEMORY;
+	}
+
+	ok = spoolss_info_cache_fetch(
+		SPOOLSS_DRIVER_INFO_CACHE,
+		key,
+		info8,
+		info8,
+		(ndr_pull_flags_fn_t)ndr_pull_spoolss_DriverInfo8);
+	if (ok) {
+		TALLOC_FREE(keystr);
+		*_info8 = info8;
+		return WERR_OK;
+	}
+	TALLOC_FREE(info8);
+
+	result = winreg_get_driver(mem_ctx, b,
+				   architecture,
+				   driver_name,
+				   driver_version,
+				   _info8);
+	if (W_ERROR_IS_OK(result)) {
+		spoolss_info_cache_store(
+			SPOOLSS_DRIVER_INFO_CACHE,
+			key,
+			*_info8,
+			(ndr_push_flags_fn_t)ndr_push_spoolss_DriverInfo8);
+	}
+
+	TALLOC_FREE(keystr);
+	return result;
+}
+
 WERROR winreg_delete_printer_key_internal(TALLOC_CTX *mem_ctx,
 					  const struct auth_session_info *session_info,
 					  struct messaging_context *msg_ctx,
@@ -159,6 +391,12 @@ WERROR winreg_get_printer_internal(TALLOC_CTX *mem_ctx,
 	WERROR result;
 	struct dcerpc_binding_handle *b;
 	TALLOC_CTX *tmp_ctx;
+	bool use_cache = (session_info == get_session_info_system());
+
+	/* only the system session sees the same data for everybody */
+	if (use_cache && spoolss_printer_cache_fetch(mem_ctx, printer, pinfo2)) {
+		return WERR_OK;
+	}
 
 	tmp_ctx = talloc_stackframe();
 	if (tmp_ctx == NULL) {
@@ -171,10 +409,17 @@ WERROR winreg_get_printer_internal(TALLOC_CTX *mem_ctx,
 		return result;
 	}
 
-	result = winreg_get_printer(mem_ctx,
-				    b,
-				    printer,
-				    pinfo2);
+	if (use_cache) {
+		result = winreg_get_printer_cached(mem_ctx,
+						   b,
+						   printer,
+						   pinfo2);
+	} else {
+		result = winreg_get_printer(mem_ctx,
+					    b,
+					    printer,
+					    pinfo2);
+	}
 
 	talloc_free(tmp_ctx);
 	return result;
@@ -409,12 +654,21 @@ WERROR winreg_get_driver_internal(TALLOC_CTX *mem_ctx,
 		return result;
 	}
 
-	result = winreg_get_driver(mem_ctx,
-				   b,
-				   architecture,
-				   driver_name,
-				   driver_version,
-				   _info8);
+	if (session_info == get_session_info_system()) {
+		result = winreg_get_driver_cached(mem_ctx,
+						  b,
+						  architecture,
+						  driver_name,
+						  driver_version,
+						  _info8);
+	} else {
+		result = winreg_get_driver(mem_ctx,
+					   b,
+					   architecture,
+					   driver_name,
+					   driver_version,
+					   _info8);
+	}
 
 	talloc_free(tmp_ctx);
 	return result;
@@ -30,6 +30,22 @@ WERROR winreg_printer_binding_handle(TALLOC_CTX *mem_ctx,
 				     struct messaging_context *msg_ctx,
 				     struct dcerpc_binding_handle **winreg_binding_handle);
 
+/*
+ * Cached variants of winreg_get_printer() and winreg_get_driver(), only
+ * use them with a binding handle for the system session.
+ */
+bool winreg_printer_is_cached(const char *printer);
+WERROR winreg_get_printer_cached(TALLOC_CTX *mem_ctx,
+				 struct dcerpc_binding_handle *b,
+				 const char *printer,
+				 struct spoolss_PrinterInfo2 **pinfo2);
+WERROR winreg_get_driver_cached(TALLOC_CTX *mem_ctx,
+				struct dcerpc_binding_handle *b,
+				const char *architecture,
+				const char *driver_name,
+				uint32_t driver_version,
+				struct spoolss_DriverInfo8 **_info8);
+
 WERROR winreg_delete_printer_key_internal(TALLOC_CTX *mem_ctx,
 					  const struct auth_session_info *session_info,
 					  struct messaging_context *msg_ctx,
@@ -0,0 +1,88 @@
+#!/bin/sh
+#
+# Check that a cached NT token ("smbd:token cache timeout") follows
+# alias membership changes: The next session after adding or removing
+# the user has the new token.
+#
+
+if [ $# -lt 7 ]; then
+	cat <<EOF
+Usage: test_token_cache.sh SERVER USERNAME PASSWORD SMBCLIENT NET SERVERCONFFILE CONFIGURATION
+EOF
+	exit 1
+fi
+
+SERVER="$1"
+USERNAME="$2"
+PASSWORD="$3"
+SMBCLIENT="$VALGRIND ${4}"
+NET="$VALGRIND ${5}"
+SERVERCONFFILE="${6}"
+CONFIGURATION="${7}"
+shift 7
+
+# The alias lives in the passdb of the server
+NET="$NET --configfile=$SERVERCONFFILE"
+
+incdir=$(dirname $0)/../../../testprogs/blackbox
+. $incdir/subunit.sh
+
+failed=0
+
+ALIAS=tokencache
+
+whoami()
+{
+	$SMBCLIENT //$SERVER/tmp $CONFIGURATION \
+		-U$USERNAME%$PASSWORD -mNT1 \
+		-c "posix; posix_whoami"
+}
+
+has_alias()
+{
+	out=$(whoami) || {
+		echo "$out"
+		return 1
+	}
+	echo "$out" | grep -q "SIDS\[[0-9]*\]:$ALIAS_SID\$"
+}
+
+lacks_alias()
+{
+	out=$(whoami) || {
+		echo "$out"
+		return 1
+	}
+	! echo "$out" | grep -q "SIDS\[[0-9]*\]:$ALIAS_SID\$"
+}
+
+testit "create alias" \
+	$NET sam createlocalgroup $ALIAS ||
+	failed=$((failed + 1))
+
+ALIAS_SID=$($NET sam show $ALIAS | sed -n 's/.* with SID //p')
+testit "found alias SID" test -n "$ALIAS_SID" || failed=$((failed + 1))
+
+# The second session setup finds the token in the cache
+testit "token has no alias" lacks_alias || failed=$((failed + 1))
+testit "cached token has no alias" lacks_alias || failed=$((failed + 1))
+
+testit "add alias member" \
+	$NET sam addmem $ALIAS $USERNAME ||
+	failed=$((failed + 1))
+
+testit "token has alias after adding" has_alias || failed=$((failed + 1))
+testit "cached token has alias" has_alias || failed=$((failed + 1))
+
+testit "remove alias member" \
+	$NET sam delmem $ALIAS $USERNAME ||
+	failed=$((failed + 1))
+
+testit "token has no alias after removal" lacks_alias ||
+	failed=$((failed + 1))
+
+testit "delete alias" \
+	$NET sam deletelocalgroup $ALIAS ||
+	failed=$((failed + 1))
+
+testok $0 $failed
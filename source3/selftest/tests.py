@@ -105,6 +105,7 @@ if "HAVE_KERNEL_OPLOCKS_LINUX" in config_hash:
 have_inotify = ("HAVE_INOTIFY" in config_hash)
 have_ldwrap = ("HAVE_LDWRAP" in config_hash)
 with_pthreadpool = ("WITH_PTHREADPOOL" in config_hash)
+have_io_uring_transport = ("HAVE_IO_URING_SETUP_BUF_RING" in config_hash)
 
 have_cluster_support = "CLUSTER_SUPPORT" in config_hash
 
@@ -574,6 +575,7 @@ local_tests = [
     "LOCAL-MESSAGING-READ2",
     "LOCAL-MESSAGING-READ3",
     "LOCAL-MESSAGING-READ4",
+    "LOCAL-MESSAGING-READ5",
     "LOCAL-MESSAGING-FDPASS1",
     "LOCAL-MESSAGING-FDPASS2",
     "LOCAL-MESSAGING-FDPASS2a",
@@ -586,6 +588,7 @@ local_tests = [
     "LOCAL-DBWRAP-WATCH3",
     "LOCAL-DBWRAP-WATCH4",
     "LOCAL-DBWRAP-DO-LOCKED1",
+    "LOCAL-DBWRAP-PARSE-BATCH1",
     "LOCAL-G-LOCK1",
     "LOCAL-G-LOCK2",
     "LOCAL-G-LOCK3",
@@ -757,6 +760,7 @@ env = "maptoguest"
 plantestsuite("samba3.blackbox.smbclient_auth.plain.bad_username", env, [os.path.join(samba3srcdir, "script/tests/test_smbclient_auth.sh"), '$SERVER', '$SERVER_IP', 'notmy$USERNAME', '$PASSWORD', smbclient3, configuration + " --option=clientntlmv2auth=no --option=clientlanmanauth=yes"])
 plantestsuite("samba3.blackbox.smbclient_ntlm.plain.NT1", env, [os.path.join(samba3srcdir, "script/tests/test_smbclient_ntlm.sh"), '$SERVER', '$USERNAME', '$PASSWORD', "baduser", smbclient3, "NT1", configuration])
 plantestsuite("samba3.blackbox.smbclient_ntlm.plain.SMB3", env, [os.path.join(samba3srcdir, "script/tests/test_smbclient_ntlm.sh"), '$SERVER', '$USERNAME', '$PASSWORD', "baduser", smbclient3, "SMB3", configuration])
+plantestsuite("samba3.blackbox.token_cache", env, [os.path.join(samba3srcdir, "script/tests/test_token_cache.sh"), '$SERVER', '$USERNAME', '$PASSWORD', smbclient3, net, '$SERVERCONFFILE', configuration])
 
 # plain
 env = "nt4_dc_smb1_done"
@@ -1385,6 +1389,10 @@ for t in tests:
         plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/vfs_fruit_xattr -U$USERNAME%$PASSWORD')
     elif t == "smb2.acls_non_canonical":
         plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/acls_non_canonical -U$USERNAME%$PASSWORD')
+    elif t == "smb2.compression":
+        plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/compression -U$USERNAME%$PASSWORD')
+    elif t == "smb2.acls_access_check_cache":
+        plansmbtorture4testsuite(t, "nt4_dc", '//$SERVER_IP/access_check_cache -U$USERNAME%$PASSWORD')
     elif t == "smb2.async_dosmode":
         plansmbtorture4testsuite("smb2.async_dosmode",
                                  "simpleserver",
@@ -1502,6 +1510,24 @@ for t in smb_transport_tests:
                              '--option=clientsmbtransport:force_bsd_tstream=yes',
                              description="smb-over-bsd-tstream")
 
+io_uring_transport_tests = [
+    "smb2.bench",
+    "smb2.compound",
+    "smb2.connect",
+    "smb2.credits",
+    "smb2.read",
+    "smb2.rw",
+]
+if have_io_uring_transport:
+    for t in io_uring_transport_tests:
+        plansmbtorture4testsuite(t, "fileserver_io_uring",
+                                 '//$SERVER/io_uring_transport -U$USERNAME%$PASSWORD',
+                                 description="io_uring transport")
+    # needs the delayed reads and writes to cancel them
+    plansmbtorture4testsuite("smb2.compound_async", "fileserver_io_uring",
+                             '//$SERVER_IP/aio_delay_inject -U$USERNAME%$PASSWORD',
+                             description="io_uring transport")
+
 test = 'rpc.lsa.lookupsids'
 auth_options = ["", "ntlm", "spnego", "spnego,ntlm", "spnego,smb1", "spnego,smb2"]
 signseal_options = ["", ",connect", ",packet", ",sign", ",seal"]
@@ -854,6 +854,8 @@ static NTSTATUS close_normal_file(struct smb_request *req, files_struct *fsp,
 	 * error here, we must remember this.
 	 */
 
+	status = write_behind_flush(fsp);
+
 	if (NT_STATUS_IS_OK(status) && fsp->op != NULL) {
 		is_durable = fsp->op->global->durable;
 	}
@@ -934,8 +936,13 @@ static NTSTATUS close_normal_file(struct smb_request *req, files_struct *fsp,
 	   the same handle we only have one share mode. Ensure we only remove
 	   the share mode on the last close. */
 
-	tmp = close_remove_share_mode(fsp, close_type);
-	status = ntstatus_keeperror(status, tmp);
+	if (!fsp->fsp_flags.no_share_mode_entry) {
+		tmp = close_remove_share_mode(fsp, close_type);
+		status = ntstatus_keeperror(status, tmp);
+	} else {
+		/* Never publish the entry of a closed stat open */
+		TALLOC_FREE(fsp->deferred_share_entry);
+	}
 
 	/*
 	 * Ensure pending modtime is set before closing underlying fd.
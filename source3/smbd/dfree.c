@@ -22,6 +22,9 @@
 #include "smbd/globals.h"
 #include "lib/util_file.h"
 #include "lib/util/memcache.h"
+#include "dbwrap/dbwrap.h"
+#include "dbwrap/dbwrap_open.h"
+#include "lib/util/util_tdb.h"
 
 /****************************************************************************
  Normalise for DOS usage.
@@ -191,6 +194,187 @@ struct dfree_cached_info {
 	uint64_t dsize;
 };
 
+/****************************************************************************
+ The results are also shared between all smbd processes in dfree_cache.tdb,
+ so that a share used by many clients runs the "dfree command" or the quota
+ queries once per "dfree cache time" and not once per process.
+
+ The results of the "dfree command" only depend on the path, those of
+ the VFS and of the quota queries also on the user.
+****************************************************************************/
+
+static struct db_context *dfree_shared_db(void)
+{
+	static struct db_context *db;
+	static bool open_failed;
+	char *db_path = NULL;
+
+	if (db != NULL || open_failed) {
+		return db;
+	}
+
+	db_path = lock_path(talloc_tos(), "dfree_cache.tdb");
+	if (db_path == NULL) {
+		return NULL;
+	}
+
+	/*
+	 * The record lock is held while the value is computed, which
+	 * calls into the VFS. Don't make it take part in the lock order
+	 * checks of the other databases.
+	 */
+	become_root();
+	db = db_open(NULL, db_path,
+		     SMBD_VOLATILE_TDB_HASH_SIZE,
+		     SMBD_VOLATILE_TDB_FLAGS,
+		     O_RDWR | O_CREAT, 0600,
+		     DBWRAP_LOCK_ORDER_NONE,
+		     DBWRAP_FLAG_NONE);
+	unbecome_root();
+	if (db == NULL) {
+		DBG_WARNING("Could not open %s: %s\n",
+			    db_path, strerror(errno));
+		open_failed = true;
+	}
+	TALLOC_FREE(db_path);
+
+	return db;
+}
+
+static char *dfree_shared_key(TALLOC_CTX *mem_ctx,
+			      connection_struct *conn,
+			      const char *key_path)
+{
+	const struct loadparm_substitution *lp_sub =
+		loadparm_s3_global_substitution();
+	const char *dfree_command = NULL;
+
+	dfree_command = lp_dfree_command(talloc_tos(), lp_sub, SNUM(conn));
+	if (dfree_command != NULL && *dfree_command != '\0') {
+		return talloc_asprintf(mem_ctx,
+				       "%s/cmd:%s/%s",
+				       lp_const_servicename(SNUM(conn)),
+				       dfree_command,
+				       key_path);
+	}
+
+	return talloc_asprintf(mem_ctx,
+			       "%s/uid:%u/%s",
+			       lp_const_servicename(SNUM(conn)),
+			       (unsigned int)get_current_uid(conn),
+			       key_path);
+}
+
+static bool dfree_cached_info_fresh(connection_struct *conn,
+				    const struct dfree_cached_info *dfc,
+				    int dfree_cache_time)
+{
+	return conn->lastused - dfc->last_dfree_time < dfree_cache_time;
+}
+
+static bool dfree_cached_info_pull(TDB_DATA data,
+				   struct dfree_cached_info *dfc)
+{
+	if (data.dsize != sizeof(*dfc)) {
+		return false;
+	}
+	memcpy(dfc, data.dptr, sizeof(*dfc));
+	return true;
+}
+
+struct dfree_shared_parse_state {
+	struct dfree_cached_info *dfc;
+	bool found;
+};
+
+static void dfree_shared_parser(TDB_DATA key, TDB_DATA data,
+				void *private_data)
+{
+	struct dfree_shared_parse_state *state = private_data;
+
+	state->found = dfree_cached_info_pull(data, state->dfc);
+}
+
+/*
+ * Fill in *dfc, from dfree_cache.tdb if another process computed a
+ * recent enough value. Otherwise the value is computed with the record
+ * locked, so that the other processes asking for it at the same time
+ * wait for this one instead of computing it as well.
+ */
+static uint64_t dfree_shared_get(connection_struct *conn,
+				 struct smb_filename *fname,
+				 const char *key_path,
+				 int dfree_cache_time,
+				 struct dfree_cached_info *dfc)
+{
+	struct db_context *db = dfree_shared_db();
+	struct dfree_shared_parse_state state = { .dfc = dfc };
+	struct db_record *rec = NULL;
+	char *key_str = NULL;
+	TDB_DATA key;
+	NTSTATUS status;
+
+	*dfc = (struct dfree_cached_info) { 0 };
+
+	if (db == NULL) {
+		goto compute;
+	}
+
+	key_str = dfree_shared_key(talloc_tos(), conn, key_path);
+	if (key_str == NULL) {
+		goto compute;
+	}
+	key = string_term_tdb_data(key_str);
+
+	status = dbwrap_parse_record(db, key, dfree_shared_parser, &state);
+	if (NT_STATUS_IS_OK(status) && state.found &&
+	    dfree_cached_info_fresh(conn, dfc, dfree_cache_time))
+	{
+		DBG_DEBUG("Returning shared dfree cache entry for %s\n",
+			  key_path);
+		TALLOC_FREE(key_str);
+		return dfc->dfree_ret;
+	}
+
+	rec = dbwrap_fetch_locked(db, key_str, key);
+	if (rec == NULL) {
+		DBG_WARNING("Could not lock dfree cache entry for %s\n",
+			    key_path);
+		TALLOC_FREE(key_str);
+		goto compute;
+	}
+
+	if (dfree_cached_info_pull(dbwrap_record_get_value(rec), dfc) &&
+	    dfree_cached_info_fresh(conn, dfc, dfree_cache_time))
+	{
+		DBG_DEBUG("Returning dfree cache entry for %s computed while "
+			  "waiting\n",
+			  key_path);
+		TALLOC_FREE(key_str);
+		return dfc->dfree_ret;
+	}
+
+compute:
+	dfc->dfree_ret = sys_disk_free(conn, fname,
+				       &dfc->bsize, &dfc->dfree, &dfc->dsize);
+	dfc->last_dfree_time = conn->lastused;
+
+	if (rec != NULL && dfc->dfree_ret != (uint64_t)-1) {
+		status = dbwrap_record_store(rec,
+					     make_tdb_data((uint8_t *)dfc,
+							   sizeof(*dfc)),
+					     0);
+		if (!NT_STATUS_IS_OK(status)) {
+			DBG_WARNING("Could not store dfree cache entry "
+				    "for %s: %s\n",
+				    key_path, nt_errstr(status));
+		}
+	}
+
+	TALLOC_FREE(key_str);
+	return dfc->dfree_ret;
+}
+
 uint64_t get_dfree_info(connection_struct *conn, struct smb_filename *fname,
 			uint64_t *bsize, uint64_t *dfree, uint64_t *dsize)
 {
@@ -267,7 +451,11 @@ uint64_t get_dfree_info(connection_struct *conn, struct smb_filename *fname,
 		goto out;
 	}
 
-	dfree_ret = sys_disk_free(conn, fname, bsize, dfree, dsize);
+	dfree_ret = dfree_shared_get(conn, fname, key_path, dfree_cache_time,
+				     &dfc_new);
+	*bsize = dfc_new.bsize;
+	*dfree = dfc_new.dfree;
+	*dsize = dfc_new.dsize;
 
 	if (dfree_ret == (uint64_t)-1) {
 		/* Don't cache bad data. */
@@ -275,11 +463,6 @@ uint64_t get_dfree_info(connection_struct *conn, struct smb_filename *fname,
 	}
 
 	DBG_DEBUG("Creating dfree cache entry for %s\n", key_path);
-	dfc_new.bsize = *bsize;
-	dfc_new.dfree = *dfree;
-	dfc_new.dsize = *dsize;
-	dfc_new.dfree_ret = dfree_ret;
-	dfc_new.last_dfree_time = conn->lastused;
 	memcache_add(smbd_memcache(),
 		     DFREE_CACHE,
 		     key,
@@ -71,6 +71,12 @@ struct dptr_struct {
 		struct smb_filename *smb_fname;
 		uint32_t mode;
 	} overflow;
+
+	/* Names read from the directory but not yet returned */
+	struct {
+		char **names;
+		size_t next;
+	} readahead;
 };
 
 static NTSTATUS OpenDir_fsp(
@@ -356,11 +362,95 @@ void dptr_RewindDir(struct dptr_struct *dptr)
 	dptr->did_stat = false;
 	TALLOC_FREE(dptr->overflow.fname);
 	TALLOC_FREE(dptr->overflow.smb_fname);
+	TALLOC_FREE(dptr->readahead.names);
+	dptr->readahead.next = 0;
+}
+
+static size_t dptr_readahead_pending(struct dptr_struct *dptr)
+{
+	return talloc_array_length(dptr->readahead.names) -
+		dptr->readahead.next;
 }
 
 unsigned int dptr_FileNumber(struct dptr_struct *dptr)
 {
-	return dptr->dir_hnd->file_number;
+	/*
+	 * Names read ahead have not been seen by the caller yet
+	 */
+	return dptr->dir_hnd->file_number - dptr_readahead_pending(dptr);
+}
+
+/****************************************************************************
+ Read up to max_names names ahead, so that the caller can prefetch their
+ metadata. Later dptr_ReadDirName() calls return them in directory order.
+ Returns the number of names available to look at.
+****************************************************************************/
+
+size_t dptr_read_ahead(struct dptr_struct *dptr,
+		       size_t max_names,
+		       const char * const **_names)
+{
+	struct smb_Dir *dir_hnd = dptr->dir_hnd;
+	size_t num = 0;
+
+	*_names = NULL;
+
+	if (!dptr->has_wild) {
+		return 0;
+	}
+
+	if (dptr_readahead_pending(dptr) > 0) {
+		/* Still busy with the last window */
+		return 0;
+	}
+	TALLOC_FREE(dptr->readahead.names);
+	dptr->readahead.next = 0;
+
+	dptr->readahead.names = talloc_zero_array(dptr, char *, max_names);
+	if (dptr->readahead.names == NULL) {
+		return 0;
+	}
+
+	while (num < max_names) {
+		const char *name = NULL;
+		char *talloced = NULL;
+
+		name = ReadDirName(dir_hnd, &talloced);
+		if (name == NULL) {
+			break;
+		}
+		if (talloced != NULL) {
+			dptr->readahead.names[num] = talloc_move(
+				dptr->readahead.names, &talloced);
+		} else {
+			dptr->readahead.names[num] = talloc_strdup(
+				dptr->readahead.names, name);
+		}
+		if (dptr->readahead.names[num] == NULL) {
+			/*
+			 * Same as a failing talloc_strdup() in
+			 * dptr_ReadDirName(), the name is lost
+			 */
+			break;
+		}
+		num += 1;
+	}
+
+	if (num == 0) {
+		TALLOC_FREE(dptr->readahead.names);
+		return 0;
+	}
+
+	if (num < max_names) {
+		char **names = talloc_realloc(
+			dptr, dptr->readahead.names, char *, num);
+		if (names != NULL) {
+			dptr->readahead.names = names;
+		}
+	}
+
+	*_names = (const char * const *)dptr->readahead.names;
+	return num;
 }
 
 bool dptr_has_wild(struct dptr_struct *dptr)
@@ -408,6 +498,20 @@ char *dptr_ReadDirName(TALLOC_CTX *ctx, struct dptr_struct *dptr)
 	if (dptr->has_wild) {
 		const char *name_temp = NULL;
 		char *talloced = NULL;
+
+		if (dptr_readahead_pending(dptr) > 0) {
+			char **names = dptr->readahead.names;
+			char *name = talloc_move(ctx,
+						 &names[dptr->readahead.next]);
+
+			dptr->readahead.next += 1;
+			if (dptr_readahead_pending(dptr) == 0) {
+				TALLOC_FREE(dptr->readahead.names);
+				dptr->readahead.next = 0;
+			}
+			return name;
+		}
+
 		name_temp = ReadDirName(dir_hnd, &talloced);
 		if (name_temp == NULL) {
 			return NULL;
@@ -45,6 +45,9 @@ bool dptr_get_priv(struct dptr_struct *dptr);
 bool dptr_has_wild(struct dptr_struct *dptr);
 const char *dptr_path(struct smbd_server_connection *sconn, int key);
 char *dptr_ReadDirName(TALLOC_CTX *ctx, struct dptr_struct *dptr);
+size_t dptr_read_ahead(struct dptr_struct *dptr,
+		       size_t max_names,
+		       const char * const **_names);
 void dptr_RewindDir(struct dptr_struct *dptr);
 void dptr_set_priv(struct dptr_struct *dptr);
 const char *dptr_wcard(struct smbd_server_connection *sconn, int key);
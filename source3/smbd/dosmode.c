@@ -914,6 +914,177 @@ NTSTATUS dos_mode_at_recv(struct tevent_req *req, uint32_t *dosmode)
 	return NT_STATUS_OK;
 }
 
+struct dos_mode_at_batch_state {
+	files_struct *dir_fsp;
+	struct smb_filename **smb_fnames;
+	uint32_t *dosmodes;
+
+	/* The entries we ask the VFS about */
+	size_t num_vfs;
+	size_t *vfs_idx;
+	struct smb_filename **vfs_fnames;
+	uint32_t *vfs_dosmodes;
+	NTSTATUS *vfs_statuses;
+};
+
+static void dos_mode_at_batch_done(struct tevent_req *subreq);
+
+/*
+ * Same as dos_mode_at_send() for a batch of entries in one directory
+ */
+struct tevent_req *dos_mode_at_batch_send(TALLOC_CTX *mem_ctx,
+					  struct tevent_context *ev,
+					  files_struct *dir_fsp,
+					  struct smb_filename **smb_fnames,
+					  size_t num_fnames)
+{
+	struct tevent_req *req = NULL;
+	struct dos_mode_at_batch_state *state = NULL;
+	struct tevent_req *subreq = NULL;
+	size_t i;
+
+	DBG_DEBUG("%s: %zu entries\n", fsp_str_dbg(dir_fsp), num_fnames);
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct dos_mode_at_batch_state);
+	if (req == NULL) {
+		return NULL;
+	}
+	*state = (struct dos_mode_at_batch_state) {
+		.dir_fsp = dir_fsp,
+		.smb_fnames = smb_fnames,
+	};
+
+	state->dosmodes = talloc_zero_array(state, uint32_t, num_fnames);
+	state->vfs_idx = talloc_array(state, size_t, num_fnames);
+	state->vfs_fnames = talloc_array(state,
+					 struct smb_filename *,
+					 num_fnames);
+	state->vfs_dosmodes = talloc_zero_array(state, uint32_t, num_fnames);
+	state->vfs_statuses = talloc_zero_array(state, NTSTATUS, num_fnames);
+	if ((state->dosmodes == NULL) || (state->vfs_idx == NULL) ||
+	    (state->vfs_fnames == NULL) || (state->vfs_dosmodes == NULL) ||
+	    (state->vfs_statuses == NULL)) {
+		tevent_req_oom(req);
+		return tevent_req_post(req, ev);
+	}
+
+	for (i = 0; i < num_fnames; i++) {
+		struct smb_filename *smb_fname = smb_fnames[i];
+
+		/* See dos_mode_at_send() */
+		if (!VALID_STAT(smb_fname->st)) {
+			continue;
+		}
+		if (smb_fname->fsp == NULL) {
+			if (ISDOTDOT(smb_fname->base_name)) {
+				state->dosmodes[i] = FILE_ATTRIBUTE_DIRECTORY;
+			} else {
+				state->dosmodes[i] = FILE_ATTRIBUTE_NORMAL;
+			}
+			continue;
+		}
+
+		state->vfs_idx[state->num_vfs] = i;
+		state->vfs_fnames[state->num_vfs] = smb_fname;
+		state->num_vfs += 1;
+	}
+
+	if (state->num_vfs == 0) {
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+	}
+
+	subreq = SMB_VFS_GET_DOS_ATTRIBUTES_BATCH_SEND(state,
+						       ev,
+						       dir_fsp,
+						       state->vfs_fnames,
+						       state->num_vfs);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_set_callback(subreq, dos_mode_at_batch_done, req);
+
+	return req;
+}
+
+static void dos_mode_at_batch_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+		tevent_req_callback_data(subreq,
+		struct tevent_req);
+	struct dos_mode_at_batch_state *state =
+		tevent_req_data(req,
+		struct dos_mode_at_batch_state);
+	struct vfs_aio_state aio_state;
+	NTSTATUS status;
+	size_t i;
+	bool ok;
+
+	/*
+	 * Make sure we run as the user again
+	 */
+	ok = change_to_user_and_service_by_fsp(state->dir_fsp);
+	SMB_ASSERT(ok);
+
+	status = SMB_VFS_GET_DOS_ATTRIBUTES_BATCH_RECV(subreq,
+						       &aio_state,
+						       state->vfs_dosmodes,
+						       state->vfs_statuses);
+	TALLOC_FREE(subreq);
+
+	for (i = 0; i < state->num_vfs; i++) {
+		struct smb_filename *smb_fname = state->vfs_fnames[i];
+		NTSTATUS entry_status = status;
+		uint32_t dosmode = 0;
+
+		if (NT_STATUS_IS_OK(entry_status)) {
+			entry_status = state->vfs_statuses[i];
+			dosmode = state->vfs_dosmodes[i];
+		}
+
+		/*
+		 * Same error handling as in
+		 * dos_mode_at_vfs_get_dosmode_done()
+		 */
+		if (NT_STATUS_EQUAL(entry_status, NT_STATUS_NOT_IMPLEMENTED) ||
+		    NT_STATUS_EQUAL(entry_status, NT_STATUS_NOT_SUPPORTED))
+		{
+			dosmode = fdos_mode(smb_fname->fsp);
+		} else {
+			if (!NT_STATUS_IS_OK(entry_status)) {
+				dosmode = 0;
+			}
+			dosmode = dos_mode_post(dosmode,
+						smb_fname->fsp,
+						__func__);
+		}
+
+		state->dosmodes[state->vfs_idx[i]] = dosmode;
+	}
+
+	tevent_req_done(req);
+}
+
+NTSTATUS dos_mode_at_batch_recv(struct tevent_req *req, uint32_t *dosmodes)
+{
+	struct dos_mode_at_batch_state *state =
+		tevent_req_data(req,
+		struct dos_mode_at_batch_state);
+	NTSTATUS status;
+
+	if (tevent_req_is_nterror(req, &status)) {
+		tevent_req_received(req);
+		return status;
+	}
+
+	memcpy(dosmodes,
+	       state->dosmodes,
+	       talloc_array_length(state->dosmodes) * sizeof(uint32_t));
+	tevent_req_received(req);
+	return NT_STATUS_OK;
+}
+
 /*******************************************************************
  chmod a file - but preserve some bits.
  If "store dos attributes" is also set it will store the create time
@@ -551,6 +551,7 @@ struct vfs_default_durable_reconnect_state {
 	struct files_struct *dirfsp;
 	struct smb_filename *rel_fname;
 	DATA_BLOB new_cookie_blob;
+	SMBPROFILE_BASIC_ASYNC_STATE(profile_locked);
 };
 
 static void vfs_default_durable_reconnect_fn(struct share_mode_lock *lck,
@@ -883,7 +884,7 @@ NTSTATUS vfs_default_durable_reconnect(struct connection_struct *conn,
 			nt_errstr(status));
 		return status;
 	}
-	state.fsp->file_id = file_id;
+	fsp_set_file_id(state.fsp, file_id);
 	state.fsp->file_pid = smb1req->smbpid;
 	state.fsp->vuid = smb1req->vuid;
 	state.fsp->fnum = op->local_id;
@@ -915,9 +916,13 @@ NTSTATUS vfs_default_durable_reconnect(struct connection_struct *conn,
 	 */
 	state.fsp->fsp_flags.aio_write_behind = false;
 
+	SMBPROFILE_BASIC_ASYNC_START(durable_reconnect_locked,
+				     profile_p,
+				     state.profile_locked);
 	status = share_mode_do_locked_brl(state.fsp,
 					  vfs_default_durable_reconnect_fn,
 					  &state);
+	SMBPROFILE_BASIC_ASYNC_END(state.profile_locked);
 	if (!NT_STATUS_IS_OK(status)) {
 		DBG_ERR("share_mode_do_locked_brl [%s] failed: %s\n",
 			smb_fname_str_dbg(smb_fname), nt_errstr(status));
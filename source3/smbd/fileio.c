@@ -197,6 +197,8 @@ void mark_file_modified(files_struct *fsp,
 	int dosmode;
 	NTSTATUS status;
 
+	fsp_lease_stat_invalidate(fsp);
+
 	if (fsp->fsp_flags.write_time_forced &&
 	    modified_state->valid)
 	{
@@ -294,6 +296,320 @@ ssize_t write_file(struct smb_request *req,
 	return total_written;
 }
 
+/*
+ * Write-behind buffer for small sequential SMB2 writes, see
+ * "smb2 write behind size". Only used while the handle holds a write
+ * lease or an exclusive oplock: nobody else can look at the file
+ * without breaking it first, and we write the buffer out before
+ * sending the break. Reads, stats, size changes, FLUSH and CLOSE on
+ * the handle write it out as well, a timer bounds how long data
+ * stays in memory.
+ */
+
+#define WRITE_BEHIND_FLUSH_MSEC 1000
+
+struct write_behind {
+	struct files_struct *fsp;
+	struct tevent_timer *te;
+	off_t offset;
+	size_t length;
+	size_t size;
+	int error;
+	uint8_t *buf;
+};
+
+/* Number of handles with buffered data in this process */
+static size_t num_write_behind_dirty;
+
+static bool write_behind_possible(struct files_struct *fsp,
+				  const char *data,
+				  off_t pos,
+				  size_t n,
+				  bool write_through)
+{
+	int size = lp_smb2_write_behind_size(SNUM(fsp->conn));
+	uint32_t lease_type;
+
+	if (fsp->write_behind != NULL) {
+		size = fsp->write_behind->size;
+	}
+	if ((size <= 0) || (n == 0) || (n >= (size_t)size)) {
+		return false;
+	}
+	if ((data == NULL) || write_through) {
+		/* recvfile or explicit write through */
+		return false;
+	}
+	if (fsp->print_file ||
+	    !fsp->fsp_flags.can_write ||
+	    fsp->fsp_flags.write_time_forced ||
+	    fsp->fsp_flags.posix_append)
+	{
+		return false;
+	}
+	if (!vfs_valid_pwrite_range(fsp, pos, n)) {
+		return false;
+	}
+	if (fsp->op == NULL) {
+		return false;
+	}
+	if (lp_kernel_oplocks(SNUM(fsp->conn)) ||
+	    (lp_strict_sync(SNUM(fsp->conn)) &&
+	     lp_sync_always(SNUM(fsp->conn))))
+	{
+		return false;
+	}
+
+	if (fsp->oplock_type == LEASE_OPLOCK) {
+		lease_type = fsp_lease_type(fsp);
+		if ((lease_type & SMB2_LEASE_WRITE) == 0) {
+			return false;
+		}
+		if (fsp->lease->lease.lease_flags &
+		    SMB2_LEASE_FLAG_BREAK_IN_PROGRESS)
+		{
+			return false;
+		}
+		return true;
+	}
+
+	if (!EXCLUSIVE_OPLOCK_TYPE(fsp->oplock_type)) {
+		return false;
+	}
+	if (fsp->sent_oplock_break != NO_BREAK_SENT) {
+		return false;
+	}
+
+	return true;
+}
+
+static bool write_behind_lock_ok(struct files_struct *fsp,
+				 off_t pos,
+				 size_t n)
+{
+	struct lock_struct lock;
+
+	init_strict_lock_struct(fsp,
+				fsp->op->global->open_persistent_id,
+				pos,
+				n,
+				WRITE_LOCK,
+				&lock);
+
+	return SMB_VFS_STRICT_LOCK_CHECK(fsp->conn, fsp, &lock);
+}
+
+/****************************************************************************
+ Write out buffered data of a handle, but keep any write error for
+ write_behind_flush().
+****************************************************************************/
+
+void write_behind_sync(struct files_struct *fsp)
+{
+	struct write_behind *wb = fsp->write_behind;
+	size_t length;
+	ssize_t ret;
+
+	if ((wb == NULL) || (wb->length == 0)) {
+		return;
+	}
+
+	TALLOC_FREE(wb->te);
+
+	length = wb->length;
+	wb->length = 0;
+	num_write_behind_dirty -= 1;
+
+	ret = real_write_file(NULL, fsp, (char *)wb->buf, wb->offset, length);
+	if (ret == -1) {
+		DBG_WARNING("Writing %zu bytes at %jd to %s failed: %s\n",
+			    length,
+			    (intmax_t)wb->offset,
+			    fsp_str_dbg(fsp),
+			    strerror(errno));
+		wb->error = errno;
+	} else if ((size_t)ret != length) {
+		DBG_WARNING("Short write of %zd/%zu bytes to %s\n",
+			    ret,
+			    length,
+			    fsp_str_dbg(fsp));
+		wb->error = ENOSPC;
+	}
+}
+
+/****************************************************************************
+ Write out buffered data of a handle and return the first write error
+ since the last call.
+****************************************************************************/
+
+NTSTATUS write_behind_flush(struct files_struct *fsp)
+{
+	struct write_behind *wb = fsp->write_behind;
+	int error;
+
+	if (wb == NULL) {
+		return NT_STATUS_OK;
+	}
+
+	write_behind_sync(fsp);
+
+	error = wb->error;
+	wb->error = 0;
+
+	if (error != 0) {
+		return map_nt_error_from_unix(error);
+	}
+	return NT_STATUS_OK;
+}
+
+/****************************************************************************
+ Write out the buffers of all our handles on a file.
+****************************************************************************/
+
+void write_behind_sync_file_id(struct smbd_server_connection *sconn,
+			       struct file_id id)
+{
+	struct files_struct *fsp = NULL;
+
+	if (num_write_behind_dirty == 0) {
+		return;
+	}
+
+	for (fsp = file_find_di_first(sconn, id, false);
+	     fsp != NULL;
+	     fsp = file_find_di_next(fsp, false))
+	{
+		write_behind_sync(fsp);
+	}
+}
+
+static struct files_struct *write_behind_sync_fn(struct files_struct *fsp,
+						 void *private_data)
+{
+	write_behind_sync(fsp);
+	return NULL;
+}
+
+/****************************************************************************
+ Write out the buffers of all handles of this process.
+****************************************************************************/
+
+void write_behind_sync_all(struct smbd_server_connection *sconn)
+{
+	if (num_write_behind_dirty == 0) {
+		return;
+	}
+	files_forall(sconn, write_behind_sync_fn, NULL);
+}
+
+static void write_behind_timer(struct tevent_context *ev,
+			       struct tevent_timer *te,
+			       struct timeval current_time,
+			       void *private_data)
+{
+	struct write_behind *wb = talloc_get_type_abort(
+		private_data, struct write_behind);
+
+	TALLOC_FREE(wb->te);
+	write_behind_sync(wb->fsp);
+}
+
+static int write_behind_destructor(struct write_behind *wb)
+{
+	if (wb->length != 0) {
+		DBG_ERR("Dropping %zu buffered bytes of %s\n",
+			wb->length,
+			fsp_str_dbg(wb->fsp));
+		num_write_behind_dirty -= 1;
+	}
+	return 0;
+}
+
+/****************************************************************************
+ Add a write to the write-behind buffer of a handle if possible.
+ Returns false if the caller needs to do the write itself.
+****************************************************************************/
+
+bool write_behind_file(files_struct *fsp,
+		       const char *data,
+		       off_t pos,
+		       size_t n,
+		       bool write_through)
+{
+	struct write_behind *wb = fsp->write_behind;
+	struct file_modified_state state;
+
+	if (!write_behind_possible(fsp, data, pos, n, write_through) ||
+	    !write_behind_lock_ok(fsp, pos, n))
+	{
+		/*
+		 * Keep the order of writes, the caller reports
+		 * lock conflicts.
+		 */
+		write_behind_sync(fsp);
+		return false;
+	}
+
+	if ((wb != NULL) &&
+	    (wb->length != 0) &&
+	    ((pos != wb->offset + (off_t)wb->length) ||
+	     (wb->length + n > wb->size)))
+	{
+		write_behind_sync(fsp);
+	}
+
+	if (wb == NULL) {
+		size_t size = lp_smb2_write_behind_size(SNUM(fsp->conn));
+
+		wb = talloc_zero(fsp, struct write_behind);
+		if (wb == NULL) {
+			return false;
+		}
+		wb->fsp = fsp;
+		wb->size = size;
+		wb->buf = talloc_size(wb, size);
+		if (wb->buf == NULL) {
+			TALLOC_FREE(wb);
+			return false;
+		}
+		talloc_set_destructor(wb, write_behind_destructor);
+		fsp->write_behind = wb;
+	}
+
+	if (wb->length == 0) {
+		wb->te = tevent_add_timer(
+			fsp->conn->sconn->ev_ctx,
+			wb,
+			timeval_current_ofs_msec(WRITE_BEHIND_FLUSH_MSEC),
+			write_behind_timer,
+			wb);
+		if (wb->te == NULL) {
+			return false;
+		}
+		wb->offset = pos;
+		num_write_behind_dirty += 1;
+	}
+
+	prepare_file_modified(fsp, &state);
+
+	memcpy(wb->buf + wb->length, data, n);
+	wb->length += n;
+
+	mark_file_modified(fsp, true, &state);
+
+	DBG_DEBUG("%s: buffered %zu bytes at %jd, %zu pending\n",
+		  fsp_str_dbg(fsp),
+		  n,
+		  (intmax_t)pos,
+		  wb->length);
+
+	if (wb->length == wb->size) {
+		write_behind_sync(fsp);
+	}
+
+	return true;
+}
+
 /*******************************************************************
 sync a file
 ********************************************************************/
@@ -325,6 +325,8 @@ NTSTATUS get_real_filename_full_scan_at(struct files_struct *dirfsp,
 		return status;
 	}
 
+	DO_PROFILE_INC(mangle_dir_scans);
+
 	/* now scan for matching names */
 	while ((dname = ReadDirName(cur_dir, &talloced))) {
 
@@ -102,6 +102,125 @@ void fsp_set_gen_id(files_struct *fsp)
 	fh_set_gen_id(fsp->fh, gen_id);
 }
 
+/*
+ * With many thousands of open files per smbd walking sconn->files
+ * to find the opens of a file shows up in profiles. So the files
+ * are also kept in a hash table by file_id. The hash is stored in
+ * the fsp, it's only valid as long as fsp->file_id is changed via
+ * fsp_set_file_id().
+ */
+
+#define FILE_ID_INDEX_MIN_BUCKETS 64
+
+static uint64_t file_id_index_hash(const struct file_id *id)
+{
+	uint64_t h = id->devid;
+
+	h = (h ^ id->inode) * UINT64_C(0x9E3779B97F4A7C15);
+	h = (h ^ id->extid) * UINT64_C(0x9E3779B97F4A7C15);
+	return h ^ (h >> 32);
+}
+
+static struct files_struct **file_id_index_bucket(
+	struct smbd_server_connection *sconn, uint64_t hash)
+{
+	size_t idx = hash & (sconn->file_id_index.num_buckets - 1);
+	return &sconn->file_id_index.buckets[idx];
+}
+
+static void file_id_index_remove(struct files_struct *fsp)
+{
+	struct smbd_server_connection *sconn = fsp->conn->sconn;
+	struct files_struct **pp = NULL;
+
+	if (!fsp->file_id_indexed) {
+		return;
+	}
+
+	pp = file_id_index_bucket(sconn, fsp->file_id_hash);
+	while (*pp != fsp) {
+		SMB_ASSERT(*pp != NULL);
+		pp = &(*pp)->file_id_next;
+	}
+	*pp = fsp->file_id_next;
+
+	fsp->file_id_next = NULL;
+	fsp->file_id_indexed = false;
+	sconn->file_id_index.num_files -= 1;
+}
+
+static void file_id_index_grow(struct smbd_server_connection *sconn)
+{
+	struct files_struct **old = sconn->file_id_index.buckets;
+	size_t old_num = sconn->file_id_index.num_buckets;
+	struct files_struct **new_buckets = NULL;
+	size_t new_num;
+	size_t i;
+
+	new_num = MAX(old_num * 2, FILE_ID_INDEX_MIN_BUCKETS);
+
+	new_buckets = talloc_zero_array(sconn, struct files_struct *, new_num);
+	if (new_buckets == NULL) {
+		/*
+		 * Just live with longer chains
+		 */
+		return;
+	}
+
+	sconn->file_id_index.buckets = new_buckets;
+	sconn->file_id_index.num_buckets = new_num;
+
+	for (i = 0; i < old_num; i++) {
+		struct files_struct *fsp = old[i];
+
+		while (fsp != NULL) {
+			struct files_struct *next = fsp->file_id_next;
+			struct files_struct **bucket =
+				file_id_index_bucket(sconn, fsp->file_id_hash);
+
+			fsp->file_id_next = *bucket;
+			*bucket = fsp;
+			fsp = next;
+		}
+	}
+
+	TALLOC_FREE(old);
+}
+
+void fsp_set_file_id(struct files_struct *fsp, struct file_id id)
+{
+	struct smbd_server_connection *sconn = fsp->conn->sconn;
+	struct files_struct **bucket = NULL;
+
+	file_id_index_remove(fsp);
+
+	fsp->file_id = id;
+
+	if (sconn->file_id_index.num_files >=
+	    sconn->file_id_index.num_buckets) {
+		file_id_index_grow(sconn);
+	}
+	if (sconn->file_id_index.num_buckets == 0) {
+		return;
+	}
+
+	fsp->file_id_hash = file_id_index_hash(&id);
+	bucket = file_id_index_bucket(sconn, fsp->file_id_hash);
+	fsp->file_id_next = *bucket;
+	*bucket = fsp;
+	fsp->file_id_indexed = true;
+	sconn->file_id_index.num_files += 1;
+}
+
+static struct files_struct *file_id_index_first(
+	struct smbd_server_connection *sconn, const struct file_id *id)
+{
+	if (sconn->file_id_index.num_buckets == 0) {
+		return NULL;
+	}
+	return *file_id_index_bucket(sconn, file_id_index_hash(id));
+}
+
 /****************************************************************************
  Find first available file slot.
 ****************************************************************************/
@@ -142,7 +261,6 @@ NTSTATUS fsp_bind_smb(struct files_struct *fsp, struct smb_request *req)
 NTSTATUS file_new(struct smb_request *req, connection_struct *conn,
 		  files_struct **result)
 {
-	struct smbd_server_connection *sconn = conn->sconn;
 	files_struct *fsp;
 	NTSTATUS status;
 
@@ -179,13 +297,6 @@ NTSTATUS file_new(struct smb_request *req, connection_struct *conn,
 
 	DBG_INFO("new file %s\n", fsp_fnum_dbg(fsp));
 
-	/* A new fsp invalidates the positive and
-	  negative fsp_fi_cache as the new fsp is pushed
-	  at the start of the list and we search from
-	  a cache hit to the *end* of the list. */
-
-	ZERO_STRUCT(sconn->fsp_fi_cache);
-
 	*result = fsp;
 	return NT_STATUS_OK;
 }
@@ -280,7 +391,7 @@ NTSTATUS open_internal_dirfsp(connection_struct *conn,
 		return NT_STATUS_NOT_A_DIRECTORY;
 	}
 
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st));
 
 	*_fsp = fsp;
 	return NT_STATUS_OK;
@@ -422,7 +533,6 @@ static NTSTATUS openat_pathref_fullname(
 
 	GetTimeOfDay(&fsp->open_time);
 	fsp_set_gen_id(fsp);
-	ZERO_STRUCT(conn->sconn->fsp_fi_cache);
 
 	fsp->fsp_flags.is_pathref = true;
 
@@ -469,7 +579,7 @@ static NTSTATUS openat_pathref_fullname(
 
 	fsp->fsp_flags.is_directory = S_ISDIR(fsp->fsp_name->st.st_ex_mode);
 
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st));
 
 	status = fsp_smb_fname_link(fsp,
 				    &smb_fname->fsp_link,
@@ -599,7 +709,6 @@ NTSTATUS open_rootdir_pathref_fsp(connection_struct *conn,
 	}
 	GetTimeOfDay(&fsp->open_time);
 	fsp_set_gen_id(fsp);
-	ZERO_STRUCT(conn->sconn->fsp_fi_cache);
 	fsp->fsp_flags.is_pathref = true;
 
 	status = fsp_set_smb_fname(fsp, &slash);
@@ -629,7 +738,7 @@ NTSTATUS open_rootdir_pathref_fsp(connection_struct *conn,
 		status = NT_STATUS_UNEXPECTED_IO_ERROR;
 		goto close_fail;
 	}
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st));
 	*_fsp = fsp;
 	return NT_STATUS_OK;
 
@@ -679,7 +788,6 @@ NTSTATUS open_stream_pathref_fsp(
 
 	GetTimeOfDay(&fsp->open_time);
 	fsp_set_gen_id(fsp);
-	ZERO_STRUCT(conn->sconn->fsp_fi_cache);
 
 	fsp->fsp_flags.is_pathref = true;
 
@@ -709,7 +817,7 @@ NTSTATUS open_stream_pathref_fsp(
 	smb_fname->st = fsp->fsp_name->st;
 
 	fsp->fsp_flags.is_directory = S_ISDIR(fsp->fsp_name->st.st_ex_mode);
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st));
 
 	status = fsp_smb_fname_link(fsp, &smb_fname->fsp_link, &smb_fname->fsp);
 	if (!NT_STATUS_IS_OK(status)) {
@@ -1036,6 +1144,257 @@ lookup:
 	return fd;
 }
 
+/*
+ * Per connection cache of pathref fsps for directories walked by
+ * openat_pathref_fsp_nosymlink(). Opening deep paths component by
+ * component costs one openat() and close() per level. Subsequent
+ * walks below a cached directory start at the deepest cached
+ * ancestor.
+ *
+ * An entry is keyed by the path relative to the share root as passed
+ * in. Before use it is checked that the path still leads to the same
+ * file_id, and entries expire after PATH_WALK_CACHE_TTL seconds.
+ * Directory renames done by us flush the cache.
+ */
+
+#define PATH_WALK_CACHE_SIZE 32
+#define PATH_WALK_CACHE_TTL 5
+
+struct path_walk_cache_entry {
+	struct path_walk_cache_entry *prev, *next;
+	struct path_walk_cache *cache;
+	char *path;
+	size_t pathlen;
+	bool posix;
+	/*
+	 * The walk checked traverse permissions for this user only
+	 */
+	const struct auth_session_info *session_info;
+	time_t added;
+	struct files_struct *fsp;
+};
+
+struct path_walk_cache {
+	struct path_walk_cache_entry *entries;
+	size_t num_entries;
+};
+
+static int path_walk_cache_entry_destructor(struct path_walk_cache_entry *e)
+{
+	DLIST_REMOVE(e->cache->entries, e);
+	e->cache->num_entries -= 1;
+
+	if (e->fsp != NULL) {
+		fd_close(e->fsp);
+		file_free(NULL, e->fsp);
+		e->fsp = NULL;
+	}
+	return 0;
+}
+
+void path_walk_cache_flush(connection_struct *conn)
+{
+	TALLOC_FREE(conn->path_walk_cache);
+}
+
+/*
+ * Open "." below dirfsp into fsp, giving a second pathref to the same
+ * directory
+ */
+static int path_walk_cache_open_dot(struct files_struct *dirfsp,
+				    struct files_struct *fsp)
+{
+	struct smb_filename dot = {
+		.base_name = discard_const_p(char, "."),
+		.twrp = dirfsp->fsp_name->twrp,
+		.flags = dirfsp->fsp_name->flags,
+	};
+	struct vfs_open_how how = {
+		.flags = O_NOFOLLOW | O_NONBLOCK | O_DIRECTORY,
+	};
+
+#ifdef O_PATH
+	how.flags |= O_PATH;
+#endif
+
+	return SMB_VFS_OPENAT(dirfsp->conn, dirfsp, &dot, fsp, &how);
+}
+
+/*
+ * Find the deepest valid cached directory for path. *_rest is set to
+ * the remaining components or NULL if the whole path is cached.
+ */
+static struct files_struct *path_walk_cache_lookup(connection_struct *conn,
+						   const char *path,
+						   bool posix,
+						   const char **_rest)
+{
+	struct path_walk_cache *cache = conn->path_walk_cache;
+	struct path_walk_cache_entry *e = NULL, *next = NULL;
+	struct path_walk_cache_entry *best = NULL;
+	size_t pathlen = strlen(path);
+	time_t now;
+
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	DO_PROFILE_INC(path_walk_cache_lookups);
+
+	now = time_mono(NULL);
+
+	for (e = cache->entries; e != NULL; e = next) {
+		next = e->next;
+
+		if (now - e->added > PATH_WALK_CACHE_TTL) {
+			DO_PROFILE_INC(path_walk_cache_expired);
+			TALLOC_FREE(e);
+			continue;
+		}
+		if ((e->posix != posix) ||
+		    (e->session_info != conn->session_info)) {
+			continue;
+		}
+		if (e->pathlen > pathlen) {
+			continue;
+		}
+		if ((best != NULL) && (e->pathlen <= best->pathlen)) {
+			continue;
+		}
+		if (strncmp(e->path, path, e->pathlen) != 0) {
+			continue;
+		}
+		if ((path[e->pathlen] != '\0') && (path[e->pathlen] != '/')) {
+			continue;
+		}
+		best = e;
+	}
+
+	if (best != NULL) {
+		struct smb_filename smb_fname = {
+			.base_name = best->path,
+			.flags = posix ? SMB_FILENAME_POSIX_PATH : 0,
+		};
+		struct file_id id;
+		int ret;
+
+		ret = SMB_VFS_FSTATAT(conn,
+				      conn->cwd_fsp,
+				      &smb_fname,
+				      &smb_fname.st,
+				      AT_SYMLINK_NOFOLLOW);
+		if (ret == -1) {
+			DO_PROFILE_INC(path_walk_cache_expired);
+			TALLOC_FREE(best);
+			return NULL;
+		}
+		id = vfs_file_id_from_sbuf(conn, &smb_fname.st);
+		if (!file_id_equal(&id, &best->fsp->file_id)) {
+			DBG_DEBUG("%s changed\n", best->path);
+			DO_PROFILE_INC(path_walk_cache_expired);
+			TALLOC_FREE(best);
+			return NULL;
+		}
+	}
+
+	if (best == NULL) {
+		return NULL;
+	}
+
+	DO_PROFILE_INC(path_walk_cache_hits);
+	DLIST_PROMOTE(cache->entries, best);
+
+	*_rest = (path[best->pathlen] == '\0') ?
+		NULL : path + best->pathlen + 1;
+
+	DBG_DEBUG("%s: starting at %s\n", path, fsp_str_dbg(best->fsp));
+
+	return best->fsp;
+}
+
+static void path_walk_cache_add(connection_struct *conn,
+				const char *path,
+				bool posix,
+				struct files_struct *dirfsp)
+{
+	struct path_walk_cache *cache = conn->path_walk_cache;
+	struct path_walk_cache_entry *e = NULL;
+	struct files_struct *fsp = NULL;
+	NTSTATUS status;
+	int fd;
+
+	if (cache == NULL) {
+		cache = talloc_zero(conn, struct path_walk_cache);
+		if (cache == NULL) {
+			return;
+		}
+		conn->path_walk_cache = cache;
+	}
+
+	for (e = cache->entries; e != NULL; e = e->next) {
+		if ((e->session_info == conn->session_info) &&
+		    (e->posix == posix) &&
+		    (strcmp(e->path, path) == 0)) {
+			TALLOC_FREE(e);
+			break;
+		}
+	}
+
+	if (cache->num_entries >= PATH_WALK_CACHE_SIZE) {
+		struct path_walk_cache_entry *last = DLIST_TAIL(cache->entries);
+		TALLOC_FREE(last);
+	}
+
+	e = talloc_zero(cache, struct path_walk_cache_entry);
+	if (e == NULL) {
+		return;
+	}
+	e->cache = cache;
+	e->pathlen = strlen(path);
+	e->path = talloc_strndup(e, path, e->pathlen);
+	if (e->path == NULL) {
+		TALLOC_FREE(e);
+		return;
+	}
+	e->posix = posix;
+	e->session_info = conn->session_info;
+	e->added = time_mono(NULL);
+
+	status = fsp_new(conn, conn, &fsp);
+	if (!NT_STATUS_IS_OK(status)) {
+		TALLOC_FREE(e);
+		return;
+	}
+	GetTimeOfDay(&fsp->open_time);
+	fsp_set_gen_id(fsp);
+	fsp->fsp_flags.is_pathref = true;
+	fsp->fsp_flags.is_directory = true;
+
+	status = fsp_set_smb_fname(fsp, dirfsp->fsp_name);
+	if (!NT_STATUS_IS_OK(status)) {
+		file_free(NULL, fsp);
+		TALLOC_FREE(e);
+		return;
+	}
+
+	fd = path_walk_cache_open_dot(dirfsp, fsp);
+	if (fd == -1) {
+		DBG_DEBUG("reopening %s failed: %s\n",
+			  fsp_str_dbg(dirfsp),
+			  strerror(errno));
+		file_free(NULL, fsp);
+		TALLOC_FREE(e);
+		return;
+	}
+	fsp_set_fd(fsp, fd);
+	fsp_set_file_id(fsp, dirfsp->file_id);
+
+	e->fsp = fsp;
+	DLIST_ADD(cache->entries, e);
+	cache->num_entries += 1;
+	talloc_set_destructor(e, path_walk_cache_entry_destructor);
+}
+
 NTSTATUS openat_pathref_fsp_nosymlink(
 	TALLOC_CTX *mem_ctx,
 	struct connection_struct *conn,
@@ -1060,8 +1419,9 @@ NTSTATUS openat_pathref_fsp_nosymlink(
 	struct smb_filename *result = NULL;
 	struct reparse_data_buffer *symlink_err = NULL;
 	struct files_struct *fsp = NULL;
+	const char *orig_path_in = path_in;
 	char *path = NULL, *next = NULL;
-	bool ok, is_toplevel;
+	bool ok, is_toplevel, use_cache, use_beneath, cache_exact = false;
 	int fd;
 	NTSTATUS status;
 	struct vfs_open_how how = {
@@ -1079,7 +1439,6 @@ NTSTATUS openat_pathref_fsp_nosymlink(
 
 	GetTimeOfDay(&fsp->open_time);
 	fsp_set_gen_id(fsp);
-	ZERO_STRUCT(conn->sconn->fsp_fi_cache);
 
 	fsp->fsp_name = &full_fname;
 
@@ -1157,18 +1516,97 @@ NTSTATUS openat_pathref_fsp_nosymlink(
 		rel_fname.base_name = next;
 	}
 
-	if (conn->open_how_resolve & VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS) {
+	use_cache = lp_path_walk_cache(SNUM(conn)) &&
+		    (twrp == 0) &&
+		    (in_dirfsp == conn->cwd_fsp);
+
+	if (use_cache) {
+		struct files_struct *cached = NULL;
+		const char *rest = NULL;
+
+		cached = path_walk_cache_lookup(conn, path_in, posix, &rest);
+		if (cached != NULL) {
+			TALLOC_FREE(full_fname.base_name);
+			full_fname.base_name = talloc_strdup(
+				talloc_tos(), cached->fsp_name->base_name);
+			if (full_fname.base_name == NULL) {
+				goto nomem;
+			}
+
+			/*
+			 * From here on the cached fsp takes the role
+			 * of the passed in dirfsp, it must not be
+			 * closed below.
+			 */
+			in_dirfsp = dirfsp = cached;
+
+			if (rest == NULL) {
+				cache_exact = true;
+
+				fd = path_walk_cache_open_dot(dirfsp, fsp);
+				if (fd == -1) {
+					status = map_nt_error_from_unix(errno);
+					goto fail;
+				}
+				fsp_set_fd(fsp, fd);
+				goto done;
+			}
+
+			path_in = rest;
+
+			TALLOC_FREE(path);
+			path = path_to_strv(talloc_tos(), path_in);
+			if (path == NULL) {
+				goto nomem;
+			}
+		}
+	}
+
+	/*
+	 * Shares following symlinks can resolve the whole path in the
+	 * kernel as long as the result stays below dirfsp. This is only
+	 * done with "vfs_default:VFS_OPEN_HOW_RESOLVE_BENEATH = yes", as
+	 * the name recorded below then still contains the symlinks.
+	 *
+	 * POSIX clients must see the symlinks. Veto files have to be
+	 * checked against the symlink targets and that only the
+	 * component by component walk does.
+	 */
+	use_beneath = (conn->open_how_resolve & VFS_OPEN_HOW_RESOLVE_BENEATH) &&
+		      lp_follow_symlinks(SNUM(conn)) &&
+		      !posix &&
+		      (conn->veto_list == NULL);
+
+	if (use_beneath ||
+	    (conn->open_how_resolve & VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS)) {
+		int saved_flags = how.flags;
 
 		/*
-		 * Try a direct openat2 with RESOLVE_NO_SYMLINKS to
-		 * avoid the openat/close loop further down.
+		 * Try a direct openat2 with RESOLVE_NO_SYMLINKS or
+		 * RESOLVE_BENEATH to avoid the openat/close loop
+		 * further down.
 		 */
 
 		rel_fname.base_name = discard_const_p(char, path_in);
-		how.resolve = VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS;
+		if (use_beneath) {
+			how.resolve = VFS_OPEN_HOW_RESOLVE_BENEATH;
+			/*
+			 * A symlink as last component needs the walk
+			 * to be reported relative to its real parent
+			 * directory, O_DIRECTORY|O_NOFOLLOW makes it
+			 * fail with ENOTDIR.
+			 */
+			how.flags |= O_DIRECTORY;
+		} else {
+			how.resolve = VFS_OPEN_HOW_RESOLVE_NO_SYMLINKS;
+		}
+
+		DO_PROFILE_INC(path_walk_openat2_lookups);
 
 		fd = SMB_VFS_OPENAT(conn, dirfsp, &rel_fname, fsp, &how);
+		how.flags = saved_flags;
 		if (fd >= 0) {
+			DO_PROFILE_INC(path_walk_openat2_hits);
 			fsp_set_fd(fsp, fd);
 			ok = full_path_extend(&full_fname.base_name,
 					      rel_fname.base_name);
@@ -1179,9 +1617,11 @@ NTSTATUS openat_pathref_fsp_nosymlink(
 		}
 
 		status = map_nt_error_from_unix(errno);
-		DBG_DEBUG("SMB_VFS_OPENAT(%s, %s, RESOLVE_NO_SYMLINKS) "
+		DBG_DEBUG("SMB_VFS_OPENAT(%s, %s, %s) "
 			  "returned %d %s => %s\n",
 			  smb_fname_str_dbg(dirfsp->fsp_name), path_in,
+			  use_beneath ? "RESOLVE_BENEATH" :
+					"RESOLVE_NO_SYMLINKS",
 			  errno, strerror(errno), nt_errstr(status));
 		SMB_ASSERT(fd == -1);
 		switch (errno) {
@@ -1205,6 +1645,15 @@ NTSTATUS openat_pathref_fsp_nosymlink(
 			 */
 			break;
 
+		case EXDEV:
+		case EAGAIN:
+			/*
+			 * RESOLVE_BENEATH: A symlink points outside
+			 * of dirfsp, or a concurrent rename made the
+			 * kernel give up. Let the walk sort it out.
+			 */
+			break;
+
 		case ENOENT:
 			/*
 			 * If we got ENOENT, the filesystem could
@@ -1218,6 +1667,8 @@ NTSTATUS openat_pathref_fsp_nosymlink(
 			goto fail;
 		}
 
+		DO_PROFILE_INC(path_walk_openat2_fallbacks);
+
 		/*
 		 * Just fallback to the openat loop
 		 */
@@ -1455,7 +1906,7 @@ done:
 	 * open.c will use this to check if delete_on_close
 	 * has been set on the dirfsp.
 	 */
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st));
 
 	result = cp_smb_filename(mem_ctx, fsp->fsp_name);
 	if (result == NULL) {
@@ -1471,6 +1922,10 @@ done:
 	}
 	talloc_set_destructor(result, smb_fname_fsp_destructor);
 
+	if (use_cache && !cache_exact && S_ISDIR(fsp->fsp_name->st.st_ex_mode)) {
+		path_walk_cache_add(conn, orig_path_in, posix, fsp);
+	}
+
 	*_smb_fname = result;
 
 	DBG_DEBUG("returning %s\n", smb_fname_str_dbg(result));
@@ -1552,7 +2007,6 @@ NTSTATUS openat_pathref_fsp_lcomp(struct files_struct *dirfsp,
 
 	GetTimeOfDay(&fsp->open_time);
 	fsp_set_gen_id(fsp);
-	ZERO_STRUCT(conn->sconn->fsp_fi_cache);
 
 	fsp->fsp_flags.is_pathref = true;
 
@@ -1642,7 +2096,7 @@ NTSTATUS openat_pathref_fsp_lcomp(struct files_struct *dirfsp,
 	fsp->fsp_flags.is_directory = S_ISDIR(fsp->fsp_name->st.st_ex_mode);
 	fsp->fsp_flags.posix_open =
 		((smb_fname_rel->flags & SMB_FILENAME_POSIX_PATH) != 0);
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &fsp->fsp_name->st));
 
 	smb_fname_rel->st = fsp->fsp_name->st;
 
@@ -2072,14 +2526,15 @@ files_struct *file_find_fd(struct smbd_server_connection *sconn, int fd)
 files_struct *file_find_dif(struct smbd_server_connection *sconn,
 			    struct file_id id, unsigned long gen_id)
 {
-	int count=0;
 	files_struct *fsp;
 
 	if (gen_id == 0) {
 		return NULL;
 	}
 
-	for (fsp = sconn->files; fsp; fsp = fsp->next,count++) {
+	for (fsp = file_id_index_first(sconn, &id);
+	     fsp != NULL;
+	     fsp = fsp->file_id_next) {
 		/*
 		 * We can have a fsp->fh->fd == -1 here as it could be a stat
 		 * open.
@@ -2093,9 +2548,6 @@ files_struct *file_find_dif(struct smbd_server_connection *sconn,
 		if (fh_get_gen_id(fsp->fh) != gen_id) {
 			continue;
 		}
-		if (count > 10) {
-			DLIST_PROMOTE(sconn->files, fsp);
-		}
 		return fsp;
 	}
 
@@ -2104,8 +2556,6 @@ files_struct *file_find_dif(struct smbd_server_connection *sconn,
 
 /****************************************************************************
  Find the first fsp given a device and inode.
- We use a singleton cache here to speed up searching from getfilepathinfo
- calls.
 ****************************************************************************/
 
 files_struct *file_find_di_first(struct smbd_server_connection *sconn,
@@ -2114,26 +2564,17 @@ files_struct *file_find_di_first(struct smbd_server_connection *sconn,
 {
 	files_struct *fsp;
 
-	if (file_id_equal(&sconn->fsp_fi_cache.id, &id)) {
-		/* Positive or negative cache hit. */
-		return sconn->fsp_fi_cache.fsp;
-	}
-
-	sconn->fsp_fi_cache.id = id;
-
-	for (fsp=sconn->files;fsp;fsp=fsp->next) {
+	for (fsp = file_id_index_first(sconn, &id);
+	     fsp != NULL;
+	     fsp = fsp->file_id_next) {
 		if (need_fsa && !fsp->fsp_flags.is_fsa) {
 			continue;
 		}
 		if (file_id_equal(&fsp->file_id, &id)) {
-			/* Setup positive cache. */
-			sconn->fsp_fi_cache.fsp = fsp;
 			return fsp;
 		}
 	}
 
-	/* Setup negative cache. */
-	sconn->fsp_fi_cache.fsp = NULL;
 	return NULL;
 }
 
@@ -2146,7 +2587,11 @@ files_struct *file_find_di_next(files_struct *start_fsp,
 {
 	files_struct *fsp;
 
-	for (fsp = start_fsp->next;fsp;fsp=fsp->next) {
+	if (!start_fsp->file_id_indexed) {
+		return NULL;
+	}
+
+	for (fsp = start_fsp->file_id_next; fsp; fsp = fsp->file_id_next) {
 		if (need_fsa && !fsp->fsp_flags.is_fsa) {
 			continue;
 		}
@@ -2158,6 +2603,24 @@ files_struct *file_find_di_next(files_struct *start_fsp,
 	return NULL;
 }
 
+/****************************************************************************
+ Forget the stat info all handles of the file cached under their lease,
+ needed whenever the file is changed through smbd.
+****************************************************************************/
+
+void fsp_lease_stat_invalidate(files_struct *fsp)
+{
+	files_struct *f = NULL;
+
+	fsp->fsp_flags.lease_stat_valid = false;
+
+	for (f = file_find_di_first(fsp->conn->sconn, fsp->file_id, false);
+	     f != NULL;
+	     f = file_find_di_next(f, false)) {
+		f->fsp_flags.lease_stat_valid = false;
+	}
+}
+
 struct files_struct *file_find_one_fsp_from_lease_key(
 	struct smbd_server_connection *sconn,
 	const struct smb2_lease_key *lease_key)
@@ -2239,9 +2702,7 @@ static void fsp_free(files_struct *fsp)
 {
 	struct smbd_server_connection *sconn = fsp->conn->sconn;
 
-	if (fsp == sconn->fsp_fi_cache.fsp) {
-		ZERO_STRUCT(sconn->fsp_fi_cache);
-	}
+	file_id_index_remove(fsp);
 
 	DLIST_REMOVE(sconn->files, fsp);
 	SMB_ASSERT(sconn->num_files > 0);
@@ -24,18 +24,13 @@
 #include "system/select.h"
 #include "librpc/gen_ndr/smbXsrv.h"
 #include "smbprofile.h"
+#include "libcli/smb/smb2_negotiate_context.h"
 
 #ifdef USE_DMAPI
 struct smbd_dmapi_context;
 extern struct smbd_dmapi_context *dmapi_ctx;
 #endif
 
-/* A singleton cache to speed up searching by dev/inode. */
-struct fsp_singleton_cache {
-	files_struct *fsp;
-	struct file_id id;
-};
-
 extern const struct mangle_fns *mangle_fns;
 
 extern unsigned char *chartest;
@@ -267,6 +262,42 @@ NTSTATUS smbd_smb2_request_verify_sizes(struct smbd_smb2_request *req,
 void smb2_request_set_async_internal(struct smbd_smb2_request *req,
 				     bool async_internal);
 
+NTSTATUS smbd_smb2_compression_negotiate(struct smbXsrv_connection *xconn,
+					 TALLOC_CTX *mem_ctx,
+					 const struct smb2_negotiate_context *in_comp,
+					 struct smb2_negotiate_contexts *out_c);
+NTSTATUS smbd_smb2_decompress(struct smbXsrv_connection *xconn,
+			      TALLOC_CTX *mem_ctx,
+			      const uint8_t *buf,
+			      size_t buflen,
+			      uint8_t **_out,
+			      size_t *_out_len);
+bool smbd_smb2_compress_read_wanted(struct smbd_smb2_request *req,
+				    uint8_t in_flags,
+				    size_t length);
+NTSTATUS smbd_smb2_request_compress(struct smbd_smb2_request *req,
+				    bool *_compressed);
+
+struct smbd_io_uring_conn;
+struct smbd_smb2_send_queue;
+bool smbd_io_uring_conn_setup(struct smbXsrv_connection *xconn);
+NTSTATUS smbd_io_uring_conn_recv(struct smbXsrv_connection *xconn);
+bool smbd_io_uring_conn_send_busy(struct smbXsrv_connection *xconn);
+NTSTATUS smbd_io_uring_conn_sendmsg(struct smbXsrv_connection *xconn,
+				    struct msghdr *msg);
+NTSTATUS smbd_io_uring_conn_sendfile(struct smbXsrv_connection *xconn,
+				     struct smbd_smb2_send_queue *e);
+void smbd_io_uring_conn_disconnect(struct smbXsrv_connection *xconn);
+NTSTATUS smbd_smb2_io_uring_incoming(struct smbXsrv_connection *xconn,
+				     const uint8_t *buf,
+				     size_t len,
+				     size_t *_consumed);
+NTSTATUS smbd_smb2_io_uring_sent(struct smbXsrv_connection *xconn,
+				 int ret);
+NTSTATUS smbd_smb2_io_uring_sendfile_done(struct smbXsrv_connection *xconn,
+					  NTSTATUS status,
+					  size_t sent);
+
 enum protocol_types smbd_smb2_protocol_dialect_match(const uint8_t *indyn,
 		                                     const int dialect_count,
 						     uint16_t *dialect);
@@ -297,6 +328,15 @@ void smbd_smb2_request_dispatch_immediate(struct tevent_context *ctx,
 				struct tevent_immediate *im,
 				void *private_data);
 
+/* From smbd/smb2_qos.c */
+bool smbd_smb2_qos_admit(struct smbd_smb2_request *req, uint16_t opcode);
+void smbd_smb2_qos_request_done(struct smbd_smb2_request *req);
+void smbd_smb2_qos_status_msg(struct messaging_context *msg_ctx,
+			      void *private_data,
+			      uint32_t msg_type,
+			      struct server_id src,
+			      DATA_BLOB *data);
+
 struct deferred_open_record;
 
 /* SMB1 -> SMB2 glue. */
@@ -346,7 +386,18 @@ struct smbXsrv_connection {
 		struct tevent_queue *shutdown_wait_queue;
 		int sock;
 		struct tevent_fd *fde;
+		/*
+		 * Only set if the connection uses
+		 * "smb2 io_uring transport".
+		 */
+		struct smbd_io_uring_conn *io_uring;
 		enum smb_transport_type type;
+		/*
+		 * SO_INCOMING_CPU of the socket and what
+		 * "smbd:cpu affinity" made of it.
+		 */
+		int incoming_cpu;
+		const char *cpu_affinity;
 
 		struct {
 			bool got_session;
@@ -444,8 +495,30 @@ struct smbXsrv_connection {
 			size_t pktlen;
 			uint8_t *pktbuf;
 		} request_read_state;
+		/*
+		 * Received bytes not yet consumed by
+		 * smbd_smb2_io_uring_incoming(), used if the
+		 * socket is read without io_uring.
+		 */
+		struct {
+			uint8_t *buf;
+			size_t size;
+			size_t ofs;
+			size_t len;
+			bool feeding;
+			struct tevent_immediate *im;
+		} recv_buf;
 		struct smbd_smb2_send_queue *send_queue;
 		size_t send_queue_len;
+		/*
+		 * Several responses are sent with one sendmsg(),
+		 * see smbd_smb2_flush_send_queue_batched()
+		 */
+		struct {
+			struct iovec *iov;
+			size_t cork;
+			struct tevent_immediate *im;
+		} send_batch;
 
 		struct {
 			/*
@@ -515,6 +588,49 @@ struct smbXsrv_connection {
 			bool posix_extensions_negotiated;
 		} server;
 
+		struct {
+			/*
+			 * The negotiated compression algorithms
+			 * in the order of our preference,
+			 * num_algos == 0 means compression is off.
+			 */
+			struct smb3_compression_capabilities negotiated;
+			/*
+			 * Scratch memory for the LZ77+Huffman
+			 * compressor, allocated on first use.
+			 */
+			struct lzxhuff_compressor_mem *huffman_mem;
+			struct {
+				uint64_t raw_bytes;
+				uint64_t compressed_in_bytes;
+				uint64_t compressed_out_bytes;
+				uint64_t decompressed_in_bytes;
+				uint64_t decompressed_out_bytes;
+			} counters;
+		} compression;
+
+		struct {
+			/*
+			 * Only used with "smb2 channel threads":
+			 * a pool with a single worker thread that
+			 * decrypts the incoming requests of this
+			 * channel, created on first use.
+			 */
+			struct pthreadpool_tevent *pool;
+			/*
+			 * A private copy of the decryption key,
+			 * so that the gnutls handle is only ever
+			 * used by our worker thread.
+			 */
+			struct smb2_signing_key *decryption_key;
+			uint64_t session_id;
+			/*
+			 * The request being decrypted, while this is
+			 * set we don't read from the socket.
+			 */
+			struct tevent_req *pending;
+		} crypto;
+
 		struct smbXsrv_preauth preauth;
 
 		struct smbd_smb2_request *requests;
@@ -595,6 +711,20 @@ struct smbd_smb2_send_queue {
 	DATA_BLOB *sendfile_header;
 	uint32_t sendfile_body_size;
 	NTSTATUS *sendfile_status;
+	/*
+	 * The source of the body, used by the
+	 * io_uring transport to splice the data.
+	 */
+	struct files_struct *sendfile_fsp;
+	off_t sendfile_offset;
+
+	/*
+	 * Set while a worker thread encrypts or signs the
+	 * response, see "smb2 encryption offload size" and
+	 * "smb2 signing offload size".
+	 * The queue doesn't move on until it's cleared.
+	 */
+	bool encrypting;
 
 	struct msghdr msg;
 	struct iovec *vector;
@@ -677,6 +807,11 @@ struct smbd_smb2_request {
 	 */
 	struct tevent_req *subreq;
 
+	/*
+	 * READ/WRITE scheduling state, see smbd/smb2_qos.c
+	 */
+	struct smbd_smb2_qos_ticket *qos;
+
 #define SMBD_SMB2_TF_IOV_OFS 0
 #define SMBD_SMB2_HDR_IOV_OFS 1
 #define SMBD_SMB2_BODY_IOV_OFS 2
@@ -800,7 +935,16 @@ struct smbd_server_connection {
 	struct files_struct *files;
 
 	int real_max_open_files;
-	struct fsp_singleton_cache fsp_fi_cache;
+
+	/*
+	 * Hash index of the files by file_id,
+	 * see fsp_set_file_id().
+	 */
+	struct {
+		struct files_struct **buckets;
+		size_t num_buckets;
+		size_t num_files;
+	} file_id_index;
 
 	struct pending_message_list *deferred_open_queue;
 
@@ -824,6 +968,12 @@ struct smbd_server_connection {
 
 	struct pthreadpool_tevent *pool;
 
+	/* Created on demand by smbd_smb2_request_allocate() */
+	struct talloc_slab *smb2_request_slab;
+
+	/* Created on demand by smbd_smb2_qos_admit() */
+	struct smbd_smb2_qos *smb2_qos;
+
 	struct smbXsrv_client *client;
 };
 
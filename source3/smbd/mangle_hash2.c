@@ -281,11 +281,30 @@ static unsigned int mangle_hash(const char *key, unsigned int length)
 	unsigned int   i;
 	fstring str;
 
+	length = MIN(length,sizeof(fstring)-1);
+
+	/*
+	 * Pure ASCII names are by far the most common ones, uppercase
+	 * and hash them in one pass without copying. This gives the
+	 * same result as the strupper_m() path below.
+	 */
+	for (value = FNV1_INIT, i=0; i < length && key[i] != '\0'; i++) {
+		unsigned char c = (unsigned char)key[i];
+
+		if (c >= 0x80) {
+			break;
+		}
+		value *= (unsigned int)FNV1_PRIME;
+		value ^= (unsigned int)toupper_m(c);
+	}
+	if (i == length || key[i] == '\0') {
+		return value & ~0x80000000;
+	}
+
 	/* we have to uppercase here to ensure that the mangled name
 	   doesn't depend on the case of the long name. Note that this
 	   is the only place where we need to use a multi-byte string
 	   function */
-	length = MIN(length,sizeof(fstring)-1);
 	strncpy(str, key, length);
 	str[length] = 0;
 	(void)strupper_m(str);
@@ -304,11 +323,38 @@ static unsigned int mangle_hash(const char *key, unsigned int length)
 	return value & ~0x80000000;  
 }
 
+/*
+  The prefix cache is keyed by the part of the hash that is encoded in
+  the mangled name, plus the lead characters of the mangled name. With
+  the lead characters in the key, names that only share the hash don't
+  evict each other.
+*/
+struct mangle_cache_key {
+	unsigned int hash;
+	char lead_chars[6];
+};
+
+/* 36^(7-mangle_prefix), the number of distinct hashes in a mangled name */
+static unsigned int mangle_hash_modulus;
+
+static DATA_BLOB cache_key(struct mangle_cache_key *key,
+			   unsigned int hash,
+			   const char *lead_chars)
+{
+	*key = (struct mangle_cache_key) {
+		.hash = hash % mangle_hash_modulus,
+	};
+	memcpy(key->lead_chars, lead_chars, mangle_prefix);
+	return data_blob_const(key, sizeof(*key));
+}
+
 /*
   insert an entry into the prefix cache. The string might not be null
   terminated */
-static void cache_insert(const char *prefix, int length, unsigned int hash)
+static void cache_insert(const char *prefix, int length, unsigned int hash,
+			 const char *lead_chars)
 {
+	struct mangle_cache_key key;
 	char *str = SMB_STRNDUP(prefix, length);
 
 	if (str == NULL) {
@@ -316,7 +362,7 @@ static void cache_insert(const char *prefix, int length, unsigned int hash)
 	}
 
 	memcache_add(smbd_memcache(), MANGLE_HASH2_CACHE,
-		     data_blob_const(&hash, sizeof(hash)),
+		     cache_key(&key, hash, lead_chars),
 		     data_blob_const(str, length+1));
 	SAFE_FREE(str);
 }
@@ -324,14 +370,20 @@ static void cache_insert(const char *prefix, int length, unsigned int hash)
 /*
   lookup an entry in the prefix cache. Return NULL if not found.
 */
-static char *cache_lookup(TALLOC_CTX *mem_ctx, unsigned int hash)
+static char *cache_lookup(TALLOC_CTX *mem_ctx, unsigned int hash,
+			  const char *lead_chars)
 {
+	struct mangle_cache_key key;
 	DATA_BLOB value;
 
+	DO_PROFILE_INC(mangle_cache_lookups);
+
 	if (!memcache_lookup(smbd_memcache(), MANGLE_HASH2_CACHE,
-			     data_blob_const(&hash, sizeof(hash)), &value)) {
+			     cache_key(&key, hash, lead_chars), &value)) {
+		DO_PROFILE_INC(mangle_cache_misses);
 		return NULL;
 	}
+	DO_PROFILE_INC(mangle_cache_hits);
 
 	SMB_ASSERT((value.length > 0)
 		   && (value.data[value.length-1] == '\0'));
@@ -437,72 +489,87 @@ static bool is_mangled(const char *name, const struct share_params *parm)
 
 static const char force_shortname_chars[] = " +,[];=";
 
+/*
+  characters that can't be returned in a 8.3 name, indexed by
+  allow_wildcards. Built on first use so that is_8_3() can check every
+  character with a single table lookup.
+*/
+static bool not_8_3_char_initialised;
+static bool not_8_3_char[2][256];
+
+static void init_not_8_3_char(void)
+{
+	unsigned int i;
+
+	for (i=0; i<256; i++) {
+		bool bad = (FLAG_CHECK(i, FLAG_ILLEGAL) || (i > 0x7e) ||
+			    ((i != 0) && (strchr(force_shortname_chars, i) != NULL)));
+
+		not_8_3_char[true][i] = bad;
+		not_8_3_char[false][i] = bad || FLAG_CHECK(i, FLAG_WILDCARD);
+	}
+	not_8_3_char_initialised = true;
+}
+
 static bool is_8_3(const char *name, bool check_case, bool allow_wildcards, const struct share_params *p)
 {
-	int len, i;
-	char *dot_p;
+	const bool *bad_char = NULL;
+	int len, prefix_len = -1;
 
 	/* as a special case, the names '.' and '..' are allowable 8.3 names */
 	if (ISDOT(name) || (ISDOTDOT(name))) {
 		return true;
 	}
 
-	/* the simplest test is on the overall length of the
-	 filename. Note that we deliberately use the ascii string
-	 length (not the multi-byte one) as it is faster, and gives us
-	 the result we need in this case. Using strlen_m would not
-	 only be slower, it would be incorrect */
-	len = strlen(name);
-	if (len > 12)
-		return False;
+	if (!not_8_3_char_initialised) {
+		init_not_8_3_char();
+	}
+	bad_char = not_8_3_char[allow_wildcards ? 1 : 0];
+
+	/*
+	 * Check the characters, the overall length and the position
+	 * of the '.' in one pass. Note that we deliberately use the
+	 * ascii string length (not the multi-byte one) as it is
+	 * faster, and gives us the result we need in this case. Using
+	 * strlen_m would not only be slower, it would be incorrect.
+	 */
+	for (len=0; name[len] != '\0'; len++) {
+		unsigned char c = (unsigned char)name[len];
 
-	/* find the '.'. Note that once again we use the non-multibyte
-           function */
-	dot_p = strchr(name, '.');
+		if (len >= 12) {
+			return false;
+		}
+		if (c == '.') {
+			/* a 8.3 name cannot contain more than 1 '.' */
+			if (prefix_len != -1) {
+				return false;
+			}
+			prefix_len = len;
+			continue;
+		}
+		if (bad_char[c]) {
+			return false;
+		}
+	}
 
-	if (!dot_p) {
+	if (prefix_len == -1) {
 		/* if the name doesn't contain a '.' then its length
-                   must be less than 8 */
+		   must be less than 8 */
 		if (len > 8) {
-			return False;
+			return false;
 		}
 	} else {
-		int prefix_len, suffix_len;
+		int suffix_len = len - (prefix_len+1);
 
 		/* if it does contain a dot then the prefix must be <=
 		   8 and the suffix <= 3 in length */
-		prefix_len = PTR_DIFF(dot_p, name);
-		suffix_len = len - (prefix_len+1);
-
 		if (prefix_len > 8 || suffix_len > 3 || suffix_len == 0) {
-			return False;
-		}
-
-		/* a 8.3 name cannot contain more than 1 '.' */
-		if (strchr(dot_p+1, '.')) {
-			return False;
-		}
-	}
-
-	/* the length are all OK. Now check to see if the characters themselves are OK */
-	for (i=0; name[i]; i++) {
-		if (FLAG_CHECK(name[i], FLAG_ILLEGAL)) {
-			return false;
-		}
-		/* note that we may allow wildcard petterns! */
-		if (!allow_wildcards && FLAG_CHECK(name[i], FLAG_WILDCARD)) {
-			return false;
-		}
-		if (((unsigned char)name[i]) > 0x7e) {
-			return false;
-		}
-		if (strchr(force_shortname_chars, name[i])) {
 			return false;
 		}
 	}
 
 	/* it is a good 8.3 name */
-	return True;
+	return true;
 }
 
 
@@ -530,6 +597,7 @@ static bool lookup_name_from_8_3(TALLOC_CTX *ctx,
 	unsigned int i;
 	char *prefix;
 	char extension[4];
+	char lead_chars[6];
 
 	*pp_out = NULL;
 
@@ -547,8 +615,13 @@ static bool lookup_name_from_8_3(TALLOC_CTX *ctx,
 		multiplier *= 36;
 	}
 
+	/* the lead characters are stored uppercased, like in the name */
+	for (i=0; i<mangle_prefix; i++) {
+		lead_chars[i] = toupper_m((unsigned char)name[i]);
+	}
+
 	/* now look in the prefix cache for that hash */
-	prefix = cache_lookup(ctx, hash);
+	prefix = cache_lookup(ctx, hash, lead_chars);
 	if (!prefix) {
 		M_DEBUG(10,("lookup_name_from_8_3: %s -> %08X -> not found\n",
 					name, hash));
@@ -779,7 +852,7 @@ static bool hash2_name_to_8_3(const char *name,
 
 	if (cache83) {
 		/* put it in the cache */
-		cache_insert(name, prefix_len, hash);
+		cache_insert(name, prefix_len, hash, lead_chars);
 	}
 
 	M_DEBUG(10,("hash2_name_to_8_3: %s -> %08X -> %s (cache=%d)\n",
@@ -812,6 +885,20 @@ const struct mangle_fns *mangle_hash2_init(void)
 		mangle_prefix = 1;
 	}
 
+	/*
+	 * Only 7-mangle_prefix base36 digits of the hash end up in the
+	 * mangled name, lookups can't see more than that.
+	 */
+	{
+		unsigned int i;
+		uint64_t modulus = 1;
+
+		for (i=mangle_prefix; i<7; i++) {
+			modulus *= 36;
+		}
+		mangle_hash_modulus = MIN(modulus, 0x80000000);
+	}
+
 #if DYNAMIC_MANGLE_TABLES
 	init_tables();
 #endif
@@ -749,7 +749,8 @@ static void notify_fsp(files_struct *fsp, struct timespec when,
 		return;
 	}
 
-	if (lp_honor_change_notify_privilege(SNUM(fsp->conn))) {
+	if (lp_honor_change_notify_privilege(SNUM(fsp->conn)) &&
+	    (name != NULL)) {
 		bool has_sec_change_notify_privilege;
 		bool expose = false;
 
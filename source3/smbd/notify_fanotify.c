@@ -0,0 +1,819 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * notify implementation using fanotify
+ *
+ * Instead of one inotify watch per directory we put a single
+ * FAN_MARK_FILESYSTEM mark on every file system that has a watched
+ * directory. With FAN_REPORT_DFID_NAME every event carries the file
+ * handle of the parent directory and the name of the entry. The
+ * directory handle is resolved to a path and matched against the
+ * watches, so recursive watches cost nothing to set up no matter how
+ * large the tree below them is.
+ */
+
+#include "includes.h"
+#include "../librpc/gen_ndr/notify.h"
+#include "smbd/smbd.h"
+#include "lib/util/sys_rw.h"
+#include "lib/dbwrap/dbwrap.h"
+#include "lib/dbwrap/dbwrap_rbt.h"
+#include "util_tdb.h"
+#include "smbd/globals.h"
+
+#include <sys/fanotify.h>
+#include <sys/vfs.h>
+
+/*
+ * Number of resolved directory handles we remember
+ */
+#define FANOTIFY_DIR_CACHE_SIZE 1024
+
+struct fanotify_private {
+	struct sys_notify_context *ctx;
+	int fd;
+	bool have_rename;
+	struct fanotify_mark_context *marks;
+	struct fanotify_watch_context *watches;
+
+	/*
+	 * Cache of directory file handle to path, flushed whenever a
+	 * directory is renamed or removed.
+	 */
+	struct db_context *dir_cache;
+	size_t dir_cache_entries;
+};
+
+/*
+ * One FAN_MARK_FILESYSTEM mark, shared by all watches on the file
+ * system
+ */
+struct fanotify_mark_context {
+	struct fanotify_mark_context *next, *prev;
+	struct fanotify_private *fa;
+	fsid_t fsid;
+	int mount_fd;
+	size_t num_watches;
+};
+
+struct fanotify_watch_context {
+	struct fanotify_watch_context *next, *prev;
+	struct fanotify_private *fa;
+	struct fanotify_mark_context *mark;
+	void (*callback)(struct sys_notify_context *ctx,
+			 void *private_data,
+			 struct notify_event *ev,
+			 uint32_t filter);
+	void *private_data;
+	uint32_t filter; /* the windows completion filter */
+	uint32_t subdir_filter;
+	char *path;
+	size_t pathlen;
+};
+
+#define FANOTIFY_EVENTS (FAN_CREATE|FAN_DELETE|FAN_MOVED_FROM|FAN_MOVED_TO|\
+			 FAN_ATTRIB|FAN_MODIFY|FAN_ONDIR)
+
+/*
+ * Same mapping as in notify_inotify.c
+ */
+static const struct {
+	uint32_t notify_mask;
+	uint64_t fanotify_mask;
+} fanotify_mapping[] = {
+	{FILE_NOTIFY_CHANGE_FILE_NAME,   FAN_CREATE|FAN_DELETE|FAN_MOVED_FROM|FAN_MOVED_TO},
+	{FILE_NOTIFY_CHANGE_DIR_NAME,    FAN_CREATE|FAN_DELETE|FAN_MOVED_FROM|FAN_MOVED_TO},
+	{FILE_NOTIFY_CHANGE_ATTRIBUTES,  FAN_ATTRIB|FAN_MOVED_TO|FAN_MOVED_FROM|FAN_MODIFY},
+	{FILE_NOTIFY_CHANGE_LAST_WRITE,  FAN_ATTRIB},
+	{FILE_NOTIFY_CHANGE_LAST_ACCESS, FAN_ATTRIB},
+	{FILE_NOTIFY_CHANGE_EA,          FAN_ATTRIB},
+	{FILE_NOTIFY_CHANGE_SECURITY,    FAN_ATTRIB}
+};
+
+static uint64_t fanotify_map(uint32_t *filter)
+{
+	size_t i;
+	uint64_t out = 0;
+
+	for (i = 0; i < ARRAY_SIZE(fanotify_mapping); i++) {
+		if (fanotify_mapping[i].notify_mask & *filter) {
+			out |= fanotify_mapping[i].fanotify_mask;
+			*filter &= ~fanotify_mapping[i].notify_mask;
+		}
+	}
+	return out;
+}
+
+/*
+ * Map fanotify mask back to filter. This returns all filters that
+ * could have asked for the event.
+ */
+static uint32_t fanotify_map_mask_to_filter(uint64_t mask)
+{
+	size_t i;
+	uint32_t filter = 0;
+
+	for (i = 0; i < ARRAY_SIZE(fanotify_mapping); i++) {
+		if (fanotify_mapping[i].fanotify_mask & mask) {
+			filter |= fanotify_mapping[i].notify_mask;
+		}
+	}
+
+	if (mask & FAN_ONDIR) {
+		filter &= ~FILE_NOTIFY_CHANGE_FILE_NAME;
+	} else {
+		filter &= ~FILE_NOTIFY_CHANGE_DIR_NAME;
+	}
+
+	return filter;
+}
+
+/*
+ * With FAN_RENAME a rename is one event carrying both the old and the
+ * new name, don't ask for the separate halves then
+ */
+static uint64_t fanotify_mark_mask(struct fanotify_private *fa)
+{
+	uint64_t mask = FANOTIFY_EVENTS;
+
+#ifdef FAN_RENAME
+	if (fa->have_rename) {
+		mask &= ~(FAN_MOVED_FROM|FAN_MOVED_TO);
+		mask |= FAN_RENAME;
+	}
+#endif
+	return mask;
+}
+
+static int fanotify_destructor(struct fanotify_private *fa)
+{
+	close(fa->fd);
+	return 0;
+}
+
+static int mark_destructor(struct fanotify_mark_context *m)
+{
+	struct fanotify_private *fa = m->fa;
+	int ret;
+
+	DLIST_REMOVE(fa->marks, m);
+
+	ret = fanotify_mark(fa->fd,
+			    FAN_MARK_REMOVE|FAN_MARK_FILESYSTEM,
+			    fanotify_mark_mask(fa),
+			    m->mount_fd,
+			    NULL);
+	if (ret == -1) {
+		DBG_NOTICE("fanotify_mark(FAN_MARK_REMOVE) failed: %s\n",
+			   strerror(errno));
+	}
+	close(m->mount_fd);
+	return 0;
+}
+
+/*
+ * Turn a directory file handle from an event into a path. Returns a
+ * talloc'ed string hanging off mem_ctx or NULL if the directory is
+ * gone already.
+ */
+static char *fanotify_dir_path(TALLOC_CTX *mem_ctx,
+			       struct fanotify_private *fa,
+			       struct fanotify_mark_context *m,
+			       struct file_handle *fh)
+{
+	TDB_DATA key = {
+		.dptr = (uint8_t *)fh,
+		.dsize = sizeof(struct file_handle) + fh->handle_bytes,
+	};
+	char procpath[sizeof("/proc/self/fd/") + 12];
+	char buf[PATH_MAX+1];
+	TDB_DATA val;
+	NTSTATUS status;
+	ssize_t len;
+	int dirfd;
+
+	status = dbwrap_fetch(fa->dir_cache, mem_ctx, key, &val);
+	if (NT_STATUS_IS_OK(status)) {
+		return (char *)val.dptr;
+	}
+
+	dirfd = open_by_handle_at(m->mount_fd, fh, O_PATH);
+	if (dirfd == -1) {
+		DBG_DEBUG("open_by_handle_at failed: %s\n", strerror(errno));
+		return NULL;
+	}
+
+	snprintf(procpath, sizeof(procpath), "/proc/self/fd/%d", dirfd);
+	len = readlink(procpath, buf, sizeof(buf)-1);
+	close(dirfd);
+	if (len == -1) {
+		DBG_DEBUG("readlink(%s) failed: %s\n",
+			  procpath, strerror(errno));
+		return NULL;
+	}
+	buf[len] = '\0';
+
+	if (fa->dir_cache_entries >= FANOTIFY_DIR_CACHE_SIZE) {
+		dbwrap_wipe(fa->dir_cache);
+		fa->dir_cache_entries = 0;
+	}
+	status = dbwrap_store(fa->dir_cache,
+			      key,
+			      make_tdb_data((uint8_t *)buf, len+1),
+			      0);
+	if (NT_STATUS_IS_OK(status)) {
+		fa->dir_cache_entries += 1;
+	}
+
+	return talloc_strndup(mem_ctx, buf, len);
+}
+
+/*
+ * Find the first watch interested in an event for "name" in "dir". The
+ * callback in notifyd does the per-client matching, so one callback
+ * per event is enough.
+ */
+static struct fanotify_watch_context *fanotify_find_watch(
+	struct fanotify_private *fa,
+	struct fanotify_mark_context *m,
+	const char *dir,
+	uint32_t filter)
+{
+	struct fanotify_watch_context *w = NULL;
+	size_t dirlen = strlen(dir);
+
+	for (w = fa->watches; w != NULL; w = w->next) {
+		uint32_t w_filter;
+
+		if (w->mark != m) {
+			continue;
+		}
+		if (dirlen < w->pathlen) {
+			continue;
+		}
+		if (strncmp(dir, w->path, w->pathlen) != 0) {
+			continue;
+		}
+
+		if (dirlen == w->pathlen) {
+			w_filter = w->filter;
+		} else if (dir[w->pathlen] == '/') {
+			w_filter = w->subdir_filter;
+		} else {
+			continue;
+		}
+
+		if ((w_filter & filter) != 0) {
+			return w;
+		}
+	}
+
+	return NULL;
+}
+
+static void fanotify_report(struct fanotify_private *fa,
+			    struct fanotify_mark_context *m,
+			    const char *dir,
+			    const char *name,
+			    uint32_t action,
+			    uint32_t filter)
+{
+	struct fanotify_watch_context *w = NULL;
+	struct notify_event ne = {
+		.action = action,
+		.path = name,
+		.dir = dir,
+	};
+
+	w = fanotify_find_watch(fa, m, dir, filter);
+	if (w == NULL) {
+		return;
+	}
+
+	DBG_DEBUG("action = %"PRIu32", dir = %s, path = %s, filter = %"PRIu32"\n",
+		  action, dir, name, filter);
+
+	w->callback(fa->ctx, w->private_data, &ne, filter);
+}
+
+/*
+ * We lost events, tell every watcher to rescan
+ */
+static void fanotify_overflow(struct fanotify_private *fa)
+{
+	struct fanotify_watch_context *w = NULL;
+
+	DBG_NOTICE("fanotify queue overflow\n");
+
+	for (w = fa->watches; w != NULL; w = w->next) {
+		struct notify_event ne = {
+			.action = NOTIFY_ACTION_MODIFIED,
+			.path = "",
+			.dir = w->path,
+		};
+		w->callback(fa->ctx, w->private_data, &ne, UINT32_MAX);
+	}
+}
+
+struct fanotify_dfid_name {
+	struct fanotify_mark_context *mark;
+	struct file_handle *fh;
+	const char *name;
+};
+
+static bool fanotify_parse_info(struct fanotify_private *fa,
+				struct fanotify_event_info_fid *fid,
+				struct fanotify_dfid_name *dn)
+{
+	struct fanotify_mark_context *m = NULL;
+	struct file_handle *fh = (struct file_handle *)fid->handle;
+
+	for (m = fa->marks; m != NULL; m = m->next) {
+		if (memcmp(&m->fsid, &fid->fsid, sizeof(m->fsid)) == 0) {
+			break;
+		}
+	}
+	if (m == NULL) {
+		return false;
+	}
+
+	*dn = (struct fanotify_dfid_name) {
+		.mark = m,
+		.fh = fh,
+		.name = (const char *)fh->f_handle + fh->handle_bytes,
+	};
+	return true;
+}
+
+static void fanotify_dispatch(struct fanotify_private *fa,
+			      struct fanotify_event_metadata *meta)
+{
+	TALLOC_CTX *frame = NULL;
+	struct fanotify_dfid_name dfid = {};
+	struct fanotify_dfid_name old_dfid = {};
+	struct fanotify_dfid_name new_dfid = {};
+	char *dir = NULL;
+	char *old_dir = NULL;
+	uint8_t *p = (uint8_t *)(meta + 1);
+	uint8_t *end = (uint8_t *)meta + meta->event_len;
+	uint64_t mask = meta->mask;
+	uint32_t filter;
+	uint32_t action;
+
+	if (mask & FAN_Q_OVERFLOW) {
+		dbwrap_wipe(fa->dir_cache);
+		fa->dir_cache_entries = 0;
+		fanotify_overflow(fa);
+		return;
+	}
+
+	while (p + sizeof(struct fanotify_event_info_header) <= end) {
+		struct fanotify_event_info_header *hdr = (void *)p;
+
+		if ((hdr->len < sizeof(*hdr)) || (p + hdr->len > end)) {
+			DBG_WARNING("Invalid fanotify info record\n");
+			return;
+		}
+
+		switch (hdr->info_type) {
+		case FAN_EVENT_INFO_TYPE_DFID_NAME:
+			fanotify_parse_info(fa, (void *)p, &dfid);
+			break;
+#ifdef FAN_RENAME
+		case FAN_EVENT_INFO_TYPE_OLD_DFID_NAME:
+			fanotify_parse_info(fa, (void *)p, &old_dfid);
+			break;
+		case FAN_EVENT_INFO_TYPE_NEW_DFID_NAME:
+			fanotify_parse_info(fa, (void *)p, &new_dfid);
+			break;
+#endif
+		default:
+			break;
+		}
+		p += hdr->len;
+	}
+
+	if ((mask & FAN_ONDIR) &&
+	    (mask & (FAN_DELETE|FAN_MOVED_FROM|FAN_MOVED_TO
+#ifdef FAN_RENAME
+		     |FAN_RENAME
+#endif
+		    ))) {
+		/*
+		 * Cached paths below this directory might be stale now
+		 */
+		dbwrap_wipe(fa->dir_cache);
+		fa->dir_cache_entries = 0;
+	}
+
+	frame = talloc_stackframe();
+
+#ifdef FAN_RENAME
+	if ((mask & FAN_RENAME) &&
+	    (old_dfid.mark != NULL) && (new_dfid.mark != NULL))
+	{
+		old_dir = fanotify_dir_path(frame, fa, old_dfid.mark,
+					    old_dfid.fh);
+		dir = fanotify_dir_path(frame, fa, new_dfid.mark, new_dfid.fh);
+
+		filter = fanotify_map_mask_to_filter(
+			FAN_MOVED_TO | (mask & FAN_ONDIR));
+
+		if (IS_SMBD_TMPNAME(old_dfid.name, NULL)) {
+			/*
+			 * smbd's mkdir_internal() creates directories
+			 * under a temporary name, see the comment in
+			 * notify_inotify.c. Pretend this is a new
+			 * directory.
+			 */
+			if (dir != NULL) {
+				fanotify_report(fa, new_dfid.mark, dir,
+						new_dfid.name,
+						NOTIFY_ACTION_ADDED, filter);
+			}
+			goto done;
+		}
+
+		if ((old_dir != NULL) && (dir != NULL) &&
+		    (strcmp(old_dir, dir) == 0)) {
+			struct fanotify_watch_context *w = NULL;
+
+			fanotify_report(fa, old_dfid.mark, old_dir,
+					old_dfid.name,
+					NOTIFY_ACTION_OLD_NAME, filter);
+			fanotify_report(fa, new_dfid.mark, dir,
+					new_dfid.name,
+					NOTIFY_ACTION_NEW_NAME, filter);
+
+			if (mask & FAN_ONDIR) {
+				goto done;
+			}
+
+			/*
+			 * Like notify_inotify.c, SMB expects a file
+			 * rename to generate a modify of the
+			 * destination as well.
+			 */
+			w = fanotify_find_watch(fa, new_dfid.mark, dir,
+						FILE_NOTIFY_CHANGE_CREATION);
+			if (w != NULL) {
+				fanotify_report(
+					fa, new_dfid.mark, dir,
+					new_dfid.name,
+					NOTIFY_ACTION_MODIFIED,
+					fanotify_map_mask_to_filter(
+						FAN_ATTRIB));
+			}
+			goto done;
+		}
+
+		if (old_dir != NULL) {
+			fanotify_report(fa, old_dfid.mark, old_dir,
+					old_dfid.name,
+					NOTIFY_ACTION_REMOVED,
+					fanotify_map_mask_to_filter(
+						FAN_MOVED_FROM |
+						(mask & FAN_ONDIR)));
+		}
+		if (dir != NULL) {
+			fanotify_report(fa, new_dfid.mark, dir,
+					new_dfid.name,
+					NOTIFY_ACTION_ADDED, filter);
+		}
+		goto done;
+	}
+#endif
+
+	if (dfid.mark == NULL) {
+		goto done;
+	}
+
+	if ((mask & (FAN_ATTRIB|FAN_MODIFY|FAN_CREATE|FAN_DELETE|
+		     FAN_MOVED_FROM|FAN_MOVED_TO)) == 0) {
+		goto done;
+	}
+
+	if ((mask & FAN_CREATE) && (mask & FAN_ONDIR) &&
+	    IS_SMBD_TMPNAME(dfid.name, NULL)) {
+		goto done;
+	}
+
+	if (mask & FAN_CREATE) {
+		action = NOTIFY_ACTION_ADDED;
+	} else if (mask & FAN_DELETE) {
+		action = NOTIFY_ACTION_REMOVED;
+	} else if (mask & FAN_MOVED_TO) {
+		action = NOTIFY_ACTION_ADDED;
+	} else if (mask & FAN_MOVED_FROM) {
+		action = NOTIFY_ACTION_REMOVED;
+	} else {
+		action = NOTIFY_ACTION_MODIFIED;
+	}
+
+	dir = fanotify_dir_path(frame, fa, dfid.mark, dfid.fh);
+	if (dir == NULL) {
+		goto done;
+	}
+
+	filter = fanotify_map_mask_to_filter(mask);
+
+	fanotify_report(fa, dfid.mark, dir, dfid.name, action, filter);
+
+done:
+	TALLOC_FREE(frame);
+}
+
+/*
+  called when the kernel has some events for us
+*/
+static void fanotify_handler(struct tevent_context *ev, struct tevent_fd *fde,
+			     uint16_t flags, void *private_data)
+{
+	struct fanotify_private *fa = talloc_get_type_abort(
+		private_data, struct fanotify_private);
+	char buf[8192] __attribute__((aligned(__alignof__(
+		struct fanotify_event_metadata))));
+	struct fanotify_event_metadata *meta = NULL;
+	ssize_t len;
+
+	len = sys_read(fa->fd, buf, sizeof(buf));
+	if (len == -1) {
+		DBG_ERR("Failed to read fanotify data - %s\n",
+			strerror(errno));
+		TALLOC_FREE(fde);
+		return;
+	}
+
+	for (meta = (struct fanotify_event_metadata *)buf;
+	     FAN_EVENT_OK(meta, len);
+	     meta = FAN_EVENT_NEXT(meta, len)) {
+
+		if (meta->vers != FANOTIFY_METADATA_VERSION) {
+			DBG_ERR("fanotify metadata version mismatch\n");
+			TALLOC_FREE(fde);
+			return;
+		}
+
+		if (meta->fd >= 0) {
+			/* We don't ask for fds, be safe anyway */
+			close(meta->fd);
+		}
+
+		fanotify_dispatch(fa, meta);
+	}
+}
+
+/*
+  setup the fanotify handle - called the first time a watch is added on
+  this context
+*/
+static int fanotify_setup(struct sys_notify_context *ctx)
+{
+	struct fanotify_private *fa = NULL;
+	struct tevent_fd *fde = NULL;
+
+	fa = talloc_zero(ctx, struct fanotify_private);
+	if (fa == NULL) {
+		return ENOMEM;
+	}
+
+	fa->fd = fanotify_init(FAN_CLASS_NOTIF|FAN_REPORT_DFID_NAME|
+			       FAN_CLOEXEC|FAN_NONBLOCK,
+			       O_RDONLY|O_CLOEXEC);
+	if (fa->fd == -1) {
+		int ret = errno;
+		DBG_NOTICE("Failed to init fanotify - %s\n", strerror(ret));
+		TALLOC_FREE(fa);
+		return ret;
+	}
+	fa->ctx = ctx;
+#ifdef FAN_RENAME
+	fa->have_rename = true;
+#endif
+
+	fa->dir_cache = db_open_rbt(fa);
+	if (fa->dir_cache == NULL) {
+		close(fa->fd);
+		TALLOC_FREE(fa);
+		return ENOMEM;
+	}
+
+	talloc_set_destructor(fa, fanotify_destructor);
+
+	fde = tevent_add_fd(ctx->ev, fa, fa->fd, TEVENT_FD_READ,
+			    fanotify_handler, fa);
+	if (fde == NULL) {
+		TALLOC_FREE(fa);
+		return ENOMEM;
+	}
+
+	ctx->private_data = fa;
+	return 0;
+}
+
+static struct fanotify_mark_context *fanotify_get_mark(
+	struct fanotify_private *fa,
+	const char *path)
+{
+	struct fanotify_mark_context *m = NULL;
+	struct statfs sbuf;
+	int ret;
+
+	ret = statfs(path, &sbuf);
+	if (ret == -1) {
+		return NULL;
+	}
+
+	for (m = fa->marks; m != NULL; m = m->next) {
+		if (memcmp(&m->fsid, &sbuf.f_fsid, sizeof(m->fsid)) == 0) {
+			return m;
+		}
+	}
+
+	m = talloc_zero(fa, struct fanotify_mark_context);
+	if (m == NULL) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	m->fa = fa;
+	m->fsid = sbuf.f_fsid;
+
+	/*
+	 * Kept open for open_by_handle_at()
+	 */
+	m->mount_fd = open(path, O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if (m->mount_fd == -1) {
+		int err = errno;
+		TALLOC_FREE(m);
+		errno = err;
+		return NULL;
+	}
+
+	ret = fanotify_mark(fa->fd, FAN_MARK_ADD|FAN_MARK_FILESYSTEM,
+			    fanotify_mark_mask(fa), m->mount_fd, NULL);
+#ifdef FAN_RENAME
+	if ((ret == -1) && (errno == EINVAL) && fa->have_rename) {
+		/*
+		 * Kernel older than 5.17, report renames as
+		 * remove/add
+		 */
+		fa->have_rename = false;
+		ret = fanotify_mark(fa->fd, FAN_MARK_ADD|FAN_MARK_FILESYSTEM,
+				    fanotify_mark_mask(fa), m->mount_fd, NULL);
+	}
+#endif
+	if (ret == -1) {
+		int err = errno;
+		DBG_NOTICE("fanotify_mark for %s failed: %s\n",
+			   path, strerror(err));
+		close(m->mount_fd);
+		TALLOC_FREE(m);
+		errno = err;
+		return NULL;
+	}
+
+	DLIST_ADD(fa->marks, m);
+	talloc_set_destructor(m, mark_destructor);
+
+	return m;
+}
+
+/*
+  destroy a watch
+*/
+static int watch_destructor(struct fanotify_watch_context *w)
+{
+	struct fanotify_mark_context *m = w->mark;
+
+	DLIST_REMOVE(w->fa->watches, w);
+
+	m->num_watches -= 1;
+	if (m->num_watches == 0) {
+		TALLOC_FREE(m);
+	}
+	return 0;
+}
+
+/*
+  add a watch. The watch is removed when the caller calls
+  talloc_free() on *handle
+*/
+int fanotify_watch(TALLOC_CTX *mem_ctx,
+		   struct sys_notify_context *ctx,
+		   const char *path,
+		   uint32_t *filter,
+		   uint32_t *subdir_filter,
+		   void (*callback)(struct sys_notify_context *ctx,
+				    void *private_data,
+				    struct notify_event *ev,
+				    uint32_t filter),
+		   void *private_data,
+		   void *handle_p)
+{
+	struct fanotify_private *fa = NULL;
+	struct fanotify_watch_context *w = NULL;
+	uint32_t orig_filter = *filter;
+	uint32_t orig_subdir_filter = *subdir_filter;
+	void **handle = (void **)handle_p;
+
+	if (ctx->private_data == NULL) {
+		int ret = fanotify_setup(ctx);
+		if (ret != 0) {
+#ifdef HAVE_INOTIFY
+			/*
+			 * No fanotify, e.g. kernel too old or missing
+			 * CAP_SYS_ADMIN. inotify takes over the context
+			 * from now on.
+			 */
+			return inotify_watch(mem_ctx, ctx, path, filter,
+					     subdir_filter, callback,
+					     private_data, handle_p);
+#else
+			return ret;
+#endif
+		}
+	}
+
+	fa = talloc_get_type(ctx->private_data, struct fanotify_private);
+	if (fa == NULL) {
+#ifdef HAVE_INOTIFY
+		return inotify_watch(mem_ctx, ctx, path, filter,
+				     subdir_filter, callback,
+				     private_data, handle_p);
+#else
+		return EINVAL;
+#endif
+	}
+
+	if ((fanotify_map(filter) | fanotify_map(subdir_filter)) == 0) {
+		/* this filter can't be handled by fanotify */
+		return EINVAL;
+	}
+
+	w = talloc(mem_ctx, struct fanotify_watch_context);
+	if (w == NULL) {
+		*filter = orig_filter;
+		*subdir_filter = orig_subdir_filter;
+		return ENOMEM;
+	}
+
+	*w = (struct fanotify_watch_context) {
+		.fa = fa,
+		.callback = callback,
+		.private_data = private_data,
+		.filter = orig_filter,
+		.subdir_filter = orig_subdir_filter,
+		.path = talloc_strdup(w, path),
+		.pathlen = strlen(path),
+	};
+	if (w->path == NULL) {
+		*filter = orig_filter;
+		*subdir_filter = orig_subdir_filter;
+		TALLOC_FREE(w);
+		return ENOMEM;
+	}
+
+	/* "/" has a trailing slash, make the prefix match work */
+	if ((w->pathlen > 1) && (w->path[w->pathlen-1] == '/')) {
+		w->pathlen -= 1;
+		w->path[w->pathlen] = '\0';
+	}
+
+	w->mark = fanotify_get_mark(fa, path);
+	if (w->mark == NULL) {
+		int err = errno;
+		*filter = orig_filter;
+		*subdir_filter = orig_subdir_filter;
+		TALLOC_FREE(w);
+		return err;
+	}
+	w->mark->num_watches += 1;
+
+	DBG_DEBUG("fanotify watch for %s filter %"PRIx32
+		  " subdir_filter %"PRIx32"\n",
+		  w->path, orig_filter, orig_subdir_filter);
+
+	(*handle) = w;
+
+	DLIST_ADD(fa->watches, w);
+
+	/* the caller frees the handle to stop watching */
+	talloc_set_destructor(w, watch_destructor);
+
+	return 0;
+}
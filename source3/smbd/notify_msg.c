@@ -129,6 +129,15 @@ static void notify_handler(struct messaging_context *msg, void *private_data,
 	event.path = event_msg->path;
 	event.private_data = event_msg->private_data;
 
+	if (event.path[0] == '\0') {
+		/*
+		 * notifyd collapsed too many changes, see
+		 * notifyd_queue_event(). A NULL name makes notify_fsp()
+		 * reply with the catch-all.
+		 */
+		event.path = NULL;
+	}
+
 	DBG_DEBUG("Got notify_event action=%"PRIu32", private_data=%p, "
 		   "path=%s\n",
 		  event.action,
@@ -38,13 +38,16 @@
 #include "ctdb_srvids.h"
 #include "server_id_db_util.h"
 #include "lib/util/iov_buf.h"
+#include "lib/util/dlinklist.h"
 #include "messages_util.h"
+#include "smbprofile.h"
 
 #ifdef CLUSTER_SUPPORT
 #include "ctdb_protocol.h"
 #endif
 
 struct notifyd_peer;
+struct notifyd_pending;
 
 /*
  * All of notifyd's state
@@ -98,6 +101,20 @@ struct notifyd_state {
 
 	sys_notify_watch_fn sys_notify_watch;
 	struct sys_notify_context *sys_notify_ctx;
+
+	/*
+	 * With coalesce_msec != 0 the events for a watcher are
+	 * collected for that long before they are sent out. Duplicate
+	 * events are merged, more than coalesce_max_events for one
+	 * watcher collapse into a single catch-all "directory
+	 * changed" event. "pending" is indexed by
+	 * notifyd_pending_key() in pending_idx.
+	 */
+	uint32_t coalesce_msec;
+	uint32_t coalesce_max_events;
+	struct notifyd_pending *pending;
+	struct db_context *pending_idx;
+	struct tevent_timer *coalesce_timer;
 };
 
 struct notifyd_peer {
@@ -108,6 +125,25 @@ struct notifyd_peer {
 	time_t last_broadcast;
 };
 
+struct notifyd_pending_event {
+	struct timespec when;
+	uint32_t action;
+	char *path;
+};
+
+/*
+ * Events collected for one watcher during the coalesce window
+ */
+struct notifyd_pending {
+	struct notifyd_pending *prev, *next;
+	struct notifyd_state *state;
+	struct notifyd_instance instance;
+	TDB_DATA watch_path;
+	struct notifyd_pending_event *events;
+	size_t num_events;
+	bool overflow;
+};
+
 static void notifyd_rec_change(struct messaging_context *msg_ctx,
 			       void *private_data, uint32_t msg_type,
 			       struct server_id src, DATA_BLOB *data);
@@ -175,7 +211,9 @@ struct tevent_req *notifyd_send(TALLOC_CTX *mem_ctx, struct tevent_context *ev,
 				struct messaging_context *msg_ctx,
 				struct ctdbd_connection *ctdbd_conn,
 				sys_notify_watch_fn sys_notify_watch,
-				struct sys_notify_context *sys_notify_ctx)
+				struct sys_notify_context *sys_notify_ctx,
+				uint32_t coalesce_msec,
+				uint32_t coalesce_max_events)
 {
 	struct tevent_req *req;
 #ifdef CLUSTER_SUPPORT
@@ -206,6 +244,16 @@ struct tevent_req *notifyd_send(TALLOC_CTX *mem_ctx, struct tevent_context *ev,
 		return tevent_req_post(req, ev);
 	}
 
+	if (coalesce_msec != 0) {
+		state->coalesce_msec = coalesce_msec;
+		state->coalesce_max_events = MAX(coalesce_max_events, 1);
+
+		state->pending_idx = db_open_rbt(state);
+		if (tevent_req_nomem(state->pending_idx, req)) {
+			return tevent_req_post(req, ev);
+		}
+	}
+
 	status = messaging_register(msg_ctx, state, MSG_SMB_NOTIFY_REC_CHANGE,
 				    notifyd_rec_change);
 	if (tevent_req_nterror(req, status)) {
@@ -686,6 +734,8 @@ static void notifyd_rec_change(struct messaging_context *msg_ctx,
 
 	log->num_recs += 1;
 
+	DO_PROFILE_INC(notifyd_reclog_in);
+
 	if (log->num_recs >= 100) {
 		/*
 		 * Don't let the log grow too large
@@ -699,6 +749,7 @@ static void notifyd_rec_change(struct messaging_context *msg_ctx,
 }
 
 struct notifyd_trigger_state {
+	struct notifyd_state *state;
 	struct messaging_context *msg_ctx;
 	struct notify_trigger_msg *msg;
 	bool recursive;
@@ -729,6 +780,9 @@ static void notifyd_trigger(struct messaging_context *msg_ctx,
 		return;
 	}
 
+	DO_PROFILE_INC(notifyd_events_in);
+
+	tstate.state = state;
 	tstate.msg_ctx = msg_ctx;
 
 	tstate.covered_by_sys_notify = (src.vnn == my_id.vnn);
@@ -789,6 +843,59 @@ static void notifyd_trigger(struct messaging_context *msg_ctx,
 static void notifyd_send_delete(struct messaging_context *msg_ctx,
 				TDB_DATA key,
 				struct notifyd_instance *instance);
+static bool notifyd_queue_event(struct notifyd_state *state,
+				TDB_DATA key,
+				const struct notifyd_instance *instance,
+				const struct notify_event_msg *msg,
+				const char *path);
+
+/*
+ * Send one MSG_PVFS_NOTIFY, discard the watch if the receiver has died
+ */
+
+static NTSTATUS notifyd_send_event(struct messaging_context *msg_ctx,
+				   TDB_DATA key,
+				   struct notifyd_instance *instance,
+				   struct notify_event_msg *msg,
+				   const char *path)
+{
+	struct server_id_buf idbuf;
+	struct iovec iov[2];
+	NTSTATUS status;
+
+	msg->private_data = instance->instance.private_data;
+
+	iov[0].iov_base = msg;
+	iov[0].iov_len = offsetof(struct notify_event_msg, path);
+	iov[1].iov_base = discard_const_p(char, path);
+	iov[1].iov_len = strlen(path) + 1;
+
+	status = messaging_send_iov(
+		msg_ctx, instance->client,
+		MSG_PVFS_NOTIFY, iov, ARRAY_SIZE(iov), NULL, 0);
+
+	DBG_DEBUG("messaging_send_iov to %s returned %s\n",
+		  server_id_str_buf(instance->client, &idbuf),
+		  nt_errstr(status));
+
+	DO_PROFILE_INC(notifyd_messages_out);
+
+	if (NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_NOT_FOUND) &&
+	    procid_is_local(&instance->client)) {
+		/*
+		 * That process has died
+		 */
+		notifyd_send_delete(msg_ctx, key, instance);
+		return status;
+	}
+
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_WARNING("messaging_send_iov returned %s\n",
+			    nt_errstr(status));
+	}
+
+	return status;
+}
 
 static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 				   void *private_data)
@@ -797,8 +904,7 @@ static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 	struct notifyd_trigger_state *tstate = private_data;
 	struct notify_event_msg msg = { .action = tstate->msg->action,
 					.when = tstate->msg->when };
-	struct iovec iov[2];
-	size_t path_len = key.dsize;
+	const char *path = tstate->msg->path + key.dsize + 1;
 	struct notifyd_watcher watcher = {};
 	struct notifyd_instance *instances = NULL;
 	size_t num_instances = 0;
@@ -820,16 +926,9 @@ static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 		  (int)key.dsize,
 		  (char *)key.dptr);
 
-	iov[0].iov_base = &msg;
-	iov[0].iov_len = offsetof(struct notify_event_msg, path);
-	iov[1].iov_base = tstate->msg->path + path_len + 1;
-	iov[1].iov_len = strlen((char *)(iov[1].iov_base)) + 1;
-
 	for (i=0; i<num_instances; i++) {
 		struct notifyd_instance *instance = &instances[i];
-		struct server_id_buf idbuf;
 		uint32_t i_filter;
-		NTSTATUS status;
 
 		if (tstate->covered_by_sys_notify) {
 			if (tstate->recursive) {
@@ -851,29 +950,225 @@ static void notifyd_trigger_parser(TDB_DATA key, TDB_DATA data,
 			continue;
 		}
 
-		msg.private_data = instance->instance.private_data;
+		if (notifyd_queue_event(tstate->state, key, instance,
+					&msg, path)) {
+			continue;
+		}
 
-		status = messaging_send_iov(
-			tstate->msg_ctx, instance->client,
-			MSG_PVFS_NOTIFY, iov, ARRAY_SIZE(iov), NULL, 0);
+		notifyd_send_event(tstate->msg_ctx, key, instance, &msg, path);
+	}
+}
 
-		DBG_DEBUG("messaging_send_iov to %s returned %s\n",
-			  server_id_str_buf(instance->client, &idbuf),
-			  nt_errstr(status));
+static size_t notifyd_pending_key(const struct notifyd_instance *instance,
+				  uint8_t buf[SERVER_ID_BUF_LENGTH +
+					      sizeof(void *)])
+{
+	server_id_put(buf, instance->client);
+	memcpy(buf + SERVER_ID_BUF_LENGTH,
+	       &instance->instance.private_data,
+	       sizeof(void *));
+	return SERVER_ID_BUF_LENGTH + sizeof(void *);
+}
+
+static int notifyd_pending_destructor(struct notifyd_pending *p)
+{
+	struct notifyd_state *state = p->state;
+	uint8_t keybuf[SERVER_ID_BUF_LENGTH + sizeof(void *)];
+	TDB_DATA key = { .dptr = keybuf };
+
+	key.dsize = notifyd_pending_key(&p->instance, keybuf);
+	dbwrap_delete(state->pending_idx, key);
+	DLIST_REMOVE(state->pending, p);
+	return 0;
+}
+
+struct notifyd_pending_fetch_state {
+	struct notifyd_pending *p;
+};
+
+static void notifyd_pending_fetch_parser(TDB_DATA key, TDB_DATA data,
+					 void *private_data)
+{
+	struct notifyd_pending_fetch_state *state = private_data;
+
+	if (data.dsize == sizeof(state->p)) {
+		memcpy(&state->p, data.dptr, sizeof(state->p));
+	}
+}
+
+static void notifyd_coalesce_flush(struct tevent_context *ev,
+				   struct tevent_timer *te,
+				   struct timeval current_time,
+				   void *private_data);
+
+/*
+ * Put an event into the coalescing buffer of a watcher. Returns false
+ * if coalescing is off or failed, the caller then sends the event
+ * right away.
+ */
+
+static bool notifyd_queue_event(struct notifyd_state *state,
+				TDB_DATA key,
+				const struct notifyd_instance *instance,
+				const struct notify_event_msg *msg,
+				const char *path)
+{
+	struct notifyd_pending_fetch_state fstate = {};
+	uint8_t keybuf[SERVER_ID_BUF_LENGTH + sizeof(void *)];
+	TDB_DATA pkey = { .dptr = keybuf };
+	struct notifyd_pending *p = NULL;
+	struct notifyd_pending_event *events = NULL;
+	size_t i;
+	NTSTATUS status;
+
+	if (state->coalesce_msec == 0) {
+		return false;
+	}
+
+	if (state->coalesce_timer == NULL) {
+		state->coalesce_timer = tevent_add_timer(
+			state->ev, state,
+			timeval_current_ofs_msec(state->coalesce_msec),
+			notifyd_coalesce_flush, state);
+		if (state->coalesce_timer == NULL) {
+			return false;
+		}
+	}
+
+	pkey.dsize = notifyd_pending_key(instance, keybuf);
 
-		if (NT_STATUS_EQUAL(status, NT_STATUS_OBJECT_NAME_NOT_FOUND) &&
-		    procid_is_local(&instance->client)) {
+	dbwrap_parse_record(state->pending_idx, pkey,
+			    notifyd_pending_fetch_parser, &fstate);
+	p = fstate.p;
+
+	if (p == NULL) {
+		p = talloc_zero(state, struct notifyd_pending);
+		if (p == NULL) {
+			return false;
+		}
+		p->state = state;
+		p->instance = *instance;
+		p->watch_path.dptr = talloc_memdup(p, key.dptr, key.dsize);
+		if (p->watch_path.dptr == NULL) {
+			TALLOC_FREE(p);
+			return false;
+		}
+		p->watch_path.dsize = key.dsize;
+
+		status = dbwrap_store(state->pending_idx, pkey,
+				      make_tdb_data((uint8_t *)&p, sizeof(p)),
+				      0);
+		if (!NT_STATUS_IS_OK(status)) {
+			TALLOC_FREE(p);
+			return false;
+		}
+		DLIST_ADD_END(state->pending, p);
+		talloc_set_destructor(p, notifyd_pending_destructor);
+	}
+
+	if (p->overflow) {
+		DO_PROFILE_INC(notifyd_events_collapsed);
+		return true;
+	}
+
+	/*
+	 * Only merge with the last event for the same name, anything
+	 * else would reorder events
+	 */
+	for (i = p->num_events; i > 0; i--) {
+		struct notifyd_pending_event *e = &p->events[i-1];
+
+		if (strcmp(e->path, path) != 0) {
+			continue;
+		}
+		if (e->action == msg->action) {
+			e->when = msg->when;
+			DO_PROFILE_INC(notifyd_events_merged);
+			return true;
+		}
+		break;
+	}
+
+	if (p->num_events >= state->coalesce_max_events) {
+		/*
+		 * Too many changes, tell the client to re-read the
+		 * directory
+		 */
+		TALLOC_FREE(p->events);
+		p->num_events = 0;
+		p->overflow = true;
+		DO_PROFILE_INC(notifyd_events_collapsed);
+		return true;
+	}
+
+	events = talloc_realloc(p, p->events, struct notifyd_pending_event,
+				p->num_events + 1);
+	if (events == NULL) {
+		return false;
+	}
+	p->events = events;
+
+	events[p->num_events] = (struct notifyd_pending_event) {
+		.when = msg->when,
+		.action = msg->action,
+		.path = talloc_strdup(events, path),
+	};
+	if (events[p->num_events].path == NULL) {
+		return false;
+	}
+	p->num_events += 1;
+
+	return true;
+}
+
+static void notifyd_coalesce_flush(struct tevent_context *ev,
+				   struct tevent_timer *te,
+				   struct timeval current_time,
+				   void *private_data)
+{
+	struct notifyd_state *state = talloc_get_type_abort(
+		private_data, struct notifyd_state);
+
+	TALLOC_FREE(state->coalesce_timer);
+
+	while (state->pending != NULL) {
+		struct notifyd_pending *p = state->pending;
+		struct notify_event_msg msg = {};
+		size_t i;
+		NTSTATUS status;
+
+		if (p->overflow) {
 			/*
-			 * That process has died
+			 * An empty name is the catch-all, see
+			 * notify_handler(). The action does not matter.
 			 */
-			notifyd_send_delete(tstate->msg_ctx, key, instance);
+			msg = (struct notify_event_msg) {
+				.when = timespec_current(),
+			};
+			notifyd_send_event(state->msg_ctx, p->watch_path,
+					   &p->instance, &msg, "");
+			TALLOC_FREE(p);
 			continue;
 		}
 
-		if (!NT_STATUS_IS_OK(status)) {
-			DBG_WARNING("messaging_send_iov returned %s\n",
-				    nt_errstr(status));
+		for (i = 0; i < p->num_events; i++) {
+			struct notifyd_pending_event *e = &p->events[i];
+
+			msg = (struct notify_event_msg) {
+				.when = e->when,
+				.action = e->action,
+			};
+			status = notifyd_send_event(state->msg_ctx,
+						    p->watch_path,
+						    &p->instance,
+						    &msg,
+						    e->path);
+			if (NT_STATUS_EQUAL(status,
+					    NT_STATUS_OBJECT_NAME_NOT_FOUND)) {
+				break;
+			}
 		}
+		TALLOC_FREE(p);
 	}
 }
 
@@ -1037,6 +1332,75 @@ static void notifyd_got_db(struct messaging_context *msg_ctx,
 		  count);
 }
 
+/*
+ * A rec_change for a (client, private_data, path) replaces whatever the
+ * earlier ones for the same watch did, see notifyd_apply_rec_change().
+ * Only broadcast the last one.
+ */
+
+static bool notifyd_rec_change_same_watch(const struct messaging_rec *r1,
+					  const struct messaging_rec *r2)
+{
+	struct notify_rec_change_msg *m1 = NULL;
+	struct notify_rec_change_msg *m2 = NULL;
+	size_t len1, len2;
+	void *p1, *p2;
+	bool ok;
+
+	if ((r1->msg_type != r2->msg_type) ||
+	    !server_id_equal(&r1->src, &r2->src)) {
+		return false;
+	}
+
+	ok = notifyd_parse_rec_change(r1->buf.data, r1->buf.length,
+				      &m1, &len1);
+	if (!ok) {
+		return false;
+	}
+	ok = notifyd_parse_rec_change(r2->buf.data, r2->buf.length,
+				      &m2, &len2);
+	if (!ok) {
+		return false;
+	}
+
+	/* avoid SIGBUS */
+	memcpy(&p1, &m1->instance.private_data, sizeof(p1));
+	memcpy(&p2, &m2->instance.private_data, sizeof(p2));
+
+	return ((p1 == p2) &&
+		(len1 == len2) &&
+		(memcmp(m1->path, m2->path, len1) == 0));
+}
+
+static void notifyd_compact_reclog(struct messaging_reclog *log)
+{
+	uint32_t i, j, num_recs = 0;
+
+	for (i=0; i<log->num_recs; i++) {
+		struct messaging_rec *r = log->recs[i];
+		bool superseded = false;
+
+		for (j=i+1; j<log->num_recs; j++) {
+			if (notifyd_rec_change_same_watch(r, log->recs[j])) {
+				superseded = true;
+				break;
+			}
+		}
+
+		if (superseded) {
+			TALLOC_FREE(log->recs[i]);
+			continue;
+		}
+		log->recs[num_recs++] = r;
+	}
+
+	DBG_DEBUG("Compacted %"PRIu32" records to %"PRIu32"\n",
+		  log->num_recs, num_recs);
+
+	log->num_recs = num_recs;
+	SMBPROFILE_COUNT_INCREMENT(notifyd_reclog_out, profile_p, num_recs);
+}
+
 static void notifyd_broadcast_reclog(struct ctdbd_connection *ctdbd_conn,
 				     struct server_id src,
 				     struct messaging_reclog *log)
@@ -1051,6 +1415,8 @@ static void notifyd_broadcast_reclog(struct ctdbd_connection *ctdbd_conn,
 		return;
 	}
 
+	notifyd_compact_reclog(log);
+
 	DBG_DEBUG("rec_index=%"PRIu64", num_recs=%"PRIu32"\n",
 		  log->rec_index,
 		  log->num_recs);
@@ -139,7 +139,9 @@ struct tevent_req *notifyd_send(TALLOC_CTX *mem_ctx, struct tevent_context *ev,
 				struct messaging_context *msg_ctx,
 				struct ctdbd_connection *ctdbd_conn,
 				sys_notify_watch_fn sys_notify_watch,
-				struct sys_notify_context *sys_notify_ctx);
+				struct sys_notify_context *sys_notify_ctx,
+				uint32_t coalesce_msec,
+				uint32_t coalesce_max_events);
 int notifyd_recv(struct tevent_req *req);
 
 #endif
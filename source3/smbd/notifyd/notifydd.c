@@ -74,7 +74,9 @@ int main(int argc, const char *argv[])
 	}
 
 	req = notifyd_send(ev, ev, msg, messaging_ctdb_connection(),
-			   NULL, NULL);
+			   NULL, NULL,
+			   lp_change_notify_coalesce_msec(),
+			   lp_change_notify_coalesce_max_events());
 	if (req == NULL) {
 		fprintf(stderr, "notifyd_send failed\n");
 		return 1;
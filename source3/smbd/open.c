@@ -42,7 +42,9 @@
 #include "locking/leases_db.h"
 #include "librpc/gen_ndr/ndr_leases_db.h"
 #include "lib/util/time_basic.h"
+#include "lib/util/util_tdb.h"
 #include "source3/smbd/dir.h"
+#include "lib/tdb_wrap/tdb_wrap.h"
 
 #if defined(HAVE_LINUX_MAGIC_H)
 #include <linux/magic.h>
@@ -248,6 +250,271 @@ access_denied:
 	return NT_STATUS_OK;
 }
 
+/*
+ * Per connection cache of access masks se_file_access_check() granted
+ * recently. Clients tend to open the same file several times within
+ * a few seconds, each time fetching and evaluating the NT ACL.
+ *
+ * An entry is bound to the file_id, the ctime and the token it was
+ * granted for. A change of the mode or the owner changes the ctime,
+ * and opens stat the file freshly. An NT ACL stored by acl_tdb, or by
+ * acl_xattr on top of xattr_tdb, changes without touching the ctime
+ * though, so fset_nt_acl_common() also bumps the seqnum of
+ * sd_changes.tdb, and the cache is dropped once that moves. That way
+ * changes done by other processes are seen as well. Only grants are
+ * cached: denials also depend on the parent directory and on share
+ * options. Entries expire after ACCESS_CHECK_CACHE_TTL seconds.
+ */
+
+#define ACCESS_CHECK_CACHE_SIZE 64
+#define ACCESS_CHECK_CACHE_TTL 10
+
+struct access_check_cache_entry {
+	struct file_id id;
+	struct timespec ctime;
+	NTTIME twrp;
+	const struct auth_session_info *session_info;
+	const struct security_token *token;
+	bool use_privs;
+	uint32_t granted;
+	time_t added;
+};
+
+struct access_check_cache {
+	int sd_seqnum;
+	unsigned int next_entry;
+	struct access_check_cache_entry entries[ACCESS_CHECK_CACHE_SIZE];
+};
+
+void access_check_cache_flush(connection_struct *conn)
+{
+	TALLOC_FREE(conn->access_check_cache);
+}
+
+static struct tdb_wrap *access_check_sd_changes_db(void)
+{
+	static struct tdb_wrap *db;
+	char *db_path = NULL;
+	int tdbflags = TDB_INCOMPATIBLE_HASH | TDB_CLEAR_IF_FIRST |
+		TDB_MUTEX_LOCKING | TDB_SEQNUM;
+
+	if (db != NULL) {
+		return db;
+	}
+
+	db_path = lock_path(talloc_tos(), "sd_changes.tdb");
+	if (db_path == NULL) {
+		return NULL;
+	}
+
+	/* We might be running as the user of the connection */
+	become_root();
+	db = tdb_wrap_open(NULL, db_path, 0, tdbflags,
+			   O_CREAT | O_RDWR, 0644);
+	unbecome_root();
+	if (db == NULL) {
+		DBG_ERR("Failed to open sd_changes.tdb\n");
+	}
+
+	TALLOC_FREE(db_path);
+	return db;
+}
+
+/*
+ * Returns -1 if changes can't be tracked, the cache must not be
+ * used then.
+ */
+static int access_check_sd_seqnum(void)
+{
+	struct tdb_wrap *db = access_check_sd_changes_db();
+
+	if (db == NULL) {
+		return -1;
+	}
+	return tdb_get_seqnum(db->tdb);
+}
+
+/*
+ * Called whenever an NT ACL was stored, possibly without changing
+ * the ctime of the file.
+ */
+void access_check_cache_sd_changed(const struct files_struct *fsp)
+{
+	struct tdb_wrap *db = access_check_sd_changes_db();
+	TDB_DATA key = string_term_tdb_data("SD_CHANGED");
+	TDB_DATA data = {
+		.dptr = discard_const_p(uint8_t, &fsp->file_id),
+		.dsize = sizeof(fsp->file_id),
+	};
+	int ret;
+
+	if (db == NULL) {
+		return;
+	}
+
+	/* Any store moves the seqnum, the data is just for debugging */
+	ret = tdb_store(db->tdb, key, data, TDB_REPLACE);
+	if (ret != 0) {
+		DBG_WARNING("tdb_store failed: %s\n",
+			    tdb_errorstr(db->tdb));
+	}
+}
+
+static bool access_check_cache_usable(const struct files_struct *fsp,
+				      uint32_t access_mask)
+{
+	const struct smb_filename *smb_fname = fsp->fsp_name;
+
+	if (!lp_access_check_cache(SNUM(fsp->conn))) {
+		return false;
+	}
+	if (!VALID_STAT(smb_fname->st)) {
+		return false;
+	}
+	if (access_mask & (SEC_FLAG_MAXIMUM_ALLOWED|SEC_FLAG_SYSTEM_SECURITY)) {
+		return false;
+	}
+	return true;
+}
+
+static struct access_check_cache_entry *access_check_cache_find(
+	connection_struct *conn,
+	const struct files_struct *fsp,
+	bool use_privs,
+	int sd_seqnum)
+{
+	struct access_check_cache *cache = conn->access_check_cache;
+	const struct security_token *token = get_current_nttok(conn);
+	const struct smb_filename *smb_fname = fsp->fsp_name;
+	unsigned int i;
+
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	if (cache->sd_seqnum != sd_seqnum) {
+		/* Some NT ACL has changed, forget everything */
+		DO_PROFILE_INC(access_check_cache_expired);
+		*cache = (struct access_check_cache) {
+			.sd_seqnum = sd_seqnum,
+		};
+		return NULL;
+	}
+
+	for (i = 0; i < ACCESS_CHECK_CACHE_SIZE; i++) {
+		struct access_check_cache_entry *e = &cache->entries[i];
+
+		if (e->token == NULL) {
+			continue;
+		}
+		if (!file_id_equal(&e->id, &fsp->file_id)) {
+			continue;
+		}
+		if ((e->token != token) ||
+		    (e->session_info != conn->session_info) ||
+		    (e->use_privs != use_privs) ||
+		    (e->twrp != smb_fname->twrp)) {
+			continue;
+		}
+		if (timespec_compare(&e->ctime,
+				     &smb_fname->st.st_ex_ctime) != 0) {
+			/* The file has changed, forget it */
+			DO_PROFILE_INC(access_check_cache_expired);
+			*e = (struct access_check_cache_entry) { .token = NULL };
+			continue;
+		}
+		return e;
+	}
+	return NULL;
+}
+
+static bool access_check_cache_lookup(const struct files_struct *fsp,
+				      bool use_privs,
+				      uint32_t access_mask,
+				      int sd_seqnum)
+{
+	struct access_check_cache_entry *e = NULL;
+
+	DO_PROFILE_INC(access_check_cache_lookups);
+
+	e = access_check_cache_find(fsp->conn, fsp, use_privs, sd_seqnum);
+	if (e == NULL) {
+		return false;
+	}
+	if (time_mono(NULL) - e->added > ACCESS_CHECK_CACHE_TTL) {
+		DO_PROFILE_INC(access_check_cache_expired);
+		*e = (struct access_check_cache_entry) { .token = NULL };
+		return false;
+	}
+	if ((e->granted & access_mask) != access_mask) {
+		return false;
+	}
+
+	DO_PROFILE_INC(access_check_cache_hits);
+	DBG_DEBUG("cached grant 0x%"PRIx32" on %s covers 0x%"PRIx32"\n",
+		  e->granted,
+		  fsp_str_dbg(fsp),
+		  access_mask);
+	return true;
+}
+
+/*
+ * sd_seqnum must have been taken before the NT ACL was read, so a
+ * grant based on an ACL changed in the meantime is not cached.
+ */
+static void access_check_cache_add(const struct files_struct *fsp,
+				   bool use_privs,
+				   uint32_t access_mask,
+				   int sd_seqnum)
+{
+	connection_struct *conn = fsp->conn;
+	struct access_check_cache *cache = conn->access_check_cache;
+	const struct smb_filename *smb_fname = fsp->fsp_name;
+	struct access_check_cache_entry *e = NULL;
+
+	/*
+	 * Coarse timestamps might not tell apart two changes within
+	 * the same tick, don't trust a ctime that is that recent.
+	 */
+	if (smb_fname->st.st_ex_ctime.tv_sec + 1 >= time(NULL)) {
+		return;
+	}
+
+	if (access_check_sd_seqnum() != sd_seqnum) {
+		return;
+	}
+
+	if (cache == NULL) {
+		cache = talloc_zero(conn, struct access_check_cache);
+		if (cache == NULL) {
+			return;
+		}
+		cache->sd_seqnum = sd_seqnum;
+		conn->access_check_cache = cache;
+	}
+
+	e = access_check_cache_find(conn, fsp, use_privs, sd_seqnum);
+	if (e != NULL) {
+		e->granted |= access_mask;
+		e->added = time_mono(NULL);
+		return;
+	}
+
+	e = &cache->entries[cache->next_entry];
+	cache->next_entry = (cache->next_entry + 1) % ACCESS_CHECK_CACHE_SIZE;
+
+	*e = (struct access_check_cache_entry) {
+		.id = fsp->file_id,
+		.ctime = smb_fname->st.st_ex_ctime,
+		.twrp = smb_fname->twrp,
+		.session_info = conn->session_info,
+		.token = get_current_nttok(conn),
+		.use_privs = use_privs,
+		.granted = access_mask,
+		.added = time_mono(NULL),
+	};
+}
+
 NTSTATUS smbd_check_access_rights_fsp(struct files_struct *dirfsp,
 				      struct files_struct *fsp,
 				      bool use_privs,
@@ -255,6 +522,9 @@ NTSTATUS smbd_check_access_rights_fsp(struct files_struct *dirfsp,
 {
 	struct security_descriptor *sd = NULL;
 	uint32_t do_not_check_mask = 0;
+	uint32_t rejected_mask = 0;
+	bool use_cache;
+	int sd_seqnum = -1;
 	NTSTATUS status;
 
 	/* Cope with fake/printer fsp's. */
@@ -312,6 +582,20 @@ NTSTATUS smbd_check_access_rights_fsp(struct files_struct *dirfsp,
 		return status;
 	}
 
+	use_cache = access_check_cache_usable(fsp, access_mask);
+	if (use_cache) {
+		sd_seqnum = access_check_sd_seqnum();
+		use_cache = (sd_seqnum != -1);
+	}
+	if (use_cache &&
+	    access_check_cache_lookup(fsp,
+				      use_privs,
+				      access_mask & ~do_not_check_mask,
+				      sd_seqnum))
+	{
+		return NT_STATUS_OK;
+	}
+
 	status = SMB_VFS_FGET_NT_ACL(metadata_fsp(fsp),
 				     (SECINFO_OWNER |
 				      SECINFO_GROUP |
@@ -325,6 +609,22 @@ NTSTATUS smbd_check_access_rights_fsp(struct files_struct *dirfsp,
 		return status;
 	}
 
+	if (use_cache && sd != NULL) {
+		status = se_file_access_check(sd,
+					      get_current_nttok(fsp->conn),
+					      use_privs,
+					      access_mask & ~do_not_check_mask,
+					      &rejected_mask);
+		if (NT_STATUS_IS_OK(status)) {
+			access_check_cache_add(fsp,
+					       use_privs,
+					       access_mask & ~do_not_check_mask,
+					       sd_seqnum);
+			TALLOC_FREE(sd);
+			return NT_STATUS_OK;
+		}
+	}
+
 	status = smbd_check_access_rights_sd(fsp->conn,
 					     dirfsp,
 					     fsp->fsp_name,
@@ -1261,7 +1561,7 @@ static NTSTATUS open_file(
 		}
 	}
 
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &smb_fname->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &smb_fname->st));
 	fsp->vuid = req ? req->vuid : UID_FIELD_INVALID;
 	fsp->file_pid = req ? req->smbpid : 0;
 	if (file_existed && S_ISLNK(smb_fname->st.st_ex_mode)) {
@@ -2147,8 +2447,62 @@ struct delay_for_oplock_state {
 	uint32_t total_lease_types;
 	bool delay;
 	struct blocker_debug_state *blocker_debug_state;
+
+	/*
+	 * Leases we sent a break for in this pass. A lease covering
+	 * several opens of the file has one share mode entry per open,
+	 * but the holder only needs to hear about it once.
+	 */
+	struct delay_for_oplock_lease_break {
+		struct server_id pid;
+		struct GUID client_guid;
+		struct smb2_lease_key lease_key;
+		uint32_t break_to;
+	} *lease_breaks;
+	size_t num_lease_breaks;
 };
 
+static bool delay_for_oplock_lease_break_sent(
+	struct delay_for_oplock_state *state,
+	const struct share_mode_entry *e,
+	uint32_t break_to)
+{
+	struct delay_for_oplock_lease_break *tmp = NULL;
+	size_t i;
+
+	for (i = 0; i < state->num_lease_breaks; i++) {
+		struct delay_for_oplock_lease_break *b =
+			&state->lease_breaks[i];
+
+		if (server_id_equal(&b->pid, &e->pid) &&
+		    GUID_equal(&b->client_guid, &e->client_guid) &&
+		    smb2_lease_key_equal(&b->lease_key, &e->lease_key) &&
+		    (b->break_to == break_to))
+		{
+			return true;
+		}
+	}
+
+	tmp = talloc_realloc(talloc_tos(),
+			     state->lease_breaks,
+			     struct delay_for_oplock_lease_break,
+			     state->num_lease_breaks + 1);
+	if (tmp == NULL) {
+		/* Just send a duplicate break */
+		return false;
+	}
+	tmp[state->num_lease_breaks] = (struct delay_for_oplock_lease_break) {
+		.pid = e->pid,
+		.client_guid = e->client_guid,
+		.lease_key = e->lease_key,
+		.break_to = break_to,
+	};
+	state->lease_breaks = tmp;
+	state->num_lease_breaks += 1;
+
+	return false;
+}
+
 static int blocker_debug_state_destructor(struct blocker_debug_state *state)
 {
 	if (state->num_blockers == 0) {
@@ -2315,11 +2669,17 @@ static bool delay_for_oplock_fn(
 		break_to &= ~(SMB2_LEASE_HANDLE|SMB2_LEASE_WRITE);
 	}
 
-	DBG_DEBUG("breaking from %d to %d\n",
-		  (int)e_lease_type,
-		  (int)break_to);
-	send_break_message(
-		fsp->conn->sconn->msg_ctx, &fsp->file_id, e, break_to);
+	if (e_is_lease &&
+	    delay_for_oplock_lease_break_sent(state, e, break_to))
+	{
+		DBG_DEBUG("lease break to %d already sent\n", (int)break_to);
+	} else {
+		DBG_DEBUG("breaking from %d to %d\n",
+			  (int)e_lease_type,
+			  (int)break_to);
+		send_break_message(
+			fsp->conn->sconn->msg_ctx, &fsp->file_id, e, break_to);
+	}
 	if (e_lease_type & state->delay_mask) {
 		state->delay = true;
 	}
@@ -2462,6 +2822,7 @@ static NTSTATUS delay_for_oplock(files_struct *fsp,
 
 	state.total_lease_types = SMB2_LEASE_NONE;
 	ok = share_mode_forall_entries(lck, delay_for_oplock_fn, &state);
+	TALLOC_FREE(state.lease_breaks);
 	if (!ok) {
 		return NT_STATUS_INTERNAL_ERROR;
 	}
@@ -2652,6 +3013,9 @@ static bool request_timed_out(struct smb_request *req, struct timeval timeout)
 
 struct defer_open_state {
 	struct smbXsrv_connection *xconn;
+	struct tevent_context *ev;
+	struct file_id id;
+	struct timeval abs_timeout;
 	uint64_t mid;
 };
 
@@ -2699,8 +3063,13 @@ static void defer_open(struct share_mode_lock *lck,
 	if (watch_state == NULL) {
 		exit_server("talloc failed");
 	}
-	watch_state->xconn = req->xconn;
-	watch_state->mid = req->mid;
+	*watch_state = (struct defer_open_state) {
+		.xconn = req->xconn,
+		.ev = req->sconn->ev_ctx,
+		.id = id,
+		.abs_timeout = abs_timeout,
+		.mid = req->mid,
+	};
 
 	DBG_DEBUG("deferring mid %" PRIu64 "\n", req->mid);
 
@@ -2728,15 +3097,111 @@ static void defer_open(struct share_mode_lock *lck,
 	}
 }
 
+struct oplock_break_pending_state {
+	struct file_id id;
+	bool pending;
+};
+
+static bool oplock_break_pending_fn(
+	struct share_mode_entry *e,
+	bool *modified,
+	void *private_data)
+{
+	struct oplock_break_pending_state *state = private_data;
+	bool breaking = false;
+	NTSTATUS status;
+
+	if (share_entry_stale_pid(e)) {
+		return false;
+	}
+
+	if ((e->op_type == EXCLUSIVE_OPLOCK) || (e->op_type == BATCH_OPLOCK)) {
+		state->pending = true;
+		return true;
+	}
+
+	if (e->op_type != LEASE_OPLOCK) {
+		return false;
+	}
+
+	status = leases_db_get(&e->client_guid,
+			       &e->lease_key,
+			       &state->id,
+			       NULL, /* current_state */
+			       &breaking,
+			       NULL, /* breaking_to_requested */
+			       NULL, /* breaking_to_required */
+			       NULL, /* lease_version */
+			       NULL); /* epoch */
+	if (NT_STATUS_IS_OK(status) && breaking) {
+		state->pending = true;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Every break ack modifies the share mode record and wakes us up. If
+ * other holders are still breaking, a retried open would just defer
+ * again, so keep waiting until the last ack (or our timeout) arrives.
+ */
+static bool oplock_breaks_pending(struct file_id id)
+{
+	struct oplock_break_pending_state state = { .id = id };
+	struct share_mode_lock *lck = NULL;
+	bool ok;
+
+	lck = fetch_share_mode_unlocked(talloc_tos(), id);
+	if (lck == NULL) {
+		return false;
+	}
+
+	ok = share_mode_forall_entries(lck, oplock_break_pending_fn, &state);
+	TALLOC_FREE(lck);
+	if (!ok) {
+		return false;
+	}
+
+	return state.pending;
+}
+
 static void defer_open_done(struct tevent_req *req)
 {
 	struct defer_open_state *state = tevent_req_callback_data(
 		req, struct defer_open_state);
+	struct tevent_req *watch_req = NULL;
 	NTSTATUS status;
 	bool ret;
 
 	status = share_mode_watch_recv(req, NULL, NULL);
 	TALLOC_FREE(req);
+
+	if (NT_STATUS_IS_OK(status) && oplock_breaks_pending(state->id)) {
+		DBG_DEBUG("breaks still pending, mid %" PRIu64 " keeps "
+			  "waiting\n",
+			  state->mid);
+
+		watch_req = share_mode_watch_send(
+			state,
+			state->ev,
+			&state->id,
+			(struct server_id){0});
+		if (watch_req != NULL) {
+			tevent_req_set_callback(
+				watch_req, defer_open_done, state);
+			ret = tevent_req_set_endtime(
+				watch_req, state->ev, state->abs_timeout);
+			if (ret) {
+				return;
+			}
+			TALLOC_FREE(watch_req);
+		}
+		DBG_WARNING("Could not rearm share mode watch, "
+			    "retrying mid %" PRIu64 "\n",
+			    state->mid);
+	}
+
 	if (!NT_STATUS_IS_OK(status)) {
 		DBG_ERR("share_mode_watch_recv() returned %s, "
 			"rescheduling mid %" PRIu64 "\n",
@@ -3545,6 +4010,228 @@ static void possibly_set_archive(struct connection_struct *conn,
 	*unx_mode = smb_fname->st.st_ex_mode;
 }
 
+/*
+ * A stat open that the client closes again in the same SMB2 compound
+ * (NTCREATEX_FLAG_COMPOUND_STAT_OPEN) does not need a share mode entry
+ * if nobody else has the file open: opens with only these access bits
+ * never conflict with share modes, don't get oplocks, can't set delete
+ * on close and can't take byte range locks. Skipping the entry saves
+ * two locked share mode record updates per CREATE/QUERY_INFO/CLOSE.
+ *
+ * With "stat open share entry delay" other stat opens get the same
+ * treatment, but the entry is only deferred (*defer = true): it is
+ * written once the handle outlives the delay or another open of the
+ * file arrives in this process.
+ */
+static bool open_ntcreate_skip_share_entry(struct files_struct *fsp,
+					   uint32_t private_flags,
+					   uint32_t access_mask,
+					   uint32_t open_access_mask,
+					   int oplock_request,
+					   const struct smb2_lease *lease,
+					   int info,
+					   bool keep_locked,
+					   bool *defer)
+{
+	const uint32_t allowed_bits =
+		(SYNCHRONIZE_ACCESS|
+		 FILE_READ_ATTRIBUTES|
+		 READ_CONTROL_ACCESS);
+	struct share_mode_lock *lck = NULL;
+	bool compound;
+
+	*defer = false;
+
+	compound = ((private_flags & NTCREATEX_FLAG_COMPOUND_STAT_OPEN) &&
+		    lp_smb2_compound_stat_opens(SNUM(fsp->conn)));
+	if (!compound &&
+	    (lp_stat_open_share_entry_delay(SNUM(fsp->conn)) <= 0))
+	{
+		return false;
+	}
+	if (lp_kernel_share_modes(SNUM(fsp->conn))) {
+		return false;
+	}
+	if ((info != FILE_WAS_OPENED) || keep_locked) {
+		return false;
+	}
+	if ((oplock_request != NO_OPLOCK) || (lease != NULL)) {
+		return false;
+	}
+	if (((access_mask | open_access_mask) & ~allowed_bits) != 0) {
+		return false;
+	}
+	if (!S_ISREG(fsp->fsp_name->st.st_ex_mode) ||
+	    fsp_is_alternate_stream(fsp))
+	{
+		return false;
+	}
+
+	/*
+	 * Any existing record may carry a pending delete on close or
+	 * oplocks, give it the full treatment.
+	 */
+	lck = fetch_share_mode_unlocked(talloc_tos(), fsp->file_id);
+	if (lck != NULL) {
+		TALLOC_FREE(lck);
+		return false;
+	}
+
+	*defer = !compound;
+	return true;
+}
+
+struct deferred_share_entry {
+	struct files_struct *fsp;
+	struct tevent_timer *te;
+	uid_t uid;
+	uint32_t share_access;
+	NTSTATUS status;
+};
+
+static void deferred_share_entry_add_fn(struct share_mode_lock *lck,
+					bool *keep_locked,
+					void *private_data)
+{
+	struct deferred_share_entry *d = talloc_get_type_abort(
+		private_data, struct deferred_share_entry);
+	struct files_struct *fsp = d->fsp;
+	bool ok;
+
+	*keep_locked = false;
+
+	share_mode_flags_restrict(lck, fsp->access_mask, d->share_access, 0);
+
+	ok = set_share_mode(lck,
+			    fsp,
+			    d->uid,
+			    fsp->mid,
+			    NO_OPLOCK,
+			    NULL,
+			    d->share_access,
+			    fsp->access_mask);
+	d->status = ok ? NT_STATUS_OK : NT_STATUS_NO_MEMORY;
+}
+
+/*
+ * Write the share mode entry of a deferred stat open to locking.tdb,
+ * so that other processes see the open.
+ */
+NTSTATUS fsp_publish_deferred_share_entry(struct files_struct *fsp)
+{
+	struct deferred_share_entry *d = fsp->deferred_share_entry;
+	struct share_mode_entry_prepare_state prepare_state;
+	NTSTATUS status;
+
+	if (d == NULL) {
+		return NT_STATUS_OK;
+	}
+
+	d->status = NT_STATUS_INTERNAL_ERROR;
+
+	status = share_mode_entry_prepare_lock_add(&prepare_state,
+						   fsp->file_id,
+						   fsp->conn->connectpath,
+						   fsp->fsp_name,
+						   deferred_share_entry_add_fn,
+						   d);
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_ERR("share_mode_entry_prepare_lock_add() failed for %s - "
+			"%s\n",
+			fsp_str_dbg(fsp),
+			nt_errstr(status));
+		return status;
+	}
+
+	status = share_mode_entry_prepare_unlock(&prepare_state, NULL, NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_ERR("share_mode_entry_prepare_unlock() failed for %s - "
+			"%s\n",
+			fsp_str_dbg(fsp),
+			nt_errstr(status));
+		smb_panic("share_mode_entry_prepare_unlock() failed!");
+	}
+
+	if (!NT_STATUS_IS_OK(d->status)) {
+		DBG_ERR("Could not add share entry for %s - %s\n",
+			fsp_str_dbg(fsp),
+			nt_errstr(d->status));
+		return d->status;
+	}
+
+	DBG_DEBUG("published deferred share entry for %s\n",
+		  fsp_str_dbg(fsp));
+
+	fsp->fsp_flags.no_share_mode_entry = false;
+	fsp->deferred_share_entry = NULL;
+	TALLOC_FREE(d);
+	return NT_STATUS_OK;
+}
+
+static void deferred_share_entry_timer(struct tevent_context *ev,
+				       struct tevent_timer *te,
+				       struct timeval current_time,
+				       void *private_data)
+{
+	struct deferred_share_entry *d = talloc_get_type_abort(
+		private_data, struct deferred_share_entry);
+
+	TALLOC_FREE(d->te);
+
+	/*
+	 * On failure the handle stays invisible to other
+	 * processes, it still works for this client.
+	 */
+	(void)fsp_publish_deferred_share_entry(d->fsp);
+}
+
+static NTSTATUS defer_share_entry(struct files_struct *fsp,
+				  uint32_t share_access)
+{
+	int delay_msec = lp_stat_open_share_entry_delay(SNUM(fsp->conn));
+	struct deferred_share_entry *d = NULL;
+
+	d = talloc(fsp, struct deferred_share_entry);
+	if (d == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	*d = (struct deferred_share_entry) {
+		.fsp = fsp,
+		.uid = get_current_uid(fsp->conn),
+		.share_access = share_access,
+	};
+
+	d->te = tevent_add_timer(fsp->conn->sconn->ev_ctx,
+				 d,
+				 timeval_current_ofs_msec(delay_msec),
+				 deferred_share_entry_timer,
+				 d);
+	if (d->te == NULL) {
+		TALLOC_FREE(d);
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	fsp->deferred_share_entry = d;
+	return NT_STATUS_OK;
+}
+
+/*
+ * Another open of the file arrived, make our deferred stat opens of it
+ * visible before the new open checks the share mode record.
+ */
+static void publish_deferred_share_entries(struct smbd_server_connection *sconn,
+					   struct file_id id)
+{
+	struct files_struct *fsp = NULL;
+
+	for (fsp = file_find_di_first(sconn, id, false);
+	     fsp != NULL;
+	     fsp = file_find_di_next(fsp, false))
+	{
+		(void)fsp_publish_deferred_share_entry(fsp);
+	}
+}
+
 /****************************************************************************
  Open a file with a share mode. Passed in an already created files_struct *.
 ****************************************************************************/
@@ -3572,6 +4259,8 @@ static NTSTATUS open_file_ntcreate(connection_struct *conn,
 	bool posix_open = False;
 	bool new_file_created = False;
 	bool truncated = false;
+	bool skip_share_entry = false;
+	bool defer_share_entry_add = false;
 	bool first_open_attempt = true;
 	bool is_twrp = (smb_fname_atname->twrp != 0);
 	NTSTATUS fsp_open = NT_STATUS_ACCESS_DENIED;
@@ -3906,7 +4595,8 @@ static NTSTATUS open_file_ntcreate(connection_struct *conn,
 		 * this won't do anything useful until the file
 		 * exists and has a valid stat struct.
 		 */
-		fsp->file_id = vfs_file_id_from_sbuf(conn, &smb_fname->st);
+		fsp_set_file_id(fsp,
+				vfs_file_id_from_sbuf(conn, &smb_fname->st));
 	}
 	fsp_apply_private_ntcreatex_flags(fsp, private_flags);
 	fsp->access_mask = open_access_mask; /* We change this to the
@@ -4074,6 +4764,7 @@ static NTSTATUS open_file_ntcreate(connection_struct *conn,
 	} else {
 		if (flags & O_TRUNC) {
 			info = FILE_WAS_OVERWRITTEN;
+			fsp_lease_stat_invalidate(fsp);
 		} else {
 			info = FILE_WAS_OPENED;
 		}
@@ -4105,23 +4796,52 @@ static NTSTATUS open_file_ntcreate(connection_struct *conn,
 		.keep_locked		= keep_locked,
 	};
 
-	status = share_mode_entry_prepare_lock_add(&lck_state.prepare_state,
-						   fsp->file_id,
-						   conn->connectpath,
-						   smb_fname,
-						   open_ntcreate_lock_add_entry,
-						   &lck_state);
-	if (!NT_STATUS_IS_OK(status)) {
-		DBG_ERR("share_mode_entry_prepare_lock_add() failed for %s - %s\n",
-			smb_fname_str_dbg(smb_fname), nt_errstr(status));
-		fd_close(fsp);
-		return status;
+	skip_share_entry = open_ntcreate_skip_share_entry(fsp,
+							  private_flags,
+							  access_mask,
+							  open_access_mask,
+							  oplock_request,
+							  lease,
+							  info,
+							  keep_locked,
+							  &defer_share_entry_add);
+	if (skip_share_entry && defer_share_entry_add) {
+		status = defer_share_entry(fsp, share_access);
+		if (!NT_STATUS_IS_OK(status)) {
+			skip_share_entry = false;
+		}
 	}
+	fsp->fsp_flags.no_share_mode_entry = skip_share_entry;
 
-	status = lck_state.status;
-	if (!NT_STATUS_IS_OK(status)) {
-		fd_close(fsp);
-		return status;
+	if (skip_share_entry) {
+		DBG_DEBUG("%s: stat open without share entry%s\n",
+			  smb_fname_str_dbg(smb_fname),
+			  defer_share_entry_add ? " (deferred)" : "");
+		fsp->oplock_type = NO_OPLOCK;
+	} else {
+		publish_deferred_share_entries(conn->sconn, fsp->file_id);
+
+		status = share_mode_entry_prepare_lock_add(
+			&lck_state.prepare_state,
+			fsp->file_id,
+			conn->connectpath,
+			smb_fname,
+			open_ntcreate_lock_add_entry,
+			&lck_state);
+		if (!NT_STATUS_IS_OK(status)) {
+			DBG_ERR("share_mode_entry_prepare_lock_add() "
+				"failed for %s - %s\n",
+				smb_fname_str_dbg(smb_fname),
+				nt_errstr(status));
+			fd_close(fsp);
+			return status;
+		}
+
+		status = lck_state.status;
+		if (!NT_STATUS_IS_OK(status)) {
+			fd_close(fsp);
+			return status;
+		}
 	}
 
 	/*
@@ -4317,13 +5037,18 @@ static NTSTATUS open_file_ntcreate(connection_struct *conn,
 	status = NT_STATUS_OK;
 
 unlock:
-	ulstatus = share_mode_entry_prepare_unlock(&lck_state.prepare_state,
-						   lck_state.cleanup_fn,
-						   &lck_state);
-	if (!NT_STATUS_IS_OK(ulstatus)) {
-		DBG_ERR("share_mode_entry_prepare_unlock() failed for %s - %s\n",
-			smb_fname_str_dbg(smb_fname), nt_errstr(ulstatus));
-		smb_panic("share_mode_entry_prepare_unlock() failed!");
+	if (!skip_share_entry) {
+		ulstatus = share_mode_entry_prepare_unlock(
+			&lck_state.prepare_state,
+			lck_state.cleanup_fn,
+			&lck_state);
+		if (!NT_STATUS_IS_OK(ulstatus)) {
+			DBG_ERR("share_mode_entry_prepare_unlock() "
+				"failed for %s - %s\n",
+				smb_fname_str_dbg(smb_fname),
+				nt_errstr(ulstatus));
+			smb_panic("share_mode_entry_prepare_unlock() failed!");
+		}
 	}
 
 	if (info == FILE_WAS_CREATED) {
@@ -5060,7 +5785,7 @@ static NTSTATUS open_directory(connection_struct *conn,
 	 * Setup the files_struct for it.
 	 */
 
-	fsp->file_id = vfs_file_id_from_sbuf(conn, &smb_dname->st);
+	fsp_set_file_id(fsp, vfs_file_id_from_sbuf(conn, &smb_dname->st));
 	fsp->vuid = req ? req->vuid : UID_FIELD_INVALID;
 	fsp->file_pid = req ? req->smbpid : 0;
 	fsp->fsp_flags.can_lock = false;
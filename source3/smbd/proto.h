@@ -77,6 +77,9 @@ struct aio_req_fsp_link *aio_add_req_to_fsp(files_struct *fsp, struct tevent_req
 struct aio_extra *create_aio_extra(TALLOC_CTX *mem_ctx,
 				   files_struct *fsp,
 				   size_t buflen);
+bool smbd_iobuf_pool_init(size_t num_bufs, size_t buf_size);
+const struct iovec *smbd_iobuf_pool_iov(size_t *num_bufs);
+ssize_t smbd_iobuf_index(const void *ptr, size_t len);
 struct tevent_req *pwrite_fsync_send(TALLOC_CTX *mem_ctx,
 				     struct tevent_context *ev,
 				     struct files_struct *fsp,
@@ -218,6 +221,12 @@ struct tevent_req *dos_mode_at_send(TALLOC_CTX *mem_ctx,
 				    files_struct *dir_fsp,
 				    struct smb_filename *smb_fname);
 NTSTATUS dos_mode_at_recv(struct tevent_req *req, uint32_t *dosmode);
+struct tevent_req *dos_mode_at_batch_send(TALLOC_CTX *mem_ctx,
+					  struct tevent_context *ev,
+					  files_struct *dir_fsp,
+					  struct smb_filename **smb_fnames,
+					  size_t num_fnames);
+NTSTATUS dos_mode_at_batch_recv(struct tevent_req *req, uint32_t *dosmodes);
 int file_set_dosmode(connection_struct *conn,
 		     struct smb_filename *smb_fname,
 		     uint32_t dosmode,
@@ -294,6 +303,16 @@ ssize_t write_file(struct smb_request *req,
 			off_t pos,
 			size_t n);
 NTSTATUS sync_file(connection_struct *conn, files_struct *fsp, bool write_through);
+void write_behind_sync(struct files_struct *fsp);
+NTSTATUS write_behind_flush(struct files_struct *fsp);
+void write_behind_sync_file_id(struct smbd_server_connection *sconn,
+			       struct file_id id);
+void write_behind_sync_all(struct smbd_server_connection *sconn);
+bool write_behind_file(files_struct *fsp,
+		       const char *data,
+		       off_t pos,
+		       size_t n,
+		       bool write_through);
 
 /* The following definitions come from smbd/filename.c  */
 
@@ -323,6 +342,7 @@ NTSTATUS get_real_filename_at(struct files_struct *dirfsp,
 NTSTATUS fsp_new(struct connection_struct *conn, TALLOC_CTX *mem_ctx,
 		 files_struct **result);
 void fsp_set_gen_id(files_struct *fsp);
+void fsp_set_file_id(struct files_struct *fsp, struct file_id id);
 NTSTATUS file_new(struct smb_request *req, connection_struct *conn,
 		  files_struct **result);
 NTSTATUS fsp_bind_smb(struct files_struct *fsp, struct smb_request *req);
@@ -343,6 +363,7 @@ files_struct *file_find_di_first(struct smbd_server_connection *sconn,
 				 bool need_fsa);
 files_struct *file_find_di_next(files_struct *start_fsp,
 				 bool need_fsa);
+void fsp_lease_stat_invalidate(files_struct *fsp);
 struct files_struct *file_find_one_fsp_from_lease_key(
 	struct smbd_server_connection *sconn,
 	const struct smb2_lease_key *lease_key);
@@ -389,6 +410,7 @@ NTSTATUS open_stream_pathref_fsp(
 
 struct reparse_data_buffer;
 
+void path_walk_cache_flush(connection_struct *conn);
 NTSTATUS openat_pathref_fsp_nosymlink(
 	TALLOC_CTX *mem_ctx,
 	struct connection_struct *conn,
@@ -590,6 +612,20 @@ int inotify_watch(TALLOC_CTX *mem_ctx,
 		  void *private_data,
 		  void *handle_p);
 
+/* The following definitions come from smbd/notify_fanotify.c  */
+
+int fanotify_watch(TALLOC_CTX *mem_ctx,
+		   struct sys_notify_context *ctx,
+		   const char *path,
+		   uint32_t *filter,
+		   uint32_t *subdir_filter,
+		   void (*callback)(struct sys_notify_context *ctx,
+				    void *private_data,
+				    struct notify_event *ev,
+				    uint32_t filter),
+		   void *private_data,
+		   void *handle_p);
+
 int fam_watch(TALLOC_CTX *mem_ctx,
 	      struct sys_notify_context *ctx,
 	      const char *path,
@@ -666,6 +702,8 @@ NTSTATUS smbd_do_query_getinfo_quota(TALLOC_CTX *mem_ctx,
 
 /* The following definitions come from smbd/open.c  */
 
+void access_check_cache_flush(connection_struct *conn);
+void access_check_cache_sd_changed(const struct files_struct *fsp);
 NTSTATUS smbd_check_access_rights_fsp(struct files_struct *dirfsp,
 				      struct files_struct *fsp,
 				      bool use_privs,
@@ -684,6 +722,7 @@ NTSTATUS reopen_from_fsp(struct files_struct *dirfsp,
 			 const struct vfs_open_how *how,
 			 bool *p_file_created);
 bool is_oplock_stat_open(uint32_t access_mask);
+NTSTATUS fsp_publish_deferred_share_entry(struct files_struct *fsp);
 bool is_lease_stat_open(uint32_t access_mask);
 NTSTATUS send_break_message(struct messaging_context *msg_ctx,
 			    const struct file_id *id,
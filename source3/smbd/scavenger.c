@@ -35,12 +35,28 @@
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_SCAVENGER
 
+struct scavenger_bucket;
+
 struct smbd_scavenger_state {
 	struct tevent_context *ev;
 	struct messaging_context *msg;
 	struct server_id parent_id;
 	struct server_id *scavenger_id;
 	bool am_scavenger;
+
+	/*
+	 * Only used in the scavenger: the disconnected opens
+	 * waiting for their cleanup, sorted by time.
+	 */
+	struct scavenger_bucket *buckets;
+	size_t num_buckets;
+	size_t num_pending;
+
+	uint64_t num_cleaned;
+	uint64_t num_failed;
+	struct timeval last_run;
+	size_t last_run_count;
+	uint64_t last_run_usec;
 };
 
 static struct smbd_scavenger_state *smbd_scavenger_state = NULL;
@@ -51,6 +67,23 @@ struct scavenger_message {
 	NTTIME until;
 };
 
+/*
+ * Mass disconnects schedule hundreds of thousands of opens for
+ * cleanup. Instead of a timer per open, the opens are collected in
+ * buckets of SCAVENGER_BUCKET_USEC, which are cleaned up in one go.
+ * An open is never cleaned up before its timeout, only up to one
+ * bucket later.
+ */
+#define SCAVENGER_BUCKET_USEC (1000*1000)
+
+struct scavenger_bucket {
+	struct scavenger_bucket *prev, *next;
+	struct smbd_scavenger_state *state;
+	struct timeval until;
+	struct scavenger_message *msgs;
+	size_t num_msgs;
+};
+
 static int smbd_scavenger_main(struct smbd_scavenger_state *state)
 {
 	struct server_id_buf tmp1, tmp2;
@@ -364,6 +397,12 @@ static void smbd_scavenger_msg(struct messaging_context *msg_ctx,
 		goto done;
 	}
 
+	if (data->length != sizeof(struct scavenger_message)) {
+		DBG_WARNING("scavenger: invalid message length %zu\n",
+			    data->length);
+		goto done;
+	}
+
 	DEBUG(10, ("scavenger: got a message\n"));
 	msg = (struct scavenger_message*)data->data;
 	scavenger_add_timer(state, msg);
@@ -371,6 +410,97 @@ done:
 	talloc_free(frame);
 }
 
+static void smbd_scavenger_status_msg(struct messaging_context *msg_ctx,
+				      void *private_data,
+				      uint32_t msg_type,
+				      struct server_id src,
+				      DATA_BLOB *data)
+{
+	struct smbd_scavenger_state *state =
+		talloc_get_type_abort(private_data,
+				      struct smbd_scavenger_state);
+	struct server_id self = messaging_server_id(msg_ctx);
+	struct server_id dst;
+	struct timeval next = { .tv_sec = 0, };
+	char *str = NULL;
+
+	if (server_id_equal(&state->parent_id, &self)) {
+		NTSTATUS status;
+
+		if (!smbd_scavenger_running(state)) {
+			const char *s = "scavenger not running\n";
+			messaging_send_buf(msg_ctx,
+					   src,
+					   MSG_SMB_SCAVENGER_STATUS,
+					   (const uint8_t *)s,
+					   strlen(s));
+			return;
+		}
+
+		/*
+		 * Tell the scavenger where the reply goes
+		 */
+		status = messaging_send_buf(msg_ctx,
+					    *state->scavenger_id,
+					    msg_type,
+					    (const uint8_t *)&src,
+					    sizeof(src));
+		if (!NT_STATUS_IS_OK(status)) {
+			DBG_NOTICE("forwarding message to scavenger failed: "
+				   "%s\n", nt_errstr(status));
+		}
+		return;
+	}
+
+	if (!state->am_scavenger) {
+		return;
+	}
+	if (!server_id_equal(&state->parent_id, &src)) {
+		DBG_DEBUG("scavenger: ignore spurious message\n");
+		return;
+	}
+	if (data->length != sizeof(dst)) {
+		DBG_WARNING("scavenger: invalid message length %zu\n",
+			    data->length);
+		return;
+	}
+	memcpy(&dst, data->data, sizeof(dst));
+
+	if (state->buckets != NULL) {
+		next = state->buckets->until;
+	}
+
+	str = talloc_asprintf(talloc_tos(),
+			      "pending opens: %zu\n"
+			      "pending buckets: %zu\n"
+			      "next cleanup: %s\n"
+			      "cleaned up: %"PRIu64"\n"
+			      "failed: %"PRIu64"\n"
+			      "last cleanup: %s, %zu opens in %"PRIu64" usec\n",
+			      state->num_pending,
+			      state->num_buckets,
+			      timeval_is_zero(&next) ? "-" :
+			      timeval_string(talloc_tos(), &next, true),
+			      state->num_cleaned,
+			      state->num_failed,
+			      timeval_is_zero(&state->last_run) ? "-" :
+			      timeval_string(talloc_tos(),
+					     &state->last_run,
+					     true),
+			      state->last_run_count,
+			      state->last_run_usec);
+	if (str == NULL) {
+		return;
+	}
+
+	messaging_send_buf(msg_ctx,
+			   dst,
+			   MSG_SMB_SCAVENGER_STATUS,
+			   (const uint8_t *)str,
+			   strlen(str));
+	TALLOC_FREE(str);
+}
+
 bool smbd_scavenger_init(TALLOC_CTX *mem_ctx,
 			 struct messaging_context *msg,
 			 struct tevent_context *ev)
@@ -401,6 +531,15 @@ bool smbd_scavenger_init(TALLOC_CTX *mem_ctx,
 		goto fail;
 	}
 
+	status = messaging_register(msg, state, MSG_SMB_SCAVENGER_TELL_STATUS,
+				    smbd_scavenger_status_msg);
+	if (!NT_STATUS_IS_OK(status)) {
+		DEBUG(2, ("failed to register message handler: %s\n",
+			  nt_errstr(status)));
+		messaging_deregister(msg, MSG_SMB_SCAVENGER, state);
+		goto fail;
+	}
+
 	smbd_scavenger_state = state;
 	return true;
 fail:
@@ -463,16 +602,14 @@ void scavenger_schedule_disconnected(struct files_struct *fsp)
 	}
 }
 
-struct scavenger_timer_context {
-	struct smbd_scavenger_state *state;
-	struct scavenger_message msg;
-};
-
 struct cleanup_disconnected_state {
 	struct file_id fid;
 	struct share_mode_lock *lck;
-	uint64_t open_persistent_id;
-	struct share_mode_entry e;
+	const uint64_t *open_persistent_ids;
+	size_t num_ids;
+	size_t num_found;
+	struct share_mode_entry *leases;
+	size_t num_leases;
 };
 
 static bool cleanup_disconnected_share_mode_entry_fn(
@@ -482,8 +619,16 @@ static bool cleanup_disconnected_share_mode_entry_fn(
 {
 	struct cleanup_disconnected_state *state = private_data;
 	bool disconnected;
+	bool found = false;
+	size_t i;
 
-	if (e->share_file_id != state->open_persistent_id) {
+	for (i = 0; i < state->num_ids; i++) {
+		if (e->share_file_id == state->open_persistent_ids[i]) {
+			found = true;
+			break;
+		}
+	}
+	if (!found) {
 		return false;
 	}
 
@@ -507,23 +652,35 @@ static bool cleanup_disconnected_share_mode_entry_fn(
 	 * the indication to delete the entry.
 	 */
 	e->stale = true;
-	state->e = *e;
 
-	return true;
+	if (e->op_type == LEASE_OPLOCK) {
+		state->leases[state->num_leases] = *e;
+		state->num_leases += 1;
+	}
+
+	state->num_found += 1;
+
+	/* end the loop once we found all entries */
+	return (state->num_found == state->num_ids);
 }
 
-static bool share_mode_cleanup_disconnected(
-	struct file_id fid, uint64_t open_persistent_id)
+/*
+ * Clean up the share mode entries and byte range locks of all
+ * disconnected opens of a file with a single share mode lock.
+ * Returns the number of opens that were cleaned up.
+ */
+static size_t share_mode_cleanup_disconnected(
+	struct file_id fid, uint64_t *open_persistent_ids, size_t num_ids)
 {
 	struct cleanup_disconnected_state state = {
 		.fid = fid,
-		.open_persistent_id = open_persistent_id
 	};
-	bool ret = false;
+	size_t ret = 0;
 	TALLOC_CTX *frame = talloc_stackframe();
 	char *name = NULL;
 	struct file_id_buf idbuf;
 	NTSTATUS status;
+	size_t i;
 	bool ok;
 
 	state.lck = get_existing_share_mode_lock(frame, fid);
@@ -534,8 +691,14 @@ static bool share_mode_cleanup_disconnected(
 	}
 	name = share_mode_filename(frame, state.lck);
 
-	ok = brl_cleanup_disconnected(fid, open_persistent_id);
-	if (!ok) {
+	i = 0;
+	while (i < num_ids) {
+		ok = brl_cleanup_disconnected(fid, open_persistent_ids[i]);
+		if (ok) {
+			i++;
+			continue;
+		}
+
 		DBG_WARNING("failed to clean up byte range locks associated "
 			  "with file (file-id='%s', servicepath='%s', "
 			  "name='%s') and open_persistent_id %"PRIu64" "
@@ -543,36 +706,50 @@ static bool share_mode_cleanup_disconnected(
 			  file_id_str_buf(fid, &idbuf),
 			  share_mode_servicepath(state.lck),
 			  name,
-			  open_persistent_id);
+			  open_persistent_ids[i]);
+
+		open_persistent_ids[i] = open_persistent_ids[num_ids - 1];
+		num_ids -= 1;
+	}
+	if (num_ids == 0) {
 		goto done;
 	}
 
-	DBG_DEBUG("cleaning up entry for file "
-		  "(file-id='%s', servicepath='%s', name='%s') "
-		  "from open_persistent_id %"PRIu64"\n",
+	DBG_DEBUG("cleaning up %zu entries for file "
+		  "(file-id='%s', servicepath='%s', name='%s')\n",
+		  num_ids,
 		  file_id_str_buf(fid, &idbuf),
 		  share_mode_servicepath(state.lck),
-		  name,
-		  open_persistent_id);
+		  name);
+
+	state.open_persistent_ids = open_persistent_ids;
+	state.num_ids = num_ids;
+	state.leases = talloc_array(frame, struct share_mode_entry, num_ids);
+	if (state.leases == NULL) {
+		DBG_WARNING("talloc_array failed\n");
+		goto done;
+	}
 
 	ok = share_mode_forall_entries(
 		state.lck, cleanup_disconnected_share_mode_entry_fn, &state);
 	if (!ok) {
-		DBG_WARNING("failed to clean up entry associated "
+		DBG_WARNING("failed to clean up entries associated "
 			  "with file (file-id='%s', servicepath='%s', "
-			  "name='%s') and open_persistent_id %"PRIu64" "
-			  "==> do not cleanup\n",
+			  "name='%s') ==> do not cleanup\n",
 			  file_id_str_buf(fid, &idbuf),
 			  share_mode_servicepath(state.lck),
-			  name,
-			  open_persistent_id);
+			  name);
 		goto done;
 	}
 
-	if (state.e.stale && (state.e.op_type == LEASE_OPLOCK)) {
+	ret = state.num_found;
+
+	for (i = 0; i < state.num_leases; i++) {
+		struct share_mode_entry *e = &state.leases[i];
+
 		status = remove_lease_if_stale(state.lck,
-					       &state.e.client_guid,
-					       &state.e.lease_key);
+					       &e->client_guid,
+					       &e->lease_key);
 		if (!NT_STATUS_IS_OK(status)) {
 			struct GUID_txt_buf gbuf;
 
@@ -584,63 +761,132 @@ static bool share_mode_cleanup_disconnected(
 				    file_id_str_buf(fid, &idbuf),
 				    share_mode_servicepath(state.lck),
 				    name,
-				    open_persistent_id,
-				    GUID_buf_string(&state.e.client_guid, &gbuf),
-				    state.e.lease_key.data[0],
-				    state.e.lease_key.data[1],
+				    e->share_file_id,
+				    GUID_buf_string(&e->client_guid, &gbuf),
+				    e->lease_key.data[0],
+				    e->lease_key.data[1],
 				    nt_errstr(status));
-			goto done;
+			ret -= 1;
 		}
 	}
 
-	ret = true;
 done:
 	talloc_free(frame);
 	return ret;
 }
 
-static void scavenger_timer(struct tevent_context *ev,
-			    struct tevent_timer *te,
-			    struct timeval t, void *data)
+static int scavenger_message_cmp(const struct scavenger_message *m1,
+				 const struct scavenger_message *m2)
 {
-	struct scavenger_timer_context *ctx =
-		talloc_get_type_abort(data, struct scavenger_timer_context);
-	struct file_id_buf idbuf;
-	NTSTATUS status;
-	bool ok;
+	int cmp;
 
-	DBG_DEBUG("do cleanup for file %s at %s\n",
-		  file_id_str_buf(ctx->msg.file_id, &idbuf),
+	cmp = NUMERIC_CMP(m1->file_id.devid, m2->file_id.devid);
+	if (cmp != 0) {
+		return cmp;
+	}
+	cmp = NUMERIC_CMP(m1->file_id.inode, m2->file_id.inode);
+	if (cmp != 0) {
+		return cmp;
+	}
+	return NUMERIC_CMP(m1->file_id.extid, m2->file_id.extid);
+}
+
+static void scavenger_bucket_timer(struct tevent_context *ev,
+				   struct tevent_timer *te,
+				   struct timeval t, void *data)
+{
+	struct scavenger_bucket *b =
+		talloc_get_type_abort(data, struct scavenger_bucket);
+	struct smbd_scavenger_state *state = b->state;
+	struct timeval start = timeval_current();
+	struct timeval end;
+	uint64_t *ids = NULL;
+	size_t num_cleaned = 0;
+	size_t i, j;
+
+	DBG_DEBUG("do cleanup of %zu opens at %s\n",
+		  b->num_msgs,
 		  timeval_string(talloc_tos(), &t, true));
 
-	status = smbXsrv_open_cleanup(ctx->msg.open_persistent_id);
-	if (!NT_STATUS_IS_OK(status)) {
-		DBG_WARNING("Failed to cleanup open global for file %s open "
-			    "%"PRIu64": %s\n",
-			    file_id_str_buf(ctx->msg.file_id, &idbuf),
-			    ctx->msg.open_persistent_id,
-			    nt_errstr(status));
+	DLIST_REMOVE(state->buckets, b);
+	state->num_buckets -= 1;
+	state->num_pending -= b->num_msgs;
+
+	ids = talloc_array(b, uint64_t, b->num_msgs);
+	if (ids == NULL) {
+		DBG_WARNING("talloc_array failed\n");
+		state->num_failed += b->num_msgs;
+		TALLOC_FREE(b);
 		return;
 	}
 
-	ok = share_mode_cleanup_disconnected(ctx->msg.file_id,
-					     ctx->msg.open_persistent_id);
-	if (!ok) {
-		DBG_WARNING("Failed to cleanup share modes and byte range "
-			    "locks for file %s open %"PRIu64"\n",
-			    file_id_str_buf(ctx->msg.file_id, &idbuf),
-			    ctx->msg.open_persistent_id);
+	/*
+	 * Group the opens by file, so that all disconnected
+	 * opens of a file are cleaned up under a single share
+	 * mode lock.
+	 */
+	TYPESAFE_QSORT(b->msgs, b->num_msgs, scavenger_message_cmp);
+
+	for (i = 0; i < b->num_msgs; i = j) {
+		struct file_id fid = b->msgs[i].file_id;
+		struct file_id_buf idbuf;
+		size_t num_ids = 0;
+		size_t n;
+
+		for (j = i; j < b->num_msgs; j++) {
+			struct scavenger_message *msg = &b->msgs[j];
+			NTSTATUS status;
+
+			if (!file_id_equal(&msg->file_id, &fid)) {
+				break;
+			}
+
+			status = smbXsrv_open_cleanup(msg->open_persistent_id);
+			if (!NT_STATUS_IS_OK(status)) {
+				DBG_WARNING("Failed to cleanup open global "
+					    "for file %s open %"PRIu64": %s\n",
+					    file_id_str_buf(fid, &idbuf),
+					    msg->open_persistent_id,
+					    nt_errstr(status));
+				continue;
+			}
+			ids[num_ids++] = msg->open_persistent_id;
+		}
+
+		if (num_ids == 0) {
+			continue;
+		}
+
+		n = share_mode_cleanup_disconnected(fid, ids, num_ids);
+		if (n != num_ids) {
+			DBG_WARNING("Failed to cleanup share modes and byte "
+				    "range locks of %zu opens for file %s\n",
+				    num_ids - n,
+				    file_id_str_buf(fid, &idbuf));
+		}
+		num_cleaned += n;
 	}
 
+	state->num_cleaned += num_cleaned;
+	state->num_failed += b->num_msgs - num_cleaned;
+
+	end = timeval_current();
+	state->last_run = start;
+	state->last_run_count = b->num_msgs;
+	state->last_run_usec = usec_time_diff(&end, &start);
+
+	TALLOC_FREE(b);
 }
 
 static void scavenger_add_timer(struct smbd_scavenger_state *state,
 				struct scavenger_message *msg)
 {
+	struct scavenger_bucket *b = NULL;
+	struct scavenger_bucket *prev = NULL;
 	struct tevent_timer *te;
-	struct scavenger_timer_context *ctx;
 	struct timeval until;
 	struct file_id_buf idbuf;
+	uint64_t usec;
 
 	nttime_to_timeval(&until, msg->until);
 
@@ -648,26 +894,70 @@ static void scavenger_add_timer(struct smbd_scavenger_state *state,
 		  file_id_str_buf(msg->file_id, &idbuf),
 		  timeval_string(talloc_tos(), &until, true));
 
-	ctx = talloc_zero(state, struct scavenger_timer_context);
-	if (ctx == NULL) {
-		DEBUG(2, ("Failed to talloc_zero(scavenger_timer_context)\n"));
-		return;
+	/*
+	 * Round up to the end of the bucket
+	 */
+	usec = (uint64_t)until.tv_sec * 1000000 + until.tv_usec;
+	usec = (usec + SCAVENGER_BUCKET_USEC - 1) / SCAVENGER_BUCKET_USEC;
+	usec *= SCAVENGER_BUCKET_USEC;
+	until = (struct timeval) {
+		.tv_sec = usec / 1000000,
+		.tv_usec = usec % 1000000,
+	};
+
+	/*
+	 * Most opens go into the latest bucket, search from the end
+	 */
+	for (b = DLIST_TAIL(state->buckets); b != NULL; b = DLIST_PREV(b)) {
+		int cmp = timeval_compare(&b->until, &until);
+
+		if (cmp == 0) {
+			break;
+		}
+		if (cmp < 0) {
+			prev = b;
+			b = NULL;
+			break;
+		}
 	}
 
-	ctx->state = state;
-	ctx->msg = *msg;
+	if (b == NULL) {
+		b = talloc_zero(state, struct scavenger_bucket);
+		if (b == NULL) {
+			DBG_WARNING("talloc_zero(scavenger_bucket) failed\n");
+			return;
+		}
+		b->state = state;
+		b->until = until;
+
+		te = tevent_add_timer(state->ev,
+				      b,
+				      until,
+				      scavenger_bucket_timer,
+				      b);
+		if (te == NULL) {
+			DEBUG(2, ("Failed to add scavenger_timer event\n"));
+			talloc_free(b);
+			return;
+		}
 
-	te = tevent_add_timer(state->ev,
-			      state,
-			      until,
-			      scavenger_timer,
-			      ctx);
-	if (te == NULL) {
-		DEBUG(2, ("Failed to add scavenger_timer event\n"));
-		talloc_free(ctx);
-		return;
+		DLIST_ADD_AFTER(state->buckets, b, prev);
+		state->num_buckets += 1;
+	}
+
+	if (b->num_msgs == talloc_array_length(b->msgs)) {
+		struct scavenger_message *tmp = NULL;
+		size_t n = MAX(b->num_msgs * 2, 16);
+
+		tmp = talloc_realloc(b, b->msgs, struct scavenger_message, n);
+		if (tmp == NULL) {
+			DBG_WARNING("talloc_realloc failed\n");
+			return;
+		}
+		b->msgs = tmp;
 	}
 
-	/* delete context after handler was running */
-	talloc_steal(te, ctx);
+	b->msgs[b->num_msgs] = *msg;
+	b->num_msgs += 1;
+	state->num_pending += 1;
 }
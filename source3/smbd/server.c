@@ -60,6 +60,8 @@
 #include "lib/global_contexts.h"
 #include "source3/lib/substitute.h"
 #include "lib/addrchange.h"
+#include "lib/tls/tls.h"
+#include "lib/util/msghdr.h"
 
 #ifdef CLUSTER_SUPPORT
 #include "ctdb_protocol.h"
@@ -67,6 +69,7 @@
 
 struct smbd_open_socket;
 struct smbd_child_pid;
+struct smbd_spare_worker;
 
 struct smbd_parent_context {
 	bool interactive;
@@ -76,6 +79,9 @@ struct smbd_parent_context {
 
 	struct smb_transports transports;
 
+	/* certificates for the 'quic' transport */
+	struct tstream_tls_params *quic_tls_params;
+
 	/* the list of listening sockets */
 	struct smbd_open_socket *sockets;
 
@@ -83,6 +89,14 @@ struct smbd_parent_context {
 	struct smbd_child_pid *children;
 	size_t num_children;
 
+	/* warm children waiting for a connection */
+	struct smbd_spare_worker *spares;
+	size_t num_spares;
+	size_t max_spares;
+	struct tevent_timer *spare_te;
+	uint64_t spare_handoffs;
+	uint64_t spare_misses;
+
 	struct server_id cleanupd;
 	struct server_id notifyd;
 
@@ -108,6 +122,9 @@ struct smbd_child_pid {
 
 static NTSTATUS messaging_send_to_children(struct messaging_context *msg_ctx,
 					   uint32_t msg_type, DATA_BLOB* data);
+static void smbd_prefork_recycle(struct smbd_parent_context *parent);
+static void smbd_prefork_child_exited(struct smbd_parent_context *parent,
+				      pid_t pid);
 
 static void smbd_parent_conf_updated(struct messaging_context *msg,
 				     void *private_data,
@@ -127,6 +144,10 @@ static void smbd_parent_conf_updated(struct messaging_context *msg,
 		DBG_ERR("Failed to reinit guest info\n");
 	}
 	messaging_send_to_children(msg, MSG_SMB_CONF_UPDATED, NULL);
+
+	if (am_parent != NULL) {
+		smbd_prefork_recycle(am_parent);
+	}
 }
 
 /****************************************************************************
@@ -338,6 +359,16 @@ static struct tevent_req *notifyd_req(struct messaging_context *msg_ctx,
 		}
 #endif
 
+#ifdef HAVE_FANOTIFY
+		/*
+		 * fanotify needs CAP_SYS_ADMIN, so keep it opt-in. It
+		 * falls back to inotify by itself.
+		 */
+		if (lp_parm_bool(-1, "notify", "fanotify", false)) {
+			sys_notify_watch = fanotify_watch;
+		}
+#endif
+
 #ifdef HAVE_FAM
 		if (lp_parm_bool(-1, "notify", "fam",
 				 (sys_notify_watch == NULL))) {
@@ -358,7 +389,9 @@ static struct tevent_req *notifyd_req(struct messaging_context *msg_ctx,
 	}
 
 	req = notifyd_send(msg_ctx, ev, msg_ctx, ctdbd_conn,
-			   sys_notify_watch, sys_notify_ctx);
+			   sys_notify_watch, sys_notify_ctx,
+			   lp_change_notify_coalesce_msec(),
+			   lp_change_notify_coalesce_max_events());
 	if (req == NULL) {
 		TALLOC_FREE(sys_notify_ctx);
 		return NULL;
@@ -430,6 +463,9 @@ static bool smbd_notifyd_init(struct messaging_context *msg, bool interactive,
 
 	reopen_logs();
 
+	/* Make the notifyd profile counters visible in smbstatus */
+	smbprofile_dump_setup(ev, NULL);
+
 	/* Set up sighup handler for notifyd */
 	se = tevent_add_signal(ev,
 			       ev,
@@ -812,6 +848,8 @@ static void remove_child_pid(struct smbd_parent_context *parent,
 	NTSTATUS status;
 	bool ok;
 
+	smbd_prefork_child_exited(parent, pid);
+
 	for (child = parent->children; child != NULL; child = child->next) {
 		if (child->pid == pid) {
 			struct smbd_child_pid *tmp = child;
@@ -954,6 +992,470 @@ static void smbd_open_socket_close_fn(struct tevent_context *ev,
 	close(fd);
 }
 
+static bool smbd_prepare_quic(struct smbd_parent_context *parent)
+{
+	struct loadparm_context *lp_ctx = NULL;
+	NTSTATUS status;
+
+	if (!tstream_tls_quic_supported()) {
+		DBG_ERR("'server smb transports' contains 'quic', "
+			"but smbd was built without QUIC support\n");
+		return true;
+	}
+
+	lp_ctx = loadparm_init_s3(talloc_tos(), loadparm_s3_helpers());
+	if (lp_ctx == NULL) {
+		DBG_ERR("loadparm_init_s3 failed\n");
+		return false;
+	}
+
+	status = tstream_tls_params_server_lpcfg(parent,
+						 lp_dns_hostname(),
+						 lp_ctx,
+						 &parent->quic_tls_params);
+	TALLOC_FREE(lp_ctx);
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_ERR("tstream_tls_params_server_lpcfg failed: %s\n",
+			nt_errstr(status));
+		return false;
+	}
+
+	if (!tstream_tls_params_enabled(parent->quic_tls_params)) {
+		DBG_ERR("'server smb transports' contains 'quic', "
+			"but 'tls enabled' is off or no 'tls keyfile' "
+			"is available\n");
+		TALLOC_FREE(parent->quic_tls_params);
+		return false;
+	}
+
+	return true;
+}
+
+static bool smbd_accept_quic(struct tstream_tls_params *tls_params, int fd)
+{
+	NTSTATUS status;
+
+	set_blocking(fd, true);
+
+	status = tstream_tls_quic_handshake(tls_params, true, fd);
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_NOTICE("QUIC handshake failed: %s\n", nt_errstr(status));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Optional pool of warm spare workers. A spare is forked and fully
+ * initialized before a client connects. It then waits for the parent
+ * to pass it an accepted connection over a socketpair.
+ * After the handoff it is an ordinary smbd child serving exactly this
+ * one connection, and the parent forks a replacement in the
+ * background.
+ */
+
+struct smbd_spare_worker {
+	struct smbd_spare_worker *prev, *next;
+	struct smbd_parent_context *parent;
+	pid_t pid;
+	int sock;
+};
+
+struct smbd_spare_handoff {
+	uint32_t transport_type;
+};
+
+static int smbd_spare_worker_destructor(struct smbd_spare_worker *w)
+{
+	if (w->sock != -1) {
+		close(w->sock);
+		w->sock = -1;
+	}
+	return 0;
+}
+
+struct smbd_spare_state {
+	struct messaging_context *msg_ctx;
+	struct tstream_tls_params *quic_tls_params;
+	int sock;
+};
+
+static void smbd_spare_handoff_handler(struct tevent_context *ev,
+				       struct tevent_fd *fde,
+				       uint16_t flags,
+				       void *private_data)
+{
+	struct smbd_spare_state *state = talloc_get_type_abort(
+		private_data, struct smbd_spare_state);
+	struct smbd_spare_handoff handoff = { .transport_type = 0, };
+	struct iovec iov = {
+		.iov_base = (void *)&handoff,
+		.iov_len = sizeof(handoff),
+	};
+	struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+	size_t bufsize = msghdr_prep_recv_fds(NULL, NULL, 0, 1);
+	uint8_t buf[bufsize];
+	struct samba_sockaddr caddr = {
+		.sa_socklen = sizeof(struct sockaddr_storage),
+	};
+	char addrstr[INET6_ADDRSTRLEN] = "unknown";
+	size_t num_fds;
+	ssize_t n;
+	int fd = -1;
+	int ret;
+
+	msghdr_prep_recv_fds(&msg, buf, bufsize, 1);
+
+	do {
+		n = recvmsg(state->sock, &msg, 0);
+	} while ((n == -1) && (errno == EINTR));
+
+	if (n <= 0) {
+		/* The parent retired us */
+		exit_server_cleanly("spare worker retired");
+		return;
+	}
+
+	num_fds = msghdr_extract_fds(&msg, NULL, 0);
+	if (num_fds == 1) {
+		msghdr_extract_fds(&msg, &fd, 1);
+	}
+	if ((fd == -1) || (n != sizeof(handoff))) {
+		if (fd != -1) {
+			close(fd);
+		}
+		exit_server_cleanly("invalid spare worker handoff");
+		return;
+	}
+
+	TALLOC_FREE(fde);
+	close(state->sock);
+	state->sock = -1;
+
+	smb_set_close_on_exec(fd);
+
+	ret = getpeername(fd, &caddr.u.sa, &caddr.sa_socklen);
+	if (ret == 0) {
+		print_sockaddr(addrstr, sizeof(addrstr), &caddr.u.ss);
+	}
+	process_set_title("smbd[%s]", "client [%s]", addrstr);
+
+	if (handoff.transport_type == SMB_TRANSPORT_TYPE_QUIC) {
+		bool ok = smbd_accept_quic(state->quic_tls_params, fd);
+		if (!ok) {
+			exit_server_cleanly("QUIC handshake failed");
+			return;
+		}
+	}
+	TALLOC_FREE(state->quic_tls_params);
+
+	smbd_process(ev,
+		     state->msg_ctx,
+		     fd,
+		     false,
+		     (enum smb_transport_type)handoff.transport_type);
+	exit_server_cleanly("end of child");
+}
+
+static void smbd_spare_worker_run(struct tevent_context *ev,
+				  struct messaging_context *msg_ctx,
+				  struct tstream_tls_params *quic_tls_params,
+				  int sock)
+{
+	struct smbd_spare_state *state = NULL;
+	struct tevent_fd *fde = NULL;
+	NTSTATUS status;
+
+	/* Stop zombies, the parent explicitly handles
+	 * them, counting worker smbds. */
+	CatchChild();
+
+	status = smbd_reinit_after_fork(msg_ctx, ev, true);
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_ERR("spare worker cannot initialize: %s\n",
+			nt_errstr(status));
+		exit_server_cleanly("spare worker init failed");
+		return;
+	}
+
+	process_set_title("smbd[spare]", "spare worker");
+
+	state = talloc_zero(ev, struct smbd_spare_state);
+	if (state == NULL) {
+		exit_server_cleanly("talloc failed");
+		return;
+	}
+	state->msg_ctx = msg_ctx;
+	state->quic_tls_params = talloc_move(state, &quic_tls_params);
+	state->sock = sock;
+
+	fde = tevent_add_fd(ev,
+			    state,
+			    sock,
+			    TEVENT_FD_READ,
+			    smbd_spare_handoff_handler,
+			    state);
+	if (fde == NULL) {
+		exit_server_cleanly("tevent_add_fd failed");
+		return;
+	}
+
+	tevent_loop_wait(ev);
+	exit_server_cleanly("spare worker done");
+}
+
+static bool smbd_prefork_spawn(struct smbd_parent_context *parent)
+{
+	struct smbd_spare_worker *w = NULL;
+	int fds[2];
+	pid_t pid;
+	int ret;
+
+	ret = socketpair(AF_UNIX, SOCK_STREAM, 0, fds);
+	if (ret == -1) {
+		DBG_ERR("socketpair failed: %s\n", strerror(errno));
+		return false;
+	}
+
+	pid = fork();
+	if (pid == 0) {
+		struct tevent_context *ev = parent->ev_ctx;
+		struct messaging_context *msg_ctx = parent->msg_ctx;
+		struct tstream_tls_params *quic_tls_params = NULL;
+
+		close(fds[0]);
+
+		quic_tls_params = talloc_steal(ev, parent->quic_tls_params);
+
+		/*
+		 * This also closes the listening sockets and the
+		 * parent ends of the other spares' socketpairs.
+		 */
+		talloc_free(parent);
+
+		smbd_spare_worker_run(ev, msg_ctx, quic_tls_params, fds[1]);
+		return false;
+	}
+
+	close(fds[1]);
+
+	if (pid < 0) {
+		DBG_ERR("fork() failed: %s\n", strerror(errno));
+		close(fds[0]);
+		return false;
+	}
+
+	add_child_pid(parent, pid);
+
+	w = talloc_zero(parent, struct smbd_spare_worker);
+	if (w == NULL) {
+		/* Without the socket it exits right away */
+		close(fds[0]);
+		return false;
+	}
+	w->parent = parent;
+	w->pid = pid;
+	w->sock = fds[0];
+	talloc_set_destructor(w, smbd_spare_worker_destructor);
+
+	set_blocking(w->sock, false);
+	smb_set_close_on_exec(w->sock);
+
+	DLIST_ADD_END(parent->spares, w);
+	parent->num_spares += 1;
+
+	DBG_DEBUG("spare worker %d ready, %zu spares\n",
+		  (int)pid, parent->num_spares);
+	return true;
+}
+
+static void smbd_prefork_fill(struct tevent_context *ev,
+			      struct tevent_timer *te,
+			      struct timeval current_time,
+			      void *private_data)
+{
+	struct smbd_parent_context *parent = talloc_get_type_abort(
+		private_data, struct smbd_parent_context);
+
+	TALLOC_FREE(parent->spare_te);
+
+	while (parent->num_spares < parent->max_spares) {
+		bool ok;
+
+		if (!allowable_number_of_smbd_processes(parent)) {
+			break;
+		}
+		ok = smbd_prefork_spawn(parent);
+		if (!ok) {
+			break;
+		}
+	}
+}
+
+static void smbd_prefork_schedule_fill(struct smbd_parent_context *parent,
+				       uint32_t delay_secs)
+{
+	if (parent->max_spares == 0 || parent->spare_te != NULL) {
+		return;
+	}
+
+	parent->spare_te = tevent_add_timer(parent->ev_ctx,
+					    parent,
+					    timeval_current_ofs(delay_secs, 0),
+					    smbd_prefork_fill,
+					    parent);
+	if (parent->spare_te == NULL) {
+		DBG_ERR("tevent_add_timer failed\n");
+	}
+}
+
+static void smbd_prefork_init(struct smbd_parent_context *parent)
+{
+	int max_spares;
+
+	if (parent->interactive) {
+		return;
+	}
+
+	max_spares = lp_parm_int(GLOBAL_SECTION_SNUM,
+				 "smbd",
+				 "spare workers",
+				 0);
+	parent->max_spares = MAX(max_spares, 0);
+
+	smbd_prefork_schedule_fill(parent, 0);
+}
+
+/*
+ * Retire all spares, e.g. after a config change: they loaded the old
+ * config before they were forked.
+ */
+static void smbd_prefork_recycle(struct smbd_parent_context *parent)
+{
+	struct smbd_spare_worker *w = NULL;
+
+	while ((w = parent->spares) != NULL) {
+		DLIST_REMOVE(parent->spares, w);
+		parent->num_spares -= 1;
+		TALLOC_FREE(w);
+	}
+
+	smbd_prefork_init(parent);
+}
+
+static void smbd_prefork_child_exited(struct smbd_parent_context *parent,
+				      pid_t pid)
+{
+	struct smbd_spare_worker *w = NULL;
+
+	for (w = parent->spares; w != NULL; w = w->next) {
+		if (w->pid == pid) {
+			break;
+		}
+	}
+	if (w == NULL) {
+		return;
+	}
+
+	DBG_WARNING("spare worker %d exited before it got a connection\n",
+		    (int)pid);
+
+	DLIST_REMOVE(parent->spares, w);
+	parent->num_spares -= 1;
+	TALLOC_FREE(w);
+
+	/* Don't fork in a tight loop if spares keep failing */
+	smbd_prefork_schedule_fill(parent, 1);
+}
+
+static bool smbd_prefork_handoff(struct smbd_parent_context *parent,
+				 int fd,
+				 enum smb_transport_type transport_type)
+{
+	struct smbd_spare_worker *w = NULL;
+	struct smbd_spare_handoff handoff = {
+		.transport_type = transport_type,
+	};
+
+	if (parent->max_spares == 0) {
+		return false;
+	}
+
+	while ((w = parent->spares) != NULL) {
+		struct iovec iov = {
+			.iov_base = (void *)&handoff,
+			.iov_len = sizeof(handoff),
+		};
+		struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+		size_t bufsize = msghdr_prep_fds(NULL, NULL, 0, &fd, 1);
+		uint8_t buf[bufsize];
+		ssize_t sent;
+
+		msghdr_prep_fds(&msg, buf, bufsize, &fd, 1);
+
+		do {
+			sent = sendmsg(w->sock, &msg, 0);
+		} while ((sent == -1) && (errno == EINTR));
+
+		DLIST_REMOVE(parent->spares, w);
+		parent->num_spares -= 1;
+
+		if (sent == sizeof(handoff)) {
+			DBG_DEBUG("handed connection to spare worker %d\n",
+				  (int)w->pid);
+			TALLOC_FREE(w);
+			parent->spare_handoffs += 1;
+			smbd_prefork_schedule_fill(parent, 0);
+			return true;
+		}
+
+		DBG_NOTICE("handoff to spare worker %d failed: %s\n",
+			   (int)w->pid,
+			   sent == -1 ? strerror(errno) : "short write");
+		TALLOC_FREE(w);
+	}
+
+	parent->spare_misses += 1;
+	smbd_prefork_schedule_fill(parent, 0);
+	return false;
+}
+
+static void smbd_prefork_status(struct messaging_context *msg_ctx,
+				void *private_data,
+				uint32_t msg_type,
+				struct server_id src,
+				DATA_BLOB *data)
+{
+	struct smbd_parent_context *parent = am_parent;
+	char *str = NULL;
+
+	if (parent == NULL) {
+		return;
+	}
+
+	str = talloc_asprintf(talloc_tos(),
+			      "spare workers: %zu/%zu\n"
+			      "children: %zu\n"
+			      "handoffs: %" PRIu64 "\n"
+			      "forked on demand: %" PRIu64 "\n",
+			      parent->num_spares,
+			      parent->max_spares,
+			      parent->num_children,
+			      parent->spare_handoffs,
+			      parent->spare_misses);
+	if (str == NULL) {
+		return;
+	}
+
+	messaging_send_buf(msg_ctx,
+			   src,
+			   MSG_SMB_PREFORK_STATUS,
+			   (const uint8_t *)str,
+			   strlen(str));
+	TALLOC_FREE(str);
+}
+
 static void smbd_accept_connection(struct tevent_context *ev,
 				   struct tevent_fd *fde,
 				   uint16_t flags,
@@ -988,11 +1490,26 @@ static void smbd_accept_connection(struct tevent_context *ev,
 			exit_server("reinit_after_fork() failed");
 			return;
 		}
+		if (transport_type == SMB_TRANSPORT_TYPE_QUIC) {
+			bool ok = smbd_accept_quic(s->parent->quic_tls_params,
+						   fd);
+			if (!ok) {
+				exit_server_cleanly("QUIC handshake failed");
+				return;
+			}
+		}
 		smbd_process(ev, msg_ctx, fd, true, transport_type);
 		exit_server_cleanly("end of interactive mode");
 		return;
 	}
 
+	if (smbd_prefork_handoff(s->parent, fd, s->transport.type)) {
+		/* The spare has its own reference now */
+		close(fd);
+		force_check_log_size();
+		return;
+	}
+
 	if (!allowable_number_of_smbd_processes(s->parent)) {
 		close(fd);
 		return;
@@ -1001,9 +1518,12 @@ static void smbd_accept_connection(struct tevent_context *ev,
 	pid = fork();
 	if (pid == 0) {
 		enum smb_transport_type transport_type = s->transport.type;
+		struct tstream_tls_params *quic_tls_params = NULL;
 		char addrstr[INET6_ADDRSTRLEN];
 		NTSTATUS status = NT_STATUS_OK;
 
+		quic_tls_params = talloc_steal(ev, s->parent->quic_tls_params);
+
 		/*
 		 * Can't use TALLOC_FREE here. Nulling out the argument to it
 		 * would overwrite memory we've just freed.
@@ -1042,6 +1562,19 @@ static void smbd_accept_connection(struct tevent_context *ev,
 		print_sockaddr(addrstr, sizeof(addrstr), &caddr.u.ss);
 		process_set_title("smbd[%s]", "client [%s]", addrstr);
 
+		if (transport_type == SMB_TRANSPORT_TYPE_QUIC) {
+			/*
+			 * The handshake is done in the child,
+			 * so that a slow client can't block
+			 * the parent.
+			 */
+			bool ok = smbd_accept_quic(quic_tls_params, fd);
+			if (!ok) {
+				goto exit;
+			}
+		}
+		TALLOC_FREE(quic_tls_params);
+
 		smbd_process(ev, msg_ctx, fd, false, transport_type);
 	 exit:
 		exit_server_cleanly("end of child");
@@ -1102,6 +1635,18 @@ static bool smbd_open_one_socket(struct smbd_parent_context *parent,
 		protocol = IPPROTO_TCP;
 		rebind = true;
 		break;
+	case SMB_TRANSPORT_TYPE_QUIC:
+		if (parent->quic_tls_params == NULL) {
+			/*
+			 * Already logged in open_sockets_smbd(),
+			 * the other transports should still work
+			 */
+			return true;
+		}
+		port = transport->port;
+		protocol = IPPROTO_QUIC;
+		rebind = true;
+		break;
 	case SMB_TRANSPORT_TYPE_UNKNOWN:
 		/*
 		 * Should never happen
@@ -1137,8 +1682,10 @@ static bool smbd_open_one_socket(struct smbd_parent_context *parent,
 	}
 
 	/* ready to listen */
-	set_socket_options(s->fd, "SO_KEEPALIVE");
-	set_socket_options(s->fd, lp_socket_options());
+	if (protocol == IPPROTO_TCP) {
+		set_socket_options(s->fd, "SO_KEEPALIVE");
+		set_socket_options(s->fd, lp_socket_options());
+	}
 
 	/* Set server socket to
 	 * non-blocking for the accept. */
@@ -1207,6 +1754,19 @@ static bool open_sockets_smbd(struct smbd_parent_context *parent,
 		case SMB_TRANSPORT_TYPE_NBT:
 			port = t->port;
 			break;
+		case SMB_TRANSPORT_TYPE_QUIC:
+			if (parent->quic_tls_params == NULL) {
+				bool ok;
+
+				ok = smbd_prepare_quic(parent);
+				if (!ok) {
+					return false;
+				}
+			}
+			/*
+			 * mDNS only announces tcp and nbt
+			 */
+			continue;
 		case SMB_TRANSPORT_TYPE_UNKNOWN:
 			/*
 			 * Should never happen
@@ -1309,6 +1869,8 @@ static bool open_sockets_smbd(struct smbd_parent_context *parent,
 			   smb_parent_send_to_children);
 	messaging_register(msg_ctx, NULL, MSG_SMB_TELL_NUM_CHILDREN,
 			   smb_tell_num_children);
+	messaging_register(msg_ctx, NULL, MSG_SMB_TELL_PREFORK_STATUS,
+			   smbd_prefork_status);
 
 	messaging_register(msg_ctx, NULL,
 			   ID_CACHE_DELETE, smbd_parent_id_cache_delete);
@@ -2362,6 +2924,8 @@ extern void build_options(bool screen);
 	if (!open_sockets_smbd(parent, ev_ctx, msg_ctx))
 		exit_server("open_sockets_smbd() failed");
 
+	smbd_prefork_init(parent);
+
 	TALLOC_FREE(frame);
 	/* make sure we always have a valid stackframe */
 	frame = talloc_stackframe();
@@ -107,7 +107,7 @@ struct files_struct *fcb_or_dos_open(
 	new_refcount = fh_get_refcount(new_fsp->fh) + 1;
 	fh_set_refcount(new_fsp->fh, new_refcount);
 
-	new_fsp->file_id = fsp->file_id;
+	fsp_set_file_id(new_fsp, fsp->file_id);
 	new_fsp->initial_allocation_size = fsp->initial_allocation_size;
 	new_fsp->file_pid = fsp->file_pid;
 	new_fsp->vuid = fsp->vuid;
@@ -63,6 +63,144 @@ struct aio_extra *create_aio_extra(TALLOC_CTX *mem_ctx,
 	return aio_ex;
 }
 
+/****************************************************************************
+ A process wide pool of long-lived read buffers. VFS modules can register
+ them with the kernel once (e.g. as io_uring fixed buffers) instead of
+ having the pages pinned for every request.
+*****************************************************************************/
+
+struct smbd_iobuf_pool {
+	size_t buf_size;
+	size_t num_bufs;
+	struct iovec *iov;
+	size_t num_free;
+	size_t *free_idx;
+};
+
+static struct smbd_iobuf_pool *smbd_iobuf_pool;
+
+static ssize_t smbd_iobuf_find(struct smbd_iobuf_pool *pool, const void *ptr)
+{
+	size_t i;
+
+	for (i = 0; i < pool->num_bufs; i++) {
+		if (pool->iov[i].iov_base == ptr) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+static int smbd_iobuf_destructor(uint8_t *buf)
+{
+	struct smbd_iobuf_pool *pool = smbd_iobuf_pool;
+	ssize_t idx = smbd_iobuf_find(pool, buf);
+
+	SMB_ASSERT(idx != -1);
+	SMB_ASSERT(pool->num_free < pool->num_bufs);
+
+	/*
+	 * Keep the buffer, talloc allows a destructor to move
+	 * the chunk to a new parent and veto the free.
+	 */
+	talloc_steal(pool, buf);
+	pool->free_idx[pool->num_free++] = idx;
+	return -1;
+}
+
+bool smbd_iobuf_pool_init(size_t num_bufs, size_t buf_size)
+{
+	struct smbd_iobuf_pool *pool = NULL;
+	size_t i;
+
+	if (smbd_iobuf_pool != NULL) {
+		/* The first caller wins */
+		return true;
+	}
+
+	if (num_bufs == 0 || buf_size == 0) {
+		return false;
+	}
+
+	pool = talloc_zero(NULL, struct smbd_iobuf_pool);
+	if (pool == NULL) {
+		return false;
+	}
+	pool->buf_size = buf_size;
+	pool->iov = talloc_zero_array(pool, struct iovec, num_bufs);
+	pool->free_idx = talloc_zero_array(pool, size_t, num_bufs);
+	if (pool->iov == NULL || pool->free_idx == NULL) {
+		TALLOC_FREE(pool);
+		return false;
+	}
+
+	for (i = 0; i < num_bufs; i++) {
+		uint8_t *buf = talloc_array(pool, uint8_t, buf_size);
+		if (buf == NULL) {
+			TALLOC_FREE(pool);
+			return false;
+		}
+		talloc_set_destructor(buf, smbd_iobuf_destructor);
+		pool->iov[i] = (struct iovec) {
+			.iov_base = buf, .iov_len = buf_size,
+		};
+		pool->free_idx[i] = num_bufs - i - 1;
+	}
+	pool->num_bufs = num_bufs;
+	pool->num_free = num_bufs;
+
+	smbd_iobuf_pool = pool;
+	return true;
+}
+
+const struct iovec *smbd_iobuf_pool_iov(size_t *num_bufs)
+{
+	if (smbd_iobuf_pool == NULL) {
+		*num_bufs = 0;
+		return NULL;
+	}
+	*num_bufs = smbd_iobuf_pool->num_bufs;
+	return smbd_iobuf_pool->iov;
+}
+
+ssize_t smbd_iobuf_index(const void *ptr, size_t len)
+{
+	struct smbd_iobuf_pool *pool = smbd_iobuf_pool;
+	const uint8_t *p = (const uint8_t *)ptr;
+	size_t i;
+
+	if (pool == NULL) {
+		return -1;
+	}
+
+	for (i = 0; i < pool->num_bufs; i++) {
+		const uint8_t *base = (const uint8_t *)pool->iov[i].iov_base;
+
+		if (p >= base && len <= pool->buf_size &&
+		    (size_t)(p - base) <= pool->buf_size - len)
+		{
+			return i;
+		}
+	}
+	return -1;
+}
+
+static uint8_t *smbd_iobuf_talloc(TALLOC_CTX *mem_ctx, size_t len)
+{
+	struct smbd_iobuf_pool *pool = smbd_iobuf_pool;
+	uint8_t *buf = NULL;
+	size_t idx;
+
+	if (pool == NULL || pool->num_free == 0 || len > pool->buf_size) {
+		return NULL;
+	}
+
+	idx = pool->free_idx[--pool->num_free];
+	buf = (uint8_t *)pool->iov[idx].iov_base;
+	talloc_steal(mem_ctx, buf);
+	return buf;
+}
+
 struct aio_req_fsp_link {
 #ifdef DEVELOPER
 	struct smbd_server_connection *sconn;
@@ -353,8 +491,12 @@ NTSTATUS schedule_smb2_aio_read(connection_struct *conn,
 		return NT_STATUS_RETRY;
 	}
 
-	/* Create the out buffer. */
-	*preadbuf = data_blob_talloc(ctx, NULL, smb_maxcnt);
+	/* Create the out buffer, preferably from the registered pool. */
+	preadbuf->data = smbd_iobuf_talloc(ctx, smb_maxcnt);
+	preadbuf->length = smb_maxcnt;
+	if (preadbuf->data == NULL) {
+		*preadbuf = data_blob_talloc(ctx, NULL, smb_maxcnt);
+	}
 	if (preadbuf->data == NULL) {
 		return NT_STATUS_NO_MEMORY;
 	}
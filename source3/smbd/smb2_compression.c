@@ -0,0 +1,458 @@
+/*
+   Unix SMB/CIFS implementation.
+   SMB3 compression transform handling for the SMB2 server
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "smbd/smbd.h"
+#include "smbd/globals.h"
+#include "../libcli/smb/smb_common.h"
+#include "libcli/smb/smb2_negotiate_context.h"
+#include "libcli/smb/smb2_compression.h"
+#include "lib/compression/lzxpress.h"
+#include "lib/compression/lzxpress_huffman.h"
+
+#undef DBGC_CLASS
+#define DBGC_CLASS DBGC_SMB2
+
+/*
+ * A decompressed message may contain a bit more than the
+ * data of a maximum sized READ, WRITE or IOCTL, e.g. the
+ * SMB2 header and the request body, or a small compound
+ * in front of it.
+ */
+#define SMB2_COMPRESSION_MAX_HDR_SLACK 0x10000
+
+NTSTATUS smbd_smb2_compression_negotiate(struct smbXsrv_connection *xconn,
+					 TALLOC_CTX *mem_ctx,
+					 const struct smb2_negotiate_context *in_comp,
+					 struct smb2_negotiate_contexts *out_c)
+{
+	const struct smb3_compression_capabilities srv_algos =
+		smb3_compression_capabilities_parse("server",
+			lp_server_smb3_compression_algorithms());
+	struct smb3_compression_capabilities *n =
+		&xconn->smb2.compression.negotiated;
+	uint8_t buf[8 + SMB3_COMPRESSION_CAPABILITIES_MAX_ALGOS * 2];
+	size_t needed = 8;
+	uint16_t algo_count;
+	uint32_t in_flags;
+	const uint8_t *p = NULL;
+	bool chained;
+	size_t si;
+	size_t i;
+
+	*n = (struct smb3_compression_capabilities) { .num_algos = 0, };
+
+	if (in_comp->data.length < needed) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	algo_count = SVAL(in_comp->data.data, 0);
+	in_flags = IVAL(in_comp->data.data, 4);
+	if (algo_count == 0) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	p = in_comp->data.data + needed;
+	needed += algo_count * 2;
+
+	if (in_comp->data.length < needed) {
+		return NT_STATUS_INVALID_PARAMETER;
+	}
+
+	if (srv_algos.num_algos == 0) {
+		/*
+		 * Compression is disabled, we just
+		 * ignore the context.
+		 */
+		return NT_STATUS_OK;
+	}
+
+	chained = (in_flags & SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED);
+
+	/*
+	 * The server algorithms are listed
+	 * with the lowest idx being preferred.
+	 */
+	for (si = 0; si < srv_algos.num_algos; si++) {
+		uint16_t sv = srv_algos.algos[si];
+
+		if (sv == SMB2_COMPRESSION_PATTERN_V1 && !chained) {
+			/*
+			 * Pattern_V1 is only valid in
+			 * chained compression
+			 */
+			continue;
+		}
+
+		for (i = 0; i < algo_count; i++) {
+			if (SVAL(p, i * 2) != sv) {
+				continue;
+			}
+
+			n->algos[n->num_algos] = sv;
+			n->num_algos += 1;
+			break;
+		}
+	}
+
+	if (n->num_algos == 0) {
+		SSVAL(buf, 0, 1); /* CompressionAlgorithmCount */
+		SSVAL(buf, 2, 0); /* Padding */
+		SIVAL(buf, 4, SMB2_COMPRESSION_CAPABILITIES_FLAG_NONE);
+		SSVAL(buf, 8, SMB2_COMPRESSION_NONE);
+
+		return smb2_negotiate_context_add(mem_ctx,
+						  out_c,
+						  SMB2_COMPRESSION_CAPABILITIES,
+						  buf,
+						  10);
+	}
+
+	n->chained = chained;
+
+	SSVAL(buf, 0, n->num_algos); /* CompressionAlgorithmCount */
+	SSVAL(buf, 2, 0); /* Padding */
+	SIVAL(buf, 4, chained ?
+		      SMB2_COMPRESSION_CAPABILITIES_FLAG_CHAINED :
+		      SMB2_COMPRESSION_CAPABILITIES_FLAG_NONE);
+	for (i = 0; i < n->num_algos; i++) {
+		SSVAL(buf, 8 + i * 2, n->algos[i]);
+		DBG_DEBUG("negotiated compression algorithm[%zu] %s\n",
+			  i, smb3_compression_algorithm_name(n->algos[i]));
+	}
+
+	return smb2_negotiate_context_add(mem_ctx,
+					  out_c,
+					  SMB2_COMPRESSION_CAPABILITIES,
+					  buf,
+					  8 + n->num_algos * 2);
+}
+
+NTSTATUS smbd_smb2_decompress(struct smbXsrv_connection *xconn,
+			      TALLOC_CTX *mem_ctx,
+			      const uint8_t *buf,
+			      size_t buflen,
+			      uint8_t **_out,
+			      size_t *_out_len)
+{
+	size_t max_size;
+	uint8_t *out = NULL;
+	size_t out_size = 0;
+	NTSTATUS status;
+	START_PROFILE_BYTES(smb2_decompress, buflen);
+
+	if (xconn->smb2.compression.negotiated.num_algos == 0) {
+		DBG_INFO("Got SMB2_COMPRESSION_TRANSFORM header, "
+			 "but compression was not negotiated\n");
+		status = NT_STATUS_INVALID_PARAMETER;
+		goto done;
+	}
+
+	max_size = MAX(xconn->smb2.server.max_trans,
+		       xconn->smb2.server.max_write);
+	max_size += SMB2_COMPRESSION_MAX_HDR_SLACK;
+
+	status = smb2_compression_decompress(mem_ctx,
+					     &xconn->smb2.compression.negotiated,
+					     buf,
+					     buflen,
+					     max_size,
+					     &out,
+					     &out_size);
+	if (!NT_STATUS_IS_OK(status)) {
+		goto done;
+	}
+
+	xconn->smb2.compression.counters.decompressed_in_bytes += buflen;
+	xconn->smb2.compression.counters.decompressed_out_bytes += out_size;
+
+	*_out = out;
+	*_out_len = out_size;
+	status = NT_STATUS_OK;
+done:
+	END_PROFILE_BYTES(smb2_decompress);
+	return status;
+}
+
+bool smbd_smb2_compress_read_wanted(struct smbd_smb2_request *req,
+				    uint8_t in_flags,
+				    size_t length)
+{
+	struct smbXsrv_connection *xconn = req->xconn;
+
+	if (xconn->smb2.compression.negotiated.num_algos == 0) {
+		return false;
+	}
+
+	if (req->do_encryption) {
+		/*
+		 * The compression transform would need to be
+		 * placed inside of the encryption transform,
+		 * we don't support that (yet).
+		 */
+		return false;
+	}
+
+	if (req->tcon == NULL || req->tcon->compat == NULL) {
+		return false;
+	}
+
+	if (!lp_smb3_compression(SNUM(req->tcon->compat)) &&
+	    !(in_flags & SMB2_READFLAG_REQUEST_COMPRESSED))
+	{
+		return false;
+	}
+
+	if (length < lp_smb3_compression_threshold()) {
+		return false;
+	}
+
+	return true;
+}
+
+static ssize_t smb2_compression_compress_algo(struct smbXsrv_connection *xconn,
+					      uint16_t algo,
+					      const uint8_t *in,
+					      size_t in_len,
+					      uint8_t *out,
+					      size_t out_len)
+{
+	struct lzxhuff_compressor_mem *mem = NULL;
+
+	switch (algo) {
+	case SMB2_COMPRESSION_LZ77:
+		return lzxpress_compress(in, in_len, out, out_len);
+	case SMB2_COMPRESSION_LZ77_HUFFMAN:
+		mem = xconn->smb2.compression.huffman_mem;
+		if (mem == NULL) {
+			mem = talloc(xconn, struct lzxhuff_compressor_mem);
+			if (mem == NULL) {
+				return -1;
+			}
+			xconn->smb2.compression.huffman_mem = mem;
+		}
+		return lzxpress_huffman_compress(mem, in, in_len, out, out_len);
+	default:
+		break;
+	}
+
+	return -1;
+}
+
+static NTSTATUS smb2_compress_read_response(struct smbd_smb2_request *req,
+					    bool *_compressed)
+{
+	struct smbXsrv_connection *xconn = req->xconn;
+	const struct smb3_compression_capabilities *n =
+		&xconn->smb2.compression.negotiated;
+	struct iovec *tf = SMBD_SMB2_IDX_TF_IOV(req,out,1);
+	struct iovec *hdr = SMBD_SMB2_IDX_HDR_IOV(req,out,1);
+	struct iovec *body = SMBD_SMB2_IDX_BODY_IOV(req,out,1);
+	struct iovec *dyn = SMBD_SMB2_IDX_DYN_IOV(req,out,1);
+	const uint8_t *data = (const uint8_t *)dyn->iov_base;
+	size_t data_len = dyn->iov_len;
+	size_t prefix_len = hdr->iov_len + body->iov_len;
+	uint16_t algo = SMB2_COMPRESSION_NONE;
+	uint8_t *comp_tf = NULL;
+	uint8_t *comp = NULL;
+	size_t comp_len = 0;
+	size_t i;
+	START_PROFILE_BYTES(smb2_compress, data_len);
+
+	if (n->chained &&
+	    smb2_compression_algo_negotiated(n,
+					     SMB2_COMPRESSION_PATTERN_V1) &&
+	    smb2_compression_is_pattern(data, data_len))
+	{
+		algo = SMB2_COMPRESSION_PATTERN_V1;
+		comp_len = SMB2_COMP_PAYLOAD_HDR_SIZE +
+			   SMB2_COMP_PATTERN_V1_SIZE;
+		comp = talloc_zero_array(req, uint8_t, comp_len);
+		if (comp == NULL) {
+			END_PROFILE_BYTES(smb2_compress);
+			return NT_STATUS_NO_MEMORY;
+		}
+		SSVAL(comp, SMB2_COMP_PAYLOAD_ALGORITHM, algo);
+		SSVAL(comp, SMB2_COMP_PAYLOAD_FLAGS,
+		      SMB2_COMPRESSION_FLAG_NONE);
+		SIVAL(comp, SMB2_COMP_PAYLOAD_LENGTH,
+		      SMB2_COMP_PATTERN_V1_SIZE);
+		SCVAL(comp, SMB2_COMP_PAYLOAD_HDR_SIZE + 0, data[0]);
+		SIVAL(comp, SMB2_COMP_PAYLOAD_HDR_SIZE + 4, data_len);
+	}
+
+	for (i = 0; comp == NULL && i < n->num_algos; i++) {
+		size_t ofs = 0;
+		size_t max_len;
+		ssize_t ret;
+
+		algo = n->algos[i];
+		if (algo == SMB2_COMPRESSION_PATTERN_V1) {
+			continue;
+		}
+
+		if (n->chained) {
+			/*
+			 * Chained payload header plus
+			 * OriginalPayloadSize
+			 */
+			ofs = SMB2_COMP_PAYLOAD_HDR_SIZE + 4;
+		}
+
+		max_len = smb2_compression_max_size(algo, data_len);
+		comp = talloc_array(req, uint8_t, ofs + max_len);
+		if (comp == NULL) {
+			END_PROFILE_BYTES(smb2_compress);
+			return NT_STATUS_NO_MEMORY;
+		}
+
+		ret = smb2_compression_compress_algo(xconn,
+						     algo,
+						     data,
+						     data_len,
+						     comp + ofs,
+						     max_len);
+		if (ret < 0) {
+			DBG_DEBUG("%s compression failed for %zu bytes\n",
+				  smb3_compression_algorithm_name(algo),
+				  data_len);
+			TALLOC_FREE(comp);
+			continue;
+		}
+		comp_len = ofs + ret;
+
+		if (ofs != 0) {
+			SSVAL(comp, SMB2_COMP_PAYLOAD_ALGORITHM, algo);
+			SSVAL(comp, SMB2_COMP_PAYLOAD_FLAGS,
+			      SMB2_COMPRESSION_FLAG_NONE);
+			SIVAL(comp, SMB2_COMP_PAYLOAD_LENGTH, 4 + ret);
+			SIVAL(comp, SMB2_COMP_PAYLOAD_ORIGINAL_SIZE, data_len);
+		}
+		break;
+	}
+
+	if (comp == NULL || comp_len + SMB2_COMP_TF_HDR_SIZE >= data_len) {
+		/*
+		 * Not worth it, send it raw.
+		 */
+		TALLOC_FREE(comp);
+		xconn->smb2.compression.counters.raw_bytes += data_len;
+		SMBPROFILE_COUNT_INCREMENT(smb2_compress_raw_bytes,
+					   profile_p,
+					   data_len);
+		END_PROFILE_BYTES(smb2_compress);
+		return NT_STATUS_OK;
+	}
+
+	comp_tf = talloc_zero_array(req, uint8_t, SMB2_COMP_TF_HDR_SIZE);
+	if (comp_tf == NULL) {
+		END_PROFILE_BYTES(smb2_compress);
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	SIVAL(comp_tf, SMB2_COMP_TF_PROTOCOL_ID, SMB2_COMP_TF_MAGIC);
+	if (n->chained) {
+		/*
+		 * The first chained payload carries the
+		 * SMB2 header and the READ response body
+		 * uncompressed.
+		 */
+		SIVAL(comp_tf, SMB2_COMP_TF_ORIGINAL_SIZE,
+		      prefix_len + data_len);
+		SSVAL(comp_tf, SMB2_COMP_TF_ALGORITHM,
+		      SMB2_COMPRESSION_NONE);
+		SSVAL(comp_tf, SMB2_COMP_TF_FLAGS,
+		      SMB2_COMPRESSION_FLAG_CHAINED);
+		SIVAL(comp_tf, SMB2_COMP_TF_OFFSET, prefix_len);
+	} else {
+		SIVAL(comp_tf, SMB2_COMP_TF_ORIGINAL_SIZE, data_len);
+		SSVAL(comp_tf, SMB2_COMP_TF_ALGORITHM, algo);
+		SSVAL(comp_tf, SMB2_COMP_TF_FLAGS,
+		      SMB2_COMPRESSION_FLAG_NONE);
+		SIVAL(comp_tf, SMB2_COMP_TF_OFFSET, prefix_len);
+	}
+
+	tf->iov_base = (void *)comp_tf;
+	tf->iov_len = SMB2_COMP_TF_HDR_SIZE;
+	dyn->iov_base = (void *)comp;
+	dyn->iov_len = comp_len;
+
+	xconn->smb2.compression.counters.compressed_in_bytes += data_len;
+	xconn->smb2.compression.counters.compressed_out_bytes += comp_len;
+	SMBPROFILE_COUNT_INCREMENT(smb2_compress_out_bytes,
+				   profile_p,
+				   comp_len);
+
+	DBG_DEBUG("compressed %zu bytes into %zu bytes using %s\n",
+		  data_len, comp_len, smb3_compression_algorithm_name(algo));
+
+	END_PROFILE_BYTES(smb2_compress);
+	*_compressed = true;
+	return NT_STATUS_OK;
+}
+
+NTSTATUS smbd_smb2_request_compress(struct smbd_smb2_request *req,
+				    bool *_compressed)
+{
+	struct smbXsrv_connection *xconn = req->xconn;
+	struct iovec *tf = SMBD_SMB2_IDX_TF_IOV(req,out,1);
+	struct iovec *hdr = SMBD_SMB2_IDX_HDR_IOV(req,out,1);
+	struct iovec *dyn = SMBD_SMB2_IDX_DYN_IOV(req,out,1);
+	const uint8_t *inbody = NULL;
+	uint8_t in_flags;
+
+	*_compressed = false;
+
+	if (xconn->smb2.compression.negotiated.num_algos == 0) {
+		return NT_STATUS_OK;
+	}
+
+	/*
+	 * We only compress READ responses which are not
+	 * part of a compound, not encrypted and not
+	 * sent via sendfile.
+	 */
+	if (req->out.vector_count != 1 + SMBD_SMB2_NUM_IOV_PER_REQ) {
+		return NT_STATUS_OK;
+	}
+	if (tf->iov_len != 0) {
+		return NT_STATUS_OK;
+	}
+	if (SVAL(hdr->iov_base, SMB2_HDR_OPCODE) != SMB2_OP_READ) {
+		return NT_STATUS_OK;
+	}
+	if (!NT_STATUS_IS_OK(NT_STATUS(IVAL(hdr->iov_base, SMB2_HDR_STATUS)))) {
+		return NT_STATUS_OK;
+	}
+	if (dyn->iov_base == NULL || dyn->iov_len == 0) {
+		return NT_STATUS_OK;
+	}
+
+	inbody = SMBD_SMB2_IDX_BODY_IOV(req,in,1)->iov_base;
+	in_flags = CVAL(inbody, 0x03);
+
+	if (!smbd_smb2_compress_read_wanted(req, in_flags, dyn->iov_len)) {
+		xconn->smb2.compression.counters.raw_bytes += dyn->iov_len;
+		SMBPROFILE_COUNT_INCREMENT(smb2_compress_raw_bytes,
+					   profile_p,
+					   dyn->iov_len);
+		return NT_STATUS_OK;
+	}
+
+	return smb2_compress_read_response(req, _compressed);
+}
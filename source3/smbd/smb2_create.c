@@ -676,6 +676,7 @@ struct smbd_smb2_create_state {
 	struct GUID req_guid;
 	struct smb_request *smb1req;
 	bool open_was_deferred;
+	bool path_prefetched;
 	struct tevent_immediate *im;
 	struct timeval request_time;
 	struct file_id id;
@@ -884,8 +885,73 @@ static NTSTATUS smbd_smb2_create_fetch_create_ctx(
 }
 
 static void smbd_smb2_create_before_exec(struct tevent_req *req);
+static bool smbd_smb2_create_prefetch_path(struct tevent_req *req);
 static void smbd_smb2_create_after_exec(struct tevent_req *req);
 static void smbd_smb2_create_finish(struct tevent_req *req);
+static void smbd_smb2_create_request_dispatch_immediate(
+	struct tevent_context *ctx,
+	struct tevent_immediate *im,
+	void *private_data);
+
+/*
+ * Check whether the rest of the compound chain only queries the handle
+ * we're about to open and then closes it: related QUERY_INFO requests
+ * followed by a related CLOSE, all on the "previous" file id.
+ */
+static bool smbd_smb2_create_closed_in_compound(
+	const struct smbd_smb2_request *smb2req)
+{
+	int idx;
+
+	if (!smbd_smb2_is_compound(smb2req)) {
+		return false;
+	}
+
+	for (idx = smb2req->current_idx + SMBD_SMB2_NUM_IOV_PER_REQ;
+	     idx < smb2req->in.vector_count;
+	     idx += SMBD_SMB2_NUM_IOV_PER_REQ)
+	{
+		const struct iovec *hdr_iov =
+			SMBD_SMB2_IDX_HDR_IOV(smb2req, in, idx);
+		const struct iovec *body_iov =
+			SMBD_SMB2_IDX_BODY_IOV(smb2req, in, idx);
+		const uint8_t *hdr = hdr_iov->iov_base;
+		const uint8_t *body = body_iov->iov_base;
+		uint32_t flags = IVAL(hdr, SMB2_HDR_FLAGS);
+		uint16_t opcode = SVAL(hdr, SMB2_HDR_OPCODE);
+		size_t fileid_ofs;
+
+		if (!(flags & SMB2_HDR_FLAG_CHAINED)) {
+			return false;
+		}
+
+		switch (opcode) {
+		case SMB2_OP_GETINFO:
+			fileid_ofs = 0x18;
+			break;
+		case SMB2_OP_CLOSE:
+			fileid_ofs = 0x08;
+			break;
+		default:
+			return false;
+		}
+
+		if (body_iov->iov_len < fileid_ofs + 16) {
+			return false;
+		}
+		if ((BVAL(body, fileid_ofs) != UINT64_MAX) ||
+		    (BVAL(body, fileid_ofs + 8) != UINT64_MAX))
+		{
+			return false;
+		}
+
+		if (opcode == SMB2_OP_CLOSE) {
+			return true;
+		}
+	}
+
+	return false;
+}
 
 static struct tevent_req *smbd_smb2_create_send(TALLOC_CTX *mem_ctx,
 			struct tevent_context *ev,
@@ -906,6 +972,7 @@ static struct tevent_req *smbd_smb2_create_send(TALLOC_CTX *mem_ctx,
 	struct smb_request *smb1req = NULL;
 	struct files_struct *dirfsp = NULL;
 	struct smb_filename *smb_fname = NULL;
+	uint32_t private_flags = 0;
 	uint32_t ucf_flags;
 	bool is_dfs = false;
 	bool is_posix = false;
@@ -945,6 +1012,7 @@ static struct tevent_req *smbd_smb2_create_send(TALLOC_CTX *mem_ctx,
 		state->request_time = old_state->request_time;
 		state->open_rec = talloc_move(state, &old_state->open_rec);
 		state->open_was_deferred = old_state->open_was_deferred;
+		state->path_prefetched = old_state->path_prefetched;
 		state->_purge_create_guid = old_state->_purge_create_guid;
 		state->purge_create_guid = old_state->purge_create_guid;
 		old_state->purge_create_guid = NULL;
@@ -1097,10 +1165,12 @@ static struct tevent_req *smbd_smb2_create_send(TALLOC_CTX *mem_ctx,
 		DATA_BLOB new_cookie = data_blob_null;
 		NTTIME now = timeval_to_nttime(&smb2req->request_time);
 		const struct smb2_lease_key *lease_key = NULL;
+		START_PROFILE(durable_reconnect);
 
 		if (state->lease_ptr != NULL) {
 			lease_key = &state->lease_ptr->lease_key;
 		}
+
 		status = smb2srv_open_recreate(smb2req->xconn,
 					       smb1req->conn->session_info,
 					       state->persistent_id,
@@ -1111,6 +1181,8 @@ static struct tevent_req *smbd_smb2_create_send(TALLOC_CTX *mem_ctx,
 		if (tevent_req_nterror(req, status)) {
 			DBG_NOTICE("smb2srv_open_recreate failed: %s\n",
 				   nt_errstr(status));
+			END_PROFILE(durable_reconnect);
+			DO_PROFILE_INC(durable_reconnect_failed);
 			return tevent_req_post(req, state->ev);
 		}
 
@@ -1119,6 +1191,8 @@ static struct tevent_req *smbd_smb2_create_send(TALLOC_CTX *mem_ctx,
 
 		if (!state->op->global->durable) {
 			talloc_free(state->op);
+			END_PROFILE(durable_reconnect);
+			DO_PROFILE_INC(durable_reconnect_failed);
 			tevent_req_nterror(req,
 					   NT_STATUS_OBJECT_NAME_NOT_FOUND);
 			return tevent_req_post(req, state->ev);
@@ -1131,6 +1205,7 @@ static struct tevent_req *smbd_smb2_create_send(TALLOC_CTX *mem_ctx,
 						   state->op, /* TALLOC_CTX */
 						   &state->result,
 						   &new_cookie);
+		END_PROFILE(durable_reconnect);
 		if (!NT_STATUS_IS_OK(status)) {
 			NTSTATUS return_status;
 
@@ -1141,6 +1216,7 @@ static struct tevent_req *smbd_smb2_create_send(TALLOC_CTX *mem_ctx,
 				   nt_errstr(return_status));
 
 			TALLOC_FREE(state->op);
+			DO_PROFILE_INC(durable_reconnect_failed);
 			tevent_req_nterror(req, return_status);
 			return tevent_req_post(req, state->ev);
 		}
@@ -1198,6 +1274,19 @@ static struct tevent_req *smbd_smb2_create_send(TALLOC_CTX *mem_ctx,
 					      state->in_create_disposition,
 					      state->in_create_options);
 
+	if (smbd_smb2_create_prefetch_path(req)) {
+		/*
+		 * We're re-dispatched once the path
+		 * is in the caches.
+		 */
+		SMBPROFILE_IOBYTES_ASYNC_SET_IDLE_X(smb2req->profile,
+						    smb2req->profile_x);
+		return req;
+	}
+	if (!tevent_req_is_in_progress(req)) {
+		return tevent_req_post(req, state->ev);
+	}
+
 	if (lp_follow_symlinks(SNUM(smb1req->conn)) &&
 	    (state->posx == NULL)) {
 		status = filename_convert_dirfsp(mem_ctx,
@@ -1279,6 +1368,15 @@ static struct tevent_req *smbd_smb2_create_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
+	if (lp_smb2_compound_stat_opens(SNUM(smb1req->conn)) &&
+	    (state->lease_ptr == NULL) &&
+	    !state->durable_requested &&
+	    !is_named_stream(smb_fname) &&
+	    smbd_smb2_create_closed_in_compound(smb2req))
+	{
+		private_flags |= NTCREATEX_FLAG_COMPOUND_STAT_OPEN;
+	}
+
 	status = SMB_VFS_CREATE_FILE(smb1req->conn,
 				     smb1req,
 				     dirfsp,
@@ -1292,7 +1390,7 @@ static struct tevent_req *smbd_smb2_create_send(TALLOC_CTX *mem_ctx,
 					     state->requested_oplock_level),
 				     state->lease_ptr,
 				     state->allocation_size,
-				     0, /* private_flags */
+				     private_flags,
 				     state->sec_desc,
 				     state->ea_list,
 				     &state->result,
@@ -1334,6 +1432,115 @@ static struct tevent_req *smbd_smb2_create_send(TALLOC_CTX *mem_ctx,
 	return req;
 }
 
+static void smbd_smb2_create_prefetch_done(struct tevent_req *subreq);
+
+/*
+ * With "aio create" we stat the path asynchronously before
+ * the synchronous path walk. Returns true if the request is
+ * suspended until that has finished.
+ */
+static bool smbd_smb2_create_prefetch_path(struct tevent_req *req)
+{
+	struct smbd_smb2_create_state *state = tevent_req_data(
+		req, struct smbd_smb2_create_state);
+	struct smbd_smb2_request *smb2req = state->smb2req;
+	connection_struct *conn = state->smb1req->conn;
+	struct smb_filename *smb_fname = NULL;
+	struct tevent_req *subreq = NULL;
+	char *stream = NULL;
+
+	if (!lp_aio_create(SNUM(conn))) {
+		return false;
+	}
+	if (state->path_prefetched || state->open_was_deferred) {
+		return false;
+	}
+	if (state->fname[0] == '\0' || state->twrp_time != 0) {
+		return false;
+	}
+	if (smbd_smb2_is_compound(smb2req) &&
+	    !smbd_smb2_is_last_in_compound(smb2req))
+	{
+		/* Same as for async reads and writes */
+		return false;
+	}
+
+	state->path_prefetched = true;
+
+	smb_fname = synthetic_smb_fname(state,
+					state->fname,
+					NULL,
+					NULL,
+					0,
+					0);
+	if (tevent_req_nomem(smb_fname, req)) {
+		return false;
+	}
+	if (state->posx == NULL) {
+		stream = strchr_m(smb_fname->base_name, ':');
+		if (stream != NULL) {
+			*stream = '\0';
+		}
+	}
+
+	subreq = SMB_VFS_FSTATAT_SEND(state,
+				      state->ev,
+				      conn->cwd_fsp,
+				      smb_fname,
+				      AT_SYMLINK_NOFOLLOW);
+	if (subreq == NULL) {
+		/* It's only an optimization */
+		return false;
+	}
+	if (!tevent_req_is_in_progress(subreq)) {
+		/* Not really async, nothing to wait for */
+		TALLOC_FREE(subreq);
+		return false;
+	}
+	tevent_req_set_callback(subreq, smbd_smb2_create_prefetch_done, req);
+	return true;
+}
+
+static void smbd_smb2_create_prefetch_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smbd_smb2_create_state *state = tevent_req_data(
+		req, struct smbd_smb2_create_state);
+	struct smbd_smb2_request *smb2req = state->smb2req;
+	struct vfs_aio_state aio_state = { 0 };
+	SMB_STRUCT_STAT sbuf;
+
+	/*
+	 * The result doesn't matter, as the real
+	 * path walk will find out anyway.
+	 */
+	SMB_VFS_FSTATAT_RECV(subreq, &aio_state, &sbuf);
+	TALLOC_FREE(subreq);
+
+	DBG_DEBUG("prefetched [%s]: %s\n",
+		  state->fname,
+		  strerror(aio_state.error));
+
+	/*
+	 * Same as schedule_deferred_open_message_smb2(),
+	 * we're called again for the same smb2req.
+	 */
+	tevent_req_set_callback(req, NULL, NULL);
+
+	TALLOC_FREE(state->im);
+	state->im = tevent_create_immediate(smb2req);
+	if (state->im == NULL) {
+		smbd_server_connection_terminate(smb2req->xconn,
+			nt_errstr(NT_STATUS_NO_MEMORY));
+		return;
+	}
+	tevent_schedule_immediate(state->im,
+				  smb2req->sconn->ev_ctx,
+				  smbd_smb2_create_request_dispatch_immediate,
+				  smb2req);
+}
+
 static void smbd_smb2_create_purge_replay_cache(struct tevent_req *req,
 						const char *caller_func)
 {
@@ -184,6 +184,11 @@ static struct tevent_req *smbd_smb2_flush_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
+	status = write_behind_flush(fsp);
+	if (tevent_req_nterror(req, status)) {
+		return tevent_req_post(req, ev);
+	}
+
 	if (!lp_strict_sync(SNUM(smbreq->conn))) {
 		/*
 		 * No strict sync. Don't really do
@@ -218,6 +218,58 @@ struct smbd_smb2_getinfo_state {
 	DATA_BLOB out_output_buffer;
 };
 
+/*
+ * While a handle holds a read and handle lease, changes through
+ * handles of other clients break the lease, and changes through
+ * handles of this client call fsp_lease_stat_invalidate(). On shares
+ * that are not modified outside of Samba the stat info of the last
+ * GETINFO can then be returned again without an fstat.
+ */
+static bool getinfo_lease_covers_stat(struct files_struct *fsp)
+{
+	const struct smb2_lease *lease = NULL;
+	uint32_t rh = SMB2_LEASE_READ | SMB2_LEASE_HANDLE;
+
+	if (fsp->oplock_type != LEASE_OPLOCK || fsp->lease == NULL) {
+		return false;
+	}
+	lease = &fsp->lease->lease;
+
+	if ((lease->lease_state & rh) != rh) {
+		return false;
+	}
+	if (lease->lease_flags & SMB2_LEASE_FLAG_BREAK_IN_PROGRESS) {
+		return false;
+	}
+	return true;
+}
+
+static bool getinfo_lease_stat_valid(struct files_struct *fsp)
+{
+	if (!fsp->fsp_flags.lease_stat_valid) {
+		return false;
+	}
+	if (!getinfo_lease_covers_stat(fsp)) {
+		return false;
+	}
+	return fsp->lease->lease.lease_epoch == fsp->lease_stat_epoch;
+}
+
+static void getinfo_lease_stat_taken(struct files_struct *fsp)
+{
+	fsp->fsp_flags.lease_stat_valid = false;
+
+	if (!getinfo_lease_covers_stat(fsp)) {
+		return;
+	}
+	if (!lp_parm_bool(SNUM(fsp->conn), "smbd", "lease stat cache", false)) {
+		return;
+	}
+
+	fsp->fsp_flags.lease_stat_valid = true;
+	fsp->lease_stat_epoch = fsp->lease->lease.lease_epoch;
+}
+
 static void smb2_ipc_getinfo(struct tevent_req *req,
 				struct smbd_smb2_getinfo_state *state,
 				struct tevent_context *ev,
@@ -393,13 +445,21 @@ static struct tevent_req *smbd_smb2_getinfo_send(TALLOC_CTX *mem_ctx,
 			 * Original code - this is an open file.
 			 */
 
-			status = vfs_stat_fsp(fsp);
-			if (!NT_STATUS_IS_OK(status)) {
-				DEBUG(3, ("smbd_smb2_getinfo_send: "
-					  "fstat of %s failed (%s)\n",
-					  fsp_fnum_dbg(fsp), nt_errstr(status)));
-				tevent_req_nterror(req, status);
-				return tevent_req_post(req, ev);
+			if (getinfo_lease_stat_valid(fsp)) {
+				DBG_DEBUG("using stat of %s cached under "
+					  "lease\n",
+					  fsp_str_dbg(fsp));
+			} else {
+				status = vfs_stat_fsp(fsp);
+				if (!NT_STATUS_IS_OK(status)) {
+					DEBUG(3, ("smbd_smb2_getinfo_send: "
+						  "fstat of %s failed (%s)\n",
+						  fsp_fnum_dbg(fsp),
+						  nt_errstr(status)));
+					tevent_req_nterror(req, status);
+					return tevent_req_post(req, ev);
+				}
+				getinfo_lease_stat_taken(fsp);
 			}
 			if (fsp_getinfo_ask_sharemode(fsp)) {
 				fileid = vfs_file_id_from_sbuf(
@@ -0,0 +1,1148 @@
+/*
+   Unix SMB/CIFS implementation.
+   io_uring based socket transport for the SMB2 server
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "replace.h"
+
+/*
+ * liburing.h only needs a forward declaration
+ * of struct open_how, see vfs_io_uring.c
+ */
+struct open_how;
+#ifdef HAVE_STRUCT_OPEN_HOW_LIBURING_COMPAT_H
+#define open_how __ignore_liburing_compat_h_open_how
+#include <liburing/compat.h>
+#undef open_how
+#endif /* HAVE_STRUCT_OPEN_HOW_LIBURING_COMPAT_H */
+
+#include "includes.h"
+#include "system/filesys.h"
+#include "smbd/smbd.h"
+#include "smbd/globals.h"
+#include "lib/util/dlinklist.h"
+#include "lib/util/iov_buf.h"
+#include <liburing.h>
+
+#undef DBGC_CLASS
+#define DBGC_CLASS DBGC_SMB2
+
+/*
+ * One ring per smbd process, shared by all connections of the
+ * process. Receives use a ring of provided buffers, so a connection
+ * waiting for the next request doesn't pin any memory.
+ *
+ * Submissions are not passed to the kernel directly, they are
+ * collected until the end of the current event loop iteration
+ * (via a tevent immediate), so that the receives and sends of all
+ * requests processed in one iteration only need a single
+ * io_uring_enter() call.
+ */
+#define SMBD_IO_URING_ENTRIES 128
+#define SMBD_IO_URING_RECV_BUFS 16 /* needs to be a power of 2 */
+#define SMBD_IO_URING_RECV_BUF_SIZE 0x10000
+#define SMBD_IO_URING_RECV_BGID 0
+
+enum smbd_io_uring_op_type {
+	SMBD_IO_URING_OP_RECV,
+	SMBD_IO_URING_OP_SENDMSG,
+	SMBD_IO_URING_OP_SENDFILE_IN,
+	SMBD_IO_URING_OP_SENDFILE_HDR,
+	SMBD_IO_URING_OP_SENDFILE_OUT,
+	SMBD_IO_URING_OP_SENDFILE_PAD,
+};
+
+struct smbd_io_uring_op;
+
+struct smbd_io_uring {
+	struct tevent_context *ev;
+	struct io_uring ring;
+	struct io_uring_buf_ring *buf_ring;
+	uint8_t *bufs;
+	struct tevent_fd *fde;
+	struct tevent_immediate *im;
+	unsigned num_queued;
+
+	/* submitted to the kernel, waiting for the completion */
+	struct smbd_io_uring_op *pending;
+	/* completed, but the completion was not processed yet */
+	struct smbd_io_uring_op *done;
+};
+
+struct smbd_io_uring_op {
+	struct smbd_io_uring_op *prev, *next;
+	/* NULL once the connection was disconnected */
+	struct smbd_io_uring_conn *c;
+	enum smbd_io_uring_op_type type;
+	bool completed;
+	int32_t res;
+	uint32_t flags;
+};
+
+struct smbd_io_uring_conn {
+	struct smbd_io_uring *u;
+	struct smbXsrv_connection *xconn;
+	struct tevent_immediate *im;
+	struct smbd_io_uring_op *recv_op;
+	struct smbd_io_uring_op *send_op;
+	struct smbd_io_uring_op *hdr_op;
+	bool feeding;
+	bool disconnected;
+
+	/*
+	 * A sendfile queue entry in progress. The body goes
+	 * from the page cache into the pipe with IORING_OP_SPLICE
+	 * and from there into the socket, so it's never copied
+	 * to user space.
+	 */
+	struct {
+		struct smbd_smb2_send_queue *e;
+		int fd;
+		int pipefd[2];
+		size_t pipe_size;
+		off_t offset;
+		size_t remaining;
+		size_t in_pipe;
+		size_t hdr_len;
+		size_t sent;
+		bool hdr_sent;
+		bool eof;
+		bool fallback;
+		int error;
+		struct iovec pad_iov;
+		struct msghdr pad_msg;
+	} sf;
+
+	/*
+	 * Received bytes not yet consumed by
+	 * smbd_smb2_io_uring_incoming().
+	 */
+	struct {
+		bool valid;
+		uint16_t bid;
+		size_t ofs;
+		size_t len;
+	} leftover;
+};
+
+static struct smbd_io_uring *smbd_io_uring_global;
+static const uint8_t smbd_io_uring_zeros[0x10000];
+static bool smbd_io_uring_unavailable;
+
+static void smbd_io_uring_fd_handler(struct tevent_context *ev,
+				     struct tevent_fd *fde,
+				     uint16_t flags,
+				     void *private_data);
+static void smbd_io_uring_run(struct smbd_io_uring *u);
+static void smbd_io_uring_schedule(struct smbd_io_uring *u);
+
+static int smbd_io_uring_destructor(struct smbd_io_uring *u)
+{
+	TALLOC_FREE(u->fde);
+
+	if (u->buf_ring != NULL) {
+		io_uring_free_buf_ring(&u->ring,
+				       u->buf_ring,
+				       SMBD_IO_URING_RECV_BUFS,
+				       SMBD_IO_URING_RECV_BGID);
+		u->buf_ring = NULL;
+	}
+	io_uring_queue_exit(&u->ring);
+
+	if (smbd_io_uring_global == u) {
+		smbd_io_uring_global = NULL;
+	}
+	return 0;
+}
+
+static struct smbd_io_uring *smbd_io_uring_get(struct tevent_context *ev)
+{
+	struct smbd_io_uring *u = NULL;
+	int mask = io_uring_buf_ring_mask(SMBD_IO_URING_RECV_BUFS);
+	int ret;
+	int i;
+
+	if (smbd_io_uring_global != NULL) {
+		return smbd_io_uring_global;
+	}
+	if (smbd_io_uring_unavailable) {
+		return NULL;
+	}
+
+	/*
+	 * The ring needs to outlive all connections,
+	 * so it's hung below the event context.
+	 */
+	u = talloc_zero(ev, struct smbd_io_uring);
+	if (u == NULL) {
+		return NULL;
+	}
+	u->ev = ev;
+
+	ret = io_uring_queue_init(SMBD_IO_URING_ENTRIES, &u->ring, 0);
+	if (ret < 0) {
+		DBG_NOTICE("io_uring_queue_init failed: %s\n",
+			   strerror(-ret));
+		TALLOC_FREE(u);
+		smbd_io_uring_unavailable = true;
+		return NULL;
+	}
+	talloc_set_destructor(u, smbd_io_uring_destructor);
+
+#ifdef HAVE_IO_URING_RING_DONTFORK
+	ret = io_uring_ring_dontfork(&u->ring);
+	if (ret < 0) {
+		DBG_NOTICE("io_uring_ring_dontfork failed: %s\n",
+			   strerror(-ret));
+		goto fail;
+	}
+#endif /* HAVE_IO_URING_RING_DONTFORK */
+
+	u->bufs = talloc_array(u,
+			       uint8_t,
+			       SMBD_IO_URING_RECV_BUFS *
+			       SMBD_IO_URING_RECV_BUF_SIZE);
+	if (u->bufs == NULL) {
+		goto fail;
+	}
+
+	u->buf_ring = io_uring_setup_buf_ring(&u->ring,
+					      SMBD_IO_URING_RECV_BUFS,
+					      SMBD_IO_URING_RECV_BGID,
+					      0,
+					      &ret);
+	if (u->buf_ring == NULL) {
+		/* Linux < 5.19 */
+		DBG_NOTICE("io_uring_setup_buf_ring failed: %s\n",
+			   strerror(-ret));
+		goto fail;
+	}
+	for (i = 0; i < SMBD_IO_URING_RECV_BUFS; i++) {
+		io_uring_buf_ring_add(u->buf_ring,
+				      u->bufs + i * SMBD_IO_URING_RECV_BUF_SIZE,
+				      SMBD_IO_URING_RECV_BUF_SIZE,
+				      i,
+				      mask,
+				      i);
+	}
+	io_uring_buf_ring_advance(u->buf_ring, SMBD_IO_URING_RECV_BUFS);
+
+	u->im = tevent_create_immediate(u);
+	if (u->im == NULL) {
+		goto fail;
+	}
+
+	u->fde = tevent_add_fd(ev,
+			       u,
+			       u->ring.ring_fd,
+			       TEVENT_FD_READ,
+			       smbd_io_uring_fd_handler,
+			       u);
+	if (u->fde == NULL) {
+		goto fail;
+	}
+
+	smbd_io_uring_global = u;
+	return u;
+
+fail:
+	TALLOC_FREE(u);
+	smbd_io_uring_unavailable = true;
+	return NULL;
+}
+
+static void smbd_io_uring_recycle_buf(struct smbd_io_uring *u, uint16_t bid)
+{
+	int mask = io_uring_buf_ring_mask(SMBD_IO_URING_RECV_BUFS);
+
+	io_uring_buf_ring_add(u->buf_ring,
+			      u->bufs + bid * SMBD_IO_URING_RECV_BUF_SIZE,
+			      SMBD_IO_URING_RECV_BUF_SIZE,
+			      bid,
+			      mask,
+			      0);
+	io_uring_buf_ring_advance(u->buf_ring, 1);
+}
+
+static void smbd_io_uring_submit(struct smbd_io_uring *u)
+{
+	int ret;
+
+	if (u->num_queued == 0) {
+		return;
+	}
+
+	ret = io_uring_submit(&u->ring);
+	if (ret == -EAGAIN || ret == -EBUSY || ret == -EINTR) {
+		/* retry in the next iteration */
+		smbd_io_uring_schedule(u);
+		return;
+	}
+	if (ret < 0) {
+		/*
+		 * This can't really happen, the sqes are valid
+		 * and we never run out of completion entries.
+		 */
+		smb_panic("smbd_io_uring_submit: io_uring_submit failed");
+	}
+	u->num_queued = 0;
+}
+
+static void smbd_io_uring_immediate(struct tevent_context *ev,
+				    struct tevent_immediate *im,
+				    void *private_data)
+{
+	struct smbd_io_uring *u = talloc_get_type_abort(
+		private_data, struct smbd_io_uring);
+
+	smbd_io_uring_run(u);
+	smbd_io_uring_submit(u);
+}
+
+static void smbd_io_uring_schedule(struct smbd_io_uring *u)
+{
+	tevent_schedule_immediate(u->im, u->ev, smbd_io_uring_immediate, u);
+}
+
+static struct io_uring_sqe *smbd_io_uring_get_sqe(struct smbd_io_uring *u)
+{
+	struct io_uring_sqe *sqe = NULL;
+
+	sqe = io_uring_get_sqe(&u->ring);
+	if (sqe == NULL) {
+		/* The submission queue is full, flush it. */
+		io_uring_submit(&u->ring);
+		u->num_queued = 0;
+		sqe = io_uring_get_sqe(&u->ring);
+		if (sqe == NULL) {
+			return NULL;
+		}
+	}
+
+	u->num_queued += 1;
+	smbd_io_uring_schedule(u);
+	return sqe;
+}
+
+static void smbd_io_uring_reap(struct smbd_io_uring *u)
+{
+	struct io_uring_cqe *cqe = NULL;
+	unsigned cqhead;
+	unsigned nr = 0;
+
+	io_uring_for_each_cqe(&u->ring, cqhead, cqe) {
+		struct smbd_io_uring_op *op = io_uring_cqe_get_data(cqe);
+
+		nr++;
+
+		if (op == NULL) {
+			/* completion of a cancel request */
+			continue;
+		}
+
+		op->completed = true;
+		op->res = cqe->res;
+		op->flags = cqe->flags;
+		DLIST_REMOVE(u->pending, op);
+		DLIST_ADD_END(u->done, op);
+	}
+
+	io_uring_cq_advance(&u->ring, nr);
+}
+
+static void smbd_io_uring_conn_feed(struct smbd_io_uring_conn *c);
+static void smbd_io_uring_conn_terminate(struct smbd_io_uring_conn *c,
+					 NTSTATUS status);
+
+static void smbd_io_uring_recv_done(struct smbd_io_uring_conn *c,
+				    struct smbd_io_uring_op *op)
+{
+	NTSTATUS status;
+
+	if (op->res == -ENOBUFS) {
+		/*
+		 * All provided buffers are held by connections
+		 * that have not consumed their data yet. Try again
+		 * once the current event loop iteration has
+		 * processed them.
+		 */
+		status = smbd_io_uring_conn_recv(c->xconn);
+		if (!NT_STATUS_IS_OK(status)) {
+			smbd_io_uring_conn_terminate(c, status);
+		}
+		return;
+	}
+
+	if (op->res < 0 && (op->flags & IORING_CQE_F_BUFFER)) {
+		smbd_io_uring_recycle_buf(c->u,
+					  op->flags >> IORING_CQE_BUFFER_SHIFT);
+	}
+
+	if (op->res == -EINTR || op->res == -EAGAIN) {
+		status = smbd_io_uring_conn_recv(c->xconn);
+		if (!NT_STATUS_IS_OK(status)) {
+			smbd_io_uring_conn_terminate(c, status);
+		}
+		return;
+	}
+	if (op->res == 0) {
+		/* propagate end of file */
+		if (op->flags & IORING_CQE_F_BUFFER) {
+			smbd_io_uring_recycle_buf(c->u,
+				op->flags >> IORING_CQE_BUFFER_SHIFT);
+		}
+		smbd_io_uring_conn_terminate(c, NT_STATUS_END_OF_FILE);
+		return;
+	}
+	if (op->res < 0) {
+		status = map_nt_error_from_unix_common(-op->res);
+		smbd_io_uring_conn_terminate(c, status);
+		return;
+	}
+	if (!(op->flags & IORING_CQE_F_BUFFER)) {
+		smbd_io_uring_conn_terminate(c, NT_STATUS_INTERNAL_ERROR);
+		return;
+	}
+
+	c->leftover.valid = true;
+	c->leftover.bid = op->flags >> IORING_CQE_BUFFER_SHIFT;
+	c->leftover.ofs = 0;
+	c->leftover.len = op->res;
+
+	smbd_io_uring_conn_feed(c);
+}
+
+static void smbd_io_uring_send_done(struct smbd_io_uring_conn *c,
+				    struct smbd_io_uring_op *op)
+{
+	NTSTATUS status;
+
+	status = smbd_smb2_io_uring_sent(c->xconn, op->res);
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_server_connection_terminate(c->xconn, nt_errstr(status));
+	}
+}
+
+static void smbd_io_uring_sendfile_done(struct smbd_io_uring_conn *c,
+					struct smbd_io_uring_op *op);
+
+static void smbd_io_uring_run(struct smbd_io_uring *u)
+{
+	struct smbd_io_uring_op *op = NULL;
+
+	smbd_io_uring_reap(u);
+
+	while ((op = u->done) != NULL) {
+		struct smbd_io_uring_conn *c = op->c;
+
+		DLIST_REMOVE(u->done, op);
+
+		if (c == NULL) {
+			/* The connection is gone, just clean up. */
+			if (op->type == SMBD_IO_URING_OP_RECV &&
+			    (op->flags & IORING_CQE_F_BUFFER)) {
+				smbd_io_uring_recycle_buf(u,
+					op->flags >> IORING_CQE_BUFFER_SHIFT);
+			}
+			TALLOC_FREE(op);
+			continue;
+		}
+
+		switch (op->type) {
+		case SMBD_IO_URING_OP_RECV:
+			c->recv_op = NULL;
+			smbd_io_uring_recv_done(c, op);
+			break;
+		case SMBD_IO_URING_OP_SENDMSG:
+			c->send_op = NULL;
+			smbd_io_uring_send_done(c, op);
+			break;
+		case SMBD_IO_URING_OP_SENDFILE_HDR:
+			c->hdr_op = NULL;
+			smbd_io_uring_sendfile_done(c, op);
+			break;
+		case SMBD_IO_URING_OP_SENDFILE_IN:
+		case SMBD_IO_URING_OP_SENDFILE_OUT:
+		case SMBD_IO_URING_OP_SENDFILE_PAD:
+			c->send_op = NULL;
+			smbd_io_uring_sendfile_done(c, op);
+			break;
+		}
+		TALLOC_FREE(op);
+	}
+}
+
+static void smbd_io_uring_fd_handler(struct tevent_context *ev,
+				     struct tevent_fd *fde,
+				     uint16_t flags,
+				     void *private_data)
+{
+	struct smbd_io_uring *u = talloc_get_type_abort(
+		private_data, struct smbd_io_uring);
+
+	smbd_io_uring_run(u);
+	smbd_io_uring_submit(u);
+}
+
+static struct smbd_io_uring_op *smbd_io_uring_op_create(
+	struct smbd_io_uring_conn *c,
+	enum smbd_io_uring_op_type type)
+{
+	struct smbd_io_uring_op *op = NULL;
+
+	/*
+	 * The op is allocated on the ring, so that it can
+	 * survive the connection until the kernel is done.
+	 */
+	op = talloc_zero(c->u, struct smbd_io_uring_op);
+	if (op == NULL) {
+		return NULL;
+	}
+	op->c = c;
+	op->type = type;
+	return op;
+}
+
+static void smbd_io_uring_op_cancel(struct smbd_io_uring *u,
+				    struct smbd_io_uring_op *op)
+{
+	struct io_uring_sqe *sqe = NULL;
+
+	op->c = NULL;
+
+	if (op->completed) {
+		/* smbd_io_uring_run() cleans up */
+		return;
+	}
+
+	sqe = smbd_io_uring_get_sqe(u);
+	if (sqe == NULL) {
+		return;
+	}
+	io_uring_prep_cancel(sqe, op, 0);
+	io_uring_sqe_set_data(sqe, NULL);
+	smbd_io_uring_submit(u);
+}
+
+static void smbd_io_uring_wait(struct smbd_io_uring *u,
+			       struct smbd_io_uring_op *op)
+{
+	while (!op->completed) {
+		struct io_uring_cqe *cqe = NULL;
+		int ret;
+
+		ret = io_uring_wait_cqe(&u->ring, &cqe);
+		if (ret == -EINTR) {
+			continue;
+		}
+		if (ret < 0) {
+			smb_panic("smbd_io_uring_wait: io_uring_wait_cqe failed");
+		}
+		smbd_io_uring_reap(u);
+	}
+
+	/* Process the completions of other connections later. */
+	smbd_io_uring_schedule(u);
+}
+
+static void smbd_io_uring_conn_orphan(struct smbd_io_uring_conn *c)
+{
+	struct smbd_io_uring *u = c->u;
+	struct smbd_io_uring_op *send_op = c->send_op;
+	struct smbd_io_uring_op *hdr_op = c->hdr_op;
+
+	if (c->disconnected) {
+		return;
+	}
+	c->disconnected = true;
+
+	TALLOC_FREE(c->im);
+
+	if (c->recv_op != NULL) {
+		smbd_io_uring_op_cancel(u, c->recv_op);
+		c->recv_op = NULL;
+	}
+	if (c->hdr_op != NULL) {
+		smbd_io_uring_op_cancel(u, c->hdr_op);
+		c->hdr_op = NULL;
+	}
+	if (c->send_op != NULL) {
+		smbd_io_uring_op_cancel(u, c->send_op);
+		c->send_op = NULL;
+	}
+
+	if (c->leftover.valid && !c->feeding) {
+		smbd_io_uring_recycle_buf(u, c->leftover.bid);
+		c->leftover.valid = false;
+	}
+
+	/*
+	 * The kernel references the msghdr and the iovecs
+	 * of the send queue entry, so we can't return before
+	 * the send is cancelled or completed. The splice
+	 * operations hold their own file references.
+	 */
+	if (hdr_op != NULL) {
+		smbd_io_uring_wait(u, hdr_op);
+	}
+	if (send_op != NULL &&
+	    (send_op->type == SMBD_IO_URING_OP_SENDMSG ||
+	     send_op->type == SMBD_IO_URING_OP_SENDFILE_PAD))
+	{
+		smbd_io_uring_wait(u, send_op);
+	}
+
+	if (c->sf.e != NULL) {
+		close(c->sf.fd);
+		c->sf.fd = -1;
+		c->sf.e = NULL;
+	}
+	if (c->sf.pipefd[0] != -1) {
+		close(c->sf.pipefd[0]);
+		close(c->sf.pipefd[1]);
+		c->sf.pipefd[0] = -1;
+		c->sf.pipefd[1] = -1;
+	}
+}
+
+static int smbd_io_uring_conn_destructor(struct smbd_io_uring_conn *c)
+{
+	smbd_io_uring_conn_orphan(c);
+	return 0;
+}
+
+static void smbd_io_uring_conn_terminate(struct smbd_io_uring_conn *c,
+					 NTSTATUS status)
+{
+	struct smbXsrv_connection *xconn = c->xconn;
+
+	smbXsrv_connection_disconnect_transport(xconn, status);
+	smbd_server_connection_terminate(xconn, nt_errstr(status));
+}
+
+static void smbd_io_uring_conn_feed(struct smbd_io_uring_conn *c)
+{
+	struct smbXsrv_connection *xconn = c->xconn;
+	struct smbd_io_uring *u = c->u;
+	NTSTATUS status = NT_STATUS_OK;
+
+	c->feeding = true;
+
+	while (c->leftover.valid && !c->disconnected) {
+		const uint8_t *buf = u->bufs +
+			c->leftover.bid * SMBD_IO_URING_RECV_BUF_SIZE +
+			c->leftover.ofs;
+		size_t consumed = 0;
+
+		status = smbd_smb2_io_uring_incoming(xconn,
+						     buf,
+						     c->leftover.len,
+						     &consumed);
+		c->leftover.ofs += consumed;
+		c->leftover.len -= consumed;
+		if (c->leftover.len == 0) {
+			smbd_io_uring_recycle_buf(u, c->leftover.bid);
+			c->leftover.valid = false;
+		}
+		if (!NT_STATUS_IS_OK(status)) {
+			break;
+		}
+		if (consumed == 0) {
+			/*
+			 * There's no pending request to read into,
+			 * smbd_smb2_request_next_incoming() calls
+			 * smbd_io_uring_conn_recv() once the send queue
+			 * has drained.
+			 */
+			break;
+		}
+	}
+
+	c->feeding = false;
+
+	if (c->disconnected) {
+		if (c->leftover.valid) {
+			smbd_io_uring_recycle_buf(u, c->leftover.bid);
+			c->leftover.valid = false;
+		}
+		return;
+	}
+
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_io_uring_conn_terminate(c, status);
+		return;
+	}
+
+	if (xconn->smb2.request_read_state.req == NULL) {
+		return;
+	}
+
+	status = smbd_io_uring_conn_recv(xconn);
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_io_uring_conn_terminate(c, status);
+		return;
+	}
+}
+
+static void smbd_io_uring_conn_feed_immediate(struct tevent_context *ev,
+					      struct tevent_immediate *im,
+					      void *private_data)
+{
+	struct smbd_io_uring_conn *c = talloc_get_type_abort(
+		private_data, struct smbd_io_uring_conn);
+
+	smbd_io_uring_conn_feed(c);
+}
+
+bool smbd_io_uring_conn_setup(struct smbXsrv_connection *xconn)
+{
+	struct smbd_io_uring *u = NULL;
+	struct smbd_io_uring_conn *c = NULL;
+
+	if (!lp_smb2_io_uring_transport()) {
+		return false;
+	}
+
+	u = smbd_io_uring_get(xconn->client->raw_ev_ctx);
+	if (u == NULL) {
+		return false;
+	}
+
+	c = talloc_zero(xconn, struct smbd_io_uring_conn);
+	if (c == NULL) {
+		return false;
+	}
+	c->u = u;
+	c->xconn = xconn;
+	c->sf.fd = -1;
+	c->sf.pipefd[0] = -1;
+	c->sf.pipefd[1] = -1;
+
+	c->im = tevent_create_immediate(c);
+	if (c->im == NULL) {
+		TALLOC_FREE(c);
+		return false;
+	}
+
+	talloc_set_destructor(c, smbd_io_uring_conn_destructor);
+	xconn->transport.io_uring = c;
+	return true;
+}
+
+NTSTATUS smbd_io_uring_conn_recv(struct smbXsrv_connection *xconn)
+{
+	struct smbd_io_uring_conn *c = xconn->transport.io_uring;
+	struct smbd_io_uring *u = c->u;
+	struct smbd_io_uring_op *op = NULL;
+	struct io_uring_sqe *sqe = NULL;
+
+	if (c->feeding) {
+		/* smbd_io_uring_conn_feed() takes care of it */
+		return NT_STATUS_OK;
+	}
+
+	if (c->leftover.valid) {
+		/*
+		 * We still have bytes from the last receive,
+		 * process them outside of the current call stack.
+		 */
+		tevent_schedule_immediate(c->im,
+					  u->ev,
+					  smbd_io_uring_conn_feed_immediate,
+					  c);
+		return NT_STATUS_OK;
+	}
+
+	if (c->recv_op != NULL) {
+		return NT_STATUS_OK;
+	}
+
+	op = smbd_io_uring_op_create(c, SMBD_IO_URING_OP_RECV);
+	if (op == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	sqe = smbd_io_uring_get_sqe(u);
+	if (sqe == NULL) {
+		TALLOC_FREE(op);
+		return NT_STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	io_uring_prep_recv(sqe,
+			   xconn->transport.sock,
+			   NULL,
+			   SMBD_IO_URING_RECV_BUF_SIZE,
+			   0);
+	sqe->flags |= IOSQE_BUFFER_SELECT;
+	sqe->buf_group = SMBD_IO_URING_RECV_BGID;
+	io_uring_sqe_set_data(sqe, op);
+
+	DLIST_ADD_END(u->pending, op);
+	c->recv_op = op;
+	return NT_STATUS_OK;
+}
+
+bool smbd_io_uring_conn_send_busy(struct smbXsrv_connection *xconn)
+{
+	struct smbd_io_uring_conn *c = xconn->transport.io_uring;
+
+	return c->send_op != NULL || c->sf.e != NULL;
+}
+
+NTSTATUS smbd_io_uring_conn_sendmsg(struct smbXsrv_connection *xconn,
+				    struct msghdr *msg)
+{
+	struct smbd_io_uring_conn *c = xconn->transport.io_uring;
+	struct smbd_io_uring *u = c->u;
+	struct smbd_io_uring_op *op = NULL;
+	struct io_uring_sqe *sqe = NULL;
+	unsigned sendmsg_flags = 0;
+
+	SMB_ASSERT(c->send_op == NULL);
+
+	op = smbd_io_uring_op_create(c, SMBD_IO_URING_OP_SENDMSG);
+	if (op == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	sqe = smbd_io_uring_get_sqe(u);
+	if (sqe == NULL) {
+		TALLOC_FREE(op);
+		return NT_STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+#ifdef MSG_NOSIGNAL
+	sendmsg_flags |= MSG_NOSIGNAL;
+#endif
+
+	io_uring_prep_sendmsg(sqe, xconn->transport.sock, msg, sendmsg_flags);
+	io_uring_sqe_set_data(sqe, op);
+
+	DLIST_ADD_END(u->pending, op);
+	c->send_op = op;
+	return NT_STATUS_OK;
+}
+
+static void smbd_io_uring_sendfile_error(struct smbd_io_uring_conn *c,
+					 int err)
+{
+	/* Only the first error is interesting */
+	if (c->sf.error == 0) {
+		c->sf.error = err;
+	}
+}
+
+static NTSTATUS smbd_io_uring_sendfile_submit(struct smbd_io_uring_conn *c)
+{
+	struct smbd_io_uring *u = c->u;
+	int sock = c->xconn->transport.sock;
+	struct smbd_io_uring_op *op = NULL;
+	struct io_uring_sqe *sqe = NULL;
+	enum smbd_io_uring_op_type type;
+	unsigned sendmsg_flags = 0;
+	size_t len;
+
+#ifdef MSG_NOSIGNAL
+	sendmsg_flags |= MSG_NOSIGNAL;
+#endif
+
+	if (c->sf.in_pipe > 0) {
+		type = SMBD_IO_URING_OP_SENDFILE_OUT;
+	} else if (c->sf.eof) {
+		type = SMBD_IO_URING_OP_SENDFILE_PAD;
+	} else {
+		type = SMBD_IO_URING_OP_SENDFILE_IN;
+	}
+
+	if (type != SMBD_IO_URING_OP_SENDFILE_IN && !c->sf.hdr_sent) {
+		struct smbd_smb2_send_queue *e = c->sf.e;
+
+		/*
+		 * The header goes out in front of the first
+		 * body bytes, MSG_WAITALL makes a short send
+		 * fail the link.
+		 */
+		op = smbd_io_uring_op_create(c, SMBD_IO_URING_OP_SENDFILE_HDR);
+		if (op == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+		sqe = smbd_io_uring_get_sqe(u);
+		if (sqe == NULL) {
+			TALLOC_FREE(op);
+			return NT_STATUS_INSUFFICIENT_RESOURCES;
+		}
+		e->msg = (struct msghdr) {
+			.msg_iov = e->vector,
+			.msg_iovlen = e->count,
+		};
+		io_uring_prep_sendmsg(sqe,
+				      sock,
+				      &e->msg,
+				      sendmsg_flags | MSG_MORE | MSG_WAITALL);
+		sqe->flags |= IOSQE_IO_LINK;
+		io_uring_sqe_set_data(sqe, op);
+		DLIST_ADD_END(u->pending, op);
+		c->hdr_op = op;
+	}
+
+	op = smbd_io_uring_op_create(c, type);
+	if (op == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	sqe = smbd_io_uring_get_sqe(u);
+	if (sqe == NULL) {
+		TALLOC_FREE(op);
+		return NT_STATUS_INSUFFICIENT_RESOURCES;
+	}
+
+	switch (type) {
+	case SMBD_IO_URING_OP_SENDFILE_IN:
+		len = MIN(c->sf.remaining, c->sf.pipe_size);
+		io_uring_prep_splice(sqe,
+				     c->sf.fd,
+				     c->sf.offset,
+				     c->sf.pipefd[1],
+				     -1,
+				     len,
+				     SPLICE_F_MOVE);
+		break;
+	case SMBD_IO_URING_OP_SENDFILE_OUT:
+		io_uring_prep_splice(sqe,
+				     c->sf.pipefd[0],
+				     -1,
+				     sock,
+				     -1,
+				     c->sf.in_pipe,
+				     SPLICE_F_MOVE |
+				     (c->sf.remaining > 0 ? SPLICE_F_MORE : 0));
+		break;
+	default:
+		/*
+		 * The file got truncated, pad the response
+		 * with zeros as sendfile_short_send() does.
+		 */
+		len = MIN(c->sf.remaining, sizeof(smbd_io_uring_zeros));
+		c->sf.pad_iov = (struct iovec) {
+			.iov_base = discard_const_p(uint8_t,
+						    smbd_io_uring_zeros),
+			.iov_len = len,
+		};
+		c->sf.pad_msg = (struct msghdr) {
+			.msg_iov = &c->sf.pad_iov,
+			.msg_iovlen = 1,
+		};
+		io_uring_prep_sendmsg(sqe,
+				      sock,
+				      &c->sf.pad_msg,
+				      sendmsg_flags | MSG_WAITALL);
+		break;
+	}
+
+	io_uring_sqe_set_data(sqe, op);
+	DLIST_ADD_END(u->pending, op);
+	c->send_op = op;
+	return NT_STATUS_OK;
+}
+
+static void smbd_io_uring_sendfile_finish(struct smbd_io_uring_conn *c,
+					  NTSTATUS status)
+{
+	struct smbXsrv_connection *xconn = c->xconn;
+	size_t sent = c->sf.sent;
+
+	close(c->sf.fd);
+	c->sf.fd = -1;
+	c->sf.e = NULL;
+
+	status = smbd_smb2_io_uring_sendfile_done(xconn, status, sent);
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_server_connection_terminate(xconn, nt_errstr(status));
+	}
+}
+
+static void smbd_io_uring_sendfile_done(struct smbd_io_uring_conn *c,
+					struct smbd_io_uring_op *op)
+{
+	int res = op->res;
+	NTSTATUS status;
+
+	switch (op->type) {
+	case SMBD_IO_URING_OP_SENDFILE_IN:
+		if (res <= 0 && !c->sf.hdr_sent) {
+			/*
+			 * Nothing is on the wire yet,
+			 * let the caller use SMB_VFS_SENDFILE().
+			 */
+			c->sf.fallback = true;
+			break;
+		}
+		if (res < 0) {
+			smbd_io_uring_sendfile_error(c, -res);
+			break;
+		}
+		if (res == 0) {
+			c->sf.eof = true;
+			break;
+		}
+		c->sf.in_pipe += res;
+		c->sf.remaining -= res;
+		c->sf.offset += res;
+		break;
+	case SMBD_IO_URING_OP_SENDFILE_HDR:
+		if (res < 0) {
+			smbd_io_uring_sendfile_error(c, -res);
+			break;
+		}
+		if ((size_t)res != c->sf.hdr_len) {
+			smbd_io_uring_sendfile_error(c, EIO);
+			break;
+		}
+		c->sf.hdr_sent = true;
+		c->sf.sent += res;
+		break;
+	case SMBD_IO_URING_OP_SENDFILE_OUT:
+		if (res <= 0) {
+			smbd_io_uring_sendfile_error(c, res < 0 ? -res : EPIPE);
+			break;
+		}
+		c->sf.in_pipe -= res;
+		c->sf.sent += res;
+		break;
+	case SMBD_IO_URING_OP_SENDFILE_PAD:
+		if (res <= 0) {
+			smbd_io_uring_sendfile_error(c, res < 0 ? -res : EPIPE);
+			break;
+		}
+		c->sf.remaining -= res;
+		c->sf.sent += res;
+		break;
+	default:
+		smbd_io_uring_sendfile_error(c, EINVAL);
+		break;
+	}
+
+	if (c->hdr_op != NULL || c->send_op != NULL) {
+		/* wait for the rest of the linked operations */
+		return;
+	}
+
+	if (c->sf.fallback) {
+		smbd_io_uring_sendfile_finish(c, NT_STATUS_NOT_SUPPORTED);
+		return;
+	}
+	if (c->sf.error != 0) {
+		status = map_nt_error_from_unix_common(c->sf.error);
+		smbd_io_uring_sendfile_finish(c, status);
+		return;
+	}
+	if (c->sf.in_pipe == 0 && c->sf.remaining == 0) {
+		smbd_io_uring_sendfile_finish(c, NT_STATUS_OK);
+		return;
+	}
+
+	status = smbd_io_uring_sendfile_submit(c);
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_io_uring_sendfile_finish(c, status);
+		return;
+	}
+}
+
+NTSTATUS smbd_io_uring_conn_sendfile(struct smbXsrv_connection *xconn,
+				     struct smbd_smb2_send_queue *e)
+{
+	struct smbd_io_uring_conn *c = xconn->transport.io_uring;
+	NTSTATUS status;
+	int fd;
+	int ret;
+
+	SMB_ASSERT(c->send_op == NULL);
+	SMB_ASSERT(c->sf.e == NULL);
+
+	if (e->sendfile_fsp == NULL || e->sendfile_body_size == 0) {
+		return NT_STATUS_NOT_SUPPORTED;
+	}
+	fd = fsp_get_io_fd(e->sendfile_fsp);
+	if (fd == -1) {
+		return NT_STATUS_NOT_SUPPORTED;
+	}
+
+	if (c->sf.pipefd[0] == -1) {
+		ret = pipe(c->sf.pipefd);
+		if (ret == -1) {
+			return NT_STATUS_NOT_SUPPORTED;
+		}
+		smb_set_close_on_exec(c->sf.pipefd[0]);
+		smb_set_close_on_exec(c->sf.pipefd[1]);
+
+		c->sf.pipe_size = 0x10000;
+#if defined(F_SETPIPE_SZ) && defined(F_GETPIPE_SZ)
+		/* best effort, limited by /proc/sys/fs/pipe-max-size */
+		(void)fcntl(c->sf.pipefd[1], F_SETPIPE_SZ, 0x100000);
+		ret = fcntl(c->sf.pipefd[1], F_GETPIPE_SZ);
+		if (ret > 0) {
+			c->sf.pipe_size = ret;
+		}
+#endif
+	}
+
+	/*
+	 * The file might be closed before we're done,
+	 * so we need our own reference.
+	 */
+	fd = fcntl(fd, F_DUPFD_CLOEXEC, 0);
+	if (fd == -1) {
+		return NT_STATUS_NOT_SUPPORTED;
+	}
+
+	c->sf.e = e;
+	c->sf.fd = fd;
+	c->sf.offset = e->sendfile_offset;
+	c->sf.remaining = e->sendfile_body_size;
+	c->sf.in_pipe = 0;
+	c->sf.hdr_len = iov_buflen(e->vector, e->count);
+	c->sf.sent = 0;
+	c->sf.hdr_sent = false;
+	c->sf.eof = false;
+	c->sf.fallback = false;
+	c->sf.error = 0;
+
+	status = smbd_io_uring_sendfile_submit(c);
+	if (!NT_STATUS_IS_OK(status)) {
+		close(c->sf.fd);
+		c->sf.fd = -1;
+		c->sf.e = NULL;
+		return status;
+	}
+
+	return NT_STATUS_OK;
+}
+
+void smbd_io_uring_conn_disconnect(struct smbXsrv_connection *xconn)
+{
+	struct smbd_io_uring_conn *c = xconn->transport.io_uring;
+
+	if (c == NULL) {
+		return;
+	}
+
+	/*
+	 * From now on the classic code paths are used,
+	 * they drop everything as the transport is dead.
+	 * The structure itself stays around until the
+	 * connection is freed, as we might be called from
+	 * within smbd_io_uring_conn_feed().
+	 */
+	xconn->transport.io_uring = NULL;
+	smbd_io_uring_conn_orphan(c);
+}
@@ -417,6 +417,17 @@ static void smbd_smb2_request_ioctl_done(struct tevent_req *subreq)
 	}
 }
 
+static bool smbd_smb2_ioctl_cancel(struct tevent_req *req)
+{
+	struct smbd_smb2_ioctl_state *state = tevent_req_data(req,
+					      struct smbd_smb2_ioctl_state);
+
+	if (state->cancel_subreq == NULL) {
+		return false;
+	}
+	return tevent_req_cancel(state->cancel_subreq);
+}
+
 static struct tevent_req *smbd_smb2_ioctl_send(TALLOC_CTX *mem_ctx,
 					       struct tevent_context *ev,
 					       struct smbd_smb2_request *smb2req,
@@ -441,6 +452,7 @@ static struct tevent_req *smbd_smb2_ioctl_send(TALLOC_CTX *mem_ctx,
 	state->in_input = in_input;
 	state->in_max_output = in_max_output;
 	state->out_output = data_blob_null;
+	tevent_req_set_cancel_fn(req, smbd_smb2_ioctl_cancel);
 
 	DEBUG(10, ("smbd_smb2_ioctl: ctl_code[0x%08x] %s, %s\n",
 		   (unsigned)in_ctl_code,
@@ -453,6 +465,14 @@ static struct tevent_req *smbd_smb2_ioctl_send(TALLOC_CTX *mem_ctx,
 	}
 	state->smbreq = smbreq;
 
+	if (fsp != NULL) {
+		/*
+		 * Many of the FSCTLs change the file, it is not worth
+		 * listing the ones that don't.
+		 */
+		fsp_lease_stat_invalidate(fsp);
+	}
+
 	switch (in_ctl_code & IOCTL_DEV_TYPE_MASK) {
 	case FSCTL_DFS:
 		return smb2_ioctl_dfs(in_ctl_code, ev, req, state);
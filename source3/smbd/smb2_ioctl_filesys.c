@@ -431,6 +431,8 @@ static NTSTATUS fsctl_zero_data(TALLOC_CTX *mem_ctx,
 		return status;
 	}
 
+	write_behind_sync(fsp);
+
 	/* allow regardless of whether FS supports sparse or not */
 
 	ndr_ret = ndr_pull_struct_blob(in_input, mem_ctx, &zdata_info,
@@ -634,6 +636,8 @@ static NTSTATUS fsctl_qar(TALLOC_CTX *mem_ctx,
 		return status;
 	}
 
+	write_behind_sync_file_id(fsp->conn->sconn, fsp->file_id);
+
 	ndr_ret = ndr_pull_struct_blob(in_input, mem_ctx, &qar_req,
 		(ndr_pull_flags_fn_t)ndr_pull_fsctl_query_alloced_ranges_req);
 	if (ndr_ret != NDR_ERR_SUCCESS) {
@@ -91,6 +91,7 @@ struct fsctl_srv_copychunk_state {
 	DATA_BLOB token;
 	struct files_struct *src_fsp;
 	struct files_struct *dst_fsp;
+	struct tevent_req *vfs_subreq;
 	enum {
 		COPYCHUNK_OUT_EMPTY = 0,
 		COPYCHUNK_OUT_LIMITS,
@@ -101,6 +102,21 @@ static void fsctl_srv_copychunk_vfs_done(struct tevent_req *subreq);
 
 static NTSTATUS fsctl_srv_copychunk_loop(struct tevent_req *req);
 
+static bool fsctl_srv_copychunk_cancel(struct tevent_req *req)
+{
+	struct fsctl_srv_copychunk_state *state = tevent_req_data(
+		req, struct fsctl_srv_copychunk_state);
+
+	/*
+	 * The VFS request fails with NT_STATUS_CANCELLED, so we don't
+	 * start the next chunk and return what has been written so far.
+	 */
+	if (state->vfs_subreq == NULL) {
+		return false;
+	}
+	return tevent_req_cancel(state->vfs_subreq);
+}
+
 static struct tevent_req *fsctl_srv_copychunk_send(TALLOC_CTX *mem_ctx,
 						   struct tevent_context *ev,
 						   uint32_t ctl_code,
@@ -130,6 +146,12 @@ static struct tevent_req *fsctl_srv_copychunk_send(TALLOC_CTX *mem_ctx,
 		.dst_fsp = dst_fsp,
 	};
 
+	/*
+	 * The source handle is only known to the offload token code, the
+	 * chunks must not miss or overtake buffered writes.
+	 */
+	write_behind_sync_all(dst_fsp->conn->sconn);
+
 	if (in_max_output < sizeof(struct srv_copychunk_rsp)) {
 		DEBUG(3, ("max output %d not large enough to hold copy chunk "
 			  "response %lu\n", (int)in_max_output,
@@ -162,6 +184,8 @@ static struct tevent_req *fsctl_srv_copychunk_send(TALLOC_CTX *mem_ctx,
 	/* any errors from here onwards should carry copychunk response data */
 	state->out_data = COPYCHUNK_OUT_RSP;
 
+	tevent_req_set_cancel_fn(req, fsctl_srv_copychunk_cancel);
+
 	status = fsctl_srv_copychunk_loop(req);
 	if (tevent_req_nterror(req, status)) {
 		return tevent_req_post(req, ev);
@@ -209,6 +233,7 @@ static NTSTATUS fsctl_srv_copychunk_loop(struct tevent_req *req)
 		return NT_STATUS_NO_MEMORY;
 	}
 	tevent_req_set_callback(subreq,	fsctl_srv_copychunk_vfs_done, req);
+	state->vfs_subreq = subreq;
 
 	return NT_STATUS_OK;
 }
@@ -222,6 +247,7 @@ static void fsctl_srv_copychunk_vfs_done(struct tevent_req *subreq)
 	off_t chunk_nwritten;
 	NTSTATUS status;
 
+	state->vfs_subreq = NULL;
 	status = SMB_VFS_OFFLOAD_WRITE_RECV(state->conn, subreq,
 					 &chunk_nwritten);
 	TALLOC_FREE(subreq);
@@ -669,6 +695,7 @@ struct tevent_req *smb2_ioctl_network_fs(uint32_t ctl_code,
 		tevent_req_set_callback(subreq,
 					smb2_ioctl_network_fs_copychunk_done,
 					req);
+		state->cancel_subreq = subreq;
 		return req;
 		break;
 	case FSCTL_QUERY_NETWORK_INTERFACE_INFO:
@@ -770,6 +797,7 @@ static void smb2_ioctl_network_fs_copychunk_done(struct tevent_req *subreq)
 	NTSTATUS status;
 	bool pack_rsp = false;
 
+	ioctl_state->cancel_subreq = NULL;
 	ZERO_STRUCT(cc_rsp);
 	status = fsctl_srv_copychunk_recv(subreq, &cc_rsp, &pack_rsp);
 	TALLOC_FREE(subreq);
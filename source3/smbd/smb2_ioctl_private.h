@@ -30,6 +30,8 @@ struct smbd_smb2_ioctl_state {
 	DATA_BLOB out_output;
 	uint8_t body_padding;
 	bool disconnect;
+	/* async subrequest to forward an SMB2 cancel to, if any */
+	struct tevent_req *cancel_subreq;
 };
 
 struct tevent_req *smb2_ioctl_dfs(uint32_t,
@@ -93,6 +93,9 @@ NTSTATUS set_sd(files_struct *fsp, struct security_descriptor *psd,
 		return NT_STATUS_OK;
 	}
 
+	/* the ACL can change the mode and the ctime */
+	fsp_lease_stat_invalidate(fsp);
+
 	refuse = refuse_symlink_fsp(fsp);
 	if (refuse) {
 		DBG_DEBUG("ACL set on symlink %s denied.\n",
@@ -170,6 +173,8 @@ NTSTATUS set_sd(files_struct *fsp, struct security_descriptor *psd,
 
 	TALLOC_FREE(psd);
 
+	access_check_cache_flush(fsp->conn);
+
 	return status;
 }
 
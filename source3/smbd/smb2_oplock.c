@@ -883,6 +883,12 @@ static void process_oplock_break_message(struct messaging_context *msg_ctx,
 		return;
 	}
 
+	/*
+	 * The opener that wants the break must see data we still buffer
+	 * for our client.
+	 */
+	write_behind_sync_file_id(sconn, fsp->file_id);
+
 	break_from = fsp_lease_type(fsp);
 
 	if (fsp->oplock_type != LEASE_OPLOCK) {
@@ -1213,6 +1213,89 @@ static int smbXsrv_connection_destructor(struct smbXsrv_connection *xconn)
 	return 0;
 }
 
+enum smbd_cpu_affinity {
+	SMBD_CPU_AFFINITY_NONE = 0,
+	SMBD_CPU_AFFINITY_CPU,
+	SMBD_CPU_AFFINITY_NODE,
+};
+
+static const struct enum_list enum_smbd_cpu_affinity[] = {
+	{ SMBD_CPU_AFFINITY_NONE, "no" },
+	{ SMBD_CPU_AFFINITY_CPU, "cpu" },
+	{ SMBD_CPU_AFFINITY_NODE, "node" },
+	{ -1, NULL }
+};
+
+/*
+ * With "smbd:cpu affinity = cpu" or "= node" the process is bound to
+ * the CPU, or to the NUMA node of the CPU, that received the first
+ * packets of its first connection. With RSS that is the CPU that
+ * services the NIC queue of the connection, so the process memory
+ * is allocated on the node the packets arrive on.
+ */
+static void smbd_connection_cpu_affinity(struct smbXsrv_connection *xconn)
+{
+	struct smbXsrv_client *client = xconn->client;
+	int cpu = sys_socket_incoming_cpu(xconn->transport.sock);
+	int node = -1;
+	int mode;
+	bool ok;
+
+	xconn->transport.incoming_cpu = cpu;
+	xconn->transport.cpu_affinity = "none";
+
+	if (client->connections != NULL) {
+		/* Further channels are served by the same process */
+		xconn->transport.cpu_affinity =
+			client->connections->transport.cpu_affinity;
+		return;
+	}
+
+	mode = lp_parm_enum(GLOBAL_SECTION_SNUM,
+			    "smbd",
+			    "cpu affinity",
+			    enum_smbd_cpu_affinity,
+			    SMBD_CPU_AFFINITY_NONE);
+	if (mode != SMBD_CPU_AFFINITY_CPU && mode != SMBD_CPU_AFFINITY_NODE) {
+		return;
+	}
+	if (cpu == -1) {
+		DBG_INFO("No incoming CPU for the connection\n");
+		return;
+	}
+
+	if (mode == SMBD_CPU_AFFINITY_NODE) {
+		node = sys_cpu_numa_node(cpu);
+		if (node == -1) {
+			DBG_INFO("No NUMA node for CPU %d\n", cpu);
+			return;
+		}
+	}
+
+	ok = sys_set_cpu_affinity(cpu, node);
+	if (!ok) {
+		DBG_WARNING("Unable to bind to %s %d: %s\n",
+			    (node != -1) ? "node" : "cpu",
+			    (node != -1) ? node : cpu,
+			    strerror(errno));
+		return;
+	}
+
+	if (node != -1) {
+		xconn->transport.cpu_affinity =
+			talloc_asprintf(client, "node %d", node);
+	} else {
+		xconn->transport.cpu_affinity =
+			talloc_asprintf(client, "cpu %d", cpu);
+	}
+	if (xconn->transport.cpu_affinity == NULL) {
+		xconn->transport.cpu_affinity = "none";
+	}
+
+	DBG_INFO("Bound to %s, incoming CPU %d\n",
+		 xconn->transport.cpu_affinity, cpu);
+}
+
 NTSTATUS smbd_add_connection(struct smbXsrv_client *client, int sock_fd,
 			     enum smb_transport_type transport_type,
 			     NTTIME now, struct smbXsrv_connection **_xconn)
@@ -1378,6 +1461,8 @@ NTSTATUS smbd_add_connection(struct smbXsrv_client *client, int sock_fd,
 		   tsocket_address_string(remote_address, talloc_tos()),
 		   tsocket_address_string(local_address, talloc_tos())));
 
+	smbd_connection_cpu_affinity(xconn);
+
 	if (lp_clustering()) {
 		/*
 		 * We need to tell ctdb about our client's TCP
@@ -1882,6 +1967,98 @@ static void smbd_tevent_trace_callback_profile(enum tevent_trace_point point,
 	errno = 0;
 }
 
+/*
+ * Bind the aio threads to "smbd:aio thread cpus", a list of
+ * CPU numbers or ranges like "0-15 32-47".
+ */
+static void smbd_set_aio_thread_cpus(struct smbd_server_connection *sconn)
+{
+	const char **list = NULL;
+	unsigned *cpus = NULL;
+	size_t num_cpus = 0;
+	size_t i;
+	int ret;
+
+	list = lp_parm_string_list(-1, "smbd", "aio thread cpus", NULL);
+	if (list == NULL) {
+		return;
+	}
+
+	for (i = 0; list[i] != NULL; i++) {
+		unsigned long first, last, cpu;
+		char *end = NULL;
+
+		first = strtoul(list[i], &end, 10);
+		last = first;
+		if (*end == '-') {
+			last = strtoul(end + 1, &end, 10);
+		}
+		if ((end == list[i]) || (*end != '\0') || (last < first) ||
+		    (last - first > 4096)) {
+			DBG_WARNING("Invalid aio thread cpus entry [%s]\n",
+				    list[i]);
+			TALLOC_FREE(cpus);
+			return;
+		}
+
+		for (cpu = first; cpu <= last; cpu++) {
+			cpus = talloc_realloc(sconn, cpus, unsigned,
+					      num_cpus + 1);
+			if (cpus == NULL) {
+				return;
+			}
+			cpus[num_cpus++] = cpu;
+		}
+	}
+
+	ret = pthreadpool_tevent_set_cpus(sconn->pool, cpus, num_cpus);
+	if (ret != 0) {
+		DBG_WARNING("pthreadpool_tevent_set_cpus() failed: %s\n",
+			    strerror(ret));
+	}
+	TALLOC_FREE(cpus);
+}
+
+/*
+ * Keep threads of the aio pool free for the classes interactive
+ * requests depend on, so that a flood of large reads or fsyncs can't
+ * delay them. "smbd:aio reserved interactive threads" defaults to 1.
+ */
+static void smbd_set_aio_reserved_threads(struct smbd_server_connection *sconn)
+{
+	static const struct {
+		enum pthreadpool_prio prio;
+		const char *option;
+		int def;
+	} reserved[] = {
+		{ PTHREADPOOL_PRIO_INTERACTIVE,
+		  "aio reserved interactive threads", 1 },
+		{ PTHREADPOOL_PRIO_METADATA,
+		  "aio reserved metadata threads", 0 },
+		{ PTHREADPOOL_PRIO_BULK,
+		  "aio reserved bulk threads", 0 },
+	};
+	size_t i;
+
+	for (i = 0; i < ARRAY_SIZE(reserved); i++) {
+		int num;
+		int ret;
+
+		num = lp_parm_int(-1, "smbd", reserved[i].option,
+				  reserved[i].def);
+		if (num < 0) {
+			num = 0;
+		}
+
+		ret = pthreadpool_tevent_set_reserved_threads(
+			sconn->pool, reserved[i].prio, num);
+		if (ret != 0) {
+			DBG_WARNING("pthreadpool_tevent_set_reserved_threads() "
+				    "failed: %s\n", strerror(ret));
+		}
+	}
+}
+
 /****************************************************************************
  Process commands from the client
 ****************************************************************************/
@@ -1944,6 +2121,8 @@ void smbd_process(struct tevent_context *ev_ctx,
 	if (ret != 0) {
 		exit_server("pthreadpool_tevent_init() failed.");
 	}
+	smbd_set_aio_thread_cpus(sconn);
+	smbd_set_aio_reserved_threads(sconn);
 
 	if (!interactive) {
 		smbd_setup_sig_term_handler(sconn);
@@ -2098,6 +2277,10 @@ void smbd_process(struct tevent_context *ev_ctx,
 			   MSG_SMB_KILL_CLIENT_IP,
 			   msg_kill_client_ip);
 
+	messaging_register(sconn->msg_ctx, sconn,
+			   MSG_SMB_TELL_QOS_STATUS,
+			   smbd_smb2_qos_status_msg);
+
 	messaging_deregister(sconn->msg_ctx, MSG_SMB_TELL_NUM_CHILDREN, NULL);
 
 	/*
@@ -0,0 +1,820 @@
+/*
+   Unix SMB/CIFS implementation.
+   SMB2 READ/WRITE scheduling between the tree connects of a client
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Every tree connect of the client is a flow. READ and WRITE
+ * requests of a flow are admitted in order, between flows they are
+ * ordered by start-time fair queuing: a request gets the start tag
+ * max(vtime, finish tag of the previous request of its flow) and a
+ * finish tag of start + cost * 100 / "smb2 qos weight", the request
+ * with the smallest start tag is admitted next. vtime is the start
+ * tag of the last admitted request. The cost of a request is the
+ * number of bytes it transfers, so a flow streaming 8MB reads does
+ * not delay a flow doing small reads by more than one of its
+ * requests.
+ *
+ * "smb2 qos max outstanding" limits the number of admitted requests
+ * of the connection, that's the point where the queues build up.
+ * On top of that requests pass token buckets, each holding at most
+ * one second worth of tokens:
+ *
+ * - every flow has one for "smb2 qos iops limit" and "smb2 qos
+ *   bandwidth limit" and one each for "smb2 qos read bandwidth
+ *   limit" and "smb2 qos write bandwidth limit",
+ * - every session has one for "smb2 qos user iops limit" and "smb2
+ *   qos user bandwidth limit",
+ * - the connection, that is the client, has one for "smb2 qos client
+ *   iops limit" and "smb2 qos client bandwidth limit".
+ *
+ * A request is admitted as long as none of its buckets is in deficit,
+ * the deficit of a large request is paid back before the next one
+ * using the same bucket goes out.
+ *
+ * Only single, non-compound requests are scheduled, everything else
+ * is dispatched immediately. An admitted request keeps its slot until
+ * its final response is queued, see smbd_smb2_qos_request_done().
+ */
+
+#include "includes.h"
+#include "smbd/smbd.h"
+#include "smbd/globals.h"
+#include "../libcli/smb/smb_common.h"
+#include "lib/util/dlinklist.h"
+#include "messages.h"
+#include "../lib/tsocket/tsocket.h"
+
+#undef DBGC_CLASS
+#define DBGC_CLASS DBGC_SMB2
+
+#define SMBD_SMB2_QOS_MIN_COST 4096
+#define SMBD_SMB2_QOS_DEFAULT_WEIGHT 100
+/* Don't refill more than a minute at once, avoids overflows */
+#define SMBD_SMB2_QOS_MAX_REFILL_USEC (60 * 1000000LL)
+
+struct smbd_smb2_qos_ticket;
+
+struct smbd_smb2_qos_bucket {
+	/* 0 means unlimited */
+	int64_t iops_limit;
+	int64_t bw_limit;
+	/* in millionths of a request */
+	int64_t iops_tokens;
+	/* in bytes */
+	int64_t bw_tokens;
+	struct timeval last_refill;
+	/* requests that had to wait for this bucket */
+	uint64_t num_throttled;
+};
+
+struct smbd_smb2_qos_flow {
+	struct smbd_smb2_qos_flow *prev, *next;
+	struct smbd_smb2_qos *qos;
+	struct smbXsrv_tcon *tcon;
+
+	uint32_t weight;
+	uint64_t finish_tag;
+
+	struct smbd_smb2_qos_bucket bucket;
+	struct smbd_smb2_qos_bucket read_bucket;
+	struct smbd_smb2_qos_bucket write_bucket;
+
+	struct smbd_smb2_qos_ticket *queue;
+};
+
+struct smbd_smb2_qos_user {
+	struct smbd_smb2_qos_user *prev, *next;
+	struct smbd_smb2_qos *qos;
+	struct smbXsrv_session *session;
+
+	struct smbd_smb2_qos_bucket bucket;
+};
+
+struct smbd_smb2_qos_ticket {
+	struct smbd_smb2_qos_ticket *prev, *next;
+	struct smbd_smb2_qos *qos;
+	struct smbd_smb2_qos_flow *flow;
+	struct smbd_smb2_qos_user *user;
+	struct smbd_smb2_request *req;
+	struct tevent_immediate *im;
+
+	uint16_t opcode;
+	uint64_t start_tag;
+	uint64_t cost;
+	bool queued;
+
+	SMBPROFILE_BASIC_ASYNC_STATE(wait);
+};
+
+struct smbd_smb2_qos {
+	struct smbd_server_connection *sconn;
+	struct smbd_smb2_qos_flow *flows;
+	struct smbd_smb2_qos_user *users;
+	struct smbd_smb2_qos_bucket client_bucket;
+	/* admitted requests */
+	struct smbd_smb2_qos_ticket *tickets;
+	uint32_t num_outstanding;
+	uint32_t num_queued;
+	uint32_t max_outstanding;
+	uint64_t vtime;
+	struct tevent_timer *te;
+};
+
+static void smbd_smb2_qos_run(struct smbd_smb2_qos *qos);
+
+static int smbd_smb2_qos_destructor(struct smbd_smb2_qos *qos)
+{
+	struct smbd_smb2_qos_flow *flow = NULL;
+	struct smbd_smb2_qos_user *user = NULL;
+	struct smbd_smb2_qos_ticket *t = NULL;
+
+	for (flow = qos->flows; flow != NULL; flow = flow->next) {
+		flow->qos = NULL;
+		for (t = flow->queue; t != NULL; t = t->next) {
+			t->qos = NULL;
+		}
+	}
+	for (user = qos->users; user != NULL; user = user->next) {
+		user->qos = NULL;
+	}
+	for (t = qos->tickets; t != NULL; t = t->next) {
+		t->qos = NULL;
+	}
+	qos->sconn->smb2_qos = NULL;
+	return 0;
+}
+
+static struct smbd_smb2_qos *smbd_smb2_qos_get(
+	struct smbd_server_connection *sconn)
+{
+	struct smbd_smb2_qos *qos = sconn->smb2_qos;
+
+	if (qos != NULL) {
+		return qos;
+	}
+
+	qos = talloc_zero(sconn, struct smbd_smb2_qos);
+	if (qos == NULL) {
+		return NULL;
+	}
+	qos->sconn = sconn;
+	talloc_set_destructor(qos, smbd_smb2_qos_destructor);
+
+	sconn->smb2_qos = qos;
+	return qos;
+}
+
+static void smbd_smb2_qos_dequeue(struct smbd_smb2_qos_ticket *t)
+{
+	if (!t->queued) {
+		return;
+	}
+	if (t->flow != NULL) {
+		DLIST_REMOVE(t->flow->queue, t);
+	}
+	if (t->qos != NULL) {
+		t->qos->num_queued -= 1;
+	}
+	t->queued = false;
+	SMBPROFILE_COUNT_INCREMENT(smb2_qos_queue_depth, profile_p, -1);
+	SMBPROFILE_BASIC_ASYNC_END(t->wait);
+}
+
+/*
+ * Hand a queued request back to smbd_smb2_request_dispatch(), the
+ * slot is accounted for right away.
+ */
+static void smbd_smb2_qos_admit_queued(struct smbd_smb2_qos_ticket *t)
+{
+	struct smbd_smb2_request *req = t->req;
+
+	smbd_smb2_qos_dequeue(t);
+
+	if (t->qos != NULL) {
+		t->qos->num_outstanding += 1;
+		t->qos->vtime = MAX(t->qos->vtime, t->start_tag);
+		DLIST_ADD(t->qos->tickets, t);
+	}
+
+	/*
+	 * smbd_smb2_request_dispatch() will redo the impersonation.
+	 * So we use req->xconn->client->raw_ev_ctx instead
+	 * of req->ev_ctx here.
+	 */
+	tevent_schedule_immediate(t->im,
+				  req->xconn->client->raw_ev_ctx,
+				  smbd_smb2_request_dispatch_immediate,
+				  req);
+}
+
+static int smbd_smb2_qos_flow_destructor(struct smbd_smb2_qos_flow *flow)
+{
+	struct smbd_smb2_qos_ticket *t = NULL;
+	struct smbd_smb2_qos_ticket *next = NULL;
+	struct smbd_smb2_qos *qos = flow->qos;
+
+	/*
+	 * The tree connect is gone, let the queued requests fail in
+	 * smbd_smb2_request_check_tcon().
+	 */
+	for (t = flow->queue; t != NULL; t = next) {
+		next = t->next;
+		smbd_smb2_qos_admit_queued(t);
+		t->flow = NULL;
+	}
+
+	if (qos == NULL) {
+		return 0;
+	}
+	DLIST_REMOVE(qos->flows, flow);
+
+	/* Also check for remaining tickets */
+	for (t = qos->tickets; t != NULL; t = t->next) {
+		if (t->flow == flow) {
+			t->flow = NULL;
+		}
+	}
+	return 0;
+}
+
+static struct smbd_smb2_qos_flow *smbd_smb2_qos_flow_get(
+	struct smbd_smb2_qos *qos,
+	struct smbXsrv_tcon *tcon)
+{
+	struct smbd_smb2_qos_flow *flow = NULL;
+
+	for (flow = qos->flows; flow != NULL; flow = flow->next) {
+		if (flow->tcon == tcon) {
+			return flow;
+		}
+	}
+
+	/*
+	 * The flow goes away with the tree connect, this way the token
+	 * buckets survive idle periods between requests.
+	 */
+	flow = talloc(tcon, struct smbd_smb2_qos_flow);
+	if (flow == NULL) {
+		return NULL;
+	}
+	*flow = (struct smbd_smb2_qos_flow) {
+		.qos = qos,
+		.tcon = tcon,
+		.weight = SMBD_SMB2_QOS_DEFAULT_WEIGHT,
+		.finish_tag = qos->vtime,
+	};
+	talloc_set_destructor(flow, smbd_smb2_qos_flow_destructor);
+
+	DLIST_ADD_END(qos->flows, flow);
+	return flow;
+}
+
+static int smbd_smb2_qos_user_destructor(struct smbd_smb2_qos_user *user)
+{
+	struct smbd_smb2_qos *qos = user->qos;
+	struct smbd_smb2_qos_flow *flow = NULL;
+	struct smbd_smb2_qos_ticket *t = NULL;
+
+	if (qos == NULL) {
+		return 0;
+	}
+	DLIST_REMOVE(qos->users, user);
+
+	for (flow = qos->flows; flow != NULL; flow = flow->next) {
+		for (t = flow->queue; t != NULL; t = t->next) {
+			if (t->user == user) {
+				t->user = NULL;
+			}
+		}
+	}
+	for (t = qos->tickets; t != NULL; t = t->next) {
+		if (t->user == user) {
+			t->user = NULL;
+		}
+	}
+	return 0;
+}
+
+static struct smbd_smb2_qos_user *smbd_smb2_qos_user_get(
+	struct smbd_smb2_qos *qos,
+	struct smbXsrv_session *session)
+{
+	struct smbd_smb2_qos_user *user = NULL;
+
+	for (user = qos->users; user != NULL; user = user->next) {
+		if (user->session == session) {
+			return user;
+		}
+	}
+
+	/* Like the flows, this goes away with the session */
+	user = talloc_zero(session, struct smbd_smb2_qos_user);
+	if (user == NULL) {
+		return NULL;
+	}
+	user->qos = qos;
+	user->session = session;
+	talloc_set_destructor(user, smbd_smb2_qos_user_destructor);
+
+	DLIST_ADD_END(qos->users, user);
+	return user;
+}
+
+static void smbd_smb2_qos_bucket_set(struct smbd_smb2_qos_bucket *b,
+				     int iops_limit,
+				     int64_t bw_limit)
+{
+	b->iops_limit = MAX(iops_limit, 0);
+	b->bw_limit = MAX(bw_limit, 0);
+}
+
+static void smbd_smb2_qos_bucket_refill(struct smbd_smb2_qos_bucket *b,
+					struct timeval now)
+{
+	int64_t elapsed;
+
+	if (timeval_is_zero(&b->last_refill)) {
+		b->iops_tokens = b->iops_limit * 1000000;
+		b->bw_tokens = b->bw_limit;
+		b->last_refill = now;
+		return;
+	}
+
+	elapsed = usec_time_diff(&now, &b->last_refill);
+	if (elapsed <= 0) {
+		return;
+	}
+	elapsed = MIN(elapsed, SMBD_SMB2_QOS_MAX_REFILL_USEC);
+	b->last_refill = now;
+
+	b->iops_tokens = MIN(b->iops_tokens + elapsed * b->iops_limit,
+			     b->iops_limit * 1000000);
+	b->bw_tokens = MIN(b->bw_tokens + elapsed * b->bw_limit / 1000000,
+			   b->bw_limit);
+}
+
+/*
+ * Returns 0 if the bucket allows the next request or the number of
+ * microseconds until it is out of deficit.
+ */
+static int64_t smbd_smb2_qos_bucket_wait(const struct smbd_smb2_qos_bucket *b)
+{
+	int64_t wait = 0;
+
+	if ((b->iops_limit != 0) && (b->iops_tokens < 0)) {
+		wait = MAX(wait, (-b->iops_tokens + b->iops_limit - 1) /
+				 b->iops_limit);
+	}
+	if ((b->bw_limit != 0) && (b->bw_tokens < 0)) {
+		wait = MAX(wait, (-b->bw_tokens * 1000000 +
+				  b->bw_limit - 1) / b->bw_limit);
+	}
+	return wait;
+}
+
+static void smbd_smb2_qos_bucket_consume(struct smbd_smb2_qos_bucket *b,
+					 uint64_t cost)
+{
+	if (b->iops_limit != 0) {
+		b->iops_tokens -= 1000000;
+	}
+	if (b->bw_limit != 0) {
+		b->bw_tokens -= cost;
+	}
+}
+
+/*
+ * Collect the buckets a ticket has to pass
+ */
+static size_t smbd_smb2_qos_ticket_buckets(
+	struct smbd_smb2_qos_ticket *t,
+	struct smbd_smb2_qos_bucket *buckets[4])
+{
+	size_t n = 0;
+
+	if (t->flow != NULL) {
+		buckets[n++] = &t->flow->bucket;
+		buckets[n++] = (t->opcode == SMB2_OP_READ) ?
+			&t->flow->read_bucket : &t->flow->write_bucket;
+	}
+	if (t->user != NULL) {
+		buckets[n++] = &t->user->bucket;
+	}
+	if (t->qos != NULL) {
+		buckets[n++] = &t->qos->client_bucket;
+	}
+	return n;
+}
+
+static int64_t smbd_smb2_qos_ticket_wait(struct smbd_smb2_qos_ticket *t,
+					 struct timeval now,
+					 bool count_throttled)
+{
+	struct smbd_smb2_qos_bucket *buckets[4];
+	int64_t wait = 0;
+	size_t i, n;
+
+	n = smbd_smb2_qos_ticket_buckets(t, buckets);
+	for (i = 0; i < n; i++) {
+		int64_t w;
+
+		smbd_smb2_qos_bucket_refill(buckets[i], now);
+		w = smbd_smb2_qos_bucket_wait(buckets[i]);
+		if ((w != 0) && count_throttled) {
+			buckets[i]->num_throttled += 1;
+		}
+		wait = MAX(wait, w);
+	}
+	return wait;
+}
+
+static void smbd_smb2_qos_ticket_consume(struct smbd_smb2_qos_ticket *t)
+{
+	struct smbd_smb2_qos_bucket *buckets[4];
+	size_t i, n;
+
+	n = smbd_smb2_qos_ticket_buckets(t, buckets);
+	for (i = 0; i < n; i++) {
+		smbd_smb2_qos_bucket_consume(buckets[i], t->cost);
+	}
+}
+
+static void smbd_smb2_qos_timer(struct tevent_context *ev,
+				struct tevent_timer *te,
+				struct timeval current_time,
+				void *private_data)
+{
+	struct smbd_smb2_qos *qos = talloc_get_type_abort(
+		private_data, struct smbd_smb2_qos);
+
+	TALLOC_FREE(qos->te);
+	smbd_smb2_qos_run(qos);
+}
+
+/*
+ * Admit queued requests as long as slots are available
+ */
+static void smbd_smb2_qos_run(struct smbd_smb2_qos *qos)
+{
+	struct timeval now = timeval_current();
+	int64_t min_wait = INT64_MAX;
+
+	while ((qos->num_queued > 0) &&
+	       ((qos->max_outstanding == 0) ||
+		(qos->num_outstanding < qos->max_outstanding)))
+	{
+		struct smbd_smb2_qos_flow *flow = NULL;
+		struct smbd_smb2_qos_ticket *best = NULL;
+
+		for (flow = qos->flows; flow != NULL; flow = flow->next) {
+			struct smbd_smb2_qos_ticket *head = flow->queue;
+			int64_t wait;
+
+			if (head == NULL) {
+				continue;
+			}
+
+			wait = smbd_smb2_qos_ticket_wait(head, now, false);
+			if (wait != 0) {
+				min_wait = MIN(min_wait, wait);
+				continue;
+			}
+
+			if ((best == NULL) ||
+			    (head->start_tag < best->start_tag)) {
+				best = head;
+			}
+		}
+
+		if (best == NULL) {
+			break;
+		}
+
+		smbd_smb2_qos_ticket_consume(best);
+		smbd_smb2_qos_admit_queued(best);
+	}
+
+	if ((qos->num_queued == 0) || (min_wait == INT64_MAX)) {
+		return;
+	}
+
+	TALLOC_FREE(qos->te);
+	qos->te = tevent_add_timer(qos->sconn->ev_ctx,
+				   qos,
+				   timeval_current_ofs_usec(min_wait),
+				   smbd_smb2_qos_timer,
+				   qos);
+	if (qos->te == NULL) {
+		DBG_ERR("tevent_add_timer failed\n");
+	}
+}
+
+static int smbd_smb2_qos_ticket_destructor(struct smbd_smb2_qos_ticket *t)
+{
+	struct smbd_smb2_qos *qos = t->qos;
+
+	if (t->queued) {
+		smbd_smb2_qos_dequeue(t);
+		return 0;
+	}
+
+	if (qos == NULL) {
+		return 0;
+	}
+
+	DLIST_REMOVE(qos->tickets, t);
+	qos->num_outstanding -= 1;
+	smbd_smb2_qos_run(qos);
+	return 0;
+}
+
+bool smbd_smb2_qos_admit(struct smbd_smb2_request *req, uint16_t opcode)
+{
+	struct smbd_smb2_qos *qos = NULL;
+	struct smbd_smb2_qos_flow *flow = NULL;
+	struct smbd_smb2_qos_user *user = NULL;
+	struct smbd_smb2_qos_ticket *t = NULL;
+	const uint8_t *body = NULL;
+	int max_outstanding;
+	int iops_limit;
+	int bw_limit;
+	int read_bw_limit;
+	int write_bw_limit;
+	int user_iops_limit;
+	int user_bw_limit;
+	int client_iops_limit;
+	int client_bw_limit;
+	int64_t wait;
+	int weight;
+	int snum;
+
+	if (req->qos != NULL) {
+		/*
+		 * This request came back from the queue via
+		 * smbd_smb2_qos_admit_queued()
+		 */
+		return true;
+	}
+
+	if ((opcode != SMB2_OP_READ) && (opcode != SMB2_OP_WRITE)) {
+		return true;
+	}
+	if ((req->tcon == NULL) || (req->tcon->compat == NULL)) {
+		return true;
+	}
+	if (req->in.vector_count != 1 + SMBD_SMB2_NUM_IOV_PER_REQ) {
+		/* Don't split compound chains */
+		return true;
+	}
+
+	snum = SNUM(req->tcon->compat);
+	max_outstanding = lp_smb2_qos_max_outstanding();
+	iops_limit = lp_smb2_qos_iops_limit(snum);
+	bw_limit = lp_smb2_qos_bandwidth_limit(snum);
+	read_bw_limit = lp_smb2_qos_read_bandwidth_limit(snum);
+	write_bw_limit = lp_smb2_qos_write_bandwidth_limit(snum);
+	user_iops_limit = lp_smb2_qos_user_iops_limit();
+	user_bw_limit = lp_smb2_qos_user_bandwidth_limit();
+	client_iops_limit = lp_smb2_qos_client_iops_limit();
+	client_bw_limit = lp_smb2_qos_client_bandwidth_limit();
+
+	if ((max_outstanding <= 0) && (iops_limit <= 0) && (bw_limit <= 0) &&
+	    (read_bw_limit <= 0) && (write_bw_limit <= 0) &&
+	    (user_iops_limit <= 0) && (user_bw_limit <= 0) &&
+	    (client_iops_limit <= 0) && (client_bw_limit <= 0)) {
+		return true;
+	}
+
+	qos = smbd_smb2_qos_get(req->sconn);
+	if (qos == NULL) {
+		return true;
+	}
+	qos->max_outstanding = MAX(max_outstanding, 0);
+
+	flow = smbd_smb2_qos_flow_get(qos, req->tcon);
+	if (flow == NULL) {
+		return true;
+	}
+	weight = lp_smb2_qos_weight(snum);
+	flow->weight = MAX(weight, 1);
+	smbd_smb2_qos_bucket_set(&flow->bucket, iops_limit, bw_limit);
+	smbd_smb2_qos_bucket_set(&flow->read_bucket, 0, read_bw_limit);
+	smbd_smb2_qos_bucket_set(&flow->write_bucket, 0, write_bw_limit);
+	smbd_smb2_qos_bucket_set(&qos->client_bucket,
+				 client_iops_limit,
+				 client_bw_limit);
+
+	if ((req->session != NULL) &&
+	    ((user_iops_limit > 0) || (user_bw_limit > 0))) {
+		user = smbd_smb2_qos_user_get(qos, req->session);
+		if (user != NULL) {
+			smbd_smb2_qos_bucket_set(&user->bucket,
+						 user_iops_limit,
+						 user_bw_limit);
+		}
+	}
+
+	t = talloc(req, struct smbd_smb2_qos_ticket);
+	if (t == NULL) {
+		return true;
+	}
+	*t = (struct smbd_smb2_qos_ticket) {
+		.qos = qos,
+		.flow = flow,
+		.user = user,
+		.req = req,
+		.opcode = opcode,
+	};
+
+	/*
+	 * smbd_smb2_request_dispatch() already checked the body is
+	 * large enough to hold the file id at 0x10, the length is at
+	 * 0x04 for both READ and WRITE.
+	 */
+	body = SMBD_SMB2_IN_BODY_PTR(req);
+	t->cost = MAX(IVAL(body, 0x04), SMBD_SMB2_QOS_MIN_COST);
+
+	t->start_tag = MAX(qos->vtime, flow->finish_tag);
+	flow->finish_tag = t->start_tag +
+		t->cost * SMBD_SMB2_QOS_DEFAULT_WEIGHT / flow->weight;
+
+	wait = smbd_smb2_qos_ticket_wait(t, timeval_current(), true);
+
+	if ((qos->num_queued == 0) &&
+	    ((qos->max_outstanding == 0) ||
+	     (qos->num_outstanding < qos->max_outstanding)) &&
+	    (wait == 0))
+	{
+		smbd_smb2_qos_ticket_consume(t);
+		qos->num_outstanding += 1;
+		qos->vtime = MAX(qos->vtime, t->start_tag);
+		DLIST_ADD(qos->tickets, t);
+		talloc_set_destructor(t, smbd_smb2_qos_ticket_destructor);
+		req->qos = t;
+		return true;
+	}
+
+	t->im = tevent_create_immediate(t);
+	if (t->im == NULL) {
+		TALLOC_FREE(t);
+		return true;
+	}
+
+	DLIST_ADD_END(flow->queue, t);
+	t->queued = true;
+	qos->num_queued += 1;
+	talloc_set_destructor(t, smbd_smb2_qos_ticket_destructor);
+	req->qos = t;
+
+	SMBPROFILE_COUNT_INCREMENT(smb2_qos_queue_depth, profile_p, 1);
+	SMBPROFILE_BASIC_ASYNC_START(smb2_qos_wait, profile_p, t->wait);
+
+	DBG_DEBUG("queued %s of %"PRIu64" bytes on tcon %"PRIu32", "
+		  "%"PRIu32" queued, %"PRIu32" outstanding\n",
+		  smb2_opcode_name(opcode),
+		  t->cost,
+		  req->tcon->global->tcon_wire_id,
+		  qos->num_queued,
+		  qos->num_outstanding);
+
+	smbd_smb2_qos_run(qos);
+	return false;
+}
+
+void smbd_smb2_qos_request_done(struct smbd_smb2_request *req)
+{
+	TALLOC_FREE(req->qos);
+}
+
+static void smbd_smb2_qos_bucket_status(char **pstr,
+					const char *prefix,
+					struct smbd_smb2_qos_bucket *b,
+					struct timeval now)
+{
+	if ((b->iops_limit == 0) && (b->bw_limit == 0)) {
+		return;
+	}
+
+	smbd_smb2_qos_bucket_refill(b, now);
+
+	talloc_asprintf_addbuf(pstr, "%s", prefix);
+	if (b->iops_limit != 0) {
+		talloc_asprintf_addbuf(pstr,
+				       " iops %"PRId64"/%"PRId64,
+				       b->iops_tokens / 1000000,
+				       b->iops_limit);
+	}
+	if (b->bw_limit != 0) {
+		talloc_asprintf_addbuf(pstr,
+				       " bytes %"PRId64"/%"PRId64,
+				       b->bw_tokens,
+				       b->bw_limit);
+	}
+	talloc_asprintf_addbuf(pstr,
+			       " throttled %"PRIu64"\n",
+			       b->num_throttled);
+}
+
+/*
+ * Reply to MSG_SMB_TELL_QOS_STATUS with the state of the token
+ * buckets, shown by "smbstatus --qos".
+ */
+void smbd_smb2_qos_status_msg(struct messaging_context *msg_ctx,
+			      void *private_data,
+			      uint32_t msg_type,
+			      struct server_id src,
+			      DATA_BLOB *data)
+{
+	struct smbd_server_connection *sconn = talloc_get_type_abort(
+		private_data, struct smbd_server_connection);
+	struct smbd_smb2_qos *qos = sconn->smb2_qos;
+	struct smbd_smb2_qos_flow *flow = NULL;
+	struct smbd_smb2_qos_user *user = NULL;
+	struct timeval now = timeval_current();
+	char *addr = NULL;
+	char *str = NULL;
+
+	if (qos == NULL) {
+		/* Nothing was ever limited */
+		return;
+	}
+
+	addr = tsocket_address_string(sconn->remote_address, talloc_tos());
+
+	str = talloc_asprintf(talloc_tos(),
+			      "client %s: %"PRIu32" outstanding, "
+			      "%"PRIu32" queued\n",
+			      addr != NULL ? addr : "?",
+			      qos->num_outstanding,
+			      qos->num_queued);
+	smbd_smb2_qos_bucket_status(&str, "  client:",
+				    &qos->client_bucket, now);
+
+	for (user = qos->users; user != NULL; user = user->next) {
+		const struct auth_session_info *info =
+			user->session->global->auth_session_info;
+		char *prefix = talloc_asprintf(
+			talloc_tos(),
+			"  session 0x%"PRIx64" (%s):",
+			user->session->global->session_wire_id,
+			((info != NULL) && (info->unix_info != NULL)) ?
+			info->unix_info->unix_name : "?");
+
+		if (prefix == NULL) {
+			continue;
+		}
+		smbd_smb2_qos_bucket_status(&str, prefix, &user->bucket, now);
+		TALLOC_FREE(prefix);
+	}
+
+	for (flow = qos->flows; flow != NULL; flow = flow->next) {
+		struct smbXsrv_tcon_global0 *global = flow->tcon->global;
+		char *prefix = talloc_asprintf(
+			talloc_tos(),
+			"  tcon 0x%"PRIx32" [%s]",
+			global->tcon_wire_id,
+			global->share_name);
+
+		if (prefix == NULL) {
+			continue;
+		}
+		smbd_smb2_qos_bucket_status(&str,
+					    talloc_asprintf(talloc_tos(),
+							    "%s:", prefix),
+					    &flow->bucket, now);
+		smbd_smb2_qos_bucket_status(&str,
+					    talloc_asprintf(talloc_tos(),
+							    "%s read:", prefix),
+					    &flow->read_bucket, now);
+		smbd_smb2_qos_bucket_status(&str,
+					    talloc_asprintf(talloc_tos(),
+							    "%s write:", prefix),
+					    &flow->write_bucket, now);
+		TALLOC_FREE(prefix);
+	}
+
+	if (str == NULL) {
+		return;
+	}
+
+	messaging_send_buf(msg_ctx,
+			   src,
+			   MSG_SMB_QOS_STATUS,
+			   (const uint8_t *)str,
+			   strlen(str));
+	TALLOC_FREE(str);
+}
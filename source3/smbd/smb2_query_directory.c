@@ -199,13 +199,17 @@ static void smbd_smb2_request_find_done(struct tevent_req *subreq)
 	}
 }
 
+/* Number of entries to ask the VFS about in one go */
+#define SMB2_QUERY_DIRECTORY_DOSMODE_BATCH 32
+
 static struct tevent_req *fetch_dos_mode_send(
 	TALLOC_CTX *mem_ctx,
 	struct tevent_context *ev,
 	struct files_struct *dir_fsp,
-	struct smb_filename **smb_fname,
-	uint32_t info_level,
-	uint8_t *entry_marshall_buf);
+	struct smb_filename **smb_fnames,
+	uint8_t **entry_marshall_bufs,
+	size_t num_entries,
+	uint32_t info_level);
 
 static NTSTATUS fetch_dos_mode_recv(struct tevent_req *req);
 
@@ -231,11 +235,18 @@ struct smbd_smb2_query_directory_state {
 	int last_entry_off;
 	size_t max_async_dosmode_active;
 	uint32_t async_dosmode_active;
+	/* Entries waiting for their DOS attributes */
+	struct smb_filename **dosmode_fnames;
+	uint8_t **dosmode_bufs;
+	size_t num_dosmode;
+	size_t stat_ahead;
+	uint32_t stat_ahead_active;
 	bool done;
 };
 
 static bool smb2_query_directory_next_entry(struct tevent_req *req);
 static void smb2_query_directory_dos_mode_done(struct tevent_req *subreq);
+static void smb2_query_directory_stat_ahead_done(struct tevent_req *subreq);
 static void smb2_query_directory_waited(struct tevent_req *subreq);
 
 static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
@@ -486,6 +497,21 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 	}
 
 	if (state->async_dosmode) {
+		state->dosmode_fnames = talloc_zero_array(
+			state,
+			struct smb_filename *,
+			SMB2_QUERY_DIRECTORY_DOSMODE_BATCH);
+		if (tevent_req_nomem(state->dosmode_fnames, req)) {
+			return tevent_req_post(req, ev);
+		}
+		state->dosmode_bufs = talloc_zero_array(
+			state,
+			uint8_t *,
+			SMB2_QUERY_DIRECTORY_DOSMODE_BATCH);
+		if (tevent_req_nomem(state->dosmode_bufs, req)) {
+			return tevent_req_post(req, ev);
+		}
+
 		/*
 		 * Should we only set async_internal
 		 * if we're not the last request in
@@ -494,6 +520,16 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 		smb2_request_set_async_internal(smb2req, true);
 	}
 
+	/*
+	 * Like the path prefetch in SMB2 create, only go async
+	 * when we're the last request of a compound chain
+	 */
+	if ((state->info_level != SMB_FIND_FILE_NAMES_INFO) &&
+	    !(smbd_smb2_is_compound(smb2req) &&
+	      !smbd_smb2_is_last_in_compound(smb2req))) {
+		state->stat_ahead = lp_smbd_async_stat_ahead(SNUM(conn));
+	}
+
 	/*
 	 * This gets set in autobuild for some tests
 	 */
@@ -519,6 +555,108 @@ static struct tevent_req *smbd_smb2_query_directory_send(TALLOC_CTX *mem_ctx,
 	return req;
 }
 
+/*
+ * Read a window of names ahead and stat them concurrently in the
+ * threadpool. The results are thrown away, the point is to have the
+ * inodes cached when smbd_dirptr_get_entry() walks the names one by one.
+ * Returns true if we have to wait for the stats.
+ */
+static bool smb2_query_directory_stat_ahead(struct tevent_req *req)
+{
+	struct smbd_smb2_query_directory_state *state = tevent_req_data(
+		req, struct smbd_smb2_query_directory_state);
+	struct files_struct *dirfsp = state->dirfsp;
+	const char * const *names = NULL;
+	size_t i, num_names;
+
+	num_names = dptr_read_ahead(dirfsp->dptr, state->stat_ahead, &names);
+
+	for (i = 0; i < num_names; i++) {
+		struct smb_filename *smb_fname = NULL;
+		struct tevent_req *subreq = NULL;
+
+		if (ISDOT(names[i]) || ISDOTDOT(names[i])) {
+			continue;
+		}
+
+		smb_fname = synthetic_smb_fname(state,
+						names[i],
+						NULL,
+						NULL,
+						dirfsp->fsp_name->twrp,
+						dirfsp->fsp_name->flags);
+		if (smb_fname == NULL) {
+			/* It's only an optimization */
+			break;
+		}
+
+		subreq = SMB_VFS_FSTATAT_SEND(state,
+					      state->ev,
+					      dirfsp,
+					      smb_fname,
+					      AT_SYMLINK_NOFOLLOW);
+		if (subreq == NULL) {
+			TALLOC_FREE(smb_fname);
+			break;
+		}
+		talloc_steal(subreq, smb_fname);
+
+		if (!tevent_req_is_in_progress(subreq)) {
+			/*
+			 * Not really async, don't bother for the rest
+			 * of this listing
+			 */
+			TALLOC_FREE(subreq);
+			state->stat_ahead = 0;
+			break;
+		}
+		tevent_req_set_callback(subreq,
+					smb2_query_directory_stat_ahead_done,
+					req);
+		state->stat_ahead_active++;
+	}
+
+	if (state->stat_ahead_active == 0) {
+		return false;
+	}
+
+	smb2_request_set_async_internal(state->smb2req, true);
+	return true;
+}
+
+/*
+ * Send the collected entries to fetch_dos_mode_send(), returns false
+ * if req failed
+ */
+static bool smb2_query_directory_fetch_dos_modes(struct tevent_req *req)
+{
+	struct smbd_smb2_query_directory_state *state = tevent_req_data(
+		req, struct smbd_smb2_query_directory_state);
+	struct tevent_req *subreq = NULL;
+
+	if (state->num_dosmode == 0) {
+		return true;
+	}
+
+	subreq = fetch_dos_mode_send(state,
+				     state->ev,
+				     state->dirfsp,
+				     state->dosmode_fnames,
+				     state->dosmode_bufs,
+				     state->num_dosmode,
+				     state->info_level);
+	if (tevent_req_nomem(subreq, req)) {
+		return false;
+	}
+	tevent_req_set_callback(subreq,
+				smb2_query_directory_dos_mode_done,
+				req);
+
+	state->async_dosmode_active++;
+	state->num_dosmode = 0;
+	return true;
+}
+
 static bool smb2_query_directory_next_entry(struct tevent_req *req)
 {
 	struct smbd_smb2_query_directory_state *state = tevent_req_data(
@@ -533,6 +671,17 @@ static bool smb2_query_directory_next_entry(struct tevent_req *req)
 
 	SMB_ASSERT(space_remaining >= 0);
 
+	if (state->stat_ahead_active > 0) {
+		/* smb2_query_directory_stat_ahead_done() continues */
+		return true;
+	}
+	if (state->stat_ahead > 0) {
+		stop = smb2_query_directory_stat_ahead(req);
+		if (stop) {
+			return true;
+		}
+	}
+
 	status = smbd_dirptr_lanman2_entry(state,
 					   state->dirfsp->conn,
 					   state->dirfsp->dptr,
@@ -579,26 +728,14 @@ static bool smb2_query_directory_next_entry(struct tevent_req *req)
 	}
 
 	if (state->async_dosmode) {
-		struct tevent_req *subreq = NULL;
-		uint8_t *buf = NULL;
+		size_t i = state->num_dosmode;
 		size_t outstanding_aio;
 
-		buf = (uint8_t *)state->base_data + state->last_entry_off;
-
-		subreq = fetch_dos_mode_send(state,
-					     state->ev,
-					     state->dirfsp,
-					     &smb_fname,
-					     state->info_level,
-					     buf);
-		if (tevent_req_nomem(subreq, req)) {
-			return true;
-		}
-		tevent_req_set_callback(subreq,
-					smb2_query_directory_dos_mode_done,
-					req);
-
-		state->async_dosmode_active++;
+		state->dosmode_fnames[i] = talloc_move(state->dosmode_fnames,
+						       &smb_fname);
+		state->dosmode_bufs[i] =
+			(uint8_t *)state->base_data + state->last_entry_off;
+		state->num_dosmode += 1;
 
 		outstanding_aio = pthreadpool_tevent_queued_jobs(
 			state->dirfsp->conn->sconn->pool);
@@ -606,6 +743,13 @@ static bool smb2_query_directory_next_entry(struct tevent_req *req)
 		if (outstanding_aio > state->max_async_dosmode_active) {
 			stop = true;
 		}
+
+		if (stop || (state->num_dosmode ==
+			     SMB2_QUERY_DIRECTORY_DOSMODE_BATCH)) {
+			if (!smb2_query_directory_fetch_dos_modes(req)) {
+				return true;
+			}
+		}
 	}
 
 	TALLOC_FREE(smb_fname);
@@ -622,6 +766,10 @@ last_entry_done:
 
 	state->done = true;
 
+	if (!smb2_query_directory_fetch_dos_modes(req)) {
+		return true;
+	}
+
 	if (state->async_dosmode_active > 0) {
 		return true;
 	}
@@ -684,6 +832,39 @@ static void smb2_query_directory_dos_mode_done(struct tevent_req *subreq)
 	return;
 }
 
+static void smb2_query_directory_stat_ahead_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+		tevent_req_callback_data(subreq,
+		struct tevent_req);
+	struct smbd_smb2_query_directory_state *state =
+		tevent_req_data(req,
+		struct smbd_smb2_query_directory_state);
+	struct vfs_aio_state aio_state = { 0 };
+	SMB_STRUCT_STAT sbuf;
+	bool ok;
+
+	/*
+	 * The result doesn't matter, smbd_dirptr_get_entry()
+	 * will look at the file anyway.
+	 */
+	SMB_VFS_FSTATAT_RECV(subreq, &aio_state, &sbuf);
+	TALLOC_FREE(subreq);
+
+	state->stat_ahead_active--;
+	if (state->stat_ahead_active > 0) {
+		return;
+	}
+
+	/*
+	 * Make sure we run as the user again
+	 */
+	ok = change_to_user_and_service_by_fsp(state->dirfsp);
+	SMB_ASSERT(ok);
+
+	smb2_query_directory_check_next_entry(req);
+}
+
 static void smb2_query_directory_check_next_entry(struct tevent_req *req)
 {
 	struct smbd_smb2_query_directory_state *state = tevent_req_data(
@@ -759,9 +940,11 @@ static NTSTATUS smbd_smb2_query_directory_recv(struct tevent_req *req,
 
 struct fetch_dos_mode_state {
 	struct files_struct *dir_fsp;
-	struct smb_filename *smb_fname;
+	struct smb_filename **smb_fnames;
+	uint8_t **entry_marshall_bufs;
+	uint32_t *dosmodes;
+	size_t num_entries;
 	uint32_t info_level;
-	uint8_t *entry_marshall_buf;
 };
 
 static void fetch_dos_mode_done(struct tevent_req *subreq);
@@ -770,13 +953,15 @@ static struct tevent_req *fetch_dos_mode_send(
 			TALLOC_CTX *mem_ctx,
 			struct tevent_context *ev,
 			struct files_struct *dir_fsp,
-			struct smb_filename **smb_fname,
-			uint32_t info_level,
-			uint8_t *entry_marshall_buf)
+			struct smb_filename **smb_fnames,
+			uint8_t **entry_marshall_bufs,
+			size_t num_entries,
+			uint32_t info_level)
 {
 	struct tevent_req *req = NULL;
 	struct fetch_dos_mode_state *state = NULL;
 	struct tevent_req *subreq = NULL;
+	size_t i;
 
 	req = tevent_req_create(mem_ctx, &state, struct fetch_dos_mode_state);
 	if (req == NULL) {
@@ -784,13 +969,38 @@ static struct tevent_req *fetch_dos_mode_send(
 	}
 	*state = (struct fetch_dos_mode_state) {
 		.dir_fsp = dir_fsp,
+		.num_entries = num_entries,
 		.info_level = info_level,
-		.entry_marshall_buf = entry_marshall_buf,
 	};
 
-	state->smb_fname = talloc_move(state, smb_fname);
+	state->smb_fnames = talloc_array(state,
+					 struct smb_filename *,
+					 num_entries);
+	if (tevent_req_nomem(state->smb_fnames, req)) {
+		return tevent_req_post(req, ev);
+	}
+	state->entry_marshall_bufs = talloc_memdup(
+		state,
+		entry_marshall_bufs,
+		num_entries * sizeof(uint8_t *));
+	if (tevent_req_nomem(state->entry_marshall_bufs, req)) {
+		return tevent_req_post(req, ev);
+	}
+	state->dosmodes = talloc_zero_array(state, uint32_t, num_entries);
+	if (tevent_req_nomem(state->dosmodes, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	for (i = 0; i < num_entries; i++) {
+		state->smb_fnames[i] = talloc_move(state->smb_fnames,
+						   &smb_fnames[i]);
+	}
 
-	subreq = dos_mode_at_send(state, ev, dir_fsp, state->smb_fname);
+	subreq = dos_mode_at_batch_send(state,
+					ev,
+					dir_fsp,
+					state->smb_fnames,
+					num_entries);
 	if (tevent_req_nomem(subreq, req)) {
 		return tevent_req_post(req, ev);
 	}
@@ -799,6 +1009,38 @@ static struct tevent_req *fetch_dos_mode_send(
 	return req;
 }
 
+static void fetch_dos_mode_marshall(struct fetch_dos_mode_state *state,
+				    struct smb_filename *smb_fname,
+				    uint8_t *entry_marshall_buf,
+				    uint32_t dosmode,
+				    off_t btime_off,
+				    off_t dosmode_off)
+{
+	uint32_t dfs_dosmode;
+	struct timespec btime_ts = {0};
+
+	dfs_dosmode = IVAL(entry_marshall_buf, dosmode_off);
+	if (dfs_dosmode == 0) {
+		/*
+		 * DOS mode for a DFS link, only overwrite if still set to 0 and
+		 * not already populated by the lower layer for a DFS link in
+		 * smbd_dirptr_lanman2_mode_fn().
+		 */
+		SIVAL(entry_marshall_buf, dosmode_off, dosmode);
+	}
+
+	btime_ts = get_create_timespec(state->dir_fsp->conn,
+				       NULL,
+				       smb_fname);
+	if (lp_dos_filetime_resolution(SNUM(state->dir_fsp->conn))) {
+		dos_filetime_timespec(&btime_ts);
+	}
+
+	put_long_date_full_timespec(state->dir_fsp->conn->ts_res,
+			       (char *)entry_marshall_buf + btime_off,
+			       &btime_ts);
+}
+
 static void fetch_dos_mode_done(struct tevent_req *subreq)
 {
 	struct tevent_req *req =
@@ -807,14 +1049,12 @@ static void fetch_dos_mode_done(struct tevent_req *subreq)
 	struct fetch_dos_mode_state *state =
 		tevent_req_data(req,
 		struct fetch_dos_mode_state);
-	uint32_t dfs_dosmode;
-	uint32_t dosmode;
-	struct timespec btime_ts = {0};
 	off_t dosmode_off;
 	off_t btime_off;
 	NTSTATUS status;
+	size_t i;
 
-	status = dos_mode_at_recv(subreq, &dosmode);
+	status = dos_mode_at_batch_recv(subreq, state->dosmodes);
 	TALLOC_FREE(subreq);
 	if (NT_STATUS_EQUAL(status, NT_STATUS_NOT_FOUND)) {
 		tevent_req_done(req);
@@ -840,28 +1080,15 @@ static void fetch_dos_mode_done(struct tevent_req *subreq)
 		return;
 	}
 
-
-	dfs_dosmode = IVAL(state->entry_marshall_buf, dosmode_off);
-	if (dfs_dosmode == 0) {
-		/*
-		 * DOS mode for a DFS link, only overwrite if still set to 0 and
-		 * not already populated by the lower layer for a DFS link in
-		 * smbd_dirptr_lanman2_mode_fn().
-		 */
-		SIVAL(state->entry_marshall_buf, dosmode_off, dosmode);
+	for (i = 0; i < state->num_entries; i++) {
+		fetch_dos_mode_marshall(state,
+					state->smb_fnames[i],
+					state->entry_marshall_bufs[i],
+					state->dosmodes[i],
+					btime_off,
+					dosmode_off);
 	}
 
-	btime_ts = get_create_timespec(state->dir_fsp->conn,
-				       NULL,
-				       state->smb_fname);
-	if (lp_dos_filetime_resolution(SNUM(state->dir_fsp->conn))) {
-		dos_filetime_timespec(&btime_ts);
-	}
-
-	put_long_date_full_timespec(state->dir_fsp->conn->ts_res,
-			       (char *)state->entry_marshall_buf + btime_off,
-			       &btime_ts);
-
 	tevent_req_done(req);
 	return;
 }
@@ -58,6 +58,7 @@ NTSTATUS smbd_smb2_request_process_read(struct smbd_smb2_request *req)
 	uint64_t in_file_id_volatile;
 	struct files_struct *in_fsp;
 	uint32_t in_minimum_count;
+	uint32_t in_channel = SMB2_CHANNEL_NONE;
 	uint32_t in_remaining_bytes;
 	struct tevent_req *subreq;
 
@@ -78,6 +79,17 @@ NTSTATUS smbd_smb2_request_process_read(struct smbd_smb2_request *req)
 	in_file_id_volatile	= BVAL(inbody, 0x18);
 	in_minimum_count	= IVAL(inbody, 0x20);
 	in_remaining_bytes	= IVAL(inbody, 0x28);
+	if (xconn->protocol >= PROTOCOL_SMB3_00) {
+		in_channel	= IVAL(inbody, 0x24);
+	}
+
+	/*
+	 * We don't support SMB Direct, so the data
+	 * can't be transferred via an RDMA channel.
+	 */
+	if (in_channel != SMB2_CHANNEL_NONE) {
+		return smbd_smb2_request_error(req, NT_STATUS_INVALID_PARAMETER);
+	}
 
 	/* check the max read size */
 	if (in_length > xconn->smb2.server.max_read) {
@@ -215,6 +227,14 @@ static int smb2_sendfile_send_data(struct smbd_smb2_read_state *state)
 	ssize_t ret;
 	int saved_errno;
 
+	if (pstatus == NULL) {
+		/*
+		 * Either the io_uring transport already sent
+		 * the data, or the connection is gone.
+		 */
+		return 0;
+	}
+
 	nread = SMB_VFS_SENDFILE(xconn->transport.sock,
 				 fsp,
 				 hdr,
@@ -346,6 +366,7 @@ static NTSTATUS schedule_smb2_sendfile_read(struct smbd_smb2_request *smb2req,
 	 * We were not configured to do so OR
 	 * Signing is active OR
 	 * This is a compound SMB2 operation OR
+	 * The response should be compressed OR
 	 * fsp is a STREAM file OR
 	 * It's not a regular file OR
 	 * Requested offset is greater than file size OR
@@ -358,6 +379,9 @@ static NTSTATUS schedule_smb2_sendfile_read(struct smbd_smb2_request *smb2req,
 	    smb2req->do_signing ||
 	    smb2req->do_encryption ||
 	    smbd_smb2_is_compound(smb2req) ||
+	    smbd_smb2_compress_read_wanted(smb2req,
+					   state->in_flags,
+					   state->in_length) ||
 	    fsp_is_alternate_stream(fsp) ||
 	    (!S_ISREG(fsp->fsp_name->st.st_ex_mode)) ||
 	    (state->in_offset >= fsp->fsp_name->st.st_ex_size) ||
@@ -549,6 +573,8 @@ static struct tevent_req *smbd_smb2_read_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
+	write_behind_sync_file_id(fsp->conn->sconn, fsp->file_id);
+
 	status = schedule_smb2_aio_read(fsp->conn,
 				smbreq,
 				fsp,
@@ -687,6 +713,8 @@ static NTSTATUS smbd_smb2_read_recv(struct tevent_req *req,
 		tevent_req_received(req);
 		state->smb2req->queue_entry.sendfile_header = &state->out_headers;
 		state->smb2req->queue_entry.sendfile_body_size = state->in_length;
+		state->smb2req->queue_entry.sendfile_fsp = state->fsp;
+		state->smb2req->queue_entry.sendfile_offset = state->in_offset;
 		talloc_set_destructor(state, smb2_sendfile_send_data);
 	} else {
 		tevent_req_received(req);
@@ -1719,6 +1719,14 @@ NTSTATUS rename_internals_fsp(connection_struct *conn,
 		rename_open_files(conn, lck, fsp->file_id, fsp->name_hash,
 				  smb_fname_dst);
 
+		if (fsp->fsp_flags.is_directory) {
+			/*
+			 * Cached paths at or below the old name are
+			 * wrong now
+			 */
+			path_walk_cache_flush(conn);
+		}
+
 		if (!fsp->fsp_flags.is_directory &&
 		    (lp_map_archive(SNUM(conn)) ||
 		     lp_store_dos_attributes(SNUM(conn))))
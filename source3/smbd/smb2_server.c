@@ -33,6 +33,7 @@
 #include "../lib/util/bitmap.h"
 #include "../librpc/gen_ndr/krb5pac.h"
 #include "lib/util/iov_buf.h"
+#include "lib/util/tracepoint.h"
 #include "lib/async_req/async_sock.h"
 #include "auth.h"
 #include "libcli/smb/smbXcli_base.h"
@@ -50,6 +51,7 @@
 #endif
 
 #include "lib/crypto/gnutls_helpers.h"
+#include "lib/pthreadpool/pthreadpool_tevent.h"
 #include <gnutls/gnutls.h>
 #include <gnutls/crypto.h>
 
@@ -61,6 +63,11 @@ static void smbd_smb2_connection_handler(struct tevent_context *ev,
 					 uint16_t flags,
 					 void *private_data);
 static NTSTATUS smbd_smb2_flush_send_queue(struct smbXsrv_connection *xconn);
+static NTSTATUS smbd_smb2_flush_send_queue_batched(
+	struct smbXsrv_connection *xconn);
+static void smbd_smb2_recv_buf_feed_immediate(struct tevent_context *ev,
+					      struct tevent_immediate *im,
+					      void *private_data);
 
 static const struct smbd_smb2_dispatch_table {
 	uint16_t opcode;
@@ -294,9 +301,79 @@ bool smbd_smb2_is_last_in_compound(const struct smbd_smb2_request *req)
 		req->in.vector_count);
 }
 
+/*
+ * Without io_uring each request used to take two recvmsg() calls,
+ * one for the NBT header and one for the PDU. Reading into a
+ * per connection buffer gets all PDUs the client pipelined with
+ * one call. As the payload of a WRITE might end up in the buffer,
+ * this is only done if recvfile is not in use.
+ */
+static NTSTATUS smbd_smb2_recv_buf_setup(struct smbXsrv_connection *xconn)
+{
+	int size;
+
+	if (xconn->transport.io_uring != NULL) {
+		return NT_STATUS_OK;
+	}
+	if (lp_min_receive_file_size() != 0) {
+		return NT_STATUS_OK;
+	}
+
+	size = lp_parm_int(-1, "smbd", "receive buffer size", 65536);
+	if (size < NBT_HDR_SIZE + SMB2_HDR_BODY) {
+		return NT_STATUS_OK;
+	}
+
+	xconn->smb2.recv_buf.im = tevent_create_immediate(xconn);
+	if (xconn->smb2.recv_buf.im == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	xconn->smb2.recv_buf.buf = talloc_array(xconn, uint8_t, size);
+	if (xconn->smb2.recv_buf.buf == NULL) {
+		TALLOC_FREE(xconn->smb2.recv_buf.im);
+		return NT_STATUS_NO_MEMORY;
+	}
+	xconn->smb2.recv_buf.size = size;
+
+	return NT_STATUS_OK;
+}
+
+/*
+ * Enough for a few dozen responses, well below IOV_MAX
+ */
+#define SMBD_SMB2_SEND_BATCH_MAX_IOV 256
+
+static NTSTATUS smbd_smb2_send_batch_setup(struct smbXsrv_connection *xconn)
+{
+	int cork;
+
+	if (xconn->transport.io_uring != NULL) {
+		/* The io_uring transport has its own send path */
+		return NT_STATUS_OK;
+	}
+
+	cork = lp_parm_int(-1, "smbd", "send batch responses", 0);
+
+	xconn->smb2.send_batch.im = tevent_create_immediate(xconn);
+	if (xconn->smb2.send_batch.im == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+	xconn->smb2.send_batch.iov = talloc_array(xconn,
+						  struct iovec,
+						  SMBD_SMB2_SEND_BATCH_MAX_IOV);
+	if (xconn->smb2.send_batch.iov == NULL) {
+		TALLOC_FREE(xconn->smb2.send_batch.im);
+		return NT_STATUS_NO_MEMORY;
+	}
+	xconn->smb2.send_batch.cork = MAX(cork, 0);
+
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS smbd_initialize_smb2(struct smbXsrv_connection *xconn,
 				     uint64_t expected_seq_low)
 {
+	NTSTATUS status;
 	int rc;
 
 	xconn->smb2.credits.seq_low = expected_seq_low;
@@ -326,6 +403,26 @@ static NTSTATUS smbd_initialize_smb2(struct smbXsrv_connection *xconn,
 	}
 	tevent_fd_set_auto_close(xconn->transport.fde);
 
+#ifdef HAVE_IO_URING_SETUP_BUF_RING
+	if (smbd_io_uring_conn_setup(xconn)) {
+		/*
+		 * Reads and writes are done via io_uring,
+		 * we only keep the fde for TEVENT_FD_ERROR.
+		 */
+		TEVENT_FD_NOT_READABLE(xconn->transport.fde);
+	}
+#endif /* HAVE_IO_URING_SETUP_BUF_RING */
+
+	status = smbd_smb2_recv_buf_setup(xconn);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
+	status = smbd_smb2_send_batch_setup(xconn);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
 	/*
 	 * Ensure child is set to non-blocking mode,
 	 * unless the system supports MSG_DONTWAIT,
@@ -387,30 +484,34 @@ void smb2_request_set_async_internal(struct smbd_smb2_request *req,
 	req->async_internal = async_internal;
 }
 
+/*
+ * Requests are allocated and freed at a high rate with lifetimes
+ * independent of each other, keep their memory in a slab.
+ */
+#define SMBD_SMB2_REQUEST_SLAB_CACHED 64
+
 static struct smbd_smb2_request *smbd_smb2_request_allocate(struct smbXsrv_connection *xconn)
 {
-	TALLOC_CTX *mem_pool;
+	struct smbd_server_connection *sconn = xconn->client->sconn;
 	struct smbd_smb2_request *req;
 
-#if 0
-	/* Enable this to find subtle valgrind errors. */
-	mem_pool = talloc_init("smbd_smb2_request_allocate");
-#else
-	mem_pool = talloc_tos();
-#endif
-	if (mem_pool == NULL) {
-		return NULL;
+	if (sconn->smb2_request_slab == NULL) {
+		/*
+		 * On failure we fall back to normal allocations
+		 */
+		sconn->smb2_request_slab = talloc_slab_create(
+			sconn,
+			sizeof(struct smbd_smb2_request),
+			0,
+			SMBD_SMB2_REQUEST_SLAB_CACHED);
 	}
 
-	req = talloc(mem_pool, struct smbd_smb2_request);
+	req = talloc_slab_alloc(sconn->smb2_request_slab,
+				xconn,
+				struct smbd_smb2_request);
 	if (req == NULL) {
-		talloc_free(mem_pool);
 		return NULL;
 	}
-	talloc_reparent(mem_pool, xconn, req);
-#if 0
-	TALLOC_FREE(mem_pool);
-#endif
 	*req = (struct smbd_smb2_request) {
 		.sconn = xconn->client->sconn,
 		.xconn = xconn,
@@ -423,10 +524,63 @@ static struct smbd_smb2_request *smbd_smb2_request_allocate(struct smbXsrv_conne
 	return req;
 }
 
+static NTSTATUS smbd_smb2_encrypt_pdu(struct smb2_signing_key *encryption_key,
+				      struct iovec *vector,
+				      int count)
+{
+	NTSTATUS status;
+
+	START_PROFILE_BYTES(smb2_encrypt, iov_buflen(&vector[1], count - 1));
+	status = smb2_signing_encrypt_pdu(encryption_key, vector, count);
+	END_PROFILE_BYTES(smb2_encrypt);
+
+	return status;
+}
+
+static NTSTATUS smbd_smb2_sign_pdu(struct smb2_signing_key *signing_key,
+				   struct iovec *vector,
+				   int count)
+{
+	NTSTATUS status;
+
+	START_PROFILE_BYTES(smb2_sign, iov_buflen(vector, count));
+	status = smb2_signing_sign_pdu(signing_key, vector, count);
+	END_PROFILE_BYTES(smb2_sign);
+
+	return status;
+}
+
+static NTSTATUS smbd_smb2_check_pdu(struct smb2_signing_key *signing_key,
+				    struct iovec *vector,
+				    int count)
+{
+	NTSTATUS status;
+
+	START_PROFILE_BYTES(smb2_verify, iov_buflen(vector, count));
+	status = smb2_signing_check_pdu(signing_key, vector, count);
+	END_PROFILE_BYTES(smb2_verify);
+
+	return status;
+}
+
+static NTSTATUS smbd_smb2_decrypt_pdu(struct smb2_signing_key *decryption_key,
+				      struct iovec *vector,
+				      int count)
+{
+	NTSTATUS status;
+
+	START_PROFILE_BYTES(smb2_decrypt, iov_buflen(&vector[1], count - 1));
+	status = smb2_signing_decrypt_pdu(decryption_key, vector, count);
+	END_PROFILE_BYTES(smb2_decrypt);
+
+	return status;
+}
+
 static NTSTATUS smbd_smb2_inbuf_parse_compound(struct smbXsrv_connection *xconn,
 					       NTTIME now,
 					       uint8_t *buf,
 					       size_t buflen,
+					       bool decrypted,
 					       struct smbd_smb2_request *req,
 					       struct iovec **piov,
 					       int *pnum_iov)
@@ -439,6 +593,7 @@ static NTSTATUS smbd_smb2_inbuf_parse_compound(struct smbXsrv_connection *xconn,
 	size_t verified_buflen = 0;
 	uint8_t *tf = NULL;
 	size_t tf_len = 0;
+	bool decompressed = false;
 
 	/*
 	 * Note: index '0' is reserved for the transport protocol
@@ -546,8 +701,17 @@ static NTSTATUS smbd_smb2_inbuf_parse_compound(struct smbXsrv_connection *xconn,
 			tf_iov[1].iov_base = (void *)hdr;
 			tf_iov[1].iov_len = enc_len;
 
-			status = smb2_signing_decrypt_pdu(s->global->decryption_key,
-							  tf_iov, 2);
+			if (decrypted && tf == first_hdr) {
+				/*
+				 * The channel thread did this already,
+				 * see smbd_smb2_request_decrypt_offload().
+				 */
+				status = NT_STATUS_OK;
+			} else {
+				status = smbd_smb2_decrypt_pdu(
+						s->global->decryption_key,
+						tf_iov, 2);
+			}
 			if (!NT_STATUS_IS_OK(status)) {
 				TALLOC_FREE(iov_alloc);
 				return status;
@@ -557,6 +721,56 @@ static NTSTATUS smbd_smb2_inbuf_parse_compound(struct smbXsrv_connection *xconn,
 			len = enc_len;
 		}
 
+		if (IVAL(hdr, 0) == SMB2_COMP_TF_MAGIC) {
+			uint8_t *dbuf = NULL;
+			size_t dlen = 0;
+			NTSTATUS status;
+
+			if (xconn->smb2.compression.negotiated.num_algos == 0) {
+				DEBUG(10, ("Got SMB2_COMPRESSION_TRANSFORM "
+					   "header, but not negotiated\n"));
+				goto inval;
+			}
+
+			/*
+			 * A compressed message is only allowed at the
+			 * start of the transport frame or directly
+			 * after the transform header and always covers
+			 * the rest of it.
+			 */
+			if (decompressed ||
+			    (tf == NULL && taken != 0) ||
+			    (tf != NULL && hdr != tf + tf_len) ||
+			    (tf != NULL && verified_buflen != buflen))
+			{
+				DEBUG(1, ("Unexpected SMB2_COMPRESSION_TRANSFORM "
+					  "header at offset %zu\n", taken));
+				goto inval;
+			}
+
+			status = smbd_smb2_decompress(xconn, mem_ctx,
+						      hdr, len,
+						      &dbuf, &dlen);
+			if (!NT_STATUS_IS_OK(status)) {
+				TALLOC_FREE(iov_alloc);
+				return status;
+			}
+
+			decompressed = true;
+			first_hdr = dbuf;
+			buflen = dlen;
+			taken = 0;
+			if (tf != NULL) {
+				verified_buflen = dlen;
+			}
+			hdr = dbuf;
+			len = dlen;
+
+			if (len < 4) {
+				goto inval;
+			}
+		}
+
 		/*
 		 * We need the header plus the body length field
 		 */
@@ -720,6 +934,7 @@ static NTSTATUS smbd_smb2_request_create(struct smbXsrv_connection *xconn,
 						now,
 						inpdu,
 						size,
+						false,
 						req, &req->in.vector,
 						&req->in.vector_count);
 	if (!NT_STATUS_IS_OK(status)) {
@@ -1568,6 +1783,9 @@ void smbXsrv_connection_disconnect_transport(struct smbXsrv_connection *xconn,
 	}
 
 	xconn->transport.status = status;
+#ifdef HAVE_IO_URING_SETUP_BUF_RING
+	smbd_io_uring_conn_disconnect(xconn);
+#endif /* HAVE_IO_URING_SETUP_BUF_RING */
 	TALLOC_FREE(xconn->transport.fde);
 	if (xconn->transport.sock != -1) {
 		xconn->transport.sock = -1;
@@ -1801,6 +2019,18 @@ void smbd_server_connection_terminate_ex(struct smbXsrv_connection *xconn,
 		  smbXsrv_connection_dbg(xconn), num_ok,
 		  reason, location);
 
+	if (xconn->smb2.compression.negotiated.num_algos > 0) {
+		DBG_INFO("conn[%s] compression: raw[%"PRIu64"] "
+			 "compressed[%"PRIu64" -> %"PRIu64"] "
+			 "decompressed[%"PRIu64" -> %"PRIu64"]\n",
+			 smbXsrv_connection_dbg(xconn),
+			 xconn->smb2.compression.counters.raw_bytes,
+			 xconn->smb2.compression.counters.compressed_in_bytes,
+			 xconn->smb2.compression.counters.compressed_out_bytes,
+			 xconn->smb2.compression.counters.decompressed_in_bytes,
+			 xconn->smb2.compression.counters.decompressed_out_bytes);
+	}
+
 	if (xconn->has_cluster_movable_ip) {
 		/*
 		 * If the connection has a movable cluster public address
@@ -2052,14 +2282,14 @@ static NTSTATUS smb2_send_async_interim_response(const struct smbd_smb2_request
 	 * we need to sign/encrypt here with the last/first key we remembered
 	 */
 	if (firsttf->iov_len == SMB2_TF_HDR_SIZE) {
-		status = smb2_signing_encrypt_pdu(req->first_enc_key,
+		status = smbd_smb2_encrypt_pdu(req->first_enc_key,
 					firsttf,
 					nreq->out.vector_count - first_idx);
 		if (!NT_STATUS_IS_OK(status)) {
 			return status;
 		}
 	} else if (smb2_signing_key_valid(req->last_sign_key)) {
-		status = smb2_signing_sign_pdu(req->last_sign_key,
+		status = smbd_smb2_sign_pdu(req->last_sign_key,
 					       outhdr_v,
 					       SMBD_SMB2_NUM_IOV_PER_REQ - 1);
 		if (!NT_STATUS_IS_OK(status)) {
@@ -2460,7 +2690,7 @@ static void smbd_smb2_request_pending_timer(struct tevent_context *ev,
 		struct smbXsrv_session *x = req->session;
 		struct smb2_signing_key *encryption_key = x->global->encryption_key;
 
-		status = smb2_signing_encrypt_pdu(encryption_key,
+		status = smbd_smb2_encrypt_pdu(encryption_key,
 					&state->vector[1+SMBD_SMB2_TF_IOV_OFS],
 					SMBD_SMB2_NUM_IOV_PER_REQ);
 		if (!NT_STATUS_IS_OK(status)) {
@@ -2940,8 +3170,6 @@ static NTSTATUS smbd_smb2_request_dispatch_update_counts(
 	uint32_t flags;
 	int cmp;
 	struct smbXsrv_open *op;
-	bool update_open = false;
-	NTSTATUS status = NT_STATUS_OK;
 
 	SMB_ASSERT(!req->request_counters_updated);
 
@@ -3027,7 +3255,6 @@ static NTSTATUS smbd_smb2_request_dispatch_update_counts(
 			op->request_count = 1;
 			op->global->channel_sequence = channel_sequence;
 			op->global->channel_generation += generation_wrap;
-			update_open = true;
 			req->request_counters_updated = true;
 		} else if (modify_call) {
 			return NT_STATUS_FILE_NOT_AVAILABLE;
@@ -3041,7 +3268,6 @@ static NTSTATUS smbd_smb2_request_dispatch_update_counts(
 			op->request_count = 1;
 			op->global->channel_sequence = channel_sequence;
 			op->global->channel_generation += generation_wrap;
-			update_open = true;
 			req->request_counters_updated = true;
 		} else if (modify_call) {
 			return NT_STATUS_FILE_NOT_AVAILABLE;
@@ -3049,11 +3275,15 @@ static NTSTATUS smbd_smb2_request_dispatch_update_counts(
 	}
 	req->channel_generation = op->global->channel_generation;
 
-	if (update_open) {
-		status = smbXsrv_open_update(op);
-	}
+	/*
+	 * The channel sequence is only ever looked at by this
+	 * process, all channels of a client are handled here.
+	 * So we don't rewrite the smbXsrv_open_global.tdb record
+	 * for every change, smbXsrv_open_close() stores the current
+	 * values when a durable handle gets disconnected.
+	 */
 
-	return status;
+	return NT_STATUS_OK;
 }
 
 #ifdef WITH_PROFILE
@@ -3086,7 +3316,10 @@ NTSTATUS smbd_smb2_request_dispatch(struct smbd_smb2_request *req)
 
 	inhdr = SMBD_SMB2_IN_HDR_PTR(req);
 
-	DO_PROFILE_INC(request);
+	if (req->qos == NULL) {
+		/* Not counted again if smbd_smb2_qos_admit() queued it */
+		DO_PROFILE_INC(request);
+	}
 
 	SMB_ASSERT(!req->request_counters_updated);
 
@@ -3099,6 +3332,14 @@ NTSTATUS smbd_smb2_request_dispatch(struct smbd_smb2_request *req)
 		  smb2_opcode_name(opcode),
 		  mid);
 
+	SAMBA_TRACEPOINT(smb2_request_start,
+			 req,
+			 mid,
+			 opcode,
+			 flags,
+			 BVAL(inhdr, SMB2_HDR_SESSION_ID),
+			 IVAL(inhdr, SMB2_HDR_TID));
+
 	if (xconn->protocol >= PROTOCOL_SMB2_02) {
 		/*
 		 * once the protocol is negotiated
@@ -3250,9 +3491,9 @@ NTSTATUS smbd_smb2_request_dispatch(struct smbd_smb2_request *req)
 			req->do_signing = true;
 		}
 
-		status = smb2_signing_check_pdu(signing_key,
-						SMBD_SMB2_IN_HDR_IOV(req),
-						SMBD_SMB2_NUM_IOV_PER_REQ - 1);
+		status = smbd_smb2_check_pdu(signing_key,
+					     SMBD_SMB2_IN_HDR_IOV(req),
+					     SMBD_SMB2_NUM_IOV_PER_REQ - 1);
 		if (NT_STATUS_EQUAL(status, NT_STATUS_ACCESS_DENIED) &&
 		    opcode == SMB2_OP_SESSSETUP && !has_channel &&
 		    NT_STATUS_IS_OK(session_status))
@@ -3474,6 +3715,14 @@ skipped_signing:
 		}
 	}
 
+	if (!smbd_smb2_qos_admit(req, opcode)) {
+		/*
+		 * Queued, smbd_smb2_request_dispatch_immediate()
+		 * brings it back here.
+		 */
+		return NT_STATUS_OK;
+	}
+
 	status = smbd_smb2_request_dispatch_update_counts(req, call->modify);
 	if (!NT_STATUS_IS_OK(status)) {
 		return smbd_smb2_request_error(req, status);
@@ -3729,112 +3978,400 @@ static void smbd_smb2_request_reply_update_counts(struct smbd_smb2_request *req)
 	}
 }
 
-static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
-{
-	struct smbXsrv_connection *xconn = req->xconn;
-	int first_idx = 1;
-	struct iovec *firsttf = SMBD_SMB2_IDX_TF_IOV(req,out,first_idx);
-	struct iovec *outhdr = SMBD_SMB2_OUT_HDR_IOV(req);
-	struct iovec *outdyn = SMBD_SMB2_OUT_DYN_IOV(req);
+struct smbd_smb2_request_encrypt_state {
+	struct smbd_smb2_request *req;
+	struct smb2_signing_key *key;
+	struct iovec *vector;
+	int count;
+	bool sign;
 	NTSTATUS status;
-	bool ok;
-
-	req->subreq = NULL;
-	TALLOC_FREE(req->async_te);
+	SMBPROFILE_BYTES_ASYNC_STATE(profile);
+};
 
-	/* MS-SMB2: 3.3.4.1 Sending Any Outgoing Message */
-	smbd_smb2_request_reply_update_counts(req);
+static int smbd_smb2_request_encrypt_state_destructor(
+	struct smbd_smb2_request_encrypt_state *state)
+{
+	return -1;
+}
 
-	if (req->do_encryption &&
-	    (firsttf->iov_len == 0) &&
-	    (!smb2_signing_key_valid(req->first_enc_key)) &&
-	    (req->session != NULL) &&
-	    smb2_signing_key_valid(req->session->global->encryption_key))
-	{
-		struct smb2_signing_key *encryption_key =
-			req->session->global->encryption_key;
-		uint8_t *tf;
-		uint64_t session_id = req->session->global->session_wire_id;
-		uint64_t nonce_high;
-		uint64_t nonce_low;
+static void smbd_smb2_request_encrypt_job(void *private_data);
+static void smbd_smb2_request_encrypt_done(struct tevent_req *subreq);
 
-		status = smb2_get_new_nonce(req->session,
-					    &nonce_high,
-					    &nonce_low);
-		if (!NT_STATUS_IS_OK(status)) {
-			return status;
-		}
+/*
+ * Large responses are encrypted on the smbd thread pool, see
+ * "smb2 encryption offload size". The send queue entry is queued
+ * right away, but flagged so that the queue stops before it. This
+ * keeps the responses of a connection in order, while the responses
+ * of several requests are encrypted in parallel.
+ */
+static bool smbd_smb2_request_encrypt_offload(struct smbd_smb2_request *req,
+					      struct iovec *tf,
+					      int count)
+{
+	struct smbXsrv_connection *xconn = req->xconn;
+	struct smbd_server_connection *sconn = xconn->client->sconn;
+	struct smbd_smb2_request_encrypt_state *state = NULL;
+	struct tevent_req *subreq = NULL;
+	size_t offload_size = lp_smb2_encryption_offload_size();
+	ssize_t len;
 
+	if (offload_size == 0) {
+		return false;
+	}
+	if (!NT_STATUS_IS_OK(xconn->transport.status)) {
+		return false;
+	}
+	if (req->preauth != NULL) {
 		/*
-		 * We need to place the SMB2_TRANSFORM header before the
-		 * first SMB2 header
+		 * The preauth hash is calculated
+		 * over the encrypted response.
 		 */
-
+		return false;
+	}
+	if (!smb2_signing_key_valid(req->first_enc_key)) {
+		return false;
+	}
+	switch (req->first_enc_key->cipher_algo_id) {
+	case SMB2_ENCRYPTION_AES128_GCM:
+	case SMB2_ENCRYPTION_AES256_GCM:
+		break;
+	default:
 		/*
-		 * we need to remember the encryption key
-		 * and defer the signing/encryption until
-		 * we are sure that we do not change
-		 * the header again.
+		 * The CCM ciphers may need temporary
+		 * talloc buffers, see smb2_signing_encrypt_pdu().
 		 */
-		status = smb2_signing_key_copy(req,
-					       encryption_key,
-					       &req->first_enc_key);
-		if (!NT_STATUS_IS_OK(status)) {
-			return status;
-		}
-
-		tf = talloc_zero_array(req, uint8_t,
-				       SMB2_TF_HDR_SIZE);
-		if (tf == NULL) {
-			return NT_STATUS_NO_MEMORY;
-		}
-
-		SIVAL(tf, SMB2_TF_PROTOCOL_ID, SMB2_TF_MAGIC);
-		SBVAL(tf, SMB2_TF_NONCE+0, nonce_low);
-		SBVAL(tf, SMB2_TF_NONCE+8, nonce_high);
-		SBVAL(tf, SMB2_TF_SESSION_ID, session_id);
+		return false;
+	}
 
-		firsttf->iov_base = (void *)tf;
-		firsttf->iov_len = SMB2_TF_HDR_SIZE;
+	len = iov_buflen(&tf[1], count - 1);
+	if (len == -1 || (size_t)len < offload_size) {
+		return false;
 	}
 
-	if ((req->current_idx > SMBD_SMB2_NUM_IOV_PER_REQ) &&
-	    (smb2_signing_key_valid(req->last_sign_key)) &&
-	    (firsttf->iov_len == 0))
-	{
-		int last_idx = req->current_idx - SMBD_SMB2_NUM_IOV_PER_REQ;
-		struct iovec *lasthdr = SMBD_SMB2_IDX_HDR_IOV(req,out,last_idx);
+	if (pthreadpool_tevent_max_threads(sconn->pool) == 0) {
+		return false;
+	}
 
+	state = talloc_zero(req, struct smbd_smb2_request_encrypt_state);
+	if (state == NULL) {
+		return false;
+	}
+	*state = (struct smbd_smb2_request_encrypt_state) {
+		.req = req,
 		/*
-		 * As we are sure the header of the last request in the
-		 * compound chain will not change, we can to sign here
-		 * with the last signing key we remembered.
+		 * This is a private copy, so the gnutls
+		 * handle is only used by the worker thread.
 		 */
-		status = smb2_signing_sign_pdu(req->last_sign_key,
-					       lasthdr,
-					       SMBD_SMB2_NUM_IOV_PER_REQ - 1);
-		if (!NT_STATUS_IS_OK(status)) {
-			return status;
-		}
+		.key = talloc_move(state, &req->first_enc_key),
+		.vector = tf,
+		.count = count,
+	};
+
+	SMBPROFILE_BYTES_ASYNC_START(smb2_encrypt,
+				     profile_p,
+				     state->profile,
+				     len);
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->profile);
+
+	subreq = pthreadpool_tevent_job_send(state,
+					     xconn->client->raw_ev_ctx,
+					     sconn->pool,
+					     smbd_smb2_request_encrypt_job,
+					     state);
+	if (subreq == NULL) {
+		SMBPROFILE_BYTES_ASYNC_END(state->profile);
+		req->first_enc_key = talloc_move(req, &state->key);
+		TALLOC_FREE(state);
+		return false;
 	}
-	TALLOC_FREE(req->last_sign_key);
+	tevent_req_set_callback(subreq, smbd_smb2_request_encrypt_done, state);
+	talloc_set_destructor(state, smbd_smb2_request_encrypt_state_destructor);
 
-	SMBPROFILE_IOBYTES_ASYNC_END_X(
-		req->profile,
-		req->profile_x,
-		iov_buflen(outhdr, SMBD_SMB2_NUM_IOV_PER_REQ - 1),
-		PULL_LE_U16(outhdr->iov_base, SMB2_HDR_OPCODE),
-		NT_STATUS(IVAL(outhdr->iov_base, SMB2_HDR_STATUS)));
+	req->queue_entry.encrypting = true;
+	DO_PROFILE_INC(smb2_encrypt_offload);
 
-	req->current_idx += SMBD_SMB2_NUM_IOV_PER_REQ;
+	return true;
+}
 
-	if (req->current_idx < req->out.vector_count) {
-		/*
-		 * We must process the remaining compound
-		 * SMB2 requests before any new incoming SMB2
-		 * requests. This is because incoming SMB2
-		 * requests may include a cancel for a
-		 * compound request we haven't processed
+/*
+ * Signing a large response is offloaded in the same way, see
+ * "smb2 signing offload size". Only the last response of a compound
+ * chain is signed here, the others are signed in
+ * smbd_smb2_request_reply() once it's known that their headers
+ * don't change anymore.
+ */
+static bool smbd_smb2_request_sign_offload(struct smbd_smb2_request *req,
+					   struct iovec *hdr,
+					   int count)
+{
+	struct smbXsrv_connection *xconn = req->xconn;
+	struct smbd_server_connection *sconn = xconn->client->sconn;
+	struct smbd_smb2_request_encrypt_state *state = NULL;
+	struct smb2_signing_key *signing_key = NULL;
+	struct tevent_req *subreq = NULL;
+	size_t offload_size = lp_smb2_signing_offload_size();
+	NTSTATUS status;
+	ssize_t len;
+
+	if (offload_size == 0) {
+		return false;
+	}
+	if (!NT_STATUS_IS_OK(xconn->transport.status)) {
+		return false;
+	}
+	if (req->preauth != NULL) {
+		/*
+		 * The preauth hash is calculated
+		 * over the signed response.
+		 */
+		return false;
+	}
+
+	signing_key = smbd_smb2_signing_key(req->session, xconn, NULL);
+	if (!smb2_signing_key_valid(signing_key)) {
+		return false;
+	}
+
+	len = iov_buflen(hdr, count);
+	if (len == -1 || (size_t)len < offload_size) {
+		return false;
+	}
+
+	if (pthreadpool_tevent_max_threads(sconn->pool) == 0) {
+		return false;
+	}
+
+	state = talloc_zero(req, struct smbd_smb2_request_encrypt_state);
+	if (state == NULL) {
+		return false;
+	}
+	*state = (struct smbd_smb2_request_encrypt_state) {
+		.req = req,
+		.vector = hdr,
+		.count = count,
+		.sign = true,
+	};
+
+	/*
+	 * The hmac and cipher handles of the session's key are
+	 * used by the main thread, so the worker thread gets its
+	 * own copy.
+	 */
+	status = smb2_signing_key_copy(state, signing_key, &state->key);
+	if (!NT_STATUS_IS_OK(status)) {
+		TALLOC_FREE(state);
+		return false;
+	}
+
+	SMBPROFILE_BYTES_ASYNC_START(smb2_sign,
+				     profile_p,
+				     state->profile,
+				     len);
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->profile);
+
+	subreq = pthreadpool_tevent_job_send(state,
+					     xconn->client->raw_ev_ctx,
+					     sconn->pool,
+					     smbd_smb2_request_encrypt_job,
+					     state);
+	if (subreq == NULL) {
+		SMBPROFILE_BYTES_ASYNC_END(state->profile);
+		TALLOC_FREE(state);
+		return false;
+	}
+	tevent_req_set_callback(subreq, smbd_smb2_request_encrypt_done, state);
+	talloc_set_destructor(state, smbd_smb2_request_encrypt_state_destructor);
+
+	req->queue_entry.encrypting = true;
+	DO_PROFILE_INC(smb2_sign_offload);
+
+	return true;
+}
+
+static void smbd_smb2_request_encrypt_job(void *private_data)
+{
+	struct smbd_smb2_request_encrypt_state *state = talloc_get_type_abort(
+		private_data, struct smbd_smb2_request_encrypt_state);
+
+	SMBPROFILE_BYTES_ASYNC_SET_BUSY(state->profile);
+	if (state->sign) {
+		state->status = smb2_signing_sign_pdu(state->key,
+						      state->vector,
+						      state->count);
+	} else {
+		state->status = smb2_signing_encrypt_pdu(state->key,
+							 state->vector,
+							 state->count);
+	}
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->profile);
+}
+
+static void smbd_smb2_request_encrypt_done(struct tevent_req *subreq)
+{
+	struct smbd_smb2_request_encrypt_state *state = tevent_req_callback_data(
+		subreq, struct smbd_smb2_request_encrypt_state);
+	struct smbd_smb2_request *req = state->req;
+	struct smbXsrv_connection *xconn = req->xconn;
+	NTSTATUS status;
+	int ret;
+
+	ret = pthreadpool_tevent_job_recv(subreq);
+	TALLOC_FREE(subreq);
+	SMBPROFILE_BYTES_ASYNC_END(state->profile);
+	talloc_set_destructor(state, NULL);
+
+	if (ret == EAGAIN) {
+		/*
+		 * We failed to create a worker thread,
+		 * do it in the main thread.
+		 */
+		if (state->sign) {
+			status = smbd_smb2_sign_pdu(state->key,
+						    state->vector,
+						    state->count);
+		} else {
+			status = smbd_smb2_encrypt_pdu(state->key,
+						       state->vector,
+						       state->count);
+		}
+	} else if (ret != 0) {
+		status = map_nt_error_from_unix_common(ret);
+	} else {
+		status = state->status;
+	}
+	TALLOC_FREE(state);
+
+	req->queue_entry.encrypting = false;
+	DLIST_REMOVE(xconn->smb2.requests, req);
+
+	if (!NT_STATUS_IS_OK(xconn->transport.status)) {
+		/*
+		 * smbXsrv_connection_disconnect_transport()
+		 * already removed us from the send queue.
+		 */
+		talloc_free(req);
+		return;
+	}
+
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_server_connection_terminate(xconn, nt_errstr(status));
+		return;
+	}
+
+	status = smbd_smb2_flush_send_queue(xconn);
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_server_connection_terminate(xconn, nt_errstr(status));
+		return;
+	}
+}
+
+static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
+{
+	struct smbXsrv_connection *xconn = req->xconn;
+	int first_idx = 1;
+	struct iovec *firsttf = SMBD_SMB2_IDX_TF_IOV(req,out,first_idx);
+	struct iovec *outhdr = SMBD_SMB2_OUT_HDR_IOV(req);
+	struct iovec *outdyn = SMBD_SMB2_OUT_DYN_IOV(req);
+	NTSTATUS status;
+	bool compressed = false;
+	bool ok;
+
+	req->subreq = NULL;
+	TALLOC_FREE(req->async_te);
+
+	/* MS-SMB2: 3.3.4.1 Sending Any Outgoing Message */
+	smbd_smb2_request_reply_update_counts(req);
+
+	if (req->do_encryption &&
+	    (firsttf->iov_len == 0) &&
+	    (!smb2_signing_key_valid(req->first_enc_key)) &&
+	    (req->session != NULL) &&
+	    smb2_signing_key_valid(req->session->global->encryption_key))
+	{
+		struct smb2_signing_key *encryption_key =
+			req->session->global->encryption_key;
+		uint8_t *tf;
+		uint64_t session_id = req->session->global->session_wire_id;
+		uint64_t nonce_high;
+		uint64_t nonce_low;
+
+		status = smb2_get_new_nonce(req->session,
+					    &nonce_high,
+					    &nonce_low);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+
+		/*
+		 * We need to place the SMB2_TRANSFORM header before the
+		 * first SMB2 header
+		 */
+
+		/*
+		 * we need to remember the encryption key
+		 * and defer the signing/encryption until
+		 * we are sure that we do not change
+		 * the header again.
+		 */
+		status = smb2_signing_key_copy(req,
+					       encryption_key,
+					       &req->first_enc_key);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+
+		tf = talloc_zero_array(req, uint8_t,
+				       SMB2_TF_HDR_SIZE);
+		if (tf == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+
+		SIVAL(tf, SMB2_TF_PROTOCOL_ID, SMB2_TF_MAGIC);
+		SBVAL(tf, SMB2_TF_NONCE+0, nonce_low);
+		SBVAL(tf, SMB2_TF_NONCE+8, nonce_high);
+		SBVAL(tf, SMB2_TF_SESSION_ID, session_id);
+
+		firsttf->iov_base = (void *)tf;
+		firsttf->iov_len = SMB2_TF_HDR_SIZE;
+	}
+
+	if ((req->current_idx > SMBD_SMB2_NUM_IOV_PER_REQ) &&
+	    (smb2_signing_key_valid(req->last_sign_key)) &&
+	    (firsttf->iov_len == 0))
+	{
+		int last_idx = req->current_idx - SMBD_SMB2_NUM_IOV_PER_REQ;
+		struct iovec *lasthdr = SMBD_SMB2_IDX_HDR_IOV(req,out,last_idx);
+
+		/*
+		 * As we are sure the header of the last request in the
+		 * compound chain will not change, we can to sign here
+		 * with the last signing key we remembered.
+		 */
+		status = smbd_smb2_sign_pdu(req->last_sign_key,
+					       lasthdr,
+					       SMBD_SMB2_NUM_IOV_PER_REQ - 1);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+	}
+	TALLOC_FREE(req->last_sign_key);
+
+	SMBPROFILE_IOBYTES_ASYNC_END_X(
+		req->profile,
+		req->profile_x,
+		iov_buflen(outhdr, SMBD_SMB2_NUM_IOV_PER_REQ - 1),
+		PULL_LE_U16(outhdr->iov_base, SMB2_HDR_OPCODE),
+		NT_STATUS(IVAL(outhdr->iov_base, SMB2_HDR_STATUS)));
+
+	req->current_idx += SMBD_SMB2_NUM_IOV_PER_REQ;
+
+	if (req->current_idx < req->out.vector_count) {
+		/*
+		 * We must process the remaining compound
+		 * SMB2 requests before any new incoming SMB2
+		 * requests. This is because incoming SMB2
+		 * requests may include a cancel for a
+		 * compound request we haven't processed
 		 * yet.
 		 */
 		struct tevent_immediate *im = tevent_create_immediate(req);
@@ -3882,6 +4419,11 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 		return NT_STATUS_INVALID_PARAMETER_MIX;
 	}
 
+	SAMBA_TRACEPOINT(smb2_reply,
+			 req,
+			 (req->out.vector_count - first_idx) /
+			 SMBD_SMB2_NUM_IOV_PER_REQ);
+
 	/* Set credit for these operations (zero credits if this
 	   is a final reply for an async operation). */
 	smb2_calculate_credits(req, req);
@@ -3890,22 +4432,40 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 	 * now check if we need to sign the current response
 	 */
 	if (firsttf->iov_len == SMB2_TF_HDR_SIZE) {
-		status = smb2_signing_encrypt_pdu(req->first_enc_key,
+		/*
+		 * If this returns true smbd_smb2_request_encrypt_done()
+		 * releases the queue entry once it's encrypted.
+		 */
+		ok = smbd_smb2_request_encrypt_offload(req,
 					firsttf,
 					req->out.vector_count - first_idx);
-		if (!NT_STATUS_IS_OK(status)) {
-			return status;
+		if (!ok) {
+			status = smbd_smb2_encrypt_pdu(req->first_enc_key,
+					firsttf,
+					req->out.vector_count - first_idx);
+			if (!NT_STATUS_IS_OK(status)) {
+				return status;
+			}
 		}
 	} else if (req->do_signing) {
 		struct smbXsrv_session *x = req->session;
 		struct smb2_signing_key *signing_key =
 			smbd_smb2_signing_key(x, xconn, NULL);
 
-		status = smb2_signing_sign_pdu(signing_key,
-					       outhdr,
-					       SMBD_SMB2_NUM_IOV_PER_REQ - 1);
-		if (!NT_STATUS_IS_OK(status)) {
-			return status;
+		/*
+		 * If this returns true smbd_smb2_request_encrypt_done()
+		 * releases the queue entry once it's signed.
+		 */
+		ok = smbd_smb2_request_sign_offload(req,
+					outhdr,
+					SMBD_SMB2_NUM_IOV_PER_REQ - 1);
+		if (!ok) {
+			status = smbd_smb2_sign_pdu(signing_key,
+					outhdr,
+					SMBD_SMB2_NUM_IOV_PER_REQ - 1);
+			if (!NT_STATUS_IS_OK(status)) {
+				return status;
+			}
 		}
 	}
 	TALLOC_FREE(req->first_enc_key);
@@ -3959,6 +4519,23 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 		req->preauth = NULL;
 	}
 
+	/*
+	 * MS-SMB2: 3.3.4.1.10 Compressing the Message: this happens
+	 * after signing, the client verifies the signature over the
+	 * decompressed message.
+	 */
+	status = smbd_smb2_request_compress(req, &compressed);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+	if (compressed) {
+		ok = smb2_setup_nbt_length(req->out.vector,
+					   req->out.vector_count);
+		if (!ok) {
+			return NT_STATUS_INVALID_PARAMETER_MIX;
+		}
+	}
+
 	/* I am a sick, sick man... :-). Sendfile hack ... JRA. */
 	if (req->out.vector_count < (2*SMBD_SMB2_NUM_IOV_PER_REQ) &&
 	    outdyn->iov_base == NULL && outdyn->iov_len != 0) {
@@ -3967,11 +4544,20 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 		req->out.vector_count -= 1;
 	}
 
+	/* Give the scheduling slot to the next queued request */
+	smbd_smb2_qos_request_done(req);
+
 	/*
 	 * We're done with this request -
 	 * move it off the "being processed" queue.
+	 *
+	 * While a worker thread encrypts or signs the response
+	 * smbd_smb2_request_encrypt_done() does this,
+	 * so that a connection shutdown waits for it.
 	 */
-	DLIST_REMOVE(xconn->smb2.requests, req);
+	if (!req->queue_entry.encrypting) {
+		DLIST_REMOVE(xconn->smb2.requests, req);
+	}
 
 	req->queue_entry.mem_ctx = req;
 	req->queue_entry.vector = req->out.vector;
@@ -3979,7 +4565,7 @@ static NTSTATUS smbd_smb2_request_reply(struct smbd_smb2_request *req)
 	DLIST_ADD_END(xconn->smb2.send_queue, &req->queue_entry);
 	xconn->smb2.send_queue_len++;
 
-	status = smbd_smb2_flush_send_queue(xconn);
+	status = smbd_smb2_flush_send_queue_batched(xconn);
 	if (!NT_STATUS_IS_OK(status)) {
 		return status;
 	}
@@ -4043,6 +4629,13 @@ NTSTATUS smbd_smb2_request_done_ex(struct smbd_smb2_request *req,
 		  (unsigned int)(dyn ? dyn->length : 0),
 		  location);
 
+	SAMBA_TRACEPOINT(smb2_request_done,
+			 req,
+			 mid,
+			 SVAL(outhdr, SMB2_HDR_OPCODE),
+			 NT_STATUS_V(status),
+			 body.length + (dyn ? dyn->length : 0));
+
 	if (body.length < 2) {
 		return smbd_smb2_request_error(req, NT_STATUS_INTERNAL_ERROR);
 	}
@@ -4637,7 +5230,17 @@ static bool is_smb2_recvfile_write(struct smbd_smb2_request_read_state *state)
 		return false;
 	}
 	if (flags & SMB2_HDR_FLAG_SIGNED) {
-		/* Signed. Cannot recvfile. */
+		/*
+		 * Signed. Cannot recvfile.
+		 *
+		 * The signature covers the data and has to be checked
+		 * before any of it reaches the file, so the whole payload
+		 * has to be buffered somewhere first anyway. Staging it
+		 * in a pipe doesn't help: sys_recvfile() copies through a
+		 * userspace buffer (splice to files is disabled), so the
+		 * data would be copied into userspace just as often as
+		 * with the normal read path.
+		 */
 		return false;
 	}
 
@@ -4679,6 +5282,22 @@ static bool is_smb2_recvfile_write(struct smbd_smb2_request_read_state *state)
 	return true;
 }
 
+static size_t smbd_smb2_min_recv_size(struct smbXsrv_connection *xconn)
+{
+	if ((xconn->transport.io_uring != NULL) ||
+	    (xconn->smb2.recv_buf.buf != NULL))
+	{
+		/*
+		 * The data is already in a buffer provided
+		 * to the kernel or our receive buffer,
+		 * there's nothing to gain from recvfile.
+		 */
+		return 0;
+	}
+
+	return lp_min_receive_file_size();
+}
+
 static NTSTATUS smbd_smb2_request_next_incoming(struct smbXsrv_connection *xconn)
 {
 	struct smbd_smb2_request_read_state *state = &xconn->smb2.request_read_state;
@@ -4701,6 +5320,14 @@ static NTSTATUS smbd_smb2_request_next_incoming(struct smbXsrv_connection *xconn
 		return NT_STATUS_OK;
 	}
 
+	if (xconn->smb2.crypto.pending != NULL) {
+		/*
+		 * smbd_smb2_request_decrypt_done() will
+		 * call us again.
+		 */
+		return NT_STATUS_OK;
+	}
+
 	max_send_queue_len = MAX(1, xconn->smb2.credits.max/16);
 	cur_send_queue_len = xconn->smb2.send_queue_len;
 
@@ -4720,7 +5347,7 @@ static NTSTATUS smbd_smb2_request_next_incoming(struct smbXsrv_connection *xconn
 	}
 	*state = (struct smbd_smb2_request_read_state) {
 		.req = req,
-		.min_recv_size = lp_min_receive_file_size(),
+		.min_recv_size = smbd_smb2_min_recv_size(xconn),
 		._vector = {
 			[0] = (struct iovec) {
 				.iov_base = (void *)state->hdr.nbt,
@@ -4731,6 +5358,27 @@ static NTSTATUS smbd_smb2_request_next_incoming(struct smbXsrv_connection *xconn
 		.count = 1,
 	};
 
+#ifdef HAVE_IO_URING_SETUP_BUF_RING
+	if (xconn->transport.io_uring != NULL) {
+		return smbd_io_uring_conn_recv(xconn);
+	}
+#endif /* HAVE_IO_URING_SETUP_BUF_RING */
+
+	if (xconn->smb2.recv_buf.len > 0) {
+		if (!xconn->smb2.recv_buf.feeding) {
+			/*
+			 * We still have bytes from the last receive,
+			 * process them outside of the current call stack.
+			 */
+			tevent_schedule_immediate(
+				xconn->smb2.recv_buf.im,
+				xconn->client->raw_ev_ctx,
+				smbd_smb2_recv_buf_feed_immediate,
+				xconn);
+		}
+		return NT_STATUS_OK;
+	}
+
 	TEVENT_FD_READABLE(xconn->transport.fde);
 
 	return NT_STATUS_OK;
@@ -4897,7 +5545,121 @@ static NTSTATUS smbd_smb2_advance_send_queue(struct smbXsrv_connection *xconn,
 	return NT_STATUS_OK;
 }
 
-static NTSTATUS smbd_smb2_flush_with_sendmsg(struct smbXsrv_connection *xconn)
+static NTSTATUS smbd_smb2_send_queue_sendfile(struct smbXsrv_connection *xconn,
+					      struct smbd_smb2_send_queue *e)
+{
+	size_t size = 0;
+	size_t i = 0;
+	uint8_t *buf;
+	NTSTATUS status = NT_STATUS_INTERNAL_ERROR;
+
+	for (i=0; i < e->count; i++) {
+		size += e->vector[i].iov_len;
+	}
+
+	if (size <= e->sendfile_header->length) {
+		buf = e->sendfile_header->data;
+	} else {
+		buf = talloc_array(e->mem_ctx, uint8_t, size);
+		if (buf == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+	}
+
+	size = 0;
+	for (i=0; i < e->count; i++) {
+		memcpy(buf+size,
+		       e->vector[i].iov_base,
+		       e->vector[i].iov_len);
+		size += e->vector[i].iov_len;
+	}
+
+	e->sendfile_header->data = buf;
+	e->sendfile_header->length = size;
+	e->sendfile_status = &status;
+	e->count = 0;
+
+	xconn->smb2.send_queue_len--;
+	DLIST_REMOVE(xconn->smb2.send_queue, e);
+
+	size += e->sendfile_body_size;
+
+	/*
+	 * This triggers the sendfile path via
+	 * the destructor.
+	 */
+	talloc_free(e->mem_ctx);
+
+	if (!NT_STATUS_IS_OK(status)) {
+		smbXsrv_connection_disconnect_transport(xconn,
+							status);
+		return status;
+	}
+	xconn->ack.unacked_bytes += size;
+	return NT_STATUS_OK;
+}
+
+/*
+ * Gather the iovecs of the plain responses at the start of the
+ * send queue, they go out with a single sendmsg().
+ */
+static size_t smbd_smb2_send_batch_prepare(struct smbXsrv_connection *xconn,
+					   struct msghdr *msg)
+{
+	struct smbd_smb2_send_queue *e = NULL;
+	struct iovec *iov = xconn->smb2.send_batch.iov;
+	size_t num_iov = 0;
+	size_t num_responses = 0;
+
+	for (e = xconn->smb2.send_queue; e != NULL; e = e->next) {
+		if (e->encrypting || (e->sendfile_header != NULL)) {
+			break;
+		}
+		if (num_iov + e->count > SMBD_SMB2_SEND_BATCH_MAX_IOV) {
+			break;
+		}
+		memcpy(iov + num_iov, e->vector, e->count * sizeof(*iov));
+		num_iov += e->count;
+		num_responses += 1;
+	}
+
+	*msg = (struct msghdr) {
+		.msg_iov = iov,
+		.msg_iovlen = num_iov,
+	};
+
+	return num_responses;
+}
+
+/*
+ * Distribute the bytes sent with a batch over the queue entries
+ */
+static NTSTATUS smbd_smb2_send_batch_advance(struct smbXsrv_connection *xconn,
+					     size_t n)
+{
+	NTSTATUS status = NT_STATUS_OK;
+
+	while (n > 0) {
+		struct smbd_smb2_send_queue *e = xconn->smb2.send_queue;
+		size_t todo;
+
+		if (e == NULL) {
+			return NT_STATUS_INTERNAL_ERROR;
+		}
+
+		todo = MIN(n, iov_buflen(e->vector, e->count));
+		n -= todo;
+
+		status = smbd_smb2_advance_send_queue(xconn, &e, todo);
+		if (!NT_STATUS_IS_OK(status)) {
+			break;
+		}
+	}
+
+	return status;
+}
+
+static NTSTATUS smbd_smb2_flush_with_sendmsg(struct smbXsrv_connection *xconn)
 {
 	int ret;
 	int err;
@@ -4913,6 +5675,15 @@ static NTSTATUS smbd_smb2_flush_with_sendmsg(struct smbXsrv_connection *xconn)
 		struct smbd_smb2_send_queue *e = xconn->smb2.send_queue;
 		unsigned sendmsg_flags = 0;
 
+		if (e->encrypting) {
+			/*
+			 * smbd_smb2_request_encrypt_done()
+			 * continues.
+			 */
+			TEVENT_FD_NOT_WRITEABLE(xconn->transport.fde);
+			return NT_STATUS_OK;
+		}
+
 		if (!NT_STATUS_IS_OK(xconn->transport.status)) {
 			/*
 			 * we're not supposed to do any io
@@ -4925,135 +5696,668 @@ static NTSTATUS smbd_smb2_flush_with_sendmsg(struct smbXsrv_connection *xconn)
 			continue;
 		}
 
-		if (e->sendfile_header != NULL) {
-			size_t size = 0;
-			size_t i = 0;
-			uint8_t *buf;
+#ifdef HAVE_IO_URING_SETUP_BUF_RING
+		if (xconn->transport.io_uring != NULL &&
+		    smbd_io_uring_conn_send_busy(xconn))
+		{
+			/*
+			 * smbd_smb2_io_uring_sent() continues
+			 * once the current send is done.
+			 */
+			return NT_STATUS_OK;
+		}
+#endif /* HAVE_IO_URING_SETUP_BUF_RING */
 
-			status = NT_STATUS_INTERNAL_ERROR;
+		if (e->sendfile_header != NULL) {
+#ifdef HAVE_IO_URING_SETUP_BUF_RING
+			if (xconn->transport.io_uring != NULL) {
+				status = smbd_io_uring_conn_sendfile(xconn, e);
+				if (NT_STATUS_IS_OK(status)) {
+					/*
+					 * smbd_smb2_io_uring_sendfile_done()
+					 * continues.
+					 */
+					return NT_STATUS_OK;
+				}
+				if (!NT_STATUS_EQUAL(status,
+						     NT_STATUS_NOT_SUPPORTED))
+				{
+					smbXsrv_connection_disconnect_transport(
+						xconn, status);
+					return status;
+				}
+			}
+#endif /* HAVE_IO_URING_SETUP_BUF_RING */
 
-			for (i=0; i < e->count; i++) {
-				size += e->vector[i].iov_len;
+			status = smbd_smb2_send_queue_sendfile(xconn, e);
+			if (!NT_STATUS_IS_OK(status)) {
+				return status;
 			}
+			continue;
+		}
 
-			if (size <= e->sendfile_header->length) {
-				buf = e->sendfile_header->data;
-			} else {
-				buf = talloc_array(e->mem_ctx, uint8_t, size);
-				if (buf == NULL) {
-					return NT_STATUS_NO_MEMORY;
+#ifdef MSG_NOSIGNAL
+		sendmsg_flags |= MSG_NOSIGNAL;
+#endif
+#ifdef MSG_DONTWAIT
+		sendmsg_flags |= MSG_DONTWAIT;
+#endif
+
+		if ((xconn->smb2.send_batch.iov != NULL) && (e->next != NULL)) {
+			struct msghdr msg;
+			size_t num_responses;
+
+			num_responses = smbd_smb2_send_batch_prepare(xconn,
+								     &msg);
+			if (num_responses > 1) {
+				ret = sendmsg(xconn->transport.sock,
+					      &msg,
+					      sendmsg_flags);
+				if (ret == 0) {
+					/* propagate end of file */
+					return NT_STATUS_INTERNAL_ERROR;
+				}
+				err = socket_error_from_errno(ret, errno, &retry);
+				if (retry) {
+					/* retry later */
+					TEVENT_FD_WRITEABLE(xconn->transport.fde);
+					return NT_STATUS_OK;
+				}
+				if (err != 0) {
+					status = map_nt_error_from_unix_common(err);
+					smbXsrv_connection_disconnect_transport(
+						xconn, status);
+					return status;
+				}
+
+				DO_PROFILE_INC(smb2_send_calls);
+				SMBPROFILE_COUNT_INCREMENT(smb2_send_responses,
+							   profile_p,
+							   num_responses);
+
+				status = smbd_smb2_send_batch_advance(xconn, ret);
+				if (NT_STATUS_EQUAL(status, NT_STATUS_RETRY)) {
+					/* retry later */
+					TEVENT_FD_WRITEABLE(xconn->transport.fde);
+					return NT_STATUS_OK;
 				}
+				if (!NT_STATUS_IS_OK(status)) {
+					smbXsrv_connection_disconnect_transport(
+						xconn, status);
+					return status;
+				}
+				continue;
 			}
+		}
+
+		e->msg = (struct msghdr) {
+			.msg_iov = e->vector,
+			.msg_iovlen = e->count,
+		};
 
-			size = 0;
-			for (i=0; i < e->count; i++) {
-				memcpy(buf+size,
-				       e->vector[i].iov_base,
-				       e->vector[i].iov_len);
-				size += e->vector[i].iov_len;
+#ifdef HAVE_IO_URING_SETUP_BUF_RING
+		if (xconn->transport.io_uring != NULL) {
+			status = smbd_io_uring_conn_sendmsg(xconn, &e->msg);
+			if (!NT_STATUS_IS_OK(status)) {
+				smbXsrv_connection_disconnect_transport(xconn,
+									status);
+				return status;
 			}
+			return NT_STATUS_OK;
+		}
+#endif /* HAVE_IO_URING_SETUP_BUF_RING */
 
-			e->sendfile_header->data = buf;
-			e->sendfile_header->length = size;
-			e->sendfile_status = &status;
-			e->count = 0;
+		ret = sendmsg(xconn->transport.sock, &e->msg, sendmsg_flags);
+		if (ret == 0) {
+			/* propagate end of file */
+			return NT_STATUS_INTERNAL_ERROR;
+		}
+		err = socket_error_from_errno(ret, errno, &retry);
+		if (retry) {
+			/* retry later */
+			TEVENT_FD_WRITEABLE(xconn->transport.fde);
+			return NT_STATUS_OK;
+		}
+		if (err != 0) {
+			status = map_nt_error_from_unix_common(err);
+			smbXsrv_connection_disconnect_transport(xconn,
+								status);
+			return status;
+		}
 
-			xconn->smb2.send_queue_len--;
-			DLIST_REMOVE(xconn->smb2.send_queue, e);
+		DO_PROFILE_INC(smb2_send_calls);
+		DO_PROFILE_INC(smb2_send_responses);
+
+		status = smbd_smb2_advance_send_queue(xconn, &e, ret);
+		if (NT_STATUS_EQUAL(status, NT_STATUS_RETRY)) {
+			/* retry later */
+			TEVENT_FD_WRITEABLE(xconn->transport.fde);
+			return NT_STATUS_OK;
+		}
+		if (!NT_STATUS_IS_OK(status)) {
+			smbXsrv_connection_disconnect_transport(xconn,
+								status);
+			return status;
+		}
+	}
+
+	return NT_STATUS_MORE_PROCESSING_REQUIRED;
+}
+
+static NTSTATUS smbd_smb2_flush_send_queue(struct smbXsrv_connection *xconn)
+{
+	NTSTATUS status;
+
+	status = smbd_smb2_flush_with_sendmsg(xconn);
+	if (!NT_STATUS_EQUAL(status, NT_STATUS_MORE_PROCESSING_REQUIRED)) {
+		return status;
+	}
+
+	/*
+	 * Restart reads if we were blocked on
+	 * draining the send queue.
+	 */
+
+	status = smbd_smb2_request_next_incoming(xconn);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
+	return NT_STATUS_OK;
+}
+
+static void smbd_smb2_send_batch_immediate(struct tevent_context *ev,
+					   struct tevent_immediate *im,
+					   void *private_data)
+{
+	struct smbXsrv_connection *xconn =
+		talloc_get_type_abort(private_data,
+		struct smbXsrv_connection);
+	NTSTATUS status;
+
+	status = smbd_smb2_flush_send_queue(xconn);
+	if (!NT_STATUS_IS_OK(status)) {
+		smbd_server_connection_terminate(xconn, nt_errstr(status));
+		return;
+	}
+}
+
+/*
+ * Used for the replies: while smbd_smb2_recv_buf_feed() processes
+ * received PDUs, or with "smbd:send batch responses" also until the
+ * end of the current event loop iteration, the responses are
+ * collected and sent together.
+ */
+static NTSTATUS smbd_smb2_flush_send_queue_batched(
+	struct smbXsrv_connection *xconn)
+{
+	size_t max_batch = SMBD_SMB2_SEND_BATCH_MAX_IOV /
+		(1 + SMBD_SMB2_NUM_IOV_PER_REQ);
+
+	if ((xconn->smb2.send_batch.iov == NULL) ||
+	    (xconn->smb2.send_queue_len >= max_batch))
+	{
+		return smbd_smb2_flush_send_queue(xconn);
+	}
+
+	if (xconn->smb2.recv_buf.feeding) {
+		/*
+		 * smbd_smb2_recv_buf_feed() flushes
+		 */
+		DO_PROFILE_INC(smb2_send_deferred);
+		return NT_STATUS_OK;
+	}
+
+	if (xconn->smb2.send_queue_len < xconn->smb2.send_batch.cork) {
+		DO_PROFILE_INC(smb2_send_deferred);
+		tevent_schedule_immediate(xconn->smb2.send_batch.im,
+					  xconn->client->raw_ev_ctx,
+					  smbd_smb2_send_batch_immediate,
+					  xconn);
+		return NT_STATUS_OK;
+	}
+
+	return smbd_smb2_flush_send_queue(xconn);
+}
+
+static NTSTATUS smbd_smb2_io_uring_continue(struct smbXsrv_connection *xconn)
+{
+	if (xconn->smb2.send_queue == NULL) {
+		/*
+		 * Restart reads if we were blocked on
+		 * draining the send queue.
+		 */
+		return smbd_smb2_request_next_incoming(xconn);
+	}
+
+	/*
+	 * Send the rest of the current entry or the next one.
+	 */
+	return smbd_smb2_flush_send_queue(xconn);
+}
+
+NTSTATUS smbd_smb2_io_uring_sent(struct smbXsrv_connection *xconn, int ret)
+{
+	struct smbd_smb2_send_queue *e = xconn->smb2.send_queue;
+	int err;
+	bool retry;
+	NTSTATUS status;
+
+	if (!NT_STATUS_IS_OK(xconn->transport.status)) {
+		/*
+		 * we're not supposed to do any io
+		 */
+		return NT_STATUS_OK;
+	}
+
+	if (e == NULL) {
+		return NT_STATUS_INTERNAL_ERROR;
+	}
+
+	if (ret == 0) {
+		/* propagate end of file */
+		return NT_STATUS_INTERNAL_ERROR;
+	}
+	if (ret < 0) {
+		err = socket_error_from_errno(-1, -ret, &retry);
+		if (retry) {
+			return smbd_smb2_flush_send_queue(xconn);
+		}
+		status = map_nt_error_from_unix_common(err);
+		smbXsrv_connection_disconnect_transport(xconn, status);
+		return status;
+	}
+
+	status = smbd_smb2_advance_send_queue(xconn, &e, ret);
+	if (!NT_STATUS_IS_OK(status) &&
+	    !NT_STATUS_EQUAL(status, NT_STATUS_RETRY))
+	{
+		smbXsrv_connection_disconnect_transport(xconn, status);
+		return status;
+	}
+
+	return smbd_smb2_io_uring_continue(xconn);
+}
+
+NTSTATUS smbd_smb2_io_uring_sendfile_done(struct smbXsrv_connection *xconn,
+					  NTSTATUS status,
+					  size_t sent)
+{
+	struct smbd_smb2_send_queue *e = xconn->smb2.send_queue;
+
+	if (!NT_STATUS_IS_OK(xconn->transport.status)) {
+		/*
+		 * we're not supposed to do any io
+		 */
+		return NT_STATUS_OK;
+	}
+
+	if (e == NULL || e->sendfile_header == NULL) {
+		return NT_STATUS_INTERNAL_ERROR;
+	}
+
+	if (NT_STATUS_EQUAL(status, NT_STATUS_NOT_SUPPORTED)) {
+		/*
+		 * Nothing was sent, fallback
+		 * to SMB_VFS_SENDFILE().
+		 */
+		status = smbd_smb2_send_queue_sendfile(xconn, e);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+		return smbd_smb2_io_uring_continue(xconn);
+	}
+
+	if (!NT_STATUS_IS_OK(status)) {
+		smbXsrv_connection_disconnect_transport(xconn, status);
+		return status;
+	}
+
+	e->count = 0;
+	xconn->smb2.send_queue_len--;
+	DLIST_REMOVE(xconn->smb2.send_queue, e);
+
+	/*
+	 * e->sendfile_status is NULL, so the
+	 * destructor doesn't send anything.
+	 */
+	talloc_free(e->mem_ctx);
+
+	xconn->ack.unacked_bytes += sent;
+
+	return smbd_smb2_io_uring_continue(xconn);
+}
+
+static NTSTATUS smbd_smb2_request_process_incoming(
+	struct smbXsrv_connection *xconn,
+	struct smbd_smb2_request *req,
+	uint8_t *pktbuf,
+	size_t pktlen,
+	size_t unread_bytes,
+	bool decrypted)
+{
+	struct smbd_server_connection *sconn = xconn->client->sconn;
+	NTSTATUS status;
+	NTTIME now;
+
+	req->request_time = timeval_current();
+	now = timeval_to_nttime(&req->request_time);
+
+	status = smbd_smb2_inbuf_parse_compound(xconn,
+						now,
+						pktbuf,
+						pktlen,
+						decrypted,
+						req,
+						&req->in.vector,
+						&req->in.vector_count);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
+	if (unread_bytes != 0) {
+		req->smb1req = talloc_zero(req, struct smb_request);
+		if (req->smb1req == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+		req->smb1req->unread_bytes = unread_bytes;
+	}
+
+	req->current_idx = 1;
+
+	DEBUG(10,("smbd_smb2_request idx[%d] of %d vectors\n",
+		 req->current_idx, req->in.vector_count));
+
+	status = smbd_smb2_request_validate(req);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
+	status = smbd_smb2_request_setup_out(req);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
+	status = smbd_smb2_request_dispatch(req);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
+	sconn->num_requests++;
+
+	/* The timeout_processing function isn't run nearly
+	   often enough to implement 'max log size' without
+	   overrunning the size of the file by many megabytes.
+	   This is especially true if we are running at debug
+	   level 10.  Checking every 50 SMB2s is a nice
+	   tradeoff of performance vs log file size overrun. */
+
+	if ((sconn->num_requests % 50) == 0 &&
+	    need_to_check_log_size()) {
+		change_to_root_user();
+		check_log_size();
+	}
+
+	status = smbd_smb2_request_next_incoming(xconn);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
+	return NT_STATUS_OK;
+}
+
+struct smbd_smb2_request_decrypt_state {
+	struct smbXsrv_connection *xconn;
+	struct smbd_smb2_request *req;
+	uint8_t *pktbuf;
+	size_t pktlen;
+	struct smb2_signing_key *key;
+	struct iovec tf_iov[2];
+	NTSTATUS status;
+	SMBPROFILE_BYTES_ASYNC_STATE(profile);
+};
+
+static int smbd_smb2_request_decrypt_state_destructor(
+	struct smbd_smb2_request_decrypt_state *state)
+{
+	return -1;
+}
+
+static void smbd_smb2_request_decrypt_job(void *private_data);
+static void smbd_smb2_request_decrypt_done(struct tevent_req *subreq);
+
+/*
+ * With "smb2 channel threads" the decryption of an incoming
+ * SMB2_TRANSFORM frame is done by a worker thread private to the
+ * channel, so that the main event loop can serve the other channels
+ * of the client in the meantime.
+ *
+ * We stop reading from the socket until the worker is done, this
+ * keeps the requests of a channel in order. Everything that is not
+ * the standard case of a single GCM transform covering the whole
+ * frame with a known session takes the synchronous path in
+ * smbd_smb2_inbuf_parse_compound(), which also generates the errors.
+ */
+static bool smbd_smb2_request_decrypt_offload(struct smbXsrv_connection *xconn)
+{
+	struct smbd_smb2_request_read_state *rstate =
+		&xconn->smb2.request_read_state;
+	struct smbd_smb2_request_decrypt_state *state = NULL;
+	struct smbXsrv_session *session = NULL;
+	struct smb2_signing_key *key = NULL;
+	struct tevent_req *subreq = NULL;
+	uint8_t *tf = rstate->pktbuf;
+	struct timeval tv = timeval_current();
+	size_t offload_size = lp_smb2_encryption_offload_size();
+	uint64_t session_id;
+	uint32_t enc_len;
+	NTSTATUS status;
+	int ret;
+
+	if (!lp_smb2_channel_threads() && offload_size == 0) {
+		return false;
+	}
+	if (rstate->doing_receivefile) {
+		return false;
+	}
+	if (xconn->protocol < PROTOCOL_SMB3_00) {
+		return false;
+	}
+	if (!xconn->smb2.got_authenticated_session) {
+		return false;
+	}
+	switch (xconn->smb2.server.cipher) {
+	case SMB2_ENCRYPTION_AES128_GCM:
+	case SMB2_ENCRYPTION_AES256_GCM:
+		break;
+	default:
+		/*
+		 * The CCM ciphers may need temporary
+		 * talloc buffers, see smb2_signing_decrypt_pdu().
+		 */
+		return false;
+	}
+	if (rstate->pktlen < SMB2_TF_HDR_SIZE) {
+		return false;
+	}
+	if (IVAL(tf, 0) != SMB2_TF_MAGIC) {
+		return false;
+	}
+	enc_len = IVAL(tf, SMB2_TF_MSG_SIZE);
+	if (rstate->pktlen != SMB2_TF_HDR_SIZE + (size_t)enc_len) {
+		return false;
+	}
+	if (enc_len < offload_size) {
+		return false;
+	}
 
-			size += e->sendfile_body_size;
+	session_id = BVAL(tf, SMB2_TF_SESSION_ID);
+	status = smb2srv_session_lookup_conn(xconn,
+					     session_id,
+					     timeval_to_nttime(&tv),
+					     &session);
+	if (!NT_STATUS_IS_OK(status)) {
+		return false;
+	}
+	key = session->global->decryption_key;
+	if (!smb2_signing_key_valid(key)) {
+		return false;
+	}
 
-			/*
-			 * This triggers the sendfile path via
-			 * the destructor.
-			 */
-			talloc_free(e->mem_ctx);
+	if (xconn->smb2.crypto.pool == NULL) {
+		ret = pthreadpool_tevent_init(xconn,
+					      1,
+					      &xconn->smb2.crypto.pool);
+		if (ret != 0) {
+			DBG_WARNING("pthreadpool_tevent_init() failed: %s\n",
+				    strerror(ret));
+			return false;
+		}
+	}
 
-			if (!NT_STATUS_IS_OK(status)) {
-				smbXsrv_connection_disconnect_transport(xconn,
-									status);
-				return status;
-			}
-			xconn->ack.unacked_bytes += size;
-			continue;
+	if (xconn->smb2.crypto.decryption_key == NULL ||
+	    xconn->smb2.crypto.session_id != session_id ||
+	    xconn->smb2.crypto.decryption_key->cipher_algo_id !=
+	    key->cipher_algo_id ||
+	    !data_blob_equal_const_time(
+		    &xconn->smb2.crypto.decryption_key->blob, &key->blob))
+	{
+		/*
+		 * Nothing is in flight,
+		 * so we can replace the key.
+		 */
+		TALLOC_FREE(xconn->smb2.crypto.decryption_key);
+		status = smb2_signing_key_copy(xconn,
+					       key,
+					       &xconn->smb2.crypto.decryption_key);
+		if (!NT_STATUS_IS_OK(status)) {
+			return false;
 		}
+		xconn->smb2.crypto.session_id = session_id;
+	}
 
-		e->msg = (struct msghdr) {
-			.msg_iov = e->vector,
-			.msg_iovlen = e->count,
-		};
+	state = talloc_zero(xconn, struct smbd_smb2_request_decrypt_state);
+	if (state == NULL) {
+		return false;
+	}
+	*state = (struct smbd_smb2_request_decrypt_state) {
+		.xconn = xconn,
+		.req = rstate->req,
+		.pktbuf = talloc_move(state, &rstate->pktbuf),
+		.pktlen = rstate->pktlen,
+		.key = xconn->smb2.crypto.decryption_key,
+		.tf_iov = {
+			[0] = {
+				.iov_base = (void *)tf,
+				.iov_len = SMB2_TF_HDR_SIZE,
+			},
+			[1] = {
+				.iov_base = (void *)(tf + SMB2_TF_HDR_SIZE),
+				.iov_len = enc_len,
+			},
+		},
+	};
 
-#ifdef MSG_NOSIGNAL
-		sendmsg_flags |= MSG_NOSIGNAL;
-#endif
-#ifdef MSG_DONTWAIT
-		sendmsg_flags |= MSG_DONTWAIT;
-#endif
+	SMBPROFILE_BYTES_ASYNC_START(smb2_decrypt,
+				     profile_p,
+				     state->profile,
+				     enc_len);
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->profile);
+
+	subreq = pthreadpool_tevent_job_send(state,
+					     xconn->client->raw_ev_ctx,
+					     xconn->smb2.crypto.pool,
+					     smbd_smb2_request_decrypt_job,
+					     state);
+	if (subreq == NULL) {
+		SMBPROFILE_BYTES_ASYNC_END(state->profile);
+		rstate->pktbuf = talloc_move(rstate->req, &state->pktbuf);
+		TALLOC_FREE(state);
+		return false;
+	}
+	tevent_req_set_callback(subreq, smbd_smb2_request_decrypt_done, state);
+	talloc_set_destructor(state, smbd_smb2_request_decrypt_state_destructor);
 
-		ret = sendmsg(xconn->transport.sock, &e->msg, sendmsg_flags);
-		if (ret == 0) {
-			/* propagate end of file */
-			return NT_STATUS_INTERNAL_ERROR;
-		}
-		err = socket_error_from_errno(ret, errno, &retry);
-		if (retry) {
-			/* retry later */
-			TEVENT_FD_WRITEABLE(xconn->transport.fde);
-			return NT_STATUS_OK;
-		}
-		if (err != 0) {
-			status = map_nt_error_from_unix_common(err);
-			smbXsrv_connection_disconnect_transport(xconn,
-								status);
-			return status;
-		}
+	xconn->smb2.crypto.pending = subreq;
+	DO_PROFILE_INC(smb2_decrypt_offload);
 
-		status = smbd_smb2_advance_send_queue(xconn, &e, ret);
-		if (NT_STATUS_EQUAL(status, NT_STATUS_RETRY)) {
-			/* retry later */
-			TEVENT_FD_WRITEABLE(xconn->transport.fde);
-			return NT_STATUS_OK;
-		}
-		if (!NT_STATUS_IS_OK(status)) {
-			smbXsrv_connection_disconnect_transport(xconn,
-								status);
-			return status;
-		}
-	}
+	*rstate = (struct smbd_smb2_request_read_state) {
+		.req = NULL,
+	};
 
-	return NT_STATUS_MORE_PROCESSING_REQUIRED;
+	return true;
 }
 
-static NTSTATUS smbd_smb2_flush_send_queue(struct smbXsrv_connection *xconn)
+static void smbd_smb2_request_decrypt_job(void *private_data)
+{
+	struct smbd_smb2_request_decrypt_state *state = talloc_get_type_abort(
+		private_data, struct smbd_smb2_request_decrypt_state);
+
+	SMBPROFILE_BYTES_ASYNC_SET_BUSY(state->profile);
+	state->status = smb2_signing_decrypt_pdu(state->key,
+						 state->tf_iov,
+						 ARRAY_SIZE(state->tf_iov));
+	SMBPROFILE_BYTES_ASYNC_SET_IDLE(state->profile);
+}
+
+static void smbd_smb2_request_decrypt_done(struct tevent_req *subreq)
 {
+	struct smbd_smb2_request_decrypt_state *state = tevent_req_callback_data(
+		subreq, struct smbd_smb2_request_decrypt_state);
+	struct smbXsrv_connection *xconn = state->xconn;
+	struct smbd_smb2_request *req = state->req;
+	uint8_t *pktbuf = NULL;
+	size_t pktlen = state->pktlen;
 	NTSTATUS status;
+	int ret;
 
-	status = smbd_smb2_flush_with_sendmsg(xconn);
-	if (!NT_STATUS_EQUAL(status, NT_STATUS_MORE_PROCESSING_REQUIRED)) {
-		return status;
-	}
+	ret = pthreadpool_tevent_job_recv(subreq);
+	TALLOC_FREE(subreq);
+	SMBPROFILE_BYTES_ASYNC_END(state->profile);
+	xconn->smb2.crypto.pending = NULL;
+	talloc_set_destructor(state, NULL);
 
-	/*
-	 * Restart reads if we were blocked on
-	 * draining the send queue.
-	 */
+	pktbuf = talloc_move(req, &state->pktbuf);
+	if (ret == 0) {
+		status = state->status;
+	} else {
+		status = map_nt_error_from_unix_common(ret);
+	}
+	TALLOC_FREE(state);
 
-	status = smbd_smb2_request_next_incoming(xconn);
+	if (ret == EAGAIN) {
+		/*
+		 * We failed to create the worker thread,
+		 * do it in the main thread.
+		 */
+		status = smbd_smb2_request_process_incoming(xconn,
+							    req,
+							    pktbuf,
+							    pktlen,
+							    0,
+							    false);
+	} else if (NT_STATUS_IS_OK(status)) {
+		status = smbd_smb2_request_process_incoming(xconn,
+							    req,
+							    pktbuf,
+							    pktlen,
+							    0,
+							    true);
+	}
 	if (!NT_STATUS_IS_OK(status)) {
-		return status;
+		smbd_server_connection_terminate(xconn, nt_errstr(status));
+		return;
 	}
-
-	return NT_STATUS_OK;
 }
 
 static NTSTATUS smbd_smb2_advance_incoming(struct smbXsrv_connection *xconn, size_t n)
 {
-	struct smbd_server_connection *sconn = xconn->client->sconn;
 	struct smbd_smb2_request_read_state *state = &xconn->smb2.request_read_state;
 	struct smbd_smb2_request *req = NULL;
+	uint8_t *pktbuf = NULL;
+	size_t pktlen;
+	size_t unread_bytes = 0;
 	size_t min_recvfile_size = UINT32_MAX;
-	NTSTATUS status;
-	NTTIME now;
 	bool ok;
 
 	ok = iov_advance(&state->vector, &state->count, n);
@@ -5162,7 +6466,7 @@ got_full:
 		req = state->req;
 		*state = (struct smbd_smb2_request_read_state) {
 			.req = req,
-			.min_recv_size = lp_min_receive_file_size(),
+			.min_recv_size = smbd_smb2_min_recv_size(xconn),
 			._vector = {
 				[0] = (struct iovec) {
 					.iov_base = (void *)state->hdr.nbt,
@@ -5175,74 +6479,200 @@ got_full:
 		return NT_STATUS_RETRY;
 	}
 
-	req = state->req;
-
-	req->request_time = timeval_current();
-	now = timeval_to_nttime(&req->request_time);
-
-	status = smbd_smb2_inbuf_parse_compound(xconn,
-						now,
-						state->pktbuf,
-						state->pktlen,
-						req,
-						&req->in.vector,
-						&req->in.vector_count);
-	if (!NT_STATUS_IS_OK(status)) {
-		return status;
+	if (smbd_smb2_request_decrypt_offload(xconn)) {
+		/*
+		 * smbd_smb2_request_decrypt_done() continues
+		 */
+		return NT_STATUS_OK;
 	}
 
+	req = state->req;
+	pktbuf = state->pktbuf;
+	pktlen = state->pktlen;
 	if (state->doing_receivefile) {
-		req->smb1req = talloc_zero(req, struct smb_request);
-		if (req->smb1req == NULL) {
-			return NT_STATUS_NO_MEMORY;
-		}
-		req->smb1req->unread_bytes = state->pktfull - state->pktlen;
+		unread_bytes = state->pktfull - state->pktlen;
 	}
 
 	*state = (struct smbd_smb2_request_read_state) {
 		.req = NULL,
 	};
 
-	req->current_idx = 1;
+	return smbd_smb2_request_process_incoming(xconn,
+						  req,
+						  pktbuf,
+						  pktlen,
+						  unread_bytes,
+						  false);
+}
 
-	DEBUG(10,("smbd_smb2_request idx[%d] of %d vectors\n",
-		 req->current_idx, req->in.vector_count));
+NTSTATUS smbd_smb2_io_uring_incoming(struct smbXsrv_connection *xconn,
+				     const uint8_t *buf,
+				     size_t len,
+				     size_t *_consumed)
+{
+	struct smbd_smb2_request_read_state *state = &xconn->smb2.request_read_state;
+	size_t consumed = 0;
+	NTSTATUS status = NT_STATUS_OK;
 
-	status = smbd_smb2_request_validate(req);
-	if (!NT_STATUS_IS_OK(status)) {
-		return status;
-	}
+	while (consumed < len &&
+	       state->req != NULL &&
+	       NT_STATUS_IS_OK(xconn->transport.status))
+	{
+		size_t n = 0;
+		int i;
 
-	status = smbd_smb2_request_setup_out(req);
-	if (!NT_STATUS_IS_OK(status)) {
-		return status;
+		for (i = 0; i < state->count && consumed + n < len; i++) {
+			size_t todo = MIN(state->vector[i].iov_len,
+					  len - consumed - n);
+
+			memcpy(state->vector[i].iov_base,
+			       buf + consumed + n,
+			       todo);
+			n += todo;
+		}
+		consumed += n;
+
+		status = smbd_smb2_advance_incoming(xconn, n);
+		if (NT_STATUS_EQUAL(status, NT_STATUS_PENDING) ||
+		    NT_STATUS_EQUAL(status, NT_STATUS_RETRY))
+		{
+			/* we have more to read */
+			status = NT_STATUS_OK;
+			continue;
+		}
+		if (!NT_STATUS_IS_OK(status)) {
+			break;
+		}
 	}
 
-	status = smbd_smb2_request_dispatch(req);
-	if (!NT_STATUS_IS_OK(status)) {
-		return status;
+	*_consumed = consumed;
+	return status;
+}
+
+static void smbd_smb2_recv_buf_feed(struct smbXsrv_connection *xconn);
+
+static void smbd_smb2_recv_buf_feed_immediate(struct tevent_context *ev,
+					      struct tevent_immediate *im,
+					      void *private_data)
+{
+	struct smbXsrv_connection *xconn =
+		talloc_get_type_abort(private_data,
+		struct smbXsrv_connection);
+
+	smbd_smb2_recv_buf_feed(xconn);
+}
+
+/*
+ * Feed the bytes we read ahead into the pending requests, this
+ * can process several PDUs from a single receive.
+ */
+static void smbd_smb2_recv_buf_feed(struct smbXsrv_connection *xconn)
+{
+	struct smbd_smb2_request_read_state *state = &xconn->smb2.request_read_state;
+	NTSTATUS status = NT_STATUS_OK;
+
+	xconn->smb2.recv_buf.feeding = true;
+
+	while ((xconn->smb2.recv_buf.len > 0) &&
+	       NT_STATUS_IS_OK(xconn->transport.status))
+	{
+		size_t consumed = 0;
+
+		status = smbd_smb2_io_uring_incoming(
+			xconn,
+			xconn->smb2.recv_buf.buf + xconn->smb2.recv_buf.ofs,
+			xconn->smb2.recv_buf.len,
+			&consumed);
+		xconn->smb2.recv_buf.ofs += consumed;
+		xconn->smb2.recv_buf.len -= consumed;
+		if (!NT_STATUS_IS_OK(status)) {
+			break;
+		}
+		if (consumed == 0) {
+			/*
+			 * There's no pending request to read into,
+			 * smbd_smb2_request_next_incoming() schedules
+			 * us again once the send queue has drained.
+			 */
+			break;
+		}
 	}
 
-	sconn->num_requests++;
+	if (xconn->smb2.recv_buf.len == 0) {
+		xconn->smb2.recv_buf.ofs = 0;
+	}
 
-	/* The timeout_processing function isn't run nearly
-	   often enough to implement 'max log size' without
-	   overrunning the size of the file by many megabytes.
-	   This is especially true if we are running at debug
-	   level 10.  Checking every 50 SMB2s is a nice
-	   tradeoff of performance vs log file size overrun. */
+	xconn->smb2.recv_buf.feeding = false;
 
-	if ((sconn->num_requests % 50) == 0 &&
-	    need_to_check_log_size()) {
-		change_to_root_user();
-		check_log_size();
+	if (NT_STATUS_IS_OK(status) &&
+	    (xconn->smb2.send_queue != NULL))
+	{
+		/*
+		 * Send the responses to the PDUs
+		 * we processed together.
+		 */
+		status = smbd_smb2_flush_send_queue(xconn);
 	}
 
-	status = smbd_smb2_request_next_incoming(xconn);
 	if (!NT_STATUS_IS_OK(status)) {
+		smbd_server_connection_terminate(xconn, nt_errstr(status));
+		return;
+	}
+
+	if (!NT_STATUS_IS_OK(xconn->transport.status)) {
+		return;
+	}
+
+	if (state->req == NULL) {
+		return;
+	}
+
+	TEVENT_FD_READABLE(xconn->transport.fde);
+}
+
+static NTSTATUS smbd_smb2_recv_buf_read(struct smbXsrv_connection *xconn)
+{
+	unsigned recv_flags = 0;
+	ssize_t ret;
+	int err;
+	bool retry;
+	NTSTATUS status;
+
+#ifdef MSG_NOSIGNAL
+	recv_flags |= MSG_NOSIGNAL;
+#endif
+#ifdef MSG_DONTWAIT
+	recv_flags |= MSG_DONTWAIT;
+#endif
+
+	ret = recv(xconn->transport.sock,
+		   xconn->smb2.recv_buf.buf,
+		   xconn->smb2.recv_buf.size,
+		   recv_flags);
+	if (ret == 0) {
+		/* propagate end of file */
+		status = NT_STATUS_END_OF_FILE;
+		smbXsrv_connection_disconnect_transport(xconn,
+							status);
+		return status;
+	}
+	err = socket_error_from_errno(ret, errno, &retry);
+	if (retry) {
+		/* retry later */
+		TEVENT_FD_READABLE(xconn->transport.fde);
+		return NT_STATUS_OK;
+	}
+	if (err != 0) {
+		status = map_nt_error_from_unix_common(err);
+		smbXsrv_connection_disconnect_transport(xconn,
+							status);
 		return status;
 	}
 
+	xconn->smb2.recv_buf.ofs = 0;
+	xconn->smb2.recv_buf.len = ret;
+
+	smbd_smb2_recv_buf_feed(xconn);
 	return NT_STATUS_OK;
 }
 
@@ -5298,6 +6728,27 @@ static NTSTATUS smbd_smb2_io_handler(struct smbXsrv_connection *xconn,
 		return NT_STATUS_OK;
 	}
 
+	if (xconn->smb2.recv_buf.len > 0) {
+		/*
+		 * smbd_smb2_recv_buf_feed_immediate() is pending,
+		 * the bytes we already have come first.
+		 */
+		TEVENT_FD_NOT_READABLE(xconn->transport.fde);
+		return NT_STATUS_OK;
+	}
+
+	if ((xconn->smb2.recv_buf.buf != NULL) &&
+	    (iov_buflen(state->vector, state->count) <
+	     xconn->smb2.recv_buf.size))
+	{
+		/*
+		 * Read as much as is available, several small
+		 * PDUs typically arrive together. Large payloads
+		 * still go directly into their buffer.
+		 */
+		return smbd_smb2_recv_buf_read(xconn);
+	}
+
 again:
 
 	state->msg = (struct msghdr) {
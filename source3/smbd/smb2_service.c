@@ -618,9 +618,18 @@ NTSTATUS make_connection_snum(struct smbXsrv_connection *xconn,
 
 	/* Initialize per-share profiling */
 	if (lp_smbd_profiling_share(snum)) {
+		/*
+		 * Key by client address, "hostname lookups" would
+		 * otherwise split one client in several records
+		 */
+		char *raddr = tsocket_address_inet_addr_string(
+			sconn->remote_address, talloc_tos());
+
 		smbprofile_persvc_mkref(snum,
 					lp_const_servicename(snum),
+					raddr != NULL ? raddr :
 					sconn->remote_hostname);
+		TALLOC_FREE(raddr);
 		on_err_call_profile_unref = true;
 	}
 
@@ -922,6 +931,8 @@ void close_cnum(connection_struct *conn,
 	const struct loadparm_substitution *lp_sub =
 		loadparm_s3_global_substitution();
 
+	path_walk_cache_flush(conn);
+	access_check_cache_flush(conn);
 	file_close_conn(conn, close_type);
 
 	change_to_root_user();
@@ -426,6 +426,13 @@ static NTSTATUS smbd_smb2_tree_connect(struct smbd_smb2_request *req,
 		*out_share_flags |= SMB2_SHAREFLAG_ENCRYPT_DATA;
 	}
 
+	if (conn->protocol >= PROTOCOL_SMB3_11 &&
+	    conn->smb2.compression.negotiated.num_algos > 0 &&
+	    lp_smb3_compression(SNUM(tcon->compat)))
+	{
+		*out_share_flags |= SMB2_SHAREFLAG_COMPRESS_DATA;
+	}
+
 	/*
 	 * For disk shares we can change the client
 	 * behavior on a cluster...
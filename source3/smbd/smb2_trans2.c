@@ -5080,6 +5080,8 @@ NTSTATUS smbd_do_setfilepathinfo(connection_struct *conn,
 
 	SMB_ASSERT(fsp != NULL);
 
+	fsp_lease_stat_invalidate(fsp);
+
 	switch (info_level) {
 
 		case SMB_INFO_STANDARD:
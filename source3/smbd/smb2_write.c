@@ -52,6 +52,7 @@ NTSTATUS smbd_smb2_request_process_write(struct smbd_smb2_request *req)
 	uint64_t in_file_id_persistent;
 	uint64_t in_file_id_volatile;
 	struct files_struct *in_fsp;
+	uint32_t in_channel = SMB2_CHANNEL_NONE;
 	uint32_t in_flags;
 	size_t in_dyn_len = 0;
 	uint8_t *in_dyn_ptr = NULL;
@@ -69,11 +70,22 @@ NTSTATUS smbd_smb2_request_process_write(struct smbd_smb2_request *req)
 	in_file_id_persistent	= BVAL(inbody, 0x10);
 	in_file_id_volatile	= BVAL(inbody, 0x18);
 	in_flags		= IVAL(inbody, 0x2C);
+	if (xconn->protocol >= PROTOCOL_SMB3_00) {
+		in_channel	= IVAL(inbody, 0x20);
+	}
 
 	if (in_data_offset != (SMB2_HDR_BODY + SMBD_SMB2_IN_BODY_LEN(req))) {
 		return smbd_smb2_request_error(req, NT_STATUS_INVALID_PARAMETER);
 	}
 
+	/*
+	 * We don't support SMB Direct, so the data
+	 * can't be transferred via an RDMA channel.
+	 */
+	if (in_channel != SMB2_CHANNEL_NONE) {
+		return smbd_smb2_request_error(req, NT_STATUS_INVALID_PARAMETER);
+	}
+
 	if (req->smb1req != NULL && req->smb1req->unread_bytes > 0) {
 		in_dyn_ptr = NULL;
 		in_dyn_len = req->smb1req->unread_bytes;
@@ -358,6 +370,17 @@ static struct tevent_req *smbd_smb2_write_send(TALLOC_CTX *mem_ctx,
 		return tevent_req_post(req, ev);
 	}
 
+	if (write_behind_file(fsp,
+			      (const char *)in_data.data,
+			      in_offset,
+			      in_data.length,
+			      state->write_through))
+	{
+		state->out_count = in_data.length;
+		tevent_req_done(req);
+		return tevent_req_post(req, ev);
+	}
+
 	/* Try and do an asynchronous write. */
 	status = schedule_aio_smb2_write(conn,
 					smbreq,
@@ -1169,25 +1169,13 @@ struct smb2srv_open_recreate_state {
 	NTSTATUS status;
 };
 
-static void smb2srv_open_recreate_fn(
-	struct db_record *rec, TDB_DATA oldval, void *private_data)
+static bool smb2srv_open_recreate_match(
+	const struct smb2srv_open_recreate_state *state,
+	TDB_DATA key,
+	const struct smbXsrv_open_global0 *global)
 {
-	struct smb2srv_open_recreate_state *state = private_data;
-	TDB_DATA key = dbwrap_record_get_key(rec);
-	struct smbXsrv_open_global0 *global = NULL;
 	struct GUID_txt_buf buf1, buf2;
 
-	state->status = smbXsrv_open_global_verify_record(
-		key, oldval, state->op, &state->op->global);
-	if (!NT_STATUS_EQUAL(state->status, NT_STATUS_REMOTE_DISCONNECT)) {
-		DBG_WARNING("smbXsrv_open_global_verify_record for %s "
-			    "failed: %s\n",
-			    tdb_data_dbg(key),
-			    nt_errstr(state->status));
-		goto not_found;
-	}
-	global = state->op->global;
-
 	if (state->lease_key != NULL &&
 	    !GUID_equal(&global->client_guid, state->client_guid))
 	{
@@ -1195,7 +1183,7 @@ static void smb2srv_open_recreate_fn(
 			   GUID_buf_string(&global->client_guid, &buf1),
 			   GUID_buf_string(state->client_guid, &buf2),
 			   tdb_data_dbg(key));
-		goto not_found;
+		return false;
 	}
 
 	/*
@@ -1210,6 +1198,68 @@ static void smb2srv_open_recreate_fn(
 			   GUID_buf_string(&global->create_guid, &buf1),
 			   GUID_buf_string(state->create_guid, &buf2),
 			   tdb_data_dbg(key));
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * After a failover all clients reconnect their durable handles at
+ * once. Many of those reconnects fail, e.g. because the handle was
+ * already scavenged or the create guid doesn't match. Find those
+ * with a read-only lookup, so that they don't contend for the record
+ * lock (or, in a cluster, migrate the record to this node) with the
+ * reconnects that succeed. The locked path checks everything again.
+ */
+static void smb2srv_open_recreate_peek_fn(
+	TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct smb2srv_open_recreate_state *state = private_data;
+	struct smbXsrv_open_global0 *global = NULL;
+	TALLOC_CTX *frame = talloc_stackframe();
+
+	state->status = smbXsrv_open_global_verify_record(
+		key, data, frame, &global);
+	if (!NT_STATUS_EQUAL(state->status, NT_STATUS_REMOTE_DISCONNECT)) {
+		DBG_DEBUG("smbXsrv_open_global_verify_record for %s "
+			  "failed: %s\n",
+			  tdb_data_dbg(key),
+			  nt_errstr(state->status));
+		state->status = NT_STATUS_OBJECT_NAME_NOT_FOUND;
+		TALLOC_FREE(frame);
+		return;
+	}
+
+	if (!smb2srv_open_recreate_match(state, key, global)) {
+		state->status = NT_STATUS_OBJECT_NAME_NOT_FOUND;
+		TALLOC_FREE(frame);
+		return;
+	}
+
+	state->status = NT_STATUS_OK;
+	TALLOC_FREE(frame);
+}
+
+static void smb2srv_open_recreate_fn(
+	struct db_record *rec, TDB_DATA oldval, void *private_data)
+{
+	struct smb2srv_open_recreate_state *state = private_data;
+	TDB_DATA key = dbwrap_record_get_key(rec);
+	struct smbXsrv_open_global0 *global = NULL;
+
+	state->status = smbXsrv_open_global_verify_record(
+		key, oldval, state->op, &state->op->global);
+	if (!NT_STATUS_EQUAL(state->status, NT_STATUS_REMOTE_DISCONNECT)) {
+		DBG_WARNING("smbXsrv_open_global_verify_record for %s "
+			    "failed: %s\n",
+			    tdb_data_dbg(key),
+			    nt_errstr(state->status));
+		goto not_found;
+	}
+	global = state->op->global;
+
+	if (!smb2srv_open_recreate_match(state, key, global)) {
 		goto not_found;
 	}
 
@@ -1291,6 +1341,21 @@ NTSTATUS smb2srv_open_recreate(struct smbXsrv_connection *conn,
 		return NT_STATUS_INSUFFICIENT_RESOURCES;
 	}
 
+	status = dbwrap_parse_record(table->global.db_ctx,
+				     key,
+				     smb2srv_open_recreate_peek_fn,
+				     &state);
+	if (NT_STATUS_IS_OK(status)) {
+		status = state.status;
+	}
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_DEBUG("no reconnectable record for %s: %s\n",
+			  tdb_data_dbg(key),
+			  nt_errstr(status));
+		DO_PROFILE_INC(durable_reconnect_peek_failed);
+		return NT_STATUS_OBJECT_NAME_NOT_FOUND;
+	}
+
 	state.op = talloc_zero(table, struct smbXsrv_open);
 	if (state.op == NULL) {
 		return NT_STATUS_NO_MEMORY;
@@ -1433,8 +1433,15 @@ NTSTATUS smbXsrv_session_add_channel(struct smbXsrv_session *session,
 		.creation_time = now,
 		.connection = conn,
 		.transport_type = conn->transport.type,
+		.incoming_cpu = conn->transport.incoming_cpu,
 	};
 
+	c->cpu_affinity = talloc_strdup(global->channels,
+					conn->transport.cpu_affinity);
+	if (c->cpu_affinity == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
 	c->local_address = tsocket_address_string(conn->local_address,
 						  global->channels);
 	if (c->local_address == NULL) {
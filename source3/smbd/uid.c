@@ -79,6 +79,7 @@ static void free_conn_state_if_unused(connection_struct *conn)
 	}
 	if (i == VUID_CACHE_SIZE) {
 		/* Not used, safe to free. */
+		access_check_cache_flush(conn);
 		TALLOC_FREE(conn->session_info);
 	}
 }
@@ -318,6 +319,13 @@ static bool check_user_ok(connection_struct *conn,
 	conn->vuid_cache->next_entry =
 		(conn->vuid_cache->next_entry + 1) % VUID_CACHE_SIZE;
 
+	/*
+	 * The access check cache refers to session_info pointers,
+	 * don't let a new one at the same address inherit entries.
+	 */
+	if (ent->session_info != NULL) {
+		access_check_cache_flush(conn);
+	}
 	TALLOC_FREE(ent->session_info);
 	TALLOC_FREE(ent->veto_list);
 	TALLOC_FREE(ent->hide_list);
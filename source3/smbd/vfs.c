@@ -33,6 +33,7 @@
 #include "lib/util/tevent_unix.h"
 #include "lib/util/tevent_ntstatus.h"
 #include "lib/util/sys_rw.h"
+#include "lib/util/tracepoint.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_VFS
@@ -563,6 +564,8 @@ int vfs_allocate_file_space(files_struct *fsp, uint64_t len)
 		return -1;
 	}
 
+	write_behind_sync(fsp);
+
 	status = vfs_stat_fsp(fsp);
 	if (!NT_STATUS_IS_OK(status)) {
 		return -1;
@@ -650,6 +653,8 @@ int vfs_set_filelen(files_struct *fsp, off_t len)
 		return -1;
 	}
 
+	write_behind_sync(fsp);
+
 	contend_level2_oplocks_begin(fsp, LEVEL2_CONTEND_SET_FILE_LEN);
 
 	DEBUG(10,("vfs_set_filelen: ftruncate %s to len %.0f\n",
@@ -1187,6 +1192,8 @@ NTSTATUS vfs_stat_fsp(files_struct *fsp)
 		return NT_STATUS_OK;
 	}
 
+	write_behind_sync_file_id(fsp->conn->sconn, fsp->file_id);
+
 	if (fsp_get_pathref_fd(fsp) == -1) {
 		if (fsp->fsp_flags.posix_open) {
 			ret = SMB_VFS_LSTAT(fsp->conn, fsp->fsp_name);
@@ -1584,12 +1591,21 @@ int smb_vfs_call_openat(struct vfs_handle_struct *handle,
 			struct files_struct *fsp,
 			const struct vfs_open_how *how)
 {
+	int fd;
+
 	VFS_FIND(openat);
-	return handle->fns->openat_fn(handle,
-				      dirfsp,
-				      smb_fname,
-				      fsp,
-				      how);
+	SAMBA_TRACEPOINT(vfs_openat_start,
+			 handle,
+			 fsp,
+			 smb_fname->base_name,
+			 how->flags);
+	fd = handle->fns->openat_fn(handle,
+				    dirfsp,
+				    smb_fname,
+				    fsp,
+				    how);
+	SAMBA_TRACEPOINT(vfs_openat_done, handle, fsp, fd, errno);
+	return fd;
 }
 
 NTSTATUS smb_vfs_call_create_file(struct vfs_handle_struct *handle,
@@ -1662,6 +1678,14 @@ struct tevent_req *smb_vfs_call_pread_send(struct vfs_handle_struct *handle,
 	VFS_FIND(pread_send);
 	state->recv_fn = handle->fns->pread_recv_fn;
 
+	SAMBA_TRACEPOINT(vfs_pread_start,
+			 req,
+			 handle,
+			 fsp->file_id.devid,
+			 fsp->file_id.inode,
+			 n,
+			 offset);
+
 	subreq = handle->fns->pread_send_fn(handle, state, ev, fsp, data, n,
 					    offset);
 	if (tevent_req_nomem(subreq, req)) {
@@ -1680,6 +1704,11 @@ static void smb_vfs_call_pread_done(struct tevent_req *subreq)
 
 	state->retval = state->recv_fn(subreq, &state->vfs_aio_state);
 	TALLOC_FREE(subreq);
+	SAMBA_TRACEPOINT(vfs_pread_done,
+			 req,
+			 state->retval,
+			 state->vfs_aio_state.error,
+			 state->vfs_aio_state.duration);
 	if (state->retval == -1) {
 		tevent_req_error(req, state->vfs_aio_state.error);
 		return;
@@ -1738,6 +1767,14 @@ struct tevent_req *smb_vfs_call_pwrite_send(struct vfs_handle_struct *handle,
 	VFS_FIND(pwrite_send);
 	state->recv_fn = handle->fns->pwrite_recv_fn;
 
+	SAMBA_TRACEPOINT(vfs_pwrite_start,
+			 req,
+			 handle,
+			 fsp->file_id.devid,
+			 fsp->file_id.inode,
+			 n,
+			 offset);
+
 	subreq = handle->fns->pwrite_send_fn(handle, state, ev, fsp, data, n,
 					     offset);
 	if (tevent_req_nomem(subreq, req)) {
@@ -1756,6 +1793,11 @@ static void smb_vfs_call_pwrite_done(struct tevent_req *subreq)
 
 	state->retval = state->recv_fn(subreq, &state->vfs_aio_state);
 	TALLOC_FREE(subreq);
+	SAMBA_TRACEPOINT(vfs_pwrite_done,
+			 req,
+			 state->retval,
+			 state->vfs_aio_state.error,
+			 state->vfs_aio_state.duration);
 	if (state->retval == -1) {
 		tevent_req_error(req, state->vfs_aio_state.error);
 		return;
@@ -1957,6 +1999,103 @@ int smb_vfs_call_fstatat(
 	return handle->fns->fstatat_fn(handle, dirfsp, smb_fname, sbuf, flags);
 }
 
+struct smb_vfs_call_fstatat_state {
+	files_struct *dirfsp;
+	int (*recv_fn)(struct tevent_req *req,
+		       struct vfs_aio_state *aio_state,
+		       SMB_STRUCT_STAT *sbuf);
+	SMB_STRUCT_STAT sbuf;
+	struct vfs_aio_state aio_state;
+};
+
+static void smb_vfs_call_fstatat_done(struct tevent_req *subreq);
+
+struct tevent_req *smb_vfs_call_fstatat_send(
+	TALLOC_CTX *mem_ctx,
+	struct tevent_context *ev,
+	struct vfs_handle_struct *handle,
+	files_struct *dirfsp,
+	const struct smb_filename *smb_fname,
+	int flags)
+{
+	struct tevent_req *req = NULL;
+	struct smb_vfs_call_fstatat_state *state = NULL;
+	struct tevent_req *subreq = NULL;
+
+	req = tevent_req_create(mem_ctx, &state,
+				struct smb_vfs_call_fstatat_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	VFS_FIND(fstatat_send);
+
+	*state = (struct smb_vfs_call_fstatat_state) {
+		.dirfsp = dirfsp,
+		.recv_fn = handle->fns->fstatat_recv_fn,
+	};
+
+	subreq = handle->fns->fstatat_send_fn(mem_ctx,
+					      ev,
+					      handle,
+					      dirfsp,
+					      smb_fname,
+					      flags);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_defer_callback(req, ev);
+
+	tevent_req_set_callback(subreq, smb_vfs_call_fstatat_done, req);
+	return req;
+}
+
+static void smb_vfs_call_fstatat_done(struct tevent_req *subreq)
+{
+	struct tevent_req *req = tevent_req_callback_data(
+		subreq, struct tevent_req);
+	struct smb_vfs_call_fstatat_state *state = tevent_req_data(
+		req, struct smb_vfs_call_fstatat_state);
+	int ret;
+	bool ok;
+
+	/*
+	 * Make sure we run as the user again
+	 */
+	ok = change_to_user_and_service_by_fsp(state->dirfsp);
+	SMB_ASSERT(ok);
+
+	ret = state->recv_fn(subreq, &state->aio_state, &state->sbuf);
+	TALLOC_FREE(subreq);
+	if (ret == -1) {
+		tevent_req_error(req, state->aio_state.error);
+		return;
+	}
+
+	tevent_req_done(req);
+}
+
+int smb_vfs_call_fstatat_recv(struct tevent_req *req,
+			      struct vfs_aio_state *aio_state,
+			      SMB_STRUCT_STAT *sbuf)
+{
+	struct smb_vfs_call_fstatat_state *state = tevent_req_data(
+		req, struct smb_vfs_call_fstatat_state);
+
+	if (tevent_req_is_unix_error(req, &aio_state->error)) {
+		tevent_req_received(req);
+		return -1;
+	}
+
+	*aio_state = state->aio_state;
+	if (sbuf != NULL) {
+		*sbuf = state->sbuf;
+	}
+
+	tevent_req_received(req);
+	return 0;
+}
+
 uint64_t smb_vfs_call_get_alloc_size(struct vfs_handle_struct *handle,
 				     struct files_struct *fsp,
 				     const SMB_STRUCT_STAT *sbuf)
@@ -2406,6 +2545,128 @@ NTSTATUS smb_vfs_call_get_dos_attributes_recv(
 	return NT_STATUS_OK;
 }
 
+struct smb_vfs_call_get_dos_attributes_batch_state {
+	files_struct *dir_fsp;
+	NTSTATUS (*recv_fn)(struct tevent_req *req,
+			    struct vfs_aio_state *aio_state,
+			    uint32_t *dosmodes,
+			    NTSTATUS *statuses);
+	struct vfs_aio_state aio_state;
+	size_t num_fnames;
+	uint32_t *dosmodes;
+	NTSTATUS *statuses;
+};
+
+static void smb_vfs_call_get_dos_attributes_batch_done(
+	struct tevent_req *subreq);
+
+struct tevent_req *smb_vfs_call_get_dos_attributes_batch_send(
+			TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev,
+			struct vfs_handle_struct *handle,
+			files_struct *dir_fsp,
+			struct smb_filename **smb_fnames,
+			size_t num_fnames)
+{
+	struct tevent_req *req = NULL;
+	struct smb_vfs_call_get_dos_attributes_batch_state *state = NULL;
+	struct tevent_req *subreq = NULL;
+
+	req = tevent_req_create(
+		mem_ctx, &state,
+		struct smb_vfs_call_get_dos_attributes_batch_state);
+	if (req == NULL) {
+		return NULL;
+	}
+
+	VFS_FIND(get_dos_attributes_batch_send);
+
+	*state = (struct smb_vfs_call_get_dos_attributes_batch_state) {
+		.dir_fsp = dir_fsp,
+		.recv_fn = handle->fns->get_dos_attributes_batch_recv_fn,
+		.num_fnames = num_fnames,
+	};
+
+	state->dosmodes = talloc_zero_array(state, uint32_t, num_fnames);
+	if (tevent_req_nomem(state->dosmodes, req)) {
+		return tevent_req_post(req, ev);
+	}
+	state->statuses = talloc_zero_array(state, NTSTATUS, num_fnames);
+	if (tevent_req_nomem(state->statuses, req)) {
+		return tevent_req_post(req, ev);
+	}
+
+	subreq = handle->fns->get_dos_attributes_batch_send_fn(mem_ctx,
+							       ev,
+							       handle,
+							       dir_fsp,
+							       smb_fnames,
+							       num_fnames);
+	if (tevent_req_nomem(subreq, req)) {
+		return tevent_req_post(req, ev);
+	}
+	tevent_req_defer_callback(req, ev);
+
+	tevent_req_set_callback(subreq,
+				smb_vfs_call_get_dos_attributes_batch_done,
+				req);
+
+	return req;
+}
+
+static void smb_vfs_call_get_dos_attributes_batch_done(
+	struct tevent_req *subreq)
+{
+	struct tevent_req *req =
+		tevent_req_callback_data(subreq,
+		struct tevent_req);
+	struct smb_vfs_call_get_dos_attributes_batch_state *state =
+		tevent_req_data(req,
+		struct smb_vfs_call_get_dos_attributes_batch_state);
+	NTSTATUS status;
+	bool ok;
+
+	/*
+	 * Make sure we run as the user again
+	 */
+	ok = change_to_user_and_service_by_fsp(state->dir_fsp);
+	SMB_ASSERT(ok);
+
+	status = state->recv_fn(subreq,
+				&state->aio_state,
+				state->dosmodes,
+				state->statuses);
+	TALLOC_FREE(subreq);
+	if (tevent_req_nterror(req, status)) {
+		return;
+	}
+
+	tevent_req_done(req);
+}
+
+NTSTATUS smb_vfs_call_get_dos_attributes_batch_recv(
+		struct tevent_req *req,
+		struct vfs_aio_state *aio_state,
+		uint32_t *dosmodes,
+		NTSTATUS *statuses)
+{
+	struct smb_vfs_call_get_dos_attributes_batch_state *state =
+		tevent_req_data(req,
+		struct smb_vfs_call_get_dos_attributes_batch_state);
+	NTSTATUS status;
+
+	if (tevent_req_is_nterror(req, &status)) {
+		tevent_req_received(req);
+		return status;
+	}
+
+	*aio_state = state->aio_state;
+	memcpy(dosmodes, state->dosmodes, state->num_fnames * sizeof(uint32_t));
+	memcpy(statuses, state->statuses, state->num_fnames * sizeof(NTSTATUS));
+	tevent_req_received(req);
+	return NT_STATUS_OK;
+}
+
 NTSTATUS smb_vfs_call_fget_compression(vfs_handle_struct *handle,
 				      TALLOC_CTX *mem_ctx,
 				      struct files_struct *fsp,
@@ -0,0 +1,140 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Compare the in-memory dbwrap backends
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "proto.h"
+#include "lib/dbwrap/dbwrap.h"
+#include "lib/dbwrap/dbwrap_rbt.h"
+#include "util_tdb.h"
+#include "lib/util/time.h"
+
+extern int torture_numops;
+
+/*
+ * torture_numops defaults to 100, that's too small to show anything
+ */
+#define BENCH_DBWRAP_RBT_MIN_KEYS 100000
+
+static int bench_dbwrap_rbt_traverse_fn(struct db_record *rec,
+					void *private_data)
+{
+	size_t *bytes = private_data;
+	*bytes += dbwrap_record_get_value(rec).dsize;
+	return 0;
+}
+
+static void bench_dbwrap_rbt_parser(TDB_DATA key, TDB_DATA data,
+				    void *private_data)
+{
+	size_t *bytes = private_data;
+	*bytes += data.dsize;
+}
+
+static bool bench_dbwrap_rbt_one(enum dbwrap_rbt_backend backend,
+				 const char *name, int num_keys)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct db_context *db = NULL;
+	struct timeval start;
+	double t_insert, t_lookup, t_traverse;
+	size_t bytes = 0;
+	NTSTATUS status;
+	int i, count;
+	bool ret = false;
+
+	db = db_open_rbt_backend(frame, backend);
+	if (db == NULL) {
+		d_fprintf(stderr, "db_open_rbt_backend failed\n");
+		goto fail;
+	}
+
+	/*
+	 * Keys look like share mode / locking.tdb keys: a common
+	 * prefix with a varying tail
+	 */
+
+	start = timeval_current();
+	for (i=0; i<num_keys; i++) {
+		char key[64];
+		uint64_t val = i;
+
+		snprintf(key, sizeof(key), "dev:fd00 inode:%"PRIu64,
+			 (uint64_t)i * 7919);
+
+		status = dbwrap_store(db,
+				      string_tdb_data(key),
+				      make_tdb_data((uint8_t *)&val,
+						    sizeof(val)),
+				      0);
+		if (!NT_STATUS_IS_OK(status)) {
+			d_fprintf(stderr, "dbwrap_store failed: %s\n",
+				  nt_errstr(status));
+			goto fail;
+		}
+	}
+	t_insert = timeval_elapsed(&start);
+
+	start = timeval_current();
+	for (i=0; i<num_keys; i++) {
+		char key[64];
+		uint64_t idx = ((uint64_t)i * 104729) % num_keys;
+
+		snprintf(key, sizeof(key), "dev:fd00 inode:%"PRIu64,
+			 idx * 7919);
+
+		status = dbwrap_parse_record(db,
+					     string_tdb_data(key),
+					     bench_dbwrap_rbt_parser,
+					     &bytes);
+		if (!NT_STATUS_IS_OK(status)) {
+			d_fprintf(stderr, "dbwrap_parse_record failed: %s\n",
+				  nt_errstr(status));
+			goto fail;
+		}
+	}
+	t_lookup = timeval_elapsed(&start);
+
+	start = timeval_current();
+	status = dbwrap_traverse_read(db, bench_dbwrap_rbt_traverse_fn,
+				      &bytes, &count);
+	t_traverse = timeval_elapsed(&start);
+	if (!NT_STATUS_IS_OK(status) || (count != num_keys)) {
+		d_fprintf(stderr, "dbwrap_traverse_read failed: %s, %d\n",
+			  nt_errstr(status), count);
+		goto fail;
+	}
+
+	printf("%s: %d keys, insert %.3fs, lookup %.3fs, traverse %.3fs\n",
+	       name, num_keys, t_insert, t_lookup, t_traverse);
+
+	ret = true;
+fail:
+	TALLOC_FREE(frame);
+	return ret;
+}
+
+bool run_bench_dbwrap_rbt(int dummy)
+{
+	int num_keys = MAX(torture_numops, BENCH_DBWRAP_RBT_MIN_KEYS);
+
+	if (!bench_dbwrap_rbt_one(DBWRAP_RBT_BACKEND_RBTREE, "rbt",
+				  num_keys)) {
+		return false;
+	}
+	return bench_dbwrap_rbt_one(DBWRAP_RBT_BACKEND_ART, "art", num_keys);
+}
@@ -166,14 +166,17 @@ bool run_dbwrap_watch2(int dummy);
 bool run_dbwrap_watch3(int dummy);
 bool run_dbwrap_watch4(int dummy);
 bool run_dbwrap_do_locked1(int dummy);
+bool run_dbwrap_parse_batch1(int dummy);
 bool run_idmap_tdb_common_test(int dummy);
 bool run_local_dbwrap_ctdb1(int dummy);
 bool run_qpathinfo_bufsize(int dummy);
 bool run_bench_pthreadpool(int dummy);
+bool run_bench_dbwrap_rbt(int dummy);
 bool run_messaging_read1(int dummy);
 bool run_messaging_read2(int dummy);
 bool run_messaging_read3(int dummy);
 bool run_messaging_read4(int dummy);
+bool run_messaging_read5(int dummy);
 bool run_messaging_fdpass1(int dummy);
 bool run_messaging_fdpass2(int dummy);
 bool run_messaging_fdpass2a(int dummy);
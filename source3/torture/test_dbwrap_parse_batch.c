@@ -0,0 +1,177 @@
+/*
+ * Unix SMB/CIFS implementation.
+ * Test dbwrap_parse_records_batch API
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "includes.h"
+#include "torture/proto.h"
+#include "system/filesys.h"
+#include "lib/dbwrap/dbwrap.h"
+#include "lib/dbwrap/dbwrap_open.h"
+#include "lib/dbwrap/dbwrap_rbt.h"
+#include "lib/util/util_tdb.h"
+
+#define PARSE_BATCH_NUM_KEYS 500
+
+struct parse_batch1_state {
+	uint32_t values[PARSE_BATCH_NUM_KEYS];
+	bool seen[PARSE_BATCH_NUM_KEYS];
+	bool ok;
+};
+
+static void parse_batch1_parser(size_t idx, TDB_DATA key, TDB_DATA data,
+				void *private_data)
+{
+	struct parse_batch1_state *state = private_data;
+	uint32_t val;
+
+	if ((idx >= PARSE_BATCH_NUM_KEYS) || state->seen[idx] ||
+	    (data.dsize != sizeof(val))) {
+		state->ok = false;
+		return;
+	}
+	memcpy(&val, data.dptr, sizeof(val));
+	if (val != state->values[idx]) {
+		state->ok = false;
+		return;
+	}
+	state->seen[idx] = true;
+}
+
+static bool parse_batch1_db(struct db_context *db)
+{
+	struct parse_batch1_state *state = NULL;
+	uint32_t *keybufs = NULL;
+	TDB_DATA *keys = NULL;
+	NTSTATUS *statuses = NULL;
+	NTSTATUS status;
+	size_t i;
+	bool ret = false;
+
+	state = talloc_zero(talloc_tos(), struct parse_batch1_state);
+	keybufs = talloc_array(state, uint32_t, PARSE_BATCH_NUM_KEYS);
+	keys = talloc_array(state, TDB_DATA, PARSE_BATCH_NUM_KEYS);
+	statuses = talloc_array(state, NTSTATUS, PARSE_BATCH_NUM_KEYS);
+	if ((state == NULL) || (keybufs == NULL) || (keys == NULL) ||
+	    (statuses == NULL)) {
+		fprintf(stderr, "talloc failed\n");
+		goto fail;
+	}
+	state->ok = true;
+
+	/*
+	 * Store every other key, ask for all of them
+	 */
+	for (i=0; i<PARSE_BATCH_NUM_KEYS; i++) {
+		keybufs[i] = i;
+		keys[i] = make_tdb_data((uint8_t *)&keybufs[i],
+					sizeof(keybufs[i]));
+		state->values[i] = i * 7;
+
+		if ((i % 2) != 0) {
+			continue;
+		}
+
+		status = dbwrap_store(
+			db,
+			keys[i],
+			make_tdb_data((uint8_t *)&state->values[i],
+				      sizeof(state->values[i])),
+			0);
+		if (!NT_STATUS_IS_OK(status)) {
+			fprintf(stderr, "dbwrap_store failed: %s\n",
+				nt_errstr(status));
+			goto fail;
+		}
+	}
+
+	status = dbwrap_parse_records_batch(db,
+					    keys,
+					    PARSE_BATCH_NUM_KEYS,
+					    parse_batch1_parser,
+					    state,
+					    statuses);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "dbwrap_parse_records_batch failed: %s\n",
+			nt_errstr(status));
+		goto fail;
+	}
+	if (!state->ok) {
+		fprintf(stderr, "parser got unexpected data\n");
+		goto fail;
+	}
+
+	for (i=0; i<PARSE_BATCH_NUM_KEYS; i++) {
+		bool stored = ((i % 2) == 0);
+		NTSTATUS expected = stored ? NT_STATUS_OK : NT_STATUS_NOT_FOUND;
+
+		if (!NT_STATUS_EQUAL(statuses[i], expected)) {
+			fprintf(stderr, "key %zu: got %s, expected %s\n",
+				i,
+				nt_errstr(statuses[i]),
+				nt_errstr(expected));
+			goto fail;
+		}
+		if (state->seen[i] != stored) {
+			fprintf(stderr, "key %zu: parser %scalled\n",
+				i,
+				stored ? "not " : "");
+			goto fail;
+		}
+	}
+
+	ret = true;
+fail:
+	TALLOC_FREE(state);
+	return ret;
+}
+
+bool run_dbwrap_parse_batch1(int dummy)
+{
+	struct db_context *db = NULL;
+	const char *dbname = "test_parse_batch.tdb";
+	bool ret = false;
+
+	db = db_open(talloc_tos(), dbname, 0,
+		     TDB_CLEAR_IF_FIRST, O_CREAT|O_RDWR, 0644,
+		     DBWRAP_LOCK_ORDER_1, DBWRAP_FLAG_NONE);
+	if (db == NULL) {
+		fprintf(stderr, "db_open failed: %s\n", strerror(errno));
+		return false;
+	}
+	if (!parse_batch1_db(db)) {
+		goto fail;
+	}
+	TALLOC_FREE(db);
+
+	/*
+	 * rbt has no batch implementation, test the generic fallback
+	 */
+	db = db_open_rbt(talloc_tos());
+	if (db == NULL) {
+		fprintf(stderr, "db_open_rbt failed\n");
+		goto fail;
+	}
+	if (!parse_batch1_db(db)) {
+		goto fail;
+	}
+
+	ret = true;
+fail:
+	TALLOC_FREE(db);
+	unlink(dbname);
+	return ret;
+}
@@ -22,14 +22,27 @@
 #include "lib/idmap_cache.h"
 #include "librpc/gen_ndr/idmap.h"
 #include "libcli/security/dom_sid.h"
+#include "lib/gencache.h"
+#include "lib/util/memcache.h"
 
 bool run_local_idmap_cache1(int dummy)
 {
 	struct dom_sid sid, found_sid;
 	struct unixid xid, found_xid;
+	struct memcache *mem;
 	bool ret = false;
 	bool expired = false;
 
+	/*
+	 * Exercise the in-memory front cache as well
+	 */
+	mem = memcache_init(NULL, 0);
+	if (mem == NULL) {
+		fprintf(stderr, "memcache_init failed\n");
+		return false;
+	}
+	memcache_set_global(mem);
+
 	xid = (struct unixid) { .id = 1234, .type = ID_TYPE_UID };
 	dom_sid_parse("S-1-5-21-2864185242-3846410404-2398417794-1235", &sid);
 	idmap_cache_set_sid2unixid(&sid, &xid);
@@ -52,6 +65,29 @@ bool run_local_idmap_cache1(int dummy)
 		goto done;
 	}
 
+	/*
+	 * A change of the gencache record by someone else must
+	 * not be hidden by the in-memory copy
+	 */
+	gencache_set("IDMAP/SID2XID/"
+		     "S-1-5-21-2864185242-3846410404-2398417794-1235",
+		     "1235:U",
+		     time(NULL) + 60);
+
+	ret = idmap_cache_find_sid2unixid(&sid, &found_xid, &expired);
+	if (!ret) {
+		fprintf(stderr, "idmap_cache_find_sid2unixid failed\n");
+		goto done;
+	}
+	if (found_xid.id != 1235) {
+		fprintf(stderr,
+			"idmap_cache_find_sid2unixid returned a stale "
+			"value\n");
+		ret = false;
+		goto done;
+	}
+	idmap_cache_set_sid2unixid(&sid, &xid);
+
 	ret = idmap_cache_find_xid2sid(&xid, &found_sid, &expired);
 	if (!ret) {
 		fprintf(stderr, "idmap_cache_find_xid2sid failed\n");
@@ -118,5 +154,6 @@ bool run_local_idmap_cache1(int dummy)
 
 	ret = true;
 done:
+	memcache_set_global(NULL);
 	return ret;
 }
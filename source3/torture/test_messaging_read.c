@@ -704,3 +704,204 @@ bool run_messaging_read4(int dummy)
 
 	return retval;
 }
+
+/**
+ * read5:
+ *
+ * A burst of messages, more than messaging_dgm reads in one batch,
+ * must all arrive at a receiver that re-issues messaging_read_send()
+ * from its callback.
+ */
+
+#define MSG_TORTURE_READ5 0xF105
+#define READ5_NUM_MSGS 100
+
+static void read5_child_exit(struct tevent_context *ev,
+			     struct tevent_fd *fde,
+			     uint16_t flags,
+			     void *private_data)
+{
+	bool *parent_done = private_data;
+
+	TALLOC_FREE(fde);
+	*parent_done = true;
+}
+
+static bool read5_child(pid_t parent_pid, int start_fd)
+{
+	struct tevent_context *ev = NULL;
+	struct messaging_context *msg_ctx = NULL;
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct tevent_fd *fde = NULL;
+	struct server_id dst;
+	bool parent_done = false;
+	bool retval = false;
+	uint8_t c;
+	ssize_t bytes;
+	int i;
+
+	ev = samba_tevent_context_init(frame);
+	if (ev == NULL) {
+		fprintf(stderr, "child: tevent_context_init failed\n");
+		goto done;
+	}
+
+	msg_ctx = messaging_init(ev, ev);
+	if (msg_ctx == NULL) {
+		fprintf(stderr, "child: messaging_init failed\n");
+		goto done;
+	}
+
+	/* wait until the parent is ready to receive messages */
+	bytes = read(start_fd, &c, 1);
+	if (bytes != 1) {
+		perror("child: read from start_fd failed");
+		goto done;
+	}
+
+	dst = messaging_server_id(msg_ctx);
+	dst.pid = parent_pid;
+
+	for (i=0; i<READ5_NUM_MSGS; i++) {
+		NTSTATUS status;
+
+		status = messaging_send_buf(msg_ctx, dst, MSG_TORTURE_READ5,
+					    NULL, 0);
+		if (!NT_STATUS_IS_OK(status)) {
+			fprintf(stderr,
+				"child: messaging_send_buf failed: %s\n",
+				nt_errstr(status));
+			goto done;
+		}
+	}
+
+	printf("child: sent %d messages\n", READ5_NUM_MSGS);
+
+	/*
+	 * Sends the parent can't take right away are queued, keep
+	 * them going until the parent closes the pipe.
+	 */
+	fde = tevent_add_fd(ev, ev, start_fd, TEVENT_FD_READ,
+			    read5_child_exit, &parent_done);
+	if (fde == NULL) {
+		fprintf(stderr, "child: tevent_add_fd failed\n");
+		goto done;
+	}
+
+	while (!parent_done) {
+		int ret = tevent_loop_once(ev);
+		if (ret != 0) {
+			fprintf(stderr, "child: tevent_loop_once failed\n");
+			goto done;
+		}
+	}
+
+	retval = true;
+
+done:
+	TALLOC_FREE(frame);
+	return retval;
+}
+
+static bool read5_parent(int start_fd)
+{
+	struct tevent_context *ev = NULL;
+	struct messaging_context *msg_ctx = NULL;
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct tevent_req *req = NULL;
+	struct timeval endtime;
+	unsigned count = 0;
+	bool retval = false;
+	uint8_t c = 1;
+	ssize_t bytes;
+	int ret;
+
+	ev = samba_tevent_context_init(frame);
+	if (ev == NULL) {
+		fprintf(stderr, "parent: tevent_context_init failed\n");
+		goto done;
+	}
+
+	msg_ctx = messaging_init(ev, ev);
+	if (msg_ctx == NULL) {
+		fprintf(stderr, "parent: messaging_init failed\n");
+		goto done;
+	}
+
+	req = msg_count_send(frame, ev, msg_ctx, MSG_TORTURE_READ5, &count);
+	if (req == NULL) {
+		fprintf(stderr, "parent: msg_count_send failed\n");
+		goto done;
+	}
+
+	bytes = write(start_fd, &c, 1);
+	if (bytes != 1) {
+		perror("parent: write to start_fd failed");
+		goto done;
+	}
+
+	endtime = timeval_current_ofs(10, 0);
+
+	while (count < READ5_NUM_MSGS) {
+		if (timeval_expired(&endtime)) {
+			fprintf(stderr, "parent: timed out after %u messages\n",
+				count);
+			goto done;
+		}
+		if (!tevent_req_is_in_progress(req)) {
+			fprintf(stderr, "parent: msg_count failed\n");
+			goto done;
+		}
+		ret = tevent_loop_once(ev);
+		if (ret != 0) {
+			fprintf(stderr, "parent: tevent_loop_once failed\n");
+			goto done;
+		}
+	}
+
+	printf("parent: received %u messages\n", count);
+
+	retval = true;
+
+done:
+	TALLOC_FREE(frame);
+	return retval;
+}
+
+bool run_messaging_read5(int dummy)
+{
+	bool retval = false;
+	pid_t parent_pid = getpid();
+	pid_t child_pid;
+	int start_pipe[2];
+	int ret;
+
+	ret = pipe(start_pipe);
+	if (ret != 0) {
+		perror("parent: pipe failed for start_pipe");
+		return retval;
+	}
+
+	child_pid = fork();
+	if (child_pid == -1) {
+		perror("fork failed");
+	} else if (child_pid == 0) {
+		close(start_pipe[1]);
+		retval = read5_child(parent_pid, start_pipe[0]);
+		exit(retval ? 0 : 1);
+	} else {
+		close(start_pipe[0]);
+		retval = read5_parent(start_pipe[1]);
+
+		/* Tell the child to exit */
+		close(start_pipe[1]);
+
+		ret = waitpid(child_pid, NULL, 0);
+		if (ret == -1) {
+			perror("parent: waitpid failed");
+			retval = false;
+		}
+	}
+
+	return retval;
+}
@@ -13773,7 +13773,7 @@ static int local_rbtree_traverse_delete(struct db_record *rec, void *private_dat
 	return 0;
 }
 
-static bool run_local_rbtree(int dummy)
+static bool local_rbtree_backend(enum dbwrap_rbt_backend backend)
 {
 	struct db_context *db;
 	bool ret = false;
@@ -13782,10 +13782,10 @@ static bool run_local_rbtree(int dummy)
 	int count = 0;
 	int count2 = 0;
 
-	db = db_open_rbt(NULL);
+	db = db_open_rbt_backend(NULL, backend);
 
 	if (db == NULL) {
-		d_fprintf(stderr, "db_open_rbt failed\n");
+		d_fprintf(stderr, "db_open_rbt_backend failed\n");
 		return false;
 	}
 
@@ -13839,6 +13839,14 @@ static bool run_local_rbtree(int dummy)
 	return ret;
 }
 
+static bool run_local_rbtree(int dummy)
+{
+	if (!local_rbtree_backend(DBWRAP_RBT_BACKEND_RBTREE)) {
+		return false;
+	}
+	return local_rbtree_backend(DBWRAP_RBT_BACKEND_ART);
+}
+
 
 /*
   local test for character set functions
@@ -16256,6 +16264,10 @@ static struct {
 		.name  = "LOCAL-DBWRAP-DO-LOCKED1",
 		.fn    = run_dbwrap_do_locked1,
 	},
+	{
+		.name  = "LOCAL-DBWRAP-PARSE-BATCH1",
+		.fn    = run_dbwrap_parse_batch1,
+	},
 	{
 		.name  = "LOCAL-MESSAGING-READ1",
 		.fn    = run_messaging_read1,
@@ -16272,6 +16284,10 @@ static struct {
 		.name  = "LOCAL-MESSAGING-READ4",
 		.fn    = run_messaging_read4,
 	},
+	{
+		.name  = "LOCAL-MESSAGING-READ5",
+		.fn    = run_messaging_read5,
+	},
 	{
 		.name  = "LOCAL-MESSAGING-FDPASS1",
 		.fn    = run_messaging_fdpass1,
@@ -16376,6 +16392,10 @@ static struct {
 		.name  = "LOCAL-BENCH-PTHREADPOOL",
 		.fn    = run_bench_pthreadpool,
 	},
+	{
+		.name  = "LOCAL-BENCH-DBWRAP-RBT",
+		.fn    = run_bench_dbwrap_rbt,
+	},
 	{
 		.name  = "LOCAL-PTHREADPOOL-TEVENT",
 		.fn    = run_pthreadpool_tevent,
@@ -389,7 +389,7 @@ static int net_idmap_restore(struct net_context *c, int argc, const char **argv)
 		input = stdin;
 	}
 
-	db = db_open(mem_ctx, dbfile, 0, TDB_DEFAULT, O_RDWR|O_CREAT, 0644,
+	db = db_open(mem_ctx, dbfile, 0, TDB_SEQNUM, O_RDWR|O_CREAT, 0644,
 		     DBWRAP_LOCK_ORDER_1, DBWRAP_FLAG_NONE);
 	if (db == NULL) {
 		d_fprintf(stderr, _("Could not open idmap db (%s): %s\n"),
@@ -600,7 +600,7 @@ static int net_idmap_delete_mapping(struct net_context *c, int argc,
 	}
 	d_fprintf(stderr, _("deleting id mapping from %s\n"), dbfile);
 
-	db = db_open(mem_ctx, dbfile, 0, TDB_DEFAULT, O_RDWR, 0,
+	db = db_open(mem_ctx, dbfile, 0, TDB_SEQNUM, O_RDWR, 0,
 		     DBWRAP_LOCK_ORDER_1, DBWRAP_FLAG_NONE);
 	if (db == NULL) {
 		d_fprintf(stderr, _("Could not open idmap db (%s): %s\n"),
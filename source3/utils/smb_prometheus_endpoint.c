@@ -34,8 +34,98 @@ struct export_state {
 	bool sent_help_smb2_request_outbytes : 1;
 	bool sent_help_smb2_request_hist : 1;
 	bool sent_help_smb2_request_failed : 1;
+	bool sent_help_vfs_call_hist : 1;
 };
 
+/*
+ * Prometheus histograms are cumulative, the profile buckets are not
+ */
+static void export_hist(struct evbuffer *buf,
+			const char *metric,
+			const char *svc,
+			const char *operation,
+			const struct smbprofile_stats_hist *hist,
+			uint64_t time,
+			uint64_t count)
+{
+	uint64_t sum = 0;
+	size_t i;
+
+	for (i = 0; i < SMBPROFILE_HIST_BUCKETS - 1; i++) {
+		sum += hist->buckets[i];
+		evbuffer_add_printf(
+			buf,
+			"%s_bucket "
+			"{share=\"%s\",operation=\"%s\",le=\"%" PRIu64 "\"} "
+			"%" PRIu64 "\n",
+			metric,
+			svc,
+			operation,
+			smbprofile_hist_bucket_limit(i),
+			sum);
+	}
+	evbuffer_add_printf(
+		buf,
+		"%s_bucket "
+		"{share=\"%s\",operation=\"%s\",le=\"+Inf\"} "
+		"%" PRIu64 "\n",
+		metric,
+		svc,
+		operation,
+		count);
+	evbuffer_add_printf(
+		buf,
+		"%s_sum "
+		"{share=\"%s\",operation=\"%s\"} "
+		"%" PRIu64 "\n",
+		metric,
+		svc,
+		operation,
+		time);
+	evbuffer_add_printf(
+		buf,
+		"%s_count "
+		"{share=\"%s\",operation=\"%s\"} "
+		"%" PRIu64 "\n",
+		metric,
+		svc,
+		operation,
+		count);
+}
+
+static void export_vfs_call_hist(const char *svc,
+				 const char *name,
+				 const struct smbprofile_stats_hist *hist,
+				 uint64_t time,
+				 uint64_t count,
+				 struct export_state *state)
+{
+	bool is_syscall;
+
+	is_syscall = (strncmp(name, "syscall_", 8) == 0);
+	if (!is_syscall) {
+		return;
+	}
+
+	if (!state->sent_help_vfs_call_hist) {
+		evbuffer_add_printf(
+			state->buf,
+			"# HELP smb_vfs_call_duration_microseconds "
+			"Histogram of latencies for VFS calls\n"
+			"# TYPE smb_vfs_call_duration_microseconds "
+			"histogram\n");
+		state->sent_help_vfs_call_hist = true;
+	}
+
+	export_hist(state->buf,
+		    "smb_vfs_call_duration_microseconds",
+		    svc,
+		    name + 8,
+		    hist,
+		    time,
+		    count);
+}
+
 static void export_count(const char *name,
 			 const struct smbprofile_stats_count *val,
 			 struct export_state *state)
@@ -199,8 +289,6 @@ static void export_iobytes_buckets(const char *svc,
 
 	is_smb2 = (strncmp(name, "smb2_", 5) == 0);
 	if (is_smb2) {
-		int i;
-
 		if (!state->sent_help_smb2_request_hist) {
 			evbuffer_add_printf(
 				state->buf,
@@ -211,41 +299,13 @@ static void export_iobytes_buckets(const char *svc,
 			state->sent_help_smb2_request_hist = true;
 		}
 
-		for (i=0; i<9; i++) {
-			evbuffer_add_printf(
-				state->buf,
-				"smb_smb2_request_duration_microseconds_bucket "
-				"{share=\"%s\",operation=\"%s\",le=\"%d000\"} "
-				"%" PRIu64 "\n",
-				svc,
-				name + 5,
-				1 << i,
-				val->buckets[i]);
-		}
-		evbuffer_add_printf(
-			state->buf,
-			"smb_smb2_request_duration_microseconds_bucket "
-			"{share=\"%s\",operation=\"%s\",le=\"+Inf\"} "
-			"%" PRIu64 "\n",
-			svc,
-			name + 5,
-			val->buckets[9]);
-		evbuffer_add_printf(
-			state->buf,
-			"smb_smb2_request_duration_microseconds_sum "
-			"{share=\"%s\",operation=\"%s\"} "
-			"%" PRIu64 "\n",
-			svc,
-			name + 5,
-			val->time);
-		evbuffer_add_printf(
-			state->buf,
-			"smb_smb2_request_duration_microseconds_count "
-			"{share=\"%s\",operation=\"%s\"} "
-			"%" PRIu64 "\n",
-			svc,
-			name + 5,
-			val->count);
+		export_hist(state->buf,
+			    "smb_smb2_request_duration_microseconds",
+			    svc,
+			    name + 5,
+			    &val->hist,
+			    val->time,
+			    val->count);
 	}
 }
 
@@ -412,6 +472,42 @@ static void export_profile_stats(const struct profile_stats *stats,
 #undef SMBPROFILE_STATS_IOBYTES
 #undef SMBPROFILE_STATS_SECTION_END
 #undef SMBPROFILE_STATS_END
+
+#define SMBPROFILE_STATS_START
+#define SMBPROFILE_STATS_SECTION_START(name, display)
+#define SMBPROFILE_STATS_COUNT(name)
+#define SMBPROFILE_STATS_TIME(name)
+#define SMBPROFILE_STATS_BASIC(name)                                   \
+	do {                                                           \
+		export_vfs_call_hist("",                               \
+				     #name,                            \
+				     &stats->values.name##_stats.hist, \
+				     stats->values.name##_stats.time,  \
+				     stats->values.name##_stats.count, \
+				     state);                           \
+	} while (0);
+#define SMBPROFILE_STATS_BYTES(name)                                   \
+	do {                                                           \
+		export_vfs_call_hist("",                               \
+				     #name,                            \
+				     &stats->values.name##_stats.hist, \
+				     stats->values.name##_stats.time,  \
+				     stats->values.name##_stats.count, \
+				     state);                           \
+	} while (0);
+#define SMBPROFILE_STATS_IOBYTES(name)
+#define SMBPROFILE_STATS_SECTION_END
+#define SMBPROFILE_STATS_END
+	SMBPROFILE_STATS_ALL_SECTIONS
+#undef SMBPROFILE_STATS_START
+#undef SMBPROFILE_STATS_SECTION_START
+#undef SMBPROFILE_STATS_COUNT
+#undef SMBPROFILE_STATS_TIME
+#undef SMBPROFILE_STATS_BASIC
+#undef SMBPROFILE_STATS_BYTES
+#undef SMBPROFILE_STATS_IOBYTES
+#undef SMBPROFILE_STATS_SECTION_END
+#undef SMBPROFILE_STATS_END
 }
 
 static void export_profile_persvc_stats(const struct profile_stats *stats,
@@ -542,6 +638,42 @@ static void export_profile_persvc_stats(const struct profile_stats *stats,
 #undef SMBPROFILE_STATS_IOBYTES
 #undef SMBPROFILE_STATS_SECTION_END
 #undef SMBPROFILE_STATS_END
+
+#define SMBPROFILE_STATS_START
+#define SMBPROFILE_STATS_SECTION_START(name, display)
+#define SMBPROFILE_STATS_COUNT(name)
+#define SMBPROFILE_STATS_TIME(name)
+#define SMBPROFILE_STATS_BASIC(name)                                   \
+	do {                                                           \
+		export_vfs_call_hist(svc,                              \
+				     #name,                            \
+				     &stats->values.name##_stats.hist, \
+				     stats->values.name##_stats.time,  \
+				     stats->values.name##_stats.count, \
+				     state);                           \
+	} while (0);
+#define SMBPROFILE_STATS_BYTES(name)                                   \
+	do {                                                           \
+		export_vfs_call_hist(svc,                              \
+				     #name,                            \
+				     &stats->values.name##_stats.hist, \
+				     stats->values.name##_stats.time,  \
+				     stats->values.name##_stats.count, \
+				     state);                           \
+	} while (0);
+#define SMBPROFILE_STATS_IOBYTES(name)
+#define SMBPROFILE_STATS_SECTION_END
+#define SMBPROFILE_STATS_END
+	SMBPROFILE_STATS_PERSVC_SECTIONS
+#undef SMBPROFILE_STATS_START
+#undef SMBPROFILE_STATS_SECTION_START
+#undef SMBPROFILE_STATS_COUNT
+#undef SMBPROFILE_STATS_TIME
+#undef SMBPROFILE_STATS_BASIC
+#undef SMBPROFILE_STATS_BYTES
+#undef SMBPROFILE_STATS_IOBYTES
+#undef SMBPROFILE_STATS_SECTION_END
+#undef SMBPROFILE_STATS_END
 }
 
 static int export_profile_persvc(const char *key,
@@ -292,7 +292,6 @@ static struct security_descriptor *get_secdesc_with_ctx(TALLOC_CTX *ctx,
 							struct cli_state *cli,
 							const char *filename)
 {
-	uint16_t fnum = (uint16_t)-1;
 	struct security_descriptor *sd;
 	NTSTATUS status;
 	uint32_t sec_info;
@@ -315,19 +314,9 @@ static struct security_descriptor *get_secdesc_with_ctx(TALLOC_CTX *ctx,
 		desired_access |= SEC_STD_READ_CONTROL;
 	}
 
-	status = cli_ntcreate(cli, filename, 0, desired_access,
-			      0, FILE_SHARE_READ|FILE_SHARE_WRITE,
-			      FILE_OPEN, 0x0, 0x0, &fnum, NULL);
-	if (!NT_STATUS_IS_OK(status)) {
-		printf("Failed to open %s: %s\n", filename, nt_errstr(status));
-		return NULL;
-	}
-
-	status = cli_query_security_descriptor(cli, fnum, sec_info,
-					       ctx, &sd);
-
-	cli_close(cli, fnum);
-
+	status = cli_query_security_descriptor_path(cli, filename,
+						    desired_access, sec_info,
+						    ctx, &sd);
 	if (!NT_STATUS_IS_OK(status)) {
 		printf("Failed to get security descriptor: %s\n",
 		       nt_errstr(status));
@@ -347,7 +336,6 @@ set sec desc for filename
 static bool set_secdesc(struct cli_state *cli, const char *filename,
                         struct security_descriptor *sd)
 {
-	uint16_t fnum = (uint16_t)-1;
         bool result=true;
 	NTSTATUS status;
 	uint32_t desired_access = 0;
@@ -383,23 +371,14 @@ static bool set_secdesc(struct cli_state *cli, const char *filename,
 		desired_access |= SEC_STD_WRITE_OWNER;
 	}
 
-	status = cli_ntcreate(cli, filename, 0,
-			      desired_access,
-			      0, FILE_SHARE_READ|FILE_SHARE_WRITE,
-			      FILE_OPEN, 0x0, 0x0, &fnum, NULL);
-	if (!NT_STATUS_IS_OK(status)) {
-		printf("Failed to open %s: %s\n", filename, nt_errstr(status));
-		return false;
-	}
-
-	status = cli_set_security_descriptor(cli, fnum, sec_info, sd);
+	status = cli_set_security_descriptor_path(cli, filename,
+						  desired_access, sec_info, sd);
 	if (!NT_STATUS_IS_OK(status)) {
 		printf("ERROR: security descriptor set failed: %s\n",
                        nt_errstr(status));
 		result=false;
 	}
 
-	cli_close(cli, fnum);
 	return result;
 }
 
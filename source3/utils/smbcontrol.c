@@ -905,6 +905,38 @@ static bool do_poolusage(struct tevent_context *ev_ctx,
 	return true;
 }
 
+/* Display g_lock contention statistics */
+
+static bool do_g_lock_stats(struct tevent_context *ev_ctx,
+			    struct messaging_context *msg_ctx,
+			    const struct server_id dst,
+			    const int argc, const char **argv)
+{
+	pid_t pid = procid_to_pid(&dst);
+	int stdout_fd = 1;
+
+	if (argc != 1) {
+		fprintf(stderr, "Usage: smbcontrol <dest> g-lock-stats\n");
+		return False;
+	}
+
+	if (pid == 0) {
+		fprintf(stderr, "Can only send to a specific PID\n");
+		return false;
+	}
+
+	messaging_send_iov(
+		msg_ctx,
+		dst,
+		MSG_REQ_G_LOCK_STATS,
+		NULL,
+		0,
+		&stdout_fd,
+		1);
+
+	return true;
+}
+
 static bool do_rpc_dump_status(
 	struct tevent_context *ev_ctx,
 	struct messaging_context *msg_ctx,
@@ -1061,6 +1093,64 @@ static bool do_num_children(struct tevent_context *ev_ctx,
 	return num_replies;
 }
 
+static bool do_scavenger_status(struct tevent_context *ev_ctx,
+				struct messaging_context *msg_ctx,
+				const struct server_id pid,
+				const int argc, const char **argv)
+{
+	if (argc != 1) {
+		fprintf(stderr,
+			"Usage: smbcontrol <dest> scavenger-status\n");
+		return False;
+	}
+
+	messaging_register(msg_ctx, NULL, MSG_SMB_SCAVENGER_STATUS,
+			   print_pid_string_cb);
+
+	if (!send_message(msg_ctx, pid, MSG_SMB_SCAVENGER_TELL_STATUS,
+			  NULL, 0)) {
+		return false;
+	}
+
+	wait_replies(ev_ctx, msg_ctx, procid_to_pid(&pid) == 0);
+
+	if (num_replies == 0)
+		printf("No replies received\n");
+
+	messaging_deregister(msg_ctx, MSG_SMB_SCAVENGER_STATUS, NULL);
+
+	return num_replies;
+}
+
+static bool do_prefork_status(struct tevent_context *ev_ctx,
+			      struct messaging_context *msg_ctx,
+			      const struct server_id pid,
+			      const int argc, const char **argv)
+{
+	if (argc != 1) {
+		fprintf(stderr,
+			"Usage: smbcontrol <dest> prefork-status\n");
+		return False;
+	}
+
+	messaging_register(msg_ctx, NULL, MSG_SMB_PREFORK_STATUS,
+			   print_pid_string_cb);
+
+	if (!send_message(msg_ctx, pid, MSG_SMB_TELL_PREFORK_STATUS,
+			  NULL, 0)) {
+		return false;
+	}
+
+	wait_replies(ev_ctx, msg_ctx, procid_to_pid(&pid) == 0);
+
+	if (num_replies == 0)
+		printf("No replies received\n");
+
+	messaging_deregister(msg_ctx, MSG_SMB_PREFORK_STATUS, NULL);
+
+	return num_replies;
+}
+
 static bool do_msg_cleanup(struct tevent_context *ev_ctx,
 			   struct messaging_context *msg_ctx,
 			   const struct server_id pid,
@@ -1526,6 +1616,11 @@ static const struct {
 		.fn   = do_poolusage,
 		.help = "Display talloc memory usage",
 	},
+	{
+		.name = "g-lock-stats",
+		.fn   = do_g_lock_stats,
+		.help = "Display g_lock contention statistics",
+	},
 	{
 		.name = "rpc-dump-status",
 		.fn   = do_rpc_dump_status,
@@ -1607,6 +1702,16 @@ static const struct {
 		.fn   = do_num_children,
 		.help = "Print number of smbd child processes",
 	},
+	{
+		.name = "scavenger-status",
+		.fn   = do_scavenger_status,
+		.help = "Print the backlog of the durable handle scavenger",
+	},
+	{
+		.name = "prefork-status",
+		.fn   = do_prefork_status,
+		.help = "Print the state of the smbd spare worker pool",
+	},
 	{
 		.name = "msg-cleanup",
 		.fn   = do_msg_cleanup,
@@ -26,6 +26,7 @@
 #include "auth/gensec/gensec.h"
 
 static int columns = 0;
+static int debug_level = -1;
 
 static time_t total_start_time = 0;
 static off_t total_bytes = 0;
@@ -51,13 +52,24 @@ struct opt {
 	int verbose;
 	int send_stdout;
 	int update;
+	int encrypt;
 	unsigned limit_rate;
+	int parallel;
 };
 static struct opt opt = { .blocksize = SMB_DEFAULT_BLOCKSIZE };
 
 static bool smb_download_file(const char *base, const char *name,
 			      bool recursive, bool resume, bool toplevel,
 			      char *outfile);
+static bool smbget_use_ranges(const char *newpath,
+			      const struct stat *remotestat,
+			      const struct stat *localstat,
+			      bool resume);
+static bool smb_download_ranges(const char *path,
+				const char *newpath,
+				int localhandle,
+				const struct stat *remotestat,
+				bool resume);
 
 static int get_num_cols(void)
 {
@@ -467,6 +479,16 @@ static bool smb_download_file(const char *base, const char *name,
 			return false;
 		}
 		/* no offset */
+		ZERO_STRUCT(localstat);
+		if (smbget_use_ranges(newpath, &remotestat, &localstat,
+				      false)) {
+			bool ok = smb_download_ranges(path, newpath,
+						      localhandle,
+						      &remotestat, false);
+			smbc_close(remotehandle);
+			close(localhandle);
+			return ok;
+		}
 	} else if (!opt.send_stdout) {
 		localhandle = open(newpath, O_CREAT | O_NONBLOCK | O_RDWR |
 						(!resume ? O_EXCL : 0),
@@ -486,6 +508,16 @@ static bool smb_download_file(const char *base, const char *name,
 			return false;
 		}
 
+		if (smbget_use_ranges(newpath, &remotestat, &localstat,
+				      resume)) {
+			bool ok = smb_download_ranges(path, newpath,
+						      localhandle,
+						      &remotestat, resume);
+			smbc_close(remotehandle);
+			close(localhandle);
+			return ok;
+		}
+
 		start_offset = localstat.st_size;
 
 		if (localstat.st_size &&
@@ -735,6 +767,487 @@ static bool smb_download_file(const char *base, const char *name,
 	return true;
 }
 
+/*
+ * Set up a libsmbclient context from the command line options. This
+ * is also used by the child processes of a parallel download, each
+ * of them needs its own connection.
+ */
+static SMBCCTX *smbget_init_context(int dbg_lvl)
+{
+	struct cli_credentials *creds = samba_cmdline_get_creds();
+	enum smb_encryption_setting encryption_state = SMB_ENCRYPTION_DEFAULT;
+	enum credentials_use_kerberos use_kerberos = CRED_USE_KERBEROS_DESIRED;
+	smbc_smb_encrypt_level encrypt_level = SMBC_ENCRYPTLEVEL_DEFAULT;
+#if 0
+	enum smb_signing_setting signing_state = SMB_SIGNING_DEFAULT;
+	const char *use_signing = "auto";
+#endif
+	bool is_nt_hash = false;
+	uint32_t gensec_features;
+	bool use_wbccache = false;
+	SMBCCTX *smb_ctx = NULL;
+	int rc;
+
+	smb_ctx = smbc_new_context();
+	if (smb_ctx == NULL) {
+		fprintf(stderr, "Unable to initialize libsmbclient\n");
+		return NULL;
+	}
+	smbc_setDebug(smb_ctx, dbg_lvl);
+
+	rc = smbc_setConfiguration(smb_ctx, lp_default_path());
+	if (rc < 0) {
+		smbc_free_context(smb_ctx, 1);
+		return NULL;
+	}
+
+	smbc_setFunctionAuthDataWithContext(smb_ctx,
+					    get_auth_data_with_context_fn);
+
+	if (smbc_init_context(smb_ctx) == NULL) {
+		smbc_free_context(smb_ctx, 1);
+		return NULL;
+	}
+
+	encryption_state = cli_credentials_get_smb_encryption(creds);
+	switch (encryption_state) {
+	case SMB_ENCRYPTION_REQUIRED:
+		encrypt_level = SMBC_ENCRYPTLEVEL_REQUIRE;
+		break;
+	case SMB_ENCRYPTION_DESIRED:
+	case SMB_ENCRYPTION_IF_REQUIRED:
+		encrypt_level = SMBC_ENCRYPTLEVEL_REQUEST;
+		break;
+	case SMB_ENCRYPTION_OFF:
+		encrypt_level = SMBC_ENCRYPTLEVEL_NONE;
+		break;
+	case SMB_ENCRYPTION_DEFAULT:
+		encrypt_level = SMBC_ENCRYPTLEVEL_DEFAULT;
+		break;
+	}
+	if (opt.encrypt) {
+		encrypt_level = SMBC_ENCRYPTLEVEL_REQUIRE;
+	}
+	smbc_setOptionSmbEncryptionLevel(smb_ctx, encrypt_level);
+
+#if 0
+	signing_state = cli_credentials_get_smb_signing(creds);
+	if (encryption_state >= SMB_ENCRYPTION_DESIRED) {
+		signing_state = SMB_SIGNING_REQUIRED;
+	}
+	switch (signing_state) {
+	case SMB_SIGNING_REQUIRED:
+		use_signing = "required";
+		break;
+	case SMB_SIGNING_DEFAULT:
+	case SMB_SIGNING_DESIRED:
+	case SMB_SIGNING_IF_REQUIRED:
+		use_signing = "yes";
+		break;
+	case SMB_SIGNING_OFF:
+		use_signing = "off";
+		break;
+	default:
+		use_signing = "auto";
+		break;
+	}
+	/* FIXME: There is no libsmbclient function to set signing state */
+#endif
+
+	use_kerberos = cli_credentials_get_kerberos_state(creds);
+	switch (use_kerberos) {
+	case CRED_USE_KERBEROS_REQUIRED:
+		smbc_setOptionUseKerberos(smb_ctx, true);
+		smbc_setOptionFallbackAfterKerberos(smb_ctx, false);
+		break;
+	case CRED_USE_KERBEROS_DESIRED:
+		smbc_setOptionUseKerberos(smb_ctx, true);
+		smbc_setOptionFallbackAfterKerberos(smb_ctx, true);
+		break;
+	case CRED_USE_KERBEROS_DISABLED:
+		smbc_setOptionUseKerberos(smb_ctx, false);
+		break;
+	}
+
+	/* Check if the password supplied is an NT hash */
+	is_nt_hash = cli_credentials_is_password_nt_hash(creds);
+	smbc_setOptionUseNTHash(smb_ctx, is_nt_hash);
+
+	/* Check if we should use the winbind ccache */
+	gensec_features = cli_credentials_get_gensec_features(creds);
+	use_wbccache = (gensec_features & GENSEC_FEATURE_NTLM_CCACHE);
+	smbc_setOptionUseCCache(smb_ctx, use_wbccache);
+
+	return smb_ctx;
+}
+
+/*
+ * Parallel ranged downloads: the file is split into ranges that are
+ * fetched by child processes, each with its own connection. The
+ * progress of each range is kept in shared memory and written to
+ * "<file>.smbget-ranges" regularly, so that --resume can continue
+ * the ranges where they stopped.
+ */
+
+#define SMBGET_RANGE_MIN_SIZE	(16*1024*1024)
+#define SMBGET_MAX_RANGES	16
+#define SMBGET_RANGES_SUFFIX	".smbget-ranges"
+
+struct smbget_range {
+	off_t start;
+	off_t end;
+	off_t done;
+};
+
+static char *smbget_ranges_path(TALLOC_CTX *mem_ctx, const char *newpath)
+{
+	return talloc_asprintf(mem_ctx, "%s" SMBGET_RANGES_SUFFIX, newpath);
+}
+
+static bool smbget_use_ranges(const char *newpath,
+			      const struct stat *remotestat,
+			      const struct stat *localstat,
+			      bool resume)
+{
+	char *rpath = NULL;
+	struct stat st;
+	int ret;
+
+	if (opt.parallel <= 1 || opt.limit_rate > 0) {
+		return false;
+	}
+	if (remotestat->st_size < 2 * SMBGET_RANGE_MIN_SIZE) {
+		return false;
+	}
+	if (localstat->st_size == 0) {
+		return true;
+	}
+	if (!resume) {
+		return false;
+	}
+
+	rpath = smbget_ranges_path(talloc_tos(), newpath);
+	if (rpath == NULL) {
+		return false;
+	}
+	ret = stat(rpath, &st);
+	TALLOC_FREE(rpath);
+	return (ret == 0);
+}
+
+static bool smbget_ranges_load(const char *rpath,
+			       const struct stat *remotestat,
+			       struct smbget_range *ranges,
+			       int *pnum_ranges)
+{
+	FILE *f = NULL;
+	intmax_t size, mtime, start, end, done;
+	off_t expected_start = 0;
+	int i, num_ranges;
+	bool ok = false;
+
+	f = fopen(rpath, "r");
+	if (f == NULL) {
+		return false;
+	}
+
+	if (fscanf(f, "smbget-ranges %jd %jd %d\n",
+		   &size, &mtime, &num_ranges) != 3) {
+		goto done;
+	}
+	if (size != remotestat->st_size || mtime != remotestat->st_mtime) {
+		goto done;
+	}
+	if (num_ranges < 1 || num_ranges > SMBGET_MAX_RANGES) {
+		goto done;
+	}
+
+	for (i = 0; i < num_ranges; i++) {
+		if (fscanf(f, "%jd %jd %jd\n", &start, &end, &done) != 3) {
+			goto done;
+		}
+		if (start != expected_start || end < start ||
+		    done < 0 || done > end - start) {
+			goto done;
+		}
+		ranges[i] = (struct smbget_range) {
+			.start = start, .end = end, .done = done,
+		};
+		expected_start = end;
+	}
+	if (expected_start != remotestat->st_size) {
+		goto done;
+	}
+
+	*pnum_ranges = num_ranges;
+	ok = true;
+done:
+	fclose(f);
+	return ok;
+}
+
+static bool smbget_ranges_save(const char *rpath,
+			       const struct stat *remotestat,
+			       const struct smbget_range *ranges,
+			       int num_ranges)
+{
+	char *tmp = NULL;
+	FILE *f = NULL;
+	int i, ret;
+
+	tmp = talloc_asprintf(talloc_tos(), "%s.tmp", rpath);
+	if (tmp == NULL) {
+		return false;
+	}
+	f = fopen(tmp, "w");
+	if (f == NULL) {
+		TALLOC_FREE(tmp);
+		return false;
+	}
+
+	fprintf(f, "smbget-ranges %jd %jd %d\n",
+		(intmax_t)remotestat->st_size,
+		(intmax_t)remotestat->st_mtime,
+		num_ranges);
+	for (i = 0; i < num_ranges; i++) {
+		fprintf(f, "%jd %jd %jd\n",
+			(intmax_t)ranges[i].start,
+			(intmax_t)ranges[i].end,
+			(intmax_t)ranges[i].done);
+	}
+
+	ret = fclose(f);
+	if (ret == 0) {
+		ret = rename(tmp, rpath);
+	}
+	if (ret != 0) {
+		unlink(tmp);
+	}
+	TALLOC_FREE(tmp);
+	return (ret == 0);
+}
+
+/* Runs in a child process with its own connection */
+static bool smbget_fetch_range(const char *path,
+			       int localhandle,
+			       struct smbget_range *r)
+{
+	SMBCCTX *smb_ctx = NULL;
+	char *readbuf = NULL;
+	off_t pos = r->start + r->done;
+	int remotehandle;
+	bool ok = false;
+
+	smb_ctx = smbget_init_context(debug_level);
+	if (smb_ctx == NULL) {
+		return false;
+	}
+	smbc_set_context(smb_ctx);
+
+	readbuf = (char *)SMB_MALLOC(opt.blocksize);
+	if (readbuf == NULL) {
+		return false;
+	}
+
+	remotehandle = smbc_open(path, O_RDONLY, 0755);
+	if (remotehandle < 0) {
+		fprintf(stderr, "Can't open %s: %s\n", path, strerror(errno));
+		goto done;
+	}
+	if (smbc_lseek(remotehandle, pos, SEEK_SET) != pos) {
+		fprintf(stderr, "Can't seek to %jd in remote file %s\n",
+			(intmax_t)pos, path);
+		goto done;
+	}
+
+	while (pos < r->end) {
+		size_t len = MIN(opt.blocksize, r->end - pos);
+		ssize_t bytesread;
+
+		bytesread = smbc_read(remotehandle, readbuf, len);
+		if (bytesread <= 0) {
+			fprintf(stderr,
+				"Can't read %zu bytes at offset %jd, file %s\n",
+				len, (intmax_t)pos, path);
+			goto done;
+		}
+		if (pwrite(localhandle, readbuf, bytesread, pos) != bytesread) {
+			fprintf(stderr,
+				"Can't write %zd bytes to local file at "
+				"offset %jd: %s\n",
+				bytesread, (intmax_t)pos, strerror(errno));
+			goto done;
+		}
+		pos += bytesread;
+		/* Only the parent reads this, for progress and resume */
+		r->done += bytesread;
+	}
+
+	ok = true;
+done:
+	SAFE_FREE(readbuf);
+	return ok;
+}
+
+static bool smb_download_ranges(const char *path,
+				const char *newpath,
+				int localhandle,
+				const struct stat *remotestat,
+				bool resume)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct smbget_range *ranges = NULL;
+	time_t start_time = time_mono(NULL);
+	char *rpath = NULL;
+	off_t start_done = 0, done = 0;
+	int num_ranges = 0;
+	int running = 0;
+	bool failed = false;
+	bool ok = false;
+	int i;
+
+	rpath = smbget_ranges_path(frame, newpath);
+	if (rpath == NULL) {
+		goto out;
+	}
+
+	ranges = (struct smbget_range *)anonymous_shared_allocate(
+		sizeof(struct smbget_range) * SMBGET_MAX_RANGES);
+	if (ranges == NULL) {
+		fprintf(stderr, "Failed to allocate shared memory: %s\n",
+			strerror(errno));
+		goto out;
+	}
+
+	if (!resume ||
+	    !smbget_ranges_load(rpath, remotestat, ranges, &num_ranges)) {
+		off_t size = remotestat->st_size;
+		off_t chunk;
+
+		num_ranges = MIN(opt.parallel, SMBGET_MAX_RANGES);
+		num_ranges = MIN(num_ranges, size / SMBGET_RANGE_MIN_SIZE);
+		chunk = size / num_ranges;
+
+		for (i = 0; i < num_ranges; i++) {
+			ranges[i] = (struct smbget_range) {
+				.start = i * chunk,
+				.end = (i == num_ranges - 1) ?
+					size : (i + 1) * chunk,
+			};
+		}
+	} else if (opt.verbose) {
+		printf("Resuming %d ranges of %s\n", num_ranges, newpath);
+	}
+
+	for (i = 0; i < num_ranges; i++) {
+		start_done += ranges[i].done;
+	}
+
+	if (ftruncate(localhandle, remotestat->st_size) != 0) {
+		fprintf(stderr, "Can't extend %s to %jd bytes: %s\n",
+			newpath, (intmax_t)remotestat->st_size,
+			strerror(errno));
+		goto out;
+	}
+
+	if (!smbget_ranges_save(rpath, remotestat, ranges, num_ranges)) {
+		fprintf(stderr, "Can't write %s: %s\n", rpath, strerror(errno));
+		goto out;
+	}
+
+	for (i = 0; i < num_ranges; i++) {
+		pid_t pid;
+
+		if (ranges[i].done == ranges[i].end - ranges[i].start) {
+			continue;
+		}
+
+		pid = fork();
+		if (pid == -1) {
+			fprintf(stderr, "fork failed: %s\n", strerror(errno));
+			failed = true;
+			break;
+		}
+		if (pid == 0) {
+			signal(SIGINT, SIG_DFL);
+			signal(SIGTERM, SIG_DFL);
+			/*
+			 * Don't touch the connections of the parent,
+			 * just _exit().
+			 */
+			ok = smbget_fetch_range(path, localhandle, &ranges[i]);
+			_exit(ok ? 0 : 1);
+		}
+		running += 1;
+	}
+
+	while (running > 0) {
+		int status;
+		pid_t pid;
+
+		pid = waitpid(-1, &status, WNOHANG);
+		if (pid == -1) {
+			fprintf(stderr, "waitpid failed: %s\n",
+				strerror(errno));
+			failed = true;
+			break;
+		}
+		if (pid > 0) {
+			running -= 1;
+			if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+				failed = true;
+			}
+			continue;
+		}
+
+		for (done = 0, i = 0; i < num_ranges; i++) {
+			done += ranges[i].done;
+		}
+		if (opt.dots) {
+			fputc('.', stderr);
+		} else if (!opt.quiet) {
+			print_progress(newpath, start_time, time_mono(NULL),
+				       start_done, done, remotestat->st_size);
+		}
+		smbget_ranges_save(rpath, remotestat, ranges, num_ranges);
+		smb_msleep(500);
+	}
+
+	for (done = 0, i = 0; i < num_ranges; i++) {
+		done += ranges[i].done;
+	}
+	total_bytes += done - start_done;
+
+	if (failed || done != remotestat->st_size) {
+		smbget_ranges_save(rpath, remotestat, ranges, num_ranges);
+		fprintf(stderr, "\nDownload of %s incomplete, use --resume "
+			"to continue\n", path);
+		goto out;
+	}
+
+	unlink(rpath);
+
+	if (opt.dots) {
+		fputc('\n', stderr);
+		printf("%s downloaded\n", path);
+	} else if (!opt.quiet) {
+		time_t secs = MAX(1, time_mono(NULL) - start_time);
+		char hsize[22], havg[22];
+
+		human_readable(done - start_done, hsize, sizeof(hsize));
+		human_readable((done - start_done) / secs, havg, sizeof(havg));
+		fprintf(stderr, "\r%s: %s in %lu seconds (%s/s, %d ranges)\n",
+			path, hsize, (unsigned long)secs, havg, num_ranges);
+	}
+	ok = true;
+out:
+	if (ranges != NULL) {
+		anonymous_shared_free(ranges);
+	}
+	TALLOC_FREE(frame);
+	return ok;
+}
+
 static void clean_exit(void)
 {
 	char bs[100];
@@ -755,7 +1268,6 @@ int main(int argc, char **argv)
 {
 	int c = 0;
 	const char *file = NULL;
-	int smb_encrypt = false;
 	int resume = 0, recursive = 0;
 	TALLOC_CTX *frame = talloc_stackframe();
 	bool ok = false;
@@ -775,7 +1287,7 @@ int main(int argc, char **argv)
 			.longName   = "encrypt",
 			.shortName  = 'e',
 			.argInfo    = POPT_ARG_NONE,
-			.arg        = &smb_encrypt,
+			.arg        = &opt.encrypt,
 			.val        = 1,
 			.descrip    = "Encrypt SMB transport"
 		},
@@ -862,6 +1374,15 @@ int main(int argc, char **argv)
 			.val        = 'l',
 			.descrip    = "Limit download speed to this many KB/s"
 		},
+		{
+			.longName   = "parallel",
+			.shortName  = 0,
+			.argInfo    = POPT_ARG_INT,
+			.arg        = &opt.parallel,
+			.val        = 'p',
+			.descrip    = "Download large files in this many "
+				      "ranges in parallel"
+		},
 
 		POPT_COMMON_SAMBA
 		POPT_COMMON_CONNECTION
@@ -872,19 +1393,7 @@ int main(int argc, char **argv)
 	};
 	poptContext pc = NULL;
 	struct cli_credentials *creds = NULL;
-	enum smb_encryption_setting encryption_state = SMB_ENCRYPTION_DEFAULT;
-	enum credentials_use_kerberos use_kerberos = CRED_USE_KERBEROS_DESIRED;
-	smbc_smb_encrypt_level encrypt_level = SMBC_ENCRYPTLEVEL_DEFAULT;
-#if 0
-	enum smb_signing_setting signing_state = SMB_SIGNING_DEFAULT;
-	const char *use_signing = "auto";
-#endif
-	bool is_nt_hash = false;
-	uint32_t gensec_features;
-	bool use_wbccache = false;
 	SMBCCTX *smb_ctx = NULL;
-	int dbg_lvl = -1;
-	int rc;
 
 	smb_init_locale();
 
@@ -958,100 +1467,15 @@ int main(int argc, char **argv)
 	samba_cmdline_burn(argc, argv);
 
 	/* smbc_new_context() will set the log level to 0 */
-	dbg_lvl = debuglevel_get();
+	debug_level = debuglevel_get();
 
-	smb_ctx = smbc_new_context();
+	smb_ctx = smbget_init_context(debug_level);
 	if (smb_ctx == NULL) {
-		fprintf(stderr, "Unable to initialize libsmbclient\n");
 		ok = false;
 		goto done;
 	}
-	smbc_setDebug(smb_ctx, dbg_lvl);
-
-	rc = smbc_setConfiguration(smb_ctx, lp_default_path());
-	if (rc < 0) {
-		ok = false;
-		goto done;
-	}
-
-	smbc_setFunctionAuthDataWithContext(smb_ctx,
-					    get_auth_data_with_context_fn);
-
-	ok = smbc_init_context(smb_ctx);
-	if (!ok) {
-		goto done;
-	}
 	smbc_set_context(smb_ctx);
 
-	encryption_state = cli_credentials_get_smb_encryption(creds);
-	switch (encryption_state) {
-	case SMB_ENCRYPTION_REQUIRED:
-		encrypt_level = SMBC_ENCRYPTLEVEL_REQUIRE;
-		break;
-	case SMB_ENCRYPTION_DESIRED:
-	case SMB_ENCRYPTION_IF_REQUIRED:
-		encrypt_level = SMBC_ENCRYPTLEVEL_REQUEST;
-		break;
-	case SMB_ENCRYPTION_OFF:
-		encrypt_level = SMBC_ENCRYPTLEVEL_NONE;
-		break;
-	case SMB_ENCRYPTION_DEFAULT:
-		encrypt_level = SMBC_ENCRYPTLEVEL_DEFAULT;
-		break;
-	}
-	if (smb_encrypt) {
-		encrypt_level = SMBC_ENCRYPTLEVEL_REQUIRE;
-	}
-	smbc_setOptionSmbEncryptionLevel(smb_ctx, encrypt_level);
-
-#if 0
-	signing_state = cli_credentials_get_smb_signing(creds);
-	if (encryption_state >= SMB_ENCRYPTION_DESIRED) {
-		signing_state = SMB_SIGNING_REQUIRED;
-	}
-	switch (signing_state) {
-	case SMB_SIGNING_REQUIRED:
-		use_signing = "required";
-		break;
-	case SMB_SIGNING_DEFAULT:
-	case SMB_SIGNING_DESIRED:
-	case SMB_SIGNING_IF_REQUIRED:
-		use_signing = "yes";
-		break;
-	case SMB_SIGNING_OFF:
-		use_signing = "off";
-		break;
-	default:
-		use_signing = "auto";
-		break;
-	}
-	/* FIXME: There is no libsmbclient function to set signing state */
-#endif
-
-	use_kerberos = cli_credentials_get_kerberos_state(creds);
-	switch (use_kerberos) {
-	case CRED_USE_KERBEROS_REQUIRED:
-		smbc_setOptionUseKerberos(smb_ctx, true);
-		smbc_setOptionFallbackAfterKerberos(smb_ctx, false);
-		break;
-	case CRED_USE_KERBEROS_DESIRED:
-		smbc_setOptionUseKerberos(smb_ctx, true);
-		smbc_setOptionFallbackAfterKerberos(smb_ctx, true);
-		break;
-	case CRED_USE_KERBEROS_DISABLED:
-		smbc_setOptionUseKerberos(smb_ctx, false);
-		break;
-	}
-
-	/* Check if the password supplied is an NT hash */
-	is_nt_hash = cli_credentials_is_password_nt_hash(creds);
-	smbc_setOptionUseNTHash(smb_ctx, is_nt_hash);
-
-	/* Check if we should use the winbind ccache */
-	gensec_features = cli_credentials_get_gensec_features(creds);
-	use_wbccache = (gensec_features & GENSEC_FEATURE_NTLM_CCACHE);
-	smbc_setOptionUseCCache(smb_ctx, use_wbccache);
-
 	columns = get_num_cols();
 
 	total_start_time = time_mono(NULL);
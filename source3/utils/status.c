@@ -67,6 +67,7 @@ static uid_t 		Ucrit_uid = 0;               /* added by OH */
 static struct server_id	Ucrit_pid[SMB_MAXPIDS];  /* Ugly !!! */   /* added by OH */
 static int		Ucrit_MaxPid=0;                    /* added by OH */
 static unsigned int	Ucrit_IsActive = 0;                /* added by OH */
+static bool		Ucrit_pid_sorted = true;
 
 static bool verbose, brief;
 static bool shares_only;            /* Added by RJS */
@@ -96,20 +97,33 @@ static unsigned int Ucrit_checkUid(uid_t uid)
 	return 0;
 }
 
+static int Ucrit_pid_cmp(const void *a, const void *b)
+{
+	return server_id_cmp((const struct server_id *)a,
+			     (const struct server_id *)b);
+}
+
 static unsigned int Ucrit_checkPid(struct server_id pid)
 {
-	int i;
+	struct server_id *found = NULL;
 
 	if ( !Ucrit_IsActive )
 		return 1;
 
-	for (i=0;i<Ucrit_MaxPid;i++) {
-		if (server_id_equal(&pid, &Ucrit_pid[i])) {
-			return 1;
-		}
+	/*
+	 * This is called for every open file, keep the pids
+	 * sorted to make it a binary search
+	 */
+	if (!Ucrit_pid_sorted) {
+		qsort(Ucrit_pid, Ucrit_MaxPid, sizeof(struct server_id),
+		      Ucrit_pid_cmp);
+		Ucrit_pid_sorted = true;
 	}
 
-	return 0;
+	found = bsearch(&pid, Ucrit_pid, Ucrit_MaxPid,
+			sizeof(struct server_id), Ucrit_pid_cmp);
+
+	return (found != NULL) ? 1 : 0;
 }
 
 static bool Ucrit_addPid( struct server_id pid )
@@ -125,6 +139,7 @@ static bool Ucrit_addPid( struct server_id pid )
 	}
 
 	Ucrit_pid[Ucrit_MaxPid++] = pid;
+	Ucrit_pid_sorted = false;
 
 	return True;
 }
@@ -187,6 +202,19 @@ static uint32_t map_share_mode_to_deny_mode(
 	return (uint32_t)-1;
 }
 
+/*
+ * Called on the raw share mode entries, lets the traversal skip
+ * decoding files nobody we are interested in has open
+ */
+static bool filter_share_mode(const struct share_mode_entry *e,
+			      void *private_data)
+{
+	if (do_checks && !is_valid_share_mode_entry(e)) {
+		return false;
+	}
+	return Ucrit_checkPid(e->pid);
+}
+
 static int print_share_mode(struct file_id fid,
 			    const struct share_mode_data *d,
 			    const struct share_mode_entry *e,
@@ -930,8 +958,83 @@ static bool print_notify_rec(const char *path, struct server_id server,
 	return result;
 }
 
+static void print_qos_status_cb(struct messaging_context *msg_ctx,
+				void *private_data,
+				uint32_t msg_type,
+				struct server_id pid,
+				DATA_BLOB *data)
+{
+	struct server_id_buf idbuf;
+	unsigned int *num_replies = (unsigned int *)private_data;
+
+	printf("PID %s:\n%.*s",
+	       server_id_str_buf(pid, &idbuf),
+	       (int)data->length,
+	       (const char *)data->data);
+	*num_replies += 1;
+}
+
+static void status_qos_timeout(struct tevent_context *ev,
+			       struct tevent_timer *te,
+			       struct timeval now,
+			       void *private_data)
+{
+	bool *timed_out = (bool *)private_data;
+
+	*timed_out = true;
+}
+
+/*
+ * Ask all smbd processes for the state of their SMB2 I/O limiters,
+ * only processes with limits configured will answer.
+ */
+static bool status_qos(struct messaging_context *msg_ctx)
+{
+	struct tevent_context *ev = messaging_tevent_context(msg_ctx);
+	struct tevent_timer *te = NULL;
+	unsigned int num_replies = 0;
+	bool timed_out = false;
+	NTSTATUS status;
+
+	status = messaging_register(msg_ctx,
+				    &num_replies,
+				    MSG_SMB_QOS_STATUS,
+				    print_qos_status_cb);
+	if (!NT_STATUS_IS_OK(status)) {
+		fprintf(stderr, "messaging_register failed: %s\n",
+			nt_errstr(status));
+		return false;
+	}
+
+	messaging_send_all(msg_ctx, MSG_SMB_TELL_QOS_STATUS, NULL, 0);
+
+	te = tevent_add_timer(ev,
+			      talloc_tos(),
+			      timeval_current_ofs(1, 0),
+			      status_qos_timeout,
+			      &timed_out);
+	if (te == NULL) {
+		fprintf(stderr, "tevent_add_timer failed\n");
+		messaging_deregister(msg_ctx, MSG_SMB_QOS_STATUS, &num_replies);
+		return false;
+	}
+
+	while (!timed_out) {
+		tevent_loop_once(ev);
+	}
+
+	messaging_deregister(msg_ctx, MSG_SMB_QOS_STATUS, &num_replies);
+
+	if (num_replies == 0) {
+		printf("No SMB2 I/O limits active\n");
+	}
+	return true;
+}
+
 enum {
 	OPT_RESOLVE_UIDS = 1000,
+	OPT_PROFILE_TOP,
+	OPT_QOS,
 };
 
 int main(int argc, const char *argv[])
@@ -1016,6 +1119,22 @@ int main(int argc, const char *argv[])
 			.val        = 'R',
 			.descrip    = "Show call rates",
 		},
+		{
+			.longName   = "profile-top",
+			.shortName  = 0,
+			.argInfo    = POPT_ARG_NONE,
+			.arg        = NULL,
+			.val        = OPT_PROFILE_TOP,
+			.descrip    = "Show the busiest shares and clients",
+		},
+		{
+			.longName   = "qos",
+			.shortName  = 0,
+			.argInfo    = POPT_ARG_NONE,
+			.arg        = NULL,
+			.val        = OPT_QOS,
+			.descrip    = "Show the state of the SMB2 I/O limits",
+		},
 		{
 			.longName   = "byterange",
 			.shortName  = 'B',
@@ -1120,6 +1239,8 @@ int main(int argc, const char *argv[])
 			break;
 		case 'P':
 		case 'R':
+		case OPT_PROFILE_TOP:
+		case OPT_QOS:
 			profile_only = c;
 			break;
 		case 'B':
@@ -1207,6 +1328,26 @@ int main(int argc, const char *argv[])
 				ret = 1;
 			}
 			goto done;
+		case OPT_PROFILE_TOP:
+			/* Per share and client summaries */
+			if (!state.json_output) {
+				ok = status_profile_top(verbose);
+				ret = ok ? 0 : 1;
+			} else {
+				fprintf(stderr, "Profile top not available in a json output.\n");
+				ret = 1;
+			}
+			goto done;
+		case OPT_QOS:
+			/* SMB2 I/O limiter state, queried from smbd */
+			if (!state.json_output) {
+				ok = status_qos(msg_ctx);
+				ret = ok ? 0 : 1;
+			} else {
+				fprintf(stderr, "QoS status not available in a json output.\n");
+				ret = 1;
+			}
+			goto done;
 		default:
 			break;
 	}
@@ -1270,7 +1411,9 @@ int main(int argc, const char *argv[])
 		}
 
 		prepare_share_mode(&state);
-		result = share_entry_forall_read(print_share_mode, &state);
+		result = share_entry_forall_read_filtered(filter_share_mode,
+							  print_share_mode,
+							  &state);
 
 		if (result == 0 && !state.json_output) {
 			fprintf(stderr, "No locked files\n");
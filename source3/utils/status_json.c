@@ -340,6 +340,9 @@ static int add_channel_to_json(struct json_object *parent_json,
 	case SMB_TRANSPORT_TYPE_TCP:
 		transport_str = "tcp";
 		break;
+	case SMB_TRANSPORT_TYPE_QUIC:
+		transport_str = "quic";
+		break;
 	}
 
 	if (transport_str == NULL) {
@@ -385,6 +388,14 @@ static int add_channel_to_json(struct json_object *parent_json,
 	if (result < 0) {
 		goto failure;
 	}
+	result = json_add_int(&sub_json, "incoming_cpu", channel->incoming_cpu);
+	if (result < 0) {
+		goto failure;
+	}
+	result = json_add_string(&sub_json, "cpu_affinity", channel->cpu_affinity);
+	if (result < 0) {
+		goto failure;
+	}
 
 	result = json_add_object(parent_json, id_str, &sub_json);
 	if (result < 0) {
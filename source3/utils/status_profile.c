@@ -47,33 +47,18 @@ static void profile_separator(const char * title,
 
 static void print_buckets(struct traverse_state *state,
 			  const char *name,
-			  const struct smbprofile_stats_iobytes *s)
+			  const struct smbprofile_stats_hist *h)
 {
+	size_t i;
+
 	if (state->json_output) {
 		return;
 	}
-	d_printf("%s_buckets: "
-		 "%"PRIu64","
-		 "%"PRIu64","
-		 "%"PRIu64","
-		 "%"PRIu64","
-		 "%"PRIu64","
-		 "%"PRIu64","
-		 "%"PRIu64","
-		 "%"PRIu64","
-		 "%"PRIu64","
-		 "%"PRIu64"\n",
-		 name,
-		 s->buckets[0],
-		 s->buckets[1],
-		 s->buckets[2],
-		 s->buckets[3],
-		 s->buckets[4],
-		 s->buckets[5],
-		 s->buckets[6],
-		 s->buckets[7],
-		 s->buckets[8],
-		 s->buckets[9]);
+	d_printf("%s_buckets: ", name);
+	for (i = 0; i < SMBPROFILE_HIST_BUCKETS; i++) {
+		d_printf("%s%"PRIu64, (i == 0) ? "" : ",", h->buckets[i]);
+	}
+	d_printf("\n");
 }
 
 /*******************************************************************
@@ -103,6 +88,32 @@ static void status_profile_dump_persvc_stats(struct traverse_state *state,
 							val);             \
 		}                                                         \
 	} while (0);
+#define __PRINT_PERCENTILE_LINE(name, _stats, pct, permille)              \
+	do {                                                              \
+		uintmax_t val = (uintmax_t)smbprofile_hist_percentile(    \
+			&(*pstats).values._stats.hist, permille);         \
+		if (!state->json_output) {                                \
+			d_printf("%s %-59s%20ju\n",                       \
+				 secname,                                 \
+				 name "_" #pct ":",                       \
+				 val);                                    \
+		} else {                                                  \
+			add_profile_persvc_item_to_json(state,            \
+							secname,          \
+							latest_section,   \
+							name,             \
+							#pct,             \
+							val);             \
+		}                                                         \
+	} while (0);
+#define __PRINT_HIST(name, _stats)                                        \
+	do {                                                              \
+		print_buckets(state, name, &(*pstats).values._stats.hist); \
+		__PRINT_PERCENTILE_LINE(name, _stats, p50, 500);          \
+		__PRINT_PERCENTILE_LINE(name, _stats, p90, 900);          \
+		__PRINT_PERCENTILE_LINE(name, _stats, p99, 990);          \
+		__PRINT_PERCENTILE_LINE(name, _stats, p999, 999);         \
+	} while (0);
 #define SMBPROFILE_STATS_START
 #define SMBPROFILE_STATS_SECTION_START(name, display) \
 	do {                                          \
@@ -121,11 +132,13 @@ static void status_profile_dump_persvc_stats(struct traverse_state *state,
 	do {                                                    \
 		__PRINT_FIELD_LINE(#name, name##_stats, count); \
 		__PRINT_FIELD_LINE(#name, name##_stats, time);  \
+		__PRINT_HIST(#name, name##_stats);              \
 	} while (0);
 #define SMBPROFILE_STATS_BYTES(name)                            \
 	do {                                                    \
 		__PRINT_FIELD_LINE(#name, name##_stats, count); \
 		__PRINT_FIELD_LINE(#name, name##_stats, time);  \
+		__PRINT_HIST(#name, name##_stats);              \
 		__PRINT_FIELD_LINE(#name, name##_stats, idle);  \
 		__PRINT_FIELD_LINE(#name, name##_stats, bytes); \
 	} while (0);
@@ -134,7 +147,7 @@ static void status_profile_dump_persvc_stats(struct traverse_state *state,
 		__PRINT_FIELD_LINE(#name, name##_stats, count);              \
 		__PRINT_FIELD_LINE(#name, name##_stats, failed_count);       \
 		__PRINT_FIELD_LINE(#name, name##_stats, time);               \
-		print_buckets(state, #name, &(*pstats).values.name##_stats); \
+		__PRINT_HIST(#name, name##_stats);                           \
 		__PRINT_FIELD_LINE(#name, name##_stats, idle);               \
 		__PRINT_FIELD_LINE(#name, name##_stats, inbytes);            \
 		__PRINT_FIELD_LINE(#name, name##_stats, outbytes);           \
@@ -143,6 +156,8 @@ static void status_profile_dump_persvc_stats(struct traverse_state *state,
 #define SMBPROFILE_STATS_END
 	SMBPROFILE_STATS_PERSVC_SECTIONS
 #undef __PRINT_FIELD_LINE
+#undef __PRINT_PERCENTILE_LINE
+#undef __PRINT_HIST
 #undef SMBPROFILE_STATS_START
 #undef SMBPROFILE_STATS_SECTION_START
 #undef SMBPROFILE_STATS_COUNT
@@ -198,6 +213,24 @@ bool status_profile_dump(bool verbose,
 	       add_profile_item_to_json(state, latest_section, name, #field, val); \
 	} \
 } while(0);
+#define __PRINT_PERCENTILE_LINE(name, _stats, pct, permille) do { \
+	uintmax_t val = (uintmax_t)smbprofile_hist_percentile( \
+		&stats.values._stats.hist, permille); \
+	if (!state->json_output) { \
+		d_printf("%-59s%20ju\n", \
+			 name "_" #pct ":", \
+			 val); \
+	} else { \
+	       add_profile_item_to_json(state, latest_section, name, #pct, val); \
+	} \
+} while(0);
+#define __PRINT_HIST(name, _stats) do { \
+	print_buckets(state, name, &stats.values._stats.hist); \
+	__PRINT_PERCENTILE_LINE(name, _stats, p50, 500); \
+	__PRINT_PERCENTILE_LINE(name, _stats, p90, 900); \
+	__PRINT_PERCENTILE_LINE(name, _stats, p99, 990); \
+	__PRINT_PERCENTILE_LINE(name, _stats, p999, 999); \
+} while(0);
 #define SMBPROFILE_STATS_START
 #define SMBPROFILE_STATS_SECTION_START(name, display) do { \
 	latest_section = display; \
@@ -212,10 +245,12 @@ bool status_profile_dump(bool verbose,
 #define SMBPROFILE_STATS_BASIC(name) do { \
 	__PRINT_FIELD_LINE(#name, name##_stats,  count); \
 	__PRINT_FIELD_LINE(#name, name##_stats,  time); \
+	__PRINT_HIST(#name, name##_stats); \
 } while(0);
 #define SMBPROFILE_STATS_BYTES(name) do { \
 	__PRINT_FIELD_LINE(#name, name##_stats,  count); \
 	__PRINT_FIELD_LINE(#name, name##_stats,  time); \
+	__PRINT_HIST(#name, name##_stats); \
 	__PRINT_FIELD_LINE(#name, name##_stats,  idle); \
 	__PRINT_FIELD_LINE(#name, name##_stats,  bytes); \
 } while(0);
@@ -223,7 +258,7 @@ bool status_profile_dump(bool verbose,
 	__PRINT_FIELD_LINE(#name, name##_stats,  count); \
 	__PRINT_FIELD_LINE(#name, name##_stats,  failed_count); \
 	__PRINT_FIELD_LINE(#name, name##_stats,  time); \
-	print_buckets(state, #name, &stats.values.name##_stats); \
+	__PRINT_HIST(#name, name##_stats); \
 	__PRINT_FIELD_LINE(#name, name##_stats,  idle); \
 	__PRINT_FIELD_LINE(#name, name##_stats,  inbytes); \
 	__PRINT_FIELD_LINE(#name, name##_stats,  outbytes); \
@@ -232,6 +267,8 @@ bool status_profile_dump(bool verbose,
 #define SMBPROFILE_STATS_END
 	SMBPROFILE_STATS_ALL_SECTIONS
 #undef __PRINT_FIELD_LINE
+#undef __PRINT_PERCENTILE_LINE
+#undef __PRINT_HIST
 #undef SMBPROFILE_STATS_START
 #undef SMBPROFILE_STATS_SECTION_START
 #undef SMBPROFILE_STATS_COUNT
@@ -509,3 +546,201 @@ bool status_profile_rates(bool verbose)
 
 	return True;
 }
+
+struct profile_top_entry {
+	char *name;
+	uint64_t ops;
+	uint64_t bytes;
+	uint64_t time;
+	struct smbprofile_stats_hist hist;
+};
+
+struct profile_top_state {
+	struct profile_top_entry *shares;
+	struct profile_top_entry *clients;
+};
+
+static bool profile_top_add(struct profile_top_entry **pentries,
+			    const char *name,
+			    size_t namelen,
+			    const struct profile_top_entry *add)
+{
+	struct profile_top_entry *entries = *pentries;
+	size_t i, num = talloc_array_length(entries);
+
+	for (i = 0; i < num; i++) {
+		if ((strlen(entries[i].name) == namelen) &&
+		    (strncmp(entries[i].name, name, namelen) == 0)) {
+			break;
+		}
+	}
+
+	if (i == num) {
+		entries = talloc_realloc(
+			NULL, entries, struct profile_top_entry, num + 1);
+		if (entries == NULL) {
+			return false;
+		}
+		*pentries = entries;
+		entries[i] = (struct profile_top_entry) {
+			.name = talloc_strndup(entries, name, namelen),
+		};
+		if (entries[i].name == NULL) {
+			return false;
+		}
+	}
+
+	entries[i].ops += add->ops;
+	entries[i].bytes += add->bytes;
+	entries[i].time += add->time;
+	for (num = 0; num < SMBPROFILE_HIST_BUCKETS; num++) {
+		entries[i].hist.buckets[num] += add->hist.buckets[num];
+	}
+	return true;
+}
+
+/*
+ * Keys are "share:pid.snum[client]" for live connections and
+ * "share:[client]" for the summaries of finished ones
+ */
+static int status_profile_top_cb(const char *key,
+				 const struct profile_stats *stats,
+				 void *private_data)
+{
+	struct profile_top_state *state = private_data;
+	struct profile_top_entry sum = {};
+	const char *sep = strchr(key, ':');
+	const char *client = NULL;
+	size_t clientlen;
+	size_t i;
+	bool ok;
+
+	if (sep == NULL) {
+		return 0;
+	}
+	client = strchr(sep, '[');
+	if (client == NULL) {
+		return 0;
+	}
+	client += 1;
+	clientlen = strlen(client);
+	if ((clientlen > 0) && (client[clientlen - 1] == ']')) {
+		clientlen -= 1;
+	}
+
+#define SMBPROFILE_STATS_START
+#define SMBPROFILE_STATS_SECTION_START(name, display)
+#define SMBPROFILE_STATS_COUNT(name)
+#define SMBPROFILE_STATS_TIME(name)
+#define SMBPROFILE_STATS_BASIC(name)
+#define SMBPROFILE_STATS_BYTES(name)
+#define SMBPROFILE_STATS_IOBYTES(name) do { \
+	sum.ops += stats->values.name##_stats.count; \
+	sum.bytes += stats->values.name##_stats.inbytes + \
+		     stats->values.name##_stats.outbytes; \
+	sum.time += stats->values.name##_stats.time; \
+	for (i = 0; i < SMBPROFILE_HIST_BUCKETS; i++) { \
+		sum.hist.buckets[i] += \
+			stats->values.name##_stats.hist.buckets[i]; \
+	} \
+} while(0);
+#define SMBPROFILE_STATS_SECTION_END
+#define SMBPROFILE_STATS_END
+	SMBPROFILE_STATS_PERSVC_SECTIONS
+#undef SMBPROFILE_STATS_START
+#undef SMBPROFILE_STATS_SECTION_START
+#undef SMBPROFILE_STATS_COUNT
+#undef SMBPROFILE_STATS_TIME
+#undef SMBPROFILE_STATS_BASIC
+#undef SMBPROFILE_STATS_BYTES
+#undef SMBPROFILE_STATS_IOBYTES
+#undef SMBPROFILE_STATS_SECTION_END
+#undef SMBPROFILE_STATS_END
+
+	ok = profile_top_add(&state->shares, key, sep - key, &sum);
+	if (!ok) {
+		return -1;
+	}
+	ok = profile_top_add(&state->clients, client, clientlen, &sum);
+	if (!ok) {
+		return -1;
+	}
+	return 0;
+}
+
+static int profile_top_cmp(const struct profile_top_entry *a,
+			   const struct profile_top_entry *b)
+{
+	if (a->ops != b->ops) {
+		return NUMERIC_CMP(b->ops, a->ops);
+	}
+	return NUMERIC_CMP(b->bytes, a->bytes);
+}
+
+static void print_profile_top(const char *title,
+			      struct profile_top_entry *entries,
+			      size_t max_entries)
+{
+	size_t i, num = talloc_array_length(entries);
+
+	TYPESAFE_QSORT(entries, num, profile_top_cmp);
+
+	printf("%s\n", title);
+	printf("%-32s %12s %16s %10s %10s\n",
+	       "Name", "Ops", "Bytes", "Avg(us)", "p99(us)");
+	printf("-------------------------------------------------------"
+	       "--------------------------------\n");
+
+	for (i = 0; (i < num) && (i < max_entries); i++) {
+		struct profile_top_entry *e = &entries[i];
+		uint64_t p99 = smbprofile_hist_percentile(&e->hist, 990);
+
+		printf("%-32s %12"PRIu64" %16"PRIu64" %10"PRIu64" ",
+		       e->name,
+		       e->ops,
+		       e->bytes,
+		       (e->ops != 0) ? e->time / e->ops : 0);
+		if (p99 == UINT64_MAX) {
+			printf("%10s\n", "inf");
+		} else {
+			printf("%10"PRIu64"\n", p99);
+		}
+	}
+	printf("\n");
+}
+
+/*******************************************************************
+ show the busiest shares and clients from the per-share records
+  ******************************************************************/
+bool status_profile_top(bool verbose)
+{
+	struct profile_top_state state = {};
+	size_t max_entries = verbose ? SIZE_MAX : 10;
+	int ret;
+
+	if (!profile_setup(NULL, True)) {
+		fprintf(stderr,"Failed to initialise profile memory\n");
+		return False;
+	}
+
+	ret = smbprofile_persvc_collect(status_profile_top_cb, &state);
+	if (ret != 0) {
+		fprintf(stderr, "Failed to collect per-share profile data\n");
+		TALLOC_FREE(state.shares);
+		TALLOC_FREE(state.clients);
+		return False;
+	}
+
+	if (talloc_array_length(state.shares) == 0) {
+		printf("No per-share profile data, "
+		       "set \"smbd profiling share = yes\"\n");
+		return True;
+	}
+
+	print_profile_top("Top shares", state.shares, max_entries);
+	print_profile_top("Top clients", state.clients, max_entries);
+
+	TALLOC_FREE(state.shares);
+	TALLOC_FREE(state.clients);
+	return True;
+}
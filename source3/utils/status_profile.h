@@ -26,5 +26,6 @@
 bool status_profile_dump(bool be_verbose,
 			 struct traverse_state *state);
 bool status_profile_rates(bool be_verbose);
+bool status_profile_top(bool be_verbose);
 
 #endif
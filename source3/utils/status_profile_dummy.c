@@ -33,3 +33,9 @@ bool status_profile_rates(bool be_verbose)
 	fprintf(stderr, "Profile data unavailable\n");
 	return true;
 }
+
+bool status_profile_top(bool be_verbose)
+{
+	fprintf(stderr, "Profile data unavailable\n");
+	return true;
+}
@@ -81,6 +81,7 @@
 #include "libsmb/samlogon_cache.h"
 #include "passdb/machine_sid.h"
 #include "lib/util/string_wrappers.h"
+#include "lib/util/memcache.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_IDMAP
@@ -92,18 +93,225 @@ static struct db_context *autorid_db;
 
 static bool ignore_builtin = false;
 
+/*
+ * Per-process copy of the domain#index -> range number assignments,
+ * so that lookups can be served from memory and only misses need to
+ * read autorid.tdb. Ranges can be deleted and handed out again by
+ * "net idmap delete range", so every entry remembers the seqnum of
+ * autorid.tdb it was read at, and the whole cache is flushed once
+ * the seqnum moves.
+ */
+static struct memcache *autorid_range_cache;
+static int autorid_range_cache_seqnum = -1;
+
+struct idmap_autorid_range_cache_entry {
+	uint32_t rangenum;
+	int seqnum;
+};
+
+/* how long range allocations had to wait for the database */
+static struct {
+	uint64_t batches;
+	uint64_t ranges;
+	uint64_t wait_usec;
+	uint64_t max_wait_usec;
+} autorid_alloc_stats;
+
+static DATA_BLOB idmap_autorid_range_cache_key(
+	const struct autorid_range_config *range,
+	fstring keystr)
+{
+	fstr_sprintf(keystr, "%s#%"PRIu32,
+		     range->domsid, range->domain_range_index);
+	return data_blob_const(keystr, strlen(keystr));
+}
+
+static void idmap_autorid_range_cache_fill(
+	const struct autorid_global_config *global,
+	struct autorid_range_config *range)
+{
+	range->low_id = global->minvalue + range->rangenum * global->rangesize;
+	range->high_id = range->low_id + global->rangesize - 1;
+}
+
+static bool idmap_autorid_range_cache_get(
+	const struct autorid_global_config *global,
+	struct autorid_range_config *range,
+	int seqnum)
+{
+	struct idmap_autorid_range_cache_entry entry;
+	fstring keystr;
+	DATA_BLOB value;
+	bool ok;
+
+	if (autorid_range_cache == NULL) {
+		return false;
+	}
+
+	if (seqnum != autorid_range_cache_seqnum) {
+		DBG_DEBUG("autorid.tdb seqnum moved from %d to %d, "
+			  "flushing the range cache\n",
+			  autorid_range_cache_seqnum, seqnum);
+		memcache_flush(autorid_range_cache, AUTORID_RANGE_CACHE);
+		autorid_range_cache_seqnum = seqnum;
+		return false;
+	}
+
+	ok = memcache_lookup(autorid_range_cache,
+			     AUTORID_RANGE_CACHE,
+			     idmap_autorid_range_cache_key(range, keystr),
+			     &value);
+	if (!ok || value.length != sizeof(entry)) {
+		return false;
+	}
+
+	memcpy(&entry, value.data, sizeof(entry));
+	if (entry.seqnum != seqnum) {
+		return false;
+	}
+
+	range->rangenum = entry.rangenum;
+	idmap_autorid_range_cache_fill(global, range);
+	return true;
+}
+
+/*
+ * seqnum must have been taken before the range was read from the
+ * database: if anything changed since then, the range might be
+ * outdated already and is not cached.
+ */
+static void idmap_autorid_range_cache_put(
+	const struct autorid_range_config *range,
+	int seqnum)
+{
+	struct idmap_autorid_range_cache_entry entry = {
+		.rangenum = range->rangenum,
+		.seqnum = seqnum,
+	};
+	fstring keystr;
+
+	if (dbwrap_get_seqnum(autorid_db) != seqnum) {
+		return;
+	}
+
+	if (autorid_range_cache == NULL) {
+		autorid_range_cache = memcache_init(NULL, 0);
+		if (autorid_range_cache == NULL) {
+			return;
+		}
+		autorid_range_cache_seqnum = seqnum;
+	}
+
+	if (seqnum != autorid_range_cache_seqnum) {
+		memcache_flush(autorid_range_cache, AUTORID_RANGE_CACHE);
+		autorid_range_cache_seqnum = seqnum;
+	}
+
+	memcache_add(autorid_range_cache,
+		     AUTORID_RANGE_CACHE,
+		     idmap_autorid_range_cache_key(range, keystr),
+		     data_blob_const(&entry, sizeof(entry)));
+}
+
+static NTSTATUS idmap_autorid_getrange_cached(
+	const struct autorid_global_config *global,
+	struct autorid_range_config *range)
+{
+	int seqnum = dbwrap_get_seqnum(autorid_db);
+	NTSTATUS status;
+
+	if (idmap_autorid_range_cache_get(global, range, seqnum)) {
+		return NT_STATUS_OK;
+	}
+
+	status = idmap_autorid_getrange(autorid_db, range->domsid,
+					range->domain_range_index,
+					&range->rangenum, NULL);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
+	idmap_autorid_range_cache_put(range, seqnum);
+	idmap_autorid_range_cache_fill(global, range);
+	return NT_STATUS_OK;
+}
+
+/*
+ * Acquire all given ranges in one transaction on autorid.tdb.
+ * Winbindd children doing bulk mappings contend for this
+ * transaction, so the time spent waiting for it is accounted. The
+ * commit moves the seqnum, so the new ranges get cached on their
+ * next lookup.
+ */
+static NTSTATUS idmap_autorid_acquire_ranges_timed(
+	const struct autorid_global_config *global,
+	struct autorid_range_config *ranges,
+	size_t num_ranges)
+{
+	struct timeval start = timeval_current();
+	struct timeval now;
+	uint64_t usec;
+	NTSTATUS status;
+	size_t i;
+
+	status = idmap_autorid_acquire_ranges(autorid_db, ranges, num_ranges);
+
+	now = timeval_current();
+	usec = usec_time_diff(&now, &start);
+	autorid_alloc_stats.batches += 1;
+	autorid_alloc_stats.wait_usec += usec;
+	autorid_alloc_stats.max_wait_usec =
+		MAX(autorid_alloc_stats.max_wait_usec, usec);
+
+	if (!NT_STATUS_IS_OK(status)) {
+		DBG_NOTICE("Acquiring %zu ranges failed after %"PRIu64" usec: "
+			   "%s\n", num_ranges, usec, nt_errstr(status));
+		return status;
+	}
+
+	autorid_alloc_stats.ranges += num_ranges;
+
+	DBG_INFO("Acquired %zu ranges in %"PRIu64" usec; so far "
+		 "%"PRIu64" ranges in %"PRIu64" batches, waiting "
+		 "%"PRIu64" usec in total, %"PRIu64" usec at most\n",
+		 num_ranges, usec,
+		 autorid_alloc_stats.ranges, autorid_alloc_stats.batches,
+		 autorid_alloc_stats.wait_usec,
+		 autorid_alloc_stats.max_wait_usec);
+
+	for (i = 0; i < num_ranges; i++) {
+		idmap_autorid_range_cache_fill(global, &ranges[i]);
+	}
+
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS idmap_autorid_get_alloc_range(struct idmap_domain *dom,
 					struct autorid_range_config *range)
 {
+	struct idmap_tdb_common_context *common =
+		talloc_get_type_abort(dom->private_data,
+				      struct idmap_tdb_common_context);
+	struct autorid_global_config *global =
+		talloc_get_type_abort(common->private_data,
+				      struct autorid_global_config);
+	int seqnum = dbwrap_get_seqnum(autorid_db);
 	NTSTATUS status;
 
 	ZERO_STRUCT(*range);
 
 	fstrcpy(range->domsid, ALLOC_RANGE);
 
+	if (idmap_autorid_range_cache_get(global, range, seqnum)) {
+		return NT_STATUS_OK;
+	}
+
 	status = idmap_autorid_get_domainrange(autorid_db,
 					       range,
 					       dom->read_only);
+	if (NT_STATUS_IS_OK(status)) {
+		idmap_autorid_range_cache_put(range, seqnum);
+	}
 
 	return status;
 }
@@ -541,9 +749,16 @@ static bool idmap_autorid_domsid_is_for_alloc(struct dom_sid *sid)
 	return false;
 }
 
+/*
+ * If pending is given and a new range has to be allocated for the
+ * SID, the range is returned in *pending with
+ * NT_STATUS_MORE_PROCESSING_REQUIRED so that the caller can acquire
+ * the ranges of several SIDs in one go.
+ */
 static NTSTATUS idmap_autorid_sid_to_id(struct idmap_tdb_common_context *common,
 					struct idmap_domain *dom,
-					struct id_map *map)
+					struct id_map *map,
+					struct autorid_range_config *pending)
 {
 	struct autorid_global_config *global =
 		talloc_get_type_abort(common->private_data,
@@ -585,9 +800,7 @@ static NTSTATUS idmap_autorid_sid_to_id(struct idmap_tdb_common_context *common,
 
 	range.domain_range_index = rid / (global->rangesize);
 
-	ret = idmap_autorid_getrange(autorid_db, range.domsid,
-				     range.domain_range_index,
-				     &range.rangenum, &range.low_id);
+	ret = idmap_autorid_getrange_cached(global, &range);
 	if (NT_STATUS_IS_OK(ret)) {
 		return idmap_autorid_sid_to_id_rid(
 			global->rangesize, range.low_id, map);
@@ -632,10 +845,13 @@ static NTSTATUS idmap_autorid_sid_to_id(struct idmap_tdb_common_context *common,
 	 * worth allocating for in higher ranges.
 	 */
 	if (range.domain_range_index != 0) {
-		uint32_t zero_rangenum, zero_low_id;
+		struct autorid_range_config zero_range = {
+			.domain_range_index = 0,
+		};
+
+		fstrcpy(zero_range.domsid, range.domsid);
 
-		ret = idmap_autorid_getrange(autorid_db, range.domsid, 0,
-					     &zero_rangenum, &zero_low_id);
+		ret = idmap_autorid_getrange_cached(global, &zero_range);
 		if (NT_STATUS_IS_OK(ret)) {
 			goto allocate;
 		}
@@ -676,7 +892,12 @@ static NTSTATUS idmap_autorid_sid_to_id(struct idmap_tdb_common_context *common,
 	return NT_STATUS_SOME_NOT_MAPPED;
 
 allocate:
-	ret = idmap_autorid_acquire_range(autorid_db, &range);
+	if (pending != NULL) {
+		*pending = range;
+		return NT_STATUS_MORE_PROCESSING_REQUIRED;
+	}
+
+	ret = idmap_autorid_acquire_ranges_timed(global, &range, 1);
 	if (!NT_STATUS_IS_OK(ret)) {
 		DBG_NOTICE("Could not determine range for domain: %s, "
 			   "check previous messages for reason\n",
@@ -696,6 +917,10 @@ static NTSTATUS idmap_autorid_sids_to_unixids(struct idmap_domain *dom,
 					      struct id_map **ids)
 {
 	struct idmap_tdb_common_context *commoncfg;
+	struct autorid_global_config *global;
+	struct autorid_range_config *pending = NULL;
+	size_t *pending_idx = NULL;
+	size_t num_pending = 0;
 	NTSTATUS ret;
 	size_t i;
 	size_t num_tomap = 0;
@@ -711,9 +936,45 @@ static NTSTATUS idmap_autorid_sids_to_unixids(struct idmap_domain *dom,
 	commoncfg =
 	    talloc_get_type_abort(dom->private_data,
 				  struct idmap_tdb_common_context);
+	global = talloc_get_type_abort(commoncfg->private_data,
+				       struct autorid_global_config);
+
+	/*
+	 * SIDs needing a new range are collected and their ranges
+	 * acquired in one transaction below: when many users of a
+	 * freshly trusted domain are mapped at once, they all end up
+	 * in a handful of ranges.
+	 */
+	pending = talloc_array(talloc_tos(), struct autorid_range_config,
+			       num_tomap);
+	pending_idx = talloc_array(pending, size_t, num_tomap);
+	if (pending == NULL || pending_idx == NULL) {
+		TALLOC_FREE(pending);
+		return NT_STATUS_NO_MEMORY;
+	}
 
 	for (i = 0; ids[i]; i++) {
-		ret = idmap_autorid_sid_to_id(commoncfg, dom, ids[i]);
+		struct autorid_range_config range;
+		size_t j;
+
+		pending_idx[i] = SIZE_MAX;
+
+		ret = idmap_autorid_sid_to_id(commoncfg, dom, ids[i], &range);
+		if (NT_STATUS_EQUAL(ret, NT_STATUS_MORE_PROCESSING_REQUIRED)) {
+			for (j = 0; j < num_pending; j++) {
+				if ((pending[j].domain_range_index ==
+				     range.domain_range_index) &&
+				    (strcmp(pending[j].domsid,
+					    range.domsid) == 0)) {
+					break;
+				}
+			}
+			if (j == num_pending) {
+				pending[num_pending++] = range;
+			}
+			pending_idx[i] = j;
+			continue;
+		}
 		if (NT_STATUS_EQUAL(ret, NT_STATUS_SOME_NOT_MAPPED) &&
 		    ids[i]->status == ID_REQUIRE_TYPE)
 		{
@@ -726,6 +987,7 @@ static NTSTATUS idmap_autorid_sids_to_unixids(struct idmap_domain *dom,
 			/* some fatal error occurred, log it */
 			DEBUG(3, ("Unexpected error resolving a SID (%s)\n",
 				  dom_sid_str_buf(ids[i]->sid, &buf)));
+			TALLOC_FREE(pending);
 			return ret;
 		}
 
@@ -734,6 +996,32 @@ static NTSTATUS idmap_autorid_sids_to_unixids(struct idmap_domain *dom,
 		}
 	}
 
+	if (num_pending > 0) {
+		ret = idmap_autorid_acquire_ranges_timed(global, pending,
+							  num_pending);
+		if (!NT_STATUS_IS_OK(ret)) {
+			DBG_NOTICE("Could not determine ranges for %zu "
+				   "domains: %s, check previous messages "
+				   "for reason\n",
+				   num_pending, nt_errstr(ret));
+			TALLOC_FREE(pending);
+			return ret;
+		}
+
+		for (i = 0; ids[i]; i++) {
+			if (pending_idx[i] == SIZE_MAX) {
+				continue;
+			}
+			idmap_autorid_sid_to_id_rid(
+				global->rangesize,
+				pending[pending_idx[i]].low_id,
+				ids[i]);
+			num_mapped++;
+		}
+	}
+
+	TALLOC_FREE(pending);
+
 	if (num_tomap == num_mapped) {
 		return NT_STATUS_OK;
 	} else if (num_required > 0) {
@@ -918,6 +1206,11 @@ static NTSTATUS idmap_autorid_initialize(struct idmap_domain *dom)
 	if (!NT_STATUS_IS_OK(status)) {
 		DEBUG(1, ("Failed to init the idmap database: %s\n",
 			  nt_errstr(status)));
+		/*
+		 * The preallocation ranges remembered in the
+		 * transaction are gone again.
+		 */
+		TALLOC_FREE(autorid_range_cache);
 		goto error;
 	}
 
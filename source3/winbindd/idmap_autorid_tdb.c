@@ -325,6 +325,50 @@ NTSTATUS idmap_autorid_acquire_range(struct db_context *db,
 	return idmap_autorid_addrange(db, range, true);
 }
 
+struct idmap_autorid_acquire_ranges_ctx {
+	struct autorid_range_config *ranges;
+	size_t num_ranges;
+};
+
+static NTSTATUS idmap_autorid_acquire_ranges_action(struct db_context *db,
+						    void *private_data)
+{
+	struct idmap_autorid_acquire_ranges_ctx *ctx =
+		(struct idmap_autorid_acquire_ranges_ctx *)private_data;
+	size_t i;
+
+	for (i = 0; i < ctx->num_ranges; i++) {
+		struct idmap_autorid_addrange_ctx addctx = {
+			.range = &ctx->ranges[i],
+			.acquire = true,
+		};
+		NTSTATUS status;
+
+		status = idmap_autorid_addrange_action(db, &addctx);
+		if (!NT_STATUS_IS_OK(status)) {
+			return status;
+		}
+	}
+
+	return NT_STATUS_OK;
+}
+
+NTSTATUS idmap_autorid_acquire_ranges(struct db_context *db,
+				      struct autorid_range_config *ranges,
+				      size_t num_ranges)
+{
+	struct idmap_autorid_acquire_ranges_ctx ctx = {
+		.ranges = ranges,
+		.num_ranges = num_ranges,
+	};
+
+	if (num_ranges == 0) {
+		return NT_STATUS_OK;
+	}
+
+	return dbwrap_trans_do(db, idmap_autorid_acquire_ranges_action, &ctx);
+}
+
 static NTSTATUS idmap_autorid_getrange_int(struct db_context *db,
 					   struct autorid_range_config *range)
 {
@@ -736,8 +780,12 @@ NTSTATUS idmap_autorid_db_open(const char *path,
 		return NT_STATUS_OK;
 	}
 
-	/* Open idmap repository */
-	*db = db_open(mem_ctx, path, 0, TDB_DEFAULT, O_RDWR | O_CREAT, 0644,
+	/*
+	 * Open idmap repository. TDB_SEQNUM lets winbindd notice range
+	 * changes made by other processes, see the range cache in
+	 * idmap_autorid.c.
+	 */
+	*db = db_open(mem_ctx, path, 0, TDB_SEQNUM, O_RDWR | O_CREAT, 0644,
 		      DBWRAP_LOCK_ORDER_1, DBWRAP_FLAG_NONE);
 
 	if (*db == NULL) {
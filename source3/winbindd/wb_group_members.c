@@ -121,14 +121,19 @@ static NTSTATUS wb_lookupgroupmem_recv(struct tevent_req *req,
 }
 
 /*
- * Same as wb_lookupgroupmem for a list of groups
+ * Same as wb_lookupgroupmem for a list of groups. Up to
+ * WB_GROUPS_MEMBERS_MAX_PENDING lookups run in parallel, so groups
+ * served by different domain children don't wait for each other.
  */
 
+#define WB_GROUPS_MEMBERS_MAX_PENDING 8
+
 struct wb_groups_members_state {
 	struct tevent_context *ev;
 	struct wbint_Principal *groups;
 	uint32_t num_groups;
 	uint32_t next_group;
+	uint32_t num_pending;
 	struct wbint_Principal *all_members;
 };
 
@@ -158,15 +163,21 @@ static struct tevent_req *wb_groups_members_send(TALLOC_CTX *mem_ctx,
 	state->all_members = NULL;
 
 	D_DEBUG("Looking up %"PRIu32" group(s).\n", num_groups);
-	status = wb_groups_members_next_subreq(state, state, &subreq);
-	if (tevent_req_nterror(req, status)) {
-		return tevent_req_post(req, ev);
+	while (state->num_pending < WB_GROUPS_MEMBERS_MAX_PENDING) {
+		status = wb_groups_members_next_subreq(state, state, &subreq);
+		if (tevent_req_nterror(req, status)) {
+			return tevent_req_post(req, ev);
+		}
+		if (subreq == NULL) {
+			break;
+		}
+		tevent_req_set_callback(subreq, wb_groups_members_done, req);
+		state->num_pending += 1;
 	}
-	if (subreq == NULL) {
+	if (state->num_pending == 0) {
 		tevent_req_done(req);
 		return tevent_req_post(req, ev);
 	}
-	tevent_req_set_callback(subreq, wb_groups_members_done, req);
 	return req;
 }
 
@@ -206,6 +217,7 @@ static void wb_groups_members_done(struct tevent_req *subreq)
 
 	status = wb_lookupgroupmem_recv(subreq, state, &num_members, &members);
 	TALLOC_FREE(subreq);
+	state->num_pending -= 1;
 
 	/*
 	 * In this error handling here we might have to be a bit more generous
@@ -248,11 +260,14 @@ static void wb_groups_members_done(struct tevent_req *subreq)
 	if (tevent_req_nterror(req, status)) {
 		return;
 	}
-	if (subreq == NULL) {
-		tevent_req_done(req);
+	if (subreq != NULL) {
+		tevent_req_set_callback(subreq, wb_groups_members_done, req);
+		state->num_pending += 1;
 		return;
 	}
-	tevent_req_set_callback(subreq, wb_groups_members_done, req);
+	if (state->num_pending == 0) {
+		tevent_req_done(req);
+	}
 }
 
 static NTSTATUS wb_groups_members_recv(struct tevent_req *req,
@@ -276,16 +291,37 @@ static NTSTATUS wb_groups_members_recv(struct tevent_req *req,
 /*
  * This is the routine expanding a list of groups up to a certain level. We
  * collect the users in a rbt database: We have to add them without duplicates,
- * and the db is indexed by SID.
+ * and the db is indexed by SID. Groups already expanded are remembered in a
+ * second rbt database, so groups nested via several paths (or in a cycle)
+ * are only looked up once.
  */
 
 struct wb_group_members_state {
 	struct tevent_context *ev;
 	int depth;
 	struct db_context *users;
+	struct db_context *seen_groups;
 	struct wbint_Principal *groups;
 };
 
+static bool wb_group_members_seen(struct wb_group_members_state *state,
+				  const struct dom_sid *sid,
+				  NTSTATUS *pstatus)
+{
+	uint8_t sidbuf[ndr_size_dom_sid(sid, 0)];
+	TDB_DATA key = { .dptr = sidbuf, .dsize = sizeof(sidbuf) };
+
+	sid_linearize(sidbuf, sizeof(sidbuf), sid);
+
+	*pstatus = NT_STATUS_OK;
+
+	if (dbwrap_exists(state->seen_groups, key)) {
+		return true;
+	}
+	*pstatus = dbwrap_store(state->seen_groups, key, key, 0);
+	return false;
+}
+
 static NTSTATUS wb_group_members_next_subreq(
 	struct wb_group_members_state *state,
 	TALLOC_CTX *mem_ctx, struct tevent_req **psubreq);
@@ -322,6 +358,10 @@ struct tevent_req *wb_group_members_send(TALLOC_CTX *mem_ctx,
 	if (tevent_req_nomem(state->users, req)) {
 		return tevent_req_post(req, ev);
 	}
+	state->seen_groups = db_open_rbt(state);
+	if (tevent_req_nomem(state->seen_groups, req)) {
+		return tevent_req_post(req, ev);
+	}
 
 	state->groups = talloc_array(state, struct wbint_Principal, num_sids);
 	if (tevent_req_nomem(state->groups, req)) {
@@ -332,6 +372,11 @@ struct tevent_req *wb_group_members_send(TALLOC_CTX *mem_ctx,
 		state->groups[i].name = NULL;
 		sid_copy(&state->groups[i].sid, &sid[i]);
 		state->groups[i].type = type[i];
+
+		(void)wb_group_members_seen(state, &sid[i], &status);
+		if (tevent_req_nterror(req, status)) {
+			return tevent_req_post(req, ev);
+		}
 	}
 
 	status = wb_group_members_next_subreq(state, state, &subreq);
@@ -445,6 +490,16 @@ static void wb_group_members_done(struct tevent_req *subreq)
 		case SID_NAME_ALIAS:
 		case SID_NAME_WKN_GRP: {
 			struct wbint_Principal *g;
+
+			if (wb_group_members_seen(state, &members[i].sid,
+						  &status)) {
+				/* Already expanded or queued */
+				break;
+			}
+			if (tevent_req_nterror(req, status)) {
+				return;
+			}
+
 			/*
 			 * Save members[i] for the next round
 			 */
@@ -461,6 +516,16 @@ static void wb_group_members_done(struct tevent_req *subreq)
 		}
 	}
 
+	if (num_groups < new_groups) {
+		state->groups = talloc_realloc(state, state->groups,
+					       struct wbint_Principal,
+					       num_groups);
+		if ((num_groups != 0) &&
+		    tevent_req_nomem(state->groups, req)) {
+			return;
+		}
+	}
+
 	status = wb_group_members_next_subreq(state, state, &subreq);
 	if (tevent_req_nterror(req, status)) {
 		return;
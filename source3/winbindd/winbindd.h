@@ -143,6 +143,9 @@ struct winbindd_child {
 
 	struct tevent_timer *lockout_policy_event;
 	struct tevent_timer *machine_password_change_event;
+
+	/* Retires an idle extra domain child, see winbindd_dual.c */
+	struct tevent_timer *idle_event;
 };
 
 /* Structures to hold per domain information */
@@ -37,6 +37,7 @@
 #include "libsmb/samlogon_cache.h"
 #include "lib/namemap_cache.h"
 #include "lib/util/string_wrappers.h"
+#include "lib/global_contexts.h"
 
 #include "lib/crypto/gnutls_helpers.h"
 #include <gnutls/crypto.h>
@@ -393,16 +394,36 @@ static char *centry_hash16(struct cache_entry *centry, TALLOC_CTX *mem_ctx)
 */
 static bool centry_sid(struct cache_entry *centry, struct dom_sid *sid)
 {
-	char *sid_string;
-	bool ret;
+	char sid_string[DOM_SID_STR_BUFLEN];
+	uint32_t len;
+
+	/*
+	 * Same encoding as centry_string(), but parse from a stack
+	 * buffer: no talloc for every SID we pull.
+	 */
+	len = centry_uint8(centry);
 
-	sid_string = centry_string(centry, talloc_tos());
-	if (sid_string == NULL) {
+	if (len == 0xFF) {
+		/* a deliberate NULL string */
 		return false;
 	}
-	ret = string_to_sid(sid, sid_string);
-	TALLOC_FREE(sid_string);
-	return ret;
+
+	if (!centry_check_bytes(centry, (size_t)len)) {
+		smb_panic_fn("centry_sid");
+	}
+
+	if (len >= sizeof(sid_string)) {
+		DBG_ERR("centry corruption? sid len (%"PRIu32") too long\n",
+			len);
+		centry->ofs += len;
+		return false;
+	}
+
+	memcpy(sid_string, centry->data + centry->ofs, len);
+	sid_string[len] = '\0';
+	centry->ofs += len;
+
+	return string_to_sid(sid, sid_string);
 }
 
 
@@ -708,7 +729,9 @@ static struct cache_entry *wcache_fetch(struct winbind_cache *cache,
 					const char *format, ...)
 {
 	va_list ap;
-	char *kstr;
+	char buf[256];
+	char *kstr = buf;
+	char *allocated = NULL;
 	struct cache_entry *centry;
 	int ret;
 
@@ -720,17 +743,32 @@ static struct cache_entry *wcache_fetch(struct winbind_cache *cache,
 
 	refresh_sequence_number(domain);
 
+	/*
+	 * Almost all keys fit into buf, only fall back to
+	 * vasprintf() for really long names.
+	 */
 	va_start(ap, format);
-	ret = vasprintf(&kstr, format, ap);
+	ret = vsnprintf(buf, sizeof(buf), format, ap);
 	va_end(ap);
 
-	if (ret == -1) {
+	if (ret < 0) {
 		return NULL;
 	}
 
+	if ((size_t)ret >= sizeof(buf)) {
+		va_start(ap, format);
+		ret = vasprintf(&allocated, format, ap);
+		va_end(ap);
+
+		if (ret == -1) {
+			return NULL;
+		}
+		kstr = allocated;
+	}
+
 	centry = wcache_fetch_raw(kstr);
 	if (centry == NULL) {
-		free(kstr);
+		SAFE_FREE(allocated);
 		return NULL;
 	}
 
@@ -740,14 +778,14 @@ static struct cache_entry *wcache_fetch(struct winbind_cache *cache,
 			 kstr, domain->name );
 
 		centry_free(centry);
-		free(kstr);
+		SAFE_FREE(allocated);
 		return NULL;
 	}
 
 	DBG_DEBUG("wcache_fetch: returning entry %s for domain %s\n",
 		 kstr, domain->name );
 
-	free(kstr);
+	SAFE_FREE(allocated);
 	return centry;
 }
 
@@ -1761,10 +1799,126 @@ skip_save:
 	return status;
 }
 
+/*
+ * With "winbind:cache stale while revalidate = yes" an expired
+ * name<->sid mapping is returned right away and refreshed from the DC
+ * from an immediate event, which runs after child_handler() has sent
+ * the response to the parent. Only the refresh itself pays the DC
+ * round trip.
+ */
+
+static bool wcache_refreshing;
+
+static bool wcache_serve_stale(void)
+{
+	if (wcache_refreshing) {
+		return false;
+	}
+	return lp_parm_bool(-1, "winbind", "cache stale while revalidate",
+			    false);
+}
+
+struct wcache_refresh_state {
+	struct winbindd_domain *domain;
+	struct tevent_immediate *im;
+	struct dom_sid sid;
+	char *domain_name;
+	char *name;
+	uint32_t flags;
+};
+
+static void wcache_refresh_sid_to_name(struct tevent_context *ev,
+				       struct tevent_immediate *im,
+				       void *private_data)
+{
+	struct wcache_refresh_state *state = talloc_get_type_abort(
+		private_data, struct wcache_refresh_state);
+	char *domain_name = NULL;
+	char *name = NULL;
+	enum lsa_SidType type;
+	struct dom_sid_buf buf;
+	NTSTATUS status;
+
+	wcache_refreshing = true;
+	status = wb_cache_sid_to_name(state->domain, state, &state->sid,
+				      &domain_name, &name, &type);
+	wcache_refreshing = false;
+
+	DBG_DEBUG("Refreshed %s: %s\n",
+		  dom_sid_str_buf(&state->sid, &buf),
+		  nt_errstr(status));
+	TALLOC_FREE(state);
+}
+
+static void wcache_refresh_name_to_sid(struct tevent_context *ev,
+				       struct tevent_immediate *im,
+				       void *private_data)
+{
+	struct wcache_refresh_state *state = talloc_get_type_abort(
+		private_data, struct wcache_refresh_state);
+	struct dom_sid sid;
+	enum lsa_SidType type;
+	NTSTATUS status;
+
+	wcache_refreshing = true;
+	status = wb_cache_name_to_sid(state->domain, state,
+				      state->domain_name, state->name,
+				      state->flags, &sid, &type);
+	wcache_refreshing = false;
+
+	DBG_DEBUG("Refreshed %s\\%s: %s\n",
+		  state->domain_name, state->name, nt_errstr(status));
+	TALLOC_FREE(state);
+}
+
+static void wcache_schedule_refresh(struct winbindd_domain *domain,
+				    const struct dom_sid *sid,
+				    const char *domain_name,
+				    const char *name,
+				    uint32_t flags)
+{
+	struct wcache_refresh_state *state = NULL;
+
+	state = talloc_zero(domain, struct wcache_refresh_state);
+	if (state == NULL) {
+		return;
+	}
+	state->domain = domain;
+	state->flags = flags;
+
+	state->im = tevent_create_immediate(state);
+	if (state->im == NULL) {
+		TALLOC_FREE(state);
+		return;
+	}
+
+	if (sid != NULL) {
+		sid_copy(&state->sid, sid);
+		tevent_schedule_immediate(state->im,
+					  global_event_context(),
+					  wcache_refresh_sid_to_name,
+					  state);
+		return;
+	}
+
+	state->domain_name = talloc_strdup(state, domain_name);
+	state->name = talloc_strdup(state, name);
+	if ((state->domain_name == NULL) || (state->name == NULL)) {
+		TALLOC_FREE(state);
+		return;
+	}
+	tevent_schedule_immediate(state->im,
+				  global_event_context(),
+				  wcache_refresh_name_to_sid,
+				  state);
+}
+
 struct wcache_name_to_sid_state {
 	struct dom_sid *sid;
 	enum lsa_SidType *type;
 	bool offline;
+	bool serve_stale;
+	bool stale;
 	bool found;
 };
 
@@ -1778,17 +1932,23 @@ static void wcache_name_to_sid_fn(const struct dom_sid *sid,
 	*state->sid = *sid;
 	*state->type = type;
 	state->found = (!expired || state->offline);
+	if (!state->found && state->serve_stale) {
+		state->found = true;
+		state->stale = true;
+	}
 }
 
 static NTSTATUS wcache_name_to_sid(struct winbindd_domain *domain,
 				   const char *domain_name,
 				   const char *name,
+				   bool *stale,
 				   struct dom_sid *sid,
 				   enum lsa_SidType *type)
 {
 	struct wcache_name_to_sid_state state = {
 		.sid = sid, .type = type, .found = false,
 		.offline = is_domain_offline(domain),
+		.serve_stale = (stale != NULL) && wcache_serve_stale(),
 	};
 	bool ok;
 
@@ -1802,6 +1962,9 @@ static NTSTATUS wcache_name_to_sid(struct winbindd_domain *domain,
 		DBG_DEBUG("cache entry not found\n");
 		return NT_STATUS_NOT_FOUND;
 	}
+	if (stale != NULL) {
+		*stale = state.stale;
+	}
 
 	return NT_STATUS_OK;
 }
@@ -1817,6 +1980,7 @@ NTSTATUS wb_cache_name_to_sid(struct winbindd_domain *domain,
 {
 	NTSTATUS status;
 	bool was_online;
+	bool stale = false;
 	const char *dom_name;
 
 	was_online = domain->online;
@@ -1824,8 +1988,13 @@ NTSTATUS wb_cache_name_to_sid(struct winbindd_domain *domain,
 	ZERO_STRUCTP(sid);
 	*type = SID_NAME_UNKNOWN;
 
-	status = wcache_name_to_sid(domain, domain_name, name, sid, type);
+	status = wcache_name_to_sid(domain, domain_name, name, &stale,
+				    sid, type);
 	if (!NT_STATUS_EQUAL(status, NT_STATUS_NOT_FOUND)) {
+		if (stale) {
+			wcache_schedule_refresh(domain, NULL, domain_name,
+						name, flags);
+		}
 		return status;
 	}
 
@@ -1845,6 +2014,7 @@ NTSTATUS wb_cache_name_to_sid(struct winbindd_domain *domain,
 			return wcache_name_to_sid(domain,
 						  domain_name,
 						  name,
+						  NULL,
 						  sid,
 						  type);
 		}
@@ -1875,6 +2045,8 @@ struct wcache_sid_to_name_state {
 	char **name;
 	enum lsa_SidType *type;
 	bool offline;
+	bool serve_stale;
+	bool stale;
 	bool found;
 };
 
@@ -1896,11 +2068,16 @@ static void wcache_sid_to_name_fn(const char *domain,
 	}
 	*state->type = type;
 	state->found = (!expired || state->offline);
+	if (!state->found && state->serve_stale) {
+		state->found = true;
+		state->stale = true;
+	}
 }
 
 static NTSTATUS wcache_sid_to_name(struct winbindd_domain *domain,
 				   const struct dom_sid *sid,
 				   TALLOC_CTX *mem_ctx,
+				   bool *stale,
 				   char **domain_name,
 				   char **name,
 				   enum lsa_SidType *type)
@@ -1908,7 +2085,8 @@ static NTSTATUS wcache_sid_to_name(struct winbindd_domain *domain,
 	struct wcache_sid_to_name_state state = {
 		.mem_ctx = mem_ctx, .found = false,
 		.domain_name = domain_name, .name = name, .type = type,
-		.offline = is_domain_offline(domain)
+		.offline = is_domain_offline(domain),
+		.serve_stale = (stale != NULL) && wcache_serve_stale(),
 	};
 	bool ok;
 
@@ -1921,6 +2099,9 @@ static NTSTATUS wcache_sid_to_name(struct winbindd_domain *domain,
 		DBG_DEBUG("cache entry not found\n");
 		return NT_STATUS_NOT_FOUND;
 	}
+	if (stale != NULL) {
+		*stale = state.stale;
+	}
 	if (*type == SID_NAME_UNKNOWN) {
 		return NT_STATUS_NONE_MAPPED;
 	}
@@ -1939,11 +2120,15 @@ NTSTATUS wb_cache_sid_to_name(struct winbindd_domain *domain,
 {
 	NTSTATUS status;
 	bool old_status;
+	bool stale = false;
 
 	old_status = domain->online;
-	status = wcache_sid_to_name(domain, sid, mem_ctx, domain_name, name,
-				    type);
+	status = wcache_sid_to_name(domain, sid, mem_ctx, &stale,
+				    domain_name, name, type);
 	if (!NT_STATUS_EQUAL(status, NT_STATUS_NOT_FOUND)) {
+		if (stale) {
+			wcache_schedule_refresh(domain, sid, NULL, NULL, 0);
+		}
 		return status;
 	}
 
@@ -1967,7 +2152,8 @@ NTSTATUS wb_cache_sid_to_name(struct winbindd_domain *domain,
 			old_status) {
 			NTSTATUS cache_status;
 			cache_status = wcache_sid_to_name(domain, sid, mem_ctx,
-							domain_name, name, type);
+							NULL, domain_name,
+							name, type);
 			return cache_status;
 		}
 	}
@@ -2033,7 +2219,7 @@ NTSTATUS wb_cache_rids_to_names(struct winbindd_domain *domain,
 			goto error;
 		}
 
-		status = wcache_sid_to_name(domain, &sid, *names, &dom,
+		status = wcache_sid_to_name(domain, &sid, *names, NULL, &dom,
 					    &name, &type);
 
 		(*types)[i] = SID_NAME_UNKNOWN;
@@ -2118,8 +2304,9 @@ NTSTATUS wb_cache_rids_to_names(struct winbindd_domain *domain,
 				}
 
 				status = wcache_sid_to_name(domain, &sid,
-							    *names, &dom,
-							    &name, &type);
+							    *names, NULL,
+							    &dom, &name,
+							    &type);
 
 				(*types)[i] = SID_NAME_UNKNOWN;
 				(*names)[i] = talloc_strdup(*names, "");
@@ -3293,8 +3480,8 @@ bool lookup_cached_sid(TALLOC_CTX *mem_ctx, const struct dom_sid *sid,
 	if (domain == NULL) {
 		return false;
 	}
-	status = wcache_sid_to_name(domain, sid, mem_ctx, domain_name, name,
-				    type);
+	status = wcache_sid_to_name(domain, sid, mem_ctx, NULL, domain_name,
+				    name, type);
 	return NT_STATUS_IS_OK(status);
 }
 
@@ -3318,7 +3505,8 @@ bool lookup_cached_name(const char *namespace,
 
 	original_online_state = domain->online;
 	domain->online = false;
-	status = wcache_name_to_sid(domain, domain_name, name, sid, type);
+	status = wcache_name_to_sid(domain, domain_name, name, NULL, sid,
+				    type);
 	domain->online = original_online_state;
 
 	return NT_STATUS_IS_OK(status);
@@ -558,6 +558,29 @@ NTSTATUS winbindd_get_trust_credentials(struct winbindd_domain *domain,
 	return NT_STATUS_OK;
 }
 
+/*
+ * With "winbind:spread domain connections = yes" the additional
+ * children of a domain (see "winbind max domain connections") don't
+ * follow the server affinity cache, child n starts with the n-th DC
+ * of the list instead. This distributes the netlogon secure channels
+ * over the DCs.
+ */
+static int cm_spread_dc_index(struct winbindd_domain *domain)
+{
+	int idx = wb_child_domain_index();
+
+	if (idx <= 0 || domain->force_dc) {
+		return 0;
+	}
+	if (!lp_parm_bool(GLOBAL_SECTION_SNUM,
+			  "winbind",
+			  "spread domain connections",
+			  false)) {
+		return 0;
+	}
+	return idx;
+}
+
 /************************************************************************
  Given just-connected transport connection to a DC, open a connection
  to the pipe.
@@ -872,11 +895,16 @@ static NTSTATUS cm_prepare_connection(struct winbindd_domain *domain,
 	}
 	tcon_status = result;
 
-	/* cache the server name for later connections */
+	/*
+	 * cache the server name for later connections, unless we
+	 * are spreading the connections over the DCs
+	 */
 
-	saf_store(domain->name, controller);
-	if (domain->alt_name) {
-		saf_store(domain->alt_name, controller);
+	if (cm_spread_dc_index(domain) == 0) {
+		saf_store(domain->name, controller);
+		if (domain->alt_name) {
+			saf_store(domain->alt_name, controller);
+		}
 	}
 
 	winbindd_set_locator_kdc_envs(domain);
@@ -1293,7 +1321,7 @@ static bool connect_preferred_dc(TALLOC_CTX *mem_ctx,
 	 */
 	if (domain->force_dc) {
 		saf_servername = domain->dcname;
-	} else {
+	} else if (cm_spread_dc_index(domain) == 0) {
 		saf_servername = saf_fetch(mem_ctx, domain->name);
 	}
 
@@ -1404,6 +1432,7 @@ static bool find_dc(TALLOC_CTX *mem_ctx,
 		smb_transports_parse("client smb transports",
 			lp_client_smb_transports());
 	int i;
+	int spread;
 	size_t fd_index;
 	struct smbXcli_transport *xtp = NULL;
 
@@ -1436,13 +1465,22 @@ static bool find_dc(TALLOC_CTX *mem_ctx,
 		return False;
 
 	D_DEBUG("Retrieved IP addresses for %d DCs.\n", num_dcs);
+
+	spread = cm_spread_dc_index(domain) % num_dcs;
+
 	for (i=0; i<num_dcs; i++) {
+		/*
+		 * smbsock_any_connect() gives the first addresses a
+		 * head start, so a rotated list makes this child
+		 * prefer another DC
+		 */
+		struct dc_name_ip *dc = &dcs[(i + spread) % num_dcs];
 
-		if (!add_string_to_array(mem_ctx, dcs[i].name,
+		if (!add_string_to_array(mem_ctx, dc->name,
 				    &dcnames, &num_dcnames)) {
 			return False;
 		}
-		if (!add_sockaddr_to_array(mem_ctx, &dcs[i].ss, TCP_SMB_PORT,
+		if (!add_sockaddr_to_array(mem_ctx, &dc->ss, TCP_SMB_PORT,
 				      &addrs, &num_addrs)) {
 			return False;
 		}
@@ -1473,7 +1511,7 @@ static bool find_dc(TALLOC_CTX *mem_ctx,
 		return False;
 	}
 	talloc_reparent(NULL, mem_ctx, xtp);
-	D_NOTICE("Successfully connected to DC '%s'.\n", dcs[fd_index].name);
+	D_NOTICE("Successfully connected to DC '%s'.\n", dcnames[fd_index]);
 
 	domain->dcaddr = addrs[fd_index];
 
@@ -1499,7 +1537,7 @@ static bool find_dc(TALLOC_CTX *mem_ctx,
 	}
 
 	/* We can not continue without the DC's name */
-	winbind_add_failed_connection_entry(domain, dcs[fd_index].name,
+	winbind_add_failed_connection_entry(domain, dcnames[fd_index],
 				    NT_STATUS_UNSUCCESSFUL);
 
 	/* Throw away all arrays as we're doing this again. */
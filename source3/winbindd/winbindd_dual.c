@@ -268,6 +268,8 @@ static void wb_child_request_waited(struct tevent_req *subreq)
 	 */
 	subreq = NULL;
 
+	TALLOC_FREE(state->child->idle_event);
+
 	if ((state->child->sock == -1) && (!fork_domain_child(state->child))) {
 		tevent_req_error(req, errno);
 		return;
@@ -338,6 +340,66 @@ int wb_child_request_recv(struct tevent_req *req, TALLOC_CTX *mem_ctx,
 	return 0;
 }
 
+static void wb_child_idle_timeout(struct tevent_context *ev,
+				  struct tevent_timer *te,
+				  struct timeval now,
+				  void *private_data)
+{
+	struct winbindd_child *child = private_data;
+
+	TALLOC_FREE(child->idle_event);
+
+	if ((child->sock == -1) || (tevent_queue_length(child->queue) > 0)) {
+		return;
+	}
+
+	DBG_INFO("Retiring idle child [%d] of domain %s\n",
+		 (int)child->pid, child->domain->name);
+
+	/*
+	 * Closing our end of the socket makes the child exit, just
+	 * like child_socket_readable() handles a dead child. The
+	 * next request picking this slot forks a new one.
+	 */
+	TALLOC_FREE(child->monitor_fde);
+	close(child->sock);
+	child->sock = -1;
+}
+
+/*
+ * With "winbind max domain connections" > 1 additional domain
+ * children are forked on demand when all running ones are busy.
+ * Let them go again after a while of inactivity, the first child of
+ * each domain is kept around.
+ */
+static void wb_child_schedule_idle(struct winbindd_child *child)
+{
+	struct winbindd_domain *domain = child->domain;
+	int timeout;
+
+	if ((domain == NULL) || (child == &domain->children[0])) {
+		return;
+	}
+	if (tevent_queue_length(child->queue) > 0) {
+		return;
+	}
+
+	timeout = lp_parm_int(-1, "winbind", "idle child timeout", 300);
+	if (timeout <= 0) {
+		return;
+	}
+
+	TALLOC_FREE(child->idle_event);
+	child->idle_event = tevent_add_timer(global_event_context(),
+					     domain->children,
+					     timeval_current_ofs(timeout, 0),
+					     wb_child_idle_timeout,
+					     child);
+	if (child->idle_event == NULL) {
+		DBG_WARNING("tevent_add_timer failed\n");
+	}
+}
+
 static void wb_child_request_cleanup(struct tevent_req *req,
 				     enum tevent_req_state req_state)
 {
@@ -389,6 +451,7 @@ static void wb_child_request_cleanup(struct tevent_req *req,
 
 	if (req_state == TEVENT_REQ_DONE) {
 		/* transmitted request and got response */
+		wb_child_schedule_idle(state->child);
 		return;
 	}
 
@@ -431,6 +494,7 @@ static void child_socket_readable(struct tevent_context *ev,
 static struct winbindd_child *choose_domain_child(struct winbindd_domain *domain)
 {
 	struct winbindd_child *shortest = &domain->children[0];
+	struct winbindd_child *unforked = NULL;
 	struct winbindd_child *current;
 	int i;
 
@@ -441,8 +505,18 @@ static struct winbindd_child *choose_domain_child(struct winbindd_domain *domain
 		current_len = tevent_queue_length(current->queue);
 
 		if (current_len == 0) {
-			/* idle child */
-			return current;
+			if (current->sock != -1) {
+				/* idle running child */
+				return current;
+			}
+			/*
+			 * Only fork a new child if none of the
+			 * running ones is idle
+			 */
+			if (unforked == NULL) {
+				unforked = current;
+			}
+			continue;
 		}
 
 		shortest_len = tevent_queue_length(shortest->queue);
@@ -452,6 +526,10 @@ static struct winbindd_child *choose_domain_child(struct winbindd_domain *domain
 		}
 	}
 
+	if (unforked != NULL) {
+		return unforked;
+	}
+
 	return shortest;
 }
 
@@ -1550,6 +1628,7 @@ static bool winbindd_reinit_after_fork_fn(struct winbindd_child *child,
 	/* Destroy all possible events in child list. */
 	TALLOC_FREE(child->lockout_policy_event);
 	TALLOC_FREE(child->machine_password_change_event);
+	TALLOC_FREE(child->idle_event);
 
 	/*
 	 * Children should never be able to send each other messages,
@@ -1648,12 +1727,22 @@ NTSTATUS winbindd_reinit_after_fork(const struct winbindd_child *myself,
  * In a child there will be only one domain, reference that here.
  */
 static struct winbindd_domain *child_domain;
+static int child_domain_index = -1;
 
 struct winbindd_domain *wb_child_domain(void)
 {
 	return child_domain;
 }
 
+/*
+ * The index of this process in the children of its domain, see
+ * "winbind max domain connections", -1 if not a domain child
+ */
+int wb_child_domain_index(void)
+{
+	return child_domain_index;
+}
+
 struct child_handler_state {
 	struct winbindd_child *child;
 	struct winbindd_cli_state cli;
@@ -1785,6 +1874,9 @@ static bool fork_domain_child(struct winbindd_child *child)
 
 	/* Child */
 	child_domain = child->domain;
+	if (child_domain != NULL) {
+		child_domain_index = child - child_domain->children;
+	}
 
 	DEBUG(10, ("Child process %d\n", (int)getpid()));
 
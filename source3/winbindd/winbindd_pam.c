@@ -56,6 +56,7 @@
 #include "lib/crypto/gnutls_helpers.h"
 #include <gnutls/crypto.h>
 #include "lib/global_contexts.h"
+#include "lib/util/memcache.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_WINBIND
@@ -1617,6 +1618,68 @@ static NTSTATUS winbindd_dual_auth_passdb(TALLOC_CTX *mem_ctx,
 	return status;
 }
 
+/*
+ * Round trip times of the netlogon SamLogon calls of this domain
+ * child. A summary is logged every "winbind:samlogon stats interval"
+ * calls (default 1000, 0 disables), and a call taking longer than
+ * "winbind:samlogon slow ms" (default 1000) is logged on its own.
+ */
+static struct {
+	uint64_t num_calls;
+	uint64_t num_failed;
+	uint64_t total_usec;
+	uint64_t max_usec;
+} samlogon_stats;
+
+static void samlogon_stats_account(struct winbindd_domain *domain,
+				   const struct timeval *start,
+				   NTSTATUS result)
+{
+	struct timeval now = timeval_current();
+	uint64_t usec = usec_time_diff(&now, start);
+	int interval;
+	int slow_ms;
+
+	samlogon_stats.num_calls += 1;
+	if (NT_STATUS_IS_ERR(result) &&
+	    !NT_STATUS_EQUAL(result, NT_STATUS_WRONG_PASSWORD) &&
+	    !NT_STATUS_EQUAL(result, NT_STATUS_NO_SUCH_USER)) {
+		samlogon_stats.num_failed += 1;
+	}
+	samlogon_stats.total_usec += usec;
+	samlogon_stats.max_usec = MAX(samlogon_stats.max_usec, usec);
+
+	slow_ms = lp_parm_int(GLOBAL_SECTION_SNUM,
+			      "winbind",
+			      "samlogon slow ms",
+			      1000);
+	if (slow_ms > 0 && usec > (uint64_t)slow_ms * 1000) {
+		DBG_WARNING("SamLogon to DC[%s] of DOMAIN[%s] took "
+			    "%"PRIu64" ms: %s\n",
+			    domain->dcname,
+			    domain->name,
+			    usec / 1000,
+			    nt_errstr(result));
+	}
+
+	interval = lp_parm_int(GLOBAL_SECTION_SNUM,
+			       "winbind",
+			       "samlogon stats interval",
+			       1000);
+	if (interval > 0 && samlogon_stats.num_calls % interval == 0) {
+		DBG_NOTICE("DOMAIN[%s] child %d: %"PRIu64" SamLogon calls, "
+			   "%"PRIu64" failed, average %"PRIu64" usec, "
+			   "max %"PRIu64" usec\n",
+			   domain->name,
+			   wb_child_domain_index(),
+			   samlogon_stats.num_calls,
+			   samlogon_stats.num_failed,
+			   samlogon_stats.total_usec /
+			   samlogon_stats.num_calls,
+			   samlogon_stats.max_usec);
+	}
+}
+
 static NTSTATUS winbind_samlogon_retry_loop(struct winbindd_domain *domain,
 					    TALLOC_CTX *mem_ctx,
 					    uint32_t logon_parameters,
@@ -1650,6 +1713,7 @@ static NTSTATUS winbind_samlogon_retry_loop(struct winbindd_domain *domain,
 	do {
 		struct rpc_pipe_client *netlogon_pipe;
 		struct netlogon_creds_cli_context *netlogon_creds_ctx = NULL;
+		struct timeval start;
 
 		/*
 		 * We should always reset authoritative to 1
@@ -1745,6 +1809,7 @@ static NTSTATUS winbind_samlogon_retry_loop(struct winbindd_domain *domain,
 		}
 
 		netr_attempts = 0;
+		start = timeval_current();
 		if (plaintext_given) {
 			result = rpccli_netlogon_password_logon(
 				netlogon_creds_ctx,
@@ -1798,6 +1863,8 @@ static NTSTATUS winbind_samlogon_retry_loop(struct winbindd_domain *domain,
 				&validation);
 		}
 
+		samlogon_stats_account(domain, &start, result);
+
 		/*
 		 * we increment this after the "feature negotiation"
 		 * for can_do_samlogon_ex and can_do_validation6
@@ -2622,6 +2689,308 @@ done:
 	return result;
 }
 
+/*
+ * Cache of successful NTLMv2 network logons, for clients that
+ * authenticate the same challenge response pair over and over again,
+ * e.g. behind HTTP proxies. With "winbind:ntlm cache time = <seconds>"
+ * the validation info is kept for that long, so a repeat does not need
+ * a round trip to the DC.
+ *
+ * The key is a SHA-256 over everything the DC would see. An NTLMv2
+ * response covers the server challenge, so a cached entry can only
+ * be hit with the exact same exchange again. The value is a header
+ * with the expiry time, the validation level and the flags, followed
+ * by the NDR encoded netr_Validation.
+ *
+ * The key also covers a generation of the user. It changes when a
+ * logon of the user fails or its password is changed through
+ * winbind, as the DC may have disabled the account or the password
+ * may be different now, so the earlier logons are not found again.
+ * Changes on the DC nobody tells us about still only become visible
+ * once the entries expire. The generations live outside the LRU of
+ * ntlm_cache, so they can't fall out and bring back old entries. To
+ * keep them bounded, both are emptied once there are too many.
+ */
+
+#define NTLM_CACHE_HDR_LEN 16
+#define NTLM_CACHE_MAX_GENERATIONS 4096
+
+static struct memcache *ntlm_cache;
+static struct memcache *ntlm_cache_gens;
+static size_t ntlm_cache_num_gens;
+static uint64_t ntlm_cache_next_gen = 1;
+
+static unsigned ntlm_cache_time(void)
+{
+	return lp_parm_int(GLOBAL_SECTION_SNUM, "winbind", "ntlm cache time", 0);
+}
+
+static struct memcache *ntlm_cache_get(void)
+{
+	if (ntlm_cache == NULL) {
+		unsigned long long size;
+
+		size = lp_parm_ulonglong(GLOBAL_SECTION_SNUM,
+					 "winbind",
+					 "ntlm cache size",
+					 1024 * 1024);
+		if (size == 0) {
+			return NULL;
+		}
+
+		ntlm_cache = memcache_init(NULL, size);
+	}
+
+	return ntlm_cache;
+}
+
+static DATA_BLOB ntlm_cache_gen_key(TALLOC_CTX *mem_ctx,
+				    const char *name_domain,
+				    const char *name_user)
+{
+	char *key = NULL;
+
+	key = talloc_asprintf_strupper_m(mem_ctx,
+					 "%s\\%s",
+					 name_domain,
+					 name_user);
+	if (key == NULL) {
+		return data_blob_null;
+	}
+	return data_blob_const(key, strlen(key));
+}
+
+static uint64_t ntlm_cache_generation(const char *name_domain,
+				      const char *name_user)
+{
+	DATA_BLOB key;
+	DATA_BLOB value;
+	uint64_t gen = 0;
+
+	if (ntlm_cache_gens == NULL) {
+		return 0;
+	}
+
+	key = ntlm_cache_gen_key(talloc_tos(), name_domain, name_user);
+	if (key.data == NULL) {
+		return UINT64_MAX;
+	}
+	if (memcache_lookup(ntlm_cache_gens, SAMLOGON_NTLM_CACHE, key, &value) &&
+	    value.length == sizeof(gen)) {
+		gen = BVAL(value.data, 0);
+	}
+	data_blob_free(&key);
+	return gen;
+}
+
+/*
+ * Make all cached logons of the user unreachable
+ */
+static void ntlm_cache_invalidate_user(const char *name_domain,
+				       const char *name_user)
+{
+	uint8_t buf[8];
+	DATA_BLOB key;
+
+	if (ntlm_cache == NULL) {
+		/* nothing was ever cached */
+		return;
+	}
+
+	if (ntlm_cache_gens == NULL) {
+		ntlm_cache_gens = memcache_init(NULL, 0);
+		if (ntlm_cache_gens == NULL) {
+			memcache_flush(ntlm_cache, SAMLOGON_NTLM_CACHE);
+			return;
+		}
+	}
+
+	if (ntlm_cache_num_gens >= NTLM_CACHE_MAX_GENERATIONS) {
+		memcache_flush(ntlm_cache, SAMLOGON_NTLM_CACHE);
+		memcache_flush(ntlm_cache_gens, SAMLOGON_NTLM_CACHE);
+		ntlm_cache_num_gens = 0;
+	}
+
+	key = ntlm_cache_gen_key(talloc_tos(), name_domain, name_user);
+	if (key.data == NULL) {
+		memcache_flush(ntlm_cache, SAMLOGON_NTLM_CACHE);
+		return;
+	}
+
+	SBVAL(buf, 0, ntlm_cache_next_gen);
+	ntlm_cache_next_gen += 1;
+	memcache_add(ntlm_cache_gens,
+		     SAMLOGON_NTLM_CACHE,
+		     key,
+		     data_blob_const(buf, sizeof(buf)));
+	ntlm_cache_num_gens += 1;
+	data_blob_free(&key);
+
+	DBG_DEBUG("Invalidated the cached NTLM logons of [%s]\\[%s]\n",
+		  name_domain, name_user);
+}
+
+static bool ntlm_cache_key(const char *name_domain,
+			   const char *name_user,
+			   const char *workstation,
+			   uint32_t logon_parameters,
+			   const DATA_BLOB *chal_blob,
+			   const DATA_BLOB *lm_response,
+			   const DATA_BLOB *nt_response,
+			   uint8_t key[32])
+{
+	const DATA_BLOB parts[] = {
+		data_blob_string_const_null(name_domain),
+		data_blob_string_const_null(name_user),
+		data_blob_string_const_null(workstation ? workstation : ""),
+		*chal_blob,
+		*lm_response,
+		*nt_response,
+	};
+	uint64_t generation = ntlm_cache_generation(name_domain, name_user);
+	gnutls_hash_hd_t hash_hnd = NULL;
+	uint8_t genbuf[8];
+	uint8_t buf[4];
+	size_t i;
+	int rc;
+
+	if (generation == UINT64_MAX) {
+		return false;
+	}
+
+	rc = gnutls_hash_init(&hash_hnd, GNUTLS_DIG_SHA256);
+	if (rc < 0) {
+		return false;
+	}
+
+	SBVAL(genbuf, 0, generation);
+	rc = gnutls_hash(hash_hnd, genbuf, sizeof(genbuf));
+
+	if (rc >= 0) {
+		SIVAL(buf, 0, logon_parameters);
+		rc = gnutls_hash(hash_hnd, buf, sizeof(buf));
+	}
+
+	for (i = 0; rc >= 0 && i < ARRAY_SIZE(parts); i++) {
+		/* the lengths keep the concatenation unambiguous */
+		SIVAL(buf, 0, parts[i].length);
+		rc = gnutls_hash(hash_hnd, buf, sizeof(buf));
+		if (rc >= 0 && parts[i].length != 0) {
+			rc = gnutls_hash(hash_hnd,
+					 parts[i].data,
+					 parts[i].length);
+		}
+	}
+	if (rc < 0) {
+		gnutls_hash_deinit(hash_hnd, NULL);
+		return false;
+	}
+
+	gnutls_hash_deinit(hash_hnd, key);
+	return true;
+}
+
+static bool ntlm_cache_fetch(TALLOC_CTX *mem_ctx,
+			     const uint8_t key[32],
+			     uint32_t *flags,
+			     uint16_t *_validation_level,
+			     union netr_Validation **_validation)
+{
+	struct memcache *cache = ntlm_cache_get();
+	DATA_BLOB mkey = data_blob_const(key, 32);
+	union netr_Validation *validation = NULL;
+	enum ndr_err_code ndr_err;
+	DATA_BLOB value;
+	DATA_BLOB blob;
+	uint16_t validation_level;
+
+	if (cache == NULL) {
+		return false;
+	}
+
+	if (!memcache_lookup(cache, SAMLOGON_NTLM_CACHE, mkey, &value)) {
+		return false;
+	}
+	if (value.length < NTLM_CACHE_HDR_LEN ||
+	    (time_t)BVAL(value.data, 0) <= time(NULL)) {
+		memcache_delete(cache, SAMLOGON_NTLM_CACHE, mkey);
+		return false;
+	}
+
+	validation_level = SVAL(value.data, 8);
+	blob = data_blob_const(value.data + NTLM_CACHE_HDR_LEN,
+			       value.length - NTLM_CACHE_HDR_LEN);
+
+	validation = talloc_zero(mem_ctx, union netr_Validation);
+	if (validation == NULL) {
+		return false;
+	}
+
+	ndr_err = ndr_pull_union_blob(&blob,
+				      validation,
+				      validation,
+				      validation_level,
+				      (ndr_pull_flags_fn_t)ndr_pull_netr_Validation);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		DBG_WARNING("ndr_pull_union_blob failed: %s\n",
+			    ndr_errstr(ndr_err));
+		memcache_delete(cache, SAMLOGON_NTLM_CACHE, mkey);
+		TALLOC_FREE(validation);
+		return false;
+	}
+
+	*flags = IVAL(value.data, 12);
+	*_validation_level = validation_level;
+	*_validation = validation;
+	return true;
+}
+
+static void ntlm_cache_store(const uint8_t key[32],
+			     unsigned cache_time,
+			     uint32_t flags,
+			     uint16_t validation_level,
+			     union netr_Validation *validation)
+{
+	struct memcache *cache = ntlm_cache_get();
+	DATA_BLOB mkey = data_blob_const(key, 32);
+	enum ndr_err_code ndr_err;
+	DATA_BLOB blob;
+	DATA_BLOB value;
+
+	if (cache == NULL) {
+		return;
+	}
+
+	ndr_err = ndr_push_union_blob(&blob,
+				      talloc_tos(),
+				      validation,
+				      validation_level,
+				      (ndr_push_flags_fn_t)ndr_push_netr_Validation);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		DBG_WARNING("ndr_push_union_blob failed: %s\n",
+			    ndr_errstr(ndr_err));
+		return;
+	}
+
+	value = data_blob_talloc(talloc_tos(),
+				 NULL,
+				 NTLM_CACHE_HDR_LEN + blob.length);
+	if (value.data == NULL) {
+		data_blob_free(&blob);
+		return;
+	}
+	SBVAL(value.data, 0, time(NULL) + cache_time);
+	SSVAL(value.data, 8, validation_level);
+	SSVAL(value.data, 10, 0);
+	SIVAL(value.data, 12, flags);
+	memcpy(value.data + NTLM_CACHE_HDR_LEN, blob.data, blob.length);
+
+	memcache_add(cache, SAMLOGON_NTLM_CACHE, mkey, value);
+
+	data_blob_clear_free(&value);
+	data_blob_clear_free(&blob);
+}
+
 NTSTATUS winbind_dual_SamLogon(struct winbindd_domain *domain,
 			       TALLOC_CTX *mem_ctx,
 			       bool for_netlogon,
@@ -2647,6 +3016,8 @@ NTSTATUS winbind_dual_SamLogon(struct winbindd_domain *domain,
 	uint16_t validation_level = 0;
 	union netr_Validation *validation = NULL;
 	NTSTATUS result;
+	unsigned cache_time = 0;
+	uint8_t cache_key[32];
 
 	/*
 	 * We check against domain->name instead of
@@ -2694,6 +3065,38 @@ NTSTATUS winbind_dual_SamLogon(struct winbindd_domain *domain,
 		}
 	}
 
+	/* Only NTLMv2 responses are bound to the server challenge */
+	if (!interactive && nt_response.length > 24) {
+		cache_time = ntlm_cache_time();
+	}
+	if (cache_time != 0) {
+		bool ok;
+
+		ok = ntlm_cache_key(name_domain,
+				    name_user,
+				    workstation,
+				    logon_parameters,
+				    &chal_blob,
+				    &lm_response,
+				    &nt_response,
+				    cache_key);
+		if (!ok) {
+			cache_time = 0;
+		}
+	}
+	if (cache_time != 0 &&
+	    ntlm_cache_fetch(mem_ctx,
+			     cache_key,
+			     flags,
+			     &validation_level,
+			     &validation)) {
+		DBG_DEBUG("Using the cached NTLM logon of [%s]\\[%s]\n",
+			  name_domain, name_user);
+		*authoritative = 1;
+		result = NT_STATUS_OK;
+		goto process_result;
+	}
+
 	result = winbind_samlogon_retry_loop(domain,
 					     mem_ctx,
 					     logon_parameters,
@@ -2713,9 +3116,18 @@ NTSTATUS winbind_dual_SamLogon(struct winbindd_domain *domain,
 					     &validation_level,
 					     &validation);
 	if (!NT_STATUS_IS_OK(result)) {
+		ntlm_cache_invalidate_user(name_domain, name_user);
 		goto done;
 	}
 
+	if (cache_time != 0) {
+		ntlm_cache_store(cache_key,
+				 cache_time,
+				 *flags,
+				 validation_level,
+				 validation);
+	}
+
 process_result:
 
 	if (NT_STATUS_IS_OK(result)) {
@@ -3145,6 +3557,10 @@ process_result:
 		}
 	}
 
+	if (domain != NULL && user != NULL) {
+		ntlm_cache_invalidate_user(domain, user);
+	}
+
 	DEBUG(NT_STATUS_IS_OK(result) ? 5 : 2,
 	      ("Password change for user [%s]\\[%s] returned %s (PAM: %d)\n",
 	       domain,
@@ -3370,6 +3786,10 @@ NTSTATUS _wbint_PamAuthCrapChangePassword(struct pipes_struct *p,
 		}
 	}
 
+	if (domain != NULL && user != NULL) {
+		ntlm_cache_invalidate_user(domain, user);
+	}
+
 	DEBUG(NT_STATUS_IS_OK(result) ? 5 : 2,
 	      ("Password change for user [%s]\\[%s] returned %s (PAM: %d)\n",
 	       domain, user,
@@ -711,6 +711,24 @@ init_sec_context_done:
 			}
 #endif /* GSS_C_CHANNEL_BOUND_FLAG */
 
+			if (gensec_gssapi_state->gss_exchange_count == 0 &&
+			    (maj_stat == GSS_S_COMPLETE ||
+			     maj_stat == GSS_S_CONTINUE_NEEDED) &&
+			    gensec_setting_bool(gensec_security->settings,
+						"gensec_gssapi",
+						"replay cache",
+						false))
+			{
+				nt_status = gssapi_replay_cache_check(
+					gensec_security->settings->lp_ctx,
+					&in);
+				if (!NT_STATUS_IS_OK(nt_status)) {
+					gss_release_buffer(&min_stat2,
+							   &output_token);
+					return nt_status;
+				}
+			}
+
 			break;
 		}
 		default:
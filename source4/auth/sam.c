@@ -33,6 +33,7 @@
 #include "librpc/gen_ndr/ndr_winbind_c.h"
 #include "lib/dbwrap/dbwrap.h"
 #include "cluster/cluster.h"
+#include "lib/util/dlinklist.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS DBGC_AUTH
@@ -353,6 +354,141 @@ static NTSTATUS authsam_domain_group_filter(TALLOC_CTX *mem_ctx,
 	return NT_STATUS_OK;
 }
 
+/*
+ * The expanded group memberships of recently seen accounts.
+ *
+ * Expanding nested groups costs a search per group, for users in
+ * thousands of groups this dominates building a token or a PAC.  The
+ * result only depends on the contents of the database, so it is kept
+ * until the sequence number changes.
+ */
+struct authsam_group_cache_entry {
+	struct authsam_group_cache_entry *prev, *next;
+	struct dom_sid account_sid;
+	uint32_t group_rid;
+	unsigned int num_member_of;
+	struct auth_SidAttr *sids;
+	uint32_t num_sids;
+};
+
+struct authsam_group_cache {
+	struct authsam_group_cache_entry *entries;
+	unsigned int num_entries;
+	unsigned int max_entries;
+	uint64_t seq_num;
+};
+
+#define AUTHSAM_GROUP_CACHE "authsam_group_cache"
+
+static struct authsam_group_cache *authsam_group_cache_get(
+	struct ldb_context *sam_ctx)
+{
+	struct authsam_group_cache *cache = NULL;
+	struct loadparm_context *lp_ctx = NULL;
+	uint64_t seq_num = 0;
+	int max_entries;
+	int ret;
+
+	cache = talloc_get_type(ldb_get_opaque(sam_ctx, AUTHSAM_GROUP_CACHE),
+				struct authsam_group_cache);
+	if (cache == NULL) {
+		lp_ctx = talloc_get_type(ldb_get_opaque(sam_ctx, "loadparm"),
+					 struct loadparm_context);
+		if (lp_ctx == NULL) {
+			return NULL;
+		}
+		max_entries = lpcfg_parm_int(lp_ctx, NULL, "auth",
+					     "group expansion cache size", 0);
+		if (max_entries <= 0) {
+			return NULL;
+		}
+
+		cache = talloc_zero(sam_ctx, struct authsam_group_cache);
+		if (cache == NULL) {
+			return NULL;
+		}
+		cache->max_entries = max_entries;
+
+		ret = ldb_set_opaque(sam_ctx, AUTHSAM_GROUP_CACHE, cache);
+		if (ret != LDB_SUCCESS) {
+			TALLOC_FREE(cache);
+			return NULL;
+		}
+	}
+
+	ret = ldb_sequence_number(sam_ctx, LDB_SEQ_HIGHEST_SEQ, &seq_num);
+	if (ret != LDB_SUCCESS) {
+		return NULL;
+	}
+
+	if (seq_num != cache->seq_num) {
+		while (cache->entries != NULL) {
+			struct authsam_group_cache_entry *e = cache->entries;
+			DLIST_REMOVE(cache->entries, e);
+			TALLOC_FREE(e);
+		}
+		cache->num_entries = 0;
+		cache->seq_num = seq_num;
+	}
+
+	return cache;
+}
+
+static struct authsam_group_cache_entry *authsam_group_cache_find(
+	struct authsam_group_cache *cache,
+	const struct dom_sid *account_sid,
+	uint32_t group_rid,
+	unsigned int num_member_of)
+{
+	struct authsam_group_cache_entry *e = NULL;
+
+	for (e = cache->entries; e != NULL; e = e->next) {
+		if (e->group_rid == group_rid &&
+		    e->num_member_of == num_member_of &&
+		    dom_sid_equal(&e->account_sid, account_sid)) {
+			DLIST_PROMOTE(cache->entries, e);
+			return e;
+		}
+	}
+
+	return NULL;
+}
+
+static void authsam_group_cache_add(struct authsam_group_cache *cache,
+				    const struct dom_sid *account_sid,
+				    uint32_t group_rid,
+				    unsigned int num_member_of,
+				    const struct auth_SidAttr *sids,
+				    uint32_t num_sids)
+{
+	struct authsam_group_cache_entry *e = NULL;
+
+	e = talloc_zero(cache, struct authsam_group_cache_entry);
+	if (e == NULL) {
+		return;
+	}
+	e->sids = talloc_memdup(e, sids, sizeof(*sids) * num_sids);
+	if (e->sids == NULL) {
+		TALLOC_FREE(e);
+		return;
+	}
+	e->num_sids = num_sids;
+	e->account_sid = *account_sid;
+	e->group_rid = group_rid;
+	e->num_member_of = num_member_of;
+
+	DLIST_ADD(cache->entries, e);
+	cache->num_entries++;
+
+	if (cache->num_entries > cache->max_entries) {
+		struct authsam_group_cache_entry *last =
+			DLIST_TAIL(cache->entries);
+		DLIST_REMOVE(cache->entries, last);
+		TALLOC_FREE(last);
+		cache->num_entries--;
+	}
+}
+
 _PUBLIC_ NTSTATUS authsam_make_user_info_dc(TALLOC_CTX *mem_ctx,
 					   struct ldb_context *sam_ctx,
 					   const char *netbios_name,
@@ -388,6 +524,8 @@ _PUBLIC_ NTSTATUS authsam_make_user_info_dc(TALLOC_CTX *mem_ctx,
 	TALLOC_CTX *tmp_ctx;
 	struct ldb_message_element *el;
 	static const char * const group_type_attrs[] = { "groupType", NULL };
+	struct authsam_group_cache *group_cache = NULL;
+	unsigned int num_member_of;
 
 	if (msg == NULL) {
 		return NT_STATUS_INVALID_PARAMETER;
@@ -431,6 +569,32 @@ _PUBLIC_ NTSTATUS authsam_make_user_info_dc(TALLOC_CTX *mem_ctx,
 	groupsid = *domain_sid;
 	sid_append_rid(&groupsid, group_rid);
 
+	/*
+	 * The memberOf values of the message are part of the key, so a
+	 * message searched without them is never answered from the cache.
+	 */
+	el = ldb_msg_find_element(msg, "memberOf");
+	num_member_of = (el != NULL) ? el->num_values : 0;
+
+	group_cache = authsam_group_cache_get(sam_ctx);
+	if (group_cache != NULL) {
+		struct authsam_group_cache_entry *e = NULL;
+
+		e = authsam_group_cache_find(group_cache, account_sid,
+					     group_rid, num_member_of);
+		if (e != NULL) {
+			TALLOC_FREE(sids);
+			sids = talloc_memdup(user_info_dc, e->sids,
+					     sizeof(*sids) * e->num_sids);
+			if (sids == NULL) {
+				TALLOC_FREE(user_info_dc);
+				return NT_STATUS_NO_MEMORY;
+			}
+			num_sids = e->num_sids;
+			goto got_sids;
+		}
+	}
+
 	sids[PRIMARY_USER_SID_INDEX] = (struct auth_SidAttr) {
 		.sid = *account_sid,
 		.attrs = SE_GROUP_DEFAULT_FLAGS,
@@ -535,6 +699,12 @@ _PUBLIC_ NTSTATUS authsam_make_user_info_dc(TALLOC_CTX *mem_ctx,
 		}
 	}
 
+	if (group_cache != NULL) {
+		authsam_group_cache_add(group_cache, account_sid, group_rid,
+					num_member_of, sids, num_sids);
+	}
+
+got_sids:
 	user_info_dc->sids = sids;
 	user_info_dc->num_sids = num_sids;
 
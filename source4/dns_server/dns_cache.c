@@ -0,0 +1,632 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   DNS server record and forwarder answer cache
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ * Both caches live in one memcache, so "dns:cache size" bounds the
+ * memory used by both of them together.
+ *
+ * Authoritative lookups are cached as the NDR encoded
+ * dnsp_DnssrvRpcRecord array returned by dns_lookup_records_wildcard().
+ * The key contains the uSNHighest of the partition holding the zone,
+ * so any change to that partition, local or replicated, makes the old
+ * entries unreachable. They are aged out by the memcache LRU.
+ *
+ * Forwarded answers are cached until the smallest TTL in the answer
+ * expires, capped by "dns:forwarder cache max ttl". TTLs are counted
+ * down when an answer is handed out from the cache.
+ */
+
+#include "includes.h"
+#include "librpc/ndr/libndr.h"
+#include "librpc/gen_ndr/ndr_dns.h"
+#include "librpc/gen_ndr/ndr_dnsp.h"
+#include "librpc/gen_ndr/irpc.h"
+#include <ldb.h>
+#include "param/param.h"
+#include "samba/service_task.h"
+#include "dsdb/samdb/samdb.h"
+#include "dsdb/common/util.h"
+#include "dns_server/dns_server.h"
+#include "lib/util/memcache.h"
+#include "lib/util/dlinklist.h"
+
+#define DNS_CACHE_DEFAULT_SIZE (4*1024*1024)
+#define DNS_CACHE_DEFAULT_FORWARDER_MAX_TTL 3600
+
+struct dns_cache_partition {
+	struct dns_cache_partition *prev, *next;
+	struct ldb_dn *zone_dn;
+	struct ldb_dn *nc_root;
+};
+
+struct dns_server_cache {
+	struct memcache *mc;
+	uint32_t forwarder_max_ttl;
+	struct dns_cache_partition *partitions;
+};
+
+/*
+ * Header of a cached forwarder answer, followed by the NDR encoded
+ * dns_name_packet.
+ */
+struct dns_cache_forwarded {
+	time_t stored;
+	time_t expires;
+};
+
+/*
+ * Header of a cached authoritative answer, followed by num_recs
+ * (uint32_t length, NDR encoded dnsp_DnssrvRpcRecord) pairs.
+ */
+struct dns_cache_records {
+	uint32_t werr;
+	uint32_t num_recs;
+};
+
+WERROR dns_cache_init(struct dns_server *dns)
+{
+	struct loadparm_context *lp_ctx = dns->task->lp_ctx;
+	struct dns_server_cache *cache = NULL;
+	unsigned long size;
+
+	size = lpcfg_parm_ulong(lp_ctx, NULL, "dns", "cache size",
+				DNS_CACHE_DEFAULT_SIZE);
+	if (size == 0) {
+		DBG_NOTICE("DNS cache disabled\n");
+		return WERR_OK;
+	}
+
+	cache = talloc_zero(dns, struct dns_server_cache);
+	if (cache == NULL) {
+		return WERR_NOT_ENOUGH_MEMORY;
+	}
+	cache->forwarder_max_ttl = lpcfg_parm_ulong(
+		lp_ctx, NULL, "dns", "forwarder cache max ttl",
+		DNS_CACHE_DEFAULT_FORWARDER_MAX_TTL);
+
+	cache->mc = memcache_init(cache, size);
+	if (cache->mc == NULL) {
+		TALLOC_FREE(cache);
+		return WERR_NOT_ENOUGH_MEMORY;
+	}
+
+	dns->cache = cache;
+	return WERR_OK;
+}
+
+void dns_cache_zones_reloaded(struct dns_server *dns)
+{
+	struct dns_server_cache *cache = dns->cache;
+	struct dns_cache_partition *p = NULL;
+
+	if (cache == NULL) {
+		return;
+	}
+
+	while ((p = cache->partitions) != NULL) {
+		DLIST_REMOVE(cache->partitions, p);
+		TALLOC_FREE(p);
+	}
+	memcache_flush(cache->mc, DNS_RECORDS_CACHE);
+}
+
+/*
+ * Find the naming context of the zone dn lives in. Looking it up
+ * needs a search, so remember it per zone.
+ */
+static struct ldb_dn *dns_cache_nc_root(struct dns_server *dns,
+					struct ldb_dn *dn)
+{
+	struct dns_server_cache *cache = dns->cache;
+	struct dns_cache_partition *p = NULL;
+	struct dns_server_zone *z = NULL;
+	int ret;
+
+	for (z = dns->zones; z != NULL; z = z->next) {
+		if (ldb_dn_compare_base(z->dn, dn) == 0) {
+			break;
+		}
+	}
+	if (z == NULL) {
+		return NULL;
+	}
+
+	for (p = cache->partitions; p != NULL; p = p->next) {
+		if (ldb_dn_compare(p->zone_dn, z->dn) == 0) {
+			DLIST_PROMOTE(cache->partitions, p);
+			return p->nc_root;
+		}
+	}
+
+	p = talloc_zero(cache, struct dns_cache_partition);
+	if (p == NULL) {
+		return NULL;
+	}
+	p->zone_dn = ldb_dn_copy(p, z->dn);
+	if (p->zone_dn == NULL) {
+		TALLOC_FREE(p);
+		return NULL;
+	}
+	ret = dsdb_find_nc_root(dns->samdb, p, z->dn, &p->nc_root);
+	if (ret != LDB_SUCCESS) {
+		DBG_WARNING("Could not find the partition of %s: %s\n",
+			    ldb_dn_get_linearized(z->dn),
+			    ldb_errstring(dns->samdb));
+		TALLOC_FREE(p);
+		return NULL;
+	}
+	DLIST_ADD(cache->partitions, p);
+
+	return p->nc_root;
+}
+
+static bool dns_cache_records_key(struct dns_server *dns,
+				  TALLOC_CTX *mem_ctx,
+				  struct ldb_dn *dn,
+				  DATA_BLOB *key)
+{
+	struct ldb_dn *nc_root = NULL;
+	const char *casefold = NULL;
+	uint64_t usn = 0;
+	char *k = NULL;
+	int ret;
+
+	nc_root = dns_cache_nc_root(dns, dn);
+	if (nc_root == NULL) {
+		return false;
+	}
+
+	ret = dsdb_load_partition_usn(dns->samdb, nc_root, &usn, NULL);
+	if (ret != LDB_SUCCESS) {
+		DBG_DEBUG("dsdb_load_partition_usn failed: %s\n",
+			  ldb_strerror(ret));
+		return false;
+	}
+
+	casefold = ldb_dn_get_casefold(dn);
+	if (casefold == NULL) {
+		return false;
+	}
+
+	k = talloc_asprintf(mem_ctx, "%"PRIu64":%s", usn, casefold);
+	if (k == NULL) {
+		return false;
+	}
+
+	*key = data_blob_const(k, strlen(k));
+	return true;
+}
+
+static bool dns_cache_records_pull(TALLOC_CTX *mem_ctx,
+				   DATA_BLOB value,
+				   WERROR *werr,
+				   struct dnsp_DnssrvRpcRecord **precords,
+				   uint16_t *prec_count)
+{
+	struct dns_cache_records hdr;
+	struct dnsp_DnssrvRpcRecord *recs = NULL;
+	size_t ofs = sizeof(hdr);
+	uint32_t i;
+
+	if (value.length < sizeof(hdr)) {
+		return false;
+	}
+	memcpy(&hdr, value.data, sizeof(hdr));
+
+	*werr = W_ERROR(hdr.werr);
+	if (hdr.num_recs == 0) {
+		*precords = NULL;
+		*prec_count = 0;
+		return true;
+	}
+
+	recs = talloc_zero_array(mem_ctx,
+				 struct dnsp_DnssrvRpcRecord,
+				 hdr.num_recs);
+	if (recs == NULL) {
+		return false;
+	}
+
+	for (i = 0; i < hdr.num_recs; i++) {
+		enum ndr_err_code ndr_err;
+		DATA_BLOB rec;
+		uint32_t len;
+
+		if (value.length - ofs < sizeof(len)) {
+			goto fail;
+		}
+		memcpy(&len, value.data + ofs, sizeof(len));
+		ofs += sizeof(len);
+		if (value.length - ofs < len) {
+			goto fail;
+		}
+		rec = data_blob_const(value.data + ofs, len);
+		ofs += len;
+
+		ndr_err = ndr_pull_struct_blob(
+			&rec,
+			recs,
+			&recs[i],
+			(ndr_pull_flags_fn_t)ndr_pull_dnsp_DnssrvRpcRecord);
+		if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+			goto fail;
+		}
+	}
+
+	*precords = recs;
+	*prec_count = hdr.num_recs;
+	return true;
+fail:
+	TALLOC_FREE(recs);
+	return false;
+}
+
+static void dns_cache_records_store(struct dns_server *dns,
+				    DATA_BLOB key,
+				    WERROR werr,
+				    const struct dnsp_DnssrvRpcRecord *records,
+				    uint16_t rec_count)
+{
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct dns_cache_records hdr = {
+		.werr = W_ERROR_V(werr),
+		.num_recs = rec_count,
+	};
+	uint8_t *buf = NULL;
+	uint16_t i;
+
+	buf = talloc_memdup(frame, &hdr, sizeof(hdr));
+	if (buf == NULL) {
+		goto done;
+	}
+
+	for (i = 0; i < rec_count; i++) {
+		enum ndr_err_code ndr_err;
+		DATA_BLOB rec;
+		size_t len = talloc_get_size(buf);
+		uint32_t reclen;
+
+		ndr_err = ndr_push_struct_blob(
+			&rec,
+			frame,
+			&records[i],
+			(ndr_push_flags_fn_t)ndr_push_dnsp_DnssrvRpcRecord);
+		if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+			goto done;
+		}
+		reclen = rec.length;
+
+		buf = talloc_realloc(frame,
+				     buf,
+				     uint8_t,
+				     len + sizeof(reclen) + rec.length);
+		if (buf == NULL) {
+			goto done;
+		}
+		memcpy(buf + len, &reclen, sizeof(reclen));
+		memcpy(buf + len + sizeof(reclen), rec.data, rec.length);
+	}
+
+	memcache_add(dns->cache->mc,
+		     DNS_RECORDS_CACHE,
+		     key,
+		     data_blob_const(buf, talloc_get_size(buf)));
+done:
+	TALLOC_FREE(frame);
+}
+
+/*
+ * Cached version of dns_lookup_records_wildcard()
+ */
+WERROR dns_cache_lookup_records(struct dns_server *dns,
+				TALLOC_CTX *mem_ctx,
+				struct ldb_dn *dn,
+				struct dnsp_DnssrvRpcRecord **records,
+				uint16_t *rec_count)
+{
+	TALLOC_CTX *frame = NULL;
+	DATA_BLOB key;
+	DATA_BLOB value;
+	WERROR werr;
+	bool ok;
+
+	if (dns->cache == NULL) {
+		return dns_lookup_records_wildcard(dns, mem_ctx, dn,
+						   records, rec_count);
+	}
+
+	frame = talloc_stackframe();
+
+	ok = dns_cache_records_key(dns, frame, dn, &key);
+	if (!ok) {
+		TALLOC_FREE(frame);
+		return dns_lookup_records_wildcard(dns, mem_ctx, dn,
+						   records, rec_count);
+	}
+
+	ok = memcache_lookup(dns->cache->mc, DNS_RECORDS_CACHE, key, &value);
+	if (ok) {
+		ok = dns_cache_records_pull(mem_ctx, value, &werr,
+					    records, rec_count);
+		if (ok) {
+			TALLOC_FREE(frame);
+			return werr;
+		}
+		memcache_delete(dns->cache->mc, DNS_RECORDS_CACHE, key);
+	}
+
+	werr = dns_lookup_records_wildcard(dns, mem_ctx, dn,
+					   records, rec_count);
+
+	/*
+	 * Non-existing names are asked for a lot, remember those as
+	 * well.
+	 */
+	if (W_ERROR_IS_OK(werr)) {
+		dns_cache_records_store(dns, key, werr, *records, *rec_count);
+	} else if (W_ERROR_EQUAL(werr, DNS_ERR(NAME_ERROR))) {
+		dns_cache_records_store(dns, key, werr, NULL, 0);
+	}
+
+	TALLOC_FREE(frame);
+	return werr;
+}
+
+static bool dns_cache_forwarder_key(TALLOC_CTX *mem_ctx,
+				    const struct dns_name_question *question,
+				    DATA_BLOB *key)
+{
+	char *name = NULL;
+	char *k = NULL;
+
+	name = strlower_talloc(mem_ctx, question->name);
+	if (name == NULL) {
+		return false;
+	}
+	k = talloc_asprintf(mem_ctx,
+			    "%u:%u:%s",
+			    (unsigned)question->question_class,
+			    (unsigned)question->question_type,
+			    name);
+	TALLOC_FREE(name);
+	if (k == NULL) {
+		return false;
+	}
+
+	*key = data_blob_const(k, strlen(k));
+	return true;
+}
+
+static void dns_cache_age_rrs(struct dns_res_rec *rrs,
+			      uint16_t count,
+			      uint32_t elapsed)
+{
+	uint16_t i;
+
+	for (i = 0; i < count; i++) {
+		if (rrs[i].rr_type == DNS_QTYPE_OPT) {
+			/* The TTL field carries flags here */
+			continue;
+		}
+		rrs[i].ttl = (rrs[i].ttl > elapsed) ? rrs[i].ttl - elapsed : 0;
+	}
+}
+
+bool dns_cache_forwarder_lookup(struct dns_server *dns,
+				TALLOC_CTX *mem_ctx,
+				const struct dns_name_question *question,
+				struct dns_name_packet **preply)
+{
+	TALLOC_CTX *frame = NULL;
+	struct dns_cache_forwarded hdr;
+	struct dns_name_packet *reply = NULL;
+	enum ndr_err_code ndr_err;
+	DATA_BLOB key;
+	DATA_BLOB value;
+	DATA_BLOB packet;
+	time_t now;
+	bool ok;
+
+	if (dns->cache == NULL) {
+		return false;
+	}
+
+	frame = talloc_stackframe();
+
+	ok = dns_cache_forwarder_key(frame, question, &key);
+	if (!ok) {
+		goto fail;
+	}
+
+	ok = memcache_lookup(dns->cache->mc, DNS_FORWARDER_CACHE, key, &value);
+	if (!ok) {
+		goto fail;
+	}
+	if (value.length < sizeof(hdr)) {
+		goto drop;
+	}
+	memcpy(&hdr, value.data, sizeof(hdr));
+
+	now = time(NULL);
+	if ((now >= hdr.expires) || (now < hdr.stored)) {
+		goto drop;
+	}
+
+	reply = talloc_zero(mem_ctx, struct dns_name_packet);
+	if (reply == NULL) {
+		goto fail;
+	}
+
+	packet = data_blob_const(value.data + sizeof(hdr),
+				 value.length - sizeof(hdr));
+	ndr_err = ndr_pull_struct_blob(
+		&packet,
+		reply,
+		reply,
+		(ndr_pull_flags_fn_t)ndr_pull_dns_name_packet);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		TALLOC_FREE(reply);
+		goto drop;
+	}
+
+	dns_cache_age_rrs(reply->answers, reply->ancount, now - hdr.stored);
+	dns_cache_age_rrs(reply->nsrecs, reply->nscount, now - hdr.stored);
+	dns_cache_age_rrs(reply->additional, reply->arcount, now - hdr.stored);
+
+	*preply = reply;
+	TALLOC_FREE(frame);
+	return true;
+
+drop:
+	memcache_delete(dns->cache->mc, DNS_FORWARDER_CACHE, key);
+fail:
+	TALLOC_FREE(frame);
+	return false;
+}
+
+static uint32_t dns_cache_min_ttl(const struct dns_res_rec *rrs,
+				  uint16_t count,
+				  uint32_t ttl)
+{
+	uint16_t i;
+
+	for (i = 0; i < count; i++) {
+		if (rrs[i].rr_type == DNS_QTYPE_OPT) {
+			continue;
+		}
+		ttl = MIN(ttl, rrs[i].ttl);
+	}
+	return ttl;
+}
+
+void dns_cache_forwarder_store(struct dns_server *dns,
+			       const struct dns_name_question *question,
+			       const struct dns_name_packet *reply)
+{
+	TALLOC_CTX *frame = NULL;
+	struct dns_cache_forwarded hdr;
+	enum ndr_err_code ndr_err;
+	DATA_BLOB key;
+	DATA_BLOB packet;
+	uint8_t *buf = NULL;
+	uint32_t ttl;
+	bool ok;
+
+	if (dns->cache == NULL) {
+		return;
+	}
+
+	/*
+	 * Only positive answers, negative caching needs the SOA
+	 * minimum and is left to the forwarder.
+	 */
+	if (((reply->operation & DNS_RCODE) != DNS_RCODE_OK) ||
+	    (reply->ancount == 0)) {
+		return;
+	}
+
+	ttl = dns_cache_min_ttl(reply->answers,
+				reply->ancount,
+				dns->cache->forwarder_max_ttl);
+	ttl = dns_cache_min_ttl(reply->nsrecs, reply->nscount, ttl);
+	if (ttl == 0) {
+		return;
+	}
+
+	frame = talloc_stackframe();
+
+	ok = dns_cache_forwarder_key(frame, question, &key);
+	if (!ok) {
+		goto done;
+	}
+
+	ndr_err = ndr_push_struct_blob(
+		&packet,
+		frame,
+		reply,
+		(ndr_push_flags_fn_t)ndr_push_dns_name_packet);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+		goto done;
+	}
+
+	hdr = (struct dns_cache_forwarded) {
+		.stored = time(NULL),
+	};
+	hdr.expires = hdr.stored + ttl;
+
+	buf = talloc_array(frame, uint8_t, sizeof(hdr) + packet.length);
+	if (buf == NULL) {
+		goto done;
+	}
+	memcpy(buf, &hdr, sizeof(hdr));
+	memcpy(buf + sizeof(hdr), packet.data, packet.length);
+
+	memcache_add(dns->cache->mc,
+		     DNS_FORWARDER_CACHE,
+		     key,
+		     data_blob_const(buf, sizeof(hdr) + packet.length));
+done:
+	TALLOC_FREE(frame);
+}
+
+static void dns_cache_counters(struct memcache *mc,
+			       enum memcache_number n,
+			       struct dnssrv_cache_counters *c)
+{
+	struct memcache_stats stats;
+	bool ok;
+
+	ok = memcache_get_stats(mc, n, &stats);
+	if (!ok) {
+		return;
+	}
+
+	*c = (struct dnssrv_cache_counters) {
+		.hits = stats.hits,
+		.misses = stats.misses,
+		.evictions = stats.evictions,
+		.num_elements = stats.num_elements,
+		.size = stats.size,
+	};
+}
+
+void dns_cache_get_stats(struct dns_server *dns,
+			 struct dnssrv_cache_counters *records,
+			 struct dnssrv_cache_counters *forwarder,
+			 uint64_t *max_size)
+{
+	struct memcache_usage usage;
+	bool ok;
+
+	*records = (struct dnssrv_cache_counters) { .hits = 0, };
+	*forwarder = (struct dnssrv_cache_counters) { .hits = 0, };
+	*max_size = 0;
+
+	if (dns->cache == NULL) {
+		return;
+	}
+
+	dns_cache_counters(dns->cache->mc, DNS_RECORDS_CACHE, records);
+	dns_cache_counters(dns->cache->mc, DNS_FORWARDER_CACHE, forwarder);
+
+	ok = memcache_get_usage(dns->cache->mc, &usage);
+	if (ok) {
+		*max_size = usage.max_size;
+	}
+}
@@ -789,6 +789,7 @@ static NTSTATUS dns_server_reload_zones(struct dns_server *dns)
 		DLIST_REMOVE(old_list, old_zone);
 		talloc_free(old_zone);
 	}
+	dns_cache_zones_reloaded(dns);
 
 	return NT_STATUS_OK;
 }
@@ -814,10 +815,31 @@ static NTSTATUS dns_reload_zones(struct irpc_message *msg,
 	return NT_STATUS_OK;
 }
 
+static NTSTATUS dns_cache_stats(struct irpc_message *msg,
+				struct dnssrv_cache_stats *r)
+{
+	struct dns_server *dns;
+
+	dns = talloc_get_type(msg->private_data, struct dns_server);
+	if (dns == NULL) {
+		r->out.result = NT_STATUS_INTERNAL_ERROR;
+		return NT_STATUS_INTERNAL_ERROR;
+	}
+
+	dns_cache_get_stats(dns,
+			    r->out.records,
+			    r->out.forwarder,
+			    r->out.max_size);
+	r->out.result = NT_STATUS_OK;
+
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS dns_task_init(struct task_server *task)
 {
 	struct dns_server *dns;
 	NTSTATUS status;
+	WERROR werr;
 	struct interface *ifaces = NULL;
 	int ret;
 	static const char * const attrs_none[] = { NULL};
@@ -928,6 +950,12 @@ static NTSTATUS dns_task_init(struct task_server *task)
 		return NT_STATUS_NO_MEMORY;
 	}
 
+	werr = dns_cache_init(dns);
+	if (!W_ERROR_IS_OK(werr)) {
+		task_server_terminate(task, "Failed to allocate DNS cache\n", true);
+		return NT_STATUS_NO_MEMORY;
+	}
+
 	status = dns_server_reload_zones(dns);
 	if (!NT_STATUS_IS_OK(status)) {
 		task_server_terminate(task, "dns: failed to load DNS zones", true);
@@ -953,6 +981,13 @@ static NTSTATUS dns_task_init(struct task_server *task)
 		task_server_terminate(task, "dns: failed to setup reload handler", true);
 		return status;
 	}
+
+	status = IRPC_REGISTER(task->msg_ctx, irpc, DNSSRV_CACHE_STATS,
+			       dns_cache_stats, dns);
+	if (!NT_STATUS_IS_OK(status)) {
+		task_server_terminate(task, "dns: failed to setup cache stats handler", true);
+		return status;
+	}
 	return NT_STATUS_OK;
 }
 
@@ -44,12 +44,15 @@ struct dns_server_tkey_store {
 	uint16_t size;
 };
 
+struct dns_server_cache;
+
 struct dns_server {
 	struct task_server *task;
 	struct ldb_context *samdb;
 	struct dns_server_zone *zones;
 	struct dns_server_tkey_store *tkeys;
 	struct cli_credentials *server_credentials;
+	struct dns_server_cache *cache;
 };
 
 struct dns_request_state {
@@ -119,6 +122,26 @@ WERROR dns_sign_tsig(struct dns_server *dns,
 		     struct dns_name_packet *packet,
 		     uint16_t error);
 
+struct dnssrv_cache_counters;
+WERROR dns_cache_init(struct dns_server *dns);
+void dns_cache_zones_reloaded(struct dns_server *dns);
+WERROR dns_cache_lookup_records(struct dns_server *dns,
+				TALLOC_CTX *mem_ctx,
+				struct ldb_dn *dn,
+				struct dnsp_DnssrvRpcRecord **records,
+				uint16_t *rec_count);
+bool dns_cache_forwarder_lookup(struct dns_server *dns,
+				TALLOC_CTX *mem_ctx,
+				const struct dns_name_question *question,
+				struct dns_name_packet **preply);
+void dns_cache_forwarder_store(struct dns_server *dns,
+			       const struct dns_name_question *question,
+			       const struct dns_name_packet *reply);
+void dns_cache_get_stats(struct dns_server *dns,
+			 struct dnssrv_cache_counters *records,
+			 struct dnssrv_cache_counters *forwarder,
+			 uint64_t *max_size);
+
 #include "source4/dns_server/dnsserver_common.h"
 
 #endif /* __DNS_SERVER_H__ */
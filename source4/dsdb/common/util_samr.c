@@ -527,6 +527,13 @@ NTSTATUS dsdb_enum_group_mem(struct ldb_context *ldb,
 	return NT_STATUS_OK;
 }
 
+/*
+ * The number of RIDs or names looked up with a single search.  Each
+ * batch turns into one OR filter, which the index resolves as a union
+ * of exact matches.
+ */
+#define DSDB_LOOKUP_BATCH_SIZE 100
+
 NTSTATUS dsdb_lookup_rids(struct ldb_context *ldb,
 			  TALLOC_CTX *mem_ctx,
 			  const struct dom_sid *domain_sid,
@@ -535,50 +542,101 @@ NTSTATUS dsdb_lookup_rids(struct ldb_context *ldb,
 			  const char **names,
 			  enum lsa_SidType *lsa_attrs)
 {
-	const char *attrs[] = { "sAMAccountType", "sAMAccountName", NULL };
+	const char *attrs[] = { "sAMAccountType", "sAMAccountName",
+				"objectSid", NULL };
+	struct ldb_dn *base_dn = NULL;
 	unsigned int i, num_mapped;
 
 	TALLOC_CTX *tmp_ctx = talloc_new(mem_ctx);
 	NT_STATUS_HAVE_NO_MEMORY(tmp_ctx);
 
+	base_dn = ldb_get_default_basedn(ldb);
+	if (base_dn == NULL) {
+		talloc_free(tmp_ctx);
+		return NT_STATUS_INTERNAL_DB_CORRUPTION;
+	}
+
 	num_mapped = 0;
 
 	for (i=0; i<num_rids; i++) {
-		struct ldb_message *msg;
-		struct ldb_dn *dn;
-		uint32_t attr;
+		lsa_attrs[i] = SID_NAME_UNKNOWN;
+	}
+
+	for (i=0; i<num_rids; i += DSDB_LOOKUP_BATCH_SIZE) {
+		unsigned int batch = MIN(num_rids - i, DSDB_LOOKUP_BATCH_SIZE);
+		struct ldb_result *res = NULL;
+		char *filter = NULL;
+		unsigned int j, k;
 		int rc;
 
-		lsa_attrs[i] = SID_NAME_UNKNOWN;
+		filter = talloc_strdup(tmp_ctx, "(&(sAMAccountName=*)(|");
+		for (j = 0; j < batch; j++) {
+			struct dom_sid sid;
+			struct dom_sid_buf buf;
 
-		dn = ldb_dn_new_fmt(tmp_ctx, ldb, "<SID=%s>",
-				    dom_sid_string(tmp_ctx,
-						   dom_sid_add_rid(tmp_ctx, domain_sid,
-								   rids[i])));
-		if (dn == NULL) {
+			sid_compose(&sid, domain_sid, rids[i + j]);
+			talloc_asprintf_addbuf(&filter, "(objectSid=%s)",
+					       dom_sid_str_buf(&sid, &buf));
+		}
+		talloc_asprintf_addbuf(&filter, "))");
+		if (filter == NULL) {
 			talloc_free(tmp_ctx);
 			return NT_STATUS_NO_MEMORY;
 		}
-		rc = dsdb_search_one(ldb, tmp_ctx, &msg, dn, LDB_SCOPE_BASE, attrs, 0, "sAMAccountName=*");
-		if (rc == LDB_ERR_NO_SUCH_OBJECT) {
-			continue;
-		} else if (rc != LDB_SUCCESS) {
+
+		rc = dsdb_search(ldb, tmp_ctx, &res, base_dn,
+				 LDB_SCOPE_SUBTREE, attrs, 0, "%s", filter);
+		if (rc != LDB_SUCCESS) {
 			talloc_free(tmp_ctx);
 			return NT_STATUS_INTERNAL_DB_CORRUPTION;
 		}
 
-		names[i] = ldb_msg_find_attr_as_string(msg, "sAMAccountName", NULL);
-		if (names[i] == NULL) {
-			DEBUG(10, ("no samAccountName\n"));
-			continue;
-		}
-		talloc_steal(names, names[i]);
-		attr = ldb_msg_find_attr_as_uint(msg, "samAccountType", 0);
-		lsa_attrs[i] = ds_atype_map(attr);
-		if (lsa_attrs[i] == SID_NAME_UNKNOWN) {
-			continue;
+		for (k = 0; k < res->count; k++) {
+			struct ldb_message *msg = res->msgs[k];
+			struct dom_sid *sid = NULL;
+			const char *name = NULL;
+			enum lsa_SidType type;
+			uint32_t rid;
+			uint32_t attr;
+			NTSTATUS status;
+
+			sid = samdb_result_dom_sid(tmp_ctx, msg, "objectSid");
+			if (sid == NULL) {
+				continue;
+			}
+			status = dom_sid_split_rid(NULL, sid, NULL, &rid);
+			if (!NT_STATUS_IS_OK(status)) {
+				continue;
+			}
+
+			name = ldb_msg_find_attr_as_string(msg,
+							   "sAMAccountName",
+							   NULL);
+			if (name == NULL) {
+				DEBUG(10, ("no samAccountName\n"));
+				continue;
+			}
+			attr = ldb_msg_find_attr_as_uint(msg,
+							 "samAccountType", 0);
+			type = ds_atype_map(attr);
+
+			/* A RID may be asked for more than once */
+			for (j = 0; j < batch; j++) {
+				if (rids[i + j] != rid || names[i + j] != NULL) {
+					continue;
+				}
+				names[i + j] = talloc_strdup(names, name);
+				if (names[i + j] == NULL) {
+					talloc_free(tmp_ctx);
+					return NT_STATUS_NO_MEMORY;
+				}
+				lsa_attrs[i + j] = type;
+				if (type != SID_NAME_UNKNOWN) {
+					num_mapped += 1;
+				}
+			}
 		}
-		num_mapped += 1;
+		TALLOC_FREE(res);
 	}
 	talloc_free(tmp_ctx);
 
@@ -250,10 +250,34 @@ struct dreplsrv_op_pull_source_schema_cycle {
 	struct drsuapi_DsReplicaLinkedAttribute *linked_attributes;
 };
 
+/*
+ * A GetNCChanges reply received while an earlier one is being applied
+ */
+struct dreplsrv_op_pull_source_chunk {
+	struct dreplsrv_op_pull_source_chunk *prev, *next;
+	struct drsuapi_DsGetNCChanges *r;
+	uint32_t ctr_level;
+	struct drsuapi_DsGetNCChangesCtr1 *ctr1;
+	struct drsuapi_DsGetNCChangesCtr6 *ctr6;
+	bool more_data;
+	struct drsuapi_DsReplicaHighWaterMark highwatermark;
+};
+
 struct dreplsrv_op_pull_source_state {
 	struct tevent_context *ev;
 	struct dreplsrv_out_operation *op;
 	void *ndr_struct_ptr;
+	/*
+	 * The GetNCChanges request in flight and the replies waiting
+	 * to be applied.  The next request of a cycle only depends on
+	 * the highwatermark of the previous reply, so with a pipeline
+	 * depth the source DSA prepares the next chunks while we commit
+	 * the current one.
+	 */
+	struct tevent_req *get_changes_subreq;
+	struct dreplsrv_op_pull_source_chunk *chunks;
+	size_t num_chunks;
+	struct tevent_immediate *apply_im;
 	/*
 	 * Used when we have to re-try with a different NC, eg for
 	 * EXOP retry or to get a current schema first
@@ -266,6 +290,39 @@ struct dreplsrv_op_pull_source_state {
 
 static void dreplsrv_op_pull_source_connect_done(struct tevent_req *subreq);
 
+/*
+ * Forget the replies fetched ahead and the request in flight, when the
+ * cycle fails or has to be restarted with different flags.
+ */
+static void dreplsrv_op_pull_source_pipeline_flush(
+	struct dreplsrv_op_pull_source_state *state)
+{
+	if (state->get_changes_subreq != NULL) {
+		TALLOC_FREE(state->get_changes_subreq);
+		TALLOC_FREE(state->ndr_struct_ptr);
+	}
+	while (state->chunks != NULL) {
+		struct dreplsrv_op_pull_source_chunk *chunk = state->chunks;
+
+		DLIST_REMOVE(state->chunks, chunk);
+		TALLOC_FREE(chunk);
+	}
+	state->num_chunks = 0;
+	if (state->apply_im != NULL) {
+		tevent_schedule_immediate(state->apply_im, NULL, NULL, NULL);
+	}
+}
+
+static void dreplsrv_op_pull_source_cleanup(struct tevent_req *req,
+					    enum tevent_req_state req_state)
+{
+	struct dreplsrv_op_pull_source_state *state =
+		tevent_req_data(req,
+		struct dreplsrv_op_pull_source_state);
+
+	dreplsrv_op_pull_source_pipeline_flush(state);
+}
+
 struct tevent_req *dreplsrv_op_pull_source_send(TALLOC_CTX *mem_ctx,
 						struct tevent_context *ev,
 						struct dreplsrv_out_operation *op)
@@ -282,6 +339,8 @@ struct tevent_req *dreplsrv_op_pull_source_send(TALLOC_CTX *mem_ctx,
 	state->ev = ev;
 	state->op = op;
 
+	tevent_req_set_cleanup_fn(req, dreplsrv_op_pull_source_cleanup);
+
 	subreq = dreplsrv_out_drsuapi_send(state, ev, op->source_dsa->conn);
 	if (tevent_req_nomem(subreq, req)) {
 		return tevent_req_post(req, ev);
@@ -347,6 +406,9 @@ static void dreplsrv_op_pull_source_connect_done(struct tevent_req *subreq)
 }
 
 static void dreplsrv_op_pull_source_get_changes_done(struct tevent_req *subreq);
+static void dreplsrv_op_pull_source_send_get_changes(
+	struct tevent_req *req,
+	const struct drsuapi_DsReplicaHighWaterMark *next_highwatermark);
 
 /*
   get a RODC partial attribute set for a replication call
@@ -475,7 +537,27 @@ static WERROR udv_convert(TALLOC_CTX *mem_ctx,
 }
 
 
+/*
+ * Start (or restart) fetching the changes from the highwatermark of
+ * the repsFrom
+ */
 static void dreplsrv_op_pull_source_get_changes_trigger(struct tevent_req *req)
+{
+	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
+						      struct dreplsrv_op_pull_source_state);
+
+	dreplsrv_op_pull_source_pipeline_flush(state);
+	dreplsrv_op_pull_source_send_get_changes(req, NULL);
+}
+
+/*
+ * Send a GetNCChanges request, either from the repsFrom
+ * highwatermark or, when fetching ahead, from the highwatermark of
+ * the last reply not applied yet.
+ */
+static void dreplsrv_op_pull_source_send_get_changes(
+	struct tevent_req *req,
+	const struct drsuapi_DsReplicaHighWaterMark *next_highwatermark)
 {
 	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
 						      struct dreplsrv_op_pull_source_state);
@@ -536,6 +618,9 @@ static void dreplsrv_op_pull_source_get_changes_trigger(struct tevent_req *req)
 
 	replica_flags = rf1->replica_flags;
 	highwatermark = rf1->highwatermark;
+	if (next_highwatermark != NULL) {
+		highwatermark = *next_highwatermark;
+	}
 
 	if (state->op->options & DRSUAPI_DRS_GET_ANC) {
 		replica_flags |= DRSUAPI_DRS_GET_ANC;
@@ -672,6 +757,7 @@ static void dreplsrv_op_pull_source_get_changes_trigger(struct tevent_req *req)
 		return;
 	}
 	tevent_req_set_callback(subreq, dreplsrv_op_pull_source_get_changes_done, req);
+	state->get_changes_subreq = subreq;
 }
 
 static void dreplsrv_op_pull_source_apply_changes_trigger(struct tevent_req *req,
@@ -680,6 +766,141 @@ static void dreplsrv_op_pull_source_apply_changes_trigger(struct tevent_req *req
 						          struct drsuapi_DsGetNCChangesCtr1 *ctr1,
 						          struct drsuapi_DsGetNCChangesCtr6 *ctr6);
 
+static void dreplsrv_op_pull_source_apply_next(struct tevent_context *ev,
+					      struct tevent_immediate *im,
+					      void *private_data);
+
+/*
+ * Ask for the chunk following the last reply not applied yet, if
+ * the pipeline has room for it, and schedule applying the replies.
+ */
+static void dreplsrv_op_pull_source_pipeline_pump(struct tevent_req *req)
+{
+	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
+						      struct dreplsrv_op_pull_source_state);
+	struct dreplsrv_op_pull_source_chunk *last = DLIST_TAIL(state->chunks);
+	uint32_t depth = state->op->service->getncchanges_pipeline_depth;
+
+	if (state->get_changes_subreq == NULL &&
+	    last != NULL &&
+	    last->more_data &&
+	    state->num_chunks <= depth) {
+		dreplsrv_op_pull_source_send_get_changes(req,
+							 &last->highwatermark);
+		if (!tevent_req_is_in_progress(req)) {
+			return;
+		}
+	}
+
+	if (state->chunks == NULL) {
+		return;
+	}
+
+	if (state->apply_im == NULL) {
+		state->apply_im = tevent_create_immediate(state);
+		if (tevent_req_nomem(state->apply_im, req)) {
+			return;
+		}
+	}
+	tevent_schedule_immediate(state->apply_im,
+				  state->ev,
+				  dreplsrv_op_pull_source_apply_next,
+				  req);
+}
+
+/*
+ * Queue a reply to be applied, if it is part of a plain replication
+ * cycle.  Extended operations are a single chunk, and the schema
+ * cycle collects all the chunks before applying them.
+ */
+static bool dreplsrv_op_pull_source_pipeline_queue(
+	struct tevent_req *req,
+	struct drsuapi_DsGetNCChanges *r,
+	uint32_t ctr_level,
+	struct drsuapi_DsGetNCChangesCtr1 *ctr1,
+	struct drsuapi_DsGetNCChangesCtr6 *ctr6)
+{
+	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
+						      struct dreplsrv_op_pull_source_state);
+	struct dreplsrv_op_pull_source_chunk *chunk = NULL;
+
+	if (state->op->service->getncchanges_pipeline_depth == 0 ||
+	    state->op->extended_op != DRSUAPI_EXOP_NONE ||
+	    state->schema_cycle != NULL) {
+		return false;
+	}
+
+	chunk = talloc_zero(state, struct dreplsrv_op_pull_source_chunk);
+	if (chunk == NULL) {
+		return false;
+	}
+	chunk->r = talloc_steal(chunk, r);
+	chunk->ctr_level = ctr_level;
+	chunk->ctr1 = ctr1;
+	chunk->ctr6 = ctr6;
+	if (ctr_level == 1) {
+		chunk->more_data = ctr1->more_data;
+		chunk->highwatermark = ctr1->new_highwatermark;
+	} else {
+		chunk->more_data = ctr6->more_data;
+		chunk->highwatermark = ctr6->new_highwatermark;
+	}
+
+	DLIST_ADD_END(state->chunks, chunk);
+	state->num_chunks += 1;
+
+	dreplsrv_op_pull_source_pipeline_pump(req);
+	return true;
+}
+
+static void dreplsrv_op_pull_source_apply_next(struct tevent_context *ev,
+					      struct tevent_immediate *im,
+					      void *private_data)
+{
+	struct tevent_req *req = talloc_get_type_abort(private_data,
+				 struct tevent_req);
+	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
+						      struct dreplsrv_op_pull_source_state);
+	struct dreplsrv_op_pull_source_chunk *chunk = state->chunks;
+	struct drsuapi_DsGetNCChanges *r = NULL;
+	uint32_t ctr_level;
+	struct drsuapi_DsGetNCChangesCtr1 *ctr1 = NULL;
+	struct drsuapi_DsGetNCChangesCtr6 *ctr6 = NULL;
+
+	if (chunk == NULL) {
+		return;
+	}
+
+	DLIST_REMOVE(state->chunks, chunk);
+	state->num_chunks -= 1;
+
+	r = talloc_steal(state, chunk->r);
+	ctr_level = chunk->ctr_level;
+	ctr1 = chunk->ctr1;
+	ctr6 = chunk->ctr6;
+	TALLOC_FREE(chunk);
+
+	dreplsrv_op_pull_source_apply_changes_trigger(req, r, ctr_level,
+						      ctr1, ctr6);
+}
+
+/*
+ * Continue the cycle after a chunk was applied
+ */
+static void dreplsrv_op_pull_source_get_more_changes(struct tevent_req *req)
+{
+	struct dreplsrv_op_pull_source_state *state = tevent_req_data(req,
+						      struct dreplsrv_op_pull_source_state);
+
+	if (state->get_changes_subreq != NULL || state->chunks != NULL) {
+		/* The next chunk is already on its way */
+		dreplsrv_op_pull_source_pipeline_pump(req);
+		return;
+	}
+
+	dreplsrv_op_pull_source_get_changes_trigger(req);
+}
+
 static void dreplsrv_op_pull_source_get_changes_done(struct tevent_req *subreq)
 {
 	struct tevent_req *req = tevent_req_callback_data(subreq,
@@ -694,6 +915,7 @@ static void dreplsrv_op_pull_source_get_changes_done(struct tevent_req *subreq)
 	struct drsuapi_DsGetNCChangesCtr6 *ctr6 = NULL;
 	enum drsuapi_DsExtendedError extended_ret = DRSUAPI_EXOP_ERR_NONE;
 	state->ndr_struct_ptr = NULL;
+	state->get_changes_subreq = NULL;
 
 	status = dcerpc_drsuapi_DsGetNCChanges_r_recv(subreq, r);
 	TALLOC_FREE(subreq);
@@ -764,6 +986,11 @@ static void dreplsrv_op_pull_source_get_changes_done(struct tevent_req *subreq)
 		}
 	}
 
+	if (dreplsrv_op_pull_source_pipeline_queue(req, r, ctr_level,
+						   ctr1, ctr6)) {
+		return;
+	}
+
 	dreplsrv_op_pull_source_apply_changes_trigger(req, r, ctr_level, ctr1, ctr6);
 }
 
@@ -1140,6 +1367,9 @@ static void dreplsrv_op_pull_source_apply_changes_trigger(struct tevent_req *req
 		}
 		DEBUG(4,("Wrong schema when applying reply GetNCChanges, retrying\n"));
 
+		/* The chunks fetched ahead are for the partition we divert from */
+		dreplsrv_op_pull_source_pipeline_flush(state);
+
 		state->retry_started = true;
 
 		subreq = dreplsrv_out_drsuapi_send(state,
@@ -1199,7 +1429,7 @@ static void dreplsrv_op_pull_source_apply_changes_trigger(struct tevent_req *req
 	TALLOC_FREE(r);
 
 	if (more_data) {
-		dreplsrv_op_pull_source_get_changes_trigger(req);
+		dreplsrv_op_pull_source_get_more_changes(req);
 		return;
 	}
 
@@ -485,6 +485,7 @@ static NTSTATUS dreplsrv_task_init(struct task_server *task)
 
 	periodic_startup_interval	= lpcfg_parm_int(task->lp_ctx, NULL, "dreplsrv", "periodic_startup_interval", 15); /* in seconds */
 	service->periodic.interval	= lpcfg_parm_int(task->lp_ctx, NULL, "dreplsrv", "periodic_interval", 300); /* in seconds */
+	service->getncchanges_pipeline_depth = lpcfg_parm_int(task->lp_ctx, NULL, "dreplsrv", "getncchanges_pipeline_depth", 1);
 
 	status = dreplsrv_periodic_schedule(service, periodic_startup_interval);
 	if (!W_ERROR_IS_OK(status)) {
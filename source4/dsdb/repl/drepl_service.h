@@ -242,6 +242,12 @@ struct dreplsrv_service {
 	bool rid_alloc_in_progress;
 
 	bool am_rodc;
+
+	/*
+	 * the number of GetNCChanges replies fetched ahead of being
+	 * applied, 0 disables the pipelining
+	 */
+	uint32_t getncchanges_pipeline_depth;
 };
 
 #include "lib/messaging/irpc.h"
@@ -38,6 +38,7 @@
 #include "param/param.h"
 #include "dsdb/samdb/ldb_modules/util.h"
 #include "lib/util/binsearch.h"
+#include "lib/util/dlinklist.h"
 
 #undef strcasecmp
 
@@ -72,18 +73,55 @@ struct aclread_context {
 	struct ldb_attr_vec tree_attrs;
 };
 
+/*
+ * The SDs we parsed most recently, most recent first, and the results
+ * of the attribute access checks done against them. Most objects of a
+ * container have byte-identical SDs, so the same check is repeated for
+ * every object of a large search.
+ */
+#define ACLREAD_SD_MEMO_MAX 32
+#define ACLREAD_ACCESS_MEMO_SLOTS 128
+
+struct aclread_access_memo {
+	bool valid;
+	uint32_t access_mask;
+	struct GUID class_guid;
+	struct GUID attr_guid;
+	struct GUID attr_security_guid;
+	int ret;
+};
+
+struct aclread_sd_memo {
+	struct aclread_sd_memo *prev, *next;
+	struct ldb_val blob;
+	struct security_descriptor *sd;
+	/*
+	 * PRINCIPAL_SELF and conditional ACEs make the result depend
+	 * on the object SID, so nothing is remembered for these.
+	 */
+	bool depends_on_object;
+	struct aclread_access_memo *checks;
+};
+
 struct aclread_private {
 	bool enabled;
 
-	/* cache of the last SD we read during any search */
-	struct security_descriptor *sd_cached;
-	struct ldb_val sd_cached_blob;
+	struct aclread_sd_memo *sd_memos;
+	unsigned int num_sd_memos;
+	/*
+	 * The token the remembered access checks were done for, they
+	 * are dropped when the session changes.
+	 */
+	DATA_BLOB memo_token;
+	bool memo_token_valid;
+
 	const char **password_attrs;
 	size_t num_password_attrs;
 };
 
 struct access_check_context {
 	struct security_descriptor *sd;
+	struct aclread_sd_memo *memo;
 	struct dom_sid sid_buf;
 	const struct dom_sid *sid;
 	const struct dsdb_class *objectclass;
@@ -450,6 +488,72 @@ static int aclread_check_object_visible(struct aclread_context *ac,
 	return LDB_ERR_INSUFFICIENT_ACCESS_RIGHTS;
 }
 
+static bool aclread_sd_depends_on_object(const struct security_descriptor *sd)
+{
+	uint32_t i;
+
+	if (sd->dacl == NULL) {
+		return false;
+	}
+
+	for (i = 0; i < sd->dacl->num_aces; i++) {
+		const struct security_ace *ace = &sd->dacl->aces[i];
+
+		if (sec_ace_callback(ace->type)) {
+			return true;
+		}
+		if (dom_sid_equal(&ace->trustee, &global_sid_Self)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+static void aclread_sd_memo_remove(struct aclread_private *private_data,
+				   struct aclread_sd_memo *memo)
+{
+	DLIST_REMOVE(private_data->sd_memos, memo);
+	private_data->num_sd_memos -= 1;
+	TALLOC_FREE(memo);
+}
+
+/*
+ * Forget the access checks if the session is not the one they were
+ * done for. The parsed SDs stay.
+ */
+static void aclread_memo_check_token(struct ldb_module *module,
+				     struct aclread_private *private_data)
+{
+	struct security_token *token = acl_user_token(module);
+	struct aclread_sd_memo *memo = NULL;
+	DATA_BLOB blob = data_blob_null;
+	enum ndr_err_code ndr_err;
+
+	if (token != NULL) {
+		ndr_err = ndr_push_struct_blob(
+			&blob, private_data, token,
+			(ndr_push_flags_fn_t)ndr_push_security_token);
+		if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+			blob = data_blob_null;
+		}
+	}
+
+	if (private_data->memo_token_valid &&
+	    blob.data != NULL &&
+	    data_blob_cmp(&blob, &private_data->memo_token) == 0) {
+		data_blob_free(&blob);
+		return;
+	}
+
+	for (memo = private_data->sd_memos; memo != NULL; memo = memo->next) {
+		TALLOC_FREE(memo->checks);
+	}
+
+	data_blob_free(&private_data->memo_token);
+	private_data->memo_token = blob;
+	private_data->memo_token_valid = (blob.data != NULL);
+}
+
 /*
  * The sd returned from this function is valid until the next call on
  * this module context
@@ -460,13 +564,15 @@ static int aclread_check_object_visible(struct aclread_context *ac,
 
 static int aclread_get_sd_from_ldb_message(struct aclread_context *ac,
 					   const struct ldb_message *acl_res,
-					   struct security_descriptor **sd)
+					   struct security_descriptor **sd,
+					   struct aclread_sd_memo **_memo)
 {
 	struct ldb_message_element *sd_element;
 	struct ldb_context *ldb = ldb_module_get_ctx(ac->module);
 	struct aclread_private *private_data
 		= talloc_get_type_abort(ldb_module_get_private(ac->module),
 				  struct aclread_private);
+	struct aclread_sd_memo *memo = NULL;
 	enum ndr_err_code ndr_err;
 
 	sd_element = ldb_msg_find_element(acl_res, "nTSecurityDescriptor");
@@ -481,44 +587,125 @@ static int aclread_get_sd_from_ldb_message(struct aclread_context *ac,
 
 	/*
 	 * The time spent in ndr_pull_security_descriptor() is quite
-	 * expensive, so we check if this is the same binary blob as last
-	 * time, and if so return the memory tree from that previous parse.
+	 * expensive, so we check if this is the same binary blob as
+	 * one of the last ones, and if so return the memory tree from
+	 * that previous parse.
 	 */
 
-	if (private_data->sd_cached != NULL &&
-	    private_data->sd_cached_blob.data != NULL &&
-	    ldb_val_equal_exact(&sd_element->values[0],
-				&private_data->sd_cached_blob)) {
-		*sd = private_data->sd_cached;
-		return LDB_SUCCESS;
+	for (memo = private_data->sd_memos; memo != NULL; memo = memo->next) {
+		if (ldb_val_equal_exact(&sd_element->values[0],
+					&memo->blob)) {
+			DLIST_PROMOTE(private_data->sd_memos, memo);
+			*sd = memo->sd;
+			*_memo = memo;
+			return LDB_SUCCESS;
+		}
 	}
 
-	*sd = talloc(private_data, struct security_descriptor);
-	if(!*sd) {
+	memo = talloc_zero(private_data, struct aclread_sd_memo);
+	if (memo == NULL) {
+		return ldb_oom(ldb);
+	}
+	memo->sd = talloc(memo, struct security_descriptor);
+	if (memo->sd == NULL) {
+		TALLOC_FREE(memo);
 		return ldb_oom(ldb);
 	}
-	ndr_err = ndr_pull_struct_blob(&sd_element->values[0], *sd, *sd,
+	ndr_err = ndr_pull_struct_blob(&sd_element->values[0], memo->sd, memo->sd,
 			     (ndr_pull_flags_fn_t)ndr_pull_security_descriptor);
 
 	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
-		TALLOC_FREE(*sd);
+		TALLOC_FREE(memo);
 		return ldb_operr(ldb);
 	}
 
-	talloc_unlink(private_data, private_data->sd_cached_blob.data);
-	private_data->sd_cached_blob = ldb_val_dup(private_data,
-						   &sd_element->values[0]);
-	if (private_data->sd_cached_blob.data == NULL) {
-		TALLOC_FREE(*sd);
+	memo->blob = ldb_val_dup(memo, &sd_element->values[0]);
+	if (memo->blob.data == NULL) {
+		TALLOC_FREE(memo);
 		return ldb_operr(ldb);
 	}
+	memo->depends_on_object = aclread_sd_depends_on_object(memo->sd);
 
-	talloc_unlink(private_data, private_data->sd_cached);
-	private_data->sd_cached = *sd;
+	while (private_data->num_sd_memos >= ACLREAD_SD_MEMO_MAX) {
+		aclread_sd_memo_remove(private_data,
+				       DLIST_TAIL(private_data->sd_memos));
+	}
+	DLIST_ADD(private_data->sd_memos, memo);
+	private_data->num_sd_memos += 1;
+
+	*sd = memo->sd;
+	*_memo = memo;
 
 	return LDB_SUCCESS;
 }
 
+/*
+ * acl_check_access_on_attribute_implicit_owner(), remembering the
+ * result for the SD
+ */
+static int aclread_check_attr_access(struct aclread_context *ac,
+				     TALLOC_CTX *mem_ctx,
+				     struct aclread_sd_memo *memo,
+				     const struct security_descriptor *sd,
+				     const struct dom_sid *sid,
+				     uint32_t access_mask,
+				     const struct dsdb_attribute *attr,
+				     const struct dsdb_class *objectclass)
+{
+	const struct aclread_private *private_data
+		= talloc_get_type_abort(ldb_module_get_private(ac->module),
+				  struct aclread_private);
+	struct aclread_access_memo *slot = NULL;
+	int ret;
+
+	if (memo != NULL &&
+	    private_data->memo_token_valid &&
+	    !memo->depends_on_object) {
+		uint32_t h;
+
+		if (memo->checks == NULL) {
+			memo->checks = talloc_zero_array(
+				memo,
+				struct aclread_access_memo,
+				ACLREAD_ACCESS_MEMO_SLOTS);
+		}
+		if (memo->checks != NULL) {
+			h = attr->schemaIDGUID.time_low * 31 +
+			    objectclass->schemaIDGUID.time_low;
+			h = h * 31 + access_mask;
+			slot = &memo->checks[h % ACLREAD_ACCESS_MEMO_SLOTS];
+		}
+	}
+
+	if (slot != NULL &&
+	    slot->valid &&
+	    slot->access_mask == access_mask &&
+	    GUID_equal(&slot->attr_guid, &attr->schemaIDGUID) &&
+	    GUID_equal(&slot->class_guid, &objectclass->schemaIDGUID) &&
+	    GUID_equal(&slot->attr_security_guid,
+		       &attr->attributeSecurityGUID)) {
+		return slot->ret;
+	}
+
+	ret = acl_check_access_on_attribute_implicit_owner(ac->module, mem_ctx, sd, sid,
+							   access_mask, attr, objectclass,
+							   IMPLICIT_OWNER_READ_CONTROL_RIGHTS);
+
+	if (slot != NULL &&
+	    (ret == LDB_SUCCESS || ret == LDB_ERR_INSUFFICIENT_ACCESS_RIGHTS)) {
+		*slot = (struct aclread_access_memo) {
+			.valid = true,
+			.access_mask = access_mask,
+			.class_guid = objectclass->schemaIDGUID,
+			.attr_guid = attr->schemaIDGUID,
+			.attr_security_guid = attr->attributeSecurityGUID,
+			.ret = ret,
+		};
+	}
+
+	return ret;
+}
+
 /* Check whether the attribute is a password attribute. */
 static bool attr_is_secret(const char *attr, const struct aclread_private *private_data)
 {
@@ -582,6 +769,7 @@ static int acl_redact_attr(TALLOC_CTX *mem_ctx,
 			   const struct ldb_message *msg,
 			   const struct dsdb_schema *schema,
 			   const struct security_descriptor *sd,
+			   struct aclread_sd_memo *memo,
 			   const struct dom_sid *sid,
 			   const struct dsdb_class *objectclass)
 {
@@ -615,9 +803,8 @@ static int acl_redact_attr(TALLOC_CTX *mem_ctx,
 
 	/* We must check whether the user has rights to view the attribute. */
 
-	ret = acl_check_access_on_attribute_implicit_owner(ac->module, mem_ctx, sd, sid,
-							   access_mask, attr, objectclass,
-							   IMPLICIT_OWNER_READ_CONTROL_RIGHTS);
+	ret = aclread_check_attr_access(ac, mem_ctx, memo, sd, sid,
+					access_mask, attr, objectclass);
 	if (ret == LDB_ERR_INSUFFICIENT_ACCESS_RIGHTS) {
 		ldb_msg_element_mark_inaccessible(el);
 	} else if (ret != LDB_SUCCESS) {
@@ -654,7 +841,7 @@ static int setup_access_check_context(struct aclread_context *ac,
 	}
 
 	/* Fetch the object's security descriptor. */
-	ret = aclread_get_sd_from_ldb_message(ac, msg, &ctx->sd);
+	ret = aclread_get_sd_from_ldb_message(ac, msg, &ctx->sd, &ctx->memo);
 	if (ret != LDB_SUCCESS) {
 		ldb_debug_set(ldb_module_get_ctx(ac->module), LDB_DEBUG_FATAL,
 			      "acl_read: cannot get descriptor of %s: %s\n",
@@ -827,6 +1014,7 @@ static int aclread_callback(struct ldb_request *req, struct ldb_reply *ares)
 					      msg,
 					      ac->schema,
 					      acl_ctx.sd,
+					      acl_ctx.memo,
 					      acl_ctx.sid,
 					      acl_ctx.objectclass);
 			if (ret != LDB_SUCCESS) {
@@ -906,6 +1094,8 @@ static int aclread_search(struct ldb_module *module, struct ldb_request *req)
 	ac->module = module;
 	ac->req = req;
 
+	aclread_memo_check_token(module, p);
+
 	attrs = req->op.search.attrs;
 	if (attrs == NULL) {
 		all_attrs = true;
@@ -1121,6 +1311,7 @@ static int acl_redact_msg_for_filter(struct ldb_module *module, struct ldb_reque
 				      msg,
 				      ac->schema,
 				      acl_ctx.sd,
+				      acl_ctx.memo,
 				      acl_ctx.sid,
 				      acl_ctx.objectclass);
 		if (ret != LDB_SUCCESS) {
@@ -1152,6 +1343,12 @@ static int aclread_init(struct ldb_module *module)
 	static const char * const secret_attrs[] = {
 		DSDB_SECRET_ATTRIBUTES
 	};
+	static const char * const redact_attrs[] = {
+		"nTSecurityDescriptor",
+		"objectClass",
+		"objectSid",
+		NULL
+	};
 	struct ldb_result *res;
 	struct ldb_message *msg;
 	struct ldb_message_element *password_attributes;
@@ -1246,6 +1443,12 @@ static int aclread_init(struct ldb_module *module)
 		return ret;
 	}
 
+	/* What setup_access_check_context() reads from the message */
+	ret = ldb_register_redact_attrs(ldb, redact_attrs);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
 done:
 	talloc_free(mem_ctx);
 	ret = ldb_next_init(module);
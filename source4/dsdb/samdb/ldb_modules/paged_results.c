@@ -50,6 +50,21 @@
 
 #include "dsdb/common/util.h"
 #include "lib/util/dlinklist.h"
+#include "param/param.h"
+
+/*
+ * Defaults for the limits on the stored results of a connection, see
+ * paged_request_init()
+ */
+#define PAGED_RESULTS_MAX_RESULT_SETS 10
+#define PAGED_RESULTS_MAX_RESULT_BYTES (64 * 1024 * 1024)
+#define PAGED_RESULTS_COOKIE_LIFETIME 900
+
+/*
+ * Once this many GUIDs of a store have been returned, and they are at
+ * least half of it, they are dropped from the array
+ */
+#define PAGED_RESULTS_COMPACT_MIN 1024
 
 /* Referrals are temporarily stored in a linked list */
 struct referral_store {
@@ -76,6 +91,8 @@ struct results_store {
 	struct GUID *results;
 	size_t num_entries;
 	size_t result_array_size;
+	/* all matches, including those dropped from results */
+	size_t total_entries;
 
 	struct ldb_control **down_controls;
 	const char * const *attrs;
@@ -89,6 +106,13 @@ struct private_data {
 	uint32_t next_free_id;
 	size_t num_stores;
 	struct results_store *store;
+
+	/* GUID array space of all stores */
+	size_t result_bytes;
+
+	size_t max_result_sets;
+	size_t max_result_bytes;
+	time_t cookie_lifetime;
 };
 
 static int store_destructor(struct results_store *del)
@@ -97,19 +121,103 @@ static int store_destructor(struct results_store *del)
 	DLIST_REMOVE(priv->store, del);
 
 	priv->num_stores -= 1;
+	priv->result_bytes -= del->result_array_size * sizeof(struct GUID);
 
 	return 0;
 }
 
+/*
+ * Forget the searches a client has not continued within the cookie
+ * lifetime. The store list is most recently used first.
+ */
+static void expire_stores(struct private_data *priv)
+{
+	time_t now = time(NULL);
+
+	while (priv->store != NULL) {
+		struct results_store *last = DLIST_TAIL(priv->store);
+
+		if (now - last->timestamp <= priv->cookie_lifetime) {
+			break;
+		}
+		TALLOC_FREE(last);
+	}
+}
+
+/*
+ * Resize the GUID array of a store, dropping the least recently used
+ * other stores of the connection if that would exceed the space
+ * allowed for them.
+ */
+static bool store_resize_results(struct results_store *store, size_t count)
+{
+	struct private_data *priv = store->priv;
+	size_t old_bytes = store->result_array_size * sizeof(struct GUID);
+	size_t new_bytes;
+	struct GUID *results = NULL;
+
+	if (count > SIZE_MAX / sizeof(struct GUID)) {
+		return false;
+	}
+	new_bytes = count * sizeof(struct GUID);
+
+	while (priv->result_bytes - old_bytes + new_bytes >
+	       priv->max_result_bytes) {
+		struct results_store *last = DLIST_TAIL(priv->store);
+
+		if (last == store) {
+			return false;
+		}
+		TALLOC_FREE(last);
+	}
+
+	if (count == 0) {
+		TALLOC_FREE(store->results);
+	} else {
+		results = talloc_realloc(store, store->results,
+					 struct GUID, count);
+		if (results == NULL) {
+			return false;
+		}
+		store->results = results;
+	}
+
+	priv->result_bytes = priv->result_bytes - old_bytes + new_bytes;
+	store->result_array_size = count;
+	return true;
+}
+
+/*
+ * Drop the GUIDs already returned, a large search is otherwise held in
+ * full until the last page.
+ */
+static void store_compact_results(struct results_store *store)
+{
+	size_t remaining;
+
+	if (store->last_i < PAGED_RESULTS_COMPACT_MIN ||
+	    store->last_i * 2 < store->num_entries) {
+		return;
+	}
+
+	remaining = store->num_entries - store->last_i;
+	if (remaining != 0) {
+		memmove(store->results,
+			&store->results[store->last_i],
+			remaining * sizeof(struct GUID));
+	}
+	store->num_entries = remaining;
+	store->last_i = 0;
+
+	/* Shrinking can not fail for lack of space */
+	store_resize_results(store, remaining);
+}
+
 static struct results_store *new_store(struct private_data *priv)
 {
 	struct results_store *newr;
 	uint32_t new_id = priv->next_free_id++;
 
-	/* TODO: we should have a limit on the number of
-	 * outstanding paged searches
-	 */
-
 	newr = talloc_zero(priv, struct results_store);
 	if (!newr) return NULL;
 
@@ -129,11 +237,10 @@ static struct results_store *new_store(struct private_data *priv)
 
 	talloc_set_destructor(newr, store_destructor);
 
-	if (priv->num_stores > 10) {
+	if (priv->num_stores > priv->max_result_sets) {
 		struct results_store *last;
 		/*
-		 * 10 is the default for MaxResultSetsPerConn --
-		 * possibly need to parameterize it.
+		 * 10 is the default for MaxResultSetsPerConn
 		 */
 		last = DLIST_TAIL(priv->store);
 		TALLOC_FREE(last);
@@ -291,6 +398,8 @@ static int paged_results(struct paged_context *ac, struct ldb_reply *ares)
 		}
 	}
 
+	store_compact_results(ac->store);
+
 	if (ac->store->first_ref) {
 		/* There is no right place to put references in the sorted
 		   results, so we send them as soon as possible.
@@ -359,7 +468,7 @@ static int paged_results(struct paged_context *ac, struct ldb_reply *ares)
 		paged->cookie = NULL;
 		paged->cookie_len = 0;
 	} else {
-		paged->size = ac->store->num_entries;
+		paged->size = ac->store->total_entries;
 		paged->cookie = talloc_strdup(paged, ac->store->cookie);
 		paged->cookie_len = strlen(paged->cookie) + 1;
 	}
@@ -410,27 +519,26 @@ static int paged_search_callback(struct ldb_request *req,
 
 	switch (ares->type) {
 	case LDB_REPLY_ENTRY:
-		if (store->results == NULL) {
-			store->num_entries = 0;
-			store->result_array_size = 16;
-			store->results = talloc_array(store, struct GUID,
-						     store->result_array_size);
-			if (store->results == NULL) {
-				return ldb_module_done(ac->req, NULL, NULL,
-						     LDB_ERR_OPERATIONS_ERROR);
-			}
-		} else if (store->num_entries == store->result_array_size) {
+		if (store->num_entries == store->result_array_size) {
+			size_t new_size = 16;
+
 			if (store->result_array_size > INT_MAX/2) {
 				return ldb_module_done(ac->req, NULL, NULL,
 						     LDB_ERR_OPERATIONS_ERROR);
 			}
-			store->result_array_size *= 2;
-			store->results = talloc_realloc(store, store->results,
-							struct GUID,
-						store->result_array_size);
-			if (store->results == NULL) {
+			if (store->result_array_size != 0) {
+				new_size = store->result_array_size * 2;
+			}
+			if (!store_resize_results(store, new_size) &&
+			    !store_resize_results(store,
+						  store->num_entries + 1)) {
+				ldb_set_errstring(
+					ldb_module_get_ctx(ac->module),
+					"paged_results: the results of "
+					"this search exceed the space "
+					"allowed for a connection");
 				return ldb_module_done(ac->req, NULL, NULL,
-						     LDB_ERR_OPERATIONS_ERROR);
+						LDB_ERR_ADMIN_LIMIT_EXCEEDED);
 			}
 		}
 
@@ -454,6 +562,7 @@ static int paged_search_callback(struct ldb_request *req,
 
 		store->results[store->num_entries] = guid;
 		store->num_entries++;
+		store->total_entries++;
 		break;
 
 	case LDB_REPLY_REFERRAL:
@@ -464,16 +573,10 @@ static int paged_search_callback(struct ldb_request *req,
 		break;
 
 	case LDB_REPLY_DONE:
-		if (store->num_entries != 0) {
-			store->results = talloc_realloc(store, store->results,
-							struct GUID,
-							store->num_entries);
-			if (store->results == NULL) {
-				return ldb_module_done(ac->req, NULL, NULL,
-						     LDB_ERR_OPERATIONS_ERROR);
-			}
+		if (!store_resize_results(store, store->num_entries)) {
+			return ldb_module_done(ac->req, NULL, NULL,
+					       LDB_ERR_OPERATIONS_ERROR);
 		}
-		store->result_array_size = store->num_entries;
 
 		ac->store->controls = talloc_move(ac->store, &ares->controls);
 		ret = paged_results(ac, ares);
@@ -647,6 +750,8 @@ static int paged_search(struct ldb_module *module, struct ldb_request *req)
 	private_data = talloc_get_type(ldb_module_get_private(module),
 					struct private_data);
 
+	expire_stores(private_data);
+
 	vlv_control = ldb_request_get_control(req, LDB_CONTROL_VLV_REQ_OID);
 	if (vlv_control != NULL) {
 		/*
@@ -791,7 +896,6 @@ static int paged_search(struct ldb_module *module, struct ldb_request *req)
 		char *expr_str;
 		bool bool_ret;
 
-		/* TODO: age out old outstanding requests */
 		for (current = private_data->store; current != NULL;
 		     current = current->next) {
 			if (strcmp(current->cookie, paged_ctrl->cookie) == 0) {
@@ -850,10 +954,13 @@ static int paged_search(struct ldb_module *module, struct ldb_request *req)
 static int paged_request_init(struct ldb_module *module)
 {
 	struct ldb_context *ldb;
+	struct loadparm_context *lp_ctx;
 	struct private_data *data;
 	int ret;
 
 	ldb = ldb_module_get_ctx(module);
+	lp_ctx = talloc_get_type(ldb_get_opaque(ldb, "loadparm"),
+				 struct loadparm_context);
 
 	data = talloc(module, struct private_data);
 	if (data == NULL) {
@@ -863,6 +970,25 @@ static int paged_request_init(struct ldb_module *module)
 	data->next_free_id = 1;
 	data->num_stores = 0;
 	data->store = NULL;
+	data->result_bytes = 0;
+
+	/*
+	 * Like MaxResultSetsPerConn and MaxResultSetSize of the AD
+	 * LDAP policies, and how long a cookie stays valid without
+	 * being used.
+	 */
+	data->max_result_sets = lpcfg_parm_ulong(lp_ctx, NULL, "dsdb",
+						  "paged results max result sets",
+						  PAGED_RESULTS_MAX_RESULT_SETS);
+	data->max_result_bytes = lpcfg_parm_ulong(lp_ctx, NULL, "dsdb",
+						   "paged results max result size",
+						   PAGED_RESULTS_MAX_RESULT_BYTES);
+	data->cookie_lifetime = lpcfg_parm_ulong(lp_ctx, NULL, "dsdb",
+						  "paged results cookie lifetime",
+						  PAGED_RESULTS_COOKIE_LIFETIME);
+	if (data->max_result_sets == 0) {
+		data->max_result_sets = 1;
+	}
 	ldb_module_set_private(module, data);
 
 	ret = ldb_mod_register_control(module, LDB_CONTROL_PAGED_RESULTS_OID);
@@ -51,6 +51,9 @@
 #include "dsdb/samdb/ldb_modules/util.h"
 #include "lib/util/tsort.h"
 #include "lib/util/binsearch.h"
+#include "lib/dbwrap/dbwrap.h"
+#include "lib/dbwrap/dbwrap_rbt.h"
+#include "lib/util/util_tdb.h"
 
 #undef strcasecmp
 
@@ -69,6 +72,9 @@ static const NTTIME DELETED_OBJECT_CONTAINER_CHANGE_TIME = 2650466015990000000UL
 struct replmd_private {
 	TALLOC_CTX *la_ctx;
 	struct la_group *la_list;
+	/* la_list by source object GUID and attribute ID */
+	struct db_context *la_groups;
+	uint32_t num_la_groups;
 	struct nc_entry {
 		struct nc_entry *prev, *next;
 		struct ldb_dn *dn;
@@ -88,10 +94,10 @@ struct replmd_private {
  * groups link attributes together by source-object and attribute-ID,
  * to improve processing efficiency (i.e. for 'member' attribute, which
  * could have 100s or 1000s of links).
- * Note this grouping is best effort - the same source object could still
- * correspond to several la_groups (a lot depends on the order DRS sends
- * the links in). The groups currently don't span replication chunks (which
- * caps the size to ~1500 links by default).
+ * The links of a source object and attribute received in any chunk
+ * of the transaction go into the same group, so a large group
+ * replicated in many chunks (e.g. when joining a domain) is read and
+ * written once.
  */
 struct la_group {
 	struct la_group *next, *prev;
@@ -356,6 +362,8 @@ static void replmd_txn_cleanup(struct replmd_private *replmd_private)
 {
 	talloc_free(replmd_private->la_ctx);
 	replmd_private->la_list = NULL;
+	replmd_private->la_groups = NULL;
+	replmd_private->num_la_groups = 0;
 	replmd_private->la_ctx = NULL;
 	replmd_private->recyclebin_state_known = false;
 }
@@ -6840,6 +6848,78 @@ static bool la_entry_matches_group(struct la_entry *la_entry,
 			   &prev->la->identifier->guid));
 }
 
+struct la_group_key {
+	struct GUID source_guid;
+	uint32_t attid;
+};
+
+static void la_group_parser(TDB_DATA key, TDB_DATA data, void *private_data)
+{
+	struct la_group **la_group = (struct la_group **)private_data;
+	uintptr_t ptr = 0;
+
+	SMB_ASSERT(data.dsize == sizeof(ptr));
+
+	memcpy(&ptr, data.dptr, data.dsize);
+
+	*la_group = talloc_get_type_abort((void *)ptr, struct la_group);
+}
+
+/**
+ * Finds the group of an earlier chunk of this transaction for the
+ * source object and attribute of a link, or adds a new one.
+ */
+static int replmd_get_la_group(struct replmd_private *replmd_private,
+			       struct la_entry *la_entry,
+			       struct la_group **_la_group)
+{
+	struct la_group_key k = {
+		.source_guid = la_entry->la->identifier->guid,
+		.attid = la_entry->la->attid,
+	};
+	TDB_DATA key = make_tdb_data((const void *)&k, sizeof(k));
+	struct la_group *la_group = NULL;
+	uintptr_t ptr;
+	NTSTATUS status;
+
+	if (replmd_private->la_groups == NULL) {
+		replmd_private->la_groups = db_open_rbt(replmd_private->la_ctx);
+		if (replmd_private->la_groups == NULL) {
+			return LDB_ERR_OPERATIONS_ERROR;
+		}
+	}
+
+	status = dbwrap_parse_record(replmd_private->la_groups, key,
+				     la_group_parser, &la_group);
+	if (NT_STATUS_IS_OK(status)) {
+		*_la_group = la_group;
+		return LDB_SUCCESS;
+	}
+	if (!NT_STATUS_EQUAL(status, NT_STATUS_NOT_FOUND)) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	la_group = talloc_zero(replmd_private->la_ctx, struct la_group);
+	if (la_group == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	ptr = (uintptr_t)la_group;
+	status = dbwrap_store(replmd_private->la_groups, key,
+			      make_tdb_data((const void *)&ptr, sizeof(ptr)),
+			      TDB_INSERT);
+	if (!NT_STATUS_IS_OK(status)) {
+		TALLOC_FREE(la_group);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	DLIST_ADD(replmd_private->la_list, la_group);
+	replmd_private->num_la_groups++;
+
+	*_la_group = la_group;
+	return LDB_SUCCESS;
+}
+
 /**
  * Creates a new la_entry to store replication info for a single
  * linked attribute.
@@ -6959,13 +7039,12 @@ static int replmd_store_linked_attributes(struct replmd_replicated_request *ar)
 
 		/* group the links together by source-object for efficiency */
 		if (new_srcobj) {
-			la_group = talloc_zero(replmd_private->la_ctx,
-					       struct la_group);
-			if (la_group == NULL) {
+			ret = replmd_get_la_group(replmd_private, la_entry,
+						  &la_group);
+			if (ret != LDB_SUCCESS) {
 				ldb_oom(ldb);
-				return LDB_ERR_OPERATIONS_ERROR;
+				return ret;
 			}
-			DLIST_ADD(replmd_private->la_list, la_group);
 		}
 		DLIST_ADD(la_group->la_entries, la_entry);
 		replmd_private->total_links++;
@@ -8237,6 +8316,142 @@ static int replmd_check_singleval_la_conflict(struct ldb_module *module,
 	return LDB_SUCCESS;
 }
 
+/*
+ * Links added to a multi-valued attribute while processing an la_group
+ * are not inserted into the sorted values one by one, which moves the
+ * values after them and invalidates the parsed_dn list each time.
+ * They are collected here, with the position they go to in the
+ * unchanged values, and merged into them in a single pass.
+ */
+struct replmd_pending_link {
+	struct ldb_val v;
+	struct GUID guid;
+	unsigned int offset;
+};
+
+struct replmd_pending_links {
+	struct replmd_pending_link *links;
+	unsigned int count;
+	/* the target GUIDs of the links */
+	struct db_context *guids;
+};
+
+static int replmd_pending_link_cmp(const struct replmd_pending_link *l1,
+				   const struct replmd_pending_link *l2)
+{
+	if (l1->offset != l2->offset) {
+		return NUMERIC_CMP(l1->offset, l2->offset);
+	}
+	return GUID_compare(&l1->guid, &l2->guid);
+}
+
+static bool replmd_pending_links_find(struct replmd_pending_links *pending,
+				      const struct GUID *guid)
+{
+	if (pending->count == 0) {
+		return false;
+	}
+	return dbwrap_exists(pending->guids,
+			     make_tdb_data((const void *)guid, sizeof(*guid)));
+}
+
+/*
+ * Returns the value the new link is stored in, NULL if out of memory
+ */
+static struct ldb_val *replmd_pending_links_add(
+	struct replmd_pending_links *pending,
+	TALLOC_CTX *mem_ctx,
+	const struct GUID *guid,
+	unsigned int offset)
+{
+	struct replmd_pending_link *link = NULL;
+	size_t size = talloc_array_length(pending->links);
+	NTSTATUS status;
+
+	if (pending->guids == NULL) {
+		pending->guids = db_open_rbt(mem_ctx);
+		if (pending->guids == NULL) {
+			return NULL;
+		}
+	}
+
+	if (pending->count == size) {
+		struct replmd_pending_link *links = NULL;
+
+		size = MAX(16, size * 2);
+		links = talloc_realloc(mem_ctx, pending->links,
+				       struct replmd_pending_link, size);
+		if (links == NULL) {
+			return NULL;
+		}
+		pending->links = links;
+	}
+
+	status = dbwrap_store(pending->guids,
+			      make_tdb_data((const void *)guid, sizeof(*guid)),
+			      make_tdb_data(NULL, 0),
+			      TDB_INSERT);
+	if (!NT_STATUS_IS_OK(status)) {
+		return NULL;
+	}
+
+	link = &pending->links[pending->count++];
+	*link = (struct replmd_pending_link) {
+		.guid = *guid,
+		.offset = offset,
+	};
+	return &link->v;
+}
+
+/*
+ * Merge the pending links into the element, which stays sorted as they
+ * are sorted by position and, for the same position, by GUID.  This
+ * invalidates any parsed_dn list of the element.
+ */
+static int replmd_pending_links_merge(struct ldb_module *module,
+				      TALLOC_CTX *element_ctx,
+				      struct ldb_message_element *old_el,
+				      struct replmd_pending_links *pending)
+{
+	struct ldb_val *values = NULL;
+	unsigned int i, j, k;
+
+	if (pending->count == 0) {
+		return LDB_SUCCESS;
+	}
+
+	TYPESAFE_QSORT(pending->links, pending->count,
+		       replmd_pending_link_cmp);
+
+	values = talloc_realloc(element_ctx, old_el->values,
+				struct ldb_val,
+				old_el->num_values + pending->count);
+	if (values == NULL) {
+		return ldb_module_oom(module);
+	}
+	old_el->values = values;
+
+	/*
+	 * Merge from the end, so the existing values are moved at most
+	 * once and never overwritten before they are moved.
+	 */
+	i = old_el->num_values;
+	j = pending->count;
+	k = old_el->num_values + pending->count;
+	while (j > 0) {
+		if (pending->links[j - 1].offset == i) {
+			values[--k] = pending->links[--j].v;
+			continue;
+		}
+		values[--k] = values[--i];
+	}
+	old_el->num_values += pending->count;
+
+	pending->count = 0;
+	TALLOC_FREE(pending->guids);
+	return LDB_SUCCESS;
+}
+
 /**
  * Processes one linked attribute received via replication.
  * @param src_dn the DN of the source object for the link
@@ -8246,7 +8461,10 @@ static int replmd_check_singleval_la_conflict(struct ldb_module *module,
  * we need to realloc old_el->values)
  * @param old_el the corresponding msg->element[] for the linked attribute
  * @param pdn_list a (binary-searchable) parsed DN array for the existing link
- * values in the msg. E.g. for a group, this is the existing members.
+ * values in the msg. E.g. for a group, this is the existing members. It is
+ * parsed if NULL and freed when the values are changed by adding a link.
+ * @param pending if not NULL new links are collected here rather than added
+ * to old_el, see replmd_pending_links_merge()
  * @param change what got modified: either nothing, an existing link value was
  * modified, or a new link value was added.
  * @returns LDB_SUCCESS if OK, an error otherwise
@@ -8260,10 +8478,12 @@ static int replmd_process_linked_attribute(struct ldb_module *module,
 					   struct ldb_request *parent,
 					   TALLOC_CTX *element_ctx,
 					   struct ldb_message_element *old_el,
-					   struct parsed_dn *pdn_list,
+					   struct parsed_dn **_pdn_list,
+					   struct replmd_pending_links *pending,
 					   replmd_link_changed *change)
 {
 	struct drsuapi_DsReplicaLinkedAttribute *la = la_entry->la;
+	struct parsed_dn *pdn_list = NULL;
 	struct ldb_context *ldb = ldb_module_get_ctx(module);
 	const struct dsdb_schema *schema = dsdb_get_schema(ldb, mem_ctx);
 	int ret;
@@ -8306,6 +8526,36 @@ static int replmd_process_linked_attribute(struct ldb_module *module,
 		return ret;
 	}
 
+	/*
+	 * A link to this target added earlier in the group is only
+	 * pending, make it a value so it is found and updated below
+	 */
+	if (pending != NULL && replmd_pending_links_find(pending, &guid)) {
+		ret = replmd_pending_links_merge(module, element_ctx,
+						 old_el, pending);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+		TALLOC_FREE(*_pdn_list);
+	}
+
+	/*
+	 * parse the existing links (this can be costly for a large
+	 * group, so we try to minimize the times we do it)
+	 */
+	if (*_pdn_list == NULL) {
+		ret = get_parsed_dns_trusted_fallback(module,
+						      replmd_private,
+						      mem_ctx, old_el,
+						      _pdn_list,
+						      attr->syntax->ldap_oid,
+						      NULL);
+		if (ret != LDB_SUCCESS) {
+			return ret;
+		}
+	}
+	pdn_list = *_pdn_list;
+
 	/* see if this link already exists */
 	ret = parsed_dn_find(ldb, pdn_list, old_el->num_values,
 			     &guid,
@@ -8389,21 +8639,43 @@ static int replmd_process_linked_attribute(struct ldb_module *module,
 			}
 		}
 
-		old_el->values = talloc_realloc(element_ctx, old_el->values,
-						struct ldb_val, old_el->num_values+1);
-		if (!old_el->values) {
-			ldb_module_oom(module);
-			return LDB_ERR_OPERATIONS_ERROR;
-		}
+		if (pending != NULL) {
+			val_to_update = replmd_pending_links_add(pending,
+								 element_ctx,
+								 &guid,
+								 offset);
+			if (val_to_update == NULL) {
+				return ldb_module_oom(module);
+			}
+		} else {
+			old_el->values = talloc_realloc(element_ctx,
+							old_el->values,
+							struct ldb_val,
+							old_el->num_values+1);
+			if (!old_el->values) {
+				ldb_module_oom(module);
+				return LDB_ERR_OPERATIONS_ERROR;
+			}
 
-		if (offset != old_el->num_values) {
-			memmove(&old_el->values[offset + 1], &old_el->values[offset],
-				(old_el->num_values - offset) * sizeof(old_el->values[0]));
-		}
+			if (offset != old_el->num_values) {
+				memmove(&old_el->values[offset + 1],
+					&old_el->values[offset],
+					(old_el->num_values - offset) *
+					sizeof(old_el->values[0]));
+			}
+
+			old_el->num_values++;
 
-		old_el->num_values++;
+			val_to_update = &old_el->values[offset];
 
-		val_to_update = &old_el->values[offset];
+			/*
+			 * Adding a link reallocs memory, and so
+			 * invalidates all the pointers in pdn_list.
+			 * Reparse the PDNs on the next call
+			 */
+			TALLOC_FREE(*_pdn_list);
+			pdn_list = NULL;
+		}
 		old_dsdb_dn = NULL;
 		*change = LINK_CHANGE_ADDED;
 	}
@@ -8510,6 +8782,8 @@ static int replmd_process_la_group(struct ldb_module *module,
 	const struct dsdb_attribute *attr = NULL;
 	struct ldb_message_element *old_el = NULL;
 	struct parsed_dn *pdn_list = NULL;
+	struct replmd_pending_links _pending = {};
+	struct replmd_pending_links *pending = NULL;
 	replmd_link_changed change_type;
 	uint32_t num_changes = 0;
 	time_t t;
@@ -8578,6 +8852,16 @@ static int replmd_process_la_group(struct ldb_module *module,
 		old_el->flags = LDB_FLAG_MOD_REPLACE;
 	}
 
+	/*
+	 * New links of a multi-valued attribute are merged into the
+	 * existing ones at the end.  A single-valued attribute has at
+	 * most a few (inactive) values, and its conflict resolution
+	 * needs to see the links added before.
+	 */
+	if (!(attr->ldb_schema_attribute->flags & LDB_ATTR_FLAG_SINGLE_VALUE)) {
+		pending = &_pending;
+	}
+
 	/*
 	 * go through and process the link target value(s) for this particular
 	 * source object and attribute. For optimization, the same msg is used
@@ -8591,40 +8875,17 @@ static int replmd_process_la_group(struct ldb_module *module,
 		prev = DLIST_PREV(la);
 		DLIST_REMOVE(la_group->la_entries, la);
 
-		/*
-		 * parse the existing links (this can be costly for a large
-		 * group, so we try to minimize the times we do it)
-		 */
-		if (pdn_list == NULL) {
-			ret = get_parsed_dns_trusted_fallback(module,
-							replmd_private,
-							tmp_ctx, old_el,
-							&pdn_list,
-							attr->syntax->ldap_oid,
-							NULL);
-
-			if (ret != LDB_SUCCESS) {
-				return ret;
-			}
-		}
 		ret = replmd_process_linked_attribute(module, tmp_ctx,
 						      replmd_private,
 						      msg->dn, attr, la, NULL,
 						      msg->elements, old_el,
-						      pdn_list, &change_type);
+						      &pdn_list, pending,
+						      &change_type);
 		if (ret != LDB_SUCCESS) {
 			replmd_txn_cleanup(replmd_private);
 			return ret;
 		}
 
-		/*
-		 * Adding a link reallocs memory, and so invalidates all the
-		 * pointers in pdn_list. Reparse the PDNs on the next loop
-		 */
-		if (change_type == LINK_CHANGE_ADDED) {
-			TALLOC_FREE(pdn_list);
-		}
-
 		if (change_type != LINK_CHANGE_NONE) {
 			num_changes++;
 		}
@@ -8645,6 +8906,15 @@ static int replmd_process_la_group(struct ldb_module *module,
 		return LDB_SUCCESS;
 	}
 
+	if (pending != NULL) {
+		ret = replmd_pending_links_merge(module, msg->elements,
+						 old_el, pending);
+		if (ret != LDB_SUCCESS) {
+			TALLOC_FREE(tmp_ctx);
+			return ret;
+		}
+	}
+
 	/*
 	 * Note that adding the whenChanged/etc attributes below will realloc
 	 * msg->elements, invalidating the existing element/parsed-DN pointers
@@ -8698,6 +8968,9 @@ static int replmd_prepare_commit(struct ldb_module *module)
 	struct replmd_private *replmd_private =
 		talloc_get_type(ldb_module_get_private(module), struct replmd_private);
 	struct la_group *la_group, *prev;
+	struct timeval start = timeval_current();
+	uint32_t num_processed = replmd_private->num_processed;
+	uint32_t num_la_groups = replmd_private->num_la_groups;
 	int ret;
 
 	if (replmd_private->la_list != NULL) {
@@ -8728,6 +9001,14 @@ static int replmd_prepare_commit(struct ldb_module *module)
 		}
 	}
 
+	if (num_la_groups != 0) {
+		DBG_NOTICE("Processed %u linked attributes of %u source "
+			   "objects/attributes in %.3f seconds\n",
+			   replmd_private->num_processed - num_processed,
+			   num_la_groups,
+			   timeval_elapsed(&start));
+	}
+
 	replmd_txn_cleanup(replmd_private);
 
 	/* possibly change @REPLCHANGED */
@@ -191,6 +191,7 @@ static int samba_dsdb_init(struct ldb_module *module)
 					     "rootdse",
 					     "dsdb_notification",
 					     "schema_load",
+					     "search_cache",
 					     "lazy_commit",
 					     "dirsync",
 					     "dsdb_paged_results",
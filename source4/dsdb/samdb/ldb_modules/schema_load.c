@@ -34,6 +34,7 @@
 #include "dsdb/samdb/ldb_modules/util.h"
 #include "lib/ldb-samba/ldb_wrap.h"
 #include "lib/util/smb_strtox.h"
+#include "lib/util/dlinklist.h"
 
 #include "system/filesys.h"
 struct schema_load_private_data {
@@ -55,6 +56,20 @@ static int dsdb_schema_from_db(struct ldb_module *module,
 			       TALLOC_CTX *mem_ctx,
 			       uint64_t schema_seq_num,
 			       struct dsdb_schema **schema);
+static int dsdb_schema_update_from_db(struct ldb_module *module,
+				      TALLOC_CTX *mem_ctx,
+				      struct dsdb_schema *old_schema,
+				      uint64_t schema_seq_num,
+				      struct dsdb_schema **schema);
+
+#define DSDB_SCHEMA_LOAD_ATTRS				\
+	DSDB_SCHEMA_COMMON_ATTRS,			\
+	DSDB_SCHEMA_ATTR_ATTRS,				\
+	DSDB_SCHEMA_CLASS_ATTRS,			\
+	"prefixMap",					\
+	"schemaInfo",					\
+	"fSMORoleOwner",				\
+	"uSNChanged"
 
 /*
  * Open sam.ldb.d/metadata.tdb.
@@ -269,7 +284,24 @@ static struct dsdb_schema *dsdb_schema_refresh(struct ldb_module *module, struct
 			  (unsigned long long)schema_seq_num));
 	}
 
-	ret = dsdb_schema_from_db(module, mem_ctx, schema_seq_num, &new_schema);
+	new_schema = NULL;
+	if (schema != NULL) {
+		ret = dsdb_schema_update_from_db(module, mem_ctx, schema,
+						 schema_seq_num, &new_schema);
+		if (ret != LDB_SUCCESS) {
+			DBG_NOTICE("Incremental schema reload failed, "
+				   "doing a full one: %d:%s: %s\n",
+				   ret, ldb_strerror(ret),
+				   ldb_errstring(ldb));
+			new_schema = NULL;
+		}
+	}
+	if (new_schema == NULL) {
+		ret = dsdb_schema_from_db(module, mem_ctx, schema_seq_num,
+					  &new_schema);
+	} else {
+		ret = LDB_SUCCESS;
+	}
 	if (ret != LDB_SUCCESS) {
 		ldb_debug_set(ldb, LDB_DEBUG_FATAL,
 			      "dsdb_schema_from_db() failed: %d:%s: %s",
@@ -311,15 +343,11 @@ static int dsdb_schema_from_db(struct ldb_module *module,
 	struct ldb_result *res;
 	struct ldb_message *schema_msg = NULL;
 	static const char *schema_attrs[] = {
-		DSDB_SCHEMA_COMMON_ATTRS,
-		DSDB_SCHEMA_ATTR_ATTRS,
-		DSDB_SCHEMA_CLASS_ATTRS,
-		"prefixMap",
-		"schemaInfo",
-		"fSMORoleOwner",
+		DSDB_SCHEMA_LOAD_ATTRS,
 		NULL
 	};
 	unsigned flags;
+	uint64_t loaded_usn = 0;
 
 	tmp_ctx = talloc_new(module);
 	if (!tmp_ctx) {
@@ -357,9 +385,12 @@ static int dsdb_schema_from_db(struct ldb_module *module,
 	 * class objects.
 	 */
 	for (i = 0; i < res->count; i++) {
-		if (ldb_msg_find_element(res->msgs[i], "prefixMap")) {
+		uint64_t usn = ldb_msg_find_attr_as_uint64(res->msgs[i],
+							   "uSNChanged", 0);
+		loaded_usn = MAX(loaded_usn, usn);
+		if (schema_msg == NULL &&
+		    ldb_msg_find_element(res->msgs[i], "prefixMap")) {
 			schema_msg = res->msgs[i];
-			break;
 		}
 	}
 
@@ -380,6 +411,7 @@ static int dsdb_schema_from_db(struct ldb_module *module,
 	}
 
 	(*schema)->metadata_usn = schema_seq_num;
+	(*schema)->loaded_usn = loaded_usn;
 
 	talloc_steal(mem_ctx, *schema);
 
@@ -392,6 +424,301 @@ failed:
 	return ret;
 }	
 
+/*
+ * The attids of the loaded definitions were made with the old
+ * prefixMap, they stay valid as long as the new one only appends
+ * prefixes to it.
+ */
+static bool schema_prefixmap_extends(const struct dsdb_schema_prefixmap *old_pfm,
+				     const struct dsdb_schema_prefixmap *new_pfm)
+{
+	uint32_t i;
+
+	if (new_pfm->length < old_pfm->length) {
+		return false;
+	}
+
+	for (i = 0; i < old_pfm->length; i++) {
+		const struct dsdb_schema_prefixmap_oid *o = &old_pfm->prefixes[i];
+		const struct dsdb_schema_prefixmap_oid *n = &new_pfm->prefixes[i];
+
+		if (o->id != n->id) {
+			return false;
+		}
+		if (data_blob_cmp(&o->bin_oid, &n->bin_oid) != 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+/*
+ * Remove the definition of the schema object with this objectGUID,
+ * it is about to be replaced by a new version.
+ */
+static bool schema_remove_by_guid(struct dsdb_schema *schema,
+				  const struct GUID *guid)
+{
+	struct dsdb_attribute *a = NULL;
+	struct dsdb_class *c = NULL;
+
+	for (a = schema->attributes; a != NULL; a = a->next) {
+		if (GUID_equal(&a->objectGUID, guid)) {
+			DLIST_REMOVE(schema->attributes, a);
+			TALLOC_FREE(a);
+			return true;
+		}
+	}
+
+	for (c = schema->classes; c != NULL; c = c->next) {
+		if (GUID_equal(&c->objectGUID, guid)) {
+			DLIST_REMOVE(schema->classes, c);
+			TALLOC_FREE(c);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/*
+  Build a new schema from the one we have, by only parsing the schema
+  objects changed since it was loaded.
+
+  *schema is left NULL if this can't be done (the in-memory schema was
+  not loaded from this database, too many objects changed, objects
+  were removed or the prefixMap was rewritten), the caller then does
+  a full load.
+*/
+static int dsdb_schema_update_from_db(struct ldb_module *module,
+				      TALLOC_CTX *mem_ctx,
+				      struct dsdb_schema *old_schema,
+				      uint64_t schema_seq_num,
+				      struct dsdb_schema **schema)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct loadparm_context *lp_ctx = NULL;
+	TALLOC_CTX *tmp_ctx = NULL;
+	char *error_string = NULL;
+	int ret;
+	unsigned int i;
+	struct ldb_dn *schema_dn = ldb_get_schema_basedn(ldb);
+	struct ldb_result *res = NULL;
+	struct ldb_result *unchanged_res = NULL;
+	struct ldb_message *schema_msg = NULL;
+	struct dsdb_schema *new_schema = NULL;
+	const struct ldb_val *prefix_val = NULL;
+	const struct ldb_val *info_val = NULL;
+	struct ldb_val info_val_default;
+	static const char *schema_attrs[] = {
+		DSDB_SCHEMA_LOAD_ATTRS,
+		NULL
+	};
+	static const char *no_attrs[] = { NULL };
+	unsigned int old_count;
+	unsigned int num_changed;
+	unsigned int num_replaced = 0;
+	uint64_t loaded_usn;
+	int max_depth;
+	unsigned flags;
+	WERROR status;
+
+	*schema = NULL;
+
+	lp_ctx = talloc_get_type_abort(ldb_get_opaque(ldb, "loadparm"),
+				       struct loadparm_context);
+	max_depth = lpcfg_parm_int(lp_ctx, NULL, "dsdb",
+				   "schema incremental reloads", 8);
+
+	if (max_depth <= 0 ||
+	    old_schema->loaded_usn == 0 ||
+	    old_schema->incremental_depth >= (uint32_t)max_depth) {
+		return LDB_SUCCESS;
+	}
+	loaded_usn = old_schema->loaded_usn;
+
+	tmp_ctx = talloc_new(module);
+	if (tmp_ctx == NULL) {
+		return ldb_oom(ldb);
+	}
+
+	/* we don't want to trace the schema load */
+	flags = ldb_get_flags(ldb);
+	ldb_set_flags(ldb, flags & ~LDB_FLG_ENABLE_TRACING);
+
+	/*
+	 * Both searches have to see the same database, so that the
+	 * objects counted as unchanged and the changed ones add up.
+	 */
+	ret = ldb_next_read_lock(module);
+	if (ret != LDB_SUCCESS) {
+		goto failed;
+	}
+
+	ret = dsdb_module_search(module, tmp_ctx, &res,
+				 schema_dn, LDB_SCOPE_SUBTREE,
+				 schema_attrs,
+				 DSDB_FLAG_NEXT_MODULE |
+				 DSDB_SEARCH_SHOW_DN_IN_STORAGE_FORMAT,
+				 NULL,
+				 "(|(objectClass=dMD)"
+				 "(&(|(objectClass=attributeSchema)"
+				 "(objectClass=classSchema))"
+				 "(uSNChanged>=%llu)))",
+				 (unsigned long long)(loaded_usn + 1));
+	if (ret == LDB_SUCCESS) {
+		ret = dsdb_module_search(module, tmp_ctx, &unchanged_res,
+					 schema_dn, LDB_SCOPE_SUBTREE,
+					 no_attrs,
+					 DSDB_FLAG_NEXT_MODULE,
+					 NULL,
+					 "(&(|(objectClass=attributeSchema)"
+					 "(objectClass=classSchema))"
+					 "(uSNChanged<=%llu))",
+					 (unsigned long long)loaded_usn);
+	}
+
+	ldb_next_read_unlock(module);
+
+	if (ret != LDB_SUCCESS) {
+		goto failed;
+	}
+
+	for (i = 0; i < res->count; i++) {
+		if (ldb_msg_find_element(res->msgs[i], "prefixMap")) {
+			schema_msg = res->msgs[i];
+			break;
+		}
+	}
+	if (schema_msg == NULL) {
+		ldb_asprintf_errstring(ldb,
+				       "dsdb_schema load failed: failed to find prefixMap");
+		ret = LDB_ERR_NO_SUCH_ATTRIBUTE;
+		goto failed;
+	}
+
+	/*
+	 * With many changes (a schema upgrade) parsing everything
+	 * again is as cheap and gives a schema not depending on the
+	 * old one.
+	 */
+	old_count = old_schema->num_attributes + old_schema->num_classes;
+	num_changed = res->count - 1;
+	if (num_changed > old_count / 4) {
+		goto done;
+	}
+
+	new_schema = dsdb_schema_copy_shallow(tmp_ctx, ldb, old_schema);
+	if (new_schema == NULL) {
+		ret = ldb_oom(ldb);
+		goto failed;
+	}
+
+	for (i = 0; i < res->count; i++) {
+		struct GUID guid;
+
+		if (res->msgs[i] == schema_msg) {
+			continue;
+		}
+
+		loaded_usn = MAX(loaded_usn,
+				 ldb_msg_find_attr_as_uint64(res->msgs[i],
+							     "uSNChanged", 0));
+
+		guid = samdb_result_guid(res->msgs[i], "objectGUID");
+		if (schema_remove_by_guid(new_schema, &guid)) {
+			num_replaced++;
+		}
+	}
+
+	if (unchanged_res->count + num_replaced != old_count) {
+		/* schema objects were deleted */
+		DBG_INFO("Schema objects were removed, doing a full reload\n");
+		TALLOC_FREE(new_schema);
+		goto done;
+	}
+
+	prefix_val = ldb_msg_find_ldb_val(schema_msg, "prefixMap");
+	info_val = ldb_msg_find_ldb_val(schema_msg, "schemaInfo");
+	if (info_val == NULL) {
+		status = dsdb_schema_info_blob_new(tmp_ctx, &info_val_default);
+		if (!W_ERROR_IS_OK(status)) {
+			ret = ldb_operr(ldb);
+			goto failed;
+		}
+		info_val = &info_val_default;
+	}
+
+	status = dsdb_load_oid_mappings_ldb(new_schema, prefix_val, info_val);
+	if (!W_ERROR_IS_OK(status)) {
+		ldb_asprintf_errstring(ldb,
+				       "dsdb_schema load failed: failed to load oid mappings: %s",
+				       win_errstr(status));
+		ret = LDB_ERR_CONSTRAINT_VIOLATION;
+		goto failed;
+	}
+
+	if (!schema_prefixmap_extends(old_schema->prefixmap,
+				      new_schema->prefixmap)) {
+		DBG_INFO("The prefixMap was rewritten, doing a full reload\n");
+		TALLOC_FREE(new_schema);
+		goto done;
+	}
+
+	new_schema->ts_last_change = old_schema->ts_last_change;
+	ret = dsdb_load_ldb_results_into_schema(tmp_ctx, ldb, new_schema,
+						res, &error_string);
+	if (ret != LDB_SUCCESS) {
+		ldb_asprintf_errstring(ldb,
+				       "dsdb_schema load failed: %s",
+				       error_string);
+		goto failed;
+	}
+
+	new_schema->fsmo.update_allowed = lpcfg_parm_bool(lp_ctx, NULL,
+							  "dsdb", "schema update allowed",
+							  false);
+	new_schema->fsmo.master_dn = ldb_msg_find_attr_as_dn(ldb, new_schema,
+							     schema_msg,
+							     "fSMORoleOwner");
+	if (ldb_dn_compare(samdb_ntds_settings_dn(ldb, tmp_ctx),
+			   new_schema->fsmo.master_dn) == 0) {
+		new_schema->fsmo.we_are_master = true;
+	} else {
+		new_schema->fsmo.we_are_master = false;
+	}
+
+	/*
+	 * The unchanged definitions were copied shallow, their
+	 * strings and arrays still belong to the old schema.
+	 */
+	if (talloc_reference(new_schema, old_schema) == NULL) {
+		ret = ldb_oom(ldb);
+		goto failed;
+	}
+
+	new_schema->metadata_usn = schema_seq_num;
+	new_schema->loaded_usn = loaded_usn;
+	new_schema->incremental_depth = old_schema->incremental_depth + 1;
+
+	DBG_NOTICE("Schema reloaded incrementally: %u changed objects, "
+		   "%u of them new\n",
+		   num_changed, num_changed - num_replaced);
+
+	*schema = talloc_steal(mem_ctx, new_schema);
+
+done:
+	ret = LDB_SUCCESS;
+failed:
+	if (flags & LDB_FLG_ENABLE_TRACING) {
+		flags = ldb_get_flags(ldb);
+		ldb_set_flags(ldb, flags | LDB_FLG_ENABLE_TRACING);
+	}
+	talloc_free(tmp_ctx);
+	return ret;
+}
+
 static int schema_load(struct ldb_context *ldb,
 		       struct ldb_module *module,
 		       bool *need_write)
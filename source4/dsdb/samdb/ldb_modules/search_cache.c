@@ -0,0 +1,632 @@
+/*
+   ldb database library
+
+   Copyright (C) Samba Team 2026
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/*
+ *  Name: ldb
+ *
+ *  Component: ldb search result cache module
+ *
+ *  Description: Clients like sssd and winbindd repeat the same searches
+ *  many times a minute. With "dsdb:search cache = yes" the results of
+ *  searches without controls are kept in a process wide cache, keyed on
+ *  the database, base, scope, filter, attributes and the security token
+ *  of the caller, so a repeated search skips the index, the filter and
+ *  the ACL evaluation below this module.
+ *
+ *  An entry is only valid for the sequence number of the database it
+ *  was filled at (see partition_metadata_sequence_number()), and for at
+ *  most "dsdb:search cache lifetime" seconds, as some values depend on
+ *  the time. Constructed attributes are never cached, and the cache is
+ *  flushed after every transaction committed through a sam.ldb of this
+ *  process.
+ */
+
+#include "includes.h"
+#include <ldb_module.h>
+#include "dsdb/samdb/samdb.h"
+#include "dsdb/samdb/ldb_modules/util.h"
+#include "auth/auth.h"
+#include "param/param.h"
+#include "librpc/gen_ndr/ndr_security.h"
+#include "lib/util/dlinklist.h"
+
+#define SEARCH_CACHE_DEFAULT_ENTRIES 128
+#define SEARCH_CACHE_DEFAULT_RESULTS 256
+#define SEARCH_CACHE_DEFAULT_LIFETIME 30
+
+struct search_cache_entry {
+	struct search_cache_entry *prev, *next;
+	uint32_t hash;
+	DATA_BLOB key;
+	const char *url;
+	uint64_t seq_num;
+	time_t created;
+	unsigned int num_msgs;
+	struct ldb_message **msgs;
+	const char **dns;
+};
+
+struct search_cache {
+	struct search_cache_entry *entries;
+	unsigned int num_entries;
+};
+
+/*
+ * LDAP connections each have their own sam.ldb, the cache is
+ * shared by all of them.
+ */
+static struct search_cache *search_cache_global;
+
+struct search_cache_private {
+	bool enabled;
+	bool in_transaction;
+	unsigned int max_entries;
+	unsigned int max_results;
+	time_t lifetime;
+};
+
+struct search_cache_context {
+	struct ldb_module *module;
+	struct ldb_request *req;
+	DATA_BLOB key;
+	uint32_t hash;
+	uint64_t seq_num;
+	bool collect;
+	unsigned int num_msgs;
+	struct ldb_message **msgs;
+	const char **dns;
+};
+
+static uint32_t search_cache_hash(const DATA_BLOB *key)
+{
+	uint32_t h = 2166136261U;
+	size_t i;
+
+	for (i = 0; i < key->length; i++) {
+		h = (h ^ key->data[i]) * 16777619U;
+	}
+	return h;
+}
+
+static void search_cache_remove(struct search_cache_entry *e)
+{
+	DLIST_REMOVE(search_cache_global->entries, e);
+	search_cache_global->num_entries -= 1;
+	TALLOC_FREE(e);
+}
+
+/*
+  drop all entries of the database behind this ldb
+*/
+static void search_cache_flush(struct ldb_context *ldb)
+{
+	const char *url = ldb_get_opaque(ldb, "ldb_url");
+	struct search_cache_entry *e = NULL, *next = NULL;
+
+	if (search_cache_global == NULL) {
+		return;
+	}
+
+	for (e = search_cache_global->entries; e != NULL; e = next) {
+		next = e->next;
+		if (url == NULL || strcmp(e->url, url) == 0) {
+			search_cache_remove(e);
+		}
+	}
+}
+
+static bool search_cache_attr_cacheable(const struct dsdb_schema *schema,
+					const char *name)
+{
+	const struct dsdb_attribute *attr = NULL;
+
+	attr = dsdb_attribute_by_lDAPDisplayName(schema, name);
+	if (attr == NULL) {
+		return true;
+	}
+	return (attr->systemFlags & DS_FLAG_ATTR_IS_CONSTRUCTED) == 0;
+}
+
+static bool search_cache_tree_cacheable(const struct dsdb_schema *schema,
+					const struct ldb_parse_tree *tree)
+{
+	const char *attr = NULL;
+	unsigned int i;
+
+	switch (tree->operation) {
+	case LDB_OP_AND:
+	case LDB_OP_OR:
+		for (i = 0; i < tree->u.list.num_elements; i++) {
+			if (!search_cache_tree_cacheable(
+				    schema, tree->u.list.elements[i])) {
+				return false;
+			}
+		}
+		return true;
+	case LDB_OP_NOT:
+		return search_cache_tree_cacheable(schema, tree->u.isnot.child);
+	default:
+		break;
+	}
+
+	attr = ldb_parse_tree_get_attr(tree);
+	if (attr == NULL) {
+		return true;
+	}
+	return search_cache_attr_cacheable(schema, attr);
+}
+
+/*
+  build the key of a search, returns false if the search must not be
+  cached
+*/
+static bool search_cache_make_key(struct ldb_module *module,
+				  struct ldb_request *req,
+				  TALLOC_CTX *mem_ctx,
+				  DATA_BLOB *key)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	const char *url = ldb_get_opaque(ldb, "ldb_url");
+	struct auth_session_info *session_info = NULL;
+	const struct dsdb_encrypted_connection_state *conn_state = NULL;
+	const struct dsdb_schema *schema = NULL;
+	const char * const *attrs = req->op.search.attrs;
+	const char *base = NULL;
+	char *filter = NULL;
+	char *s = NULL;
+	DATA_BLOB token_blob = data_blob_null;
+	bool no_gc = false;
+	unsigned int i;
+
+	if (url == NULL ||
+	    req->op.search.base == NULL ||
+	    ldb_dn_is_null(req->op.search.base) ||
+	    ldb_dn_is_special(req->op.search.base) ||
+	    req->op.search.tree == NULL) {
+		/* the rootDSE has the current time */
+		return false;
+	}
+
+	for (i = 0; req->controls != NULL && req->controls[i] != NULL; i++) {
+		struct ldb_control *c = req->controls[i];
+
+		if (c->oid != NULL &&
+		    strcmp(c->oid, DSDB_CONTROL_NO_GLOBAL_CATALOG) == 0 &&
+		    c->data == NULL) {
+			no_gc = true;
+			continue;
+		}
+		return false;
+	}
+
+	schema = dsdb_get_schema(ldb, NULL);
+	if (schema == NULL) {
+		return false;
+	}
+	for (i = 0; attrs != NULL && attrs[i] != NULL; i++) {
+		if (!search_cache_attr_cacheable(schema, attrs[i])) {
+			return false;
+		}
+	}
+	if (!search_cache_tree_cacheable(schema, req->op.search.tree)) {
+		return false;
+	}
+
+	base = ldb_dn_get_casefold(req->op.search.base);
+	filter = ldb_filter_from_tree(mem_ctx, req->op.search.tree);
+	if (base == NULL || filter == NULL) {
+		return false;
+	}
+
+	conn_state = ldb_get_opaque(
+		ldb, DSDB_OPAQUE_ENCRYPTED_CONNECTION_STATE_NAME);
+
+	s = talloc_asprintf(mem_ctx,
+			    "%s%c%s%c%d%c%s%c%d%d%d%c",
+			    url, '\0',
+			    base, '\0',
+			    (int)req->op.search.scope, '\0',
+			    filter, '\0',
+			    ldb_req_is_untrusted(req) ? 1 : 0,
+			    no_gc ? 1 : 0,
+			    (conn_state != NULL &&
+			     conn_state->using_encrypted_connection) ? 1 : 0,
+			    '\0');
+	if (s == NULL) {
+		return false;
+	}
+	*key = data_blob_talloc(mem_ctx, s, talloc_get_size(s) - 1);
+	TALLOC_FREE(s);
+	if (key->data == NULL) {
+		return false;
+	}
+
+	for (i = 0; attrs != NULL && attrs[i] != NULL; i++) {
+		if (!data_blob_append(mem_ctx, key,
+				      attrs[i], strlen(attrs[i]) + 1)) {
+			return false;
+		}
+	}
+	if (attrs == NULL &&
+	    !data_blob_append(mem_ctx, key, "\0", 2)) {
+		return false;
+	}
+
+	session_info = ldb_get_opaque(ldb, DSDB_SESSION_INFO);
+	if (session_info != NULL && session_info->security_token != NULL) {
+		enum ndr_err_code ndr_err;
+
+		ndr_err = ndr_push_struct_blob(
+			&token_blob, mem_ctx, session_info->security_token,
+			(ndr_push_flags_fn_t)ndr_push_security_token);
+		if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err)) {
+			return false;
+		}
+		if (!data_blob_append(mem_ctx, key,
+				      token_blob.data, token_blob.length)) {
+			return false;
+		}
+		data_blob_free(&token_blob);
+	}
+
+	return true;
+}
+
+static struct search_cache_entry *search_cache_lookup(const DATA_BLOB *key,
+						       uint32_t hash)
+{
+	struct search_cache_entry *e = NULL;
+
+	if (search_cache_global == NULL) {
+		return NULL;
+	}
+
+	for (e = search_cache_global->entries; e != NULL; e = e->next) {
+		if (e->hash == hash && data_blob_cmp(&e->key, key) == 0) {
+			return e;
+		}
+	}
+	return NULL;
+}
+
+static int search_cache_replay(struct ldb_module *module,
+			       struct ldb_request *req,
+			       struct search_cache_entry *e)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < e->num_msgs; i++) {
+		struct ldb_message *msg = NULL;
+
+		msg = ldb_msg_copy(req, e->msgs[i]);
+		if (msg == NULL) {
+			return ldb_module_oom(module);
+		}
+		msg->dn = ldb_dn_new(msg, ldb, e->dns[i]);
+		if (msg->dn == NULL) {
+			TALLOC_FREE(msg);
+			return ldb_module_oom(module);
+		}
+		ret = ldb_module_send_entry(req, msg, NULL);
+		if (ret != LDB_SUCCESS) {
+			/* the callback has called ldb_module_done() */
+			return ret;
+		}
+	}
+
+	return ldb_module_done(req, NULL, NULL, LDB_SUCCESS);
+}
+
+static void search_cache_store(struct search_cache_context *ac)
+{
+	struct search_cache_private *p =
+		talloc_get_type_abort(ldb_module_get_private(ac->module),
+				      struct search_cache_private);
+	struct ldb_context *ldb = ldb_module_get_ctx(ac->module);
+	struct search_cache_entry *e = NULL;
+
+	if (search_cache_global == NULL) {
+		search_cache_global = talloc_zero(NULL, struct search_cache);
+		if (search_cache_global == NULL) {
+			return;
+		}
+	}
+
+	e = search_cache_lookup(&ac->key, ac->hash);
+	if (e != NULL) {
+		search_cache_remove(e);
+	}
+
+	while (search_cache_global->num_entries >= p->max_entries &&
+	       search_cache_global->entries != NULL) {
+		search_cache_remove(
+			DLIST_TAIL(search_cache_global->entries));
+	}
+
+	e = talloc_zero(search_cache_global, struct search_cache_entry);
+	if (e == NULL) {
+		return;
+	}
+	e->url = talloc_strdup(e, ldb_get_opaque(ldb, "ldb_url"));
+	if (e->url == NULL) {
+		TALLOC_FREE(e);
+		return;
+	}
+	e->key = data_blob_talloc(e, ac->key.data, ac->key.length);
+	if (e->key.data == NULL) {
+		TALLOC_FREE(e);
+		return;
+	}
+	e->hash = ac->hash;
+	e->seq_num = ac->seq_num;
+	e->created = time(NULL);
+	e->num_msgs = ac->num_msgs;
+	e->msgs = talloc_move(e, &ac->msgs);
+	e->dns = talloc_move(e, &ac->dns);
+
+	DLIST_ADD(search_cache_global->entries, e);
+	search_cache_global->num_entries += 1;
+}
+
+static int search_cache_collect(struct search_cache_context *ac,
+				const struct ldb_message *msg)
+{
+	struct search_cache_private *p =
+		talloc_get_type_abort(ldb_module_get_private(ac->module),
+				      struct search_cache_private);
+	struct ldb_message *copy = NULL;
+	const char *dn = NULL;
+
+	if (ac->num_msgs >= p->max_results) {
+		return LDB_ERR_ADMIN_LIMIT_EXCEEDED;
+	}
+
+	ac->msgs = talloc_realloc(ac, ac->msgs, struct ldb_message *,
+				  ac->num_msgs + 1);
+	ac->dns = talloc_realloc(ac, ac->dns, const char *,
+				 ac->num_msgs + 1);
+	if (ac->msgs == NULL || ac->dns == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+
+	/*
+	 * The cache outlives this ldb, so keep the DN as a string
+	 */
+	dn = ldb_dn_get_linearized(msg->dn);
+	if (dn == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	copy = ldb_msg_copy(ac->msgs, msg);
+	if (copy == NULL) {
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	TALLOC_FREE(copy->dn);
+	ac->dns[ac->num_msgs] = talloc_strdup(ac->dns, dn);
+	if (ac->dns[ac->num_msgs] == NULL) {
+		TALLOC_FREE(copy);
+		return LDB_ERR_OPERATIONS_ERROR;
+	}
+	ac->msgs[ac->num_msgs] = copy;
+	ac->num_msgs += 1;
+
+	return LDB_SUCCESS;
+}
+
+static int search_cache_callback(struct ldb_request *req,
+				 struct ldb_reply *ares)
+{
+	struct search_cache_context *ac =
+		talloc_get_type_abort(req->context,
+				      struct search_cache_context);
+	int ret;
+
+	if (!ares) {
+		return ldb_module_done(ac->req, NULL, NULL,
+				       LDB_ERR_OPERATIONS_ERROR);
+	}
+	if (ares->error != LDB_SUCCESS) {
+		return ldb_module_done(ac->req, ares->controls,
+				       ares->response, ares->error);
+	}
+
+	switch (ares->type) {
+	case LDB_REPLY_ENTRY:
+		if (ac->collect && ares->controls == NULL) {
+			ret = search_cache_collect(ac, ares->message);
+			if (ret != LDB_SUCCESS) {
+				ac->collect = false;
+			}
+		} else {
+			ac->collect = false;
+		}
+		return ldb_module_send_entry(ac->req, ares->message,
+					     ares->controls);
+
+	case LDB_REPLY_REFERRAL:
+		ac->collect = false;
+		return ldb_module_send_referral(ac->req, ares->referral);
+
+	case LDB_REPLY_DONE:
+		if (ac->collect && ares->controls == NULL) {
+			search_cache_store(ac);
+		}
+		return ldb_module_done(ac->req, ares->controls,
+				       ares->response, LDB_SUCCESS);
+	}
+
+	return LDB_SUCCESS;
+}
+
+static int search_cache_search(struct ldb_module *module,
+			       struct ldb_request *req)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct search_cache_private *p =
+		talloc_get_type_abort(ldb_module_get_private(module),
+				      struct search_cache_private);
+	struct search_cache_context *ac = NULL;
+	struct search_cache_entry *e = NULL;
+	struct ldb_request *down_req = NULL;
+	int ret;
+
+	/*
+	 * Within a transaction the results may depend on changes that
+	 * are not committed yet.
+	 */
+	if (!p->enabled || p->in_transaction) {
+		return ldb_next_request(module, req);
+	}
+
+	ac = talloc_zero(req, struct search_cache_context);
+	if (ac == NULL) {
+		return ldb_module_oom(module);
+	}
+	ac->module = module;
+	ac->req = req;
+
+	if (!search_cache_make_key(module, req, ac, &ac->key)) {
+		TALLOC_FREE(ac);
+		return ldb_next_request(module, req);
+	}
+	ac->hash = search_cache_hash(&ac->key);
+
+	ret = ldb_sequence_number(ldb, LDB_SEQ_HIGHEST_SEQ, &ac->seq_num);
+	if (ret != LDB_SUCCESS) {
+		TALLOC_FREE(ac);
+		return ldb_next_request(module, req);
+	}
+
+	e = search_cache_lookup(&ac->key, ac->hash);
+	if (e != NULL) {
+		if (e->seq_num == ac->seq_num &&
+		    time(NULL) - e->created <= p->lifetime) {
+			DLIST_PROMOTE(search_cache_global->entries, e);
+			TALLOC_FREE(ac);
+			return search_cache_replay(module, req, e);
+		}
+		search_cache_remove(e);
+	}
+
+	ac->collect = true;
+
+	ret = ldb_build_search_req_ex(&down_req, ldb, ac,
+				      req->op.search.base,
+				      req->op.search.scope,
+				      req->op.search.tree,
+				      req->op.search.attrs,
+				      req->controls,
+				      ac, search_cache_callback,
+				      req);
+	LDB_REQ_SET_LOCATION(down_req);
+	if (ret != LDB_SUCCESS) {
+		return ret;
+	}
+
+	return ldb_next_request(module, down_req);
+}
+
+static int search_cache_start_transaction(struct ldb_module *module)
+{
+	struct search_cache_private *p =
+		talloc_get_type_abort(ldb_module_get_private(module),
+				      struct search_cache_private);
+
+	int ret;
+
+	ret = ldb_next_start_trans(module);
+	if (ret == LDB_SUCCESS) {
+		p->in_transaction = true;
+	}
+	return ret;
+}
+
+static int search_cache_end_transaction(struct ldb_module *module)
+{
+	struct search_cache_private *p =
+		talloc_get_type_abort(ldb_module_get_private(module),
+				      struct search_cache_private);
+
+	p->in_transaction = false;
+	/*
+	 * Not every change moves the sequence number, so don't trust
+	 * it for what has just been written
+	 */
+	search_cache_flush(ldb_module_get_ctx(module));
+	return ldb_next_end_trans(module);
+}
+
+static int search_cache_del_transaction(struct ldb_module *module)
+{
+	struct search_cache_private *p =
+		talloc_get_type_abort(ldb_module_get_private(module),
+				      struct search_cache_private);
+
+	p->in_transaction = false;
+	return ldb_next_del_trans(module);
+}
+
+static int search_cache_init(struct ldb_module *module)
+{
+	struct ldb_context *ldb = ldb_module_get_ctx(module);
+	struct loadparm_context *lp_ctx =
+		talloc_get_type(ldb_get_opaque(ldb, "loadparm"),
+				struct loadparm_context);
+	struct search_cache_private *p = NULL;
+
+	p = talloc_zero(module, struct search_cache_private);
+	if (p == NULL) {
+		return ldb_module_oom(module);
+	}
+
+	p->enabled = lpcfg_parm_bool(lp_ctx, NULL,
+				     "dsdb", "search cache", false);
+	p->max_entries = lpcfg_parm_int(lp_ctx, NULL,
+					"dsdb", "search cache entries",
+					SEARCH_CACHE_DEFAULT_ENTRIES);
+	p->max_results = lpcfg_parm_int(lp_ctx, NULL,
+					"dsdb", "search cache max results",
+					SEARCH_CACHE_DEFAULT_RESULTS);
+	p->lifetime = lpcfg_parm_int(lp_ctx, NULL,
+				     "dsdb", "search cache lifetime",
+				     SEARCH_CACHE_DEFAULT_LIFETIME);
+	if (p->max_entries == 0 || p->max_results == 0) {
+		p->enabled = false;
+	}
+
+	ldb_module_set_private(module, p);
+
+	return ldb_next_init(module);
+}
+
+static const struct ldb_module_ops ldb_search_cache_module_ops = {
+	.name		   = "search_cache",
+	.search		   = search_cache_search,
+	.start_transaction = search_cache_start_transaction,
+	.end_transaction   = search_cache_end_transaction,
+	.del_transaction   = search_cache_del_transaction,
+	.init_context	   = search_cache_init,
+};
+
+int ldb_search_cache_module_init(const char *version)
+{
+	LDB_MODULE_CHECK_VERSION(version);
+	return ldb_register_module(&ldb_search_cache_module_ops);
+}
@@ -61,6 +61,9 @@ int samdb_connect_url(TALLOC_CTX *mem_ctx,
 		      char **errstring)
 {
 	struct ldb_context *ldb = NULL;
+	struct timespec start_time;
+	struct timespec init_time;
+	struct timespec connect_time;
 	int ret;
 	*ldb_ret = NULL;
 	*errstring = NULL;
@@ -80,6 +83,8 @@ int samdb_connect_url(TALLOC_CTX *mem_ctx,
 		}
 	}
 
+	clock_gettime_mono(&start_time);
+
 	ldb = samba_ldb_init(mem_ctx, ev_ctx, lp_ctx, session_info, NULL);
 
 	if (ldb == NULL) {
@@ -93,6 +98,8 @@ int samdb_connect_url(TALLOC_CTX *mem_ctx,
 
 	dsdb_set_global_schema(ldb);
 
+	clock_gettime_mono(&init_time);
+
 	ret = samba_ldb_connect(ldb, lp_ctx, url, flags);
 	if (ret != LDB_SUCCESS) {
 		*errstring = talloc_asprintf(mem_ctx,
@@ -103,6 +110,19 @@ int samdb_connect_url(TALLOC_CTX *mem_ctx,
 		return LDB_ERR_OPERATIONS_ERROR;
 	}
 
+	clock_gettime_mono(&connect_time);
+
+	/*
+	 * The connect covers loading the module stack, the
+	 * @ATTRIBUTES/@INDEXLIST of each partition and, unless
+	 * inherited, the schema
+	 */
+	DBG_INFO("Opened %s in %.3f seconds: init %.3f, connect %.3f\n",
+		 url,
+		 timespec_elapsed2(&start_time, &connect_time),
+		 timespec_elapsed2(&start_time, &init_time),
+		 timespec_elapsed2(&init_time, &connect_time));
+
 	/*
 	 * If a remote_address was specified, then set it on the DB
 	 * and do not add to the wrap list (as we need to keep the LDB
@@ -164,6 +184,43 @@ struct ldb_context *samdb_connect(TALLOC_CTX *mem_ctx,
 	return NULL;
 }
 
+/*
+ * Called in a process about to fork workers: open (once) a sam.ldb
+ * and refresh the global schema through it, so the workers inherit
+ * a current schema instead of each loading it again.
+ */
+void samdb_prepare_fork(TALLOC_CTX *mem_ctx,
+			struct tevent_context *ev_ctx,
+			struct loadparm_context *lp_ctx,
+			struct ldb_context **_ldb)
+{
+	struct timespec start_time;
+
+	clock_gettime_mono(&start_time);
+
+	if (*_ldb == NULL) {
+		*_ldb = samdb_connect(mem_ctx,
+				      ev_ctx,
+				      lp_ctx,
+				      system_session(lp_ctx),
+				      NULL,
+				      0);
+		if (*_ldb == NULL) {
+			DBG_WARNING("Failed to open sam.ldb before fork\n");
+			return;
+		}
+	}
+
+	/* this runs the schema refresh if the schema was changed */
+	if (dsdb_get_schema(*_ldb, NULL) == NULL) {
+		DBG_WARNING("No schema loaded before fork\n");
+		return;
+	}
+
+	DBG_INFO("Prepared sam.ldb for fork in %.3f seconds\n",
+		 timespec_elapsed(&start_time));
+}
+
 /****************************************************************************
  Create the SID list for this user.
 ****************************************************************************/
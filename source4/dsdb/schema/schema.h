@@ -252,6 +252,20 @@ struct dsdb_schema {
 	 */
 	uint64_t metadata_usn;
 
+	/*
+	 * The highest uSNChanged of the schema objects this was
+	 * loaded from, 0 if it was not loaded from the local ldb.
+	 * The next refresh only needs to parse objects changed since.
+	 */
+	uint64_t loaded_usn;
+
+	/*
+	 * Number of refreshes applied on top of the last full load.
+	 * Each of these shares the definitions of the previous
+	 * schema, which is kept alive by it.
+	 */
+	uint32_t incremental_depth;
+
 	/* Should the syntax handlers in this case handle all incoming OIDs automatically, assigning them as an OID if no text name is known? */
 	bool relax_OID_conversions;
 
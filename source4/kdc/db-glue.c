@@ -36,6 +36,7 @@
 #include "lib/crypto/gkdi.h"
 #include "../lib/crypto/md4.h"
 #include "lib/util/memory.h"
+#include "lib/util/dlinklist.h"
 #include "system/kerberos.h"
 #include "auth/kerberos/kerberos.h"
 #include "kdc/authn_policy_util.h"
@@ -3344,6 +3345,160 @@ static krb5_error_code samba_kdc_lookup_server(krb5_context context,
 
 
 
+/*
+ * A short lived cache of the server lookups, as the same few service
+ * principals are asked for over and over again.  Any change to the
+ * database (seen as a new sequence number) empties it, so a password
+ * or key change is seen by the next request.
+ *
+ * The cached search results are still converted by
+ * samba_kdc_message2entry() for every request, the entry is owned by
+ * the caller.
+ */
+struct samba_kdc_server_cache_entry {
+	struct samba_kdc_server_cache_entry *prev, *next;
+	char *principal;
+	int name_type;
+	bool for_as_req;
+	time_t expires;
+	struct ldb_dn *realm_dn;
+	struct ldb_message *msg;
+};
+
+struct samba_kdc_server_cache {
+	struct samba_kdc_server_cache_entry *entries;
+	unsigned int num_entries;
+	unsigned int max_entries;
+	time_t ttl;
+	uint64_t seq_num;
+};
+
+static struct samba_kdc_server_cache *samba_kdc_server_cache(
+	struct samba_kdc_db_context *kdc_db_ctx)
+{
+	struct samba_kdc_server_cache *cache = kdc_db_ctx->server_cache;
+	uint64_t seq_num = 0;
+	int ttl;
+	int ret;
+
+	if (cache == NULL) {
+		ttl = lpcfg_parm_int(kdc_db_ctx->lp_ctx, NULL, "kdc",
+				     "server lookup cache ttl", 0);
+		if (ttl <= 0) {
+			return NULL;
+		}
+
+		cache = talloc_zero(kdc_db_ctx, struct samba_kdc_server_cache);
+		if (cache == NULL) {
+			return NULL;
+		}
+		cache->ttl = ttl;
+		cache->max_entries = lpcfg_parm_int(kdc_db_ctx->lp_ctx, NULL,
+						    "kdc",
+						    "server lookup cache size",
+						    128);
+		kdc_db_ctx->server_cache = cache;
+	}
+
+	if (cache->max_entries == 0) {
+		return NULL;
+	}
+
+	ret = ldb_sequence_number(kdc_db_ctx->samdb, LDB_SEQ_HIGHEST_SEQ,
+				  &seq_num);
+	if (ret != LDB_SUCCESS) {
+		return NULL;
+	}
+
+	if (seq_num != cache->seq_num) {
+		while (cache->entries != NULL) {
+			struct samba_kdc_server_cache_entry *e = cache->entries;
+			DLIST_REMOVE(cache->entries, e);
+			TALLOC_FREE(e);
+		}
+		cache->num_entries = 0;
+		cache->seq_num = seq_num;
+	}
+
+	return cache;
+}
+
+static struct samba_kdc_server_cache_entry *samba_kdc_server_cache_find(
+	struct samba_kdc_server_cache *cache,
+	const char *principal,
+	int name_type,
+	bool for_as_req)
+{
+	struct samba_kdc_server_cache_entry *e = NULL;
+	time_t now = time_mono(NULL);
+
+	for (e = cache->entries; e != NULL; e = e->next) {
+		if (e->name_type != name_type ||
+		    e->for_as_req != for_as_req ||
+		    strcmp(e->principal, principal) != 0) {
+			continue;
+		}
+		if (e->expires <= now) {
+			DLIST_REMOVE(cache->entries, e);
+			TALLOC_FREE(e);
+			cache->num_entries--;
+			return NULL;
+		}
+		DLIST_PROMOTE(cache->entries, e);
+		return e;
+	}
+
+	return NULL;
+}
+
+static void samba_kdc_server_cache_add(struct samba_kdc_server_cache *cache,
+				       const char *principal,
+				       int name_type,
+				       bool for_as_req,
+				       struct ldb_dn *realm_dn,
+				       const struct ldb_message *msg)
+{
+	struct samba_kdc_server_cache_entry *e = NULL;
+	const struct ldb_message_element *objectclasses = NULL;
+	struct ldb_val gmsa_oc_val = data_blob_string_const("msDS-GroupManagedServiceAccount");
+
+	/*
+	 * The managed password of a gMSA is brought up to date as
+	 * part of each search.
+	 */
+	objectclasses = ldb_msg_find_element(msg, "objectClass");
+	if (objectclasses != NULL &&
+	    ldb_msg_find_val(objectclasses, &gmsa_oc_val) != NULL) {
+		return;
+	}
+
+	e = talloc_zero(cache, struct samba_kdc_server_cache_entry);
+	if (e == NULL) {
+		return;
+	}
+	e->principal = talloc_strdup(e, principal);
+	e->realm_dn = ldb_dn_copy(e, realm_dn);
+	e->msg = ldb_msg_copy(e, msg);
+	if (e->principal == NULL || e->realm_dn == NULL || e->msg == NULL) {
+		TALLOC_FREE(e);
+		return;
+	}
+	e->name_type = name_type;
+	e->for_as_req = for_as_req;
+	e->expires = time_mono(NULL) + cache->ttl;
+
+	DLIST_ADD(cache->entries, e);
+	cache->num_entries++;
+
+	if (cache->num_entries > cache->max_entries) {
+		struct samba_kdc_server_cache_entry *last =
+			DLIST_TAIL(cache->entries);
+		DLIST_REMOVE(cache->entries, last);
+		TALLOC_FREE(last);
+		cache->num_entries--;
+	}
+}
+
 static krb5_error_code samba_kdc_fetch_server(krb5_context context,
 					      struct samba_kdc_db_context *kdc_db_ctx,
 					      TALLOC_CTX *mem_ctx,
@@ -3353,14 +3508,56 @@ static krb5_error_code samba_kdc_fetch_server(krb5_context context,
 					      struct sdb_entry *entry)
 {
 	krb5_error_code ret;
-	struct ldb_dn *realm_dn;
-	struct ldb_message *msg;
+	struct ldb_dn *realm_dn = NULL;
+	struct ldb_message *msg = NULL;
+	struct samba_kdc_server_cache *cache = NULL;
+	char *principal_string = NULL;
+	int name_type = smb_krb5_principal_get_type(context, principal);
+	bool for_as_req = (flags & SDB_F_FOR_AS_REQ) != 0;
 
-	ret = samba_kdc_lookup_server(context, kdc_db_ctx, mem_ctx, principal,
-				      flags, &realm_dn, &msg);
-	if (ret != 0) {
-		return ret;
+	cache = samba_kdc_server_cache(kdc_db_ctx);
+	if (cache != NULL) {
+		struct samba_kdc_server_cache_entry *e = NULL;
+
+		ret = krb5_unparse_name(context, principal, &principal_string);
+		if (ret != 0) {
+			principal_string = NULL;
+			cache = NULL;
+		}
+		if (cache != NULL) {
+			e = samba_kdc_server_cache_find(cache,
+							principal_string,
+							name_type,
+							for_as_req);
+		}
+		if (e != NULL) {
+			realm_dn = ldb_dn_copy(mem_ctx, e->realm_dn);
+			msg = ldb_msg_copy(mem_ctx, e->msg);
+			if (realm_dn == NULL || msg == NULL) {
+				SAFE_FREE(principal_string);
+				return ENOMEM;
+			}
+		}
+	}
+
+	if (msg == NULL) {
+		ret = samba_kdc_lookup_server(context, kdc_db_ctx, mem_ctx,
+					      principal, flags,
+					      &realm_dn, &msg);
+		if (ret != 0) {
+			SAFE_FREE(principal_string);
+			return ret;
+		}
+		if (cache != NULL) {
+			samba_kdc_server_cache_add(cache,
+						   principal_string,
+						   name_type,
+						   for_as_req,
+						   realm_dn,
+						   msg);
+		}
 	}
+	SAFE_FREE(principal_string);
 
 	ret = samba_kdc_message2entry(context, kdc_db_ctx, mem_ctx,
 				      principal, SAMBA_KDC_ENT_TYPE_SERVER,
@@ -535,6 +535,18 @@ static void kdc_post_fork(struct task_server *task, struct process_details *pd)
 }
 
 
+/*
+  make sure the kdc worker about to be forked inherits a current schema
+*/
+static void kdc_pre_fork(struct task_server *task, struct process_details *pd)
+{
+	struct kdc_server *kdc = talloc_get_type_abort(task->private_data,
+						       struct kdc_server);
+
+	samdb_prepare_fork(kdc, task->event_ctx, task->lp_ctx,
+			   &kdc->pre_fork_samdb);
+}
+
 /* called at smbd startup - register ourselves as a server service */
 NTSTATUS server_service_kdc_init(TALLOC_CTX *ctx)
 {
@@ -542,7 +554,8 @@ NTSTATUS server_service_kdc_init(TALLOC_CTX *ctx)
 		.inhibit_fork_on_accept = true,
 		.inhibit_pre_fork = false,
 		.task_init = kdc_task_init,
-		.post_fork = kdc_post_fork
+		.post_fork = kdc_post_fork,
+		.pre_fork = kdc_pre_fork,
 	};
 	return register_server_service(ctx, "kdc", &details);
 }
@@ -42,6 +42,9 @@ struct kdc_server {
 	const char *kpasswd_keytab_name;
 	void *private_data;
 	struct samba_kdc_db_context *kdc_db_ctx;
+
+	/* only used in the prefork master, see kdc_pre_fork() */
+	struct ldb_context *pre_fork_samdb;
 };
 
 typedef enum kdc_code_e {
@@ -1333,6 +1333,9 @@ krb5_error_code samba_kdc_get_user_info_from_db(TALLOC_CTX *mem_ctx,
 	if (entry->info_from_db == NULL) {
 		struct auth_user_info_dc *info_from_db = NULL;
 		struct loadparm_context *lp_ctx = kdc_db_ctx->lp_ctx;
+		struct timespec start_time;
+
+		clock_gettime_mono(&start_time);
 
 		nt_status = authsam_make_user_info_dc(entry,
 						      kdc_db_ctx->samdb,
@@ -1351,6 +1354,12 @@ krb5_error_code samba_kdc_get_user_info_from_db(TALLOC_CTX *mem_ctx,
 			return map_errno_from_nt_status(nt_status);
 		}
 
+		DBG_DEBUG("Got user info for PAC of %s with %"PRIu32" SIDs "
+			  "in %.6f seconds\n",
+			  info_from_db->info->account_name,
+			  info_from_db->num_sids,
+			  timespec_elapsed(&start_time));
+
 		entry->info_from_db = info_from_db;
 	}
 
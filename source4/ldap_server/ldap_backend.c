@@ -352,6 +352,58 @@ NTSTATUS ldapsrv_queue_reply(struct ldapsrv_call *call, struct ldapsrv_reply *re
 	return status;
 }
 
+/*
+ * Search entries are encoded directly into buffers shared by the
+ * consecutive entries of a call, growing up to this size
+ */
+#define LDAPSRV_REPLY_BUFFER_SIZE ((size_t)(64 * 1024))
+
+/*
+ * Reserve len bytes at the end of the replies of a call, it is
+ * subject to the same LDAP_SERVER_MAX_REPLY_SIZE limit as
+ * ldapsrv_queue_reply()
+ */
+static NTSTATUS ldapsrv_reply_buffer(struct ldapsrv_call *call,
+				     size_t len,
+				     uint8_t **buf)
+{
+	struct ldapsrv_reply *reply = DLIST_TAIL(call->replies);
+
+	if (call->reply_size > call->reply_size + len
+	    || call->reply_size + len > LDAP_SERVER_MAX_REPLY_SIZE) {
+		DBG_WARNING("Refusing to queue LDAP search response size "
+			    "of more than %zu bytes\n",
+			    LDAP_SERVER_MAX_REPLY_SIZE);
+		return NT_STATUS_FILE_TOO_LARGE;
+	}
+
+	if (reply == NULL ||
+	    reply->buffer_size == 0 ||
+	    reply->buffer_size - reply->blob.length < len) {
+		size_t size = MIN(call->reply_size, LDAPSRV_REPLY_BUFFER_SIZE);
+
+		reply = talloc_zero(call, struct ldapsrv_reply);
+		if (reply == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+		reply->buffer_size = MAX(len, size);
+		reply->blob.data = talloc_size(reply, reply->buffer_size);
+		if (reply->blob.data == NULL) {
+			TALLOC_FREE(reply);
+			return NT_STATUS_NO_MEMORY;
+		}
+		talloc_set_name_const(reply->blob.data,
+				      "Outgoing, encoded LDAP search entries");
+		DLIST_ADD_END(call->replies, reply);
+	}
+
+	*buf = reply->blob.data + reply->blob.length;
+	reply->blob.length += len;
+	call->reply_size += len;
+
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS ldapsrv_unwilling(struct ldapsrv_call *call, int error)
 {
 	struct ldapsrv_reply *reply;
@@ -608,9 +660,7 @@ static int ldap_server_search_callback(struct ldb_request *req, struct ldb_reply
 	struct ldapsrv_context *ctx = talloc_get_type(req->context, struct ldapsrv_context);
 	struct ldapsrv_call *call = ctx->call;
 	struct ldb_context *ldb = call->conn->ldb;
-	unsigned int j;
 	struct ldapsrv_reply *ent_r = NULL;
-	struct ldap_SearchResEntry *ent;
 	int ret;
 	NTSTATUS status;
 
@@ -625,45 +675,43 @@ static int ldap_server_search_callback(struct ldb_request *req, struct ldb_reply
 	case LDB_REPLY_ENTRY:
 	{
 		struct ldb_message *msg = ares->message;
-		ent_r = ldapsrv_init_reply(call, LDAP_TAG_SearchResultEntry);
-		if (ent_r == NULL) {
-			return ldb_oom(ldb);
-		}
+		char *dn = NULL;
+		uint8_t *buf = NULL;
+		size_t size;
 
 		ctx->count++;
 
+		dn = ldb_dn_get_extended_linearized(ares, msg->dn,
+						    ctx->extended_type);
+		if (dn == NULL) {
+			return ldb_oom(ldb);
+		}
+
 		/*
-		 * Put the LDAP search response data under ent_r->msg
-		 * so we can free that later once encoded
+		 * Encode the entry without building an ldap_message
+		 * first, the attributes and values are not copied
+		 * before they end up in the reply buffer.
 		 */
-		talloc_steal(ent_r->msg, msg);
-
-		ent = &ent_r->msg->r.SearchResultEntry;
-		ent->dn = ldb_dn_get_extended_linearized(ent_r, msg->dn,
-							 ctx->extended_type);
-		ent->num_attributes = 0;
-		ent->attributes = NULL;
-		if (msg->num_elements == 0) {
-			goto queue_reply;
-		}
-		ent->num_attributes = msg->num_elements;
-		ent->attributes = talloc_array(ent_r, struct ldb_message_element, ent->num_attributes);
-		if (ent->attributes == NULL) {
-			return ldb_oom(ldb);
+		size = ldap_search_entry_size(call->request->messageid,
+					      dn,
+					      msg);
+		if (size == 0) {
+			DBG_ERR("Failed to encode ldap reply of type %d: "
+				"entry too large\n",
+				LDAP_TAG_SearchResultEntry);
+			return ldb_request_done(req, ldb_operr(ldb));
 		}
 
-		for (j=0; j < ent->num_attributes; j++) {
-			ent->attributes[j].name = msg->elements[j].name;
-			ent->attributes[j].num_values = 0;
-			ent->attributes[j].values = NULL;
-			if (ctx->attributesonly && (msg->elements[j].num_values == 0)) {
-				continue;
-			}
-			ent->attributes[j].num_values = msg->elements[j].num_values;
-			ent->attributes[j].values = msg->elements[j].values;
+		status = ldapsrv_reply_buffer(call, size, &buf);
+		if (NT_STATUS_IS_OK(status)) {
+			ldap_search_entry_encode(call->request->messageid,
+						 dn,
+						 msg,
+						 buf);
 		}
+		TALLOC_FREE(dn);
 
-		{
+		if (msg->num_elements != 0) {
 			const struct ldb_control
 				*ctrl = ldb_controls_get_control(
 					ares->controls,
@@ -687,8 +735,6 @@ static int ldap_server_search_callback(struct ldb_request *req, struct ldb_reply
 			}
 		}
 
-queue_reply:
-		status = ldapsrv_queue_reply(call, ent_r);
 		if (NT_STATUS_EQUAL(status, NT_STATUS_FILE_TOO_LARGE)) {
 			ret = ldb_request_done(req,
 					       LDB_ERR_SIZE_LIMIT_EXCEEDED);
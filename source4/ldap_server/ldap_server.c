@@ -284,6 +284,13 @@ static int ldapsrv_call_destructor(struct ldapsrv_call *call)
 
 	DLIST_REMOVE(call->conn->pending_calls, call);
 
+	if (call->pipelined) {
+		call->conn->pipeline.num_active -= 1;
+	}
+	if (call->conn->pipeline.deferred == call) {
+		call->conn->pipeline.deferred = NULL;
+	}
+
 	call->conn = NULL;
 	return 0;
 }
@@ -405,6 +412,9 @@ static void ldapsrv_accept(struct stream_connection *c,
 	/* load limits from the conf partition */
 	ldapsrv_load_limits(conn); /* should we fail on error ? */
 
+	conn->pipeline.max_active = MAX(
+		lpcfg_ldap_max_pipelined_requests(conn->lp_ctx), 1);
+
 	/* register the server */
 	irpc_add_name(c->msg_ctx, "ldap_server");
 
@@ -470,10 +480,81 @@ static NTSTATUS ldapsrv_packet_check(
 	DATA_BLOB blob,
 	size_t *packet_size);
 
+static void ldapsrv_call_process_done(struct tevent_req *subreq);
+
+static bool ldapsrv_call_queue(struct ldapsrv_call *call)
+{
+	struct ldapsrv_connection *conn = call->conn;
+	struct tevent_req *subreq = NULL;
+
+	/* queue the call in the global queue */
+	subreq = ldapsrv_process_call_send(call,
+					   conn->connection->event.ctx,
+					   conn->service->call_queue,
+					   call);
+	if (subreq == NULL) {
+		ldapsrv_terminate_connection(conn, "ldapsrv_process_call_send failed");
+		return false;
+	}
+	tevent_req_set_callback(subreq, ldapsrv_call_process_done, call);
+	conn->active_call = subreq;
+	return true;
+}
+
+/*
+ * Requests that don't change the state of the connection can be
+ * processed while the replies to the ones before are still
+ * written. Everything else waits for the connection to be idle,
+ * for a bind RFC 4511 even requires this.
+ */
+static bool ldapsrv_call_pipelinable(struct ldapsrv_call *call)
+{
+	struct ldap_message *msg = call->request;
+	size_t i;
+
+	switch (msg->type) {
+	case LDAP_TAG_SearchRequest:
+	case LDAP_TAG_ModifyRequest:
+	case LDAP_TAG_AddRequest:
+	case LDAP_TAG_DelRequest:
+	case LDAP_TAG_ModifyDNRequest:
+	case LDAP_TAG_CompareRequest:
+		break;
+	default:
+		return false;
+	}
+
+	for (i = 0; msg->controls != NULL && msg->controls[i] != NULL; i++) {
+		const char *oid = msg->controls[i]->oid;
+
+		/* notifications stay on conn->pending_calls */
+		if (strcmp(oid, LDB_CONTROL_NOTIFICATION_OID) == 0) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
 static bool ldapsrv_call_read_next(struct ldapsrv_connection *conn)
 {
 	struct tevent_req *subreq;
 
+	if (conn->limits.reason != NULL) {
+		/* terminating */
+		return false;
+	}
+
+	if (conn->pipeline.deferred != NULL) {
+		struct ldapsrv_call *call = conn->pipeline.deferred;
+
+		if (conn->pipeline.num_active != 0) {
+			return true;
+		}
+		conn->pipeline.deferred = NULL;
+		return ldapsrv_call_queue(call);
+	}
+
 	if (conn->pending_calls != NULL) {
 		conn->limits.endtime = timeval_zero();
 
@@ -487,6 +568,24 @@ static bool ldapsrv_call_read_next(struct ldapsrv_connection *conn)
 	}
 
 	if (conn->sockets.read_req != NULL) {
+		if ((conn->pipeline.num_active == 0) &&
+		    !timeval_is_zero(&conn->limits.endtime)) {
+			/*
+			 * The read was started without a timeout while
+			 * we were busy replying.
+			 */
+			bool ok;
+			ok = tevent_req_set_endtime(conn->sockets.read_req,
+						    conn->connection->event.ctx,
+						    conn->limits.endtime);
+			if (!ok) {
+				ldapsrv_terminate_connection(
+					conn,
+					"ldapsrv_call_read_next: "
+					"no memory for tevent_req_set_endtime");
+				return false;
+			}
+		}
 		return true;
 	}
 
@@ -529,7 +628,8 @@ static bool ldapsrv_call_read_next(struct ldapsrv_connection *conn)
 				"no memory for tstream_read_pdu_blob_send");
 		return false;
 	}
-	if (!timeval_is_zero(&conn->limits.endtime)) {
+	if ((conn->pipeline.num_active == 0) &&
+	    !timeval_is_zero(&conn->limits.endtime)) {
 		bool ok;
 		ok = tevent_req_set_endtime(subreq,
 					    conn->connection->event.ctx,
@@ -547,7 +647,6 @@ static bool ldapsrv_call_read_next(struct ldapsrv_connection *conn)
 	return true;
 }
 
-static void ldapsrv_call_process_done(struct tevent_req *subreq);
 static int ldapsrv_check_packet_size(
 	struct ldapsrv_connection *conn,
 	size_t size);
@@ -630,18 +729,30 @@ static void ldapsrv_call_read_done(struct tevent_req *subreq)
 	data_blob_free(&blob);
 	TALLOC_FREE(asn1);
 
+	if (!ldapsrv_call_pipelinable(call)) {
+		if (conn->pipeline.num_active != 0) {
+			/*
+			 * Wait for the calls before to be replied,
+			 * ldapsrv_call_read_next() will queue it.
+			 */
+			conn->pipeline.deferred = call;
+			return;
+		}
+		ldapsrv_call_queue(call);
+		return;
+	}
 
-	/* queue the call in the global queue */
-	subreq = ldapsrv_process_call_send(call,
-					   conn->connection->event.ctx,
-					   conn->service->call_queue,
-					   call);
-	if (subreq == NULL) {
-		ldapsrv_terminate_connection(conn, "ldapsrv_process_call_send failed");
+	call->pipelined = true;
+	conn->pipeline.num_active += 1;
+
+	if (!ldapsrv_call_queue(call)) {
 		return;
 	}
-	tevent_req_set_callback(subreq, ldapsrv_call_process_done, call);
-	conn->active_call = subreq;
+
+	if (conn->pipeline.num_active < conn->pipeline.max_active) {
+		/* read the next one while this one is processed */
+		ldapsrv_call_read_next(conn);
+	}
 }
 
 static void ldapsrv_call_wait_done(struct tevent_req *subreq);
@@ -656,7 +767,9 @@ static void ldapsrv_call_process_done(struct tevent_req *subreq)
 	struct ldapsrv_connection *conn = call->conn;
 	NTSTATUS status;
 
-	conn->active_call = NULL;
+	if (conn->active_call == subreq) {
+		conn->active_call = NULL;
+	}
 
 	status = ldapsrv_process_call_recv(subreq);
 	TALLOC_FREE(subreq);
@@ -665,6 +778,12 @@ static void ldapsrv_call_process_done(struct tevent_req *subreq)
 		return;
 	}
 
+	if (conn->limits.reason != NULL) {
+		/* Dropped in ldapsrv_process_call_trigger() */
+		TALLOC_FREE(call);
+		return;
+	}
+
 	if (call->wait_send != NULL) {
 		subreq = call->wait_send(call,
 					 conn->connection->event.ctx,
@@ -1050,6 +1169,15 @@ static void ldapsrv_process_call_trigger(struct tevent_req *req,
 	struct ldapsrv_connection *conn = state->call->conn;
 	NTSTATUS status;
 
+	if (conn->limits.reason != NULL) {
+		/*
+		 * A pipelined call of a connection that is going
+		 * away
+		 */
+		tevent_req_done(req);
+		return;
+	}
+
 	if (conn->deferred_expire_disconnect != NULL) {
 		/*
 		 * Just drop this on the floor
@@ -1595,6 +1723,21 @@ static void ldapsrv_post_fork(struct task_server *task, struct process_details *
 	}
 }
 
+/*
+ * In the prefork master, make sure the worker about to be forked
+ * inherits a current schema.
+ */
+static void ldapsrv_pre_fork(struct task_server *task, struct process_details *pd)
+{
+	struct ldapsrv_service *ldap_service =
+		talloc_get_type_abort(task->private_data, struct ldapsrv_service);
+
+	samdb_prepare_fork(ldap_service,
+			   task->event_ctx,
+			   task->lp_ctx,
+			   &ldap_service->pre_fork_sam_ctx);
+}
+
 static void ldapsrv_before_loop(struct task_server *task)
 {
 	struct ldapsrv_service *ldap_service =
@@ -1717,6 +1860,7 @@ NTSTATUS server_service_ldap_init(TALLOC_CTX *ctx)
 		.task_init = ldapsrv_task_init,
 		.post_fork = ldapsrv_post_fork,
 		.before_loop = ldapsrv_before_loop,
+		.pre_fork = ldapsrv_pre_fork,
 	};
 	return register_server_service(ctx, "ldap", &details);
 }
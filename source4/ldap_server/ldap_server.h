@@ -70,6 +70,14 @@ struct ldapsrv_connection {
 	struct tevent_req *deferred_expire_disconnect;
 
 	struct ldapsrv_call *pending_calls;
+
+	struct {
+		/* calls that don't stop us from reading the next one */
+		size_t num_active;
+		size_t max_active;
+		/* a call waiting for num_active to drop to 0 */
+		struct ldapsrv_call *deferred;
+	} pipeline;
 };
 
 struct ldapsrv_call {
@@ -80,6 +88,8 @@ struct ldapsrv_call {
 		struct ldapsrv_reply *prev, *next;
 		struct ldap_message *msg;
 		DATA_BLOB blob;
+		/* shared by several search entries if non-zero */
+		size_t buffer_size;
 	} *replies;
 	struct iovec *out_iov;
 	size_t iov_count;
@@ -101,6 +111,8 @@ struct ldapsrv_call {
 		bool busy;
 		uint64_t generation;
 	} notification;
+
+	bool pipelined;
 };
 
 /*
@@ -129,6 +141,9 @@ struct ldapsrv_service {
 	struct tevent_context *current_ev;
 	struct imessaging_context *current_msg;
 	struct ldb_context *sam_ctx;
+
+	/* only used in the prefork master, see ldapsrv_pre_fork() */
+	struct ldb_context *pre_fork_sam_ctx;
 };
 
 #include "ldap_server/proto.h"
@@ -78,6 +78,7 @@ NTSTATUS irpc_servers_byname(struct imessaging_context *msg_ctx,
 			     TALLOC_CTX *mem_ctx, const char *name,
 			     unsigned *num_servers,
 			     struct server_id **servers);
+int irpc_names_seqnum(struct imessaging_context *msg_ctx);
 struct irpc_name_records *irpc_all_servers(struct imessaging_context *msg_ctx,
 					   TALLOC_CTX *mem_ctx);
 void irpc_remove_name(struct imessaging_context *msg_ctx, const char *name);
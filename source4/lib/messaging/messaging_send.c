@@ -53,6 +53,15 @@ NTSTATUS irpc_servers_byname(struct imessaging_context *msg_ctx,
 	return NT_STATUS_OK;
 }
 
+/*
+  return a number that changes whenever a server name is
+  registered or removed
+*/
+int irpc_names_seqnum(struct imessaging_context *msg_ctx)
+{
+	return server_id_db_seqnum(msg_ctx->names);
+}
+
 /*
   Send a message to a particular server
 */
@@ -136,4 +136,9 @@ NTSTATUS tstream_tls_sync_setup(struct tstream_tls_params *_tls_params,
 
 const DATA_BLOB *tstream_tls_sync_channel_bindings(struct tstream_tls_sync *tlsss);
 
+bool tstream_tls_quic_supported(void);
+NTSTATUS tstream_tls_quic_handshake(struct tstream_tls_params *tls_params,
+				    bool is_server,
+				    int sockfd);
+
 #endif /* _TLS_H_ */
@@ -33,6 +33,10 @@
 #include <gnutls/x509.h>
 #include "lib/crypto/gnutls_helpers.h"
 
+#ifdef HAVE_LIBQUIC
+#include <netinet/quic.h>
+#endif
+
 #define DH_BITS 2048
 
 const char *tls_verify_peer_string(enum tls_verify_peer_state verify_peer)
@@ -1922,3 +1926,79 @@ NTSTATUS tstream_tls_sync_setup(struct tstream_tls_params *_tls_params,
 	*_tlsss = tlsss;
 	return NT_STATUS_OK;
 }
+
+bool tstream_tls_quic_supported(void)
+{
+#ifdef HAVE_LIBQUIC
+	return true;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Run the TLS 1.3 handshake of a kernel QUIC socket (IPPROTO_QUIC),
+ * the socket needs to be blocking.
+ *
+ * Once this returned NT_STATUS_OK the kernel takes care of
+ * the encryption and the socket can be used as a plain
+ * byte stream.
+ */
+NTSTATUS tstream_tls_quic_handshake(struct tstream_tls_params *_tls_params,
+				    bool is_server,
+				    int sockfd)
+{
+#ifdef HAVE_LIBQUIC
+	TALLOC_CTX *frame = talloc_stackframe();
+	struct tstream_tls *tlss = NULL;
+	gnutls_datum_t alpn = {
+		.data = discard_const_p(unsigned char, "smb"),
+		.size = 3,
+	};
+	NTSTATUS status;
+	int ret;
+
+	tlss = talloc_zero(frame, struct tstream_tls);
+	if (tlss == NULL) {
+		TALLOC_FREE(frame);
+		return NT_STATUS_NO_MEMORY;
+	}
+	talloc_set_destructor(tlss, tstream_tls_destructor);
+	tlss->is_server = is_server;
+
+	status = tstream_tls_prepare_gnutls(_tls_params, tlss);
+	if (!NT_STATUS_IS_OK(status)) {
+		TALLOC_FREE(frame);
+		return status;
+	}
+
+	ret = gnutls_alpn_set_protocols(tlss->tls_session, &alpn, 1, 0);
+	if (ret != GNUTLS_E_SUCCESS) {
+		TALLOC_FREE(frame);
+		return gnutls_error_to_ntstatus(ret,
+				NT_STATUS_CRYPTO_SYSTEM_INVALID);
+	}
+
+	gnutls_transport_set_int(tlss->tls_session, sockfd);
+
+	ret = quic_handshake(tlss->tls_session);
+	if (ret != 0) {
+		DBG_NOTICE("quic_handshake failed: %s\n", strerror(-ret));
+		TALLOC_FREE(frame);
+		return map_nt_error_from_unix_common(-ret);
+	}
+
+	if (!is_server) {
+		status = tstream_tls_verify_peer(tlss);
+		if (!NT_STATUS_IS_OK(status)) {
+			TALLOC_FREE(frame);
+			return status;
+		}
+	}
+
+	TALLOC_FREE(frame);
+	return NT_STATUS_OK;
+#else
+	return NT_STATUS_NOT_SUPPORTED;
+#endif
+}
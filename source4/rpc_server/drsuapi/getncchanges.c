@@ -39,6 +39,7 @@
 #include "lib/dbwrap/dbwrap.h"
 #include "lib/dbwrap/dbwrap_rbt.h"
 #include "librpc/gen_ndr/ndr_misc.h"
+#include "lib/pthreadpool/pthreadpool_pipe.h"
 
 #undef DBGC_CLASS
 #define DBGC_CLASS            DBGC_DRS_REPL
@@ -76,6 +77,9 @@ struct drsuapi_getncchanges_state {
 	/* these are just used for debugging the replication's progress */
 	uint32_t links_given;
 	uint32_t total_links;
+
+	/* secret attributes of this chunk encrypted in helper threads */
+	struct getncchanges_encrypt_batch *encrypt_batch;
 };
 
 /* We must keep the GUIDs in NDR form for sorting */
@@ -446,6 +450,293 @@ static WERROR get_nc_changes_filter_attrs(struct drsuapi_DsReplicaObjectListItem
 /*
   drsuapi_DsGetNCChanges for one object
 */
+/*
+ * Encrypting the secret attributes of a chunk is the only part of
+ * building it not using the ldb, schema or talloc trees shared with
+ * the rest of the server, so it is handed to helper threads.  They
+ * work on copies in contexts of their own, while the main thread
+ * goes on with the next objects.  The encrypted values are put in
+ * place by getncchanges_encrypt_batch_finish() before the reply is
+ * sent, so the order of the objects is unchanged.
+ */
+struct getncchanges_encrypt_job;
+
+struct getncchanges_encrypt_link {
+	struct getncchanges_encrypt_job *job;
+};
+
+struct getncchanges_encrypt_job {
+	/* only used by the main thread */
+	struct drsuapi_DsReplicaAttribute *attr;
+	struct getncchanges_encrypt_link *link;
+	bool running;
+
+	/* only used by the helper thread while running */
+	DATA_BLOB session_key;
+	bool rid_crypt;
+	uint32_t rid;
+	DATA_BLOB plain;
+	DATA_BLOB enc;
+	WERROR werr;
+};
+
+struct getncchanges_encrypt_batch {
+	struct drsuapi_getncchanges_state *getnc_state;
+	struct pthreadpool_pipe *pool;
+	struct getncchanges_encrypt_job **jobs;
+	unsigned int num_jobs;
+	unsigned int num_running;
+};
+
+static struct pthreadpool_pipe *getncchanges_encrypt_pool;
+static pid_t getncchanges_encrypt_pool_pid;
+
+/*
+ * The job lives as long as the object its attribute belongs to, an
+ * object dropped from the chunk drops its jobs.
+ */
+static int getncchanges_encrypt_link_destructor(
+	struct getncchanges_encrypt_link *link)
+{
+	if (link->job != NULL) {
+		link->job->attr = NULL;
+		link->job->link = NULL;
+	}
+	return 0;
+}
+
+static void getncchanges_encrypt_job_fn(void *private_data)
+{
+	struct getncchanges_encrypt_job *job = private_data;
+
+	job->werr = drsuapi_encrypt_attribute_value(job,
+						    &job->session_key,
+						    job->rid_crypt,
+						    job->rid,
+						    &job->plain,
+						    &job->enc);
+}
+
+static void getncchanges_encrypt_batch_wait(
+	struct getncchanges_encrypt_batch *batch)
+{
+	while (batch->num_running > 0) {
+		int jobids[16];
+		int i, num;
+
+		num = pthreadpool_pipe_finished_jobs(batch->pool, jobids,
+						     ARRAY_SIZE(jobids));
+		if (num < 0) {
+			/* we can't know which jobs are still running */
+			smb_panic("pthreadpool_pipe_finished_jobs failed");
+		}
+		for (i = 0; i < num; i++) {
+			struct getncchanges_encrypt_job *job = NULL;
+
+			if (jobids[i] < 0 ||
+			    (unsigned int)jobids[i] >= batch->num_jobs) {
+				smb_panic("invalid encrypt job id");
+			}
+			job = batch->jobs[jobids[i]];
+			job->running = false;
+			batch->num_running -= 1;
+		}
+	}
+}
+
+static int getncchanges_encrypt_batch_destructor(
+	struct getncchanges_encrypt_batch *batch)
+{
+	unsigned int i;
+
+	getncchanges_encrypt_batch_wait(batch);
+
+	for (i = 0; i < batch->num_jobs; i++) {
+		struct getncchanges_encrypt_job *job = batch->jobs[i];
+
+		if (job->link != NULL) {
+			job->link->job = NULL;
+		}
+		TALLOC_FREE(job);
+	}
+	if (batch->getnc_state != NULL) {
+		batch->getnc_state->encrypt_batch = NULL;
+	}
+	return 0;
+}
+
+/*
+ * Start a batch, unless "drs:secret encryption threads" is 0 (the
+ * default) or the helper threads can't be started
+ */
+static struct getncchanges_encrypt_batch *getncchanges_encrypt_batch_new(
+	struct loadparm_context *lp_ctx,
+	struct drsuapi_getncchanges_state *getnc_state)
+{
+	struct getncchanges_encrypt_batch *batch = NULL;
+	int num_threads;
+
+	/* left over by an earlier call failing half way */
+	TALLOC_FREE(getnc_state->encrypt_batch);
+
+	num_threads = lpcfg_parm_int(lp_ctx, NULL, "drs",
+				     "secret encryption threads", 0);
+	if (num_threads <= 0) {
+		return NULL;
+	}
+
+	if (getncchanges_encrypt_pool != NULL &&
+	    getncchanges_encrypt_pool_pid != getpid()) {
+		/* the threads of the parent are gone after a fork */
+		getncchanges_encrypt_pool = NULL;
+	}
+	if (getncchanges_encrypt_pool == NULL) {
+		int ret;
+
+		ret = pthreadpool_pipe_init(num_threads,
+					    &getncchanges_encrypt_pool);
+		if (ret != 0) {
+			DBG_WARNING("pthreadpool_pipe_init failed: %s\n",
+				    strerror(ret));
+			getncchanges_encrypt_pool = NULL;
+			return NULL;
+		}
+		getncchanges_encrypt_pool_pid = getpid();
+	}
+
+	batch = talloc_zero(getnc_state, struct getncchanges_encrypt_batch);
+	if (batch == NULL) {
+		return NULL;
+	}
+	batch->getnc_state = getnc_state;
+	batch->pool = getncchanges_encrypt_pool;
+	talloc_set_destructor(batch, getncchanges_encrypt_batch_destructor);
+
+	getnc_state->encrypt_batch = batch;
+	return batch;
+}
+
+/*
+ * Like drsuapi_encrypt_attribute(), but encrypt the value in a helper
+ * thread
+ */
+static WERROR getncchanges_encrypt_attribute(
+	struct getncchanges_encrypt_batch *batch,
+	struct drsuapi_DsReplicaObjectListItemEx *obj,
+	const DATA_BLOB *session_key,
+	uint32_t rid,
+	struct drsuapi_DsReplicaAttribute *attr)
+{
+	struct getncchanges_encrypt_job *job = NULL;
+	struct getncchanges_encrypt_job **jobs = NULL;
+	bool rid_crypt = false;
+	int ret;
+
+	if (attr->value_ctr.num_values == 0) {
+		return WERR_OK;
+	}
+
+	if (!drsuapi_attribute_is_encrypted(attr->attid, &rid_crypt)) {
+		return WERR_OK;
+	}
+
+	if (attr->value_ctr.num_values > 1) {
+		return WERR_DS_DRA_INVALID_PARAMETER;
+	}
+
+	if (!attr->value_ctr.values[0].blob) {
+		return WERR_DS_DRA_INVALID_PARAMETER;
+	}
+
+	if (batch->num_jobs >= INT_MAX) {
+		return drsuapi_encrypt_attribute(obj, session_key, rid, attr);
+	}
+
+	jobs = talloc_realloc(batch, batch->jobs,
+			      struct getncchanges_encrypt_job *,
+			      batch->num_jobs + 1);
+	if (jobs == NULL) {
+		return WERR_NOT_ENOUGH_MEMORY;
+	}
+	batch->jobs = jobs;
+
+	/*
+	 * A context of its own, the helper thread allocates the
+	 * encrypted value on it
+	 */
+	job = talloc_zero(NULL, struct getncchanges_encrypt_job);
+	if (job == NULL) {
+		return WERR_NOT_ENOUGH_MEMORY;
+	}
+	job->session_key = data_blob_talloc(job, session_key->data,
+					    session_key->length);
+	job->plain = data_blob_talloc(job,
+				      attr->value_ctr.values[0].blob->data,
+				      attr->value_ctr.values[0].blob->length);
+	job->link = talloc(obj, struct getncchanges_encrypt_link);
+	if ((session_key->length != 0 && job->session_key.data == NULL) ||
+	    (job->plain.length != 0 && job->plain.data == NULL) ||
+	    job->link == NULL) {
+		TALLOC_FREE(job->link);
+		TALLOC_FREE(job);
+		return WERR_NOT_ENOUGH_MEMORY;
+	}
+	job->link->job = job;
+	talloc_set_destructor(job->link, getncchanges_encrypt_link_destructor);
+	job->attr = attr;
+	job->rid_crypt = rid_crypt;
+	job->rid = rid;
+
+	batch->jobs[batch->num_jobs] = job;
+
+	ret = pthreadpool_pipe_add_job(batch->pool, batch->num_jobs,
+				       getncchanges_encrypt_job_fn, job);
+	if (ret != 0) {
+		/* Do it here instead */
+		getncchanges_encrypt_job_fn(job);
+	} else {
+		job->running = true;
+		batch->num_running += 1;
+	}
+	batch->num_jobs += 1;
+
+	return WERR_OK;
+}
+
+/*
+ * Wait for the helper threads and put the encrypted values in place
+ */
+static WERROR getncchanges_encrypt_batch_finish(
+	struct getncchanges_encrypt_batch *batch)
+{
+	unsigned int i;
+	WERROR werr = WERR_OK;
+
+	getncchanges_encrypt_batch_wait(batch);
+
+	for (i = 0; i < batch->num_jobs; i++) {
+		struct getncchanges_encrypt_job *job = batch->jobs[i];
+		DATA_BLOB *blob = NULL;
+
+		if (job->attr == NULL) {
+			/* the object was not sent */
+			continue;
+		}
+		if (!W_ERROR_IS_OK(job->werr)) {
+			werr = job->werr;
+			break;
+		}
+
+		blob = job->attr->value_ctr.values[0].blob;
+		talloc_free(blob->data);
+		blob->data = talloc_steal(blob, job->enc.data);
+		blob->length = job->enc.length;
+	}
+
+	TALLOC_FREE(batch);
+	return werr;
+}
+
 static WERROR get_nc_changes_build_object(struct drsuapi_DsReplicaObjectListItemEx *obj,
 					  const struct ldb_message *msg,
 					  struct ldb_context *sam_ctx,
@@ -698,8 +989,15 @@ static WERROR get_nc_changes_build_object(struct drsuapi_DsReplicaObjectListItem
 			}
 			/* some attributes needs to be encrypted
 			   before being sent */
-			werr = drsuapi_encrypt_attribute(obj, session_key, rid,
-							 &obj->object.attribute_ctr.attributes[i]);
+			if (getnc_state->encrypt_batch != NULL) {
+				werr = getncchanges_encrypt_attribute(
+					getnc_state->encrypt_batch,
+					obj, session_key, rid,
+					&obj->object.attribute_ctr.attributes[i]);
+			} else {
+				werr = drsuapi_encrypt_attribute(obj, session_key, rid,
+								 &obj->object.attribute_ctr.attributes[i]);
+			}
 			if (!W_ERROR_IS_OK(werr)) {
 				DEBUG(0,("Unable to encrypt %s on %s in DRS object - %s\n",
 					 sa->lDAPDisplayName, ldb_dn_get_linearized(msg->dn),
@@ -2697,12 +2995,13 @@ static struct getncchanges_repl_chunk * getncchanges_chunk_new(TALLOC_CTX *mem_c
 }
 
 /*
-  drsuapi_DsGetNCChanges
+  build the uncompressed drsuapi_DsGetNCChangesCtr6 reply
 
   see MS-DRSR 4.1.10.5.2 for basic logic of this function
 */
-WERROR dcesrv_drsuapi_DsGetNCChanges(struct dcesrv_call_state *dce_call, TALLOC_CTX *mem_ctx,
-				     struct drsuapi_DsGetNCChanges *r)
+static WERROR getncchanges_reply(struct dcesrv_call_state *dce_call,
+				 TALLOC_CTX *mem_ctx,
+				 struct drsuapi_DsGetNCChanges *r)
 {
 	struct auth_session_info *session_info =
 		dcesrv_call_session_info(dce_call);
@@ -3485,6 +3784,11 @@ allowed:
 			       uint32_t_ptr_cmp);
 	}
 
+	if (req10->extended_op == DRSUAPI_EXOP_NONE) {
+		getncchanges_encrypt_batch_new(dce_call->conn->dce_ctx->lp_ctx,
+					       getnc_state);
+	}
+
 	/*
 	 * If we have the NC root in this replication, send it
 	 * first regardless.  However, don't bump the USN now,
@@ -3711,6 +4015,14 @@ allowed:
 		TALLOC_FREE(tmp_ctx);
 	}
 
+	if (getnc_state->encrypt_batch != NULL) {
+		werr = getncchanges_encrypt_batch_finish(
+			getnc_state->encrypt_batch);
+		if (!W_ERROR_IS_OK(werr)) {
+			return werr;
+		}
+	}
+
 	/* copy the constructed object list into the response message */
 	r->out.ctr->ctr6.object_count = repl_chunk->object_count;
 	r->out.ctr->ctr6.first_object = repl_chunk->object_list;
@@ -3908,3 +4220,158 @@ allowed:
 
 	return WERR_OK;
 }
+
+#define DEFAULT_COMPRESSION_THRESHOLD (32 * 1024)
+
+/*
+ * Per process, logged with every compressed reply
+ */
+static struct {
+	uint64_t replies;
+	uint64_t uncompressed_bytes;
+	uint64_t compressed_bytes;
+} getncchanges_compression_stats;
+
+/*
+ * Return the reply as MSZIP compressed drsuapi_DsGetNCChangesCtr7
+ * if the client asked for compression (DRSUAPI_DRS_USE_COMPRESSION
+ * is set by the KCC for intersite links), supports it and the reply
+ * is large enough to be worth it.
+ *
+ * We only produce MSZIP, DRSUAPI_COMPRESSION_TYPE_WIN2K3_LZ77_DIRECT2
+ * is not implemented by our NDR layer.
+ */
+static void getncchanges_compress_reply(struct dcesrv_call_state *dce_call,
+					struct drsuapi_bind_state *b_state,
+					TALLOC_CTX *mem_ctx,
+					struct drsuapi_DsGetNCChanges *r)
+{
+	struct loadparm_context *lp_ctx = dce_call->conn->dce_ctx->lp_ctx;
+	const uint32_t required_extensions =
+		DRSUAPI_SUPPORTED_EXTENSION_GETCHG_COMPRESS |
+		DRSUAPI_SUPPORTED_EXTENSION_GETCHGREPLY_V7;
+	struct drsuapi_DsGetNCChangesCtr6TS *ts = NULL;
+	struct drsuapi_DsGetNCChangesMSZIPCtr6 mszip6 = {};
+	uint32_t replica_flags;
+	size_t uncompressed_size;
+	size_t threshold;
+	struct ndr_push *ndr = NULL;
+	enum ndr_err_code ndr_err;
+
+	if (*r->out.level_out != 6) {
+		return;
+	}
+
+	switch (r->in.level) {
+	case 5:
+		replica_flags = r->in.req->req5.replica_flags;
+		break;
+	case 8:
+		replica_flags = r->in.req->req8.replica_flags;
+		break;
+	case 10:
+		replica_flags = r->in.req->req10.replica_flags;
+		break;
+	default:
+		return;
+	}
+
+	if (!(replica_flags & DRSUAPI_DRS_USE_COMPRESSION)) {
+		return;
+	}
+	if ((b_state->remote_extensions & required_extensions) !=
+	    required_extensions) {
+		return;
+	}
+	if (!lpcfg_parm_bool(lp_ctx, NULL, "drs", "compression", true)) {
+		return;
+	}
+
+	ts = talloc_zero(mem_ctx, struct drsuapi_DsGetNCChangesCtr6TS);
+	if (ts == NULL) {
+		return;
+	}
+	ts->ctr6 = r->out.ctr->ctr6;
+
+	threshold = lpcfg_parm_ulong(lp_ctx, NULL,
+				     "drs", "compression threshold",
+				     DEFAULT_COMPRESSION_THRESHOLD);
+	uncompressed_size = ndr_size_struct(
+		ts, 0, (ndr_push_flags_fn_t)ndr_push_drsuapi_DsGetNCChangesCtr6TS);
+	if (uncompressed_size < threshold) {
+		TALLOC_FREE(ts);
+		return;
+	}
+
+	/*
+	 * Pushing the scalars does the compression and returns the
+	 * lengths, so we know the ratio and that the real marshalling
+	 * of the reply is not going to fail.
+	 */
+	ndr = ndr_push_init_ctx(mem_ctx);
+	if (ndr == NULL) {
+		TALLOC_FREE(ts);
+		return;
+	}
+	mszip6.ts = ts;
+	ndr_err = ndr_push_drsuapi_DsGetNCChangesMSZIPCtr6(ndr,
+							   NDR_SCALARS,
+							   &mszip6);
+	if (!NDR_ERR_CODE_IS_SUCCESS(ndr_err) || ndr->offset < 8) {
+		DBG_WARNING("Failed to compress a reply of %zu bytes: %s\n",
+			    uncompressed_size,
+			    ndr_map_error2string(ndr_err));
+		TALLOC_FREE(ndr);
+		TALLOC_FREE(ts);
+		return;
+	}
+	mszip6.decompressed_length = IVAL(ndr->data, 0);
+	mszip6.compressed_length = IVAL(ndr->data, 4);
+	TALLOC_FREE(ndr);
+
+	*r->out.level_out = 7;
+	r->out.ctr->ctr7 = (struct drsuapi_DsGetNCChangesCtr7) {
+		.level = 6,
+		.type = DRSUAPI_COMPRESSION_TYPE_MSZIP,
+		.ctr.mszip6 = mszip6,
+	};
+
+	getncchanges_compression_stats.replies += 1;
+	getncchanges_compression_stats.uncompressed_bytes +=
+		mszip6.decompressed_length;
+	getncchanges_compression_stats.compressed_bytes +=
+		mszip6.compressed_length;
+
+	DBG_INFO("Compressed reply from %"PRIu32" to %"PRIu32" bytes, "
+		 "%"PRIu64" replies from %"PRIu64" to %"PRIu64" bytes so far\n",
+		 mszip6.decompressed_length,
+		 mszip6.compressed_length,
+		 getncchanges_compression_stats.replies,
+		 getncchanges_compression_stats.uncompressed_bytes,
+		 getncchanges_compression_stats.compressed_bytes);
+}
+
+/*
+  drsuapi_DsGetNCChanges
+
+  see MS-DRSR 4.1.10.5.2 for basic logic of this function
+*/
+WERROR dcesrv_drsuapi_DsGetNCChanges(struct dcesrv_call_state *dce_call, TALLOC_CTX *mem_ctx,
+				     struct drsuapi_DsGetNCChanges *r)
+{
+	struct dcesrv_handle *h;
+	struct drsuapi_bind_state *b_state;
+	WERROR werr;
+
+	DCESRV_PULL_HANDLE_WERR(h, r->in.bind_handle, DRSUAPI_BIND_HANDLE);
+	b_state = h->data;
+
+	werr = getncchanges_reply(dce_call, mem_ctx, r);
+	if (!W_ERROR_IS_OK(werr)) {
+		return werr;
+	}
+
+	getncchanges_compress_reply(dce_call, b_state, mem_ctx, r);
+
+	return WERR_OK;
+}
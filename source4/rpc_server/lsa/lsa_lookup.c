@@ -36,6 +36,11 @@ struct dcesrv_lsa_TranslatedItem {
 	uint32_t wb_idx;
 	bool done;
 	bool invalid_sid;
+	struct {
+		uint32_t count;
+		const char *name;
+		uint32_t atype;
+	} account;
 	struct {
 		const char *domain; /* only $DOMAIN\ */
 		const char *namespace; /* $NAMESPACE\ or @$NAMESPACE */
@@ -64,6 +69,9 @@ struct dcesrv_lsa_Lookup_view_table {
 
 static const struct dcesrv_lsa_Lookup_view_table *dcesrv_lsa_view_table(
 	enum lsa_LookupNamesLevel level);
+static NTSTATUS dcesrv_lsa_lookup_sid_account(
+		struct dcesrv_lsa_LookupSids_base_state *state,
+		struct dcesrv_lsa_TranslatedItem *item);
 
 /*
   lookup a SID for 1 name
@@ -284,6 +292,8 @@ struct dcesrv_lsa_LookupSids_base_state {
 
 	struct dsdb_trust_routing_table *routing_table;
 
+	bool account_prefetched;
+
 	struct {
 		struct dcerpc_binding_handle *irpc_handle;
 		struct lsa_SidArray sids;
@@ -306,10 +316,129 @@ static void dcesrv_lsa_LookupSids_base_map(
 	struct dcesrv_lsa_LookupSids_base_state *state);
 static void dcesrv_lsa_LookupSids_base_done(struct tevent_req *subreq);
 
+/*
+  the number of SIDs resolved with a single search
+*/
+#define LSA_LOOKUP_SIDS_BATCH 1000
+
+/*
+  resolve all SIDs of our own domain with one OR-filtered objectSid
+  search per batch, rather than one search per SID in
+  dcesrv_lsa_lookup_sid_account()
+*/
+static NTSTATUS dcesrv_lsa_LookupSids_prefetch_account(
+	struct dcesrv_lsa_LookupSids_base_state *state)
+{
+	struct lsa_policy_state *policy_state = state->policy_state;
+	struct lsa_LookupSids3 *r = &state->r;
+	const char * const attrs[] = { "sAMAccountName", "sAMAccountType",
+				       "objectSid", NULL};
+	uint32_t *batch = NULL;
+	uint32_t num_batch = 0;
+	bool use_account = false;
+	uint32_t v;
+	uint32_t i;
+
+	for (v=0; v < state->view_table->count; v++) {
+		if (state->view_table->array[v]->lookup_sid ==
+		    dcesrv_lsa_lookup_sid_account) {
+			use_account = true;
+			break;
+		}
+	}
+	if (!use_account) {
+		return NT_STATUS_OK;
+	}
+
+	batch = talloc_array(state, uint32_t, LSA_LOOKUP_SIDS_BATCH);
+	if (batch == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
+
+	for (i=0; i <= r->in.sids->num_sids; i++) {
+		struct ldb_message **res = NULL;
+		char *filter = NULL;
+		uint32_t j;
+		int count;
+		int k;
+
+		if (i < r->in.sids->num_sids) {
+			const struct dom_sid *sid = state->items[i].sid;
+
+			if (dom_sid_in_domain(policy_state->domain_sid, sid)) {
+				batch[num_batch++] = i;
+			}
+			if (num_batch < LSA_LOOKUP_SIDS_BATCH) {
+				continue;
+			}
+		}
+		if (num_batch == 0) {
+			continue;
+		}
+
+		filter = talloc_strdup(state, "(&(sAMAccountName=*)(|");
+		for (j = 0; j < num_batch; j++) {
+			const struct dom_sid *sid = state->items[batch[j]].sid;
+			char *encoded_sid = NULL;
+
+			encoded_sid = ldap_encode_ndr_dom_sid(state, sid);
+			if (encoded_sid == NULL) {
+				TALLOC_FREE(filter);
+				break;
+			}
+			talloc_asprintf_addbuf(&filter, "(objectSid=%s)",
+					       encoded_sid);
+			TALLOC_FREE(encoded_sid);
+		}
+		talloc_asprintf_addbuf(&filter, "))");
+		if (filter == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+
+		count = gendb_search(policy_state->sam_ldb, state->mem_ctx,
+				     policy_state->domain_dn, &res, attrs,
+				     "%s", filter);
+		TALLOC_FREE(filter);
+		if (count < 0) {
+			return NT_STATUS_INTERNAL_DB_ERROR;
+		}
+
+		for (k = 0; k < count; k++) {
+			struct dom_sid *sid = NULL;
+
+			sid = samdb_result_dom_sid(res, res[k], "objectSid");
+			if (sid == NULL) {
+				continue;
+			}
+
+			for (j = 0; j < num_batch; j++) {
+				struct dcesrv_lsa_TranslatedItem *item =
+					&state->items[batch[j]];
+
+				if (!dom_sid_equal(item->sid, sid)) {
+					continue;
+				}
+				item->account.count++;
+				item->account.name = ldb_msg_find_attr_as_string(
+					res[k], "sAMAccountName", NULL);
+				item->account.atype = ldb_msg_find_attr_as_uint(
+					res[k], "sAMAccountType", 0);
+			}
+		}
+
+		num_batch = 0;
+	}
+
+	TALLOC_FREE(batch);
+	state->account_prefetched = true;
+	return NT_STATUS_OK;
+}
+
 static NTSTATUS dcesrv_lsa_LookupSids_base_call(struct dcesrv_lsa_LookupSids_base_state *state)
 {
 	struct lsa_LookupSids3 *r = &state->r;
 	struct tevent_req *subreq = NULL;
+	NTSTATUS status;
 	uint32_t v;
 	uint32_t i;
 
@@ -366,13 +495,17 @@ static NTSTATUS dcesrv_lsa_LookupSids_base_call(struct dcesrv_lsa_LookupSids_bas
 		}
 	}
 
+	status = dcesrv_lsa_LookupSids_prefetch_account(state);
+	if (!NT_STATUS_IS_OK(status)) {
+		return status;
+	}
+
 	for (v=0; v < state->view_table->count; v++) {
 		const struct dcesrv_lsa_Lookup_view *view =
 			state->view_table->array[v];
 
 		for (i=0; i < r->in.sids->num_sids; i++) {
 			struct dcesrv_lsa_TranslatedItem *item = &state->items[i];
-			NTSTATUS status;
 
 			if (item->done) {
 				continue;
@@ -1922,6 +2055,32 @@ static NTSTATUS dcesrv_lsa_lookup_sid_account(
 		return NT_STATUS_NONE_MAPPED;
 	}
 
+	if (state->account_prefetched) {
+		if (item->account.count > 1) {
+			status = NT_STATUS_INTERNAL_DB_CORRUPTION;
+			DBG_ERR("sid[%s] found %"PRIu32" times - %s\n",
+				item->hints.sid, item->account.count,
+				nt_errstr(status));
+			return status;
+		}
+		if (item->account.count == 1) {
+			if (item->account.name == NULL) {
+				return NT_STATUS_INTERNAL_ERROR;
+			}
+			if (ds_atype_map(item->account.atype) != SID_NAME_UNKNOWN) {
+				item->name = item->account.name;
+				item->type = ds_atype_map(item->account.atype);
+			}
+		}
+
+		/*
+		 * We know we're authoritative
+		 */
+		item->authority_name = policy_state->domain_name;
+		item->authority_sid = policy_state->domain_sid;
+		return NT_STATUS_OK;
+	}
+
 	status = dcesrv_lsa_lookup_sid(state->policy_state,
 				       state->mem_ctx,
 				       policy_state->domain_name,
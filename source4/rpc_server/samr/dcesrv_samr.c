@@ -2110,6 +2110,11 @@ static NTSTATUS dcesrv_samr_GetAliasMembership(struct dcesrv_call_state *dce_cal
 }
 
 
+/*
+  the number of names resolved with a single search in samr_LookupNames
+*/
+#define SAMR_LOOKUP_NAMES_BATCH 100
+
 /*
   samr_LookupNames
 */
@@ -2120,7 +2125,9 @@ static NTSTATUS dcesrv_samr_LookupNames(struct dcesrv_call_state *dce_call, TALL
 	struct samr_domain_state *d_state;
 	uint32_t i, num_mapped;
 	NTSTATUS status = NT_STATUS_OK;
-	const char * const attrs[] = { "sAMAccountType", "objectSid", NULL };
+	const char * const attrs[] = { "sAMAccountType", "objectSid",
+				       "sAMAccountName", NULL };
+	uint32_t *matches = NULL;
 	int count;
 
 	ZERO_STRUCTP(r->out.rids);
@@ -2145,42 +2152,106 @@ static NTSTATUS dcesrv_samr_LookupNames(struct dcesrv_call_state *dce_call, TALL
 	num_mapped = 0;
 
 	for (i=0;i<r->in.num_names;i++) {
-		struct ldb_message **res;
-		struct dom_sid *sid;
-		uint32_t atype, rtype;
-
 		r->out.rids->ids[i] = 0;
 		r->out.types->ids[i] = SID_NAME_UNKNOWN;
+	}
 
-		count = gendb_search(d_state->sam_ctx, mem_ctx, d_state->domain_dn, &res, attrs,
-				     "sAMAccountName=%s",
-				     ldb_binary_encode_string(mem_ctx, r->in.names[i].string));
-		if (count != 1) {
-			status = STATUS_SOME_UNMAPPED;
-			continue;
-		}
+	/*
+	 * Resolve the names in batches with a single search each,
+	 * rather than one search per name.
+	 */
+	matches = talloc_zero_array(mem_ctx, uint32_t, r->in.num_names);
+	if (matches == NULL) {
+		return NT_STATUS_NO_MEMORY;
+	}
 
-		sid = samdb_result_dom_sid(mem_ctx, res[0], "objectSid");
-		if (sid == NULL) {
-			status = STATUS_SOME_UNMAPPED;
+	for (i=0;i<r->in.num_names;i+=SAMR_LOOKUP_NAMES_BATCH) {
+		uint32_t batch = MIN(r->in.num_names - i,
+				     SAMR_LOOKUP_NAMES_BATCH);
+		struct ldb_message **res = NULL;
+		char *filter = NULL;
+		uint32_t num_filter = 0;
+		uint32_t j;
+		int k;
+
+		filter = talloc_strdup(mem_ctx, "(|");
+		for (j = 0; j < batch; j++) {
+			const char *name = r->in.names[i + j].string;
+
+			if (name == NULL) {
+				continue;
+			}
+			talloc_asprintf_addbuf(&filter, "(sAMAccountName=%s)",
+					       ldb_binary_encode_string(mem_ctx,
+									name));
+			num_filter++;
+		}
+		talloc_asprintf_addbuf(&filter, ")");
+		if (filter == NULL) {
+			return NT_STATUS_NO_MEMORY;
+		}
+		if (num_filter == 0) {
+			talloc_free(filter);
 			continue;
 		}
 
-		atype = ldb_msg_find_attr_as_uint(res[0], "sAMAccountType", 0);
-		if (atype == 0) {
-			status = STATUS_SOME_UNMAPPED;
-			continue;
+		count = gendb_search(d_state->sam_ctx, mem_ctx,
+				     d_state->domain_dn, &res, attrs,
+				     "%s", filter);
+		if (count < 0) {
+			count = 0;
 		}
 
-		rtype = ds_atype_map(atype);
+		for (k = 0; k < count; k++) {
+			const char *account_name = NULL;
+			struct dom_sid *sid;
+			uint32_t atype, rtype;
+
+			account_name = ldb_msg_find_attr_as_string(
+				res[k], "sAMAccountName", NULL);
+			if (account_name == NULL) {
+				continue;
+			}
+
+			sid = samdb_result_dom_sid(mem_ctx, res[k], "objectSid");
+			atype = ldb_msg_find_attr_as_uint(res[k], "sAMAccountType", 0);
+			rtype = ds_atype_map(atype);
+
+			for (j = 0; j < batch; j++) {
+				const char *name = r->in.names[i + j].string;
+
+				if (name == NULL ||
+				    strcasecmp_m(name, account_name) != 0) {
+					continue;
+				}
+
+				/*
+				 * As with a search per name, an ambiguous
+				 * name is left unmapped.
+				 */
+				matches[i + j]++;
+				if (matches[i + j] > 1 ||
+				    sid == NULL ||
+				    rtype == SID_NAME_UNKNOWN) {
+					r->out.rids->ids[i + j] = 0;
+					r->out.types->ids[i + j] = SID_NAME_UNKNOWN;
+					continue;
+				}
 
-		if (rtype == SID_NAME_UNKNOWN) {
+				r->out.rids->ids[i + j] =
+					sid->sub_auths[sid->num_auths-1];
+				r->out.types->ids[i + j] = rtype;
+			}
+		}
+		talloc_free(res);
+		talloc_free(filter);
+	}
+
+	for (i=0;i<r->in.num_names;i++) {
+		if (r->out.types->ids[i] == SID_NAME_UNKNOWN) {
 			status = STATUS_SOME_UNMAPPED;
 			continue;
 		}
-
-		r->out.rids->ids[i] = sid->sub_auths[sid->num_auths-1];
-		r->out.types->ids[i] = rtype;
 		num_mapped++;
 	}
 
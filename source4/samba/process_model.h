@@ -33,7 +33,8 @@
  * with a comment and maybe update struct process_model_critical_sizes.
  */
 /* version 1 - initial version - metze */
-#define PROCESS_MODEL_VERSION 1
+/* version 2 - add listen_reuseport */
+#define PROCESS_MODEL_VERSION 2
 
 /* the process model operations structure - contains function pointers to 
    the model-specific implementations of each operation */
@@ -79,6 +80,13 @@ struct model_ops {
 
 	/* function to set a title for the connection or task */
 	void (*set_title)(struct tevent_context *, const char *title);
+
+	/*
+	 * optional, return true if listening sockets should be
+	 * created with SO_REUSEPORT, see
+	 * stream_setup_reuseport_listeners()
+	 */
+	bool (*listen_reuseport)(struct loadparm_context *lp_ctx);
 };
 
 /* this structure is used by modules to determine the size of some critical types */
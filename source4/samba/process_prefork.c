@@ -31,9 +31,17 @@
  * doesn't handle the server workload (i.e. processing messages) itself, but is
  * responsible for restarting workers if they exit unexpectedly. The top-level
  * samba process is responsible for restarting the master process if it exits.
+ *
+ * By default the workers all accept connections from the listening sockets
+ * of the master. With 'prefork:reuseport = yes' every worker gets listening
+ * sockets of its own, and with 'prefork:cpu affinity = yes' the workers are
+ * pinned to a CPU each.
  */
 #include "includes.h"
 #include <unistd.h>
+#ifdef HAVE_SCHED_SETAFFINITY
+#include <sched.h>
+#endif
 
 #include "lib/events/events.h"
 #include "lib/messaging/messaging.h"
@@ -158,6 +166,70 @@ static void prefork_reload_after_fork(void)
 	force_check_log_size();
 }
 
+/*
+ * With "prefork:reuseport = yes" each worker listens on sockets of its
+ * own, bound with SO_REUSEPORT, so the kernel balances the connections
+ * over the workers.
+ */
+static bool prefork_listen_reuseport(struct loadparm_context *lp_ctx)
+{
+	return lpcfg_parm_bool(lp_ctx, NULL, "prefork", "reuseport", false);
+}
+
+/*
+ * With "prefork:cpu affinity = yes" worker n is pinned to the n-th
+ * CPU the master is allowed to run on, wrapping around if there are
+ * more workers than CPUs.
+ */
+static void prefork_set_cpu_affinity(struct loadparm_context *lp_ctx,
+				     const char *service_name,
+				     unsigned instance)
+{
+#ifdef HAVE_SCHED_SETAFFINITY
+	cpu_set_t allowed;
+	cpu_set_t cpuset;
+	int num_cpus;
+	int cpu;
+	int n;
+	int ret;
+
+	if (!lpcfg_parm_bool(lp_ctx, NULL, "prefork", "cpu affinity", false)) {
+		return;
+	}
+
+	ret = sched_getaffinity(0, sizeof(allowed), &allowed);
+	if (ret != 0) {
+		DBG_WARNING("sched_getaffinity failed: %s\n", strerror(errno));
+		return;
+	}
+	num_cpus = CPU_COUNT(&allowed);
+	if (num_cpus == 0) {
+		return;
+	}
+
+	n = instance % num_cpus;
+	for (cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+		if (!CPU_ISSET(cpu, &allowed)) {
+			continue;
+		}
+		if (n-- == 0) {
+			break;
+		}
+	}
+
+	CPU_ZERO(&cpuset);
+	CPU_SET(cpu, &cpuset);
+	ret = sched_setaffinity(0, sizeof(cpuset), &cpuset);
+	if (ret != 0) {
+		DBG_WARNING("Unable to pin [%s] worker(%u) to CPU %d: %s\n",
+			    service_name, instance, cpu, strerror(errno));
+		return;
+	}
+	DBG_INFO("Pinned [%s] worker(%u) to CPU %d\n",
+		 service_name, instance, cpu);
+#endif
+}
+
 /*
  * clean up any messaging associated with the old process.
  *
@@ -752,6 +824,12 @@ static void prefork_fork_worker(struct task_server *task,
 {
 	struct tfork *w = NULL;
 	pid_t pid;
+	struct timespec start_time;
+
+	clock_gettime_mono(&start_time);
+	if (service_details->pre_fork != NULL) {
+		service_details->pre_fork(task, pd);
+	}
 
 	w = tfork_create();
 	if (w == NULL) {
@@ -796,6 +874,12 @@ static void prefork_fork_worker(struct task_server *task,
 		}
 		tevent_fd_set_auto_close(fde);
 	} else {
+		struct timespec forked_time;
+		struct timespec reinit_time;
+		struct timespec post_fork_time;
+		struct timespec ready_time;
+
+		clock_gettime_mono(&forked_time);
 
 		/*
 		 * we're the child (prefork-worker). We never write to the
@@ -819,9 +903,26 @@ static void prefork_fork_worker(struct task_server *task,
 				  pd->instances);
 
 		prefork_reload_after_fork();
+		prefork_set_cpu_affinity(lp_ctx, service_name, pd->instances);
+		clock_gettime_mono(&reinit_time);
 		if (service_details->post_fork != NULL) {
 			service_details->post_fork(task, pd);
 		}
+		{
+			NTSTATUS status = stream_setup_reuseport_listeners();
+			if (!NT_STATUS_IS_OK(status)) {
+				/*
+				 * Not fatal, the sockets of the master
+				 * are still served
+				 */
+				DBG_ERR("Worker [%s](%d) failed to set up "
+					"SO_REUSEPORT listeners: %s\n",
+					service_name,
+					pd->instances,
+					nt_errstr(status));
+			}
+		}
+		clock_gettime_mono(&post_fork_time);
 		{
 			struct talloc_ctx *ctx = talloc_new(NULL);
 			char *name = NULL;
@@ -838,6 +939,19 @@ static void prefork_fork_worker(struct task_server *task,
 		if (service_details->before_loop != NULL) {
 			service_details->before_loop(task);
 		}
+		clock_gettime_mono(&ready_time);
+
+		DBG_NOTICE("Pre-forked worker [%s](%d) ready after %.3f "
+			   "seconds: pre_fork %.3f, reinit %.3f, "
+			   "post_fork %.3f, before_loop %.3f\n",
+			   service_name,
+			   pd->instances,
+			   timespec_elapsed2(&start_time, &ready_time),
+			   timespec_elapsed2(&start_time, &forked_time),
+			   timespec_elapsed2(&forked_time, &reinit_time),
+			   timespec_elapsed2(&reinit_time, &post_fork_time),
+			   timespec_elapsed2(&post_fork_time, &ready_time));
+
 		tevent_loop_wait(ev2);
 		imessaging_dgm_unref_ev(ev2);
 		talloc_free(ev2);
@@ -910,6 +1024,7 @@ static const struct model_ops prefork_ops = {
 	.terminate_task		= prefork_terminate_task,
 	.terminate_connection	= prefork_terminate_connection,
 	.set_title		= prefork_set_title,
+	.listen_reuseport	= prefork_listen_reuseport,
 };
 
 /*
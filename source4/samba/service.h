@@ -102,6 +102,18 @@ struct service_details {
 	 * and/or event handlers on the correct contexts.
 	 */
 	void (*before_loop) (struct task_server *);
+	/*
+	 * This is only called in the prefork process model with
+	 * inhibit_pre_fork = false, in the service master process
+	 * right before each service worker is forked, including when
+	 * a worker that died is restarted:
+	 *   task_init(master) -> before_loop(master)
+	 *   -> pre_fork(master) -> post_fork(worker) -> before_loop(worker)
+	 *
+	 * State brought up to date here is inherited by the worker,
+	 * instead of each worker building it again.
+	 */
+	void (*pre_fork) (struct task_server *, struct process_details *);
 };
 
 NTSTATUS samba_service_init(void);
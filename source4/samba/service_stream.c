@@ -29,6 +29,7 @@
 #include "param/param.h"
 #include "../lib/tsocket/tsocket.h"
 #include "lib/util/util_net.h"
+#include "lib/util/dlinklist.h"
 
 /* size of listen() backlog in smbd */
 #define SERVER_LISTEN_BACKLOG 10
@@ -45,8 +46,19 @@ struct stream_socket {
 	struct socket_context *sock;
 	void *private_data;
 	void *process_context;
+
+	/* only set for sockets listening with SO_REUSEPORT */
+	struct stream_socket *prev, *next;
+	struct socket_address *address;
+	const char *socket_options;
 };
 
+/*
+ * The SO_REUSEPORT sockets of this process, they are inherited by
+ * the children of a process model
+ */
+static struct stream_socket *reuseport_sockets;
+
 
 /*
   close the socket and shutdown a stream_connection
@@ -272,6 +284,12 @@ static void stream_accept_handler(struct tevent_context *ev, struct tevent_fd *f
 		stream_socket->process_context);
 }
 
+static int stream_socket_reuseport_destructor(struct stream_socket *s)
+{
+	DLIST_REMOVE(reuseport_sockets, s);
+	return 0;
+}
+
 /*
   setup a listen stream socket
   if you pass *port == 0, then a port > 1024 is used
@@ -298,6 +316,7 @@ NTSTATUS stream_setup_socket(TALLOC_CTX *mem_ctx,
 	struct tevent_fd *fde;
 	int i;
 	struct sockaddr_storage ss;
+	bool reuseport = false;
 
 	stream_socket = talloc_zero(mem_ctx, struct stream_socket);
 	NT_STATUS_HAVE_NO_MEMORY(stream_socket);
@@ -344,6 +363,22 @@ NTSTATUS stream_setup_socket(TALLOC_CTX *mem_ctx,
 		NT_STATUS_NOT_OK_RETURN(status);
 	}
 
+#ifdef SO_REUSEPORT
+	/*
+	 * Only for IP sockets, a unix domain socket can only have
+	 * one listener
+	 */
+	if (port != NULL &&
+	    model_ops->listen_reuseport != NULL &&
+	    model_ops->listen_reuseport(lp_ctx)) {
+		status = socket_set_option(stream_socket->sock,
+					   "SO_REUSEPORT",
+					   NULL);
+		NT_STATUS_NOT_OK_RETURN(status);
+		reuseport = true;
+	}
+#endif
+
 	/* TODO: set socket ACL's (host allow etc) here when they're
 	 * implemented */
 
@@ -400,6 +435,97 @@ NTSTATUS stream_setup_socket(TALLOC_CTX *mem_ctx,
 	stream_socket->model_ops        = model_ops;
 	stream_socket->process_context  = process_context;
 
+	if (reuseport) {
+		/* the address actually bound, with the port chosen */
+		stream_socket->address = socket_get_my_addr(stream_socket->sock,
+							    stream_socket);
+		NT_STATUS_HAVE_NO_MEMORY(stream_socket->address);
+		if (socket_options != NULL) {
+			stream_socket->socket_options =
+				talloc_strdup(stream_socket, socket_options);
+			NT_STATUS_HAVE_NO_MEMORY(stream_socket->socket_options);
+		}
+		DLIST_ADD_END(reuseport_sockets, stream_socket);
+		talloc_set_destructor(stream_socket,
+				      stream_socket_reuseport_destructor);
+	}
+
+	return NT_STATUS_OK;
+}
+
+/*
+  open an additional listener in this process for each of the
+  SO_REUSEPORT sockets it inherited. The kernel then distributes the
+  new connections over the processes, rather than waking all of them
+  for each connection on the shared socket.
+
+  The inherited sockets are still served, the connections already
+  queued on them would be lost otherwise.
+*/
+NTSTATUS stream_setup_reuseport_listeners(void)
+{
+	struct stream_socket *s = NULL;
+
+	for (s = reuseport_sockets; s != NULL; s = s->next) {
+		struct stream_socket *l = NULL;
+		struct tevent_fd *fde = NULL;
+		NTSTATUS status;
+
+		l = talloc_zero(s, struct stream_socket);
+		NT_STATUS_HAVE_NO_MEMORY(l);
+
+		status = socket_create(l, s->address->family,
+				       SOCKET_TYPE_STREAM,
+				       &l->sock, 0);
+		if (!NT_STATUS_IS_OK(status)) {
+			TALLOC_FREE(l);
+			return status;
+		}
+
+		status = socket_set_option(l->sock, "SO_KEEPALIVE", NULL);
+		if (NT_STATUS_IS_OK(status) && s->socket_options != NULL) {
+			status = socket_set_option(l->sock,
+						   s->socket_options,
+						   NULL);
+		}
+		if (NT_STATUS_IS_OK(status)) {
+			status = socket_set_option(l->sock,
+						   "SO_REUSEPORT",
+						   NULL);
+		}
+		if (NT_STATUS_IS_OK(status)) {
+			status = socket_listen(l->sock, s->address,
+					       SERVER_LISTEN_BACKLOG, 0);
+		}
+		if (!NT_STATUS_IS_OK(status)) {
+			DBG_ERR("Failed to listen on %s:%d - %s\n",
+				s->address->addr,
+				s->address->port,
+				nt_errstr(status));
+			TALLOC_FREE(l);
+			return status;
+		}
+
+		fde = tevent_add_fd(s->event_ctx, l->sock,
+				    socket_get_fd(l->sock),
+				    TEVENT_FD_READ,
+				    stream_accept_handler, l);
+		if (fde == NULL) {
+			DBG_ERR("Failed to setup fd event\n");
+			TALLOC_FREE(l);
+			return NT_STATUS_NO_MEMORY;
+		}
+		tevent_fd_set_close_fn(fde, socket_tevent_fd_close_fn);
+		socket_set_flags(l->sock, SOCKET_FLAG_NOCLOSE);
+
+		l->lp_ctx          = s->lp_ctx;
+		l->private_data    = s->private_data;
+		l->ops             = s->ops;
+		l->event_ctx       = s->event_ctx;
+		l->model_ops       = s->model_ops;
+		l->process_context = s->process_context;
+	}
+
 	return NT_STATUS_OK;
 }
 
@@ -444,6 +444,8 @@ smb2_s3only = [
     "smb2.ea",
     "smb2.create_no_streams",
     "smb2.streams",
+    "smb2.compression",
+    "smb2.acls_access_check_cache",
 ]
 smb2 = [x for x in smbtorture4_testsuites("smb2.") if x not in smb2_s3only]
 
@@ -1095,6 +1097,8 @@ for env in ["nt4_dc", "nt4_member", "ad_dc", "ad_member", "chgdcpass", "rodc"]:
 
     planpythontestsuite(env + ":local", "samba.tests.ntlm_auth")
 
+planpythontestsuite("ad_member_idmap_rid:local", "samba.tests.ntlm_auth_cache")
+
 plantestsuite(
     "samba.wbinfo_u_large_ad.(ad_dc:local)",
     "ad_dc:local",
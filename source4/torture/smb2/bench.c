@@ -128,6 +128,160 @@
 		       __location__, (unsigned int)(sattrib), fname); \
 	}} while (0)
 
+/*
+ * Log-linear latency histogram in microseconds, similar to
+ * HdrHistogram: each power of two is split into
+ * BENCH_HIST_SUB_BUCKETS linear buckets, so every value is
+ * recorded with a precision of about 6%.
+ */
+#define BENCH_HIST_SUB_BITS 4
+#define BENCH_HIST_SUB_BUCKETS (1 << BENCH_HIST_SUB_BITS)
+#define BENCH_HIST_BUCKETS (64 * BENCH_HIST_SUB_BUCKETS)
+
+struct test_smb2_bench_histogram {
+	uint64_t count;
+	uint64_t buckets[BENCH_HIST_BUCKETS];
+};
+
+static size_t test_smb2_bench_histogram_idx(uint64_t usec)
+{
+	unsigned msb;
+
+	if (usec < BENCH_HIST_SUB_BUCKETS) {
+		return usec;
+	}
+
+	for (msb = 63; (usec & (UINT64_C(1) << msb)) == 0; msb--) {
+		;
+	}
+
+	return (msb - BENCH_HIST_SUB_BITS + 1) * BENCH_HIST_SUB_BUCKETS +
+		((usec >> (msb - BENCH_HIST_SUB_BITS)) &
+		 (BENCH_HIST_SUB_BUCKETS - 1));
+}
+
+static double test_smb2_bench_histogram_value(size_t idx)
+{
+	size_t e = idx / BENCH_HIST_SUB_BUCKETS;
+	size_t m = idx % BENCH_HIST_SUB_BUCKETS;
+	uint64_t lower, width;
+
+	if (e == 0) {
+		return idx / 1000000.0;
+	}
+
+	lower = (uint64_t)(BENCH_HIST_SUB_BUCKETS + m) << (e - 1);
+	width = UINT64_C(1) << (e - 1);
+
+	/* report the middle of the bucket, in seconds */
+	return (lower + width / 2) / 1000000.0;
+}
+
+static void test_smb2_bench_histogram_add(
+	struct test_smb2_bench_histogram *h, double latency)
+{
+	uint64_t usec = latency * 1000000;
+
+	h->buckets[test_smb2_bench_histogram_idx(usec)] += 1;
+	h->count += 1;
+}
+
+static double test_smb2_bench_histogram_percentile(
+	const struct test_smb2_bench_histogram *h, double percentile)
+{
+	double t = h->count * percentile / 100.0;
+	uint64_t target = t;
+	uint64_t sum = 0;
+	size_t i;
+
+	if (h->count == 0) {
+		return 0.0;
+	}
+	if (target < t) {
+		target += 1;
+	}
+	target = MAX(target, 1);
+
+	for (i = 0; i < BENCH_HIST_BUCKETS; i++) {
+		sum += h->buckets[i];
+		if (sum >= target) {
+			return test_smb2_bench_histogram_value(i);
+		}
+	}
+
+	return test_smb2_bench_histogram_value(BENCH_HIST_BUCKETS - 1);
+}
+
+/*
+ * Print the latency percentiles of one operation and, if the
+ * "bench_json" option names a file, append a JSON line with the
+ * results to it, so that runs can be compared by scripts.
+ */
+static void test_smb2_bench_report(struct torture_context *tctx,
+				   const char *op,
+				   int timelimit,
+				   uint64_t num_finished,
+				   uint64_t num_bytes,
+				   double total_latency,
+				   double min_latency,
+				   double max_latency,
+				   const struct test_smb2_bench_histogram *h)
+{
+	const char *path = torture_setting_string(tctx, "bench_json", NULL);
+	const char *test = "";
+	double p50 = test_smb2_bench_histogram_percentile(h, 50);
+	double p90 = test_smb2_bench_histogram_percentile(h, 90);
+	double p99 = test_smb2_bench_histogram_percentile(h, 99);
+	double p999 = test_smb2_bench_histogram_percentile(h, 99.9);
+	double avs_latency = 0;
+	FILE *f = NULL;
+
+	torture_comment(tctx,
+			"%s[p50=%.6f,p90=%.6f,p99=%.6f,p99.9=%.6f]\n",
+			op, p50, p90, p99, p999);
+
+	if (path == NULL || path[0] == '\0') {
+		return;
+	}
+
+	if (tctx->active_test != NULL) {
+		test = tctx->active_test->name;
+	}
+	if (num_finished != 0) {
+		avs_latency = total_latency / num_finished;
+	}
+	timelimit = MAX(timelimit, 1);
+
+	f = fopen(path, "a");
+	if (f == NULL) {
+		torture_warning(tctx, "Failed to open %s: %s\n",
+				path, strerror(errno));
+		return;
+	}
+
+	fprintf(f,
+		"{\"test\": \"%s\", \"op\": \"%s\", "
+		"\"nprocs\": %d, \"qdepth\": %d, \"seconds\": %d, "
+		"\"num\": %llu, \"num_per_sec\": %.2f, "
+		"\"bytes_per_sec\": %.2f, "
+		"\"avs_latency\": %.6f, \"min_latency\": %.6f, "
+		"\"max_latency\": %.6f, \"p50\": %.6f, \"p90\": %.6f, "
+		"\"p99\": %.6f, \"p99.9\": %.6f}\n",
+		test,
+		op,
+		torture_setting_int(tctx, "nprocs", 4),
+		torture_setting_int(tctx, "qdepth", 1),
+		timelimit,
+		(unsigned long long)num_finished,
+		(double)num_finished / timelimit,
+		(double)num_bytes / timelimit,
+		avs_latency,
+		min_latency,
+		max_latency,
+		p50, p90, p99, p999);
+	fclose(f);
+}
+
 /*
    stress testing keepalive iops
  */
@@ -149,6 +303,7 @@ struct test_smb2_bench_echo_state {
 	double total_latency;
 	double min_latency;
 	double max_latency;
+	struct test_smb2_bench_histogram hist;
 	bool ok;
 	bool stop;
 };
@@ -229,6 +384,7 @@ static void test_smb2_bench_echo_loop_done(struct tevent_req *req)
 	torture_assert_ntstatus_ok_goto(state->tctx, loop->error,
 					state->ok, asserted, __location__);
 	SMB_ASSERT(latency >= 0.000001);
+	test_smb2_bench_histogram_add(&state->hist, latency);
 
 	if (loop->num_finished == 0) {
 		/* first round */
@@ -355,6 +511,15 @@ static void test_smb2_bench_echo_progress(struct tevent_context *ev,
 			avs_echo_latency,
 			state->min_latency,
 			state->max_latency);
+	test_smb2_bench_report(state->tctx,
+			       "echo",
+			       state->timelimit,
+			       state->num_finished,
+			       0,
+			       state->total_latency,
+			       state->min_latency,
+			       state->max_latency,
+			       &state->hist);
 
 asserted:
 	state->stop = true;
@@ -505,12 +670,14 @@ struct test_smb2_bench_path_contention_shared_state {
 		double total_latency;
 		double min_latency;
 		double max_latency;
+		struct test_smb2_bench_histogram hist;
 	} opens;
 	struct {
 		uint64_t num_finished;
 		double total_latency;
 		double min_latency;
 		double max_latency;
+		struct test_smb2_bench_histogram hist;
 	} closes;
 	bool ok;
 	bool stop;
@@ -603,6 +770,7 @@ static void test_smb2_bench_path_contention_loop_opened(struct smb2_request *req
 					state->ok, asserted, __location__);
 	ZERO_STRUCT(loop->opens.io.out.blobs);
 	SMB_ASSERT(latency >= 0.000001);
+	test_smb2_bench_histogram_add(&state->opens.hist, latency);
 
 	if (loop->opens.num_finished == 0) {
 		/* first round */
@@ -664,6 +832,7 @@ static void test_smb2_bench_path_contention_loop_closed(struct smb2_request *req
 	torture_assert_ntstatus_ok_goto(state->tctx, loop->error,
 					state->ok, asserted, __location__);
 	SMB_ASSERT(latency >= 0.000001);
+	test_smb2_bench_histogram_add(&state->closes.hist, latency);
 	if (loop->closes.num_finished == 0) {
 		/* first round */
 		loop->closes.min_latency = latency;
@@ -827,6 +996,24 @@ static void test_smb2_bench_path_contention_progress(struct tevent_context *ev,
 			avs_close_latency,
 			state->closes.min_latency,
 			state->closes.max_latency);
+	test_smb2_bench_report(state->tctx,
+			       "open",
+			       state->timelimit,
+			       state->opens.num_finished,
+			       0,
+			       state->opens.total_latency,
+			       state->opens.min_latency,
+			       state->opens.max_latency,
+			       &state->opens.hist);
+	test_smb2_bench_report(state->tctx,
+			       "close",
+			       state->timelimit,
+			       state->closes.num_finished,
+			       0,
+			       state->closes.total_latency,
+			       state->closes.min_latency,
+			       state->closes.max_latency,
+			       &state->closes.hist);
 
 asserted:
 	state->stop = true;
@@ -986,6 +1173,7 @@ struct test_smb2_bench_read_state {
 	double total_latency;
 	double min_latency;
 	double max_latency;
+	struct test_smb2_bench_histogram hist;
 	bool ok;
 	bool stop;
 };
@@ -1083,6 +1271,7 @@ static void test_smb2_bench_read_loop_done(struct tevent_req *req)
 	torture_assert_u32_equal_goto(state->tctx, data_length, state->io_size,
 					state->ok, asserted, __location__);
 	SMB_ASSERT(latency >= 0.000001);
+	test_smb2_bench_histogram_add(&state->hist, latency);
 
 	if (loop->num_finished == 0) {
 		/* first round */
@@ -1211,6 +1400,15 @@ static void test_smb2_bench_read_progress(struct tevent_context *ev,
 			avs_read_latency,
 			state->min_latency,
 			state->max_latency);
+	test_smb2_bench_report(state->tctx,
+			       "read",
+			       state->timelimit,
+			       state->num_finished,
+			       state->num_finished * state->io_size,
+			       state->total_latency,
+			       state->min_latency,
+			       state->max_latency,
+			       &state->hist);
 
 asserted:
 	state->stop = true;
@@ -1409,12 +1607,14 @@ struct test_smb2_bench_session_setup_shared_state {
 		double total_latency;
 		double min_latency;
 		double max_latency;
+		struct test_smb2_bench_histogram hist;
 	} setups;
 	struct {
 		uint64_t num_finished;
 		double total_latency;
 		double min_latency;
 		double max_latency;
+		struct test_smb2_bench_histogram hist;
 	} logoffs;
 	bool ok;
 	bool stop;
@@ -1520,6 +1720,7 @@ static void test_smb2_bench_session_setup_loop_done_setup(struct tevent_req *sub
 	torture_assert_ntstatus_ok_goto(state->tctx, loop->error,
 					state->ok, asserted, __location__);
 	SMB_ASSERT(latency >= 0.000001);
+	test_smb2_bench_histogram_add(&state->setups.hist, latency);
 
 	if (loop->setups.num_finished == 0) {
 		/* first round */
@@ -1581,6 +1782,7 @@ static void test_smb2_bench_session_setup_loop_done_logoff(struct smb2_request *
 					state->ok, asserted, __location__);
 	TALLOC_FREE(loop->session);
 	SMB_ASSERT(latency >= 0.000001);
+	test_smb2_bench_histogram_add(&state->logoffs.hist, latency);
 	if (loop->logoffs.num_finished == 0) {
 		/* first round */
 		loop->logoffs.min_latency = latency;
@@ -1744,6 +1946,24 @@ static void test_smb2_bench_session_setup_progress(struct tevent_context *ev,
 			avs_logoff_latency,
 			state->logoffs.min_latency,
 			state->logoffs.max_latency);
+	test_smb2_bench_report(state->tctx,
+			       "setup",
+			       state->timelimit,
+			       state->setups.num_finished,
+			       0,
+			       state->setups.total_latency,
+			       state->setups.min_latency,
+			       state->setups.max_latency,
+			       &state->setups.hist);
+	test_smb2_bench_report(state->tctx,
+			       "logoff",
+			       state->timelimit,
+			       state->logoffs.num_finished,
+			       0,
+			       state->logoffs.total_latency,
+			       state->logoffs.min_latency,
+			       state->logoffs.max_latency,
+			       &state->logoffs.hist);
 
 asserted:
 	state->stop = true;
@@ -1869,6 +2089,1151 @@ static bool test_smb2_bench_session_setup(struct torture_context *tctx,
 	return ret;
 }
 
+/*
+ * List a directory the way macOS Finder does with vfs_fruit: enumerate
+ * it, then open every file and query its streams. Every file carries
+ * a small metadata stream and a larger resource fork like stream.
+ */
+static bool test_smb2_bench_stream_listing(struct torture_context *tctx,
+					   struct smb2_tree *tree)
+{
+	int nfiles = torture_setting_int(tctx, "nfiles", 100);
+	int timelimit = torture_setting_int(tctx, "timelimit", 10);
+	const char *dname = "bench_stream_listing_dir";
+	uint8_t meta[60] = { 'A', 'F', 'P', 0, };
+	uint8_t rsrc[4096] = { 0, };
+	struct timeval starttime;
+	uint64_t num_listings = 0;
+	uint64_t num_files = 0;
+	double elapsed;
+	union smb_fsinfo info;
+	struct smb2_handle dh;
+	bool ret = true;
+	NTSTATUS status;
+	int i;
+
+	smb2_deltree(tree, dname);
+
+	status = torture_smb2_testdir(tree, dname, &dh);
+	CHECK_STATUS(status, NT_STATUS_OK);
+
+	ZERO_STRUCT(info);
+	info.generic.level = RAW_QFS_ATTRIBUTE_INFORMATION;
+	info.generic.handle = dh;
+	status = smb2_getinfo_fs(tree, tree, &info);
+	CHECK_STATUS(status, NT_STATUS_OK);
+	if (!(info.attribute_info.out.fs_attr & FILE_NAMED_STREAMS)) {
+		smb2_util_close(tree, dh);
+		smb2_deltree(tree, dname);
+		torture_skip(tctx, "No FILE_NAMED_STREAMS supported");
+	}
+
+	torture_comment(tctx, "Creating %d files with streams\n", nfiles);
+
+	for (i = 0; i < nfiles; i++) {
+		struct smb2_handle h;
+		char *fname = NULL;
+		char *sname = NULL;
+
+		fname = talloc_asprintf(tctx, "%s\\file_%d.dat", dname, i);
+		torture_assert(tctx, fname != NULL, __location__);
+
+		status = torture_smb2_testfile(tree, fname, &h);
+		CHECK_STATUS(status, NT_STATUS_OK);
+		status = smb2_util_close(tree, h);
+		CHECK_STATUS(status, NT_STATUS_OK);
+
+		sname = talloc_asprintf(tctx, "%s:bench_info", fname);
+		torture_assert(tctx, sname != NULL, __location__);
+		status = torture_smb2_testfile(tree, sname, &h);
+		CHECK_STATUS(status, NT_STATUS_OK);
+		status = smb2_util_write(tree, h, meta, 0, sizeof(meta));
+		CHECK_STATUS(status, NT_STATUS_OK);
+		status = smb2_util_close(tree, h);
+		CHECK_STATUS(status, NT_STATUS_OK);
+		TALLOC_FREE(sname);
+
+		sname = talloc_asprintf(tctx, "%s:bench_rsrc", fname);
+		torture_assert(tctx, sname != NULL, __location__);
+		status = torture_smb2_testfile(tree, sname, &h);
+		CHECK_STATUS(status, NT_STATUS_OK);
+		status = smb2_util_write(tree, h, rsrc, 0, sizeof(rsrc));
+		CHECK_STATUS(status, NT_STATUS_OK);
+		status = smb2_util_close(tree, h);
+		CHECK_STATUS(status, NT_STATUS_OK);
+		TALLOC_FREE(sname);
+		TALLOC_FREE(fname);
+	}
+
+	torture_comment(tctx, "Running for %d seconds\n", timelimit);
+
+	starttime = timeval_current();
+
+	while (timeval_elapsed(&starttime) < timelimit) {
+		TALLOC_CTX *frame = talloc_new(tctx);
+		struct smb2_find f = {
+			.in.file.handle = dh,
+			.in.pattern = "*",
+			.in.continue_flags = SMB2_CONTINUE_FLAG_REOPEN,
+			.in.max_response_size = 0x10000,
+			.in.level = SMB2_FIND_ID_BOTH_DIRECTORY_INFO,
+		};
+		union smb_search_data *d = NULL;
+		unsigned int count;
+		unsigned int j;
+
+		do {
+			status = smb2_find_level(tree, frame, &f, &count, &d);
+			if (NT_STATUS_EQUAL(status, STATUS_NO_MORE_FILES)) {
+				break;
+			}
+			torture_assert_ntstatus_ok_goto(tctx, status, ret,
+							done, "smb2_find_level");
+
+			for (j = 0; j < count; j++) {
+				const char *name =
+					d[j].id_both_directory_info.name.s;
+				union smb_fileinfo finfo;
+				struct smb2_create cr;
+				char *fname = NULL;
+
+				if (strcmp(name, ".") == 0 ||
+				    strcmp(name, "..") == 0) {
+					continue;
+				}
+
+				fname = talloc_asprintf(frame, "%s\\%s",
+							dname, name);
+				torture_assert_goto(tctx, fname != NULL,
+						    ret, done, __location__);
+
+				cr = (struct smb2_create) {
+					.in.desired_access =
+						SEC_FILE_READ_ATTRIBUTE,
+					.in.share_access =
+						NTCREATEX_SHARE_ACCESS_MASK,
+					.in.create_disposition =
+						NTCREATEX_DISP_OPEN,
+					.in.impersonation_level =
+					     SMB2_IMPERSONATION_IMPERSONATION,
+					.in.fname = fname,
+				};
+				status = smb2_create(tree, frame, &cr);
+				torture_assert_ntstatus_ok_goto(
+					tctx, status, ret, done, "smb2_create");
+
+				finfo = (union smb_fileinfo) {
+					.generic.level =
+					     RAW_FILEINFO_STREAM_INFORMATION,
+					.generic.in.file.handle =
+						cr.out.file.handle,
+				};
+				status = smb2_getinfo_file(tree, frame, &finfo);
+				torture_assert_ntstatus_ok_goto(
+					tctx, status, ret, done,
+					"smb2_getinfo_file");
+				torture_assert_goto(
+					tctx,
+					finfo.stream_info.out.num_streams >= 3,
+					ret, done, "num_streams");
+
+				status = smb2_util_close(tree,
+							 cr.out.file.handle);
+				torture_assert_ntstatus_ok_goto(
+					tctx, status, ret, done,
+					"smb2_util_close");
+
+				num_files += 1;
+			}
+
+			f.in.continue_flags = 0;
+		} while (count != 0);
+
+		num_listings += 1;
+		TALLOC_FREE(frame);
+	}
+
+	elapsed = timeval_elapsed(&starttime);
+	torture_comment(tctx,
+			"%.2f seconds: listings/s=%.2f files/s=%.2f\n",
+			elapsed,
+			num_listings / elapsed,
+			num_files / elapsed);
+
+done:
+	smb2_util_close(tree, dh);
+	smb2_deltree(tree, dname);
+	return ret;
+}
+
+/*
+   Generic driver for simple request/response workloads
+
+   Every workload only provides the preparation of a loop and the
+   start of a single operation. The driver opens the connections,
+   runs the loops and collects the throughput and latency numbers.
+ */
+
+struct test_smb2_bench_ops_state;
+struct test_smb2_bench_ops_loop;
+
+struct test_smb2_bench_ops {
+	const char *name;
+	const char *dname;
+	bool (*setup)(struct test_smb2_bench_ops_state *state,
+		      struct smb2_tree *tree);
+	bool (*setup_loop)(struct test_smb2_bench_ops_loop *loop);
+	/*
+	 * Start one operation, which calls
+	 * test_smb2_bench_ops_loop_done() once it's finished.
+	 */
+	bool (*start)(struct test_smb2_bench_ops_loop *loop);
+};
+
+struct test_smb2_bench_ops_conn {
+	struct test_smb2_bench_ops_state *state;
+	int idx;
+	struct smb2_tree *tree;
+};
+
+struct test_smb2_bench_ops_state {
+	struct torture_context *tctx;
+	const struct test_smb2_bench_ops *ops;
+	const char *unique;
+	size_t num_conns;
+	struct test_smb2_bench_ops_conn *conns;
+	size_t num_loops;
+	struct test_smb2_bench_ops_loop *loops;
+	size_t pending_loops;
+	uint32_t io_size;
+	uint64_t file_size;
+	bool random_io;
+	int num_files;
+	uint8_t *buf;
+	struct timeval starttime;
+	int timecount;
+	int timelimit;
+	uint64_t interval_finished;
+	uint64_t interval_bytes;
+	double interval_latency;
+	double interval_min_latency;
+	double interval_max_latency;
+	uint64_t num_finished;
+	uint64_t num_bytes;
+	double total_latency;
+	double min_latency;
+	double max_latency;
+	struct test_smb2_bench_histogram hist;
+	bool ok;
+	bool stop;
+};
+
+struct test_smb2_bench_ops_loop {
+	struct test_smb2_bench_ops_state *state;
+	struct test_smb2_bench_ops_conn *conn;
+	int idx;
+	struct tevent_immediate *im;
+	char *fname;
+	struct smb2_handle handle;
+	uint64_t offset;
+	int phase;
+	uint64_t op_bytes;
+	struct smb2_lock lck;
+	struct smb2_lock_element el;
+	struct timeval starttime;
+	uint64_t total_finished;
+	uint64_t max_finished;
+	NTSTATUS error;
+};
+
+static uint32_t test_smb2_bench_ops_timeout(
+	struct test_smb2_bench_ops_loop *loop)
+{
+	return loop->conn->tree->session->transport->options.request_timeout * 1000;
+}
+
+static void test_smb2_bench_ops_loop_do(
+	struct test_smb2_bench_ops_loop *loop);
+
+static void test_smb2_bench_ops_loop_start(struct tevent_context *ctx,
+					   struct tevent_immediate *im,
+					   void *private_data)
+{
+	struct test_smb2_bench_ops_loop *loop =
+		(struct test_smb2_bench_ops_loop *)
+		private_data;
+
+	test_smb2_bench_ops_loop_do(loop);
+}
+
+static void test_smb2_bench_ops_loop_do(
+	struct test_smb2_bench_ops_loop *loop)
+{
+	struct test_smb2_bench_ops_state *state = loop->state;
+	bool ok;
+
+	if (state->stop) {
+		return;
+	}
+
+	loop->starttime = timeval_current();
+	loop->phase = 0;
+	loop->op_bytes = 0;
+
+	ok = state->ops->start(loop);
+	torture_assert_goto(state->tctx, ok,
+			    state->ok, asserted, state->ops->name);
+	return;
+asserted:
+	state->stop = true;
+}
+
+static void test_smb2_bench_ops_loop_done(
+	struct test_smb2_bench_ops_loop *loop)
+{
+	struct test_smb2_bench_ops_state *state = loop->state;
+	double latency = timeval_elapsed(&loop->starttime);
+
+	torture_assert_ntstatus_ok_goto(state->tctx, loop->error,
+					state->ok, asserted,
+					state->ops->name);
+
+	if (state->interval_finished == 0) {
+		state->interval_min_latency = latency;
+		state->interval_max_latency = latency;
+	}
+	if (latency < state->interval_min_latency) {
+		state->interval_min_latency = latency;
+	}
+	if (latency > state->interval_max_latency) {
+		state->interval_max_latency = latency;
+	}
+
+	state->interval_finished += 1;
+	state->interval_bytes += loop->op_bytes;
+	state->interval_latency += latency;
+	test_smb2_bench_histogram_add(&state->hist, latency);
+
+	loop->total_finished += 1;
+	if (loop->total_finished >= loop->max_finished) {
+		if (state->pending_loops > 0) {
+			state->pending_loops -= 1;
+		}
+		if (state->pending_loops == 0) {
+			goto asserted;
+		}
+	}
+
+	test_smb2_bench_ops_loop_do(loop);
+	return;
+asserted:
+	state->stop = true;
+}
+
+static void test_smb2_bench_ops_progress(struct tevent_context *ev,
+					 struct tevent_timer *te,
+					 struct timeval current_time,
+					 void *private_data)
+{
+	struct test_smb2_bench_ops_state *state =
+		(struct test_smb2_bench_ops_state *)private_data;
+	uint64_t num = state->interval_finished;
+	uint64_t bytes = state->interval_bytes;
+	double avs_latency = 0;
+
+	state->timecount += 1;
+
+	if (num != 0) {
+		if (state->num_finished == 0) {
+			state->min_latency = state->interval_min_latency;
+			state->max_latency = state->interval_max_latency;
+		}
+		if (state->interval_min_latency < state->min_latency) {
+			state->min_latency = state->interval_min_latency;
+		}
+		if (state->interval_max_latency > state->max_latency) {
+			state->max_latency = state->interval_max_latency;
+		}
+		avs_latency = state->interval_latency / num;
+	}
+
+	state->num_finished += num;
+	state->num_bytes += bytes;
+	state->total_latency += state->interval_latency;
+
+	if (state->timecount < state->timelimit) {
+		double min_latency = state->interval_min_latency;
+		double max_latency = state->interval_max_latency;
+
+		state->interval_finished = 0;
+		state->interval_bytes = 0;
+		state->interval_latency = 0.0;
+
+		te = tevent_add_timer(state->tctx->ev,
+				      state,
+				      timeval_current_ofs(1, 0),
+				      test_smb2_bench_ops_progress,
+				      state);
+		torture_assert_goto(state->tctx, te != NULL,
+				    state->ok, asserted, "tevent_add_timer");
+
+		if (!torture_setting_bool(state->tctx, "progress", true)) {
+			return;
+		}
+
+		torture_comment(state->tctx,
+				"%.2f second: "
+				"%s[num/s=%llu,bytes/s=%llu,avslat=%.6f,minlat=%.6f,maxlat=%.6f]      \r",
+				timeval_elapsed(&state->starttime),
+				state->ops->name,
+				(unsigned long long)num,
+				(unsigned long long)bytes,
+				avs_latency,
+				min_latency,
+				max_latency);
+		return;
+	}
+
+	avs_latency = 0;
+	if (state->num_finished != 0) {
+		avs_latency = state->total_latency / state->num_finished;
+	}
+
+	torture_comment(state->tctx,
+			"%.2f second: "
+			"%s[num/s=%llu,bytes/s=%llu,avslat=%.6f,minlat=%.6f,maxlat=%.6f]\n",
+			timeval_elapsed(&state->starttime),
+			state->ops->name,
+			(unsigned long long)(state->num_finished / state->timelimit),
+			(unsigned long long)(state->num_bytes / state->timelimit),
+			avs_latency,
+			state->min_latency,
+			state->max_latency);
+	test_smb2_bench_report(state->tctx,
+			       state->ops->name,
+			       state->timelimit,
+			       state->num_finished,
+			       state->num_bytes,
+			       state->total_latency,
+			       state->min_latency,
+			       state->max_latency,
+			       &state->hist);
+
+asserted:
+	state->stop = true;
+}
+
+static bool test_smb2_bench_ops_run(struct torture_context *tctx,
+				    struct smb2_tree *tree,
+				    const struct test_smb2_bench_ops *ops)
+{
+	struct test_smb2_bench_ops_state *state = NULL;
+	int torture_nprocs = torture_setting_int(tctx, "nprocs", 4);
+	int torture_qdepth = torture_setting_int(tctx, "qdepth", 1);
+	int torture_io_size = torture_setting_int(tctx, "io_size", 4096);
+	int looplimit = torture_setting_int(tctx, "looplimit", -1);
+	int timelimit = torture_setting_int(tctx, "timelimit", 10);
+	struct tevent_timer *te = NULL;
+	uint32_t timeout_msec;
+	struct smb2_handle dh;
+	size_t i;
+	size_t li = 0;
+	NTSTATUS status;
+	bool ok;
+
+	smb2_deltree(tree, ops->dname);
+
+	status = torture_smb2_testdir(tree, ops->dname, &dh);
+	CHECK_STATUS(status, NT_STATUS_OK);
+	status = smb2_util_close(tree, dh);
+	CHECK_STATUS(status, NT_STATUS_OK);
+
+	state = talloc_zero(tctx, struct test_smb2_bench_ops_state);
+	torture_assert(tctx, state != NULL, __location__);
+	state->tctx = tctx;
+	state->ops = ops;
+	state->unique = generate_random_str(state, 8);
+	torture_assert(tctx, state->unique != NULL, __location__);
+	state->num_conns = torture_nprocs;
+	state->conns = talloc_zero_array(state,
+			struct test_smb2_bench_ops_conn,
+			state->num_conns);
+	torture_assert(tctx, state->conns != NULL, __location__);
+	state->num_loops = torture_nprocs * torture_qdepth;
+	state->loops = talloc_zero_array(state,
+			struct test_smb2_bench_ops_loop,
+			state->num_loops);
+	torture_assert(tctx, state->loops != NULL, __location__);
+	state->ok = true;
+	state->timelimit = MAX(timelimit, 1);
+	state->io_size = MAX(torture_io_size, 1);
+	state->io_size = MIN(state->io_size, 16*1024*1024);
+	state->file_size = torture_setting_ulong(tctx, "file_size",
+						 64*1024*1024);
+	state->file_size = MAX(state->file_size, state->io_size);
+	state->random_io = torture_setting_bool(tctx, "random_io", false);
+	state->num_files = MAX(torture_setting_int(tctx, "num_files", 10000),
+			       1);
+
+	state->buf = talloc_array(state, uint8_t, state->io_size);
+	torture_assert(tctx, state->buf != NULL, __location__);
+	generate_random_buffer(state->buf, state->io_size);
+
+	if (ops->setup != NULL) {
+		ok = ops->setup(state, tree);
+		torture_assert(tctx, ok, "setup failed");
+	}
+
+	timeout_msec = tree->session->transport->options.request_timeout * 1000;
+
+	torture_comment(tctx, "Opening %zu connections\n", state->num_conns);
+
+	for (i=0;i<state->num_conns;i++) {
+		struct smb2_tree *ct = NULL;
+		DATA_BLOB out_input_buffer = data_blob_null;
+		DATA_BLOB out_output_buffer = data_blob_null;
+		size_t pcli;
+
+		state->conns[i].state = state;
+		state->conns[i].idx = i;
+
+		if (!torture_smb2_connection(tctx, &ct)) {
+			torture_comment(tctx, "Failed opening %zu/%zu connections\n", i, state->num_conns);
+			return false;
+		}
+		state->conns[i].tree = talloc_steal(state->conns, ct);
+
+		smb2cli_conn_set_max_credits(ct->session->transport->conn, 8192);
+		smb2cli_ioctl(ct->session->transport->conn,
+			      timeout_msec,
+			      ct->session->smbXcli,
+			      ct->smbXcli,
+			      UINT64_MAX, /* in_fid_persistent */
+			      UINT64_MAX, /* in_fid_volatile */
+			      UINT32_MAX,
+			      0, /* in_max_input_length */
+			      NULL, /* in_input_buffer */
+			      1, /* in_max_output_length */
+			      NULL, /* in_output_buffer */
+			      SMB2_IOCTL_FLAG_IS_FSCTL,
+			      ct,
+			      &out_input_buffer,
+			      &out_output_buffer);
+		torture_assert(tctx,
+		       smbXcli_conn_is_connected(ct->session->transport->conn),
+		       "smbXcli_conn_is_connected");
+
+		for (pcli = 0; pcli < torture_qdepth; pcli++) {
+			struct test_smb2_bench_ops_loop *loop = &state->loops[li];
+
+			loop->idx = li++;
+			if (looplimit != -1) {
+				loop->max_finished = looplimit;
+			} else {
+				loop->max_finished = UINT64_MAX;
+			}
+			loop->state = state;
+			loop->conn = &state->conns[i];
+			loop->im = tevent_create_immediate(state->loops);
+			torture_assert(tctx, loop->im != NULL, __location__);
+
+			loop->fname = talloc_asprintf(state->loops,
+						"%s\\%s_loop_%zu_conn_%zu_loop_%zu.dat",
+						ops->dname, state->unique, li, i, pcli);
+			torture_assert(tctx, loop->fname != NULL, __location__);
+
+			if (ops->setup_loop != NULL) {
+				ok = ops->setup_loop(loop);
+				torture_assert(tctx, ok, "setup_loop failed");
+			}
+		}
+	}
+
+	for (li = 0; li < state->num_loops; li++) {
+		struct test_smb2_bench_ops_loop *loop = &state->loops[li];
+
+		tevent_schedule_immediate(loop->im,
+					  tctx->ev,
+					  test_smb2_bench_ops_loop_start,
+					  loop);
+	}
+
+	torture_comment(tctx, "Opened %zu connections with qdepth=%d => %zu loops\n",
+			state->num_conns, torture_qdepth, state->num_loops);
+
+	torture_comment(tctx, "Running for %d seconds\n", state->timelimit);
+
+	state->starttime = timeval_current();
+	state->pending_loops = state->num_loops;
+
+	te = tevent_add_timer(tctx->ev,
+			      state,
+			      timeval_current_ofs(1, 0),
+			      test_smb2_bench_ops_progress,
+			      state);
+	torture_assert(tctx, te != NULL, __location__);
+
+	while (!state->stop) {
+		int rc = tevent_loop_once(tctx->ev);
+		torture_assert_int_equal(tctx, rc, 0, "tevent_loop_once");
+	}
+
+	torture_comment(tctx, "%.2f seconds\n", timeval_elapsed(&state->starttime));
+	ok = state->ok;
+	TALLOC_FREE(state);
+	smb2_deltree(tree, ops->dname);
+	return ok;
+}
+
+static bool test_smb2_bench_ops_create(struct test_smb2_bench_ops_loop *loop,
+				       const char *fname,
+				       uint32_t create_disposition,
+				       uint32_t create_options,
+				       bool keep_open)
+{
+	struct torture_context *tctx = loop->state->tctx;
+	struct smb2_tree *tree = loop->conn->tree;
+	struct smb2_create cr;
+	NTSTATUS status;
+
+	ZERO_STRUCT(cr);
+	cr.in.desired_access = SEC_RIGHTS_FILE_ALL;
+	cr.in.file_attributes = FILE_ATTRIBUTE_NORMAL;
+	cr.in.share_access = NTCREATEX_SHARE_ACCESS_READ |
+			     NTCREATEX_SHARE_ACCESS_WRITE |
+			     NTCREATEX_SHARE_ACCESS_DELETE;
+	cr.in.create_disposition = create_disposition;
+	cr.in.create_options = create_options |
+			       NTCREATEX_OPTIONS_NON_DIRECTORY_FILE;
+	cr.in.impersonation_level = SMB2_IMPERSONATION_ANONYMOUS;
+	cr.in.fname = fname;
+	status = smb2_create(tree, tctx, &cr);
+	torture_assert_ntstatus_ok(tctx, status, fname);
+
+	if (keep_open) {
+		loop->handle = cr.out.file.handle;
+		return true;
+	}
+
+	status = smb2_util_close(tree, cr.out.file.handle);
+	torture_assert_ntstatus_ok(tctx, status, fname);
+	return true;
+}
+
+/*
+   stress testing write iops, sequential or with "random_io"
+   within a file of "file_size" bytes
+ */
+
+static bool test_smb2_bench_write_setup_loop(
+	struct test_smb2_bench_ops_loop *loop)
+{
+	return test_smb2_bench_ops_create(loop,
+					  loop->fname,
+					  NTCREATEX_DISP_CREATE,
+					  NTCREATEX_OPTIONS_DELETE_ON_CLOSE,
+					  true);
+}
+
+static void test_smb2_bench_write_done(struct tevent_req *subreq);
+
+static bool test_smb2_bench_write_start(struct test_smb2_bench_ops_loop *loop)
+{
+	struct test_smb2_bench_ops_state *state = loop->state;
+	uint64_t nblocks = MAX(state->file_size / state->io_size, 1);
+	struct tevent_req *subreq = NULL;
+	uint64_t offset;
+
+	if (state->random_io) {
+		offset = (generate_random_u64() % nblocks) * state->io_size;
+	} else {
+		offset = loop->offset;
+		loop->offset += state->io_size;
+		if (loop->offset >= nblocks * state->io_size) {
+			loop->offset = 0;
+		}
+	}
+
+	loop->op_bytes = state->io_size;
+
+	subreq = smb2cli_write_send(state->loops,
+				    state->tctx->ev,
+				    loop->conn->tree->session->transport->conn,
+				    test_smb2_bench_ops_timeout(loop),
+				    loop->conn->tree->session->smbXcli,
+				    loop->conn->tree->smbXcli,
+				    state->io_size, /* length */
+				    offset,
+				    loop->handle.data[0],/* fid_persistent */
+				    loop->handle.data[1],/* fid_volatile */
+				    0, /* remaining_bytes */
+				    0, /* flags */
+				    state->buf);
+	if (subreq == NULL) {
+		return false;
+	}
+	tevent_req_set_callback(subreq, test_smb2_bench_write_done, loop);
+	return true;
+}
+
+static void test_smb2_bench_write_done(struct tevent_req *subreq)
+{
+	struct test_smb2_bench_ops_loop *loop =
+		(struct test_smb2_bench_ops_loop *)
+		tevent_req_callback_data_void(subreq);
+	uint32_t written = 0;
+
+	loop->error = smb2cli_write_recv(subreq, &written);
+	TALLOC_FREE(subreq);
+	if (NT_STATUS_IS_OK(loop->error) &&
+	    written != loop->state->io_size) {
+		loop->error = NT_STATUS_UNEXPECTED_IO_ERROR;
+	}
+
+	test_smb2_bench_ops_loop_done(loop);
+}
+
+static const struct test_smb2_bench_ops test_smb2_bench_write_ops = {
+	.name = "write",
+	.dname = "bench_write_dir",
+	.setup_loop = test_smb2_bench_write_setup_loop,
+	.start = test_smb2_bench_write_start,
+};
+
+static bool test_smb2_bench_write(struct torture_context *tctx,
+				  struct smb2_tree *tree)
+{
+	return test_smb2_bench_ops_run(tctx, tree, &test_smb2_bench_write_ops);
+}
+
+/*
+   stress testing CREATE-QUERY_INFO-CLOSE metadata storms
+ */
+
+/* FileAllInformation */
+#define BENCH_FILE_ALL_INFORMATION 18
+
+static bool test_smb2_bench_metadata_setup_loop(
+	struct test_smb2_bench_ops_loop *loop)
+{
+	return test_smb2_bench_ops_create(loop,
+					  loop->fname,
+					  NTCREATEX_DISP_CREATE,
+					  0,
+					  false);
+}
+
+static void test_smb2_bench_metadata_done(struct tevent_req *subreq);
+
+static bool test_smb2_bench_metadata_start(
+	struct test_smb2_bench_ops_loop *loop)
+{
+	struct test_smb2_bench_ops_state *state = loop->state;
+	struct tevent_req *subreq = NULL;
+
+	subreq = smb2cli_create_send(state->loops,
+				     state->tctx->ev,
+				     loop->conn->tree->session->transport->conn,
+				     test_smb2_bench_ops_timeout(loop),
+				     loop->conn->tree->session->smbXcli,
+				     loop->conn->tree->smbXcli,
+				     loop->fname,
+				     SMB2_OPLOCK_LEVEL_NONE,
+				     SMB2_IMPERSONATION_IMPERSONATION,
+				     SEC_FILE_READ_ATTRIBUTE,
+				     0, /* file_attributes */
+				     NTCREATEX_SHARE_ACCESS_READ |
+				     NTCREATEX_SHARE_ACCESS_WRITE |
+				     NTCREATEX_SHARE_ACCESS_DELETE,
+				     NTCREATEX_DISP_OPEN,
+				     NTCREATEX_OPTIONS_NON_DIRECTORY_FILE,
+				     NULL); /* blobs */
+	if (subreq == NULL) {
+		return false;
+	}
+	tevent_req_set_callback(subreq, test_smb2_bench_metadata_done, loop);
+	return true;
+}
+
+static void test_smb2_bench_metadata_done(struct tevent_req *subreq)
+{
+	struct test_smb2_bench_ops_loop *loop =
+		(struct test_smb2_bench_ops_loop *)
+		tevent_req_callback_data_void(subreq);
+	struct test_smb2_bench_ops_state *state = loop->state;
+	TALLOC_CTX *frame = NULL;
+	DATA_BLOB out = data_blob_null;
+
+	switch (loop->phase) {
+	case 0:
+		loop->error = smb2cli_create_recv(subreq,
+						  &loop->handle.data[0],
+						  &loop->handle.data[1],
+						  NULL, NULL, NULL, NULL);
+		TALLOC_FREE(subreq);
+		if (!NT_STATUS_IS_OK(loop->error)) {
+			break;
+		}
+
+		loop->phase = 1;
+		subreq = smb2cli_query_info_send(
+			state->loops,
+			state->tctx->ev,
+			loop->conn->tree->session->transport->conn,
+			test_smb2_bench_ops_timeout(loop),
+			loop->conn->tree->session->smbXcli,
+			loop->conn->tree->smbXcli,
+			SMB2_0_INFO_FILE,
+			BENCH_FILE_ALL_INFORMATION,
+			0xFFFF, /* in_max_output_length */
+			NULL, /* in_input_buffer */
+			0, /* in_additional_info */
+			0, /* in_flags */
+			loop->handle.data[0],
+			loop->handle.data[1]);
+		if (subreq == NULL) {
+			loop->error = NT_STATUS_NO_MEMORY;
+			break;
+		}
+		tevent_req_set_callback(subreq,
+					test_smb2_bench_metadata_done,
+					loop);
+		return;
+	case 1:
+		/*
+		 * out points into the response, which is
+		 * moved to frame, so free that instead
+		 */
+		frame = talloc_stackframe();
+		loop->error = smb2cli_query_info_recv(subreq,
+						      frame,
+						      &out);
+		TALLOC_FREE(subreq);
+		loop->op_bytes = out.length;
+		TALLOC_FREE(frame);
+		if (!NT_STATUS_IS_OK(loop->error)) {
+			break;
+		}
+
+		loop->phase = 2;
+		subreq = smb2cli_close_send(
+			state->loops,
+			state->tctx->ev,
+			loop->conn->tree->session->transport->conn,
+			test_smb2_bench_ops_timeout(loop),
+			loop->conn->tree->session->smbXcli,
+			loop->conn->tree->smbXcli,
+			0, /* flags */
+			loop->handle.data[0],
+			loop->handle.data[1]);
+		if (subreq == NULL) {
+			loop->error = NT_STATUS_NO_MEMORY;
+			break;
+		}
+		tevent_req_set_callback(subreq,
+					test_smb2_bench_metadata_done,
+					loop);
+		return;
+	default:
+		loop->error = smb2cli_close_recv(subreq);
+		TALLOC_FREE(subreq);
+		break;
+	}
+
+	test_smb2_bench_ops_loop_done(loop);
+}
+
+static const struct test_smb2_bench_ops test_smb2_bench_metadata_ops = {
+	.name = "create-query-close",
+	.dname = "bench_metadata_dir",
+	.setup_loop = test_smb2_bench_metadata_setup_loop,
+	.start = test_smb2_bench_metadata_start,
+};
+
+static bool test_smb2_bench_metadata(struct torture_context *tctx,
+				     struct smb2_tree *tree)
+{
+	return test_smb2_bench_ops_run(tctx, tree,
+				       &test_smb2_bench_metadata_ops);
+}
+
+/*
+   stress testing the listing of a directory with "num_files" entries
+ */
+
+static bool test_smb2_bench_query_directory_setup(
+	struct test_smb2_bench_ops_state *state,
+	struct smb2_tree *tree)
+{
+	struct torture_context *tctx = state->tctx;
+	int i;
+
+	torture_comment(tctx, "Creating %d files\n", state->num_files);
+
+	for (i = 0; i < state->num_files; i++) {
+		struct smb2_create cr;
+		char *fname = NULL;
+		NTSTATUS status;
+
+		fname = talloc_asprintf(state, "%s\\%s_%d.dat",
+					state->ops->dname,
+					state->unique,
+					i);
+		torture_assert(tctx, fname != NULL, __location__);
+
+		ZERO_STRUCT(cr);
+		cr.in.desired_access = SEC_RIGHTS_FILE_ALL;
+		cr.in.file_attributes = FILE_ATTRIBUTE_NORMAL;
+		cr.in.share_access = NTCREATEX_SHARE_ACCESS_NONE;
+		cr.in.create_disposition = NTCREATEX_DISP_CREATE;
+		cr.in.create_options = NTCREATEX_OPTIONS_NON_DIRECTORY_FILE;
+		cr.in.impersonation_level = SMB2_IMPERSONATION_ANONYMOUS;
+		cr.in.fname = fname;
+
+		status = smb2_create(tree, state, &cr);
+		torture_assert_ntstatus_ok(tctx, status, fname);
+		status = smb2_util_close(tree, cr.out.file.handle);
+		torture_assert_ntstatus_ok(tctx, status, fname);
+		TALLOC_FREE(fname);
+	}
+
+	return true;
+}
+
+static void test_smb2_bench_query_directory_done(struct tevent_req *subreq);
+
+static bool test_smb2_bench_query_directory_start(
+	struct test_smb2_bench_ops_loop *loop)
+{
+	struct test_smb2_bench_ops_state *state = loop->state;
+	struct tevent_req *subreq = NULL;
+
+	subreq = smb2cli_create_send(state->loops,
+				     state->tctx->ev,
+				     loop->conn->tree->session->transport->conn,
+				     test_smb2_bench_ops_timeout(loop),
+				     loop->conn->tree->session->smbXcli,
+				     loop->conn->tree->smbXcli,
+				     state->ops->dname,
+				     SMB2_OPLOCK_LEVEL_NONE,
+				     SMB2_IMPERSONATION_IMPERSONATION,
+				     SEC_DIR_LIST,
+				     0, /* file_attributes */
+				     NTCREATEX_SHARE_ACCESS_READ |
+				     NTCREATEX_SHARE_ACCESS_WRITE |
+				     NTCREATEX_SHARE_ACCESS_DELETE,
+				     NTCREATEX_DISP_OPEN,
+				     NTCREATEX_OPTIONS_DIRECTORY,
+				     NULL); /* blobs */
+	if (subreq == NULL) {
+		return false;
+	}
+	tevent_req_set_callback(subreq,
+				test_smb2_bench_query_directory_done,
+				loop);
+	return true;
+}
+
+static void test_smb2_bench_query_directory_done(struct tevent_req *subreq)
+{
+	struct test_smb2_bench_ops_loop *loop =
+		(struct test_smb2_bench_ops_loop *)
+		tevent_req_callback_data_void(subreq);
+	struct test_smb2_bench_ops_state *state = loop->state;
+	TALLOC_CTX *frame = NULL;
+	uint8_t *data = NULL;
+	uint32_t data_length = 0;
+	uint8_t flags = 0;
+
+	switch (loop->phase) {
+	case 0:
+		loop->error = smb2cli_create_recv(subreq,
+						  &loop->handle.data[0],
+						  &loop->handle.data[1],
+						  NULL, NULL, NULL, NULL);
+		TALLOC_FREE(subreq);
+		if (!NT_STATUS_IS_OK(loop->error)) {
+			break;
+		}
+		loop->phase = 1;
+		flags = SMB2_CONTINUE_FLAG_RESTART;
+		break;
+	case 1:
+		/*
+		 * data points into the response, which is
+		 * moved to frame, so free that instead
+		 */
+		frame = talloc_stackframe();
+		loop->error = smb2cli_query_directory_recv(subreq,
+							   frame,
+							   &data,
+							   &data_length);
+		TALLOC_FREE(subreq);
+		TALLOC_FREE(frame);
+		if (NT_STATUS_EQUAL(loop->error, STATUS_NO_MORE_FILES)) {
+			loop->error = NT_STATUS_OK;
+			loop->phase = 2;
+			break;
+		}
+		if (!NT_STATUS_IS_OK(loop->error)) {
+			break;
+		}
+		loop->op_bytes += data_length;
+		break;
+	default:
+		loop->error = smb2cli_close_recv(subreq);
+		TALLOC_FREE(subreq);
+		test_smb2_bench_ops_loop_done(loop);
+		return;
+	}
+
+	if (!NT_STATUS_IS_OK(loop->error)) {
+		test_smb2_bench_ops_loop_done(loop);
+		return;
+	}
+
+	if (loop->phase == 1) {
+		subreq = smb2cli_query_directory_send(
+			state->loops,
+			state->tctx->ev,
+			loop->conn->tree->session->transport->conn,
+			test_smb2_bench_ops_timeout(loop),
+			loop->conn->tree->session->smbXcli,
+			loop->conn->tree->smbXcli,
+			SMB2_FIND_ID_BOTH_DIRECTORY_INFO,
+			flags,
+			0, /* file_index */
+			loop->handle.data[0],
+			loop->handle.data[1],
+			"*",
+			0x10000); /* outbuf_len */
+	} else {
+		subreq = smb2cli_close_send(
+			state->loops,
+			state->tctx->ev,
+			loop->conn->tree->session->transport->conn,
+			test_smb2_bench_ops_timeout(loop),
+			loop->conn->tree->session->smbXcli,
+			loop->conn->tree->smbXcli,
+			0, /* flags */
+			loop->handle.data[0],
+			loop->handle.data[1]);
+	}
+	if (subreq == NULL) {
+		loop->error = NT_STATUS_NO_MEMORY;
+		test_smb2_bench_ops_loop_done(loop);
+		return;
+	}
+	tevent_req_set_callback(subreq,
+				test_smb2_bench_query_directory_done,
+				loop);
+}
+
+static const struct test_smb2_bench_ops test_smb2_bench_query_directory_ops = {
+	.name = "query-directory",
+	.dname = "bench_query_directory_dir",
+	.setup = test_smb2_bench_query_directory_setup,
+	.start = test_smb2_bench_query_directory_start,
+};
+
+static bool test_smb2_bench_query_directory(struct torture_context *tctx,
+					    struct smb2_tree *tree)
+{
+	return test_smb2_bench_ops_run(tctx, tree,
+				       &test_smb2_bench_query_directory_ops);
+}
+
+/*
+   stress testing byte range lock churn, all loops lock
+   and unlock their own range of the same file
+ */
+
+static bool test_smb2_bench_lock_setup_loop(
+	struct test_smb2_bench_ops_loop *loop)
+{
+	struct test_smb2_bench_ops_state *state = loop->state;
+	const char *fname = NULL;
+
+	fname = talloc_asprintf(state->loops, "%s\\%s_lock.dat",
+				state->ops->dname, state->unique);
+	if (fname == NULL) {
+		return false;
+	}
+
+	return test_smb2_bench_ops_create(loop,
+					  fname,
+					  NTCREATEX_DISP_OPEN_IF,
+					  0,
+					  true);
+}
+
+static void test_smb2_bench_lock_done(struct smb2_request *req);
+
+static bool test_smb2_bench_lock_send(struct test_smb2_bench_ops_loop *loop,
+				      uint32_t flags)
+{
+	struct smb2_request *req = NULL;
+
+	loop->el = (struct smb2_lock_element) {
+		.offset = loop->idx * 8,
+		.length = 8,
+		.flags = flags,
+	};
+	loop->lck = (struct smb2_lock) {
+		.in.file.handle = loop->handle,
+		.in.lock_count = 1,
+		.in.locks = &loop->el,
+	};
+
+	req = smb2_lock_send(loop->conn->tree, &loop->lck);
+	if (req == NULL) {
+		return false;
+	}
+	req->async.fn = test_smb2_bench_lock_done;
+	req->async.private_data = loop;
+	return true;
+}
+
+static bool test_smb2_bench_lock_start(struct test_smb2_bench_ops_loop *loop)
+{
+	return test_smb2_bench_lock_send(loop,
+					 SMB2_LOCK_FLAG_EXCLUSIVE |
+					 SMB2_LOCK_FLAG_FAIL_IMMEDIATELY);
+}
+
+static void test_smb2_bench_lock_done(struct smb2_request *req)
+{
+	struct test_smb2_bench_ops_loop *loop =
+		(struct test_smb2_bench_ops_loop *)
+		req->async.private_data;
+	bool ok;
+
+	loop->error = smb2_lock_recv(req, &loop->lck);
+	if (NT_STATUS_IS_OK(loop->error) && loop->phase == 0) {
+		loop->phase = 1;
+		ok = test_smb2_bench_lock_send(loop, SMB2_LOCK_FLAG_UNLOCK);
+		if (ok) {
+			return;
+		}
+		loop->error = NT_STATUS_NO_MEMORY;
+	}
+
+	test_smb2_bench_ops_loop_done(loop);
+}
+
+static const struct test_smb2_bench_ops test_smb2_bench_lock_ops = {
+	.name = "byte-range-lock",
+	.dname = "bench_lock_dir",
+	.setup_loop = test_smb2_bench_lock_setup_loop,
+	.start = test_smb2_bench_lock_start,
+};
+
+static bool test_smb2_bench_lock(struct torture_context *tctx,
+				 struct smb2_tree *tree)
+{
+	return test_smb2_bench_ops_run(tctx, tree, &test_smb2_bench_lock_ops);
+}
+
 struct torture_suite *torture_smb2_bench_init(TALLOC_CTX *ctx)
 {
 	struct torture_suite *suite = torture_suite_create(ctx, "bench");
@@ -1878,6 +3243,11 @@ struct torture_suite *torture_smb2_bench_init(TALLOC_CTX *ctx)
 	torture_suite_add_1smb2_test(suite, "path-contention-shared", test_smb2_bench_path_contention_shared);
 	torture_suite_add_1smb2_test(suite, "read", test_smb2_bench_read);
 	torture_suite_add_1smb2_test(suite, "session-setup", test_smb2_bench_session_setup);
+	torture_suite_add_1smb2_test(suite, "stream-listing", test_smb2_bench_stream_listing);
+	torture_suite_add_1smb2_test(suite, "write", test_smb2_bench_write);
+	torture_suite_add_1smb2_test(suite, "create-query-close", test_smb2_bench_metadata);
+	torture_suite_add_1smb2_test(suite, "query-directory", test_smb2_bench_query_directory);
+	torture_suite_add_1smb2_test(suite, "byte-range-lock", test_smb2_bench_lock);
 
 	suite->description = talloc_strdup(suite, "SMB2-BENCH tests");
 
@@ -0,0 +1,517 @@
+/*
+   Unix SMB/CIFS implementation.
+
+   test suite for SMB3 compression
+
+   This program is free software; you can redistribute it and/or modify
+   it under the terms of the GNU General Public License as published by
+   the Free Software Foundation; either version 3 of the License, or
+   (at your option) any later version.
+
+   This program is distributed in the hope that it will be useful,
+   but WITHOUT ANY WARRANTY; without even the implied warranty of
+   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+   GNU General Public License for more details.
+
+   You should have received a copy of the GNU General Public License
+   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "includes.h"
+#include "libcli/smb2/smb2.h"
+#include "libcli/smb2/smb2_calls.h"
+#include "torture/torture.h"
+#include "torture/smb2/proto.h"
+#include "../libcli/smb/smbXcli_base.h"
+#include "libcli/smb/smb2_negotiate_context.h"
+
+#define FNAME "smb2_compression.dat"
+
+/*
+ * Large enough to be above the default
+ * "smb3 compression threshold" of the server.
+ */
+#define TEST_DATA_SIZE (64 * 1024)
+
+static void test_compression_fill(uint8_t *buf, size_t len, bool pattern)
+{
+	static const char text[] = "SMB3 compression test data ";
+	size_t i;
+
+	if (pattern) {
+		memset(buf, 0xaa, len);
+		return;
+	}
+
+	for (i = 0; i < len; i++) {
+		buf[i] = text[(i / 3) % (sizeof(text) - 1)];
+	}
+}
+
+static bool test_compression_connect(struct torture_context *tctx,
+				     struct smb2_tree *tree0,
+				     const struct smb3_compression_capabilities *caps,
+				     struct smb2_tree **_tree)
+{
+	struct smbcli_options options = tree0->session->transport->options;
+	struct smb2_tree *tree = NULL;
+	bool ok;
+
+	options.min_protocol = PROTOCOL_SMB3_11;
+	options.max_protocol = PROTOCOL_SMB3_11;
+	options.smb3_capabilities.compression = *caps;
+
+	ok = torture_smb2_connection_ext(tctx, 0, &options, &tree);
+	torture_assert(tctx, ok, "torture_smb2_connection_ext failed\n");
+
+	*_tree = tree;
+	return true;
+}
+
+/*
+ * Write compressible data to a share with "smb3 compression = yes",
+ * the client compresses the WRITE request, the server compresses
+ * the READ response.
+ */
+static bool test_compression_write_read(struct torture_context *tctx,
+					struct smb2_tree *tree0,
+					const struct smb3_compression_capabilities *caps,
+					bool pattern)
+{
+	TALLOC_CTX *mem_ctx = talloc_new(tctx);
+	struct smb2_tree *tree = NULL;
+	struct smbXcli_conn *conn = NULL;
+	const struct smb3_compression_capabilities *n = NULL;
+	struct smb2_handle h = {{0}};
+	struct smb2_read rd;
+	uint8_t *buf = NULL;
+	uint64_t compressed;
+	uint64_t decompressed;
+	NTSTATUS status;
+	bool ret = true;
+
+	if (smbXcli_conn_protocol(tree0->session->transport->conn) <
+	    PROTOCOL_SMB3_11)
+	{
+		torture_skip(tctx, "SMB 3.1.1 not supported\n");
+	}
+
+	smb2_util_unlink(tree0, FNAME);
+
+	ret = test_compression_connect(tctx, tree0, caps, &tree);
+	torture_assert_goto(tctx, ret, ret, done, "connect failed\n");
+	conn = tree->session->transport->conn;
+
+	n = smb2cli_conn_server_compression(conn);
+	torture_assert_int_equal_goto(tctx, n->num_algos, caps->num_algos,
+				      ret, done,
+				      "compression not negotiated\n");
+	torture_assert_goto(tctx, n->chained == caps->chained, ret, done,
+			    "unexpected chained compression\n");
+
+	torture_assert_goto(tctx,
+			    smb2cli_tcon_flags(tree->smbXcli) &
+			    SMB2_SHAREFLAG_COMPRESS_DATA,
+			    ret, done,
+			    "share doesn't have SMB2_SHAREFLAG_COMPRESS_DATA\n");
+
+	buf = talloc_array(mem_ctx, uint8_t, TEST_DATA_SIZE);
+	torture_assert_goto(tctx, buf != NULL, ret, done, "talloc failed\n");
+	test_compression_fill(buf, TEST_DATA_SIZE, pattern);
+
+	status = torture_smb2_testfile(tree, FNAME, &h);
+	torture_assert_ntstatus_ok_goto(tctx, status, ret, done,
+					"torture_smb2_testfile failed\n");
+
+	compressed = smb2cli_conn_compressed_requests(conn);
+	decompressed = smb2cli_conn_decompressed_responses(conn);
+
+	status = smb2_util_write(tree, h, buf, 0, TEST_DATA_SIZE);
+	torture_assert_ntstatus_ok_goto(tctx, status, ret, done,
+					"smb2_util_write failed\n");
+	torture_assert_goto(tctx,
+			    smb2cli_conn_compressed_requests(conn) > compressed,
+			    ret, done,
+			    "WRITE request was not compressed\n");
+
+	rd = (struct smb2_read) {
+		.in.file.handle = h,
+		.in.length = TEST_DATA_SIZE,
+		.in.offset = 0,
+	};
+	status = smb2_read(tree, mem_ctx, &rd);
+	torture_assert_ntstatus_ok_goto(tctx, status, ret, done,
+					"smb2_read failed\n");
+	torture_assert_int_equal_goto(tctx, rd.out.data.length,
+				      TEST_DATA_SIZE, ret, done,
+				      "short read\n");
+	torture_assert_mem_equal_goto(tctx, rd.out.data.data, buf,
+				      TEST_DATA_SIZE, ret, done,
+				      "data mismatch\n");
+	torture_assert_goto(tctx,
+			    smb2cli_conn_decompressed_responses(conn) >
+			    decompressed,
+			    ret, done,
+			    "READ response was not compressed\n");
+
+done:
+	if (tree != NULL) {
+		if (!smb2_util_handle_empty(h)) {
+			smb2_util_close(tree, h);
+		}
+		TALLOC_FREE(tree);
+	}
+	smb2_util_unlink(tree0, FNAME);
+	talloc_free(mem_ctx);
+	return ret;
+}
+
+static bool test_compression_lz77(struct torture_context *tctx,
+				  struct smb2_tree *tree0)
+{
+	const struct smb3_compression_capabilities caps = {
+		.num_algos = 1,
+		.algos = { SMB2_COMPRESSION_LZ77, },
+	};
+
+	return test_compression_write_read(tctx, tree0, &caps, false);
+}
+
+static bool test_compression_lz77_chained(struct torture_context *tctx,
+					  struct smb2_tree *tree0)
+{
+	const struct smb3_compression_capabilities caps = {
+		.num_algos = 1,
+		.algos = { SMB2_COMPRESSION_LZ77, },
+		.chained = true,
+	};
+
+	return test_compression_write_read(tctx, tree0, &caps, false);
+}
+
+static bool test_compression_lz77_huffman(struct torture_context *tctx,
+					  struct smb2_tree *tree0)
+{
+	const struct smb3_compression_capabilities caps = {
+		.num_algos = 1,
+		.algos = { SMB2_COMPRESSION_LZ77_HUFFMAN, },
+	};
+
+	return test_compression_write_read(tctx, tree0, &caps, false);
+}
+
+static bool test_compression_lz77_huffman_chained(struct torture_context *tctx,
+						  struct smb2_tree *tree0)
+{
+	const struct smb3_compression_capabilities caps = {
+		.num_algos = 1,
+		.algos = { SMB2_COMPRESSION_LZ77_HUFFMAN, },
+		.chained = true,
+	};
+
+	return test_compression_write_read(tctx, tree0, &caps, false);
+}
+
+static bool test_compression_pattern_v1(struct torture_context *tctx,
+					struct smb2_tree *tree0)
+{
+	const struct smb3_compression_capabilities caps = {
+		.num_algos = 2,
+		.algos = {
+			SMB2_COMPRESSION_PATTERN_V1,
+			SMB2_COMPRESSION_LZ77,
+		},
+		.chained = true,
+	};
+
+	return test_compression_write_read(tctx, tree0, &caps, true);
+}
+
+/*
+ * Pattern_V1 is only valid with chained compression and the
+ * server returns its own preference order.
+ */
+static bool test_compression_negotiate(struct torture_context *tctx,
+				       struct smb2_tree *tree0)
+{
+	const struct smb3_compression_capabilities unchained = {
+		.num_algos = 2,
+		.algos = {
+			SMB2_COMPRESSION_PATTERN_V1,
+			SMB2_COMPRESSION_LZ77,
+		},
+	};
+	const struct smb3_compression_capabilities pattern_only = {
+		.num_algos = 1,
+		.algos = { SMB2_COMPRESSION_PATTERN_V1, },
+	};
+	const struct smb3_compression_capabilities chained = {
+		.num_algos = 2,
+		.algos = {
+			SMB2_COMPRESSION_LZ77,
+			SMB2_COMPRESSION_LZ77_HUFFMAN,
+		},
+		.chained = true,
+	};
+	const struct smb3_compression_capabilities *n = NULL;
+	struct smb2_tree *tree = NULL;
+	bool ret = true;
+
+	if (smbXcli_conn_protocol(tree0->session->transport->conn) <
+	    PROTOCOL_SMB3_11)
+	{
+		torture_skip(tctx, "SMB 3.1.1 not supported\n");
+	}
+
+	ret = test_compression_connect(tctx, tree0, &unchained, &tree);
+	torture_assert_goto(tctx, ret, ret, done, "connect failed\n");
+	n = smb2cli_conn_server_compression(tree->session->transport->conn);
+	torture_assert_int_equal_goto(tctx, n->num_algos, 1, ret, done,
+				      "Pattern_V1 negotiated unchained\n");
+	torture_assert_int_equal_goto(tctx, n->algos[0],
+				      SMB2_COMPRESSION_LZ77, ret, done,
+				      "LZ77 not negotiated\n");
+	torture_assert_goto(tctx, !n->chained, ret, done,
+			    "chained not requested\n");
+	TALLOC_FREE(tree);
+
+	ret = test_compression_connect(tctx, tree0, &pattern_only, &tree);
+	torture_assert_goto(tctx, ret, ret, done, "connect failed\n");
+	n = smb2cli_conn_server_compression(tree->session->transport->conn);
+	torture_assert_int_equal_goto(tctx, n->num_algos, 0, ret, done,
+				      "Pattern_V1 negotiated unchained\n");
+	TALLOC_FREE(tree);
+
+	ret = test_compression_connect(tctx, tree0, &chained, &tree);
+	torture_assert_goto(tctx, ret, ret, done, "connect failed\n");
+	n = smb2cli_conn_server_compression(tree->session->transport->conn);
+	torture_assert_int_equal_goto(tctx, n->num_algos, 2, ret, done,
+				      "unexpected number of algorithms\n");
+	torture_assert_int_equal_goto(tctx, n->algos[0],
+				      SMB2_COMPRESSION_LZ77_HUFFMAN, ret, done,
+				      "server order not used\n");
+	torture_assert_int_equal_goto(tctx, n->algos[1],
+				      SMB2_COMPRESSION_LZ77, ret, done,
+				      "server order not used\n");
+	torture_assert_goto(tctx, n->chained, ret, done,
+			    "chained not negotiated\n");
+
+done:
+	TALLOC_FREE(tree);
+	return ret;
+}
+
+static void mangle_original_size_max(uint8_t *buf, size_t buflen)
+{
+	SIVAL(buf, SMB2_COMP_TF_ORIGINAL_SIZE, UINT32_MAX);
+}
+
+static void mangle_original_size_inc(uint8_t *buf, size_t buflen)
+{
+	uint32_t v = IVAL(buf, SMB2_COMP_TF_ORIGINAL_SIZE);
+
+	SIVAL(buf, SMB2_COMP_TF_ORIGINAL_SIZE, v + 1);
+}
+
+static void mangle_original_size_dec(uint8_t *buf, size_t buflen)
+{
+	uint32_t v = IVAL(buf, SMB2_COMP_TF_ORIGINAL_SIZE);
+
+	SIVAL(buf, SMB2_COMP_TF_ORIGINAL_SIZE, v - 1);
+}
+
+static void mangle_offset_max(uint8_t *buf, size_t buflen)
+{
+	SIVAL(buf, SMB2_COMP_TF_OFFSET, UINT32_MAX);
+}
+
+static void mangle_offset_past_end(uint8_t *buf, size_t buflen)
+{
+	SIVAL(buf, SMB2_COMP_TF_OFFSET, buflen - SMB2_COMP_TF_HDR_SIZE + 1);
+}
+
+/*
+ * In a chained message SMB2_COMP_TF_OFFSET is
+ * the Length of the first payload.
+ */
+static void mangle_payload_length_past_end(uint8_t *buf, size_t buflen)
+{
+	SIVAL(buf, SMB2_COMP_TF_OFFSET, buflen);
+}
+
+struct test_compression_mangle {
+	const char *name;
+	bool chained;
+	void (*fn)(uint8_t *buf, size_t buflen);
+	bool called;
+};
+
+static void test_compression_hook(uint8_t *buf,
+				  size_t buflen,
+				  void *private_data)
+{
+	struct test_compression_mangle *m =
+		(struct test_compression_mangle *)private_data;
+
+	m->fn(buf, buflen);
+	m->called = true;
+}
+
+static bool test_compression_malformed_one(struct torture_context *tctx,
+					   struct smb2_tree *tree0,
+					   struct test_compression_mangle *m,
+					   const uint8_t *buf)
+{
+	const struct smb3_compression_capabilities caps = {
+		.num_algos = 1,
+		.algos = { SMB2_COMPRESSION_LZ77, },
+		.chained = m->chained,
+	};
+	struct smb2_tree *tree = NULL;
+	struct smbXcli_conn *conn = NULL;
+	struct smb2_handle h = {{0}};
+	uint64_t compressed;
+	NTSTATUS status;
+	bool ret = true;
+
+	torture_comment(tctx, "%s %s\n",
+			m->chained ? "chained" : "unchained", m->name);
+
+	ret = test_compression_connect(tctx, tree0, &caps, &tree);
+	torture_assert_goto(tctx, ret, ret, done, "connect failed\n");
+	conn = tree->session->transport->conn;
+
+	status = torture_smb2_testfile(tree, FNAME, &h);
+	torture_assert_ntstatus_ok_goto(tctx, status, ret, done,
+					"torture_smb2_testfile failed\n");
+
+	/*
+	 * Make sure the server accepts the
+	 * message before we break it.
+	 */
+	compressed = smb2cli_conn_compressed_requests(conn);
+	status = smb2_util_write(tree, h, buf, 0, TEST_DATA_SIZE);
+	torture_assert_ntstatus_ok_goto(tctx, status, ret, done,
+					"smb2_util_write failed\n");
+	torture_assert_goto(tctx,
+			    smb2cli_conn_compressed_requests(conn) > compressed,
+			    ret, done,
+			    "WRITE request was not compressed\n");
+
+	m->called = false;
+	smb2cli_conn_torture_compression_hook(conn, test_compression_hook, m);
+
+	status = smb2_util_write(tree, h, buf, 0, TEST_DATA_SIZE);
+	torture_assert_goto(tctx, m->called, ret, done,
+			    "WRITE request was not compressed\n");
+	torture_assert_goto(tctx, !NT_STATUS_IS_OK(status), ret, done,
+			    "malformed WRITE request succeeded\n");
+	torture_assert_goto(tctx, !smbXcli_conn_is_connected(conn), ret, done,
+			    "server didn't disconnect\n");
+
+done:
+	if (tree != NULL) {
+		if (conn != NULL) {
+			smb2cli_conn_torture_compression_hook(conn, NULL, NULL);
+		}
+		if (smbXcli_conn_is_connected(conn) &&
+		    !smb2_util_handle_empty(h))
+		{
+			smb2_util_close(tree, h);
+		}
+		TALLOC_FREE(tree);
+	}
+	return ret;
+}
+
+/*
+ * The server has to reject compressed messages
+ * with invalid OriginalSize, Offset or Length
+ * values without crashing.
+ */
+static bool test_compression_malformed(struct torture_context *tctx,
+				       struct smb2_tree *tree0)
+{
+	struct test_compression_mangle tests[] = {
+		{
+			.name = "OriginalSize 0xFFFFFFFF",
+			.fn = mangle_original_size_max,
+		},{
+			.name = "OriginalSize + 1",
+			.fn = mangle_original_size_inc,
+		},{
+			.name = "OriginalSize - 1",
+			.fn = mangle_original_size_dec,
+		},{
+			.name = "Offset 0xFFFFFFFF",
+			.fn = mangle_offset_max,
+		},{
+			.name = "Offset past the end",
+			.fn = mangle_offset_past_end,
+		},{
+			.name = "OriginalSize + 1",
+			.chained = true,
+			.fn = mangle_original_size_inc,
+		},{
+			.name = "OriginalSize - 1",
+			.chained = true,
+			.fn = mangle_original_size_dec,
+		},{
+			.name = "payload Length past the end",
+			.chained = true,
+			.fn = mangle_payload_length_past_end,
+		},
+	};
+	uint8_t *buf = NULL;
+	size_t i;
+	bool ret = true;
+
+	if (smbXcli_conn_protocol(tree0->session->transport->conn) <
+	    PROTOCOL_SMB3_11)
+	{
+		torture_skip(tctx, "SMB 3.1.1 not supported\n");
+	}
+
+	smb2_util_unlink(tree0, FNAME);
+
+	buf = talloc_array(tctx, uint8_t, TEST_DATA_SIZE);
+	torture_assert(tctx, buf != NULL, "talloc failed\n");
+	test_compression_fill(buf, TEST_DATA_SIZE, false);
+
+	for (i = 0; i < ARRAY_SIZE(tests); i++) {
+		ret = test_compression_malformed_one(tctx, tree0,
+						     &tests[i], buf);
+		if (!ret) {
+			break;
+		}
+	}
+
+	smb2_util_unlink(tree0, FNAME);
+	TALLOC_FREE(buf);
+	return ret;
+}
+
+struct torture_suite *torture_smb2_compression_init(TALLOC_CTX *ctx)
+{
+	struct torture_suite *suite =
+		torture_suite_create(ctx, "compression");
+
+	torture_suite_add_1smb2_test(suite, "lz77",
+				     test_compression_lz77);
+	torture_suite_add_1smb2_test(suite, "lz77_chained",
+				     test_compression_lz77_chained);
+	torture_suite_add_1smb2_test(suite, "lz77_huffman",
+				     test_compression_lz77_huffman);
+	torture_suite_add_1smb2_test(suite, "lz77_huffman_chained",
+				     test_compression_lz77_huffman_chained);
+	torture_suite_add_1smb2_test(suite, "pattern_v1",
+				     test_compression_pattern_v1);
+	torture_suite_add_1smb2_test(suite, "negotiate",
+				     test_compression_negotiate);
+	torture_suite_add_1smb2_test(suite, "malformed",
+				     test_compression_malformed);
+
+	suite->description = talloc_strdup(suite, "SMB3 compression tests");
+
+	return suite;
+}
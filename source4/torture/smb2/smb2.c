@@ -159,6 +159,7 @@ NTSTATUS torture_smb2_init(TALLOC_CTX *ctx)
 	torture_suite_add_suite(suite, torture_smb2_fileid_init(suite));
 	torture_suite_add_suite(suite, torture_smb2_acls_init(suite));
 	torture_suite_add_suite(suite, torture_smb2_acls_non_canonical_init(suite));
+	torture_suite_add_suite(suite, torture_smb2_acls_access_check_cache_init(suite));
 	torture_suite_add_suite(suite, torture_smb2_notify_init(suite));
 	torture_suite_add_suite(suite, torture_smb2_notify_inotify_init(suite));
 	torture_suite_add_suite(suite,
@@ -204,6 +205,7 @@ NTSTATUS torture_smb2_init(TALLOC_CTX *ctx)
 	torture_suite_add_simple_test(suite, "check-sharemode",
 				      torture_smb2_check_sharemode);
 	torture_suite_add_suite(suite, torture_smb2_crediting_init(suite));
+	torture_suite_add_suite(suite, torture_smb2_compression_init(suite));
 
 	torture_suite_add_suite(suite, torture_smb2_doc_init(suite));
 	torture_suite_add_suite(suite, torture_smb2_multichannel_init(suite));
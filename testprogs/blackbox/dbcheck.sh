@@ -45,6 +45,11 @@ dbcheck_reset_well_known_acls()
 	$PYTHON $BINDIR/samba-tool dbcheck --cross-ncs --reset-well-known-acls $ARGS
 }
 
+dbcheck_jobs()
+{
+	$PYTHON $BINDIR/samba-tool dbcheck --cross-ncs --jobs=3 $ARGS
+}
+
 reindex()
 {
 	$PYTHON $BINDIR/samba-tool dbcheck --reindex $ARGS
@@ -64,6 +69,7 @@ dbcheck_fix_one_way_links
 dbcheck_fix_stale_links
 dbcheck_fix_crosspartition_backlinks
 testit "dbcheck" dbcheck || failed=$(expr $failed + 1)
+testit "dbcheck_jobs" dbcheck_jobs || failed=$(expr $failed + 1)
 testit "reindex" reindex || failed=$(expr $failed + 1)
 testit "fixed_attrs" fixed_attrs || failed=$(expr $failed + 1)
 testit "force_modules" force_modules || failed=$(expr $failed + 1)